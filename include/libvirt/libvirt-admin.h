@@ -213,6 +213,63 @@ virAdmServerPtr virAdmConnectLookupServer(virAdmConnectPtr conn,
 
 # define VIR_THREADPOOL_JOB_QUEUE_DEPTH "jobQueueDepth"
 
+/**
+ * VIR_THREADPOOL_JOB_QUEUES:
+ * Macro for the threadpool jobQueues attribute: represents the number of
+ * separate job queues ordinary workers are spread over, as
+ * VIR_TYPED_PARAM_UINT. Zero means all workers share a single queue. With
+ * multiple queues, each worker prefers jobs from its own queue and steals
+ * jobs from the other queues when idle, which reduces contention between
+ * workers on servers with many of them. Priority workers always use a
+ * dedicated shared queue.
+ *
+ * Since: 8.5.0
+ */
+
+# define VIR_THREADPOOL_JOB_QUEUES "jobQueues"
+
+/**
+ * VIR_THREADPOOL_WORKERS_IDLE_TIMEOUT:
+ * Macro for the threadpool idleTimeout attribute: represents the number of
+ * seconds after which an idle ordinary worker exits, as long as there are
+ * more than VIR_THREADPOOL_WORKERS_MIN workers, as VIR_TYPED_PARAM_UINT.
+ * Zero, the default, keeps idle workers around forever. New workers are
+ * started on demand up to VIR_THREADPOOL_WORKERS_MAX whenever jobs queue
+ * up faster than the free workers take them.
+ *
+ * Since: 8.5.0
+ */
+
+# define VIR_THREADPOOL_WORKERS_IDLE_TIMEOUT "idleTimeout"
+
+/**
+ * VIR_THREADPOOL_WORKERS_SPAWNED:
+ * Macro for the threadpool spawnedWorkers attribute: represents the number
+ * of ordinary workers started since the threadpool was created, as
+ * VIR_TYPED_PARAM_ULLONG.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ *
+ * Since: 8.5.0
+ */
+
+# define VIR_THREADPOOL_WORKERS_SPAWNED "spawnedWorkers"
+
+/**
+ * VIR_THREADPOOL_WORKERS_RETIRED:
+ * Macro for the threadpool retiredWorkers attribute: represents the number
+ * of ordinary workers which exited after being idle for longer than
+ * VIR_THREADPOOL_WORKERS_IDLE_TIMEOUT, as VIR_TYPED_PARAM_ULLONG.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ *
+ * Since: 8.5.0
+ */
+
+# define VIR_THREADPOOL_WORKERS_RETIRED "retiredWorkers"
+
 /* Tunables for a server workerpool */
 int virAdmServerGetThreadPoolParameters(virAdmServerPtr srv,
                                         virTypedParameterPtr *params,
@@ -394,6 +451,112 @@ virAdmServerLookupClient(virAdmServerPtr srv,
 
 # define VIR_CLIENT_INFO_SELINUX_CONTEXT "selinux_context"
 
+/**
+ * VIR_CLIENT_INFO_CALLS:
+ * Macro represents the number of calls the client has made so far, as
+ * VIR_TYPED_PARAM_ULLONG.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ *
+ * Since: 8.5.0
+ */
+
+# define VIR_CLIENT_INFO_CALLS "calls"
+
+/**
+ * VIR_CLIENT_INFO_CPU_TIME:
+ * Macro represents the CPU time spent by the daemon's workers processing the
+ * client's calls so far, in microseconds, as VIR_TYPED_PARAM_ULLONG.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ *
+ * Since: 8.5.0
+ */
+
+# define VIR_CLIENT_INFO_CPU_TIME "cpu_time"
+
+/**
+ * VIR_CLIENT_INFO_BYTES_IN:
+ * Macro represents the number of bytes received from the client so far, as
+ * VIR_TYPED_PARAM_ULLONG.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ *
+ * Since: 8.5.0
+ */
+
+# define VIR_CLIENT_INFO_BYTES_IN "bytes_in"
+
+/**
+ * VIR_CLIENT_INFO_BYTES_OUT:
+ * Macro represents the number of bytes sent to the client so far, as
+ * VIR_TYPED_PARAM_ULLONG.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ *
+ * Since: 8.5.0
+ */
+
+# define VIR_CLIENT_INFO_BYTES_OUT "bytes_out"
+
+/**
+ * VIR_CLIENT_INFO_REQUESTS:
+ * Macro represents the number of the client's calls currently being processed
+ * or waiting for their reply to be sent, as VIR_TYPED_PARAM_UINT.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ *
+ * Since: 8.5.0
+ */
+
+# define VIR_CLIENT_INFO_REQUESTS "requests"
+
+/**
+ * VIR_CLIENT_INFO_REQUESTS_MAX:
+ * Macro represents the maximum number of calls the client may have in
+ * progress at a time, as VIR_TYPED_PARAM_UINT. Further calls are not read
+ * from the client until some of them finish. The limit is set by the
+ * max_client_requests setting of the daemon.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ *
+ * Since: 8.5.0
+ */
+
+# define VIR_CLIENT_INFO_REQUESTS_MAX "requests_max"
+
+/**
+ * VIR_CLIENT_INFO_TX_QUEUED:
+ * Macro represents the number of messages waiting to be sent to the client,
+ * including events, as VIR_TYPED_PARAM_UINT.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ *
+ * Since: 8.5.0
+ */
+
+# define VIR_CLIENT_INFO_TX_QUEUED "tx_queued"
+
+/**
+ * VIR_CLIENT_INFO_BUFFER_BYTES:
+ * Macro represents the memory in bytes used by the messages being received
+ * from the client and waiting to be sent to it, as VIR_TYPED_PARAM_ULLONG.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ *
+ * Since: 8.5.0
+ */
+
+# define VIR_CLIENT_INFO_BUFFER_BYTES "buffer_bytes"
+
 int virAdmClientGetInfo(virAdmClientPtr client,
                         virTypedParameterPtr *params,
                         int *nparams,
@@ -464,6 +627,226 @@ int virAdmServerSetClientLimits(virAdmServerPtr srv,
 int virAdmServerUpdateTlsFiles(virAdmServerPtr srv,
                                unsigned int flags);
 
+/* Server statistics */
+
+/**
+ * VIR_SERVER_STATS_MSGBUF_HITS:
+ * Macro for the number of RPC message buffer allocations served from the
+ * daemon's message buffer pool, as VIR_TYPED_PARAM_ULLONG. The pool is
+ * shared by all servers of the daemon.
+ *
+ * Since: 8.5.0
+ */
+
+# define VIR_SERVER_STATS_MSGBUF_HITS "msgbuf.hits"
+
+/**
+ * VIR_SERVER_STATS_MSGBUF_MISSES:
+ * Macro for the number of RPC message buffer allocations which could not be
+ * served from the daemon's message buffer pool, as VIR_TYPED_PARAM_ULLONG.
+ *
+ * Since: 8.5.0
+ */
+
+# define VIR_SERVER_STATS_MSGBUF_MISSES "msgbuf.misses"
+
+/**
+ * VIR_SERVER_STATS_MSGBUF_CACHED:
+ * Macro for the number of unused RPC message buffers currently kept in the
+ * daemon's message buffer pool, as VIR_TYPED_PARAM_ULLONG.
+ *
+ * Since: 8.5.0
+ */
+
+# define VIR_SERVER_STATS_MSGBUF_CACHED "msgbuf.cached"
+
+/**
+ * VIR_SERVER_STATS_MSGBUF_CACHED_BYTES:
+ * Macro for the size in bytes of unused RPC message buffers currently kept
+ * in the daemon's message buffer pool, as VIR_TYPED_PARAM_ULLONG.
+ *
+ * Since: 8.5.0
+ */
+
+# define VIR_SERVER_STATS_MSGBUF_CACHED_BYTES "msgbuf.cached_bytes"
+
+/**
+ * VIR_SERVER_STATS_CLIENTS_TX_QUEUED:
+ * Macro for the number of messages waiting to be sent to all clients of
+ * the server, as VIR_TYPED_PARAM_ULLONG.
+ *
+ * Since: 8.5.0
+ */
+
+# define VIR_SERVER_STATS_CLIENTS_TX_QUEUED "clients.tx_queued"
+
+/**
+ * VIR_SERVER_STATS_CLIENTS_BUFFER_BYTES:
+ * Macro for the memory in bytes used by the messages being received from
+ * and waiting to be sent to all clients of the server, as
+ * VIR_TYPED_PARAM_ULLONG.
+ *
+ * Since: 8.5.0
+ */
+
+# define VIR_SERVER_STATS_CLIENTS_BUFFER_BYTES "clients.buffer_bytes"
+
+/**
+ * VIR_SERVER_STATS_EVENT_ITERATIONS:
+ * Macro for the number of iterations of the daemon's event loop, as
+ * VIR_TYPED_PARAM_ULLONG. The event loop is shared by all servers of the
+ * daemon, as are all the other event loop statistics.
+ *
+ * Since: 8.5.0
+ */
+
+# define VIR_SERVER_STATS_EVENT_ITERATIONS "event.iterations"
+
+/**
+ * VIR_SERVER_STATS_EVENT_HANDLE_DISPATCHES:
+ * Macro for the number of times a file handle watched by the event loop
+ * was dispatched, as VIR_TYPED_PARAM_ULLONG.
+ *
+ * Since: 8.5.0
+ */
+
+# define VIR_SERVER_STATS_EVENT_HANDLE_DISPATCHES "event.handle_dispatches"
+
+/**
+ * VIR_SERVER_STATS_EVENT_TIMEOUT_DISPATCHES:
+ * Macro for the number of times a timeout of the event loop was
+ * dispatched, as VIR_TYPED_PARAM_ULLONG.
+ *
+ * Since: 8.5.0
+ */
+
+# define VIR_SERVER_STATS_EVENT_TIMEOUT_DISPATCHES "event.timeout_dispatches"
+
+/**
+ * VIR_SERVER_STATS_EVENT_TIMEOUT_BATCHES:
+ * Macro for the number of event loop wakeups dispatching timeouts, as
+ * VIR_TYPED_PARAM_ULLONG. All timeouts due at the same time are dispatched
+ * in one batch.
+ *
+ * Since: 8.5.0
+ */
+
+# define VIR_SERVER_STATS_EVENT_TIMEOUT_BATCHES "event.timeout_batches"
+
+/**
+ * VIR_SERVER_STATS_EVENT_HANDLES:
+ * Macro for the number of file handles currently registered with the event
+ * loop, as VIR_TYPED_PARAM_ULLONG.
+ *
+ * Since: 8.5.0
+ */
+
+# define VIR_SERVER_STATS_EVENT_HANDLES "event.handles"
+
+/**
+ * VIR_SERVER_STATS_EVENT_TIMEOUTS:
+ * Macro for the number of timeouts currently registered with the event
+ * loop, as VIR_TYPED_PARAM_ULLONG.
+ *
+ * Since: 8.5.0
+ */
+
+# define VIR_SERVER_STATS_EVENT_TIMEOUTS "event.timeouts"
+
+/**
+ * VIR_SERVER_STATS_EVENT_TIMEOUTS_ENABLED:
+ * Macro for the number of currently registered timeouts which are enabled,
+ * as VIR_TYPED_PARAM_ULLONG.
+ *
+ * Since: 8.5.0
+ */
+
+# define VIR_SERVER_STATS_EVENT_TIMEOUTS_ENABLED "event.timeouts_enabled"
+
+/**
+ * VIR_SERVER_STATS_EVENT_DISPATCH_TIME:
+ * Macro for the total time in microseconds the event loop spent running
+ * file handle and timeout callbacks, as VIR_TYPED_PARAM_ULLONG.
+ *
+ * Since: 8.5.0
+ */
+
+# define VIR_SERVER_STATS_EVENT_DISPATCH_TIME "event.dispatch_time"
+
+/**
+ * VIR_SERVER_STATS_EVENT_MAX_DISPATCH_TIME:
+ * Macro for the longest time in microseconds a single file handle or
+ * timeout callback ran, as VIR_TYPED_PARAM_ULLONG. No other event of the
+ * daemon is processed while a callback runs.
+ *
+ * Since: 8.5.0
+ */
+
+# define VIR_SERVER_STATS_EVENT_MAX_DISPATCH_TIME "event.max_dispatch_time"
+
+/**
+ * VIR_SERVER_STATS_EVENT_SLOWEST_CALLBACK:
+ * Macro for the callback which ran for the time reported as
+ * VIR_SERVER_STATS_EVENT_MAX_DISPATCH_TIME, as VIR_TYPED_PARAM_STRING.
+ * The callback is described by its symbol name if it has one, otherwise
+ * by the binary containing it and its offset in the binary.
+ *
+ * Since: 8.5.0
+ */
+
+# define VIR_SERVER_STATS_EVENT_SLOWEST_CALLBACK "event.slowest_callback"
+
+/**
+ * VIR_SERVER_STATS_EVENT_SLOW_DISPATCHES:
+ * Macro for the number of callbacks which ran longer than the slow
+ * callback threshold of the daemon, as VIR_TYPED_PARAM_ULLONG.
+ *
+ * Since: 8.5.0
+ */
+
+# define VIR_SERVER_STATS_EVENT_SLOW_DISPATCHES "event.slow_dispatches"
+
+/**
+ * VIR_SERVER_STATS_EVENT_HEARTBEATS:
+ * Macro for the number of times the heartbeat timer of the event loop
+ * ran, as VIR_TYPED_PARAM_ULLONG. The heartbeat only runs if the daemon
+ * has a slow callback threshold set.
+ *
+ * Since: 8.5.0
+ */
+
+# define VIR_SERVER_STATS_EVENT_HEARTBEATS "event.heartbeats"
+
+/**
+ * VIR_SERVER_STATS_EVENT_HEARTBEAT_LAG:
+ * Macro for the total time in microseconds the heartbeat timer ran late,
+ * as VIR_TYPED_PARAM_ULLONG.
+ *
+ * Since: 8.5.0
+ */
+
+# define VIR_SERVER_STATS_EVENT_HEARTBEAT_LAG "event.heartbeat_lag"
+
+/**
+ * VIR_SERVER_STATS_EVENT_MAX_HEARTBEAT_LAG:
+ * Macro for the longest time in microseconds the heartbeat timer ran
+ * late, as VIR_TYPED_PARAM_ULLONG.
+ *
+ * Since: 8.5.0
+ */
+
+# define VIR_SERVER_STATS_EVENT_MAX_HEARTBEAT_LAG "event.max_heartbeat_lag"
+
+int virAdmServerGetStats(virAdmServerPtr srv,
+                         virTypedParameterPtr *params,
+                         int *nparams,
+                         unsigned int flags);
+
+int virAdmServerGetProcedureStats(virAdmServerPtr srv,
+                                  virTypedParameterPtr *params,
+                                  int *nparams,
+                                  unsigned int flags);
+
 int virAdmConnectGetLoggingOutputs(virAdmConnectPtr conn,
                                    char **outputs,
                                    unsigned int flags);
@@ -88,6 +88,13 @@ typedef enum {
 virDomainSnapshotPtr virDomainSnapshotCreateXML(virDomainPtr domain,
                                                 const char *xmlDesc,
                                                 unsigned int flags);
+
+/* Take consistent snapshots of the current state of several VMs */
+int virDomainListSnapshotCreateXML(virDomainPtr *doms,
+                                   const char **xmlDescs,
+                                   virDomainSnapshotPtr **snaps,
+                                   unsigned int flags);
+
 /**
  * virDomainSnapshotXMLFlags:
  *
@@ -1083,6 +1083,15 @@ typedef enum {
       */
     VIR_MIGRATE_NON_SHARED_SYNCHRONOUS_WRITES = (1 << 18),
 
+    /* Use zero-copy mechanism for migrating memory pages. For QEMU/KVM this
+     * means QEMU will be temporarily allowed to lock all guest pages in host's
+     * memory, although only those that are queued for transfer will be locked
+     * at the same time. Requires VIR_MIGRATE_PARALLEL.
+     *
+     * Since: 8.5.0
+     */
+    VIR_MIGRATE_ZEROCOPY = (1 << 19),
+
 } virDomainMigrateFlags;
 
 
@@ -2624,8 +2633,16 @@ int virDomainDetachDevice(virDomainPtr domain, const char *xml);
 
 int virDomainAttachDeviceFlags(virDomainPtr domain,
                                const char *xml, unsigned int flags);
+int virDomainAttachDevices(virDomainPtr domain,
+                           const char **xmls,
+                           unsigned int nxmls,
+                           unsigned int flags);
 int virDomainDetachDeviceFlags(virDomainPtr domain,
                                const char *xml, unsigned int flags);
+int virDomainDetachDevices(virDomainPtr domain,
+                           const char **xmls,
+                           unsigned int nxmls,
+                           unsigned int flags);
 int virDomainUpdateDeviceFlags(virDomainPtr domain,
                                const char *xml, unsigned int flags);
 
@@ -2667,6 +2684,11 @@ typedef enum {
     VIR_DOMAIN_STATS_IOTHREAD = (1 << 7), /* return iothread poll info (Since: 4.10.0) */
     VIR_DOMAIN_STATS_MEMORY = (1 << 8), /* return domain memory info (Since: 6.0.0) */
     VIR_DOMAIN_STATS_DIRTYRATE = (1 << 9), /* return domain dirty rate info (Since: 7.2.0) */
+    VIR_DOMAIN_STATS_JOB = (1 << 10), /* return progress of the active job (Since: 8.5.0) */
+    VIR_DOMAIN_STATS_START = (1 << 11), /* return time spent starting the domain (Since: 8.5.0) */
+    VIR_DOMAIN_STATS_PRESSURE = (1 << 12), /* return pressure stall information of the domain (Since: 8.5.0) */
+    VIR_DOMAIN_STATS_JOB_LOCK = (1 << 13), /* return contention of domain jobs (Since: 8.5.0) */
+    VIR_DOMAIN_STATS_DAEMON_MEMORY = (1 << 14), /* return memory the daemon uses for the domain (Since: 8.5.0) */
 } virDomainStatsTypes;
 
 /**
@@ -2686,6 +2708,9 @@ typedef enum {
     VIR_CONNECT_GET_ALL_DOMAINS_STATS_SHUTOFF = VIR_CONNECT_LIST_DOMAINS_SHUTOFF, /* (Since: 1.2.8) */
     VIR_CONNECT_GET_ALL_DOMAINS_STATS_OTHER = VIR_CONNECT_LIST_DOMAINS_OTHER, /* (Since: 1.2.8) */
 
+    VIR_CONNECT_GET_ALL_DOMAINS_STATS_CACHED = 1 << 28, /* accept statistics cached by the
+                                                           daemon within its configured
+                                                           maximum age (Since: 8.5.0) */
     VIR_CONNECT_GET_ALL_DOMAINS_STATS_NOWAIT = 1 << 29, /* report statistics that can be obtained
                                                            immediately without any blocking (Since: 4.5.0) */
     VIR_CONNECT_GET_ALL_DOMAINS_STATS_BACKING = 1 << 30, /* include backing chain for block stats (Since: 1.2.12) */
@@ -2704,6 +2729,267 @@ int virDomainListGetStats(virDomainPtr *doms,
 
 void virDomainStatsRecordListFree(virDomainStatsRecordPtr *stats);
 
+/**
+ * VIR_CONNECT_LIST_DOMAINS_PAGE_CURSOR:
+ *
+ * The cursor returned by the previous call of virConnectListDomainsPage(),
+ * the listing continues with the domain that follows it. If omitted, the
+ * listing starts with the first domain, as VIR_TYPED_PARAM_STRING.
+ *
+ * Since: 8.5.0
+ */
+# define VIR_CONNECT_LIST_DOMAINS_PAGE_CURSOR "cursor"
+
+/**
+ * VIR_CONNECT_LIST_DOMAINS_PAGE_LIMIT:
+ *
+ * The maximum number of domains returned by a single call of
+ * virConnectListDomainsPage(), as VIR_TYPED_PARAM_UINT. If omitted or 0,
+ * up to 1000 domains are returned. Remote connections return at most 16384
+ * domains regardless of a larger limit.
+ *
+ * Since: 8.5.0
+ */
+# define VIR_CONNECT_LIST_DOMAINS_PAGE_LIMIT "limit"
+
+/**
+ * VIR_CONNECT_LIST_DOMAINS_PAGE_NAME:
+ *
+ * Only list domains whose name matches this shell-style glob pattern, as
+ * VIR_TYPED_PARAM_STRING.
+ *
+ * Since: 8.5.0
+ */
+# define VIR_CONNECT_LIST_DOMAINS_PAGE_NAME "name"
+
+/**
+ * VIR_CONNECT_LIST_DOMAINS_PAGE_METADATA:
+ *
+ * Only list domains which have custom metadata in the XML namespace with
+ * this URI (see virDomainSetMetadata()), as VIR_TYPED_PARAM_STRING.
+ *
+ * Since: 8.5.0
+ */
+# define VIR_CONNECT_LIST_DOMAINS_PAGE_METADATA "metadata"
+
+/**
+ * VIR_CONNECT_LIST_DOMAINS_PAGE_STATS:
+ *
+ * Bitwise-OR of virDomainStatsTypes which are to be returned along with
+ * each listed domain, as VIR_TYPED_PARAM_UINT. If omitted, no statistics
+ * are returned. 0 requests all statistics supported by the hypervisor,
+ * just like with virConnectGetAllDomainStats().
+ *
+ * Since: 8.5.0
+ */
+# define VIR_CONNECT_LIST_DOMAINS_PAGE_STATS "stats"
+
+int virConnectListDomainsPage(virConnectPtr conn,
+                              virTypedParameterPtr params,
+                              int nparams,
+                              virDomainStatsRecordPtr **records,
+                              char **cursor,
+                              unsigned int flags);
+
+/**
+ * virConnectDomainStatsCallback:
+ * @conn: connection object
+ * @dom: domain the statistics belong to
+ * @params: changed statistics stored as array of virTypedParameter
+ * @nparams: size of the array
+ * @opaque: application specified data
+ *
+ * The callback signature to use when subscribing to domain statistics with
+ * virConnectDomainStatsRegister(). The first invocation for a domain carries
+ * all statistics of the subscribed groups, subsequent ones only those which
+ * changed since the previous invocation. The fields are named the same way
+ * as those returned by virConnectGetAllDomainStats(). The params must not
+ * be freed in the callback handler as it's done internally after the
+ * callback handler is executed.
+ *
+ * Since: 8.5.0
+ */
+typedef void (*virConnectDomainStatsCallback)(virConnectPtr conn,
+                                              virDomainPtr dom,
+                                              virTypedParameterPtr params,
+                                              int nparams,
+                                              void *opaque);
+
+/**
+ * virConnectDomainStatsRegisterFlags:
+ *
+ * Since: 8.5.0
+ */
+typedef enum {
+    VIR_CONNECT_DOMAIN_STATS_REGISTER_INTERVAL_MSEC = (1 << 0), /* interval is in milliseconds (Since: 8.5.0) */
+} virConnectDomainStatsRegisterFlags;
+
+int virConnectDomainStatsRegister(virConnectPtr conn,
+                                  virDomainPtr dom,
+                                  unsigned int stats,
+                                  unsigned int interval,
+                                  virConnectDomainStatsCallback cb,
+                                  void *opaque,
+                                  virFreeCallback freecb,
+                                  unsigned int flags);
+
+int virConnectDomainStatsDeregister(virConnectPtr conn,
+                                    int callbackID);
+
+/**
+ * VIR_DOMAIN_EVENT_RING_MAGIC:
+ *
+ * Magic number at the start of the shared memory returned by
+ * virConnectDomainEventRingOpen().
+ *
+ * Since: 8.5.0
+ */
+# define VIR_DOMAIN_EVENT_RING_MAGIC 0x4c564552
+
+/**
+ * VIR_DOMAIN_EVENT_RING_VERSION:
+ *
+ * Version of the layout of the shared memory returned by
+ * virConnectDomainEventRingOpen() described by this header.
+ *
+ * Since: 8.5.0
+ */
+# define VIR_DOMAIN_EVENT_RING_VERSION 1
+
+/**
+ * virDomainEventRingHeader:
+ *
+ * Header at the start of the shared memory returned by
+ * virConnectDomainEventRingOpen(). Positions count the bytes written
+ * since the ring was created, the record at position P starts at byte
+ * (P % size) of the data area.
+ *
+ * Since: 8.5.0
+ */
+typedef struct _virDomainEventRingHeader virDomainEventRingHeader;
+struct _virDomainEventRingHeader {
+    unsigned int magic;         /* VIR_DOMAIN_EVENT_RING_MAGIC */
+    unsigned int version;       /* VIR_DOMAIN_EVENT_RING_VERSION */
+    unsigned long long offset;  /* of the data area from the start */
+    unsigned long long size;    /* of the data area, a power of two */
+    unsigned long long head;    /* position following the newest record */
+    unsigned long long tail;    /* position of the oldest record */
+};
+
+/**
+ * virDomainEventRingRecordType:
+ *
+ * Since: 8.5.0
+ */
+typedef enum {
+    VIR_DOMAIN_EVENT_RING_RECORD_PADDING = 0, /* fills the end of the data
+                                                 area, to be skipped
+                                                 (Since: 8.5.0) */
+    VIR_DOMAIN_EVENT_RING_RECORD_EVENT = 1,   /* virDomainEventRingEvent
+                                                 (Since: 8.5.0) */
+    VIR_DOMAIN_EVENT_RING_RECORD_STATS = 2,   /* virDomainEventRingStats
+                                                 (Since: 8.5.0) */
+
+# ifdef VIR_ENUM_SENTINELS
+    VIR_DOMAIN_EVENT_RING_RECORD_LAST /* (Since: 8.5.0) */
+# endif
+} virDomainEventRingRecordType;
+
+/**
+ * virDomainEventRingRecord:
+ *
+ * The common start of all records in the ring but padding, of which
+ * only @length and @type are valid.
+ *
+ * Since: 8.5.0
+ */
+typedef struct _virDomainEventRingRecord virDomainEventRingRecord;
+struct _virDomainEventRingRecord {
+    unsigned int length;            /* of the whole record, a multiple of 8 */
+    unsigned int type;              /* virDomainEventRingRecordType */
+    unsigned long long timestamp;   /* milliseconds since the epoch */
+    unsigned char uuid[VIR_UUID_BUFLEN]; /* of the domain */
+    int id;                         /* of the domain, -1 if it's inactive */
+    unsigned int name;              /* offset of the NUL terminated name
+                                       of the domain from the start of
+                                       the record */
+};
+
+/**
+ * virDomainEventRingEvent:
+ *
+ * A domain event. The @data depends on @eventID:
+ *
+ * VIR_DOMAIN_EVENT_ID_LIFECYCLE: virDomainEventType, detail
+ * VIR_DOMAIN_EVENT_ID_REBOOT: none
+ * VIR_DOMAIN_EVENT_ID_RTC_CHANGE: the new UTC offset in seconds
+ * VIR_DOMAIN_EVENT_ID_WATCHDOG: virDomainEventWatchdogAction
+ * VIR_DOMAIN_EVENT_ID_CONTROL_ERROR: none
+ * VIR_DOMAIN_EVENT_ID_PMWAKEUP: reason
+ * VIR_DOMAIN_EVENT_ID_PMSUSPEND: reason
+ * VIR_DOMAIN_EVENT_ID_BALLOON_CHANGE: the new balloon size in KiB
+ * VIR_DOMAIN_EVENT_ID_PMSUSPEND_DISK: reason
+ * VIR_DOMAIN_EVENT_ID_AGENT_LIFECYCLE: virConnectDomainEventAgentLifecycleState,
+ *                                      virConnectDomainEventAgentLifecycleReason
+ *
+ * Since: 8.5.0
+ */
+typedef struct _virDomainEventRingEvent virDomainEventRingEvent;
+struct _virDomainEventRingEvent {
+    virDomainEventRingRecord record;
+    int eventID;                    /* virDomainEventID */
+    unsigned int reserved;
+    long long data[4];              /* depends on eventID */
+};
+
+/**
+ * virDomainEventRingStats:
+ *
+ * Statistics of a domain, with the same fields as
+ * virConnectDomainStatsRegister() passes to its callback.
+ *
+ * Since: 8.5.0
+ */
+typedef struct _virDomainEventRingStats virDomainEventRingStats;
+struct _virDomainEventRingStats {
+    virDomainEventRingRecord record;
+    unsigned int nparams;           /* number of virDomainEventRingParam */
+    unsigned int params;            /* offset of the first
+                                       virDomainEventRingParam from the
+                                       start of the record */
+};
+
+/**
+ * virDomainEventRingParam:
+ *
+ * A field of virDomainEventRingStats, followed by its NUL terminated
+ * name. The next one follows @length bytes after the start of this one.
+ *
+ * Since: 8.5.0
+ */
+typedef struct _virDomainEventRingParam virDomainEventRingParam;
+struct _virDomainEventRingParam {
+    unsigned int length;        /* including the name and the string value,
+                                   a multiple of 8 */
+    int type;                   /* virTypedParameterType */
+    union {
+        int i;                      /* type is INT */
+        unsigned int ui;            /* type is UINT */
+        long long int l;            /* type is LLONG */
+        unsigned long long int ul;  /* type is ULLONG */
+        double d;                   /* type is DOUBLE */
+        char b;                     /* type is BOOLEAN */
+        unsigned long long int s;   /* type is STRING, offset of the NUL
+                                       terminated string from the start
+                                       of the param */
+    } value;
+};
+
+int virConnectDomainEventRingOpen(virConnectPtr conn,
+                                  unsigned int stats,
+                                  unsigned int interval,
+                                  unsigned int flags);
+
 /*
  * Perf Event API
  */
@@ -4414,6 +4700,61 @@ typedef enum {
  */
 # define VIR_DOMAIN_JOB_DISK_BPS                 "disk_bps"
 
+/**
+ * VIR_DOMAIN_JOB_MIRROR_COUNT:
+ *
+ * virDomainGetJobStats field: number of disks copied to the destination
+ * by a non-shared storage migration, as VIR_TYPED_PARAM_UINT. The progress
+ * of each of the disks is reported in fields starting with
+ * VIR_DOMAIN_JOB_MIRROR_PREFIX followed by the index of the disk
+ * (counting from 0) and one of the VIR_DOMAIN_JOB_MIRROR_SUFFIX_* suffixes,
+ * e.g. "mirror.0.total".
+ *
+ * Since: 8.5.0
+ */
+# define VIR_DOMAIN_JOB_MIRROR_COUNT             "mirror.count"
+
+/**
+ * VIR_DOMAIN_JOB_MIRROR_PREFIX:
+ *
+ * virDomainGetJobStats field prefix of the per disk storage migration
+ * progress fields, see VIR_DOMAIN_JOB_MIRROR_COUNT.
+ *
+ * Since: 8.5.0
+ */
+# define VIR_DOMAIN_JOB_MIRROR_PREFIX            "mirror."
+
+/**
+ * VIR_DOMAIN_JOB_MIRROR_SUFFIX_DISK:
+ *
+ * virDomainGetJobStats field suffix: target name of the disk, as
+ * VIR_TYPED_PARAM_STRING.
+ *
+ * Since: 8.5.0
+ */
+# define VIR_DOMAIN_JOB_MIRROR_SUFFIX_DISK       ".disk"
+
+/**
+ * VIR_DOMAIN_JOB_MIRROR_SUFFIX_TOTAL:
+ *
+ * virDomainGetJobStats field suffix: number of bytes which need to be
+ * copied for the disk, as VIR_TYPED_PARAM_ULLONG. The value may grow while
+ * the guest keeps writing to the disk.
+ *
+ * Since: 8.5.0
+ */
+# define VIR_DOMAIN_JOB_MIRROR_SUFFIX_TOTAL      ".total"
+
+/**
+ * VIR_DOMAIN_JOB_MIRROR_SUFFIX_PROCESSED:
+ *
+ * virDomainGetJobStats field suffix: number of bytes copied for the disk
+ * so far, as VIR_TYPED_PARAM_ULLONG.
+ *
+ * Since: 8.5.0
+ */
+# define VIR_DOMAIN_JOB_MIRROR_SUFFIX_PROCESSED  ".processed"
+
 /**
  * VIR_DOMAIN_JOB_COMPRESSION_CACHE:
  *
@@ -6387,6 +6728,7 @@ typedef enum {
     VIR_DOMAIN_DIRTYRATE_MODE_PAGE_SAMPLING = 0,        /* default mode - page-sampling (Since: 8.1.0) */
     VIR_DOMAIN_DIRTYRATE_MODE_DIRTY_BITMAP = 1 << 0,    /* dirty-bitmap mode (Since: 8.1.0) */
     VIR_DOMAIN_DIRTYRATE_MODE_DIRTY_RING = 1 << 1,      /* dirty-ring mode (Since: 8.1.0) */
+    VIR_DOMAIN_DIRTYRATE_CONTINUOUS = 1 << 2,           /* keep calculating in the background (Since: 8.5.0) */
 } virDomainDirtyRateCalcFlags;
 
 int virDomainStartDirtyRateCalc(virDomainPtr domain,
@@ -0,0 +1,55 @@
+#!/usr/bin/env python3
+#
+# Copyright (C) 2022 Red Hat, Inc.
+#
+# This library is free software; you can redistribute it and/or
+# modify it under the terms of the GNU Lesser General Public
+# License as published by the Free Software Foundation; either
+# version 2.1 of the License, or (at your option) any later version.
+#
+# This library is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public
+# License along with this library.  If not, see
+# <http://www.gnu.org/licenses/>.
+#
+# Generates a C header with the contents of all the CPU map files, so
+# that the CPU map doesn't have to be read from dozens of files.
+#
+# Usage: gencpumap.py FILE...
+
+import os
+import sys
+
+
+def escape(line):
+    line = line.replace("\\", "\\\\")
+    line = line.replace("\"", "\\\"")
+    # avoid trigraphs
+    line = line.replace("?", "\\?")
+    return line
+
+
+print("/* Generated by gencpumap.py, do not edit */")
+print("")
+print("typedef struct _cpuMapBuiltinFile cpuMapBuiltinFile;")
+print("struct _cpuMapBuiltinFile {")
+print("    const char *filename;")
+print("    const char *contents;")
+print("};")
+print("")
+print("static const cpuMapBuiltinFile cpuMapBuiltin[] = {")
+
+for path in sys.argv[1:]:
+    with open(path, "r", encoding="ascii") as fh:
+        lines = fh.read().splitlines()
+
+    print("    { \"%s\"," % os.path.basename(path))
+    for line in lines:
+        print("      \"%s\\n\"" % escape(line))
+    print("    },")
+
+print("};")
@@ -43,6 +43,9 @@ const ADMIN_CLIENT_LIST_MAX = 16384;
 /* Upper limit on number of client info parameters */
 const ADMIN_CLIENT_INFO_PARAMETERS_MAX = 64;
 
+/* Upper limit on number of server stats parameters */
+const ADMIN_SERVER_STATS_MAX = 65536;
+
 /* Upper limit on number of client processing controls */
 const ADMIN_SERVER_CLIENT_LIMITS_MAX = 32;
 
@@ -214,6 +217,24 @@ struct admin_connect_set_logging_filters_args {
     unsigned int flags;
 };
 
+struct admin_server_get_stats_args {
+    admin_nonnull_server srv;
+    unsigned int flags;
+};
+
+struct admin_server_get_stats_ret {
+    admin_typed_param params<ADMIN_SERVER_STATS_MAX>;
+};
+
+struct admin_server_get_procedure_stats_args {
+    admin_nonnull_server srv;
+    unsigned int flags;
+};
+
+struct admin_server_get_procedure_stats_ret {
+    admin_typed_param params<ADMIN_SERVER_STATS_MAX>;
+};
+
 /* Define the program number, protocol version and procedure numbers here. */
 const ADMIN_PROGRAM = 0x06900690;
 const ADMIN_PROTOCOL_VERSION = 1;
@@ -324,5 +345,15 @@ enum admin_procedure {
     /**
      * @generate: both
      */
-    ADMIN_PROC_SERVER_UPDATE_TLS_FILES = 18
+    ADMIN_PROC_SERVER_UPDATE_TLS_FILES = 18,
+
+    /**
+     * @generate: none
+     */
+    ADMIN_PROC_SERVER_GET_STATS = 19,
+
+    /**
+     * @generate: none
+     */
+    ADMIN_PROC_SERVER_GET_PROCEDURE_STATS = 20
 };
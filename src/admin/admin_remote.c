@@ -388,6 +388,84 @@ remoteAdminServerGetClientLimits(virAdmServerPtr srv,
     return rv;
 }
 
+static int
+remoteAdminServerGetStats(virAdmServerPtr srv,
+                          virTypedParameterPtr *params,
+                          int *nparams,
+                          unsigned int flags)
+{
+    int rv = -1;
+    admin_server_get_stats_args args;
+    admin_server_get_stats_ret ret;
+    remoteAdminPriv *priv = srv->conn->privateData;
+    args.flags = flags;
+    make_nonnull_server(&args.srv, srv);
+
+    memset(&ret, 0, sizeof(ret));
+    virObjectLock(priv);
+
+    if (call(srv->conn, 0, ADMIN_PROC_SERVER_GET_STATS,
+             (xdrproc_t) xdr_admin_server_get_stats_args,
+             (char *) &args,
+             (xdrproc_t) xdr_admin_server_get_stats_ret,
+             (char *) &ret) == -1)
+        goto cleanup;
+
+    if (virTypedParamsDeserialize((struct _virTypedParameterRemote *) ret.params.params_val,
+                                  ret.params.params_len,
+                                  ADMIN_SERVER_STATS_MAX,
+                                  params,
+                                  nparams) < 0)
+        goto cleanup;
+
+    rv = 0;
+    xdr_free((xdrproc_t) xdr_admin_server_get_stats_ret,
+             (char *) &ret);
+
+ cleanup:
+    virObjectUnlock(priv);
+    return rv;
+}
+
+static int
+remoteAdminServerGetProcedureStats(virAdmServerPtr srv,
+                                   virTypedParameterPtr *params,
+                                   int *nparams,
+                                   unsigned int flags)
+{
+    int rv = -1;
+    admin_server_get_procedure_stats_args args;
+    admin_server_get_procedure_stats_ret ret;
+    remoteAdminPriv *priv = srv->conn->privateData;
+    args.flags = flags;
+    make_nonnull_server(&args.srv, srv);
+
+    memset(&ret, 0, sizeof(ret));
+    virObjectLock(priv);
+
+    if (call(srv->conn, 0, ADMIN_PROC_SERVER_GET_PROCEDURE_STATS,
+             (xdrproc_t) xdr_admin_server_get_procedure_stats_args,
+             (char *) &args,
+             (xdrproc_t) xdr_admin_server_get_procedure_stats_ret,
+             (char *) &ret) == -1)
+        goto cleanup;
+
+    if (virTypedParamsDeserialize((struct _virTypedParameterRemote *) ret.params.params_val,
+                                  ret.params.params_len,
+                                  ADMIN_SERVER_STATS_MAX,
+                                  params,
+                                  nparams) < 0)
+        goto cleanup;
+
+    rv = 0;
+    xdr_free((xdrproc_t) xdr_admin_server_get_procedure_stats_ret,
+             (char *) &ret);
+
+ cleanup:
+    virObjectUnlock(priv);
+    return rv;
+}
+
 static int
 remoteAdminServerSetClientLimits(virAdmServerPtr srv,
                                  virTypedParameterPtr params,
@@ -24,9 +24,11 @@
 #include "datatypes.h"
 #include "viralloc.h"
 #include "virerror.h"
+#include "vireventglib.h"
 #include "viridentity.h"
 #include "virlog.h"
 #include "rpc/virnetdaemon.h"
+#include "rpc/virnetmessage.h"
 #include "rpc/virnetserver.h"
 #include "virstring.h"
 #include "virthreadpool.h"
@@ -80,6 +82,10 @@ adminServerGetThreadPoolParameters(virNetServer *srv,
     size_t freeWorkers;
     size_t nPrioWorkers;
     size_t jobQueueDepth;
+    size_t jobQueues;
+    unsigned int idleTimeout;
+    unsigned long long spawnedWorkers;
+    unsigned long long retiredWorkers;
     g_autoptr(virTypedParamList) paramlist = g_new0(virTypedParamList, 1);
 
     virCheckFlags(0, -1);
@@ -87,7 +93,11 @@ adminServerGetThreadPoolParameters(virNetServer *srv,
     if (virNetServerGetThreadPoolParameters(srv, &minWorkers, &maxWorkers,
                                             &nWorkers, &freeWorkers,
                                             &nPrioWorkers,
-                                            &jobQueueDepth) < 0) {
+                                            &jobQueueDepth,
+                                            &jobQueues,
+                                            &idleTimeout,
+                                            &spawnedWorkers,
+                                            &retiredWorkers) < 0) {
         virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                        _("Unable to retrieve threadpool parameters"));
         return -1;
@@ -117,6 +127,22 @@ adminServerGetThreadPoolParameters(virNetServer *srv,
                                  "%s", VIR_THREADPOOL_JOB_QUEUE_DEPTH) < 0)
         return -1;
 
+    if (virTypedParamListAddUInt(paramlist, jobQueues,
+                                 "%s", VIR_THREADPOOL_JOB_QUEUES) < 0)
+        return -1;
+
+    if (virTypedParamListAddUInt(paramlist, idleTimeout,
+                                 "%s", VIR_THREADPOOL_WORKERS_IDLE_TIMEOUT) < 0)
+        return -1;
+
+    if (virTypedParamListAddULLong(paramlist, spawnedWorkers,
+                                   "%s", VIR_THREADPOOL_WORKERS_SPAWNED) < 0)
+        return -1;
+
+    if (virTypedParamListAddULLong(paramlist, retiredWorkers,
+                                   "%s", VIR_THREADPOOL_WORKERS_RETIRED) < 0)
+        return -1;
+
     *nparams = virTypedParamListStealParams(paramlist, params);
 
     return 0;
@@ -131,6 +157,8 @@ adminServerSetThreadPoolParameters(virNetServer *srv,
     long long int minWorkers = -1;
     long long int maxWorkers = -1;
     long long int prioWorkers = -1;
+    long long int jobQueues = -1;
+    long long int idleTimeout = -1;
     virTypedParameterPtr param = NULL;
 
     virCheckFlags(0, -1);
@@ -142,6 +170,10 @@ adminServerSetThreadPoolParameters(virNetServer *srv,
                                VIR_TYPED_PARAM_UINT,
                                VIR_THREADPOOL_WORKERS_PRIORITY,
                                VIR_TYPED_PARAM_UINT,
+                               VIR_THREADPOOL_JOB_QUEUES,
+                               VIR_TYPED_PARAM_UINT,
+                               VIR_THREADPOOL_WORKERS_IDLE_TIMEOUT,
+                               VIR_TYPED_PARAM_UINT,
                                NULL) < 0)
         return -1;
 
@@ -157,8 +189,17 @@ adminServerSetThreadPoolParameters(virNetServer *srv,
                                    VIR_THREADPOOL_WORKERS_PRIORITY)))
         prioWorkers = param->value.ui;
 
+    if ((param = virTypedParamsGet(params, nparams,
+                                   VIR_THREADPOOL_JOB_QUEUES)))
+        jobQueues = param->value.ui;
+
+    if ((param = virTypedParamsGet(params, nparams,
+                                   VIR_THREADPOOL_WORKERS_IDLE_TIMEOUT)))
+        idleTimeout = param->value.ui;
+
     if (virNetServerSetThreadPoolParameters(srv, minWorkers,
-                                            maxWorkers, prioWorkers) < 0)
+                                            maxWorkers, prioWorkers,
+                                            jobQueues, idleTimeout) < 0)
         return -1;
 
     return 0;
@@ -206,6 +247,7 @@ adminClientGetInfo(virNetServerClient *client,
     const char *attr = NULL;
     g_autoptr(virTypedParamList) paramlist = g_new0(virTypedParamList, 1);
     g_autoptr(virIdentity) identity = NULL;
+    virNetServerClientStats stats;
     int rc;
 
     virCheckFlags(0, -1);
@@ -283,6 +325,26 @@ adminClientGetInfo(virNetServerClient *client,
                                    "%s", VIR_CLIENT_INFO_SELINUX_CONTEXT) < 0)
         return -1;
 
+    virNetServerClientGetStats(client, &stats);
+
+    if (virTypedParamListAddULLong(paramlist, stats.calls,
+                                   "%s", VIR_CLIENT_INFO_CALLS) < 0 ||
+        virTypedParamListAddULLong(paramlist, stats.cpuTime,
+                                   "%s", VIR_CLIENT_INFO_CPU_TIME) < 0 ||
+        virTypedParamListAddULLong(paramlist, stats.bytesIn,
+                                   "%s", VIR_CLIENT_INFO_BYTES_IN) < 0 ||
+        virTypedParamListAddULLong(paramlist, stats.bytesOut,
+                                   "%s", VIR_CLIENT_INFO_BYTES_OUT) < 0 ||
+        virTypedParamListAddUInt(paramlist, stats.requests,
+                                 "%s", VIR_CLIENT_INFO_REQUESTS) < 0 ||
+        virTypedParamListAddUInt(paramlist, stats.requestsMax,
+                                 "%s", VIR_CLIENT_INFO_REQUESTS_MAX) < 0 ||
+        virTypedParamListAddUInt(paramlist, stats.txQueued,
+                                 "%s", VIR_CLIENT_INFO_TX_QUEUED) < 0 ||
+        virTypedParamListAddULLong(paramlist, stats.bufferBytes,
+                                   "%s", VIR_CLIENT_INFO_BUFFER_BYTES) < 0)
+        return -1;
+
     *nparams = virTypedParamListStealParams(paramlist, params);
     return 0;
 }
@@ -374,3 +436,228 @@ adminServerUpdateTlsFiles(virNetServer *srv,
 
     return virNetServerUpdateTlsFiles(srv);
 }
+
+int
+adminServerGetStats(virNetServer *srv,
+                    virTypedParameterPtr *params,
+                    int *nparams,
+                    unsigned int flags)
+{
+    g_autoptr(virTypedParamList) paramlist = g_new0(virTypedParamList, 1);
+    unsigned long long hits;
+    unsigned long long misses;
+    size_t nbuffers;
+    size_t nbytes;
+    virEventGLibStats events;
+    g_autofree virThreadPoolClassStats *classes = NULL;
+    size_t nclasses = 0;
+    g_autofree virThreadPoolThreadStats *workers = NULL;
+    size_t nworkers = 0;
+    virNetServerClient **clients = NULL;
+    int nclients;
+    int c;
+    unsigned long long txQueued = 0;
+    unsigned long long bufferBytes = 0;
+    size_t i;
+
+    virCheckFlags(0, -1);
+
+    virNetMessageGetBufferPoolStats(&hits, &misses, &nbuffers, &nbytes);
+    virEventGLibGetStats(&events);
+    virNetServerGetJobClassStats(srv, &classes, &nclasses);
+    virNetServerGetWorkerThreadStats(srv, &workers, &nworkers);
+
+    if ((nclients = virNetServerGetClients(srv, &clients)) < 0)
+        return -1;
+
+    for (c = 0; c < nclients; c++) {
+        virNetServerClientStats stats;
+
+        virNetServerClientGetStats(clients[c], &stats);
+        txQueued += stats.txQueued;
+        bufferBytes += stats.bufferBytes;
+    }
+    virObjectListFreeCount(clients, nclients);
+
+    if (virTypedParamListAddULLong(paramlist, hits,
+                                   "%s", VIR_SERVER_STATS_MSGBUF_HITS) < 0)
+        return -1;
+
+    if (virTypedParamListAddULLong(paramlist, misses,
+                                   "%s", VIR_SERVER_STATS_MSGBUF_MISSES) < 0)
+        return -1;
+
+    if (virTypedParamListAddULLong(paramlist, nbuffers,
+                                   "%s", VIR_SERVER_STATS_MSGBUF_CACHED) < 0)
+        return -1;
+
+    if (virTypedParamListAddULLong(paramlist, nbytes,
+                                   "%s", VIR_SERVER_STATS_MSGBUF_CACHED_BYTES) < 0)
+        return -1;
+
+    if (virTypedParamListAddULLong(paramlist, txQueued,
+                                   "%s", VIR_SERVER_STATS_CLIENTS_TX_QUEUED) < 0 ||
+        virTypedParamListAddULLong(paramlist, bufferBytes,
+                                   "%s", VIR_SERVER_STATS_CLIENTS_BUFFER_BYTES) < 0)
+        return -1;
+
+    if (virTypedParamListAddULLong(paramlist, events.iterations,
+                                   "%s", VIR_SERVER_STATS_EVENT_ITERATIONS) < 0 ||
+        virTypedParamListAddULLong(paramlist, events.handleDispatches,
+                                   "%s", VIR_SERVER_STATS_EVENT_HANDLE_DISPATCHES) < 0 ||
+        virTypedParamListAddULLong(paramlist, events.timeoutDispatches,
+                                   "%s", VIR_SERVER_STATS_EVENT_TIMEOUT_DISPATCHES) < 0 ||
+        virTypedParamListAddULLong(paramlist, events.timeoutBatches,
+                                   "%s", VIR_SERVER_STATS_EVENT_TIMEOUT_BATCHES) < 0 ||
+        virTypedParamListAddULLong(paramlist, events.handles,
+                                   "%s", VIR_SERVER_STATS_EVENT_HANDLES) < 0 ||
+        virTypedParamListAddULLong(paramlist, events.timeouts,
+                                   "%s", VIR_SERVER_STATS_EVENT_TIMEOUTS) < 0 ||
+        virTypedParamListAddULLong(paramlist, events.timeoutsEnabled,
+                                   "%s", VIR_SERVER_STATS_EVENT_TIMEOUTS_ENABLED) < 0 ||
+        virTypedParamListAddULLong(paramlist, events.dispatchTime,
+                                   "%s", VIR_SERVER_STATS_EVENT_DISPATCH_TIME) < 0 ||
+        virTypedParamListAddULLong(paramlist, events.dispatchTimeMax,
+                                   "%s", VIR_SERVER_STATS_EVENT_MAX_DISPATCH_TIME) < 0 ||
+        virTypedParamListAddULLong(paramlist, events.slowDispatches,
+                                   "%s", VIR_SERVER_STATS_EVENT_SLOW_DISPATCHES) < 0 ||
+        virTypedParamListAddULLong(paramlist, events.heartbeats,
+                                   "%s", VIR_SERVER_STATS_EVENT_HEARTBEATS) < 0 ||
+        virTypedParamListAddULLong(paramlist, events.heartbeatLag,
+                                   "%s", VIR_SERVER_STATS_EVENT_HEARTBEAT_LAG) < 0 ||
+        virTypedParamListAddULLong(paramlist, events.heartbeatLagMax,
+                                   "%s", VIR_SERVER_STATS_EVENT_MAX_HEARTBEAT_LAG) < 0)
+        return -1;
+
+    if (events.slowestCb) {
+        g_autofree char *slowest = virEventGLibCallbackName(events.slowestCb);
+
+        if (virTypedParamListAddString(paramlist, slowest,
+                                       "%s", VIR_SERVER_STATS_EVENT_SLOWEST_CALLBACK) < 0)
+            return -1;
+    }
+
+    if (virTypedParamListAddUInt(paramlist, nclasses, "class.count") < 0)
+        return -1;
+
+    for (i = 0; i < nclasses; i++) {
+        virThreadPoolClassStats *ent = &classes[i];
+
+        if (virTypedParamListAddString(paramlist, ent->name,
+                                       "class.%zu.name", i) < 0 ||
+            virTypedParamListAddBoolean(paramlist, ent->exclusive,
+                                        "class.%zu.exclusive", i) < 0 ||
+            virTypedParamListAddUInt(paramlist, ent->workers,
+                                     "class.%zu.workers", i) < 0 ||
+            virTypedParamListAddUInt(paramlist, ent->jobQueueDepth,
+                                     "class.%zu.queue_depth", i) < 0 ||
+            virTypedParamListAddULLong(paramlist, ent->jobs,
+                                       "class.%zu.jobs", i) < 0 ||
+            virTypedParamListAddULLong(paramlist, ent->waitTime,
+                                       "class.%zu.wait_time", i) < 0 ||
+            virTypedParamListAddULLong(paramlist, ent->maxWaitTime,
+                                       "class.%zu.max_wait_time", i) < 0)
+            return -1;
+    }
+
+    if (virTypedParamListAddUInt(paramlist, nworkers, "worker.count") < 0)
+        return -1;
+
+    for (i = 0; i < nworkers; i++) {
+        virThreadPoolThreadStats *ent = &workers[i];
+
+        if (virTypedParamListAddULLong(paramlist, ent->id,
+                                       "worker.%zu.id", i) < 0 ||
+            virTypedParamListAddString(paramlist, ent->className,
+                                       "worker.%zu.class", i) < 0)
+            return -1;
+
+        if (ent->job &&
+            virTypedParamListAddString(paramlist, ent->job,
+                                       "worker.%zu.job", i) < 0)
+            return -1;
+
+        if (ent->hasCPUTime &&
+            virTypedParamListAddULLong(paramlist, ent->cpuTime,
+                                       "worker.%zu.cpu_time", i) < 0)
+            return -1;
+    }
+
+    *nparams = virTypedParamListStealParams(paramlist, params);
+
+    return 0;
+}
+
+static int
+adminServerAddHistogram(virTypedParamList *paramlist,
+                        size_t idx,
+                        const char *name,
+                        unsigned long long *hist)
+{
+    size_t i;
+
+    for (i = 0; i < VIR_NET_SERVER_PROGRAM_HIST_BUCKETS; i++) {
+        if (!hist[i])
+            continue;
+
+        if (virTypedParamListAddULLong(paramlist, hist[i], "proc.%zu.%s.%llu",
+                                       idx, name,
+                                       virNetServerProgramHistBucketStart(i)) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+int
+adminServerGetProcedureStats(virNetServer *srv,
+                             virTypedParameterPtr *params,
+                             int *nparams,
+                             unsigned int flags)
+{
+    g_autoptr(virTypedParamList) paramlist = g_new0(virTypedParamList, 1);
+    g_autofree virNetServerProgramProcStats *stats = NULL;
+    size_t nstats = 0;
+    size_t i;
+
+    virCheckFlags(0, -1);
+
+    virNetServerGetProcedureStats(srv, &stats, &nstats);
+
+    if (virTypedParamListAddUInt(paramlist, nstats, "proc.count") < 0)
+        return -1;
+
+    for (i = 0; i < nstats; i++) {
+        virNetServerProgramProcStats *ent = &stats[i];
+
+        if (virTypedParamListAddUInt(paramlist, ent->program,
+                                     "proc.%zu.program", i) < 0 ||
+            virTypedParamListAddUInt(paramlist, ent->procedure,
+                                     "proc.%zu.procedure", i) < 0 ||
+            virTypedParamListAddULLong(paramlist, ent->calls,
+                                       "proc.%zu.calls", i) < 0 ||
+            virTypedParamListAddULLong(paramlist, ent->errors,
+                                       "proc.%zu.errors", i) < 0 ||
+            virTypedParamListAddULLong(paramlist, ent->bytesIn,
+                                       "proc.%zu.bytes_in", i) < 0 ||
+            virTypedParamListAddULLong(paramlist, ent->bytesOut,
+                                       "proc.%zu.bytes_out", i) < 0 ||
+            virTypedParamListAddULLong(paramlist, ent->queued,
+                                       "proc.%zu.queued", i) < 0 ||
+            virTypedParamListAddULLong(paramlist, ent->queueTime,
+                                       "proc.%zu.queue_time", i) < 0 ||
+            virTypedParamListAddULLong(paramlist, ent->dispatchTime,
+                                       "proc.%zu.dispatch_time", i) < 0)
+            return -1;
+
+        if (adminServerAddHistogram(paramlist, i, "queue_hist",
+                                    ent->queueHist) < 0 ||
+            adminServerAddHistogram(paramlist, i, "dispatch_hist",
+                                    ent->dispatchHist) < 0)
+            return -1;
+    }
+
+    *nparams = virTypedParamListStealParams(paramlist, params);
+
+    return 0;
+}
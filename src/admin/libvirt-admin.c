@@ -810,6 +810,11 @@ virAdmConnectLookupServer(virAdmConnectPtr conn,
  *      VIR_THREADPOOL_WORKERS_PRIORITY
  *      VIR_THREADPOOL_WORKERS_FREE
  *      VIR_THREADPOOL_WORKERS_CURRENT
+ *      VIR_THREADPOOL_JOB_QUEUE_DEPTH
+ *      VIR_THREADPOOL_JOB_QUEUES
+ *      VIR_THREADPOOL_WORKERS_IDLE_TIMEOUT
+ *      VIR_THREADPOOL_WORKERS_SPAWNED
+ *      VIR_THREADPOOL_WORKERS_RETIRED
  *
  * Returns 0 on success, -1 in case of an error.
  *
@@ -1164,6 +1169,175 @@ virAdmServerUpdateTlsFiles(virAdmServerPtr srv,
     return ret;
 }
 
+/**
+ * virAdmServerGetStats:
+ * @srv: a valid server object reference
+ * @params: pointer to a list of typed parameters which will be allocated
+ *          to store all returned statistics
+ * @nparams: pointer which will hold the number of params returned in @params
+ * @flags: extra flags; not used yet, so callers should always pass 0
+ *
+ * Retrieves runtime statistics of server @srv. Upon successful completion,
+ * @params will be allocated automatically to hold all returned data, setting
+ * @nparams accordingly. The following statistics are reported:
+ *      VIR_SERVER_STATS_MSGBUF_HITS
+ *      VIR_SERVER_STATS_MSGBUF_MISSES
+ *      VIR_SERVER_STATS_MSGBUF_CACHED
+ *      VIR_SERVER_STATS_MSGBUF_CACHED_BYTES
+ *      VIR_SERVER_STATS_CLIENTS_TX_QUEUED
+ *      VIR_SERVER_STATS_CLIENTS_BUFFER_BYTES
+ *      VIR_SERVER_STATS_EVENT_ITERATIONS
+ *      VIR_SERVER_STATS_EVENT_HANDLE_DISPATCHES
+ *      VIR_SERVER_STATS_EVENT_TIMEOUT_DISPATCHES
+ *      VIR_SERVER_STATS_EVENT_TIMEOUT_BATCHES
+ *      VIR_SERVER_STATS_EVENT_HANDLES
+ *      VIR_SERVER_STATS_EVENT_TIMEOUTS
+ *      VIR_SERVER_STATS_EVENT_TIMEOUTS_ENABLED
+ *      VIR_SERVER_STATS_EVENT_DISPATCH_TIME
+ *      VIR_SERVER_STATS_EVENT_MAX_DISPATCH_TIME
+ *      VIR_SERVER_STATS_EVENT_SLOWEST_CALLBACK
+ *      VIR_SERVER_STATS_EVENT_SLOW_DISPATCHES
+ *      VIR_SERVER_STATS_EVENT_HEARTBEATS
+ *      VIR_SERVER_STATS_EVENT_HEARTBEAT_LAG
+ *      VIR_SERVER_STATS_EVENT_MAX_HEARTBEAT_LAG
+ *
+ * Additionally, the job classes of the worker pool of @srv are reported.
+ * Their number is returned as "class.count", each of them is then described
+ * by the following fields, where <num> goes from 0 to "class.count" - 1:
+ *
+ *  "class.<num>.name" - name of the class, as string
+ *  "class.<num>.exclusive" - whether only the workers reserved for the
+ *                            class run its calls, as boolean
+ *  "class.<num>.workers" - number of workers reserved for the class or the
+ *                          number of ordinary workers for class 0, as
+ *                          unsigned int
+ *  "class.<num>.queue_depth" - number of calls waiting for a worker, as
+ *                              unsigned int
+ *  "class.<num>.jobs" - number of calls taken by a worker so far, as
+ *                       unsigned long long
+ *  "class.<num>.wait_time" - total time in microseconds the calls spent
+ *                            waiting for a worker, as unsigned long long
+ *  "class.<num>.max_wait_time" - longest time in microseconds a call spent
+ *                                waiting for a worker, as unsigned long long
+ *
+ * The running workers are reported as well, their number as "worker.count"
+ * and each of them, where <num> goes from 0 to "worker.count" - 1, as:
+ *
+ *  "worker.<num>.id" - ID of the thread, matching the thread IDs shown by
+ *                      tools like top or perf, as unsigned long long
+ *  "worker.<num>.class" - name of the job class the worker is reserved for,
+ *                         or "default" for ordinary workers, as string
+ *  "worker.<num>.job" - name of the call the worker is running, as string;
+ *                       missing if the worker is idle
+ *  "worker.<num>.cpu_time" - CPU time in nanoseconds used by the worker, as
+ *                            unsigned long long; missing if the platform
+ *                            can't tell
+ *
+ * Returns 0 on success, -1 in case of an error. Caller is responsible for
+ * deallocating @params.
+ *
+ * Since: 8.5.0
+ */
+int
+virAdmServerGetStats(virAdmServerPtr srv,
+                     virTypedParameterPtr *params,
+                     int *nparams,
+                     unsigned int flags)
+{
+    int ret = -1;
+
+    VIR_DEBUG("srv=%p, params=%p, nparams=%p, flags=0x%x",
+              srv, params, nparams, flags);
+    virResetLastError();
+
+    virCheckAdmServerGoto(srv, error);
+    virCheckNonNullArgGoto(params, error);
+    virCheckNonNullArgGoto(nparams, error);
+
+    if ((ret = remoteAdminServerGetStats(srv, params, nparams, flags)) < 0)
+        goto error;
+
+    return ret;
+ error:
+    virDispatchError(NULL);
+    return -1;
+}
+
+/**
+ * virAdmServerGetProcedureStats:
+ * @srv: a valid server object reference
+ * @params: pointer to a list of typed parameters which will be allocated
+ *          to store all returned statistics
+ * @nparams: pointer which will hold the number of params returned in @params
+ * @flags: extra flags; not used yet, so callers should always pass 0
+ *
+ * Retrieves per procedure RPC statistics of server @srv, covering every
+ * procedure which has been called since the server was started. Upon
+ * successful completion, @params will be allocated automatically to hold all
+ * returned data, setting @nparams accordingly.
+ *
+ * The number of reported procedures is returned as "proc.count", each of
+ * them is then described by the following fields, where <num> goes from
+ * 0 to "proc.count" - 1:
+ *
+ *  "proc.<num>.program" - RPC program number, as unsigned int
+ *  "proc.<num>.procedure" - procedure number within the program, as
+ *                           unsigned int
+ *  "proc.<num>.calls" - number of dispatched calls, as unsigned long long
+ *  "proc.<num>.errors" - number of calls which returned an error, as
+ *                        unsigned long long
+ *  "proc.<num>.bytes_in" - total size of the incoming calls, as unsigned
+ *                          long long
+ *  "proc.<num>.bytes_out" - total size of the successful replies, as
+ *                           unsigned long long
+ *  "proc.<num>.queued" - number of calls which were queued for a worker
+ *                        thread, as unsigned long long
+ *  "proc.<num>.queue_time" - total time in microseconds the calls spent
+ *                            waiting for a worker thread, as unsigned long
+ *                            long
+ *  "proc.<num>.dispatch_time" - total time in microseconds spent executing
+ *                               the calls, as unsigned long long
+ *  "proc.<num>.queue_hist.<bound>" - number of calls which waited for at
+ *                                    least <bound> microseconds, but less
+ *                                    than the next reported bound, as
+ *                                    unsigned long long
+ *  "proc.<num>.dispatch_hist.<bound>" - same as "queue_hist" for the time
+ *                                       spent executing the calls
+ *
+ * The histogram bounds are 0 and the powers of two; buckets which were
+ * never hit are omitted.
+ *
+ * Returns 0 on success, -1 in case of an error. Caller is responsible for
+ * deallocating @params.
+ *
+ * Since: 8.5.0
+ */
+int
+virAdmServerGetProcedureStats(virAdmServerPtr srv,
+                              virTypedParameterPtr *params,
+                              int *nparams,
+                              unsigned int flags)
+{
+    int ret = -1;
+
+    VIR_DEBUG("srv=%p, params=%p, nparams=%p, flags=0x%x",
+              srv, params, nparams, flags);
+    virResetLastError();
+
+    virCheckAdmServerGoto(srv, error);
+    virCheckNonNullArgGoto(params, error);
+    virCheckNonNullArgGoto(nparams, error);
+
+    if ((ret = remoteAdminServerGetProcedureStats(srv, params, nparams,
+                                                  flags)) < 0)
+        goto error;
+
+    return ret;
+ error:
+    virDispatchError(NULL);
+    return -1;
+}
+
 /**
  * virAdmConnectGetLoggingOutputs:
  * @conn: pointer to an active admin connection
@@ -128,6 +128,42 @@ virCHDomainObjEndJob(virDomainObj *obj)
     virCondSignal(&priv->job.cond);
 }
 
+/*
+ * obj must be locked before calling and the caller must own a job
+ *
+ * To be called immediately before any HTTP API call, so that other
+ * threads can look at the domain while the call is waiting for
+ * cloud-hypervisor. Jobs keep anything else from using the monitor.
+ *
+ * Must be followed by virCHDomainObjExitMonitor
+ */
+void
+virCHDomainObjEnterMonitor(virDomainObj *obj)
+{
+    virCHDomainObjPrivate *priv = obj->privateData;
+
+    VIR_DEBUG("Entering monitor (mon=%p vm=%p name=%s)",
+              priv->monitor, obj, obj->def->name);
+
+    if (!priv->job.active)
+        VIR_WARN("Entering a monitor without a job");
+
+    virObjectUnlock(obj);
+}
+
+/*
+ * obj must NOT be locked before calling
+ *
+ * Should be paired with an earlier virCHDomainObjEnterMonitor() call
+ */
+void
+virCHDomainObjExitMonitor(virDomainObj *obj)
+{
+    virObjectLock(obj);
+
+    VIR_DEBUG("Exited monitor (vm=%p name=%s)", obj, obj->def->name);
+}
+
 void
 virCHDomainRemoveInactive(virCHDriver *driver,
                           virDomainObj *vm)
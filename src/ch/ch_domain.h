@@ -76,6 +76,12 @@ virCHDomainObjBeginJob(virDomainObj *obj, virDomainJob job)
 void
 virCHDomainObjEndJob(virDomainObj *obj);
 
+void
+virCHDomainObjEnterMonitor(virDomainObj *obj);
+
+void
+virCHDomainObjExitMonitor(virDomainObj *obj);
+
 void
 virCHDomainRemoveInactive(virCHDriver *driver,
                           virDomainObj *vm);
@@ -409,7 +409,13 @@ chDomainShutdownFlags(virDomainPtr dom,
                        _("only can shutdown running/paused domain"));
         goto endjob;
     } else {
-        if (virCHMonitorShutdownVM(priv->monitor) < 0) {
+        int rc;
+
+        virCHDomainObjEnterMonitor(vm);
+        rc = virCHMonitorShutdownVM(priv->monitor);
+        virCHDomainObjExitMonitor(vm);
+
+        if (rc < 0) {
             virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                         _("failed to shutdown guest VM"));
             goto endjob;
@@ -465,7 +471,13 @@ chDomainReboot(virDomainPtr dom, unsigned int flags)
                        _("only can reboot running/paused domain"));
         goto endjob;
     } else {
-        if (virCHMonitorRebootVM(priv->monitor) < 0) {
+        int rc;
+
+        virCHDomainObjEnterMonitor(vm);
+        rc = virCHMonitorRebootVM(priv->monitor);
+        virCHDomainObjExitMonitor(vm);
+
+        if (rc < 0) {
             virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                            _("failed to reboot domain"));
             goto endjob;
@@ -513,7 +525,13 @@ chDomainSuspend(virDomainPtr dom)
                        _("only can suspend running domain"));
         goto endjob;
     } else {
-        if (virCHMonitorSuspendVM(priv->monitor) < 0) {
+        int rc;
+
+        virCHDomainObjEnterMonitor(vm);
+        rc = virCHMonitorSuspendVM(priv->monitor);
+        virCHDomainObjExitMonitor(vm);
+
+        if (rc < 0) {
             virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                         _("failed to suspend domain"));
             goto endjob;
@@ -558,7 +576,13 @@ chDomainResume(virDomainPtr dom)
                        _("only can resume paused domain"));
         goto endjob;
     } else {
-        if (virCHMonitorResumeVM(priv->monitor) < 0) {
+        int rc;
+
+        virCHDomainObjEnterMonitor(vm);
+        rc = virCHMonitorResumeVM(priv->monitor);
+        virCHDomainObjExitMonitor(vm);
+
+        if (rc < 0) {
             virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                         _("failed to resume domain"));
             goto endjob;
@@ -931,6 +955,7 @@ chConnectSupportsFeature(virConnectPtr conn,
         case VIR_DRV_FEATURE_REMOTE:
         case VIR_DRV_FEATURE_PROGRAM_KEEPALIVE:
         case VIR_DRV_FEATURE_REMOTE_CLOSE_CALLBACK:
+        case VIR_DRV_FEATURE_REMOTE_COMPACT_DOMAIN_STATS:
         case VIR_DRV_FEATURE_REMOTE_EVENT_CALLBACK:
         case VIR_DRV_FEATURE_TYPED_PARAM_STRING:
         case VIR_DRV_FEATURE_NETWORK_UPDATE_HAS_CORRECT_ORDER:
@@ -720,6 +720,10 @@ virCHMonitorGet(virCHMonitor *mon, const char *endpoint, virJSONValue **response
         }
 
         responseCode = virCHMonitorCurlPerform(mon->handle);
+
+        /* reset the libcurl handle to avoid leaking a stack pointer to data,
+         * the connection to cloud-hypervisor is kept open for the next call */
+        curl_easy_reset(mon->handle);
     }
 
     if (responseCode == 200 || responseCode == 204) {
@@ -735,8 +739,7 @@ virCHMonitorGet(virCHMonitor *mon, const char *endpoint, virJSONValue **response
 
  cleanup:
     g_free(data.content);
-    /* reset the libcurl handle to avoid leaking a stack pointer to data */
-    curl_easy_reset(mon->handle);
+    curl_slist_free_all(headers);
 
     return ret;
 }
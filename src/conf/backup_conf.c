@@ -135,6 +135,10 @@ virDomainBackupDiskDefParseXML(xmlNodePtr node,
     if (!push) {
         def->exportname = virXMLPropString(node, "exportname");
         def->exportbitmap = virXMLPropString(node, "exportbitmap");
+
+        if (virXMLPropUInt(node, "exportiothread", 10, VIR_XML_PROP_NONZERO,
+                           &def->exportiothread) < 0)
+            return -1;
     }
 
     if (virXMLPropEnum(node, "backupmode",
@@ -251,6 +255,10 @@ virDomainBackupDefParse(xmlXPathContextPtr ctxt,
         if (virXMLPropTristateBool(node, "tls", VIR_XML_PROP_NONE,
                                    &def->tls) < 0)
             return NULL;
+
+        if (virXMLPropUInt(node, "maxConnections", 10, VIR_XML_PROP_NONE,
+                           &def->maxConnections) < 0)
+            return NULL;
     }
 
     if ((n = virXPathNodeSet("./disks/*", ctxt, &nodes)) < 0)
@@ -349,6 +357,8 @@ virDomainBackupDiskDefFormat(virBuffer *buf,
 
         virBufferEscapeString(&attrBuf, " exportname='%s'", disk->exportname);
         virBufferEscapeString(&attrBuf, " exportbitmap='%s'", disk->exportbitmap);
+        if (disk->exportiothread)
+            virBufferAsprintf(&attrBuf, " exportiothread='%u'", disk->exportiothread);
 
         if (disk->store->id != 0)
             virBufferAsprintf(&attrBuf, " index='%u'", disk->store->id);
@@ -413,6 +423,8 @@ virDomainBackupDefFormat(virBuffer *buf,
         if (def->server->port)
             virBufferAsprintf(&serverAttrBuf, " port='%u'", def->server->port);
         virBufferEscapeString(&serverAttrBuf, " socket='%s'", def->server->socket);
+        if (def->maxConnections)
+            virBufferAsprintf(&serverAttrBuf, " maxConnections='%u'", def->maxConnections);
     }
 
     virXMLFormatElement(&childBuf, "server", &serverAttrBuf, NULL);
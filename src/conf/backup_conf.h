@@ -64,6 +64,7 @@ struct _virDomainBackupDiskDef {
     char *incremental; /* name of the starting point checkpoint of an incremental backup */
     char *exportname; /* name of the NBD export for pull mode backup */
     char *exportbitmap; /* name of the bitmap exposed in NBD for pull mode backup */
+    unsigned int exportiothread; /* iothread serving the NBD export, 0 if default */
 
     /* details of target for push-mode, or of the scratch file for pull-mode */
     virStorageSource *store;
@@ -80,6 +81,7 @@ struct _virDomainBackupDef {
     char *incremental;
     virStorageNetHostDef *server; /* only when type == PULL */
     virTristateBool tls; /* use TLS for NBD */
+    unsigned int maxConnections; /* limit of NBD client connections, 0 if unlimited */
 
     size_t ndisks; /* should not exceed dom->ndisks */
     virDomainBackupDiskDef *disks;
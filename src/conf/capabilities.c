@@ -1437,6 +1437,186 @@ virCapabilitiesHostNUMAGetMaxNode(virCapsHostNUMA *caps)
 }
 
 
+static unsigned int
+virCapabilitiesHostNUMACellDistance(virCapsHostNUMACell *cell,
+                                    int node)
+{
+    size_t i;
+
+    for (i = 0; i < cell->ndistances; i++) {
+        if ((int) cell->distances[i].cellid == node)
+            return cell->distances[i].value;
+    }
+
+    /* Defaults of the ACPI SLIT table */
+    return cell->num == node ? 10 : 20;
+}
+
+
+typedef struct _virCapsHostNUMAPlacement virCapsHostNUMAPlacement;
+struct _virCapsHostNUMAPlacement {
+    bool fits;
+    size_t nnodes;
+    bool device;
+    unsigned long long distance;
+    unsigned long long freeMem;
+};
+
+
+/* Returns true if placement @a is better than @b */
+static bool
+virCapabilitiesHostNUMAPlacementBetter(const virCapsHostNUMAPlacement *a,
+                                       const virCapsHostNUMAPlacement *b)
+{
+    if (a->fits != b->fits)
+        return a->fits;
+    if (a->nnodes != b->nnodes)
+        return a->nnodes < b->nnodes;
+    if (a->device != b->device)
+        return a->device;
+    if (a->distance != b->distance)
+        return a->distance < b->distance;
+    return a->freeMem > b->freeMem;
+}
+
+
+/* Grow a set of cells from @seed by the nearest remaining cell until the
+ * domain fits. Cells in the set are marked in @used. */
+static void
+virCapabilitiesHostNUMAPlaceFrom(virCapsHostNUMA *caps,
+                                 size_t seed,
+                                 const unsigned long long *freeMem,
+                                 const size_t *idleCpus,
+                                 virBitmap *deviceNodes,
+                                 unsigned int vcpus,
+                                 unsigned long long memory,
+                                 bool *used,
+                                 virCapsHostNUMAPlacement *placement)
+{
+    virCapsHostNUMACell *seedCell = g_ptr_array_index(caps->cells, seed);
+    size_t ncells = caps->cells->len;
+    size_t cpus = 0;
+    size_t i;
+
+    memset(used, 0, sizeof(*used) * ncells);
+    memset(placement, 0, sizeof(*placement));
+
+    while (!placement->fits && placement->nnodes < ncells) {
+        virCapsHostNUMACell *cell;
+        ssize_t next = -1;
+        unsigned int nextDistance = 0;
+
+        for (i = 0; i < ncells; i++) {
+            unsigned int distance;
+
+            if (used[i])
+                continue;
+
+            cell = g_ptr_array_index(caps->cells, i);
+            distance = virCapabilitiesHostNUMACellDistance(seedCell, cell->num);
+
+            if (next < 0 || distance < nextDistance) {
+                next = i;
+                nextDistance = distance;
+            }
+        }
+
+        cell = g_ptr_array_index(caps->cells, next);
+
+        used[next] = true;
+        placement->nnodes++;
+        placement->distance += nextDistance;
+        placement->freeMem += freeMem[next];
+        cpus += idleCpus[next];
+        if (deviceNodes && virBitmapIsBitSet(deviceNodes, cell->num))
+            placement->device = true;
+
+        placement->fits = placement->freeMem >= memory && cpus >= vcpus;
+    }
+}
+
+
+/**
+ * virCapabilitiesHostNUMAPlace:
+ * @caps: host NUMA topology
+ * @freeMem: free memory usable by the domain in each cell of @caps (KiB)
+ * @busyCpus: host CPUs already used by other domains, or NULL
+ * @deviceNodes: host nodes of devices assigned to the domain, or NULL
+ * @vcpus: number of vCPUs of the domain
+ * @memory: memory of the domain (KiB)
+ *
+ * Choose host NUMA nodes for a domain with automatic placement. Starting
+ * from each node in turn, the nearest nodes are added until there's enough
+ * free memory for the domain and enough idle CPUs for its vCPUs. The
+ * smallest such set of nodes wins, preferring sets which contain a node of
+ * an assigned device, then sets with the shortest distances and finally
+ * sets with the most free memory. If the domain doesn't fit anywhere, all
+ * nodes are returned.
+ *
+ * The @freeMem array is indexed in the order of cells in @caps.
+ *
+ * Returns bitmap of the host nodes.
+ */
+virBitmap *
+virCapabilitiesHostNUMAPlace(virCapsHostNUMA *caps,
+                             const unsigned long long *freeMem,
+                             virBitmap *busyCpus,
+                             virBitmap *deviceNodes,
+                             unsigned int vcpus,
+                             unsigned long long memory)
+{
+    size_t ncells = caps->cells->len;
+    g_autoptr(virBitmap) ret = NULL;
+    g_autofree size_t *idleCpus = g_new0(size_t, ncells);
+    g_autofree bool *used = g_new0(bool, ncells);
+    virCapsHostNUMAPlacement best = { 0 };
+    size_t bestSeed = 0;
+    size_t i;
+    size_t j;
+
+    for (i = 0; i < ncells; i++) {
+        virCapsHostNUMACell *cell = g_ptr_array_index(caps->cells, i);
+
+        for (j = 0; j < cell->ncpus; j++) {
+            if (!busyCpus || !virBitmapIsBitSet(busyCpus, cell->cpus[j].id))
+                idleCpus[i]++;
+        }
+    }
+
+    for (i = 0; i < ncells; i++) {
+        virCapsHostNUMAPlacement cur;
+
+        virCapabilitiesHostNUMAPlaceFrom(caps, i, freeMem, idleCpus,
+                                         deviceNodes, vcpus, memory,
+                                         used, &cur);
+
+        if (i == 0 || virCapabilitiesHostNUMAPlacementBetter(&cur, &best)) {
+            best = cur;
+            bestSeed = i;
+        }
+    }
+
+    if (best.fits) {
+        virCapabilitiesHostNUMAPlaceFrom(caps, bestSeed, freeMem, idleCpus,
+                                         deviceNodes, vcpus, memory,
+                                         used, &best);
+    } else {
+        for (i = 0; i < ncells; i++)
+            used[i] = true;
+    }
+
+    ret = virBitmapNew(virCapabilitiesHostNUMAGetMaxNode(caps) + 1);
+
+    for (i = 0; i < ncells; i++) {
+        virCapsHostNUMACell *cell = g_ptr_array_index(caps->cells, i);
+
+        if (used[i])
+            ignore_value(virBitmapSetBit(ret, cell->num));
+    }
+
+    return g_steal_pointer(&ret);
+}
+
 int
 virCapabilitiesGetNodeInfo(virNodeInfoPtr nodeinfo)
 {
@@ -2009,14 +2189,99 @@ virCapabilitiesHostNUMANew(void)
 }
 
 
+/* Host NUMA topology from the last virCapabilitiesHostNUMANewHost() call,
+ * valid while the host topology generation doesn't change */
+static virMutex virCapabilitiesHostNUMACacheLock = VIR_MUTEX_INITIALIZER;
+static virCapsHostNUMA *virCapabilitiesHostNUMACache;
+static unsigned int virCapabilitiesHostNUMACacheGeneration;
+
+
+/* Huge page pools can be resized at any time without a uevent */
+static bool
+virCapabilitiesHostNUMAPagesChanged(virCapsHostNUMA *caps)
+{
+    size_t i;
+
+    for (i = 0; i < caps->cells->len; i++) {
+        virCapsHostNUMACell *cell = g_ptr_array_index(caps->cells, i);
+        g_autofree virCapsHostNUMACellPageInfo *pageinfo = NULL;
+        int npageinfo = 0;
+        int j;
+
+        if (virCapabilitiesGetNUMAPagesInfo(cell->num, &pageinfo, &npageinfo) < 0) {
+            virResetLastError();
+            return true;
+        }
+
+        if (npageinfo != cell->npageinfo)
+            return true;
+
+        for (j = 0; j < npageinfo; j++) {
+            if (pageinfo[j].size != cell->pageinfo[j].size ||
+                pageinfo[j].avail != cell->pageinfo[j].avail)
+                return true;
+        }
+    }
+
+    return false;
+}
+
+
+static virCapsHostNUMA *
+virCapabilitiesHostNUMAGetCached(unsigned int generation)
+{
+    VIR_LOCK_GUARD lock = virLockGuardLock(&virCapabilitiesHostNUMACacheLock);
+
+    if (!virCapabilitiesHostNUMACache ||
+        virCapabilitiesHostNUMACacheGeneration != generation ||
+        virCapabilitiesHostNUMAPagesChanged(virCapabilitiesHostNUMACache))
+        return NULL;
+
+    virCapabilitiesHostNUMARef(virCapabilitiesHostNUMACache);
+    return virCapabilitiesHostNUMACache;
+}
+
+
+static void
+virCapabilitiesHostNUMASetCached(virCapsHostNUMA *caps,
+                                 unsigned int generation)
+{
+    VIR_LOCK_GUARD lock = virLockGuardLock(&virCapabilitiesHostNUMACacheLock);
+
+    virCapabilitiesHostNUMAUnref(virCapabilitiesHostNUMACache);
+    virCapabilitiesHostNUMARef(caps);
+    virCapabilitiesHostNUMACache = caps;
+    virCapabilitiesHostNUMACacheGeneration = generation;
+}
+
+
+/**
+ * virCapabilitiesHostNUMANewHost:
+ *
+ * Detect the NUMA topology of the host. Once host topology changes are
+ * watched (see virHostCPUTopologyWatch()), the result is cached and
+ * shared by all callers, which must not modify it.
+ *
+ * Returns a reference to the host NUMA topology or NULL on error.
+ */
 virCapsHostNUMA *
 virCapabilitiesHostNUMANewHost(void)
 {
-    virCapsHostNUMA *caps = virCapabilitiesHostNUMANew();
+    virCapsHostNUMA *caps = NULL;
+    unsigned int generation = 0;
+    bool cache = virHostCPUGetTopologyGeneration(&generation);
+
+    if (cache && (caps = virCapabilitiesHostNUMAGetCached(generation)))
+        return caps;
+
+    caps = virCapabilitiesHostNUMANew();
 
     if (virNumaIsAvailable()) {
-        if (virCapabilitiesHostNUMAInitReal(caps) == 0)
+        if (virCapabilitiesHostNUMAInitReal(caps) == 0) {
+            if (cache)
+                virCapabilitiesHostNUMASetCached(caps, generation);
             return caps;
+        }
 
         virCapabilitiesHostNUMAUnref(caps);
         caps = virCapabilitiesHostNUMANew();
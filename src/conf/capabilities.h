@@ -330,6 +330,13 @@ virBitmap *virCapabilitiesHostNUMAGetCpus(virCapsHostNUMA *caps,
 
 int virCapabilitiesHostNUMAGetMaxNode(virCapsHostNUMA *caps);
 
+virBitmap *virCapabilitiesHostNUMAPlace(virCapsHostNUMA *caps,
+                                        const unsigned long long *freeMem,
+                                        virBitmap *busyCpus,
+                                        virBitmap *deviceNodes,
+                                        unsigned int vcpus,
+                                        unsigned long long memory);
+
 int virCapabilitiesGetNodeInfo(virNodeInfoPtr nodeinfo);
 
 int virCapabilitiesInitPages(virCaps *caps);
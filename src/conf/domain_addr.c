@@ -590,31 +590,41 @@ virDomainPCIAddressBusSetModel(virDomainPCIAddressBus *bus,
 }
 
 
-bool
-virDomainPCIAddressBusIsFullyReserved(virDomainPCIAddressBus *bus)
+/* Returns the first slot of @bus, starting at @slot, with no function
+ * in use, or -1 if there is none. */
+static int
+virDomainPCIAddressBusNextFreeSlot(virDomainPCIAddressBus *bus,
+                                   size_t slot)
 {
-    size_t i;
+    uint32_t freeSlots;
 
-    for (i = bus->minSlot; i <= bus->maxSlot; i++) {
-        if (!bus->slot[i].functions)
-            return false;
-    }
+    if (slot > bus->maxSlot)
+        return -1;
 
-    return true;
+    /* bits of free slots in range [slot, maxSlot] */
+    freeSlots = ~bus->slotsInUse;
+    freeSlots &= G_MAXUINT32 << slot;
+    if (bus->maxSlot < VIR_PCI_ADDRESS_SLOT_LAST)
+        freeSlots &= (1U << (bus->maxSlot + 1)) - 1;
+
+    if (!freeSlots)
+        return -1;
+
+    return __builtin_ffs(freeSlots) - 1;
 }
 
 
-static bool ATTRIBUTE_NONNULL(1)
-virDomainPCIAddressBusIsEmpty(virDomainPCIAddressBus *bus)
+bool
+virDomainPCIAddressBusIsFullyReserved(virDomainPCIAddressBus *bus)
 {
-    size_t i;
+    return virDomainPCIAddressBusNextFreeSlot(bus, bus->minSlot) < 0;
+}
 
-    for (i = bus->minSlot; i <= bus->maxSlot; i++) {
-        if (bus->slot[i].functions)
-            return false;
-    }
 
-    return true;
+static bool ATTRIBUTE_NONNULL(1)
+virDomainPCIAddressBusIsEmpty(virDomainPCIAddressBus *bus)
+{
+    return bus->slotsInUse == 0;
 }
 
 
@@ -871,6 +881,7 @@ virDomainPCIAddressReserveAddrInternal(virDomainPCIAddressSet *addrs,
 
     /* mark the requested function as reserved */
     bus->slot[addr->slot].functions |= (1 << addr->function);
+    bus->slotsInUse |= 1U << addr->slot;
     VIR_DEBUG("Reserving PCI address %s (aggregate='%s')", addrStr,
               bus->slot[addr->slot].aggregate ? "true" : "false");
 
@@ -955,7 +966,12 @@ void
 virDomainPCIAddressReleaseAddr(virDomainPCIAddressSet *addrs,
                                virPCIDeviceAddress *addr)
 {
-    addrs->buses[addr->bus].slot[addr->slot].functions &= ~(1 << addr->function);
+    virDomainPCIAddressBus *bus = &addrs->buses[addr->bus];
+
+    bus->slot[addr->slot].functions &= ~(1 << addr->function);
+
+    if (!bus->slot[addr->slot].functions)
+        bus->slotsInUse &= ~(1U << addr->slot);
 }
 
 
@@ -1030,17 +1046,21 @@ virDomainPCIAddressFindUnusedFunctionOnBus(virDomainPCIAddressBus *bus,
                                            virDomainPCIConnectFlags flags,
                                            bool *found)
 {
-    g_autofree char *addrStr = NULL;
-
     *found = false;
 
-    if (!(addrStr = virPCIDeviceAddressAsString(searchAddr)))
-        return -1;
-
-    if (!virDomainPCIAddressFlagsCompatible(searchAddr, addrStr, bus->flags,
+    /* No error is reported, so there's no need to format the address */
+    if (!virDomainPCIAddressFlagsCompatible(searchAddr, NULL, bus->flags,
                                             flags, false, false)) {
         VIR_DEBUG("PCI bus %04x:%02x is not compatible with the device",
                   searchAddr->domain, searchAddr->bus);
+    } else if (!(flags & VIR_PCI_CONNECT_AGGREGATE_SLOT)) {
+        /* Only completely unused slots will do */
+        int slot = virDomainPCIAddressBusNextFreeSlot(bus, searchAddr->slot);
+
+        if (slot >= 0) {
+            searchAddr->slot = slot;
+            *found = true;
+        }
     } else {
         while (searchAddr->slot <= bus->maxSlot) {
             if (bus->slot[searchAddr->slot].functions == 0) {
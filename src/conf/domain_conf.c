@@ -1334,6 +1334,12 @@ VIR_ENUM_IMPL(virDomainDiskMirrorState,
               "pivot",
 );
 
+VIR_ENUM_IMPL(virDomainIOThreadPollTuning,
+              VIR_DOMAIN_IOTHREAD_POLL_TUNING_LAST,
+              "none",
+              "adaptive",
+);
+
 VIR_ENUM_IMPL(virDomainMemorySource,
               VIR_DOMAIN_MEMORY_SOURCE_LAST,
               "none",
@@ -2297,6 +2303,7 @@ virDomainDiskDefFree(virDomainDiskDef *def)
     g_free(def->domain_name);
     g_free(def->blkdeviotune.group_name);
     g_free(def->virtio);
+    g_free(def->autoextend);
     virDomainDeviceInfoClear(&def->info);
     virObjectUnref(def->privateData);
 
@@ -3867,6 +3874,8 @@ static void virDomainObjDispose(void *obj)
     virDomainObjDeprecationFree(dom);
     virDomainSnapshotObjListFree(dom->snapshots);
     virDomainCheckpointObjListFree(dom->checkpoints);
+    g_free(dom->defineHash);
+    g_free(dom->defineFormatHash);
 }
 
 virDomainObj *
@@ -8830,6 +8839,31 @@ virDomainDiskDefIotuneParse(virDomainDiskDef *def,
 #undef PARSE_IOTUNE
 
 
+static int
+virDomainDiskDefAutoExtendParse(virDomainDiskDef *def,
+                                xmlXPathContextPtr ctxt)
+{
+    VIR_XPATH_NODE_AUTORESTORE(ctxt)
+    g_autofree virDomainDiskAutoExtendDef *autoextend = NULL;
+
+    if (!(ctxt->node = virXPathNode("./autoextend", ctxt)))
+        return 0;
+
+    autoextend = g_new0(virDomainDiskAutoExtendDef, 1);
+
+    if (virParseScaledValue("./threshold", NULL, ctxt, &autoextend->threshold,
+                            1, ULLONG_MAX, true) < 0 ||
+        virParseScaledValue("./step", NULL, ctxt, &autoextend->step,
+                            1, ULLONG_MAX, true) < 0 ||
+        virParseScaledValue("./max", NULL, ctxt, &autoextend->max,
+                            1, ULLONG_MAX, false) < 0)
+        return -1;
+
+    def->autoextend = g_steal_pointer(&autoextend);
+    return 0;
+}
+
+
 static int
 virDomainDiskDefMirrorParse(virDomainDiskDef *def,
                             xmlNodePtr cur,
@@ -9278,6 +9312,9 @@ virDomainDiskDefParseXML(virDomainXMLOption *xmlopt,
     if (virDomainDiskDefIotuneParse(def, ctxt) < 0)
         return NULL;
 
+    if (virDomainDiskDefAutoExtendParse(def, ctxt) < 0)
+        return NULL;
+
     def->domain_name = virXPathString("string(./backenddomain/@name)", ctxt);
     def->serial = virXPathString("string(./serial)", ctxt);
     def->wwn = virXPathString("string(./wwn)", ctxt);
@@ -13535,6 +13572,18 @@ virDomainMemballoonDefParseXML(virDomainXMLOption *xmlopt,
             def->period = 0;
     }
 
+    if (virXPathNode("./autosize", ctxt)) {
+        def->autosize = true;
+
+        if (virDomainParseMemory("./autosize/@min", "./autosize/@unit", ctxt,
+                                 &def->autosizeMin, true, false) < 0)
+            goto error;
+
+        if (virDomainParseMemory("./autosize/@max", "./autosize/@unit", ctxt,
+                                 &def->autosizeMax, false, false) < 0)
+            goto error;
+    }
+
     if (def->model == VIR_DOMAIN_MEMBALLOON_MODEL_NONE)
         VIR_DEBUG("Ignoring device address for none model Memballoon");
     else if (virDomainDeviceInfoParseXML(xmlopt, node, ctxt,
@@ -17000,20 +17049,39 @@ virDomainIdmapDefParseXML(xmlXPathContextPtr ctxt,
  *     <iothreadids>
  *       <iothread id='1'/>
  *       <iothread id='3'/>
- *       <iothread id='5'/>
+ *       <iothread id='5'>
+ *         <poll tuning='adaptive' budget='10'/>
+ *       </iothread>
  *       <iothread id='7'/>
  *     </iothreadids>
  */
 static virDomainIOThreadIDDef *
-virDomainIOThreadIDDefParseXML(xmlNodePtr node)
+virDomainIOThreadIDDefParseXML(xmlNodePtr node,
+                               xmlXPathContextPtr ctxt)
 {
     g_autoptr(virDomainIOThreadIDDef) iothrid = g_new0(virDomainIOThreadIDDef, 1);
+    VIR_XPATH_NODE_AUTORESTORE(ctxt)
+    xmlNodePtr poll;
+
+    ctxt->node = node;
 
     if (virXMLPropUInt(node, "id", 10,
                        VIR_XML_PROP_REQUIRED | VIR_XML_PROP_NONZERO,
                        &iothrid->iothread_id) < 0)
         return NULL;
 
+    if ((poll = virXPathNode("./poll", ctxt))) {
+        if (virXMLPropEnum(poll, "tuning",
+                           virDomainIOThreadPollTuningTypeFromString,
+                           VIR_XML_PROP_REQUIRED | VIR_XML_PROP_NONZERO,
+                           &iothrid->pollTuning) < 0)
+            return NULL;
+
+        if (virXMLPropUInt(poll, "budget", 10, VIR_XML_PROP_NONZERO,
+                           &iothrid->pollBudget) < 0)
+            return NULL;
+    }
+
     return g_steal_pointer(&iothrid);
 }
 
@@ -17047,7 +17115,7 @@ virDomainDefParseIOThreads(virDomainDef *def,
 
     for (i = 0; i < n; i++) {
         virDomainIOThreadIDDef *iothrid = NULL;
-        if (!(iothrid = virDomainIOThreadIDDefParseXML(nodes[i])))
+        if (!(iothrid = virDomainIOThreadIDDefParseXML(nodes[i], ctxt)))
             return -1;
 
         if (virDomainIOThreadIDFind(def, iothrid->iothread_id)) {
@@ -23545,6 +23613,27 @@ virDomainDiskDefFormatIotune(virBuffer *buf,
 #undef FORMAT_IOTUNE
 
 
+static void
+virDomainDiskDefFormatAutoExtend(virBuffer *buf,
+                                 virDomainDiskDef *disk)
+{
+    g_auto(virBuffer) childBuf = VIR_BUFFER_INIT_CHILD(buf);
+
+    if (!disk->autoextend)
+        return;
+
+    virBufferAsprintf(&childBuf, "<threshold unit='bytes'>%llu</threshold>\n",
+                      disk->autoextend->threshold);
+    virBufferAsprintf(&childBuf, "<step unit='bytes'>%llu</step>\n",
+                      disk->autoextend->step);
+    if (disk->autoextend->max)
+        virBufferAsprintf(&childBuf, "<max unit='bytes'>%llu</max>\n",
+                          disk->autoextend->max);
+
+    virXMLFormatElement(buf, "autoextend", NULL, &childBuf);
+}
+
+
 static void
 virDomainDiskDefFormatDriver(virBuffer *buf,
                              virDomainDiskDef *disk)
@@ -23802,6 +23891,7 @@ virDomainDiskDefFormat(virBuffer *buf,
     virBufferAddLit(&childBuf, "/>\n");
 
     virDomainDiskDefFormatIotune(&childBuf, def);
+    virDomainDiskDefFormatAutoExtend(&childBuf, def);
 
     if (def->src->readonly)
         virBufferAddLit(&childBuf, "<readonly/>\n");
@@ -25805,6 +25895,13 @@ virDomainMemballoonDefFormat(virBuffer *buf,
     if (def->period)
         virBufferAsprintf(&childrenBuf, "<stats period='%i'/>\n", def->period);
 
+    if (def->autosize) {
+        virBufferAsprintf(&childrenBuf, "<autosize min='%llu'", def->autosizeMin);
+        if (def->autosizeMax)
+            virBufferAsprintf(&childrenBuf, " max='%llu'", def->autosizeMax);
+        virBufferAddLit(&childrenBuf, " unit='KiB'/>\n");
+    }
+
     virDomainDeviceInfoFormat(&childrenBuf, &def->info, flags);
 
     virDomainVirtioOptionsFormat(&driverAttrBuf, def->virtio);
@@ -27573,7 +27670,8 @@ virDomainDefIothreadShouldFormat(virDomainDef *def)
     size_t i;
 
     for (i = 0; i < def->niothreadids; i++) {
-        if (!def->iothreadids[i]->autofill)
+        if (!def->iothreadids[i]->autofill ||
+            def->iothreadids[i]->pollTuning)
             return true;
     }
 
@@ -28233,8 +28331,22 @@ virDomainDefFormatInternalSetRootName(virDomainDef *def,
             virBufferAddLit(buf, "<iothreadids>\n");
             virBufferAdjustIndent(buf, 2);
             for (i = 0; i < def->niothreadids; i++) {
-                virBufferAsprintf(buf, "<iothread id='%u'/>\n",
-                                  def->iothreadids[i]->iothread_id);
+                virDomainIOThreadIDDef *iothread = def->iothreadids[i];
+                g_auto(virBuffer) attrBuf = VIR_BUFFER_INITIALIZER;
+                g_auto(virBuffer) childBuf = VIR_BUFFER_INIT_CHILD(buf);
+                g_auto(virBuffer) pollAttrBuf = VIR_BUFFER_INITIALIZER;
+
+                virBufferAsprintf(&attrBuf, " id='%u'", iothread->iothread_id);
+
+                if (iothread->pollTuning)
+                    virBufferAsprintf(&pollAttrBuf, " tuning='%s'",
+                                      virDomainIOThreadPollTuningTypeToString(iothread->pollTuning));
+                if (iothread->pollBudget)
+                    virBufferAsprintf(&pollAttrBuf, " budget='%u'",
+                                      iothread->pollBudget);
+
+                virXMLFormatElement(&childBuf, "poll", &pollAttrBuf, NULL);
+                virXMLFormatElement(buf, "iothread", &attrBuf, &childBuf);
             }
             virBufferAdjustIndent(buf, -2);
             virBufferAddLit(buf, "</iothreadids>\n");
@@ -28656,43 +28768,60 @@ virDomainDefFormat(virDomainDef *def,
 }
 
 
-char *
-virDomainObjFormat(virDomainObj *obj,
-                   virDomainXMLOption *xmlopt,
-                   unsigned int flags)
+static int
+virDomainObjFormatBuf(virBuffer *buf,
+                      virDomainObj *obj,
+                      virDomainXMLOption *xmlopt,
+                      unsigned int flags)
 {
-    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
     int state;
     int reason;
     size_t i;
 
     state = virDomainObjGetState(obj, &reason);
-    virBufferAsprintf(&buf, "<domstatus state='%s' reason='%s' pid='%lld'>\n",
+    virBufferAsprintf(buf, "<domstatus state='%s' reason='%s' pid='%lld'>\n",
                       virDomainStateTypeToString(state),
                       virDomainStateReasonToString(state, reason),
                       (long long)obj->pid);
-    virBufferAdjustIndent(&buf, 2);
+    virBufferAdjustIndent(buf, 2);
 
     for (i = 0; i < VIR_DOMAIN_TAINT_LAST; i++) {
         if (obj->taint & (1 << i))
-            virBufferAsprintf(&buf, "<taint flag='%s'/>\n",
+            virBufferAsprintf(buf, "<taint flag='%s'/>\n",
                               virDomainTaintTypeToString(i));
     }
 
     for (i = 0; i < obj->ndeprecations; i++) {
-        virBufferEscapeString(&buf, "<deprecation>%s</deprecation>\n",
+        virBufferEscapeString(buf, "<deprecation>%s</deprecation>\n",
                               obj->deprecations[i]);
     }
 
     if (xmlopt->privateData.format &&
-        xmlopt->privateData.format(&buf, obj) < 0)
-        return NULL;
+        xmlopt->privateData.format(buf, obj) < 0)
+        return -1;
+
+    if (virDomainDefFormatInternal(obj->def, xmlopt, buf, flags) < 0)
+        return -1;
+
+    virBufferAdjustIndent(buf, -2);
+    virBufferAddLit(buf, "</domstatus>\n");
+
+    return 0;
+}
 
-    if (virDomainDefFormatInternal(obj->def, xmlopt, &buf, flags) < 0)
+char *
+virDomainObjFormat(virDomainObj *obj,
+                   virDomainXMLOption *xmlopt,
+                   unsigned int flags)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+
+    virBufferSizeHint(&buf, obj->formatSizeHint);
+
+    if (virDomainObjFormatBuf(&buf, obj, xmlopt, flags) < 0)
         return NULL;
 
-    virBufferAdjustIndent(&buf, -2);
-    virBufferAddLit(&buf, "</domstatus>\n");
+    obj->formatSizeHint = virBufferUse(&buf);
 
     return virBufferContentAndReset(&buf);
 }
@@ -28823,63 +28952,388 @@ virDomainDefCompatibleDevice(virDomainDef *def,
     return 0;
 }
 
-static int
-virDomainDefSaveXML(virDomainDef *def,
-                    const char *configDir,
-                    const char *xml)
+/* flags used for formatting status XML of domain objects */
+#define VIR_DOMAIN_DEF_FORMAT_STATUS_FLAGS \
+    (VIR_DOMAIN_DEF_FORMAT_SECURE | \
+     VIR_DOMAIN_DEF_FORMAT_STATUS | \
+     VIR_DOMAIN_DEF_FORMAT_ACTUAL_NET | \
+     VIR_DOMAIN_DEF_FORMAT_PCI_ORIG_STATES | \
+     VIR_DOMAIN_DEF_FORMAT_CLOCK_ADJUST)
+
+
+/*
+ * Returns path of the XML file of domain @name in @configDir, which is
+ * created if needed, or NULL on error.
+ */
+static char *
+virDomainSaveFilePrepare(const char *configDir,
+                         const char *name)
 {
-    char uuidstr[VIR_UUID_STRING_BUFLEN];
     g_autofree char *configFile = NULL;
 
-    if (!configDir)
-        return 0;
-
-    if ((configFile = virDomainConfigFile(configDir, def->name)) == NULL)
-        return -1;
+    if ((configFile = virDomainConfigFile(configDir, name)) == NULL)
+        return NULL;
 
     if (g_mkdir_with_parents(configDir, 0777) < 0) {
         virReportSystemError(errno,
                              _("cannot create config directory '%s'"),
                              configDir);
-        return -1;
+        return NULL;
     }
 
-    virUUIDFormat(def->uuid, uuidstr);
+    return g_steal_pointer(&configFile);
+}
+
+
+/**
+ * virDomainSaveXML:
+ * @name: name of the domain
+ * @uuid: UUID of the domain
+ * @configDir: directory to save the XML in
+ * @xml: formatted config or status XML
+ *
+ * Saves XML formatted earlier, e.g. while holding the lock of the domain
+ * object which doesn't need to be held anymore while writing it.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virDomainSaveXML(const char *name,
+                 const unsigned char *uuid,
+                 const char *configDir,
+                 const char *xml)
+{
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
+    g_autofree char *configFile = NULL;
+
+    if (!configDir)
+        return 0;
+
+    if (!(configFile = virDomainSaveFilePrepare(configDir, name)))
+        return -1;
+
+    virUUIDFormat(uuid, uuidstr);
     return virXMLSaveFile(configFile,
-                           virXMLPickShellSafeComment(def->name, uuidstr), "edit",
+                           virXMLPickShellSafeComment(name, uuidstr), "edit",
                            xml);
 }
 
+
+struct virDomainSaveFormatData {
+    virDomainDef *def;
+    virDomainObj *obj;
+    virDomainXMLOption *xmlopt;
+    unsigned int flags;
+};
+
+
+static int
+virDomainSaveFormat(virBuffer *buf,
+                    const void *opaque)
+{
+    const struct virDomainSaveFormatData *data = opaque;
+
+    if (data->obj)
+        return virDomainObjFormatBuf(buf, data->obj, data->xmlopt, data->flags);
+
+    return virDomainDefFormatInternal(data->def, data->xmlopt, buf, data->flags);
+}
+
+
+/*
+ * Formats the XML described by @data straight into the file, so that
+ * saving domains with many devices doesn't need to hold all of the
+ * XML in memory.
+ */
+static int
+virDomainSaveStream(const char *configDir,
+                    const struct virDomainSaveFormatData *data)
+{
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
+    g_autofree char *configFile = NULL;
+
+    if (!configDir)
+        return 0;
+
+    if (!(configFile = virDomainSaveFilePrepare(configDir, data->def->name)))
+        return -1;
+
+    virUUIDFormat(data->def->uuid, uuidstr);
+    return virXMLSaveFileFormat(configFile,
+                                virXMLPickShellSafeComment(data->def->name,
+                                                           uuidstr),
+                                "edit", virDomainSaveFormat, data);
+}
+
 int
 virDomainDefSave(virDomainDef *def,
                  virDomainXMLOption *xmlopt,
                  const char *configDir)
 {
+    struct virDomainSaveFormatData data = {
+        .def = def,
+        .xmlopt = xmlopt,
+        .flags = VIR_DOMAIN_DEF_FORMAT_SECURE,
+    };
+
+    return virDomainSaveStream(configDir, &data);
+}
+
+/**
+ * virDomainObjFormatStatus:
+ * @obj: domain object
+ * @xmlopt: XML parser configuration
+ *
+ * Formats the status XML of @obj as written by virDomainObjSave.
+ *
+ * Returns the XML on success, NULL on error.
+ */
+char *
+virDomainObjFormatStatus(virDomainObj *obj,
+                         virDomainXMLOption *xmlopt)
+{
+    return virDomainObjFormat(obj, xmlopt, VIR_DOMAIN_DEF_FORMAT_STATUS_FLAGS);
+}
+
+
+struct virDomainObjMemoryUsageData {
+    virDomainXMLOption *xmlopt;
+    const char *uuidstr;
+    unsigned long long size;
+    size_t count;
+    int ret;
+};
+
+
+static int
+virDomainObjSnapshotMemoryUsage(void *payload,
+                                const char *name G_GNUC_UNUSED,
+                                void *opaque)
+{
+    struct virDomainObjMemoryUsageData *data = opaque;
     g_autofree char *xml = NULL;
 
-    if (!(xml = virDomainDefFormat(def, xmlopt, VIR_DOMAIN_DEF_FORMAT_SECURE)))
+    if (!(xml = virDomainSnapshotDefFormat(data->uuidstr,
+                                           virDomainSnapshotObjGetDef(payload),
+                                           data->xmlopt,
+                                           VIR_DOMAIN_SNAPSHOT_FORMAT_SECURE |
+                                           VIR_DOMAIN_SNAPSHOT_FORMAT_INTERNAL))) {
+        data->ret = -1;
+        return -1;
+    }
+
+    data->size += sizeof(virDomainSnapshotDef) + strlen(xml);
+    data->count++;
+    return 0;
+}
+
+
+static int
+virDomainObjCheckpointMemoryUsage(void *payload,
+                                  const char *name G_GNUC_UNUSED,
+                                  void *opaque)
+{
+    struct virDomainObjMemoryUsageData *data = opaque;
+    g_autofree char *xml = NULL;
+
+    if (!(xml = virDomainCheckpointDefFormat(virDomainCheckpointObjGetDef(payload),
+                                             data->xmlopt,
+                                             VIR_DOMAIN_CHECKPOINT_FORMAT_SECURE))) {
+        data->ret = -1;
         return -1;
+    }
 
-    return virDomainDefSaveXML(def, configDir, xml);
+    data->size += sizeof(virDomainCheckpointDef) + strlen(xml);
+    data->count++;
+    return 0;
 }
 
+
+/**
+ * virDomainObjGetMemoryUsage:
+ * @obj: locked domain object
+ * @xmlopt: XML parser configuration
+ * @usage: filled with the memory usage
+ *
+ * Estimates the memory the daemon uses to hold @obj. Parsed definitions
+ * take roughly as much memory as their XML, so the sizes are computed
+ * from the length of the XML formatted from them, which is costly for
+ * domains with many snapshots.
+ *
+ * Returns 0 on success, -1 on error.
+ */
 int
-virDomainObjSave(virDomainObj *obj,
-                 virDomainXMLOption *xmlopt,
-                 const char *statusDir)
+virDomainObjGetMemoryUsage(virDomainObj *obj,
+                           virDomainXMLOption *xmlopt,
+                           virDomainObjMemoryUsage *usage)
+{
+    virDomainDef *defs[] = { obj->def, obj->newDef };
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
+    struct virDomainObjMemoryUsageData data = { .xmlopt = xmlopt };
+    size_t i;
+
+    memset(usage, 0, sizeof(*usage));
+
+    for (i = 0; i < G_N_ELEMENTS(defs); i++) {
+        g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+
+        if (!defs[i])
+            continue;
+
+        virBufferSizeHint(&buf, obj->formatSizeHint);
+        if (virDomainDefFormatInternal(defs[i], xmlopt, &buf,
+                                       VIR_DOMAIN_DEF_FORMAT_SECURE) < 0)
+            return -1;
+
+        usage->definition += sizeof(virDomainDef) + virBufferUse(&buf);
+    }
+
+    if (xmlopt->privateData.format) {
+        g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+
+        if (xmlopt->privateData.format(&buf, obj) < 0)
+            return -1;
+
+        usage->privateData = virBufferUse(&buf);
+    }
+
+    virUUIDFormat(obj->def->uuid, uuidstr);
+    data.uuidstr = uuidstr;
+
+    if (obj->snapshots) {
+        virDomainSnapshotForEach(obj->snapshots,
+                                 virDomainObjSnapshotMemoryUsage, &data);
+        if (data.ret < 0)
+            return -1;
+
+        usage->snapshots = data.size;
+        usage->nsnapshots = data.count;
+    }
+
+    if (obj->checkpoints) {
+        data.size = 0;
+        data.count = 0;
+        virDomainCheckpointForEach(obj->checkpoints,
+                                   virDomainObjCheckpointMemoryUsage, &data);
+        if (data.ret < 0)
+            return -1;
+
+        usage->checkpoints = data.size;
+        usage->ncheckpoints = data.count;
+    }
+
+    return 0;
+}
+
+
+/**
+ * virDomainDefParseHash:
+ * @xml: domain XML document
+ * @flags: bitwise-OR of virDomainDefParseFlags used to parse @xml
+ *
+ * Returns SHA-256 checksum identifying a definition parsed from @xml with
+ * @flags, as a hex string. Drivers use it to recognize documents that
+ * were defined from before.
+ */
+char *
+virDomainDefParseHash(const char *xml,
+                      unsigned int flags)
 {
-    unsigned int flags = (VIR_DOMAIN_DEF_FORMAT_SECURE |
-                          VIR_DOMAIN_DEF_FORMAT_STATUS |
-                          VIR_DOMAIN_DEF_FORMAT_ACTUAL_NET |
-                          VIR_DOMAIN_DEF_FORMAT_PCI_ORIG_STATES |
-                          VIR_DOMAIN_DEF_FORMAT_CLOCK_ADJUST);
+    g_autoptr(GChecksum) sum = g_checksum_new(G_CHECKSUM_SHA256);
 
+    g_checksum_update(sum, (const guchar *)&flags, sizeof(flags));
+    g_checksum_update(sum, (const guchar *)xml, -1);
+
+    return g_strdup(g_checksum_get_string(sum));
+}
+
+
+static char *
+virDomainObjDefineFormatHash(virDomainObj *vm,
+                             virDomainXMLOption *xmlopt)
+{
+    virDomainDef *def = vm->newDef ? vm->newDef : vm->def;
     g_autofree char *xml = NULL;
 
-    if (!(xml = virDomainObjFormat(obj, xmlopt, flags)))
-        return -1;
+    if (!(xml = virDomainDefFormat(def, xmlopt, VIR_DOMAIN_DEF_FORMAT_SECURE)))
+        return NULL;
+
+    return g_compute_checksum_for_string(G_CHECKSUM_SHA256, xml, -1);
+}
+
+
+/**
+ * virDomainObjSetDefineHash:
+ * @vm: locked domain object
+ * @xmlopt: XML parser configuration
+ * @hash: virDomainDefParseHash of the XML @vm was just defined from
+ *
+ * Records that the persistent definition of @vm was defined from the XML
+ * identified by @hash, so that virDomainObjCheckDefineHash can recognize
+ * an attempt to define the same XML again.
+ */
+void
+virDomainObjSetDefineHash(virDomainObj *vm,
+                          virDomainXMLOption *xmlopt,
+                          const char *hash)
+{
+    g_clear_pointer(&vm->defineHash, g_free);
+    g_clear_pointer(&vm->defineFormatHash, g_free);
+
+    if (!(vm->defineFormatHash = virDomainObjDefineFormatHash(vm, xmlopt))) {
+        virResetLastError();
+        return;
+    }
+
+    vm->defineHash = g_strdup(hash);
+}
+
+
+/**
+ * virDomainObjCheckDefineHash:
+ * @vm: locked domain object
+ * @xmlopt: XML parser configuration
+ * @hash: virDomainDefParseHash of XML about to be defined
+ *
+ * Checks whether @vm is persistent, was last defined from the XML
+ * identified by @hash and its persistent definition was not changed since.
+ * Checking the latter costs formatting the definition, which spares
+ * writing out and syncing the configuration file.
+ *
+ * Returns true if defining the XML again would not change anything.
+ */
+bool
+virDomainObjCheckDefineHash(virDomainObj *vm,
+                            virDomainXMLOption *xmlopt,
+                            const char *hash)
+{
+    g_autofree char *formatHash = NULL;
+
+    if (!vm->persistent || !vm->defineHash || STRNEQ(vm->defineHash, hash))
+        return false;
+
+    if (!(formatHash = virDomainObjDefineFormatHash(vm, xmlopt))) {
+        virResetLastError();
+        return false;
+    }
+
+    return STREQ_NULLABLE(formatHash, vm->defineFormatHash);
+}
+
+
+int
+virDomainObjSave(virDomainObj *obj,
+                 virDomainXMLOption *xmlopt,
+                 const char *statusDir)
+{
+    struct virDomainSaveFormatData data = {
+        .def = obj->def,
+        .obj = obj,
+        .xmlopt = xmlopt,
+        .flags = VIR_DOMAIN_DEF_FORMAT_STATUS_FLAGS,
+    };
 
-    return virDomainDefSaveXML(obj->def, statusDir, xml);
+    return virDomainSaveStream(statusDir, &data);
 }
 
 
@@ -551,6 +551,14 @@ VIR_ENUM_DECL(virDomainSnapshotLocation);
 
 
 /* Stores the virtual disk configuration */
+/* Policy for extending the volume of a disk as the guest writes into it */
+typedef struct _virDomainDiskAutoExtendDef virDomainDiskAutoExtendDef;
+struct _virDomainDiskAutoExtendDef {
+    unsigned long long threshold; /* extend when less free space is left, in bytes */
+    unsigned long long step; /* size to extend by, in bytes */
+    unsigned long long max; /* maximum size of the volume in bytes, 0 if unlimited */
+};
+
 struct _virDomainDiskDef {
     virStorageSource *src; /* non-NULL.  XXX Allow NULL for empty cdrom? */
 
@@ -609,6 +617,7 @@ struct _virDomainDiskDef {
     unsigned int queue_size;
     virDomainDiskModel model;
     virDomainVirtioOptions *virtio;
+    virDomainDiskAutoExtendDef *autoextend;
 
     bool diskElementAuth;
     bool diskElementEnc;
@@ -2019,6 +2028,11 @@ struct _virDomainMemballoonDef {
     virTristateSwitch autodeflate;
     virTristateSwitch free_page_reporting;
     virDomainVirtioOptions *virtio;
+
+    /* balloon target adjusted by the hypervisor driver within bounds */
+    bool autosize;
+    unsigned long long autosizeMin; /* in KiB */
+    unsigned long long autosizeMax; /* in KiB, 0 for the whole memory */
 };
 
 struct _virDomainNVRAMDef {
@@ -2639,6 +2653,13 @@ struct _virDomainHugePage {
 
 #define VIR_DOMAIN_CPUMASK_LEN 16384
 
+typedef enum {
+    VIR_DOMAIN_IOTHREAD_POLL_TUNING_NONE = 0,
+    VIR_DOMAIN_IOTHREAD_POLL_TUNING_ADAPTIVE,
+
+    VIR_DOMAIN_IOTHREAD_POLL_TUNING_LAST
+} virDomainIOThreadPollTuning;
+
 struct _virDomainIOThreadIDDef {
     bool autofill;
     unsigned int iothread_id;
@@ -2646,6 +2667,9 @@ struct _virDomainIOThreadIDDef {
     virBitmap *cpumask;
 
     virDomainThreadSchedParam sched;
+
+    virDomainIOThreadPollTuning pollTuning;
+    unsigned int pollBudget; /* in percent of a host CPU, 0 for default */
 };
 
 void virDomainIOThreadIDDefFree(virDomainIOThreadIDDef *def);
@@ -3082,6 +3106,16 @@ struct _virDomainObj {
     int taint;
     size_t ndeprecations;
     char **deprecations;
+
+    /* Length of the XML last formatted by virDomainObjFormat, used to
+     * preallocate buffers for formatting XML of the domain */
+    size_t formatSizeHint;
+
+    /* Hash of the XML and parse flags the persistent definition was last
+     * defined from and hash of the persistent definition formatted right
+     * after that, see virDomainObjSetDefineHash */
+    char *defineHash;
+    char *defineFormatHash;
 };
 
 G_DEFINE_AUTOPTR_CLEANUP_FUNC(virDomainObj, virObjectUnref);
@@ -3623,6 +3657,37 @@ char *virDomainObjFormat(virDomainObj *obj,
                          virDomainXMLOption *xmlopt,
                          unsigned int flags)
     ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
+char *virDomainObjFormatStatus(virDomainObj *obj,
+                               virDomainXMLOption *xmlopt)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
+
+typedef struct _virDomainObjMemoryUsage virDomainObjMemoryUsage;
+struct _virDomainObjMemoryUsage {
+    /* approximate bytes used by the live and persistent definitions */
+    unsigned long long definition;
+    /* approximate bytes used by the private data of the driver */
+    unsigned long long privateData;
+    unsigned long long snapshots;
+    size_t nsnapshots;
+    unsigned long long checkpoints;
+    size_t ncheckpoints;
+};
+
+int virDomainObjGetMemoryUsage(virDomainObj *obj,
+                               virDomainXMLOption *xmlopt,
+                               virDomainObjMemoryUsage *usage)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2) ATTRIBUTE_NONNULL(3);
+char *virDomainDefParseHash(const char *xml,
+                            unsigned int flags)
+    ATTRIBUTE_NONNULL(1);
+void virDomainObjSetDefineHash(virDomainObj *vm,
+                               virDomainXMLOption *xmlopt,
+                               const char *hash)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2) ATTRIBUTE_NONNULL(3);
+bool virDomainObjCheckDefineHash(virDomainObj *vm,
+                                 virDomainXMLOption *xmlopt,
+                                 const char *hash)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2) ATTRIBUTE_NONNULL(3);
 int virDomainDefFormatInternal(virDomainDef *def,
                                virDomainXMLOption *xmlopt,
                                virBuffer *buf,
@@ -3828,6 +3893,14 @@ int virDomainObjSave(virDomainObj *obj,
     ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2)
     ATTRIBUTE_NONNULL(3);
 
+int virDomainSaveXML(const char *name,
+                     const unsigned char *uuid,
+                     const char *configDir,
+                     const char *xml)
+    G_GNUC_WARN_UNUSED_RESULT
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2)
+    ATTRIBUTE_NONNULL(4);
+
 typedef void (*virDomainLoadConfigNotify)(virDomainObj *dom,
                                           int newDomain,
                                           void *opaque);
@@ -4030,6 +4103,7 @@ VIR_ENUM_DECL(virDomainTPMVersion);
 VIR_ENUM_DECL(virDomainTPMPcrBank);
 VIR_ENUM_DECL(virDomainMemoryModel);
 VIR_ENUM_DECL(virDomainMemoryBackingModel);
+VIR_ENUM_DECL(virDomainIOThreadPollTuning);
 VIR_ENUM_DECL(virDomainMemorySource);
 VIR_ENUM_DECL(virDomainMemoryAllocation);
 VIR_ENUM_DECL(virDomainIOMMUModel);
@@ -49,6 +49,7 @@ static virClass *virDomainEventBalloonChangeClass;
 static virClass *virDomainEventDeviceRemovedClass;
 static virClass *virDomainEventPMClass;
 static virClass *virDomainQemuMonitorEventClass;
+static virClass *virDomainStatsEventClass;
 static virClass *virDomainEventTunableClass;
 static virClass *virDomainEventAgentLifecycleClass;
 static virClass *virDomainEventDeviceAddedClass;
@@ -73,6 +74,7 @@ static void virDomainEventBalloonChangeDispose(void *obj);
 static void virDomainEventDeviceRemovedDispose(void *obj);
 static void virDomainEventPMDispose(void *obj);
 static void virDomainQemuMonitorEventDispose(void *obj);
+static void virDomainStatsEventDispose(void *obj);
 static void virDomainEventTunableDispose(void *obj);
 static void virDomainEventAgentLifecycleDispose(void *obj);
 static void virDomainEventDeviceAddedDispose(void *obj);
@@ -96,6 +98,12 @@ virDomainQemuMonitorEventDispatchFunc(virConnectPtr conn,
                                       virConnectObjectEventGenericCallback cb,
                                       void *cbopaque);
 
+static void
+virDomainStatsEventDispatchFunc(virConnectPtr conn,
+                                virObjectEvent *event,
+                                virConnectObjectEventGenericCallback cb,
+                                void *cbopaque);
+
 struct _virDomainEvent {
     virObjectEvent parent;
 
@@ -213,6 +221,15 @@ struct _virDomainQemuMonitorEvent {
 };
 typedef struct _virDomainQemuMonitorEvent virDomainQemuMonitorEvent;
 
+struct _virDomainStatsEvent {
+    virObjectEvent parent;
+
+    int callbackID; /* subscription the event is meant for, or -1 */
+    virTypedParameterPtr params;
+    int nparams;
+};
+typedef struct _virDomainStatsEvent virDomainStatsEvent;
+
 struct _virDomainEventTunable {
     virDomainEvent parent;
 
@@ -319,6 +336,8 @@ virDomainEventsOnceInit(void)
         return -1;
     if (!VIR_CLASS_NEW(virDomainQemuMonitorEvent, virClassForObjectEvent()))
         return -1;
+    if (!VIR_CLASS_NEW(virDomainStatsEvent, virClassForObjectEvent()))
+        return -1;
     if (!VIR_CLASS_NEW(virDomainEventTunable, virDomainEventClass))
         return -1;
     if (!VIR_CLASS_NEW(virDomainEventAgentLifecycle, virDomainEventClass))
@@ -492,6 +511,15 @@ virDomainQemuMonitorEventDispose(void *obj)
     g_free(event->details);
 }
 
+static void
+virDomainStatsEventDispose(void *obj)
+{
+    virDomainStatsEvent *event = obj;
+    VIR_DEBUG("obj=%p", event);
+
+    virTypedParamsFree(event->params, event->nparams);
+}
+
 static void
 virDomainEventTunableDispose(void *obj)
 {
@@ -592,6 +620,12 @@ virDomainEventNew(virClass *klass,
                                     id, name, uuid, uuidstr)))
         return NULL;
 
+    /* These only report the current value of a property, so only
+     * the latest one is of interest to a lagging client */
+    if (eventID == VIR_DOMAIN_EVENT_ID_BALLOON_CHANGE ||
+        eventID == VIR_DOMAIN_EVENT_ID_RTC_CHANGE)
+        event->parent.coalesce = true;
+
     return (virObjectEvent *)event;
 }
 
@@ -2124,6 +2158,84 @@ virDomainQemuMonitorEventDispatchFunc(virConnectPtr conn,
 }
 
 
+/**
+ * virDomainStatsEventNew:
+ * @id: domain ID
+ * @name: domain name
+ * @uuid: domain UUID
+ * @callbackID: subscription the event is meant for, or -1 for any
+ * @params: statistics, ownership is transferred to the event
+ * @nparams: number of items in @params
+ *
+ * Creates an event delivering statistics to subscribers registered with
+ * virDomainStatsEventStateRegisterID().
+ */
+virObjectEvent *
+virDomainStatsEventNew(int id,
+                       const char *name,
+                       const unsigned char *uuid,
+                       int callbackID,
+                       virTypedParameterPtr params,
+                       int nparams)
+{
+    virDomainStatsEvent *ev;
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
+
+    if (virDomainEventsInitialize() < 0)
+        goto error;
+
+    virUUIDFormat(uuid, uuidstr);
+    if (!(ev = virObjectEventNew(virDomainStatsEventClass,
+                                 virDomainStatsEventDispatchFunc,
+                                 0, id, name, uuid, uuidstr)))
+        goto error;
+
+    ev->callbackID = callbackID;
+    ev->params = params;
+    ev->nparams = nparams;
+
+    return (virObjectEvent *)ev;
+
+ error:
+    virTypedParamsFree(params, nparams);
+    return NULL;
+}
+
+
+/* Stats events are sent to a single subscription, so the callback ID
+ * assigned at registration is kept in a wrapper around the caller's
+ * opaque data for the filter to match against. */
+struct virDomainStatsEventData {
+    int callbackID;
+    void *opaque;
+    virFreeCallback freecb;
+};
+typedef struct virDomainStatsEventData virDomainStatsEventData;
+
+
+static void
+virDomainStatsEventDispatchFunc(virConnectPtr conn,
+                                virObjectEvent *event,
+                                virConnectObjectEventGenericCallback cb,
+                                void *cbopaque)
+{
+    virDomainPtr dom;
+    virDomainStatsEvent *statsEvent;
+    virDomainStatsEventData *data = cbopaque;
+
+    if (!(dom = virGetDomain(conn, event->meta.name,
+                             event->meta.uuid, event->meta.id)))
+        return;
+
+    statsEvent = (virDomainStatsEvent *)event;
+    ((virConnectDomainStatsCallback)cb)(conn, dom,
+                                        statsEvent->params,
+                                        statsEvent->nparams,
+                                        data->opaque);
+    virObjectUnref(dom);
+}
+
+
 /**
  * virDomainEventStateRegister:
  * @conn: connection to associate with callback
@@ -2330,6 +2442,94 @@ virDomainQemuMonitorEventFilter(virConnectPtr conn G_GNUC_UNUSED,
 }
 
 
+/**
+ * virDomainStatsEventFilter:
+ * @conn: the connection pointer
+ * @event: the event about to be dispatched
+ * @opaque: the opaque data registered with the filter
+ *
+ * Callback for filtering stats events meant for other subscriptions.
+ * Returns true if the event should be dispatched.
+ */
+static bool
+virDomainStatsEventFilter(virConnectPtr conn G_GNUC_UNUSED,
+                          virObjectEvent *event,
+                          void *opaque)
+{
+    virDomainStatsEventData *data = opaque;
+    virDomainStatsEvent *statsEvent = (virDomainStatsEvent *) event;
+
+    return statsEvent->callbackID < 0 ||
+        statsEvent->callbackID == data->callbackID;
+}
+
+
+static void
+virDomainStatsEventCleanup(void *opaque)
+{
+    virDomainStatsEventData *data = opaque;
+
+    if (data->freecb)
+        (data->freecb)(data->opaque);
+    g_free(data);
+}
+
+
+/**
+ * virDomainStatsEventStateRegisterID:
+ * @conn: connection to associate with callback
+ * @state: object event state
+ * @dom: optional domain where event must occur
+ * @cb: function to invoke when event occurs
+ * @opaque: data blob to pass to callback
+ * @freecb: callback to free @opaque
+ * @callbackID: filled with callback ID
+ *
+ * Register the function @cb with connection @conn, from @state, for
+ * stats events. Each registration is matched by exactly one subscription,
+ * events created with its @callbackID are dispatched to it only.
+ *
+ * Returns: the number of callbacks now registered, or -1 on error
+ */
+int
+virDomainStatsEventStateRegisterID(virConnectPtr conn,
+                                   virObjectEventState *state,
+                                   virDomainPtr dom,
+                                   virConnectDomainStatsCallback cb,
+                                   void *opaque,
+                                   virFreeCallback freecb,
+                                   int *callbackID)
+{
+    virDomainStatsEventData *data = NULL;
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
+    int ret;
+
+    if (virDomainEventsInitialize() < 0)
+        return -1;
+
+    data = g_new0(virDomainStatsEventData, 1);
+    data->callbackID = -1;
+    data->opaque = opaque;
+    data->freecb = freecb;
+
+    if (dom)
+        virUUIDFormat(dom->uuid, uuidstr);
+    ret = virObjectEventStateRegisterID(conn, state, dom ? uuidstr : NULL,
+                                        virDomainStatsEventFilter, data,
+                                        virDomainStatsEventClass, 0,
+                                        VIR_OBJECT_EVENT_CALLBACK(cb),
+                                        data, virDomainStatsEventCleanup,
+                                        false, callbackID, false);
+    if (ret < 0) {
+        g_free(data);
+        return -1;
+    }
+
+    data->callbackID = *callbackID;
+    return ret;
+}
+
+
 static void
 virDomainQemuMonitorEventCleanup(void *opaque)
 {
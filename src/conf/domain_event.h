@@ -335,6 +335,26 @@ virDomainQemuMonitorEventStateRegisterID(virConnectPtr conn,
     ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2) ATTRIBUTE_NONNULL(5)
     ATTRIBUTE_NONNULL(9);
 
+int
+virDomainStatsEventStateRegisterID(virConnectPtr conn,
+                                   virObjectEventState *state,
+                                   virDomainPtr dom,
+                                   virConnectDomainStatsCallback cb,
+                                   void *opaque,
+                                   virFreeCallback freecb,
+                                   int *callbackID)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2) ATTRIBUTE_NONNULL(4)
+    ATTRIBUTE_NONNULL(7);
+
+virObjectEvent *
+virDomainStatsEventNew(int id,
+                       const char *name,
+                       const unsigned char *uuid,
+                       int callbackID,
+                       virTypedParameterPtr params,
+                       int nparams)
+    ATTRIBUTE_NONNULL(2) ATTRIBUTE_NONNULL(3);
+
 virObjectEvent *
 virDomainQemuMonitorEventNew(int id,
                              const char *name,
@@ -902,6 +902,20 @@ virDomainDiskDefValidate(const virDomainDef *def,
         return -1;
     }
 
+    if (disk->autoextend) {
+        if (disk->src->type != VIR_STORAGE_TYPE_VOLUME) {
+            virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
+                           _("automatic extension is supported only for disks of type 'volume'"));
+            return -1;
+        }
+
+        if (disk->autoextend->threshold == 0 || disk->autoextend->step == 0) {
+            virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
+                           _("threshold and step of automatic extension must be greater than zero"));
+            return -1;
+        }
+    }
+
     return 0;
 }
 
@@ -1664,6 +1678,73 @@ virDomainDefCputuneValidate(const virDomainDef *def)
 #undef CPUTUNE_VALIDATE_QUOTA
 
 
+static int
+virDomainDefIOThreadsValidate(const virDomainDef *def)
+{
+    size_t i;
+
+    for (i = 0; i < def->niothreadids; i++) {
+        const virDomainIOThreadIDDef *iothread = def->iothreadids[i];
+
+        if (iothread->pollBudget &&
+            iothread->pollTuning != VIR_DOMAIN_IOTHREAD_POLL_TUNING_ADAPTIVE) {
+            virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
+                           _("polling budget of iothread '%u' requires adaptive polling"),
+                           iothread->iothread_id);
+            return -1;
+        }
+
+        if (iothread->pollBudget > 100) {
+            virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
+                           _("polling budget of iothread '%u' must be in range [1, 100]"),
+                           iothread->iothread_id);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+static int
+virDomainDefMemballoonValidate(const virDomainDef *def)
+{
+    const virDomainMemballoonDef *memballoon = def->memballoon;
+    unsigned long long total = virDomainDefGetMemoryTotal(def);
+
+    if (!memballoon || !memballoon->autosize)
+        return 0;
+
+    if (memballoon->model == VIR_DOMAIN_MEMBALLOON_MODEL_NONE) {
+        virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
+                       _("balloon autosize requires a memballoon device"));
+        return -1;
+    }
+
+    if (memballoon->period == 0) {
+        virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
+                       _("balloon autosize requires a statistics period"));
+        return -1;
+    }
+
+    if (memballoon->autosizeMax &&
+        memballoon->autosizeMax < memballoon->autosizeMin) {
+        virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
+                       _("balloon autosize minimum must not exceed its maximum"));
+        return -1;
+    }
+
+    if (memballoon->autosizeMin > total ||
+        memballoon->autosizeMax > total) {
+        virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
+                       _("balloon autosize bounds must not exceed the domain memory"));
+        return -1;
+    }
+
+    return 0;
+}
+
+
 static int
 virDomainDefIOMMUValidate(const virDomainDef *def)
 {
@@ -1753,6 +1834,12 @@ virDomainDefValidateInternal(const virDomainDef *def,
     if (virDomainDefCputuneValidate(def) < 0)
         return -1;
 
+    if (virDomainDefIOThreadsValidate(def) < 0)
+        return -1;
+
+    if (virDomainDefMemballoonValidate(def) < 0)
+        return -1;
+
     if (virDomainDefBootValidate(def) < 0)
         return -1;
 
@@ -2951,7 +2951,7 @@ virNWFilterRuleDefDetailsFormat(virBuffer *buf,
 }
 
 
-static int
+int
 virNWFilterRuleDefFormat(virBuffer *buf,
                          virNWFilterRuleDef *def)
 {
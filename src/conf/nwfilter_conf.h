@@ -541,6 +541,10 @@ virNWFilterDefParseNode(xmlDocPtr xml,
 char *
 virNWFilterDefFormat(const virNWFilterDef *def);
 
+int
+virNWFilterRuleDefFormat(virBuffer *buf,
+                         virNWFilterRuleDef *def);
+
 int
 virNWFilterSaveConfig(const char *configDir,
                       virNWFilterDef *def);
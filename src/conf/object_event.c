@@ -37,6 +37,12 @@
 
 VIR_LOG_INIT("conf.object_event");
 
+struct _virObjectEventQueue {
+    size_t count;
+    virObjectEvent **events;
+};
+typedef struct _virObjectEventQueue virObjectEventQueue;
+
 struct _virObjectEventCallback {
     int callbackID;
     virClass *klass;
@@ -52,6 +58,13 @@ struct _virObjectEventCallback {
     virFreeCallback freecb;
     bool deleted;
     bool legacy; /* true if end user does not know callbackID */
+
+    /* Delivery policy, see virObjectEventStateSetCallbackPolicy() */
+    unsigned int coalesceMs;
+    size_t maxQueued;
+    virObjectEventQueue pending;
+    unsigned long long pendingDue; /* monotonic time in ms */
+    unsigned long long dropped;
 };
 typedef struct _virObjectEventCallback virObjectEventCallback;
 
@@ -61,12 +74,6 @@ struct _virObjectEventCallbackList {
     virObjectEventCallback **callbacks;
 };
 
-struct _virObjectEventQueue {
-    size_t count;
-    virObjectEvent **events;
-};
-typedef struct _virObjectEventQueue virObjectEventQueue;
-
 struct _virObjectEventState {
     virObjectLockable parent;
     /* The list of domain event callbacks */
@@ -77,13 +84,20 @@ struct _virObjectEventState {
     int timer;
     /* Flag if we're in process of dispatching */
     bool isDispatching;
+    /* Number of events dropped by bounded callback queues */
+    unsigned long long dropped;
 };
 
+/* Delivery policy applied to newly registered callbacks */
+static unsigned int virObjectEventDefaultCoalesceMs;
+static size_t virObjectEventDefaultMaxQueued;
+
 static virClass *virObjectEventClass;
 static virClass *virObjectEventStateClass;
 
 static void virObjectEventDispose(void *obj);
 static void virObjectEventStateDispose(void *obj);
+static void virObjectEventQueueClear(virObjectEventQueue *queue);
 
 static int
 virObjectEventOnceInit(void)
@@ -138,6 +152,7 @@ virObjectEventCallbackFree(virObjectEventCallback *cb)
         return;
 
     virObjectUnref(cb->conn);
+    virObjectEventQueueClear(&cb->pending);
     g_free(cb->key);
     g_free(cb);
 }
@@ -159,6 +174,7 @@ virObjectEventCallbackListFree(virObjectEventCallbackList *list)
         virFreeCallback freecb = list->callbacks[i]->freecb;
         if (freecb)
             (*freecb)(list->callbacks[i]->opaque);
+        virObjectEventQueueClear(&list->callbacks[i]->pending);
         g_free(list->callbacks[i]);
     }
     g_free(list->callbacks);
@@ -439,6 +455,8 @@ virObjectEventCallbackListAddID(virConnectPtr conn,
     cb->filter = filter;
     cb->filter_opaque = filter_opaque;
     cb->legacy = legacy;
+    cb->coalesceMs = virObjectEventDefaultCoalesceMs;
+    cb->maxQueued = virObjectEventDefaultMaxQueued;
 
     VIR_APPEND_ELEMENT(cbList->callbacks, cbList->count, cb);
 
@@ -669,6 +687,53 @@ virObjectEventDispatchMatchCallback(virObjectEvent *event,
 }
 
 
+/**
+ * virObjectEventCallbackDefer:
+ * @state: the event state object
+ * @cb: callback with a coalescing policy
+ * @event: the event to defer
+ *
+ * Appends @event to the pending queue of @cb. A coalescable event
+ * replaces any pending event of the same object, so that only the
+ * latest one is delivered. If the queue grows beyond its bound,
+ * the oldest pending event is dropped.
+ */
+static void
+virObjectEventCallbackDefer(virObjectEventState *state,
+                            virObjectEventCallback *cb,
+                            virObjectEvent *event)
+{
+    virObjectEventQueue *pending = &cb->pending;
+    size_t i;
+
+    if (event->coalesce) {
+        for (i = 0; i < pending->count; i++) {
+            if (pending->events[i]->eventID == event->eventID &&
+                STREQ(pending->events[i]->meta.key, event->meta.key)) {
+                virObjectUnref(pending->events[i]);
+                VIR_DELETE_ELEMENT(pending->events, i, pending->count);
+                break;
+            }
+        }
+    }
+
+    if (pending->count == 0)
+        cb->pendingDue = g_get_monotonic_time() / 1000 + cb->coalesceMs;
+
+    virObjectRef(event);
+    VIR_APPEND_ELEMENT(pending->events, pending->count, event);
+
+    if (cb->maxQueued && pending->count > cb->maxQueued) {
+        if (cb->dropped++ == 0)
+            VIR_WARN("Event queue of callback %d is full, dropping events",
+                     cb->callbackID);
+        state->dropped++;
+        virObjectUnref(pending->events[0]);
+        VIR_DELETE_ELEMENT(pending->events, 0, pending->count);
+    }
+}
+
+
 static void
 virObjectEventStateDispatchCallbacks(virObjectEventState *state,
                                      virObjectEvent *event,
@@ -686,6 +751,14 @@ virObjectEventStateDispatchCallbacks(virObjectEventState *state,
         if (!virObjectEventDispatchMatchCallback(event, cb))
             continue;
 
+        /* Events which cannot be coalesced are still delivered
+         * right away, unless they have to wait behind pending
+         * ones to preserve ordering */
+        if ((cb->coalesceMs && event->coalesce) || cb->pending.count) {
+            virObjectEventCallbackDefer(state, cb, event);
+            continue;
+        }
+
         /* Drop the lock while dispatching, for sake of re-entrance */
         virObjectUnlock(state);
         event->dispatch(cb->conn, event, cb->cb, cb->opaque);
@@ -711,6 +784,64 @@ virObjectEventStateQueueDispatch(virObjectEventState *state,
 }
 
 
+/**
+ * virObjectEventStateDispatchPending:
+ * @state: the event state object
+ * @callbacks: the callback list
+ *
+ * Delivers the pending events of all callbacks whose coalescing
+ * interval has elapsed.
+ *
+ * Returns the number of milliseconds until the next pending queue
+ * is due, or -1 if there is none.
+ */
+static int
+virObjectEventStateDispatchPending(virObjectEventState *state,
+                                   virObjectEventCallbackList *callbacks)
+{
+    unsigned long long now = g_get_monotonic_time() / 1000;
+    unsigned long long next = 0;
+    size_t cbCount = callbacks->count;
+    size_t i;
+    size_t j;
+
+    for (i = 0; i < cbCount; i++) {
+        virObjectEventCallback *cb = callbacks->callbacks[i];
+        virObjectEventQueue queue;
+
+        if (cb->deleted || cb->pending.count == 0)
+            continue;
+
+        if (cb->pendingDue > now) {
+            if (!next || cb->pendingDue < next)
+                next = cb->pendingDue;
+            continue;
+        }
+
+        queue.count = cb->pending.count;
+        queue.events = g_steal_pointer(&cb->pending.events);
+        cb->pending.count = 0;
+
+        for (j = 0; j < queue.count; j++) {
+            virObjectEvent *event = queue.events[j];
+
+            if (!cb->deleted) {
+                virObjectUnlock(state);
+                event->dispatch(cb->conn, event, cb->cb, cb->opaque);
+                virObjectLock(state);
+            }
+            virObjectUnref(event);
+        }
+        g_free(queue.events);
+    }
+
+    if (!next)
+        return -1;
+
+    return MIN(next - now, INT_MAX);
+}
+
+
 /**
  * virObjectEventStateQueueRemote:
  * @state: the event state object
@@ -790,6 +921,7 @@ static void
 virObjectEventStateFlush(virObjectEventState *state)
 {
     virObjectEventQueue tempQueue;
+    int nextDue;
 
     /* We need to lock as well as ref due to the fact that we might
      * unref the state we're working on in this very function */
@@ -809,6 +941,8 @@ virObjectEventStateFlush(virObjectEventState *state)
                                      &tempQueue,
                                      state->callbacks);
 
+    nextDue = virObjectEventStateDispatchPending(state, state->callbacks);
+
     /* Purge any deleted callbacks */
     virObjectEventCallbackListPurgeMarked(state->callbacks);
 
@@ -816,6 +950,11 @@ virObjectEventStateFlush(virObjectEventState *state)
      * well like virObjectEventStateDeregisterID() would do. */
     virObjectEventStateCleanupTimer(state, true);
 
+    /* Come back once the earliest pending queue is due, unless new
+     * events arrived meanwhile and the timer fires right away */
+    if (state->timer != -1 && nextDue >= 0 && state->queue->count == 0)
+        virEventUpdateTimeout(state->timer, nextDue);
+
     state->isDispatching = false;
     virObjectUnlock(state);
     virObjectUnref(state);
@@ -1065,3 +1204,93 @@ virObjectEventStateSetRemote(virConnectPtr conn,
     }
     virObjectUnlock(state);
 }
+
+
+/**
+ * virObjectEventStateSetCallbackPolicy:
+ * @conn: connection associated with the callback
+ * @state: object event state
+ * @callbackID: the callback to adjust
+ * @coalesceMs: coalescing interval in milliseconds, 0 to disable
+ * @maxQueued: maximum number of pending events, 0 for no limit
+ *
+ * Changes the delivery policy of @callbackID for connection @conn.
+ * With a non-zero @coalesceMs, events which only describe the latest
+ * state of an object (e.g. balloon changes) are held back for up to
+ * @coalesceMs milliseconds and superseded by newer events of the
+ * same object in the meantime. Other events are delivered right away
+ * unless they have to wait behind held back events. At most
+ * @maxQueued events are kept pending for the callback; beyond that
+ * the oldest ones are dropped. Events delivered right away never
+ * count against @maxQueued, so it has no effect without @coalesceMs.
+ *
+ * Returns 0 on success, -1 with an error reported if @callbackID
+ * is not registered.
+ */
+int
+virObjectEventStateSetCallbackPolicy(virConnectPtr conn,
+                                     virObjectEventState *state,
+                                     int callbackID,
+                                     unsigned int coalesceMs,
+                                     size_t maxQueued)
+{
+    VIR_LOCK_GUARD lock = virObjectLockGuard(state);
+    size_t i;
+
+    for (i = 0; i < state->callbacks->count; i++) {
+        virObjectEventCallback *cb = state->callbacks->callbacks[i];
+
+        if (cb->deleted)
+            continue;
+
+        if (cb->callbackID == callbackID && cb->conn == conn) {
+            cb->coalesceMs = coalesceMs;
+            cb->maxQueued = maxQueued;
+            /* Have anything pending flushed if coalescing got disabled */
+            if (cb->pending.count && state->timer != -1)
+                virEventUpdateTimeout(state->timer, 0);
+            if (!coalesceMs)
+                cb->pendingDue = 0;
+            return 0;
+        }
+    }
+
+    virReportError(VIR_ERR_INVALID_ARG,
+                   _("event callback id %d not registered"),
+                   callbackID);
+    return -1;
+}
+
+
+/**
+ * virObjectEventStateGetDropped:
+ * @state: object event state
+ *
+ * Returns the number of events dropped by bounded callback queues
+ * of @state.
+ */
+unsigned long long
+virObjectEventStateGetDropped(virObjectEventState *state)
+{
+    VIR_LOCK_GUARD lock = virObjectLockGuard(state);
+
+    return state->dropped;
+}
+
+
+/**
+ * virObjectEventSetDefaultPolicy:
+ * @coalesceMs: coalescing interval in milliseconds, 0 to disable
+ * @maxQueued: maximum number of pending events, 0 for no limit
+ *
+ * Sets the delivery policy of callbacks registered from now on, see
+ * virObjectEventStateSetCallbackPolicy(). This is meant to be called
+ * once during daemon startup.
+ */
+void
+virObjectEventSetDefaultPolicy(unsigned int coalesceMs,
+                               size_t maxQueued)
+{
+    virObjectEventDefaultCoalesceMs = coalesceMs;
+    virObjectEventDefaultMaxQueued = maxQueued;
+}
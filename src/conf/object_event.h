@@ -85,3 +85,19 @@ virObjectEventStateSetRemote(virConnectPtr conn,
                              int callbackID,
                              int remoteID)
     ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
+
+int
+virObjectEventStateSetCallbackPolicy(virConnectPtr conn,
+                                     virObjectEventState *state,
+                                     int callbackID,
+                                     unsigned int coalesceMs,
+                                     size_t maxQueued)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
+
+unsigned long long
+virObjectEventStateGetDropped(virObjectEventState *state)
+    ATTRIBUTE_NONNULL(1);
+
+void
+virObjectEventSetDefaultPolicy(unsigned int coalesceMs,
+                               size_t maxQueued);
@@ -45,6 +45,7 @@ struct  __attribute__((aligned(8))) _virObjectEvent {
     int eventID;
     virObjectMeta meta;
     int remoteID;
+    bool coalesce; /* a newer event of the same object supersedes this one */
     virObjectEventDispatchFunc dispatch;
 };
 
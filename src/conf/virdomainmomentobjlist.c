@@ -68,47 +68,54 @@ virDomainMomentForEachChild(virDomainMomentObj *moment,
     return moment->nchildren;
 }
 
-struct moment_act_on_descendant {
-    int number;
-    virHashIterator iter;
-    void *data;
-};
-
-static int
-virDomainMomentActOnDescendant(void *payload,
-                               const char *name,
-                               void *data)
+/* Push children of @moment onto @stack so that they are popped in
+ * the order of the list of children. */
+static void
+virDomainMomentPushChildren(GPtrArray *stack,
+                            virDomainMomentObj *moment)
 {
-    virDomainMomentObj *obj = payload;
-    struct moment_act_on_descendant *curr = data;
-    virDomainMomentObj tmp = *obj;
-
-    /* Careful: curr->iter can delete obj, hence the need for tmp */
-    (curr->iter)(payload, name, curr->data);
-    curr->number += 1 + virDomainMomentForEachDescendant(&tmp,
-                                                         curr->iter,
-                                                         curr->data);
-    return 0;
+    virDomainMomentObj *child;
+    size_t i = stack->len;
+    size_t j;
+
+    for (child = moment->first_child; child; child = child->sibling)
+        g_ptr_array_add(stack, child);
+
+    for (j = stack->len; i + 1 < j; i++, j--) {
+        gpointer tmp = stack->pdata[i];
+
+        stack->pdata[i] = stack->pdata[j - 1];
+        stack->pdata[j - 1] = tmp;
+    }
 }
 
+
 /* Run iter(data) on all descendants of moment, while ignoring all
  * other entries in moments.  Return the number of descendants
- * visited.  The visit is guaranteed to be topological, but no
- * particular order between siblings is guaranteed.  */
+ * visited.  The visit is guaranteed to be topological and matches a
+ * depth-first walk through the lists of children.  The walk doesn't
+ * recurse, so that long chains of moments can't exhaust the stack.  */
 int
 virDomainMomentForEachDescendant(virDomainMomentObj *moment,
                                  virHashIterator iter,
                                  void *data)
 {
-    struct moment_act_on_descendant act;
+    g_autoptr(GPtrArray) stack = g_ptr_array_new();
+    int number = 0;
+
+    virDomainMomentPushChildren(stack, moment);
 
-    act.number = 0;
-    act.iter = iter;
-    act.data = data;
-    virDomainMomentForEachChild(moment,
-                                virDomainMomentActOnDescendant, &act);
+    while (stack->len > 0) {
+        virDomainMomentObj *obj = g_ptr_array_remove_index(stack, stack->len - 1);
 
-    return act.number;
+        /* Careful: iter can delete obj, so its children must be
+         * collected first */
+        virDomainMomentPushChildren(stack, obj);
+        (iter)(obj, obj->def->name, data);
+        number++;
+    }
+
+    return number;
 }
 
 
@@ -119,23 +126,23 @@ virDomainMomentForEachDescendant(virDomainMomentObj *moment,
 void
 virDomainMomentDropParent(virDomainMomentObj *moment)
 {
-    virDomainMomentObj *prev = NULL;
-    virDomainMomentObj *curr = NULL;
-
-    moment->parent->nchildren--;
-    curr = moment->parent->first_child;
-    while (curr != moment) {
-        if (!curr) {
-            VIR_WARN("inconsistent moment relations");
-            return;
-        }
-        prev = curr;
-        curr = curr->sibling;
+    virDomainMomentObj *parent = moment->parent;
+
+    if (moment->prev_sibling) {
+        moment->prev_sibling->sibling = moment->sibling;
+    } else if (parent->first_child == moment) {
+        parent->first_child = moment->sibling;
+    } else {
+        VIR_WARN("inconsistent moment relations");
+        return;
     }
-    if (prev)
-        prev->sibling = g_steal_pointer(&moment->sibling);
-    else
-        moment->parent->first_child = g_steal_pointer(&moment->sibling);
+
+    if (moment->sibling)
+        moment->sibling->prev_sibling = moment->prev_sibling;
+
+    parent->nchildren--;
+    moment->sibling = NULL;
+    moment->prev_sibling = NULL;
     moment->parent = NULL;
 }
 
@@ -156,7 +163,10 @@ virDomainMomentSetParent(virDomainMomentObj *moment,
 {
     moment->parent = parent;
     parent->nchildren++;
+    moment->prev_sibling = NULL;
     moment->sibling = parent->first_child;
+    if (parent->first_child)
+        parent->first_child->prev_sibling = moment;
     parent->first_child = moment;
 }
 
@@ -195,6 +205,8 @@ virDomainMomentMoveChildren(virDomainMomentObj *from,
         child->parent = to;
         if (!child->sibling) {
             child->sibling = to->first_child;
+            if (to->first_child)
+                to->first_child->prev_sibling = child;
             break;
         }
         child = child->sibling;
@@ -468,14 +480,18 @@ virDomainMomentForEach(virDomainMomentObjList *moments,
 }
 
 
-/* Struct and callback function used as a hash table callback; each call
- * inspects the pre-existing moment->def->parent_name field, and adjusts
- * the moment->parent field as well as the parent's child fields to
- * wire up the hierarchical relations for the given moment.  The error
- * indicator gets set if a parent is missing or a requested parent would
- * cause a circular parent chain.  */
+/* Struct and callback functions used as hash table callbacks; the
+ * first one inspects the pre-existing moment->def->parent_name field,
+ * and adjusts the moment->parent field as well as the parent's child
+ * fields to wire up the hierarchical relations for the given moment.
+ * Moments not reachable from the metaroot afterwards are part of a
+ * circular parent chain or descend from one, the second one breaks
+ * such chains by turning one moment of each into a root.  The error
+ * indicator gets set if a parent is missing or a requested parent
+ * would cause a circular parent chain.  */
 struct moment_set_relation {
     virDomainMomentObjList *moments;
+    GHashTable *reachable;
     int err;
 };
 static int
@@ -485,45 +501,77 @@ virDomainMomentSetRelations(void *payload,
 {
     virDomainMomentObj *obj = payload;
     struct moment_set_relation *curr = data;
-    virDomainMomentObj *tmp;
     virDomainMomentObj *parent;
 
     parent = virDomainMomentFindByName(curr->moments, obj->def->parent_name);
-    if (!parent) {
-        parent = &curr->moments->metaroot;
+    if (!parent || parent == obj) {
         if (obj->def->parent_name) {
             curr->err = -1;
-            VIR_WARN("moment %s lacks parent %s", obj->def->name,
-                     obj->def->parent_name);
-        }
-    } else {
-        tmp = parent;
-        while (tmp && tmp->def) {
-            if (tmp == obj) {
-                curr->err = -1;
-                parent = &curr->moments->metaroot;
+            if (parent)
                 VIR_WARN("moment %s in circular chain", obj->def->name);
-                break;
-            }
-            tmp = tmp->parent;
+            else
+                VIR_WARN("moment %s lacks parent %s", obj->def->name,
+                         obj->def->parent_name);
         }
+        parent = &curr->moments->metaroot;
     }
     virDomainMomentSetParent(obj, parent);
     return 0;
 }
 
 
+static int
+virDomainMomentMarkReachable(void *payload,
+                             const char *name G_GNUC_UNUSED,
+                             void *data)
+{
+    struct moment_set_relation *curr = data;
+
+    g_hash_table_add(curr->reachable, payload);
+    return 0;
+}
+
+
+static int
+virDomainMomentBreakCycle(void *payload,
+                          const char *name G_GNUC_UNUSED,
+                          void *data)
+{
+    virDomainMomentObj *obj = payload;
+    struct moment_set_relation *curr = data;
+
+    if (g_hash_table_contains(curr->reachable, obj))
+        return 0;
+
+    curr->err = -1;
+    VIR_WARN("moment %s in circular chain", obj->def->name);
+    virDomainMomentDropParent(obj);
+    virDomainMomentSetParent(obj, &curr->moments->metaroot);
+
+    g_hash_table_add(curr->reachable, obj);
+    virDomainMomentForEachDescendant(obj, virDomainMomentMarkReachable, curr);
+    return 0;
+}
+
+
 /* Populate parent link and child count of all moments, with all
  * assigned defs having relations starting as 0/NULL. Return 0 on
  * success, -1 if a parent is missing or if a circular relationship
- * was requested. */
+ * was requested. This is linear in the number of moments. */
 int
 virDomainMomentUpdateRelations(virDomainMomentObjList *moments)
 {
-    struct moment_set_relation act = { moments, 0 };
+    g_autoptr(GHashTable) reachable = g_hash_table_new(NULL, NULL);
+    struct moment_set_relation act = { moments, reachable, 0 };
 
     virDomainMomentDropChildren(&moments->metaroot);
     virHashForEach(moments->objs, virDomainMomentSetRelations, &act);
+
+    virDomainMomentForEachDescendant(&moments->metaroot,
+                                     virDomainMomentMarkReachable, &act);
+    if (g_hash_table_size(reachable) < virHashSize(moments->objs))
+        virHashForEach(moments->objs, virDomainMomentBreakCycle, &act);
+
     if (act.err)
         moments->current = NULL;
     return act.err;
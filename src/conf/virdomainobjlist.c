@@ -29,8 +29,11 @@
 #include "snapshot_conf.h"
 #include "viralloc.h"
 #include "virfile.h"
+#include "virhashcode.h"
 #include "virlog.h"
 #include "virstring.h"
+#include "virthreadpool.h"
+#include "virxml.h"
 #include "virdomainsnapshotobjlist.h"
 #include "virdomaincheckpointobjlist.h"
 
@@ -42,18 +45,38 @@ static virClass *virDomainObjListClass;
 static void virDomainObjListDispose(void *obj);
 
 
-struct _virDomainObjList {
-    virObjectRWLockable parent;
+/* Number of shards the domain hash tables are split into */
+#define VIR_DOMAIN_OBJ_LIST_SHARDS 32
 
-    /* uuid string -> virDomainObj  mapping
-     * for O(1), lookup-by-uuid */
+typedef struct _virDomainObjListShard virDomainObjListShard;
+struct _virDomainObjListShard {
+    virRWLock lock;
+
+    /* raw uuid -> virDomainObj mapping of domains whose
+     * UUID hashes into this shard */
     GHashTable *objs;
 
-    /* name -> virDomainObj mapping for O(1),
-     * lookup-by-name */
+    /* name -> virDomainObj mapping of domains whose
+     * name hashes into this shard */
     GHashTable *objsName;
 };
 
+/*
+ * Lookups only take the read lock of the shard holding the key, so they
+ * never wait for lookups or modifications of other shards. Operations
+ * modifying the list (add, remove, rename) are serialized by the write lock
+ * of the list object itself and write lock the affected shards only for
+ * the duration of the hash table update. Neither lock is ever held while
+ * waiting for a domain object lock; code that holds a domain object lock
+ * may take a shard lock.
+ */
+struct _virDomainObjList {
+    virObjectRWLockable parent;
+
+    virDomainObjListShard *shards;
+    size_t nshards;
+};
+
 
 static int virDomainObjListOnceInit(void)
 {
@@ -68,6 +91,7 @@ VIR_ONCE_GLOBAL_INIT(virDomainObjList);
 virDomainObjList *virDomainObjListNew(void)
 {
     virDomainObjList *doms;
+    size_t i;
 
     if (virDomainObjListInitialize() < 0)
         return NULL;
@@ -75,8 +99,23 @@ virDomainObjList *virDomainObjListNew(void)
     if (!(doms = virObjectRWLockableNew(virDomainObjListClass)))
         return NULL;
 
-    doms->objs = virHashNew(virObjectFreeHashData);
-    doms->objsName = virHashNew(virObjectFreeHashData);
+    doms->shards = g_new0(virDomainObjListShard, VIR_DOMAIN_OBJ_LIST_SHARDS);
+
+    for (i = 0; i < VIR_DOMAIN_OBJ_LIST_SHARDS; i++) {
+        virDomainObjListShard *shard = doms->shards + i;
+
+        if (virRWLockInit(&shard->lock) < 0) {
+            virReportSystemError(errno, "%s",
+                                 _("Unable to initialize RW lock"));
+            virObjectUnref(doms);
+            return NULL;
+        }
+
+        shard->objs = virHashNewUUID(virObjectFreeHashData);
+        shard->objsName = virHashNew(virObjectFreeHashData);
+        doms->nshards++;
+    }
+
     return doms;
 }
 
@@ -84,9 +123,91 @@ virDomainObjList *virDomainObjListNew(void)
 static void virDomainObjListDispose(void *obj)
 {
     virDomainObjList *doms = obj;
+    size_t i;
+
+    for (i = 0; i < doms->nshards; i++) {
+        virDomainObjListShard *shard = doms->shards + i;
+
+        g_clear_pointer(&shard->objs, g_hash_table_unref);
+        g_clear_pointer(&shard->objsName, g_hash_table_unref);
+        virRWLockDestroy(&shard->lock);
+    }
+
+    g_free(doms->shards);
+}
+
+
+/*
+ * @key is either a name or a raw UUID as selected by @byName.
+ */
+static virDomainObjListShard *
+virDomainObjListGetShard(virDomainObjList *doms,
+                         const void *key,
+                         bool byName)
+{
+    unsigned int hash;
+
+    if (byName)
+        hash = g_str_hash(key);
+    else
+        hash = virHashCodeGen(key, VIR_UUID_BUFLEN, 0);
+
+    return doms->shards + (hash % doms->nshards);
+}
+
+
+/*
+ * Look up @key in the table of its shard selected by @byName and return a
+ * new reference to the domain object, which is not locked.
+ */
+static virDomainObj *
+virDomainObjListLookup(virDomainObjList *doms,
+                       const void *key,
+                       bool byName)
+{
+    virDomainObjListShard *shard = virDomainObjListGetShard(doms, key, byName);
+    virDomainObj *obj;
+
+    virRWLockRead(&shard->lock);
+    obj = g_hash_table_lookup(byName ? shard->objsName : shard->objs, key);
+    virObjectRef(obj);
+    virRWLockUnlock(&shard->lock);
+
+    return obj;
+}
+
+
+/*
+ * Returns a new reference to each domain object on the list at the time
+ * of the call. Shards are read locked one at a time, so this never blocks
+ * lookups or modifications for longer than it takes to copy one shard.
+ */
+static virDomainObj **
+virDomainObjListSnapshot(virDomainObjList *doms,
+                         size_t *nvms)
+{
+    virDomainObj **vms = NULL;
+    size_t i;
+
+    *nvms = 0;
+
+    for (i = 0; i < doms->nshards; i++) {
+        virDomainObjListShard *shard = doms->shards + i;
+        GHashTableIter iter;
+        void *obj;
 
-    g_clear_pointer(&doms->objs, g_hash_table_unref);
-    g_clear_pointer(&doms->objsName, g_hash_table_unref);
+        virRWLockRead(&shard->lock);
+
+        VIR_REALLOC_N(vms, *nvms + virHashSize(shard->objs));
+
+        g_hash_table_iter_init(&iter, shard->objs);
+        while (g_hash_table_iter_next(&iter, NULL, &obj))
+            vms[(*nvms)++] = virObjectRef(obj);
+
+        virRWLockUnlock(&shard->lock);
+    }
+
+    return vms;
 }
 
 
@@ -111,12 +232,22 @@ virDomainObj *
 virDomainObjListFindByID(virDomainObjList *doms,
                          int id)
 {
-    virDomainObj *obj;
+    virDomainObj **vms = NULL;
+    size_t nvms = 0;
+    virDomainObj *obj = NULL;
+    size_t i;
+
+    vms = virDomainObjListSnapshot(doms, &nvms);
+
+    for (i = 0; i < nvms; i++) {
+        if (virDomainObjListSearchID(vms[i], NULL, &id)) {
+            obj = virObjectRef(vms[i]);
+            break;
+        }
+    }
+
+    virObjectListFreeCount(vms, nvms);
 
-    virObjectRWLockRead(doms);
-    obj = virHashSearch(doms->objs, virDomainObjListSearchID, &id, NULL);
-    virObjectRef(obj);
-    virObjectRWUnlock(doms);
     if (obj) {
         virObjectLock(obj);
         if (obj->removing)
@@ -131,15 +262,11 @@ static virDomainObj *
 virDomainObjListFindByUUIDLocked(virDomainObjList *doms,
                                  const unsigned char *uuid)
 {
-    char uuidstr[VIR_UUID_STRING_BUFLEN];
     virDomainObj *obj;
 
-    virUUIDFormat(uuid, uuidstr);
-    obj = virHashLookup(doms->objs, uuidstr);
-    if (obj) {
-        virObjectRef(obj);
+    obj = virDomainObjListLookup(doms, uuid, false);
+    if (obj)
         virObjectLock(obj);
-    }
     return obj;
 }
 
@@ -158,9 +285,7 @@ virDomainObjListFindByUUID(virDomainObjList *doms,
 {
     virDomainObj *obj;
 
-    virObjectRWLockRead(doms);
     obj = virDomainObjListFindByUUIDLocked(doms, uuid);
-    virObjectRWUnlock(doms);
 
     if (obj && obj->removing)
         virDomainObjEndAPI(&obj);
@@ -175,11 +300,9 @@ virDomainObjListFindByNameLocked(virDomainObjList *doms,
 {
     virDomainObj *obj;
 
-    obj = virHashLookup(doms->objsName, name);
-    if (obj) {
-        virObjectRef(obj);
+    obj = virDomainObjListLookup(doms, name, true);
+    if (obj)
         virObjectLock(obj);
-    }
     return obj;
 }
 
@@ -198,9 +321,7 @@ virDomainObjListFindByName(virDomainObjList *doms,
 {
     virDomainObj *obj;
 
-    virObjectRWLockRead(doms);
     obj = virDomainObjListFindByNameLocked(doms, name);
-    virObjectRWUnlock(doms);
 
     if (obj && obj->removing)
         virDomainObjEndAPI(&obj);
@@ -209,6 +330,52 @@ virDomainObjListFindByName(virDomainObjList *doms,
 }
 
 
+/*
+ * Add @obj under @key into the table of its shard selected by @byName.
+ * The table takes a new reference on success.
+ */
+static int
+virDomainObjListInsert(virDomainObjList *doms,
+                       const void *key,
+                       bool byName,
+                       virDomainObj *obj)
+{
+    virDomainObjListShard *shard = virDomainObjListGetShard(doms, key, byName);
+    GHashTable *table = byName ? shard->objsName : shard->objs;
+    bool exists;
+
+    virRWLockWrite(&shard->lock);
+    if (!(exists = g_hash_table_contains(table, key))) {
+        g_hash_table_insert(table,
+                            byName ? g_strdup(key) : virHashUUIDKeyNew(key),
+                            virObjectRef(obj));
+    }
+    virRWLockUnlock(&shard->lock);
+
+    if (exists) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("domain '%s' is already on the list"),
+                       obj->def->name);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static void
+virDomainObjListDelete(virDomainObjList *doms,
+                       const void *key,
+                       bool byName)
+{
+    virDomainObjListShard *shard = virDomainObjListGetShard(doms, key, byName);
+
+    virRWLockWrite(&shard->lock);
+    g_hash_table_remove(byName ? shard->objsName : shard->objs, key);
+    virRWLockUnlock(&shard->lock);
+}
+
+
 /**
  * @doms: Domain object list pointer
  * @vm: Domain object to be added
@@ -217,7 +384,7 @@ virDomainObjListFindByName(virDomainObjList *doms,
  *
  * Add the @vm into the @doms->objs and @doms->objsName hash
  * tables. Once successfully added into a table, increase the
- * reference count since upon removal in virHashRemoveEntry
+ * reference count since upon removal from a table
  * the virObjectUnref will be called since the hash tables were
  * configured to call virObjectFreeHashData when the object is
  * removed from the hash table.
@@ -229,18 +396,13 @@ static int
 virDomainObjListAddObjLocked(virDomainObjList *doms,
                              virDomainObj *vm)
 {
-    char uuidstr[VIR_UUID_STRING_BUFLEN];
-
-    virUUIDFormat(vm->def->uuid, uuidstr);
-    if (virHashAddEntry(doms->objs, uuidstr, vm) < 0)
+    if (virDomainObjListInsert(doms, vm->def->uuid, false, vm) < 0)
         return -1;
-    virObjectRef(vm);
 
-    if (virHashAddEntry(doms->objsName, vm->def->name, vm) < 0) {
-        virHashRemoveEntry(doms->objs, uuidstr);
+    if (virDomainObjListInsert(doms, vm->def->name, true, vm) < 0) {
+        virDomainObjListDelete(doms, vm->def->uuid, false);
         return -1;
     }
-    virObjectRef(vm);
 
     return 0;
 }
@@ -368,12 +530,41 @@ void
 virDomainObjListRemoveLocked(virDomainObjList *doms,
                              virDomainObj *dom)
 {
-    char uuidstr[VIR_UUID_STRING_BUFLEN];
+    virDomainObjListDelete(doms, dom->def->uuid, false);
+    virDomainObjListDelete(doms, dom->def->name, true);
+}
+
 
-    virUUIDFormat(dom->def->uuid, uuidstr);
+/**
+ * virDomainObjListFindRedundantDefine:
+ * @doms: domain object list
+ * @def: definition parsed from XML about to be defined
+ * @xmlopt: XML parser configuration
+ * @hash: virDomainDefParseHash of the XML @def was parsed from
+ *
+ * Looks up the domain with the UUID of @def if defining the XML identified
+ * by @hash would not change anything for it, see
+ * virDomainObjCheckDefineHash. There's no need to replace the definition
+ * of such domain and save it. XML without an UUID never matches, the
+ * parser generates a new one each time it's parsed.
+ *
+ * Returns the locked and ref'd domain object or NULL if there's none.
+ */
+virDomainObj *
+virDomainObjListFindRedundantDefine(virDomainObjList *doms,
+                                    const virDomainDef *def,
+                                    virDomainXMLOption *xmlopt,
+                                    const char *hash)
+{
+    virDomainObj *vm;
 
-    virHashRemoveEntry(doms->objs, uuidstr);
-    virHashRemoveEntry(doms->objsName, dom->def->name);
+    if (!(vm = virDomainObjListFindByUUID(doms, def->uuid)))
+        return NULL;
+
+    if (!virDomainObjCheckDefineHash(vm, xmlopt, hash))
+        virDomainObjEndAPI(&vm);
+
+    return vm;
 }
 
 
@@ -424,6 +615,7 @@ virDomainObjListRename(virDomainObjList *doms,
 {
     int ret = -1;
     g_autofree char *old_name = NULL;
+    virDomainObj *existing;
     int rc;
 
     if (STREQ(dom->def->name, new_name)) {
@@ -443,25 +635,24 @@ virDomainObjListRename(virDomainObjList *doms,
     virObjectLock(dom);
     virObjectUnref(dom);
 
-    if (virHashLookup(doms->objsName, new_name) != NULL) {
+    if ((existing = virDomainObjListLookup(doms, new_name, true))) {
+        virObjectUnref(existing);
         virReportError(VIR_ERR_OPERATION_INVALID,
                        _("domain with name '%s' already exists"),
                        new_name);
         goto cleanup;
     }
 
-    if (virHashAddEntry(doms->objsName, new_name, dom) < 0)
-        goto cleanup;
-
-    /* Increment the refcnt for @new_name. We're about to remove
+    /* Inserting increments the refcnt for @new_name. We're about to remove
      * the @old_name which will cause the refcnt to be decremented
      * via the virObjectUnref call made during the virObjectFreeHashData
      * as a result of removing something from the object list hash
      * table as set up during virDomainObjListNew. */
-    virObjectRef(dom);
+    if (virDomainObjListInsert(doms, new_name, true, dom) < 0)
+        goto cleanup;
 
     rc = callback(dom, new_name, flags, opaque);
-    virHashRemoveEntry(doms->objsName, rc < 0 ? new_name : old_name);
+    virDomainObjListDelete(doms, rc < 0 ? new_name : old_name, true);
     if (rc < 0)
         goto cleanup;
 
@@ -472,40 +663,198 @@ virDomainObjListRename(virDomainObjList *doms,
 }
 
 
-static virDomainObj *
-virDomainObjListLoadConfig(virDomainObjList *doms,
-                           virDomainXMLOption *xmlopt,
-                           const char *configDir,
-                           const char *autostartDir,
-                           const char *name,
-                           virDomainLoadConfigNotify notify,
-                           void *opaque)
+/* Upper bound of threads parsing configs in parallel on daemon startup */
+#define VIR_DOMAIN_OBJ_LIST_LOAD_WORKERS 16
+
+typedef struct _virDomainObjListLoadData virDomainObjListLoadData;
+struct _virDomainObjListLoadData {
+    const char *configDir;
+    const char *autostartDir;
+    bool liveStatus;
+    virDomainXMLOption *xmlopt;
+
+    virMutex lock;
+    virCond cond;
+    size_t pending;
+};
+
+typedef struct _virDomainObjListLoadJob virDomainObjListLoadJob;
+struct _virDomainObjListLoadJob {
+    virDomainObjListLoadData *data;
+    char *name;
+
+    /* Result of parsing a persistent config */
+    virDomainDef *def;
+    int autostart;
+
+    /* Result of parsing a status file, unlocked */
+    virDomainObj *obj;
+};
+
+
+static int
+virDomainObjListParseConfig(virDomainObjListLoadJob *job)
 {
+    virDomainObjListLoadData *data = job->data;
     g_autofree char *configFile = NULL;
     g_autofree char *autostartLink = NULL;
     g_autoptr(virDomainDef) def = NULL;
-    virDomainObj *dom;
     int autostart;
-    g_autoptr(virDomainDef) oldDef = NULL;
 
-    if ((configFile = virDomainConfigFile(configDir, name)) == NULL)
-        return NULL;
-    if (!(def = virDomainDefParseFile(configFile, xmlopt, NULL,
+    if ((configFile = virDomainConfigFile(data->configDir, job->name)) == NULL)
+        return -1;
+    if (!(def = virDomainDefParseFile(configFile, data->xmlopt, NULL,
                                       VIR_DOMAIN_DEF_PARSE_INACTIVE |
                                       VIR_DOMAIN_DEF_PARSE_SKIP_VALIDATE |
                                       VIR_DOMAIN_DEF_PARSE_ALLOW_POST_PARSE_FAIL)))
-        return NULL;
+        return -1;
 
-    if ((autostartLink = virDomainConfigFile(autostartDir, name)) == NULL)
-        return NULL;
+    if ((autostartLink = virDomainConfigFile(data->autostartDir, job->name)) == NULL)
+        return -1;
 
     if ((autostart = virFileLinkPointsTo(autostartLink, configFile)) < 0)
+        return -1;
+
+    job->def = g_steal_pointer(&def);
+    job->autostart = autostart;
+    return 0;
+}
+
+
+static int
+virDomainObjListParseStatus(virDomainObjListLoadJob *job)
+{
+    virDomainObjListLoadData *data = job->data;
+    g_autofree char *statusFile = NULL;
+
+    if ((statusFile = virDomainConfigFile(data->configDir, job->name)) == NULL)
+        return -1;
+
+    if (!(job->obj = virDomainObjParseFile(statusFile, data->xmlopt,
+                                           VIR_DOMAIN_DEF_PARSE_STATUS |
+                                           VIR_DOMAIN_DEF_PARSE_ACTUAL_NET |
+                                           VIR_DOMAIN_DEF_PARSE_PCI_ORIG_STATES |
+                                           VIR_DOMAIN_DEF_PARSE_SKIP_VALIDATE |
+                                           VIR_DOMAIN_DEF_PARSE_ALLOW_POST_PARSE_FAIL)))
+        return -1;
+
+    /* The object is handed over to the thread adding it to the list */
+    virObjectUnlock(job->obj);
+    return 0;
+}
+
+
+static void
+virDomainObjListParse(virDomainObjListLoadJob *job)
+{
+    /* NB: errors are only logged, so one malformed config doesn't
+       kill the whole process */
+    VIR_INFO("Loading config file '%s.xml'", job->name);
+    if (job->data->liveStatus)
+        ignore_value(virDomainObjListParseStatus(job));
+    else
+        ignore_value(virDomainObjListParseConfig(job));
+}
+
+
+static void
+virDomainObjListParseWorker(void *jobdata,
+                            void *opaque G_GNUC_UNUSED)
+{
+    virDomainObjListLoadJob *job = jobdata;
+    virDomainObjListLoadData *data = job->data;
+
+    virDomainObjListParse(job);
+
+    VIR_WITH_MUTEX_LOCK_GUARD(&data->lock) {
+        if (--data->pending == 0)
+            virCondSignal(&data->cond);
+    }
+}
+
+
+/*
+ * Parses the files of @njobs @jobs on a short lived pool of @nworkers
+ * threads. Returns the number of jobs handled, which is less than @njobs
+ * if not all of them could be queued.
+ */
+static size_t
+virDomainObjListParseParallel(virDomainObjListLoadData *data,
+                              virDomainObjListLoadJob *jobs,
+                              size_t njobs,
+                              size_t nworkers)
+{
+    virThreadPool *pool;
+    size_t i = 0;
+
+    if (virMutexInit(&data->lock) < 0)
+        return 0;
+
+    if (virCondInit(&data->cond) < 0) {
+        virMutexDestroy(&data->lock);
+        return 0;
+    }
+
+    if ((pool = virThreadPoolNewFull(0, nworkers, 0,
+                                     virDomainObjListParseWorker,
+                                     "domain-load", NULL, NULL))) {
+        VIR_WITH_MUTEX_LOCK_GUARD(&data->lock) {
+            for (i = 0; i < njobs; i++) {
+                if (virThreadPoolSendJob(pool, 0, &jobs[i]) < 0)
+                    break;
+                data->pending++;
+            }
+
+            while (data->pending > 0)
+                ignore_value(virCondWait(&data->cond, &data->lock));
+        }
+
+        virThreadPoolFree(pool);
+    }
+
+    virCondDestroy(&data->cond);
+    virMutexDestroy(&data->lock);
+
+    return i;
+}
+
+
+static void
+virDomainObjListParseAll(virDomainObjListLoadData *data,
+                         virDomainObjListLoadJob *jobs,
+                         size_t njobs)
+{
+    size_t nworkers = MIN(njobs, MIN(g_get_num_processors(),
+                                     VIR_DOMAIN_OBJ_LIST_LOAD_WORKERS));
+    size_t i = 0;
+
+    if (nworkers > 1)
+        i = virDomainObjListParseParallel(data, jobs, njobs, nworkers);
+
+    /* Whatever could not be parsed in parallel is parsed right here */
+    for (; i < njobs; i++)
+        virDomainObjListParse(&jobs[i]);
+}
+
+
+static virDomainObj *
+virDomainObjListLoadConfig(virDomainObjList *doms,
+                           virDomainObjListLoadJob *job,
+                           virDomainLoadConfigNotify notify,
+                           void *opaque)
+{
+    g_autoptr(virDomainDef) def = g_steal_pointer(&job->def);
+    virDomainObj *dom;
+    g_autoptr(virDomainDef) oldDef = NULL;
+
+    if (!def)
         return NULL;
 
-    if (!(dom = virDomainObjListAddLocked(doms, &def, xmlopt, 0, &oldDef)))
+    if (!(dom = virDomainObjListAddLocked(doms, &def, job->data->xmlopt,
+                                          0, &oldDef)))
         return NULL;
 
-    dom->autostart = autostart;
+    dom->autostart = job->autostart;
 
     if (notify)
         (*notify)(dom, oldDef == NULL, opaque);
@@ -516,30 +865,20 @@ virDomainObjListLoadConfig(virDomainObjList *doms,
 
 static virDomainObj *
 virDomainObjListLoadStatus(virDomainObjList *doms,
-                           const char *statusDir,
-                           const char *name,
-                           virDomainXMLOption *xmlopt,
+                           virDomainObjListLoadJob *job,
                            virDomainLoadConfigNotify notify,
                            void *opaque)
 {
-    g_autofree char *statusFile = NULL;
-    virDomainObj *obj = NULL;
-    char uuidstr[VIR_UUID_STRING_BUFLEN];
-
-    if ((statusFile = virDomainConfigFile(statusDir, name)) == NULL)
-        goto error;
+    virDomainObj *obj = g_steal_pointer(&job->obj);
+    virDomainObj *existing;
 
-    if (!(obj = virDomainObjParseFile(statusFile, xmlopt,
-                                      VIR_DOMAIN_DEF_PARSE_STATUS |
-                                      VIR_DOMAIN_DEF_PARSE_ACTUAL_NET |
-                                      VIR_DOMAIN_DEF_PARSE_PCI_ORIG_STATES |
-                                      VIR_DOMAIN_DEF_PARSE_SKIP_VALIDATE |
-                                      VIR_DOMAIN_DEF_PARSE_ALLOW_POST_PARSE_FAIL)))
-        goto error;
+    if (!obj)
+        return NULL;
 
-    virUUIDFormat(obj->def->uuid, uuidstr);
+    virObjectLock(obj);
 
-    if (virHashLookup(doms->objs, uuidstr) != NULL) {
+    if ((existing = virDomainObjListLookup(doms, obj->def->uuid, false))) {
+        virObjectUnref(existing);
         virReportError(VIR_ERR_INTERNAL_ERROR,
                        _("unexpected domain %s already exists"),
                        obj->def->name);
@@ -560,6 +899,13 @@ virDomainObjListLoadStatus(virDomainObjList *doms,
 }
 
 
+/**
+ * virDomainObjListLoadAllConfigs:
+ *
+ * Loads all domain configs, or status files if @liveStatus is true, from
+ * @configDir. The files are parsed in parallel and the domains are then
+ * added to @doms in the order of the directory listing.
+ */
 int
 virDomainObjListLoadAllConfigs(virDomainObjList *doms,
                                const char *configDir,
@@ -571,6 +917,13 @@ virDomainObjListLoadAllConfigs(virDomainObjList *doms,
 {
     g_autoptr(DIR) dir = NULL;
     struct dirent *entry;
+    virDomainObjListLoadData data = {
+        .configDir = configDir, .autostartDir = autostartDir,
+        .liveStatus = liveStatus, .xmlopt = xmlopt,
+    };
+    g_autofree virDomainObjListLoadJob *jobs = NULL;
+    size_t njobs = 0;
+    size_t i;
     int ret = -1;
     int rc;
 
@@ -579,39 +932,40 @@ virDomainObjListLoadAllConfigs(virDomainObjList *doms,
     if ((rc = virDirOpenIfExists(&dir, configDir)) <= 0)
         return rc;
 
-    virObjectRWLockWrite(doms);
-
     while ((ret = virDirRead(dir, &entry, configDir)) > 0) {
-        virDomainObj *dom;
+        virDomainObjListLoadJob job = { .data = &data };
 
         if (!virStringStripSuffix(entry->d_name, ".xml"))
             continue;
 
-        /* NB: ignoring errors, so one malformed config doesn't
-           kill the whole process */
-        VIR_INFO("Loading config file '%s.xml'", entry->d_name);
+        job.name = g_strdup(entry->d_name);
+        VIR_APPEND_ELEMENT(jobs, njobs, job);
+    }
+
+    virDomainObjListParseAll(&data, jobs, njobs);
+
+    virObjectRWLockWrite(doms);
+
+    for (i = 0; i < njobs; i++) {
+        virDomainObjListLoadJob *job = jobs + i;
+        virDomainObj *dom;
+
         if (liveStatus)
-            dom = virDomainObjListLoadStatus(doms,
-                                             configDir,
-                                             entry->d_name,
-                                             xmlopt,
-                                             notify,
-                                             opaque);
+            dom = virDomainObjListLoadStatus(doms, job, notify, opaque);
         else
-            dom = virDomainObjListLoadConfig(doms,
-                                             xmlopt,
-                                             configDir,
-                                             autostartDir,
-                                             entry->d_name,
-                                             notify,
-                                             opaque);
+            dom = virDomainObjListLoadConfig(doms, job, notify, opaque);
+
         if (dom) {
             if (!liveStatus)
                 dom->persistent = 1;
             virDomainObjEndAPI(&dom);
         } else {
-            VIR_ERROR(_("Failed to load config for domain '%s'"), entry->d_name);
+            VIR_ERROR(_("Failed to load config for domain '%s'"), job->name);
         }
+
+        virDomainDefFree(job->def);
+        virObjectUnref(job->obj);
+        g_free(job->name);
     }
 
     virObjectRWUnlock(doms);
@@ -658,9 +1012,14 @@ virDomainObjListNumOfDomains(virDomainObjList *doms,
                              virConnectPtr conn)
 {
     struct virDomainObjListData data = { filter, conn, active, 0 };
-    virObjectRWLockRead(doms);
-    virHashForEach(doms->objs, virDomainObjListCount, &data);
-    virObjectRWUnlock(doms);
+    virDomainObj **vms = NULL;
+    size_t nvms = 0;
+    size_t i;
+
+    vms = virDomainObjListSnapshot(doms, &nvms);
+    for (i = 0; i < nvms; i++)
+        virDomainObjListCount(vms[i], NULL, &data);
+    virObjectListFreeCount(vms, nvms);
     return data.count;
 }
 
@@ -702,9 +1061,14 @@ virDomainObjListGetActiveIDs(virDomainObjList *doms,
 {
     struct virDomainIDData data = { filter, conn,
                                     0, maxids, ids };
-    virObjectRWLockRead(doms);
-    virHashForEach(doms->objs, virDomainObjListCopyActiveIDs, &data);
-    virObjectRWUnlock(doms);
+    virDomainObj **vms = NULL;
+    size_t nvms = 0;
+    size_t i;
+
+    vms = virDomainObjListSnapshot(doms, &nvms);
+    for (i = 0; i < nvms; i++)
+        virDomainObjListCopyActiveIDs(vms[i], NULL, &data);
+    virObjectListFreeCount(vms, nvms);
     return data.numids;
 }
 
@@ -754,10 +1118,14 @@ virDomainObjListGetInactiveNames(virDomainObjList *doms,
 {
     struct virDomainNameData data = { filter, conn,
                                       0, 0, maxnames, names };
+    virDomainObj **vms = NULL;
+    size_t nvms = 0;
     size_t i;
-    virObjectRWLockRead(doms);
-    virHashForEach(doms->objs, virDomainObjListCopyInactiveNames, &data);
-    virObjectRWUnlock(doms);
+
+    vms = virDomainObjListSnapshot(doms, &nvms);
+    for (i = 0; i < nvms; i++)
+        virDomainObjListCopyInactiveNames(vms[i], NULL, &data);
+    virObjectListFreeCount(vms, nvms);
     if (data.oom) {
         for (i = 0; i < data.numnames; i++)
             VIR_FREE(data.names[i]);
@@ -768,26 +1136,6 @@ virDomainObjListGetInactiveNames(virDomainObjList *doms,
 }
 
 
-struct virDomainListIterData {
-    virDomainObjListIterator callback;
-    void *opaque;
-    int ret;
-};
-
-
-static int
-virDomainObjListHelper(void *payload,
-                       const char *name G_GNUC_UNUSED,
-                       void *opaque)
-{
-    struct virDomainListIterData *data = opaque;
-
-    if (data->callback(payload, data->opaque) < 0)
-        data->ret = -1;
-    return 0;
-}
-
-
 /**
  * virDomainObjListForEach:
  * @doms: Pointer to the domain object list
@@ -801,6 +1149,10 @@ virDomainObjListHelper(void *payload,
  * @callback wants to modify the list of domains (@doms) then
  * @modify must be set to true.
  *
+ * The domains are iterated over a snapshot of the list, so lookups are
+ * not blocked while @callback runs. Modifications of the list by other
+ * threads are blocked for the duration of the iteration though.
+ *
  * Returns: 0 on success,
  *         -1 otherwise.
  */
@@ -810,16 +1162,139 @@ virDomainObjListForEach(virDomainObjList *doms,
                         virDomainObjListIterator callback,
                         void *opaque)
 {
-    struct virDomainListIterData data = {
-        callback, opaque, 0,
-    };
+    virDomainObj **vms = NULL;
+    size_t nvms = 0;
+    size_t i;
+    int ret = 0;
 
     if (modify)
         virObjectRWLockWrite(doms);
     else
         virObjectRWLockRead(doms);
-    virHashForEachSafe(doms->objs, virDomainObjListHelper, &data);
+
+    vms = virDomainObjListSnapshot(doms, &nvms);
+    for (i = 0; i < nvms; i++) {
+        if (callback(vms[i], opaque) < 0)
+            ret = -1;
+    }
+
     virObjectRWUnlock(doms);
+
+    virObjectListFreeCount(vms, nvms);
+    return ret;
+}
+
+
+typedef struct _virDomainObjListForEachData virDomainObjListForEachData;
+struct _virDomainObjListForEachData {
+    virDomainObjListIterator callback;
+    void *opaque;
+
+    virMutex lock;
+    virCond cond;
+    size_t pending;
+    int ret;
+};
+
+typedef struct _virDomainObjListForEachJob virDomainObjListForEachJob;
+struct _virDomainObjListForEachJob {
+    virDomainObjListForEachData *data;
+    virDomainObj *vm;
+};
+
+
+static void
+virDomainObjListForEachWorker(void *jobdata,
+                              void *opaque G_GNUC_UNUSED)
+{
+    virDomainObjListForEachJob *job = jobdata;
+    virDomainObjListForEachData *data = job->data;
+    int rc = data->callback(job->vm, data->opaque);
+
+    VIR_WITH_MUTEX_LOCK_GUARD(&data->lock) {
+        if (rc < 0)
+            data->ret = -1;
+        if (--data->pending == 0)
+            virCondSignal(&data->cond);
+    }
+}
+
+
+/**
+ * virDomainObjListForEachParallel:
+ * @doms: Pointer to the domain object list
+ * @callback: callback to run over each domain on the list
+ * @opaque: opaque data to pass to @callback
+ *
+ * Like virDomainObjListForEach without @modify, except that @callback
+ * is run for multiple domains at once on a short lived pool of threads.
+ * Meant for expensive per domain work on daemon startup, e.g. loading
+ * snapshot metadata. @callback must lock the domain it is given and
+ * must be safe to run concurrently for different domains.
+ *
+ * Returns: 0 on success,
+ *         -1 otherwise.
+ */
+int
+virDomainObjListForEachParallel(virDomainObjList *doms,
+                                virDomainObjListIterator callback,
+                                void *opaque)
+{
+    virDomainObjListForEachData data = { .callback = callback,
+                                         .opaque = opaque };
+    g_autofree virDomainObjListForEachJob *jobs = NULL;
+    virThreadPool *pool = NULL;
+    virDomainObj **vms = NULL;
+    size_t nvms = 0;
+    size_t nworkers;
+    size_t i = 0;
+
+    if (virMutexInit(&data.lock) < 0)
+        return virDomainObjListForEach(doms, false, callback, opaque);
+
+    if (virCondInit(&data.cond) < 0) {
+        virMutexDestroy(&data.lock);
+        return virDomainObjListForEach(doms, false, callback, opaque);
+    }
+
+    virObjectRWLockRead(doms);
+
+    vms = virDomainObjListSnapshot(doms, &nvms);
+    jobs = g_new0(virDomainObjListForEachJob, nvms);
+    nworkers = MIN(nvms, MIN(g_get_num_processors(),
+                             VIR_DOMAIN_OBJ_LIST_LOAD_WORKERS));
+
+    if (nworkers > 1 &&
+        (pool = virThreadPoolNewFull(0, nworkers, 0,
+                                     virDomainObjListForEachWorker,
+                                     "domain-foreach", NULL, NULL))) {
+        VIR_WITH_MUTEX_LOCK_GUARD(&data.lock) {
+            for (i = 0; i < nvms; i++) {
+                jobs[i].data = &data;
+                jobs[i].vm = vms[i];
+                if (virThreadPoolSendJob(pool, 0, &jobs[i]) < 0)
+                    break;
+                data.pending++;
+            }
+
+            while (data.pending > 0)
+                ignore_value(virCondWait(&data.cond, &data.lock));
+        }
+
+        virThreadPoolFree(pool);
+    }
+
+    /* Whatever could not be handled in parallel is handled right here */
+    for (; i < nvms; i++) {
+        if (callback(vms[i], opaque) < 0)
+            data.ret = -1;
+    }
+
+    virObjectRWUnlock(doms);
+
+    virObjectListFreeCount(vms, nvms);
+    virCondDestroy(&data.cond);
+    virMutexDestroy(&data.lock);
     return data.ret;
 }
 
@@ -897,24 +1372,6 @@ virDomainObjMatchFilter(virDomainObj *vm,
 #undef MATCH
 
 
-struct virDomainListData {
-    virDomainObj **vms;
-    size_t nvms;
-};
-
-
-static int
-virDomainObjListCollectIterator(void *payload,
-                                const char *name G_GNUC_UNUSED,
-                                void *opaque)
-{
-    struct virDomainListData *data = opaque;
-
-    data->vms[data->nvms++] = virObjectRef(payload);
-    return 0;
-}
-
-
 static void
 virDomainObjListFilter(virDomainObj ***list,
                        size_t *nvms,
@@ -956,18 +1413,219 @@ virDomainObjListCollect(virDomainObjList *domlist,
                         virDomainObjListACLFilter filter,
                         unsigned int flags)
 {
-    struct virDomainListData data = { NULL, 0 };
+    *vms = virDomainObjListSnapshot(domlist, nvms);
+
+    virDomainObjListFilter(vms, nvms, conn, filter, flags);
+
+    return 0;
+}
+
+
+static void
+virDomainObjListPageHeapSwap(char **names,
+                             size_t i,
+                             size_t j)
+{
+    char *tmp = names[i];
 
-    virObjectRWLockRead(domlist);
-    data.vms = g_new0(virDomainObj *, virHashSize(domlist->objs));
+    names[i] = names[j];
+    names[j] = tmp;
+}
+
+
+/*
+ * Sift the name at @i of the max-heap @names of @nnames names down to
+ * its place.
+ */
+static void
+virDomainObjListPageHeapDown(char **names,
+                             size_t nnames,
+                             size_t i)
+{
+    while (2 * i + 1 < nnames) {
+        size_t child = 2 * i + 1;
 
-    virHashForEach(domlist->objs, virDomainObjListCollectIterator, &data);
-    virObjectRWUnlock(domlist);
+        if (child + 1 < nnames && strcmp(names[child + 1], names[child]) > 0)
+            child++;
 
-    virDomainObjListFilter(&data.vms, &data.nvms, conn, filter, flags);
+        if (strcmp(names[i], names[child]) >= 0)
+            break;
 
-    *nvms = data.nvms;
-    *vms = data.vms;
+        virDomainObjListPageHeapSwap(names, i, child);
+        i = child;
+    }
+}
+
+
+/* Sift the name at @i of the max-heap @names up to its place. */
+static void
+virDomainObjListPageHeapUp(char **names,
+                           size_t i)
+{
+    while (i > 0 && strcmp(names[(i - 1) / 2], names[i]) < 0) {
+        virDomainObjListPageHeapSwap(names, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+
+static int
+virDomainObjListPageNameCompare(const void *a,
+                                const void *b)
+{
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+
+/*
+ * Fill @names with the up to @bound smallest names which follow @cursor
+ * and match @pattern, in strcmp() order. Only names smaller than the
+ * largest one kept so far are copied.
+ *
+ * Returns the number of names in @names.
+ */
+static size_t
+virDomainObjListPageSelect(virDomainObjList *domlist,
+                           const char *cursor,
+                           const char *pattern,
+                           char **names,
+                           size_t bound)
+{
+    size_t nnames = 0;
+    size_t i;
+
+    for (i = 0; i < domlist->nshards; i++) {
+        virDomainObjListShard *shard = domlist->shards + i;
+        GHashTableIter iter;
+        void *key;
+
+        virRWLockRead(&shard->lock);
+
+        g_hash_table_iter_init(&iter, shard->objsName);
+        while (g_hash_table_iter_next(&iter, &key, NULL)) {
+            if (cursor && strcmp(key, cursor) <= 0)
+                continue;
+
+            if (nnames == bound && strcmp(key, names[0]) >= 0)
+                continue;
+
+            if (pattern && !g_pattern_match_simple(pattern, key))
+                continue;
+
+            if (nnames == bound) {
+                g_free(names[0]);
+                names[0] = g_strdup(key);
+                virDomainObjListPageHeapDown(names, nnames, 0);
+            } else {
+                names[nnames] = g_strdup(key);
+                virDomainObjListPageHeapUp(names, nnames++);
+            }
+        }
+
+        virRWLockUnlock(&shard->lock);
+    }
+
+    qsort(names, nnames, sizeof(*names), virDomainObjListPageNameCompare);
+
+    return nnames;
+}
+
+
+/**
+ * virDomainObjListCollectPage:
+ * @domlist: domain list
+ * @conn: connection to check the ACL of listed domains for
+ * @cursor: name of the last domain of the previous page or NULL
+ * @limit: maximum number of domains to collect
+ * @pattern: glob pattern domain names must match or NULL
+ * @metadata: namespace URI of custom metadata domains must have or NULL
+ * @vms: filled with the collected domains
+ * @nvms: filled with the number of domains in @vms
+ * @next: filled with the cursor of the next page or NULL
+ * @filter: ACL filter
+ * @flags: bitwise-OR of virConnectListAllDomainsFlags
+ *
+ * Collects up to @limit domains matching the filters whose names follow
+ * @cursor in strcmp() order. Each pass over the names keeps only the
+ * smallest of them, one more than the domains still missing from the
+ * page, and looks up and locks only the domains it needs to evaluate the
+ * rest of the filters for. Passes which don't fill the page because of
+ * the remaining filters are repeated after the last name seen, with twice
+ * as many names each time.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virDomainObjListCollectPage(virDomainObjList *domlist,
+                            virConnectPtr conn,
+                            const char *cursor,
+                            size_t limit,
+                            const char *pattern,
+                            const char *metadata,
+                            virDomainObj ***vms,
+                            size_t *nvms,
+                            char **next,
+                            virDomainObjListACLFilter filter,
+                            unsigned int flags)
+{
+    g_autofree char *last = g_strdup(cursor);
+    size_t bound = limit + 1;
+
+    *vms = NULL;
+    *nvms = 0;
+    *next = NULL;
+
+    while (*nvms < limit) {
+        g_autofree char **names = g_new0(char *, bound);
+        size_t nnames;
+        size_t i;
+
+        nnames = virDomainObjListPageSelect(domlist, last, pattern,
+                                            names, bound);
+
+        for (i = 0; i < nnames && *nvms < limit; i++) {
+            virDomainObj *vm;
+            bool match;
+
+            if (!(vm = virDomainObjListLookup(domlist, names[i], true)))
+                continue;
+
+            virObjectLock(vm);
+            /* the domain might have been renamed meanwhile */
+            match = !vm->removing &&
+                STREQ(vm->def->name, names[i]) &&
+                (!filter || filter(conn, vm->def)) &&
+                virDomainObjMatchFilter(vm, flags) &&
+                (!metadata ||
+                 (vm->def->metadata &&
+                  virXMLFindChildNodeByNs(vm->def->metadata, metadata)));
+            virObjectUnlock(vm);
+
+            if (match)
+                VIR_APPEND_ELEMENT(*vms, *nvms, vm);
+            else
+                virObjectUnref(vm);
+        }
+
+        /* the page is full and names may be left after the last one
+         * evaluated, either in this pass or beyond its bound */
+        if (*nvms == limit && i > 0 && (i < nnames || nnames == bound))
+            *next = g_strdup(names[i - 1]);
+
+        if (nnames > 0) {
+            g_free(last);
+            last = g_strdup(names[nnames - 1]);
+        }
+
+        for (i = 0; i < nnames; i++)
+            g_free(names[i]);
+
+        /* all names after the cursor were evaluated */
+        if (nnames < bound || *next)
+            break;
+
+        bound *= 2;
+    }
 
     return 0;
 }
@@ -991,28 +1649,22 @@ virDomainObjListConvert(virDomainObjList *domlist,
     *nvms = 0;
     *vms = NULL;
 
-    virObjectRWLockRead(domlist);
     for (i = 0; i < ndoms; i++) {
         virDomainPtr dom = doms[i];
 
-        virUUIDFormat(dom->uuid, uuidstr);
-
-        if (!(vm = virHashLookup(domlist->objs, uuidstr))) {
+        if (!(vm = virDomainObjListLookup(domlist, dom->uuid, false))) {
             if (skip_missing)
                 continue;
 
-            virObjectRWUnlock(domlist);
+            virUUIDFormat(dom->uuid, uuidstr);
             virReportError(VIR_ERR_NO_DOMAIN,
                            _("no domain with matching uuid '%s' (%s)"),
                            uuidstr, dom->name);
             goto error;
         }
 
-        virObjectRef(vm);
-
         VIR_APPEND_ELEMENT(*vms, *nvms, vm);
     }
-    virObjectRWUnlock(domlist);
 
     virDomainObjListFilter(vms, nvms, conn, filter, flags);
 
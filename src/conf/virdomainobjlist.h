@@ -58,6 +58,11 @@ int virDomainObjListRename(virDomainObjList *doms,
 
 void virDomainObjListRemove(virDomainObjList *doms,
                             virDomainObj *dom);
+
+virDomainObj *virDomainObjListFindRedundantDefine(virDomainObjList *doms,
+                                                  const virDomainDef *def,
+                                                  virDomainXMLOption *xmlopt,
+                                                  const char *hash);
 void virDomainObjListRemoveLocked(virDomainObjList *doms,
                                   virDomainObj *dom);
 
@@ -92,6 +97,9 @@ int virDomainObjListForEach(virDomainObjList *doms,
                             bool modify,
                             virDomainObjListIterator callback,
                             void *opaque);
+int virDomainObjListForEachParallel(virDomainObjList *doms,
+                                    virDomainObjListIterator callback,
+                                    void *opaque);
 
 #define VIR_CONNECT_LIST_DOMAINS_FILTERS_ACTIVE \
                 (VIR_CONNECT_LIST_DOMAINS_ACTIVE | \
@@ -138,6 +146,17 @@ int virDomainObjListCollect(virDomainObjList *doms,
                             size_t *nvms,
                             virDomainObjListACLFilter filter,
                             unsigned int flags);
+int virDomainObjListCollectPage(virDomainObjList *domlist,
+                                virConnectPtr conn,
+                                const char *cursor,
+                                size_t limit,
+                                const char *pattern,
+                                const char *metadata,
+                                virDomainObj ***vms,
+                                size_t *nvms,
+                                char **next,
+                                virDomainObjListACLFilter filter,
+                                unsigned int flags);
 int virDomainObjListExport(virDomainObjList *doms,
                            virConnectPtr conn,
                            virDomainPtr **domains,
@@ -326,7 +326,7 @@ virNetworkObjListNew(void)
     if (!(nets = virObjectRWLockableNew(virNetworkObjListClass)))
         return NULL;
 
-    nets->objs = virHashNew(virObjectFreeHashData);
+    nets->objs = virHashNewUUID(virObjectFreeHashData);
 
     return nets;
 }
@@ -337,11 +337,8 @@ virNetworkObjFindByUUIDLocked(virNetworkObjList *nets,
                               const unsigned char *uuid)
 {
     virNetworkObj *obj = NULL;
-    char uuidstr[VIR_UUID_STRING_BUFLEN];
-
-    virUUIDFormat(uuid, uuidstr);
 
-    obj = virHashLookup(nets->objs, uuidstr);
+    obj = g_hash_table_lookup(nets->objs, uuid);
     if (obj)
         virObjectRef(obj);
     return obj;
@@ -582,10 +579,8 @@ virNetworkObjAssignDefLocked(virNetworkObjList *nets,
         if (!(obj = virNetworkObjNew()))
               goto cleanup;
 
-        virUUIDFormat(def->uuid, uuidstr);
-        if (virHashAddEntry(nets->objs, uuidstr, obj) < 0)
-            goto cleanup;
-        virObjectRef(obj);
+        g_hash_table_insert(nets->objs, virHashUUIDKeyNew(def->uuid),
+                            virObjectRef(obj));
 
         obj->def = def;
         obj->persistent = !(flags & VIR_NETWORK_OBJ_LIST_ADD_LIVE);
@@ -767,14 +762,11 @@ void
 virNetworkObjRemoveInactive(virNetworkObjList *nets,
                             virNetworkObj *obj)
 {
-    char uuidstr[VIR_UUID_STRING_BUFLEN];
-
-    virUUIDFormat(obj->def->uuid, uuidstr);
     virObjectRef(obj);
     virObjectUnlock(obj);
     virObjectRWLockWrite(nets);
     virObjectLock(obj);
-    virHashRemoveEntry(nets->objs, uuidstr);
+    g_hash_table_remove(nets->objs, obj->def->uuid);
     virObjectRWUnlock(nets);
     virObjectUnref(obj);
 }
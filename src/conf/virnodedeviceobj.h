@@ -36,6 +36,10 @@ struct _virNodeDeviceDriverState {
     virCond initCond;
     bool initialized;
 
+    /* signalled whenever a device is added to @devs, guarded by @lock */
+    virCond devsCond;
+    unsigned long long devsGeneration;
+
     /* pid file FD, ensures two copies of the driver can't use the same root */
     int lockFD;
 
@@ -129,7 +129,7 @@ virNWFilterObjListNew(void)
      * neither hash table. Thus we only need to have a destroy
      * callback for one of the two hash tables.
      */
-    nwfilters->objs = virHashNew((GDestroyNotify)virNWFilterObjFree);
+    nwfilters->objs = virHashNewUUID((GDestroyNotify)virNWFilterObjFree);
     nwfilters->objsName = virHashNew(NULL);
 
     return nwfilters;
@@ -140,14 +140,10 @@ void
 virNWFilterObjListRemove(virNWFilterObjList *nwfilters,
                          virNWFilterObj *obj)
 {
-    char uuidstr[VIR_UUID_STRING_BUFLEN];
-
-    virUUIDFormat(obj->def->uuid, uuidstr);
-
     virNWFilterObjUnlock(obj);
 
     g_hash_table_remove(nwfilters->objsName, obj->def->name);
-    g_hash_table_remove(nwfilters->objs, uuidstr);
+    g_hash_table_remove(nwfilters->objs, obj->def->uuid);
 }
 
 
@@ -155,12 +151,9 @@ virNWFilterObj *
 virNWFilterObjListFindByUUID(virNWFilterObjList *nwfilters,
                              const unsigned char *uuid)
 {
-    char uuidstr[VIR_UUID_STRING_BUFLEN];
     virNWFilterObj *obj;
 
-    virUUIDFormat(uuid, uuidstr);
-
-    obj = g_hash_table_lookup(nwfilters->objs, uuidstr);
+    obj = g_hash_table_lookup(nwfilters->objs, uuid);
     if (obj)
         virNWFilterObjLock(obj);
 
@@ -364,9 +357,7 @@ virNWFilterObjListAssignDef(virNWFilterObjList *nwfilters,
     if (!(obj = virNWFilterObjNew()))
         return NULL;
 
-    virUUIDFormat(def->uuid, uuidstr);
-
-    g_hash_table_insert(nwfilters->objs, g_strdup(uuidstr), obj);
+    g_hash_table_insert(nwfilters->objs, virHashUUIDKeyNew(def->uuid), obj);
     g_hash_table_insert(nwfilters->objsName, g_strdup(def->name), obj);
 
     obj->def = def;
@@ -30,6 +30,7 @@
 #include "virfile.h"
 #include "virhash.h"
 #include "virlog.h"
+#include "virsecureerase.h"
 #include "virstring.h"
 
 #define VIR_FROM_THIS VIR_FROM_SECRET
@@ -41,7 +42,7 @@ struct _virSecretObj {
     char *configFile;
     char *base64File;
     virSecretDef *def;
-    unsigned char *value;       /* May be NULL */
+    unsigned char *value;       /* May be NULL, allocated by virSecureAlloc */
     size_t value_size;
 };
 
@@ -118,7 +119,7 @@ virSecretObjListNew(void)
     if (!(secrets = virObjectRWLockableNew(virSecretObjListClass)))
         return NULL;
 
-    if (!(secrets->objs = virHashNew(virObjectFreeHashData))) {
+    if (!(secrets->objs = virHashNewUUID(virObjectFreeHashData))) {
         virObjectUnref(secrets);
         return NULL;
     }
@@ -133,11 +134,7 @@ virSecretObjDispose(void *opaque)
     virSecretObj *obj = opaque;
 
     virSecretDefFree(obj->def);
-    if (obj->value) {
-        /* Wipe before free to ensure we don't leave a secret on the heap */
-        memset(obj->value, 0, obj->value_size);
-        g_free(obj->value);
-    }
+    virSecureFree(obj->value, obj->value_size);
     g_free(obj->configFile);
     g_free(obj->base64File);
 }
@@ -163,16 +160,16 @@ virSecretObjListDispose(void *obj)
  */
 static virSecretObj *
 virSecretObjListFindByUUIDLocked(virSecretObjList *secrets,
-                                 const char *uuidstr)
+                                 const unsigned char *uuid)
 {
-    return virObjectRef(virHashLookup(secrets->objs, uuidstr));
+    return virObjectRef(g_hash_table_lookup(secrets->objs, uuid));
 }
 
 
 /**
  * virSecretObjFindByUUID:
  * @secrets: list of secret objects
- * @uuidstr: secret uuid to find
+ * @uuid: secret uuid to find
  *
  * This function locks @secrets and finds the secret object which
  * corresponds to @uuid.
@@ -181,12 +178,12 @@ virSecretObjListFindByUUIDLocked(virSecretObjList *secrets,
  */
 virSecretObj *
 virSecretObjListFindByUUID(virSecretObjList *secrets,
-                           const char *uuidstr)
+                           const unsigned char *uuid)
 {
     virSecretObj *obj;
 
     virObjectRWLockRead(secrets);
-    obj = virSecretObjListFindByUUIDLocked(secrets, uuidstr);
+    obj = virSecretObjListFindByUUIDLocked(secrets, uuid);
     virObjectRWUnlock(secrets);
     if (obj)
         virObjectLock(obj);
@@ -286,20 +283,18 @@ void
 virSecretObjListRemove(virSecretObjList *secrets,
                        virSecretObj *obj)
 {
-    char uuidstr[VIR_UUID_STRING_BUFLEN];
     virSecretDef *def;
 
     if (!obj)
         return;
     def = obj->def;
 
-    virUUIDFormat(def->uuid, uuidstr);
     virObjectRef(obj);
     virObjectUnlock(obj);
 
     virObjectRWLockWrite(secrets);
     virObjectLock(obj);
-    virHashRemoveEntry(secrets->objs, uuidstr);
+    g_hash_table_remove(secrets->objs, def->uuid);
     virSecretObjEndAPI(&obj);
     virObjectRWUnlock(secrets);
 }
@@ -338,7 +333,7 @@ virSecretObjListAdd(virSecretObjList *secrets,
     virUUIDFormat((*newdef)->uuid, uuidstr);
 
     /* Is there a secret already matching this UUID */
-    if ((obj = virSecretObjListFindByUUIDLocked(secrets, uuidstr))) {
+    if ((obj = virSecretObjListFindByUUIDLocked(secrets, (*newdef)->uuid))) {
         virObjectLock(obj);
         objdef = obj->def;
 
@@ -387,11 +382,9 @@ virSecretObjListAdd(virSecretObjList *secrets,
             !(obj->base64File = virFileBuildPath(configDir, uuidstr, ".base64")))
             goto cleanup;
 
-        if (virHashAddEntry(secrets->objs, uuidstr, obj) < 0)
-            goto cleanup;
-
+        g_hash_table_insert(secrets->objs, virHashUUIDKeyNew((*newdef)->uuid),
+                            virObjectRef(obj));
         obj->def = g_steal_pointer(newdef);
-        virObjectRef(obj);
     }
 
     ret = g_steal_pointer(&obj);
@@ -742,34 +735,32 @@ virSecretObjSetValue(virSecretObj *obj,
                      size_t value_size)
 {
     virSecretDef *def = obj->def;
-    g_autofree unsigned char *old_value = NULL;
-    g_autofree unsigned char *new_value = NULL;
+    unsigned char *old_value = NULL;
+    unsigned char *new_value = NULL;
     size_t old_value_size;
 
-    new_value = g_new0(unsigned char, value_size);
+    new_value = virSecureAlloc(value_size);
 
     old_value = obj->value;
     old_value_size = obj->value_size;
 
     memcpy(new_value, value, value_size);
-    obj->value = g_steal_pointer(&new_value);
+    obj->value = new_value;
     obj->value_size = value_size;
 
     if (!def->isephemeral && virSecretObjSaveData(obj) < 0)
         goto error;
 
     /* Saved successfully - drop old value */
-    if (old_value)
-        memset(old_value, 0, old_value_size);
+    virSecureFree(old_value, old_value_size);
 
     return 0;
 
  error:
     /* Error - restore previous state and free new value */
-    new_value = g_steal_pointer(&obj->value);
-    obj->value = g_steal_pointer(&old_value);
+    obj->value = old_value;
     obj->value_size = old_value_size;
-    memset(new_value, 0, value_size);
+    virSecureFree(new_value, value_size);
     return -1;
 }
 
@@ -814,6 +805,8 @@ virSecretLoadValue(virSecretObj *obj)
     int ret = -1, fd = -1;
     struct stat st;
     g_autofree char *contents = NULL;
+    g_autofree unsigned char *value = NULL;
+    size_t value_size = 0;
 
     if ((fd = open(obj->base64File, O_RDONLY)) == -1) {
         if (errno == ENOENT) {
@@ -849,13 +842,18 @@ virSecretLoadValue(virSecretObj *obj)
 
     VIR_FORCE_CLOSE(fd);
 
-    obj->value = g_base64_decode(contents, &obj->value_size);
+    value = g_base64_decode(contents, &value_size);
+
+    obj->value = virSecureAlloc(value_size);
+    obj->value_size = value_size;
+    memcpy(obj->value, value, value_size);
 
     ret = 0;
 
  cleanup:
+    virSecureErase(value, value_size);
     if (contents != NULL)
-        memset(contents, 0, st.st_size);
+        virSecureErase(contents, st.st_size);
     VIR_FORCE_CLOSE(fd);
     return ret;
 }
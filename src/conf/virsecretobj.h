@@ -37,7 +37,7 @@ virSecretObjListNew(void);
 
 virSecretObj *
 virSecretObjListFindByUUID(virSecretObjList *secrets,
-                           const char *uuidstr);
+                           const unsigned char *uuid);
 
 virSecretObj *
 virSecretObjListFindByUsage(virSecretObjList *secrets,
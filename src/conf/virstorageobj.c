@@ -92,6 +92,10 @@ struct _virStoragePoolObj {
     virStoragePoolDef *newDef;
 
     virStorageVolObjList *volumes;
+
+    /* path string -> virStorageVolDef mapping of the volumes
+     * known before the refresh in progress was started */
+    GHashTable *stashedVols;
 };
 
 struct _virStoragePoolObjList {
@@ -348,6 +352,7 @@ virStoragePoolObjDispose(void *opaque)
     virStoragePoolObj *obj = opaque;
 
     virStoragePoolObjClearVols(obj);
+    virStoragePoolObjClearStashedVols(obj);
     virObjectUnref(obj->volumes);
 
     virStoragePoolDefFree(obj->def);
@@ -379,7 +384,7 @@ virStoragePoolObjListNew(void)
     if (!(pools = virObjectRWLockableNew(virStoragePoolObjListClass)))
         return NULL;
 
-    pools->objs = virHashNew(virObjectFreeHashData);
+    pools->objs = virHashNewUUID(virObjectFreeHashData);
     pools->objsName = virHashNew(virObjectFreeHashData);
 
     return pools;
@@ -497,14 +502,11 @@ void
 virStoragePoolObjRemove(virStoragePoolObjList *pools,
                         virStoragePoolObj *obj)
 {
-    char uuidstr[VIR_UUID_STRING_BUFLEN];
-
-    virUUIDFormat(obj->def->uuid, uuidstr);
     virObjectRef(obj);
     virObjectUnlock(obj);
     virObjectRWLockWrite(pools);
     virObjectLock(obj);
-    g_hash_table_remove(pools->objs, uuidstr);
+    g_hash_table_remove(pools->objs, obj->def->uuid);
     g_hash_table_remove(pools->objsName, obj->def->name);
     virObjectUnref(obj);
     virObjectRWUnlock(pools);
@@ -515,11 +517,7 @@ static virStoragePoolObj *
 virStoragePoolObjFindByUUIDLocked(virStoragePoolObjList *pools,
                                   const unsigned char *uuid)
 {
-    char uuidstr[VIR_UUID_STRING_BUFLEN];
-
-    virUUIDFormat(uuid, uuidstr);
-
-    return virObjectRef(virHashLookup(pools->objs, uuidstr));
+    return virObjectRef(g_hash_table_lookup(pools->objs, uuid));
 }
 
 
@@ -610,6 +608,79 @@ virStoragePoolObjClearVols(virStoragePoolObj *obj)
 }
 
 
+/**
+ * virStoragePoolObjStashVols:
+ * @obj: pool object
+ *
+ * Remove all volumes from @obj like virStoragePoolObjClearVols does, but
+ * keep their definitions around so that the backend refreshing the pool
+ * can pick up those which did not change using virStoragePoolObjUnstashVol
+ * instead of probing them again. The definitions which were not picked up
+ * are released by virStoragePoolObjClearStashedVols.
+ */
+void
+virStoragePoolObjStashVols(virStoragePoolObj *obj)
+{
+    GHashTableIter iter;
+    void *value;
+
+    virStoragePoolObjClearStashedVols(obj);
+
+    if (!obj->volumes)
+        return;
+
+    /* the key is owned by the definition itself */
+    obj->stashedVols = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+                                             (GDestroyNotify) virStorageVolDefFree);
+
+    virObjectRWLockWrite(obj->volumes);
+    g_hash_table_iter_init(&iter, obj->volumes->objsPath);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        virStorageVolObj *volobj = value;
+
+        VIR_WITH_OBJECT_LOCK_GUARD(volobj) {
+            virStorageVolDef *voldef = g_steal_pointer(&volobj->voldef);
+
+            g_hash_table_insert(obj->stashedVols, voldef->target.path, voldef);
+        }
+    }
+    virObjectRWUnlock(obj->volumes);
+
+    virStoragePoolObjClearVols(obj);
+}
+
+
+/**
+ * virStoragePoolObjUnstashVol:
+ * @obj: pool object
+ * @path: target path of the volume
+ *
+ * Returns the definition of the volume at @path stashed by
+ * virStoragePoolObjStashVols, or NULL if there is none. The caller
+ * takes over the ownership of the returned definition.
+ */
+virStorageVolDef *
+virStoragePoolObjUnstashVol(virStoragePoolObj *obj,
+                            const char *path)
+{
+    virStorageVolDef *voldef;
+
+    if (!obj->stashedVols ||
+        !(voldef = g_hash_table_lookup(obj->stashedVols, path)))
+        return NULL;
+
+    g_hash_table_steal(obj->stashedVols, path);
+    return voldef;
+}
+
+
+void
+virStoragePoolObjClearStashedVols(virStoragePoolObj *obj)
+{
+    g_clear_pointer(&obj->stashedVols, g_hash_table_unref);
+}
+
+
 int
 virStoragePoolObjAddVol(virStoragePoolObj *obj,
                         virStorageVolDef *voldef)
@@ -1522,7 +1593,6 @@ virStoragePoolObjListAdd(virStoragePoolObjList *pools,
                          unsigned int flags)
 {
     virStoragePoolObj *obj = NULL;
-    char uuidstr[VIR_UUID_STRING_BUFLEN];
     int rc;
 
     virObjectRWLockWrite(pools);
@@ -1545,14 +1615,12 @@ virStoragePoolObjListAdd(virStoragePoolObjList *pools,
     if (!(obj = virStoragePoolObjNew()))
         goto error;
 
-    virUUIDFormat((*def)->uuid, uuidstr);
-
     if (!(*def)->name ||
-        g_hash_table_contains(pools->objs, uuidstr) ||
+        g_hash_table_contains(pools->objs, (*def)->uuid) ||
         g_hash_table_contains(pools->objsName, (*def)->name))
         goto error;
 
-    g_hash_table_insert(pools->objs, g_strdup(uuidstr), obj);
+    g_hash_table_insert(pools->objs, virHashUUIDKeyNew((*def)->uuid), obj);
     virObjectRef(obj);
 
     g_hash_table_insert(pools->objsName, g_strdup((*def)->name), obj);
@@ -173,6 +173,16 @@ virStorageVolDefFindByName(virStoragePoolObj *obj,
 void
 virStoragePoolObjClearVols(virStoragePoolObj *obj);
 
+void
+virStoragePoolObjStashVols(virStoragePoolObj *obj);
+
+virStorageVolDef *
+virStoragePoolObjUnstashVol(virStoragePoolObj *obj,
+                            const char *path);
+
+void
+virStoragePoolObjClearStashedVols(virStoragePoolObj *obj);
+
 typedef bool
 (*virStoragePoolVolumeACLFilter)(virConnectPtr conn,
                                  virStoragePoolDef *pool,
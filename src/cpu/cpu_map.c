@@ -24,6 +24,7 @@
 #include "virfile.h"
 #include "cpu.h"
 #include "cpu_map.h"
+#include "cpu_map_builtin.h"
 #include "configmake.h"
 #include "virstring.h"
 #include "virlog.h"
@@ -32,6 +33,39 @@
 
 VIR_LOG_INIT("cpu.cpu_map");
 
+/*
+ * The files of the CPU map are built into the library so that they don't
+ * need to be looked up and read one by one. The files are only read when
+ * running from the build tree, where they may be edited locally.
+ */
+static xmlDocPtr
+cpuMapParse(const char *filename,
+            char **mapfile,
+            xmlXPathContextPtr *ctxt)
+{
+    g_autofree char *installed = g_build_filename(PKGDATADIR "/cpu_map",
+                                                  filename, NULL);
+    size_t i;
+
+    if (!(*mapfile = virFileFindResource(filename,
+                                         abs_top_srcdir "/src/cpu_map",
+                                         PKGDATADIR "/cpu_map")))
+        return NULL;
+
+    if (STREQ(*mapfile, installed)) {
+        for (i = 0; i < G_N_ELEMENTS(cpuMapBuiltin); i++) {
+            if (STREQ(cpuMapBuiltin[i].filename, filename)) {
+                VIR_DEBUG("Using built-in CPU map file %s", filename);
+                return virXMLParseStringCtxt(cpuMapBuiltin[i].contents,
+                                             *mapfile, ctxt);
+            }
+        }
+    }
+
+    VIR_DEBUG("Reading CPU map file %s", *mapfile);
+    return virXMLParseFileCtxt(*mapfile, ctxt);
+}
+
 static int
 loadData(const char *mapfile,
          xmlXPathContextPtr ctxt,
@@ -81,14 +115,9 @@ cpuMapLoadInclude(const char *filename,
     g_autoptr(xmlXPathContext) ctxt = NULL;
     g_autofree char *mapfile = NULL;
 
-    if (!(mapfile = virFileFindResource(filename,
-                                        abs_top_srcdir "/src/cpu_map",
-                                        PKGDATADIR "/cpu_map")))
-        return -1;
+    VIR_DEBUG("Loading CPU map include %s", filename);
 
-    VIR_DEBUG("Loading CPU map include from %s", mapfile);
-
-    if (!(xml = virXMLParseFileCtxt(mapfile, &ctxt)))
+    if (!(xml = cpuMapParse(filename, &mapfile, &ctxt)))
         return -1;
 
     ctxt->node = xmlDocGetRootElement(xml);
@@ -151,12 +180,7 @@ int cpuMapLoad(const char *arch,
     g_autofree char *xpath = NULL;
     g_autofree char *mapfile = NULL;
 
-    if (!(mapfile = virFileFindResource("index.xml",
-                                        abs_top_srcdir "/src/cpu_map",
-                                        PKGDATADIR "/cpu_map")))
-        return -1;
-
-    VIR_DEBUG("Loading '%s' CPU map from %s", NULLSTR(arch), mapfile);
+    VIR_DEBUG("Loading '%s' CPU map", NULLSTR(arch));
 
     if (arch == NULL) {
         virReportError(VIR_ERR_INTERNAL_ERROR,
@@ -164,7 +188,7 @@ int cpuMapLoad(const char *arch,
         return -1;
     }
 
-    if (!(xml = virXMLParseFileCtxt(mapfile, &ctxt)))
+    if (!(xml = cpuMapParse("index.xml", &mapfile, &ctxt)))
         return -1;
 
     virBufferAsprintf(&buf, "./arch[@name='%s']", arch);
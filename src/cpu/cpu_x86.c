@@ -33,6 +33,8 @@
 #include "virendian.h"
 #include "virstring.h"
 #include "virhostcpu.h"
+#include "virhash.h"
+#include "virthread.h"
 
 #define VIR_FROM_THIS VIR_FROM_CPU
 
@@ -2135,11 +2137,11 @@ x86DataFilterTSX(virCPUx86Data *data,
 
 
 static int
-x86Decode(virCPUDef *cpu,
-          const virCPUx86Data *cpuData,
-          virDomainCapsCPUModels *models,
-          const char **preferred,
-          bool migratable)
+x86DecodeImpl(virCPUDef *cpu,
+              const virCPUx86Data *cpuData,
+              virDomainCapsCPUModels *models,
+              const char **preferred,
+              bool migratable)
 {
     virCPUx86Map *map;
     virCPUx86Model *candidate;
@@ -2269,6 +2271,152 @@ x86Decode(virCPUDef *cpu,
     return 0;
 }
 
+/* Decoding compares the data with every CPU model in the map, which is
+ * slow and yet done over and over with the same data whenever the host
+ * CPU is compared with or translated to guest CPUs. Decoded models are
+ * remembered keyed by all the inputs of the decoding; the map never
+ * changes once loaded. */
+#define X86_DECODE_CACHE_SIZE 64
+
+static virMutex x86DecodeCacheLock = VIR_MUTEX_INITIALIZER;
+static GHashTable *x86DecodeCache;
+
+
+static char *
+x86DecodeCacheKey(virCPUDef *cpu,
+                  const virCPUx86Data *cpuData,
+                  virDomainCapsCPUModels *models,
+                  const char **preferred,
+                  bool migratable)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    size_t i;
+
+    virBufferAsprintf(&buf, "%d:%d:%d:", cpu->type, cpu->fallback, migratable);
+
+    for (i = 0; preferred && preferred[i]; i++)
+        virBufferAsprintf(&buf, "%s,", preferred[i]);
+    virBufferAddChar(&buf, ':');
+
+    for (i = 0; i < cpuData->len; i++) {
+        const virCPUx86DataItem *item = cpuData->items + i;
+
+        switch (item->type) {
+        case VIR_CPU_X86_DATA_CPUID:
+            virBufferAsprintf(&buf, "c%x,%x,%x,%x,%x,%x;",
+                              item->data.cpuid.eax_in,
+                              item->data.cpuid.ecx_in,
+                              item->data.cpuid.eax,
+                              item->data.cpuid.ebx,
+                              item->data.cpuid.ecx,
+                              item->data.cpuid.edx);
+            break;
+
+        case VIR_CPU_X86_DATA_MSR:
+            virBufferAsprintf(&buf, "m%x,%x,%x;",
+                              item->data.msr.index,
+                              item->data.msr.eax,
+                              item->data.msr.edx);
+            break;
+
+        case VIR_CPU_X86_DATA_NONE:
+        default:
+            break;
+        }
+    }
+
+    if (models) {
+        virBufferAddChar(&buf, ':');
+        for (i = 0; i < models->nmodels; i++) {
+            virDomainCapsCPUModel *model = models->models + i;
+            char **blocker;
+
+            virBufferAsprintf(&buf, "%s", model->name);
+            for (blocker = model->blockers; blocker && *blocker; blocker++)
+                virBufferAsprintf(&buf, ",%s", *blocker);
+            virBufferAddChar(&buf, ';');
+        }
+    }
+
+    return virBufferContentAndReset(&buf);
+}
+
+
+static virCPUDef *
+x86DecodeCacheLookup(const char *key)
+{
+    VIR_LOCK_GUARD lock = virLockGuardLock(&x86DecodeCacheLock);
+    virCPUDef *cached;
+
+    if (!x86DecodeCache ||
+        !(cached = virHashLookup(x86DecodeCache, key)))
+        return NULL;
+
+    return virCPUDefCopy(cached);
+}
+
+
+static void
+x86DecodeCacheStore(char **key,
+                    virCPUDef *cpu)
+{
+    VIR_LOCK_GUARD lock = virLockGuardLock(&x86DecodeCacheLock);
+    g_autoptr(virCPUDef) cached = virCPUDefNew();
+
+    if (!x86DecodeCache)
+        x86DecodeCache = virHashNew((GDestroyNotify) virCPUDefFree);
+
+    /* The same few CPUs are decoded all the time, no need for anything
+     * smarter than starting over when the cache is full. */
+    if (virHashSize(x86DecodeCache) >= X86_DECODE_CACHE_SIZE)
+        g_hash_table_remove_all(x86DecodeCache);
+
+    cached->type = cpu->type;
+    if (virCPUDefCopyModel(cached, cpu, false) < 0)
+        return;
+
+    g_hash_table_insert(x86DecodeCache, g_steal_pointer(key),
+                        g_steal_pointer(&cached));
+}
+
+
+static int
+x86Decode(virCPUDef *cpu,
+          const virCPUx86Data *cpuData,
+          virDomainCapsCPUModels *models,
+          const char **preferred,
+          bool migratable)
+{
+    g_autofree char *key = NULL;
+    g_autoptr(virCPUDef) cached = NULL;
+
+    if (!cpuData)
+        return -1;
+
+    key = x86DecodeCacheKey(cpu, cpuData, models, preferred, migratable);
+
+    if ((cached = x86DecodeCacheLookup(key))) {
+        VIR_DEBUG("Using cached CPU model %s", cached->model);
+
+        if (cached->vendor)
+            cpu->vendor = g_steal_pointer(&cached->vendor);
+        cpu->model = g_steal_pointer(&cached->model);
+        cpu->features = g_steal_pointer(&cached->features);
+        cpu->nfeatures = cached->nfeatures;
+        cached->nfeatures = 0;
+        cpu->nfeatures_max = cached->nfeatures_max;
+        cached->nfeatures_max = 0;
+        return 0;
+    }
+
+    if (x86DecodeImpl(cpu, cpuData, models, preferred, migratable) < 0)
+        return -1;
+
+    x86DecodeCacheStore(&key, cpu);
+    return 0;
+}
+
+
 static int
 x86DecodeCPUData(virCPUDef *cpu,
                  const virCPUData *data,
@@ -26,6 +26,7 @@
 #include "virerror.h"
 #include "virlog.h"
 #include "viralloc.h"
+#include "virhash.h"
 #include "viruuid.h"
 #include "virstring.h"
 
@@ -52,6 +53,7 @@ virClass *virStoragePoolClass;
 static void virConnectDispose(void *obj);
 static void virConnectCloseCallbackDataDispose(void *obj);
 static void virDomainDispose(void *obj);
+static void virDomainHandleFree(void *opaque);
 static void virDomainCheckpointDispose(void *obj);
 static void virDomainSnapshotDispose(void *obj);
 static void virInterfaceDispose(void *obj);
@@ -130,10 +132,17 @@ VIR_ONCE_GLOBAL_INIT(virDataTypes);
 virConnectPtr
 virGetConnect(void)
 {
+    virConnectPtr conn;
+
     if (virDataTypesInitialize() < 0)
         return NULL;
 
-    return virObjectLockableNew(virConnectClass);
+    if (!(conn = virObjectLockableNew(virConnectClass)))
+        return NULL;
+
+    conn->domains = virHashNewUUID(virDomainHandleFree);
+
+    return conn;
 }
 
 
@@ -176,6 +185,7 @@ virConnectDispose(void *obj)
     virResetError(&conn->err);
 
     virURIFree(conn->uri);
+    g_clear_pointer(&conn->domains, g_hash_table_unref);
 }
 
 
@@ -269,6 +279,28 @@ virConnectCloseCallbackDataGetCallback(virConnectCloseCallbackData *closeData)
     return closeData->callback;
 }
 
+/*
+ * Entry of virConnect's table of domains. The weak reference doesn't keep
+ * the domain alive, it only allows taking a new reference for as long as
+ * someone else holds one.
+ */
+typedef struct _virDomainHandle virDomainHandle;
+struct _virDomainHandle {
+    GWeakRef ref;
+    virDomainPtr domain;    /* only compared to, never dereferenced */
+};
+
+
+static void
+virDomainHandleFree(void *opaque)
+{
+    virDomainHandle *handle = opaque;
+
+    g_weak_ref_clear(&handle->ref);
+    g_free(handle);
+}
+
+
 /**
  * virGetDomain:
  * @conn: the hypervisor connection
@@ -276,8 +308,10 @@ virConnectCloseCallbackDataGetCallback(virConnectCloseCallbackData *closeData)
  * @uuid: pointer to the uuid
  * @id: domain ID
  *
- * Allocates a new domain object. When the object is no longer needed,
- * virObjectUnref() must be called in order to not leak data.
+ * Returns the domain object of the connection matching @uuid and @name if
+ * one is still alive, updating its @id, or allocates a new one. When the
+ * object is no longer needed, virObjectUnref() must be called in order to
+ * not leak data.
  *
  * Returns a pointer to the domain object, or NULL on error.
  */
@@ -287,6 +321,8 @@ virGetDomain(virConnectPtr conn,
              const unsigned char *uuid,
              int id)
 {
+    virDomainHandle *handle;
+    virDomainPtr stale = NULL;
     virDomainPtr ret = NULL;
 
     if (virDataTypesInitialize() < 0)
@@ -296,8 +332,30 @@ virGetDomain(virConnectPtr conn,
     virCheckNonNullArgGoto(name, error);
     virCheckNonNullArgGoto(uuid, error);
 
-    if (!(ret = virObjectNew(virDomainClass)))
+    virObjectLock(conn);
+
+    if ((handle = g_hash_table_lookup(conn->domains, uuid)) &&
+        (ret = g_weak_ref_get(&handle->ref))) {
+        /* The name of a live object can't be changed under its users'
+         * hands, so a renamed domain gets a new object. */
+        if (STREQ(ret->name, name)) {
+            if (ret->id != id) {
+                ret->id = id;
+                ret->stateCached = false;
+                ret->stateGeneration++;
+            }
+            virObjectUnlock(conn);
+            return ret;
+        }
+
+        /* Can't be released while holding the connection lock */
+        stale = g_steal_pointer(&ret);
+    }
+
+    if (!(ret = virObjectNew(virDomainClass))) {
+        virObjectUnlock(conn);
         goto error;
+    }
 
     ret->name = g_strdup(name);
 
@@ -305,9 +363,18 @@ virGetDomain(virConnectPtr conn,
     ret->id = id;
     memcpy(&(ret->uuid[0]), uuid, VIR_UUID_BUFLEN);
 
+    handle = g_new0(virDomainHandle, 1);
+    g_weak_ref_init(&handle->ref, ret);
+    handle->domain = ret;
+    g_hash_table_replace(conn->domains, virHashUUIDKeyNew(uuid), handle);
+
+    virObjectUnlock(conn);
+    virObjectUnref(stale);
+
     return ret;
 
  error:
+    virObjectUnref(stale);
     virObjectUnref(ret);
     return NULL;
 }
@@ -327,10 +394,18 @@ virDomainDispose(void *obj)
 {
     virDomainPtr domain = obj;
     char uuidstr[VIR_UUID_STRING_BUFLEN];
+    virDomainHandle *handle;
 
     virUUIDFormat(domain->uuid, uuidstr);
     VIR_DEBUG("release domain %p %s %s", domain, domain->name, uuidstr);
 
+    /* The entry might already belong to a newer object of the domain */
+    virObjectLock(domain->conn);
+    if ((handle = g_hash_table_lookup(domain->conn->domains, domain->uuid)) &&
+        handle->domain == domain)
+        g_hash_table_remove(domain->conn->domains, domain->uuid);
+    virObjectUnlock(domain->conn);
+
     g_free(domain->name);
     virObjectUnref(domain->conn);
 }
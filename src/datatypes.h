@@ -544,6 +544,10 @@ struct _virConnect {
     virError err;           /* the last error */
     virErrorFunc handler;   /* associated handler */
     void *userData;         /* the user data */
+
+    /* Live virDomain objects of this connection indexed by UUID, so that
+     * looking a domain up again returns the same object. */
+    GHashTable *domains;
 };
 
 G_DEFINE_AUTOPTR_CLEANUP_FUNC(virConnect, virObjectUnref);
@@ -603,6 +607,13 @@ struct _virDomain {
     char *name;                          /* the domain external name */
     int id;                              /* the domain ID */
     unsigned char uuid[VIR_UUID_BUFLEN]; /* the domain unique identifier */
+
+    /* Client side cache of the domain state, filled in and invalidated by
+     * the remote driver. Connection lock must be held to access these. */
+    bool stateCached;
+    int state;
+    int reason;
+    unsigned int stateGeneration;        /* bumped on every invalidation */
 };
 
 /**
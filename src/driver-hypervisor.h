@@ -1437,6 +1437,54 @@ typedef int
                                   int seconds,
                                   unsigned int flags);
 
+typedef int
+(*virDrvConnectDomainStatsRegister)(virConnectPtr conn,
+                                    virDomainPtr dom,
+                                    unsigned int stats,
+                                    unsigned int interval,
+                                    virConnectDomainStatsCallback cb,
+                                    void *opaque,
+                                    virFreeCallback freecb,
+                                    unsigned int flags);
+
+typedef int
+(*virDrvConnectDomainStatsDeregister)(virConnectPtr conn,
+                                      int callbackID);
+
+typedef int
+(*virDrvConnectDomainEventRingOpen)(virConnectPtr conn,
+                                    unsigned int stats,
+                                    unsigned int interval,
+                                    unsigned int flags);
+
+typedef int
+(*virDrvDomainListSnapshotCreateXML)(virConnectPtr conn,
+                                     virDomainPtr *doms,
+                                     unsigned int ndoms,
+                                     const char **xmlDescs,
+                                     virDomainSnapshotPtr **snaps,
+                                     unsigned int flags);
+
+typedef int
+(*virDrvDomainAttachDevices)(virDomainPtr domain,
+                             const char **xmls,
+                             unsigned int nxmls,
+                             unsigned int flags);
+
+typedef int
+(*virDrvDomainDetachDevices)(virDomainPtr domain,
+                             const char **xmls,
+                             unsigned int nxmls,
+                             unsigned int flags);
+
+typedef int
+(*virDrvConnectListDomainsPage)(virConnectPtr conn,
+                                virTypedParameterPtr params,
+                                int nparams,
+                                virDomainStatsRecordPtr **records,
+                                char **cursor,
+                                unsigned int flags);
+
 typedef struct _virHypervisorDriver virHypervisorDriver;
 
 /**
@@ -1707,4 +1755,11 @@ struct _virHypervisorDriver {
     virDrvDomainAuthorizedSSHKeysSet domainAuthorizedSSHKeysSet;
     virDrvDomainGetMessages domainGetMessages;
     virDrvDomainStartDirtyRateCalc domainStartDirtyRateCalc;
+    virDrvConnectDomainStatsRegister connectDomainStatsRegister;
+    virDrvConnectDomainStatsDeregister connectDomainStatsDeregister;
+    virDrvConnectDomainEventRingOpen connectDomainEventRingOpen;
+    virDrvDomainListSnapshotCreateXML domainListSnapshotCreateXML;
+    virDrvDomainAttachDevices domainAttachDevices;
+    virDrvDomainDetachDevices domainDetachDevices;
+    virDrvConnectListDomainsPage connectListDomainsPage;
 };
@@ -51,9 +51,19 @@ typedef int
 typedef int
 (*virDrvStateShutdownWait)(void);
 
+/*
+ * The state drivers are initialized in the order they were registered,
+ * unless they list the names of the drivers they depend on in
+ * @dependencies. Such drivers are initialized concurrently with the other
+ * drivers registered after the last driver without @dependencies before
+ * them, once the drivers they depend on are initialized. An empty list
+ * means the driver depends on no such driver, dependencies which are not
+ * registered are ignored.
+ */
 typedef struct _virStateDriver virStateDriver;
 struct _virStateDriver {
     const char *name;
+    const char *const *dependencies; /* NULL terminated */
     bool initialized;
     virDrvStateInitialize stateInitialize;
     virDrvStateCleanup stateCleanup;
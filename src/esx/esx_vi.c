@@ -27,6 +27,7 @@
 
 #include "virbuffer.h"
 #include "viralloc.h"
+#include "virhash.h"
 #include "virlog.h"
 #include "viruuid.h"
 #include "vmx.h"
@@ -782,6 +783,9 @@ ESX_VI__TEMPLATE__FREE(Context,
     if (item->sessionLock)
         virMutexDestroy(item->sessionLock);
 
+    if (item->virtualMachineRefsLock)
+        virMutexDestroy(item->virtualMachineRefsLock);
+
     esxVI_CURL_Free(&item->curl);
     g_free(item->url);
     g_free(item->ipAddress);
@@ -790,6 +794,8 @@ ESX_VI__TEMPLATE__FREE(Context,
     esxVI_ServiceContent_Free(&item->service);
     esxVI_UserSession_Free(&item->session);
     g_free(item->sessionLock);
+    g_clear_pointer(&item->virtualMachineRefs, g_hash_table_unref);
+    g_free(item->virtualMachineRefsLock);
     esxVI_Datacenter_Free(&item->datacenter);
     g_free(item->datacenterPath);
     esxVI_ComputeResource_Free(&item->computeResource);
@@ -845,6 +851,15 @@ esxVI_Context_Connect(esxVI_Context *ctx, const char *url,
         return -1;
     }
 
+    ctx->virtualMachineRefs = virHashNew(g_free);
+    ctx->virtualMachineRefsLock = g_new0(virMutex, 1);
+
+    if (virMutexInit(ctx->virtualMachineRefsLock) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("Could not initialize virtual machine cache mutex"));
+        return -1;
+    }
+
     if (esxVI_RetrieveServiceContent(ctx, &ctx->service) < 0)
         return -1;
 
@@ -2670,6 +2685,95 @@ esxVI_LookupVirtualMachineList(esxVI_Context *ctx,
 
 
 
+/*
+ * Looking up a virtual machine by its UUID takes a FindByUuid call before
+ * its properties can be retrieved. The managed object IDs found are
+ * remembered, so that the next lookups of the same virtual machine need
+ * a single call. The ID may have been reused or the UUID of the virtual
+ * machine changed in the meantime, so it's only trusted if the retrieved
+ * config.uuid property still matches.
+ *
+ * Returns true and sets @virtualMachine if the cached ID is still valid,
+ * false otherwise, without reporting errors.
+ */
+static bool
+esxVI_LookupVirtualMachineByCachedUuid(esxVI_Context *ctx,
+                                       const unsigned char *uuid,
+                                       const char *uuid_string,
+                                       esxVI_String *propertyNameList,
+                                       esxVI_ObjectContent **virtualMachine)
+{
+    bool result = false;
+    g_autofree char *value = NULL;
+    esxVI_ManagedObjectReference *managedObjectReference = NULL;
+    esxVI_String *completePropertyNameList = NULL;
+    esxVI_ObjectContent *candidate = NULL;
+    esxVI_DynamicProperty *dynamicProperty;
+    unsigned char candidate_uuid[VIR_UUID_BUFLEN];
+
+    VIR_WITH_MUTEX_LOCK_GUARD(ctx->virtualMachineRefsLock) {
+        value = g_strdup(virHashLookup(ctx->virtualMachineRefs, uuid_string));
+    }
+
+    if (!value)
+        return false;
+
+    if (esxVI_ManagedObjectReference_Alloc(&managedObjectReference) < 0)
+        goto cleanup;
+
+    managedObjectReference->type = g_strdup("VirtualMachine");
+    managedObjectReference->value = g_steal_pointer(&value);
+
+    if (esxVI_String_DeepCopyList(&completePropertyNameList,
+                                  propertyNameList) < 0 ||
+        esxVI_String_AppendValueToList(&completePropertyNameList,
+                                       "config.uuid") < 0 ||
+        esxVI_LookupObjectContentByType(ctx, managedObjectReference,
+                                        "VirtualMachine",
+                                        completePropertyNameList, &candidate,
+                                        esxVI_Occurrence_OptionalItem) < 0 ||
+        !candidate) {
+        goto cleanup;
+    }
+
+    for (dynamicProperty = candidate->propSet; dynamicProperty;
+         dynamicProperty = dynamicProperty->_next) {
+        if (STREQ(dynamicProperty->name, "config.uuid")) {
+            if (esxVI_AnyType_ExpectType(dynamicProperty->val,
+                                         esxVI_Type_String) < 0 ||
+                virUUIDParse(dynamicProperty->val->string, candidate_uuid) < 0) {
+                goto cleanup;
+            }
+
+            if (memcmp(uuid, candidate_uuid, VIR_UUID_BUFLEN) == 0) {
+                *virtualMachine = g_steal_pointer(&candidate);
+                result = true;
+            }
+
+            break;
+        }
+    }
+
+ cleanup:
+    if (!result) {
+        VIR_DEBUG("Cached ID of virtual machine '%s' is stale", uuid_string);
+
+        virResetLastError();
+
+        VIR_WITH_MUTEX_LOCK_GUARD(ctx->virtualMachineRefsLock) {
+            g_hash_table_remove(ctx->virtualMachineRefs, uuid_string);
+        }
+    }
+
+    esxVI_ManagedObjectReference_Free(&managedObjectReference);
+    esxVI_String_Free(&completePropertyNameList);
+    esxVI_ObjectContent_Free(&candidate);
+
+    return result;
+}
+
+
+
 int
 esxVI_LookupVirtualMachineByUuid(esxVI_Context *ctx, const unsigned char *uuid,
                                  esxVI_String *propertyNameList,
@@ -2684,6 +2788,11 @@ esxVI_LookupVirtualMachineByUuid(esxVI_Context *ctx, const unsigned char *uuid,
 
     virUUIDFormat(uuid, uuid_string);
 
+    if (esxVI_LookupVirtualMachineByCachedUuid(ctx, uuid, uuid_string,
+                                               propertyNameList,
+                                               virtualMachine))
+        return 0;
+
     if (esxVI_FindByUuid(ctx, ctx->datacenter->_reference, uuid_string,
                          esxVI_Boolean_True, esxVI_Boolean_Undefined,
                          &managedObjectReference) < 0) {
@@ -2710,6 +2819,11 @@ esxVI_LookupVirtualMachineByUuid(esxVI_Context *ctx, const unsigned char *uuid,
         goto cleanup;
     }
 
+    VIR_WITH_MUTEX_LOCK_GUARD(ctx->virtualMachineRefsLock) {
+        g_hash_table_insert(ctx->virtualMachineRefs, g_strdup(uuid_string),
+                            g_strdup(managedObjectReference->value));
+    }
+
     result = 0;
 
  cleanup:
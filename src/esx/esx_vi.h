@@ -184,7 +184,9 @@ struct _esxVI_Context {
     esxVI_ProductLine productLine;
     unsigned long productVersion; /* = 1000000 * major + 1000 * minor + micro */
     esxVI_UserSession *session; /* ... except the session ... */
-    virMutex *sessionLock; /* ... that is protected by this mutex */
+    virMutex *sessionLock; /* ... that is protected by this mutex, ... */
+    GHashTable *virtualMachineRefs; /* ... and the UUID -> ID cache of VMs */
+    virMutex *virtualMachineRefsLock; /* that is protected by this mutex */
     esxVI_Datacenter *datacenter;
     char *datacenterPath; /* including folders */
     esxVI_ComputeResource *computeResource;
@@ -34,6 +34,7 @@
 #include "virlog.h"
 #include "virutil.h"
 #include "virnetdev.h"
+#include "virthread.h"
 #include "configmake.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
@@ -597,26 +598,109 @@ virHostdevRestoreNetConfig(virDomainHostdevDef *hostdev,
     }
 }
 
-static int
-virHostdevResetAllPCIDevices(virHostdevManager *mgr,
-                             virPCIDeviceList *pcidevs)
+/* Devices sharing a bus are reset by the same thread, one after another,
+ * because a secondary bus reset affects all of them */
+struct virHostdevResetPCIBusData {
+    virHostdevManager *mgr;
+    virPCIDevice **pcidevs;
+    size_t npcidevs;
+    virThread thread;
+    bool threadRunning;
+    virErrorPtr err;
+    int ret;
+};
+
+static void
+virHostdevResetPCIBusDevices(void *opaque)
 {
-    int ret = 0;
+    struct virHostdevResetPCIBusData *data = opaque;
     size_t i;
 
-    for (i = 0; i < virPCIDeviceListCount(pcidevs); i++) {
-        virPCIDevice *pci = virPCIDeviceListGet(pcidevs, i);
+    for (i = 0; i < data->npcidevs; i++) {
+        virPCIDevice *pci = data->pcidevs[i];
 
         /* We can avoid looking up the actual device here, because performing
          * a PCI reset on a device doesn't require any information other than
          * the address, which 'pci' already contains */
         VIR_DEBUG("Resetting PCI device %s", virPCIDeviceGetName(pci));
-        if (virPCIDeviceReset(pci, mgr->activePCIHostdevs,
-                              mgr->inactivePCIHostdevs) < 0) {
+        if (virPCIDeviceReset(pci, data->mgr->activePCIHostdevs,
+                              data->mgr->inactivePCIHostdevs) < 0) {
             VIR_ERROR(_("Failed to reset PCI device: %s"),
                       virGetLastErrorMessage());
+            if (!data->err)
+                virErrorPreserveLast(&data->err);
+            data->ret = -1;
+        }
+    }
+}
+
+/*
+ * Resetting a device may take up to several hundred milliseconds, most of
+ * which are spent waiting for the device to settle. Therefore devices on
+ * different buses are reset in parallel. The bookkeeping lists are locked
+ * by the caller and only looked into until all the threads are finished.
+ */
+static int
+virHostdevResetAllPCIDevices(virHostdevManager *mgr,
+                             virPCIDeviceList *pcidevs)
+{
+    size_t count = virPCIDeviceListCount(pcidevs);
+    g_autofree struct virHostdevResetPCIBusData *buses = NULL;
+    size_t nbuses = 0;
+    int ret = 0;
+    size_t i;
+    size_t j;
+
+    if (count == 0)
+        return 0;
+
+    buses = g_new0(struct virHostdevResetPCIBusData, count);
+
+    for (i = 0; i < count; i++) {
+        virPCIDevice *pci = virPCIDeviceListGet(pcidevs, i);
+        virPCIDeviceAddress *addr = virPCIDeviceGetAddress(pci);
+
+        for (j = 0; j < nbuses; j++) {
+            virPCIDeviceAddress *busAddr = virPCIDeviceGetAddress(buses[j].pcidevs[0]);
+
+            if (busAddr->domain == addr->domain && busAddr->bus == addr->bus)
+                break;
+        }
+
+        if (j == nbuses)
+            buses[nbuses++].mgr = mgr;
+
+        VIR_APPEND_ELEMENT_COPY(buses[j].pcidevs, buses[j].npcidevs, pci);
+    }
+
+    /* The first bus is handled by this thread, which also serves as a
+     * fallback should a new thread fail to start */
+    for (j = 1; j < nbuses; j++) {
+        if (virThreadCreateFull(&buses[j].thread, true,
+                                virHostdevResetPCIBusDevices,
+                                "hostdev-reset", false, &buses[j]) < 0) {
+            VIR_WARN("Failed to start thread for resetting PCI devices");
+            continue;
+        }
+        buses[j].threadRunning = true;
+    }
+
+    virHostdevResetPCIBusDevices(&buses[0]);
+
+    for (j = 1; j < nbuses; j++) {
+        if (buses[j].threadRunning)
+            virThreadJoin(&buses[j].thread);
+        else
+            virHostdevResetPCIBusDevices(&buses[j]);
+    }
+
+    for (j = 0; j < nbuses; j++) {
+        if (buses[j].ret < 0 && ret == 0) {
+            virErrorRestore(&buses[j].err);
             ret = -1;
         }
+        virFreeError(buses[j].err);
+        g_free(buses[j].pcidevs);
     }
 
     return ret;
@@ -22,6 +22,7 @@
 #include <config.h>
 
 #include <netcf.h>
+#include <sys/stat.h>
 
 #include "virerror.h"
 #include "datatypes.h"
@@ -44,6 +45,13 @@ VIR_LOG_INIT("interface.interface_backend_netcf");
 
 #define INTERFACE_DRIVER_NAME "netcf"
 
+/* Configured host interface as listed by netcf */
+typedef struct {
+    char *name;
+    char *mac;
+    virInterfaceDef *inactiveDef; /* NULL until asked for */
+} netcfCachedInterface;
+
 /* Main driver state */
 typedef struct
 {
@@ -54,8 +62,26 @@ typedef struct
     char *stateDir;
     struct netcf *netcf;
     bool privileged;
+
+    /* Each netcf call reloads and parses all the network configuration
+     * files, which is slow on hosts with many interfaces. What depends on
+     * nothing but the configuration is cached here for as long as the
+     * configuration files stay the same as described by @cacheStamp, see
+     * netcfCacheRefresh. */
+    char *cacheStamp;
+    netcfCachedInterface *cache;
+    size_t ncache;
 } virNetcfDriverState, *virNetcfDriverStatePtr;
 
+/* Where the netcf backends of the various distributions read the
+ * configuration from */
+static const char *netcfConfigPaths[] = {
+    SYSCONFDIR "/sysconfig/network-scripts",
+    SYSCONFDIR "/sysconfig/network",
+    SYSCONFDIR "/network/interfaces",
+    SYSCONFDIR "/network/interfaces.d",
+};
+
 static virClass *virNetcfDriverStateClass;
 static void virNetcfDriverStateDispose(void *obj);
 
@@ -73,11 +99,29 @@ VIR_ONCE_GLOBAL_INIT(virNetcfDriverState);
 static virNetcfDriverStatePtr driver;
 
 
+static void
+netcfCacheClear(virNetcfDriverStatePtr _driver)
+{
+    size_t i;
+
+    for (i = 0; i < _driver->ncache; i++) {
+        g_free(_driver->cache[i].name);
+        g_free(_driver->cache[i].mac);
+        virInterfaceDefFree(_driver->cache[i].inactiveDef);
+    }
+    g_clear_pointer(&_driver->cache, g_free);
+    _driver->ncache = 0;
+    g_clear_pointer(&_driver->cacheStamp, g_free);
+}
+
+
 static void
 virNetcfDriverStateDispose(void *obj)
 {
     virNetcfDriverStatePtr _driver = obj;
 
+    netcfCacheClear(_driver);
+
     if (_driver->netcf)
         ncf_close(_driver->netcf);
 
@@ -159,6 +203,7 @@ netcfStateReload(void)
         return 0;
 
     VIR_WITH_OBJECT_LOCK_GUARD(driver) {
+        netcfCacheClear(driver);
         ncf_close(driver->netcf);
         if (ncf_init(&driver->netcf, NULL) != 0) {
             /* this isn't a good situation, because we can't shut down the
@@ -249,6 +294,18 @@ netcfGetMinimalDefForDevice(struct netcf_if *iface)
 }
 
 
+static virInterfaceDef *
+netcfGetMinimalDefForCached(netcfCachedInterface *cached)
+{
+    virInterfaceDef *def = g_new0(virInterfaceDef, 1);
+
+    def->name = g_strdup(cached->name);
+    def->mac = g_strdup(cached->mac);
+
+    return def;
+}
+
+
 static int netcf_to_vir_err(int netcf_errcode)
 {
     switch (netcf_errcode) {
@@ -289,6 +346,155 @@ static int netcf_to_vir_err(int netcf_errcode)
     }
 }
 
+static void
+netcfConfigStampAdd(virBuffer *buf,
+                    const char *path,
+                    struct stat *sb)
+{
+    virBufferAsprintf(buf, "%s %llu %lld %lld.%09ld\n", path,
+                      (unsigned long long)sb->st_ino,
+                      (long long)sb->st_size,
+                      (long long)sb->st_mtim.tv_sec, sb->st_mtim.tv_nsec);
+}
+
+
+/*
+ * Describes the state of the network configuration files. Directories
+ * are described by their entries, as editing a file in place doesn't
+ * change the modification time of the directory. There's no point in
+ * reporting errors, a file that can't be looked at just doesn't
+ * contribute to the description.
+ */
+static char *
+netcfConfigStamp(void)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    size_t i;
+
+    for (i = 0; i < G_N_ELEMENTS(netcfConfigPaths); i++) {
+        g_autoptr(DIR) dir = NULL;
+        struct dirent *ent;
+        struct stat sb;
+
+        if (stat(netcfConfigPaths[i], &sb) < 0)
+            continue;
+
+        netcfConfigStampAdd(&buf, netcfConfigPaths[i], &sb);
+
+        if (!S_ISDIR(sb.st_mode) ||
+            virDirOpenQuiet(&dir, netcfConfigPaths[i]) < 0)
+            continue;
+
+        while (virDirRead(dir, &ent, NULL) > 0) {
+            g_autofree char *path = g_build_filename(netcfConfigPaths[i],
+                                                     ent->d_name, NULL);
+
+            if (stat(path, &sb) == 0)
+                netcfConfigStampAdd(&buf, path, &sb);
+        }
+    }
+
+    virBufferAddLit(&buf, "\n");
+    return virBufferContentAndReset(&buf);
+}
+
+
+/*
+ * Makes sure the cache of configured interfaces matches the current
+ * configuration files. The driver must be locked.
+ */
+static int
+netcfCacheRefresh(void)
+{
+    g_autofree char *stamp = netcfConfigStamp();
+    unsigned int ncf_flags = NETCF_IFACE_ACTIVE | NETCF_IFACE_INACTIVE;
+    char **names = NULL;
+    int count;
+    int ret = -1;
+    size_t i;
+
+    if (driver->cacheStamp && STREQ(driver->cacheStamp, stamp))
+        return 0;
+
+    netcfCacheClear(driver);
+
+    if ((count = ncf_num_of_interfaces(driver->netcf, ncf_flags)) < 0) {
+        const char *errmsg, *details;
+        int errcode = ncf_error(driver->netcf, &errmsg, &details);
+
+        virReportError(netcf_to_vir_err(errcode),
+                       _("failed to get number of host interfaces: %s%s%s"),
+                       errmsg, details ? " - " : "",
+                       NULLSTR_EMPTY(details));
+        return -1;
+    }
+
+    names = g_new0(char *, count + 1);
+
+    if (count > 0 &&
+        (count = ncf_list_interfaces(driver->netcf, count,
+                                     names, ncf_flags)) < 0) {
+        const char *errmsg, *details;
+        int errcode = ncf_error(driver->netcf, &errmsg, &details);
+
+        virReportError(netcf_to_vir_err(errcode),
+                       _("failed to list host interfaces: %s%s%s"),
+                       errmsg, details ? " - " : "",
+                       NULLSTR_EMPTY(details));
+        goto cleanup;
+    }
+
+    driver->cache = g_new0(netcfCachedInterface, MAX(count, 1));
+
+    for (i = 0; i < count; i++) {
+        struct netcf_if *iface = ncf_lookup_by_name(driver->netcf, names[i]);
+        netcfCachedInterface *cached;
+
+        if (!iface) {
+            const char *errmsg, *details;
+            int errcode = ncf_error(driver->netcf, &errmsg, &details);
+            if (errcode != NETCF_NOERROR) {
+                virReportError(netcf_to_vir_err(errcode),
+                               _("couldn't find interface named '%s': %s%s%s"),
+                               names[i], errmsg,
+                               details ? " - " : "", NULLSTR_EMPTY(details));
+                netcfCacheClear(driver);
+                goto cleanup;
+            }
+            continue;
+        }
+
+        cached = driver->cache + driver->ncache++;
+        cached->name = g_strdup(ncf_if_name(iface));
+        cached->mac = g_strdup(ncf_if_mac_string(iface));
+        ncf_if_free(iface);
+    }
+
+    driver->cacheStamp = g_steal_pointer(&stamp);
+    ret = 0;
+
+ cleanup:
+    for (i = 0; names[i]; i++)
+        VIR_FREE(names[i]);
+    VIR_FREE(names);
+    return ret;
+}
+
+
+static netcfCachedInterface *
+netcfCacheLookupByName(const char *name)
+{
+    size_t i;
+
+    for (i = 0; i < driver->ncache; i++) {
+        if (STREQ(driver->cache[i].name, name))
+            return driver->cache + i;
+    }
+
+    return NULL;
+}
+
+
 static struct netcf_if *interfaceDriverGetNetcfIF(struct netcf *ncf, virInterfacePtr ifinfo)
 {
     /* 1) caller already has lock,
@@ -587,6 +793,51 @@ static int netcfConnectListDefinedInterfaces(virConnectPtr conn, char **const na
     return count;
 }
 
+static int
+netcfConnectListAllInterfacesCached(virConnectPtr conn,
+                                    virInterfacePtr **ifaces,
+                                    virInterfaceObjListFilter filter)
+{
+    virInterfacePtr *tmp_iface_objs = NULL;
+    int niface_objs = 0;
+    size_t i;
+
+    if (netcfCacheRefresh() < 0)
+        return -1;
+
+    if (ifaces)
+        tmp_iface_objs = g_new0(virInterfacePtr, driver->ncache + 1);
+
+    for (i = 0; i < driver->ncache; i++) {
+        g_autoptr(virInterfaceDef) def = netcfGetMinimalDefForCached(driver->cache + i);
+
+        if (!filter(conn, def))
+            continue;
+
+        if (ifaces) {
+            if (!(tmp_iface_objs[niface_objs] = virGetInterface(conn, def->name,
+                                                                def->mac)))
+                goto error;
+        }
+        niface_objs++;
+    }
+
+    if (tmp_iface_objs) {
+        /* trim the array to the final size */
+        VIR_REALLOC_N(tmp_iface_objs, niface_objs + 1);
+        *ifaces = g_steal_pointer(&tmp_iface_objs);
+    }
+
+    return niface_objs;
+
+ error:
+    for (i = 0; i < niface_objs; i++)
+        virObjectUnref(tmp_iface_objs[i]);
+    g_free(tmp_iface_objs);
+    return -1;
+}
+
+
 #define MATCH(FLAG) (flags & (FLAG))
 static int
 netcfConnectListAllInterfaces(virConnectPtr conn,
@@ -610,6 +861,13 @@ netcfConnectListAllInterfaces(virConnectPtr conn,
 
     virObjectLock(driver);
 
+    /* the list of all interfaces depends on the configuration only */
+    if (!MATCH(VIR_CONNECT_LIST_INTERFACES_FILTERS_ACTIVE)) {
+        ret = netcfConnectListAllInterfacesCached(conn, ifaces,
+                                                  virConnectListAllInterfacesCheckACL);
+        goto cleanup;
+    }
+
     /* let netcf pre-filter for this flag to save time */
     if (MATCH(VIR_CONNECT_LIST_INTERFACES_FILTERS_ACTIVE)) {
         if (MATCH(VIR_CONNECT_LIST_INTERFACES_ACTIVE))
@@ -728,8 +986,20 @@ static virInterfacePtr netcfInterfaceLookupByName(virConnectPtr conn,
     struct netcf_if *iface;
     virInterfacePtr ret = NULL;
     g_autoptr(virInterfaceDef) def = NULL;
+    netcfCachedInterface *cached;
     VIR_LOCK_GUARD lock = virObjectLockGuard(driver);
 
+    if (netcfCacheRefresh() == 0 &&
+        (cached = netcfCacheLookupByName(name))) {
+        def = netcfGetMinimalDefForCached(cached);
+
+        if (virInterfaceLookupByNameEnsureACL(conn, def) < 0)
+            return NULL;
+
+        return virGetInterface(conn, def->name, def->mac);
+    }
+    virResetLastError();
+
     iface = ncf_lookup_by_name(driver->netcf, name);
     if (!iface) {
         const char *errmsg, *details;
@@ -768,6 +1038,36 @@ static virInterfacePtr netcfInterfaceLookupByMACString(virConnectPtr conn,
     g_autoptr(virInterfaceDef) def = NULL;
     VIR_LOCK_GUARD lock = virObjectLockGuard(driver);
 
+    if (netcfCacheRefresh() == 0) {
+        netcfCachedInterface *cached = NULL;
+        size_t i;
+
+        niface = 0;
+        for (i = 0; i < driver->ncache; i++) {
+            if (driver->cache[i].mac &&
+                STRCASEEQ(driver->cache[i].mac, macstr)) {
+                cached = driver->cache + i;
+                niface++;
+            }
+        }
+
+        if (niface > 1) {
+            virReportError(VIR_ERR_MULTIPLE_INTERFACES,
+                           "%s", _("multiple interfaces with matching MAC address"));
+            return NULL;
+        }
+
+        if (cached) {
+            def = netcfGetMinimalDefForCached(cached);
+
+            if (virInterfaceLookupByMACStringEnsureACL(conn, def) < 0)
+                return NULL;
+
+            return virGetInterface(conn, def->name, def->mac);
+        }
+    }
+    virResetLastError();
+
     niface = ncf_lookup_by_mac_string(driver->netcf, macstr, 1, &iface);
 
     if (niface < 0) {
@@ -813,10 +1113,41 @@ static char *netcfInterfaceGetXMLDesc(virInterfacePtr ifinfo,
     g_autoptr(virInterfaceDef) ifacedef = NULL;
     char *ret = NULL;
     bool active;
+    netcfCachedInterface *cached;
     VIR_LOCK_GUARD lock = virObjectLockGuard(driver);
 
     virCheckFlags(VIR_INTERFACE_XML_INACTIVE, NULL);
 
+    /* the inactive XML depends on the configuration only */
+    if ((flags & VIR_INTERFACE_XML_INACTIVE) &&
+        netcfCacheRefresh() == 0 &&
+        (cached = netcfCacheLookupByName(ifinfo->name))) {
+        if (!cached->inactiveDef) {
+            if (!(iface = interfaceDriverGetNetcfIF(driver->netcf, ifinfo)))
+                goto cleanup;
+
+            if (!(xmlstr = ncf_if_xml_desc(iface))) {
+                const char *errmsg, *details;
+                int errcode = ncf_error(driver->netcf, &errmsg, &details);
+                virReportError(netcf_to_vir_err(errcode),
+                               _("could not get interface XML description: %s%s%s"),
+                               errmsg, details ? " - " : "",
+                               NULLSTR_EMPTY(details));
+                goto cleanup;
+            }
+
+            if (!(cached->inactiveDef = virInterfaceDefParseString(xmlstr, 0)))
+                goto cleanup;
+        }
+
+        if (virInterfaceGetXMLDescEnsureACL(ifinfo->conn, cached->inactiveDef) < 0)
+            goto cleanup;
+
+        ret = virInterfaceDefFormat(cached->inactiveDef);
+        goto cleanup;
+    }
+    virResetLastError();
+
     iface = interfaceDriverGetNetcfIF(driver->netcf, ifinfo);
     if (!iface) {
         /* helper already reported error */
@@ -889,6 +1220,10 @@ static virInterfacePtr netcfInterfaceDefineXML(virConnectPtr conn,
         goto cleanup;
     }
 
+    /* netcf may change the configuration files within the granularity of
+     * their timestamps, so don't rely on them */
+    netcfCacheClear(driver);
+
     iface = ncf_define(driver->netcf, xmlstr);
     if (!iface) {
         const char *errmsg, *details;
@@ -928,6 +1263,7 @@ static int netcfInterfaceUndefine(virInterfacePtr ifinfo)
     if (virInterfaceUndefineEnsureACL(ifinfo->conn, def) < 0)
        goto cleanup;
 
+    netcfCacheClear(driver);
     ret = ncf_if_undefine(iface);
     if (ret < 0) {
         const char *errmsg, *details;
@@ -977,6 +1313,7 @@ static int netcfInterfaceCreate(virInterfacePtr ifinfo,
         goto cleanup;
     }
 
+    netcfCacheClear(driver);
     ret = ncf_if_up(iface);
     if (ret < 0) {
         const char *errmsg, *details;
@@ -1026,6 +1363,7 @@ static int netcfInterfaceDestroy(virInterfacePtr ifinfo,
         goto cleanup;
     }
 
+    netcfCacheClear(driver);
     ret = ncf_if_down(iface);
     if (ret < 0) {
         const char *errmsg, *details;
@@ -1082,6 +1420,7 @@ static int netcfInterfaceChangeBegin(virConnectPtr conn, unsigned int flags)
         return -1;
 
     VIR_WITH_OBJECT_LOCK_GUARD(driver) {
+        netcfCacheClear(driver);
         ret = ncf_change_begin(driver->netcf, 0);
         if (ret < 0) {
             const char *errmsg, *details;
@@ -1106,6 +1445,7 @@ static int netcfInterfaceChangeCommit(virConnectPtr conn, unsigned int flags)
         return -1;
 
     VIR_WITH_OBJECT_LOCK_GUARD(driver) {
+        netcfCacheClear(driver);
         ret = ncf_change_commit(driver->netcf, 0);
         if (ret < 0) {
             const char *errmsg, *details;
@@ -1130,6 +1470,7 @@ static int netcfInterfaceChangeRollback(virConnectPtr conn, unsigned int flags)
         return -1;
 
     VIR_WITH_OBJECT_LOCK_GUARD(driver) {
+        netcfCacheClear(driver);
         ret = ncf_change_rollback(driver->netcf, 0);
         if (ret < 0) {
             const char *errmsg, *details;
@@ -1185,6 +1526,7 @@ static virConnectDriver interfaceConnectDriver = {
 
 static virStateDriver interfaceStateDriver = {
     .name = INTERFACE_DRIVER_NAME,
+    .dependencies = (const char *const []) { NULL },
     .stateInitialize = netcfStateInitialize,
     .stateCleanup = netcfStateCleanup,
     .stateReload = netcfStateReload,
@@ -1264,6 +1264,7 @@ static virConnectDriver udevConnectDriver = {
 
 static virStateDriver interfaceStateDriver = {
     .name = "udev",
+    .dependencies = (const char *const []) { NULL },
     .stateInitialize = udevStateInitialize,
     .stateCleanup = udevStateCleanup,
 };
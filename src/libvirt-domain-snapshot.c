@@ -265,6 +265,115 @@ virDomainSnapshotCreateXML(virDomainPtr domain,
 }
 
 
+/**
+ * virDomainListSnapshotCreateXML:
+ * @doms: NULL terminated array of domains
+ * @xmlDescs: array of snapshot XML descriptions, one for each of @doms
+ * @snaps: pointer that will be filled with the array of new snapshots
+ * @flags: bitwise-OR of supported virDomainSnapshotCreateFlags
+ *
+ * Creates a snapshot of each of the running domains in @doms at the same
+ * time, for example of all domains that make up a single application.
+ * Note that all domains in @doms must share the same connection and that
+ * a domain must not be listed more than once. The snapshot of the i-th
+ * domain is described by the i-th element of @xmlDescs, see
+ * virDomainSnapshotCreateXML() for its format.
+ *
+ * The snapshots are taken in phases which overlap for all domains. If
+ * @flags includes VIR_DOMAIN_SNAPSHOT_CREATE_QUIESCE, the file systems of
+ * all domains are frozen first using the guest agent, then the disk
+ * snapshots of all domains are taken, and only once all of them are done
+ * the file systems are thawed, so the snapshots are consistent across the
+ * whole group while the guests are frozen only for as long as the slowest
+ * one takes. Without VIR_DOMAIN_SNAPSHOT_CREATE_QUIESCE, the disks of all
+ * domains are still snapshotted at about the same time, but each of them
+ * may be inconsistent as if power had been pulled.
+ *
+ * @flags must include VIR_DOMAIN_SNAPSHOT_CREATE_DISK_ONLY.
+ * VIR_DOMAIN_SNAPSHOT_CREATE_REUSE_EXT, VIR_DOMAIN_SNAPSHOT_CREATE_NO_METADATA,
+ * VIR_DOMAIN_SNAPSHOT_CREATE_ATOMIC and VIR_DOMAIN_SNAPSHOT_CREATE_VALIDATE
+ * have the same meaning as for virDomainSnapshotCreateXML() and apply to
+ * each of the domains. Not all hypervisors support this API.
+ *
+ * If the snapshot of any domain can't be prepared, no snapshot is taken.
+ * However, if the snapshot of one of the domains fails once they are being
+ * taken, the snapshots of the other domains may still have been created,
+ * even though this API reports an error. It is then necessary to check the
+ * current snapshot of each domain using virDomainSnapshotCurrent() to find
+ * out which of them actually changed.
+ *
+ * Returns the number of snapshots created, which is the number of domains
+ * in @doms, or -1 on error. On success @snaps is filled with an array of the
+ * new snapshots in the order of @doms, which the caller must free by calling
+ * virDomainSnapshotFree() on each element and free() on the array.
+ *
+ * Since: 8.5.0
+ */
+int
+virDomainListSnapshotCreateXML(virDomainPtr *doms,
+                               const char **xmlDescs,
+                               virDomainSnapshotPtr **snaps,
+                               unsigned int flags)
+{
+    virConnectPtr conn = NULL;
+    unsigned int ndoms = 0;
+    int ret = -1;
+
+    VIR_DEBUG("doms=%p, xmlDescs=%p, snaps=%p, flags=0x%x",
+              doms, xmlDescs, snaps, flags);
+
+    virResetLastError();
+
+    virCheckNonNullArgGoto(doms, error);
+    virCheckNonNullArgGoto(xmlDescs, error);
+    virCheckNonNullArgGoto(snaps, error);
+
+    if (!*doms) {
+        virReportError(VIR_ERR_INVALID_ARG,
+                       _("doms array in %s must contain at least one domain"),
+                       __FUNCTION__);
+        goto error;
+    }
+
+    conn = doms[0]->conn;
+    virCheckConnectReturn(conn, -1);
+    virCheckReadOnlyGoto(conn->flags, error);
+
+    for (; doms[ndoms]; ndoms++) {
+        virCheckDomainGoto(doms[ndoms], error);
+
+        if (doms[ndoms]->conn != conn) {
+            virReportError(VIR_ERR_INVALID_ARG, "%s",
+                           _("domains in 'doms' array must belong to a "
+                             "single connection"));
+            goto error;
+        }
+
+        virCheckNonNullArgGoto(xmlDescs[ndoms], error);
+    }
+
+    VIR_REQUIRE_FLAG_GOTO(VIR_DOMAIN_SNAPSHOT_CREATE_QUIESCE,
+                          VIR_DOMAIN_SNAPSHOT_CREATE_DISK_ONLY,
+                          error);
+
+    if (!conn->driver->domainListSnapshotCreateXML) {
+        virReportUnsupportedError();
+        goto error;
+    }
+
+    if ((ret = conn->driver->domainListSnapshotCreateXML(conn, doms, ndoms,
+                                                         xmlDescs, snaps,
+                                                         flags)) < 0)
+        goto error;
+
+    return ret;
+
+ error:
+    virDispatchError(conn);
+    return -1;
+}
+
+
 /**
  * virDomainSnapshotGetXMLDesc:
  * @snapshot: a domain snapshot object
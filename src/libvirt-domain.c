@@ -6982,6 +6982,94 @@ virConnectListAllDomains(virConnectPtr conn,
 }
 
 
+/**
+ * virConnectListDomainsPage:
+ * @conn: Pointer to the hypervisor connection.
+ * @params: pointer to listing parameters
+ * @nparams: number of listing parameters
+ * @records: Pointer to a variable to store the array containing the listed
+ *           domains and their statistics
+ * @cursor: Pointer to a variable to store the cursor of the next page
+ * @flags: bitwise-OR of virConnectListAllDomainsFlags
+ *
+ * Lists one page of the domains known to the hypervisor. Unlike
+ * virConnectListAllDomains(), which always returns all the matching domains
+ * at once, this returns at most VIR_CONNECT_LIST_DOMAINS_PAGE_LIMIT domains
+ * ordered by their names, and the filters described by @params are
+ * evaluated by the hypervisor. Each call still has to look at the names of
+ * all the domains, but only the domains which may end up on the page are
+ * examined any further, so the memory used and the time spent on
+ * evaluating the rest of the filters or collecting the statistics are
+ * proportional to the size of the page rather than to the number of
+ * domains.
+ *
+ * @flags filter the domains the same way as with
+ * virConnectListAllDomains(). The supported @params are
+ * VIR_CONNECT_LIST_DOMAINS_PAGE_CURSOR, VIR_CONNECT_LIST_DOMAINS_PAGE_LIMIT,
+ * VIR_CONNECT_LIST_DOMAINS_PAGE_NAME, VIR_CONNECT_LIST_DOMAINS_PAGE_METADATA
+ * and VIR_CONNECT_LIST_DOMAINS_PAGE_STATS.
+ *
+ * Each of the returned records refers to one domain. Its typed parameters
+ * hold the statistics requested by VIR_CONNECT_LIST_DOMAINS_PAGE_STATS, as
+ * they would be reported by virConnectGetAllDomainStats(), except that the
+ * statistics which need to wait for a busy domain are left out instead. The
+ * array stored into @records must be freed by the caller using
+ * virDomainStatsRecordListFree().
+ *
+ * If there are more domains to list, @cursor is set to a string that has
+ * to be passed as VIR_CONNECT_LIST_DOMAINS_PAGE_CURSOR to get the next
+ * page and which must be freed by the caller. Otherwise, @cursor is set to
+ * NULL. The cursor doesn't hold any resources on the hypervisor, so the
+ * listing may be abandoned at any time. Domains which are defined or
+ * undefined during the listing may or may not be included in it.
+ *
+ * Returns the number of domains in @records, possibly 0 even when @cursor
+ * is set; -1 in case of error.
+ *
+ * Since: 8.5.0
+ */
+int
+virConnectListDomainsPage(virConnectPtr conn,
+                          virTypedParameterPtr params,
+                          int nparams,
+                          virDomainStatsRecordPtr **records,
+                          char **cursor,
+                          unsigned int flags)
+{
+    VIR_DEBUG("conn=%p, params=%p, nparams=%d, records=%p, cursor=%p, flags=0x%x",
+              conn, params, nparams, records, cursor, flags);
+    VIR_TYPED_PARAMS_DEBUG(params, nparams);
+
+    virResetLastError();
+
+    if (records)
+        *records = NULL;
+    if (cursor)
+        *cursor = NULL;
+
+    virCheckConnectReturn(conn, -1);
+    virCheckNonNullArrayArgGoto(params, nparams, error);
+    virCheckNonNegativeArgGoto(nparams, error);
+    virCheckNonNullArgGoto(records, error);
+    virCheckNonNullArgGoto(cursor, error);
+
+    if (conn->driver->connectListDomainsPage) {
+        int ret;
+        ret = conn->driver->connectListDomainsPage(conn, params, nparams,
+                                                   records, cursor, flags);
+        if (ret < 0)
+            goto error;
+        return ret;
+    }
+
+    virReportUnsupportedError();
+
+ error:
+    virDispatchError(conn);
+    return -1;
+}
+
+
 /**
  * virDomainCreate:
  * @domain: pointer to a defined domain
@@ -8804,6 +8892,69 @@ virDomainAttachDeviceFlags(virDomainPtr domain,
 }
 
 
+/**
+ * virDomainAttachDevices:
+ * @domain: pointer to domain object
+ * @xmls: array of XML descriptions of one device each
+ * @nxmls: number of items in @xmls
+ * @flags: bitwise-OR of virDomainDeviceModifyFlags
+ *
+ * Attach several virtual devices to a domain at once. This works like
+ * calling virDomainAttachDeviceFlags() for each member of @xmls in turn,
+ * but the domain is locked for modification just once, and its state is
+ * saved only after all the devices have been attached, which is
+ * considerably faster for a larger number of devices.
+ *
+ * The devices are attached in the order given. If any of them can't be
+ * attached, an error is returned, and the persistent configuration is not
+ * changed. However, devices attached to the running domain before the
+ * failing one are not removed again, since that generally requires the
+ * cooperation of the guest. Their presence can be checked for with
+ * virDomainGetXMLDesc().
+ *
+ * Returns 0 in case of success, -1 in case of failure.
+ *
+ * Since: 8.5.0
+ */
+int
+virDomainAttachDevices(virDomainPtr domain,
+                       const char **xmls,
+                       unsigned int nxmls,
+                       unsigned int flags)
+{
+    virConnectPtr conn;
+    size_t i;
+
+    VIR_DOMAIN_DEBUG(domain, "xmls=%p, nxmls=%u, flags=0x%x",
+                     xmls, nxmls, flags);
+
+    virResetLastError();
+
+    virCheckDomainReturn(domain, -1);
+    conn = domain->conn;
+
+    virCheckNonNullArrayArgGoto(xmls, nxmls, error);
+    virCheckPositiveArgGoto(nxmls, error);
+    for (i = 0; i < nxmls; i++)
+        virCheckNonNullArgGoto(xmls[i], error);
+    virCheckReadOnlyGoto(conn->flags, error);
+
+    if (conn->driver->domainAttachDevices) {
+        int ret;
+        ret = conn->driver->domainAttachDevices(domain, xmls, nxmls, flags);
+        if (ret < 0)
+            goto error;
+        return ret;
+    }
+
+    virReportUnsupportedError();
+
+ error:
+    virDispatchError(domain->conn);
+    return -1;
+}
+
+
 /**
  * virDomainDetachDevice:
  * @domain: pointer to domain object
@@ -8934,6 +9085,72 @@ virDomainDetachDeviceFlags(virDomainPtr domain,
 }
 
 
+/**
+ * virDomainDetachDevices:
+ * @domain: pointer to domain object
+ * @xmls: array of XML descriptions of one device each
+ * @nxmls: number of items in @xmls
+ * @flags: bitwise-OR of virDomainDeviceModifyFlags
+ *
+ * Detach several virtual devices from a domain at once. This works like
+ * calling virDomainDetachDeviceFlags() for each member of @xmls, but when
+ * the devices are detached from a running domain, their removal is
+ * requested all together first and only then the hypervisor waits for the
+ * guest to release them. Since a guest usually handles such requests in
+ * parallel, this takes about as long as detaching a single device.
+ *
+ * Just like with virDomainDetachDeviceFlags(), success does not guarantee
+ * that all the devices were removed from the running domain by the time
+ * this API returns. The removal of the remaining devices is signaled by
+ * VIR_DOMAIN_EVENT_ID_DEVICE_REMOVED events, or it may also be rejected
+ * by the guest. If detaching any of the devices fails, an error is
+ * returned, the persistent configuration is not changed, and devices
+ * detached from the running domain before the failure are not attached
+ * back.
+ *
+ * Returns 0 in case of success, -1 in case of failure.
+ *
+ * Since: 8.5.0
+ */
+int
+virDomainDetachDevices(virDomainPtr domain,
+                       const char **xmls,
+                       unsigned int nxmls,
+                       unsigned int flags)
+{
+    virConnectPtr conn;
+    size_t i;
+
+    VIR_DOMAIN_DEBUG(domain, "xmls=%p, nxmls=%u, flags=0x%x",
+                     xmls, nxmls, flags);
+
+    virResetLastError();
+
+    virCheckDomainReturn(domain, -1);
+    conn = domain->conn;
+
+    virCheckNonNullArrayArgGoto(xmls, nxmls, error);
+    virCheckPositiveArgGoto(nxmls, error);
+    for (i = 0; i < nxmls; i++)
+        virCheckNonNullArgGoto(xmls[i], error);
+    virCheckReadOnlyGoto(conn->flags, error);
+
+    if (conn->driver->domainDetachDevices) {
+        int ret;
+        ret = conn->driver->domainDetachDevices(domain, xmls, nxmls, flags);
+        if (ret < 0)
+            goto error;
+        return ret;
+    }
+
+    virReportUnsupportedError();
+
+ error:
+    virDispatchError(domain->conn);
+    return -1;
+}
+
+
 /**
  * virDomainUpdateDeviceFlags:
  * @domain: pointer to domain object
@@ -12211,6 +12428,14 @@ virConnectGetDomainCapabilities(virConnectPtr conn,
  *                          host scheduler, but was waiting in the queue
  *                          instead of running. Exposed to the VM as a steal
  *                          time.
+ *     "vcpu.<num>.haltpoll.success.time" - halt-polling time spent by vCPU
+ *                                          <num> polling until a virtual
+ *                                          interrupt was delivered in
+ *                                          nanoseconds as unsigned long long.
+ *     "vcpu.<num>.haltpoll.fail.time" - halt-polling time spent by vCPU <num>
+ *                                       polling before it had to schedule
+ *                                       out in nanoseconds as unsigned long
+ *                                       long.
  *
  * VIR_DOMAIN_STATS_INTERFACE:
  *     Return network interface statistics (from domain point of view).
@@ -12341,6 +12566,12 @@ virConnectGetDomainCapabilities(virConnectPtr conn,
  *     "perf.emulation_faults" - The count of emulation faults as unsigned
  *                               long long. It is produced by the
  *                               emulation_faults perf event
+ *     "perf.vcpu.<num>.<event>" - the count of the perf event of the thread
+ *                                 of vCPU <num> as unsigned long long. The
+ *                                 QEMU driver reports these only if enabled
+ *                                 by the 'perf_vcpu_stats' option in
+ *                                 qemu.conf, counting starts when the
+ *                                 statistics are first queried.
  *
  * VIR_DOMAIN_STATS_IOTHREAD:
  *     Return IOThread statistics if available. IOThread polling is a
@@ -12400,6 +12631,12 @@ virConnectGetDomainCapabilities(virConnectPtr conn,
  *     "memory.bandwidth.monitor.<num>.node.<index>.bytes.total" - the total
  *                       bytes consumed by @vcpus that passing through all
  *                       memory controllers, either local or remote controller.
+ *     "memory.bandwidth.monitor.<num>.node.<index>.bytes.local.rate" - the
+ *                       recent rate of bytes.local in bytes per second, if
+ *                       known.
+ *     "memory.bandwidth.monitor.<num>.node.<index>.bytes.total.rate" - the
+ *                       recent rate of bytes.total in bytes per second, if
+ *                       known.
  *
  * VIR_DOMAIN_STATS_DIRTYRATE:
  *     Return memory dirty rate information. The typed parameter keys are in
@@ -12421,6 +12658,141 @@ virConnectGetDomainCapabilities(virConnectPtr conn,
  *     "dirtyrate.vcpu.<num>.megabytes_per_second" - the calculated memory dirty
  *                                                   rate for a virtual cpu as
  *                                                   unsigned long long.
+ *     "dirtyrate.history.count" - number of results of background
+ *                                 calculations started with
+ *                                 VIR_DOMAIN_DIRTYRATE_CONTINUOUS, as
+ *                                 unsigned int. The results are numbered
+ *                                 from 0, which is the most recent one.
+ *     "dirtyrate.history.<num>.calc_start_time" - the start time of the
+ *                                                 calculation as long long.
+ *     "dirtyrate.history.<num>.calc_period" - the period of the calculation
+ *                                             as int.
+ *     "dirtyrate.history.<num>.megabytes_per_second" - the calculated memory
+ *                                                      dirty rate in MiB/s
+ *                                                      as long long.
+ *
+ * VIR_DOMAIN_STATS_JOB:
+ *     Return the progress of the job running on the domain, such as an
+ *     outgoing migration, save or dump. The group is empty if no job is
+ *     running. The typed parameter keys are in this format:
+ *
+ *     "job.type" - the type of the job as int from virDomainJobType enum.
+ *     "job.<field>" - the fields reported by virDomainGetJobStats() for the
+ *                     job, e.g. "job.data_processed", "job.memory_dirty_rate"
+ *                     or "job.memory_bps", with the same meaning and type.
+ *
+ *     The values are refreshed from the hypervisor whenever the statistics
+ *     can be gathered without waiting for the job, otherwise the data
+ *     recorded last by the job itself is reported.
+ *
+ * VIR_DOMAIN_STATS_START:
+ *     Return the time the hypervisor spent starting the domain, split into
+ *     the phases of the startup. The group is empty if the time is not known,
+ *     e.g. when the domain was started before the daemon was restarted. The
+ *     typed parameter keys are in this format:
+ *
+ *     "start.time" - total time spent starting the domain in microseconds as
+ *                    unsigned long long.
+ *     "start.phase.count" - number of phases of the startup as unsigned int.
+ *     "start.phase.<num>.name" - name of the phase as string, e.g.
+ *                                "command-line", "security" or "monitor".
+ *     "start.phase.<num>.time" - time spent in the phase in microseconds as
+ *                                unsigned long long. Phases which did not
+ *                                take place are reported as 0.
+ *
+ * VIR_DOMAIN_STATS_PRESSURE:
+ *     Return the pressure stall information of the cgroup of the domain, i.e.
+ *     the share of time the domain was stalled waiting for CPU, memory or I/O.
+ *     The typed parameter keys are in this format:
+ *
+ *     "pressure.<resource>.some.avg10" - percentage of time at least some of
+ *                                        the tasks of the domain were stalled
+ *                                        on <resource> over the last 10
+ *                                        seconds as double. <resource> is
+ *                                        one of "cpu", "memory" or "io".
+ *     "pressure.<resource>.some.avg60" - the same over the last 60 seconds as
+ *                                        double.
+ *     "pressure.<resource>.some.avg300" - the same over the last 300 seconds
+ *                                         as double.
+ *     "pressure.<resource>.some.total" - total time at least some of the
+ *                                        tasks were stalled in microseconds
+ *                                        as unsigned long long.
+ *     "pressure.<resource>.full.{avg10,avg60,avg300,total}" - the same for the
+ *                                        time all non-idle tasks of the domain
+ *                                        were stalled at once.
+ *     "pressure.<resource>.triggers" - number of times the pressure triggers
+ *                                      configured for <resource> in the
+ *                                      hypervisor fired as unsigned long long.
+ *                                      Only reported while the domain is
+ *                                      watched by a subscription of
+ *                                      virConnectDomainStatsRegister(), which
+ *                                      receives the group immediately
+ *                                      whenever a trigger fires.
+ *
+ * VIR_DOMAIN_STATS_JOB_LOCK:
+ *     Return how long APIs waited for and held the job which serializes
+ *     operations with the domain, since the daemon started. All times are in
+ *     milliseconds. The typed parameter keys are in this format:
+ *
+ *     "joblock.type.count" - number of job types reported below as unsigned
+ *                            int. Types never used are not reported.
+ *     "joblock.type.<num>.name" - name of the job type as string, e.g.
+ *                                 "query", "modify", "agent" for guest agent
+ *                                 jobs or "async" for long running jobs such
+ *                                 as migration.
+ *     "joblock.type.<num>.wait.count" - number of jobs acquired as unsigned
+ *                                       long long.
+ *     "joblock.type.<num>.wait.sum" - total time spent waiting for the job
+ *                                     as unsigned long long.
+ *     "joblock.type.<num>.wait.max" - longest wait as unsigned long long.
+ *     "joblock.type.<num>.wait.bucket.<i>" - number of waits shorter than
+ *                                            2^<i> milliseconds and not
+ *                                            counted in a smaller bucket,
+ *                                            as unsigned long long. The
+ *                                            last bucket counts all the
+ *                                            longer waits too.
+ *     "joblock.type.<num>.hold.{count,sum,max,bucket.<i>}" - the same for
+ *                                            the time from acquiring the
+ *                                            job to ending it.
+ *     "joblock.type.<num>.timeouts" - number of times the job could not be
+ *                                     acquired in time as unsigned long long.
+ *     "joblock.api.count" - number of APIs reported below as unsigned int.
+ *     "joblock.api.<num>.name" - name of the API as string.
+ *     "joblock.api.<num>.{wait,hold}.{count,sum,max}",
+ *     "joblock.api.<num>.timeouts" - the same as for job types, without the
+ *                                    buckets.
+ *     "joblock.waiter.count" - number of threads waiting for a job right now
+ *                              as unsigned int.
+ *     "joblock.waiter.<num>.api" - API waiting for the job as string.
+ *     "joblock.waiter.<num>.job" - type of the requested job as string.
+ *     "joblock.waiter.<num>.agent_job" - type of the requested agent job as
+ *                                        string.
+ *     "joblock.waiter.<num>.async_job" - type of the requested async job as
+ *                                        string.
+ *     "joblock.waiter.<num>.time" - time waited so far as unsigned long long.
+ *
+ * VIR_DOMAIN_STATS_DAEMON_MEMORY:
+ *     Return an estimate of the memory the daemon uses to hold the domain,
+ *     in bytes. Computing it is costly, so the group is only returned when
+ *     requested explicitly. The typed parameter keys are in this format:
+ *
+ *     "daemon_memory.total" - total memory used for the domain as unsigned
+ *                             long long, not including the capabilities.
+ *     "daemon_memory.definition" - memory used by the live and persistent
+ *                                  definitions as unsigned long long.
+ *     "daemon_memory.private" - memory used by the runtime state of the
+ *                               hypervisor driver as unsigned long long.
+ *     "daemon_memory.snapshots.count" - number of snapshots as unsigned int.
+ *     "daemon_memory.snapshots.bytes" - memory used by the snapshots as
+ *                                       unsigned long long.
+ *     "daemon_memory.checkpoints.count" - number of checkpoints as unsigned
+ *                                         int.
+ *     "daemon_memory.checkpoints.bytes" - memory used by the checkpoints as
+ *                                         unsigned long long.
+ *     "daemon_memory.capabilities" - memory used by the capabilities of the
+ *                                    emulator of a running domain as unsigned
+ *                                    long long. They are shared with other
+ *                                    domains using the same emulator.
  *
  * Note that entire stats groups or individual stat fields may be missing from
  * the output in case they are not supported by the given hypervisor, are not
@@ -12444,6 +12816,12 @@ virConnectGetDomainCapabilities(virConnectPtr conn,
  * is returned for the domain.  That subset being statistics that
  * don't involve querying the underlying hypervisor.
  *
+ * Passing VIR_CONNECT_GET_ALL_DOMAINS_STATS_CACHED in @flags allows the
+ * hypervisor to return statistics it collected for an earlier caller
+ * instead of querying the domain again, provided they are not older than
+ * the maximum age configured in the daemon.  Without such configuration
+ * the flag has no effect.
+ *
  * Similarly to virConnectListAllDomains, @flags can contain various flags to
  * filter the list of domains to provide stats for.
  *
@@ -12536,6 +12914,12 @@ virConnectGetAllDomainStats(virConnectPtr conn,
  * is returned for the domain.  That subset being statistics that
  * don't involve querying the underlying hypervisor.
  *
+ * Passing VIR_CONNECT_GET_ALL_DOMAINS_STATS_CACHED in @flags allows the
+ * hypervisor to return statistics it collected for an earlier caller
+ * instead of querying the domain again, provided they are not older than
+ * the maximum age configured in the daemon.  Without such configuration
+ * the flag has no effect.
+ *
  * Note that any of the domain list filtering flags in @flags may be rejected
  * by this function.
  *
@@ -12634,6 +13018,210 @@ virDomainStatsRecordListFree(virDomainStatsRecordPtr *stats)
 }
 
 
+/**
+ * virConnectDomainStatsRegister:
+ * @conn: pointer to the connection
+ * @dom: pointer to the domain, or NULL
+ * @stats: stats types, bitwise-OR of virDomainStatsTypes
+ * @interval: sampling interval in seconds
+ * @cb: callback to the function handling the statistics
+ * @opaque: opaque data to pass on to the callback
+ * @freecb: optional function to deallocate opaque when not used anymore
+ * @flags: bitwise-OR of virConnectDomainStatsRegisterFlags
+ *
+ * Subscribes to statistics of running domains. Instead of the caller
+ * polling virConnectGetAllDomainStats(), the hypervisor samples the
+ * statistics every @interval seconds and invokes @cb for each domain whose
+ * statistics changed, passing only the changed fields. Sampling is shared by
+ * all subscribers, so that each domain is queried at most once per pass
+ * regardless of the number of subscriptions.
+ *
+ * With VIR_CONNECT_DOMAIN_STATS_REGISTER_INTERVAL_MSEC in @flags the
+ * @interval is in milliseconds instead. Combined with the
+ * VIR_DOMAIN_STATS_JOB group this allows following the progress of
+ * migration and dump jobs closely without polling virDomainGetJobStats().
+ *
+ * The @stats parameter has the same meaning as in
+ * virConnectGetAllDomainStats(); using 0 subscribes to all stats groups
+ * supported by the hypervisor. Statistics that can't be gathered without
+ * waiting for another job running on the domain may be missing from a
+ * particular sample.
+ *
+ * If @dom is NULL, then statistics of all running domains are delivered.
+ * If @dom is non-NULL, then only the specific domain is sampled.
+ *
+ * The virDomainPtr object handle passed into the callback upon delivery
+ * is only valid for the duration of execution of the callback. If the
+ * callback wishes to keep the domain object after the callback returns,
+ * it shall take a reference to it, by calling virDomainRef().
+ * The reference can be released once the object is no longer required
+ * by calling virDomainFree().
+ *
+ * The return value from this method is a positive integer identifier
+ * for the callback. To unregister a callback, this callback ID should
+ * be passed to the virConnectDomainStatsDeregister() method.
+ *
+ * Returns a callback identifier on success, -1 on failure
+ *
+ * Since: 8.5.0
+ */
+int
+virConnectDomainStatsRegister(virConnectPtr conn,
+                              virDomainPtr dom,
+                              unsigned int stats,
+                              unsigned int interval,
+                              virConnectDomainStatsCallback cb,
+                              void *opaque,
+                              virFreeCallback freecb,
+                              unsigned int flags)
+{
+    VIR_DOMAIN_DEBUG(dom,
+                     "conn=%p, stats=0x%x, interval=%u, cb=%p, opaque=%p, "
+                     "freecb=%p, flags=0x%x",
+                     conn, stats, interval, cb, opaque, freecb, flags);
+
+    virResetLastError();
+
+    virCheckConnectReturn(conn, -1);
+    if (dom) {
+        virCheckDomainGoto(dom, error);
+        if (dom->conn != conn) {
+            virReportInvalidArg(dom,
+                                _("domain '%s' in %s must match connection"),
+                                dom->name, __FUNCTION__);
+            goto error;
+        }
+    }
+    virCheckNonNullArgGoto(cb, error);
+    virCheckPositiveArgGoto(interval, error);
+
+    if (conn->driver && conn->driver->connectDomainStatsRegister) {
+        int ret;
+        ret = conn->driver->connectDomainStatsRegister(conn, dom, stats,
+                                                       interval, cb, opaque,
+                                                       freecb, flags);
+        if (ret < 0)
+            goto error;
+        return ret;
+    }
+
+    virReportUnsupportedError();
+ error:
+    virDispatchError(conn);
+    return -1;
+}
+
+
+/**
+ * virConnectDomainStatsDeregister:
+ * @conn: pointer to the connection
+ * @callbackID: the callback identifier
+ *
+ * Removes a statistics subscription. The callbackID parameter should be
+ * the value obtained from a previous virConnectDomainStatsRegister()
+ * method.
+ *
+ * Returns 0 on success, -1 on failure
+ *
+ * Since: 8.5.0
+ */
+int
+virConnectDomainStatsDeregister(virConnectPtr conn,
+                                int callbackID)
+{
+    VIR_DEBUG("conn=%p, callbackID=%d", conn, callbackID);
+
+    virResetLastError();
+
+    virCheckConnectReturn(conn, -1);
+    virCheckNonNegativeArgGoto(callbackID, error);
+
+    if (conn->driver && conn->driver->connectDomainStatsDeregister) {
+        int ret;
+        ret = conn->driver->connectDomainStatsDeregister(conn, callbackID);
+        if (ret < 0)
+            goto error;
+        return ret;
+    }
+
+    virReportUnsupportedError();
+ error:
+    virDispatchError(conn);
+    return -1;
+}
+
+
+/**
+ * virConnectDomainEventRingOpen:
+ * @conn: pointer to the connection
+ * @stats: stats types, bitwise-OR of virDomainStatsTypes
+ * @interval: sampling interval in seconds, or 0
+ * @flags: bitwise-OR of virConnectDomainStatsRegisterFlags
+ *
+ * Opens a ring in shared memory where the daemon publishes the events of
+ * all domains in the binary layout described by virDomainEventRingHeader
+ * and the records following it. Unlike event callbacks, reading the ring
+ * needs neither system calls nor decoding, which suits high-rate local
+ * consumers. It's only available to clients connected to the daemon over
+ * a UNIX socket.
+ *
+ * If @interval is not 0, the ring also gets statistics of running domains
+ * as if subscribed to with virConnectDomainStatsRegister() with the same
+ * @stats, @interval and @flags, otherwise @stats and @flags must be 0.
+ *
+ * The returned file descriptor is read-only. The caller maps it with
+ * mmap(), using PROT_READ and MAP_SHARED, after finding out the size from
+ * fstat(). To read the records, the caller loads the head of the ring
+ * with acquire semantics and reads the records before it, starting from
+ * the tail the first time. After copying a record out, the caller loads
+ * the tail with acquire semantics. If the tail is past the position of
+ * the record, the record was overwritten while being copied and the
+ * caller lost the records up to the tail. The daemon never waits for
+ * readers, so a caller which can't keep up with the size of the ring
+ * loses the oldest records.
+ *
+ * The daemon stops publishing when @conn is closed. There can be only one
+ * ring per connection.
+ *
+ * Returns a file descriptor on success, which the caller must close, or
+ * -1 on failure
+ *
+ * Since: 8.5.0
+ */
+int
+virConnectDomainEventRingOpen(virConnectPtr conn,
+                              unsigned int stats,
+                              unsigned int interval,
+                              unsigned int flags)
+{
+    VIR_DEBUG("conn=%p, stats=0x%x, interval=%u, flags=0x%x",
+              conn, stats, interval, flags);
+
+    virResetLastError();
+
+    virCheckConnectReturn(conn, -1);
+    if (interval == 0 && (stats != 0 || flags != 0)) {
+        virReportInvalidArg(interval, "%s",
+                            _("stats types and flags require non-zero interval"));
+        goto error;
+    }
+
+    if (conn->driver && conn->driver->connectDomainEventRingOpen) {
+        int ret;
+        ret = conn->driver->connectDomainEventRingOpen(conn, stats,
+                                                       interval, flags);
+        if (ret < 0)
+            goto error;
+        return ret;
+    }
+
+    virReportUnsupportedError();
+ error:
+    virDispatchError(conn);
+    return -1;
+}
+
+
 /**
  * virDomainGetFSInfo:
  * @dom: a domain object
@@ -13826,6 +14414,12 @@ virDomainGetMessages(virDomainPtr domain,
  * The calculated dirty rate information is available by calling
  * virConnectGetAllDomainStats.
  *
+ * With VIR_DOMAIN_DIRTYRATE_CONTINUOUS in @flags, the hypervisor starts a
+ * new calculation shortly after each one finishes and keeps the results
+ * of the recent ones, which are reported as "dirtyrate.history.*" by
+ * virConnectGetAllDomainStats. The background calculation goes on until
+ * this function is called again or the domain stops.
+ *
  * Returns 0 in case of success, -1 otherwise.
  *
  * Since: 7.2.0
@@ -53,6 +53,7 @@
 #include "virstring.h"
 #include "virutil.h"
 #include "virtypedparam.h"
+#include "viridentity.h"
 
 #ifdef WITH_TEST
 # include "test/test_driver.h"
@@ -599,6 +600,104 @@ virRegisterStateDriver(virStateDriver *driver)
 }
 
 
+typedef struct _virStateInitData virStateInitData;
+struct _virStateInitData {
+    virMutex lock;
+    virCond cond;
+
+    bool privileged;
+    const char *root;
+    virStateInhibitCallback callback;
+    void *opaque;
+    virIdentity *identity;
+};
+
+typedef struct _virStateInitJob virStateInitJob;
+struct _virStateInitJob {
+    virStateInitData *data;
+    virStateDriver *driver;
+    virThread thread;
+    bool started;
+    bool finished;
+    bool processed;
+    virDrvStateInitResult result;
+    virErrorPtr error;
+};
+
+
+static bool
+virStateDriverDependsOn(size_t drv,
+                        size_t other)
+{
+    const char *const *deps = virStateDriverTab[drv]->dependencies;
+
+    /* Drivers without dependencies listed wait for all the drivers
+     * registered before them and vice versa */
+    if (other < drv && (!deps || !virStateDriverTab[other]->dependencies))
+        return true;
+
+    if (!deps)
+        return false;
+
+    for (; *deps; deps++) {
+        if (STREQ(*deps, virStateDriverTab[other]->name))
+            return true;
+    }
+
+    return false;
+}
+
+
+/* Whether the drivers @job depends on are initialized. Must be called
+ * with the lock of the jobs held. */
+static bool
+virStateInitJobIsReady(virStateInitJob *jobs,
+                       size_t job)
+{
+    size_t i;
+
+    for (i = 0; i < virStateDriverTabCount; i++) {
+        if (i == job || !jobs[i].driver || !virStateDriverDependsOn(job, i))
+            continue;
+
+        if (!jobs[i].processed)
+            return false;
+    }
+
+    return true;
+}
+
+
+static void
+virStateInitJobRun(void *opaque)
+{
+    virStateInitJob *job = opaque;
+    virStateInitData *data = job->data;
+    virDrvStateInitResult ret;
+    gint64 start = g_get_monotonic_time();
+
+    if (data->identity)
+        virIdentitySetCurrent(data->identity);
+
+    VIR_DEBUG("Running global init for %s state driver", job->driver->name);
+    ret = job->driver->stateInitialize(data->privileged,
+                                       data->root,
+                                       data->callback,
+                                       data->opaque);
+    VIR_DEBUG("State init of %s driver took %lld ms, result %d",
+              job->driver->name,
+              (long long) (g_get_monotonic_time() - start) / 1000, ret);
+
+    VIR_WITH_MUTEX_LOCK_GUARD(&data->lock) {
+        if (ret == VIR_DRV_STATE_INIT_ERROR)
+            virErrorPreserveLast(&job->error);
+        job->result = ret;
+        job->finished = true;
+        virCondSignal(&data->cond);
+    }
+}
+
+
 /**
  * virStateInitialize:
  * @privileged: set to true if running with root privilege, false otherwise
@@ -627,6 +726,9 @@ virRegisterStateDriver(virStateDriver *driver)
  *    @root/var/lib/$DRIVER/
  *    @root/run/$DRIVER/
  *
+ * Each driver is initialized in a thread of its own as soon as the
+ * drivers it depends on are initialized.
+ *
  * Returns 0 if all succeed, -1 upon any failure.
  */
 int
@@ -636,36 +738,119 @@ virStateInitialize(bool privileged,
                    virStateInhibitCallback callback,
                    void *opaque)
 {
+    virStateInitData data = {
+        .privileged = privileged,
+        .root = root,
+        .callback = callback,
+        .opaque = opaque,
+    };
+    g_autofree virStateInitJob *jobs = NULL;
+    virErrorPtr err = NULL;
+    size_t running = 0;
+    bool failed = false;
     size_t i;
 
     if (virInitialize() < 0)
         return -1;
 
+    if (virMutexInit(&data.lock) < 0)
+        return -1;
+
+    if (virCondInit(&data.cond) < 0) {
+        virMutexDestroy(&data.lock);
+        return -1;
+    }
+
+    data.identity = virIdentityGetCurrent();
+
+    jobs = g_new0(virStateInitJob, virStateDriverTabCount);
     for (i = 0; i < virStateDriverTabCount; i++) {
+        jobs[i].data = &data;
         if (virStateDriverTab[i]->stateInitialize &&
-            !virStateDriverTab[i]->initialized) {
-            virDrvStateInitResult ret;
-            VIR_DEBUG("Running global init for %s state driver",
-                      virStateDriverTab[i]->name);
-            virStateDriverTab[i]->initialized = true;
-            ret = virStateDriverTab[i]->stateInitialize(privileged,
-                                                        root,
-                                                        callback,
-                                                        opaque);
-            VIR_DEBUG("State init result %d (mandatory=%d)", ret, mandatory);
-            if (ret == VIR_DRV_STATE_INIT_ERROR) {
-                VIR_ERROR(_("Initialization of %s state driver failed: %s"),
-                          virStateDriverTab[i]->name,
-                          virGetLastErrorMessage());
-                return -1;
+            !virStateDriverTab[i]->initialized)
+            jobs[i].driver = virStateDriverTab[i];
+    }
+
+    virMutexLock(&data.lock);
+    while (true) {
+        for (i = 0; i < virStateDriverTabCount && !failed; i++) {
+            virStateInitJob *job = &jobs[i];
+            g_autofree char *name = NULL;
+
+            if (!job->driver || job->started ||
+                !virStateInitJobIsReady(jobs, i))
+                continue;
+
+            name = g_strdup_printf("init-%s", job->driver->name);
+            job->driver->initialized = true;
+
+            if (virThreadCreateFull(&job->thread, true, virStateInitJobRun,
+                                    name, false, job) < 0) {
+                virReportSystemError(errno,
+                                     _("Unable to create thread to initialize %s state driver"),
+                                     job->driver->name);
+                virErrorPreserveLast(&err);
+                failed = true;
+                break;
             }
-            if (ret == VIR_DRV_STATE_INIT_SKIPPED && mandatory) {
+
+            job->started = true;
+            running++;
+        }
+
+        if (running == 0)
+            break;
+
+        ignore_value(virCondWait(&data.cond, &data.lock));
+
+        for (i = 0; i < virStateDriverTabCount; i++) {
+            virStateInitJob *job = &jobs[i];
+
+            if (!job->finished || job->processed)
+                continue;
+
+            job->processed = true;
+            running--;
+
+            if (job->result == VIR_DRV_STATE_INIT_ERROR) {
+                VIR_ERROR(_("Initialization of %s state driver failed: %s"),
+                          job->driver->name,
+                          job->error ? NULLSTR(job->error->message) : "");
+                if (!err)
+                    err = g_steal_pointer(&job->error);
+                failed = true;
+            } else if (job->result == VIR_DRV_STATE_INIT_SKIPPED && mandatory) {
                 VIR_ERROR(_("Initialization of mandatory %s state driver skipped"),
-                          virStateDriverTab[i]->name);
-                return -1;
+                          job->driver->name);
+                failed = true;
             }
         }
     }
+    virMutexUnlock(&data.lock);
+
+    for (i = 0; i < virStateDriverTabCount; i++) {
+        if (jobs[i].started)
+            virThreadJoin(&jobs[i].thread);
+        virFreeError(jobs[i].error);
+
+        if (!failed && jobs[i].driver && !jobs[i].started) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Dependencies of %s state driver can't be satisfied"),
+                           jobs[i].driver->name);
+            virErrorPreserveLast(&err);
+            failed = true;
+        }
+    }
+
+    g_clear_object(&data.identity);
+    virCondDestroy(&data.cond);
+    virMutexDestroy(&data.lock);
+
+    if (failed) {
+        virErrorRestore(&err);
+        return -1;
+    }
+
     return 0;
 }
 
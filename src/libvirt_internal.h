@@ -131,6 +131,12 @@ typedef enum {
      * Whether the virNetworkUpdate() API implementation passes arguments to
      * the driver's callback in correct order. */
     VIR_DRV_FEATURE_NETWORK_UPDATE_HAS_CORRECT_ORDER = 16,
+
+    /*
+     * Support for the compact encoding of bulk domain stats rpc, which sends
+     * each field name only once per reply.
+     */
+    VIR_DRV_FEATURE_REMOTE_COMPACT_DOMAIN_STATS = 17,
 } virDrvFeature;
 
 
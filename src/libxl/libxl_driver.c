@@ -58,6 +58,8 @@
 #include "virutil.h"
 #include "domain_validate.h"
 #include "domain_driver.h"
+#include "viridentity.h"
+#include "virthreadpool.h"
 
 #define VIR_FROM_THIS VIR_FROM_LIBXL
 
@@ -492,14 +494,127 @@ libxlReconnectDomain(virDomainObj *vm,
  error:
     libxlDomainCleanup(driver, vm);
     if (!vm->persistent)
-        virDomainObjListRemoveLocked(driver->domains, vm);
+        virDomainObjListRemove(driver->domains, vm);
     goto cleanup;
 }
 
+
+/* Reconnecting and autostarting talks to the hypervisor and xenstore for
+ * each domain and is independent of other domains, so it's spread over a
+ * few workers. */
+#define LIBXL_STARTUP_WORKERS 8
+
+typedef struct _libxlDomainsParallelData libxlDomainsParallelData;
+struct _libxlDomainsParallelData {
+    libxlDriverPrivate *driver;
+    virDomainObjListIterator callback;
+
+    virMutex lock;
+    virCond cond;
+    size_t pending;
+};
+
+
+static void
+libxlDomainsParallelWorker(void *jobdata,
+                           void *opaque)
+{
+    virDomainObj *vm = jobdata;
+    libxlDomainsParallelData *data = opaque;
+
+    ignore_value(data->callback(vm, data->driver));
+    virObjectUnref(vm);
+
+    VIR_WITH_MUTEX_LOCK_GUARD(&data->lock) {
+        if (--data->pending == 0)
+            virCondSignal(&data->cond);
+    }
+}
+
+
+/*
+ * Calls @callback for every domain in the list of @driver from a bounded
+ * pool of workers and waits for all of them to finish. Unlike
+ * virDomainObjListForEach, the domain list is not locked while @callback
+ * runs, so it's free to remove domains from it. If the pool can't be used,
+ * the domains are processed in the calling thread instead.
+ */
+static void
+libxlDomainsForEachParallel(libxlDriverPrivate *driver,
+                            const char *name,
+                            virDomainObjListIterator callback)
+{
+    g_autoptr(virIdentity) identity = virIdentityGetCurrent();
+    libxlDomainsParallelData data = { .driver = driver, .callback = callback };
+    virThreadPool *pool = NULL;
+    virDomainObj **vms = NULL;
+    size_t nvms = 0;
+    size_t i;
+
+    if (virDomainObjListCollect(driver->domains, NULL, &vms, &nvms,
+                                NULL, 0) < 0)
+        return;
+
+    if (nvms > 1) {
+        if (virMutexInit(&data.lock) < 0) {
+            virReportSystemError(errno, "%s", _("unable to init mutex"));
+        } else if (virCondInit(&data.cond) < 0) {
+            virReportSystemError(errno, "%s", _("unable to init cond"));
+            virMutexDestroy(&data.lock);
+        } else if (!(pool = virThreadPoolNewFull(0, MIN(nvms, LIBXL_STARTUP_WORKERS),
+                                                 0, libxlDomainsParallelWorker,
+                                                 name, identity, &data))) {
+            virCondDestroy(&data.cond);
+            virMutexDestroy(&data.lock);
+        }
+
+        if (!pool) {
+            VIR_WARN("Failed to create %s pool, processing domains serially: %s",
+                     name, virGetLastErrorMessage());
+            virResetLastError();
+        }
+    }
+
+    for (i = 0; i < nvms; i++) {
+        if (pool) {
+            VIR_WITH_MUTEX_LOCK_GUARD(&data.lock) {
+                data.pending++;
+            }
+
+            if (virThreadPoolSendJob(pool, 0, vms[i]) == 0) {
+                vms[i] = NULL;
+                continue;
+            }
+
+            VIR_WITH_MUTEX_LOCK_GUARD(&data.lock) {
+                data.pending--;
+            }
+            virResetLastError();
+        }
+
+        ignore_value(callback(vms[i], driver));
+        g_clear_pointer(&vms[i], virObjectUnref);
+    }
+
+    if (pool) {
+        VIR_WITH_MUTEX_LOCK_GUARD(&data.lock) {
+            while (data.pending > 0)
+                ignore_value(virCondWait(&data.cond, &data.lock));
+        }
+
+        virThreadPoolFree(pool);
+        virCondDestroy(&data.cond);
+        virMutexDestroy(&data.lock);
+    }
+
+    g_free(vms);
+}
+
+
 static void
 libxlReconnectDomains(libxlDriverPrivate *driver)
 {
-    virDomainObjListForEach(driver->domains, true, libxlReconnectDomain, driver);
+    libxlDomainsForEachParallel(driver, "libxl-reconnect", libxlReconnectDomain);
 }
 
 static int
@@ -808,9 +923,15 @@ libxlStateInitialize(bool privileged,
         goto error;
 
     if (autostart) {
-        virDomainObjListForEach(libxl_driver->domains, false,
-                                libxlAutostartDomain,
-                                libxl_driver);
+        /* Ballooning dom0 down for one domain doesn't account for the
+         * others being created at the same time */
+        if (cfg->autoballoon)
+            virDomainObjListForEach(libxl_driver->domains, false,
+                                    libxlAutostartDomain,
+                                    libxl_driver);
+        else
+            libxlDomainsForEachParallel(libxl_driver, "libxl-autostart",
+                                        libxlAutostartDomain);
     }
 
     virDomainObjListForEach(libxl_driver->domains, false,
@@ -5705,6 +5826,7 @@ libxlConnectSupportsFeature(virConnectPtr conn, int feature)
     case VIR_DRV_FEATURE_REMOTE:
     case VIR_DRV_FEATURE_PROGRAM_KEEPALIVE:
     case VIR_DRV_FEATURE_REMOTE_CLOSE_CALLBACK:
+    case VIR_DRV_FEATURE_REMOTE_COMPACT_DOMAIN_STATS:
     case VIR_DRV_FEATURE_REMOTE_EVENT_CALLBACK:
     case VIR_DRV_FEATURE_TYPED_PARAM_STRING:
     case VIR_DRV_FEATURE_NETWORK_UPDATE_HAS_CORRECT_ORDER:
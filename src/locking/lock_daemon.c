@@ -915,6 +915,7 @@ int main(int argc, char **argv) {
                               config->log_level,
                               config->log_filters,
                               config->log_outputs,
+                              NULL,
                               privileged,
                               verbose,
                               godaemon) < 0) {
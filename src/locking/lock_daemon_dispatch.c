@@ -35,6 +35,36 @@ VIR_LOG_INIT("locking.lock_daemon_dispatch");
 
 #include "lock_daemon_dispatch_stubs.h"
 
+static int
+virLockDaemonDispatchAcquireResource(virLockDaemonClient *priv,
+                                     const char *path,
+                                     const char *name,
+                                     unsigned int flags)
+{
+    virLockSpace *lockspace;
+    unsigned int newFlags;
+
+    virCheckFlags(VIR_LOCK_SPACE_PROTOCOL_ACQUIRE_RESOURCE_SHARED |
+                  VIR_LOCK_SPACE_PROTOCOL_ACQUIRE_RESOURCE_AUTOCREATE, -1);
+
+    if (!(lockspace = virLockDaemonFindLockSpace(lockDaemon, path))) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Lockspace for path %s does not exist"),
+                       path);
+        return -1;
+    }
+
+    newFlags = 0;
+    if (flags & VIR_LOCK_SPACE_PROTOCOL_ACQUIRE_RESOURCE_SHARED)
+        newFlags |= VIR_LOCK_SPACE_ACQUIRE_SHARED;
+    if (flags & VIR_LOCK_SPACE_PROTOCOL_ACQUIRE_RESOURCE_AUTOCREATE)
+        newFlags |= VIR_LOCK_SPACE_ACQUIRE_AUTOCREATE;
+
+    return virLockSpaceAcquireResource(lockspace, name,
+                                       priv->ownerPid, newFlags);
+}
+
+
 static int
 virLockSpaceProtocolDispatchAcquireResource(virNetServer *server G_GNUC_UNUSED,
                                             virNetServerClient *client,
@@ -43,17 +73,11 @@ virLockSpaceProtocolDispatchAcquireResource(virNetServer *server G_GNUC_UNUSED,
                                             virLockSpaceProtocolAcquireResourceArgs *args)
 {
     int rv = -1;
-    unsigned int flags = args->flags;
     virLockDaemonClient *priv =
         virNetServerClientGetPrivateData(client);
-    virLockSpace *lockspace;
-    unsigned int newFlags;
 
     g_mutex_lock(&priv->lock);
 
-    virCheckFlagsGoto(VIR_LOCK_SPACE_PROTOCOL_ACQUIRE_RESOURCE_SHARED |
-                      VIR_LOCK_SPACE_PROTOCOL_ACQUIRE_RESOURCE_AUTOCREATE, cleanup);
-
     if (priv->restricted) {
         virReportError(VIR_ERR_OPERATION_DENIED, "%s",
                        _("lock manager connection has been restricted"));
@@ -66,24 +90,75 @@ virLockSpaceProtocolDispatchAcquireResource(virNetServer *server G_GNUC_UNUSED,
         goto cleanup;
     }
 
-    if (!(lockspace = virLockDaemonFindLockSpace(lockDaemon, args->path))) {
-        virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("Lockspace for path %s does not exist"),
-                       args->path);
+    if (virLockDaemonDispatchAcquireResource(priv, args->path, args->name,
+                                             args->flags) < 0)
         goto cleanup;
-    }
 
-    newFlags = 0;
-    if (flags & VIR_LOCK_SPACE_PROTOCOL_ACQUIRE_RESOURCE_SHARED)
-        newFlags |= VIR_LOCK_SPACE_ACQUIRE_SHARED;
-    if (flags & VIR_LOCK_SPACE_PROTOCOL_ACQUIRE_RESOURCE_AUTOCREATE)
-        newFlags |= VIR_LOCK_SPACE_ACQUIRE_AUTOCREATE;
+    rv = 0;
 
-    if (virLockSpaceAcquireResource(lockspace,
-                                    args->name,
-                                    priv->ownerPid,
-                                    newFlags) < 0)
+ cleanup:
+    if (rv < 0)
+        virNetMessageSaveError(rerr);
+    g_mutex_unlock(&priv->lock);
+    return rv;
+}
+
+
+/*
+ * Acquire all resources in @args at once, saving a round trip to the
+ * daemon per resource. Either all of them are acquired or, if any of them
+ * can't be, those already acquired are released again.
+ */
+static int
+virLockSpaceProtocolDispatchAcquireResources(virNetServer *server G_GNUC_UNUSED,
+                                             virNetServerClient *client,
+                                             virNetMessage *msg G_GNUC_UNUSED,
+                                             struct virNetMessageError *rerr,
+                                             virLockSpaceProtocolAcquireResourcesArgs *args)
+{
+    int rv = -1;
+    unsigned int flags = args->flags;
+    virLockDaemonClient *priv =
+        virNetServerClientGetPrivateData(client);
+    size_t i;
+
+    g_mutex_lock(&priv->lock);
+
+    virCheckFlagsGoto(0, cleanup);
+
+    if (priv->restricted) {
+        virReportError(VIR_ERR_OPERATION_DENIED, "%s",
+                       _("lock manager connection has been restricted"));
         goto cleanup;
+    }
+
+    if (!priv->ownerId) {
+        virReportError(VIR_ERR_OPERATION_INVALID, "%s",
+                       _("lock owner details have not been registered"));
+        goto cleanup;
+    }
+
+    for (i = 0; i < args->resources.resources_len; i++) {
+        virLockSpaceProtocolResource *res = &args->resources.resources_val[i];
+
+        if (virLockDaemonDispatchAcquireResource(priv, res->path, res->name,
+                                                 res->flags) < 0) {
+            virErrorPtr orig_err;
+
+            virErrorPreserveLast(&orig_err);
+            while (i-- > 0) {
+                virLockSpace *lockspace;
+
+                res = &args->resources.resources_val[i];
+                if ((lockspace = virLockDaemonFindLockSpace(lockDaemon, res->path)))
+                    ignore_value(virLockSpaceReleaseResource(lockspace,
+                                                             res->name,
+                                                             priv->ownerPid));
+            }
+            virErrorRestore(&orig_err);
+            goto cleanup;
+        }
+    }
 
     rv = 0;
 
@@ -649,6 +649,87 @@ static int virLockManagerLockDaemonAddResource(virLockManager *lock,
 }
 
 
+static int
+virLockManagerLockDaemonAcquireResourcesOneByOne(virLockManagerLockDaemonPrivate *priv,
+                                                 virNetClient *client,
+                                                 virNetClientProgram *program,
+                                                 int *counter)
+{
+    size_t i;
+
+    for (i = 0; i < priv->nresources; i++) {
+        virLockSpaceProtocolAcquireResourceArgs args;
+
+        memset(&args, 0, sizeof(args));
+
+        args.path = priv->resources[i].lockspace;
+        args.name = priv->resources[i].name;
+        args.flags = priv->resources[i].flags;
+
+        if (virNetClientProgramCall(program,
+                                    client,
+                                    (*counter)++,
+                                    VIR_LOCK_SPACE_PROTOCOL_PROC_ACQUIRE_RESOURCE,
+                                    0, NULL, NULL, NULL,
+                                    (xdrproc_t)xdr_virLockSpaceProtocolAcquireResourceArgs, &args,
+                                    (xdrproc_t)xdr_void, NULL) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+/*
+ * Acquire all resources in a single call so that starting a domain with
+ * many disks doesn't take a round trip to virtlockd per disk. Daemons
+ * which don't know the call yet get the resources one by one.
+ */
+static int
+virLockManagerLockDaemonAcquireResources(virLockManagerLockDaemonPrivate *priv,
+                                         virNetClient *client,
+                                         virNetClientProgram *program,
+                                         int *counter)
+{
+    virLockSpaceProtocolAcquireResourcesArgs args;
+    g_autofree virLockSpaceProtocolResource *resources = NULL;
+    size_t i;
+
+    if (priv->nresources > VIR_LOCK_SPACE_PROTOCOL_RESOURCES_MAX)
+        return virLockManagerLockDaemonAcquireResourcesOneByOne(priv, client,
+                                                                program, counter);
+
+    resources = g_new0(virLockSpaceProtocolResource, priv->nresources);
+    for (i = 0; i < priv->nresources; i++) {
+        resources[i].path = priv->resources[i].lockspace;
+        resources[i].name = priv->resources[i].name;
+        resources[i].flags = priv->resources[i].flags;
+    }
+
+    memset(&args, 0, sizeof(args));
+    args.resources.resources_len = priv->nresources;
+    args.resources.resources_val = resources;
+
+    if (virNetClientProgramCall(program,
+                                client,
+                                (*counter)++,
+                                VIR_LOCK_SPACE_PROTOCOL_PROC_ACQUIRE_RESOURCES,
+                                0, NULL, NULL, NULL,
+                                (xdrproc_t)xdr_virLockSpaceProtocolAcquireResourcesArgs, &args,
+                                (xdrproc_t)xdr_void, NULL) < 0) {
+        if (virGetLastErrorCode() != VIR_ERR_RPC)
+            return -1;
+
+        VIR_DEBUG("Falling back to acquiring resources one by one");
+        virResetLastError();
+        return virLockManagerLockDaemonAcquireResourcesOneByOne(priv, client,
+                                                                program, counter);
+    }
+
+    return 0;
+}
+
+
 static int virLockManagerLockDaemonAcquire(virLockManager *lock,
                                            const char *state G_GNUC_UNUSED,
                                            unsigned int flags,
@@ -679,27 +760,11 @@ static int virLockManagerLockDaemonAcquire(virLockManager *lock,
         (*fd = virNetClientDupFD(client, false)) < 0)
         goto cleanup;
 
-    if (!(flags & VIR_LOCK_MANAGER_ACQUIRE_REGISTER_ONLY)) {
-        size_t i;
-        for (i = 0; i < priv->nresources; i++) {
-            virLockSpaceProtocolAcquireResourceArgs args;
-
-            memset(&args, 0, sizeof(args));
-
-            args.path = priv->resources[i].lockspace;
-            args.name = priv->resources[i].name;
-            args.flags = priv->resources[i].flags;
-
-            if (virNetClientProgramCall(program,
-                                        client,
-                                        counter++,
-                                        VIR_LOCK_SPACE_PROTOCOL_PROC_ACQUIRE_RESOURCE,
-                                        0, NULL, NULL, NULL,
-                                        (xdrproc_t)xdr_virLockSpaceProtocolAcquireResourceArgs, &args,
-                                        (xdrproc_t)xdr_void, NULL) < 0)
-                goto cleanup;
-        }
-    }
+    if (!(flags & VIR_LOCK_MANAGER_ACQUIRE_REGISTER_ONLY) &&
+        priv->nresources > 0 &&
+        virLockManagerLockDaemonAcquireResources(priv, client, program,
+                                                 &counter) < 0)
+        goto cleanup;
 
     if ((flags & VIR_LOCK_MANAGER_ACQUIRE_RESTRICT) &&
         virLockManagerLockDaemonConnectionRestrict(lock, client, program, &counter) < 0)
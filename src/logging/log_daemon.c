@@ -152,6 +152,7 @@ virLogDaemonNew(virLogDaemonConfig *config, bool privileged)
     if (!(logd->handler = virLogHandlerNew(privileged,
                                            config->max_size,
                                            config->max_backups,
+                                           config->backup_compression,
                                            virLogDaemonInhibitor,
                                            logd)))
         goto error;
@@ -238,6 +239,7 @@ virLogDaemonNewPostExecRestart(virJSONValue *object, bool privileged,
                                                           privileged,
                                                           config->max_size,
                                                           config->max_backups,
+                                                          config->backup_compression,
                                                           virLogDaemonInhibitor,
                                                           logd)))
         goto error;
@@ -721,6 +723,7 @@ int main(int argc, char **argv) {
                               config->log_level,
                               config->log_filters,
                               config->log_outputs,
+                              NULL,
                               privileged,
                               verbose,
                               godaemon) < 0) {
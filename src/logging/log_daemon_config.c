@@ -84,6 +84,8 @@ static int
 virLogDaemonConfigLoadOptions(virLogDaemonConfig *data,
                               virConf *conf)
 {
+    g_autofree char *compression = NULL;
+
     if (virConfGetValueUInt(conf, "log_level", &data->log_level) < 0)
         return -1;
     if (virConfGetValueString(conf, "log_filters", &data->log_filters) < 0)
@@ -98,6 +100,18 @@ virLogDaemonConfigLoadOptions(virLogDaemonConfig *data,
         return -1;
     if (virConfGetValueSizeT(conf, "max_backups", &data->max_backups) < 0)
         return -1;
+    if (virConfGetValueString(conf, "backup_compression", &compression) < 0)
+        return -1;
+    if (compression) {
+        int val = virRotatingFileCompressionTypeFromString(compression);
+
+        if (val < 0) {
+            virReportError(VIR_ERR_CONF_SYNTAX,
+                           _("Unknown backup_compression '%s'"), compression);
+            return -1;
+        }
+        data->backup_compression = val;
+    }
 
     return 0;
 }
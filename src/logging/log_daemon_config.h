@@ -22,6 +22,7 @@
 #pragma once
 
 #include "internal.h"
+#include "virrotatingfile.h"
 
 typedef struct _virLogDaemonConfig virLogDaemonConfig;
 struct _virLogDaemonConfig {
@@ -33,6 +34,7 @@ struct _virLogDaemonConfig {
 
     size_t max_backups;
     size_t max_size;
+    virRotatingFileCompression backup_compression;
 };
 
 
@@ -43,6 +43,10 @@ VIR_LOG_INIT("logging.log_handler");
 
 #define DEFAULT_MODE 0600
 
+/* Data waiting in a log pipe is read and written to the log file in chunks
+ * of up to this size (the default capacity of a Linux pipe). */
+#define VIR_LOG_HANDLER_BUF_SIZE (64 * 1024)
+
 typedef struct _virLogHandlerLogFile virLogHandlerLogFile;
 struct _virLogHandlerLogFile {
     virRotatingFileWriter *file;
@@ -61,10 +65,14 @@ struct _virLogHandler {
     bool privileged;
     size_t max_size;
     size_t max_backups;
+    virRotatingFileCompression backup_compression;
 
     virLogHandlerLogFile **files;
     size_t nfiles;
 
+    /* shared by all files, only used with the handler locked */
+    char *buf;
+
     virLogHandlerShutdownInhibitor inhibitor;
     void *opaque;
 };
@@ -118,6 +126,26 @@ virLogHandlerLogFileClose(virLogHandler *handler,
 }
 
 
+static virRotatingFileWriter *
+virLogHandlerWriterNew(virLogHandler *handler,
+                       const char *path,
+                       bool trunc)
+{
+    virRotatingFileWriter *writer;
+
+    if (!(writer = virRotatingFileWriterNew(path,
+                                            handler->max_size,
+                                            handler->max_backups,
+                                            trunc,
+                                            DEFAULT_MODE)))
+        return NULL;
+
+    virRotatingFileWriterSetCompression(writer, handler->backup_compression);
+
+    return writer;
+}
+
+
 static virLogHandlerLogFile *
 virLogHandlerGetLogFileFromWatch(virLogHandler *handler,
                                  int watch)
@@ -133,6 +161,55 @@ virLogHandlerGetLogFileFromWatch(virLogHandler *handler,
 }
 
 
+/*
+ * Reads the data waiting in the pipe of @file into @handler->buf, so that
+ * many small writes to the pipe end up in a single write to the log file.
+ * Only the first read may block and only if @block is true, the rest of the
+ * buffer is filled only as long as there's data ready in the pipe.
+ *
+ * Returns the number of bytes read, 0 on EOF or if no data was ready, and
+ * -1 with errno set if the very first read failed.
+ */
+static ssize_t
+virLogHandlerDomainLogFileRead(virLogHandler *handler,
+                               virLogHandlerLogFile *file,
+                               bool block)
+{
+    size_t got = 0;
+
+    while (got < VIR_LOG_HANDLER_BUF_SIZE) {
+        ssize_t len;
+
+        if (!block || got > 0) {
+            struct pollfd pfd = { .fd = file->pipefd, .events = POLLIN };
+            int rc = poll(&pfd, 1, 0);
+
+            if (rc < 0 && errno == EINTR)
+                continue;
+            if (rc <= 0)
+                break;
+        }
+
+        len = read(file->pipefd, handler->buf + got,
+                   VIR_LOG_HANDLER_BUF_SIZE - got);
+        if (len < 0) {
+            if (errno == EINTR)
+                continue;
+            /* report the error on the next read, data comes first */
+            if (got > 0)
+                break;
+            return -1;
+        } else if (len == 0) {
+            break;
+        }
+
+        got += len;
+    }
+
+    return got;
+}
+
+
 static void
 virLogHandlerDomainLogFileEvent(int watch,
                                 int fd,
@@ -141,7 +218,6 @@ virLogHandlerDomainLogFileEvent(int watch,
 {
     virLogHandler *handler = opaque;
     virLogHandlerLogFile *logfile;
-    char buf[1024];
     ssize_t len;
 
     virObjectLock(handler);
@@ -157,12 +233,8 @@ virLogHandlerDomainLogFileEvent(int watch,
         goto cleanup;
     }
 
- reread:
-    len = read(fd, buf, sizeof(buf));
+    len = virLogHandlerDomainLogFileRead(handler, logfile, true);
     if (len < 0) {
-        if (errno == EINTR)
-            goto reread;
-
         virReportSystemError(errno, "%s",
                              _("Unable to read from log pipe"));
         goto error;
@@ -170,7 +242,7 @@ virLogHandlerDomainLogFileEvent(int watch,
         goto error;
     }
 
-    if (virRotatingFileWriterAppend(logfile->file, buf, len) != len)
+    if (virRotatingFileWriterAppend(logfile->file, handler->buf, len) != len)
         goto error;
 
  cleanup:
@@ -188,6 +260,7 @@ virLogHandler *
 virLogHandlerNew(bool privileged,
                  size_t max_size,
                  size_t max_backups,
+                 virRotatingFileCompression backup_compression,
                  virLogHandlerShutdownInhibitor inhibitor,
                  void *opaque)
 {
@@ -199,9 +272,11 @@ virLogHandlerNew(bool privileged,
     if (!(handler = virObjectLockableNew(virLogHandlerClass)))
         return NULL;
 
+    handler->buf = g_new0(char, VIR_LOG_HANDLER_BUF_SIZE);
     handler->privileged = privileged;
     handler->max_size = max_size;
     handler->max_backups = max_backups;
+    handler->backup_compression = backup_compression;
     handler->inhibitor = inhibitor;
     handler->opaque = opaque;
 
@@ -253,11 +328,7 @@ virLogHandlerLogFilePostExecRestart(virLogHandler *handler,
         goto error;
     }
 
-    if ((file->file = virRotatingFileWriterNew(path,
-                                               handler->max_size,
-                                               handler->max_backups,
-                                               false,
-                                               DEFAULT_MODE)) == NULL)
+    if (!(file->file = virLogHandlerWriterNew(handler, path, false)))
         goto error;
 
     if (virJSONValueObjectGetNumberInt(object, "pipefd", &file->pipefd) < 0) {
@@ -285,6 +356,7 @@ virLogHandlerNewPostExecRestart(virJSONValue *object,
                                 bool privileged,
                                 size_t max_size,
                                 size_t max_backups,
+                                virRotatingFileCompression backup_compression,
                                 virLogHandlerShutdownInhibitor inhibitor,
                                 void *opaque)
 {
@@ -295,6 +367,7 @@ virLogHandlerNewPostExecRestart(virJSONValue *object,
     if (!(handler = virLogHandlerNew(privileged,
                                      max_size,
                                      max_backups,
+                                     backup_compression,
                                      inhibitor,
                                      opaque)))
         return NULL;
@@ -350,6 +423,7 @@ virLogHandlerDispose(void *obj)
         virLogHandlerLogFileFree(handler->files[i]);
     }
     g_free(handler->files);
+    g_free(handler->buf);
 }
 
 
@@ -393,11 +467,7 @@ virLogHandlerDomainOpenLogFile(virLogHandler *handler,
     file->driver = g_strdup(driver);
     file->domname = g_strdup(domname);
 
-    if ((file->file = virRotatingFileWriterNew(path,
-                                               handler->max_size,
-                                               handler->max_backups,
-                                               trunc,
-                                               DEFAULT_MODE)) == NULL)
+    if (!(file->file = virLogHandlerWriterNew(handler, path, trunc)))
         goto error;
 
     VIR_APPEND_ELEMENT_COPY(handler->files, handler->nfiles, file);
@@ -428,40 +498,19 @@ virLogHandlerDomainOpenLogFile(virLogHandler *handler,
 
 
 static void
-virLogHandlerDomainLogFileDrain(virLogHandlerLogFile *file)
+virLogHandlerDomainLogFileDrain(virLogHandler *handler,
+                                virLogHandlerLogFile *file)
 {
-    char buf[1024];
     ssize_t len;
-    struct pollfd pfd;
-    int ret;
 
     for (;;) {
-        pfd.fd = file->pipefd;
-        pfd.events = POLLIN;
-        pfd.revents = 0;
-
-        ret = poll(&pfd, 1, 0);
-        if (ret < 0) {
-            if (errno == EINTR)
-                continue;
-
-            return;
-        }
-
-        if (ret == 0)
+        len = virLogHandlerDomainLogFileRead(handler, file, false);
+        if (len <= 0)
             return;
 
-        len = read(file->pipefd, buf, sizeof(buf));
         file->drained = true;
-        if (len < 0) {
-            if (errno == EINTR)
-                continue;
-            return;
-        } else if (len == 0) {
-            return;
-        }
 
-        if (virRotatingFileWriterAppend(file->file, buf, len) != len)
+        if (virRotatingFileWriterAppend(file->file, handler->buf, len) != len)
             return;
     }
 }
@@ -497,7 +546,7 @@ virLogHandlerDomainGetLogFilePosition(virLogHandler *handler,
         goto cleanup;
     }
 
-    virLogHandlerDomainLogFileDrain(file);
+    virLogHandlerDomainLogFileDrain(handler, file);
 
     *inode = virRotatingFileWriterGetINode(file->file);
     *offset = virRotatingFileWriterGetOffset(file->file);
@@ -539,6 +588,10 @@ virLogHandlerDomainReadLogFile(virLogHandler *handler,
         goto error;
     data[got] = '\0';
 
+    /* callers ask for generous amounts, don't keep the unused part around
+     * while the reply is sent */
+    data = g_renew(char, data, got + 1);
+
     virRotatingFileReaderFree(file);
     virObjectUnlock(handler);
     return data;
@@ -579,11 +632,7 @@ virLogHandlerDomainAppendLogFile(virLogHandler *handler,
     }
 
     if (!writer) {
-        if (!(newwriter = virRotatingFileWriterNew(path,
-                                                   handler->max_size,
-                                                   handler->max_backups,
-                                                   false,
-                                                   DEFAULT_MODE)))
+        if (!(newwriter = virLogHandlerWriterNew(handler, path, false)))
             goto cleanup;
 
         writer = newwriter;
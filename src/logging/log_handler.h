@@ -22,6 +22,7 @@
 
 #include "internal.h"
 #include "virjson.h"
+#include "virrotatingfile.h"
 
 typedef struct _virLogHandler virLogHandler;
 
@@ -32,12 +33,14 @@ typedef void (*virLogHandlerShutdownInhibitor)(bool inhibit,
 virLogHandler *virLogHandlerNew(bool privileged,
                                   size_t max_size,
                                   size_t max_backups,
+                                  virRotatingFileCompression backup_compression,
                                   virLogHandlerShutdownInhibitor inhibitor,
                                   void *opaque);
 virLogHandler *virLogHandlerNewPostExecRestart(virJSONValue *child,
                                                  bool privileged,
                                                  size_t max_size,
                                                  size_t max_backups,
+                                                 virRotatingFileCompression backup_compression,
                                                  virLogHandlerShutdownInhibitor inhibitor,
                                                  void *opaque);
 
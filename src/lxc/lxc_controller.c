@@ -66,6 +66,7 @@
 #include "virgettext.h"
 #include "virsocket.h"
 #include "virutil.h"
+#include "virtime.h"
 
 #define VIR_FROM_THIS VIR_FROM_LXC
 
@@ -567,7 +568,8 @@ static int virLXCControllerAppendNBDPids(virLXCController *ctrl,
     g_autofree pid_t *pids = NULL;
     size_t npids = 0;
     size_t i;
-    size_t loops = 0;
+    virTimeBackOffVar timeout;
+    bool found = false;
     pid_t pid;
 
     if (!STRPREFIX(dev, "/dev/"))
@@ -575,18 +577,23 @@ static int virLXCControllerAppendNBDPids(virLXCController *ctrl,
 
     pidpath = g_strdup_printf("/sys/devices/virtual/block/%s/pid", dev + 5);
 
-    /* Wait for the pid file to appear */
-    while (!virFileExists(pidpath)) {
-        /* wait for 100ms before checking again, but don't do it for ever */
-        if (errno == ENOENT && loops < 10) {
-            g_usleep(100 * 1000);
-            loops++;
-        } else {
-            virReportSystemError(errno,
-                                 _("Cannot check NBD device %s pid"),
-                                 dev + 5);
-            return -1;
-        }
+    /* Wait for the pid file to appear, it usually takes just a few
+     * milliseconds, but don't do it for ever */
+    if (virTimeBackOffStart(&timeout, 1, 1000) < 0)
+        return -1;
+    while (virTimeBackOffWait(&timeout)) {
+        if ((found = virFileExists(pidpath)))
+            break;
+
+        if (errno != ENOENT)
+            break;
+    }
+
+    if (!found) {
+        virReportSystemError(errno,
+                             _("Cannot check NBD device %s pid"),
+                             dev + 5);
+        return -1;
     }
 
     if (virPidFileReadPath(pidpath, &pid) < 0)
@@ -2295,6 +2302,7 @@ virLXCControllerRun(virLXCController *ctrl)
     int control[2] = { -1, -1};
     int containerhandshake[2] = { -1, -1 };
     char **containerTTYPaths = g_new0(char *, ctrl->nconsoles);
+    gint64 start = g_get_monotonic_time();
     size_t i;
 
     if (socketpair(PF_UNIX, SOCK_STREAM, 0, control) < 0) {
@@ -2354,6 +2362,9 @@ virLXCControllerRun(virLXCController *ctrl)
                                            ctrl->nconsoles,
                                            containerTTYPaths)) < 0)
         goto cleanup;
+    VIR_DEBUG("Container %s started after %lld ms of setup",
+              ctrl->def->name,
+              (long long)(g_get_monotonic_time() - start) / 1000);
     VIR_FORCE_CLOSE(control[1]);
     VIR_FORCE_CLOSE(containerhandshake[1]);
 
@@ -2392,6 +2403,9 @@ virLXCControllerRun(virLXCController *ctrl)
                              _("error receiving signal from container"));
         goto cleanup;
     }
+    VIR_DEBUG("Container %s set up after %lld ms",
+              ctrl->def->name,
+              (long long)(g_get_monotonic_time() - start) / 1000);
 
     /* ...and reduce our privileges */
     if (lxcControllerClearCapabilities() < 0)
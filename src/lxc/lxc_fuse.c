@@ -61,8 +61,18 @@ struct virLXCFuse {
     struct fuse_session *sess;
 # endif
     virMutex lock;
+
+    /* Monitoring agents may read /proc/meminfo many times a second, the
+     * formatted content is reused for a while instead of reading the
+     * cgroup files each time. Requests are handled by the single
+     * fuse_loop thread so this doesn't need a lock. */
+    char *meminfo;
+    gint64 meminfoTime;
 };
 
+/* How long the content of /proc/meminfo is reused, in microseconds */
+# define LXC_FUSE_MEMINFO_TTL (G_USEC_PER_SEC / 2)
+
 static const char *fuse_meminfo_path = "/meminfo";
 
 static int
@@ -72,7 +82,8 @@ lxcProcGetattrImpl(const char *path,
     g_autofree char *mempath = NULL;
     struct stat sb;
     struct fuse_context *context = fuse_get_context();
-    virDomainDef *def = (virDomainDef *)context->private_data;
+    struct virLXCFuse *fuse = context->private_data;
+    virDomainDef *def = fuse->def;
 
     memset(stbuf, 0, sizeof(struct stat));
     mempath = g_strdup_printf("/proc/%s", path);
@@ -188,19 +199,15 @@ lxcProcHostRead(char *path,
 }
 
 static int
-lxcProcReadMeminfo(char *hostpath,
-                   virDomainDef *def,
-                   char *buf,
-                   size_t size,
-                   off_t offset)
+lxcProcFormatMeminfo(char *hostpath,
+                     virDomainDef *def,
+                     char **meminfo_str)
 {
-    int res;
     g_autoptr(FILE) fp = NULL;
     g_autofree char *line = NULL;
     size_t n;
     struct virLXCMeminfo meminfo;
     g_auto(virBuffer) buffer = VIR_BUFFER_INITIALIZER;
-    const char *new_meminfo = NULL;
 
     if (virLXCCgroupGetMeminfo(&meminfo) < 0) {
         virErrorSetErrnoFromLastError();
@@ -213,7 +220,6 @@ lxcProcReadMeminfo(char *hostpath,
         return -errno;
     }
 
-    res = -1;
     while (getline(&line, &n, fp) > 0) {
         char *ptr = strchr(line, ':');
         if (!ptr)
@@ -286,19 +292,49 @@ lxcProcReadMeminfo(char *hostpath,
 
     }
 
-    new_meminfo = virBufferCurrentContent(&buffer);
-    res = virBufferUse(&buffer);
+    *meminfo_str = virBufferContentAndReset(&buffer);
+    if (!*meminfo_str)
+        *meminfo_str = g_strdup("");
+
+    return 0;
+}
+
+static int
+lxcProcReadMeminfo(char *hostpath,
+                   struct virLXCFuse *fuse,
+                   char *buf,
+                   size_t size,
+                   off_t offset)
+{
+    gint64 now = g_get_monotonic_time();
+    size_t len;
+    int res;
+
+    /* A reader going through the file in several chunks gets them all
+     * from the same snapshot as long as it's quick enough */
+    if (!fuse->meminfo || now - fuse->meminfoTime > LXC_FUSE_MEMINFO_TTL) {
+        g_autofree char *meminfo = NULL;
+
+        if ((res = lxcProcFormatMeminfo(hostpath, fuse->def, &meminfo)) < 0)
+            return res;
+
+        g_free(fuse->meminfo);
+        fuse->meminfo = g_steal_pointer(&meminfo);
+        fuse->meminfoTime = now;
+    }
+
+    len = strlen(fuse->meminfo);
 
-    if (offset > res)
+    if (offset > (off_t)len)
         return 0;
 
-    res -= offset;
+    len -= offset;
 
-    if (res > size)
-        res = size;
-    memcpy(buf, new_meminfo + offset, res);
+    if (len > size)
+        len = size;
+    memcpy(buf, fuse->meminfo + offset, len);
 
-    return res;
+    return len;
 }
 
 static int
@@ -311,15 +347,15 @@ lxcProcRead(const char *path,
     int res = -ENOENT;
     g_autofree char *hostpath = NULL;
     struct fuse_context *context = NULL;
-    virDomainDef *def = NULL;
+    struct virLXCFuse *fuse = NULL;
 
     hostpath = g_strdup_printf("/proc/%s", path);
 
     context = fuse_get_context();
-    def = (virDomainDef *)context->private_data;
+    fuse = context->private_data;
 
     if (STREQ(path, fuse_meminfo_path)) {
-        if ((res = lxcProcReadMeminfo(hostpath, def, buf, size, offset)) < 0)
+        if ((res = lxcProcReadMeminfo(hostpath, fuse, buf, size, offset)) < 0)
             res = lxcProcHostRead(hostpath, buf, size, offset);
     }
 
@@ -386,7 +422,7 @@ lxcSetupFuse(struct virLXCFuse **f,
         goto error;
 
 # if FUSE_USE_VERSION >= 31
-    fuse->fuse = fuse_new(&args, &lxcProcOper, sizeof(lxcProcOper), fuse->def);
+    fuse->fuse = fuse_new(&args, &lxcProcOper, sizeof(lxcProcOper), fuse);
     if (fuse->fuse == NULL)
         goto error;
 
@@ -407,7 +443,7 @@ lxcSetupFuse(struct virLXCFuse **f,
         goto error;
 
     fuse->fuse = fuse_new(fuse->ch, &args, &lxcProcOper,
-                          sizeof(lxcProcOper), fuse->def);
+                          sizeof(lxcProcOper), fuse);
     if (fuse->fuse == NULL) {
         goto error;
     }
@@ -458,6 +494,7 @@ lxcFreeFuse(struct virLXCFuse **f)
         }
 
         g_free(fuse->mountpoint);
+        g_free(fuse->meminfo);
         g_free(*f);
     }
 }
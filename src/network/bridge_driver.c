@@ -66,6 +66,7 @@
 #include "network_event.h"
 #include "virhook.h"
 #include "virjson.h"
+#include "virleaseindex.h"
 #include "virnetworkportdef.h"
 #include "virutil.h"
 
@@ -362,6 +363,7 @@ networkRemoveInactive(virNetworkDriverState *driver,
 {
     g_autofree char *leasefile = NULL;
     g_autofree char *customleasefile = NULL;
+    g_autofree char *customleaseindex = NULL;
     g_autofree char *configfile = NULL;
     g_autofree char *statusfile = NULL;
     g_autofree char *macMapFile = NULL;
@@ -380,6 +382,8 @@ networkRemoveInactive(virNetworkDriverState *driver,
     if (!(customleasefile = networkDnsmasqLeaseFileNameCustom(driver, def->bridge)))
         return -1;
 
+    customleaseindex = g_strdup_printf("%s" VIR_LEASE_INDEX_SUFFIX, customleasefile);
+
     if (!(configfile = networkDnsmasqConfigFileName(driver, def->name)))
         return -1;
 
@@ -393,6 +397,7 @@ networkRemoveInactive(virNetworkDriverState *driver,
     dnsmasqDelete(dctx);
     unlink(leasefile);
     unlink(customleasefile);
+    unlink(customleaseindex);
     unlink(configfile);
 
     /* MAC map manager */
@@ -599,6 +604,7 @@ networkStateInitialize(bool privileged,
     g_autofree char *configdir = NULL;
     g_autofree char *rundir = NULL;
     bool autostart = true;
+    int firewallBackend;
 #ifdef WITH_FIREWALLD
     GDBusConnection *sysbus = NULL;
 #endif
@@ -619,6 +625,13 @@ networkStateInitialize(bool privileged,
 
     network_driver->privileged = privileged;
 
+    if ((firewallBackend = virFirewallBackendTypeFromString(FIREWALL_BACKEND)) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("unknown firewall backend '%s'"), FIREWALL_BACKEND);
+        goto error;
+    }
+    network_driver->firewallBackend = firewallBackend;
+
     if (!(network_driver->xmlopt = networkDnsmasqCreateXMLConf()))
         goto error;
 
@@ -864,6 +877,7 @@ networkConnectSupportsFeature(virConnectPtr conn, int feature)
     case VIR_DRV_FEATURE_REMOTE:
     case VIR_DRV_FEATURE_PROGRAM_KEEPALIVE:
     case VIR_DRV_FEATURE_REMOTE_CLOSE_CALLBACK:
+    case VIR_DRV_FEATURE_REMOTE_COMPACT_DOMAIN_STATS:
     case VIR_DRV_FEATURE_REMOTE_EVENT_CALLBACK:
     case VIR_DRV_FEATURE_TYPED_PARAM_STRING:
     case VIR_DRV_FEATURE_NETWORK_UPDATE_HAS_CORRECT_ORDER:
@@ -1128,7 +1142,7 @@ networkDnsmasqConfContents(virNetworkObj *obj,
                            char **configstr,
                            char **hostsfilestr,
                            dnsmasqContext *dctx,
-                           dnsmasqCaps *caps G_GNUC_UNUSED)
+                           dnsmasqCaps *caps)
 {
     virNetworkDef *def = virNetworkObjGetDef(obj);
     g_auto(virBuffer) configbuf = VIR_BUFFER_INITIALIZER;
@@ -1394,10 +1408,17 @@ networkDnsmasqConfContents(virNetworkObj *obj,
      * listening for DHCP, we should write a 0-length hosts
      * file to allow for runtime additions.
      */
-    if (ipv4def || ipv6def)
+    if (ipv4def || ipv6def) {
         virBufferAsprintf(&configbuf, "dhcp-hostsfile=%s\n",
                           dctx->hostsfile->path);
 
+        /* Hosts added at runtime are written here, so that dnsmasq picks
+         * them up without having to be sent SIGHUP. */
+        if (dnsmasqCapsGet(caps, DNSMASQ_CAPS_DHCP_HOSTSDIR))
+            virBufferAsprintf(&configbuf, "dhcp-hostsdir=%s\n",
+                              dctx->hostsfile->dir);
+    }
+
     /* Likewise, always create this file and put it on the
      * commandline, to allow for runtime additions.
      */
@@ -1576,10 +1597,31 @@ networkStartDhcpDaemon(virNetworkDriverState *driver,
 }
 
 
+/* networkDnsmasqUsesHostsdir:
+ *  Check whether the running dnsmasq of the network was configured with
+ *  dhcp-hostsdir, which depends on the dnsmasq version it was started
+ *  with.
+ */
+static bool
+networkDnsmasqUsesHostsdir(virNetworkDriverState *driver,
+                           virNetworkDef *def)
+{
+    g_autofree char *configfile = NULL;
+    g_autofree char *config = NULL;
+
+    if (!(configfile = networkDnsmasqConfigFileName(driver, def->name)) ||
+        virFileReadAllQuiet(configfile, 1024 * 1024, &config) < 0)
+        return false;
+
+    return strstr(config, "\ndhcp-hostsdir=") != NULL;
+}
+
+
 /* networkRefreshDhcpDaemon:
  *  Update dnsmasq config files, then send a SIGHUP so that it rereads
  *  them.   This only works for the dhcp-hostsfile and the
- *  addn-hosts file.
+ *  addn-hosts file. If the only change is the addition of DHCP hosts,
+ *  dnsmasq configured with dhcp-hostsdir picks them up without SIGHUP.
  *
  *  Returns 0 on success, -1 on failure.
  */
@@ -1594,6 +1636,7 @@ networkRefreshDhcpDaemon(virNetworkDriverState *driver,
     virNetworkIPDef *ipv4def;
     virNetworkIPDef *ipv6def;
     g_autoptr(dnsmasqContext) dctx = NULL;
+    bool reload = true;
 
     /* if no IP addresses specified, nothing to do */
     if (!virNetworkDefGetIPByIndex(def, AF_UNSPEC, 0))
@@ -1637,8 +1680,19 @@ networkRefreshDhcpDaemon(virNetworkDriverState *driver,
     if (networkBuildDnsmasqHostsList(dctx, &def->dns) < 0)
         return -1;
 
-    if (dnsmasqSave(dctx) < 0)
-        return -1;
+    if (networkDnsmasqUsesHostsdir(driver, def)) {
+        if (dnsmasqSaveIncremental(dctx, &reload) < 0)
+            return -1;
+    } else {
+        if (dnsmasqSave(dctx) < 0)
+            return -1;
+    }
+
+    if (!reload) {
+        VIR_DEBUG("dnsmasq for network %s picks up new hosts on its own",
+                  def->bridge);
+        return 0;
+    }
 
     dnsmasqPid = virNetworkObjGetDnsmasqPid(obj);
     return kill(dnsmasqPid, SIGHUP);
@@ -1739,8 +1793,8 @@ networkReloadFirewallRulesHelper(virNetworkObj *obj,
              * network type, forward='open', doesn't need this because it
              * has no iptables rules.
              */
-            networkRemoveFirewallRules(def);
-            ignore_value(networkAddFirewallRules(def));
+            networkRemoveFirewallRules(def, network_driver->firewallBackend);
+            ignore_value(networkAddFirewallRules(def, network_driver->firewallBackend));
             break;
 
         case VIR_NETWORK_FORWARD_OPEN:
@@ -2001,7 +2055,7 @@ networkStartNetworkVirtual(virNetworkDriverState *driver,
 
     /* Add "once per network" rules */
     if (def->forward.type != VIR_NETWORK_FORWARD_OPEN &&
-        networkAddFirewallRules(def) < 0)
+        networkAddFirewallRules(def, network_driver->firewallBackend) < 0)
         goto error;
 
     firewalRulesAdded = true;
@@ -2084,7 +2138,7 @@ networkStartNetworkVirtual(virNetworkDriverState *driver,
 
     if (firewalRulesAdded &&
         def->forward.type != VIR_NETWORK_FORWARD_OPEN)
-        networkRemoveFirewallRules(def);
+        networkRemoveFirewallRules(def, network_driver->firewallBackend);
 
     virNetworkObjUnrefMacMap(obj);
 
@@ -2122,7 +2176,7 @@ networkShutdownNetworkVirtual(virNetworkObj *obj)
     ignore_value(virNetDevSetOnline(def->bridge, false));
 
     if (def->forward.type != VIR_NETWORK_FORWARD_OPEN)
-        networkRemoveFirewallRules(def);
+        networkRemoveFirewallRules(def, network_driver->firewallBackend);
 
     ignore_value(virNetDevBridgeDelete(def->bridge));
 
@@ -3306,7 +3360,7 @@ networkUpdate(virNetworkPtr net,
                  * old rules (and remember to load new ones after the
                  * update).
                  */
-                networkRemoveFirewallRules(def);
+                networkRemoveFirewallRules(def, network_driver->firewallBackend);
                 needFirewallRefresh = true;
                 break;
             default:
@@ -3334,14 +3388,15 @@ networkUpdate(virNetworkPtr net,
                             parentIndex, xml,
                             network_driver->xmlopt, flags) < 0) {
         if (needFirewallRefresh)
-            ignore_value(networkAddFirewallRules(def));
+            ignore_value(networkAddFirewallRules(def, network_driver->firewallBackend));
         goto cleanup;
     }
 
     /* @def is replaced */
     def = virNetworkObjGetDef(obj);
 
-    if (needFirewallRefresh && networkAddFirewallRules(def) < 0)
+    if (needFirewallRefresh &&
+        networkAddFirewallRules(def, network_driver->firewallBackend) < 0)
         goto cleanup;
 
     if (flags & VIR_NETWORK_UPDATE_AFFECT_CONFIG) {
@@ -3879,6 +3934,26 @@ networkLogAllocation(virNetworkDef *netdef,
  * "backend" function table.
  */
 
+/* networkFindUnusedInterface:
+ * @netdef: the network definition
+ *
+ * Returns the first device of the interface pool of @netdef which has
+ * no connections, or NULL if all of them are in use.
+ */
+static virNetworkForwardIfDef *
+networkFindUnusedInterface(virNetworkDef *netdef)
+{
+    size_t i;
+
+    for (i = 0; i < netdef->forward.nifs; i++) {
+        if (netdef->forward.ifs[i].connections == 0)
+            return &netdef->forward.ifs[i];
+    }
+
+    return NULL;
+}
+
+
 /* networkAllocatePort:
  * @obj: the network to allocate from
  * @port: the port definition to allocate
@@ -3992,14 +4067,7 @@ networkAllocatePort(virNetworkObj *obj,
         if (networkCreateInterfacePool(netdef) < 0)
             return -1;
 
-        /* pick first dev with 0 connections */
-        for (i = 0; i < netdef->forward.nifs; i++) {
-            if (netdef->forward.ifs[i].connections == 0) {
-                dev = &netdef->forward.ifs[i];
-                break;
-            }
-        }
-        if (!dev) {
+        if (!(dev = networkFindUnusedInterface(netdef))) {
             virReportError(VIR_ERR_INTERNAL_ERROR,
                            _("network '%s' requires exclusive access "
                              "to interfaces, but none are available"),
@@ -4112,17 +4180,11 @@ networkAllocatePort(virNetworkObj *obj,
                  (port->virtPortProfile->virtPortType
                   == VIR_NETDEV_VPORT_PROFILE_8021QBH))) {
 
-                /* pick first dev with 0 connections */
-                for (i = 0; i < netdef->forward.nifs; i++) {
-                    if (netdef->forward.ifs[i].connections == 0) {
-                        dev = &netdef->forward.ifs[i];
-                        break;
-                    }
-                }
+                dev = networkFindUnusedInterface(netdef);
             } else {
-                /* pick least used dev */
+                /* pick least used dev, an unused one can't be beaten */
                 dev = &netdef->forward.ifs[0];
-                for (i = 1; i < netdef->forward.nifs; i++) {
+                for (i = 1; i < netdef->forward.nifs && dev->connections > 0; i++) {
                     if (netdef->forward.ifs[i].connections < dev->connections)
                         dev = &netdef->forward.ifs[i];
                 }
@@ -5261,6 +5323,7 @@ static virConnectDriver networkConnectDriver = {
 
 static virStateDriver networkStateDriver = {
     .name = "bridge",
+    .dependencies = (const char *const []) { NULL },
     .stateInitialize  = networkStateInitialize,
     .stateCleanup = networkStateCleanup,
     .stateReload = networkStateReload,
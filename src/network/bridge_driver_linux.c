@@ -28,6 +28,7 @@
 #include "virlog.h"
 #include "virfirewall.h"
 #include "virfirewalld.h"
+#include "network_nftables.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
 
@@ -35,25 +36,44 @@ VIR_LOG_INIT("network.bridge_driver_linux");
 
 #define PROC_NET_ROUTE "/proc/net/route"
 
-static virOnceControl createdOnce;
-static bool chainInitDone; /* true iff networkSetupPrivateChains was ever called */
+static virMutex chainInitLock = VIR_MUTEX_INITIALIZER;
+/* true iff networkSetupPrivateChains was ever called for the backend */
+static bool chainInitDone[VIR_FIREWALL_BACKEND_LAST];
 
 static virErrorPtr errInitV4;
 static virErrorPtr errInitV6;
 
-/* Usually only called via virOnce, but can also be called directly in
- * response to firewalld reload (if chainInitDone == true)
+
+static int
+networkSetupPrivateChainsLayer(virFirewallBackend backend,
+                               virFirewallLayer layer)
+{
+    if (backend == VIR_FIREWALL_BACKEND_NFTABLES)
+        return networkNftablesSetupPrivateChains(layer);
+
+    return iptablesSetupPrivateChains(layer);
+}
+
+
+/* Usually only called once per backend, but can also be called with
+ * @force in response to firewalld reload (if chainInitDone == true)
  */
-static void networkSetupPrivateChains(void)
+static void networkSetupPrivateChains(virFirewallBackend backend,
+                                      bool force)
 {
+    VIR_LOCK_GUARD lock = virLockGuardLock(&chainInitLock);
     int rc;
 
-    VIR_DEBUG("Setting up global firewall chains");
+    if (chainInitDone[backend] && !force)
+        return;
+
+    VIR_DEBUG("Setting up global firewall chains using %s",
+              virFirewallBackendTypeToString(backend));
 
     g_clear_pointer(&errInitV4, virFreeError);
     g_clear_pointer(&errInitV6, virFreeError);
 
-    rc = iptablesSetupPrivateChains(VIR_FIREWALL_LAYER_IPV4);
+    rc = networkSetupPrivateChainsLayer(backend, VIR_FIREWALL_LAYER_IPV4);
     if (rc < 0) {
         VIR_DEBUG("Failed to create global IPv4 chains: %s",
                   virGetLastErrorMessage());
@@ -66,7 +86,7 @@ static void networkSetupPrivateChains(void)
             VIR_DEBUG("Global IPv4 chains already exist");
     }
 
-    rc = iptablesSetupPrivateChains(VIR_FIREWALL_LAYER_IPV6);
+    rc = networkSetupPrivateChainsLayer(backend, VIR_FIREWALL_LAYER_IPV6);
     if (rc < 0) {
         VIR_DEBUG("Failed to create global IPv6 chains: %s",
                   virGetLastErrorMessage());
@@ -79,7 +99,7 @@ static void networkSetupPrivateChains(void)
             VIR_DEBUG("Global IPv6 chains already exist");
     }
 
-    chainInitDone = true;
+    chainInitDone[backend] = true;
 }
 
 
@@ -156,16 +176,16 @@ networkPreReloadFirewallRules(virNetworkDriverState *driver,
      * of starting the network though as that makes them
      * more likely to be seen by a human
      */
-    if (chainInitDone && force) {
+    if (chainInitDone[driver->firewallBackend] && force) {
         /* The Private chains have already been initialized once
          * during this run of libvirtd, so 1) we can't do it again via
          * virOnce(), and 2) we need to re-add the private chains even
          * if there are currently no running networks, because the
          * next time a network is started, libvirt will expect that
          * the chains have already been added. So we call directly
-         * instead of via virOnce().
+         * even if it was done already.
          */
-        networkSetupPrivateChains();
+        networkSetupPrivateChains(driver->firewallBackend, true);
 
     } else {
         if (!networkHasRunningNetworksWithFW(driver)) {
@@ -173,7 +193,7 @@ networkPreReloadFirewallRules(virNetworkDriverState *driver,
             return;
         }
 
-        ignore_value(virOnce(&createdOnce, networkSetupPrivateChains));
+        networkSetupPrivateChains(driver->firewallBackend, false);
     }
 }
 
@@ -803,14 +823,14 @@ networkRemoveIPSpecificFirewallRules(virFirewall *fw,
 
 
 /* Add all rules for all ip addresses (and general rules) on a network */
-int networkAddFirewallRules(virNetworkDef *def)
+int networkAddFirewallRules(virNetworkDef *def,
+                            virFirewallBackend firewallBackend)
 {
     size_t i;
     virNetworkIPDef *ipdef;
     g_autoptr(virFirewall) fw = virFirewallNew();
 
-    if (virOnce(&createdOnce, networkSetupPrivateChains) < 0)
-        return -1;
+    networkSetupPrivateChains(firewallBackend, false);
 
     if (errInitV4 &&
         (virNetworkDefGetIPByIndex(def, AF_INET, 0) ||
@@ -893,6 +913,9 @@ int networkAddFirewallRules(virNetworkDef *def)
         }
     }
 
+    if (firewallBackend == VIR_FIREWALL_BACKEND_NFTABLES)
+        return networkNftablesAddFirewallRules(def);
+
     virFirewallStartTransaction(fw, 0);
 
     networkAddGeneralFirewallRules(fw, def);
@@ -921,12 +944,18 @@ int networkAddFirewallRules(virNetworkDef *def)
 }
 
 /* Remove all rules for all ip addresses (and general rules) on a network */
-void networkRemoveFirewallRules(virNetworkDef *def)
+void networkRemoveFirewallRules(virNetworkDef *def,
+                                virFirewallBackend firewallBackend)
 {
     size_t i;
     virNetworkIPDef *ipdef;
     g_autoptr(virFirewall) fw = virFirewallNew();
 
+    if (firewallBackend == VIR_FIREWALL_BACKEND_NFTABLES) {
+        networkNftablesRemoveFirewallRules(def);
+        return;
+    }
+
     virFirewallStartTransaction(fw, VIR_FIREWALL_TRANSACTION_IGNORE_ERRORS);
     networkRemoveChecksumFirewallRules(fw, def);
 
@@ -26,6 +26,7 @@
 #include "virdnsmasq.h"
 #include "virnetworkobj.h"
 #include "object_event.h"
+#include "virfirewall.h"
 
 /* Main driver state */
 struct _virNetworkDriverState {
@@ -33,6 +34,7 @@ struct _virNetworkDriverState {
 
     /* Read-only */
     bool privileged;
+    virFirewallBackend firewallBackend;
 
     /* pid file FD, ensures two copies of the driver can't use the same root */
     int lockFD;
@@ -65,6 +67,8 @@ void networkPostReloadFirewallRules(bool startup);
 
 int networkCheckRouteCollision(virNetworkDef *def);
 
-int networkAddFirewallRules(virNetworkDef *def);
+int networkAddFirewallRules(virNetworkDef *def,
+                            virFirewallBackend firewallBackend);
 
-void networkRemoveFirewallRules(virNetworkDef *def);
+void networkRemoveFirewallRules(virNetworkDef *def,
+                                virFirewallBackend firewallBackend);
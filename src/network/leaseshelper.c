@@ -243,6 +243,13 @@ main(int argc, char **argv)
         /* Write to file */
         if (virFileRewriteStr(custom_lease_file, 0644, leases_str) < 0)
             goto cleanup;
+
+        /* The index only speeds up the NSS plugin which falls back to
+         * parsing the leases file if the index is missing or stale. */
+        if (virLeaseWriteIndex(custom_lease_file, leases_array_new) < 0) {
+            virDispatchError(NULL);
+            virResetLastError();
+        }
         break;
 
     case VIR_LEASE_ACTION_LAST:
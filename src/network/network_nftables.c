@@ -0,0 +1,455 @@
+/*
+ * network_nftables.c: nftables based firewall rules of virtual networks
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "network_nftables.h"
+#include "virerror.h"
+#include "virlog.h"
+
+#define VIR_FROM_THIS VIR_FROM_NETWORK
+
+VIR_LOG_INIT("network.network_nftables");
+
+/*
+ * All rules live in a table of our own, one for each of the ip and ip6
+ * families. Its base chains only contain a lookup of the interface in a
+ * verdict map, whose elements jump to the chains of the network using
+ * the bridge:
+ *
+ *   forward:      oifname vmap @guest_in    -> guest_in_$bridge
+ *                 iifname vmap @guest_out   -> guest_out_$bridge
+ *   postrouting:  iifname vmap @guest_nat   -> guest_nat_$bridge
+ *
+ * This way, packets don't have to walk through the rules of every
+ * network on the host, and networks are added and removed without
+ * knowing the handles of their rules.
+ */
+#define NFTABLES_TABLE "libvirt_network"
+
+static const char networkLocalMulticastIPv4[] = "224.0.0.0/24";
+static const char networkLocalMulticastIPv6[] = "ff02::/16";
+static const char networkLocalBroadcast[] = "255.255.255.255/32";
+
+
+static const char *
+nftablesLayerFamily(virFirewallLayer layer)
+{
+    return layer == VIR_FIREWALL_LAYER_IPV6 ? "ip6" : "ip";
+}
+
+
+static virFirewallRule *
+nftablesAddCommand(virFirewall *fw,
+                   virFirewallLayer layer,
+                   const char *command,
+                   const char *object,
+                   const char *name)
+{
+    return virFirewallAddRule(fw, layer, command, object,
+                              nftablesLayerFamily(layer), NFTABLES_TABLE,
+                              name, NULL);
+}
+
+
+/**
+ * networkNftablesSetupPrivateChains:
+ * @layer: VIR_FIREWALL_LAYER_IPV4 or VIR_FIREWALL_LAYER_IPV6
+ *
+ * Create the table, base chains and verdict maps shared by all
+ * networks, unless they exist already. The base chains are always
+ * rewritten, the maps and thus the networks using them are kept.
+ *
+ * Returns 1 on success, -1 on error. Unlike with iptables there is no
+ * telling whether anything had to be created, so success is always
+ * reported as creation.
+ */
+int
+networkNftablesSetupPrivateChains(virFirewallLayer layer)
+{
+    g_autoptr(virFirewall) fw = virFirewallNewFromBackend(VIR_FIREWALL_BACKEND_NFTABLES);
+    const char *family = nftablesLayerFamily(layer);
+    const char *maps[] = { "guest_in", "guest_out", "guest_nat" };
+    virFirewallRule *rule;
+    size_t i;
+
+    virFirewallStartTransaction(fw, 0);
+
+    virFirewallAddRule(fw, layer, "add", "table", family, NFTABLES_TABLE, NULL);
+
+    for (i = 0; i < G_N_ELEMENTS(maps); i++) {
+        rule = nftablesAddCommand(fw, layer, "add", "map", maps[i]);
+        virFirewallRuleAddArg(fw, rule, "{ type ifname : verdict; }");
+    }
+
+    rule = nftablesAddCommand(fw, layer, "add", "chain", "forward");
+    virFirewallRuleAddArg(fw, rule,
+                          "{ type filter hook forward priority 0; policy accept; }");
+    nftablesAddCommand(fw, layer, "flush", "chain", "forward");
+
+    rule = nftablesAddCommand(fw, layer, "add", "rule", "forward");
+    virFirewallRuleAddArgList(fw, rule, "oifname", "vmap", "@guest_in", NULL);
+    rule = nftablesAddCommand(fw, layer, "add", "rule", "forward");
+    virFirewallRuleAddArgList(fw, rule, "iifname", "vmap", "@guest_out", NULL);
+
+    rule = nftablesAddCommand(fw, layer, "add", "chain", "postrouting");
+    virFirewallRuleAddArg(fw, rule,
+                          "{ type nat hook postrouting priority 100; policy accept; }");
+    nftablesAddCommand(fw, layer, "flush", "chain", "postrouting");
+
+    rule = nftablesAddCommand(fw, layer, "add", "rule", "postrouting");
+    virFirewallRuleAddArgList(fw, rule, "iifname", "vmap", "@guest_nat", NULL);
+
+    if (virFirewallApply(fw) < 0)
+        return -1;
+
+    return 1;
+}
+
+
+static char *
+nftablesFormatNatAddress(virSocketAddr *addr,
+                         bool brackets)
+{
+    g_autofree char *str = NULL;
+
+    if (!(str = virSocketAddrFormat(addr)))
+        return NULL;
+
+    if (brackets)
+        return g_strdup_printf("[%s]", str);
+
+    return g_steal_pointer(&str);
+}
+
+
+/* Fill in the action of a masquerading rule of @def, optionally
+ * restricted to @protocol, the same way iptablesForwardMasquerade()
+ * does it. */
+static int
+nftablesAddNatAction(virFirewall *fw,
+                     virFirewallRule *rule,
+                     virNetworkDef *def,
+                     int af,
+                     const char *protocol)
+{
+    virSocketAddrRange *addr = &def->forward.addr;
+    virPortRange port = def->forward.port;
+    g_autofree char *portRangeStr = NULL;
+    g_autofree char *addrStartStr = NULL;
+    g_autofree char *addrEndStr = NULL;
+    g_autofree char *natRangeStr = NULL;
+
+    if (protocol) {
+        if (port.start == 0 && port.end == 0) {
+            port.start = 1024;
+            port.end = 65535;
+        }
+
+        if (port.start < port.end && port.end < 65536) {
+            portRangeStr = g_strdup_printf(":%u-%u", port.start, port.end);
+        } else {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Invalid port range '%u-%u'."),
+                           port.start, port.end);
+            return -1;
+        }
+    }
+
+    if (!VIR_SOCKET_ADDR_IS_FAMILY(&addr->start, af)) {
+        virFirewallRuleAddArg(fw, rule, "masquerade");
+        if (portRangeStr)
+            virFirewallRuleAddArgList(fw, rule, "to", portRangeStr, NULL);
+        return 0;
+    }
+
+    /* IPv6 addresses have to be put into brackets if a port follows */
+    if (!(addrStartStr = nftablesFormatNatAddress(&addr->start,
+                                                  af == AF_INET6 && portRangeStr)))
+        return -1;
+
+    if (VIR_SOCKET_ADDR_IS_FAMILY(&addr->end, af) &&
+        !(addrEndStr = nftablesFormatNatAddress(&addr->end,
+                                                af == AF_INET6 && portRangeStr)))
+        return -1;
+
+    natRangeStr = g_strdup_printf("%s%s%s%s",
+                                  addrStartStr,
+                                  addrEndStr ? "-" : "",
+                                  NULLSTR_EMPTY(addrEndStr),
+                                  NULLSTR_EMPTY(portRangeStr));
+
+    virFirewallRuleAddArgList(fw, rule, "snat", "to", natRangeStr, NULL);
+    return 0;
+}
+
+
+static int
+nftablesAddMasqueradingRules(virFirewall *fw,
+                             virFirewallLayer layer,
+                             virNetworkDef *def,
+                             const char *chain,
+                             const char *networkstr,
+                             const char *physdev)
+{
+    const char *addrFamily = nftablesLayerFamily(layer);
+    int af = layer == VIR_FIREWALL_LAYER_IPV6 ? AF_INET6 : AF_INET;
+    const char *protocols[] = { "tcp", "udp", NULL };
+    virFirewallRule *rule;
+    size_t i;
+
+    /* Don't masquerade packets targeting the local multicast range,
+     * nor the local broadcast address, as they're never forwarded
+     * and strict DHCP clients don't accept replies with changed
+     * source ports. */
+    rule = nftablesAddCommand(fw, layer, "add", "rule", chain);
+    virFirewallRuleAddArgList(fw, rule,
+                              addrFamily, "saddr", networkstr,
+                              addrFamily, "daddr",
+                              af == AF_INET ? networkLocalMulticastIPv4 :
+                              networkLocalMulticastIPv6,
+                              NULL);
+    if (physdev)
+        virFirewallRuleAddArgList(fw, rule, "oifname", physdev, NULL);
+    virFirewallRuleAddArg(fw, rule, "return");
+
+    if (af == AF_INET) {
+        rule = nftablesAddCommand(fw, layer, "add", "rule", chain);
+        virFirewallRuleAddArgList(fw, rule,
+                                  addrFamily, "saddr", networkstr,
+                                  addrFamily, "daddr", networkLocalBroadcast,
+                                  NULL);
+        if (physdev)
+            virFirewallRuleAddArgList(fw, rule, "oifname", physdev, NULL);
+        virFirewallRuleAddArg(fw, rule, "return");
+    }
+
+    /* Masquerade TCP and UDP using unprivileged source ports only, so
+     * that guests can't get past the source port checks of e.g. NFS,
+     * then anything else. */
+    for (i = 0; i < G_N_ELEMENTS(protocols); i++) {
+        rule = nftablesAddCommand(fw, layer, "add", "rule", chain);
+        virFirewallRuleAddArgList(fw, rule,
+                                  addrFamily, "saddr", networkstr,
+                                  addrFamily, "daddr", "!=", networkstr,
+                                  NULL);
+        if (protocols[i])
+            virFirewallRuleAddArgList(fw, rule, "meta", "l4proto", protocols[i], NULL);
+        if (physdev)
+            virFirewallRuleAddArgList(fw, rule, "oifname", physdev, NULL);
+
+        if (nftablesAddNatAction(fw, rule, def, af, protocols[i]) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+nftablesAddNetworkRules(virFirewall *fw,
+                        virFirewallLayer layer,
+                        virNetworkDef *def)
+{
+    const char *addrFamily = nftablesLayerFamily(layer);
+    int af = layer == VIR_FIREWALL_LAYER_IPV6 ? AF_INET6 : AF_INET;
+    const char *forwardIf = virNetworkDefForwardIf(def, 0);
+    g_autofree char *bridge = g_strdup_printf("\"%s\"", def->bridge);
+    g_autofree char *physdev = NULL;
+    g_autofree char *inChain = g_strdup_printf("guest_in_%s", def->bridge);
+    g_autofree char *outChain = g_strdup_printf("guest_out_%s", def->bridge);
+    g_autofree char *natChain = g_strdup_printf("guest_nat_%s", def->bridge);
+    bool nat = false;
+    virNetworkIPDef *ipdef;
+    virFirewallRule *rule;
+    size_t i;
+
+    if (forwardIf)
+        physdev = g_strdup_printf("\"%s\"", forwardIf);
+
+    nftablesAddCommand(fw, layer, "add", "chain", inChain);
+    nftablesAddCommand(fw, layer, "flush", "chain", inChain);
+    nftablesAddCommand(fw, layer, "add", "chain", outChain);
+    nftablesAddCommand(fw, layer, "flush", "chain", outChain);
+
+    /* Allow traffic between guests on the same bridge */
+    rule = nftablesAddCommand(fw, layer, "add", "rule", inChain);
+    virFirewallRuleAddArgList(fw, rule, "iifname", bridge, "accept", NULL);
+
+    for (i = 0; (ipdef = virNetworkDefGetIPByIndex(def, af, i)); i++) {
+        int prefix = virNetworkIPDefPrefix(ipdef);
+        g_autofree char *networkstr = NULL;
+        bool masquerade;
+
+        /* NB: in the case of IPv6, routing rules are added when the
+         * forward mode is NAT. This is because IPv6 has no NAT.
+         */
+        if (def->forward.type != VIR_NETWORK_FORWARD_NAT &&
+            def->forward.type != VIR_NETWORK_FORWARD_ROUTE)
+            continue;
+
+        masquerade = def->forward.type == VIR_NETWORK_FORWARD_NAT &&
+                     (af == AF_INET ||
+                      def->forward.natIPv6 == VIR_TRISTATE_BOOL_YES);
+
+        if (prefix < 0) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Invalid prefix or netmask for '%s'"),
+                           def->bridge);
+            return -1;
+        }
+
+        if (!(networkstr = virSocketAddrFormatWithPrefix(&ipdef->address,
+                                                         prefix, true)))
+            return -1;
+
+        /* allow forwarding packets from the bridge interface */
+        rule = nftablesAddCommand(fw, layer, "add", "rule", outChain);
+        virFirewallRuleAddArgList(fw, rule, addrFamily, "saddr", networkstr, NULL);
+        if (physdev)
+            virFirewallRuleAddArgList(fw, rule, "oifname", physdev, NULL);
+        virFirewallRuleAddArg(fw, rule, "accept");
+
+        /* allow forwarding packets to the bridge interface, if they are
+         * part of an existing connection in case of masquerading */
+        rule = nftablesAddCommand(fw, layer, "add", "rule", inChain);
+        if (physdev)
+            virFirewallRuleAddArgList(fw, rule, "iifname", physdev, NULL);
+        virFirewallRuleAddArgList(fw, rule, addrFamily, "daddr", networkstr, NULL);
+        if (masquerade)
+            virFirewallRuleAddArgList(fw, rule, "ct", "state", "established,related", NULL);
+        virFirewallRuleAddArg(fw, rule, "accept");
+
+        if (!masquerade)
+            continue;
+
+        if (!nat) {
+            nftablesAddCommand(fw, layer, "add", "chain", natChain);
+            nftablesAddCommand(fw, layer, "flush", "chain", natChain);
+            nat = true;
+        }
+
+        if (nftablesAddMasqueradingRules(fw, layer, def, natChain,
+                                         networkstr, physdev) < 0)
+            return -1;
+    }
+
+    /* Catch all rules to block forwarding to/from bridges */
+    rule = nftablesAddCommand(fw, layer, "add", "rule", inChain);
+    virFirewallRuleAddArg(fw, rule, "reject");
+    rule = nftablesAddCommand(fw, layer, "add", "rule", outChain);
+    virFirewallRuleAddArg(fw, rule, "reject");
+
+    rule = nftablesAddCommand(fw, layer, "add", "element", "guest_in");
+    virFirewallRuleAddArgList(fw, rule, "{", bridge, ":", "jump", inChain, "}", NULL);
+    rule = nftablesAddCommand(fw, layer, "add", "element", "guest_out");
+    virFirewallRuleAddArgList(fw, rule, "{", bridge, ":", "jump", outChain, "}", NULL);
+    if (nat) {
+        rule = nftablesAddCommand(fw, layer, "add", "element", "guest_nat");
+        virFirewallRuleAddArgList(fw, rule, "{", bridge, ":", "jump", natChain, "}", NULL);
+    }
+
+    return 0;
+}
+
+
+static void
+nftablesRemoveNetworkRules(virFirewall *fw,
+                           virFirewallLayer layer,
+                           virNetworkDef *def)
+{
+    g_autofree char *bridge = g_strdup_printf("\"%s\"", def->bridge);
+    const char *maps[] = { "guest_in", "guest_out", "guest_nat" };
+    size_t i;
+
+    for (i = 0; i < G_N_ELEMENTS(maps); i++) {
+        g_autofree char *chain = g_strdup_printf("%s_%s", maps[i], def->bridge);
+        virFirewallRule *rule;
+
+        /* the chain can't be deleted while the map still jumps to it */
+        rule = nftablesAddCommand(fw, layer, "delete", "element", maps[i]);
+        virFirewallRuleAddArgList(fw, rule, "{", bridge, "}", NULL);
+        nftablesAddCommand(fw, layer, "flush", "chain", chain);
+        nftablesAddCommand(fw, layer, "delete", "chain", chain);
+    }
+}
+
+
+static bool
+nftablesNetworkNeedsIPv6(virNetworkDef *def)
+{
+    return virNetworkDefGetIPByIndex(def, AF_INET6, 0) || def->ipv6nogw;
+}
+
+
+/**
+ * networkNftablesAddFirewallRules:
+ * @def: the network definition
+ *
+ * Add the rules for the network using the bridge of @def. The rules
+ * allowing DHCP and DNS to reach dnsmasq which are used with iptables
+ * are not needed: nftables accepts only what all tables accept, so an
+ * accept rule here could not override a drop elsewhere anyway. The
+ * DHCP checksum fixup has no nftables equivalent and is skipped too.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+networkNftablesAddFirewallRules(virNetworkDef *def)
+{
+    g_autoptr(virFirewall) fw = virFirewallNewFromBackend(VIR_FIREWALL_BACKEND_NFTABLES);
+    bool ipv6 = nftablesNetworkNeedsIPv6(def);
+
+    virFirewallStartTransaction(fw, 0);
+
+    if (nftablesAddNetworkRules(fw, VIR_FIREWALL_LAYER_IPV4, def) < 0)
+        return -1;
+
+    if (ipv6 && nftablesAddNetworkRules(fw, VIR_FIREWALL_LAYER_IPV6, def) < 0)
+        return -1;
+
+    virFirewallStartRollback(fw, 0);
+
+    nftablesRemoveNetworkRules(fw, VIR_FIREWALL_LAYER_IPV4, def);
+    if (ipv6)
+        nftablesRemoveNetworkRules(fw, VIR_FIREWALL_LAYER_IPV6, def);
+
+    return virFirewallApply(fw);
+}
+
+
+/**
+ * networkNftablesRemoveFirewallRules:
+ * @def: the network definition
+ *
+ * Remove the rules added by networkNftablesAddFirewallRules(). Rules of
+ * both families are removed regardless of the IP addresses of @def, in
+ * case they changed since the rules were added.
+ */
+void
+networkNftablesRemoveFirewallRules(virNetworkDef *def)
+{
+    g_autoptr(virFirewall) fw = virFirewallNewFromBackend(VIR_FIREWALL_BACKEND_NFTABLES);
+
+    virFirewallStartTransaction(fw, VIR_FIREWALL_TRANSACTION_IGNORE_ERRORS);
+
+    nftablesRemoveNetworkRules(fw, VIR_FIREWALL_LAYER_IPV4, def);
+    nftablesRemoveNetworkRules(fw, VIR_FIREWALL_LAYER_IPV6, def);
+
+    ignore_value(virFirewallApply(fw));
+}
@@ -43,6 +43,7 @@
 #include "virutil.h"
 #include "vircommand.h"
 #include "virlog.h"
+#include "virtime.h"
 
 #define VIR_FROM_THIS VIR_FROM_NODEDEV
 
@@ -511,6 +512,12 @@ nodeDeviceFindNewDevice(virConnectPtr conn,
     nodeDeviceGetTime(&start);
 
     while ((now - start) < LINUX_NEW_DEVICE_WAIT_TIME) {
+        unsigned long long generation;
+        unsigned long long deadline;
+
+        VIR_WITH_MUTEX_LOCK_GUARD(&driver->lock) {
+            generation = driver->devsGeneration;
+        }
 
         virWaitForDevices();
 
@@ -519,7 +526,21 @@ nodeDeviceFindNewDevice(virConnectPtr conn,
         if (device != NULL)
             break;
 
-        sleep(5);
+        /* Rather than sleeping unconditionally, retry as soon as any
+         * device gets added to the list, which is what happens once
+         * udev processed the event for the device we're waiting for. */
+        if (virTimeMillisNow(&deadline) < 0)
+            break;
+        deadline += 5 * 1000;
+
+        VIR_WITH_MUTEX_LOCK_GUARD(&driver->lock) {
+            while (driver->devsGeneration == generation) {
+                if (virCondWaitUntil(&driver->devsCond, &driver->lock,
+                                     deadline) < 0)
+                    break;
+            }
+        }
+
         if (nodeDeviceGetTime(&now) == -1)
             break;
     }
@@ -1691,6 +1712,22 @@ removeMissingPersistentMdev(virNodeDeviceObj *obj,
 }
 
 
+/**
+ * nodeDeviceNotifyDeviceAdded:
+ *
+ * Wake up anybody waiting in nodeDeviceFindNewDevice() for a device to
+ * appear. Must be called whenever a device is added to driver->devs.
+ */
+void
+nodeDeviceNotifyDeviceAdded(void)
+{
+    VIR_LOCK_GUARD lock = virLockGuardLock(&driver->lock);
+
+    driver->devsGeneration++;
+    virCondBroadcast(&driver->devsCond);
+}
+
+
 int
 nodeDeviceUpdateMediatedDevices(void)
 {
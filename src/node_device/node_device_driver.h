@@ -159,6 +159,9 @@ nodeDeviceParseMdevctlJSON(const char *jsonstring,
 int
 nodeDeviceUpdateMediatedDevices(void);
 
+void
+nodeDeviceNotifyDeviceAdded(void);
+
 void
 nodeDeviceGenerateName(virNodeDeviceDef *def,
                        const char *subsystem,
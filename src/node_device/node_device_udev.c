@@ -1425,6 +1425,7 @@ udevRemoveOneDeviceSysPath(const char *path)
     virNodeDeviceObj *obj = NULL;
     virNodeDeviceDef *def;
     virObjectEvent *event = NULL;
+    bool updateMdevs;
 
     if (!(obj = virNodeDeviceObjListFindBySysfsPath(driver->devs, path))) {
         VIR_DEBUG("Failed to find device to remove that has udev path '%s'",
@@ -1433,6 +1434,11 @@ udevRemoveOneDeviceSysPath(const char *path)
     }
     def = virNodeDeviceObjGetDef(obj);
 
+    /* Only mediated devices and their parents can change what mdevctl
+     * reports, don't fork it needlessly for every other device removed. */
+    updateMdevs = def->caps->data.type == VIR_NODE_DEV_CAP_MDEV ||
+                  virNodeDeviceObjHasCap(obj, VIR_NODE_DEV_CAP_MDEV_TYPES);
+
     event = virNodeDeviceEventLifecycleNew(def->name,
                                            VIR_NODE_DEVICE_EVENT_DELETED,
                                            0);
@@ -1450,8 +1456,7 @@ udevRemoveOneDeviceSysPath(const char *path)
     }
     virNodeDeviceObjEndAPI(&obj);
 
-    /* cannot check for mdev_types since they have already been removed */
-    if (nodeDeviceUpdateMediatedDevices() < 0)
+    if (updateMdevs && nodeDeviceUpdateMediatedDevices() < 0)
         VIR_WARN("mdevctl failed to update mediated devices");
 
     virObjectEventStateQueue(driver->nodeDeviceEventState, event);
@@ -1509,19 +1514,15 @@ udevSetParent(struct udev_device *device,
     return 0;
 }
 
-static int
-udevAddOneDevice(struct udev_device *device)
+/* Reads everything about @device, except for its parent, which can only be
+ * looked up once the parent itself is known. Unlike the rest of adding a
+ * device, this doesn't touch the list of devices, and can be run for
+ * several devices in parallel.
+ */
+static virNodeDeviceDef *
+udevNewDeviceDef(struct udev_device *device)
 {
-    virNodeDeviceDef *def = NULL;
-    virNodeDeviceObj *obj = NULL;
-    virNodeDeviceDef *objdef;
-    virObjectEvent *event = NULL;
-    bool new_device = true;
-    int ret = -1;
-    bool persistent = false;
-    bool autostart = false;
-    bool is_mdev;
-    bool has_mdev_types = false;
+    g_autoptr(virNodeDeviceDef) def = NULL;
 
     def = g_new0(virNodeDeviceDef, 1);
 
@@ -1532,13 +1533,35 @@ udevAddOneDevice(struct udev_device *device)
     def->caps = g_new0(virNodeDevCapsDef, 1);
 
     if (udevGetDeviceType(device, &def->caps->data.type) != 0)
-        goto cleanup;
+        return NULL;
 
     if (udevGetDeviceNodes(device, def) != 0)
-        goto cleanup;
+        return NULL;
 
     if (udevGetDeviceDetails(device, def) != 0)
-        goto cleanup;
+        return NULL;
+
+    return g_steal_pointer(&def);
+}
+
+
+/* Takes ownership of @def. If @updateMdevs is false, the caller is
+ * responsible for calling nodeDeviceUpdateMediatedDevices() afterwards.
+ */
+static int
+udevAddOneDeviceDef(struct udev_device *device,
+                    virNodeDeviceDef *def,
+                    bool updateMdevs)
+{
+    virNodeDeviceObj *obj = NULL;
+    virNodeDeviceDef *objdef;
+    virObjectEvent *event = NULL;
+    bool new_device = true;
+    int ret = -1;
+    bool persistent = false;
+    bool autostart = false;
+    bool is_mdev;
+    bool has_mdev_types = false;
 
     if (udevSetParent(device, def) != 0)
         goto cleanup;
@@ -1580,7 +1603,11 @@ udevAddOneDevice(struct udev_device *device)
     has_mdev_types = virNodeDeviceObjHasCap(obj, VIR_NODE_DEV_CAP_MDEV_TYPES);
     virNodeDeviceObjEndAPI(&obj);
 
-    if (has_mdev_types && nodeDeviceUpdateMediatedDevices() < 0)
+    if (new_device)
+        nodeDeviceNotifyDeviceAdded();
+
+    if (updateMdevs && has_mdev_types &&
+        nodeDeviceUpdateMediatedDevices() < 0)
         VIR_WARN("mdevctl failed to update mediated devices");
 
     ret = 0;
@@ -1599,28 +1626,16 @@ udevAddOneDevice(struct udev_device *device)
 
 
 static int
-udevProcessDeviceListEntry(struct udev *udev,
-                           struct udev_list_entry *list_entry)
+udevAddOneDevice(struct udev_device *device)
 {
-    struct udev_device *device;
-    const char *name = NULL;
-    int ret = -1;
-
-    name = udev_list_entry_get_name(list_entry);
-
-    device = udev_device_new_from_syspath(udev, name);
+    virNodeDeviceDef *def;
 
-    if (device != NULL) {
-        if (udevAddOneDevice(device) != 0) {
-            VIR_DEBUG("Failed to create node device for udev device '%s'",
-                      name);
-        }
-        ret = 0;
+    if (!(def = udevNewDeviceDef(device))) {
+        VIR_DEBUG("Discarding device %s", udev_device_get_syspath(device));
+        return -1;
     }
 
-    udev_device_unref(device);
-
-    return ret;
+    return udevAddOneDeviceDef(device, def, true);
 }
 
 
@@ -1648,11 +1663,73 @@ udevEnumerateAddMatches(struct udev_enumerate *udev_enumerate)
 }
 
 
+/* Reading the details of a device may take a while, e.g. for PCI devices
+ * with VPD, or when a host has thousands of devices. Therefore when all
+ * devices are enumerated, they are read by a few worker threads, each of
+ * them with its own udev context since libudev is not thread safe. The
+ * devices are still added to the list in the order given by udev though,
+ * so that parents are known before their children.
+ */
+#define UDEV_ENUMERATE_MAX_WORKERS 8
+
+typedef struct _udevEnumerateData udevEnumerateData;
+struct _udevEnumerateData {
+    virMutex lock;
+    virCond cond;
+    char **syspaths;
+    virNodeDeviceDef **defs;
+    bool *done;
+    size_t ndevices;
+    size_t next; /* index of the next device to be read by a worker */
+};
+
+
+static void
+udevEnumerateWorker(void *opaque)
+{
+    udevEnumerateData *data = opaque;
+    struct udev *udev = udev_new();
+
+    while (true) {
+        struct udev_device *device = NULL;
+        virNodeDeviceDef *def = NULL;
+        size_t i;
+
+        VIR_WITH_MUTEX_LOCK_GUARD(&data->lock) {
+            i = data->next++;
+        }
+
+        if (i >= data->ndevices)
+            break;
+
+        if (udev &&
+            (device = udev_device_new_from_syspath(udev, data->syspaths[i]))) {
+            def = udevNewDeviceDef(device);
+            udev_device_unref(device);
+        }
+
+        VIR_WITH_MUTEX_LOCK_GUARD(&data->lock) {
+            data->defs[i] = def;
+            data->done[i] = true;
+            virCondBroadcast(&data->cond);
+        }
+    }
+
+    if (udev)
+        udev_unref(udev);
+}
+
+
 static int
 udevEnumerateDevices(struct udev *udev)
 {
     struct udev_enumerate *udev_enumerate = NULL;
     struct udev_list_entry *list_entry = NULL;
+    udevEnumerateData data = { 0 };
+    g_autofree virThread *workers = NULL;
+    size_t maxworkers;
+    size_t nworkers = 0;
+    size_t i;
     int ret = -1;
 
     udev_enumerate = udev_enumerate_new(udev);
@@ -1664,12 +1741,90 @@ udevEnumerateDevices(struct udev *udev)
 
     udev_list_entry_foreach(list_entry,
                             udev_enumerate_get_list_entry(udev_enumerate)) {
+        char *syspath = g_strdup(udev_list_entry_get_name(list_entry));
+
+        VIR_APPEND_ELEMENT(data.syspaths, data.ndevices, syspath);
+    }
+
+    if (data.ndevices == 0) {
+        ret = 0;
+        goto cleanup;
+    }
+
+    data.defs = g_new0(virNodeDeviceDef *, data.ndevices);
+    data.done = g_new0(bool, data.ndevices);
+
+    if (virMutexInit(&data.lock) < 0) {
+        virReportSystemError(errno, "%s", _("Unable to initialize mutex"));
+        goto cleanup;
+    }
+
+    if (virCondInit(&data.cond) < 0) {
+        virReportSystemError(errno, "%s", _("Unable to initialize condition"));
+        virMutexDestroy(&data.lock);
+        goto cleanup;
+    }
+
+    maxworkers = MIN(g_get_num_processors(), UDEV_ENUMERATE_MAX_WORKERS);
+    maxworkers = MIN(maxworkers, data.ndevices);
+
+    workers = g_new0(virThread, maxworkers);
+    for (i = 0; i < maxworkers; i++) {
+        if (virThreadCreateFull(&workers[nworkers], true, udevEnumerateWorker,
+                                "udev-enumerate", false, &data) < 0) {
+            VIR_WARN("Failed to start udev enumeration worker");
+            break;
+        }
+        nworkers++;
+    }
+
+    /* Without any workers, read all the devices right here */
+    if (nworkers == 0)
+        udevEnumerateWorker(&data);
 
-        udevProcessDeviceListEntry(udev, list_entry);
+    for (i = 0; i < data.ndevices; i++) {
+        struct udev_device *device;
+        virNodeDeviceDef *def = NULL;
+
+        VIR_WITH_MUTEX_LOCK_GUARD(&data.lock) {
+            while (!data.done[i])
+                ignore_value(virCondWait(&data.cond, &data.lock));
+            def = g_steal_pointer(&data.defs[i]);
+        }
+
+        if (!def) {
+            VIR_DEBUG("Failed to create node device for udev device '%s'",
+                      data.syspaths[i]);
+            continue;
+        }
+
+        if (!(device = udev_device_new_from_syspath(udev, data.syspaths[i]))) {
+            virNodeDeviceDefFree(def);
+            continue;
+        }
+
+        /* Mediated devices are updated just once by the caller */
+        if (udevAddOneDeviceDef(device, def, false) != 0) {
+            VIR_DEBUG("Failed to create node device for udev device '%s'",
+                      data.syspaths[i]);
+        }
+
+        udev_device_unref(device);
     }
 
+    for (i = 0; i < nworkers; i++)
+        virThreadJoin(&workers[i]);
+
+    virCondDestroy(&data.cond);
+    virMutexDestroy(&data.lock);
+
     ret = 0;
  cleanup:
+    for (i = 0; i < data.ndevices; i++)
+        g_free(data.syspaths[i]);
+    g_free(data.syspaths);
+    g_free(data.defs);
+    g_free(data.done);
     udev_enumerate_unref(udev_enumerate);
     return ret;
 }
@@ -1712,6 +1867,8 @@ nodeStateCleanup(void)
         }
     }
 
+    virPCITopologyCacheSetEnabled(false);
+
     virObjectUnref(priv);
     virObjectUnref(driver->nodeDeviceEventState);
 
@@ -1721,6 +1878,7 @@ nodeStateCleanup(void)
         virPidFileRelease(driver->stateDir, "driver", driver->lockFD);
 
     VIR_FREE(driver->stateDir);
+    virCondDestroy(&driver->devsCond);
     virCondDestroy(&driver->initCond);
     virMutexDestroy(&driver->lock);
     VIR_FREE(driver);
@@ -1734,9 +1892,16 @@ static int
 udevHandleOneDevice(struct udev_device *device)
 {
     const char *action = udev_device_get_action(device);
+    const char *subsystem = udev_device_get_subsystem(device);
 
     VIR_DEBUG("udev action: '%s': %s", action, udev_device_get_syspath(device));
 
+    /* Binding drivers doesn't change the topology, so those events are not
+     * worth throwing the whole cache away for */
+    if (STREQ_NULLABLE(subsystem, "pci") &&
+        (STREQ(action, "add") || STREQ(action, "remove") || STREQ(action, "move")))
+        virPCITopologyCacheInvalidate();
+
     if (STREQ(action, "add") || STREQ(action, "change"))
         return udevAddOneDevice(device);
 
@@ -2232,6 +2397,14 @@ nodeStateInitialize(bool privileged,
         VIR_FREE(driver);
         return VIR_DRV_STATE_INIT_ERROR;
     }
+    if (virCondInit(&driver->devsCond) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to initialize condition variable"));
+        virCondDestroy(&driver->initCond);
+        virMutexDestroy(&driver->lock);
+        VIR_FREE(driver);
+        return VIR_DRV_STATE_INIT_ERROR;
+    }
 
     driver->privileged = privileged;
 
@@ -2285,6 +2458,9 @@ nodeStateInitialize(bool privileged,
 
     udev_monitor_enable_receiving(priv->udev_monitor);
 
+    /* From now on every change of PCI devices is seen by the event handler */
+    virPCITopologyCacheSetEnabled(true);
+
     /* mimic udevd's behaviour and override the systems rmem_max limit in case
      * there's a significant number of device 'add' events
      */
@@ -2397,6 +2573,7 @@ static virConnectDriver udevConnectDriver = {
 
 static virStateDriver udevStateDriver = {
     .name = "udev",
+    .dependencies = (const char *const []) { NULL },
     .stateInitialize = nodeStateInitialize, /* 0.7.3 */
     .stateCleanup = nodeStateCleanup, /* 0.7.3 */
     .stateReload = nodeStateReload, /* 0.7.3 */
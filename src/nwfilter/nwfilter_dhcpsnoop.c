@@ -83,6 +83,8 @@ struct virNWFilterSnoopState {
     virMutex             snoopLock;  /* protects SnoopReqs and IfNameToKey */
     GHashTable *     active;
     virMutex             activeLock; /* protects Active */
+    /* decodes the packets of all snooped interfaces */
+    virThreadPool *      decodePool;
 };
 
 # define VIR_IFKEY_LEN   ((VIR_UUID_STRING_BUFLEN) + (VIR_MAC_STRING_BUFLEN))
@@ -91,6 +93,8 @@ typedef struct _virNWFilterSnoopReq virNWFilterSnoopReq;
 
 typedef struct _virNWFilterSnoopIPLease virNWFilterSnoopIPLease;
 
+typedef struct _virNWFilterDHCPDecodeJob virNWFilterDHCPDecodeJob;
+
 typedef enum {
     THREAD_STATUS_NONE,
     THREAD_STATUS_OK,
@@ -120,7 +124,17 @@ struct _virNWFilterSnoopReq {
     virCond                              threadStatusCond;
 
     int                                  jobCompletionStatus;
-    /* the number of submitted jobs in the worker's queue */
+    /*
+     * packets waiting to be decoded, in the order they were captured;
+     * the request is submitted to the shared decode pool as a single
+     * job whenever packets are queued and it isn't being decoded
+     * already, so the packets of an interface are decoded one by one
+     */
+    virNWFilterDHCPDecodeJob *           jobsHead;
+    virNWFilterDHCPDecodeJob *           jobsTail;
+    bool                                 jobsScheduled;
+    virMutex                             jobsLock; /* protects the above */
+    virCond                              jobsCond; /* signals !jobsScheduled */
     /*
      * protect those members that can change while the
      * req is on the public SnoopReq hash and
@@ -204,14 +218,16 @@ G_STATIC_ASSERT(sizeof(struct _virNWFilterSnoopDHCPHdr) == 236);
 # define PCAP_READ_MAXERRS          25 /* retries on failing device */
 # define PCAP_FLOOD_TIMEOUT_MS      10 /* ms */
 
-typedef struct _virNWFilterDHCPDecodeJob virNWFilterDHCPDecodeJob;
 struct _virNWFilterDHCPDecodeJob {
     unsigned char packet[PCAP_PBUFSIZE];
     int caplen;
     bool fromVM;
     int *qCtr;
+    virNWFilterDHCPDecodeJob *next;
 };
 
+# define DHCP_DECODE_MAX_WORKERS    4
+
 # define DHCP_PKT_RATE          10 /* pkts/sec */
 # define DHCP_PKT_BURST         50 /* pkts/sec */
 # define DHCP_BURST_INTERVAL_S  10 /* sec */
@@ -506,6 +522,19 @@ virNWFilterSnoopReqNew(const char *ifkey)
         return NULL;
     }
 
+    if (virMutexInit(&req->jobsLock) < 0) {
+        virCondDestroy(&req->threadStatusCond);
+        virMutexDestroy(&req->lock);
+        return NULL;
+    }
+
+    if (virCondInit(&req->jobsCond) < 0) {
+        virMutexDestroy(&req->jobsLock);
+        virCondDestroy(&req->threadStatusCond);
+        virMutexDestroy(&req->lock);
+        return NULL;
+    }
+
     virNWFilterSnoopReqGet(req);
     return g_steal_pointer(&req);
 }
@@ -535,6 +564,8 @@ virNWFilterSnoopReqFree(virNWFilterSnoopReq *req)
 
     virMutexDestroy(&req->lock);
     virCondDestroy(&req->threadStatusCond);
+    virMutexDestroy(&req->jobsLock);
+    virCondDestroy(&req->jobsCond);
     virFreeError(req->threadError);
 
     g_free(req);
@@ -991,38 +1022,71 @@ virNWFilterSnoopDHCPOpen(const char *ifname, virMacAddr *mac,
     return NULL;
 }
 
+static virNWFilterDHCPDecodeJob *
+virNWFilterSnoopReqJobPop(virNWFilterSnoopReq *req)
+{
+    virNWFilterDHCPDecodeJob *job = req->jobsHead;
+
+    if (job) {
+        req->jobsHead = job->next;
+        if (!req->jobsHead)
+            req->jobsTail = NULL;
+        job->next = NULL;
+    }
+
+    return job;
+}
+
 /*
- * Worker function to decode the DHCP message and with that
- * also do the time-consuming work of instantiating the filters
+ * Worker function to decode the DHCP messages of a snoop request and
+ * with that also do the time-consuming work of instantiating the filters
  */
-static void virNWFilterDHCPDecodeWorker(void *jobdata, void *opaque)
+static void virNWFilterDHCPDecodeWorker(void *jobdata, void *opaque G_GNUC_UNUSED)
 {
-    virNWFilterSnoopReq *req = opaque;
-    g_autofree virNWFilterDHCPDecodeJob *job = jobdata;
-    virNWFilterSnoopEthHdr *packet = (virNWFilterSnoopEthHdr *)job->packet;
+    virNWFilterSnoopReq *req = jobdata;
 
-    if (virNWFilterSnoopDHCPDecode(req, packet,
-                                   job->caplen, job->fromVM) == -1) {
-        req->jobCompletionStatus = -1;
+    while (true) {
+        g_autofree virNWFilterDHCPDecodeJob *job = NULL;
+        virNWFilterSnoopEthHdr *packet;
 
-        virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("Instantiation of rules failed on "
-                         "interface '%s'"), req->binding->portdevname);
+        VIR_WITH_MUTEX_LOCK_GUARD(&req->jobsLock) {
+            if (!(job = virNWFilterSnoopReqJobPop(req))) {
+                req->jobsScheduled = false;
+                virCondBroadcast(&req->jobsCond);
+            }
+        }
+
+        if (!job)
+            break;
+
+        packet = (virNWFilterSnoopEthHdr *)job->packet;
+
+        if (virNWFilterSnoopDHCPDecode(req, packet,
+                                       job->caplen, job->fromVM) == -1) {
+            req->jobCompletionStatus = -1;
+
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Instantiation of rules failed on "
+                             "interface '%s'"), req->binding->portdevname);
+        }
+        ignore_value(!!g_atomic_int_dec_and_test(job->qCtr));
     }
-    ignore_value(!!g_atomic_int_dec_and_test(job->qCtr));
+
+    /* the reference was taken by virNWFilterSnoopDHCPDecodeJobSubmit */
+    virNWFilterSnoopReqPut(req);
 }
 
 /*
- * Submit a job to the worker thread doing the time-consuming work...
+ * Submit a job to the worker threads doing the time-consuming work...
  */
 static int
-virNWFilterSnoopDHCPDecodeJobSubmit(virThreadPool *pool,
+virNWFilterSnoopDHCPDecodeJobSubmit(virNWFilterSnoopReq *req,
                                     virNWFilterSnoopEthHdr *pep,
                                     int len, pcap_direction_t dir,
                                     int *qCtr)
 {
     virNWFilterDHCPDecodeJob *job;
-    int ret;
+    bool failed = false;
 
     if (len <= MIN_VALID_DHCP_PKT_SIZE || len > sizeof(job->packet))
         return 0;
@@ -1034,14 +1098,57 @@ virNWFilterSnoopDHCPDecodeJobSubmit(virThreadPool *pool,
     job->fromVM = (dir == PCAP_D_IN);
     job->qCtr = qCtr;
 
-    ret = virThreadPoolSendJob(pool, 0, job);
+    VIR_WITH_MUTEX_LOCK_GUARD(&req->jobsLock) {
+        if (!req->jobsScheduled) {
+            /* the worker picking up the request runs until its queue
+             * is empty and then drops this reference */
+            virNWFilterSnoopReqGet(req);
+
+            if (virThreadPoolSendJob(virNWFilterSnoopState.decodePool,
+                                     0, req) < 0) {
+                failed = true;
+                break;
+            }
+
+            req->jobsScheduled = true;
+        }
+
+        if (req->jobsTail)
+            req->jobsTail->next = job;
+        else
+            req->jobsHead = job;
+        req->jobsTail = job;
 
-    if (ret == 0)
         g_atomic_int_add(qCtr, 1);
-    else
+    }
+
+    if (failed) {
+        virNWFilterSnoopReqPut(req);
         g_free(job);
+        return -1;
+    }
 
-    return ret;
+    return 0;
+}
+
+/*
+ * Drop the packets of @req which weren't decoded yet and wait for the
+ * one being decoded, if any. Called by the snooping thread before it
+ * goes away along with the queue counters of the jobs.
+ */
+static void
+virNWFilterSnoopReqJobsDrain(virNWFilterSnoopReq *req)
+{
+    VIR_LOCK_GUARD lock = virLockGuardLock(&req->jobsLock);
+    virNWFilterDHCPDecodeJob *job;
+
+    while ((job = virNWFilterSnoopReqJobPop(req))) {
+        ignore_value(!!g_atomic_int_dec_and_test(job->qCtr));
+        g_free(job);
+    }
+
+    while (req->jobsScheduled)
+        ignore_value(virCondWait(&req->jobsCond, &req->jobsLock));
 }
 
 /*
@@ -1177,7 +1284,6 @@ virNWFilterDHCPSnoopThread(void *req0)
     int tmp = -1, rv, n, pollTo;
     size_t i;
     g_autofree char *threadkey = NULL;
-    virThreadPool *worker = NULL;
     time_t last_displayed = 0, last_displayed_queue = 0;
     virNWFilterSnoopPcapConf pcapConf[] = {
         {
@@ -1231,12 +1337,10 @@ virNWFilterDHCPSnoopThread(void *req0)
             }
             tmp = virNetDevGetIndex(req->binding->portdevname, &ifindex);
             threadkey = g_strdup(req->threadkey);
-            worker = virThreadPoolNewFull(1, 1, 0, virNWFilterDHCPDecodeWorker,
-                                          "dhcp-decode", NULL, req);
         }
 
         /* let creator know how well we initialized */
-        if (error || !threadkey || tmp < 0 || !worker || ifindex != req->ifindex) {
+        if (error || !threadkey || tmp < 0 || ifindex != req->ifindex) {
             virErrorPreserveLast(&req->threadError);
             req->threadStatus = THREAD_STATUS_FAIL;
         } else {
@@ -1356,7 +1460,7 @@ virNWFilterDHCPSnoopThread(void *req0)
                     continue;
                 }
 
-                if (virNWFilterSnoopDHCPDecodeJobSubmit(worker, packet,
+                if (virNWFilterSnoopDHCPDecodeJobSubmit(req, packet,
                                                       hdr->caplen,
                                                       pcapConf[i].dir,
                                                       &pcapConf[i].qCtr) < 0) {
@@ -1384,7 +1488,7 @@ virNWFilterDHCPSnoopThread(void *req0)
     }
 
  cleanup:
-    virThreadPoolFree(worker);
+    virNWFilterSnoopReqJobsDrain(req);
 
     virNWFilterSnoopReqPut(req);
 
@@ -1873,6 +1977,18 @@ virNWFilterDHCPSnoopInit(void)
     virNWFilterSnoopState.snoopReqs =
         virHashNew(virNWFilterSnoopReqRelease);
 
+    if (!(virNWFilterSnoopState.decodePool =
+          virThreadPoolNewFull(1, DHCP_DECODE_MAX_WORKERS, 0,
+                               virNWFilterDHCPDecodeWorker,
+                               "dhcp-decode", NULL, NULL))) {
+        g_clear_pointer(&virNWFilterSnoopState.snoopReqs, g_hash_table_unref);
+        g_clear_pointer(&virNWFilterSnoopState.active, g_hash_table_unref);
+        g_clear_pointer(&virNWFilterSnoopState.ifnameToKey, g_hash_table_unref);
+        virMutexDestroy(&virNWFilterSnoopState.activeLock);
+        virMutexDestroy(&virNWFilterSnoopState.snoopLock);
+        return -1;
+    }
+
     virNWFilterSnoopLeaseFileLoad();
     virNWFilterSnoopLeaseFileOpen();
 
@@ -1948,6 +2064,9 @@ virNWFilterDHCPSnoopShutdown(void)
     virNWFilterSnoopEndThreads();
     virNWFilterSnoopJoinThreads();
 
+    /* all snooping threads drained their queues before exiting */
+    g_clear_pointer(&virNWFilterSnoopState.decodePool, virThreadPoolFree);
+
     VIR_WITH_MUTEX_LOCK_GUARD(&virNWFilterSnoopState.snoopLock) {
         virNWFilterSnoopLeaseFileClose();
         g_clear_pointer(&virNWFilterSnoopState.ifnameToKey, g_hash_table_unref);
@@ -840,6 +840,8 @@ static virConnectDriver nwfilterConnectDriver = {
 
 static virStateDriver stateDriver = {
     .name = "NWFilter",
+    /* don't race with the network driver setting up its firewall rules */
+    .dependencies = (const char *const []) { "bridge", NULL },
     .stateInitialize = nwfilterStateInitialize,
     .stateCleanup = nwfilterStateCleanup,
     .stateReload = nwfilterStateReload,
@@ -37,6 +37,7 @@
 #include "datatypes.h"
 #include "virsocketaddr.h"
 #include "virstring.h"
+#include "vircrypto.h"
 
 #define VIR_FROM_THIS VIR_FROM_NWFILTER
 
@@ -49,6 +50,11 @@ VIR_LOG_INIT("nwfilter.nwfilter_gentech_driver");
 
 static int _virNWFilterTeardownFilter(const char *ifname);
 
+/* Digests of the rules last applied to each interface, see
+ * virNWFilterInstDigest() */
+static virMutex ruleDigestsLock = VIR_MUTEX_INITIALIZER;
+static GHashTable *ruleDigests;
+
 
 static virNWFilterTechDriver *filter_tech_drivers[] = {
     &ebiptables_driver,
@@ -76,6 +82,10 @@ void virNWFilterTechDriversShutdown(void)
             filter_tech_drivers[i]->shutdown();
         i++;
     }
+
+    VIR_WITH_MUTEX_LOCK_GUARD(&ruleDigestsLock) {
+        g_clear_pointer(&ruleDigests, g_hash_table_unref);
+    }
 }
 
 
@@ -218,6 +228,80 @@ virNWFilterInstReset(virNWFilterInst *inst)
 
 
 
+/**
+ * virNWFilterInstDigest:
+ * @inst: the instantiated rules of an interface
+ *
+ * Returns a digest of everything the tech driver bases the rules of an
+ * interface on, i.e. the rules along with the chains they go into and
+ * the values of all variables, or NULL on error. If the digest of the
+ * rules built for an updated filter matches the one of the rules in
+ * place, the interface doesn't have to be touched.
+ */
+static char *
+virNWFilterInstDigest(virNWFilterInst *inst)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    g_autofree char *str = NULL;
+    char *digest = NULL;
+    size_t i;
+
+    for (i = 0; i < inst->nrules; i++) {
+        virNWFilterRuleInst *rule = inst->rules[i];
+
+        virBufferAsprintf(&buf, "%s %d %d\n", rule->chainSuffix,
+                          rule->chainPriority, rule->priority);
+
+        if (virNWFilterRuleDefFormat(&buf, rule->def) < 0 ||
+            virNWFilterFormatParamAttributes(&buf, rule->vars,
+                                             rule->chainSuffix) < 0)
+            return NULL;
+    }
+
+    if (!(str = virBufferContentAndReset(&buf)))
+        str = g_strdup("");
+
+    if (virCryptoHashString(VIR_CRYPTO_HASH_SHA256, str, &digest) < 0)
+        return NULL;
+
+    return digest;
+}
+
+
+static bool
+virNWFilterRulesDigestMatches(const char *ifname,
+                              const char *digest)
+{
+    VIR_LOCK_GUARD lock = virLockGuardLock(&ruleDigestsLock);
+
+    if (!ruleDigests)
+        return false;
+
+    return STREQ_NULLABLE(virHashLookup(ruleDigests, ifname), digest);
+}
+
+
+/* Remember @digest as the one of the rules applied to @ifname; NULL
+ * makes the next update rebuild the rules unconditionally */
+static void
+virNWFilterRulesDigestSet(const char *ifname,
+                          char *digest)
+{
+    VIR_LOCK_GUARD lock = virLockGuardLock(&ruleDigestsLock);
+
+    if (!digest) {
+        if (ruleDigests)
+            virHashRemoveEntry(ruleDigests, ifname);
+        return;
+    }
+
+    if (!ruleDigests)
+        ruleDigests = virHashNew(g_free);
+
+    ignore_value(virHashUpdateEntry(ruleDigests, ifname, digest));
+}
+
+
 static int
 virNWFilterDefToInst(virNWFilterDriverState *driver,
                      virNWFilterDef *def,
@@ -474,6 +558,7 @@ virNWFilterDoInstantiate(virNWFilterTechDriver *techdriver,
     const char *learning;
     bool reportIP = false;
     g_autoptr(GHashTable) missing_vars = virHashNew(virNWFilterVarValueHashFree);
+    g_autofree char *digest = NULL;
 
     memset(&inst, 0, sizeof(inst));
 
@@ -494,6 +579,10 @@ virNWFilterDoInstantiate(virNWFilterTechDriver *techdriver,
     if (learning == NULL)
         learning = NWFILTER_DFLT_LEARN;
 
+    /* the rules are replaced while the address is being learned */
+    if (virHashSize(missing_vars) > 0)
+        virNWFilterRulesDigestSet(binding->portdevname, NULL);
+
     if (virHashSize(missing_vars) == 1) {
         if (virHashLookup(missing_vars,
                           NWFILTER_STD_VAR_IP) != NULL) {
@@ -542,9 +631,22 @@ virNWFilterDoInstantiate(virNWFilterTechDriver *techdriver,
     if (rc < 0)
         goto error;
 
+    if (!(digest = virNWFilterInstDigest(&inst))) {
+        rc = -1;
+        goto error;
+    }
+
     switch (useNewFilter) {
     case INSTANTIATE_FOLLOW_NEWFILTER:
         instantiate = *foundNewFilter;
+        /* the filter changed, but not in a way affecting the rules of
+         * the interface, e.g. it was redefined with the same rules */
+        if (instantiate &&
+            virNWFilterRulesDigestMatches(binding->portdevname, digest)) {
+            VIR_DEBUG("Rules of %s are unchanged", binding->portdevname);
+            *foundNewFilter = false;
+            instantiate = false;
+        }
         break;
     case INSTANTIATE_ALWAYS:
         instantiate = true;
@@ -567,6 +669,9 @@ virNWFilterDoInstantiate(virNWFilterTechDriver *techdriver,
             rc = -1;
         }
 
+        virNWFilterRulesDigestSet(binding->portdevname,
+                                  rc == 0 ? g_steal_pointer(&digest) : NULL);
+
         virNWFilterUnlockIface(binding->portdevname);
     }
 
@@ -789,6 +894,9 @@ virNWFilterRollbackUpdateFilter(virNWFilterBindingDef *binding)
         return -1;
     }
 
+    /* the new rules are dropped again, so which ones remain is unknown */
+    virNWFilterRulesDigestSet(binding->portdevname, NULL);
+
     /* don't tear anything while the address is being learned */
     if (virNetDevGetIndex(binding->portdevname, &ifindex) < 0)
         virResetLastError();
@@ -849,6 +957,8 @@ _virNWFilterTeardownFilter(const char *ifname)
 
     techdriver->allTeardown(ifname);
 
+    virNWFilterRulesDigestSet(ifname, NULL);
+
     virNWFilterIPAddrMapDelIPAddr(ifname, NULL);
 
     virNWFilterUnlockIface(ifname);
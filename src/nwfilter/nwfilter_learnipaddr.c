@@ -51,12 +51,18 @@
 #include "nwfilter_learnipaddr.h"
 #include "virstring.h"
 #include "virsocket.h"
+#include "virutil.h"
+#include "virfile.h"
 
 #define VIR_FROM_THIS VIR_FROM_NWFILTER
 
 VIR_LOG_INIT("nwfilter.nwfilter_learnipaddr");
 
 #define PKT_TIMEOUT_MS 500 /* ms */
+/* packets are delivered immediately and the learning threads are woken up
+ * when they're asked to terminate, so this just caps the time a thread
+ * doesn't notice that something went wrong with the interface */
+#define LEARN_POLL_MAX_TIMEOUT_MS (10 * 1000) /* ms */
 
 /* structure of an ARP request/reply message */
 struct f_arphdr {
@@ -134,6 +140,7 @@ struct _virNWFilterIPAddrLearnReq {
 
     int status;
     volatile bool terminate;
+    int wakeupFD[2]; /* pipe to interrupt the learning thread's poll() */
 };
 
 
@@ -207,10 +214,25 @@ virNWFilterIPAddrLearnReqFree(virNWFilterIPAddrLearnReq *req)
 
     virNWFilterBindingDefFree(req->binding);
 
+    VIR_FORCE_CLOSE(req->wakeupFD[0]);
+    VIR_FORCE_CLOSE(req->wakeupFD[1]);
+
     g_free(req);
 }
 
 
+/* Interrupt the learning thread of @req so that it notices a request
+ * to terminate right away. Call with pendingLearnReqLock held. */
+static void
+virNWFilterIPAddrLearnReqWakeup(virNWFilterIPAddrLearnReq *req)
+{
+    char c = 0;
+
+    if (req->wakeupFD[1] >= 0)
+        ignore_value(safewrite(req->wakeupFD[1], &c, sizeof(c)));
+}
+
+
 #if WITH_LIBPCAP
 
 static int
@@ -253,6 +275,7 @@ virNWFilterTerminateLearnReq(const char *ifname)
         virNWFilterIPAddrLearnReq *req;
         if ((req = virHashLookup(pendingLearnReq, ifindex_str))) {
             req->terminate = true;
+            virNWFilterIPAddrLearnReqWakeup(req);
             return 0;
         }
     }
@@ -368,7 +391,7 @@ learnIPAddressThread(void *arg)
     bool showError = true;
     enum howDetect howDetected = 0;
     virNWFilterTechDriver *techdriver = req->techdriver;
-    struct pollfd fds[1];
+    struct pollfd fds[2];
 
     if (virNWFilterLockIface(req->binding->portdevname) < 0)
        goto err_no_lock;
@@ -382,7 +405,10 @@ learnIPAddressThread(void *arg)
         goto cleanup;
     }
 
-    handle = pcap_open_live(listen_if, BUFSIZ, 0, PKT_TIMEOUT_MS, errbuf);
+    /* In immediate mode, packets are handed out as they arrive rather
+     * than when the capture buffer fills up or its timeout expires, so
+     * there's no need to wake up periodically while nothing happens. */
+    handle = pcap_create(listen_if, errbuf);
 
     if (handle == NULL) {
         VIR_DEBUG("Couldn't open device %s: %s", listen_if, errbuf);
@@ -390,8 +416,20 @@ learnIPAddressThread(void *arg)
         goto cleanup;
     }
 
+    if (pcap_set_snaplen(handle, BUFSIZ) < 0 ||
+        pcap_set_timeout(handle, PKT_TIMEOUT_MS) < 0 ||
+        pcap_set_immediate_mode(handle, 1) < 0 ||
+        pcap_activate(handle) < 0) {
+        VIR_DEBUG("Couldn't activate device %s: %s",
+                  listen_if, pcap_geterr(handle));
+        req->status = ENODEV;
+        goto cleanup;
+    }
+
     fds[0].fd = pcap_fileno(handle);
     fds[0].events = POLLIN | POLLERR;
+    fds[1].fd = req->wakeupFD[0];
+    fds[1].events = POLLIN;
 
     virMacAddrFormat(&req->binding->mac, macaddr);
 
@@ -433,7 +471,17 @@ learnIPAddressThread(void *arg)
     pcap_freecode(&fp);
 
     while (req->status == 0 && vmaddr == 0) {
-        int n = poll(fds, G_N_ELEMENTS(fds), PKT_TIMEOUT_MS);
+        int n = poll(fds, G_N_ELEMENTS(fds), LEARN_POLL_MAX_TIMEOUT_MS);
+
+        if (n > 0 && fds[1].revents) {
+            char drain[16];
+
+            /* woken up to notice the termination request below */
+            while (saferead(req->wakeupFD[0], drain, sizeof(drain)) > 0)
+                ;
+            fds[1].revents = 0;
+            n--;
+        }
 
         if (threadsTerminate || req->terminate) {
             req->status = ECANCELED;
@@ -450,7 +498,7 @@ learnIPAddressThread(void *arg)
             break;
         }
 
-        if (n == 0)
+        if (n == 0 || !fds[0].revents)
             continue;
 
         if (fds[0].revents & (POLLHUP | POLLERR)) {
@@ -682,10 +730,14 @@ virNWFilterLearnIPAddress(virNWFilterTechDriver *techdriver,
     }
 
     req = g_new0(virNWFilterIPAddrLearnReq, 1);
+    req->wakeupFD[0] = req->wakeupFD[1] = -1;
 
     if (!(req->binding = virNWFilterBindingDefCopy(binding)))
         goto err_free_req;
 
+    if (virPipeNonBlock(req->wakeupFD) < 0)
+        goto err_free_req;
+
     req->ifindex = ifindex;
     req->driver = driver;
     req->howDetect = howDetect;
@@ -750,11 +802,25 @@ virNWFilterLearnInit(void)
 }
 
 
+static int
+virNWFilterLearnReqWakeupIter(void *payload,
+                              const char *name G_GNUC_UNUSED,
+                              void *opaque G_GNUC_UNUSED)
+{
+    virNWFilterIPAddrLearnReqWakeup(payload);
+    return 0;
+}
+
+
 void
 virNWFilterLearnThreadsTerminate(bool allowNewThreads)
 {
     threadsTerminate = true;
 
+    VIR_WITH_MUTEX_LOCK_GUARD(&pendingLearnReqLock) {
+        virHashForEach(pendingLearnReq, virNWFilterLearnReqWakeupIter, NULL);
+    }
+
     while (virHashSize(pendingLearnReq) != 0)
         g_usleep((PKT_TIMEOUT_MS * 1000) / 3);
 
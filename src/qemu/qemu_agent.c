@@ -41,6 +41,8 @@
 #include "virenum.h"
 #include "virsocket.h"
 #include "virutil.h"
+#include "virhash.h"
+#include "virbuffer.h"
 
 #define VIR_FROM_THIS VIR_FROM_QEMU
 
@@ -77,6 +79,29 @@ struct _qemuAgentMessage {
     /* id of the issued sync command */
     unsigned long long id;
     bool first;
+    /* number of replies expected for a batch of commands, which are
+     * collected in rxObjects instead of rxObject */
+    size_t nbatch;
+    virJSONValue **rxObjects;
+    size_t nrxObjects;
+};
+
+
+/* Replies of commands whose results rarely change are reused for the given
+ * number of seconds. The cache lives as long as the connection to the
+ * agent, which is reopened when the guest reboots. */
+static const struct {
+    const char *name;
+    unsigned int ttl;
+} qemuAgentCacheable[] = {
+    { "guest-get-osinfo", 600 },
+    { "guest-get-host-name", 60 },
+};
+
+typedef struct _qemuAgentCacheEntry qemuAgentCacheEntry;
+struct _qemuAgentCacheEntry {
+    virJSONValue *reply;
+    unsigned long long expires;
 };
 
 
@@ -118,6 +143,11 @@ struct _qemuAgent {
      * Take that as indication of successful completion */
     qemuAgentEvent await_event;
     int timeout;
+
+    /* Replies to commands sent ahead by qemuAgentPrefetch and cached
+     * replies, both by command name */
+    GHashTable *prefetched;
+    GHashTable *cache;
 };
 
 static virClass *qemuAgentClass;
@@ -147,6 +177,18 @@ static void qemuAgentDispose(void *obj)
     g_free(agent->buffer);
     g_main_context_unref(agent->context);
     virResetError(&agent->lastError);
+    g_clear_pointer(&agent->prefetched, g_hash_table_unref);
+    g_clear_pointer(&agent->cache, g_hash_table_unref);
+}
+
+
+static void
+qemuAgentCacheEntryFree(void *opaque)
+{
+    qemuAgentCacheEntry *entry = opaque;
+
+    virJSONValueFree(entry->reply);
+    g_free(entry);
 }
 
 static int
@@ -256,8 +298,13 @@ qemuAgentIOProcessLine(qemuAgent *agent,
                     return 0;
                 }
             }
-            msg->rxObject = g_steal_pointer(&obj);
-            msg->finished = true;
+            if (msg->nbatch > 0) {
+                VIR_APPEND_ELEMENT(msg->rxObjects, msg->nrxObjects, obj);
+                msg->finished = msg->nrxObjects == msg->nbatch;
+            } else {
+                msg->rxObject = g_steal_pointer(&obj);
+                msg->finished = true;
+            }
         } else {
             /* we are out of sync */
             VIR_DEBUG("Ignoring delayed reply");
@@ -617,6 +664,8 @@ qemuAgentOpen(virDomainObj *vm,
     agent->vm = virObjectRef(vm);
     agent->cb = cb;
     agent->singleSync = singleSync;
+    agent->prefetched = virHashNew(virJSONValueHashFree);
+    agent->cache = virHashNew(qemuAgentCacheEntryFree);
 
     if (config->type != VIR_DOMAIN_CHR_TYPE_UNIX) {
         virReportError(VIR_ERR_INTERNAL_ERROR,
@@ -1007,6 +1056,110 @@ qemuAgentCheckError(virJSONValue *cmd,
     return 0;
 }
 
+/*
+ * Returns the name of @cmd if it has no arguments, which makes its reply
+ * suitable for prefetching or caching, NULL otherwise.
+ */
+static const char *
+qemuAgentStorableCommandName(virJSONValue *cmd)
+{
+    if (virJSONValueObjectHasKey(cmd, "arguments"))
+        return NULL;
+
+    return virJSONValueObjectGetString(cmd, "execute");
+}
+
+
+static unsigned int
+qemuAgentCacheTTL(const char *name)
+{
+    size_t i;
+
+    for (i = 0; i < G_N_ELEMENTS(qemuAgentCacheable); i++) {
+        if (STREQ(qemuAgentCacheable[i].name, name))
+            return qemuAgentCacheable[i].ttl;
+    }
+
+    return 0;
+}
+
+
+static bool
+qemuAgentCacheLookup(qemuAgent *agent,
+                     const char *name,
+                     virJSONValue **reply)
+{
+    qemuAgentCacheEntry *entry;
+    unsigned long long now;
+
+    if (!(entry = virHashLookup(agent->cache, name)) ||
+        virTimeMillisNow(&now) < 0)
+        return false;
+
+    if (now >= entry->expires) {
+        virHashRemoveEntry(agent->cache, name);
+        return false;
+    }
+
+    if (reply)
+        *reply = virJSONValueCopy(entry->reply);
+    return true;
+}
+
+
+/* Caches successful replies of the commands in qemuAgentCacheable */
+static void
+qemuAgentCacheStore(qemuAgent *agent,
+                    virJSONValue *cmd,
+                    virJSONValue *reply)
+{
+    const char *name = qemuAgentStorableCommandName(cmd);
+    qemuAgentCacheEntry *entry;
+    unsigned long long now;
+    unsigned int ttl;
+
+    if (!name || !(ttl = qemuAgentCacheTTL(name)) ||
+        !virJSONValueObjectHasKey(reply, "return") ||
+        virTimeMillisNow(&now) < 0)
+        return;
+
+    entry = g_new0(qemuAgentCacheEntry, 1);
+    entry->reply = virJSONValueCopy(reply);
+    entry->expires = now + ttl * 1000ull;
+
+    g_hash_table_insert(agent->cache, g_strdup(name), entry);
+}
+
+
+/*
+ * Takes the prefetched or cached reply to @cmd, if any. Returns true if
+ * @reply was set.
+ */
+static bool
+qemuAgentTakeStoredReply(qemuAgent *agent,
+                         virJSONValue *cmd,
+                         virJSONValue **reply)
+{
+    const char *name = qemuAgentStorableCommandName(cmd);
+
+    if (!name)
+        return false;
+
+    if ((*reply = virHashSteal(agent->prefetched, name))) {
+        VIR_DEBUG("Using prefetched reply to '%s'", name);
+        qemuAgentCacheStore(agent, cmd, *reply);
+        return true;
+    }
+
+    if (qemuAgentCacheLookup(agent, name, reply)) {
+        VIR_DEBUG("Using cached reply to '%s'", name);
+        return true;
+    }
+
+    return false;
+}
+
+
 static int
 qemuAgentCommandFull(qemuAgent *agent,
                      virJSONValue *cmd,
@@ -1028,6 +1181,11 @@ qemuAgentCommandFull(qemuAgent *agent,
         goto cleanup;
     }
 
+    if (qemuAgentTakeStoredReply(agent, cmd, reply)) {
+        ret = qemuAgentCheckError(cmd, *reply, report_unsupported);
+        goto cleanup;
+    }
+
     if (qemuAgentGuestSync(agent) < 0)
         goto cleanup;
 
@@ -1065,6 +1223,9 @@ qemuAgentCommandFull(qemuAgent *agent,
     *reply = msg.rxObject;
     ret = qemuAgentCheckError(cmd, *reply, report_unsupported);
 
+    if (ret == 0)
+        qemuAgentCacheStore(agent, cmd, *reply);
+
  cleanup:
     VIR_FREE(msg.txBuffer);
     agent->await_event = QEMU_AGENT_EVENT_NONE;
@@ -1072,6 +1233,104 @@ qemuAgentCommandFull(qemuAgent *agent,
     return ret;
 }
 
+
+/**
+ * qemuAgentPrefetch:
+ * @agent: agent object
+ * @cmdnames: names of commands without arguments
+ * @ncmdnames: number of @cmdnames
+ *
+ * Sends the commands in @cmdnames whose replies aren't cached to the guest
+ * agent at once and keeps their replies for the next calls running them,
+ * so that all of them take a single round trip to the guest. The agent
+ * runs commands one after another and replies to them in order. Errors
+ * are not reported, the commands are simply sent again when they are run.
+ * The replies that weren't used must be dropped by qemuAgentPrefetchClear.
+ */
+void
+qemuAgentPrefetch(qemuAgent *agent,
+                  const char **cmdnames,
+                  size_t ncmdnames)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    g_autofree const char **sent = g_new0(const char *, ncmdnames);
+    size_t nsent = 0;
+    qemuAgentMessage msg = { 0 };
+    int seconds = agent->timeout;
+    virErrorPtr orig_err;
+    size_t i;
+
+    qemuAgentPrefetchClear(agent);
+
+    for (i = 0; i < ncmdnames; i++) {
+        if (qemuAgentCacheLookup(agent, cmdnames[i], NULL))
+            continue;
+
+        virBufferAsprintf(&buf, "{\"execute\":\"%s\"}" LINE_ENDING, cmdnames[i]);
+        sent[nsent++] = cmdnames[i];
+    }
+
+    if (nsent < 2 || !agent->running)
+        return;
+
+    virErrorPreserveLast(&orig_err);
+
+    if (qemuAgentGuestSync(agent) < 0)
+        goto cleanup;
+
+    msg.txBuffer = virBufferContentAndReset(&buf);
+    msg.txLength = strlen(msg.txBuffer);
+    msg.nbatch = nsent;
+
+    /* The timeout applies to the whole batch */
+    if (seconds == VIR_DOMAIN_QEMU_AGENT_COMMAND_DEFAULT)
+        seconds = QEMU_AGENT_WAIT_TIME;
+    if (seconds > 0)
+        seconds *= nsent;
+
+    VIR_DEBUG("Prefetching %zu commands, seconds = %d", nsent, seconds);
+
+    /* Replies received before a timeout are still good */
+    ignore_value(qemuAgentSend(agent, &msg, seconds));
+
+    for (i = 0; i < msg.nrxObjects; i++)
+        g_hash_table_insert(agent->prefetched, g_strdup(sent[i]),
+                            g_steal_pointer(&msg.rxObjects[i]));
+
+ cleanup:
+    g_free(msg.rxObjects);
+    g_free(msg.txBuffer);
+    agent->await_event = QEMU_AGENT_EVENT_NONE;
+    virErrorRestore(&orig_err);
+}
+
+
+/**
+ * qemuAgentPrefetchClear:
+ * @agent: agent object
+ *
+ * Drops the replies of qemuAgentPrefetch that weren't used.
+ */
+void
+qemuAgentPrefetchClear(qemuAgent *agent)
+{
+    g_hash_table_remove_all(agent->prefetched);
+}
+
+
+/**
+ * qemuAgentInvalidateCache:
+ * @agent: agent object
+ *
+ * Drops the cached replies of commands whose results rarely change, such
+ * as the OS info or host name of the guest.
+ */
+void
+qemuAgentInvalidateCache(qemuAgent *agent)
+{
+    g_hash_table_remove_all(agent->cache);
+}
+
 static int
 qemuAgentCommand(qemuAgent *agent,
                  virJSONValue *cmd,
@@ -1127,6 +1386,12 @@ void qemuAgentNotifyEvent(qemuAgent *agent,
     VIR_LOCK_GUARD lock = virObjectLockGuard(agent);
 
     VIR_DEBUG("agent=%p event=%d await_event=%d", agent, event, agent->await_event);
+
+    /* The guest OS might change across a reset or shutdown */
+    if (event == QEMU_AGENT_EVENT_RESET ||
+        event == QEMU_AGENT_EVENT_SHUTDOWN)
+        g_hash_table_remove_all(agent->cache);
+
     if (agent->await_event == event) {
         agent->await_event = QEMU_AGENT_EVENT_NONE;
         /* somebody waiting for this event, wake him up. */
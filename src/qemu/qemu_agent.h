@@ -45,6 +45,12 @@ void qemuAgentClose(qemuAgent *mon);
 
 void qemuAgentNotifyClose(qemuAgent *mon);
 
+void qemuAgentPrefetch(qemuAgent *mon,
+                       const char **cmdnames,
+                       size_t ncmdnames);
+void qemuAgentPrefetchClear(qemuAgent *mon);
+void qemuAgentInvalidateCache(qemuAgent *mon);
+
 typedef enum {
     QEMU_AGENT_EVENT_NONE = 0,
     QEMU_AGENT_EVENT_SHUTDOWN,
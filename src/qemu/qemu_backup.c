@@ -62,8 +62,11 @@ qemuDomainGetBackup(virDomainObj *vm)
 
 
 static int
-qemuBackupPrepare(virDomainBackupDef *def)
+qemuBackupPrepare(virDomainObj *vm,
+                  virDomainBackupDef *def)
 {
+    qemuDomainObjPrivate *priv = vm->privateData;
+    size_t i;
 
     if (def->type == VIR_DOMAIN_BACKUP_TYPE_PULL) {
         if (!def->server) {
@@ -97,6 +100,35 @@ qemuBackupPrepare(virDomainBackupDef *def)
                            _("unexpected transport in <domainbackup>"));
             return -1;
         }
+
+        /* both 'max-connections' of 'nbd-server-start' and 'iothread' of
+         * 'block-export-add' were introduced along with the latter */
+        if (def->maxConnections &&
+            !virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_BLOCK_EXPORT_ADD)) {
+            virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                           _("limiting NBD connections of a backup is not supported with this QEMU"));
+            return -1;
+        }
+
+        for (i = 0; i < def->ndisks; i++) {
+            virDomainBackupDiskDef *backupdisk = def->disks + i;
+
+            if (!backupdisk->exportiothread)
+                continue;
+
+            if (!virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_BLOCK_EXPORT_ADD)) {
+                virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                               _("iothread of a backup NBD export is not supported with this QEMU"));
+                return -1;
+            }
+
+            if (!virDomainIOThreadIDFind(vm->def, backupdisk->exportiothread)) {
+                virReportError(VIR_ERR_INVALID_ARG,
+                               _("iothread '%u' of NBD export of disk '%s' does not exist"),
+                               backupdisk->exportiothread, backupdisk->name);
+                return -1;
+            }
+        }
     }
 
     return 0;
@@ -537,15 +569,20 @@ qemuBackupBeginPullExportDisks(virDomainObj *vm,
 
     for (i = 0; i < ndisks; i++) {
         struct qemuBackupDiskData *dd = disks + i;
+        g_autofree char *iothread = NULL;
 
         if (!dd->backupdisk->exportname)
             dd->backupdisk->exportname = g_strdup(dd->domdisk->dst);
 
+        if (dd->backupdisk->exportiothread)
+            iothread = g_strdup_printf("iothread%u", dd->backupdisk->exportiothread);
+
         if (qemuBlockExportAddNBD(vm, NULL,
                                   dd->store,
                                   dd->backupdisk->exportname,
                                   false,
-                                  dd->incrementalBitmap) < 0)
+                                  dd->incrementalBitmap,
+                                  iothread) < 0)
             return -1;
     }
 
@@ -840,7 +877,7 @@ qemuBackupBegin(virDomainObj *vm,
         goto endjob;
     }
 
-    if (qemuBackupPrepare(def) < 0)
+    if (qemuBackupPrepare(vm, def) < 0)
         goto endjob;
 
     if (qemuBackupBeginPrepareTLS(vm, cfg, def, &tlsProps, &tlsSecretProps) < 0)
@@ -885,7 +922,8 @@ qemuBackupBegin(virDomainObj *vm,
             rc = qemuMonitorAddObject(priv->mon, &tlsProps, &tlsAlias);
 
         if (rc == 0) {
-            if ((rc = qemuMonitorNBDServerStart(priv->mon, priv->backup->server, tlsAlias)) == 0)
+            if ((rc = qemuMonitorNBDServerStart(priv->mon, priv->backup->server,
+                                                tlsAlias, priv->backup->maxConnections)) == 0)
                 nbd_running = true;
         }
     }
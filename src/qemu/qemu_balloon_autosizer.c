@@ -0,0 +1,423 @@
+/*
+ * qemu_balloon_autosizer.c: automatic sizing of memory balloons
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "qemu_balloon_autosizer.h"
+#define LIBVIRT_QEMU_BALLOON_AUTOSIZERPRIV_H_ALLOW
+#include "qemu_balloon_autosizerpriv.h"
+#include "qemu_domain.h"
+#include "qemu_periodic.h"
+
+#include "viralloc.h"
+#include "vircgroup.h"
+#include "virhostmem.h"
+#include "virlog.h"
+#include "viruuid.h"
+
+#define VIR_FROM_THIS VIR_FROM_QEMU
+
+VIR_LOG_INIT("qemu.qemu_balloon_autosizer");
+
+/* Interval in milliseconds between two passes of the balloon autosizer */
+#define QEMU_BALLOON_AUTOSIZER_INTERVAL 5000
+
+struct _qemuBalloonAutosizer {
+    virQEMUDriver *driver;
+    qemuPeriodic *worker;
+
+    /* The rest is accessed by the worker thread only */
+
+    /* domain UUID -> qemuBalloonAutosizerState */
+    GHashTable *domains;
+};
+
+
+/**
+ * qemuBalloonAutosizerDecide:
+ * @state: state of the domain
+ * @cur: current balloon size in KiB
+ * @min: lowest balloon size in KiB
+ * @max: highest balloon size in KiB
+ * @usable: memory the guest can use without swapping in KiB
+ * @hostShort: whether the host or the domain's cgroup is short of memory
+ * @hostFree: free host memory in KiB, ULLONG_MAX if unknown
+ *
+ * Returns the balloon size the domain should use next. The balloon is
+ * deflated at once, as far as the host has free memory, when the guest
+ * runs short of usable memory, and inflated by a quarter of the excess
+ * usable memory otherwise, or by all of it if @hostShort.
+ */
+unsigned long long
+qemuBalloonAutosizerDecide(qemuBalloonAutosizerState *state,
+                           unsigned long long cur,
+                           unsigned long long min,
+                           unsigned long long max,
+                           unsigned long long usable,
+                           bool hostShort,
+                           unsigned long long hostFree)
+{
+    unsigned long long headroom = cur * QEMU_BALLOON_AUTOSIZER_HEADROOM / 100;
+    unsigned long long excess = 0;
+    unsigned long long want = cur;
+
+    /* the stats may lag behind a shrinking balloon */
+    if (usable > headroom)
+        excess = MIN(usable - headroom, cur);
+
+    if (usable < headroom / 2) {
+        want = cur + MIN(headroom - usable, hostFree);
+        state->hold = QEMU_BALLOON_AUTOSIZER_HOLD;
+    } else if (usable > headroom * 2 && hostShort) {
+        want = cur - excess;
+    } else if (state->hold > 0) {
+        state->hold--;
+    } else if (usable > headroom * 2) {
+        want = cur - excess / 4;
+    }
+
+    want = MAX(MIN(want, max), min);
+
+    /* don't bother about small changes unless the bounds were violated */
+    if (cur >= min && cur <= max &&
+        (want > cur ? want - cur : cur - want) < QEMU_BALLOON_AUTOSIZER_MIN_STEP)
+        return cur;
+
+    return want;
+}
+
+
+static bool
+qemuBalloonAutosizerWants(virDomainObj *vm)
+{
+    return virDomainDefHasMemballoon(vm->def) && vm->def->memballoon->autosize;
+}
+
+
+/**
+ * qemuBalloonAutosizerDomain:
+ * @driver: qemu driver
+ * @autosizer: balloon autosizer
+ * @vm: locked domain object
+ * @hostFree: free host memory in KiB, 0 if unknown
+ * @hostTotal: host memory in KiB, 0 if unknown
+ *
+ * Samples the balloon stats of @vm with an autosized balloon and the
+ * memory pressure of its cgroup and updates its balloon size in qemu.
+ */
+static void
+qemuBalloonAutosizerDomain(virQEMUDriver *driver,
+                           qemuBalloonAutosizer *autosizer,
+                           virDomainObj *vm,
+                           unsigned long long hostFree,
+                           unsigned long long hostTotal)
+{
+    qemuDomainObjPrivate *priv = vm->privateData;
+    virDomainMemballoonDef *memballoon = vm->def->memballoon;
+    virDomainMemoryStatStruct stats[VIR_DOMAIN_MEMORY_STAT_NR];
+    qemuBalloonAutosizerState *state;
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
+    unsigned long long actual = 0;
+    unsigned long long usable = 0;
+    unsigned long long unused = 0;
+    unsigned long long lastUpdate = 0;
+    unsigned long long cur;
+    unsigned long long min;
+    unsigned long long max;
+    unsigned long long want;
+    bool hasUsable = false;
+    bool hasUnused = false;
+    bool hostShort = false;
+    int nstats;
+    size_t i;
+    int rc;
+
+    if (!qemuBalloonAutosizerWants(vm))
+        return;
+
+    /* don't wait for other jobs, a busy domain is sized in the next pass */
+    if (qemuDomainObjBeginJobNowait(driver, vm, VIR_JOB_MODIFY) < 0) {
+        virResetLastError();
+        return;
+    }
+
+    if (!virDomainObjIsActive(vm))
+        goto endjob;
+
+    qemuDomainObjEnterMonitor(driver, vm);
+    nstats = qemuMonitorGetMemoryStats(priv->mon, memballoon,
+                                       stats, VIR_DOMAIN_MEMORY_STAT_NR);
+    qemuDomainObjExitMonitor(vm);
+
+    if (nstats < 0 || !virDomainObjIsActive(vm)) {
+        virResetLastError();
+        goto endjob;
+    }
+
+    for (i = 0; i < nstats; i++) {
+        if (stats[i].tag == VIR_DOMAIN_MEMORY_STAT_ACTUAL_BALLOON) {
+            actual = stats[i].val;
+        } else if (stats[i].tag == VIR_DOMAIN_MEMORY_STAT_USABLE) {
+            usable = stats[i].val;
+            hasUsable = true;
+        } else if (stats[i].tag == VIR_DOMAIN_MEMORY_STAT_UNUSED) {
+            unused = stats[i].val;
+            hasUnused = true;
+        } else if (stats[i].tag == VIR_DOMAIN_MEMORY_STAT_LAST_UPDATE) {
+            lastUpdate = stats[i].val;
+        }
+    }
+
+    /* older guests don't report usable memory */
+    if (!hasUsable) {
+        if (!hasUnused)
+            goto endjob;
+        usable = unused;
+    }
+
+    virUUIDFormat(vm->def->uuid, uuidstr);
+
+    if (!(state = virHashLookup(autosizer->domains, uuidstr))) {
+        state = g_new0(qemuBalloonAutosizerState, 1);
+        if (virHashAddEntry(autosizer->domains, uuidstr, state) < 0) {
+            g_free(state);
+            virResetLastError();
+            goto endjob;
+        }
+    }
+
+    state->seen = true;
+
+    /* the guest didn't refresh its stats since the previous pass */
+    if (lastUpdate && lastUpdate == state->lastUpdate)
+        goto endjob;
+    state->lastUpdate = lastUpdate;
+
+    cur = actual ? actual : vm->def->mem.cur_balloon;
+
+    /* virtio-mem memory is not ballooned */
+    max = virDomainDefGetMemoryTotal(vm->def);
+    for (i = 0; i < vm->def->nmems; i++) {
+        if (vm->def->mems[i]->model == VIR_DOMAIN_MEMORY_MODEL_VIRTIO_MEM)
+            max -= vm->def->mems[i]->size;
+    }
+    if (memballoon->autosizeMax)
+        max = MIN(max, memballoon->autosizeMax);
+    min = MIN(memballoon->autosizeMin, max);
+
+    if (hostTotal && hostFree * 100 < hostTotal * QEMU_BALLOON_AUTOSIZER_HOST_LOW)
+        hostShort = true;
+
+    if (priv->cgroup) {
+        virCgroupPressure some;
+        virCgroupPressure full;
+        bool hasFull;
+
+        if (virCgroupGetPressure(priv->cgroup, VIR_CGROUP_PRESSURE_MEMORY,
+                                 &some, &full, &hasFull) < 0)
+            virResetLastError();
+        else if (some.avg10 >= QEMU_BALLOON_AUTOSIZER_PRESSURE)
+            hostShort = true;
+    }
+
+    want = qemuBalloonAutosizerDecide(state, cur, min, max, usable, hostShort,
+                                      hostTotal ? hostFree : ULLONG_MAX);
+
+    if (want == cur)
+        goto endjob;
+
+    VIR_DEBUG("setting balloon of domain %s to %llu KiB (usable %llu KiB)",
+              vm->def->name, want, usable);
+
+    qemuDomainObjEnterMonitor(driver, vm);
+    rc = qemuMonitorSetBalloon(priv->mon, want);
+    qemuDomainObjExitMonitor(vm);
+
+    if (rc < 0) {
+        VIR_WARN("Unable to set balloon of domain %s: %s",
+                 vm->def->name, virGetLastErrorMessage());
+        virResetLastError();
+    }
+
+ endjob:
+    qemuDomainObjEndJob(vm);
+}
+
+
+static int
+qemuBalloonAutosizerForget(const void *payload,
+                           const char *name G_GNUC_UNUSED,
+                           const void *opaque G_GNUC_UNUSED)
+{
+    const qemuBalloonAutosizerState *state = payload;
+
+    return !state->seen;
+}
+
+
+static int
+qemuBalloonAutosizerUnsee(void *payload,
+                          const char *name G_GNUC_UNUSED,
+                          void *opaque G_GNUC_UNUSED)
+{
+    qemuBalloonAutosizerState *state = payload;
+
+    state->seen = false;
+    return 0;
+}
+
+
+/**
+ * qemuBalloonAutosizerPass:
+ * @opaque: balloon autosizer
+ *
+ * Sizes the balloons of all running domains which ask for it.
+ */
+static void
+qemuBalloonAutosizerPass(void *opaque)
+{
+    qemuBalloonAutosizer *autosizer = opaque;
+    virQEMUDriver *driver = autosizer->driver;
+    virDomainObj **vms = NULL;
+    unsigned long long hostTotal = 0;
+    unsigned long long hostFree = 0;
+    size_t nvms;
+    size_t i;
+
+    /* nothing to size, don't bother looking at every domain */
+    if (g_atomic_int_get(&driver->nautosized) == 0) {
+        virHashRemoveAll(autosizer->domains);
+        return;
+    }
+
+    if (virDomainObjListCollect(driver->domains, NULL, &vms, &nvms,
+                                NULL, VIR_CONNECT_LIST_DOMAINS_ACTIVE) < 0) {
+        virResetLastError();
+        return;
+    }
+
+    /* in bytes */
+    if (virHostMemGetInfo(&hostTotal, &hostFree) < 0) {
+        virResetLastError();
+        hostTotal = 0;
+        hostFree = 0;
+    }
+
+    for (i = 0; i < nvms; i++) {
+        virObjectLock(vms[i]);
+        if (virDomainObjIsActive(vms[i]))
+            qemuBalloonAutosizerDomain(driver, autosizer, vms[i],
+                                       hostFree / 1024, hostTotal / 1024);
+        virObjectUnlock(vms[i]);
+    }
+
+    /* domains which are gone or were not sampled are dropped */
+    virHashRemoveSet(autosizer->domains, qemuBalloonAutosizerForget, NULL);
+    virHashForEach(autosizer->domains, qemuBalloonAutosizerUnsee, NULL);
+
+    virObjectListFreeCount(vms, nvms);
+}
+
+
+/**
+ * qemuBalloonAutosizerAddDomain:
+ * @driver: qemu driver
+ * @vm: domain object being started or reconnected to
+ *
+ * Counts @vm among the domains the autosizer looks at if its balloon is
+ * autosized. While no balloon is the passes of the autosizer are
+ * skipped.
+ */
+void
+qemuBalloonAutosizerAddDomain(virQEMUDriver *driver,
+                              virDomainObj *vm)
+{
+    qemuDomainObjPrivate *priv = vm->privateData;
+
+    if (priv->autosized || !qemuBalloonAutosizerWants(vm))
+        return;
+
+    priv->autosized = true;
+    g_atomic_int_inc(&driver->nautosized);
+}
+
+
+/**
+ * qemuBalloonAutosizerRemoveDomain:
+ * @driver: qemu driver
+ * @vm: domain object being stopped
+ *
+ * Undoes qemuBalloonAutosizerAddDomain.
+ */
+void
+qemuBalloonAutosizerRemoveDomain(virQEMUDriver *driver,
+                                 virDomainObj *vm)
+{
+    qemuDomainObjPrivate *priv = vm->privateData;
+
+    if (!priv->autosized)
+        return;
+
+    priv->autosized = false;
+    ignore_value(g_atomic_int_dec_and_test(&driver->nautosized));
+}
+
+
+void
+qemuBalloonAutosizerFree(qemuBalloonAutosizer *autosizer)
+{
+    if (!autosizer)
+        return;
+
+    /* stop the worker before freeing the state it uses */
+    qemuPeriodicFree(autosizer->worker);
+    g_clear_pointer(&autosizer->domains, g_hash_table_unref);
+    g_free(autosizer);
+}
+
+
+/**
+ * qemuBalloonAutosizerStart:
+ * @driver: qemu driver
+ *
+ * Starts the thread sizing the balloons of domains which ask for it by
+ * <autosize/> in their <memballoon>.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+qemuBalloonAutosizerStart(virQEMUDriver *driver)
+{
+    qemuBalloonAutosizer *autosizer = g_new0(qemuBalloonAutosizer, 1);
+
+    autosizer->driver = driver;
+    autosizer->domains = virHashNew(g_free);
+
+    if (!(autosizer->worker = qemuPeriodicNew("qemu-balloon",
+                                              _("balloon autosizer"),
+                                              QEMU_BALLOON_AUTOSIZER_INTERVAL,
+                                              qemuBalloonAutosizerPass,
+                                              autosizer))) {
+        qemuBalloonAutosizerFree(autosizer);
+        return -1;
+    }
+
+    driver->balloonAutosizer = autosizer;
+
+    return 0;
+}
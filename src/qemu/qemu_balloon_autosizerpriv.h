@@ -0,0 +1,60 @@
+/*
+ * qemu_balloon_autosizerpriv.h: private declarations for the balloon
+ *                               autosizer
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBVIRT_QEMU_BALLOON_AUTOSIZERPRIV_H_ALLOW
+# error "qemu_balloon_autosizerpriv.h may only be included by qemu_balloon_autosizer.c or test suites"
+#endif /* LIBVIRT_QEMU_BALLOON_AUTOSIZERPRIV_H_ALLOW */
+
+#pragma once
+
+#include "qemu_balloon_autosizer.h"
+
+/* Usable guest memory in percent of the balloon size the autosizer aims
+ * for. The balloon is deflated below half of it and inflated above twice
+ * of it. */
+#define QEMU_BALLOON_AUTOSIZER_HEADROOM 20
+
+/* Share of free host memory in percent below which the host is short of
+ * memory, and the memory stall of the domain's cgroup in percent above
+ * which the domain is, so that excess guest memory is reclaimed at once */
+#define QEMU_BALLOON_AUTOSIZER_HOST_LOW 5
+#define QEMU_BALLOON_AUTOSIZER_PRESSURE 10.0
+
+/* Number of passes a deflated balloon isn't inflated again unless the
+ * host is short of memory */
+#define QEMU_BALLOON_AUTOSIZER_HOLD 12
+
+/* Balloon changes smaller than this in KiB are not worth doing */
+#define QEMU_BALLOON_AUTOSIZER_MIN_STEP (16 * 1024)
+
+typedef struct _qemuBalloonAutosizerState qemuBalloonAutosizerState;
+struct _qemuBalloonAutosizerState {
+    unsigned long long lastUpdate; /* guest timestamp of the used stats */
+    unsigned int hold;
+    bool seen;
+};
+
+unsigned long long
+qemuBalloonAutosizerDecide(qemuBalloonAutosizerState *state,
+                           unsigned long long cur,
+                           unsigned long long min,
+                           unsigned long long max,
+                           unsigned long long usable,
+                           bool hostShort,
+                           unsigned long long hostFree);
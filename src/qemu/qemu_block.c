@@ -24,6 +24,7 @@
 #include "qemu_alias.h"
 #include "qemu_security.h"
 
+#include "driver.h"
 #include "storage_source.h"
 #include "viralloc.h"
 #include "virstoragefile.h"
@@ -1698,89 +1699,78 @@ qemuBlockStorageSourceAttachPrepareBlockdev(virStorageSource *src,
 }
 
 
-static int
-qemuBlockStorageSourceAttachApplyStorageDeps(qemuMonitor *mon,
-                                             qemuBlockStorageSourceAttachData *data)
+static void
+qemuBlockStorageSourceAttachBatchAdd(qemuMonitorBlockdevAddBatchEntry **batch,
+                                     size_t *nbatch,
+                                     virJSONValue **props,
+                                     char **objalias,
+                                     bool *added)
 {
-    if (data->prmgrProps &&
-        qemuMonitorAddObject(mon, &data->prmgrProps, &data->prmgrAlias) < 0)
-        return -1;
-
-    if (data->authsecretProps &&
-        qemuMonitorAddObject(mon, &data->authsecretProps,
-                             &data->authsecretAlias) < 0)
-        return -1;
-
-    if (data->httpcookiesecretProps &&
-        qemuMonitorAddObject(mon, &data->httpcookiesecretProps,
-                             &data->httpcookiesecretAlias) < 0)
-        return -1;
-
-    if (data->tlsKeySecretProps &&
-        qemuMonitorAddObject(mon, &data->tlsKeySecretProps,
-                             &data->tlsKeySecretAlias) < 0)
-        return -1;
+    qemuMonitorBlockdevAddBatchEntry entry = { props, objalias, added };
 
-    if (data->tlsProps &&
-        qemuMonitorAddObject(mon, &data->tlsProps, &data->tlsAlias) < 0)
-        return -1;
+    if (!*props)
+        return;
 
-    return 0;
+    VIR_APPEND_ELEMENT(*batch, *nbatch, entry);
 }
 
 
-static int
-qemuBlockStorageSourceAttachApplyStorage(qemuMonitor *mon,
-                                         qemuBlockStorageSourceAttachData *data)
+/**
+ * qemuBlockStorageSourceAttachPrepareBatch:
+ * @data: structure holding data of block device to apply
+ * @batch: array of objects and block nodes to add, extended
+ * @nbatch: number of elements of @batch
+ *
+ * Appends all objects and block nodes of @data to @batch in the order they
+ * depend on each other, so that qemuMonitorBlockdevAddBatch can add them.
+ */
+static void
+qemuBlockStorageSourceAttachPrepareBatch(qemuBlockStorageSourceAttachData *data,
+                                         qemuMonitorBlockdevAddBatchEntry **batch,
+                                         size_t *nbatch)
 {
-    if (data->storageProps) {
-        if (qemuMonitorBlockdevAdd(mon, &data->storageProps) < 0)
-            return -1;
-
-        data->storageAttached = true;
-    }
-
-    return 0;
-}
+    /* storage dependencies */
+    qemuBlockStorageSourceAttachBatchAdd(batch, nbatch, &data->prmgrProps,
+                                         &data->prmgrAlias, NULL);
+    qemuBlockStorageSourceAttachBatchAdd(batch, nbatch, &data->authsecretProps,
+                                         &data->authsecretAlias, NULL);
+    qemuBlockStorageSourceAttachBatchAdd(batch, nbatch, &data->httpcookiesecretProps,
+                                         &data->httpcookiesecretAlias, NULL);
+    qemuBlockStorageSourceAttachBatchAdd(batch, nbatch, &data->tlsKeySecretProps,
+                                         &data->tlsKeySecretAlias, NULL);
+    qemuBlockStorageSourceAttachBatchAdd(batch, nbatch, &data->tlsProps,
+                                         &data->tlsAlias, NULL);
 
+    qemuBlockStorageSourceAttachBatchAdd(batch, nbatch, &data->storageProps,
+                                         NULL, &data->storageAttached);
+    qemuBlockStorageSourceAttachBatchAdd(batch, nbatch, &data->storageSliceProps,
+                                         NULL, &data->storageSliceAttached);
 
-static int
-qemuBlockStorageSourceAttachApplyFormatDeps(qemuMonitor *mon,
-                                            qemuBlockStorageSourceAttachData *data)
-{
-    if (data->encryptsecretProps &&
-        qemuMonitorAddObject(mon, &data->encryptsecretProps,
-                             &data->encryptsecretAlias) < 0)
-        return -1;
+    /* format dependencies */
+    qemuBlockStorageSourceAttachBatchAdd(batch, nbatch, &data->encryptsecretProps,
+                                         &data->encryptsecretAlias, NULL);
 
-    return 0;
+    qemuBlockStorageSourceAttachBatchAdd(batch, nbatch, &data->formatProps,
+                                         NULL, &data->formatAttached);
 }
 
 
 static int
-qemuBlockStorageSourceAttachApplyFormat(qemuMonitor *mon,
-                                        qemuBlockStorageSourceAttachData *data)
+qemuBlockStorageSourceAttachApplyFrontend(qemuMonitor *mon,
+                                          qemuBlockStorageSourceAttachData *data)
 {
-    if (data->formatProps) {
-        if (qemuMonitorBlockdevAdd(mon, &data->formatProps) < 0)
+    if (data->driveCmd) {
+        if (qemuMonitorAddDrive(mon, data->driveCmd) < 0)
             return -1;
 
-        data->formatAttached = true;
+        data->driveAdded = true;
     }
 
-    return 0;
-}
-
-
-static int
-qemuBlockStorageSourceAttachApplyStorageSlice(qemuMonitor *mon,
-                                              qemuBlockStorageSourceAttachData *data)
-{
-    if (data->storageSliceProps) {
-        if (qemuMonitorBlockdevAdd(mon, &data->storageSliceProps) < 0)
+    if (data->chardevDef) {
+        if (qemuMonitorAttachCharDev(mon, data->chardevAlias, data->chardevDef) < 0)
             return -1;
 
-        data->storageSliceAttached = true;
+        data->chardevAdded = true;
     }
 
     return 0;
@@ -1804,28 +1794,15 @@ int
 qemuBlockStorageSourceAttachApply(qemuMonitor *mon,
                                   qemuBlockStorageSourceAttachData *data)
 {
-    if (qemuBlockStorageSourceAttachApplyStorageDeps(mon, data) < 0 ||
-        qemuBlockStorageSourceAttachApplyStorage(mon, data) < 0 ||
-        qemuBlockStorageSourceAttachApplyStorageSlice(mon, data) < 0 ||
-        qemuBlockStorageSourceAttachApplyFormatDeps(mon, data) < 0 ||
-        qemuBlockStorageSourceAttachApplyFormat(mon, data) < 0)
-        return -1;
-
-    if (data->driveCmd) {
-        if (qemuMonitorAddDrive(mon, data->driveCmd) < 0)
-            return -1;
-
-        data->driveAdded = true;
-    }
+    g_autofree qemuMonitorBlockdevAddBatchEntry *batch = NULL;
+    size_t nbatch = 0;
 
-    if (data->chardevDef) {
-        if (qemuMonitorAttachCharDev(mon, data->chardevAlias, data->chardevDef) < 0)
-            return -1;
+    qemuBlockStorageSourceAttachPrepareBatch(data, &batch, &nbatch);
 
-        data->chardevAdded = true;
-    }
+    if (qemuMonitorBlockdevAddBatch(mon, batch, nbatch) < 0)
+        return -1;
 
-    return 0;
+    return qemuBlockStorageSourceAttachApplyFrontend(mon, data);
 }
 
 
@@ -2061,15 +2038,25 @@ int
 qemuBlockStorageSourceChainAttach(qemuMonitor *mon,
                                   qemuBlockStorageSourceChainData *data)
 {
+    g_autofree qemuMonitorBlockdevAddBatchEntry *batch = NULL;
+    size_t nbatch = 0;
     size_t i;
 
-    for (i = data->nsrcdata; i > 0; i--) {
-        if (qemuBlockStorageSourceAttachApply(mon, data->srcdata[i - 1]) < 0)
-            return -1;
-    }
+    /* all nodes of the chain are added in one go to avoid a round trip to
+     * the monitor per node, starting from the bottom of the chain */
+    for (i = data->nsrcdata; i > 0; i--)
+        qemuBlockStorageSourceAttachPrepareBatch(data->srcdata[i - 1],
+                                                 &batch, &nbatch);
 
-    if (data->copyOnReadProps) {
-        if (qemuMonitorBlockdevAdd(mon, &data->copyOnReadProps) < 0)
+    if (data->copyOnReadProps)
+        qemuBlockStorageSourceAttachBatchAdd(&batch, &nbatch,
+                                             &data->copyOnReadProps, NULL, NULL);
+
+    if (qemuMonitorBlockdevAddBatch(mon, batch, nbatch) < 0)
+        return -1;
+
+    for (i = data->nsrcdata; i > 0; i--) {
+        if (qemuBlockStorageSourceAttachApplyFrontend(mon, data->srcdata[i - 1]) < 0)
             return -1;
     }
 
@@ -2682,210 +2669,256 @@ qemuBlockStorageSourceCreateGetStorageProps(virStorageSource *src,
 }
 
 
+/*
+ * Runs blockdev-create jobs for all @create with non-NULL @props at once and
+ * waits until all of them finish, so that creating the images of many disks
+ * takes about as long as the slowest of them. Consumes @props.
+ */
 static int
 qemuBlockStorageSourceCreateGeneric(virDomainObj *vm,
-                                    virJSONValue *createProps,
-                                    virStorageSource *src,
-                                    virStorageSource *chain,
+                                    qemuBlockStorageSourceCreateData *create,
+                                    virJSONValue **props,
+                                    size_t ncreate,
                                     bool storageCreate,
                                     virDomainAsyncJob asyncJob)
 {
-    g_autoptr(virJSONValue) props = createProps;
     qemuDomainObjPrivate *priv = vm->privateData;
-    qemuBlockJobData *job = NULL;
+    g_autofree qemuBlockJobData **jobs = g_new0(qemuBlockJobData *, ncreate);
+    bool running = true;
     int ret = -1;
+    size_t i;
     int rc;
 
-    if (!(job = qemuBlockJobNewCreate(vm, src, chain, storageCreate)))
-        return -1;
+    for (i = 0; i < ncreate; i++) {
+        if (!props[i])
+            continue;
 
-    qemuBlockJobSyncBegin(job);
+        if (!(jobs[i] = qemuBlockJobNewCreate(vm, create[i].src, create[i].chain,
+                                              storageCreate)))
+            goto cleanup;
 
-    if (qemuDomainObjEnterMonitorAsync(priv->driver, vm, asyncJob) < 0)
-        goto cleanup;
+        qemuBlockJobSyncBegin(jobs[i]);
 
-    rc = qemuMonitorBlockdevCreate(priv->mon, job->name, &props);
+        if (qemuDomainObjEnterMonitorAsync(priv->driver, vm, asyncJob) < 0)
+            goto cleanup;
 
-    qemuDomainObjExitMonitor(vm);
-    if (rc < 0)
-        goto cleanup;
+        rc = qemuMonitorBlockdevCreate(priv->mon, jobs[i]->name, &props[i]);
+
+        qemuDomainObjExitMonitor(vm);
+        if (rc < 0)
+            goto cleanup;
 
-    qemuBlockJobStarted(job, vm);
+        qemuBlockJobStarted(jobs[i], vm);
+    }
+
+    while (true) {
+        running = false;
+
+        for (i = 0; i < ncreate; i++) {
+            if (!jobs[i])
+                continue;
+
+            qemuBlockJobUpdate(vm, jobs[i], asyncJob);
+            if (qemuBlockJobIsRunning(jobs[i]))
+                running = true;
+        }
+
+        if (!running)
+            break;
 
-    qemuBlockJobUpdate(vm, job, asyncJob);
-    while (qemuBlockJobIsRunning(job))  {
         if (virDomainObjWait(vm) < 0)
             goto cleanup;
-        qemuBlockJobUpdate(vm, job, asyncJob);
     }
 
-    if (job->state == QEMU_BLOCKJOB_STATE_FAILED ||
-        job->state == QEMU_BLOCKJOB_STATE_CANCELLED) {
-        if (job->state == QEMU_BLOCKJOB_STATE_CANCELLED && !job->errmsg) {
-            virReportError(VIR_ERR_OPERATION_FAILED, "%s",
-                           _("blockdev-create job was cancelled"));
-        } else {
-            virReportError(VIR_ERR_OPERATION_FAILED,
-                           _("failed to format image: '%s'"), NULLSTR(job->errmsg));
+    for (i = 0; i < ncreate; i++) {
+        qemuBlockJobData *job = jobs[i];
+
+        if (!job)
+            continue;
+
+        if (job->state == QEMU_BLOCKJOB_STATE_FAILED ||
+            job->state == QEMU_BLOCKJOB_STATE_CANCELLED) {
+            if (job->state == QEMU_BLOCKJOB_STATE_CANCELLED && !job->errmsg) {
+                virReportError(VIR_ERR_OPERATION_FAILED, "%s",
+                               _("blockdev-create job was cancelled"));
+            } else {
+                virReportError(VIR_ERR_OPERATION_FAILED,
+                               _("failed to format image: '%s'"), NULLSTR(job->errmsg));
+            }
+            goto cleanup;
         }
-        goto cleanup;
     }
 
     ret = 0;
 
  cleanup:
-    qemuBlockJobStartupFinalize(vm, job);
+    for (i = 0; i < ncreate; i++) {
+        if (jobs[i])
+            qemuBlockJobStartupFinalize(vm, jobs[i]);
+        g_clear_pointer(&props[i], virJSONValueFree);
+    }
     return ret;
 }
 
 
 static int
 qemuBlockStorageSourceCreateStorage(virDomainObj *vm,
-                                    virStorageSource *src,
-                                    virStorageSource *chain,
+                                    qemuBlockStorageSourceCreateData *create,
+                                    size_t ncreate,
                                     virDomainAsyncJob asyncJob)
 {
-    virStorageType actualType = virStorageSourceGetActualType(src);
-    g_autoptr(virJSONValue) createstorageprops = NULL;
-    int ret;
-
-    /* We create local files directly to be able to apply security labels
-     * properly. This is enough for formats which store the capacity of the image
-     * in the metadata as they will grow. We must create a correctly sized
-     * image for 'raw' and 'luks' though as the image size influences the
-     * capacity.
-     */
-    if (actualType != VIR_STORAGE_TYPE_NETWORK &&
-        !(actualType == VIR_STORAGE_TYPE_FILE && src->format == VIR_STORAGE_FILE_RAW))
-        return 0;
+    g_autofree virJSONValue **createstorageprops = g_new0(virJSONValue *, ncreate);
+    size_t i;
 
-    if (qemuBlockStorageSourceCreateGetStorageProps(src, &createstorageprops) < 0)
-        return -1;
+    for (i = 0; i < ncreate; i++) {
+        virStorageSource *src = create[i].src;
+        virStorageType actualType = virStorageSourceGetActualType(src);
+
+        /* We create local files directly to be able to apply security labels
+         * properly. This is enough for formats which store the capacity of the image
+         * in the metadata as they will grow. We must create a correctly sized
+         * image for 'raw' and 'luks' though as the image size influences the
+         * capacity.
+         */
+        if (actualType != VIR_STORAGE_TYPE_NETWORK &&
+            !(actualType == VIR_STORAGE_TYPE_FILE && src->format == VIR_STORAGE_FILE_RAW))
+            continue;
 
-    if (!createstorageprops) {
-        /* we can always try opening it to see whether it was existing */
-        return 0;
+        /* without props we can always try opening it to see whether it
+         * was existing */
+        if (qemuBlockStorageSourceCreateGetStorageProps(src, &createstorageprops[i]) < 0)
+            goto error;
     }
 
-    ret = qemuBlockStorageSourceCreateGeneric(vm, createstorageprops, src, chain,
-                                              true, asyncJob);
-    createstorageprops = NULL;
+    return qemuBlockStorageSourceCreateGeneric(vm, create, createstorageprops,
+                                               ncreate, true, asyncJob);
 
-    return ret;
+ error:
+    for (i = 0; i < ncreate; i++)
+        virJSONValueFree(createstorageprops[i]);
+    return -1;
 }
 
 
 static int
 qemuBlockStorageSourceCreateFormat(virDomainObj *vm,
-                                   virStorageSource *src,
-                                   virStorageSource *backingStore,
-                                   virStorageSource *chain,
+                                   qemuBlockStorageSourceCreateData *create,
+                                   size_t ncreate,
                                    virDomainAsyncJob asyncJob)
 {
-    g_autoptr(virJSONValue) createformatprops = NULL;
-    int ret;
+    g_autofree virJSONValue **createformatprops = g_new0(virJSONValue *, ncreate);
+    size_t i;
 
-    if (src->format == VIR_STORAGE_FILE_RAW &&
-        !src->encryption)
-        return 0;
+    for (i = 0; i < ncreate; i++) {
+        virStorageSource *src = create[i].src;
 
-    if (qemuBlockStorageSourceCreateGetFormatProps(src, backingStore,
-                                                   &createformatprops) < 0)
-        return -1;
+        if (src->format == VIR_STORAGE_FILE_RAW &&
+            !src->encryption)
+            continue;
 
-    if (!createformatprops) {
-        virReportError(VIR_ERR_OPERATION_UNSUPPORTED,
-                       _("can't create storage format '%s'"),
-                       virStorageFileFormatTypeToString(src->format));
-        return -1;
+        if (qemuBlockStorageSourceCreateGetFormatProps(src, create[i].backingStore,
+                                                       &createformatprops[i]) < 0)
+            goto error;
+
+        if (!createformatprops[i]) {
+            virReportError(VIR_ERR_OPERATION_UNSUPPORTED,
+                           _("can't create storage format '%s'"),
+                           virStorageFileFormatTypeToString(src->format));
+            goto error;
+        }
     }
 
-    ret = qemuBlockStorageSourceCreateGeneric(vm, createformatprops, src, chain,
-                                              false, asyncJob);
-    createformatprops = NULL;
+    return qemuBlockStorageSourceCreateGeneric(vm, create, createformatprops,
+                                               ncreate, false, asyncJob);
 
-    return ret;
+ error:
+    for (i = 0; i < ncreate; i++)
+        virJSONValueFree(createformatprops[i]);
+    return -1;
 }
 
 
 /**
- * qemuBlockStorageSourceCreate:
+ * qemuBlockStorageSourceCreateMultiple:
  * @vm: domain object
- * @src: storage source definition to create
- * @backingStore: backingStore of the new image (used only in image metadata)
- * @chain: backing chain to unplug in case of a long-running job failure
- * @data: qemuBlockStorageSourceAttachData for @src so that it can be attached
+ * @create: storage sources to create along with their attachment data
+ * @ncreate: number of elements in @create
  * @asyncJob: qemu asynchronous job type
  *
- * Creates and formats a storage volume according to @src and attaches it to @vm.
- * @data must provide attachment data as if @src was existing. @src is attached
- * after successful return of this function. If libvirtd is restarted during
- * the create job @chain is unplugged, otherwise it's left for the caller.
- * If @backingStore is provided, the new image will refer to it as its backing
- * store.
+ * Same as qemuBlockStorageSourceCreate for each of @create, except that the
+ * blockdev-create jobs for all of them run at the same time. If creating any
+ * of them fails, all of them are unplugged again.
  */
 int
-qemuBlockStorageSourceCreate(virDomainObj *vm,
-                             virStorageSource *src,
-                             virStorageSource *backingStore,
-                             virStorageSource *chain,
-                             qemuBlockStorageSourceAttachData *data,
-                             virDomainAsyncJob asyncJob)
+qemuBlockStorageSourceCreateMultiple(virDomainObj *vm,
+                                     qemuBlockStorageSourceCreateData *create,
+                                     size_t ncreate,
+                                     virDomainAsyncJob asyncJob)
 {
     qemuDomainObjPrivate *priv = vm->privateData;
     int ret = -1;
-    int rc;
+    int rc = 0;
+    size_t i;
 
-    if (src->sliceStorage) {
-        virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
-                       _("creation of images with slice type='storage' is not supported"));
-        return -1;
+    for (i = 0; i < ncreate; i++) {
+        if (create[i].src->sliceStorage) {
+            virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                           _("creation of images with slice type='storage' is not supported"));
+            return -1;
+        }
     }
 
     /* grant write access to read-only images during formatting */
-    if (src->readonly &&
-        qemuDomainStorageSourceAccessAllow(priv->driver, vm, src, false,
-                                           false, true) < 0)
-        return -1;
+    for (i = 0; i < ncreate; i++) {
+        if (create[i].src->readonly &&
+            qemuDomainStorageSourceAccessAllow(priv->driver, vm, create[i].src,
+                                               false, false, true) < 0)
+            goto cleanup;
+    }
 
     if (qemuDomainObjEnterMonitorAsync(priv->driver, vm, asyncJob) < 0)
         goto cleanup;
 
-    rc = qemuBlockStorageSourceAttachApplyStorageDeps(priv->mon, data);
+    for (i = 0; i < ncreate && rc == 0; i++)
+        rc = qemuBlockStorageSourceAttachApplyStorageDeps(priv->mon, create[i].data);
 
     qemuDomainObjExitMonitor(vm);
     if (rc < 0)
         goto cleanup;
 
-    if (qemuBlockStorageSourceCreateStorage(vm, src, chain, asyncJob) < 0)
+    if (qemuBlockStorageSourceCreateStorage(vm, create, ncreate, asyncJob) < 0)
         goto cleanup;
 
     if (qemuDomainObjEnterMonitorAsync(priv->driver, vm, asyncJob) < 0)
         goto cleanup;
 
-    rc = qemuBlockStorageSourceAttachApplyStorage(priv->mon, data);
+    for (i = 0; i < ncreate && rc == 0; i++) {
+        rc = qemuBlockStorageSourceAttachApplyStorage(priv->mon, create[i].data);
 
-    if (rc == 0)
-        rc = qemuBlockStorageSourceAttachApplyFormatDeps(priv->mon, data);
+        if (rc == 0)
+            rc = qemuBlockStorageSourceAttachApplyFormatDeps(priv->mon, create[i].data);
+    }
 
     qemuDomainObjExitMonitor(vm);
     if (rc < 0)
         goto cleanup;
 
-    if (qemuBlockStorageSourceCreateFormat(vm, src, backingStore, chain,
-                                           asyncJob) < 0)
+    if (qemuBlockStorageSourceCreateFormat(vm, create, ncreate, asyncJob) < 0)
         goto cleanup;
 
     /* revoke write access to read-only images during formatting */
-    if (src->readonly &&
-        qemuDomainStorageSourceAccessAllow(priv->driver, vm, src, true,
-                                           false, true) < 0)
-        goto cleanup;
+    for (i = 0; i < ncreate; i++) {
+        if (create[i].src->readonly &&
+            qemuDomainStorageSourceAccessAllow(priv->driver, vm, create[i].src,
+                                               true, false, true) < 0)
+            goto cleanup;
+    }
 
     if (qemuDomainObjEnterMonitorAsync(priv->driver, vm, asyncJob) < 0)
         goto cleanup;
 
-    rc = qemuBlockStorageSourceAttachApplyFormat(priv->mon, data);
+    for (i = 0; i < ncreate && rc == 0; i++)
+        rc = qemuBlockStorageSourceAttachApplyFormat(priv->mon, create[i].data);
 
     qemuDomainObjExitMonitor(vm);
     if (rc < 0)
@@ -2898,7 +2931,8 @@ qemuBlockStorageSourceCreate(virDomainObj *vm,
         virDomainObjIsActive(vm) &&
         qemuDomainObjEnterMonitorAsync(priv->driver, vm, asyncJob) == 0) {
 
-        qemuBlockStorageSourceAttachRollback(priv->mon, data);
+        for (i = 0; i < ncreate; i++)
+            qemuBlockStorageSourceAttachRollback(priv->mon, create[i].data);
         qemuDomainObjExitMonitor(vm);
     }
 
@@ -2906,6 +2940,41 @@ qemuBlockStorageSourceCreate(virDomainObj *vm,
 }
 
 
+/**
+ * qemuBlockStorageSourceCreate:
+ * @vm: domain object
+ * @src: storage source definition to create
+ * @backingStore: backingStore of the new image (used only in image metadata)
+ * @chain: backing chain to unplug in case of a long-running job failure
+ * @data: qemuBlockStorageSourceAttachData for @src so that it can be attached
+ * @asyncJob: qemu asynchronous job type
+ *
+ * Creates and formats a storage volume according to @src and attaches it to @vm.
+ * @data must provide attachment data as if @src was existing. @src is attached
+ * after successful return of this function. If libvirtd is restarted during
+ * the create job @chain is unplugged, otherwise it's left for the caller.
+ * If @backingStore is provided, the new image will refer to it as its backing
+ * store.
+ */
+int
+qemuBlockStorageSourceCreate(virDomainObj *vm,
+                             virStorageSource *src,
+                             virStorageSource *backingStore,
+                             virStorageSource *chain,
+                             qemuBlockStorageSourceAttachData *data,
+                             virDomainAsyncJob asyncJob)
+{
+    qemuBlockStorageSourceCreateData create = {
+        .src = src,
+        .backingStore = backingStore,
+        .chain = chain,
+        .data = data,
+    };
+
+    return qemuBlockStorageSourceCreateMultiple(vm, &create, 1, asyncJob);
+}
+
+
 /**
  * qemuBlockStorageSourceCreateDetectSize:
  * @blockNamedNodeData: hash table filled with qemuBlockNamedNodeData
@@ -2994,21 +3063,12 @@ qemuBlockNamedNodeDataGetBitmapByName(GHashTable *blockNamedNodeData,
                                       const char *bitmap)
 {
     qemuBlockNamedNodeData *nodedata;
-    size_t i;
 
-    if (!(nodedata = virHashLookup(blockNamedNodeData, src->nodeformat)))
+    if (!(nodedata = virHashLookup(blockNamedNodeData, src->nodeformat)) ||
+        !nodedata->bitmapsByName)
         return NULL;
 
-    for (i = 0; i < nodedata->nbitmaps; i++) {
-        qemuBlockNamedNodeDataBitmap *bitmapdata = nodedata->bitmaps[i];
-
-        if (STRNEQ(bitmapdata->name, bitmap))
-            continue;
-
-        return bitmapdata;
-    }
-
-    return NULL;
+    return g_hash_table_lookup(nodedata->bitmapsByName, bitmap);
 }
 
 
@@ -3053,20 +3113,28 @@ qemuBlockGetBitmapMergeActionsGetBitmaps(virStorageSource *topsrc,
 {
     g_autoptr(GSList) ret = NULL;
     qemuBlockNamedNodeData *entry;
+    qemuBlockNamedNodeDataBitmap *bitmap;
     size_t i;
 
     /* for now it doesn't make sense to consider bitmaps which are not present
      * in @topsrc as we can't recreate a bitmap for a layer if it's missing */
 
+    /* a single bitmap is looked up directly rather than by checking all
+     * bitmaps of @topsrc, which with long checkpoint chains are many */
+    if (bitmapname) {
+        if (!(bitmap = qemuBlockNamedNodeDataGetBitmapByName(blockNamedNodeData,
+                                                             topsrc, bitmapname)) ||
+            !qemuBlockBitmapChainIsValid(topsrc, bitmapname, blockNamedNodeData))
+            return NULL;
+
+        return g_slist_prepend(NULL, bitmap->name);
+    }
+
     if (!(entry = virHashLookup(blockNamedNodeData, topsrc->nodeformat)))
         return NULL;
 
     for (i = 0; i < entry->nbitmaps; i++) {
-        qemuBlockNamedNodeDataBitmap *bitmap = entry->bitmaps[i];
-
-        if (bitmapname &&
-            STRNEQ(bitmapname, bitmap->name))
-            continue;
+        bitmap = entry->bitmaps[i];
 
         if (!qemuBlockBitmapChainIsValid(topsrc, bitmap->name, blockNamedNodeData))
             continue;
@@ -3545,7 +3613,8 @@ virJSONValue *
 qemuBlockExportGetNBDProps(const char *nodename,
                            const char *exportname,
                            bool writable,
-                           const char **bitmaps)
+                           const char **bitmaps,
+                           const char *iothread)
 {
     g_autofree char *exportid = NULL;
     g_autoptr(virJSONValue) bitmapsarr = NULL;
@@ -3569,6 +3638,7 @@ qemuBlockExportGetNBDProps(const char *nodename,
                               "b:writable", writable,
                               "s:name", exportname,
                               "A:bitmaps", &bitmapsarr,
+                              "S:iothread", iothread,
                               NULL) < 0)
         return NULL;
 
@@ -3584,6 +3654,7 @@ qemuBlockExportGetNBDProps(const char *nodename,
  * @exportname: name for the export
  * @writable: whether the NBD export allows writes
  * @bitmap: (optional) block dirty bitmap to export along
+ * @iothread: (optional) alias of the iothread which should serve the export
  *
  * This function automatically selects the proper invocation of exporting a
  * block backend via NBD in qemu. This includes use of nodename for blockdev
@@ -3597,7 +3668,8 @@ qemuBlockExportAddNBD(virDomainObj *vm,
                       virStorageSource *src,
                       const char *exportname,
                       bool writable,
-                      const char *bitmap)
+                      const char *bitmap,
+                      const char *iothread)
 {
     qemuDomainObjPrivate *priv = vm->privateData;
     g_autoptr(virJSONValue) nbdprops = NULL;
@@ -3613,8 +3685,142 @@ qemuBlockExportAddNBD(virDomainObj *vm,
                                        exportname, writable, bitmap);
 
     if (!(nbdprops = qemuBlockExportGetNBDProps(src->nodeformat, exportname,
-                                                writable, bitmaps)))
+                                                writable, bitmaps, iothread)))
         return -1;
 
     return qemuMonitorBlockExportAdd(priv->mon, &nbdprops);
 }
+
+
+static bool
+qemuBlockAutoExtendApplies(virDomainDiskDef *disk)
+{
+    /* only the volume itself is extended, which an overlay created e.g. by
+     * an external snapshot replaces as the top image */
+    return disk->autoextend &&
+           disk->src->type == VIR_STORAGE_TYPE_VOLUME &&
+           disk->src->srcpool &&
+           disk->src->nodestorage;
+}
+
+
+static int
+qemuBlockAutoExtendSetThreshold(virDomainObj *vm,
+                                virDomainDiskDef *disk,
+                                unsigned long long capacity,
+                                virDomainAsyncJob asyncJob)
+{
+    qemuDomainObjPrivate *priv = vm->privateData;
+    virDomainDiskAutoExtendDef *autoextend = disk->autoextend;
+    unsigned long long threshold = 1;
+    int rc;
+
+    if (autoextend->max && capacity >= autoextend->max) {
+        VIR_DEBUG("volume of disk '%s' reached its maximum size", disk->dst);
+        return 0;
+    }
+
+    /* with less free space than the threshold extend on the next write */
+    if (capacity > autoextend->threshold)
+        threshold = capacity - autoextend->threshold;
+
+    if (qemuDomainObjEnterMonitorAsync(priv->driver, vm, asyncJob) < 0)
+        return -1;
+
+    rc = qemuMonitorSetBlockThreshold(priv->mon, disk->src->nodestorage, threshold);
+
+    qemuDomainObjExitMonitor(vm);
+    return rc;
+}
+
+
+/**
+ * qemuBlockAutoExtendArm:
+ * @vm: domain object
+ * @disk: disk definition
+ * @blockNamedNodeData: hash table filled with qemuBlockNamedNodeData
+ * @asyncJob: qemu asynchronous job type
+ *
+ * Registers the write threshold of the volume backing @disk according to its
+ * <autoextend> policy so that qemuBlockAutoExtend is called once the guest
+ * writes close to the end of the volume. Disks without the policy or whose
+ * top image is no longer the volume are ignored.
+ */
+int
+qemuBlockAutoExtendArm(virDomainObj *vm,
+                       virDomainDiskDef *disk,
+                       GHashTable *blockNamedNodeData,
+                       virDomainAsyncJob asyncJob)
+{
+    qemuBlockNamedNodeData *entry;
+
+    if (!qemuBlockAutoExtendApplies(disk))
+        return 0;
+
+    if (!(entry = virHashLookup(blockNamedNodeData, disk->src->nodestorage))) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("failed to find data for block node '%s'"),
+                       disk->src->nodestorage);
+        return -1;
+    }
+
+    return qemuBlockAutoExtendSetThreshold(vm, disk, entry->capacity, asyncJob);
+}
+
+
+/**
+ * qemuBlockAutoExtend:
+ * @vm: domain object
+ * @disk: disk definition
+ *
+ * Extends the volume backing @disk by the step of its <autoextend> policy
+ * using the storage driver and registers the write threshold for the new
+ * size. QEMU notices the new size of the storage on its own, so that the
+ * image doesn't need to be resized. The caller must hold a modify job.
+ */
+int
+qemuBlockAutoExtend(virDomainObj *vm,
+                    virDomainDiskDef *disk)
+{
+    virDomainDiskAutoExtendDef *autoextend = disk->autoextend;
+    g_autofree char *poolname = NULL;
+    g_autofree char *volname = NULL;
+    g_autoptr(virConnect) conn = NULL;
+    g_autoptr(virStoragePool) pool = NULL;
+    g_autoptr(virStorageVol) vol = NULL;
+    virStorageVolInfo info;
+    unsigned long long capacity = 0;
+    int rc = -1;
+
+    if (!qemuBlockAutoExtendApplies(disk))
+        return 0;
+
+    poolname = g_strdup(disk->src->srcpool->pool);
+    volname = g_strdup(disk->src->srcpool->volume);
+
+    /* the storage driver may live in a different daemon */
+    qemuDomainObjEnterRemote(vm);
+
+    if ((conn = virGetConnectStorage()) &&
+        (pool = virStoragePoolLookupByName(conn, poolname)) &&
+        (vol = virStorageVolLookupByName(pool, volname)) &&
+        virStorageVolGetInfo(vol, &info) == 0) {
+        capacity = info.capacity + autoextend->step;
+
+        if (autoextend->max && capacity > autoextend->max)
+            capacity = autoextend->max;
+
+        if (capacity > info.capacity)
+            rc = virStorageVolResize(vol, capacity, VIR_STORAGE_VOL_RESIZE_ALLOCATE);
+        else
+            rc = 0;
+    }
+
+    if (qemuDomainObjExitRemote(vm, true) < 0 || rc < 0)
+        return -1;
+
+    VIR_DEBUG("volume '%s' of disk '%s' extended to '%llu'",
+              volname, disk->dst, capacity);
+
+    return qemuBlockAutoExtendSetThreshold(vm, disk, capacity, VIR_ASYNC_JOB_NONE);
+}
@@ -207,6 +207,20 @@ qemuBlockStorageSourceCreateGetStorageProps(virStorageSource *src,
                                             virJSONValue **props)
     ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2) G_GNUC_WARN_UNUSED_RESULT;
 
+typedef struct _qemuBlockStorageSourceCreateData qemuBlockStorageSourceCreateData;
+struct _qemuBlockStorageSourceCreateData {
+    virStorageSource *src;
+    virStorageSource *backingStore;
+    virStorageSource *chain;
+    qemuBlockStorageSourceAttachData *data;
+};
+
+int
+qemuBlockStorageSourceCreateMultiple(virDomainObj *vm,
+                                     qemuBlockStorageSourceCreateData *create,
+                                     size_t ncreate,
+                                     virDomainAsyncJob asyncJob);
+
 int
 qemuBlockStorageSourceCreate(virDomainObj *vm,
                              virStorageSource *src,
@@ -293,7 +307,8 @@ virJSONValue *
 qemuBlockExportGetNBDProps(const char *nodename,
                            const char *exportname,
                            bool writable,
-                           const char **bitmaps);
+                           const char **bitmaps,
+                           const char *iothread);
 
 
 int
@@ -302,4 +317,15 @@ qemuBlockExportAddNBD(virDomainObj *vm,
                       virStorageSource *src,
                       const char *exportname,
                       bool writable,
-                      const char *bitmap);
+                      const char *bitmap,
+                      const char *iothread);
+
+int
+qemuBlockAutoExtendArm(virDomainObj *vm,
+                       virDomainDiskDef *disk,
+                       GHashTable *blockNamedNodeData,
+                       virDomainAsyncJob asyncJob);
+
+int
+qemuBlockAutoExtend(virDomainObj *vm,
+                    virDomainDiskDef *disk);
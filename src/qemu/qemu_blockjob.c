@@ -1812,6 +1812,40 @@ qemuBlockJobSyncEnd(virDomainObj *vm,
 }
 
 
+/**
+ * qemuBlockJobSyncWait:
+ * @vm: domain
+ * @job: synchronous block job data
+ * @asyncJob: current qemu asynchronous job type
+ *
+ * Waits until an event changing the state of the synchronous block @job is
+ * delivered and processes it. The domain condition is signalled by events of
+ * all block jobs and also by unrelated events, thus the wait is resumed until
+ * the event of @job actually arrived, which avoids re-checking the job every
+ * time the condition is signalled.
+ *
+ * Returns 0 on success, -1 if the domain is no longer running or waiting
+ * failed.
+ */
+int
+qemuBlockJobSyncWait(virDomainObj *vm,
+                     qemuBlockJobData *job,
+                     int asyncJob)
+{
+    int state = job->state;
+
+    /* the state can also be changed by the event thread if the event was
+     * dispatched there before the job was made synchronous */
+    while (job->newstate == -1 && job->state == state) {
+        if (virDomainObjWait(vm) < 0)
+            return -1;
+    }
+
+    qemuBlockJobUpdate(vm, job, asyncJob);
+    return 0;
+}
+
+
 qemuBlockJobData *
 qemuBlockJobGetByDisk(virDomainDiskDef *disk)
 {
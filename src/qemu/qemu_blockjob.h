@@ -137,6 +137,9 @@ struct _qemuBlockJobData {
 
     int brokentype; /* the previous type of a broken blockjob qemuBlockJobType */
 
+    unsigned long long bandwidth; /* bytes/s requested by the user, 0 if unlimited */
+    unsigned long long speed; /* bytes/s set by the block job governor, 0 if none */
+
     bool invalidData; /* the job data (except name) is not valid */
     bool reconnected; /* internal field for tracking whether job is live after reconnect to qemu */
 };
@@ -226,6 +229,9 @@ void qemuBlockJobSyncBegin(qemuBlockJobData *job);
 void qemuBlockJobSyncEnd(virDomainObj *vm,
                          qemuBlockJobData *job,
                          int asyncJob);
+int qemuBlockJobSyncWait(virDomainObj *vm,
+                         qemuBlockJobData *job,
+                         int asyncJob);
 
 qemuBlockJobData *
 qemuBlockJobGetByDisk(virDomainDiskDef *disk)
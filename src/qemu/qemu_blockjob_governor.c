@@ -0,0 +1,509 @@
+/*
+ * qemu_blockjob_governor.c: sharing of bandwidth between block jobs
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "qemu_blockjob_governor.h"
+#define LIBVIRT_QEMU_BLOCKJOB_GOVERNORPRIV_H_ALLOW
+#include "qemu_blockjob_governorpriv.h"
+#include "qemu_blockjob.h"
+#include "qemu_domain.h"
+#include "qemu_periodic.h"
+
+#include "viralloc.h"
+#include "virlog.h"
+#include "viruuid.h"
+
+#define VIR_FROM_THIS VIR_FROM_QEMU
+
+VIR_LOG_INIT("qemu.qemu_blockjob_governor");
+
+/* Interval in milliseconds between two adjustments of the bandwidth of block
+ * jobs by the block job governor */
+#define QEMU_BLOCK_JOB_GOVERNOR_INTERVAL 5000
+
+struct _qemuBlockJobGovernor {
+    virQEMUDriver *driver;
+    qemuPeriodic *worker;
+
+    /* The rest is accessed by the worker thread only */
+
+    unsigned long long limit; /* upper bound of @budget in bytes/s */
+    unsigned long long latencyTarget; /* in nanoseconds, 0 if not adapting */
+    unsigned long long budget; /* bytes/s shared by all governed jobs */
+
+    /* domain UUID -> qemuBlockJobGovernorSample taken in the previous pass */
+    GHashTable *samples;
+};
+
+
+static bool
+qemuBlockJobGovernorWants(qemuBlockJobData *job)
+{
+    switch ((qemuBlockJobType) job->type) {
+    case QEMU_BLOCKJOB_TYPE_PULL:
+    case QEMU_BLOCKJOB_TYPE_COPY:
+    case QEMU_BLOCKJOB_TYPE_COMMIT:
+    case QEMU_BLOCKJOB_TYPE_ACTIVE_COMMIT:
+        break;
+
+    case QEMU_BLOCKJOB_TYPE_NONE:
+    case QEMU_BLOCKJOB_TYPE_BACKUP:
+    case QEMU_BLOCKJOB_TYPE_INTERNAL:
+    case QEMU_BLOCKJOB_TYPE_CREATE:
+    case QEMU_BLOCKJOB_TYPE_BROKEN:
+    case QEMU_BLOCKJOB_TYPE_LAST:
+        return false;
+    }
+
+    /* synchronous jobs are the storage mirrors of migrations, which have
+     * their own bandwidth limits */
+    return !job->synchronous;
+}
+
+
+static int
+qemuBlockJobGovernorCountIterator(void *payload,
+                                  const char *name G_GNUC_UNUSED,
+                                  void *opaque)
+{
+    qemuBlockJobData *job = payload;
+    size_t *njobs = opaque;
+
+    if (qemuBlockJobGovernorWants(job) &&
+        job->state == QEMU_BLOCKJOB_STATE_RUNNING)
+        (*njobs)++;
+
+    return 0;
+}
+
+
+static int
+qemuBlockJobGovernorPendingIterator(void *payload,
+                                    const char *name G_GNUC_UNUSED,
+                                    void *opaque)
+{
+    qemuBlockJobData *job = payload;
+    bool *pending = opaque;
+
+    if (qemuBlockJobGovernorWants(job) &&
+        (job->state == QEMU_BLOCKJOB_STATE_RUNNING || job->speed))
+        *pending = true;
+
+    return 0;
+}
+
+
+/**
+ * qemuBlockJobGovernorCongested:
+ * @prev: sample taken in the previous pass
+ * @cur: sample taken now
+ * @latencyTarget: latency target in nanoseconds
+ *
+ * Returns true if the average latency of the guest I/O requests completed
+ * between @prev and @cur exceeds @latencyTarget.
+ */
+bool
+qemuBlockJobGovernorCongested(const qemuBlockJobGovernorSample *prev,
+                              const qemuBlockJobGovernorSample *cur,
+                              unsigned long long latencyTarget)
+{
+    /* counters going backwards were reset by a disk hot-unplug */
+    if (cur->ops <= prev->ops || cur->time < prev->time)
+        return false;
+
+    return (cur->time - prev->time) / (cur->ops - prev->ops) > latencyTarget;
+}
+
+
+/**
+ * qemuBlockJobGovernorAdjustBudget:
+ * @budget: bandwidth budget in bytes/s used in the previous pass
+ * @limit: upper bound of the budget in bytes/s
+ * @njobs: number of running governed jobs
+ * @congested: whether the guest I/O latency of any domain exceeds the target
+ *
+ * The budget is halved on congestion, but never below what gives each job
+ * the minimum speed, and raised by a tenth of @limit otherwise.
+ *
+ * Returns the budget to use in this pass.
+ */
+unsigned long long
+qemuBlockJobGovernorAdjustBudget(unsigned long long budget,
+                                 unsigned long long limit,
+                                 size_t njobs,
+                                 bool congested)
+{
+    unsigned long long minBudget;
+
+    if (njobs == 0)
+        return limit;
+
+    minBudget = MIN(QEMU_BLOCK_JOB_GOVERNOR_MIN_SPEED * njobs, limit);
+
+    if (congested)
+        return MAX(budget / 2, minBudget);
+
+    return MIN(budget + limit / 10, limit);
+}
+
+
+/**
+ * qemuBlockJobGovernorShare:
+ * @budget: bandwidth budget in bytes/s
+ * @njobs: number of running governed jobs
+ *
+ * Returns the bandwidth in bytes/s given to each running job.
+ */
+unsigned long long
+qemuBlockJobGovernorShare(unsigned long long budget,
+                          size_t njobs)
+{
+    return MAX(budget / MAX(njobs, 1), QEMU_BLOCK_JOB_GOVERNOR_MIN_SPEED);
+}
+
+
+/**
+ * qemuBlockJobGovernorGatherStats:
+ * @driver: qemu driver
+ * @vm: locked domain object with a job
+ * @sample: filled with the totals of all disks
+ *
+ * Returns 0 on success, -1 on error.
+ */
+static int
+qemuBlockJobGovernorGatherStats(virQEMUDriver *driver,
+                                virDomainObj *vm,
+                                qemuBlockJobGovernorSample *sample)
+{
+    qemuDomainObjPrivate *priv = vm->privateData;
+    bool blockdev = virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_BLOCKDEV);
+    g_autoptr(GHashTable) blockstats = NULL;
+    size_t i;
+    int rc;
+
+    qemuDomainObjEnterMonitor(driver, vm);
+    rc = qemuMonitorGetAllBlockStatsInfo(priv->mon, &blockstats);
+    qemuDomainObjExitMonitor(vm);
+
+    if (rc < 0)
+        return -1;
+
+    sample->ops = 0;
+    sample->time = 0;
+
+    for (i = 0; i < vm->def->ndisks; i++) {
+        virDomainDiskDef *disk = vm->def->disks[i];
+        const char *entryname = disk->info.alias;
+        qemuBlockStats *stats;
+
+        if (virStorageSourceGetActualType(disk->src) == VIR_STORAGE_TYPE_VHOST_USER)
+            continue;
+
+        if (blockdev && QEMU_DOMAIN_DISK_PRIVATE(disk)->qomName)
+            entryname = QEMU_DOMAIN_DISK_PRIVATE(disk)->qomName;
+
+        if (!entryname || !(stats = virHashLookup(blockstats, entryname)))
+            continue;
+
+        sample->ops += stats->rd_req + stats->wr_req + stats->flush_req;
+        sample->time += stats->rd_total_times + stats->wr_total_times +
+                        stats->flush_total_times;
+    }
+
+    return 0;
+}
+
+
+/**
+ * qemuBlockJobGovernorSampleLatency:
+ * @gov: block job governor
+ * @vm: locked domain object
+ * @sampled: set of UUIDs of sampled domains, filled
+ *
+ * Samples the guest disk I/O statistics of @vm. Returns true if the average
+ * latency of the requests the guest completed since the previous sample
+ * exceeds the latency target.
+ */
+static bool
+qemuBlockJobGovernorSampleLatency(qemuBlockJobGovernor *gov,
+                                  virDomainObj *vm,
+                                  GHashTable *sampled)
+{
+    qemuBlockJobGovernorSample cur;
+    qemuBlockJobGovernorSample *sample;
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
+    bool congested = false;
+    int rc = -1;
+
+    /* don't wait for other jobs, a busy domain is sampled in the next pass */
+    if (qemuDomainObjBeginJobNowait(gov->driver, vm, VIR_JOB_QUERY) < 0) {
+        virResetLastError();
+        return false;
+    }
+
+    if (virDomainObjIsActive(vm))
+        rc = qemuBlockJobGovernorGatherStats(gov->driver, vm, &cur);
+
+    qemuDomainObjEndJob(vm);
+
+    if (rc < 0) {
+        virResetLastError();
+        return false;
+    }
+
+    virUUIDFormat(vm->def->uuid, uuidstr);
+    ignore_value(virHashAddEntry(sampled, uuidstr, vm));
+
+    if ((sample = virHashLookup(gov->samples, uuidstr))) {
+        if (qemuBlockJobGovernorCongested(sample, &cur, gov->latencyTarget)) {
+            VIR_DEBUG("guest I/O latency of domain %s above target",
+                      vm->def->name);
+            congested = true;
+        }
+    } else {
+        sample = g_new0(qemuBlockJobGovernorSample, 1);
+        if (virHashAddEntry(gov->samples, uuidstr, sample) < 0) {
+            g_free(sample);
+            virResetLastError();
+            return false;
+        }
+    }
+
+    *sample = cur;
+
+    return congested;
+}
+
+
+static int
+qemuBlockJobGovernorForget(const void *payload G_GNUC_UNUSED,
+                           const char *name,
+                           const void *opaque)
+{
+    GHashTable *sampled = (GHashTable *) opaque;
+
+    return !virHashHasEntry(sampled, name);
+}
+
+
+/**
+ * qemuBlockJobGovernorApply:
+ * @driver: qemu driver
+ * @vm: locked domain object
+ * @share: bandwidth in bytes/s given to each running job
+ *
+ * Sets the speed of the governed jobs of @vm which are copying data to @share
+ * or the bandwidth requested by the user if that is lower. Jobs which are no
+ * longer copying get the bandwidth requested by the user back.
+ */
+static void
+qemuBlockJobGovernorApply(virQEMUDriver *driver,
+                          virDomainObj *vm,
+                          unsigned long long share)
+{
+    qemuDomainObjPrivate *priv = vm->privateData;
+    g_autofree virHashKeyValuePair *items = NULL;
+    bool pending = false;
+    size_t i;
+
+    virHashForEach(priv->blockjobs, qemuBlockJobGovernorPendingIterator, &pending);
+    if (!pending)
+        return;
+
+    if (qemuDomainObjBeginJobNowait(driver, vm, VIR_JOB_MODIFY) < 0) {
+        virResetLastError();
+        return;
+    }
+
+    if (!virDomainObjIsActive(vm))
+        goto endjob;
+
+    if (!(items = virHashGetItems(priv->blockjobs, NULL, false)))
+        goto endjob;
+
+    for (i = 0; items[i].key; i++) {
+        /* the domain is unlocked while talking to the monitor */
+        g_autoptr(qemuBlockJobData) job = virObjectRef((void *) items[i].value);
+        unsigned long long speed;
+        int rc;
+
+        if (!qemuBlockJobGovernorWants(job))
+            continue;
+
+        if (job->state == QEMU_BLOCKJOB_STATE_RUNNING) {
+            speed = share;
+            if (job->bandwidth && job->bandwidth < speed)
+                speed = job->bandwidth;
+        } else if (job->speed) {
+            speed = job->bandwidth;
+        } else {
+            continue;
+        }
+
+        if (speed == job->speed) {
+            if (job->state != QEMU_BLOCKJOB_STATE_RUNNING)
+                job->speed = 0;
+            continue;
+        }
+
+        VIR_DEBUG("setting speed of block job '%s' of domain %s to %llu",
+                  job->name, vm->def->name, speed);
+
+        qemuDomainObjEnterMonitor(driver, vm);
+        rc = qemuMonitorBlockJobSetSpeed(priv->mon, job->name, speed);
+        qemuDomainObjExitMonitor(vm);
+
+        if (rc < 0) {
+            VIR_WARN("Unable to set speed of block job '%s' of domain %s: %s",
+                     job->name, vm->def->name, virGetLastErrorMessage());
+            virResetLastError();
+            continue;
+        }
+
+        if (job->state == QEMU_BLOCKJOB_STATE_RUNNING)
+            job->speed = speed;
+        else
+            job->speed = 0;
+    }
+
+ endjob:
+    qemuDomainObjEndJob(vm);
+}
+
+
+/**
+ * qemuBlockJobGovernorPass:
+ * @opaque: block job governor
+ *
+ * Splits the bandwidth budget between the running block jobs of all domains.
+ */
+static void
+qemuBlockJobGovernorPass(void *opaque)
+{
+    qemuBlockJobGovernor *gov = opaque;
+    virQEMUDriver *driver = gov->driver;
+    g_autoptr(GHashTable) sampled = virHashNew(NULL);
+    virDomainObj **vms = NULL;
+    size_t nvms;
+    size_t njobs = 0;
+    bool congested = false;
+    unsigned long long share;
+    size_t i;
+
+    if (virDomainObjListCollect(driver->domains, NULL, &vms, &nvms,
+                                NULL, VIR_CONNECT_LIST_DOMAINS_ACTIVE) < 0) {
+        virResetLastError();
+        return;
+    }
+
+    for (i = 0; i < nvms; i++) {
+        virDomainObj *vm = vms[i];
+        qemuDomainObjPrivate *priv = vm->privateData;
+
+        virObjectLock(vm);
+        if (virDomainObjIsActive(vm))
+            virHashForEach(priv->blockjobs,
+                           qemuBlockJobGovernorCountIterator, &njobs);
+        virObjectUnlock(vm);
+    }
+
+    if (njobs > 0 && gov->latencyTarget > 0) {
+        for (i = 0; i < nvms; i++) {
+            virObjectLock(vms[i]);
+            if (virDomainObjIsActive(vms[i]) &&
+                qemuBlockJobGovernorSampleLatency(gov, vms[i], sampled))
+                congested = true;
+            virObjectUnlock(vms[i]);
+        }
+    }
+
+    /* samples of domains which are gone or were not sampled are stale */
+    virHashRemoveSet(gov->samples, qemuBlockJobGovernorForget, sampled);
+
+    gov->budget = qemuBlockJobGovernorAdjustBudget(gov->budget, gov->limit,
+                                                   njobs, congested);
+    share = qemuBlockJobGovernorShare(gov->budget, njobs);
+
+    VIR_DEBUG("governing %zu block jobs, budget %llu, share %llu%s",
+              njobs, gov->budget, share, congested ? ", congested" : "");
+
+    /* jobs which stopped copying still need their bandwidth restored even if
+     * no job is running anymore */
+    for (i = 0; i < nvms; i++) {
+        virObjectLock(vms[i]);
+        if (virDomainObjIsActive(vms[i]))
+            qemuBlockJobGovernorApply(driver, vms[i], share);
+        virObjectUnlock(vms[i]);
+    }
+
+    virObjectListFreeCount(vms, nvms);
+}
+
+
+void
+qemuBlockJobGovernorFree(qemuBlockJobGovernor *gov)
+{
+    if (!gov)
+        return;
+
+    /* stop the worker before freeing the state it uses */
+    qemuPeriodicFree(gov->worker);
+    g_clear_pointer(&gov->samples, g_hash_table_unref);
+    g_free(gov);
+}
+
+
+/**
+ * qemuBlockJobGovernorStart:
+ * @driver: qemu driver
+ * @cfg: driver configuration
+ *
+ * Starts the thread adjusting the bandwidth of block jobs of all domains if
+ * the 'block_job_bandwidth_limit' option is set.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+qemuBlockJobGovernorStart(virQEMUDriver *driver,
+                          virQEMUDriverConfig *cfg)
+{
+    qemuBlockJobGovernor *gov;
+
+    if (cfg->blockJobBandwidthLimit == 0)
+        return 0;
+
+    gov = g_new0(qemuBlockJobGovernor, 1);
+    gov->driver = driver;
+    gov->limit = (unsigned long long) cfg->blockJobBandwidthLimit << 20;
+    gov->latencyTarget = cfg->blockJobLatencyTarget * 1000ULL * 1000ULL;
+    gov->budget = gov->limit;
+    gov->samples = virHashNew(g_free);
+
+    if (!(gov->worker = qemuPeriodicNew("qemu-blockjob-gov",
+                                        _("block job governor"),
+                                        QEMU_BLOCK_JOB_GOVERNOR_INTERVAL,
+                                        qemuBlockJobGovernorPass, gov))) {
+        qemuBlockJobGovernorFree(gov);
+        return -1;
+    }
+
+    driver->blockJobGovernor = gov;
+
+    return 0;
+}
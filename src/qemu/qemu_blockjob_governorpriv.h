@@ -0,0 +1,50 @@
+/*
+ * qemu_blockjob_governorpriv.h: private declarations for the block job
+ *                               governor
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBVIRT_QEMU_BLOCKJOB_GOVERNORPRIV_H_ALLOW
+# error "qemu_blockjob_governorpriv.h may only be included by qemu_blockjob_governor.c or test suites"
+#endif /* LIBVIRT_QEMU_BLOCKJOB_GOVERNORPRIV_H_ALLOW */
+
+#pragma once
+
+#include "qemu_blockjob_governor.h"
+
+/* Minimum bandwidth in bytes/s given to a single governed block job */
+#define QEMU_BLOCK_JOB_GOVERNOR_MIN_SPEED (1ULL << 20)
+
+typedef struct _qemuBlockJobGovernorSample qemuBlockJobGovernorSample;
+struct _qemuBlockJobGovernorSample {
+    unsigned long long ops; /* guest I/O requests completed so far */
+    unsigned long long time; /* time spent on them in nanoseconds */
+};
+
+bool
+qemuBlockJobGovernorCongested(const qemuBlockJobGovernorSample *prev,
+                              const qemuBlockJobGovernorSample *cur,
+                              unsigned long long latencyTarget);
+
+unsigned long long
+qemuBlockJobGovernorAdjustBudget(unsigned long long budget,
+                                 unsigned long long limit,
+                                 size_t njobs,
+                                 bool congested);
+
+unsigned long long
+qemuBlockJobGovernorShare(unsigned long long budget,
+                          size_t njobs);
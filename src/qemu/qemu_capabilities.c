@@ -676,6 +676,7 @@ VIR_ENUM_IMPL(virQEMUCaps,
               /* 430 */
               "chardev.qemu-vdagent", /* QEMU_CAPS_CHARDEV_QEMU_VDAGENT */
               "display-dbus", /* QEMU_CAPS_DISPLAY_DBUS */
+              "query-stats", /* QEMU_CAPS_QUERY_STATS */
     );
 
 
@@ -727,8 +728,14 @@ struct _virQEMUCapsAccel {
  *
  * And don't forget to update virQEMUCapsNewCopy.
  */
+typedef struct _virQEMUCapsDomainCapsXML virQEMUCapsDomainCapsXML;
+struct _virQEMUCapsDomainCapsXML {
+    time_t firmwareMtime;
+    char *xml;
+};
+
 struct _virQEMUCaps {
-    virObject parent;
+    virObjectLockable parent;
 
     bool kvmSupportsNesting;
     bool kvmSupportsSecureGuest;
@@ -761,6 +768,10 @@ struct _virQEMUCaps {
     virQEMUCapsAccel kvm;
     virQEMUCapsAccel hvf;
     virQEMUCapsAccel tcg;
+
+    /* Formatted domain capabilities, keyed by machine, arch and virt type.
+     * Protected by the object lock. */
+    GHashTable *domCapsXML;
 };
 
 struct virQEMUCapsSearchData {
@@ -772,16 +783,54 @@ struct virQEMUCapsSearchData {
 static virClass *virQEMUCapsClass;
 static void virQEMUCapsDispose(void *obj);
 
+/* capability name -> flag + 1, for parsing of the cache and status XML */
+static GHashTable *virQEMUCapsFlagNames;
+
 static int virQEMUCapsOnceInit(void)
 {
-    if (!VIR_CLASS_NEW(virQEMUCaps, virClassForObject()))
+    size_t i;
+
+    if (!VIR_CLASS_NEW(virQEMUCaps, virClassForObjectLockable()))
         return -1;
 
+    virQEMUCapsFlagNames = virHashNew(NULL);
+
+    for (i = 0; i < QEMU_CAPS_LAST; i++) {
+        if (virHashAddEntry(virQEMUCapsFlagNames, virQEMUCapsTypeToString(i),
+                            GINT_TO_POINTER(i + 1)) < 0)
+            return -1;
+    }
+
     return 0;
 }
 
 VIR_ONCE_GLOBAL_INIT(virQEMUCaps);
 
+
+/**
+ * virQEMUCapsFlagFromString:
+ * @name: name of a capability
+ *
+ * Same as virQEMUCapsTypeFromString, but uses a hash table rather than
+ * comparing @name with the name of every capability. Meant for parsing the
+ * capabilities cache and status XML which contain hundreds of flags.
+ *
+ * Returns the capability flag or -1 if @name is unknown.
+ */
+int
+virQEMUCapsFlagFromString(const char *name)
+{
+    void *flag;
+
+    if (virQEMUCapsInitialize() < 0)
+        return -1;
+
+    if (!(flag = virHashLookup(virQEMUCapsFlagNames, name)))
+        return -1;
+
+    return GPOINTER_TO_INT(flag) - 1;
+}
+
 virArch virQEMUCapsArchFromString(const char *arch)
 {
     if (STREQ(arch, "i386"))
@@ -1230,6 +1279,7 @@ struct virQEMUCapsStringFlags virQEMUCapsCommands[] = {
     { "query-dirty-rate", QEMU_CAPS_QUERY_DIRTY_RATE },
     { "sev-inject-launch-secret", QEMU_CAPS_SEV_INJECT_LAUNCH_SECRET },
     { "calc-dirty-rate", QEMU_CAPS_CALC_DIRTY_RATE },
+    { "query-stats", QEMU_CAPS_QUERY_STATS },
 };
 
 struct virQEMUCapsStringFlags virQEMUCapsMigration[] = {
@@ -1881,6 +1931,16 @@ int virQEMUCapsGetDefaultVersion(virCaps *caps,
 }
 
 
+static void
+virQEMUCapsDomainCapsXMLFree(void *opaque)
+{
+    virQEMUCapsDomainCapsXML *entry = opaque;
+
+    g_free(entry->xml);
+    g_free(entry);
+}
+
+
 virQEMUCaps *
 virQEMUCapsNew(void)
 {
@@ -1889,11 +1949,12 @@ virQEMUCapsNew(void)
     if (virQEMUCapsInitialize() < 0)
         return NULL;
 
-    if (!(qemuCaps = virObjectNew(virQEMUCapsClass)))
+    if (!(qemuCaps = virObjectLockableNew(virQEMUCapsClass)))
         return NULL;
 
     qemuCaps->invalidation = true;
     qemuCaps->flags = virBitmapNew(QEMU_CAPS_LAST);
+    qemuCaps->domCapsXML = virHashNew(virQEMUCapsDomainCapsXMLFree);
 
     return qemuCaps;
 }
@@ -2099,6 +2160,8 @@ void virQEMUCapsDispose(void *obj)
     virQEMUCapsAccelClear(&qemuCaps->kvm);
     virQEMUCapsAccelClear(&qemuCaps->hvf);
     virQEMUCapsAccelClear(&qemuCaps->tcg);
+
+    g_clear_pointer(&qemuCaps->domCapsXML, g_hash_table_unref);
 }
 
 void
@@ -4145,7 +4208,9 @@ struct _virQEMUCapsCachePriv {
     char *kernelVersion;
     char *hostCPUSignature;
 
-    /* cache whether /dev/kvm is usable as runUid:runGuid */
+    /* cache whether /dev/kvm is usable as runUid:runGuid, the cache is
+     * validated by concurrent lookups of different binaries */
+    virMutex kvmLock;
     virTristateBool kvmUsable;
     time_t kvmCtime;
 };
@@ -4161,6 +4226,7 @@ virQEMUCapsCachePrivFree(void *privData)
     g_free(priv->kernelVersion);
     virCPUDataFree(priv->cpuData);
     g_free(priv->hostCPUSignature);
+    virMutexDestroy(&priv->kvmLock);
     g_free(priv);
 }
 
@@ -4248,7 +4314,7 @@ virQEMUCapsParseFlags(virQEMUCaps *qemuCaps, xmlXPathContextPtr ctxt)
             return -1;
         }
 
-        flag = virQEMUCapsTypeFromString(str);
+        flag = virQEMUCapsFlagFromString(str);
         if (flag < 0) {
             virReportError(VIR_ERR_INTERNAL_ERROR,
                            _("Unknown qemu capabilities flag %s"), str);
@@ -4805,6 +4871,22 @@ virQEMUCapsFormatCache(virQEMUCaps *qemuCaps)
 }
 
 
+/**
+ * virQEMUCapsGetMemoryUsage:
+ * @qemuCaps: QEMU capabilities
+ *
+ * Returns the approximate number of bytes used by @qemuCaps, estimated
+ * from the length of its cache XML.
+ */
+unsigned long long
+virQEMUCapsGetMemoryUsage(virQEMUCaps *qemuCaps)
+{
+    g_autofree char *xml = virQEMUCapsFormatCache(qemuCaps);
+
+    return sizeof(*qemuCaps) + strlen(xml);
+}
+
+
 static int
 virQEMUCapsSaveFile(void *data,
                     const char *filename,
@@ -4941,9 +5023,13 @@ virQEMUCapsKVMUsable(virQEMUCapsCachePriv *priv)
     struct stat sb;
     static const char *kvm_device = "/dev/kvm";
     virTristateBool value;
-    virTristateBool cached_value = priv->kvmUsable;
+    virTristateBool cached_value;
     time_t kvm_ctime;
-    time_t cached_kvm_ctime = priv->kvmCtime;
+    time_t cached_kvm_ctime;
+    VIR_LOCK_GUARD lock = virLockGuardLock(&priv->kvmLock);
+
+    cached_value = priv->kvmUsable;
+    cached_kvm_ctime = priv->kvmCtime;
 
     if (stat(kvm_device, &sb) < 0) {
         if (errno != ENOENT) {
@@ -5746,6 +5832,12 @@ virQEMUCapsCacheNew(const char *libDir,
         goto error;
 
     priv = g_new0(virQEMUCapsCachePriv, 1);
+    if (virMutexInit(&priv->kvmLock) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("unable to initialize mutex"));
+        g_free(priv);
+        goto error;
+    }
     virFileCacheSetPriv(cache, priv);
 
     priv->libDir = g_strdup(libDir);
@@ -5787,6 +5879,75 @@ virQEMUCapsCacheLookup(virFileCache *cache,
 }
 
 
+typedef struct _virQEMUCapsCachePrefetchData virQEMUCapsCachePrefetchData;
+struct _virQEMUCapsCachePrefetchData {
+    virFileCache *cache;
+    char *binary;
+};
+
+
+static void
+virQEMUCapsCachePrefetchThread(void *opaque)
+{
+    virQEMUCapsCachePrefetchData *data = opaque;
+    virQEMUCaps *qemuCaps;
+
+    if (!(qemuCaps = virQEMUCapsCacheLookup(data->cache, data->binary)))
+        virResetLastError();
+
+    virObjectUnref(qemuCaps);
+    virObjectUnref(data->cache);
+    g_free(data->binary);
+    g_free(data);
+}
+
+
+/**
+ * virQEMUCapsCachePrefetch:
+ * @cache: QEMU capabilities cache
+ *
+ * Looks up the capabilities of the default emulator of every guest
+ * architecture in background threads, one per binary. Binaries whose cached
+ * capabilities are outdated, e.g. after an upgrade of QEMU, are thus probed
+ * concurrently and lookups of a binary wait only for its own probe.
+ */
+void
+virQEMUCapsCachePrefetch(virFileCache *cache)
+{
+    g_autoptr(GHashTable) binaries = virHashNew(NULL);
+    virArch hostarch = virArchFromHost();
+    size_t i;
+
+    for (i = 0; i < VIR_ARCH_LAST; i++) {
+        g_autofree char *binary = virQEMUCapsGetDefaultEmulator(hostarch, i);
+        virQEMUCapsCachePrefetchData *data;
+        virThread thread;
+
+        /* several architectures may be handled by the same binary */
+        if (!binary || virHashHasEntry(binaries, binary))
+            continue;
+
+        if (virHashAddEntry(binaries, binary, cache) < 0) {
+            virResetLastError();
+            continue;
+        }
+
+        data = g_new0(virQEMUCapsCachePrefetchData, 1);
+        data->cache = virObjectRef(cache);
+        data->binary = g_steal_pointer(&binary);
+
+        if (virThreadCreateFull(&thread, false, virQEMUCapsCachePrefetchThread,
+                                "qemu-caps-probe", false, data) < 0) {
+            VIR_WARN("Unable to create thread probing capabilities of %s",
+                     data->binary);
+            virObjectUnref(data->cache);
+            g_free(data->binary);
+            g_free(data);
+        }
+    }
+}
+
+
 virQEMUCaps *
 virQEMUCapsCacheLookupCopy(virFileCache *cache,
                            virDomainVirtType virtType,
@@ -6575,6 +6736,62 @@ virQEMUCapsFillDomainCaps(virQEMUCaps *qemuCaps,
 }
 
 
+/**
+ * virQEMUCapsGetDomainCapsXML:
+ * @qemuCaps: QEMU capabilities
+ * @key: identifies the domain capabilities, see virQEMUCapsSetDomainCapsXML
+ * @firmwareMtime: modification time of firmware descriptors
+ *
+ * Looks up domain capabilities previously stored by
+ * virQEMUCapsSetDomainCapsXML. Since @qemuCaps is replaced whenever QEMU
+ * is probed again, only changes of the firmware descriptors need to be
+ * checked for.
+ *
+ * Returns a copy of the formatted domain capabilities or NULL if they
+ * have to be formatted again.
+ */
+char *
+virQEMUCapsGetDomainCapsXML(virQEMUCaps *qemuCaps,
+                            const char *key,
+                            time_t firmwareMtime)
+{
+    VIR_LOCK_GUARD lock = virObjectLockGuard(qemuCaps);
+    virQEMUCapsDomainCapsXML *entry = virHashLookup(qemuCaps->domCapsXML, key);
+
+    if (!entry || entry->firmwareMtime != firmwareMtime)
+        return NULL;
+
+    return g_strdup(entry->xml);
+}
+
+
+/**
+ * virQEMUCapsSetDomainCapsXML:
+ * @qemuCaps: QEMU capabilities
+ * @key: identifies the domain capabilities
+ * @firmwareMtime: modification time of firmware descriptors @xml reflects
+ * @xml: formatted domain capabilities
+ *
+ * Remembers @xml for virQEMUCapsGetDomainCapsXML. The @key must cover all
+ * the inputs @xml was built from, other than @qemuCaps and the firmware
+ * descriptors.
+ */
+void
+virQEMUCapsSetDomainCapsXML(virQEMUCaps *qemuCaps,
+                            const char *key,
+                            time_t firmwareMtime,
+                            const char *xml)
+{
+    VIR_LOCK_GUARD lock = virObjectLockGuard(qemuCaps);
+    virQEMUCapsDomainCapsXML *entry = g_new0(virQEMUCapsDomainCapsXML, 1);
+
+    entry->firmwareMtime = firmwareMtime;
+    entry->xml = g_strdup(xml);
+
+    ignore_value(virHashUpdateEntry(qemuCaps->domCapsXML, key, entry));
+}
+
+
 void
 virQEMUCapsSetMicrocodeVersion(virQEMUCaps *qemuCaps,
                                unsigned int microcodeVersion)
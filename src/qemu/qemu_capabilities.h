@@ -651,6 +651,7 @@ typedef enum { /* virQEMUCapsFlags grouping marker for syntax-check */
     /* 430 */
     QEMU_CAPS_CHARDEV_QEMU_VDAGENT, /* -chardev qemu-vdagent */
     QEMU_CAPS_DISPLAY_DBUS, /* -display dbus */
+    QEMU_CAPS_QUERY_STATS, /* accepts query-stats */
 
     QEMU_CAPS_LAST /* this must always be the last item */
 } virQEMUCapsFlags;
@@ -682,6 +683,7 @@ const char *virQEMUCapsGetBinary(virQEMUCaps *qemuCaps);
 virArch virQEMUCapsGetArch(virQEMUCaps *qemuCaps);
 unsigned int virQEMUCapsGetVersion(virQEMUCaps *qemuCaps);
 const char *virQEMUCapsGetPackage(virQEMUCaps *qemuCaps);
+unsigned long long virQEMUCapsGetMemoryUsage(virQEMUCaps *qemuCaps);
 
 unsigned int virQEMUCapsGetKVMVersion(virQEMUCaps *qemuCaps);
 int virQEMUCapsAddCPUDefinitions(virQEMUCaps *qemuCaps,
@@ -768,6 +770,7 @@ virFileCache *virQEMUCapsCacheNew(const char *libDir,
                                     gid_t gid);
 virQEMUCaps *virQEMUCapsCacheLookup(virFileCache *cache,
                                       const char *binary);
+void virQEMUCapsCachePrefetch(virFileCache *cache);
 virQEMUCaps *virQEMUCapsCacheLookupCopy(virFileCache *cache,
                                           virDomainVirtType virtType,
                                           const char *binary,
@@ -789,6 +792,8 @@ int virQEMUCapsGetDefaultVersion(virCaps *caps,
 
 VIR_ENUM_DECL(virQEMUCaps);
 
+int virQEMUCapsFlagFromString(const char *name);
+
 bool virQEMUCapsSupportsGICVersion(virQEMUCaps *qemuCaps,
                                    virDomainVirtType virtType,
                                    virGICVersion version);
@@ -808,6 +813,14 @@ int virQEMUCapsFillDomainCaps(virQEMUCaps *qemuCaps,
                               virFirmware **firmwares,
                               size_t nfirmwares);
 
+char *virQEMUCapsGetDomainCapsXML(virQEMUCaps *qemuCaps,
+                                  const char *key,
+                                  time_t firmwareMtime);
+void virQEMUCapsSetDomainCapsXML(virQEMUCaps *qemuCaps,
+                                 const char *key,
+                                 time_t firmwareMtime,
+                                 const char *xml);
+
 void virQEMUCapsFillDomainMemoryBackingCaps(virQEMUCaps *qemuCaps,
                                             virDomainCapsMemoryBacking *memoryBacking);
 
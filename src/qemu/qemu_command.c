@@ -2493,13 +2493,38 @@ qemuBuildObjectCommandline(virCommand *cmd,
 }
 
 
+/**
+ * qemuBuildBlockdevCommandline:
+ * @cmd: the command to modify
+ * @props: JSON properties of the block node, may be NULL
+ *
+ * Adds a -blockdev argument for @props. The properties are formatted directly
+ * into the argument of @cmd.
+ */
+static int
+qemuBuildBlockdevCommandline(virCommand *cmd,
+                             virJSONValue *props)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+
+    if (!props)
+        return 0;
+
+    if (virJSONValueToBuffer(props, &buf, false) < 0)
+        return -1;
+
+    virCommandAddArg(cmd, "-blockdev");
+    virCommandAddArgBuffer(cmd, &buf);
+
+    return 0;
+}
+
+
 static int
 qemuBuildBlockStorageSourceAttachDataCommandline(virCommand *cmd,
                                                  qemuBlockStorageSourceAttachData *data,
                                                  virQEMUCaps *qemuCaps)
 {
-    char *tmp;
-
     if (qemuBuildObjectCommandline(cmd, data->prmgrProps, qemuCaps) < 0 ||
         qemuBuildObjectCommandline(cmd, data->authsecretProps, qemuCaps) < 0 ||
         qemuBuildObjectCommandline(cmd, data->encryptsecretProps, qemuCaps) < 0 ||
@@ -2516,29 +2541,10 @@ qemuBuildBlockStorageSourceAttachDataCommandline(virCommand *cmd,
             return -1;
     }
 
-    if (data->storageProps) {
-        if (!(tmp = virJSONValueToString(data->storageProps, false)))
-            return -1;
-
-        virCommandAddArgList(cmd, "-blockdev", tmp, NULL);
-        VIR_FREE(tmp);
-    }
-
-    if (data->storageSliceProps) {
-        if (!(tmp = virJSONValueToString(data->storageSliceProps, false)))
-            return -1;
-
-        virCommandAddArgList(cmd, "-blockdev", tmp, NULL);
-        VIR_FREE(tmp);
-    }
-
-    if (data->formatProps) {
-        if (!(tmp = virJSONValueToString(data->formatProps, false)))
-            return -1;
-
-        virCommandAddArgList(cmd, "-blockdev", tmp, NULL);
-        VIR_FREE(tmp);
-    }
+    if (qemuBuildBlockdevCommandline(cmd, data->storageProps) < 0 ||
+        qemuBuildBlockdevCommandline(cmd, data->storageSliceProps) < 0 ||
+        qemuBuildBlockdevCommandline(cmd, data->formatProps) < 0)
+        return -1;
 
     return 0;
 }
@@ -2551,7 +2557,6 @@ qemuBuildDiskSourceCommandLine(virCommand *cmd,
 {
     g_autoptr(qemuBlockStorageSourceChainData) data = NULL;
     g_autoptr(virJSONValue) copyOnReadProps = NULL;
-    g_autofree char *copyOnReadPropsStr = NULL;
     size_t i;
 
     if (virStorageSourceGetActualType(disk->src) == VIR_STORAGE_TYPE_VHOST_USER) {
@@ -2580,12 +2585,8 @@ qemuBuildDiskSourceCommandLine(virCommand *cmd,
             return -1;
     }
 
-    if (copyOnReadProps) {
-        if (!(copyOnReadPropsStr = virJSONValueToString(copyOnReadProps, false)))
-            return -1;
-
-        virCommandAddArgList(cmd, "-blockdev", copyOnReadPropsStr, NULL);
-    }
+    if (qemuBuildBlockdevCommandline(cmd, copyOnReadProps) < 0)
+        return -1;
 
     return 0;
 }
@@ -3636,6 +3637,56 @@ qemuBuildMemoryGetPagesize(virQEMUDriverConfig *cfg,
 }
 
 
+/**
+ * qemuBuildMemoryBackendPreallocThreads:
+ * @cfg: qemu driver config
+ * @nodemask: host NUMA nodes the memory is bound to, or NULL
+ * @size: size of the memory in KiB
+ *
+ * Preallocation is bound by the memory bandwidth of the host NUMA nodes
+ * the memory lives on, so the number of threads follows the number of
+ * nodes the memory is bound to (all host nodes if @nodemask is NULL).
+ * There's no point in more threads than CPUs of those nodes, as they
+ * inherit the affinity of QEMU at startup, nor in more than one thread
+ * per GiB.
+ *
+ * Returns the number of threads, 0 to leave the choice to QEMU.
+ */
+static unsigned int
+qemuBuildMemoryBackendPreallocThreads(virQEMUDriverConfig *cfg,
+                                      virBitmap *nodemask,
+                                      unsigned long long size)
+{
+    g_autoptr(virBitmap) hostNodes = NULL;
+    g_autoptr(virBitmap) cpus = NULL;
+    unsigned long long threads;
+
+    if (cfg->preallocThreadsPerNode == 0)
+        return 0;
+
+    if (!nodemask) {
+        if (!virNumaIsAvailable() ||
+            !(hostNodes = virNumaGetHostMemoryNodeset())) {
+            virResetLastError();
+            return 0;
+        }
+        nodemask = hostNodes;
+    }
+
+    threads = (unsigned long long) cfg->preallocThreadsPerNode *
+        MAX(1, virBitmapCountBits(nodemask));
+
+    if (virNumaNodesetToCPUset(nodemask, &cpus) < 0)
+        virResetLastError();
+    else if (cpus && !virBitmapIsAllClear(cpus))
+        threads = MIN(threads, virBitmapCountBits(cpus));
+
+    threads = MIN(threads, MAX(1, size / (1024 * 1024)));
+
+    return threads;
+}
+
+
 /**
  * qemuBuildMemoryBackendProps:
  * @backendProps: [out] constructed object
@@ -3790,6 +3841,14 @@ qemuBuildMemoryBackendProps(virJSONValue **backendProps,
         backendType = "memory-backend-ram";
     }
 
+    if (mem->sourceNodes) {
+        nodemask = mem->sourceNodes;
+    } else {
+        if (virDomainNumatuneMaybeGetNodeset(def->numa, priv->autoNodeset,
+                                             &nodemask, mem->targetNode) < 0)
+            return -1;
+    }
+
     /* This is a terrible hack, but unfortunately there is no better way.
      * The replacement for '-m X' argument is not simple '-machine
      * memory-backend' and '-object memory-backend-*,size=X' (which was the
@@ -3822,10 +3881,17 @@ qemuBuildMemoryBackendProps(virJSONValue **backendProps,
             virJSONValueObjectAppendBoolean(props, "reserve", 0) < 0)
             return -1;
     } else {
+        unsigned int threads = def->mem.allocation_threads;
+
+        if (prealloc && threads == 0 &&
+            virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_MEMORY_BACKEND_PREALLOC_THREADS))
+            threads = qemuBuildMemoryBackendPreallocThreads(cfg, nodemask,
+                                                            mem->size);
+
         if (!priv->memPrealloc &&
             virJSONValueObjectAdd(&props,
                                   "B:prealloc", prealloc,
-                                  "p:prealloc-threads", def->mem.allocation_threads,
+                                  "p:prealloc-threads", threads,
                                   NULL) < 0)
             return -1;
     }
@@ -3855,14 +3921,6 @@ qemuBuildMemoryBackendProps(virJSONValue **backendProps,
             return -1;
     }
 
-    if (mem->sourceNodes) {
-        nodemask = mem->sourceNodes;
-    } else {
-        if (virDomainNumatuneMaybeGetNodeset(def->numa, priv->autoNodeset,
-                                             &nodemask, mem->targetNode) < 0)
-            return -1;
-    }
-
     /* If mode is "restrictive", we should only use cgroups setting allowed memory
      * nodes, and skip passing the host-nodes and policy parameters to QEMU command
      * line which means we will use system default memory policy. */
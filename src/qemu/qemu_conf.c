@@ -266,11 +266,15 @@ virQEMUDriverConfig *virQEMUDriverConfigNew(bool privileged,
 
     cfg->keepAliveInterval = 5;
     cfg->keepAliveCount = 5;
+    cfg->statsWorkers = 8;
     cfg->seccompSandbox = -1;
 
     cfg->logTimestamp = true;
     cfg->glusterDebugLevel = 4;
     cfg->stdioLogD = true;
+#if WITH_NUMAD
+    cfg->numadPlacement = true;
+#endif
 
     cfg->namespaces = virBitmapNew(QEMU_DOMAIN_NS_LAST);
 
@@ -365,6 +369,8 @@ static void virQEMUDriverConfigDispose(void *obj)
 
     g_free(cfg->lockManagerName);
 
+    g_strfreev(cfg->pressureTriggers);
+
     virFirmwareFreeList(cfg->firmwares, cfg->nfirmwares);
 
     g_free(cfg->memoryBackingDir);
@@ -622,6 +628,8 @@ virQEMUDriverConfigLoadSaveEntry(virQEMUDriverConfig *cfg,
         return -1;
     if (virConfGetValueBool(conf, "auto_start_bypass_cache", &cfg->autoStartBypassCache) < 0)
         return -1;
+    if (virConfGetValueBool(conf, "status_write_back", &cfg->statusWriteBack) < 0)
+        return -1;
 
     return 0;
 }
@@ -727,6 +735,21 @@ virQEMUDriverConfigLoadDeviceEntry(virQEMUDriverConfig *cfg,
 
     if (virConfGetValueBool(conf, "relaxed_acs_check", &cfg->relaxedACS) < 0)
         return -1;
+    if (virConfGetValueBool(conf, "backing_chain_trust_readonly",
+                            &cfg->backingChainTrustReadonly) < 0)
+        return -1;
+    if (virConfGetValueUInt(conf, "block_job_bandwidth_limit",
+                            &cfg->blockJobBandwidthLimit) < 0)
+        return -1;
+    if (virConfGetValueUInt(conf, "block_job_latency_target",
+                            &cfg->blockJobLatencyTarget) < 0)
+        return -1;
+    if (virConfGetValueULLong(conf, "iotune_balancer_total_iops_sec",
+                              &cfg->iotuneBalancerTotalIops) < 0)
+        return -1;
+    if (virConfGetValueULLong(conf, "iotune_balancer_total_bytes_sec",
+                              &cfg->iotuneBalancerTotalBytes) < 0)
+        return -1;
     if (virConfGetValueString(conf, "lock_manager", &cfg->lockManagerName) < 0)
         return -1;
     if ((rv = virConfGetValueBool(conf, "allow_disk_format_probing", &tmp)) < 0)
@@ -741,12 +764,56 @@ virQEMUDriverConfigLoadDeviceEntry(virQEMUDriverConfig *cfg,
 }
 
 
+/*
+ * Checks a pressure trigger of the form "<resource> <some|full> <stall>
+ * <window>" with the times in microseconds, the format of the kernel
+ * prefixed by the resource.
+ */
+static int
+virQEMUDriverConfigCheckPressureTrigger(const char *trigger)
+{
+    g_auto(GStrv) fields = g_strsplit(trigger, " ", 0);
+    unsigned long long stall;
+    unsigned long long window;
+
+    if (g_strv_length(fields) != 4 ||
+        virCgroupPressureResourceTypeFromString(fields[0]) < 0 ||
+        (STRNEQ(fields[1], "some") && STRNEQ(fields[1], "full")) ||
+        virStrToLong_ullp(fields[2], NULL, 10, &stall) < 0 ||
+        virStrToLong_ullp(fields[3], NULL, 10, &window) < 0 ||
+        stall == 0 || stall > window) {
+        virReportError(VIR_ERR_CONF_SYNTAX,
+                       _("Invalid pressure trigger '%s'"), trigger);
+        return -1;
+    }
+
+    return 0;
+}
+
+
 static int
 virQEMUDriverConfigLoadRPCEntry(virQEMUDriverConfig *cfg,
                                 virConf *conf)
 {
+    size_t i;
+
     if (virConfGetValueUInt(conf, "max_queued", &cfg->maxQueuedJobs) < 0)
         return -1;
+    if (virConfGetValueUInt(conf, "stats_workers", &cfg->statsWorkers) < 0)
+        return -1;
+    if (virConfGetValueUInt(conf, "reconnect_workers", &cfg->reconnectWorkers) < 0)
+        return -1;
+    if (virConfGetValueUInt(conf, "stats_cache_max_age", &cfg->statsCacheMaxAge) < 0)
+        return -1;
+    if (virConfGetValueBool(conf, "perf_vcpu_stats", &cfg->perfVcpuStats) < 0)
+        return -1;
+    if (virConfGetValueStringList(conf, "pressure_triggers", false,
+                                  &cfg->pressureTriggers) < 0)
+        return -1;
+    for (i = 0; cfg->pressureTriggers && cfg->pressureTriggers[i]; i++) {
+        if (virQEMUDriverConfigCheckPressureTrigger(cfg->pressureTriggers[i]) < 0)
+            return -1;
+    }
     if (virConfGetValueInt(conf, "keepalive_interval", &cfg->keepAliveInterval) < 0)
         return -1;
     if (virConfGetValueUInt(conf, "keepalive_count", &cfg->keepAliveCount) < 0)
@@ -807,6 +874,13 @@ virQEMUDriverConfigLoadNetworkEntry(virQEMUDriverConfig *cfg,
         return -1;
     }
 
+    if (virConfGetValueULLong(conf, "migration_convergence_max_downtime",
+                              &cfg->migrationConvergenceMaxDowntime) < 0)
+        return -1;
+    if (virConfGetValueBool(conf, "migration_convergence_postcopy",
+                            &cfg->migrationConvergencePostcopy) < 0)
+        return -1;
+
     return 0;
 }
 
@@ -994,6 +1068,7 @@ virQEMUDriverConfigLoadMemoryEntry(virQEMUDriverConfig *cfg,
                                    virConf *conf)
 {
     g_autofree char *dir = NULL;
+    g_autofree char *placement = NULL;
     int rc;
 
     if ((rc = virConfGetValueString(conf, "memory_backing_dir", &dir)) < 0)
@@ -1004,6 +1079,31 @@ virQEMUDriverConfigLoadMemoryEntry(virQEMUDriverConfig *cfg,
         cfg->memoryBackingDir = g_strdup_printf("%s/libvirt/qemu", dir);
     }
 
+    if (virConfGetValueString(conf, "numa_placement", &placement) < 0)
+        return -1;
+    if (placement) {
+        if (STREQ(placement, "numad")) {
+            cfg->numadPlacement = true;
+        } else if (STREQ(placement, "libvirt")) {
+            cfg->numadPlacement = false;
+        } else {
+            virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
+                           _("Unknown NUMA placement engine %s"),
+                           placement);
+            return -1;
+        }
+    }
+
+    if (virConfGetValueBool(conf, "cpu_balancer", &cfg->cpuBalancer) < 0)
+        return -1;
+
+    if (virConfGetValueBool(conf, "hugepage_pool_grow", &cfg->hugepagePoolGrow) < 0)
+        return -1;
+
+    if (virConfGetValueUInt(conf, "prealloc_threads_per_node",
+                            &cfg->preallocThreadsPerNode) < 0)
+        return -1;
+
     return 0;
 }
 
@@ -51,6 +51,14 @@
 
 #define QEMU_DRIVER_NAME "QEMU"
 
+typedef struct _qemuDomainStatsPush qemuDomainStatsPush;
+
+typedef struct _qemuBlockJobGovernor qemuBlockJobGovernor;
+typedef struct _qemuIOTuneBalancer qemuIOTuneBalancer;
+typedef struct _qemuCPUBalancer qemuCPUBalancer;
+typedef struct _qemuIOThreadPollTuner qemuIOThreadPollTuner;
+typedef struct _qemuBalloonAutosizer qemuBalloonAutosizer;
+
 typedef struct _virQEMUDriver virQEMUDriver;
 
 typedef struct _virQEMUDriverConfig virQEMUDriverConfig;
@@ -170,6 +178,11 @@ struct _virQEMUDriverConfig {
     bool macFilter;
 
     bool relaxedACS;
+    bool backingChainTrustReadonly;
+    unsigned int blockJobBandwidthLimit; /* in MiB/s, 0 disables the governor */
+    unsigned int blockJobLatencyTarget; /* in milliseconds */
+    unsigned long long iotuneBalancerTotalIops; /* 0 if not balanced */
+    unsigned long long iotuneBalancerTotalBytes; /* 0 if not balanced */
     bool vncAllowHostAudio;
     bool nogfxAllowHostAudio;
     bool setProcessName;
@@ -181,6 +194,11 @@ struct _virQEMUDriverConfig {
     bool dumpGuestCore;
 
     unsigned int maxQueuedJobs;
+    unsigned int statsWorkers;
+    unsigned int reconnectWorkers;
+    unsigned int statsCacheMaxAge; /* in milliseconds, 0 disables the cache */
+    bool perfVcpuStats;
+    char **pressureTriggers;
 
     char **securityDriverNames;
     bool securityDefaultConfined;
@@ -193,6 +211,7 @@ struct _virQEMUDriverConfig {
     char *autoDumpPath;
     bool autoDumpBypassCache;
     bool autoStartBypassCache;
+    bool statusWriteBack;
 
     char *lockManagerName;
 
@@ -206,6 +225,8 @@ struct _virQEMUDriverConfig {
     char *migrationAddress;
     unsigned int migrationPortMin;
     unsigned int migrationPortMax;
+    unsigned long long migrationConvergenceMaxDowntime;
+    bool migrationConvergencePostcopy;
 
     bool logTimestamp;
     bool stdioLogD;
@@ -216,6 +237,10 @@ struct _virQEMUDriverConfig {
     bool virtiofsdDebug;
 
     char *memoryBackingDir;
+    bool numadPlacement;
+    bool cpuBalancer;
+    bool hugepagePoolGrow;
+    unsigned int preallocThreadsPerNode;
 
     uid_t swtpm_user;
     gid_t swtpm_group;
@@ -242,12 +267,32 @@ struct _virQEMUDriver {
     /* Immutable pointer, self-locking APIs */
     virThreadPool *workerPool;
 
+    /* Immutable pointer once set on startup, self-locking APIs. NULL when
+     * every domain is reconnected on a thread of its own */
+    virThreadPool *reconnectPool;
+
+    /* Immutable pointer once set on startup, self-locking APIs. NULL
+     * unless status_write_back is enabled */
+    virThreadPool *statusPool;
+
+    /* Atomic inc only */
+    unsigned int reconnectQueued;
+    unsigned int reconnectDone;
+
     /* Atomic increment only */
     int lastvmid;
 
     /* Atomic inc/dec only */
     unsigned int nactive;
 
+    /* Atomic inc/dec only. Running domains with adaptively polling
+     * IOThreads, see qemuIOThreadPollTunerAddDomain */
+    unsigned int npollTuned;
+
+    /* Atomic inc/dec only. Running domains with an autosized balloon, see
+     * qemuBalloonAutosizerAddDomain */
+    unsigned int nautosized;
+
     /* Immutable values */
     bool privileged;
     char *embeddedRoot;
@@ -260,6 +305,14 @@ struct _virQEMUDriver {
     /* Immutable pointer, self-locking APIs */
     virDomainObjList *domains;
 
+    /* Require lock. Host CPUs used by running domains keyed by domain
+     * name, see qemuProcessRegisterBusyCpus */
+    GHashTable *busyCpus;
+
+    /* Require lock. Huge pages reserved by running domains keyed by domain
+     * name, see qemuProcessReserveHugepages */
+    GHashTable *hugepageReservations;
+
     /* Immutable pointer */
     char *qemuImgBinary;
 
@@ -288,6 +341,24 @@ struct _virQEMUDriver {
     /* Immutable pointer, self-locking APIs */
     virObjectEventState *domainEventState;
 
+    /* Immutable pointer, self-locking APIs */
+    qemuDomainStatsPush *statsPush;
+
+    /* Immutable pointer, NULL if the governor is disabled */
+    qemuBlockJobGovernor *blockJobGovernor;
+
+    /* Immutable pointer, NULL if the balancer is disabled */
+    qemuIOTuneBalancer *iotuneBalancer;
+
+    /* Immutable pointer, NULL if the balancer is disabled */
+    qemuCPUBalancer *cpuBalancer;
+
+    /* Immutable pointer */
+    qemuIOThreadPollTuner *iothreadPollTuner;
+
+    /* Immutable pointer */
+    qemuBalloonAutosizer *balloonAutosizer;
+
     /* Immutable pointer. self-locking APIs */
     virSecurityManager *securityManager;
 
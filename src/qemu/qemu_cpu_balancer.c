@@ -0,0 +1,732 @@
+/*
+ * qemu_cpu_balancer.c: placement of domains on groups of host CPUs
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "qemu_cpu_balancer.h"
+#define LIBVIRT_QEMU_CPU_BALANCERPRIV_H_ALLOW
+#include "qemu_cpu_balancerpriv.h"
+#include "qemu_domain.h"
+#include "qemu_periodic.h"
+
+#include "viralloc.h"
+#include "virhostcpu.h"
+#include "virlog.h"
+#include "virprocess.h"
+#include "virtime.h"
+#include "viruuid.h"
+
+#define VIR_FROM_THIS VIR_FROM_QEMU
+
+VIR_LOG_INIT("qemu.qemu_cpu_balancer");
+
+/* Interval in milliseconds between two passes of the CPU balancer */
+#define QEMU_CPU_BALANCER_INTERVAL 10000
+
+struct _qemuCPUBalancer {
+    virQEMUDriver *driver;
+    qemuPeriodic *worker;
+
+    /* The rest is accessed by the worker thread only */
+
+    /* UUID -> qemuCPUBalancerDomain */
+    GHashTable *domains;
+};
+
+
+static void
+qemuCPUBalancerGroupsFree(qemuCPUBalancerGroup *groups,
+                          size_t ngroups)
+{
+    size_t i;
+
+    for (i = 0; i < ngroups; i++)
+        virBitmapFree(groups[i].cpus);
+    g_free(groups);
+}
+
+
+static virCapsHostNUMACellCPU *
+qemuCPUBalancerFindCPU(virCapsHostNUMA *host,
+                       int id,
+                       int *node)
+{
+    size_t i;
+    int j;
+
+    for (i = 0; i < host->cells->len; i++) {
+        virCapsHostNUMACell *cell = g_ptr_array_index(host->cells, i);
+
+        for (j = 0; j < cell->ncpus; j++) {
+            if (cell->cpus[j].id == id) {
+                *node = cell->num;
+                return &cell->cpus[j];
+            }
+        }
+    }
+
+    *node = -1;
+    return NULL;
+}
+
+
+/**
+ * qemuCPUBalancerGetGroups:
+ * @driver: qemu driver
+ * @ngroups: filled with the number of groups
+ *
+ * Splits the online host CPUs into groups of CPUs sharing the last level
+ * cache, or sharing a NUMA node if the cache topology is unknown. Domains are
+ * kept within one group so that their threads share the cache and memory of
+ * the group. The capacity of a group counts SMT siblings of a core as a
+ * fraction of a CPU.
+ *
+ * Returns the groups, or NULL if there are none.
+ */
+static qemuCPUBalancerGroup *
+qemuCPUBalancerGetGroups(virQEMUDriver *driver,
+                         size_t *ngroups)
+{
+    g_autoptr(virCaps) caps = NULL;
+    g_autoptr(virCapsHostNUMA) host = NULL;
+    g_autoptr(virBitmap) online = NULL;
+    g_autoptr(GPtrArray) sets = g_ptr_array_new_with_free_func((GDestroyNotify) virBitmapFree);
+    qemuCPUBalancerGroup *groups = NULL;
+    unsigned int level = 0;
+    size_t i;
+    int j;
+
+    *ngroups = 0;
+
+    if (!(caps = virQEMUDriverGetCapabilities(driver, false)) ||
+        !(host = virCapabilitiesHostNUMANewHost()) ||
+        !(online = virHostCPUGetOnlineBitmap())) {
+        virResetLastError();
+        return NULL;
+    }
+
+    for (i = 0; i < caps->host.cache.nbanks; i++) {
+        virCapsHostCacheBank *bank = caps->host.cache.banks[i];
+
+        if (bank->type != VIR_CACHE_TYPE_CODE)
+            level = MAX(level, bank->level);
+    }
+
+    for (i = 0; i < caps->host.cache.nbanks; i++) {
+        virCapsHostCacheBank *bank = caps->host.cache.banks[i];
+
+        if (bank->level == level && bank->type != VIR_CACHE_TYPE_CODE)
+            g_ptr_array_add(sets, virBitmapNewCopy(bank->cpus));
+    }
+
+    if (sets->len == 0) {
+        for (i = 0; i < host->cells->len; i++) {
+            virCapsHostNUMACell *cell = g_ptr_array_index(host->cells, i);
+            virBitmap *cpus = virBitmapNew(0);
+
+            for (j = 0; j < cell->ncpus; j++)
+                virBitmapSetBitExpand(cpus, cell->cpus[j].id);
+
+            g_ptr_array_add(sets, cpus);
+        }
+    }
+
+    groups = g_new0(qemuCPUBalancerGroup, sets->len);
+
+    for (i = 0; i < sets->len; i++) {
+        qemuCPUBalancerGroup *group = &groups[*ngroups];
+        virBitmap *cpus = g_ptr_array_index(sets, i);
+        ssize_t cpu = -1;
+
+        virBitmapIntersect(cpus, online);
+
+        if (virBitmapIsAllClear(cpus))
+            continue;
+
+        group->id = virBitmapNextSetBit(cpus, -1);
+        group->ncpus = virBitmapCountBits(cpus);
+        qemuCPUBalancerFindCPU(host, group->id, &group->node);
+
+        while ((cpu = virBitmapNextSetBit(cpus, cpu)) >= 0) {
+            int node;
+            virCapsHostNUMACellCPU *hostcpu = qemuCPUBalancerFindCPU(host, cpu, &node);
+
+            if (!hostcpu || !hostcpu->siblings ||
+                virBitmapNextSetBit(hostcpu->siblings, -1) == cpu)
+                group->capacity += QEMU_CPU_BALANCER_CORE_CAPACITY;
+            else
+                group->capacity += QEMU_CPU_BALANCER_SMT_CAPACITY;
+        }
+
+        group->cpus = g_steal_pointer(&sets->pdata[i]);
+        (*ngroups)++;
+    }
+
+    if (*ngroups == 0) {
+        g_free(groups);
+        return NULL;
+    }
+
+    return groups;
+}
+
+
+static qemuCPUBalancerGroup *
+qemuCPUBalancerFindGroup(qemuCPUBalancerGroup *groups,
+                         size_t ngroups,
+                         int id)
+{
+    size_t i;
+
+    for (i = 0; i < ngroups; i++) {
+        if (groups[i].id == id)
+            return &groups[i];
+    }
+
+    return NULL;
+}
+
+
+/**
+ * qemuCPUBalancerDomainEligible:
+ * @vm: domain object
+ *
+ * Only domains without any explicit placement of their vCPUs, emulator,
+ * IOThreads or memory and without guest NUMA topology are balanced, all
+ * other domains are left alone.
+ */
+static bool
+qemuCPUBalancerDomainEligible(virDomainObj *vm)
+{
+    virDomainDef *def = vm->def;
+    size_t i;
+
+    if (def->placement_mode != VIR_DOMAIN_CPU_PLACEMENT_MODE_STATIC ||
+        def->cpumask ||
+        def->cputune.emulatorpin ||
+        virDomainNumatuneHasPlacementAuto(def->numa) ||
+        virDomainNumatuneGetNodeset(def->numa, NULL, -1) ||
+        virDomainNumatuneHasPerNodeBinding(def->numa) ||
+        virDomainNumaGetNodeCount(def->numa) > 1 ||
+        !qemuDomainHasVcpuPids(vm))
+        return false;
+
+    for (i = 0; i < virDomainDefGetVcpusMax(def); i++) {
+        if (virDomainDefGetVcpu(def, i)->cpumask)
+            return false;
+    }
+
+    for (i = 0; i < def->niothreadids; i++) {
+        if (def->iothreadids[i]->cpumask)
+            return false;
+    }
+
+    return true;
+}
+
+
+/**
+ * qemuCPUBalancerPinDomain:
+ * @vm: locked domain object
+ * @cpus: CPUs to pin to
+ *
+ * Sets the affinity of all threads of @vm which the user didn't pin
+ * explicitly to @cpus. The pinning is not reflected in the domain definition.
+ */
+static void
+qemuCPUBalancerPinDomain(virDomainObj *vm,
+                         virBitmap *cpus)
+{
+    virDomainDef *def = vm->def;
+    g_autofree pid_t *tids = NULL;
+    size_t ntids = 0;
+    size_t i;
+    size_t j;
+
+    if (virProcessGetPids(vm->pid, &ntids, &tids) < 0) {
+        virResetLastError();
+        return;
+    }
+
+    for (i = 0; i < ntids; i++) {
+        virBitmap *pinned = def->cputune.emulatorpin;
+
+        for (j = 0; j < virDomainDefGetVcpusMax(def); j++) {
+            virDomainVcpuDef *vcpu = virDomainDefGetVcpu(def, j);
+
+            if (vcpu->online && qemuDomainGetVcpuPid(vm, j) == tids[i])
+                pinned = vcpu->cpumask;
+        }
+
+        for (j = 0; j < def->niothreadids; j++) {
+            if (def->iothreadids[j]->thread_id == tids[i])
+                pinned = def->iothreadids[j]->cpumask;
+        }
+
+        if (pinned)
+            continue;
+
+        /* threads may exit at any time */
+        if (virProcessSetAffinity(tids[i], cpus, true) < 0)
+            virResetLastError();
+    }
+}
+
+
+/**
+ * qemuCPUBalancerDomainUpdate:
+ * @dom: balanced domain
+ * @nvcpus: number of online vCPUs
+ * @cpuTime: CPU time used by the domain so far in ns
+ * @cpuWait: time its vCPUs waited for a CPU so far in ns
+ * @now: time of the current pass in ms
+ *
+ * Updates the load of @dom from the counters since the previous sample.
+ */
+void
+qemuCPUBalancerDomainUpdate(qemuCPUBalancerDomain *dom,
+                            unsigned int nvcpus,
+                            unsigned long long cpuTime,
+                            unsigned long long cpuWait,
+                            unsigned long long now)
+{
+    dom->nvcpus = nvcpus;
+
+    if (dom->sampled && now > dom->sampled &&
+        cpuTime >= dom->cpuTime && cpuWait >= dom->cpuWait) {
+        /* ns per ms equals millionths of a CPU */
+        dom->load = (cpuTime - dom->cpuTime) / (now - dom->sampled) / 1000;
+        dom->wait = (cpuWait - dom->cpuWait) / (now - dom->sampled) / 1000;
+    } else {
+        /* until measured, expect a new domain to keep all its vCPUs busy */
+        dom->load = dom->nvcpus * QEMU_CPU_BALANCER_CORE_CAPACITY;
+        dom->wait = 0;
+    }
+
+    dom->cpuTime = cpuTime;
+    dom->cpuWait = cpuWait;
+    dom->sampled = now;
+}
+
+
+/**
+ * qemuCPUBalancerSampleDomain:
+ * @bal: CPU balancer
+ * @vm: locked domain object
+ * @now: time of the current pass in ms
+ *
+ * Updates the observed CPU load of @vm and the time its vCPUs spent waiting
+ * for a CPU. A domain which is not eligible anymore is unpinned.
+ */
+static void
+qemuCPUBalancerSampleDomain(qemuCPUBalancer *bal,
+                            virDomainObj *vm,
+                            unsigned long long now)
+{
+    qemuCPUBalancerDomain *dom;
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
+    unsigned long long cpuTime = 0;
+    unsigned long long cpuWait = 0;
+    size_t i;
+
+    virUUIDFormat(vm->def->uuid, uuidstr);
+    dom = virHashLookup(bal->domains, uuidstr);
+
+    if (!qemuCPUBalancerDomainEligible(vm)) {
+        if (dom) {
+            if (dom->applied >= 0 && dom->pid == vm->pid) {
+                g_autoptr(virBitmap) online = virHostCPUGetOnlineBitmap();
+
+                VIR_DEBUG("unpinning domain %s", vm->def->name);
+                if (online)
+                    qemuCPUBalancerPinDomain(vm, online);
+                else
+                    virResetLastError();
+            }
+            virHashRemoveEntry(bal->domains, uuidstr);
+        }
+        return;
+    }
+
+    if (dom && dom->pid != vm->pid) {
+        virHashRemoveEntry(bal->domains, uuidstr);
+        dom = NULL;
+    }
+
+    if (!dom) {
+        dom = g_new0(qemuCPUBalancerDomain, 1);
+        dom->pid = vm->pid;
+        dom->group = -1;
+        dom->applied = -1;
+        if (virHashAddEntry(bal->domains, uuidstr, dom) < 0) {
+            virResetLastError();
+            g_free(dom);
+            return;
+        }
+    }
+
+    if (virProcessGetStatInfo(&cpuTime, NULL, NULL, vm->pid, 0) < 0) {
+        virResetLastError();
+        return;
+    }
+
+    for (i = 0; i < virDomainDefGetVcpusMax(vm->def); i++) {
+        unsigned long long wait;
+        pid_t tid = qemuDomainGetVcpuPid(vm, i);
+
+        if (tid == 0)
+            continue;
+
+        if (virProcessGetSchedInfo(&wait, vm->pid, tid) < 0) {
+            virResetLastError();
+            continue;
+        }
+
+        cpuWait += wait;
+    }
+
+    qemuCPUBalancerDomainUpdate(dom, virDomainDefGetVcpus(vm->def),
+                                cpuTime, cpuWait, now);
+    dom->seen = true;
+}
+
+
+static int
+qemuCPUBalancerForget(const void *payload,
+                      const char *name G_GNUC_UNUSED,
+                      const void *opaque G_GNUC_UNUSED)
+{
+    const qemuCPUBalancerDomain *dom = payload;
+
+    return !dom->seen;
+}
+
+
+static int
+qemuCPUBalancerDomainCompare(const void *a,
+                             const void *b)
+{
+    const qemuCPUBalancerDomain *da = *(qemuCPUBalancerDomain * const *) a;
+    const qemuCPUBalancerDomain *db = *(qemuCPUBalancerDomain * const *) b;
+
+    if (da->load > db->load)
+        return -1;
+    if (da->load < db->load)
+        return 1;
+    return 0;
+}
+
+
+/* Utilization of @group in thousandths if @load is added to its load */
+static unsigned long long
+qemuCPUBalancerUtilization(qemuCPUBalancerGroup *group,
+                           long long load)
+{
+    return (group->load + load) * 1000 / group->capacity;
+}
+
+
+/**
+ * qemuCPUBalancerAssign:
+ * @doms: sampled domains, sorted by load
+ * @ndoms: number of domains
+ * @groups: CPU groups
+ * @ngroups: number of groups
+ * @now: time of the current pass in ms
+ *
+ * Places new domains into the group with most spare capacity which has
+ * enough CPUs for all their vCPUs. Then, if the busiest group is
+ * overcommitted or its vCPUs wait for a CPU, moves one domain out of it if
+ * that lowers the utilization of the busiest group noticeably. Moving a
+ * domain to another NUMA node than its memory is allocated from is
+ * expensive, so such moves must pay off more.
+ */
+void
+qemuCPUBalancerAssign(qemuCPUBalancerDomain **doms,
+                      size_t ndoms,
+                      qemuCPUBalancerGroup *groups,
+                      size_t ngroups,
+                      unsigned long long now)
+{
+    qemuCPUBalancerGroup *busiest = NULL;
+    qemuCPUBalancerDomain *move = NULL;
+    qemuCPUBalancerGroup *target = NULL;
+    unsigned long long best = 0;
+    size_t i;
+    size_t j;
+
+    for (i = 0; i < ndoms; i++) {
+        qemuCPUBalancerGroup *group;
+
+        if (!(group = qemuCPUBalancerFindGroup(groups, ngroups, doms[i]->group)) ||
+            group->ncpus < doms[i]->nvcpus) {
+            doms[i]->group = -1;
+            continue;
+        }
+
+        group->load += doms[i]->load;
+        group->wait += doms[i]->wait;
+    }
+
+    for (i = 0; i < ndoms; i++) {
+        qemuCPUBalancerGroup *group = NULL;
+
+        if (doms[i]->group >= 0)
+            continue;
+
+        for (j = 0; j < ngroups; j++) {
+            if (groups[j].ncpus < doms[i]->nvcpus)
+                continue;
+
+            if (!group ||
+                qemuCPUBalancerUtilization(&groups[j], doms[i]->load) <
+                qemuCPUBalancerUtilization(group, doms[i]->load))
+                group = &groups[j];
+        }
+
+        if (!group)
+            continue;
+
+        doms[i]->group = group->id;
+        group->load += doms[i]->load;
+        group->wait += doms[i]->wait;
+    }
+
+    for (i = 0; i < ngroups; i++) {
+        if (!busiest ||
+            qemuCPUBalancerUtilization(&groups[i], 0) >
+            qemuCPUBalancerUtilization(busiest, 0))
+            busiest = &groups[i];
+    }
+
+    if (!busiest ||
+        (qemuCPUBalancerUtilization(busiest, 0) < 900 &&
+         busiest->wait * 10 < busiest->capacity))
+        return;
+
+    for (i = 0; i < ndoms; i++) {
+        unsigned long long before = qemuCPUBalancerUtilization(busiest, 0);
+
+        if (doms[i]->group != busiest->id ||
+            (doms[i]->moved && now - doms[i]->moved < QEMU_CPU_BALANCER_SETTLE))
+            continue;
+
+        for (j = 0; j < ngroups; j++) {
+            unsigned long long after;
+            unsigned long long threshold = 100;
+
+            if (&groups[j] == busiest ||
+                groups[j].ncpus < doms[i]->nvcpus)
+                continue;
+
+            if (groups[j].node != busiest->node)
+                threshold = 300;
+
+            after = MAX(qemuCPUBalancerUtilization(busiest, -(long long) doms[i]->load),
+                        qemuCPUBalancerUtilization(&groups[j], doms[i]->load));
+
+            if (after + threshold <= before && before - after > best) {
+                best = before - after;
+                move = doms[i];
+                target = &groups[j];
+            }
+        }
+    }
+
+    if (!move)
+        return;
+
+    VIR_DEBUG("moving domain with load %llu from CPU group %d to %d",
+              move->load, busiest->id, target->id);
+
+    busiest->load -= move->load;
+    target->load += move->load;
+    move->group = target->id;
+    move->moved = now;
+}
+
+
+/**
+ * qemuCPUBalancerApplyDomain:
+ * @bal: CPU balancer
+ * @vm: locked domain object
+ * @groups: CPU groups
+ * @ngroups: number of groups
+ *
+ * Pins the threads of @vm to the CPUs of the group it's assigned to. The
+ * threads are pinned again whenever vCPUs were added, as new threads don't
+ * necessarily inherit the affinity.
+ */
+static void
+qemuCPUBalancerApplyDomain(qemuCPUBalancer *bal,
+                           virDomainObj *vm,
+                           qemuCPUBalancerGroup *groups,
+                           size_t ngroups)
+{
+    qemuCPUBalancerDomain *dom;
+    qemuCPUBalancerGroup *group;
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
+
+    virUUIDFormat(vm->def->uuid, uuidstr);
+
+    if (!(dom = virHashLookup(bal->domains, uuidstr)) ||
+        dom->pid != vm->pid ||
+        !qemuCPUBalancerDomainEligible(vm))
+        return;
+
+    if (!(group = qemuCPUBalancerFindGroup(groups, ngroups, dom->group))) {
+        /* doesn't fit into any group anymore */
+        if (dom->applied >= 0) {
+            g_autoptr(virBitmap) online = virHostCPUGetOnlineBitmap();
+
+            if (online)
+                qemuCPUBalancerPinDomain(vm, online);
+            else
+                virResetLastError();
+            dom->applied = -1;
+        }
+        return;
+    }
+
+    if (dom->applied == group->id &&
+        dom->nvcpus == virDomainDefGetVcpus(vm->def))
+        return;
+
+    VIR_DEBUG("pinning domain %s to CPU group %d", vm->def->name, group->id);
+
+    qemuCPUBalancerPinDomain(vm, group->cpus);
+    dom->applied = group->id;
+}
+
+
+/**
+ * qemuCPUBalancerPass:
+ * @opaque: CPU balancer
+ *
+ * Samples the CPU load of all running domains which are eligible for
+ * balancing, rearranges them between the CPU groups of the host and pins
+ * their threads accordingly.
+ */
+static void
+qemuCPUBalancerPass(void *opaque)
+{
+    qemuCPUBalancer *bal = opaque;
+    virQEMUDriver *driver = bal->driver;
+    g_autofree virHashKeyValuePair *items = NULL;
+    g_autofree qemuCPUBalancerDomain **doms = NULL;
+    qemuCPUBalancerGroup *groups = NULL;
+    virDomainObj **vms = NULL;
+    unsigned long long now;
+    size_t nvms;
+    size_t ndoms = 0;
+    size_t ngroups = 0;
+    size_t i;
+
+    if (virTimeMillisNow(&now) < 0 ||
+        virDomainObjListCollect(driver->domains, NULL, &vms, &nvms,
+                                NULL, VIR_CONNECT_LIST_DOMAINS_ACTIVE) < 0) {
+        virResetLastError();
+        return;
+    }
+
+    for (i = 0; i < nvms; i++) {
+        virObjectLock(vms[i]);
+        if (virDomainObjIsActive(vms[i]))
+            qemuCPUBalancerSampleDomain(bal, vms[i], now);
+        virObjectUnlock(vms[i]);
+    }
+
+    /* domains which are gone or were not sampled are dropped */
+    virHashRemoveSet(bal->domains, qemuCPUBalancerForget, NULL);
+
+    if ((items = virHashGetItems(bal->domains, &ndoms, false))) {
+        doms = g_new0(qemuCPUBalancerDomain *, ndoms);
+        for (i = 0; i < ndoms; i++)
+            doms[i] = (qemuCPUBalancerDomain *) items[i].value;
+
+        qsort(doms, ndoms, sizeof(*doms), qemuCPUBalancerDomainCompare);
+    }
+
+    if (ndoms > 0 &&
+        (groups = qemuCPUBalancerGetGroups(driver, &ngroups))) {
+        qemuCPUBalancerAssign(doms, ndoms, groups, ngroups, now);
+
+        for (i = 0; i < nvms; i++) {
+            virObjectLock(vms[i]);
+            if (virDomainObjIsActive(vms[i]))
+                qemuCPUBalancerApplyDomain(bal, vms[i], groups, ngroups);
+            virObjectUnlock(vms[i]);
+        }
+    }
+
+    for (i = 0; i < ndoms; i++)
+        doms[i]->seen = false;
+
+    qemuCPUBalancerGroupsFree(groups, ngroups);
+    virObjectListFreeCount(vms, nvms);
+}
+
+
+void
+qemuCPUBalancerFree(qemuCPUBalancer *bal)
+{
+    if (!bal)
+        return;
+
+    /* stop the worker before freeing the state it uses */
+    qemuPeriodicFree(bal->worker);
+    g_clear_pointer(&bal->domains, g_hash_table_unref);
+    g_free(bal);
+}
+
+
+/**
+ * qemuCPUBalancerStart:
+ * @driver: qemu driver
+ * @cfg: driver configuration
+ *
+ * Starts the thread pinning the threads of domains without explicit pinning
+ * to groups of host CPUs if the 'cpu_balancer' option is enabled.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+qemuCPUBalancerStart(virQEMUDriver *driver,
+                     virQEMUDriverConfig *cfg)
+{
+    qemuCPUBalancer *bal;
+
+    if (!cfg->cpuBalancer)
+        return 0;
+
+    bal = g_new0(qemuCPUBalancer, 1);
+    bal->driver = driver;
+    bal->domains = virHashNew(g_free);
+
+    if (!(bal->worker = qemuPeriodicNew("qemu-cpu-bal",
+                                        _("CPU balancer"),
+                                        QEMU_CPU_BALANCER_INTERVAL,
+                                        qemuCPUBalancerPass, bal))) {
+        qemuCPUBalancerFree(bal);
+        return -1;
+    }
+
+    driver->cpuBalancer = bal;
+
+    return 0;
+}
@@ -0,0 +1,81 @@
+/*
+ * qemu_cpu_balancerpriv.h: private declarations for the CPU balancer
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBVIRT_QEMU_CPU_BALANCERPRIV_H_ALLOW
+# error "qemu_cpu_balancerpriv.h may only be included by qemu_cpu_balancer.c or test suites"
+#endif /* LIBVIRT_QEMU_CPU_BALANCERPRIV_H_ALLOW */
+
+#pragma once
+
+#include "qemu_cpu_balancer.h"
+
+/* Minimum time in milliseconds a domain stays in a CPU group after it
+ * was moved */
+#define QEMU_CPU_BALANCER_SETTLE 60000
+
+/* Capacity of a CPU, in thousandths of a CPU, depending on whether it's
+ * the first thread of a core or an SMT sibling sharing the core with it */
+#define QEMU_CPU_BALANCER_CORE_CAPACITY 1000
+#define QEMU_CPU_BALANCER_SMT_CAPACITY 250
+
+typedef struct _qemuCPUBalancerGroup qemuCPUBalancerGroup;
+struct _qemuCPUBalancerGroup {
+    virBitmap *cpus;
+    int id; /* first CPU of the group */
+    int node; /* host NUMA node of the first CPU, -1 if unknown */
+    size_t ncpus;
+    unsigned long long capacity; /* in thousandths of a CPU */
+
+    /* of the domains assigned to the group in the current pass */
+    unsigned long long load; /* in thousandths of a CPU */
+    unsigned long long wait;
+};
+
+typedef struct _qemuCPUBalancerDomain qemuCPUBalancerDomain;
+struct _qemuCPUBalancerDomain {
+    pid_t pid;
+
+    /* counters in the previous pass */
+    unsigned long long cpuTime; /* in ns */
+    unsigned long long cpuWait; /* in ns */
+    unsigned long long sampled; /* time of the previous pass in ms */
+
+    /* observed in the current pass, in thousandths of a CPU */
+    unsigned long long load;
+    unsigned long long wait;
+
+    unsigned int nvcpus;
+    int group; /* id of the assigned group, -1 if none */
+    int applied; /* id of the group the threads are pinned to, -1 if none */
+    unsigned long long moved; /* time of the last move in ms */
+    bool seen;
+};
+
+void
+qemuCPUBalancerDomainUpdate(qemuCPUBalancerDomain *dom,
+                            unsigned int nvcpus,
+                            unsigned long long cpuTime,
+                            unsigned long long cpuWait,
+                            unsigned long long now);
+
+void
+qemuCPUBalancerAssign(qemuCPUBalancerDomain **doms,
+                      size_t ndoms,
+                      qemuCPUBalancerGroup *groups,
+                      size_t ngroups,
+                      unsigned long long now);
@@ -875,6 +875,7 @@ qemuDomainVcpuPrivateDispose(void *obj)
     g_free(priv->alias);
     virJSONValueFree(priv->props);
     g_free(priv->qomPath);
+    virPerfFree(priv->perf);
     return;
 }
 
@@ -1175,6 +1176,7 @@ qemuDomainSecretInfoSetup(qemuDomainObjPrivate *priv,
  * Looks up a secret in the secret driver based on @usageType and @seclookupdef
  * and builds qemuDomainSecretInfo *from it. @use describes the usage of the
  * secret in case if @srcalias requires more secrets for various usage cases.
+ * The secret cache of @priv is used while there is one.
  */
 static qemuDomainSecretInfo *
 qemuDomainSecretInfoSetupFromSecret(qemuDomainObjPrivate *priv,
@@ -1189,17 +1191,23 @@ qemuDomainSecretInfoSetupFromSecret(qemuDomainObjPrivate *priv,
     g_autofree uint8_t *secret = NULL;
     size_t secretlen = 0;
     VIR_IDENTITY_AUTORESTORE virIdentity *oldident = virIdentityElevateCurrent();
-    g_autoptr(virConnect) conn = virGetConnectSecret();
+    g_autoptr(virConnect) conn = NULL;
 
     if (!oldident)
         return NULL;
 
-    if (!conn)
-        return NULL;
+    if (priv->secretCache) {
+        if (virSecretCacheGetSecretString(priv->secretCache, seclookupdef,
+                                          usageType, &secret, &secretlen) < 0)
+            return NULL;
+    } else {
+        if (!(conn = virGetConnectSecret()))
+            return NULL;
 
-    if (virSecretGetSecretString(conn, seclookupdef, usageType,
-                                 &secret, &secretlen) < 0)
-        return NULL;
+        if (virSecretGetSecretString(conn, seclookupdef, usageType,
+                                     &secret, &secretlen) < 0)
+            return NULL;
+    }
 
     secinfo = qemuDomainSecretInfoSetup(priv, alias, username, secret, secretlen);
 
@@ -1655,6 +1663,26 @@ qemuDomainObjStopWorker(virDomainObj *dom)
 }
 
 
+/**
+ * qemuDomainStatsCacheClear:
+ * @priv: domain private data
+ *
+ * Drops all bulk stats cached for the domain.
+ */
+void
+qemuDomainStatsCacheClear(qemuDomainObjPrivate *priv)
+{
+    size_t i;
+
+    for (i = 0; i < priv->nstatsCache; i++)
+        virTypedParamsFree(priv->statsCache[i].params,
+                           priv->statsCache[i].nparams);
+
+    g_clear_pointer(&priv->statsCache, g_free);
+    priv->nstatsCache = 0;
+}
+
+
 /**
  * qemuDomainObjPrivateDataClear:
  * @priv: domain private data
@@ -1712,6 +1740,11 @@ qemuDomainObjPrivateDataClear(qemuDomainObjPrivate *priv)
         g_slist_free_full(g_steal_pointer(&priv->dbusVMStateIds), g_free);
 
     priv->dbusVMState = false;
+
+    qemuDomainStatsCacheClear(priv);
+
+    priv->ndirtyRateHistory = 0;
+    priv->dirtyRateHistoryNext = 0;
 }
 
 
@@ -1751,6 +1784,7 @@ qemuDomainObjPrivateFree(void *data)
         g_object_unref(priv->eventThread);
     }
 
+    g_mutex_clear(&priv->statusLock);
     g_free(priv);
 }
 
@@ -1762,6 +1796,8 @@ qemuDomainObjPrivateAlloc(void *opaque)
 {
     g_autoptr(qemuDomainObjPrivate) priv = g_new0(qemuDomainObjPrivate, 1);
 
+    g_mutex_init(&priv->statusLock);
+
     if (qemuDomainObjInitJob(&priv->job, &qemuPrivateJobCallbacks) < 0) {
         virReportSystemError(errno, "%s",
                              _("Unable to init qemu driver mutexes"));
@@ -2080,6 +2116,8 @@ qemuDomainObjPrivateXMLFormatBlockjobIterator(void *payload,
         virBufferEscapeString(&attrBuf, " brokentype='%s'", qemuBlockjobTypeToString(job->brokentype));
     if (!job->jobflagsmissing)
         virBufferAsprintf(&attrBuf, " jobflags='0x%x'", job->jobflags);
+    if (job->bandwidth)
+        virBufferAsprintf(&attrBuf, " bandwidth='%llu'", job->bandwidth);
     virBufferEscapeString(&childBuf, "<errmsg>%s</errmsg>", job->errmsg);
 
     if (job->disk) {
@@ -2420,6 +2458,12 @@ qemuDomainObjPrivateXMLFormat(virBuffer *buf,
                           priv->originalMemlock);
     }
 
+    if (priv->preMigrationMemlock > 0) {
+        virBufferAsprintf(buf,
+                          "<preMigrationMemlock>%llu</preMigrationMemlock>\n",
+                          priv->preMigrationMemlock);
+    }
+
     return 0;
 }
 
@@ -2771,6 +2815,8 @@ qemuDomainObjPrivateXMLParseBlockjobData(virDomainObj *vm,
     if (virXPathULongHex("string(./@jobflags)", ctxt, &jobflags) != 0)
         job->jobflagsmissing = true;
 
+    ignore_value(virXPathULongLong("string(./@bandwidth)", ctxt, &job->bandwidth));
+
     if (!disk && !invalidData) {
         if ((tmp = virXPathNode("./chains/disk", ctxt)) &&
             !(job->chain = qemuDomainObjPrivateXMLParseBlockjobChain(tmp, ctxt, xmlopt)))
@@ -3027,7 +3073,7 @@ qemuDomainObjPrivateXMLParse(xmlXPathContextPtr ctxt,
         for (i = 0; i < n; i++) {
             g_autofree char *str = virXMLPropString(nodes[i], "name");
             if (str) {
-                int flag = virQEMUCapsTypeFromString(str);
+                int flag = virQEMUCapsFlagFromString(str);
                 if (flag < 0) {
                     virReportError(VIR_ERR_INTERNAL_ERROR,
                                    _("Unknown qemu capabilities flag %s"), str);
@@ -3146,6 +3192,13 @@ qemuDomainObjPrivateXMLParse(xmlXPathContextPtr ctxt,
         return -1;
     }
 
+    if (virXPathULongLong("string(./preMigrationMemlock)", ctxt,
+                          &priv->preMigrationMemlock) == -2) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("failed to parse pre-migration memlock limit"));
+        return -1;
+    }
+
     return 0;
 }
 
@@ -3354,6 +3407,44 @@ qemuDomainDefNamespaceParseCaps(qemuDomainXmlNsDef *nsdef,
     return 0;
 }
 
+VIR_ENUM_IMPL(qemuDomainStartPhase,
+              QEMU_DOMAIN_START_PHASE_LAST,
+              "init",
+              "prepare-domain",
+              "prepare-host",
+              "command-line",
+              "spawn",
+              "namespace",
+              "cgroup",
+              "security",
+              "monitor",
+              "vcpus",
+              "devices",
+              "refresh",
+              "finish",
+             );
+
+
+/* Used as job names of the workers processing the events */
+VIR_ENUM_IMPL(qemuProcessEvent,
+              QEMU_PROCESS_EVENT_LAST,
+              "watchdog",
+              "guest-panic",
+              "device-deleted",
+              "nic-rx-filter-changed",
+              "serial-changed",
+              "block-job",
+              "job-status-change",
+              "monitor-eof",
+              "pr-disconnect",
+              "rdma-gid-status-changed",
+              "guest-crashloaded",
+              "memory-device-size-change",
+              "block-threshold",
+              "dirtyrate-sample",
+             );
+
+
 VIR_ENUM_IMPL(qemuDomainXmlNsOverride,
               QEMU_DOMAIN_XML_NS_OVERRIDE_LAST,
               "",
@@ -6039,17 +6130,167 @@ virDomainDefParserConfig virQEMUDriverDomainDefParserConfig = {
 };
 
 
+/**
+ * qemuDomainSaveStatusBarrier:
+ * @obj: domain object, locked
+ *
+ * Writes the status XML of @obj right away, superseding a write-back
+ * still pending for it. To be used wherever the status on disk must be
+ * current before the caller carries on, e.g. before QEMU is started or
+ * a migration proceeds, so that a restarted daemon finds it.
+ *
+ * Returns 0 on success, -1 with error reported otherwise.
+ */
+int
+qemuDomainSaveStatusBarrier(virDomainObj *obj)
+{
+    qemuDomainObjPrivate *priv = obj->privateData;
+    virQEMUDriver *driver = priv->driver;
+    g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(driver);
+    g_autoptr(GMutexLocker) locker = g_mutex_locker_new(&priv->statusLock);
+
+    priv->statusDirty = false;
+
+    return virDomainObjSave(obj, driver->xmlopt, cfg->stateDir);
+}
+
+
+/**
+ * qemuDomainSaveStatusSync:
+ * @obj: domain object, locked
+ *
+ * Same as qemuDomainSaveStatusBarrier for callers which can't fail:
+ * the status of inactive domains is not saved and errors only produce
+ * a warning.
+ */
+void
+qemuDomainSaveStatusSync(virDomainObj *obj)
+{
+    if (!virDomainObjIsActive(obj))
+        return;
+
+    if (qemuDomainSaveStatusBarrier(obj) < 0)
+        VIR_WARN("Failed to save status on vm %s", obj->def->name);
+}
+
+
+/**
+ * qemuDomainSaveStatus:
+ * @obj: domain object, locked
+ *
+ * Saves the status XML of @obj. With status_write_back enabled in
+ * qemu.conf the domain is only marked dirty and the XML is written by
+ * the status writer thread later, so that a sequence of updates, as
+ * done by hotplug or block jobs, results in a single write. Otherwise
+ * the status is written synchronously.
+ */
 void
 qemuDomainSaveStatus(virDomainObj *obj)
 {
     qemuDomainObjPrivate *priv = obj->privateData;
     virQEMUDriver *driver = priv->driver;
+
+    if (!virDomainObjIsActive(obj))
+        return;
+
+    if (!driver->statusPool) {
+        qemuDomainSaveStatusSync(obj);
+        return;
+    }
+
+    priv->statusDirty = true;
+
+    if (priv->statusQueued)
+        return;
+
+    virObjectRef(obj);
+    if (virThreadPoolSendJob(driver->statusPool, 0, obj) < 0) {
+        virObjectUnref(obj);
+        virResetLastError();
+        qemuDomainSaveStatusSync(obj);
+        return;
+    }
+
+    priv->statusQueued = true;
+}
+
+
+/*
+ * Runs in the status writer pool and inherits a reference to @jobdata
+ * domain object. The XML is formatted under the domain lock, but
+ * written after releasing it. @statusLock is taken before that so that
+ * a barrier or removal of the status file can't race with the write.
+ */
+void
+qemuDomainSaveStatusWorker(void *jobdata,
+                           void *opaque)
+{
+    virDomainObj *obj = jobdata;
+    virQEMUDriver *driver = opaque;
+    qemuDomainObjPrivate *priv = obj->privateData;
     g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(driver);
+    g_autofree char *xml = NULL;
+    g_autofree char *name = NULL;
+    unsigned char uuid[VIR_UUID_BUFLEN];
+
+    virObjectLock(obj);
+
+    priv->statusQueued = false;
+
+    if (!priv->statusDirty || !virDomainObjIsActive(obj)) {
+        priv->statusDirty = false;
+        virDomainObjEndAPI(&obj);
+        return;
+    }
+
+    priv->statusDirty = false;
 
-    if (virDomainObjIsActive(obj)) {
-        if (virDomainObjSave(obj, driver->xmlopt, cfg->stateDir) < 0)
-            VIR_WARN("Failed to save status on vm %s", obj->def->name);
+    if (!(xml = virDomainObjFormatStatus(obj, driver->xmlopt))) {
+        VIR_WARN("Failed to save status on vm %s", obj->def->name);
+        virDomainObjEndAPI(&obj);
+        return;
     }
+
+    name = g_strdup(obj->def->name);
+    memcpy(uuid, obj->def->uuid, VIR_UUID_BUFLEN);
+
+    g_mutex_lock(&priv->statusLock);
+    virObjectUnlock(obj);
+
+    if (virDomainSaveXML(name, uuid, cfg->stateDir, xml) < 0)
+        VIR_WARN("Failed to save status on vm %s", name);
+
+    g_mutex_unlock(&priv->statusLock);
+    virObjectUnref(obj);
+}
+
+
+static int
+qemuDomainSaveStatusFlushOne(virDomainObj *obj,
+                             void *opaque G_GNUC_UNUSED)
+{
+    qemuDomainObjPrivate *priv = obj->privateData;
+    VIR_LOCK_GUARD lock = virObjectLockGuard(obj);
+
+    if (priv->statusDirty)
+        qemuDomainSaveStatusSync(obj);
+
+    return 0;
+}
+
+
+/**
+ * qemuDomainSaveStatusFlushAll:
+ * @driver: qemu driver
+ *
+ * Writes status XML of all domains with a write-back still pending.
+ * Must be called once the status writer pool is gone.
+ */
+void
+qemuDomainSaveStatusFlushAll(virQEMUDriver *driver)
+{
+    virDomainObjListForEach(driver->domains, false,
+                            qemuDomainSaveStatusFlushOne, NULL);
 }
 
 
@@ -6504,10 +6745,13 @@ qemuDomainDefFormatXMLInternal(virQEMUDriver *driver,
                                virQEMUCaps *qemuCaps,
                                virDomainDef *def,
                                virCPUDef *origCPU,
-                               unsigned int flags)
+                               unsigned int flags,
+                               size_t sizeHint)
 {
     g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
 
+    virBufferSizeHint(&buf, sizeHint);
+
     if (qemuDomainDefFormatBufInternal(driver, qemuCaps, def, origCPU, flags, &buf) < 0)
         return NULL;
 
@@ -6521,7 +6765,7 @@ qemuDomainDefFormatXML(virQEMUDriver *driver,
                        virDomainDef *def,
                        unsigned int flags)
 {
-    return qemuDomainDefFormatXMLInternal(driver, qemuCaps, def, NULL, flags);
+    return qemuDomainDefFormatXMLInternal(driver, qemuCaps, def, NULL, flags, 0);
 }
 
 
@@ -6532,6 +6776,7 @@ char *qemuDomainFormatXML(virQEMUDriver *driver,
     virDomainDef *def;
     qemuDomainObjPrivate *priv = vm->privateData;
     virCPUDef *origCPU = NULL;
+    char *xml;
 
     if ((flags & VIR_DOMAIN_XML_INACTIVE) && vm->newDef) {
         def = vm->newDef;
@@ -6540,7 +6785,13 @@ char *qemuDomainFormatXML(virQEMUDriver *driver,
         origCPU = priv->origCPU;
     }
 
-    return qemuDomainDefFormatXMLInternal(driver, priv->qemuCaps, def, origCPU, flags);
+    if (!(xml = qemuDomainDefFormatXMLInternal(driver, priv->qemuCaps, def,
+                                               origCPU, flags,
+                                               vm->formatSizeHint)))
+        return NULL;
+
+    vm->formatSizeHint = strlen(xml);
+    return xml;
 }
 
 char *
@@ -6558,7 +6809,7 @@ qemuDomainDefFormatLive(virQEMUDriver *driver,
     if (compatible)
         flags |= VIR_DOMAIN_XML_MIGRATABLE;
 
-    return qemuDomainDefFormatXMLInternal(driver, qemuCaps, def, origCPU, flags);
+    return qemuDomainDefFormatXMLInternal(driver, qemuCaps, def, origCPU, flags, 0);
 }
 
 
@@ -7747,7 +7998,12 @@ qemuDomainDetermineDiskChain(virQEMUDriver *driver,
     src = disksrc;
     /* skip to the end of the chain if there is any */
     while (virStorageSourceHasBacking(src)) {
-        if (report_broken) {
+        /* read-only backing layers may be trusted to exist, qemu reports
+         * them as broken when opening the chain otherwise */
+        bool trusted = src != disksrc && src->readonly &&
+                       cfg->backingChainTrustReadonly;
+
+        if (report_broken && !trusted) {
             int rv = virStorageSourceSupportsAccess(src);
 
             if (rv < 0)
@@ -9463,6 +9719,61 @@ qemuDomainGetMemLockLimitBytes(virDomainDef *def,
 }
 
 
+/**
+ * qemuDomainSetMaxMemLock:
+ * @vm: domain
+ * @limit: the desired memory locking limit
+ * @origPtr: where to store or restore the original memory locking limit
+ *
+ * Set the memory locking limit for @vm unless it's already big enough. If
+ * @origPtr is non-NULL, the original value of the limit will be store there
+ * and can be restored by calling this function with @limit == 0.
+ *
+ * Returns: 0 on success, -1 otherwise.
+ */
+int
+qemuDomainSetMaxMemLock(virDomainObj *vm,
+                        unsigned long long limit,
+                        unsigned long long *origPtr)
+{
+    unsigned long long current = 0;
+
+    if (virProcessGetMaxMemLock(vm->pid, &current) < 0)
+        return -1;
+
+    if (limit > 0) {
+        VIR_DEBUG("Requested memory lock limit: %llu", limit);
+        /* If the limit is already high enough, we can assume
+         * that some external process is taking care of managing
+         * process limits and we shouldn't do anything ourselves:
+         * we're probably running in a containerized environment
+         * where we don't have enough privilege anyway */
+        if (current >= limit) {
+            VIR_DEBUG("Current limit %llu is big enough", current);
+            return 0;
+        }
+
+        /* If this is the first time adjusting the limit, save the current
+         * value so that we can restore it once memory locking is no longer
+         * required */
+        if (*origPtr == 0)
+            *origPtr = current;
+    } else {
+        /* Once memory locking is no longer required, we can restore the
+         * original, usually very low, limit. But only if we actually stored
+         * the original limit before. */
+        if (*origPtr == 0)
+            return 0;
+
+        limit = *origPtr;
+        *origPtr = 0;
+        VIR_DEBUG("Resetting memory lock limit back to %llu", limit);
+    }
+
+    return virProcessSetMaxMemLock(vm->pid, limit);
+}
+
+
 /**
  * qemuDomainAdjustMaxMemLock:
  * @vm: domain
@@ -9484,43 +9795,9 @@ int
 qemuDomainAdjustMaxMemLock(virDomainObj *vm,
                            bool forceVFIO)
 {
-    qemuDomainObjPrivate *priv = vm->privateData;
-    unsigned long long currentMemLock = 0;
-    unsigned long long desiredMemLock = 0;
-
-    desiredMemLock = qemuDomainGetMemLockLimitBytes(vm->def, forceVFIO);
-    if (virProcessGetMaxMemLock(vm->pid, &currentMemLock) < 0)
-        return -1;
-
-    if (desiredMemLock > 0) {
-        if (currentMemLock < desiredMemLock) {
-            /* If this is the first time adjusting the limit, save the current
-             * value so that we can restore it once memory locking is no longer
-             * required */
-            if (priv->originalMemlock == 0) {
-                priv->originalMemlock = currentMemLock;
-            }
-        } else {
-            /* If the limit is already high enough, we can assume
-             * that some external process is taking care of managing
-             * process limits and we shouldn't do anything ourselves:
-             * we're probably running in a containerized environment
-             * where we don't have enough privilege anyway */
-            desiredMemLock = 0;
-        }
-    } else {
-        /* Once memory locking is no longer required, we can restore the
-         * original, usually very low, limit */
-        desiredMemLock = priv->originalMemlock;
-        priv->originalMemlock = 0;
-    }
-
-    if (desiredMemLock > 0 &&
-        virProcessSetMaxMemLock(vm->pid, desiredMemLock) < 0) {
-        return -1;
-    }
-
-    return 0;
+    return qemuDomainSetMaxMemLock(vm,
+                                   qemuDomainGetMemLockLimitBytes(vm->def, forceVFIO),
+                                   &QEMU_DOMAIN_PRIVATE(vm)->originalMemlock);
 }
 
 
@@ -11106,6 +11383,7 @@ qemuProcessEventFree(struct qemuProcessEvent *event)
     case QEMU_PROCESS_EVENT_BLOCK_JOB:
     case QEMU_PROCESS_EVENT_MONITOR_EOF:
     case QEMU_PROCESS_EVENT_GUEST_CRASHLOADED:
+    case QEMU_PROCESS_EVENT_BLOCK_THRESHOLD:
         g_free(event->data);
         break;
     case QEMU_PROCESS_EVENT_JOB_STATUS_CHANGE:
@@ -11115,6 +11393,7 @@ qemuProcessEventFree(struct qemuProcessEvent *event)
         qemuMonitorMemoryDeviceSizeChangeFree(event->data);
         break;
     case QEMU_PROCESS_EVENT_PR_DISCONNECT:
+    case QEMU_PROCESS_EVENT_DIRTYRATE_SAMPLE:
     case QEMU_PROCESS_EVENT_LAST:
         break;
     }
@@ -44,6 +44,7 @@
 #include "virdomainmomentobjlist.h"
 #include "virenum.h"
 #include "vireventthread.h"
+#include "virsecret.h"
 
 #define QEMU_DOMAIN_FORMAT_LIVE_FLAGS \
     (VIR_DOMAIN_XML_SECURE)
@@ -62,6 +63,12 @@ typedef void (*qemuDomainCleanupCallback)(virQEMUDriver *driver,
 #define QEMU_DOMAIN_MASTER_KEY_LEN 32  /* 32 bytes for 256 bit random key */
 
 void qemuDomainSaveStatus(virDomainObj *obj);
+void qemuDomainSaveStatusSync(virDomainObj *obj);
+int qemuDomainSaveStatusBarrier(virDomainObj *obj)
+    G_GNUC_WARN_UNUSED_RESULT;
+void qemuDomainSaveStatusWorker(void *jobdata,
+                                void *opaque);
+void qemuDomainSaveStatusFlushAll(virQEMUDriver *driver);
 void qemuDomainSaveConfig(virDomainObj *obj);
 
 
@@ -74,7 +81,7 @@ typedef enum {
 
 typedef struct _qemuDomainUnpluggingDevice qemuDomainUnpluggingDevice;
 struct _qemuDomainUnpluggingDevice {
-    const char *alias;
+    char *alias;
     qemuDomainUnpluggingDeviceStatus status;
     bool eventSeen; /* True if DEVICE_DELETED event arrived. */
 };
@@ -98,6 +105,44 @@ struct _qemuDomainSecretInfo {
     char *ciphertext; /* encoded/encrypted secret */
 };
 
+typedef struct _qemuDomainStatsCacheEntry qemuDomainStatsCacheEntry;
+struct _qemuDomainStatsCacheEntry {
+    unsigned int stats;         /* single stats group (virDomainStatsTypes) */
+    unsigned int flags;         /* qemuDomainStatsFlags used for collection */
+    gint64 timestamp;           /* g_get_monotonic_time() of collection */
+    virTypedParameterPtr params;
+    size_t nparams;
+};
+
+/* Phases of qemuProcessStart in the order they happen */
+typedef enum {
+    QEMU_DOMAIN_START_PHASE_INIT,
+    QEMU_DOMAIN_START_PHASE_PREPARE_DOMAIN,
+    QEMU_DOMAIN_START_PHASE_PREPARE_HOST,
+    QEMU_DOMAIN_START_PHASE_COMMAND_LINE,
+    QEMU_DOMAIN_START_PHASE_SPAWN,
+    QEMU_DOMAIN_START_PHASE_NAMESPACE,
+    QEMU_DOMAIN_START_PHASE_CGROUP,
+    QEMU_DOMAIN_START_PHASE_SECURITY,
+    QEMU_DOMAIN_START_PHASE_MONITOR,
+    QEMU_DOMAIN_START_PHASE_VCPUS,
+    QEMU_DOMAIN_START_PHASE_DEVICES,
+    QEMU_DOMAIN_START_PHASE_REFRESH,
+    QEMU_DOMAIN_START_PHASE_FINISH,
+
+    QEMU_DOMAIN_START_PHASE_LAST
+} qemuDomainStartPhase;
+VIR_ENUM_DECL(qemuDomainStartPhase);
+
+typedef struct _qemuDomainDirtyRateSample qemuDomainDirtyRateSample;
+struct _qemuDomainDirtyRateSample {
+    long long startTime;
+    int calcTime;
+    long long dirtyRate; /* MiB/s */
+};
+
+#define QEMU_DOMAIN_DIRTYRATE_HISTORY 16
+
 typedef struct _qemuDomainObjPrivate qemuDomainObjPrivate;
 struct _qemuDomainObjPrivate {
     virQEMUDriver *driver;
@@ -112,6 +157,13 @@ struct _qemuDomainObjPrivate {
     virDomainChrSourceDef *monConfig;
     bool monError;
     unsigned long long monStart;
+
+    /* The domain is queued in the reconnect pool after daemon restart and
+     * nothing else may touch it until the reconnect begins. */
+    bool reconnectPending;
+    /* The reconnect was queued once more as a priority job */
+    bool reconnectPrioritized;
+
     int agentTimeout;
 
     qemuAgent *agent;
@@ -154,7 +206,9 @@ struct _qemuDomainObjPrivate {
 
     virPerf *perf;
 
-    qemuDomainUnpluggingDevice unplug;
+    /* devices whose removal the current job is waiting for */
+    qemuDomainUnpluggingDevice *unplug;
+    size_t nunplug;
 
     char **qemuDevices; /* NULL-terminated list of devices aliases known to QEMU */
 
@@ -177,6 +231,9 @@ struct _qemuDomainObjPrivate {
     uint8_t *masterKey;
     size_t masterKeyLen;
 
+    /* secrets fetched while preparing the domain for startup */
+    virSecretCache *secretCache;
+
     /* note whether memory device alias does not correspond to slot number */
     bool memAliasOrderMismatch;
 
@@ -245,6 +302,45 @@ struct _qemuDomainObjPrivate {
 
     unsigned long long originalMemlock; /* Original RLIMIT_MEMLOCK, zero if no
                                          * restore will be required later */
+    unsigned long long preMigrationMemlock; /* Original RLIMIT_MEMLOCK in case
+                                               it was changed for the current
+                                               migration job. */
+
+    /* bulk stats cached for callers passing
+     * VIR_CONNECT_GET_ALL_DOMAINS_STATS_CACHED */
+    qemuDomainStatsCacheEntry *statsCache;
+    size_t nstatsCache;
+
+    /* Status XML write-back, see qemuDomainSaveStatus. The flags are
+     * protected by the domain lock, @statusLock serializes writes and
+     * removal of the status file and nests inside the domain lock */
+    bool statusDirty;
+    bool statusQueued;
+    GMutex statusLock;
+
+    /* Duration of the phases of the start of the domain in microseconds, see
+     * qemuProcessStartPhaseEnd. Not kept across restarts of the daemon, in
+     * which case @startPhaseBegin is 0 */
+    unsigned long long startPhases[QEMU_DOMAIN_START_PHASE_LAST];
+    unsigned long long startPhaseBegin; /* g_get_monotonic_time() */
+    unsigned long long startBegin;
+
+    /* Background dirty rate calculation, see
+     * qemuProcessStartDirtyRateSampling. @dirtyRateTimer is 0 if it's not
+     * running. @dirtyRateHistory is a ring buffer of the last
+     * @ndirtyRateHistory results, the newest one is just before
+     * @dirtyRateHistoryNext */
+    int dirtyRateTimer;
+    int dirtyRatePeriod;
+    qemuMonitorDirtyRateCalcMode dirtyRateMode;
+    qemuDomainDirtyRateSample dirtyRateHistory[QEMU_DOMAIN_DIRTYRATE_HISTORY];
+    size_t ndirtyRateHistory;
+    size_t dirtyRateHistoryNext;
+
+    /* true if the domain is counted in virQEMUDriver's @npollTuned and
+     * @nautosized respectively */
+    bool pollTuned;
+    bool autosized;
 };
 
 #define QEMU_DOMAIN_PRIVATE(vm) \
@@ -322,6 +418,10 @@ struct _qemuDomainVcpuPrivate {
     int vcpus;
 
     char *qomPath;
+
+    /* per-vCPU perf events, counting the thread @perfTid */
+    virPerf *perf;
+    pid_t perfTid;
 };
 
 #define QEMU_DOMAIN_VCPU_PRIVATE(vcpu) \
@@ -426,9 +526,12 @@ typedef enum {
     QEMU_PROCESS_EVENT_RDMA_GID_STATUS_CHANGED,
     QEMU_PROCESS_EVENT_GUEST_CRASHLOADED,
     QEMU_PROCESS_EVENT_MEMORY_DEVICE_SIZE_CHANGE,
+    QEMU_PROCESS_EVENT_BLOCK_THRESHOLD,
+    QEMU_PROCESS_EVENT_DIRTYRATE_SAMPLE,
 
     QEMU_PROCESS_EVENT_LAST
 } qemuProcessEventType;
+VIR_ENUM_DECL(qemuProcessEvent);
 
 struct qemuProcessEvent {
     virDomainObj *vm;
@@ -769,6 +872,8 @@ void qemuDomainCleanupRemove(virDomainObj *vm,
 void qemuDomainCleanupRun(virQEMUDriver *driver,
                           virDomainObj *vm);
 
+void qemuDomainStatsCacheClear(qemuDomainObjPrivate *priv);
+
 void qemuDomainObjPrivateDataClear(qemuDomainObjPrivate *priv);
 
 extern virDomainXMLPrivateDataCallbacks virQEMUDriverPrivateDataCallbacks;
@@ -836,6 +941,9 @@ unsigned long long qemuDomainGetMemLockLimitBytes(virDomainDef *def,
                                                   bool forceVFIO);
 int qemuDomainAdjustMaxMemLock(virDomainObj *vm,
                                bool forceVFIO);
+int qemuDomainSetMaxMemLock(virDomainObj *vm,
+                            unsigned long long limit,
+                            unsigned long long *origPtr);
 int qemuDomainAdjustMaxMemLockHostdev(virDomainObj *vm,
                                       virDomainHostdevDef *hostdev);
 
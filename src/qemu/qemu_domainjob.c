@@ -21,11 +21,18 @@
 #include "qemu_domain.h"
 #include "qemu_migration.h"
 #include "qemu_domainjob.h"
+#include "qemu_process.h"
 #include "viralloc.h"
 #include "virlog.h"
 #include "virerror.h"
 #include "virtime.h"
 #include "virthreadjob.h"
+#include "virhash.h"
+#include "virprobe.h"
+
+#ifdef WITH_DTRACE_PROBES
+# include "libvirt_qemu_probes.h"
+#endif
 
 #define VIR_FROM_THIS VIR_FROM_QEMU
 
@@ -42,9 +49,17 @@ static void *
 qemuJobDataCopyPrivateData(void *data)
 {
     qemuDomainJobDataPrivate *ret = g_new0(qemuDomainJobDataPrivate, 1);
+    qemuDomainMirrorStats *src = &((qemuDomainJobDataPrivate *) data)->mirrorStats;
+    size_t i;
 
     memcpy(ret, data, sizeof(qemuDomainJobDataPrivate));
 
+    ret->mirrorStats.disks = g_new0(qemuDomainMirrorDiskStats, src->ndisks);
+    for (i = 0; i < src->ndisks; i++) {
+        ret->mirrorStats.disks[i] = src->disks[i];
+        ret->mirrorStats.disks[i].disk = g_strdup(src->disks[i].disk);
+    }
+
     return ret;
 }
 
@@ -52,7 +67,23 @@ qemuJobDataCopyPrivateData(void *data)
 static void
 qemuJobDataFreePrivateData(void *data)
 {
-    g_free(data);
+    qemuDomainJobDataPrivate *priv = data;
+
+    qemuDomainMirrorStatsClear(&priv->mirrorStats);
+    g_free(priv);
+}
+
+
+void
+qemuDomainMirrorStatsClear(qemuDomainMirrorStats *stats)
+{
+    size_t i;
+
+    for (i = 0; i < stats->ndisks; i++)
+        g_free(stats->disks[i].disk);
+    g_free(stats->disks);
+
+    memset(stats, 0, sizeof(*stats));
 }
 
 
@@ -172,6 +203,333 @@ qemuDomainObjInitJob(qemuDomainJobObj *job,
         return -1;
     }
 
+    job->lockStats = g_new0(qemuDomainJobLockStats, 1);
+    job->lockStats->apis = virHashNew(g_free);
+
+    return 0;
+}
+
+
+static void
+qemuDomainJobLockStatsFree(qemuDomainJobLockStats *stats)
+{
+    if (!stats)
+        return;
+
+    g_hash_table_unref(stats->apis);
+    g_free(stats->waiters);
+    g_free(stats);
+}
+
+
+static void
+qemuDomainJobLockHistogramAdd(qemuDomainJobLockHistogram *hist,
+                              unsigned long long duration)
+{
+    size_t i = 0;
+
+    while (i < QEMU_DOMAIN_JOB_LOCK_BUCKETS - 1 && duration >= (1ULL << i))
+        i++;
+
+    hist->count++;
+    hist->sum += duration;
+    hist->max = MAX(hist->max, duration);
+    hist->buckets[i]++;
+}
+
+
+static qemuDomainJobLockCounters *
+qemuDomainJobLockStatsGetAPI(qemuDomainJobLockStats *stats,
+                             const char *api)
+{
+    qemuDomainJobLockCounters *counters;
+
+    if (!api)
+        return NULL;
+
+    if (!(counters = g_hash_table_lookup(stats->apis, api))) {
+        counters = g_new0(qemuDomainJobLockCounters, 1);
+        g_hash_table_insert(stats->apis, g_strdup(api), counters);
+    }
+
+    return counters;
+}
+
+
+/*
+ * Record that @api waited @duration milliseconds for a job of @type, or
+ * gave up waiting if @timeout is true.
+ */
+static void
+qemuDomainJobLockStatsWait(qemuDomainJobObj *job,
+                           virDomainJob type,
+                           const char *api,
+                           unsigned long long duration,
+                           bool timeout)
+{
+    qemuDomainJobLockCounters *counters[2];
+    size_t i;
+
+    if (!job->lockStats)
+        return;
+
+    counters[0] = &job->lockStats->types[type];
+    counters[1] = qemuDomainJobLockStatsGetAPI(job->lockStats, api);
+
+    for (i = 0; i < G_N_ELEMENTS(counters) && counters[i]; i++) {
+        if (timeout)
+            counters[i]->timeouts++;
+        else
+            qemuDomainJobLockHistogramAdd(&counters[i]->wait, duration);
+    }
+}
+
+
+/*
+ * Record that @api held a job of @type since @started, which it's about
+ * to end.
+ */
+static void
+qemuDomainJobLockStatsHold(qemuDomainJobObj *job,
+                           virDomainJob type,
+                           const char *api,
+                           unsigned long long started)
+{
+    qemuDomainJobLockCounters *counters;
+    unsigned long long now;
+
+    if (!job->lockStats || !started ||
+        virTimeMillisNow(&now) < 0 || now < started)
+        return;
+
+    qemuDomainJobLockHistogramAdd(&job->lockStats->types[type].hold,
+                                  now - started);
+    if ((counters = qemuDomainJobLockStatsGetAPI(job->lockStats, api)))
+        qemuDomainJobLockHistogramAdd(&counters->hold, now - started);
+}
+
+
+static void
+qemuDomainObjEndJobProbe(virDomainObj *obj,
+                         const char *kind,
+                         const char *job,
+                         const char *api,
+                         unsigned long long started)
+{
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
+    unsigned long long now;
+
+    if (!started || virTimeMillisNow(&now) < 0 || now < started)
+        return;
+
+    virUUIDFormat(obj->def->uuid, uuidstr);
+    PROBE(QEMU_JOB_END,
+          "uuid=%s kind=%s job=%s api=%s held_ms=%llu",
+          uuidstr, kind, job, NULLSTR(api), now - started);
+}
+
+
+static void
+qemuDomainJobLockWaiterAdd(qemuDomainJobObj *job,
+                           qemuDomainJobLockWaiter *waiter)
+{
+    if (!job->lockStats)
+        return;
+
+    VIR_APPEND_ELEMENT_COPY(job->lockStats->waiters,
+                            job->lockStats->nwaiters, waiter);
+}
+
+
+static void
+qemuDomainJobLockWaiterRemove(qemuDomainJobObj *job,
+                              qemuDomainJobLockWaiter *waiter)
+{
+    size_t i;
+
+    if (!job->lockStats)
+        return;
+
+    for (i = 0; i < job->lockStats->nwaiters; i++) {
+        if (job->lockStats->waiters[i] == waiter) {
+            VIR_DELETE_ELEMENT(job->lockStats->waiters, i,
+                               job->lockStats->nwaiters);
+            return;
+        }
+    }
+}
+
+
+static const char *
+qemuDomainJobLockTypeToString(virDomainJob type)
+{
+    switch (type) {
+    case VIR_JOB_NONE:
+        return "agent";
+    case VIR_JOB_ASYNC:
+        return "async";
+    case VIR_JOB_QUERY:
+    case VIR_JOB_DESTROY:
+    case VIR_JOB_SUSPEND:
+    case VIR_JOB_MODIFY:
+    case VIR_JOB_ABORT:
+    case VIR_JOB_MIGRATION_OP:
+    case VIR_JOB_ASYNC_NESTED:
+    case VIR_JOB_LAST:
+        break;
+    }
+
+    return virDomainJobTypeToString(type);
+}
+
+
+static bool
+qemuDomainJobLockCountersUsed(qemuDomainJobLockCounters *counters)
+{
+    return counters->wait.count || counters->hold.count || counters->timeouts;
+}
+
+
+static int
+qemuDomainJobLockHistogramToParams(virTypedParamList *params,
+                                   qemuDomainJobLockHistogram *hist,
+                                   bool buckets,
+                                   const char *prefix)
+{
+    size_t i;
+
+    if (virTypedParamListAddULLong(params, hist->count, "%s.count", prefix) < 0 ||
+        virTypedParamListAddULLong(params, hist->sum, "%s.sum", prefix) < 0 ||
+        virTypedParamListAddULLong(params, hist->max, "%s.max", prefix) < 0)
+        return -1;
+
+    if (!buckets)
+        return 0;
+
+    for (i = 0; i < QEMU_DOMAIN_JOB_LOCK_BUCKETS; i++) {
+        if (virTypedParamListAddULLong(params, hist->buckets[i],
+                                       "%s.bucket.%zu", prefix, i) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+qemuDomainJobLockCountersToParams(virTypedParamList *params,
+                                  qemuDomainJobLockCounters *counters,
+                                  bool buckets,
+                                  const char *prefix)
+{
+    g_autofree char *wait = g_strdup_printf("%s.wait", prefix);
+    g_autofree char *hold = g_strdup_printf("%s.hold", prefix);
+
+    if (qemuDomainJobLockHistogramToParams(params, &counters->wait,
+                                           buckets, wait) < 0 ||
+        qemuDomainJobLockHistogramToParams(params, &counters->hold,
+                                           buckets, hold) < 0 ||
+        virTypedParamListAddULLong(params, counters->timeouts,
+                                   "%s.timeouts", prefix) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+/**
+ * qemuDomainJobLockStatsToParams:
+ * @job: job object of a domain, which must be locked
+ * @params: list to add the "joblock.*" statistics to
+ *
+ * Reports how long jobs of every type and every API waited for and held
+ * the job of the domain, and who waits for it right now. The per API
+ * statistics are without histograms to keep the list short.
+ *
+ * Returns 0 on success, -1 otherwise.
+ */
+int
+qemuDomainJobLockStatsToParams(qemuDomainJobObj *job,
+                               virTypedParamList *params)
+{
+    qemuDomainJobLockStats *stats = job->lockStats;
+    g_autofree virHashKeyValuePair *apis = NULL;
+    unsigned long long now;
+    size_t ntypes = 0;
+    size_t napis = 0;
+    size_t n;
+    size_t i;
+
+    if (!stats)
+        return 0;
+
+    if (virTimeMillisNow(&now) < 0)
+        return -1;
+
+    for (i = 0; i < VIR_JOB_LAST; i++) {
+        if (qemuDomainJobLockCountersUsed(&stats->types[i]))
+            ntypes++;
+    }
+
+    if (virTypedParamListAddUInt(params, ntypes, "joblock.type.count") < 0)
+        return -1;
+
+    for (i = 0, n = 0; i < VIR_JOB_LAST; i++) {
+        g_autofree char *prefix = NULL;
+
+        if (!qemuDomainJobLockCountersUsed(&stats->types[i]))
+            continue;
+
+        prefix = g_strdup_printf("joblock.type.%zu", n);
+
+        if (virTypedParamListAddString(params, qemuDomainJobLockTypeToString(i),
+                                       "%s.name", prefix) < 0 ||
+            qemuDomainJobLockCountersToParams(params, &stats->types[i],
+                                              true, prefix) < 0)
+            return -1;
+        n++;
+    }
+
+    apis = virHashGetItems(stats->apis, &napis, true);
+
+    if (virTypedParamListAddUInt(params, napis, "joblock.api.count") < 0)
+        return -1;
+
+    for (i = 0; i < napis; i++) {
+        g_autofree char *prefix = g_strdup_printf("joblock.api.%zu", i);
+
+        if (virTypedParamListAddString(params, apis[i].key,
+                                       "%s.name", prefix) < 0 ||
+            qemuDomainJobLockCountersToParams(params,
+                                              (qemuDomainJobLockCounters *) apis[i].value,
+                                              false, prefix) < 0)
+            return -1;
+    }
+
+    if (virTypedParamListAddUInt(params, stats->nwaiters,
+                                 "joblock.waiter.count") < 0)
+        return -1;
+
+    for (i = 0; i < stats->nwaiters; i++) {
+        qemuDomainJobLockWaiter *waiter = stats->waiters[i];
+
+        if (virTypedParamListAddString(params, NULLSTR(waiter->api),
+                                       "joblock.waiter.%zu.api", i) < 0 ||
+            virTypedParamListAddString(params,
+                                       virDomainJobTypeToString(waiter->job),
+                                       "joblock.waiter.%zu.job", i) < 0 ||
+            virTypedParamListAddString(params,
+                                       virDomainAgentJobTypeToString(waiter->agentJob),
+                                       "joblock.waiter.%zu.agent_job", i) < 0 ||
+            virTypedParamListAddString(params,
+                                       virDomainAsyncJobTypeToString(waiter->asyncJob),
+                                       "joblock.waiter.%zu.async_job", i) < 0 ||
+            virTypedParamListAddULLong(params,
+                                       now > waiter->since ? now - waiter->since : 0,
+                                       "joblock.waiter.%zu.time", i) < 0)
+            return -1;
+    }
+
     return 0;
 }
 
@@ -251,6 +609,8 @@ qemuDomainObjClearJob(qemuDomainJobObj *job)
 
     if (job->cb)
         g_clear_pointer(&job->privateData, job->cb->freeJobPrivate);
+
+    g_clear_pointer(&job->lockStats, qemuDomainJobLockStatsFree);
 }
 
 bool
@@ -498,6 +858,38 @@ qemuDomainMigrationJobDataToParams(virDomainJobData *jobData,
                                 stats->disk_bps) < 0)
         goto error;
 
+    if (mirrorStats->ndisks > 0) {
+        size_t i;
+
+        if (virTypedParamsAddUInt(&par, &npar, &maxpar,
+                                  VIR_DOMAIN_JOB_MIRROR_COUNT,
+                                  mirrorStats->ndisks) < 0)
+            goto error;
+
+        for (i = 0; i < mirrorStats->ndisks; i++) {
+            qemuDomainMirrorDiskStats *disk = mirrorStats->disks + i;
+            char field[VIR_TYPED_PARAM_FIELD_LENGTH];
+
+            g_snprintf(field, sizeof(field), VIR_DOMAIN_JOB_MIRROR_PREFIX "%zu"
+                       VIR_DOMAIN_JOB_MIRROR_SUFFIX_DISK, i);
+            if (virTypedParamsAddString(&par, &npar, &maxpar,
+                                        field, disk->disk) < 0)
+                goto error;
+
+            g_snprintf(field, sizeof(field), VIR_DOMAIN_JOB_MIRROR_PREFIX "%zu"
+                       VIR_DOMAIN_JOB_MIRROR_SUFFIX_TOTAL, i);
+            if (virTypedParamsAddULLong(&par, &npar, &maxpar,
+                                        field, disk->total) < 0)
+                goto error;
+
+            g_snprintf(field, sizeof(field), VIR_DOMAIN_JOB_MIRROR_PREFIX "%zu"
+                       VIR_DOMAIN_JOB_MIRROR_SUFFIX_PROCESSED, i);
+            if (virTypedParamsAddULLong(&par, &npar, &maxpar,
+                                        field, disk->transferred) < 0)
+                goto error;
+        }
+    }
+
     if (stats->xbzrle_set) {
         if (virTypedParamsAddULLong(&par, &npar, &maxpar,
                                     VIR_DOMAIN_JOB_COMPRESSION_CACHE,
@@ -694,7 +1086,7 @@ qemuDomainObjSetJobPhase(virDomainObj *obj,
 
     priv->job.phase = phase;
     priv->job.asyncOwner = me;
-    qemuDomainSaveStatus(obj);
+    qemuDomainSaveStatusSync(obj);
 }
 
 void
@@ -717,7 +1109,7 @@ qemuDomainObjDiscardAsyncJob(virDomainObj *obj)
     if (priv->job.active == VIR_JOB_ASYNC_NESTED)
         qemuDomainObjResetJob(&priv->job);
     qemuDomainObjResetAsyncJob(&priv->job);
-    qemuDomainSaveStatus(obj);
+    qemuDomainSaveStatusSync(obj);
 }
 
 void
@@ -801,6 +1193,8 @@ qemuDomainObjBeginJobInternal(virQEMUDriver *driver,
     unsigned long long agentDuration = 0;
     unsigned long long asyncDuration = 0;
     const char *currentAPI = virThreadJobGet();
+    qemuDomainJobLockWaiter waiter = { currentAPI, job, agentJob, asyncJob, 0 };
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
 
     VIR_DEBUG("Starting job: API=%s job=%s agentJob=%s asyncJob=%s "
               "(vm=%p name=%s, current job=%s agentJob=%s async=%s)",
@@ -816,8 +1210,11 @@ qemuDomainObjBeginJobInternal(virQEMUDriver *driver,
     if (virTimeMillisNow(&now) < 0)
         return -1;
 
+    virUUIDFormat(obj->def->uuid, uuidstr);
     priv->job.jobsQueued++;
     then = now + QEMU_JOB_WAIT_TIME;
+    waiter.since = now;
+    qemuDomainJobLockWaiterAdd(&priv->job, &waiter);
 
  retry:
     if ((!async && job != VIR_JOB_DESTROY) &&
@@ -826,6 +1223,17 @@ qemuDomainObjBeginJobInternal(virQEMUDriver *driver,
         goto error;
     }
 
+    while (priv->reconnectPending) {
+        if (nowait)
+            goto cleanup;
+
+        qemuProcessReconnectPrioritize(driver, obj);
+
+        VIR_DEBUG("Waiting for reconnect (vm=%p name=%s)", obj, obj->def->name);
+        if (virCondWaitUntil(&priv->job.cond, &obj->parent.lock, then) < 0)
+            goto error;
+    }
+
     while (!nested && !qemuDomainNestedJobAllowed(&priv->job, job)) {
         if (nowait)
             goto cleanup;
@@ -850,9 +1258,6 @@ qemuDomainObjBeginJobInternal(virQEMUDriver *driver,
         goto retry;
 
     if (obj->removing) {
-        char uuidstr[VIR_UUID_STRING_BUFLEN];
-
-        virUUIDFormat(obj->def->uuid, uuidstr);
         virReportError(VIR_ERR_NO_DOMAIN,
                        _("no domain with matching uuid '%s' (%s)"),
                        uuidstr, obj->def->name);
@@ -902,8 +1307,18 @@ qemuDomainObjBeginJobInternal(virQEMUDriver *driver,
         priv->job.agentStarted = now;
     }
 
+    qemuDomainJobLockWaiterRemove(&priv->job, &waiter);
+    qemuDomainJobLockStatsWait(&priv->job, job, currentAPI,
+                               now - waiter.since, false);
+    PROBE(QEMU_JOB_BEGIN,
+          "uuid=%s job=%s agent_job=%s async_job=%s api=%s wait_ms=%llu",
+          uuidstr, virDomainJobTypeToString(job),
+          virDomainAgentJobTypeToString(agentJob),
+          virDomainAsyncJobTypeToString(asyncJob),
+          NULLSTR(currentAPI), now - waiter.since);
+
     if (qemuDomainTrackJob(job))
-        qemuDomainSaveStatus(obj);
+        qemuDomainSaveStatusSync(obj);
 
     return 0;
 
@@ -945,6 +1360,14 @@ qemuDomainObjBeginJobInternal(virQEMUDriver *driver,
         agentBlocker = priv->job.agentOwnerAPI;
 
     if (errno == ETIMEDOUT) {
+        qemuDomainJobLockStatsWait(&priv->job, job, currentAPI, 0, true);
+        PROBE(QEMU_JOB_TIMEOUT,
+              "uuid=%s job=%s agent_job=%s async_job=%s api=%s blocker=%s",
+              uuidstr, virDomainJobTypeToString(job),
+              virDomainAgentJobTypeToString(agentJob),
+              virDomainAsyncJobTypeToString(asyncJob),
+              NULLSTR(currentAPI), NULLSTR(blocker ? blocker : agentBlocker));
+
         if (blocker && agentBlocker) {
             virReportError(VIR_ERR_OPERATION_TIMEOUT,
                            _("cannot acquire state change "
@@ -996,6 +1419,7 @@ qemuDomainObjBeginJobInternal(virQEMUDriver *driver,
     }
 
  cleanup:
+    qemuDomainJobLockWaiterRemove(&priv->job, &waiter);
     priv->job.jobsQueued--;
     return ret;
 }
@@ -1123,6 +1547,10 @@ qemuDomainObjEndJob(virDomainObj *obj)
               virDomainAsyncJobTypeToString(priv->job.asyncJob),
               obj, obj->def->name);
 
+    qemuDomainJobLockStatsHold(&priv->job, job, priv->job.ownerAPI,
+                               priv->job.started);
+    qemuDomainObjEndJobProbe(obj, "job", virDomainJobTypeToString(job),
+                             priv->job.ownerAPI, priv->job.started);
     qemuDomainObjResetJob(&priv->job);
     if (qemuDomainTrackJob(job))
         qemuDomainSaveStatus(obj);
@@ -1144,6 +1572,11 @@ qemuDomainObjEndAgentJob(virDomainObj *obj)
               virDomainAsyncJobTypeToString(priv->job.asyncJob),
               obj, obj->def->name);
 
+    qemuDomainJobLockStatsHold(&priv->job, VIR_JOB_NONE,
+                               priv->job.agentOwnerAPI, priv->job.agentStarted);
+    qemuDomainObjEndJobProbe(obj, "agent",
+                             virDomainAgentJobTypeToString(agentJob),
+                             priv->job.agentOwnerAPI, priv->job.agentStarted);
     qemuDomainObjResetAgentJob(&priv->job);
     /* We indeed need to wake up ALL threads waiting because
      * grabbing a job requires checking more variables. */
@@ -1161,8 +1594,13 @@ qemuDomainObjEndAsyncJob(virDomainObj *obj)
               virDomainAsyncJobTypeToString(priv->job.asyncJob),
               obj, obj->def->name);
 
+    qemuDomainJobLockStatsHold(&priv->job, VIR_JOB_ASYNC,
+                               priv->job.asyncOwnerAPI, priv->job.asyncStarted);
+    qemuDomainObjEndJobProbe(obj, "async",
+                             virDomainAsyncJobTypeToString(priv->job.asyncJob),
+                             priv->job.asyncOwnerAPI, priv->job.asyncStarted);
     qemuDomainObjResetAsyncJob(&priv->job);
-    qemuDomainSaveStatus(obj);
+    qemuDomainSaveStatusSync(obj);
     virCondBroadcast(&priv->job.asyncCond);
 }
 
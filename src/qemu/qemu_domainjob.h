@@ -32,10 +32,20 @@ typedef enum {
 } qemuDomainJobStatsType;
 
 
+typedef struct _qemuDomainMirrorDiskStats qemuDomainMirrorDiskStats;
+struct _qemuDomainMirrorDiskStats {
+    char *disk; /* target of the mirrored disk */
+    unsigned long long transferred;
+    unsigned long long total;
+};
+
 typedef struct _qemuDomainMirrorStats qemuDomainMirrorStats;
 struct _qemuDomainMirrorStats {
     unsigned long long transferred;
     unsigned long long total;
+
+    size_t ndisks;
+    qemuDomainMirrorDiskStats *disks;
 };
 
 typedef struct _qemuDomainBackupStats qemuDomainBackupStats;
@@ -60,6 +70,47 @@ struct _qemuDomainJobDataPrivate {
 
 extern virDomainJobDataPrivateDataCallbacks qemuJobDataPrivateDataCallbacks;
 
+
+#define QEMU_DOMAIN_JOB_LOCK_BUCKETS 16
+
+/* Bucket <i> counts durations shorter than 2^i milliseconds which didn't
+ * fit into a smaller bucket, the last one also all the longer ones. */
+typedef struct _qemuDomainJobLockHistogram qemuDomainJobLockHistogram;
+struct _qemuDomainJobLockHistogram {
+    unsigned long long count;
+    unsigned long long sum;             /* in milliseconds */
+    unsigned long long max;             /* in milliseconds */
+    unsigned long long buckets[QEMU_DOMAIN_JOB_LOCK_BUCKETS];
+};
+
+typedef struct _qemuDomainJobLockCounters qemuDomainJobLockCounters;
+struct _qemuDomainJobLockCounters {
+    qemuDomainJobLockHistogram wait;    /* until the job was acquired */
+    qemuDomainJobLockHistogram hold;    /* from acquiring the job to its end */
+    unsigned long long timeouts;        /* jobs not acquired in time */
+};
+
+typedef struct _qemuDomainJobLockWaiter qemuDomainJobLockWaiter;
+struct _qemuDomainJobLockWaiter {
+    const char *api;
+    virDomainJob job;
+    virDomainAgentJob agentJob;
+    virDomainAsyncJob asyncJob;
+    unsigned long long since;
+};
+
+/* Contention of the jobs of a domain, kept while the daemon runs */
+typedef struct _qemuDomainJobLockStats qemuDomainJobLockStats;
+struct _qemuDomainJobLockStats {
+    /* Indexed by virDomainJob, VIR_JOB_NONE is used for agent jobs */
+    qemuDomainJobLockCounters types[VIR_JOB_LAST];
+    GHashTable *apis;                   /* API name -> qemuDomainJobLockCounters */
+
+    /* Threads waiting for a job, they own the entries */
+    qemuDomainJobLockWaiter **waiters;
+    size_t nwaiters;
+};
+
 typedef struct _qemuDomainJobObj qemuDomainJobObj;
 
 typedef void *(*qemuDomainObjPrivateJobAlloc)(void);
@@ -114,8 +165,12 @@ struct _qemuDomainJobObj {
 
     void *privateData;                  /* job specific collection of data */
     qemuDomainObjPrivateJobCallbacks *cb;
+
+    qemuDomainJobLockStats *lockStats;
 };
 
+void qemuDomainMirrorStatsClear(qemuDomainMirrorStats *stats);
+
 void qemuDomainJobSetStatsType(virDomainJobData *jobData,
                                qemuDomainJobStatsType type);
 
@@ -124,6 +179,9 @@ const char *qemuDomainAsyncJobPhaseToString(virDomainAsyncJob job,
 int qemuDomainAsyncJobPhaseFromString(virDomainAsyncJob job,
                                       const char *phase);
 
+int qemuDomainJobLockStatsToParams(qemuDomainJobObj *job,
+                                   virTypedParamList *params);
+
 void qemuDomainEventEmitJobCompleted(virQEMUDriver *driver,
                                      virDomainObj *vm);
 
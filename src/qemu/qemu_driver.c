@@ -40,16 +40,22 @@
 #include "qemu_capabilities.h"
 #include "qemu_command.h"
 #include "qemu_cgroup.h"
+#include "qemu_cpu_balancer.h"
+#include "qemu_firmware.h"
 #include "qemu_hostdev.h"
 #include "qemu_hotplug.h"
+#include "qemu_iothread_poll_tuner.h"
+#include "qemu_iotune_balancer.h"
 #include "qemu_monitor.h"
 #include "qemu_process.h"
 #include "qemu_migration.h"
 #include "qemu_migration_params.h"
 #include "qemu_blockjob.h"
+#include "qemu_blockjob_governor.h"
 #include "qemu_security.h"
 #include "qemu_checkpoint.h"
 #include "qemu_backup.h"
+#include "qemu_balloon_autosizer.h"
 #include "qemu_namespace.h"
 #include "qemu_saveimage.h"
 #include "qemu_snapshot.h"
@@ -107,14 +113,22 @@
 #include "virperf.h"
 #include "virnuma.h"
 #include "netdev_bandwidth_conf.h"
+#include "virprobe.h"
+#include "virthreadjob.h"
 #include "virqemu.h"
 #include "virdomainsnapshotobjlist.h"
 #include "virenum.h"
 #include "virdomaincheckpointobjlist.h"
 #include "virsocket.h"
+#include "vireventglibwatch.h"
 #include "virutil.h"
+#include "virtpm.h"
 #include "backup_conf.h"
 
+#ifdef WITH_DTRACE_PROBES
+# include "libvirt_qemu_probes.h"
+#endif
+
 #define VIR_FROM_THIS VIR_FROM_QEMU
 
 VIR_LOG_INIT("qemu.qemu_driver");
@@ -162,6 +176,13 @@ static int qemuDomainObjStart(virConnectPtr conn,
 static int qemuDomainManagedSaveLoad(virDomainObj *vm,
                                      void *opaque);
 
+static qemuDomainStatsPush *qemuDomainStatsPushNew(void);
+static void qemuDomainStatsPushFree(qemuDomainStatsPush *push);
+static void qemuDomainStatsPushGetPressureTriggers(qemuDomainStatsPush *push,
+                                                   const unsigned char *uuid,
+                                                   unsigned long long *triggers,
+                                                   bool *watched);
+
 static virQEMUDriver *qemu_driver;
 
 /* Looks up the domain object from snapshot and unlocks the
@@ -593,11 +614,17 @@ qemuStateInitialize(bool privileged,
     if (!(qemu_driver->domains = virDomainObjListNew()))
         goto error;
 
+    qemu_driver->busyCpus = virHashNew((GDestroyNotify) virBitmapFree);
+    qemu_driver->hugepageReservations = virHashNew((GDestroyNotify) g_array_unref);
+
     /* Init domain events */
     qemu_driver->domainEventState = virObjectEventStateNew();
     if (!qemu_driver->domainEventState)
         goto error;
 
+    if (!(qemu_driver->statsPush = qemuDomainStatsPushNew()))
+        goto error;
+
     /* read the host sysinfo */
     if (privileged)
         qemu_driver->hostsysinfo = virSysinfoRead();
@@ -831,6 +858,10 @@ qemuStateInitialize(bool privileged,
     if (!qemu_driver->qemuCapsCache)
         goto error;
 
+    /* don't make the first API call after an upgrade of QEMU wait for all
+     * binaries to be probed one after another */
+    virQEMUCapsCachePrefetch(qemu_driver->qemuCapsCache);
+
     if (!(sec_managers = qemuSecurityGetNested(qemu_driver->securityManager)))
         goto error;
 
@@ -901,15 +932,13 @@ qemuStateInitialize(bool privileged,
                                        NULL, NULL) < 0)
         goto error;
 
-    virDomainObjListForEach(qemu_driver->domains,
-                            false,
-                            qemuDomainSnapshotLoad,
-                            cfg->snapshotDir);
+    virDomainObjListForEachParallel(qemu_driver->domains,
+                                    qemuDomainSnapshotLoad,
+                                    cfg->snapshotDir);
 
-    virDomainObjListForEach(qemu_driver->domains,
-                            false,
-                            qemuDomainCheckpointLoad,
-                            cfg->checkpointDir);
+    virDomainObjListForEachParallel(qemu_driver->domains,
+                                    qemuDomainCheckpointLoad,
+                                    cfg->checkpointDir);
 
     virDomainObjListForEach(qemu_driver->domains,
                             false,
@@ -926,8 +955,31 @@ qemuStateInitialize(bool privileged,
     if (!qemu_driver->workerPool)
         goto error;
 
+    if (cfg->statusWriteBack &&
+        !(qemu_driver->statusPool = virThreadPoolNewFull(0, 1, 0,
+                                                         qemuDomainSaveStatusWorker,
+                                                         "qemu-status",
+                                                         identity,
+                                                         qemu_driver)))
+        goto error;
+
     qemuProcessReconnectAll(qemu_driver);
 
+    if (qemuBlockJobGovernorStart(qemu_driver, cfg) < 0)
+        goto error;
+
+    if (qemuIOTuneBalancerStart(qemu_driver, cfg) < 0)
+        goto error;
+
+    if (qemuCPUBalancerStart(qemu_driver, cfg) < 0)
+        goto error;
+
+    if (qemuIOThreadPollTunerStart(qemu_driver) < 0)
+        goto error;
+
+    if (qemuBalloonAutosizerStart(qemu_driver) < 0)
+        goto error;
+
     if (virDriverShouldAutostart(cfg->stateDir, &autostart) < 0)
         goto error;
 
@@ -1039,6 +1091,8 @@ static int
 qemuStateShutdownPrepare(void)
 {
     virThreadPoolStop(qemu_driver->workerPool);
+    if (qemu_driver->reconnectPool)
+        virThreadPoolStop(qemu_driver->reconnectPool);
     return 0;
 }
 
@@ -1075,6 +1129,12 @@ qemuStateCleanup(void)
     if (!qemu_driver)
         return -1;
 
+    qemuBalloonAutosizerFree(qemu_driver->balloonAutosizer);
+    qemuIOThreadPollTunerFree(qemu_driver->iothreadPollTuner);
+    qemuCPUBalancerFree(qemu_driver->cpuBalancer);
+    qemuIOTuneBalancerFree(qemu_driver->iotuneBalancer);
+    qemuBlockJobGovernorFree(qemu_driver->blockJobGovernor);
+    qemuDomainStatsPushFree(qemu_driver->statsPush);
     virObjectUnref(qemu_driver->migrationErrors);
     virObjectUnref(qemu_driver->closeCallbacks);
     virLockManagerPluginUnref(qemu_driver->lockManager);
@@ -1091,8 +1151,14 @@ qemuStateCleanup(void)
     virObjectUnref(qemu_driver->caps);
     ebtablesContextFree(qemu_driver->ebtables);
     VIR_FREE(qemu_driver->qemuImgBinary);
+    virThreadPoolFree(qemu_driver->statusPool);
+    qemu_driver->statusPool = NULL;
+    qemuDomainSaveStatusFlushAll(qemu_driver);
     virObjectUnref(qemu_driver->domains);
+    g_clear_pointer(&qemu_driver->busyCpus, g_hash_table_unref);
+    g_clear_pointer(&qemu_driver->hugepageReservations, g_hash_table_unref);
     virThreadPoolFree(qemu_driver->workerPool);
+    virThreadPoolFree(qemu_driver->reconnectPool);
 
     if (qemu_driver->lockFD != -1)
         virPidFileRelease(qemu_driver->config->stateDir, "driver", qemu_driver->lockFD);
@@ -1193,6 +1259,7 @@ qemuConnectSupportsFeature(virConnectPtr conn, int feature)
     case VIR_DRV_FEATURE_REMOTE:
     case VIR_DRV_FEATURE_PROGRAM_KEEPALIVE:
     case VIR_DRV_FEATURE_REMOTE_CLOSE_CALLBACK:
+    case VIR_DRV_FEATURE_REMOTE_COMPACT_DOMAIN_STATS:
     case VIR_DRV_FEATURE_REMOTE_EVENT_CALLBACK:
     case VIR_DRV_FEATURE_TYPED_PARAM_STRING:
     case VIR_DRV_FEATURE_NETWORK_UPDATE_HAS_CORRECT_ORDER:
@@ -1299,36 +1366,6 @@ static char *qemuConnectGetCapabilities(virConnectPtr conn) {
 }
 
 
-static int
-qemuGetSchedstatDelay(unsigned long long *cpudelay,
-                      pid_t pid,
-                      pid_t tid)
-{
-    g_autofree char *path = NULL;
-    g_autofree char *buf = NULL;
-
-    if (tid)
-        path = g_strdup_printf("/proc/%d/task/%d/schedstat", (int)pid, (int)tid);
-    else
-        path = g_strdup_printf("/proc/%d/schedstat", (int)pid);
-
-    /* This file might not exist (needs CONFIG_SCHED_INFO) */
-    if (!virFileExists(path))
-        return 0;
-
-    if (virFileReadAll(path, 1024, &buf) < 0)
-        return -1;
-
-    if (sscanf(buf, "%*u %llu", cpudelay) != 1) {
-        virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("Unable to parse schedstat info at '%s'"),
-                       path);
-        return -1;
-    }
-
-    return 0;
-}
-
 static int
 qemuDomainHelperGetVcpus(virDomainObj *vm,
                          virVcpuInfoPtr info,
@@ -1338,6 +1375,7 @@ qemuDomainHelperGetVcpus(virDomainObj *vm,
                          unsigned char *cpumaps,
                          int maplen)
 {
+    g_autoptr(virProcessTasks) tasks = NULL;
     size_t ncpuinfo = 0;
     size_t i;
 
@@ -1350,6 +1388,12 @@ qemuDomainHelperGetVcpus(virDomainObj *vm,
         return -1;
     }
 
+    /* Wide guests have hundreds of vCPU threads, read their statistics
+     * relative to a single handle of the task directory */
+    if ((info || cpuwait || cpudelay) &&
+        !(tasks = virProcessTasksOpen(vm->pid)))
+        return -1;
+
     if (info)
         memset(info, 0, sizeof(*info) * maxinfo);
 
@@ -1368,9 +1412,9 @@ qemuDomainHelperGetVcpus(virDomainObj *vm,
             vcpuinfo->number = i;
             vcpuinfo->state = VIR_VCPU_RUNNING;
 
-            if (virProcessGetStatInfo(&vcpuinfo->cpuTime,
-                                      &vcpuinfo->cpu, NULL,
-                                      vm->pid, vcpupid) < 0) {
+            if (virProcessTasksGetStatInfo(tasks, vcpupid,
+                                           &vcpuinfo->cpuTime,
+                                           &vcpuinfo->cpu) < 0) {
                 virReportSystemError(errno, "%s",
                                      _("cannot get vCPU placement & pCPU time"));
                 return -1;
@@ -1388,12 +1432,12 @@ qemuDomainHelperGetVcpus(virDomainObj *vm,
         }
 
         if (cpuwait) {
-            if (virProcessGetSchedInfo(&(cpuwait[ncpuinfo]), vm->pid, vcpupid) < 0)
+            if (virProcessTasksGetSchedInfo(tasks, vcpupid, &(cpuwait[ncpuinfo])) < 0)
                 return -1;
         }
 
         if (cpudelay) {
-            if (qemuGetSchedstatDelay(&(cpudelay[ncpuinfo]), vm->pid, vcpupid) < 0)
+            if (virProcessTasksGetSchedDelay(tasks, vcpupid, &(cpudelay[ncpuinfo])) < 0)
                 return -1;
         }
 
@@ -4255,14 +4299,116 @@ processMemoryDeviceSizeChange(virQEMUDriver *driver,
 }
 
 
+static void
+processBlockThresholdEvent(virQEMUDriver *driver,
+                           virDomainObj *vm,
+                           const char *nodename)
+{
+    virDomainDiskDef *disk;
+    virStorageSource *src;
+
+    if (qemuDomainObjBeginJob(driver, vm, VIR_JOB_MODIFY) < 0)
+        return;
+
+    if (!virDomainObjIsActive(vm)) {
+        VIR_DEBUG("Domain is not running");
+        goto endjob;
+    }
+
+    /* the disk may have been unplugged or got a new top image meanwhile */
+    if (!(disk = qemuDomainDiskLookupByNodename(vm->def, NULL, nodename, &src)) ||
+        src != disk->src) {
+        VIR_DEBUG("block node '%s' is no longer the top of a disk", nodename);
+        goto endjob;
+    }
+
+    if (qemuBlockAutoExtend(vm, disk) < 0)
+        VIR_WARN("Unable to extend volume of disk '%s' of domain '%s': %s",
+                 disk->dst, vm->def->name, virGetLastErrorMessage());
+
+ endjob:
+    qemuDomainObjEndJob(vm);
+}
+
+
+static void
+qemuDomainDirtyRateHistoryAdd(qemuDomainObjPrivate *priv,
+                              qemuMonitorDirtyRateInfo *info)
+{
+    qemuDomainDirtyRateSample *sample;
+
+    /* The same result is seen again if the calculation was restarted by
+     * someone else in between */
+    if (priv->ndirtyRateHistory > 0) {
+        sample = priv->dirtyRateHistory +
+            (priv->dirtyRateHistoryNext + QEMU_DOMAIN_DIRTYRATE_HISTORY - 1) %
+            QEMU_DOMAIN_DIRTYRATE_HISTORY;
+
+        if (sample->startTime == info->startTime)
+            return;
+    }
+
+    sample = priv->dirtyRateHistory + priv->dirtyRateHistoryNext;
+    sample->startTime = info->startTime;
+    sample->calcTime = info->calcTime;
+    sample->dirtyRate = info->dirtyRate;
+
+    priv->dirtyRateHistoryNext = (priv->dirtyRateHistoryNext + 1) %
+        QEMU_DOMAIN_DIRTYRATE_HISTORY;
+    if (priv->ndirtyRateHistory < QEMU_DOMAIN_DIRTYRATE_HISTORY)
+        priv->ndirtyRateHistory++;
+}
+
+
+static void
+processDirtyRateSampleEvent(virQEMUDriver *driver,
+                            virDomainObj *vm)
+{
+    qemuDomainObjPrivate *priv = vm->privateData;
+    qemuMonitorDirtyRateInfo info = { 0 };
+    int rc;
+
+    /* Unlike starting a calculation through the API, sampling must not
+     * wait for migration to finish, the results are most useful then */
+    if (qemuDomainObjBeginJob(driver, vm, VIR_JOB_QUERY) < 0)
+        return;
+
+    if (!virDomainObjIsActive(vm) || priv->dirtyRateTimer == 0)
+        goto endjob;
+
+    qemuDomainObjEnterMonitor(driver, vm);
+    rc = qemuMonitorQueryDirtyRate(priv->mon, &info);
+    if (rc == 0 && info.status != VIR_DOMAIN_DIRTYRATE_MEASURING)
+        rc = qemuMonitorStartDirtyRateCalc(priv->mon, priv->dirtyRatePeriod,
+                                           priv->dirtyRateMode);
+    qemuDomainObjExitMonitor(vm);
+
+    if (rc < 0) {
+        VIR_DEBUG("Failed to sample dirty rate of domain %s: %s",
+                  vm->def->name, virGetLastErrorMessage());
+        virResetLastError();
+        goto endjob;
+    }
+
+    if (info.status == VIR_DOMAIN_DIRTYRATE_MEASURED)
+        qemuDomainDirtyRateHistoryAdd(priv, &info);
+
+ endjob:
+    qemuDomainObjEndJob(vm);
+    g_free(info.rates);
+}
+
+
 static void qemuProcessEventHandler(void *data, void *opaque)
 {
     struct qemuProcessEvent *processEvent = data;
     virDomainObj *vm = processEvent->vm;
     virQEMUDriver *driver = opaque;
 
-    VIR_DEBUG("vm=%p, event=%d", vm, processEvent->eventType);
+    VIR_DEBUG("vm=%p, event=%s", vm,
+              qemuProcessEventTypeToString(processEvent->eventType));
 
+    virThreadJobSet(qemuProcessEventTypeToString(processEvent->eventType));
     virObjectLock(vm);
 
     switch (processEvent->eventType) {
@@ -4307,12 +4453,19 @@ static void qemuProcessEventHandler(void *data, void *opaque)
     case QEMU_PROCESS_EVENT_MEMORY_DEVICE_SIZE_CHANGE:
         processMemoryDeviceSizeChange(driver, vm, processEvent->data);
         break;
+    case QEMU_PROCESS_EVENT_BLOCK_THRESHOLD:
+        processBlockThresholdEvent(driver, vm, processEvent->data);
+        break;
+    case QEMU_PROCESS_EVENT_DIRTYRATE_SAMPLE:
+        processDirtyRateSampleEvent(driver, vm);
+        break;
     case QEMU_PROCESS_EVENT_LAST:
         break;
     }
 
     virDomainObjEndAPI(&vm);
     qemuProcessEventFree(processEvent);
+    virThreadJobClear(0);
 }
 
 
@@ -6556,6 +6709,31 @@ qemuDomainCreate(virDomainPtr dom)
     return qemuDomainCreateWithFlags(dom, 0);
 }
 
+/* Finish define of @vm from XML it was already defined from, parsed
+ * into @def which the caller has checked ACLs of, without touching the
+ * definition of @vm. Consumes the lock and reference to @vm. */
+static virDomainPtr
+qemuDomainDefineXMLRedundant(virConnectPtr conn,
+                             virDomainObj *vm,
+                             const virDomainDef *def)
+{
+    virQEMUDriver *driver = conn->privateData;
+    virDomainPtr dom = NULL;
+    virObjectEvent *event = NULL;
+
+    event = virDomainEventLifecycleNewFromObj(vm,
+                                     VIR_DOMAIN_EVENT_DEFINED,
+                                     VIR_DOMAIN_EVENT_DEFINED_UPDATED);
+
+    VIR_DEBUG("Domain '%s' is already defined from the same XML",
+              def->name);
+    dom = virGetDomain(conn, vm->def->name, vm->def->uuid, vm->def->id);
+
+    virDomainObjEndAPI(&vm);
+    virObjectEventStateQueue(driver->domainEventState, event);
+    return dom;
+}
+
 static virDomainPtr
 qemuDomainDefineXMLFlags(virConnectPtr conn,
                          const char *xml,
@@ -6568,6 +6746,7 @@ qemuDomainDefineXMLFlags(virConnectPtr conn,
     virDomainPtr dom = NULL;
     virObjectEvent *event = NULL;
     g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(driver);
+    g_autofree char *hash = NULL;
     unsigned int parse_flags = VIR_DOMAIN_DEF_PARSE_INACTIVE |
                                VIR_DOMAIN_DEF_PARSE_ABI_UPDATE;
 
@@ -6586,6 +6765,14 @@ qemuDomainDefineXMLFlags(virConnectPtr conn,
     if (virDomainDefineXMLFlagsEnsureACL(conn, def) < 0)
         goto cleanup;
 
+    hash = virDomainDefParseHash(xml, parse_flags);
+
+    /* Management applications tend to re-define domains from the very same
+     * XML they defined them from, which would not change anything. */
+    if ((vm = virDomainObjListFindRedundantDefine(driver->domains, def,
+                                                  driver->xmlopt, hash)))
+        return qemuDomainDefineXMLRedundant(conn, vm, def);
+
     if (!(vm = virDomainObjListAdd(driver->domains, &def,
                                    driver->xmlopt,
                                    0, &oldDef)))
@@ -6599,6 +6786,7 @@ qemuDomainDefineXMLFlags(virConnectPtr conn,
         goto cleanup;
 
     vm->persistent = 1;
+    virDomainObjSetDefineHash(vm, driver->xmlopt, hash);
 
     event = virDomainEventLifecycleNewFromObj(vm,
                                      VIR_DOMAIN_EVENT_DEFINED,
@@ -7822,20 +8010,51 @@ qemuDomainAttachDeviceLiveAndConfigHomogenize(const virDomainDeviceDef *devConf,
 }
 
 
+static int
+qemuDomainAttachDeviceLiveOne(virDomainObj *vm,
+                              virQEMUDriver *driver,
+                              const char *xml,
+                              const virDomainDeviceDef *devConf,
+                              unsigned int parse_flags)
+{
+    qemuDomainObjPrivate *priv = vm->privateData;
+    g_autoptr(virDomainDeviceDef) devLive = NULL;
+
+    if (!(devLive = virDomainDeviceDefParse(xml, vm->def,
+                                            driver->xmlopt, priv->qemuCaps,
+                                            parse_flags)))
+        return -1;
+
+    if (devConf)
+        qemuDomainAttachDeviceLiveAndConfigHomogenize(devConf, devLive);
+
+    if (virDomainDeviceValidateAliasForHotplug(vm, devLive,
+                                               VIR_DOMAIN_AFFECT_LIVE) < 0)
+        return -1;
+
+    if (virDomainDefCompatibleDevice(vm->def, devLive, NULL,
+                                     VIR_DOMAIN_DEVICE_ACTION_ATTACH,
+                                     true) < 0)
+        return -1;
+
+    return qemuDomainAttachDeviceLive(vm, devLive, driver);
+}
+
+
 static int
 qemuDomainAttachDeviceLiveAndConfig(virDomainObj *vm,
                                     virQEMUDriver *driver,
-                                    const char *xml,
+                                    const char **xmls,
+                                    size_t nxmls,
                                     unsigned int flags)
 {
     qemuDomainObjPrivate *priv = vm->privateData;
     g_autoptr(virDomainDef) vmdef = NULL;
     g_autoptr(virQEMUDriverConfig) cfg = NULL;
-    g_autoptr(virDomainDeviceDef) devConf = NULL;
-    virDomainDeviceDef devConfSave = { 0 };
-    g_autoptr(virDomainDeviceDef) devLive = NULL;
+    g_autofree virDomainDeviceDef *devConfSave = NULL;
     unsigned int parse_flags = VIR_DOMAIN_DEF_PARSE_INACTIVE |
                                VIR_DOMAIN_DEF_PARSE_ABI_UPDATE;
+    size_t i;
 
     virCheckFlags(VIR_DOMAIN_AFFECT_LIVE |
                   VIR_DOMAIN_AFFECT_CONFIG, -1);
@@ -7851,59 +8070,61 @@ qemuDomainAttachDeviceLiveAndConfig(virDomainObj *vm,
         if (!vmdef)
             return -1;
 
-        if (!(devConf = virDomainDeviceDefParse(xml, vmdef,
-                                                driver->xmlopt, priv->qemuCaps,
-                                                parse_flags)))
-            return -1;
-
-        /*
-         * devConf will be NULLed out by
-         * qemuDomainAttachDeviceConfig(), so save it for later use by
-         * qemuDomainAttachDeviceLiveAndConfigHomogenize()
-         */
-        devConfSave = *devConf;
+        devConfSave = g_new0(virDomainDeviceDef, nxmls);
 
-        if (virDomainDeviceValidateAliasForHotplug(vm, devConf,
-                                                   VIR_DOMAIN_AFFECT_CONFIG) < 0)
-            return -1;
+        for (i = 0; i < nxmls; i++) {
+            g_autoptr(virDomainDeviceDef) devConf = NULL;
 
-        if (virDomainDefCompatibleDevice(vmdef, devConf, NULL,
-                                         VIR_DOMAIN_DEVICE_ACTION_ATTACH,
-                                         false) < 0)
-            return -1;
+            if (!(devConf = virDomainDeviceDefParse(xmls[i], vmdef,
+                                                    driver->xmlopt,
+                                                    priv->qemuCaps,
+                                                    parse_flags)))
+                return -1;
 
-        if (qemuDomainAttachDeviceConfig(vmdef, devConf, priv->qemuCaps,
-                                         parse_flags,
-                                         driver->xmlopt) < 0)
-            return -1;
-    }
+            /*
+             * devConf will be NULLed out by
+             * qemuDomainAttachDeviceConfig(), so save it for later use by
+             * qemuDomainAttachDeviceLiveAndConfigHomogenize()
+             */
+            devConfSave[i] = *devConf;
 
-    if (flags & VIR_DOMAIN_AFFECT_LIVE) {
-        if (!(devLive = virDomainDeviceDefParse(xml, vm->def,
-                                                driver->xmlopt, priv->qemuCaps,
-                                                parse_flags)))
-            return -1;
+            if (virDomainDeviceValidateAliasForHotplug(vm, devConf,
+                                                       VIR_DOMAIN_AFFECT_CONFIG) < 0)
+                return -1;
 
-        if (flags & VIR_DOMAIN_AFFECT_CONFIG)
-            qemuDomainAttachDeviceLiveAndConfigHomogenize(&devConfSave, devLive);
+            if (virDomainDefCompatibleDevice(vmdef, devConf, NULL,
+                                             VIR_DOMAIN_DEVICE_ACTION_ATTACH,
+                                             false) < 0)
+                return -1;
 
-        if (virDomainDeviceValidateAliasForHotplug(vm, devLive,
-                                                   VIR_DOMAIN_AFFECT_LIVE) < 0)
-            return -1;
+            if (qemuDomainAttachDeviceConfig(vmdef, devConf, priv->qemuCaps,
+                                             parse_flags,
+                                             driver->xmlopt) < 0)
+                return -1;
+        }
+    }
 
-        if (virDomainDefCompatibleDevice(vm->def, devLive, NULL,
-                                         VIR_DOMAIN_DEVICE_ACTION_ATTACH,
-                                         true) < 0)
-            return -1;
+    if (flags & VIR_DOMAIN_AFFECT_LIVE) {
+        /* Each device is parsed only once those before it are attached,
+         * since e.g. indexes and addresses are assigned based on the
+         * devices the domain has at that point. */
+        for (i = 0; i < nxmls; i++) {
+            if (qemuDomainAttachDeviceLiveOne(vm, driver, xmls[i],
+                                              devConfSave ? &devConfSave[i] : NULL,
+                                              parse_flags) < 0)
+                break;
+        }
 
-        if (qemuDomainAttachDeviceLive(vm, devLive, driver) < 0)
-            return -1;
         /*
-         * update domain status forcibly because the domain status may be
-         * changed even if we failed to attach the device. For example,
-         * a new controller may be created.
+         * Update domain status just once for all the devices, but also if
+         * attaching any of them failed, because the devices before it are
+         * attached.
          */
-        qemuDomainSaveStatus(vm);
+        if (i > 0)
+            qemuDomainSaveStatus(vm);
+
+        if (i < nxmls)
+            return -1;
     }
 
     /* Finally, if no error until here, we can save config. */
@@ -7938,7 +8159,42 @@ qemuDomainAttachDeviceFlags(virDomainPtr dom,
     if (virDomainObjUpdateModificationImpact(vm, &flags) < 0)
         goto endjob;
 
-    if (qemuDomainAttachDeviceLiveAndConfig(vm, driver, xml, flags) < 0)
+    if (qemuDomainAttachDeviceLiveAndConfig(vm, driver, &xml, 1, flags) < 0)
+        goto endjob;
+
+    ret = 0;
+
+ endjob:
+    qemuDomainObjEndJob(vm);
+
+ cleanup:
+    virDomainObjEndAPI(&vm);
+    return ret;
+}
+
+static int
+qemuDomainAttachDevices(virDomainPtr dom,
+                        const char **xmls,
+                        unsigned int nxmls,
+                        unsigned int flags)
+{
+    virQEMUDriver *driver = dom->conn->privateData;
+    virDomainObj *vm = NULL;
+    int ret = -1;
+
+    if (!(vm = qemuDomainObjFromDomain(dom)))
+        goto cleanup;
+
+    if (virDomainAttachDevicesEnsureACL(dom->conn, vm->def, flags) < 0)
+        goto cleanup;
+
+    if (qemuDomainObjBeginJob(driver, vm, VIR_JOB_MODIFY) < 0)
+        goto cleanup;
+
+    if (virDomainObjUpdateModificationImpact(vm, &flags) < 0)
+        goto endjob;
+
+    if (qemuDomainAttachDeviceLiveAndConfig(vm, driver, xmls, nxmls, flags) < 0)
         goto endjob;
 
     ret = 0;
@@ -8059,15 +8315,16 @@ static int qemuDomainUpdateDeviceFlags(virDomainPtr dom,
 static int
 qemuDomainDetachDeviceLiveAndConfig(virQEMUDriver *driver,
                                     virDomainObj *vm,
-                                    const char *xml,
+                                    const char **xmls,
+                                    size_t nxmls,
                                     unsigned int flags)
 {
     qemuDomainObjPrivate *priv = vm->privateData;
     g_autoptr(virQEMUDriverConfig) cfg = NULL;
-    g_autoptr(virDomainDeviceDef) dev = NULL;
-    virDomainDeviceDef *dev_copy = NULL;
+    virDomainDeviceDef **devs = NULL;
     unsigned int parse_flags = VIR_DOMAIN_DEF_PARSE_SKIP_VALIDATE;
     g_autoptr(virDomainDef) vmdef = NULL;
+    size_t i;
     int ret = -1;
 
     virCheckFlags(VIR_DOMAIN_AFFECT_LIVE |
@@ -8079,40 +8336,56 @@ qemuDomainDetachDeviceLiveAndConfig(virQEMUDriver *driver,
         !(flags & VIR_DOMAIN_AFFECT_LIVE))
         parse_flags |= VIR_DOMAIN_DEF_PARSE_INACTIVE;
 
-    dev = dev_copy = virDomainDeviceDefParse(xml, vm->def,
-                                             driver->xmlopt, priv->qemuCaps,
-                                             parse_flags);
-    if (dev == NULL)
-        goto cleanup;
-
-    if (flags & VIR_DOMAIN_AFFECT_CONFIG &&
-        flags & VIR_DOMAIN_AFFECT_LIVE) {
-        /* If we are affecting both CONFIG and LIVE
-         * create a deep copy of device as adding
-         * to CONFIG takes one instance.
-         */
-        dev_copy = virDomainDeviceDefCopy(dev, vm->def,
-                                          driver->xmlopt, priv->qemuCaps);
-        if (!dev_copy)
-            goto cleanup;
-    }
+    devs = g_new0(virDomainDeviceDef *, nxmls);
 
     if (flags & VIR_DOMAIN_AFFECT_CONFIG) {
         /* Make a copy for updated domain. */
         vmdef = virDomainObjCopyPersistentDef(vm, driver->xmlopt, priv->qemuCaps);
         if (!vmdef)
             goto cleanup;
+    }
 
-        if (qemuDomainDetachDeviceConfig(vmdef, dev_copy, priv->qemuCaps,
-                                         parse_flags,
-                                         driver->xmlopt) < 0)
+    for (i = 0; i < nxmls; i++) {
+        devs[i] = virDomainDeviceDefParse(xmls[i], vm->def,
+                                          driver->xmlopt, priv->qemuCaps,
+                                          parse_flags);
+        if (devs[i] == NULL)
             goto cleanup;
+
+        if (flags & VIR_DOMAIN_AFFECT_CONFIG) {
+            g_autoptr(virDomainDeviceDef) dev_copy = NULL;
+            virDomainDeviceDef *dev = devs[i];
+
+            if (flags & VIR_DOMAIN_AFFECT_LIVE) {
+                /* If we are affecting both CONFIG and LIVE
+                 * create a deep copy of device as adding
+                 * to CONFIG takes one instance.
+                 */
+                dev_copy = virDomainDeviceDefCopy(devs[i], vm->def,
+                                                  driver->xmlopt, priv->qemuCaps);
+                if (!dev_copy)
+                    goto cleanup;
+                dev = dev_copy;
+            }
+
+            if (qemuDomainDetachDeviceConfig(vmdef, dev, priv->qemuCaps,
+                                             parse_flags,
+                                             driver->xmlopt) < 0)
+                goto cleanup;
+        }
     }
 
     if (flags & VIR_DOMAIN_AFFECT_LIVE) {
         int rc;
 
-        if ((rc = qemuDomainDetachDeviceLive(vm, dev, driver, false)) < 0)
+        /* Request unplug of all the devices before waiting for any of
+         * them, so that the guest can handle them in parallel. */
+        if (nxmls == 1)
+            rc = qemuDomainDetachDeviceLive(vm, devs[0], driver, false);
+        else
+            rc = qemuDomainDetachDevicesLive(vm, devs, nxmls, driver);
+
+        if (rc < 0)
             goto cleanup;
 
         if (rc == 0 && qemuDomainUpdateDeviceList(driver, vm, VIR_ASYNC_JOB_NONE) < 0)
@@ -8132,8 +8405,9 @@ qemuDomainDetachDeviceLiveAndConfig(virQEMUDriver *driver,
     ret = 0;
 
  cleanup:
-    if (dev != dev_copy)
-        virDomainDeviceDefFree(dev_copy);
+    for (i = 0; i < nxmls; i++)
+        virDomainDeviceDefFree(devs[i]);
+    g_free(devs);
     return ret;
 }
 
@@ -8223,7 +8497,7 @@ qemuDomainDetachDeviceFlags(virDomainPtr dom,
     if (virDomainObjUpdateModificationImpact(vm, &flags) < 0)
         goto endjob;
 
-    if (qemuDomainDetachDeviceLiveAndConfig(driver, vm, xml, flags) < 0)
+    if (qemuDomainDetachDeviceLiveAndConfig(driver, vm, &xml, 1, flags) < 0)
         goto endjob;
 
     ret = 0;
@@ -8238,9 +8512,10 @@ qemuDomainDetachDeviceFlags(virDomainPtr dom,
 
 
 static int
-qemuDomainDetachDeviceAlias(virDomainPtr dom,
-                            const char *alias,
-                            unsigned int flags)
+qemuDomainDetachDevices(virDomainPtr dom,
+                        const char **xmls,
+                        unsigned int nxmls,
+                        unsigned int flags)
 {
     virQEMUDriver *driver = dom->conn->privateData;
     virDomainObj *vm = NULL;
@@ -8249,7 +8524,7 @@ qemuDomainDetachDeviceAlias(virDomainPtr dom,
     if (!(vm = qemuDomainObjFromDomain(dom)))
         goto cleanup;
 
-    if (virDomainDetachDeviceAliasEnsureACL(dom->conn, vm->def, flags) < 0)
+    if (virDomainDetachDevicesEnsureACL(dom->conn, vm->def, flags) < 0)
         goto cleanup;
 
     if (qemuDomainObjBeginJob(driver, vm, VIR_JOB_MODIFY) < 0)
@@ -8258,7 +8533,7 @@ qemuDomainDetachDeviceAlias(virDomainPtr dom,
     if (virDomainObjUpdateModificationImpact(vm, &flags) < 0)
         goto endjob;
 
-    if (qemuDomainDetachDeviceAliasLiveAndConfig(driver, vm, alias, flags) < 0)
+    if (qemuDomainDetachDeviceLiveAndConfig(driver, vm, xmls, nxmls, flags) < 0)
         goto endjob;
 
     ret = 0;
@@ -8272,26 +8547,61 @@ qemuDomainDetachDeviceAlias(virDomainPtr dom,
 }
 
 
-static int qemuDomainDetachDevice(virDomainPtr dom, const char *xml)
-{
-    return qemuDomainDetachDeviceFlags(dom, xml,
-                                       VIR_DOMAIN_AFFECT_LIVE);
-}
-
-static int qemuDomainGetAutostart(virDomainPtr dom,
-                                  int *autostart)
+static int
+qemuDomainDetachDeviceAlias(virDomainPtr dom,
+                            const char *alias,
+                            unsigned int flags)
 {
-    virDomainObj *vm;
+    virQEMUDriver *driver = dom->conn->privateData;
+    virDomainObj *vm = NULL;
     int ret = -1;
 
     if (!(vm = qemuDomainObjFromDomain(dom)))
         goto cleanup;
 
-    if (virDomainGetAutostartEnsureACL(dom->conn, vm->def) < 0)
+    if (virDomainDetachDeviceAliasEnsureACL(dom->conn, vm->def, flags) < 0)
         goto cleanup;
 
-    *autostart = vm->autostart;
-    ret = 0;
+    if (qemuDomainObjBeginJob(driver, vm, VIR_JOB_MODIFY) < 0)
+        goto cleanup;
+
+    if (virDomainObjUpdateModificationImpact(vm, &flags) < 0)
+        goto endjob;
+
+    if (qemuDomainDetachDeviceAliasLiveAndConfig(driver, vm, alias, flags) < 0)
+        goto endjob;
+
+    ret = 0;
+
+ endjob:
+    qemuDomainObjEndJob(vm);
+
+ cleanup:
+    virDomainObjEndAPI(&vm);
+    return ret;
+}
+
+
+static int qemuDomainDetachDevice(virDomainPtr dom, const char *xml)
+{
+    return qemuDomainDetachDeviceFlags(dom, xml,
+                                       VIR_DOMAIN_AFFECT_LIVE);
+}
+
+static int qemuDomainGetAutostart(virDomainPtr dom,
+                                  int *autostart)
+{
+    virDomainObj *vm;
+    int ret = -1;
+
+    if (!(vm = qemuDomainObjFromDomain(dom)))
+        goto cleanup;
+
+    if (virDomainGetAutostartEnsureACL(dom->conn, vm->def) < 0)
+        goto cleanup;
+
+    *autostart = vm->autostart;
+    ret = 0;
 
  cleanup:
     virDomainObjEndAPI(&vm);
@@ -12610,6 +12920,43 @@ qemuDomainGetJobInfoDumpStats(virQEMUDriver *driver,
 }
 
 
+/**
+ * qemuDomainJobDataRefresh:
+ * @driver: qemu driver
+ * @vm: domain object
+ * @jobData: copy of the current job data of @vm
+ *
+ * Updates @jobData with the progress reported by QEMU. The caller must
+ * have entered a job which allows accessing the monitor.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+static int
+qemuDomainJobDataRefresh(virQEMUDriver *driver,
+                         virDomainObj *vm,
+                         virDomainJobData *jobData)
+{
+    qemuDomainJobDataPrivate *privStats = jobData->privateData;
+
+    switch (privStats->statsType) {
+    case QEMU_DOMAIN_JOB_STATS_TYPE_MIGRATION:
+    case QEMU_DOMAIN_JOB_STATS_TYPE_SAVEDUMP:
+        return qemuDomainGetJobInfoMigrationStats(driver, vm, jobData);
+
+    case QEMU_DOMAIN_JOB_STATS_TYPE_MEMDUMP:
+        return qemuDomainGetJobInfoDumpStats(driver, vm, jobData);
+
+    case QEMU_DOMAIN_JOB_STATS_TYPE_BACKUP:
+        return qemuBackupGetJobInfoStats(driver, vm, jobData);
+
+    case QEMU_DOMAIN_JOB_STATS_TYPE_NONE:
+        break;
+    }
+
+    return 0;
+}
+
+
 static int
 qemuDomainGetJobStatsInternal(virQEMUDriver *driver,
                               virDomainObj *vm,
@@ -12617,7 +12964,6 @@ qemuDomainGetJobStatsInternal(virQEMUDriver *driver,
                               virDomainJobData **jobData)
 {
     qemuDomainObjPrivate *priv = vm->privateData;
-    qemuDomainJobDataPrivate *privStats = NULL;
     int ret = -1;
 
     *jobData = NULL;
@@ -12648,28 +12994,8 @@ qemuDomainGetJobStatsInternal(virQEMUDriver *driver,
     }
     *jobData = virDomainJobDataCopy(priv->job.current);
 
-    privStats = (*jobData)->privateData;
-
-    switch (privStats->statsType) {
-    case QEMU_DOMAIN_JOB_STATS_TYPE_MIGRATION:
-    case QEMU_DOMAIN_JOB_STATS_TYPE_SAVEDUMP:
-        if (qemuDomainGetJobInfoMigrationStats(driver, vm, *jobData) < 0)
-            goto cleanup;
-        break;
-
-    case QEMU_DOMAIN_JOB_STATS_TYPE_MEMDUMP:
-        if (qemuDomainGetJobInfoDumpStats(driver, vm, *jobData) < 0)
-            goto cleanup;
-        break;
-
-    case QEMU_DOMAIN_JOB_STATS_TYPE_BACKUP:
-        if (qemuBackupGetJobInfoStats(driver, vm, *jobData) < 0)
-            goto cleanup;
-        break;
-
-    case QEMU_DOMAIN_JOB_STATS_TYPE_NONE:
-        break;
-    }
+    if (qemuDomainJobDataRefresh(driver, vm, *jobData) < 0)
+        goto cleanup;
 
     ret = 0;
 
@@ -13365,6 +13691,60 @@ qemuDomainSnapshotCreateXML(virDomainPtr domain,
 }
 
 
+static int
+qemuDomainListSnapshotCreateXML(virConnectPtr conn,
+                                virDomainPtr *doms,
+                                unsigned int ndoms,
+                                const char **xmlDescs,
+                                virDomainSnapshotPtr **snaps,
+                                unsigned int flags)
+{
+    virQEMUDriver *driver = conn->privateData;
+    g_autofree virDomainObj **vms = NULL;
+    size_t nvms = 0;
+    size_t i;
+    size_t j;
+    int ret = -1;
+
+    vms = g_new0(virDomainObj *, ndoms);
+
+    for (i = 0; i < ndoms; i++) {
+        virDomainObj *vm;
+
+        if (!(vm = qemuDomainObjFromDomain(doms[i])))
+            goto cleanup;
+
+        if (virDomainListSnapshotCreateXMLEnsureACL(conn, vm->def, flags) < 0) {
+            virDomainObjEndAPI(&vm);
+            goto cleanup;
+        }
+
+        /* the snapshot job of the first occurrence would block the other */
+        for (j = 0; j < nvms; j++) {
+            if (vms[j] == vm) {
+                virReportError(VIR_ERR_INVALID_ARG,
+                               _("domain '%s' is listed more than once"),
+                               vm->def->name);
+                virDomainObjEndAPI(&vm);
+                goto cleanup;
+            }
+        }
+
+        /* the domains are locked one at a time while being snapshotted */
+        virObjectUnlock(vm);
+        vms[nvms++] = vm;
+    }
+
+    ret = qemuSnapshotCreateXMLList(driver, doms, vms, xmlDescs, ndoms,
+                                    snaps, flags);
+
+ cleanup:
+    for (i = 0; i < nvms; i++)
+        virObjectUnref(vms[i]);
+    return ret;
+}
+
+
 static int
 qemuDomainSnapshotListNames(virDomainPtr domain,
                             char **names,
@@ -14459,6 +14839,8 @@ qemuDomainBlockPullCommon(virDomainObj *vm,
     if (!(job = qemuBlockJobDiskNewPull(vm, disk, baseSource, flags)))
         goto endjob;
 
+    job->bandwidth = speed;
+
     if (blockdev) {
         jobname = job->name;
         persistjob = true;
@@ -14571,11 +14953,10 @@ qemuDomainBlockJobAbort(virDomainPtr dom,
     if (!async) {
         qemuBlockJobUpdate(vm, job, VIR_ASYNC_JOB_NONE);
         while (qemuBlockJobIsRunning(job)) {
-            if (virDomainObjWait(vm) < 0) {
+            if (qemuBlockJobSyncWait(vm, job, VIR_ASYNC_JOB_NONE) < 0) {
                 ret = -1;
                 goto endjob;
             }
-            qemuBlockJobUpdate(vm, job, VIR_ASYNC_JOB_NONE);
         }
 
         if (pivot &&
@@ -14775,6 +15156,14 @@ qemuDomainBlockJobSetSpeed(virDomainPtr dom,
                                       speed);
     qemuDomainObjExitMonitor(vm);
 
+    if (ret == 0) {
+        /* the block job governor re-applies its share on top of the new
+         * limit the next time it runs */
+        job->bandwidth = speed;
+        job->speed = 0;
+        qemuDomainSaveStatus(vm);
+    }
+
  endjob:
     qemuDomainObjEndJob(vm);
 
@@ -15187,6 +15576,8 @@ qemuDomainBlockCopyCommon(virDomainObj *vm,
     if (!(job = qemuBlockJobDiskNewCopy(vm, disk, mirror, mirror_shallow, mirror_reuse, flags)))
         goto endjob;
 
+    job->bandwidth = bandwidth;
+
     disk->mirrorState = VIR_DOMAIN_DISK_MIRROR_STATE_NONE;
 
     /* Actually start the mirroring */
@@ -15609,6 +16000,8 @@ qemuDomainBlockCommit(virDomainPtr dom,
                                           flags)))
         goto endjob;
 
+    job->bandwidth = speed;
+
     disk->mirrorState = VIR_DOMAIN_DISK_MIRROR_STATE_NONE;
 
     /* Start the commit operation.  Pass the user's original spelling,
@@ -16469,6 +16862,7 @@ qemuDomainGetBlockIoTune(virDomainPtr dom,
     return ret;
 }
 
+
 static int
 qemuDomainGetDiskErrors(virDomainPtr dom,
                         virDomainDiskErrorPtr errors,
@@ -16579,6 +16973,12 @@ qemuDomainSetMetadata(virDomainPtr dom,
 
     if (ret == 0) {
         virObjectEvent *ev = NULL;
+
+        /* a status write-back formatted before the change might still
+         * overwrite the file, make sure another one follows */
+        if (driver->statusPool)
+            qemuDomainSaveStatus(vm);
+
         ev = virDomainEventMetadataChangeNewFromObj(vm, type, uri);
         virObjectEventStateQueue(driver->domainEventState, ev);
     }
@@ -17531,6 +17931,9 @@ qemuConnectGetDomainCapabilities(virConnectPtr conn,
     virArch arch;
     virDomainVirtType virttype;
     g_autoptr(virDomainCaps) domCaps = NULL;
+    g_autofree char *key = NULL;
+    time_t firmwareMtime;
+    char *xml;
 
     virCheckFlags(0, NULL);
 
@@ -17546,12 +17949,30 @@ qemuConnectGetDomainCapabilities(virConnectPtr conn,
     if (!qemuCaps)
         return NULL;
 
+    /* Besides QEMU capabilities and firmware descriptors, the result
+     * depends on host support for VFIO and swtpm, which may change while
+     * we are running. */
+    key = g_strdup_printf("%s:%s:%s:%d:%d", NULLSTR(machine),
+                          virArchToString(arch),
+                          virDomainVirtTypeToString(virttype),
+                          qemuHostdevHostSupportsPassthroughVFIO(),
+                          virTPMHasSwtpm());
+    firmwareMtime = qemuFirmwareGetConfigsMtime(driver->privileged);
+
+    if ((xml = virQEMUCapsGetDomainCapsXML(qemuCaps, key, firmwareMtime)))
+        return xml;
+
     if (!(domCaps = virQEMUDriverGetDomainCapabilities(driver,
                                                        qemuCaps, machine,
                                                        arch, virttype)))
         return NULL;
 
-    return virDomainCapsFormat(domCaps);
+    if (!(xml = virDomainCapsFormat(domCaps)))
+        return NULL;
+
+    virQEMUCapsSetDomainCapsXML(qemuCaps, key, firmwareMtime, xml);
+
+    return xml;
 }
 
 
@@ -17576,6 +17997,7 @@ typedef enum {
                                             accessed */
     QEMU_DOMAIN_STATS_BACKING  = 1 << 1, /* include backing chain in
                                             block stats */
+    QEMU_DOMAIN_STATS_CACHED   = 1 << 2, /* cached stats are acceptable */
 } qemuDomainStatsFlags;
 
 
@@ -17708,6 +18130,7 @@ qemuDomainGetStatsMemoryBandwidth(virQEMUDriver *driver,
 {
     virQEMUResctrlMonData **resdata = NULL;
     char **features = NULL;
+    unsigned long long *rates = NULL;
     size_t nresdata = 0;
     size_t i = 0;
     size_t j = 0;
@@ -17754,6 +18177,7 @@ qemuDomainGetStatsMemoryBandwidth(virQEMUDriver *driver,
 
 
             features = resdata[i]->stats[j]->features;
+            rates = resdata[i]->stats[j]->rates;
             for (k = 0; features[k]; k++) {
                 if (STREQ(features[k], "mbm_local_bytes")) {
                     /* The accumulative data passing through local memory
@@ -17764,6 +18188,13 @@ qemuDomainGetStatsMemoryBandwidth(virQEMUDriver *driver,
                                                    "%zu.node.%zu.bytes.local",
                                                    i, j) < 0)
                         goto cleanup;
+
+                    if (rates &&
+                        virTypedParamListAddULLong(params, rates[k],
+                                                   "memory.bandwidth.monitor."
+                                                   "%zu.node.%zu.bytes.local.rate",
+                                                   i, j) < 0)
+                        goto cleanup;
                 }
 
                 if (STREQ(features[k], "mbm_total_bytes")) {
@@ -17775,6 +18206,13 @@ qemuDomainGetStatsMemoryBandwidth(virQEMUDriver *driver,
                                                    "%zu.node.%zu.bytes.total",
                                                    i, j) < 0)
                         goto cleanup;
+
+                    if (rates &&
+                        virTypedParamListAddULLong(params, rates[k],
+                                                   "memory.bandwidth.monitor."
+                                                   "%zu.node.%zu.bytes.total.rate",
+                                                   i, j) < 0)
+                        goto cleanup;
                 }
             }
         }
@@ -17986,6 +18424,76 @@ qemuDomainGetStatsBalloon(virQEMUDriver *driver,
 }
 
 
+static const char *qemuDomainGetStatsVcpuHaltPollNames[] = {
+    "halt_poll_success_ns",
+    "halt_poll_fail_ns",
+    NULL
+};
+
+/* Fetch the KVM halt polling counters of all vCPUs via 'query-stats'. Only
+ * the counters we report are requested so that the reply stays small even
+ * for guests with hundreds of vCPUs. Values are stored at the vCPU id in
+ * @success and @fail and the ids which were filled are set in @valid. */
+static int
+qemuDomainGetStatsVcpuHaltPoll(virQEMUDriver *driver,
+                               virDomainObj *dom,
+                               unsigned long long *success,
+                               unsigned long long *fail,
+                               virBitmap *valid)
+{
+    qemuDomainObjPrivate *priv = dom->privateData;
+    g_autoptr(virJSONValue) queried = NULL;
+    size_t maxvcpus = virDomainDefGetVcpusMax(dom->def);
+    size_t i;
+    size_t j;
+
+    qemuDomainObjEnterMonitor(driver, dom);
+    queried = qemuMonitorQueryStats(priv->mon,
+                                    QEMU_MONITOR_QUERY_STATS_TARGET_VCPU,
+                                    NULL,
+                                    QEMU_MONITOR_QUERY_STATS_PROVIDER_KVM,
+                                    qemuDomainGetStatsVcpuHaltPollNames);
+    qemuDomainObjExitMonitor(dom);
+
+    if (!queried)
+        return -1;
+
+    for (i = 0; i < virJSONValueArraySize(queried); i++) {
+        virJSONValue *info = virJSONValueArrayGet(queried, i);
+        g_autoptr(GHashTable) stats = NULL;
+        virJSONValue *value;
+        const char *qomPath;
+
+        if (!(qomPath = virJSONValueObjectGetString(info, "qom-path")))
+            continue;
+
+        for (j = 0; j < maxvcpus; j++) {
+            virDomainVcpuDef *vcpu = virDomainDefGetVcpu(dom->def, j);
+
+            if (vcpu->online &&
+                STREQ_NULLABLE(QEMU_DOMAIN_VCPU_PRIVATE(vcpu)->qomPath, qomPath))
+                break;
+        }
+
+        if (j == maxvcpus)
+            continue;
+
+        if (!(stats = qemuMonitorExtractQueryStats(info)))
+            return -1;
+
+        if (!(value = virHashLookup(stats, "halt_poll_success_ns")) ||
+            virJSONValueGetNumberUlong(value, &success[j]) < 0 ||
+            !(value = virHashLookup(stats, "halt_poll_fail_ns")) ||
+            virJSONValueGetNumberUlong(value, &fail[j]) < 0)
+            continue;
+
+        ignore_value(virBitmapSetBit(valid, j));
+    }
+
+    return 0;
+}
+
+
 static int
 qemuDomainGetStatsVcpu(virQEMUDriver *driver,
                        virDomainObj *dom,
@@ -17999,6 +18507,9 @@ qemuDomainGetStatsVcpu(virQEMUDriver *driver,
     virVcpuInfoPtr cpuinfo = NULL;
     g_autofree unsigned long long *cpuwait = NULL;
     g_autofree unsigned long long *cpudelay = NULL;
+    g_autofree unsigned long long *haltpollsuccess = NULL;
+    g_autofree unsigned long long *haltpollfail = NULL;
+    g_autoptr(virBitmap) haltpollvalid = NULL;
 
     if (virTypedParamListAddUInt(params, virDomainDefGetVcpus(dom->def),
                                  "vcpu.current") < 0)
@@ -18019,6 +18530,22 @@ qemuDomainGetStatsVcpu(virQEMUDriver *driver,
             virResetLastError();
     }
 
+    if (HAVE_JOB(privflags) && virDomainObjIsActive(dom) &&
+        virQEMUCapsGet(QEMU_DOMAIN_PRIVATE(dom)->qemuCaps, QEMU_CAPS_QUERY_STATS)) {
+        size_t maxvcpus = virDomainDefGetVcpusMax(dom->def);
+
+        haltpollsuccess = g_new0(unsigned long long, maxvcpus);
+        haltpollfail = g_new0(unsigned long long, maxvcpus);
+        haltpollvalid = virBitmapNew(maxvcpus);
+
+        if (qemuDomainGetStatsVcpuHaltPoll(driver, dom, haltpollsuccess,
+                                           haltpollfail, haltpollvalid) < 0) {
+            /* halt polling stats are optional, so stay silent */
+            virBitmapClearAll(haltpollvalid);
+            virResetLastError();
+        }
+    }
+
     if (qemuDomainHelperGetVcpus(dom, cpuinfo, cpuwait, cpudelay,
                                  virDomainDefGetVcpus(dom->def),
                                  NULL, 0) < 0) {
@@ -18048,6 +18575,21 @@ qemuDomainGetStatsVcpu(virQEMUDriver *driver,
                                         "vcpu.%u.delay", cpuinfo[i].number) < 0)
             goto cleanup;
 
+        if (haltpollvalid &&
+            virBitmapIsBitSet(haltpollvalid, cpuinfo[i].number)) {
+            if (virTypedParamListAddULLong(params,
+                                           haltpollsuccess[cpuinfo[i].number],
+                                           "vcpu.%u.haltpoll.success.time",
+                                           cpuinfo[i].number) < 0)
+                goto cleanup;
+
+            if (virTypedParamListAddULLong(params,
+                                           haltpollfail[cpuinfo[i].number],
+                                           "vcpu.%u.haltpoll.fail.time",
+                                           cpuinfo[i].number) < 0)
+                goto cleanup;
+        }
+
         /* state below is extracted from the individual vcpu structs */
         if (!(vcpu = virDomainDefGetVcpu(dom->def, cpuinfo[i].number)))
             continue;
@@ -18616,40 +19158,111 @@ qemuDomainGetStatsIOThread(virQEMUDriver *driver,
 }
 
 
-static int
-qemuDomainGetStatsPerfOneEvent(virPerf *perf,
-                               virPerfEventType type,
-                               virTypedParamList *params)
+/**
+ * qemuDomainGetStatsPerfVcpuSync:
+ * @vm: domain object
+ * @vcpu: vCPU definition
+ *
+ * Makes the perf events of the thread of @vcpu mirror the perf events
+ * enabled for the whole domain. Events which can't be enabled for the thread
+ * are skipped.
+ *
+ * Returns the perf events of the thread, or NULL if it has none.
+ */
+static virPerf *
+qemuDomainGetStatsPerfVcpuSync(virDomainObj *vm,
+                               virDomainVcpuDef *vcpu)
 {
-    uint64_t value = 0;
+    qemuDomainObjPrivate *priv = vm->privateData;
+    qemuDomainVcpuPrivate *vcpupriv = QEMU_DOMAIN_VCPU_PRIVATE(vcpu);
+    size_t i;
 
-    if (virPerfReadEvent(perf, type, &value) < 0)
-        return -1;
+    if (vcpupriv->perf &&
+        (!vcpu->online || vcpupriv->perfTid != vcpupriv->tid))
+        g_clear_pointer(&vcpupriv->perf, virPerfFree);
 
-    if (virTypedParamListAddULLong(params, value, "perf.%s",
-                                   virPerfEventTypeToString(type)) < 0)
-        return -1;
+    if (!vcpu->online || vcpupriv->tid == 0)
+        return NULL;
 
-    return 0;
+    if (!vcpupriv->perf) {
+        vcpupriv->perf = virPerfNew();
+        vcpupriv->perfTid = vcpupriv->tid;
+    }
+
+    for (i = 0; i < VIR_PERF_EVENT_LAST; i++) {
+        bool enabled = virPerfEventIsEnabled(priv->perf, i);
+
+        if (enabled == virPerfEventIsEnabled(vcpupriv->perf, i))
+            continue;
+
+        if ((enabled &&
+             virPerfEventEnable(vcpupriv->perf, i, vcpupriv->tid) < 0) ||
+            (!enabled &&
+             virPerfEventDisable(vcpupriv->perf, i) < 0)) {
+            VIR_DEBUG("Unable to update perf event %s of vCPU thread %d of domain %s: %s",
+                      virPerfEventTypeToString(i), (int) vcpupriv->tid,
+                      vm->def->name, virGetLastErrorMessage());
+            virResetLastError();
+        }
+    }
+
+    return vcpupriv->perf;
 }
 
+
 static int
-qemuDomainGetStatsPerf(virQEMUDriver *driver G_GNUC_UNUSED,
+qemuDomainGetStatsPerf(virQEMUDriver *driver,
                        virDomainObj *dom,
                        virTypedParamList *params,
                        unsigned int privflags G_GNUC_UNUSED)
 {
-    size_t i;
+    g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(driver);
     qemuDomainObjPrivate *priv = dom->privateData;
+    uint64_t values[VIR_PERF_EVENT_LAST];
+    size_t i;
+    size_t j;
+
+    if (!priv->perf)
+        return 0;
+
+    if (virPerfReadEvents(priv->perf, values) < 0)
+        return -1;
 
     for (i = 0; i < VIR_PERF_EVENT_LAST; i++) {
         if (!virPerfEventIsEnabled(priv->perf, i))
              continue;
 
-        if (qemuDomainGetStatsPerfOneEvent(priv->perf, i, params) < 0)
+        if (virTypedParamListAddULLong(params, values[i], "perf.%s",
+                                       virPerfEventTypeToString(i)) < 0)
             return -1;
     }
 
+    if (!cfg->perfVcpuStats)
+        return 0;
+
+    for (i = 0; i < virDomainDefGetVcpusMax(dom->def); i++) {
+        virDomainVcpuDef *vcpu = virDomainDefGetVcpu(dom->def, i);
+        virPerf *perf;
+
+        if (!(perf = qemuDomainGetStatsPerfVcpuSync(dom, vcpu)))
+            continue;
+
+        if (virPerfReadEvents(perf, values) < 0) {
+            virResetLastError();
+            continue;
+        }
+
+        for (j = 0; j < VIR_PERF_EVENT_LAST; j++) {
+            if (!virPerfEventIsEnabled(perf, j))
+                continue;
+
+            if (virTypedParamListAddULLong(params, values[j],
+                                           "perf.vcpu.%zu.%s", i,
+                                           virPerfEventTypeToString(j)) < 0)
+                return -1;
+        }
+    }
+
     return 0;
 }
 
@@ -18668,6 +19281,37 @@ qemuDomainGetStatsDirtyRateMon(virQEMUDriver *driver,
     return ret;
 }
 
+static int
+qemuDomainGetStatsDirtyRateHistory(virDomainObj *dom,
+                                   virTypedParamList *params)
+{
+    qemuDomainObjPrivate *priv = dom->privateData;
+    size_t i;
+
+    if (priv->ndirtyRateHistory == 0)
+        return 0;
+
+    if (virTypedParamListAddUInt(params, priv->ndirtyRateHistory,
+                                 "dirtyrate.history.count") < 0)
+        return -1;
+
+    for (i = 0; i < priv->ndirtyRateHistory; i++) {
+        qemuDomainDirtyRateSample *sample = priv->dirtyRateHistory +
+            (priv->dirtyRateHistoryNext + QEMU_DOMAIN_DIRTYRATE_HISTORY - 1 - i) %
+            QEMU_DOMAIN_DIRTYRATE_HISTORY;
+
+        if (virTypedParamListAddLLong(params, sample->startTime,
+                                      "dirtyrate.history.%zu.calc_start_time", i) < 0 ||
+            virTypedParamListAddInt(params, sample->calcTime,
+                                    "dirtyrate.history.%zu.calc_period", i) < 0 ||
+            virTypedParamListAddLLong(params, sample->dirtyRate,
+                                      "dirtyrate.history.%zu.megabytes_per_second", i) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
 static int
 qemuDomainGetStatsDirtyRate(virQEMUDriver *driver,
                             virDomainObj *dom,
@@ -18676,7 +19320,14 @@ qemuDomainGetStatsDirtyRate(virQEMUDriver *driver,
 {
     qemuMonitorDirtyRateInfo info;
 
-    if (!HAVE_JOB(privflags) || !virDomainObjIsActive(dom))
+    if (!virDomainObjIsActive(dom))
+        return 0;
+
+    /* The history doesn't need the monitor */
+    if (qemuDomainGetStatsDirtyRateHistory(dom, params) < 0)
+        return -1;
+
+    if (!HAVE_JOB(privflags))
         return 0;
 
     if (qemuDomainGetStatsDirtyRateMon(driver, dom, &info) < 0)
@@ -18718,11 +19369,260 @@ qemuDomainGetStatsDirtyRate(virQEMUDriver *driver,
     return 0;
 }
 
-typedef int
-(*qemuDomainGetStatsFunc)(virQEMUDriver *driver,
-                          virDomainObj *dom,
-                          virTypedParamList *list,
-                          unsigned int flags);
+
+static int
+qemuDomainGetStatsJobParam(virTypedParamList *params,
+                           virTypedParameterPtr param)
+{
+    switch ((virTypedParameterType) param->type) {
+    case VIR_TYPED_PARAM_INT:
+        return virTypedParamListAddInt(params, param->value.i,
+                                       "job.%s", param->field);
+    case VIR_TYPED_PARAM_UINT:
+        return virTypedParamListAddUInt(params, param->value.ui,
+                                        "job.%s", param->field);
+    case VIR_TYPED_PARAM_LLONG:
+        return virTypedParamListAddLLong(params, param->value.l,
+                                         "job.%s", param->field);
+    case VIR_TYPED_PARAM_ULLONG:
+        return virTypedParamListAddULLong(params, param->value.ul,
+                                          "job.%s", param->field);
+    case VIR_TYPED_PARAM_DOUBLE:
+        return virTypedParamListAddDouble(params, param->value.d,
+                                          "job.%s", param->field);
+    case VIR_TYPED_PARAM_BOOLEAN:
+        return virTypedParamListAddBoolean(params, param->value.b,
+                                           "job.%s", param->field);
+    case VIR_TYPED_PARAM_STRING:
+        return virTypedParamListAddString(params, param->value.s,
+                                          "job.%s", param->field);
+    case VIR_TYPED_PARAM_LAST:
+        break;
+    }
+
+    return 0;
+}
+
+
+static int
+qemuDomainGetStatsJob(virQEMUDriver *driver,
+                      virDomainObj *dom,
+                      virTypedParamList *params,
+                      unsigned int privflags)
+{
+    qemuDomainObjPrivate *priv = dom->privateData;
+    qemuDomainJobDataPrivate *privStats;
+    g_autoptr(virDomainJobData) jobData = NULL;
+    virTypedParameterPtr par = NULL;
+    int npar = 0;
+    int type;
+    size_t i;
+    int ret = -1;
+
+    if (!virDomainObjIsActive(dom) || !priv->job.current ||
+        priv->job.asyncJob == VIR_ASYNC_JOB_MIGRATION_IN)
+        return 0;
+
+    jobData = virDomainJobDataCopy(priv->job.current);
+    privStats = jobData->privateData;
+
+    if (privStats->statsType == QEMU_DOMAIN_JOB_STATS_TYPE_NONE)
+        return 0;
+
+    /* Without a job the monitor can't be used, report the data the job
+     * recorded last, e.g. from migration status events */
+    if (HAVE_JOB(privflags)) {
+        if (qemuDomainJobDataRefresh(driver, dom, jobData) < 0)
+            return -1;
+    } else if (qemuDomainJobDataUpdateTime(jobData) < 0) {
+        return -1;
+    }
+
+    if (qemuDomainJobDataToParams(jobData, &type, &par, &npar) < 0)
+        return -1;
+
+    if (virTypedParamListAddInt(params, type, "job.type") < 0)
+        goto cleanup;
+
+    for (i = 0; i < npar; i++) {
+        if (qemuDomainGetStatsJobParam(params, par + i) < 0)
+            goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virTypedParamsFree(par, npar);
+    return ret;
+}
+
+
+static int
+qemuDomainGetStatsStart(virQEMUDriver *driver G_GNUC_UNUSED,
+                        virDomainObj *dom,
+                        virTypedParamList *params,
+                        unsigned int privflags G_GNUC_UNUSED)
+{
+    qemuDomainObjPrivate *priv = dom->privateData;
+    size_t i;
+
+    /* not known for domains started before the daemon was restarted */
+    if (!virDomainObjIsActive(dom) || priv->startPhaseBegin == 0)
+        return 0;
+
+    if (virTypedParamListAddULLong(params,
+                                   priv->startPhaseBegin - priv->startBegin,
+                                   "start.time") < 0)
+        return -1;
+
+    if (virTypedParamListAddUInt(params, QEMU_DOMAIN_START_PHASE_LAST,
+                                 "start.phase.count") < 0)
+        return -1;
+
+    for (i = 0; i < QEMU_DOMAIN_START_PHASE_LAST; i++) {
+        if (virTypedParamListAddString(params,
+                                       qemuDomainStartPhaseTypeToString(i),
+                                       "start.phase.%zu.name", i) < 0)
+            return -1;
+
+        if (virTypedParamListAddULLong(params, priv->startPhases[i],
+                                       "start.phase.%zu.time", i) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+qemuDomainGetStatsPressureAdd(virTypedParamList *params,
+                              const char *resource,
+                              const char *kind,
+                              virCgroupPressure *pressure)
+{
+    if (virTypedParamListAddDouble(params, pressure->avg10,
+                                   "pressure.%s.%s.avg10",
+                                   resource, kind) < 0 ||
+        virTypedParamListAddDouble(params, pressure->avg60,
+                                   "pressure.%s.%s.avg60",
+                                   resource, kind) < 0 ||
+        virTypedParamListAddDouble(params, pressure->avg300,
+                                   "pressure.%s.%s.avg300",
+                                   resource, kind) < 0 ||
+        virTypedParamListAddULLong(params, pressure->total,
+                                   "pressure.%s.%s.total",
+                                   resource, kind) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+static int
+qemuDomainGetStatsPressure(virQEMUDriver *driver,
+                           virDomainObj *dom,
+                           virTypedParamList *params,
+                           unsigned int privflags G_GNUC_UNUSED)
+{
+    qemuDomainObjPrivate *priv = dom->privateData;
+    unsigned long long triggers[VIR_CGROUP_PRESSURE_LAST] = { 0 };
+    bool watched[VIR_CGROUP_PRESSURE_LAST] = { false };
+    size_t i;
+
+    if (!virDomainObjIsActive(dom) || !priv->cgroup)
+        return 0;
+
+    qemuDomainStatsPushGetPressureTriggers(driver->statsPush, dom->def->uuid,
+                                           triggers, watched);
+
+    for (i = 0; i < VIR_CGROUP_PRESSURE_LAST; i++) {
+        const char *resource = virCgroupPressureResourceTypeToString(i);
+        virCgroupPressure some;
+        virCgroupPressure full;
+        bool hasFull;
+
+        /* not available with cgroup v1 or without CONFIG_PSI */
+        if (virCgroupGetPressure(priv->cgroup, i, &some, &full, &hasFull) < 0) {
+            virResetLastError();
+            continue;
+        }
+
+        if (qemuDomainGetStatsPressureAdd(params, resource, "some", &some) < 0)
+            return -1;
+
+        if (hasFull &&
+            qemuDomainGetStatsPressureAdd(params, resource, "full", &full) < 0)
+            return -1;
+
+        if (watched[i] &&
+            virTypedParamListAddULLong(params, triggers[i],
+                                       "pressure.%s.triggers", resource) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+qemuDomainGetStatsJobLock(virQEMUDriver *driver G_GNUC_UNUSED,
+                          virDomainObj *dom,
+                          virTypedParamList *params,
+                          unsigned int privflags G_GNUC_UNUSED)
+{
+    qemuDomainObjPrivate *priv = dom->privateData;
+
+    return qemuDomainJobLockStatsToParams(&priv->job, params);
+}
+
+
+static int
+qemuDomainGetStatsDaemonMemory(virQEMUDriver *driver,
+                               virDomainObj *dom,
+                               virTypedParamList *params,
+                               unsigned int privflags G_GNUC_UNUSED)
+{
+    qemuDomainObjPrivate *priv = dom->privateData;
+    virDomainObjMemoryUsage usage;
+    unsigned long long total;
+
+    if (virDomainObjGetMemoryUsage(dom, driver->xmlopt, &usage) < 0)
+        return -1;
+
+    total = sizeof(*dom) + sizeof(*priv) + usage.definition +
+        usage.privateData + usage.snapshots + usage.checkpoints;
+
+    if (virTypedParamListAddULLong(params, total,
+                                   "daemon_memory.total") < 0 ||
+        virTypedParamListAddULLong(params, usage.definition,
+                                   "daemon_memory.definition") < 0 ||
+        virTypedParamListAddULLong(params, usage.privateData,
+                                   "daemon_memory.private") < 0 ||
+        virTypedParamListAddUInt(params, usage.nsnapshots,
+                                 "daemon_memory.snapshots.count") < 0 ||
+        virTypedParamListAddULLong(params, usage.snapshots,
+                                   "daemon_memory.snapshots.bytes") < 0 ||
+        virTypedParamListAddUInt(params, usage.ncheckpoints,
+                                 "daemon_memory.checkpoints.count") < 0 ||
+        virTypedParamListAddULLong(params, usage.checkpoints,
+                                   "daemon_memory.checkpoints.bytes") < 0)
+        return -1;
+
+    /* Shared by all domains using the same emulator binary */
+    if (priv->qemuCaps &&
+        virTypedParamListAddULLong(params,
+                                   virQEMUCapsGetMemoryUsage(priv->qemuCaps),
+                                   "daemon_memory.capabilities") < 0)
+        return -1;
+
+    return 0;
+}
+
+typedef int
+(*qemuDomainGetStatsFunc)(virQEMUDriver *driver,
+                          virDomainObj *dom,
+                          virTypedParamList *list,
+                          unsigned int flags);
 
 struct qemuDomainGetStatsWorker {
     qemuDomainGetStatsFunc func;
@@ -18732,226 +19632,1651 @@ struct qemuDomainGetStatsWorker {
 };
 
 
-static virQEMUCapsFlags queryIOThreadRequired[] = {
-    QEMU_CAPS_OBJECT_IOTHREAD,
-    QEMU_CAPS_LAST
-};
+static virQEMUCapsFlags queryIOThreadRequired[] = {
+    QEMU_CAPS_OBJECT_IOTHREAD,
+    QEMU_CAPS_LAST
+};
+
+static virQEMUCapsFlags queryDirtyRateRequired[] = {
+    QEMU_CAPS_QUERY_DIRTY_RATE,
+    QEMU_CAPS_LAST
+};
+
+static struct qemuDomainGetStatsWorker qemuDomainGetStatsWorkers[] = {
+    { qemuDomainGetStatsState, VIR_DOMAIN_STATS_STATE, false, NULL },
+    { qemuDomainGetStatsCpu, VIR_DOMAIN_STATS_CPU_TOTAL, false, NULL },
+    { qemuDomainGetStatsBalloon, VIR_DOMAIN_STATS_BALLOON, true, NULL },
+    { qemuDomainGetStatsVcpu, VIR_DOMAIN_STATS_VCPU, true, NULL },
+    { qemuDomainGetStatsInterface, VIR_DOMAIN_STATS_INTERFACE, false, NULL },
+    { qemuDomainGetStatsBlock, VIR_DOMAIN_STATS_BLOCK, true, NULL },
+    { qemuDomainGetStatsPerf, VIR_DOMAIN_STATS_PERF, false, NULL },
+    { qemuDomainGetStatsIOThread, VIR_DOMAIN_STATS_IOTHREAD, true, queryIOThreadRequired },
+    { qemuDomainGetStatsMemory, VIR_DOMAIN_STATS_MEMORY, false, NULL },
+    { qemuDomainGetStatsDirtyRate, VIR_DOMAIN_STATS_DIRTYRATE, true, queryDirtyRateRequired },
+    { qemuDomainGetStatsJob, VIR_DOMAIN_STATS_JOB, true, NULL },
+    { qemuDomainGetStatsStart, VIR_DOMAIN_STATS_START, false, NULL },
+    { qemuDomainGetStatsPressure, VIR_DOMAIN_STATS_PRESSURE, false, NULL },
+    { qemuDomainGetStatsJobLock, VIR_DOMAIN_STATS_JOB_LOCK, false, NULL },
+    { qemuDomainGetStatsDaemonMemory, VIR_DOMAIN_STATS_DAEMON_MEMORY, false, NULL },
+    { NULL, 0, false, NULL }
+};
+
+
+static int
+qemuDomainGetStatsCheckSupport(unsigned int *stats,
+                               bool enforce,
+                               virDomainObj *vm)
+{
+    qemuDomainObjPrivate *priv = vm->privateData;
+    unsigned int supportedstats = 0;
+    size_t i;
+
+    for (i = 0; qemuDomainGetStatsWorkers[i].func; i++) {
+        bool supportedByQemu = true;
+        virQEMUCapsFlags *requiredCaps = qemuDomainGetStatsWorkers[i].requiredCaps;
+
+        while (requiredCaps && *requiredCaps != QEMU_CAPS_LAST) {
+            if (!virQEMUCapsGet(priv->qemuCaps, *requiredCaps)) {
+                supportedByQemu = false;
+                break;
+            }
+
+            requiredCaps++;
+        }
+
+        if (supportedByQemu) {
+            supportedstats |= qemuDomainGetStatsWorkers[i].stats;
+        }
+    }
+
+    if (*stats == 0) {
+        /* Formatting all the XML of the domain is too costly to be
+         * done unless asked for */
+        *stats = supportedstats & ~VIR_DOMAIN_STATS_DAEMON_MEMORY;
+        return 0;
+    }
+
+    if (enforce &&
+        *stats & ~supportedstats) {
+        virReportError(VIR_ERR_ARGUMENT_UNSUPPORTED,
+                       _("Stats types bits 0x%x are not supported by this daemon or QEMU"),
+                       *stats & ~supportedstats);
+        return -1;
+    }
+
+    *stats &= supportedstats;
+    return 0;
+}
+
+
+static bool
+qemuDomainGetStatsNeedMonitor(unsigned int stats)
+{
+    size_t i;
+
+    for (i = 0; qemuDomainGetStatsWorkers[i].func; i++)
+        if (stats & qemuDomainGetStatsWorkers[i].stats &&
+            qemuDomainGetStatsWorkers[i].monitor)
+            return true;
+
+    return false;
+}
+
+
+/**
+ * qemuDomainStatsCacheLookup:
+ * @priv: domain private data
+ * @worker: stats worker the data is looked up for
+ * @flags: qemuDomainStatsFlags of the current request
+ * @maxAge: maximum age of the cached data in milliseconds
+ *
+ * Looks up stats of @worker cached in @priv which are not older than
+ * @maxAge and are at least as complete as what collecting them with
+ * @flags would produce.  The caller must hold the domain object lock and
+ * must not use the returned entry after releasing it.
+ *
+ * Returns the cache entry or NULL if there's no usable one.
+ */
+static qemuDomainStatsCacheEntry *
+qemuDomainStatsCacheLookup(qemuDomainObjPrivate *priv,
+                           struct qemuDomainGetStatsWorker *worker,
+                           unsigned int flags,
+                           unsigned int maxAge)
+{
+    gint64 now = g_get_monotonic_time();
+    size_t i;
+
+    for (i = 0; i < priv->nstatsCache; i++) {
+        qemuDomainStatsCacheEntry *entry = priv->statsCache + i;
+
+        if (entry->stats != worker->stats ||
+            (entry->flags & QEMU_DOMAIN_STATS_BACKING) != (flags & QEMU_DOMAIN_STATS_BACKING))
+            continue;
+
+        if (now - entry->timestamp > (gint64) maxAge * 1000)
+            return NULL;
+
+        if (worker->monitor && HAVE_JOB(flags) && !HAVE_JOB(entry->flags))
+            return NULL;
+
+        return entry;
+    }
+
+    return NULL;
+}
+
+
+/**
+ * qemuDomainStatsCacheStore:
+ * @priv: domain private data
+ * @stats: stats group the data belongs to
+ * @flags: qemuDomainStatsFlags the data was collected with
+ * @params: collected stats
+ * @nparams: number of items in @params
+ *
+ * Stores a copy of @params in the stats cache of @priv replacing any
+ * previous data of the same group collected with the same backing chain
+ * setting.  The caller must hold the domain object lock.
+ */
+static void
+qemuDomainStatsCacheStore(qemuDomainObjPrivate *priv,
+                          unsigned int stats,
+                          unsigned int flags,
+                          virTypedParameterPtr params,
+                          size_t nparams)
+{
+    qemuDomainStatsCacheEntry *entry = NULL;
+    virTypedParameterPtr copy = NULL;
+    int rc;
+    size_t i;
+
+    flags &= QEMU_DOMAIN_STATS_HAVE_JOB | QEMU_DOMAIN_STATS_BACKING;
+
+    rc = virTypedParamsCopy(&copy, params, nparams);
+
+    for (i = 0; i < priv->nstatsCache; i++) {
+        if (priv->statsCache[i].stats == stats &&
+            (priv->statsCache[i].flags & QEMU_DOMAIN_STATS_BACKING) == (flags & QEMU_DOMAIN_STATS_BACKING)) {
+            entry = priv->statsCache + i;
+            virTypedParamsFree(entry->params, entry->nparams);
+            break;
+        }
+    }
+
+    /* Don't keep serving the old data, nor stats which are not there */
+    if (rc < 0) {
+        virResetLastError();
+        if (entry)
+            VIR_DELETE_ELEMENT(priv->statsCache, i, priv->nstatsCache);
+        return;
+    }
+
+    if (!entry) {
+        VIR_EXPAND_N(priv->statsCache, priv->nstatsCache, 1);
+        entry = priv->statsCache + priv->nstatsCache - 1;
+    }
+
+    entry->stats = stats;
+    entry->flags = flags;
+    entry->timestamp = g_get_monotonic_time();
+    entry->params = copy;
+    entry->nparams = nparams;
+}
+
+
+/**
+ * qemuDomainStatsCacheCovers:
+ * @priv: domain private data
+ * @stats: requested stats groups
+ * @flags: qemuDomainStatsFlags of the current request
+ * @maxAge: maximum age of the cached data in milliseconds
+ *
+ * Returns true if all groups in @stats which require the monitor can be
+ * served from the stats cache, so that no job needs to be acquired.
+ */
+static bool
+qemuDomainStatsCacheCovers(qemuDomainObjPrivate *priv,
+                           unsigned int stats,
+                           unsigned int flags,
+                           unsigned int maxAge)
+{
+    size_t i;
+
+    for (i = 0; qemuDomainGetStatsWorkers[i].func; i++) {
+        struct qemuDomainGetStatsWorker *worker = qemuDomainGetStatsWorkers + i;
+
+        if (!(stats & worker->stats) || !worker->monitor)
+            continue;
+
+        if (!qemuDomainStatsCacheLookup(priv, worker,
+                                        flags | QEMU_DOMAIN_STATS_HAVE_JOB,
+                                        maxAge))
+            return false;
+    }
+
+    return true;
+}
+
+
+/**
+ * qemuDomainGetStatsParams:
+ * @driver: qemu driver
+ * @dom: locked domain object
+ * @stats: stats groups to collect
+ * @params: list the stats are appended to
+ * @groupEnd: optional array filled with the size of @params after each
+ *            worker in qemuDomainGetStatsWorkers
+ * @flags: qemuDomainStatsFlags
+ *
+ * Collects the stats groups in @stats of @dom.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+static int
+qemuDomainGetStatsParams(virQEMUDriver *driver,
+                         virDomainObj *dom,
+                         unsigned int stats,
+                         virTypedParamList *params,
+                         size_t *groupEnd,
+                         unsigned int flags)
+{
+    g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(driver);
+    qemuDomainObjPrivate *priv = dom->privateData;
+    bool useCache = cfg->statsCacheMaxAge > 0 && virDomainObjIsActive(dom);
+    int id = dom->def->id;
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
+    size_t i;
+
+    virUUIDFormat(dom->def->uuid, uuidstr);
+
+    for (i = 0; qemuDomainGetStatsWorkers[i].func; i++) {
+        struct qemuDomainGetStatsWorker *worker = qemuDomainGetStatsWorkers + i;
+        qemuDomainStatsCacheEntry *entry;
+        size_t start = params->npar;
+        unsigned long long begin = g_get_monotonic_time();
+        bool cached = false;
+
+        if (groupEnd)
+            groupEnd[i] = start;
+
+        if (!(stats & worker->stats))
+            continue;
+
+        if (useCache && (flags & QEMU_DOMAIN_STATS_CACHED) &&
+            (entry = qemuDomainStatsCacheLookup(priv, worker, flags,
+                                                cfg->statsCacheMaxAge))) {
+            virTypedParamListAddParams(params, entry->params, entry->nparams);
+            cached = true;
+        } else {
+            if (worker->func(driver, dom, params, flags) < 0)
+                return -1;
+
+            /* The domain object lock is dropped while talking to the
+             * monitor so make sure the data still belongs to the same
+             * instance of the domain before caching it. */
+            if (useCache && virDomainObjIsActive(dom) && dom->def->id == id)
+                qemuDomainStatsCacheStore(priv, worker->stats, flags,
+                                          params->par + start,
+                                          params->npar - start);
+        }
+
+        PROBE(QEMU_STATS_WORKER,
+              "uuid=%s group=0x%x cached=%d nparams=%zu usec=%llu",
+              uuidstr, worker->stats, cached, params->npar - start,
+              g_get_monotonic_time() - begin);
+
+        if (groupEnd)
+            groupEnd[i] = params->npar;
+    }
+
+    return 0;
+}
+
+
+/**
+ * qemuDomainGetStatsLocked:
+ * @driver: qemu driver
+ * @vm: locked domain object
+ * @stats: stats groups to collect
+ * @params: list the stats are appended to
+ * @groupEnd: optional, see qemuDomainGetStatsParams
+ * @flags: virConnectGetAllDomainStatsFlags
+ *
+ * Collects the stats groups in @stats of @vm, acquiring a query job for the
+ * groups which need to talk to the monitor.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+static int
+qemuDomainGetStatsLocked(virQEMUDriver *driver,
+                         virDomainObj *vm,
+                         unsigned int stats,
+                         virTypedParamList *params,
+                         size_t *groupEnd,
+                         unsigned int flags)
+{
+    bool enforce = !!(flags & VIR_CONNECT_GET_ALL_DOMAINS_STATS_ENFORCE_STATS);
+    unsigned int privflags = 0;
+    unsigned int domflags = 0;
+    int rc;
+
+    if (flags & VIR_CONNECT_GET_ALL_DOMAINS_STATS_BACKING)
+        domflags |= QEMU_DOMAIN_STATS_BACKING;
+    if (flags & VIR_CONNECT_GET_ALL_DOMAINS_STATS_CACHED)
+        domflags |= QEMU_DOMAIN_STATS_CACHED;
+
+    if (qemuDomainGetStatsCheckSupport(&stats, enforce, vm) < 0)
+        return -1;
+
+    if (qemuDomainGetStatsNeedMonitor(stats))
+        privflags |= QEMU_DOMAIN_STATS_HAVE_JOB;
+
+    if (HAVE_JOB(privflags) && (domflags & QEMU_DOMAIN_STATS_CACHED)) {
+        g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(driver);
+
+        if (cfg->statsCacheMaxAge > 0 && virDomainObjIsActive(vm) &&
+            qemuDomainStatsCacheCovers(vm->privateData, stats, domflags,
+                                       cfg->statsCacheMaxAge))
+            privflags &= ~QEMU_DOMAIN_STATS_HAVE_JOB;
+    }
+
+    if (HAVE_JOB(privflags)) {
+        int rv;
+
+        if (flags & VIR_CONNECT_GET_ALL_DOMAINS_STATS_NOWAIT)
+            rv = qemuDomainObjBeginJobNowait(driver, vm, VIR_JOB_QUERY);
+        else
+            rv = qemuDomainObjBeginJob(driver, vm, VIR_JOB_QUERY);
+
+        if (rv == 0)
+            domflags |= QEMU_DOMAIN_STATS_HAVE_JOB;
+    }
+    /* else: without a job it's still possible to gather some data */
+
+    rc = qemuDomainGetStatsParams(driver, vm, stats, params, groupEnd, domflags);
+
+    if (HAVE_JOB(domflags))
+        qemuDomainObjEndJob(vm);
+
+    return rc;
+}
+
+
+static int
+qemuConnectGetAllDomainStatsOne(virConnectPtr conn,
+                                virDomainObj *vm,
+                                unsigned int stats,
+                                virDomainStatsRecordPtr *record,
+                                unsigned int flags)
+{
+    virQEMUDriver *driver = conn->privateData;
+    g_autofree virDomainStatsRecordPtr tmp = NULL;
+    g_autoptr(virTypedParamList) params = g_new0(virTypedParamList, 1);
+    int ret = -1;
+
+    virObjectLock(vm);
+
+    if (qemuDomainGetStatsLocked(driver, vm, stats, params, NULL, flags) < 0)
+        goto cleanup;
+
+    tmp = g_new0(virDomainStatsRecord, 1);
+
+    if (!(tmp->dom = virGetDomain(conn, vm->def->name,
+                                  vm->def->uuid, vm->def->id)))
+        goto cleanup;
+
+    tmp->nparams = virTypedParamListStealParams(params, &tmp->params);
+    *record = g_steal_pointer(&tmp);
+    ret = 0;
+
+ cleanup:
+    virObjectUnlock(vm);
+    return ret;
+}
+
+
+typedef struct _qemuConnectGetAllDomainStatsData qemuConnectGetAllDomainStatsData;
+struct _qemuConnectGetAllDomainStatsData {
+    virConnectPtr conn;
+    unsigned int stats;
+    unsigned int flags;
+
+    virDomainObj **vms;
+    virDomainStatsRecordPtr *records;
+    virErrorPtr *errors;
+
+    virMutex lock;
+    virCond cond;
+    size_t pending;
+    bool failed;
+};
+
+typedef struct _qemuConnectGetAllDomainStatsJob qemuConnectGetAllDomainStatsJob;
+struct _qemuConnectGetAllDomainStatsJob {
+    qemuConnectGetAllDomainStatsData *data;
+    size_t idx;
+};
+
+
+static void
+qemuConnectGetAllDomainStatsWorker(void *jobdata,
+                                   void *opaque G_GNUC_UNUSED)
+{
+    qemuConnectGetAllDomainStatsJob *job = jobdata;
+    qemuConnectGetAllDomainStatsData *data = job->data;
+    bool skip;
+
+    VIR_WITH_MUTEX_LOCK_GUARD(&data->lock) {
+        skip = data->failed;
+    }
+
+    /* No point in collecting more once the call is going to fail */
+    if (!skip &&
+        qemuConnectGetAllDomainStatsOne(data->conn, data->vms[job->idx],
+                                        data->stats, &data->records[job->idx],
+                                        data->flags) < 0) {
+        data->errors[job->idx] = virSaveLastError();
+        skip = true;
+    }
+
+    VIR_WITH_MUTEX_LOCK_GUARD(&data->lock) {
+        if (skip)
+            data->failed = true;
+        if (--data->pending == 0)
+            virCondSignal(&data->cond);
+    }
+}
+
+
+/*
+ * Collects the statistics of @nvms domains into @records on up to
+ * @nworkers threads. Every domain is handled exactly as in the
+ * sequential case, so the semantics of the flags are kept, and
+ * @records keeps the order of @vms. Returns the index of the first
+ * domain which failed with its error set, or @nvms on success.
+ */
+static size_t
+qemuConnectGetAllDomainStatsParallel(virConnectPtr conn,
+                                     virDomainObj **vms,
+                                     size_t nvms,
+                                     unsigned int stats,
+                                     virDomainStatsRecordPtr *records,
+                                     unsigned int flags,
+                                     size_t nworkers)
+{
+    g_autoptr(virIdentity) identity = virIdentityGetCurrent();
+    g_autofree qemuConnectGetAllDomainStatsJob *jobs = NULL;
+    g_autofree virErrorPtr *errors = NULL;
+    qemuConnectGetAllDomainStatsData data = {
+        .conn = conn, .stats = stats, .flags = flags, .vms = vms,
+        .records = records,
+    };
+    virThreadPool *pool;
+    size_t ret = nvms;
+    size_t i;
+
+    errors = g_new0(virErrorPtr, nvms);
+    data.errors = errors;
+
+    if (virMutexInit(&data.lock) < 0) {
+        virReportSystemError(errno, "%s", _("unable to init mutex"));
+        return 0;
+    }
+    if (virCondInit(&data.cond) < 0) {
+        virReportSystemError(errno, "%s", _("unable to init cond"));
+        virMutexDestroy(&data.lock);
+        return 0;
+    }
+
+    if (!(pool = virThreadPoolNewFull(0, nworkers, 0,
+                                      qemuConnectGetAllDomainStatsWorker,
+                                      "qemu-stats", identity, NULL))) {
+        ret = 0;
+        goto cleanup;
+    }
+
+    jobs = g_new0(qemuConnectGetAllDomainStatsJob, nvms);
+
+    VIR_WITH_MUTEX_LOCK_GUARD(&data.lock) {
+        for (i = 0; i < nvms; i++) {
+            jobs[i].data = &data;
+            jobs[i].idx = i;
+
+            if (virThreadPoolSendJob(pool, 0, &jobs[i]) < 0) {
+                errors[i] = virSaveLastError();
+                data.failed = true;
+                break;
+            }
+            data.pending++;
+        }
+
+        while (data.pending > 0)
+            ignore_value(virCondWait(&data.cond, &data.lock));
+    }
+
+    virThreadPoolFree(pool);
+
+    for (i = 0; i < nvms; i++) {
+        if (errors[i]) {
+            if (ret == nvms) {
+                virSetError(errors[i]);
+                ret = i;
+            }
+            virFreeError(errors[i]);
+        }
+    }
+
+ cleanup:
+    virCondDestroy(&data.cond);
+    virMutexDestroy(&data.lock);
+    return ret;
+}
+
+
+static int
+qemuConnectGetAllDomainStats(virConnectPtr conn,
+                             virDomainPtr *doms,
+                             unsigned int ndoms,
+                             unsigned int stats,
+                             virDomainStatsRecordPtr **retStats,
+                             unsigned int flags)
+{
+    virQEMUDriver *driver = conn->privateData;
+    g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(driver);
+    virErrorPtr orig_err = NULL;
+    virDomainObj **vms = NULL;
+    size_t nvms;
+    virDomainStatsRecordPtr *tmpstats = NULL;
+    g_autofree virDomainStatsRecordPtr *records = NULL;
+    size_t failed;
+    int nstats = 0;
+    size_t i;
+    int ret = -1;
+    unsigned int lflags = flags & (VIR_CONNECT_LIST_DOMAINS_FILTERS_ACTIVE |
+                                   VIR_CONNECT_LIST_DOMAINS_FILTERS_PERSISTENT |
+                                   VIR_CONNECT_LIST_DOMAINS_FILTERS_STATE);
+
+    virCheckFlags(VIR_CONNECT_LIST_DOMAINS_FILTERS_ACTIVE |
+                  VIR_CONNECT_LIST_DOMAINS_FILTERS_PERSISTENT |
+                  VIR_CONNECT_LIST_DOMAINS_FILTERS_STATE |
+                  VIR_CONNECT_GET_ALL_DOMAINS_STATS_NOWAIT |
+                  VIR_CONNECT_GET_ALL_DOMAINS_STATS_CACHED |
+                  VIR_CONNECT_GET_ALL_DOMAINS_STATS_BACKING |
+                  VIR_CONNECT_GET_ALL_DOMAINS_STATS_ENFORCE_STATS, -1);
+
+    if (virConnectGetAllDomainStatsEnsureACL(conn) < 0)
+        return -1;
+
+    if (ndoms) {
+        if (virDomainObjListConvert(driver->domains, conn, doms, ndoms, &vms,
+                                    &nvms, virConnectGetAllDomainStatsCheckACL,
+                                    lflags, true) < 0)
+            return -1;
+    } else {
+        if (virDomainObjListCollect(driver->domains, conn, &vms, &nvms,
+                                    virConnectGetAllDomainStatsCheckACL,
+                                    lflags) < 0)
+            return -1;
+    }
+
+    tmpstats = g_new0(virDomainStatsRecordPtr, nvms + 1);
+    records = g_new0(virDomainStatsRecordPtr, nvms);
+
+    if (cfg->statsWorkers > 1 && nvms > 1) {
+        failed = qemuConnectGetAllDomainStatsParallel(conn, vms, nvms, stats,
+                                                      records, flags,
+                                                      MIN(cfg->statsWorkers, nvms));
+    } else {
+        for (failed = 0; failed < nvms; failed++) {
+            if (qemuConnectGetAllDomainStatsOne(conn, vms[failed], stats,
+                                                &records[failed], flags) < 0)
+                break;
+        }
+    }
+
+    /* Hand over the records in the order of @vms, so that even on
+     * failure all collected ones are freed along with @tmpstats */
+    for (i = 0; i < nvms; i++) {
+        if (records[i])
+            tmpstats[nstats++] = records[i];
+    }
+
+    if (failed < nvms)
+        goto cleanup;
+
+    *retStats = g_steal_pointer(&tmpstats);
+
+    ret = nstats;
+
+ cleanup:
+    virErrorPreserveLast(&orig_err);
+    virDomainStatsRecordListFree(tmpstats);
+    virObjectListFreeCount(vms, nvms);
+    virErrorRestore(&orig_err);
+
+    return ret;
+}
+
+
+/* Number of domains listed by a page unless the caller asks otherwise */
+#define QEMU_LIST_DOMAINS_PAGE_LIMIT 1000
+
+/* A page with statistics shows what virConnectGetAllDomainStats() would,
+ * so the domains have to pass its ACL filter as well */
+static bool
+qemuConnectListDomainsPageStatsFilter(virConnectPtr conn,
+                                      virDomainDef *def)
+{
+    return virConnectListDomainsPageCheckACL(conn, def) &&
+        virConnectGetAllDomainStatsCheckACL(conn, def);
+}
+
+
+static int
+qemuConnectListDomainsPage(virConnectPtr conn,
+                           virTypedParameterPtr params,
+                           int nparams,
+                           virDomainStatsRecordPtr **records,
+                           char **cursor,
+                           unsigned int flags)
+{
+    virQEMUDriver *driver = conn->privateData;
+    g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(driver);
+    virErrorPtr orig_err = NULL;
+    const char *start = NULL;
+    const char *pattern = NULL;
+    const char *metadata = NULL;
+    unsigned int limit = 0;
+    unsigned int stats = 0;
+    bool wantStats = false;
+    virDomainObj **vms = NULL;
+    size_t nvms = 0;
+    g_autofree char *next = NULL;
+    virDomainStatsRecordPtr *tmprecords = NULL;
+    g_autofree virDomainStatsRecordPtr *recs = NULL;
+    int nrecords = 0;
+    /* the statistics must not make the listing wait for busy domains */
+    unsigned int statsflags = VIR_CONNECT_GET_ALL_DOMAINS_STATS_NOWAIT;
+    size_t failed;
+    size_t i;
+    int rc;
+    int ret = -1;
+
+    virCheckFlags(VIR_CONNECT_LIST_DOMAINS_FILTERS_ALL, -1);
+
+    if (virTypedParamsValidate(params, nparams,
+                               VIR_CONNECT_LIST_DOMAINS_PAGE_CURSOR, VIR_TYPED_PARAM_STRING,
+                               VIR_CONNECT_LIST_DOMAINS_PAGE_LIMIT, VIR_TYPED_PARAM_UINT,
+                               VIR_CONNECT_LIST_DOMAINS_PAGE_NAME, VIR_TYPED_PARAM_STRING,
+                               VIR_CONNECT_LIST_DOMAINS_PAGE_METADATA, VIR_TYPED_PARAM_STRING,
+                               VIR_CONNECT_LIST_DOMAINS_PAGE_STATS, VIR_TYPED_PARAM_UINT,
+                               NULL) < 0)
+        return -1;
+
+    if (virTypedParamsGetString(params, nparams,
+                                VIR_CONNECT_LIST_DOMAINS_PAGE_CURSOR, &start) < 0 ||
+        virTypedParamsGetString(params, nparams,
+                                VIR_CONNECT_LIST_DOMAINS_PAGE_NAME, &pattern) < 0 ||
+        virTypedParamsGetString(params, nparams,
+                                VIR_CONNECT_LIST_DOMAINS_PAGE_METADATA, &metadata) < 0 ||
+        virTypedParamsGetUInt(params, nparams,
+                              VIR_CONNECT_LIST_DOMAINS_PAGE_LIMIT, &limit) < 0)
+        return -1;
+
+    if ((rc = virTypedParamsGetUInt(params, nparams,
+                                    VIR_CONNECT_LIST_DOMAINS_PAGE_STATS,
+                                    &stats)) < 0)
+        return -1;
+    wantStats = rc == 1;
+
+    if (limit == 0)
+        limit = QEMU_LIST_DOMAINS_PAGE_LIMIT;
+
+    if (virConnectListDomainsPageEnsureACL(conn) < 0)
+        return -1;
+
+    if (virDomainObjListCollectPage(driver->domains, conn, start, limit,
+                                    pattern, metadata, &vms, &nvms, &next,
+                                    wantStats ?
+                                    qemuConnectListDomainsPageStatsFilter :
+                                    virConnectListDomainsPageCheckACL,
+                                    flags) < 0)
+        return -1;
+
+    tmprecords = g_new0(virDomainStatsRecordPtr, nvms + 1);
+    recs = g_new0(virDomainStatsRecordPtr, nvms);
+
+    if (wantStats && cfg->statsWorkers > 1 && nvms > 1) {
+        failed = qemuConnectGetAllDomainStatsParallel(conn, vms, nvms, stats,
+                                                      recs, statsflags,
+                                                      MIN(cfg->statsWorkers, nvms));
+    } else {
+        for (failed = 0; failed < nvms; failed++) {
+            virDomainObj *vm = vms[failed];
+
+            if (wantStats) {
+                if (qemuConnectGetAllDomainStatsOne(conn, vm, stats,
+                                                    &recs[failed],
+                                                    statsflags) < 0)
+                    break;
+                continue;
+            }
+
+            recs[failed] = g_new0(virDomainStatsRecord, 1);
+
+            virObjectLock(vm);
+            recs[failed]->dom = virGetDomain(conn, vm->def->name,
+                                             vm->def->uuid, vm->def->id);
+            virObjectUnlock(vm);
+
+            if (!recs[failed]->dom) {
+                g_clear_pointer(&recs[failed], g_free);
+                break;
+            }
+        }
+    }
+
+    /* Hand over the records in the order of @vms, so that even on
+     * failure all collected ones are freed along with @tmprecords */
+    for (i = 0; i < nvms; i++) {
+        if (recs[i])
+            tmprecords[nrecords++] = recs[i];
+    }
+
+    if (failed < nvms)
+        goto cleanup;
+
+    *records = g_steal_pointer(&tmprecords);
+    *cursor = g_steal_pointer(&next);
+    ret = nrecords;
+
+ cleanup:
+    virErrorPreserveLast(&orig_err);
+    virDomainStatsRecordListFree(tmprecords);
+    virObjectListFreeCount(vms, nvms);
+    virErrorRestore(&orig_err);
+
+    return ret;
+}
+
+
+/* Push based stats subscriptions.
+ *
+ * A single thread samples the stats of running domains on behalf of all
+ * subscriptions registered with virConnectDomainStatsRegister. Each pass
+ * collects the union of the stats groups of the subscriptions which are
+ * due, once per domain, and sends every subscription an event with the
+ * values which changed since the previous event it got for the domain.
+ */
+typedef struct _qemuDomainStatsSubscription qemuDomainStatsSubscription;
+struct _qemuDomainStatsSubscription {
+    int callbackID;
+    /* The subscriber, whose ACLs decide which domains it gets stats of */
+    virConnectPtr conn;
+    virIdentity *identity;
+    virDomainObjListACLFilter filter;
+    bool hasDom;
+    unsigned char uuid[VIR_UUID_BUFLEN];
+    unsigned int stats;
+    unsigned long long interval; /* in milliseconds */
+    unsigned long long due; /* time of the next sample in ms */
+
+    /* domain UUID -> virTypedParamList with the values sent last */
+    GHashTable *last;
+};
+
+struct _qemuDomainStatsPush {
+    virMutex lock;
+    virCond cond;
+    virThread thread;
+    bool running;
+    bool quit;
+
+    qemuDomainStatsSubscription **subs;
+    size_t nsubs;
+
+    /* domain UUID -> qemuDomainStatsPressureWatch of domains whose
+     * pressure stats are subscribed to */
+    GHashTable *pressure;
+    /* UUIDs of domains whose pressure triggers fired since the last pass */
+    GHashTable *urgent;
+};
+
+
+/*
+ * The pressure triggers configured in qemu.conf are armed in the cgroup
+ * of each domain with subscribed pressure stats. The kernel signals them
+ * by POLLPRI which the public event handle API doesn't expose, hence the
+ * GLib watches. Firing triggers make the push thread send the pressure
+ * group to the subscriptions right away instead of at their next interval.
+ */
+typedef struct _qemuDomainStatsPressureWatch qemuDomainStatsPressureWatch;
+struct _qemuDomainStatsPressureWatch {
+    size_t ntriggers;
+    int *fds;
+    GSource **sources;
+
+    bool armed[VIR_CGROUP_PRESSURE_LAST];
+    unsigned long long triggers[VIR_CGROUP_PRESSURE_LAST];
+};
+
+typedef struct _qemuDomainStatsPressureSource qemuDomainStatsPressureSource;
+struct _qemuDomainStatsPressureSource {
+    qemuDomainStatsPush *push;
+    char *uuidstr;
+    virCgroupPressureResource resource;
+};
+
+
+static void
+qemuDomainStatsPressureWatchFree(void *opaque)
+{
+    qemuDomainStatsPressureWatch *watch = opaque;
+    size_t i;
+
+    for (i = 0; i < watch->ntriggers; i++) {
+        if (watch->sources[i]) {
+            g_source_destroy(watch->sources[i]);
+            g_source_unref(watch->sources[i]);
+        }
+        VIR_FORCE_CLOSE(watch->fds[i]);
+    }
+
+    g_free(watch->sources);
+    g_free(watch->fds);
+    g_free(watch);
+}
+
+
+static void
+qemuDomainStatsPressureSourceFree(void *opaque)
+{
+    qemuDomainStatsPressureSource *src = opaque;
+
+    g_free(src->uuidstr);
+    g_free(src);
+}
+
+
+static void
+qemuDomainStatsSubscriptionFree(qemuDomainStatsSubscription *sub)
+{
+    if (!sub)
+        return;
+
+    g_clear_pointer(&sub->last, g_hash_table_unref);
+    g_clear_object(&sub->identity);
+    virObjectUnref(sub->conn);
+    g_free(sub);
+}
+
+
+static qemuDomainStatsPush *
+qemuDomainStatsPushNew(void)
+{
+    qemuDomainStatsPush *push = g_new0(qemuDomainStatsPush, 1);
+
+    if (virMutexInit(&push->lock) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("cannot initialize stats push mutex"));
+        g_free(push);
+        return NULL;
+    }
+
+    if (virCondInit(&push->cond) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("cannot initialize stats push condition"));
+        virMutexDestroy(&push->lock);
+        g_free(push);
+        return NULL;
+    }
+
+    push->pressure = virHashNew(qemuDomainStatsPressureWatchFree);
+    push->urgent = virHashNew(NULL);
+
+    return push;
+}
+
+
+static void
+qemuDomainStatsPushFree(qemuDomainStatsPush *push)
+{
+    size_t i;
+
+    if (!push)
+        return;
+
+    if (push->running) {
+        VIR_WITH_MUTEX_LOCK_GUARD(&push->lock) {
+            push->quit = true;
+            virCondSignal(&push->cond);
+        }
+        virThreadJoin(&push->thread);
+    }
+
+    for (i = 0; i < push->nsubs; i++)
+        qemuDomainStatsSubscriptionFree(push->subs[i]);
+    g_free(push->subs);
+
+    g_clear_pointer(&push->pressure, g_hash_table_unref);
+    g_clear_pointer(&push->urgent, g_hash_table_unref);
+
+    virCondDestroy(&push->cond);
+    virMutexDestroy(&push->lock);
+    g_free(push);
+}
+
+
+static bool
+qemuDomainStatsSubscriptionWants(qemuDomainStatsSubscription *sub,
+                                 virDomainObj *vm)
+{
+    return !sub->hasDom ||
+        memcmp(sub->uuid, vm->def->uuid, VIR_UUID_BUFLEN) == 0;
+}
+
+
+static qemuDomainStatsSubscription *
+qemuDomainStatsPushFind(qemuDomainStatsPush *push,
+                        int callbackID)
+{
+    size_t i;
+
+    for (i = 0; i < push->nsubs; i++) {
+        if (push->subs[i]->callbackID == callbackID)
+            return push->subs[i];
+    }
+
+    return NULL;
+}
+
+
+static bool
+qemuDomainStatsParamEqual(virTypedParameterPtr a,
+                          virTypedParameterPtr b)
+{
+    if (a->type != b->type)
+        return false;
+
+    if (a->type == VIR_TYPED_PARAM_INT)
+        return a->value.i == b->value.i;
+    if (a->type == VIR_TYPED_PARAM_UINT)
+        return a->value.ui == b->value.ui;
+    if (a->type == VIR_TYPED_PARAM_LLONG)
+        return a->value.l == b->value.l;
+    if (a->type == VIR_TYPED_PARAM_ULLONG)
+        return a->value.ul == b->value.ul;
+    if (a->type == VIR_TYPED_PARAM_DOUBLE)
+        return a->value.d == b->value.d;
+    if (a->type == VIR_TYPED_PARAM_BOOLEAN)
+        return !!a->value.b == !!b->value.b;
+    if (a->type == VIR_TYPED_PARAM_STRING)
+        return STREQ_NULLABLE(a->value.s, b->value.s);
+
+    return false;
+}
+
+
+/**
+ * qemuDomainStatsPushDiff:
+ * @last: values sent last, updated to the current ones
+ * @par: freshly sampled values
+ * @npar: number of items in @par
+ * @delta: list the changed values are appended to
+ *
+ * Fields missing in @par, e.g. because the monitor was busy, keep their
+ * previous value in @last so that they aren't reported as changed once
+ * they are available again.
+ */
+static void
+qemuDomainStatsPushDiff(virTypedParamList *last,
+                        virTypedParameterPtr par,
+                        size_t npar,
+                        virTypedParamList *delta)
+{
+    size_t hint = 0;
+    size_t i;
+    size_t j;
+
+    for (i = 0; i < npar; i++) {
+        virTypedParameterPtr old = NULL;
+
+        /* stats groups report their fields in a stable order, so the field
+         * following the previous match is the likely candidate */
+        if (hint < last->npar && STREQ(last->par[hint].field, par[i].field)) {
+            old = last->par + hint++;
+        } else {
+            for (j = 0; j < last->npar; j++) {
+                if (STREQ(last->par[j].field, par[i].field)) {
+                    old = last->par + j;
+                    hint = j + 1;
+                    break;
+                }
+            }
+        }
+
+        if (old && qemuDomainStatsParamEqual(old, par + i))
+            continue;
+
+        virTypedParamListAddParams(delta, par + i, 1);
+
+        if (old) {
+            if (old->type == VIR_TYPED_PARAM_STRING)
+                g_free(old->value.s);
+            old->type = par[i].type;
+            if (par[i].type == VIR_TYPED_PARAM_STRING)
+                old->value.s = g_strdup(par[i].value.s);
+            else
+                old->value = par[i].value;
+        } else {
+            virTypedParamListAddParams(last, par + i, 1);
+        }
+    }
+}
+
+
+static gboolean
+qemuDomainStatsPressureFired(int fd G_GNUC_UNUSED,
+                             GIOCondition cond,
+                             gpointer opaque)
+{
+    qemuDomainStatsPressureSource *src = opaque;
+    qemuDomainStatsPush *push = src->push;
+    qemuDomainStatsPressureWatch *watch;
+    VIR_LOCK_GUARD lock = virLockGuardLock(&push->lock);
+
+    /* the cgroup was removed */
+    if (cond & (G_IO_ERR | G_IO_HUP | G_IO_NVAL))
+        return G_SOURCE_REMOVE;
+
+    if ((watch = virHashLookup(push->pressure, src->uuidstr)))
+        watch->triggers[src->resource]++;
+
+    ignore_value(virHashUpdateEntry(push->urgent, src->uuidstr, push));
+    virCondSignal(&push->cond);
+
+    return G_SOURCE_CONTINUE;
+}
+
+
+/**
+ * qemuDomainStatsPushWatchPressure:
+ * @driver: qemu driver
+ * @vm: locked domain object
+ * @uuidstr: UUID of @vm
+ *
+ * Arms the configured pressure triggers in the cgroup of @vm unless
+ * they are already armed. Triggers which can't be armed, e.g. with
+ * cgroup v1, are only warned about once.
+ */
+static void
+qemuDomainStatsPushWatchPressure(virQEMUDriver *driver,
+                                 virDomainObj *vm,
+                                 const char *uuidstr)
+{
+    qemuDomainStatsPush *push = driver->statsPush;
+    qemuDomainObjPrivate *priv = vm->privateData;
+    g_autoptr(virQEMUDriverConfig) cfg = NULL;
+    qemuDomainStatsPressureWatch *watch;
+    size_t i;
+
+    VIR_WITH_MUTEX_LOCK_GUARD(&push->lock) {
+        if (virHashHasEntry(push->pressure, uuidstr))
+            return;
+    }
+
+    cfg = virQEMUDriverGetConfig(driver);
+
+    if (!cfg->pressureTriggers || !priv->cgroup)
+        return;
+
+    watch = g_new0(qemuDomainStatsPressureWatch, 1);
+    watch->ntriggers = g_strv_length(cfg->pressureTriggers);
+    watch->fds = g_new0(int, watch->ntriggers);
+    watch->sources = g_new0(GSource *, watch->ntriggers);
+
+    for (i = 0; i < watch->ntriggers; i++) {
+        /* the format was validated when loading the config */
+        g_auto(GStrv) fields = g_strsplit(cfg->pressureTriggers[i], " ", 2);
+        int resource = virCgroupPressureResourceTypeFromString(fields[0]);
+        qemuDomainStatsPressureSource *src;
+
+        if ((watch->fds[i] = virCgroupOpenPressureTrigger(priv->cgroup,
+                                                          resource,
+                                                          fields[1])) < 0) {
+            VIR_WARN("Unable to arm pressure trigger '%s' of domain %s: %s",
+                     cfg->pressureTriggers[i], vm->def->name,
+                     virGetLastErrorMessage());
+            virResetLastError();
+            continue;
+        }
+
+        src = g_new0(qemuDomainStatsPressureSource, 1);
+        src->push = push;
+        src->uuidstr = g_strdup(uuidstr);
+        src->resource = resource;
+
+        watch->sources[i] = virEventGLibAddSocketWatch(watch->fds[i],
+                                                       G_IO_PRI | G_IO_ERR,
+                                                       NULL,
+                                                       qemuDomainStatsPressureFired,
+                                                       src,
+                                                       qemuDomainStatsPressureSourceFree);
+        watch->armed[resource] = true;
+    }
+
+    VIR_WITH_MUTEX_LOCK_GUARD(&push->lock) {
+        if (virHashAddEntry(push->pressure, uuidstr, watch) < 0) {
+            qemuDomainStatsPressureWatchFree(watch);
+            virResetLastError();
+        }
+    }
+}
+
+
+static void
+qemuDomainStatsPushGetPressureTriggers(qemuDomainStatsPush *push,
+                                       const unsigned char *uuid,
+                                       unsigned long long *triggers,
+                                       bool *watched)
+{
+    qemuDomainStatsPressureWatch *watch;
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
+    size_t i;
+    VIR_LOCK_GUARD lock = virLockGuardLock(&push->lock);
+
+    virUUIDFormat(uuid, uuidstr);
+
+    if (!(watch = virHashLookup(push->pressure, uuidstr)))
+        return;
+
+    for (i = 0; i < VIR_CGROUP_PRESSURE_LAST; i++) {
+        watched[i] = watch->armed[i];
+        triggers[i] = watch->triggers[i];
+    }
+}
+
+
+/**
+ * qemuDomainStatsPushDomain:
+ * @driver: qemu driver
+ * @vm: domain object
+ * @callbacks: IDs of the subscriptions to sample @vm for
+ * @ncallbacks: number of items in @callbacks
+ * @sampled: set of UUIDs of sampled domains, updated
+ * @mask: stats groups to sample at most
+ */
+static void
+qemuDomainStatsPushDomain(virQEMUDriver *driver,
+                          virDomainObj *vm,
+                          int *callbacks,
+                          size_t ncallbacks,
+                          GHashTable *sampled,
+                          unsigned int mask)
+{
+    qemuDomainStatsPush *push = driver->statsPush;
+    g_autoptr(virTypedParamList) params = g_new0(virTypedParamList, 1);
+    size_t groupEnd[G_N_ELEMENTS(qemuDomainGetStatsWorkers)] = { 0 };
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
+    unsigned char uuid[VIR_UUID_BUFLEN];
+    g_autofree char *name = NULL;
+    g_autofree bool *allowed = g_new0(bool, ncallbacks);
+    unsigned int stats = 0;
+    int id;
+    size_t i;
+    size_t j;
+
+    virObjectLock(vm);
+
+    if (!virDomainObjIsActive(vm)) {
+        virObjectUnlock(vm);
+        return;
+    }
+
+    virUUIDFormat(vm->def->uuid, uuidstr);
+    ignore_value(virHashAddEntry(sampled, uuidstr, vm));
+
+    for (i = 0; i < ncallbacks; i++) {
+        g_autoptr(virIdentity) identity = NULL;
+        virConnectPtr conn = NULL;
+        virDomainObjListACLFilter filter = NULL;
+
+        VIR_WITH_MUTEX_LOCK_GUARD(&push->lock) {
+            qemuDomainStatsSubscription *sub;
+
+            if ((sub = qemuDomainStatsPushFind(push, callbacks[i])) &&
+                qemuDomainStatsSubscriptionWants(sub, vm)) {
+                if (sub->identity)
+                    identity = g_object_ref(sub->identity);
+                conn = virObjectRef(sub->conn);
+                filter = sub->filter;
+            }
+        }
+
+        if (!conn)
+            continue;
+
+        /* The ACL check may take a while, so it's done without holding
+         * the lock, as the subscriber */
+        if (virIdentitySetCurrent(identity) == 0 &&
+            filter(conn, vm->def))
+            allowed[i] = true;
+        ignore_value(virIdentitySetCurrent(NULL));
+        virResetLastError();
+        virObjectUnref(conn);
+
+        if (!allowed[i])
+            continue;
+
+        VIR_WITH_MUTEX_LOCK_GUARD(&push->lock) {
+            qemuDomainStatsSubscription *sub;
 
-static virQEMUCapsFlags queryDirtyRateRequired[] = {
-    QEMU_CAPS_QUERY_DIRTY_RATE,
-    QEMU_CAPS_LAST
-};
+            if ((sub = qemuDomainStatsPushFind(push, callbacks[i])))
+                stats |= sub->stats & mask;
+        }
+    }
 
-static struct qemuDomainGetStatsWorker qemuDomainGetStatsWorkers[] = {
-    { qemuDomainGetStatsState, VIR_DOMAIN_STATS_STATE, false, NULL },
-    { qemuDomainGetStatsCpu, VIR_DOMAIN_STATS_CPU_TOTAL, false, NULL },
-    { qemuDomainGetStatsBalloon, VIR_DOMAIN_STATS_BALLOON, true, NULL },
-    { qemuDomainGetStatsVcpu, VIR_DOMAIN_STATS_VCPU, true, NULL },
-    { qemuDomainGetStatsInterface, VIR_DOMAIN_STATS_INTERFACE, false, NULL },
-    { qemuDomainGetStatsBlock, VIR_DOMAIN_STATS_BLOCK, true, NULL },
-    { qemuDomainGetStatsPerf, VIR_DOMAIN_STATS_PERF, false, NULL },
-    { qemuDomainGetStatsIOThread, VIR_DOMAIN_STATS_IOTHREAD, true, queryIOThreadRequired },
-    { qemuDomainGetStatsMemory, VIR_DOMAIN_STATS_MEMORY, false, NULL },
-    { qemuDomainGetStatsDirtyRate, VIR_DOMAIN_STATS_DIRTYRATE, true, queryDirtyRateRequired },
-    { NULL, 0, false, NULL }
+    if (!stats) {
+        virObjectUnlock(vm);
+        return;
+    }
+
+    if (stats & VIR_DOMAIN_STATS_PRESSURE)
+        qemuDomainStatsPushWatchPressure(driver, vm, uuidstr);
+
+    /* Don't wait for other jobs so that a single busy domain doesn't
+     * delay the stats of all the others */
+    if (qemuDomainGetStatsLocked(driver, vm, stats, params, groupEnd,
+                                 VIR_CONNECT_GET_ALL_DOMAINS_STATS_NOWAIT) < 0) {
+        VIR_WARN("Unable to sample stats of domain %s: %s",
+                 vm->def->name, virGetLastErrorMessage());
+        virResetLastError();
+        virObjectUnlock(vm);
+        return;
+    }
+
+    id = vm->def->id;
+    name = g_strdup(vm->def->name);
+    memcpy(uuid, vm->def->uuid, VIR_UUID_BUFLEN);
+
+    virObjectUnlock(vm);
+
+    VIR_WITH_MUTEX_LOCK_GUARD(&push->lock) {
+        for (i = 0; i < ncallbacks; i++) {
+            qemuDomainStatsSubscription *sub;
+            g_autoptr(virTypedParamList) delta = NULL;
+            virTypedParamList *last;
+            virTypedParameterPtr par = NULL;
+            virObjectEvent *event;
+            size_t npar;
+
+            if (!allowed[i] ||
+                !(sub = qemuDomainStatsPushFind(push, callbacks[i])) ||
+                (sub->hasDom && memcmp(sub->uuid, uuid, VIR_UUID_BUFLEN) != 0))
+                continue;
+
+            if (!(last = virHashLookup(sub->last, uuidstr))) {
+                last = g_new0(virTypedParamList, 1);
+                if (virHashAddEntry(sub->last, uuidstr, last) < 0) {
+                    virTypedParamListFree(last);
+                    virResetLastError();
+                    continue;
+                }
+            }
+
+            delta = g_new0(virTypedParamList, 1);
+
+            for (j = 0; qemuDomainGetStatsWorkers[j].func; j++) {
+                size_t start = j > 0 ? groupEnd[j - 1] : 0;
+
+                if (!(sub->stats & mask & qemuDomainGetStatsWorkers[j].stats))
+                    continue;
+
+                qemuDomainStatsPushDiff(last, params->par + start,
+                                        groupEnd[j] - start, delta);
+            }
+
+            if (delta->npar == 0)
+                continue;
+
+            npar = virTypedParamListStealParams(delta, &par);
+            if ((event = virDomainStatsEventNew(id, name, uuid,
+                                                sub->callbackID, par, npar)))
+                virObjectEventStateQueue(driver->domainEventState, event);
+        }
+    }
+}
+
+
+static int
+qemuDomainStatsPushForget(const void *payload G_GNUC_UNUSED,
+                          const char *name,
+                          const void *opaque)
+{
+    GHashTable *sampled = (GHashTable *) opaque;
+
+    return !virHashHasEntry(sampled, name);
+}
+
+
+typedef struct _qemuDomainStatsPushForgetData qemuDomainStatsPushForgetData;
+struct _qemuDomainStatsPushForgetData {
+    qemuDomainStatsPush *push;
+    GHashTable *sampled;
 };
 
 
+/* Disarms the pressure triggers of domains which are no longer running
+ * or whose pressure stats aren't subscribed to anymore. */
 static int
-qemuDomainGetStatsCheckSupport(unsigned int *stats,
-                               bool enforce,
-                               virDomainObj *vm)
+qemuDomainStatsPushForgetPressure(const void *payload G_GNUC_UNUSED,
+                                  const char *name,
+                                  const void *opaque)
 {
-    qemuDomainObjPrivate *priv = vm->privateData;
-    unsigned int supportedstats = 0;
+    const qemuDomainStatsPushForgetData *data = opaque;
+    unsigned char uuid[VIR_UUID_BUFLEN];
     size_t i;
 
-    for (i = 0; qemuDomainGetStatsWorkers[i].func; i++) {
-        bool supportedByQemu = true;
-        virQEMUCapsFlags *requiredCaps = qemuDomainGetStatsWorkers[i].requiredCaps;
-
-        while (requiredCaps && *requiredCaps != QEMU_CAPS_LAST) {
-            if (!virQEMUCapsGet(priv->qemuCaps, *requiredCaps)) {
-                supportedByQemu = false;
-                break;
-            }
+    if (!virHashHasEntry(data->sampled, name) ||
+        virUUIDParse(name, uuid) < 0)
+        return 1;
 
-            requiredCaps++;
-        }
+    for (i = 0; i < data->push->nsubs; i++) {
+        qemuDomainStatsSubscription *sub = data->push->subs[i];
 
-        if (supportedByQemu) {
-            supportedstats |= qemuDomainGetStatsWorkers[i].stats;
-        }
+        if ((sub->stats & VIR_DOMAIN_STATS_PRESSURE) &&
+            (!sub->hasDom || memcmp(sub->uuid, uuid, VIR_UUID_BUFLEN) == 0))
+            return 0;
     }
 
-    if (*stats == 0) {
-        *stats = supportedstats;
-        return 0;
+    return 1;
+}
+
+
+/**
+ * qemuDomainStatsPushPass:
+ * @driver: qemu driver
+ * @callbacks: IDs of the subscriptions which are due
+ * @ncallbacks: number of items in @callbacks
+ *
+ * Samples all running domains wanted by the @callbacks subscriptions
+ * and drops their last values of domains which are no longer running.
+ */
+static void
+qemuDomainStatsPushPass(virQEMUDriver *driver,
+                        int *callbacks,
+                        size_t ncallbacks)
+{
+    qemuDomainStatsPush *push = driver->statsPush;
+    g_autoptr(GHashTable) sampled = virHashNew(NULL);
+    virDomainObj **vms = NULL;
+    size_t nvms;
+    size_t i;
+
+    if (virDomainObjListCollect(driver->domains, NULL, &vms, &nvms,
+                                NULL, VIR_CONNECT_LIST_DOMAINS_ACTIVE) < 0) {
+        virResetLastError();
+        return;
     }
 
-    if (enforce &&
-        *stats & ~supportedstats) {
-        virReportError(VIR_ERR_ARGUMENT_UNSUPPORTED,
-                       _("Stats types bits 0x%x are not supported by this daemon or QEMU"),
-                       *stats & ~supportedstats);
-        return -1;
+    for (i = 0; i < nvms; i++)
+        qemuDomainStatsPushDomain(driver, vms[i], callbacks, ncallbacks,
+                                  sampled, ~0U);
+
+    VIR_WITH_MUTEX_LOCK_GUARD(&push->lock) {
+        qemuDomainStatsPushForgetData forget = { push, sampled };
+
+        for (i = 0; i < ncallbacks; i++) {
+            qemuDomainStatsSubscription *sub;
+
+            if ((sub = qemuDomainStatsPushFind(push, callbacks[i])))
+                virHashRemoveSet(sub->last, qemuDomainStatsPushForget, sampled);
+        }
+
+        virHashRemoveSet(push->pressure, qemuDomainStatsPushForgetPressure,
+                         &forget);
     }
 
-    *stats &= supportedstats;
-    return 0;
+    virObjectListFreeCount(vms, nvms);
 }
 
 
-static bool
-qemuDomainGetStatsNeedMonitor(unsigned int stats)
+/**
+ * qemuDomainStatsPushPressurePass:
+ * @driver: qemu driver
+ * @urgent: set of UUIDs of domains whose pressure triggers fired
+ * @callbacks: IDs of the subscriptions to pressure stats
+ * @ncallbacks: number of items in @callbacks
+ *
+ * Sends the pressure stats of the @urgent domains out of order.
+ */
+static void
+qemuDomainStatsPushPressurePass(virQEMUDriver *driver,
+                                GHashTable *urgent,
+                                int *callbacks,
+                                size_t ncallbacks)
 {
+    g_autoptr(GHashTable) sampled = virHashNew(NULL);
+    g_autofree virHashKeyValuePair *items = virHashGetItems(urgent, NULL, false);
     size_t i;
 
-    for (i = 0; qemuDomainGetStatsWorkers[i].func; i++)
-        if (stats & qemuDomainGetStatsWorkers[i].stats &&
-            qemuDomainGetStatsWorkers[i].monitor)
-            return true;
+    for (i = 0; items[i].key; i++) {
+        unsigned char uuid[VIR_UUID_BUFLEN];
+        virDomainObj *vm;
 
-    return false;
+        if (virUUIDParse(items[i].key, uuid) < 0 ||
+            !(vm = virDomainObjListFindByUUID(driver->domains, uuid)))
+            continue;
+
+        virObjectUnlock(vm);
+        qemuDomainStatsPushDomain(driver, vm, callbacks, ncallbacks,
+                                  sampled, VIR_DOMAIN_STATS_PRESSURE);
+        virObjectUnref(vm);
+    }
 }
 
 
-static int
-qemuDomainGetStats(virConnectPtr conn,
-                   virDomainObj *dom,
-                   unsigned int stats,
-                   virDomainStatsRecordPtr *record,
-                   unsigned int flags)
+static void
+qemuDomainStatsPushThread(void *opaque)
 {
-    g_autofree virDomainStatsRecordPtr tmp = NULL;
-    g_autoptr(virTypedParamList) params = NULL;
-    size_t i;
+    virQEMUDriver *driver = opaque;
+    qemuDomainStatsPush *push = driver->statsPush;
 
-    params = g_new0(virTypedParamList, 1);
+    virMutexLock(&push->lock);
 
-    for (i = 0; qemuDomainGetStatsWorkers[i].func; i++) {
-        if (stats & qemuDomainGetStatsWorkers[i].stats) {
-            if (qemuDomainGetStatsWorkers[i].func(conn->privateData, dom, params,
-                                                  flags) < 0)
-                return -1;
+    while (!push->quit) {
+        g_autofree int *callbacks = NULL;
+        size_t ncallbacks = 0;
+        unsigned long long now;
+        unsigned long long next = 0;
+        size_t i;
+
+        if (virHashSize(push->urgent) > 0) {
+            g_autoptr(GHashTable) urgent = g_steal_pointer(&push->urgent);
+
+            push->urgent = virHashNew(NULL);
+
+            for (i = 0; i < push->nsubs; i++) {
+                if (push->subs[i]->stats & VIR_DOMAIN_STATS_PRESSURE)
+                    VIR_APPEND_ELEMENT_COPY(callbacks, ncallbacks,
+                                            push->subs[i]->callbackID);
+            }
+
+            virMutexUnlock(&push->lock);
+            qemuDomainStatsPushPressurePass(driver, urgent,
+                                            callbacks, ncallbacks);
+            virMutexLock(&push->lock);
+            continue;
         }
-    }
 
-    tmp = g_new0(virDomainStatsRecord, 1);
+        ignore_value(virTimeMillisNow(&now));
 
-    if (!(tmp->dom = virGetDomain(conn, dom->def->name,
-                                  dom->def->uuid, dom->def->id)))
-        return -1;
+        for (i = 0; i < push->nsubs; i++) {
+            qemuDomainStatsSubscription *sub = push->subs[i];
 
-    tmp->nparams = virTypedParamListStealParams(params, &tmp->params);
-    *record = g_steal_pointer(&tmp);
-    return 0;
+            if (sub->due <= now) {
+                VIR_APPEND_ELEMENT_COPY(callbacks, ncallbacks, sub->callbackID);
+
+                sub->due += sub->interval;
+                if (sub->due <= now)
+                    sub->due = now + sub->interval;
+            }
+
+            if (next == 0 || sub->due < next)
+                next = sub->due;
+        }
+
+        if (ncallbacks > 0) {
+            virMutexUnlock(&push->lock);
+            qemuDomainStatsPushPass(driver, callbacks, ncallbacks);
+            virMutexLock(&push->lock);
+            continue;
+        }
+
+        if (next == 0)
+            ignore_value(virCondWait(&push->cond, &push->lock));
+        else
+            ignore_value(virCondWaitUntil(&push->cond, &push->lock, next));
+    }
+
+    virMutexUnlock(&push->lock);
 }
 
 
 static int
-qemuConnectGetAllDomainStats(virConnectPtr conn,
-                             virDomainPtr *doms,
-                             unsigned int ndoms,
-                             unsigned int stats,
-                             virDomainStatsRecordPtr **retStats,
-                             unsigned int flags)
+qemuDomainStatsPushAdd(virQEMUDriver *driver,
+                       virConnectPtr conn,
+                       int callbackID,
+                       virDomainPtr dom,
+                       unsigned int stats,
+                       unsigned long long interval,
+                       virDomainObjListACLFilter filter)
 {
-    virQEMUDriver *driver = conn->privateData;
-    virErrorPtr orig_err = NULL;
-    virDomainObj **vms = NULL;
-    size_t nvms;
-    virDomainStatsRecordPtr *tmpstats = NULL;
-    bool enforce = !!(flags & VIR_CONNECT_GET_ALL_DOMAINS_STATS_ENFORCE_STATS);
-    int nstats = 0;
+    qemuDomainStatsPush *push = driver->statsPush;
+    qemuDomainStatsSubscription *sub = NULL;
+    unsigned long long now;
     size_t i;
-    int ret = -1;
-    unsigned int lflags = flags & (VIR_CONNECT_LIST_DOMAINS_FILTERS_ACTIVE |
-                                   VIR_CONNECT_LIST_DOMAINS_FILTERS_PERSISTENT |
-                                   VIR_CONNECT_LIST_DOMAINS_FILTERS_STATE);
+    VIR_LOCK_GUARD lock = virLockGuardLock(&push->lock);
+
+    if (!push->running) {
+        if (virThreadCreateFull(&push->thread, true,
+                                qemuDomainStatsPushThread,
+                                "qemu-stats-push",
+                                false,
+                                driver) < 0) {
+            virReportSystemError(errno, "%s",
+                                 _("Unable to create stats push thread"));
+            return -1;
+        }
+        push->running = true;
+    }
 
-    virCheckFlags(VIR_CONNECT_LIST_DOMAINS_FILTERS_ACTIVE |
-                  VIR_CONNECT_LIST_DOMAINS_FILTERS_PERSISTENT |
-                  VIR_CONNECT_LIST_DOMAINS_FILTERS_STATE |
-                  VIR_CONNECT_GET_ALL_DOMAINS_STATS_NOWAIT |
-                  VIR_CONNECT_GET_ALL_DOMAINS_STATS_BACKING |
-                  VIR_CONNECT_GET_ALL_DOMAINS_STATS_ENFORCE_STATS, -1);
+    /* stats groups are filtered per subscription, so resolve 0 to all
+     * groups right away; unsupported ones are masked out per domain */
+    if (stats == 0) {
+        for (i = 0; qemuDomainGetStatsWorkers[i].func; i++)
+            stats |= qemuDomainGetStatsWorkers[i].stats;
+    }
 
-    if (virConnectGetAllDomainStatsEnsureACL(conn) < 0)
-        return -1;
+    ignore_value(virTimeMillisNow(&now));
 
-    if (ndoms) {
-        if (virDomainObjListConvert(driver->domains, conn, doms, ndoms, &vms,
-                                    &nvms, virConnectGetAllDomainStatsCheckACL,
-                                    lflags, true) < 0)
-            return -1;
-    } else {
-        if (virDomainObjListCollect(driver->domains, conn, &vms, &nvms,
-                                    virConnectGetAllDomainStatsCheckACL,
-                                    lflags) < 0)
-            return -1;
+    sub = g_new0(qemuDomainStatsSubscription, 1);
+    sub->callbackID = callbackID;
+    sub->conn = virObjectRef(conn);
+    sub->identity = virIdentityGetCurrent();
+    sub->filter = filter;
+    if (dom) {
+        sub->hasDom = true;
+        memcpy(sub->uuid, dom->uuid, VIR_UUID_BUFLEN);
     }
+    sub->stats = stats;
+    sub->interval = interval;
+    /* Remote clients learn the callback ID from the reply which may race
+     * with an immediate first event, so wait for a full interval, and at
+     * least a second for sub-second intervals. */
+    sub->due = now + MAX(interval, 1000);
+    sub->last = virHashNew((GDestroyNotify) virTypedParamListFree);
 
-    tmpstats = g_new0(virDomainStatsRecordPtr, nvms + 1);
+    VIR_APPEND_ELEMENT(push->subs, push->nsubs, sub);
+    virCondSignal(&push->cond);
 
-    for (i = 0; i < nvms; i++) {
-        virDomainObj *vm = vms[i];
-        virDomainStatsRecordPtr tmp = NULL;
-        unsigned int privflags = 0;
-        unsigned int requestedStats = stats;
-        unsigned int domflags = 0;
-        int rc;
+    return 0;
+}
 
-        if (flags & VIR_CONNECT_GET_ALL_DOMAINS_STATS_BACKING)
-            domflags |= QEMU_DOMAIN_STATS_BACKING;
 
-        virObjectLock(vm);
+static void
+qemuDomainStatsPushRemove(virQEMUDriver *driver,
+                          int callbackID)
+{
+    qemuDomainStatsPush *push = driver->statsPush;
+    size_t i;
+    VIR_LOCK_GUARD lock = virLockGuardLock(&push->lock);
 
-        if (qemuDomainGetStatsCheckSupport(&requestedStats, enforce, vm) < 0) {
-            virObjectUnlock(vm);
-            goto cleanup;
+    for (i = 0; i < push->nsubs; i++) {
+        if (push->subs[i]->callbackID == callbackID) {
+            qemuDomainStatsSubscriptionFree(push->subs[i]);
+            VIR_DELETE_ELEMENT(push->subs, i, push->nsubs);
+            return;
         }
+    }
+}
 
-        if (qemuDomainGetStatsNeedMonitor(requestedStats))
-            privflags |= QEMU_DOMAIN_STATS_HAVE_JOB;
 
-        if (HAVE_JOB(privflags)) {
-            int rv;
+static int
+qemuConnectDomainStatsRegister(virConnectPtr conn,
+                               virDomainPtr dom,
+                               unsigned int stats,
+                               unsigned int interval,
+                               virConnectDomainStatsCallback callback,
+                               void *opaque,
+                               virFreeCallback freecb,
+                               unsigned int flags)
+{
+    virQEMUDriver *driver = conn->privateData;
+    unsigned long long intervalMs = interval;
+    int callbackID;
 
-            if (flags & VIR_CONNECT_GET_ALL_DOMAINS_STATS_NOWAIT)
-                rv = qemuDomainObjBeginJobNowait(driver, vm, VIR_JOB_QUERY);
-            else
-                rv = qemuDomainObjBeginJob(driver, vm, VIR_JOB_QUERY);
+    virCheckFlags(VIR_CONNECT_DOMAIN_STATS_REGISTER_INTERVAL_MSEC, -1);
 
-            if (rv == 0)
-                domflags |= QEMU_DOMAIN_STATS_HAVE_JOB;
-        }
-        /* else: without a job it's still possible to gather some data */
+    if (virConnectDomainStatsRegisterEnsureACL(conn) < 0)
+        return -1;
 
-        rc = qemuDomainGetStats(conn, vm, requestedStats, &tmp, domflags);
+    if (!(flags & VIR_CONNECT_DOMAIN_STATS_REGISTER_INTERVAL_MSEC))
+        intervalMs *= 1000;
 
-        if (HAVE_JOB(domflags))
-            qemuDomainObjEndJob(vm);
+    if (virDomainStatsEventStateRegisterID(conn,
+                                           driver->domainEventState,
+                                           dom, callback, opaque, freecb,
+                                           &callbackID) < 0)
+        return -1;
 
-        virObjectUnlock(vm);
+    if (qemuDomainStatsPushAdd(driver, conn, callbackID, dom, stats, intervalMs,
+                               virConnectDomainStatsRegisterCheckACL) < 0) {
+        virObjectEventStateDeregisterID(conn, driver->domainEventState,
+                                        callbackID, false);
+        return -1;
+    }
 
-        if (rc < 0)
-            goto cleanup;
+    return callbackID;
+}
 
-        tmpstats[nstats++] = tmp;
-    }
 
-    *retStats = g_steal_pointer(&tmpstats);
+static int
+qemuConnectDomainStatsDeregister(virConnectPtr conn,
+                                 int callbackID)
+{
+    virQEMUDriver *driver = conn->privateData;
 
-    ret = nstats;
+    if (virConnectDomainStatsDeregisterEnsureACL(conn) < 0)
+        return -1;
 
- cleanup:
-    virErrorPreserveLast(&orig_err);
-    virDomainStatsRecordListFree(tmpstats);
-    virObjectListFreeCount(vms, nvms);
-    virErrorRestore(&orig_err);
+    if (virObjectEventStateDeregisterID(conn, driver->domainEventState,
+                                        callbackID, true) < 0)
+        return -1;
 
-    return ret;
+    qemuDomainStatsPushRemove(driver, callbackID);
+
+    return 0;
 }
 
 
@@ -20541,6 +22866,20 @@ qemuDomainGetGuestInfo(virDomainPtr dom,
     qemuAgentDiskInfo **agentdiskinfo = NULL;
     virDomainInterfacePtr *ifaces = NULL;
     size_t nifaces = 0;
+    static const struct {
+        unsigned int type;
+        const char *command;
+    } types_commands[] = {
+        { VIR_DOMAIN_GUEST_INFO_USERS, "guest-get-users" },
+        { VIR_DOMAIN_GUEST_INFO_OS, "guest-get-osinfo" },
+        { VIR_DOMAIN_GUEST_INFO_TIMEZONE, "guest-get-timezone" },
+        { VIR_DOMAIN_GUEST_INFO_HOSTNAME, "guest-get-host-name" },
+        { VIR_DOMAIN_GUEST_INFO_FILESYSTEM, "guest-get-fsinfo" },
+        { VIR_DOMAIN_GUEST_INFO_DISKS, "guest-get-disks" },
+        { VIR_DOMAIN_GUEST_INFO_INTERFACES, "guest-network-get-interfaces" },
+    };
+    const char *commands[G_N_ELEMENTS(types_commands)];
+    size_t ncommands = 0;
     size_t i;
 
     virCheckFlags(0, -1);
@@ -20563,6 +22902,14 @@ qemuDomainGetGuestInfo(virDomainPtr dom,
 
     agent = qemuDomainObjEnterAgent(vm);
 
+    /* Send all the commands at once instead of waiting for the guest to
+     * reply to each of them in turn */
+    for (i = 0; i < G_N_ELEMENTS(types_commands); i++) {
+        if (supportedTypes & types_commands[i].type)
+            commands[ncommands++] = types_commands[i].command;
+    }
+    qemuAgentPrefetch(agent, commands, ncommands);
+
     /* The agent info commands will return -2 for any commands that are not
      * supported by the agent, or -1 for all other errors. In the case where no
      * categories were explicitly requested (i.e. 'types' is 0), ignore
@@ -20612,6 +22959,7 @@ qemuDomainGetGuestInfo(virDomainPtr dom,
             nifaces = rc;
     }
 
+    qemuAgentPrefetchClear(agent);
     qemuDomainObjExitAgent(vm, agent);
     qemuDomainObjEndAgentJob(vm);
 
@@ -20657,6 +23005,7 @@ qemuDomainGetGuestInfo(virDomainPtr dom,
     return ret;
 
  exitagent:
+    qemuAgentPrefetchClear(agent);
     qemuDomainObjExitAgent(vm, agent);
 
  endagentjob:
@@ -20835,7 +23184,8 @@ qemuDomainStartDirtyRateCalc(virDomainPtr dom,
 
     virCheckFlags(VIR_DOMAIN_DIRTYRATE_MODE_PAGE_SAMPLING |
                   VIR_DOMAIN_DIRTYRATE_MODE_DIRTY_BITMAP |
-                  VIR_DOMAIN_DIRTYRATE_MODE_DIRTY_RING, -1);
+                  VIR_DOMAIN_DIRTYRATE_MODE_DIRTY_RING |
+                  VIR_DOMAIN_DIRTYRATE_CONTINUOUS, -1);
 
     if (seconds < MIN_DIRTYRATE_CALC_PERIOD ||
         seconds > MAX_DIRTYRATE_CALC_PERIOD) {
@@ -20896,6 +23246,13 @@ qemuDomainStartDirtyRateCalc(virDomainPtr dom,
 
     qemuDomainObjExitMonitor(vm);
 
+    if (ret == 0) {
+        if (flags & VIR_DOMAIN_DIRTYRATE_CONTINUOUS)
+            ret = qemuProcessStartDirtyRateSampling(vm, seconds, mode);
+        else
+            qemuProcessStopDirtyRateSampling(vm);
+    }
+
  endjob:
     qemuDomainObjEndJob(vm);
 
@@ -21152,6 +23509,12 @@ static virHypervisorDriver qemuHypervisorDriver = {
     .domainGetMessages = qemuDomainGetMessages, /* 7.1.0 */
     .domainStartDirtyRateCalc = qemuDomainStartDirtyRateCalc, /* 7.2.0 */
     .domainSetLaunchSecurityState = qemuDomainSetLaunchSecurityState, /* 8.0.0 */
+    .connectDomainStatsRegister = qemuConnectDomainStatsRegister, /* 8.5.0 */
+    .connectDomainStatsDeregister = qemuConnectDomainStatsDeregister, /* 8.5.0 */
+    .domainListSnapshotCreateXML = qemuDomainListSnapshotCreateXML, /* 8.5.0 */
+    .domainAttachDevices = qemuDomainAttachDevices, /* 8.5.0 */
+    .domainDetachDevices = qemuDomainDetachDevices, /* 8.5.0 */
+    .connectListDomainsPage = qemuConnectListDomainsPage, /* 8.5.0 */
 };
 
 
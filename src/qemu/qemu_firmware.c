@@ -20,6 +20,8 @@
 
 #include <config.h>
 
+#include <sys/stat.h>
+
 #include "qemu_firmware.h"
 #include "qemu_interop_config.h"
 #include "configmake.h"
@@ -922,6 +924,13 @@ qemuFirmwareFetchConfigs(char ***firmwares,
 }
 
 
+time_t
+qemuFirmwareGetConfigsMtime(bool privileged)
+{
+    return qemuInteropGetConfigsMtime("firmware", privileged);
+}
+
+
 static bool
 qemuFirmwareMatchesMachineArch(const qemuFirmware *fw,
                                const char *machine,
@@ -1304,41 +1313,143 @@ qemuFirmwareSanityCheck(const qemuFirmware *fw,
 }
 
 
-static ssize_t
-qemuFirmwareFetchParsedConfigs(bool privileged,
-                               qemuFirmware ***firmwaresRet,
-                               char ***pathsRet)
+/* Parsed firmware descriptors, in order of priority. The object is never
+ * modified once built, so it can be used without holding any lock. */
+typedef struct _qemuFirmwareList qemuFirmwareList;
+struct _qemuFirmwareList {
+    virObject parent;
+
+    size_t nfirmwares;
+    qemuFirmware **firmwares;
+    char **paths;
+    time_t *mtimes;
+};
+
+static virClass *qemuFirmwareListClass;
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(qemuFirmwareList, virObjectUnref);
+
+/* Descriptors parsed last time, indexed by @privileged. */
+static virMutex qemuFirmwareListLock = VIR_MUTEX_INITIALIZER;
+static qemuFirmwareList *qemuFirmwareListCache[2];
+
+
+static void
+qemuFirmwareListDispose(void *obj)
 {
-    g_auto(GStrv) paths = NULL;
-    size_t npaths;
-    qemuFirmware **firmwares = NULL;
+    qemuFirmwareList *list = obj;
     size_t i;
 
-    if (qemuFirmwareFetchConfigs(&paths, privileged) < 0)
+    for (i = 0; i < list->nfirmwares; i++)
+        qemuFirmwareFree(list->firmwares[i]);
+    g_free(list->firmwares);
+    g_strfreev(list->paths);
+    g_free(list->mtimes);
+}
+
+
+static int
+qemuFirmwareListOnceInit(void)
+{
+    if (!VIR_CLASS_NEW(qemuFirmwareList, virClassForObject()))
         return -1;
 
-    if (!paths)
+    return 0;
+}
+
+VIR_ONCE_GLOBAL_INIT(qemuFirmwareList);
+
+
+static time_t
+qemuFirmwareGetMtime(const char *path)
+{
+    struct stat sb;
+
+    if (stat(path, &sb) < 0)
         return 0;
 
-    npaths = g_strv_length(paths);
+    return sb.st_mtime;
+}
+
 
-    firmwares = g_new0(qemuFirmware *, npaths);
+/* Whether @list was parsed from the very same files as @paths are. */
+static bool
+qemuFirmwareListIsValid(qemuFirmwareList *list,
+                        char **paths)
+{
+    size_t npaths = paths ? g_strv_length(paths) : 0;
+    size_t i;
+
+    if (list->nfirmwares != npaths)
+        return false;
 
     for (i = 0; i < npaths; i++) {
-        if (!(firmwares[i] = qemuFirmwareParse(paths[i])))
-            goto error;
+        if (STRNEQ(list->paths[i], paths[i]) ||
+            list->mtimes[i] != qemuFirmwareGetMtime(paths[i]))
+            return false;
+    }
+
+    return true;
+}
+
+
+/**
+ * qemuFirmwareFetchParsedConfigs:
+ * @privileged: whether running as privileged daemon
+ *
+ * Every domain with firmware autoselection and every query of domain
+ * capabilities needs all the firmware descriptors. Reading the
+ * directories is cheap compared to parsing the JSON descriptors, so
+ * the parsed descriptors are kept for as long as none of the files
+ * is added, removed or modified.
+ *
+ * Returns: a reference to the list of parsed descriptors on success,
+ *          NULL otherwise.
+ */
+static qemuFirmwareList *
+qemuFirmwareFetchParsedConfigs(bool privileged)
+{
+    g_autoptr(qemuFirmwareList) list = NULL;
+    g_auto(GStrv) paths = NULL;
+    size_t i;
+
+    if (qemuFirmwareListInitialize() < 0)
+        return NULL;
+
+    if (qemuFirmwareFetchConfigs(&paths, privileged) < 0)
+        return NULL;
+
+    VIR_WITH_MUTEX_LOCK_GUARD(&qemuFirmwareListLock) {
+        qemuFirmwareList *cached = qemuFirmwareListCache[privileged];
+
+        if (cached && qemuFirmwareListIsValid(cached, paths))
+            return virObjectRef(cached);
     }
 
-    *firmwaresRet = g_steal_pointer(&firmwares);
-    if (pathsRet)
-        *pathsRet = g_steal_pointer(&paths);
-    return npaths;
+    if (!(list = virObjectNew(qemuFirmwareListClass)))
+        return NULL;
 
- error:
-    while (i > 0)
-        qemuFirmwareFree(firmwares[--i]);
-    VIR_FREE(firmwares);
-    return -1;
+    if (paths) {
+        list->nfirmwares = g_strv_length(paths);
+        list->firmwares = g_new0(qemuFirmware *, list->nfirmwares);
+        list->mtimes = g_new0(time_t, list->nfirmwares);
+
+        for (i = 0; i < list->nfirmwares; i++) {
+            list->mtimes[i] = qemuFirmwareGetMtime(paths[i]);
+
+            if (!(list->firmwares[i] = qemuFirmwareParse(paths[i])))
+                return NULL;
+        }
+
+        list->paths = g_steal_pointer(&paths);
+    }
+
+    VIR_WITH_MUTEX_LOCK_GUARD(&qemuFirmwareListLock) {
+        virObjectUnref(qemuFirmwareListCache[privileged]);
+        qemuFirmwareListCache[privileged] = virObjectRef(list);
+    }
+
+    return g_steal_pointer(&list);
 }
 
 
@@ -1347,14 +1458,11 @@ qemuFirmwareFillDomain(virQEMUDriver *driver,
                        virDomainDef *def,
                        unsigned int flags)
 {
-    g_auto(GStrv) paths = NULL;
-    qemuFirmware **firmwares = NULL;
-    ssize_t nfirmwares = 0;
+    g_autoptr(qemuFirmwareList) list = NULL;
     const qemuFirmware *theone = NULL;
     bool needResult = true;
     const bool reset_nvram = flags & VIR_QEMU_PROCESS_START_RESET_NVRAM;
     size_t i;
-    int ret = -1;
 
     /* Fill in FW paths if either os.firmware is enabled, or
      * loader path was provided with no nvram varstore. */
@@ -1378,15 +1486,14 @@ qemuFirmwareFillDomain(virQEMUDriver *driver,
             return 0;
     }
 
-    if ((nfirmwares = qemuFirmwareFetchParsedConfigs(driver->privileged,
-                                                     &firmwares, &paths)) < 0)
+    if (!(list = qemuFirmwareFetchParsedConfigs(driver->privileged)))
         return -1;
 
-    for (i = 0; i < nfirmwares; i++) {
-        if (qemuFirmwareMatchDomain(def, firmwares[i], paths[i])) {
-            theone = firmwares[i];
+    for (i = 0; i < list->nfirmwares; i++) {
+        if (qemuFirmwareMatchDomain(def, list->firmwares[i], list->paths[i])) {
+            theone = list->firmwares[i];
             VIR_DEBUG("Found matching firmware (description path '%s')",
-                      paths[i]);
+                      list->paths[i]);
             break;
         }
     }
@@ -1396,31 +1503,26 @@ qemuFirmwareFillDomain(virQEMUDriver *driver,
             virReportError(VIR_ERR_OPERATION_FAILED,
                            _("Unable to find any firmware to satisfy '%s'"),
                            virDomainOsDefFirmwareTypeToString(def->os.firmware));
-        } else {
-            VIR_DEBUG("Unable to find NVRAM template for '%s', "
-                      "falling back to old style",
-                      NULLSTR(def->os.loader ? def->os.loader->path : NULL));
-            ret = 0;
+            return -1;
         }
-        goto cleanup;
+
+        VIR_DEBUG("Unable to find NVRAM template for '%s', "
+                  "falling back to old style",
+                  NULLSTR(def->os.loader ? def->os.loader->path : NULL));
+        return 0;
     }
 
     /* Firstly, let's do some sanity checks. If either of these
      * fail we can still start the domain successfully, but it's
      * likely that admin/FW manufacturer messed up. */
-    qemuFirmwareSanityCheck(theone, paths[i]);
+    qemuFirmwareSanityCheck(theone, list->paths[i]);
 
     if (qemuFirmwareEnableFeatures(driver, def, theone) < 0)
-        goto cleanup;
+        return -1;
 
     def->os.firmware = VIR_DOMAIN_OS_DEF_FIRMWARE_NONE;
 
-    ret = 0;
- cleanup:
-    for (i = 0; i < nfirmwares; i++)
-        qemuFirmwareFree(firmwares[i]);
-    VIR_FREE(firmwares);
-    return ret;
+    return 0;
 }
 
 
@@ -1463,8 +1565,7 @@ qemuFirmwareGetSupported(const char *machine,
                          virFirmware ***fws,
                          size_t *nfws)
 {
-    qemuFirmware **firmwares = NULL;
-    ssize_t nfirmwares = 0;
+    g_autoptr(qemuFirmwareList) list = NULL;
     size_t i;
 
     *supported = VIR_DOMAIN_OS_DEF_FIRMWARE_NONE;
@@ -1475,12 +1576,11 @@ qemuFirmwareGetSupported(const char *machine,
         *nfws = 0;
     }
 
-    if ((nfirmwares = qemuFirmwareFetchParsedConfigs(privileged,
-                                                     &firmwares, NULL)) < 0)
+    if (!(list = qemuFirmwareFetchParsedConfigs(privileged)))
         return -1;
 
-    for (i = 0; i < nfirmwares; i++) {
-        qemuFirmware *fw = firmwares[i];
+    for (i = 0; i < list->nfirmwares; i++) {
+        qemuFirmware *fw = list->firmwares[i];
         const qemuFirmwareMappingFlash *flash = &fw->mapping.data.flash;
         const qemuFirmwareMappingMemory *memory = &fw->mapping.data.memory;
         const char *fwpath = NULL;
@@ -1562,11 +1662,8 @@ qemuFirmwareGetSupported(const char *machine,
         }
     }
 
-    if (fws && !*fws && nfirmwares)
+    if (fws && !*fws && list->nfirmwares)
         VIR_REALLOC_N(*fws, 0);
 
-    for (i = 0; i < nfirmwares; i++)
-        qemuFirmwareFree(firmwares[i]);
-    VIR_FREE(firmwares);
     return 0;
 }
@@ -42,6 +42,9 @@ int
 qemuFirmwareFetchConfigs(char ***firmwares,
                          bool privileged);
 
+time_t
+qemuFirmwareGetConfigsMtime(bool privileged);
+
 int
 qemuFirmwareFillDomain(virQEMUDriver *driver,
                        virDomainDef *def,
@@ -75,8 +75,9 @@ VIR_LOG_INIT("qemu.qemu_hotplug");
 #define QEMU_UNPLUG_TIMEOUT_PPC64 1000ull * 10
 
 
-static void
-qemuDomainResetDeviceRemoval(virDomainObj *vm);
+static qemuDomainUnpluggingDevice *
+qemuDomainFindDeviceRemoval(virDomainObj *vm,
+                            const char *alias);
 
 /**
  * qemuDomainDeleteDevice:
@@ -104,6 +105,7 @@ qemuDomainDeleteDevice(virDomainObj *vm,
 {
     qemuDomainObjPrivate *priv = vm->privateData;
     virQEMUDriver *driver = priv->driver;
+    qemuDomainUnpluggingDevice *unplug;
     int rc;
 
     qemuDomainObjEnterMonitor(driver, vm);
@@ -117,10 +119,10 @@ qemuDomainDeleteDevice(virDomainObj *vm,
          * even arrived. If it did, we need to claim success to
          * make the caller remove device from domain XML. */
 
-        if (priv->unplug.eventSeen) {
+        if ((unplug = qemuDomainFindDeviceRemoval(vm, alias)) &&
+            unplug->eventSeen) {
             /* The event arrived. Return success. */
             VIR_DEBUG("Detaching of device %s failed, but event arrived", alias);
-            qemuDomainResetDeviceRemoval(vm);
             rc = 0;
         } else if (rc == -2) {
             /* The device does not exist in qemu, but it still
@@ -836,6 +838,17 @@ qemuDomainAttachDiskGeneric(virQEMUDriver *driver,
     if (rc < 0)
         goto rollback;
 
+    /* Same as with throttling there isn't anything sane to do once the
+     * device is attached, so failure to arm the threshold is just logged. */
+    if (disk->autoextend) {
+        g_autoptr(GHashTable) blockNamedNodeData = NULL;
+
+        if (!(blockNamedNodeData = qemuBlockGetNamedNodeData(vm, asyncJob)) ||
+            qemuBlockAutoExtendArm(vm, disk, blockNamedNodeData, asyncJob) < 0)
+            VIR_WARN("failed to set up automatic extension for '%s' of '%s'",
+                     disk->dst, vm->def->name);
+    }
+
     return 0;
 
  rollback:
@@ -5260,10 +5273,9 @@ qemuDomainMarkDeviceAliasForRemoval(virDomainObj *vm,
                                     const char *alias)
 {
     qemuDomainObjPrivate *priv = vm->privateData;
+    qemuDomainUnpluggingDevice unplug = { .alias = g_strdup(alias) };
 
-    memset(&priv->unplug, 0, sizeof(priv->unplug));
-
-    priv->unplug.alias = alias;
+    VIR_APPEND_ELEMENT(priv->unplug, priv->nunplug, unplug);
 }
 
 
@@ -5276,12 +5288,32 @@ qemuDomainMarkDeviceForRemoval(virDomainObj *vm,
 }
 
 
+static qemuDomainUnpluggingDevice *
+qemuDomainFindDeviceRemoval(virDomainObj *vm,
+                            const char *alias)
+{
+    qemuDomainObjPrivate *priv = vm->privateData;
+    size_t i;
+
+    for (i = 0; i < priv->nunplug; i++) {
+        if (STREQ_NULLABLE(priv->unplug[i].alias, alias))
+            return &priv->unplug[i];
+    }
+
+    return NULL;
+}
+
+
 static void
 qemuDomainResetDeviceRemoval(virDomainObj *vm)
 {
     qemuDomainObjPrivate *priv = vm->privateData;
-    priv->unplug.alias = NULL;
-    priv->unplug.eventSeen = false;
+    size_t i;
+
+    for (i = 0; i < priv->nunplug; i++)
+        g_free(priv->unplug[i].alias);
+    g_clear_pointer(&priv->unplug, g_free);
+    priv->nunplug = 0;
 }
 
 
@@ -5295,38 +5327,64 @@ qemuDomainGetUnplugTimeout(virDomainObj *vm)
 }
 
 
-/* Returns:
- *  -1 Unplug of the device failed
+/* Waits for all the devices marked for removal at once, so that the guest
+ * can process their unplug requests in parallel. The timeout applies to
+ * the whole set of devices rather than to each of them.
  *
- *   0 removal of the device did not finish in qemuDomainRemoveDeviceWaitTime
+ * Returns:
+ *   0 removal of some of the devices did not finish in time
  *
- *   1 when the caller is responsible for finishing the device removal:
- *      - DEVICE_DELETED event arrived before the timeout time
- *      - we failed to reliably wait for the event and thus use fallback behavior
+ *   1 when the caller is responsible for finishing the removal of each
+ *     device (see qemuDomainWaitForDeviceRemoval)
  */
 static int
-qemuDomainWaitForDeviceRemoval(virDomainObj *vm)
+qemuDomainWaitForDevicesRemoval(virDomainObj *vm)
 {
     qemuDomainObjPrivate *priv = vm->privateData;
     unsigned long long until;
+    size_t i;
     int rc;
 
     if (virTimeMillisNow(&until) < 0)
         return 1;
     until += qemuDomainGetUnplugTimeout(vm);
 
-    while (priv->unplug.alias) {
-        if ((rc = virDomainObjWaitUntil(vm, until)) == 1)
-            return 0;
+    for (i = 0; i < priv->nunplug; i++) {
+        while (!priv->unplug[i].eventSeen) {
+            if ((rc = virDomainObjWaitUntil(vm, until)) == 1)
+                return 0;
 
-        if (rc < 0) {
-            VIR_WARN("Failed to wait on unplug condition for domain '%s' "
-                     "device '%s'", vm->def->name, priv->unplug.alias);
-            return 1;
+            if (rc < 0) {
+                VIR_WARN("Failed to wait on unplug condition for domain '%s' "
+                         "device '%s'", vm->def->name, priv->unplug[i].alias);
+                return 1;
+            }
         }
     }
 
-    if (priv->unplug.status == QEMU_DOMAIN_UNPLUGGING_DEVICE_STATUS_GUEST_REJECTED) {
+    return 1;
+}
+
+
+/* Returns:
+ *  -1 Unplug of the device failed
+ *
+ *   0 removal of the device did not finish in qemuDomainRemoveDeviceWaitTime
+ *
+ *   1 when the caller is responsible for finishing the device removal:
+ *      - DEVICE_DELETED event arrived before the timeout time
+ *      - we failed to reliably wait for the event and thus use fallback behavior
+ */
+static int
+qemuDomainWaitForDeviceRemoval(virDomainObj *vm)
+{
+    qemuDomainObjPrivate *priv = vm->privateData;
+    int rc;
+
+    if ((rc = qemuDomainWaitForDevicesRemoval(vm)) <= 0)
+        return rc;
+
+    if (priv->unplug[0].status == QEMU_DOMAIN_UNPLUGGING_DEVICE_STATUS_GUEST_REJECTED) {
         virReportError(VIR_ERR_OPERATION_FAILED, "%s",
                        _("unplug of device was rejected by the guest"));
         return -1;
@@ -5346,13 +5404,12 @@ qemuDomainSignalDeviceRemoval(virDomainObj *vm,
                               const char *devAlias,
                               qemuDomainUnpluggingDeviceStatus status)
 {
-    qemuDomainObjPrivate *priv = vm->privateData;
+    qemuDomainUnpluggingDevice *unplug = qemuDomainFindDeviceRemoval(vm, devAlias);
 
-    if (STREQ_NULLABLE(priv->unplug.alias, devAlias)) {
+    if (unplug && !unplug->eventSeen) {
         VIR_DEBUG("Removal of device '%s' continues in waiting thread", devAlias);
-        qemuDomainResetDeviceRemoval(vm);
-        priv->unplug.status = status;
-        priv->unplug.eventSeen = true;
+        unplug->status = status;
+        unplug->eventSeen = true;
         virDomainObjBroadcast(vm);
         return true;
     }
@@ -5972,15 +6029,27 @@ qemuDomainDetachDeviceLease(virQEMUDriver *driver,
 }
 
 
-int
-qemuDomainDetachDeviceLive(virDomainObj *vm,
-                           virDomainDeviceDef *match,
-                           virQEMUDriver *driver,
-                           bool async)
+/* Looks up the device matching @match in the live definition, stores it
+ * into @detach and validates that it can be unplugged.
+ *
+ * Returns:
+ *  -1 on error
+ *
+ *   0 if the device was already detached, as lease, chr and unassigned
+ *     devices are handled here completely
+ *
+ *   1 if the caller has to unplug @detach via qemuDomainDeleteDevice()
+ */
+static int
+qemuDomainDetachDeviceLivePrepare(virDomainObj *vm,
+                                  virDomainDeviceDef *match,
+                                  virQEMUDriver *driver,
+                                  bool async,
+                                  virDomainDeviceDef *detach)
 {
-    virDomainDeviceDef detach = { .type = match->type };
     virDomainDeviceInfo *info = NULL;
-    int ret = -1;
+
+    detach->type = match->type;
 
     switch ((virDomainDeviceType)match->type) {
         /*
@@ -6003,74 +6072,74 @@ qemuDomainDetachDeviceLive(virDomainObj *vm,
          */
     case VIR_DOMAIN_DEVICE_DISK:
         if (qemuDomainDetachPrepDisk(vm, match->data.disk,
-                                     &detach.data.disk) < 0) {
+                                     &detach->data.disk) < 0) {
             return -1;
         }
         break;
     case VIR_DOMAIN_DEVICE_CONTROLLER:
         if (qemuDomainDetachPrepController(vm, match->data.controller,
-                                           &detach.data.controller) < 0) {
+                                           &detach->data.controller) < 0) {
             return -1;
         }
         break;
     case VIR_DOMAIN_DEVICE_NET:
         if (qemuDomainDetachPrepNet(vm, match->data.net,
-                                    &detach.data.net) < 0) {
+                                    &detach->data.net) < 0) {
             return -1;
         }
         break;
     case VIR_DOMAIN_DEVICE_HOSTDEV:
         if (qemuDomainDetachPrepHostdev(vm, match->data.hostdev,
-                                        &detach.data.hostdev) < 0) {
+                                        &detach->data.hostdev) < 0) {
             return -1;
         }
         break;
     case VIR_DOMAIN_DEVICE_RNG:
         if (qemuDomainDetachPrepRNG(vm, match->data.rng,
-                                    &detach.data.rng) < 0) {
+                                    &detach->data.rng) < 0) {
             return -1;
         }
         break;
     case VIR_DOMAIN_DEVICE_MEMORY:
         if (qemuDomainDetachPrepMemory(vm, match->data.memory,
-                                       &detach.data.memory) < 0) {
+                                       &detach->data.memory) < 0) {
             return -1;
         }
         break;
     case VIR_DOMAIN_DEVICE_SHMEM:
         if (qemuDomainDetachPrepShmem(vm, match->data.shmem,
-                                      &detach.data.shmem) < 0) {
+                                      &detach->data.shmem) < 0) {
             return -1;
         }
         break;
     case VIR_DOMAIN_DEVICE_WATCHDOG:
         if (qemuDomainDetachPrepWatchdog(vm, match->data.watchdog,
-                                         &detach.data.watchdog) < 0) {
+                                         &detach->data.watchdog) < 0) {
             return -1;
         }
         break;
     case VIR_DOMAIN_DEVICE_INPUT:
         if (qemuDomainDetachPrepInput(vm, match->data.input,
-                                      &detach.data.input) < 0) {
+                                      &detach->data.input) < 0) {
             return -1;
         }
         break;
     case VIR_DOMAIN_DEVICE_REDIRDEV:
         if (qemuDomainDetachPrepRedirdev(vm, match->data.redirdev,
-                                         &detach.data.redirdev) < 0) {
+                                         &detach->data.redirdev) < 0) {
             return -1;
         }
         break;
     case VIR_DOMAIN_DEVICE_VSOCK:
         if (qemuDomainDetachPrepVsock(vm, match->data.vsock,
-                                      &detach.data.vsock) < 0) {
+                                      &detach->data.vsock) < 0) {
             return -1;
         }
         break;
 
     case VIR_DOMAIN_DEVICE_FS:
         if (qemuDomainDetachPrepFS(vm, match->data.fs,
-                                   &detach.data.fs) < 0) {
+                                   &detach->data.fs) < 0) {
             return -1;
         }
         break;
@@ -6096,7 +6165,7 @@ qemuDomainDetachDeviceLive(virDomainObj *vm,
 
     /* "detach" now points to the actual device we want to detach */
 
-    if (!(info = virDomainDeviceGetInfo(&detach))) {
+    if (!(info = virDomainDeviceGetInfo(detach))) {
         /*
          * This should never happen, since all of the device types in
          * the switch cases that end with a "break" instead of a
@@ -6104,7 +6173,7 @@ qemuDomainDetachDeviceLive(virDomainObj *vm,
          */
         virReportError(VIR_ERR_INTERNAL_ERROR,
                        _("device of type '%s' has no device info"),
-                       virDomainDeviceTypeToString(detach.type));
+                       virDomainDeviceTypeToString(detach->type));
         return -1;
     }
 
@@ -6114,7 +6183,7 @@ qemuDomainDetachDeviceLive(virDomainObj *vm,
     if (!info->alias) {
         virReportError(VIR_ERR_INTERNAL_ERROR,
                        _("Cannot detach %s device with no alias"),
-                       virDomainDeviceTypeToString(detach.type));
+                       virDomainDeviceTypeToString(detach->type));
         return -1;
     }
 
@@ -6122,7 +6191,7 @@ qemuDomainDetachDeviceLive(virDomainObj *vm,
         virReportError(VIR_ERR_OPERATION_FAILED,
                        _("cannot hot unplug %s device with multifunction PCI guest address: "
                          VIR_PCI_DEVICE_ADDRESS_FMT),
-                       virDomainDeviceTypeToString(detach.type),
+                       virDomainDeviceTypeToString(detach->type),
                        info->addr.pci.domain, info->addr.pci.bus,
                        info->addr.pci.slot, info->addr.pci.function);
         return -1;
@@ -6139,7 +6208,7 @@ qemuDomainDetachDeviceLive(virDomainObj *vm,
                            _("cannot hot unplug %s device with PCI guest address: "
                              VIR_PCI_DEVICE_ADDRESS_FMT
                              " - controller not found"),
-                           virDomainDeviceTypeToString(detach.type),
+                           virDomainDeviceTypeToString(detach->type),
                            info->addr.pci.domain, info->addr.pci.bus,
                            info->addr.pci.slot, info->addr.pci.function);
             return -1;
@@ -6151,7 +6220,7 @@ qemuDomainDetachDeviceLive(virDomainObj *vm,
                            _("cannot hot unplug %s device with PCI guest address: "
                              VIR_PCI_DEVICE_ADDRESS_FMT
                              " - not allowed by controller"),
-                           virDomainDeviceTypeToString(detach.type),
+                           virDomainDeviceTypeToString(detach->type),
                            info->addr.pci.domain, info->addr.pci.bus,
                            info->addr.pci.slot, info->addr.pci.function);
             return -1;
@@ -6159,9 +6228,30 @@ qemuDomainDetachDeviceLive(virDomainObj *vm,
     } else if (info->type == VIR_DOMAIN_DEVICE_ADDRESS_TYPE_UNASSIGNED) {
         /* Unassigned devices are not exposed to QEMU, so remove the device
          * explicitly, just like if we received DEVICE_DELETED event.*/
-        return qemuDomainRemoveDevice(driver, vm, &detach);
+        return qemuDomainRemoveDevice(driver, vm, detach);
     }
 
+    return 1;
+}
+
+
+int
+qemuDomainDetachDeviceLive(virDomainObj *vm,
+                           virDomainDeviceDef *match,
+                           virQEMUDriver *driver,
+                           bool async)
+{
+    virDomainDeviceDef detach = { 0 };
+    virDomainDeviceInfo *info = NULL;
+    int ret = -1;
+    int rc;
+
+    if ((rc = qemuDomainDetachDeviceLivePrepare(vm, match, driver,
+                                                async, &detach)) <= 0)
+        return rc;
+
+    info = virDomainDeviceGetInfo(&detach);
+
     /*
      * Issue the qemu monitor command to delete the device (based on
      * its alias), and optionally wait a short time in case the
@@ -6191,6 +6281,118 @@ qemuDomainDetachDeviceLive(virDomainObj *vm,
 }
 
 
+/**
+ * qemuDomainDetachDevicesLive:
+ * @vm: domain object
+ * @matches: devices to detach
+ * @nmatches: number of items in @matches
+ * @driver: qemu driver
+ *
+ * Works like qemuDomainDetachDeviceLive() for each of @matches, except
+ * that unplug of all the devices is requested first and only then it is
+ * waited for them to be removed, within a single timeout. Devices which
+ * were not removed by then are left for the DEVICE_DELETED event handler.
+ *
+ * Returns 0 on success, -1 otherwise.
+ */
+int
+qemuDomainDetachDevicesLive(virDomainObj *vm,
+                            virDomainDeviceDef **matches,
+                            size_t nmatches,
+                            virQEMUDriver *driver)
+{
+    g_autofree virDomainDeviceDef *detach = g_new0(virDomainDeviceDef, nmatches);
+    g_autofree bool *unplug = g_new0(bool, nmatches);
+    virErrorPtr save_error = NULL;
+    bool failed = false;
+    size_t i;
+    size_t j;
+    int rc;
+
+    for (i = 0; i < nmatches; i++) {
+        virDomainDeviceInfo *info;
+
+        if ((rc = qemuDomainDetachDeviceLivePrepare(vm, matches[i], driver,
+                                                    false, &detach[i])) < 0)
+            return -1;
+
+        if (rc == 0)
+            continue;
+
+        info = virDomainDeviceGetInfo(&detach[i]);
+
+        for (j = 0; j < i; j++) {
+            if (unplug[j] && virDomainDeviceGetInfo(&detach[j]) == info) {
+                virReportError(VIR_ERR_OPERATION_INVALID,
+                               _("device '%s' is listed more than once"),
+                               info->alias);
+                return -1;
+            }
+        }
+
+        unplug[i] = true;
+    }
+
+    for (i = 0; i < nmatches; i++) {
+        virDomainDeviceInfo *info;
+
+        if (!unplug[i])
+            continue;
+
+        info = virDomainDeviceGetInfo(&detach[i]);
+
+        qemuDomainMarkDeviceForRemoval(vm, info);
+
+        if (qemuDomainDeleteDevice(vm, info->alias) < 0) {
+            if (virDomainObjIsActive(vm))
+                qemuDomainRemoveAuditDevice(vm, &detach[i], false);
+            failed = true;
+            break;
+        }
+    }
+
+    /* Don't wait for the devices if unplug of any of them couldn't be even
+     * requested, but still finish removal of those which are gone already. */
+    if (failed) {
+        virErrorPreserveLast(&save_error);
+        rc = 0;
+    } else {
+        rc = qemuDomainWaitForDevicesRemoval(vm);
+    }
+
+    for (i = 0; i < nmatches; i++) {
+        virDomainDeviceInfo *info;
+        qemuDomainUnpluggingDevice *removal;
+
+        if (!unplug[i])
+            continue;
+
+        info = virDomainDeviceGetInfo(&detach[i]);
+
+        if (!(removal = qemuDomainFindDeviceRemoval(vm, info->alias)) ||
+            (rc == 0 && !removal->eventSeen))
+            continue;
+
+        if (removal->status == QEMU_DOMAIN_UNPLUGGING_DEVICE_STATUS_GUEST_REJECTED) {
+            if (!failed)
+                virReportError(VIR_ERR_OPERATION_FAILED,
+                               _("unplug of device '%s' was rejected by the guest"),
+                               info->alias);
+            failed = true;
+            continue;
+        }
+
+        if (qemuDomainRemoveDevice(driver, vm, &detach[i]) < 0)
+            failed = true;
+    }
+
+    qemuDomainResetDeviceRemoval(vm);
+    virErrorRestore(&save_error);
+
+    return failed ? -1 : 0;
+}
+
+
 static int
 qemuDomainRemoveVcpu(virQEMUDriver *driver,
                      virDomainObj *vm,
@@ -6260,7 +6462,6 @@ qemuDomainRemoveVcpuAlias(virQEMUDriver *driver,
 
 static int
 qemuDomainHotplugDelVcpu(virQEMUDriver *driver,
-                         virQEMUDriverConfig *cfg,
                          virDomainObj *vm,
                          unsigned int vcpu)
 {
@@ -6299,8 +6500,7 @@ qemuDomainHotplugDelVcpu(virQEMUDriver *driver,
 
     qemuDomainVcpuPersistOrder(vm->def);
 
-    if (virDomainObjSave(vm, driver->xmlopt, cfg->stateDir) < 0)
-        goto cleanup;
+    qemuDomainSaveStatus(vm);
 
     ret = 0;
 
@@ -6312,7 +6512,6 @@ qemuDomainHotplugDelVcpu(virQEMUDriver *driver,
 
 static int
 qemuDomainHotplugAddVcpu(virQEMUDriver *driver,
-                         virQEMUDriverConfig *cfg,
                          virDomainObj *vm,
                          unsigned int vcpu)
 {
@@ -6369,8 +6568,7 @@ qemuDomainHotplugAddVcpu(virQEMUDriver *driver,
 
     qemuDomainVcpuPersistOrder(vm->def);
 
-    if (virDomainObjSave(vm, driver->xmlopt, cfg->stateDir) < 0)
-        return -1;
+    qemuDomainSaveStatus(vm);
 
     return 0;
 }
@@ -6469,7 +6667,6 @@ qemuDomainSelectHotplugVcpuEntities(virDomainDef *def,
 
 static int
 qemuDomainSetVcpusLive(virQEMUDriver *driver,
-                       virQEMUDriverConfig *cfg,
                        virDomainObj *vm,
                        virBitmap *vcpumap,
                        bool enable)
@@ -6484,7 +6681,7 @@ qemuDomainSetVcpusLive(virQEMUDriver *driver,
 
     if (enable) {
         while ((nextvcpu = virBitmapNextSetBit(vcpumap, nextvcpu)) != -1) {
-            if (qemuDomainHotplugAddVcpu(driver, cfg, vm, nextvcpu) < 0)
+            if (qemuDomainHotplugAddVcpu(driver, vm, nextvcpu) < 0)
                 goto cleanup;
         }
     } else {
@@ -6492,7 +6689,7 @@ qemuDomainSetVcpusLive(virQEMUDriver *driver,
             if (!virBitmapIsBitSet(vcpumap, nextvcpu))
                 continue;
 
-            if (qemuDomainHotplugDelVcpu(driver, cfg, vm, nextvcpu) < 0)
+            if (qemuDomainHotplugDelVcpu(driver, vm, nextvcpu) < 0)
                 goto cleanup;
         }
     }
@@ -6610,7 +6807,7 @@ qemuDomainSetVcpusInternal(virQEMUDriver *driver,
                                                             &enable)))
             return -1;
 
-        if (qemuDomainSetVcpusLive(driver, cfg, vm, vcpumap, enable) < 0)
+        if (qemuDomainSetVcpusLive(driver, vm, vcpumap, enable) < 0)
             return -1;
     }
 
@@ -6796,7 +6993,7 @@ qemuDomainSetVcpuInternal(virQEMUDriver *driver,
     }
 
     if (livevcpus &&
-        qemuDomainSetVcpusLive(driver, cfg, vm, livevcpus, state) < 0)
+        qemuDomainSetVcpusLive(driver, vm, livevcpus, state) < 0)
         return -1;
 
     if (persistentDef) {
@@ -127,6 +127,11 @@ int qemuDomainDetachDeviceLive(virDomainObj *vm,
                                virQEMUDriver *driver,
                                bool async);
 
+int qemuDomainDetachDevicesLive(virDomainObj *vm,
+                                virDomainDeviceDef **matches,
+                                size_t nmatches,
+                                virQEMUDriver *driver);
+
 void qemuDomainRemoveVcpuAlias(virQEMUDriver *driver,
                                virDomainObj *vm,
                                const char *alias);
@@ -82,22 +82,16 @@ qemuBuildFileList(GHashTable *files, const char *dir)
 
 #define QEMU_CONFDIR SYSCONFDIR "/qemu"
 
-int
-qemuInteropFetchConfigs(const char *name,
-                        char ***configs,
-                        bool privileged)
+/* Returns the directories holding @name descriptions, in order of
+ * increasing priority. */
+static GStrv
+qemuInteropGetConfigDirs(const char *name,
+                         bool privileged)
 {
-    g_autoptr(GHashTable) files = virHashNew(g_free);
-    g_autofree char *homeConfig = NULL;
-    g_autofree char *xdgConfig = NULL;
-    g_autofree char *dataLocation = virFileBuildPath(QEMU_DATADIR, name, NULL);
-    g_autofree char *confLocation = virFileBuildPath(QEMU_CONFDIR, name, NULL);
-    g_autofree virHashKeyValuePair *pairs = NULL;
-    size_t npairs;
-    virHashKeyValuePair *tmp = NULL;
-    size_t nconfigs = 0;
+    GStrv dirs = g_new0(char *, 4);
 
-    *configs = NULL;
+    dirs[0] = virFileBuildPath(QEMU_DATADIR, name, NULL);
+    dirs[1] = virFileBuildPath(QEMU_CONFDIR, name, NULL);
 
     if (!privileged) {
         /* This is a slight divergence from the specification.
@@ -105,7 +99,7 @@ qemuInteropFetchConfigs(const char *name,
          * much sense to parse files in root's home directory. It
          * makes sense only for session daemon which runs under
          * regular user. */
-        xdgConfig = g_strdup(getenv("XDG_CONFIG_HOME"));
+        g_autofree char *xdgConfig = g_strdup(getenv("XDG_CONFIG_HOME"));
 
         if (!xdgConfig) {
             g_autofree char *home = virGetUserDirectory();
@@ -113,18 +107,32 @@ qemuInteropFetchConfigs(const char *name,
             xdgConfig = g_strdup_printf("%s/.config", home);
         }
 
-        homeConfig = g_strdup_printf("%s/qemu/%s", xdgConfig, name);
+        dirs[2] = g_strdup_printf("%s/qemu/%s", xdgConfig, name);
     }
 
-    if (qemuBuildFileList(files, dataLocation) < 0)
-        return -1;
+    return dirs;
+}
 
-    if (qemuBuildFileList(files, confLocation) < 0)
-        return -1;
 
-    if (homeConfig &&
-        qemuBuildFileList(files, homeConfig) < 0)
-        return -1;
+int
+qemuInteropFetchConfigs(const char *name,
+                        char ***configs,
+                        bool privileged)
+{
+    g_autoptr(GHashTable) files = virHashNew(g_free);
+    g_auto(GStrv) dirs = qemuInteropGetConfigDirs(name, privileged);
+    g_autofree virHashKeyValuePair *pairs = NULL;
+    size_t npairs;
+    virHashKeyValuePair *tmp = NULL;
+    size_t nconfigs = 0;
+    GStrv dir;
+
+    *configs = NULL;
+
+    for (dir = dirs; *dir; dir++) {
+        if (qemuBuildFileList(files, *dir) < 0)
+            return -1;
+    }
 
     /* At this point, the @files hash table contains unique set of filenames
      * where each filename (as key) has the highest priority full pathname
@@ -163,3 +171,35 @@ qemuInteropFetchConfigs(const char *name,
 
     return 0;
 }
+
+
+/**
+ * qemuInteropGetConfigsMtime:
+ * @name: type of descriptions, e.g. "firmware"
+ * @privileged: whether running as privileged daemon
+ *
+ * Descriptions are added, removed and replaced by packages, which
+ * changes the modification time of the directory holding them. This
+ * provides a cheap check whether anything derived from the descriptions
+ * is still up to date.
+ *
+ * Returns the latest modification time of the directories @name
+ * descriptions are loaded from, 0 if none of them exists.
+ */
+time_t
+qemuInteropGetConfigsMtime(const char *name,
+                           bool privileged)
+{
+    g_auto(GStrv) dirs = qemuInteropGetConfigDirs(name, privileged);
+    time_t mtime = 0;
+    GStrv dir;
+
+    for (dir = dirs; *dir; dir++) {
+        struct stat sb;
+
+        if (stat(*dir, &sb) == 0)
+            mtime = MAX(mtime, sb.st_mtime);
+    }
+
+    return mtime;
+}
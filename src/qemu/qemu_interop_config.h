@@ -23,3 +23,5 @@
 #include "internal.h"
 
 int qemuInteropFetchConfigs(const char *name, char ***configs, bool privileged);
+
+time_t qemuInteropGetConfigsMtime(const char *name, bool privileged);
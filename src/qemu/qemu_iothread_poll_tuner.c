@@ -0,0 +1,472 @@
+/*
+ * qemu_iothread_poll_tuner.c: adaptive polling of IOThreads
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "qemu_iothread_poll_tuner.h"
+#define LIBVIRT_QEMU_IOTHREAD_POLL_TUNERPRIV_H_ALLOW
+#include "qemu_iothread_poll_tunerpriv.h"
+#include "qemu_domain.h"
+#include "qemu_periodic.h"
+
+#include "viralloc.h"
+#include "virlog.h"
+#include "virprocess.h"
+#include "virtime.h"
+#include "viruuid.h"
+
+#define VIR_FROM_THIS VIR_FROM_QEMU
+
+VIR_LOG_INIT("qemu.qemu_iothread_poll_tuner");
+
+/* Interval in milliseconds between two passes of the IOThread poll tuner */
+#define QEMU_IOTHREAD_POLL_TUNER_INTERVAL 5000
+
+struct _qemuIOThreadPollTuner {
+    virQEMUDriver *driver;
+    qemuPeriodic *worker;
+
+    /* The rest is accessed by the worker thread only */
+
+    /* "UUID:iothread id" -> qemuIOThreadPollTunerState */
+    GHashTable *iothreads;
+};
+
+
+/**
+ * qemuIOThreadPollTunerShrink:
+ * @pollMaxNs: current maximum polling time
+ *
+ * Returns half of @pollMaxNs, or 0 if that's below the minimum.
+ */
+static unsigned long long
+qemuIOThreadPollTunerShrink(unsigned long long pollMaxNs)
+{
+    if (pollMaxNs / 2 < QEMU_IOTHREAD_POLL_TUNER_MIN_NS)
+        return 0;
+
+    return pollMaxNs / 2;
+}
+
+
+/**
+ * qemuIOThreadPollTunerDecide:
+ * @state: state of the IOThread
+ * @budget: CPU budget of the IOThread in percent
+ * @elapsed: time since the previous pass in ms
+ * @cpuTime: CPU time used by the IOThread since the previous pass in ns
+ * @ops: requests completed since the previous pass
+ * @opsTime: time spent by those requests in ns
+ *
+ * Returns the maximum polling time the IOThread should use next. The
+ * polling time is halved while the disks of the IOThread are idle or the
+ * IOThread exceeds its CPU budget. Otherwise it's doubled as long as that
+ * lowers the average latency of the requests by at least 5%, and reverted
+ * and kept for a while when it doesn't.
+ */
+unsigned long long
+qemuIOThreadPollTunerDecide(qemuIOThreadPollTunerState *state,
+                            unsigned int budget,
+                            unsigned long long elapsed,
+                            unsigned long long cpuTime,
+                            unsigned long long ops,
+                            unsigned long long opsTime)
+{
+    unsigned long long latency = ops ? opsTime / ops : 0;
+    unsigned long long prevLatency = state->latency;
+    bool probe = state->probe;
+
+    state->latency = latency;
+    state->probe = false;
+
+    if (cpuTime * 100 > budget * elapsed * 1000 * 1000) {
+        state->hold = QEMU_IOTHREAD_POLL_TUNER_HOLD;
+        return qemuIOThreadPollTunerShrink(state->pollMaxNs);
+    }
+
+    if (ops == 0)
+        return qemuIOThreadPollTunerShrink(state->pollMaxNs);
+
+    if (probe) {
+        if (prevLatency && latency * 100 <= prevLatency * 95)
+            return state->pollMaxNs;
+
+        state->hold = QEMU_IOTHREAD_POLL_TUNER_HOLD;
+        return state->prevPollMaxNs;
+    }
+
+    if (state->hold > 0) {
+        state->hold--;
+        return state->pollMaxNs;
+    }
+
+    if (state->pollMaxNs >= QEMU_IOTHREAD_POLL_TUNER_MAX_NS)
+        return state->pollMaxNs;
+
+    state->probe = true;
+    state->prevPollMaxNs = state->pollMaxNs;
+
+    return MAX(state->pollMaxNs * 2, QEMU_IOTHREAD_POLL_TUNER_MIN_NS);
+}
+
+
+/* Whether @vm has any IOThread with adaptive polling which qemu supports */
+static bool
+qemuIOThreadPollTunerWants(virDomainObj *vm)
+{
+    qemuDomainObjPrivate *priv = vm->privateData;
+    size_t i;
+
+    if (!virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_IOTHREAD_POLLING))
+        return false;
+
+    for (i = 0; i < vm->def->niothreadids; i++) {
+        if (vm->def->iothreadids[i]->pollTuning == VIR_DOMAIN_IOTHREAD_POLL_TUNING_ADAPTIVE)
+            return true;
+    }
+
+    return false;
+}
+
+
+/**
+ * qemuIOThreadPollTunerDomain:
+ * @driver: qemu driver
+ * @tuner: IOThread poll tuner
+ * @vm: locked domain object
+ * @now: time of the current pass in ms
+ *
+ * Samples the IOThreads of @vm with adaptive polling and the disks they
+ * serve and updates their maximum polling time in qemu.
+ */
+static void
+qemuIOThreadPollTunerDomain(virQEMUDriver *driver,
+                            qemuIOThreadPollTuner *tuner,
+                            virDomainObj *vm,
+                            unsigned long long now)
+{
+    qemuDomainObjPrivate *priv = vm->privateData;
+    bool blockdev = virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_BLOCKDEV);
+    g_autoptr(GHashTable) blockstats = NULL;
+    qemuMonitorIOThreadInfo **iothreads = NULL;
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
+    int niothreads = 0;
+    size_t i;
+    size_t j;
+    int rc;
+
+    if (!qemuIOThreadPollTunerWants(vm))
+        return;
+
+    /* don't wait for other jobs, a busy domain is tuned in the next pass */
+    if (qemuDomainObjBeginJobNowait(driver, vm, VIR_JOB_MODIFY) < 0) {
+        virResetLastError();
+        return;
+    }
+
+    if (!virDomainObjIsActive(vm))
+        goto endjob;
+
+    qemuDomainObjEnterMonitor(driver, vm);
+    rc = qemuMonitorGetAllBlockStatsInfo(priv->mon, &blockstats);
+    if (rc >= 0)
+        rc = qemuMonitorGetIOThreads(priv->mon, &iothreads, &niothreads);
+    qemuDomainObjExitMonitor(vm);
+
+    if (rc < 0 || !virDomainObjIsActive(vm)) {
+        virResetLastError();
+        goto endjob;
+    }
+
+    virUUIDFormat(vm->def->uuid, uuidstr);
+
+    for (i = 0; i < niothreads; i++) {
+        qemuMonitorIOThreadInfo *info = iothreads[i];
+        virDomainIOThreadIDDef *iothread;
+        qemuIOThreadPollTunerState *state;
+        qemuMonitorIOThreadInfo set = { 0 };
+        g_autofree char *key = NULL;
+        unsigned long long cpuTime = 0;
+        unsigned long long ops = 0;
+        unsigned long long opsTime = 0;
+        unsigned long long want;
+        unsigned int budget;
+
+        if (!info->poll_valid ||
+            !(iothread = virDomainIOThreadIDFind(vm->def, info->iothread_id)) ||
+            iothread->pollTuning != VIR_DOMAIN_IOTHREAD_POLL_TUNING_ADAPTIVE)
+            continue;
+
+        if (virProcessGetStatInfo(&cpuTime, NULL, NULL,
+                                  vm->pid, info->thread_id) < 0) {
+            virResetLastError();
+            continue;
+        }
+
+        for (j = 0; j < vm->def->ndisks; j++) {
+            virDomainDiskDef *disk = vm->def->disks[j];
+            const char *entryname = disk->info.alias;
+            qemuBlockStats *stats;
+
+            if (disk->iothread != info->iothread_id)
+                continue;
+
+            if (blockdev && QEMU_DOMAIN_DISK_PRIVATE(disk)->qomName)
+                entryname = QEMU_DOMAIN_DISK_PRIVATE(disk)->qomName;
+
+            if (!entryname || !(stats = virHashLookup(blockstats, entryname)))
+                continue;
+
+            ops += stats->rd_req + stats->wr_req + stats->flush_req;
+            opsTime += stats->rd_total_times + stats->wr_total_times +
+                       stats->flush_total_times;
+        }
+
+        key = g_strdup_printf("%s:%u", uuidstr, info->iothread_id);
+
+        if (!(state = virHashLookup(tuner->iothreads, key))) {
+            state = g_new0(qemuIOThreadPollTunerState, 1);
+            if (virHashAddEntry(tuner->iothreads, key, state) < 0) {
+                g_free(state);
+                virResetLastError();
+                continue;
+            }
+        }
+
+        state->seen = true;
+
+        /* start over with a new thread, changed counters or a polling
+         * time set through virDomainSetIOThreadParams */
+        if (state->thread_id != info->thread_id ||
+            state->pollMaxNs != info->poll_max_ns ||
+            !state->sampled || now <= state->sampled ||
+            cpuTime < state->cpuTime ||
+            ops < state->ops || opsTime < state->opsTime) {
+            memset(state, 0, sizeof(*state));
+            state->thread_id = info->thread_id;
+            state->pollMaxNs = info->poll_max_ns;
+            state->seen = true;
+            want = state->pollMaxNs;
+        } else {
+            budget = iothread->pollBudget;
+            if (budget == 0)
+                budget = QEMU_IOTHREAD_POLL_TUNER_BUDGET;
+
+            want = qemuIOThreadPollTunerDecide(state, budget,
+                                               now - state->sampled,
+                                               cpuTime - state->cpuTime,
+                                               ops - state->ops,
+                                               opsTime - state->opsTime);
+        }
+
+        state->cpuTime = cpuTime;
+        state->ops = ops;
+        state->opsTime = opsTime;
+        state->sampled = now;
+
+        if (want == state->pollMaxNs)
+            continue;
+
+        VIR_DEBUG("setting poll-max-ns of IOThread %u of domain %s to %llu",
+                  info->iothread_id, vm->def->name, want);
+
+        set.iothread_id = info->iothread_id;
+        set.poll_max_ns = want;
+        set.set_poll_max_ns = true;
+
+        qemuDomainObjEnterMonitor(driver, vm);
+        rc = qemuMonitorSetIOThread(priv->mon, &set);
+        qemuDomainObjExitMonitor(vm);
+
+        if (rc < 0) {
+            VIR_WARN("Unable to set poll-max-ns of IOThread %u of domain %s: %s",
+                     info->iothread_id, vm->def->name, virGetLastErrorMessage());
+            virResetLastError();
+            state->probe = false;
+            continue;
+        }
+
+        state->pollMaxNs = want;
+
+        if (!virDomainObjIsActive(vm))
+            break;
+    }
+
+ endjob:
+    qemuDomainObjEndJob(vm);
+
+    for (i = 0; i < niothreads; i++)
+        g_free(iothreads[i]);
+    g_free(iothreads);
+}
+
+
+static int
+qemuIOThreadPollTunerForget(const void *payload,
+                            const char *name G_GNUC_UNUSED,
+                            const void *opaque G_GNUC_UNUSED)
+{
+    const qemuIOThreadPollTunerState *state = payload;
+
+    return !state->seen;
+}
+
+
+static int
+qemuIOThreadPollTunerUnsee(void *payload,
+                           const char *name G_GNUC_UNUSED,
+                           void *opaque G_GNUC_UNUSED)
+{
+    qemuIOThreadPollTunerState *state = payload;
+
+    state->seen = false;
+    return 0;
+}
+
+
+/**
+ * qemuIOThreadPollTunerPass:
+ * @opaque: IOThread poll tuner
+ *
+ * Tunes the polling of the IOThreads of all running domains which ask for
+ * adaptive polling.
+ */
+static void
+qemuIOThreadPollTunerPass(void *opaque)
+{
+    qemuIOThreadPollTuner *tuner = opaque;
+    virQEMUDriver *driver = tuner->driver;
+    virDomainObj **vms = NULL;
+    unsigned long long now;
+    size_t nvms;
+    size_t i;
+
+    /* nothing to tune, don't bother looking at every domain */
+    if (g_atomic_int_get(&driver->npollTuned) == 0) {
+        virHashRemoveAll(tuner->iothreads);
+        return;
+    }
+
+    if (virTimeMillisNow(&now) < 0 ||
+        virDomainObjListCollect(driver->domains, NULL, &vms, &nvms,
+                                NULL, VIR_CONNECT_LIST_DOMAINS_ACTIVE) < 0) {
+        virResetLastError();
+        return;
+    }
+
+    for (i = 0; i < nvms; i++) {
+        virObjectLock(vms[i]);
+        if (virDomainObjIsActive(vms[i]))
+            qemuIOThreadPollTunerDomain(driver, tuner, vms[i], now);
+        virObjectUnlock(vms[i]);
+    }
+
+    /* IOThreads of domains which are gone or were not sampled are dropped */
+    virHashRemoveSet(tuner->iothreads, qemuIOThreadPollTunerForget, NULL);
+    virHashForEach(tuner->iothreads, qemuIOThreadPollTunerUnsee, NULL);
+
+    virObjectListFreeCount(vms, nvms);
+}
+
+
+/**
+ * qemuIOThreadPollTunerAddDomain:
+ * @driver: qemu driver
+ * @vm: domain object being started or reconnected to
+ *
+ * Counts @vm among the domains the tuner looks at if it has any IOThread
+ * with adaptive polling. While no domain does the passes of the tuner are
+ * skipped.
+ */
+void
+qemuIOThreadPollTunerAddDomain(virQEMUDriver *driver,
+                               virDomainObj *vm)
+{
+    qemuDomainObjPrivate *priv = vm->privateData;
+
+    if (priv->pollTuned || !qemuIOThreadPollTunerWants(vm))
+        return;
+
+    priv->pollTuned = true;
+    g_atomic_int_inc(&driver->npollTuned);
+}
+
+
+/**
+ * qemuIOThreadPollTunerRemoveDomain:
+ * @driver: qemu driver
+ * @vm: domain object being stopped
+ *
+ * Undoes qemuIOThreadPollTunerAddDomain.
+ */
+void
+qemuIOThreadPollTunerRemoveDomain(virQEMUDriver *driver,
+                                  virDomainObj *vm)
+{
+    qemuDomainObjPrivate *priv = vm->privateData;
+
+    if (!priv->pollTuned)
+        return;
+
+    priv->pollTuned = false;
+    ignore_value(g_atomic_int_dec_and_test(&driver->npollTuned));
+}
+
+
+void
+qemuIOThreadPollTunerFree(qemuIOThreadPollTuner *tuner)
+{
+    if (!tuner)
+        return;
+
+    /* stop the worker before freeing the state it uses */
+    qemuPeriodicFree(tuner->worker);
+    g_clear_pointer(&tuner->iothreads, g_hash_table_unref);
+    g_free(tuner);
+}
+
+
+/**
+ * qemuIOThreadPollTunerStart:
+ * @driver: qemu driver
+ *
+ * Starts the thread tuning the polling of IOThreads of domains which ask for
+ * it by <poll tuning='adaptive'/>.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+qemuIOThreadPollTunerStart(virQEMUDriver *driver)
+{
+    qemuIOThreadPollTuner *tuner = g_new0(qemuIOThreadPollTuner, 1);
+
+    tuner->driver = driver;
+    tuner->iothreads = virHashNew(g_free);
+
+    if (!(tuner->worker = qemuPeriodicNew("qemu-iothr-poll",
+                                          _("IOThread poll tuner"),
+                                          QEMU_IOTHREAD_POLL_TUNER_INTERVAL,
+                                          qemuIOThreadPollTunerPass, tuner))) {
+        qemuIOThreadPollTunerFree(tuner);
+        return -1;
+    }
+
+    driver->iothreadPollTuner = tuner;
+
+    return 0;
+}
@@ -0,0 +1,65 @@
+/*
+ * qemu_iothread_poll_tunerpriv.h: private declarations for the IOThread poll
+ *                                 tuner
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBVIRT_QEMU_IOTHREAD_POLL_TUNERPRIV_H_ALLOW
+# error "qemu_iothread_poll_tunerpriv.h may only be included by qemu_iothread_poll_tuner.c or test suites"
+#endif /* LIBVIRT_QEMU_IOTHREAD_POLL_TUNERPRIV_H_ALLOW */
+
+#pragma once
+
+#include "qemu_iothread_poll_tuner.h"
+
+/* Share of a host CPU in percent an adaptively polling IOThread may use
+ * unless the domain definition sets a budget */
+#define QEMU_IOTHREAD_POLL_TUNER_BUDGET 10
+
+/* Range of the poll-max-ns values set by the tuner, polling is disabled
+ * rather than set below the minimum */
+#define QEMU_IOTHREAD_POLL_TUNER_MIN_NS 4096
+#define QEMU_IOTHREAD_POLL_TUNER_MAX_NS 262144
+
+/* Number of passes an IOThread keeps its polling time after an increase
+ * didn't improve the latency or the CPU budget was exceeded */
+#define QEMU_IOTHREAD_POLL_TUNER_HOLD 6
+
+typedef struct _qemuIOThreadPollTunerState qemuIOThreadPollTunerState;
+struct _qemuIOThreadPollTunerState {
+    int thread_id;
+    unsigned long long pollMaxNs; /* value set in qemu */
+    unsigned long long prevPollMaxNs; /* value before an increase on probe */
+
+    /* counters in the previous pass */
+    unsigned long long cpuTime; /* ns spent by the IOThread */
+    unsigned long long ops; /* requests of the disks of the IOThread */
+    unsigned long long opsTime; /* ns spent by the requests */
+    unsigned long long sampled; /* time of the previous pass in ms */
+    unsigned long long latency; /* average latency in ns, 0 if unknown */
+
+    unsigned int hold;
+    bool probe;
+    bool seen;
+};
+
+unsigned long long
+qemuIOThreadPollTunerDecide(qemuIOThreadPollTunerState *state,
+                            unsigned int budget,
+                            unsigned long long elapsed,
+                            unsigned long long cpuTime,
+                            unsigned long long ops,
+                            unsigned long long opsTime);
@@ -0,0 +1,542 @@
+/*
+ * qemu_iotune_balancer.c: balancing of the limits of throttle groups
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "qemu_iotune_balancer.h"
+#define LIBVIRT_QEMU_IOTUNE_BALANCERPRIV_H_ALLOW
+#include "qemu_iotune_balancerpriv.h"
+#include "qemu_alias.h"
+#include "qemu_domain.h"
+#include "qemu_periodic.h"
+
+#include "viralloc.h"
+#include "virlog.h"
+#include "virtime.h"
+#include "viruuid.h"
+
+#define VIR_FROM_THIS VIR_FROM_QEMU
+
+VIR_LOG_INIT("qemu.qemu_iotune_balancer");
+
+/* Interval in milliseconds between two rebalancing passes of the limits of
+ * throttle groups */
+#define QEMU_IOTUNE_BALANCER_INTERVAL 5000
+
+struct _qemuIOTuneBalancer {
+    virQEMUDriver *driver;
+    qemuPeriodic *worker;
+
+    /* The rest is accessed by the worker thread only */
+
+    unsigned long long totalIops; /* host-wide caps, 0 if not balanced */
+    unsigned long long totalBytes;
+
+    /* "UUID:group name" -> qemuIOTuneBalancerGroup */
+    GHashTable *groups;
+};
+
+
+/**
+ * qemuIOTuneBalancerDemand:
+ * @rate: observed rate
+ * @limit: limit currently set
+ *
+ * Returns what a throttle group is expected to need in the next interval. A
+ * group using (almost) all of its limit might need much more, so that it's
+ * offered twice its limit, otherwise the observed rate plus some headroom.
+ */
+unsigned long long
+qemuIOTuneBalancerDemand(unsigned long long rate,
+                         unsigned long long limit)
+{
+    if (rate >= limit - limit / 10)
+        return limit * 2;
+
+    return rate + rate / 4;
+}
+
+
+/**
+ * qemuIOTuneBalancerGroupSample:
+ * @group: throttle group
+ * @ops: requests completed by the member disks so far
+ * @transferred: bytes transferred by the member disks so far
+ * @now: time of the current pass in ms
+ *
+ * Updates the demand of @group from the rates observed since the previous
+ * sample. Without a usable previous sample the group is expected to need
+ * the limits currently set.
+ */
+void
+qemuIOTuneBalancerGroupSample(qemuIOTuneBalancerGroup *group,
+                              unsigned long long ops,
+                              unsigned long long transferred,
+                              unsigned long long now)
+{
+    unsigned long long elapsed = now - group->sampled;
+
+    if (group->sampled && now > group->sampled &&
+        ops >= group->ops && transferred >= group->transferred) {
+        unsigned long long iops = (ops - group->ops) * 1000 / elapsed;
+        unsigned long long bps = (transferred - group->transferred) * 1000 / elapsed;
+
+        if (group->iops)
+            group->wantIops = qemuIOTuneBalancerDemand(iops, group->iops);
+        if (group->bytes)
+            group->wantBytes = qemuIOTuneBalancerDemand(bps, group->bytes);
+    } else {
+        group->wantIops = group->iops;
+        group->wantBytes = group->bytes;
+    }
+
+    group->ops = ops;
+    group->transferred = transferred;
+    group->sampled = now;
+}
+
+
+/**
+ * qemuIOTuneBalancerSampleDomain:
+ * @driver: qemu driver
+ * @bal: throttle group balancer
+ * @vm: locked domain object
+ * @now: time of the current pass in ms
+ *
+ * Updates the observed demand of the throttle groups of @vm.
+ */
+static void
+qemuIOTuneBalancerSampleDomain(virQEMUDriver *driver,
+                               qemuIOTuneBalancer *bal,
+                               virDomainObj *vm,
+                               unsigned long long now)
+{
+    qemuDomainObjPrivate *priv = vm->privateData;
+    bool blockdev = virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_BLOCKDEV);
+    g_autoptr(GHashTable) blockstats = NULL;
+    g_autoptr(GHashTable) counters = virHashNew(g_free);
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
+    bool hasGroups = false;
+    size_t i;
+    int rc;
+
+    for (i = 0; i < vm->def->ndisks; i++) {
+        if (vm->def->disks[i]->blkdeviotune.group_name)
+            hasGroups = true;
+    }
+
+    if (!hasGroups)
+        return;
+
+    /* don't wait for other jobs, a busy domain is sampled in the next pass */
+    if (qemuDomainObjBeginJobNowait(driver, vm, VIR_JOB_QUERY) < 0) {
+        virResetLastError();
+        return;
+    }
+
+    if (!virDomainObjIsActive(vm)) {
+        qemuDomainObjEndJob(vm);
+        return;
+    }
+
+    qemuDomainObjEnterMonitor(driver, vm);
+    rc = qemuMonitorGetAllBlockStatsInfo(priv->mon, &blockstats);
+    qemuDomainObjExitMonitor(vm);
+
+    qemuDomainObjEndJob(vm);
+
+    if (rc < 0 || !virDomainObjIsActive(vm)) {
+        virResetLastError();
+        return;
+    }
+
+    virUUIDFormat(vm->def->uuid, uuidstr);
+
+    for (i = 0; i < vm->def->ndisks; i++) {
+        virDomainDiskDef *disk = vm->def->disks[i];
+        virDomainBlockIoTuneInfo *iotune = &disk->blkdeviotune;
+        qemuIOTuneBalancerGroup *group;
+        qemuBlockStats *stats;
+        qemuBlockStats *total;
+        const char *entryname = disk->info.alias;
+        g_autofree char *key = NULL;
+
+        if (!iotune->group_name ||
+            (!iotune->total_iops_sec && !iotune->total_bytes_sec))
+            continue;
+
+        if (blockdev && QEMU_DOMAIN_DISK_PRIVATE(disk)->qomName)
+            entryname = QEMU_DOMAIN_DISK_PRIVATE(disk)->qomName;
+
+        if (!entryname || !(stats = virHashLookup(blockstats, entryname)))
+            continue;
+
+        key = g_strdup_printf("%s:%s", uuidstr, iotune->group_name);
+
+        if (!(group = virHashLookup(bal->groups, key))) {
+            group = g_new0(qemuIOTuneBalancerGroup, 1);
+            if (virHashAddEntry(bal->groups, key, group) < 0) {
+                g_free(group);
+                virResetLastError();
+                continue;
+            }
+        }
+
+        if (!group->seen) {
+            /* limits changed by the user are applied to all members of the
+             * group, so the first member carries the configured values */
+            if (group->baseIops != iotune->total_iops_sec ||
+                group->baseBytes != iotune->total_bytes_sec) {
+                group->baseIops = iotune->total_iops_sec;
+                group->baseBytes = iotune->total_bytes_sec;
+                group->iops = group->baseIops;
+                group->bytes = group->baseBytes;
+            }
+            group->seen = true;
+        }
+
+        if (!(total = virHashLookup(counters, key))) {
+            total = g_new0(qemuBlockStats, 1);
+            if (virHashAddEntry(counters, key, total) < 0) {
+                g_free(total);
+                virResetLastError();
+                continue;
+            }
+        }
+
+        total->rd_req += stats->rd_req + stats->wr_req;
+        total->rd_bytes += stats->rd_bytes + stats->wr_bytes;
+    }
+
+    for (i = 0; i < vm->def->ndisks; i++) {
+        virDomainBlockIoTuneInfo *iotune = &vm->def->disks[i]->blkdeviotune;
+        qemuIOTuneBalancerGroup *group;
+        qemuBlockStats *total;
+        g_autofree char *key = NULL;
+
+        if (!iotune->group_name)
+            continue;
+
+        key = g_strdup_printf("%s:%s", uuidstr, iotune->group_name);
+
+        /* each group is accounted once */
+        if (!(total = virHashSteal(counters, key)) ||
+            !(group = virHashLookup(bal->groups, key))) {
+            g_free(total);
+            continue;
+        }
+
+        qemuIOTuneBalancerGroupSample(group, total->rd_req, total->rd_bytes, now);
+        g_free(total);
+    }
+}
+
+
+/**
+ * qemuIOTuneBalancerAllocate:
+ * @groups: throttle groups sampled in the current pass
+ * @ngroups: number of elements of @groups
+ * @total: host-wide cap
+ * @bytes: allocate the bytes limits rather than the IOPS limits
+ *
+ * Each group gets its configured limit. What's left of @total is split
+ * between the groups demanding more than their configured limit, in
+ * proportion of the additional demand if there isn't enough for all of them.
+ */
+void
+qemuIOTuneBalancerAllocate(qemuIOTuneBalancerGroup **groups,
+                           size_t ngroups,
+                           unsigned long long total,
+                           bool bytes)
+{
+    unsigned long long reserved = 0;
+    unsigned long long extra = 0;
+    unsigned long long spare;
+    size_t i;
+
+    for (i = 0; i < ngroups; i++) {
+        unsigned long long base = bytes ? groups[i]->baseBytes : groups[i]->baseIops;
+        unsigned long long want = bytes ? groups[i]->wantBytes : groups[i]->wantIops;
+
+        reserved += base;
+        if (base && want > base)
+            extra += want - base;
+    }
+
+    spare = total > reserved ? total - reserved : 0;
+
+    for (i = 0; i < ngroups; i++) {
+        unsigned long long base = bytes ? groups[i]->baseBytes : groups[i]->baseIops;
+        unsigned long long want = bytes ? groups[i]->wantBytes : groups[i]->wantIops;
+        unsigned long long limit = base;
+
+        if (base && want > base && spare > 0) {
+            if (extra <= spare)
+                limit += want - base;
+            else
+                limit += (unsigned long long) ((double) (want - base) * spare / extra);
+        }
+
+        if (bytes)
+            groups[i]->wantBytes = limit;
+        else
+            groups[i]->wantIops = limit;
+    }
+}
+
+
+/**
+ * qemuIOTuneBalancerApplyDomain:
+ * @driver: qemu driver
+ * @bal: throttle group balancer
+ * @vm: locked domain object
+ *
+ * Sets the limits allocated to the throttle groups of @vm in qemu. The limits
+ * of the domain definition are kept as configured by the user.
+ */
+static void
+qemuIOTuneBalancerApplyDomain(virQEMUDriver *driver,
+                              qemuIOTuneBalancer *bal,
+                              virDomainObj *vm)
+{
+    qemuDomainObjPrivate *priv = vm->privateData;
+    bool blockdev = virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_BLOCKDEV);
+    g_autoptr(GHashTable) applied = virHashNew(NULL);
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
+    bool job = false;
+    size_t i;
+
+    virUUIDFormat(vm->def->uuid, uuidstr);
+
+    for (i = 0; i < vm->def->ndisks; i++) {
+        virDomainDiskDef *disk = vm->def->disks[i];
+        qemuIOTuneBalancerGroup *group;
+        virDomainBlockIoTuneInfo info = { 0 };
+        g_autofree char *key = NULL;
+        g_autofree char *drivealias = NULL;
+        const char *qdevid = NULL;
+        int rc;
+
+        if (!disk->blkdeviotune.group_name ||
+            virStorageSourceIsEmpty(disk->src))
+            continue;
+
+        key = g_strdup_printf("%s:%s", uuidstr, disk->blkdeviotune.group_name);
+
+        if (virHashHasEntry(applied, key) ||
+            !(group = virHashLookup(bal->groups, key)) ||
+            !group->seen ||
+            (group->wantIops == group->iops && group->wantBytes == group->bytes))
+            continue;
+
+        ignore_value(virHashAddEntry(applied, key, group));
+
+        if (!job) {
+            if (qemuDomainObjBeginJobNowait(driver, vm, VIR_JOB_MODIFY) < 0) {
+                virResetLastError();
+                return;
+            }
+            job = true;
+        }
+
+        if (!virDomainObjIsActive(vm))
+            break;
+
+        if (blockdev && QEMU_DOMAIN_DISK_PRIVATE(disk)->qomName) {
+            qdevid = QEMU_DOMAIN_DISK_PRIVATE(disk)->qomName;
+        } else {
+            if (!(drivealias = qemuAliasDiskDriveFromDisk(disk))) {
+                virResetLastError();
+                continue;
+            }
+        }
+
+        virDomainBlockIoTuneInfoCopy(&disk->blkdeviotune, &info);
+
+        if (group->baseIops) {
+            info.total_iops_sec = group->wantIops;
+            if (info.total_iops_sec_max &&
+                info.total_iops_sec_max < info.total_iops_sec)
+                info.total_iops_sec_max = info.total_iops_sec;
+        }
+
+        if (group->baseBytes) {
+            info.total_bytes_sec = group->wantBytes;
+            if (info.total_bytes_sec_max &&
+                info.total_bytes_sec_max < info.total_bytes_sec)
+                info.total_bytes_sec_max = info.total_bytes_sec;
+        }
+
+        VIR_DEBUG("setting limits of throttle group '%s' of domain %s to "
+                  "%llu IOPS, %llu bytes/s", info.group_name, vm->def->name,
+                  info.total_iops_sec, info.total_bytes_sec);
+
+        qemuDomainObjEnterMonitor(driver, vm);
+        rc = qemuMonitorSetBlockIoThrottle(priv->mon, drivealias, qdevid, &info);
+        qemuDomainObjExitMonitor(vm);
+
+        if (rc < 0) {
+            VIR_WARN("Unable to set limits of throttle group '%s' of domain %s: %s",
+                     info.group_name, vm->def->name, virGetLastErrorMessage());
+            virResetLastError();
+            VIR_FREE(info.group_name);
+            continue;
+        }
+
+        VIR_FREE(info.group_name);
+
+        group->iops = group->wantIops;
+        group->bytes = group->wantBytes;
+    }
+
+    if (job)
+        qemuDomainObjEndJob(vm);
+}
+
+
+static int
+qemuIOTuneBalancerForget(const void *payload,
+                         const char *name G_GNUC_UNUSED,
+                         const void *opaque G_GNUC_UNUSED)
+{
+    const qemuIOTuneBalancerGroup *group = payload;
+
+    return !group->seen;
+}
+
+
+/**
+ * qemuIOTuneBalancerPass:
+ * @opaque: throttle group balancer
+ *
+ * Samples the demand of the throttle groups of all running domains and splits
+ * the host-wide caps between them.
+ */
+static void
+qemuIOTuneBalancerPass(void *opaque)
+{
+    qemuIOTuneBalancer *bal = opaque;
+    virQEMUDriver *driver = bal->driver;
+    g_autofree virHashKeyValuePair *items = NULL;
+    g_autofree qemuIOTuneBalancerGroup **groups = NULL;
+    virDomainObj **vms = NULL;
+    unsigned long long now;
+    size_t nvms;
+    size_t ngroups = 0;
+    size_t i;
+
+    if (virTimeMillisNow(&now) < 0 ||
+        virDomainObjListCollect(driver->domains, NULL, &vms, &nvms,
+                                NULL, VIR_CONNECT_LIST_DOMAINS_ACTIVE) < 0) {
+        virResetLastError();
+        return;
+    }
+
+    for (i = 0; i < nvms; i++) {
+        virObjectLock(vms[i]);
+        if (virDomainObjIsActive(vms[i]))
+            qemuIOTuneBalancerSampleDomain(driver, bal, vms[i], now);
+        virObjectUnlock(vms[i]);
+    }
+
+    /* groups of domains which are gone or were not sampled are dropped */
+    virHashRemoveSet(bal->groups, qemuIOTuneBalancerForget, NULL);
+
+    if ((items = virHashGetItems(bal->groups, &ngroups, false))) {
+        groups = g_new0(qemuIOTuneBalancerGroup *, ngroups);
+        for (i = 0; i < ngroups; i++)
+            groups[i] = (qemuIOTuneBalancerGroup *) items[i].value;
+
+        if (bal->totalIops)
+            qemuIOTuneBalancerAllocate(groups, ngroups, bal->totalIops, false);
+        else
+            for (i = 0; i < ngroups; i++)
+                groups[i]->wantIops = groups[i]->baseIops;
+
+        if (bal->totalBytes)
+            qemuIOTuneBalancerAllocate(groups, ngroups, bal->totalBytes, true);
+        else
+            for (i = 0; i < ngroups; i++)
+                groups[i]->wantBytes = groups[i]->baseBytes;
+    }
+
+    for (i = 0; i < nvms; i++) {
+        virObjectLock(vms[i]);
+        if (virDomainObjIsActive(vms[i]))
+            qemuIOTuneBalancerApplyDomain(driver, bal, vms[i]);
+        virObjectUnlock(vms[i]);
+    }
+
+    for (i = 0; i < ngroups; i++)
+        groups[i]->seen = false;
+
+    virObjectListFreeCount(vms, nvms);
+}
+
+
+void
+qemuIOTuneBalancerFree(qemuIOTuneBalancer *bal)
+{
+    if (!bal)
+        return;
+
+    /* stop the worker before freeing the state it uses */
+    qemuPeriodicFree(bal->worker);
+    g_clear_pointer(&bal->groups, g_hash_table_unref);
+    g_free(bal);
+}
+
+
+/**
+ * qemuIOTuneBalancerStart:
+ * @driver: qemu driver
+ * @cfg: driver configuration
+ *
+ * Starts the thread balancing the limits of throttle groups of all domains
+ * if any of the 'iotune_balancer_total_*' options is set.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+qemuIOTuneBalancerStart(virQEMUDriver *driver,
+                        virQEMUDriverConfig *cfg)
+{
+    qemuIOTuneBalancer *bal;
+
+    if (cfg->iotuneBalancerTotalIops == 0 &&
+        cfg->iotuneBalancerTotalBytes == 0)
+        return 0;
+
+    bal = g_new0(qemuIOTuneBalancer, 1);
+    bal->driver = driver;
+    bal->totalIops = cfg->iotuneBalancerTotalIops;
+    bal->totalBytes = cfg->iotuneBalancerTotalBytes;
+    bal->groups = virHashNew(g_free);
+
+    if (!(bal->worker = qemuPeriodicNew("qemu-iotune-bal",
+                                        _("throttle group balancer"),
+                                        QEMU_IOTUNE_BALANCER_INTERVAL,
+                                        qemuIOTuneBalancerPass, bal))) {
+        qemuIOTuneBalancerFree(bal);
+        return -1;
+    }
+
+    driver->iotuneBalancer = bal;
+
+    return 0;
+}
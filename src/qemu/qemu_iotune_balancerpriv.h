@@ -0,0 +1,63 @@
+/*
+ * qemu_iotune_balancerpriv.h: private declarations for the throttle group
+ *                             balancer
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBVIRT_QEMU_IOTUNE_BALANCERPRIV_H_ALLOW
+# error "qemu_iotune_balancerpriv.h may only be included by qemu_iotune_balancer.c or test suites"
+#endif /* LIBVIRT_QEMU_IOTUNE_BALANCERPRIV_H_ALLOW */
+
+#pragma once
+
+#include "qemu_iotune_balancer.h"
+
+typedef struct _qemuIOTuneBalancerGroup qemuIOTuneBalancerGroup;
+struct _qemuIOTuneBalancerGroup {
+    /* limits configured by the user, guaranteed to the group */
+    unsigned long long baseIops;
+    unsigned long long baseBytes;
+
+    /* limits currently set in qemu */
+    unsigned long long iops;
+    unsigned long long bytes;
+
+    /* counters of the member disks in the previous pass */
+    unsigned long long ops;
+    unsigned long long transferred;
+    unsigned long long sampled; /* time of the previous pass in ms */
+
+    /* demand observed in the current pass */
+    unsigned long long wantIops;
+    unsigned long long wantBytes;
+    bool seen;
+};
+
+unsigned long long
+qemuIOTuneBalancerDemand(unsigned long long rate,
+                         unsigned long long limit);
+
+void
+qemuIOTuneBalancerGroupSample(qemuIOTuneBalancerGroup *group,
+                              unsigned long long ops,
+                              unsigned long long transferred,
+                              unsigned long long now);
+
+void
+qemuIOTuneBalancerAllocate(qemuIOTuneBalancerGroup **groups,
+                           size_t ngroups,
+                           unsigned long long total,
+                           bool bytes);
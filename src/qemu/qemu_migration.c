@@ -26,6 +26,8 @@
 #include <poll.h>
 
 #include "qemu_migration.h"
+#define LIBVIRT_QEMU_MIGRATIONPRIV_H_ALLOW
+#include "qemu_migrationpriv.h"
 #include "qemu_migration_cookie.h"
 #include "qemu_migration_params.h"
 #include "qemu_monitor.h"
@@ -505,12 +507,12 @@ qemuMigrationDstStartNBDServer(virQEMUDriver *driver,
             goto cleanup;
 
         if (!server_started) {
-            if (qemuMonitorNBDServerStart(priv->mon, &server, tls_alias) < 0)
+            if (qemuMonitorNBDServerStart(priv->mon, &server, tls_alias, 0) < 0)
                 goto exit_monitor;
             server_started = true;
         }
 
-        if (qemuBlockExportAddNBD(vm, diskAlias, disk->src, diskAlias, true, NULL) < 0)
+        if (qemuBlockExportAddNBD(vm, diskAlias, disk->src, diskAlias, true, NULL, NULL) < 0)
             goto exit_monitor;
         qemuDomainObjExitMonitor(vm);
     }
@@ -1122,8 +1124,8 @@ qemuMigrationSrcNBDStorageCopy(virQEMUDriver *driver,
     size_t i;
     unsigned long long mirror_speed = speed;
     bool mirror_shallow = flags & VIR_MIGRATE_NON_SHARED_INC;
+    size_t ncopy = 0;
     int rv;
-    g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(driver);
     g_autoptr(virURI) uri = NULL;
     const char *socket = NULL;
 
@@ -1137,6 +1139,17 @@ qemuMigrationSrcNBDStorageCopy(virQEMUDriver *driver,
     }
     mirror_speed <<= 20;
 
+    /* All disks are mirrored concurrently, split the migration bandwidth
+     * among them so that the storage copy doesn't exceed it in total */
+    for (i = 0; i < vm->def->ndisks; i++) {
+        if (qemuMigrationAnyCopyDisk(vm->def->disks[i],
+                                     nmigrate_disks, migrate_disks))
+            ncopy++;
+    }
+
+    if (mirror_speed && ncopy > 1)
+        mirror_speed = MAX(mirror_speed / ncopy, 1);
+
     /* If qemu doesn't support overriding of TLS hostname for NBD connections
      * we won't attempt it */
     if (!virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_BLOCKDEV_NBD_TLS_HOSTNAME))
@@ -1193,7 +1206,7 @@ qemuMigrationSrcNBDStorageCopy(virQEMUDriver *driver,
                                               tlsAlias, tlsHostname, flags) < 0)
             return -1;
 
-        if (virDomainObjSave(vm, driver->xmlopt, cfg->stateDir) < 0) {
+        if (qemuDomainSaveStatusBarrier(vm) < 0) {
             VIR_WARN("Failed to save status on vm %s", vm->def->name);
             return -1;
         }
@@ -1876,6 +1889,168 @@ qemuMigrationAnyCompleted(virQEMUDriver *driver,
 }
 
 
+/* Number of passes over guest memory after which the expected downtime
+ * reported by QEMU is considered meaningful */
+#define QEMU_MIGRATION_CONVERGENCE_MIN_PASS 2
+/* Number of passes which must fail to converge with the downtime limit at
+ * its upper bound before switching to post-copy */
+#define QEMU_MIGRATION_CONVERGENCE_STALLED_PASSES 3
+
+
+static void
+qemuMigrationSrcConvergenceInit(virQEMUDriver *driver,
+                                virDomainObj *vm,
+                                virDomainAsyncJob asyncJob,
+                                qemuMigrationConvergence *conv)
+{
+    g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(driver);
+    qemuDomainObjPrivate *priv = vm->privateData;
+
+    memset(conv, 0, sizeof(*conv));
+
+    if (asyncJob != VIR_ASYNC_JOB_MIGRATION_OUT ||
+        cfg->migrationConvergenceMaxDowntime == 0 ||
+        !virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_MIGRATION_PARAM_DOWNTIME))
+        return;
+
+    conv->maxDowntime = cfg->migrationConvergenceMaxDowntime;
+    conv->postcopy = cfg->migrationConvergencePostcopy &&
+                     (priv->job.apiFlags & VIR_MIGRATE_POSTCOPY);
+}
+
+
+static int
+qemuMigrationSrcConvergenceSetDowntime(virQEMUDriver *driver,
+                                       virDomainObj *vm,
+                                       virDomainAsyncJob asyncJob,
+                                       unsigned long long downtime)
+{
+    g_autoptr(qemuMigrationParams) migParams = NULL;
+
+    if (!(migParams = qemuMigrationParamsNew()))
+        return -1;
+
+    if (qemuMigrationParamsSetULL(migParams,
+                                  QEMU_MIGRATION_PARAM_DOWNTIME_LIMIT,
+                                  downtime) < 0)
+        return -1;
+
+    return qemuMigrationParamsApply(driver, vm, asyncJob, migParams);
+}
+
+
+/**
+ * qemuMigrationConvergenceDecide:
+ * @conv: convergence controller state
+ * @stats: current migration statistics
+ * @downtime: filled with the new downtime limit
+ *
+ * Once per pass over guest memory compares the downtime QEMU expects for
+ * the final switchover with the current downtime limit and decides to
+ * raise the limit up to the configured bound if needed. When even the
+ * bound can't be met for several passes, decides to switch the migration
+ * to post-copy if the user allowed it. The state in @conv is updated as if
+ * the returned action succeeded.
+ *
+ * Returns the action to be taken.
+ */
+qemuMigrationConvergenceAction
+qemuMigrationConvergenceDecide(qemuMigrationConvergence *conv,
+                               const qemuMonitorMigrationStats *stats,
+                               unsigned long long *downtime)
+{
+    if (stats->status != QEMU_MONITOR_MIGRATION_STATUS_ACTIVE ||
+        stats->ram_iteration <= conv->pass)
+        return QEMU_MIGRATION_CONVERGENCE_NONE;
+
+    conv->pass = stats->ram_iteration;
+
+    if (conv->pass < QEMU_MIGRATION_CONVERGENCE_MIN_PASS ||
+        !stats->downtime_set)
+        return QEMU_MIGRATION_CONVERGENCE_NONE;
+
+    VIR_DEBUG("Migration pass %llu: expected downtime %llums, limit %llums, "
+              "dirty rate %llu pages/s",
+              conv->pass, stats->downtime, conv->downtime,
+              stats->ram_dirty_rate);
+
+    if (stats->downtime <= conv->downtime) {
+        conv->stalled = 0;
+        return QEMU_MIGRATION_CONVERGENCE_NONE;
+    }
+
+    if (conv->downtime < conv->maxDowntime) {
+        *downtime = MIN(stats->downtime, conv->maxDowntime);
+        conv->downtime = *downtime;
+        return QEMU_MIGRATION_CONVERGENCE_SET_DOWNTIME;
+    }
+
+    if (!conv->postcopy ||
+        ++conv->stalled < QEMU_MIGRATION_CONVERGENCE_STALLED_PASSES)
+        return QEMU_MIGRATION_CONVERGENCE_NONE;
+
+    /* The controller has nothing left to do */
+    conv->maxDowntime = 0;
+    return QEMU_MIGRATION_CONVERGENCE_POSTCOPY;
+}
+
+
+/*
+ * Called whenever the migration job is woken up to apply the decision of
+ * qemuMigrationConvergenceDecide.
+ *
+ * Returns 0 on success, -1 if the controller failed and should be disabled.
+ */
+static int
+qemuMigrationSrcConvergenceStep(virQEMUDriver *driver,
+                                virDomainObj *vm,
+                                virDomainAsyncJob asyncJob,
+                                qemuMigrationConvergence *conv)
+{
+    qemuDomainObjPrivate *priv = vm->privateData;
+    qemuMonitorMigrationStats stats = { 0 };
+    unsigned long long downtime = 0;
+    int rc;
+
+    if (conv->downtime == 0) {
+        g_autoptr(qemuMigrationParams) migParams = NULL;
+
+        if (qemuMigrationParamsFetch(driver, vm, asyncJob, &migParams) < 0 ||
+            qemuMigrationParamsGetULL(migParams,
+                                      QEMU_MIGRATION_PARAM_DOWNTIME_LIMIT,
+                                      &conv->downtime) != 0)
+            return -1;
+    }
+
+    if (qemuDomainObjEnterMonitorAsync(driver, vm, asyncJob) < 0)
+        return -1;
+    rc = qemuMonitorGetMigrationStats(priv->mon, &stats, NULL);
+    qemuDomainObjExitMonitor(vm);
+    if (rc < 0)
+        return -1;
+
+    switch (qemuMigrationConvergenceDecide(conv, &stats, &downtime)) {
+    case QEMU_MIGRATION_CONVERGENCE_NONE:
+        break;
+
+    case QEMU_MIGRATION_CONVERGENCE_SET_DOWNTIME:
+        VIR_DEBUG("Raising migration downtime limit to %llums", downtime);
+        return qemuMigrationSrcConvergenceSetDowntime(driver, vm, asyncJob,
+                                                      downtime);
+
+    case QEMU_MIGRATION_CONVERGENCE_POSTCOPY:
+        VIR_DEBUG("Migration does not converge, starting post-copy");
+        if (qemuDomainObjEnterMonitorAsync(driver, vm, asyncJob) < 0)
+            return -1;
+        rc = qemuMonitorMigrateStartPostCopy(priv->mon);
+        qemuDomainObjExitMonitor(vm);
+        return rc;
+    }
+
+    return 0;
+}
+
+
 /* Returns 0 on success, -2 when migration needs to be cancelled, or -1 when
  * QEMU reports failed migration.
  */
@@ -1888,15 +2063,26 @@ qemuMigrationSrcWaitForCompletion(virQEMUDriver *driver,
 {
     qemuDomainObjPrivate *priv = vm->privateData;
     virDomainJobData *jobData = priv->job.current;
+    qemuMigrationConvergence conv;
     int rv;
 
     jobData->status = VIR_DOMAIN_JOB_STATUS_MIGRATING;
 
+    qemuMigrationSrcConvergenceInit(driver, vm, asyncJob, &conv);
+
     while ((rv = qemuMigrationAnyCompleted(driver, vm, asyncJob,
                                            dconn, flags)) != 1) {
         if (rv < 0)
             return rv;
 
+        if (conv.maxDowntime &&
+            qemuMigrationSrcConvergenceStep(driver, vm, asyncJob, &conv) < 0) {
+            VIR_WARN("Migration convergence controller failed on domain %s: %s",
+                     vm->def->name, virGetLastErrorMessage());
+            virResetLastError();
+            conv.maxDowntime = 0;
+        }
+
         if (virDomainObjWait(vm) < 0) {
             if (virDomainObjIsActive(vm))
                 jobData->status = VIR_DOMAIN_JOB_STATUS_FAILED;
@@ -2356,6 +2542,12 @@ qemuMigrationSrcBeginPhase(virQEMUDriver *driver,
         return NULL;
     }
 
+    if (flags & VIR_MIGRATE_ZEROCOPY && !(flags & VIR_MIGRATE_PARALLEL)) {
+        virReportError(VIR_ERR_ARGUMENT_UNSUPPORTED, "%s",
+                       _("zero-copy is only available for parallel migration"));
+        return NULL;
+    }
+
     if (flags & (VIR_MIGRATE_NON_SHARED_DISK | VIR_MIGRATE_NON_SHARED_INC)) {
         if (flags & VIR_MIGRATE_NON_SHARED_SYNCHRONOUS_WRITES &&
             !virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_BLOCKDEV)) {
@@ -2701,18 +2893,11 @@ qemuMigrationDstPrepareAnyBlockDirtyBitmaps(virDomainObj *vm,
 
         for (nextbitmap = disk->bitmaps; nextbitmap; nextbitmap = nextbitmap->next) {
             qemuMigrationBlockDirtyBitmapsDiskBitmap *bitmap = nextbitmap->data;
-            size_t k;
 
             /* don't migrate into existing bitmaps */
-            for (k = 0; k < nodedata->nbitmaps; k++) {
-                if (STREQ(bitmap->bitmapname, nodedata->bitmaps[k]->name)) {
-                    bitmap->skip = true;
-                    break;
-                }
-            }
-
-            if (bitmap->skip)
-                continue;
+            if (nodedata->bitmapsByName &&
+                g_hash_table_contains(nodedata->bitmapsByName, bitmap->bitmapname))
+                bitmap->skip = true;
         }
     }
 
@@ -3032,7 +3217,8 @@ qemuMigrationDstPrepareAny(virQEMUDriver *driver,
         goto stopjob;
 
  done:
-    if (qemuMigrationCookieFormat(mig, driver, vm,
+    if (qemuMigrationCookieAddPersistentHash(mig, driver, vm) < 0 ||
+        qemuMigrationCookieFormat(mig, driver, vm,
                                   QEMU_MIGRATION_DESTINATION,
                                   cookieout, cookieoutlen, cookieFlags) < 0) {
         /* We could tear down the whole guest here, but
@@ -3548,7 +3734,11 @@ struct _qemuMigrationSpec {
     } fwd;
 };
 
-#define TUNNEL_SEND_BUF_SIZE 65536
+/* Each chunk read from QEMU is sent as a single stream message. Use the
+ * largest payload every daemon version accepts (the legacy limit of
+ * VIR_NET_MESSAGE_LEGACY_PAYLOAD_MAX), so that the IO thread spends as
+ * little time as possible on per message overhead. */
+#define TUNNEL_SEND_BUF_SIZE 262120
 
 typedef struct _qemuMigrationIOThread qemuMigrationIOThread;
 struct _qemuMigrationIOThread {
@@ -4119,6 +4309,21 @@ qemuMigrationSrcRun(virQEMUDriver *driver,
                                  migParams) < 0)
         goto error;
 
+    if (flags & VIR_MIGRATE_ZEROCOPY) {
+        /* Zero-copy requires pages in transfer to be locked in host memory.
+         * Unfortunately, we have no reliable way of computing how many pages
+         * will need to be locked at the same time. Thus we set the limit to
+         * the whole guest memory and reset it back once migration is done. */
+        unsigned long long limit;
+
+        if (virMemoryLimitIsSet(vm->def->mem.hard_limit))
+            limit = vm->def->mem.hard_limit;
+        else
+            limit = virDomainDefGetMemoryTotal(vm->def);
+
+        if (qemuDomainSetMaxMemLock(vm, limit << 10, &priv->preMigrationMemlock) < 0)
+            goto error;
+    }
 
     if (storageMigration) {
         if (mig->nbd) {
@@ -5642,6 +5847,9 @@ qemuMigrationDstFinish(virQEMUDriver *driver,
                                          cookiein, cookieinlen, cookie_flags)))
         goto endjob;
 
+    if (qemuMigrationCookieResolvePersistent(mig, driver, vm) < 0)
+        goto endjob;
+
     if (flags & VIR_MIGRATE_OFFLINE) {
         if (retcode == 0 &&
             qemuMigrationDstPersist(driver, vm, mig, false) == 0)
@@ -6241,12 +6449,13 @@ qemuMigrationSrcFetchMirrorStats(virQEMUDriver *driver,
     if (!blockinfo)
         return -1;
 
-    memset(stats, 0, sizeof(*stats));
+    qemuDomainMirrorStatsClear(stats);
 
     for (i = 0; i < vm->def->ndisks; i++) {
         virDomainDiskDef *disk = vm->def->disks[i];
         qemuDomainDiskPrivate *diskPriv = QEMU_DOMAIN_DISK_PRIVATE(disk);
         qemuMonitorBlockJobInfo *data;
+        qemuDomainMirrorDiskStats diskStats;
 
         if (!diskPriv->migrating ||
             !(data = virHashLookup(blockinfo, disk->info.alias)))
@@ -6254,6 +6463,11 @@ qemuMigrationSrcFetchMirrorStats(virQEMUDriver *driver,
 
         stats->transferred += data->cur;
         stats->total += data->end;
+
+        diskStats.disk = g_strdup(disk->dst);
+        diskStats.transferred = data->cur;
+        diskStats.total = data->end;
+        VIR_APPEND_ELEMENT(stats->disks, stats->ndisks, diskStats);
     }
 
     return 0;
@@ -158,6 +158,8 @@ qemuMigrationCookieFree(qemuMigrationCookie *mig)
 
     qemuMigrationCookieGraphicsFree(mig->graphics);
     virDomainDefFree(mig->persistent);
+    g_free(mig->localPersistentHash);
+    g_free(mig->remotePersistentHash);
     qemuMigrationCookieNetworkFree(mig->network);
     qemuMigrationCookieNBDFree(mig->nbd);
 
@@ -451,6 +453,103 @@ qemuMigrationCookieGetPersistent(qemuMigrationCookie *mig)
 }
 
 
+static char *
+qemuMigrationCookiePersistentHash(virQEMUDriver *driver,
+                                  virQEMUCaps *qemuCaps,
+                                  virDomainDef *def)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+
+    if (qemuDomainDefFormatBuf(driver, qemuCaps, def,
+                               VIR_DOMAIN_XML_INACTIVE |
+                               VIR_DOMAIN_XML_SECURE |
+                               VIR_DOMAIN_XML_MIGRATABLE,
+                               &buf) < 0)
+        return NULL;
+
+    return g_compute_checksum_for_string(G_CHECKSUM_SHA256,
+                                         virBufferCurrentContent(&buf), -1);
+}
+
+
+/**
+ * qemuMigrationCookieAddPersistentHash:
+ * @mig: migration cookie
+ * @driver: qemu driver
+ * @vm: domain object
+ *
+ * Advertises the hash of the persistent definition of @vm, if any, so that
+ * the source can refer to it instead of sending an identical definition
+ * back in the cookie.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+qemuMigrationCookieAddPersistentHash(qemuMigrationCookie *mig,
+                                     virQEMUDriver *driver,
+                                     virDomainObj *vm)
+{
+    qemuDomainObjPrivate *priv = vm->privateData;
+
+    if (!vm->persistent || !vm->newDef)
+        return 0;
+
+    g_free(mig->localPersistentHash);
+    if (!(mig->localPersistentHash = qemuMigrationCookiePersistentHash(driver,
+                                                                       priv->qemuCaps,
+                                                                       vm->newDef)))
+        return -1;
+
+    return 0;
+}
+
+
+/**
+ * qemuMigrationCookieResolvePersistent:
+ * @mig: migration cookie
+ * @driver: qemu driver
+ * @vm: domain object
+ *
+ * If the peer referred to the persistent definition of @vm by its hash
+ * rather than sending it, fills in the persistent definition of @mig with
+ * a copy of the local one.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+qemuMigrationCookieResolvePersistent(qemuMigrationCookie *mig,
+                                     virQEMUDriver *driver,
+                                     virDomainObj *vm)
+{
+    qemuDomainObjPrivate *priv = vm->privateData;
+    g_autofree char *hash = NULL;
+
+    if (mig->persistent || !mig->remotePersistentHash)
+        return 0;
+
+    if (vm->persistent && vm->newDef &&
+        !(hash = qemuMigrationCookiePersistentHash(driver, priv->qemuCaps,
+                                                   vm->newDef)))
+        return -1;
+
+    if (STRNEQ_NULLABLE(hash, mig->remotePersistentHash)) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("persistent domain definition referenced by migration "
+                         "cookie does not match the local one"));
+        return -1;
+    }
+
+    if (!(mig->persistent = qemuDomainDefCopy(driver, priv->qemuCaps,
+                                              vm->newDef,
+                                              VIR_DOMAIN_XML_SECURE |
+                                              VIR_DOMAIN_XML_MIGRATABLE)))
+        return -1;
+
+    mig->flags |= QEMU_MIGRATION_COOKIE_PERSISTENT;
+    return 0;
+}
+
+
 static int
 qemuMigrationCookieAddNetwork(qemuMigrationCookie *mig,
                               virQEMUDriver *driver,
@@ -877,14 +976,28 @@ qemuMigrationCookieXMLFormat(virQEMUDriver *driver,
 
     if ((mig->flags & QEMU_MIGRATION_COOKIE_PERSISTENT) &&
         mig->persistent) {
-        if (qemuDomainDefFormatBuf(driver,
-                                   qemuCaps,
-                                   mig->persistent,
-                                   VIR_DOMAIN_XML_INACTIVE |
-                                   VIR_DOMAIN_XML_SECURE |
-                                   VIR_DOMAIN_XML_MIGRATABLE,
-                                   buf) < 0)
+        g_autofree char *hash = NULL;
+
+        if (mig->remotePersistentHash &&
+            !(hash = qemuMigrationCookiePersistentHash(driver, qemuCaps,
+                                                       mig->persistent)))
+            return -1;
+
+        /* the destination already has an identical definition */
+        if (hash && STREQ(hash, mig->remotePersistentHash)) {
+            virBufferAsprintf(buf, "<persistent-ref hash='%s'/>\n", hash);
+        } else if (qemuDomainDefFormatBuf(driver,
+                                          qemuCaps,
+                                          mig->persistent,
+                                          VIR_DOMAIN_XML_INACTIVE |
+                                          VIR_DOMAIN_XML_SECURE |
+                                          VIR_DOMAIN_XML_MIGRATABLE,
+                                          buf) < 0) {
             return -1;
+        }
+    } else if (mig->localPersistentHash) {
+        virBufferAsprintf(buf, "<persistent-ref hash='%s'/>\n",
+                          mig->localPersistentHash);
     }
 
     if ((mig->flags & QEMU_MIGRATION_COOKIE_NETWORK) && mig->network)
@@ -1383,6 +1496,10 @@ qemuMigrationCookieXMLParse(qemuMigrationCookie *mig,
             return -1;
     }
 
+    if (!mig->persistent)
+        mig->remotePersistentHash = virXPathString("string(./persistent-ref[1]/@hash)",
+                                                   ctxt);
+
     if ((flags & QEMU_MIGRATION_COOKIE_NETWORK) &&
         virXPathBoolean("count(./network) > 0", ctxt) &&
         (!(mig->network = qemuMigrationCookieNetworkXMLParse(ctxt))))
@@ -155,6 +155,12 @@ struct _qemuMigrationCookie {
     /* If (flags & QEMU_MIGRATION_COOKIE_PERSISTENT) */
     virDomainDef *persistent;
 
+    /* SHA-256 of the persistent definition the local host has for the
+     * domain, sent to let the peer refer to it instead of sending it */
+    char *localPersistentHash;
+    /* SHA-256 of the persistent definition as referenced by the peer */
+    char *remotePersistentHash;
+
     /* If (flags & QEMU_MIGRATION_COOKIE_NETWORK) */
     qemuMigrationCookieNetwork *network;
 
@@ -208,6 +214,16 @@ qemuMigrationCookieAddPersistent(qemuMigrationCookie *mig,
 virDomainDef *
 qemuMigrationCookieGetPersistent(qemuMigrationCookie *mig);
 
+int
+qemuMigrationCookieAddPersistentHash(qemuMigrationCookie *mig,
+                                     virQEMUDriver *driver,
+                                     virDomainObj *vm);
+
+int
+qemuMigrationCookieResolvePersistent(qemuMigrationCookie *mig,
+                                     virQEMUDriver *driver,
+                                     virDomainObj *vm);
+
 /* qemuMigrationCookieXMLFormat is exported for test use only! */
 int
 qemuMigrationCookieXMLFormat(virQEMUDriver *driver,
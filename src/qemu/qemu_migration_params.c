@@ -96,6 +96,7 @@ VIR_ENUM_IMPL(qemuMigrationCapability,
               "multifd",
               "dirty-bitmaps",
               "return-path",
+              "zero-copy-send",
 );
 
 
@@ -177,6 +178,11 @@ static const qemuMigrationParamsFlagMapItem qemuMigrationParamsFlagMap[] = {
      VIR_MIGRATE_TUNNELLED,
      QEMU_MIGRATION_CAP_RETURN_PATH,
      QEMU_MIGRATION_SOURCE | QEMU_MIGRATION_DESTINATION},
+
+    {QEMU_MIGRATION_FLAG_REQUIRED,
+     VIR_MIGRATE_ZEROCOPY,
+     QEMU_MIGRATION_CAP_ZERO_COPY_SEND,
+     QEMU_MIGRATION_SOURCE},
 };
 
 /* Translation from VIR_MIGRATE_PARAM_* typed parameters to
@@ -1248,6 +1254,9 @@ qemuMigrationParamsReset(virQEMUDriver *driver,
     /* We don't reset 'block-bitmap-mapping' as it can't be unset */
 
  cleanup:
+    if (virDomainObjIsActive(vm))
+        qemuDomainSetMaxMemLock(vm, 0, &QEMU_DOMAIN_PRIVATE(vm)->preMigrationMemlock);
+
     virErrorRestore(&err);
 }
 
@@ -0,0 +1,50 @@
+/*
+ * qemu_migrationpriv.h: private declarations for QEMU migration handling
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef LIBVIRT_QEMU_MIGRATIONPRIV_H_ALLOW
+# error "qemu_migrationpriv.h may only be included by qemu_migration.c or test suites"
+#endif /* LIBVIRT_QEMU_MIGRATIONPRIV_H_ALLOW */
+
+#pragma once
+
+#include "qemu_monitor.h"
+
+/*
+ * This header file should never be used outside unit tests.
+ */
+
+typedef struct _qemuMigrationConvergence qemuMigrationConvergence;
+struct _qemuMigrationConvergence {
+    unsigned long long maxDowntime; /* ms, 0 if the controller is disabled */
+    bool postcopy;
+    unsigned long long pass; /* last pass handled by the controller */
+    unsigned long long downtime; /* current downtime limit, 0 if unknown */
+    unsigned int stalled;
+};
+
+typedef enum {
+    QEMU_MIGRATION_CONVERGENCE_NONE = 0,
+    QEMU_MIGRATION_CONVERGENCE_SET_DOWNTIME, /* raise the downtime limit */
+    QEMU_MIGRATION_CONVERGENCE_POSTCOPY, /* switch to post-copy */
+} qemuMigrationConvergenceAction;
+
+qemuMigrationConvergenceAction
+qemuMigrationConvergenceDecide(qemuMigrationConvergence *conv,
+                               const qemuMonitorMigrationStats *stats,
+                               unsigned long long *downtime);
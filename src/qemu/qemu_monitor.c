@@ -203,6 +203,7 @@ qemuMonitorDispose(void *obj)
     virResetError(&mon->lastError);
     virCondDestroy(&mon->notify);
     g_free(mon->buffer);
+    virJSONStreamParserFree(mon->parser);
     g_free(mon->balloonpath);
     g_free(mon->domainName);
 }
@@ -300,9 +301,6 @@ qemuMonitorIOProcess(qemuMonitor *mon)
     if (len < 0)
         return -1;
 
-    if (len && mon->waitGreeting)
-        mon->waitGreeting = false;
-
     if (len < mon->bufferOffset) {
         memmove(mon->buffer, mon->buffer + len, mon->bufferOffset - len);
         mon->bufferOffset -= len;
@@ -2788,25 +2786,25 @@ qemuMonitorCreateObjectProps(virJSONValue **propsret,
 
 
 /**
- * qemuMonitorAddObject:
+ * qemuMonitorAddObjectWrapProps:
  * @mon: Pointer to monitor object
  * @props: Pointer to a JSON object holding configuration of the object to add.
- *         The object must be non-null and contain at least the "qom-type" and
- *         "id" field. The object is consumed and the pointer is cleared.
- * @alias: If not NULL, returns the alias of the added object if it was added
- *         successfully to qemu. Caller should free the returned pointer.
+ * @pr: filled with the arguments of the 'object-add' command
+ * @alias: filled with a copy of the "id" of the object
+ *
+ * Validates @props and converts them into the argument format of 'object-add'
+ * supported by the qemu process. @props is consumed.
  *
  * Returns 0 on success -1 on error.
  */
-int
-qemuMonitorAddObject(qemuMonitor *mon,
-                     virJSONValue **props,
-                     char **alias)
+static int
+qemuMonitorAddObjectWrapProps(qemuMonitor *mon,
+                              virJSONValue **props,
+                              virJSONValue **pr,
+                              char **alias)
 {
-    g_autoptr(virJSONValue) pr = NULL;
     const char *type = NULL;
     const char *id = NULL;
-    g_autofree char *aliasCopy = NULL;
 
     if (!*props) {
         virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
@@ -2819,8 +2817,6 @@ qemuMonitorAddObject(qemuMonitor *mon,
 
     VIR_DEBUG("type=%s id=%s", NULLSTR(type), NULLSTR(id));
 
-    QEMU_CHECK_MONITOR(mon);
-
     if (!id || !type) {
         virReportError(VIR_ERR_INTERNAL_ERROR,
                        _("missing alias or qom-type for qemu object '%s'"),
@@ -2828,11 +2824,10 @@ qemuMonitorAddObject(qemuMonitor *mon,
         return -1;
     }
 
-    if (alias)
-        aliasCopy = g_strdup(id);
+    *alias = g_strdup(id);
 
     if (mon->objectAddNoWrap) {
-        pr = g_steal_pointer(props);
+        *pr = g_steal_pointer(props);
     } else {
         /* we need to create a wrapper which has the 'qom-type' and 'id' and
          * store everything else under a 'props' sub-object */
@@ -2846,7 +2841,7 @@ qemuMonitorAddObject(qemuMonitor *mon,
         if (!virJSONValueObjectGetKey(*props, 0))
             g_clear_pointer(props, virJSONValueFree);
 
-        if (virJSONValueObjectAdd(&pr,
+        if (virJSONValueObjectAdd(pr,
                                   "s:qom-type", type,
                                   "s:id", id,
                                   "A:props", props,
@@ -2854,6 +2849,34 @@ qemuMonitorAddObject(qemuMonitor *mon,
             return -1;
     }
 
+    return 0;
+}
+
+
+/**
+ * qemuMonitorAddObject:
+ * @mon: Pointer to monitor object
+ * @props: Pointer to a JSON object holding configuration of the object to add.
+ *         The object must be non-null and contain at least the "qom-type" and
+ *         "id" field. The object is consumed and the pointer is cleared.
+ * @alias: If not NULL, returns the alias of the added object if it was added
+ *         successfully to qemu. Caller should free the returned pointer.
+ *
+ * Returns 0 on success -1 on error.
+ */
+int
+qemuMonitorAddObject(qemuMonitor *mon,
+                     virJSONValue **props,
+                     char **alias)
+{
+    g_autoptr(virJSONValue) pr = NULL;
+    g_autofree char *aliasCopy = NULL;
+
+    QEMU_CHECK_MONITOR(mon);
+
+    if (qemuMonitorAddObjectWrapProps(mon, props, &pr, &aliasCopy) < 0)
+        return -1;
+
     if (qemuMonitorJSONAddObject(mon, &pr) < 0)
         return -1;
 
@@ -3647,19 +3670,21 @@ qemuMonitorGetSEVCapabilities(qemuMonitor *mon,
 int
 qemuMonitorNBDServerStart(qemuMonitor *mon,
                           const virStorageNetHostDef *server,
-                          const char *tls_alias)
+                          const char *tls_alias,
+                          unsigned int maxConnections)
 {
     /* Peek inside the struct for nicer logging */
     if (server->transport == VIR_STORAGE_NET_HOST_TRANS_TCP)
-        VIR_DEBUG("server={tcp host=%s port=%u} tls_alias=%s",
-                  NULLSTR(server->name), server->port, NULLSTR(tls_alias));
+        VIR_DEBUG("server={tcp host=%s port=%u} tls_alias=%s maxConnections=%u",
+                  NULLSTR(server->name), server->port, NULLSTR(tls_alias),
+                  maxConnections);
     else
-        VIR_DEBUG("server={unix socket=%s} tls_alias=%s",
-                  NULLSTR(server->socket), NULLSTR(tls_alias));
+        VIR_DEBUG("server={unix socket=%s} tls_alias=%s maxConnections=%u",
+                  NULLSTR(server->socket), NULLSTR(tls_alias), maxConnections);
 
     QEMU_CHECK_MONITOR(mon);
 
-    return qemuMonitorJSONNBDServerStart(mon, server, tls_alias);
+    return qemuMonitorJSONNBDServerStart(mon, server, tls_alias, maxConnections);
 }
 
 
@@ -4174,6 +4199,67 @@ qemuMonitorBlockdevAdd(qemuMonitor *mon,
 }
 
 
+
+/**
+ * qemuMonitorBlockdevAddBatch:
+ * @mon: monitor object
+ * @entries: objects and block nodes to add
+ * @nentries: number of elements of @entries
+ *
+ * Adds the objects and block nodes described by @entries to qemu in order.
+ * All 'object-add' and 'blockdev-add' commands are pipelined so that adding
+ * a whole backing chain costs a single round trip to the monitor. All props
+ * of @entries are consumed.
+ *
+ * qemu executes all the commands even if one of them fails, thus the caller
+ * must roll back all entries which were reported as added via their
+ * 'objalias' or 'added' fields if -1 is returned. The error of the first
+ * command which failed is reported.
+ */
+int
+qemuMonitorBlockdevAddBatch(qemuMonitor *mon,
+                            qemuMonitorBlockdevAddBatchEntry *entries,
+                            size_t nentries)
+{
+    g_autoptr(virJSONValue) cmdargs = virJSONValueNewArray();
+    g_autofree char **aliases = NULL;
+    int ret = -1;
+    size_t i;
+
+    VIR_DEBUG("nentries=%zu", nentries);
+
+    QEMU_CHECK_MONITOR(mon);
+
+    if (nentries == 0)
+        return 0;
+
+    /* not a NULL terminated list, entries of block nodes have no alias */
+    aliases = g_new0(char *, nentries);
+
+    for (i = 0; i < nentries; i++) {
+        g_autoptr(virJSONValue) pr = NULL;
+
+        if (entries[i].objalias) {
+            if (qemuMonitorAddObjectWrapProps(mon, entries[i].props,
+                                              &pr, &aliases[i]) < 0)
+                goto cleanup;
+        } else {
+            pr = g_steal_pointer(entries[i].props);
+        }
+
+        if (virJSONValueArrayAppend(cmdargs, &pr) < 0)
+            goto cleanup;
+    }
+
+    ret = qemuMonitorJSONBlockdevAddBatch(mon, entries, cmdargs, aliases);
+
+ cleanup:
+    for (i = 0; i < nentries; i++)
+        g_free(aliases[i]);
+
+    return ret;
+}
+
 int
 qemuMonitorBlockdevReopen(qemuMonitor *mon,
                           virJSONValue **props)
@@ -4520,3 +4606,88 @@ qemuMonitorChangeMemoryRequestedSize(qemuMonitor *mon,
 
     return qemuMonitorJSONChangeMemoryRequestedSize(mon, alias, requestedsize);
 }
+
+
+VIR_ENUM_IMPL(qemuMonitorQueryStatsTarget,
+              QEMU_MONITOR_QUERY_STATS_TARGET_LAST,
+              "vm",
+              "vcpu",
+);
+
+
+VIR_ENUM_IMPL(qemuMonitorQueryStatsProvider,
+              QEMU_MONITOR_QUERY_STATS_PROVIDER_LAST,
+              "kvm",
+);
+
+
+/**
+ * qemuMonitorQueryStats:
+ * @mon: monitor object
+ * @target: the type of object to query statistics of
+ * @vcpus: NULL-terminated list of vCPU QOM paths, or NULL for all vCPUs
+ * @provider: the statistics provider to query
+ * @names: NULL-terminated list of statistics to return, or NULL for all
+ *
+ * Issues 'query-stats' restricted to @provider and, when given, to the
+ * statistics listed in @names, so that QEMU only gathers and formats the
+ * counters the caller is interested in. @vcpus is only meaningful for the
+ * 'vcpu' @target.
+ *
+ * Returns the 'return' array of the reply or NULL on error.
+ */
+virJSONValue *
+qemuMonitorQueryStats(qemuMonitor *mon,
+                      qemuMonitorQueryStatsTargetType target,
+                      char **vcpus,
+                      qemuMonitorQueryStatsProviderType provider,
+                      const char **names)
+{
+    VIR_DEBUG("target=%u vcpus=%p provider=%u names=%p",
+              target, vcpus, provider, names);
+
+    QEMU_CHECK_MONITOR_NULL(mon);
+
+    return qemuMonitorJSONQueryStats(mon, target, vcpus, provider, names);
+}
+
+
+/**
+ * qemuMonitorExtractQueryStats:
+ * @info: one element of the array returned by qemuMonitorQueryStats
+ *
+ * Returns a hash table mapping the names of the statistics contained in
+ * @info to their JSON values. The values are borrowed from @info, which
+ * thus must outlive the returned table. Returns NULL on error.
+ */
+GHashTable *
+qemuMonitorExtractQueryStats(virJSONValue *info)
+{
+    g_autoptr(GHashTable) hash_table = virHashNew(NULL);
+    virJSONValue *stats;
+    size_t i;
+
+    if (!(stats = virJSONValueObjectGetArray(info, "stats"))) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("query-stats reply was missing 'stats' data"));
+        return NULL;
+    }
+
+    for (i = 0; i < virJSONValueArraySize(stats); i++) {
+        virJSONValue *stat = virJSONValueArrayGet(stats, i);
+        virJSONValue *value;
+        const char *name;
+
+        if (!(name = virJSONValueObjectGetString(stat, "name")) ||
+            !(value = virJSONValueObjectGet(stat, "value"))) {
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("malformed statistic in query-stats reply"));
+            return NULL;
+        }
+
+        if (virHashAddEntry(hash_table, name, value) < 0)
+            return NULL;
+    }
+
+    return g_steal_pointer(&hash_table);
+}
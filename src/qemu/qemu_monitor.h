@@ -722,6 +722,9 @@ struct _qemuBlockNamedNodeData {
 
     qemuBlockNamedNodeDataBitmap **bitmaps;
     size_t nbitmaps;
+    /* @bitmaps indexed by name, as nodes can carry hundreds of checkpoint
+     * bitmaps; NULL if the node has no bitmaps */
+    GHashTable *bitmapsByName;
 
     /* the cluster size of the image is valid only when > 0 */
     unsigned long long clusterSize;
@@ -1243,7 +1246,8 @@ char *qemuMonitorGetTargetArch(qemuMonitor *mon);
 
 int qemuMonitorNBDServerStart(qemuMonitor *mon,
                               const virStorageNetHostDef *server,
-                              const char *tls_alias)
+                              const char *tls_alias,
+                              unsigned int maxConnections)
     ATTRIBUTE_NONNULL(2);
 int qemuMonitorNBDServerAdd(qemuMonitor *mon,
                             const char *deviceID,
@@ -1362,6 +1366,19 @@ int qemuMonitorBlockdevCreate(qemuMonitor *mon,
 int qemuMonitorBlockdevAdd(qemuMonitor *mon,
                            virJSONValue **props);
 
+typedef struct _qemuMonitorBlockdevAddBatchEntry qemuMonitorBlockdevAddBatchEntry;
+struct _qemuMonitorBlockdevAddBatchEntry {
+    virJSONValue **props; /* consumed */
+    char **objalias; /* if non-NULL, @props describe an object added via
+                        'object-add' and this is filled with its alias once
+                        it was added, otherwise 'blockdev-add' is used */
+    bool *added; /* set to true once the block node was added */
+};
+
+int qemuMonitorBlockdevAddBatch(qemuMonitor *mon,
+                                qemuMonitorBlockdevAddBatchEntry *entries,
+                                size_t nentries);
+
 int qemuMonitorBlockdevReopen(qemuMonitor *mon,
                               virJSONValue **props);
 
@@ -1542,3 +1559,30 @@ int
 qemuMonitorChangeMemoryRequestedSize(qemuMonitor *mon,
                                      const char *alias,
                                      unsigned long long requestedsize);
+
+typedef enum {
+    QEMU_MONITOR_QUERY_STATS_TARGET_VM,
+    QEMU_MONITOR_QUERY_STATS_TARGET_VCPU,
+
+    QEMU_MONITOR_QUERY_STATS_TARGET_LAST,
+} qemuMonitorQueryStatsTargetType;
+
+VIR_ENUM_DECL(qemuMonitorQueryStatsTarget);
+
+typedef enum {
+    QEMU_MONITOR_QUERY_STATS_PROVIDER_KVM,
+
+    QEMU_MONITOR_QUERY_STATS_PROVIDER_LAST,
+} qemuMonitorQueryStatsProviderType;
+
+VIR_ENUM_DECL(qemuMonitorQueryStatsProvider);
+
+virJSONValue *
+qemuMonitorQueryStats(qemuMonitor *mon,
+                      qemuMonitorQueryStatsTargetType target,
+                      char **vcpus,
+                      qemuMonitorQueryStatsProviderType provider,
+                      const char **names);
+
+GHashTable *
+qemuMonitorExtractQueryStats(virJSONValue *info);
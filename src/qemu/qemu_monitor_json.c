@@ -53,6 +53,9 @@ VIR_LOG_INIT("qemu.qemu_monitor_json");
 
 #define LINE_ENDING "\r\n"
 
+/* Same limit as the monitor applies to its receive buffer */
+#define QEMU_MONITOR_JSON_MAX_MESSAGE (10 * 1024 * 1024)
+
 static void qemuMonitorJSONHandleShutdown(qemuMonitor *mon, virJSONValue *data);
 static void qemuMonitorJSONHandleReset(qemuMonitor *mon, virJSONValue *data);
 static void qemuMonitorJSONHandleStop(qemuMonitor *mon, virJSONValue *data);
@@ -189,36 +192,73 @@ qemuMonitorJSONIOProcessEvent(qemuMonitor *mon,
     return 0;
 }
 
-int
-qemuMonitorJSONIOProcessLine(qemuMonitor *mon,
-                             const char *line,
-                             qemuMonitorMessage *msg)
+/* Store a reply to one of the commands of a pipelined batch. QEMU echoes
+ * the 'id' of the command in the reply, but replies to commands which could
+ * not even be parsed lack it. As in-band commands are processed in order,
+ * such a reply belongs to the first command still waiting for one. */
+static int
+qemuMonitorJSONIOProcessBatchReply(qemuMonitorMessage *msg,
+                                   virJSONValue **obj,
+                                   const char *line)
 {
-    g_autoptr(virJSONValue) obj = NULL;
+    const char *id = virJSONValueObjectGetString(*obj, "id");
+    size_t i;
 
-    VIR_DEBUG("Line [%s]", line);
+    for (i = 0; i < msg->nids; i++) {
+        if (id ? STREQ(msg->ids[i], id) : !msg->rxObjects[i])
+            break;
+    }
 
-    if (!(obj = virJSONValueFromString(line)))
+    if (i == msg->nids || msg->rxObjects[i]) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Unexpected JSON reply '%s'"), line);
         return -1;
+    }
+
+    msg->rxObjects[i] = g_steal_pointer(obj);
 
-    if (virJSONValueGetType(obj) != VIR_JSON_TYPE_OBJECT) {
+    if (++msg->nreplies == msg->nids)
+        msg->finished = true;
+
+    return 0;
+}
+
+/**
+ * qemuMonitorJSONIOProcessObject:
+ * @mon: monitor object
+ * @obj: parsed message received from QEMU
+ * @line: text of the message, used for logging and error reporting
+ * @msg: message waiting for a reply, if any
+ *
+ * Dispatches an event or a reply received from QEMU. If @obj is a reply
+ * which was stored in @msg, *@obj is stolen.
+ */
+int
+qemuMonitorJSONIOProcessObject(qemuMonitor *mon,
+                               virJSONValue **obj,
+                               const char *line,
+                               qemuMonitorMessage *msg)
+{
+    if (virJSONValueGetType(*obj) != VIR_JSON_TYPE_OBJECT) {
         virReportError(VIR_ERR_INTERNAL_ERROR,
                        _("Parsed JSON reply '%s' isn't an object"), line);
         return -1;
     }
 
-    if (virJSONValueObjectHasKey(obj, "QMP") == 1) {
+    if (virJSONValueObjectHasKey(*obj, "QMP") == 1) {
         return 0;
-    } else if (virJSONValueObjectHasKey(obj, "event") == 1) {
+    } else if (virJSONValueObjectHasKey(*obj, "event") == 1) {
         PROBE(QEMU_MONITOR_RECV_EVENT,
               "mon=%p event=%s", mon, line);
-        return qemuMonitorJSONIOProcessEvent(mon, obj);
-    } else if (virJSONValueObjectHasKey(obj, "error") == 1 ||
-               virJSONValueObjectHasKey(obj, "return") == 1) {
+        return qemuMonitorJSONIOProcessEvent(mon, *obj);
+    } else if (virJSONValueObjectHasKey(*obj, "error") == 1 ||
+               virJSONValueObjectHasKey(*obj, "return") == 1) {
         PROBE(QEMU_MONITOR_RECV_REPLY,
               "mon=%p reply=%s", mon, line);
-        if (msg) {
-            msg->rxObject = g_steal_pointer(&obj);
+        if (msg && msg->nids > 0) {
+            return qemuMonitorJSONIOProcessBatchReply(msg, obj, line);
+        } else if (msg) {
+            msg->rxObject = g_steal_pointer(obj);
             msg->finished = 1;
             return 0;
         } else {
@@ -233,28 +273,98 @@ qemuMonitorJSONIOProcessLine(qemuMonitor *mon,
     return -1;
 }
 
+int
+qemuMonitorJSONIOProcessLine(qemuMonitor *mon,
+                             const char *line,
+                             qemuMonitorMessage *msg)
+{
+    g_autoptr(virJSONValue) obj = NULL;
+
+    VIR_DEBUG("Line [%s]", line);
+
+    if (!(obj = virJSONValueFromString(line)))
+        return -1;
+
+    return qemuMonitorJSONIOProcessObject(mon, &obj, line, msg);
+}
+
+
+/* Feed a piece of a message which didn't arrive in one go to the stream
+ * parser, so that the monitor buffer doesn't have to hold all of it. */
+static int
+qemuMonitorJSONIOProcessPartial(qemuMonitor *mon,
+                                const char *data,
+                                size_t len)
+{
+    if (len == 0)
+        return 0;
+
+    if (!mon->parser &&
+        !(mon->parser = virJSONStreamParserNew()))
+        return -1;
+
+    mon->parserLength += len;
+    if (mon->parserLength > QEMU_MONITOR_JSON_MAX_MESSAGE) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("QEMU monitor reply exceeds buffer size (%d bytes)"),
+                       QEMU_MONITOR_JSON_MAX_MESSAGE);
+        return -1;
+    }
+
+    return virJSONStreamParserFeed(mon->parser, data, len);
+}
+
+
 int qemuMonitorJSONIOProcess(qemuMonitor *mon,
                              const char *data,
                              size_t len,
                              qemuMonitorMessage *msg)
 {
-    int used = 0;
+    size_t used = 0;
     /*VIR_DEBUG("Data %d bytes [%s]", len, data);*/
 
     while (used < len) {
         char *nl = strstr(data + used, LINE_ENDING);
+        size_t got;
+
+        if (!nl) {
+            /* Hold back a trailing '\r' as it may be the start of the line
+             * ending and hand the rest to the parser right away. */
+            got = len - used;
+            if (data[len - 1] == '\r')
+                got--;
 
-        if (nl) {
-            int got = nl - (data + used);
+            if (qemuMonitorJSONIOProcessPartial(mon, data + used, got) < 0)
+                return -1;
+
+            used += got;
+            break;
+        }
+
+        got = nl - (data + used);
+
+        if (mon->parserLength > 0) {
+            g_autoptr(virJSONValue) obj = NULL;
+
+            if (qemuMonitorJSONIOProcessPartial(mon, data + used, got) < 0)
+                return -1;
+
+            VIR_DEBUG("Streamed line of %zu bytes", mon->parserLength);
+            mon->parserLength = 0;
+            used += got + strlen(LINE_ENDING);
+
+            if (!(obj = virJSONStreamParserFinish(mon->parser)) ||
+                qemuMonitorJSONIOProcessObject(mon, &obj, "<streamed>", msg) < 0)
+                return -1;
+        } else {
             g_autofree char *line = g_strndup(data + used, got);
 
             used += got + strlen(LINE_ENDING);
-            line[got] = '\0'; /* kill \n */
             if (qemuMonitorJSONIOProcessLine(mon, line, msg) < 0)
                 return -1;
-        } else {
-            break;
         }
+
+        mon->waitGreeting = false;
     }
 
     return used;
@@ -316,6 +426,80 @@ qemuMonitorJSONCommand(qemuMonitor *mon,
     return qemuMonitorJSONCommandWithFd(mon, cmd, -1, reply);
 }
 
+
+/**
+ * qemuMonitorJSONCommandBatch:
+ * @mon: monitor object
+ * @cmds: commands to execute
+ * @ncmds: number of commands in @cmds
+ * @replies: filled with the replies to @cmds, must have @ncmds elements
+ *
+ * Sends all of @cmds to QEMU in a single write without waiting for replies
+ * in between and collects their replies, which are matched to the commands
+ * by their 'id'. This saves a round trip per command for callers which need
+ * the results of several independent queries. The replies still need to be
+ * checked for errors individually.
+ *
+ * Returns 0 on success, -1 if the commands could not be sent or a reply is
+ * missing. In the error case @replies are not touched.
+ */
+static int
+qemuMonitorJSONCommandBatch(qemuMonitor *mon,
+                            virJSONValue **cmds,
+                            size_t ncmds,
+                            virJSONValue **replies)
+{
+    qemuMonitorMessage msg;
+    g_auto(virBuffer) cmdbuf = VIR_BUFFER_INITIALIZER;
+    g_auto(GStrv) ids = g_new0(char *, ncmds + 1);
+    g_autofree virJSONValue **rxObjects = g_new0(virJSONValue *, ncmds);
+    int ret = -1;
+    size_t i;
+
+    memset(&msg, 0, sizeof(msg));
+
+    for (i = 0; i < ncmds; i++) {
+        ids[i] = qemuMonitorNextCommandID(mon);
+
+        if (virJSONValueObjectAppendString(cmds[i], "id", ids[i]) < 0) {
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("Unable to append command 'id' string"));
+            return -1;
+        }
+
+        if (virJSONValueToBuffer(cmds[i], &cmdbuf, false) < 0)
+            return -1;
+        virBufferAddLit(&cmdbuf, "\r\n");
+    }
+
+    msg.txLength = virBufferUse(&cmdbuf);
+    msg.txBuffer = virBufferCurrentContent(&cmdbuf);
+    msg.txFD = -1;
+    msg.ids = ids;
+    msg.rxObjects = rxObjects;
+    msg.nids = ncmds;
+
+    if (qemuMonitorSend(mon, &msg) < 0)
+        goto cleanup;
+
+    if (msg.nreplies != ncmds) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("Missing monitor reply object"));
+        goto cleanup;
+    }
+
+    for (i = 0; i < ncmds; i++)
+        replies[i] = g_steal_pointer(&rxObjects[i]);
+
+    ret = 0;
+
+ cleanup:
+    for (i = 0; i < ncmds; i++)
+        virJSONValueFree(rxObjects[i]);
+
+    return ret;
+}
+
 /* Ignoring OOM in this method, since we're already reporting
  * a more important error
  *
@@ -2473,12 +2657,40 @@ qemuMonitorJSONGetAllBlockStatsInfo(qemuMonitor *mon,
     int nstats = 0;
     int rc;
     size_t i;
+    g_autoptr(virJSONValue) cmdDevices = NULL;
+    g_autoptr(virJSONValue) cmdNodes = NULL;
+    virJSONValue *cmds[2];
+    virJSONValue *replies[2];
+    g_autoptr(virJSONValue) replyDevices = NULL;
+    g_autoptr(virJSONValue) replyNodes = NULL;
     g_autoptr(virJSONValue) blockstatsDevices = NULL;
     g_autoptr(virJSONValue) blockstatsNodes = NULL;
 
-    if (!(blockstatsDevices = qemuMonitorJSONQueryBlockstats(mon, false)))
+    /* both queries are independent so issue them in one go */
+    if (!(cmdDevices = qemuMonitorJSONMakeCommand("query-blockstats",
+                                                  "B:query-nodes", false,
+                                                  NULL)) ||
+        !(cmdNodes = qemuMonitorJSONMakeCommand("query-blockstats",
+                                                "B:query-nodes", true,
+                                                NULL)))
         return -1;
 
+    cmds[0] = cmdDevices;
+    cmds[1] = cmdNodes;
+
+    if (qemuMonitorJSONCommandBatch(mon, cmds, G_N_ELEMENTS(cmds), replies) < 0)
+        return -1;
+
+    replyDevices = replies[0];
+    replyNodes = replies[1];
+
+    if (qemuMonitorJSONCheckReply(cmdDevices, replyDevices, VIR_JSON_TYPE_ARRAY) < 0 ||
+        qemuMonitorJSONCheckReply(cmdNodes, replyNodes, VIR_JSON_TYPE_ARRAY) < 0)
+        return -1;
+
+    blockstatsDevices = virJSONValueObjectStealArray(replyDevices, "return");
+    blockstatsNodes = virJSONValueObjectStealArray(replyNodes, "return");
+
     for (i = 0; i < virJSONValueArraySize(blockstatsDevices); i++) {
         virJSONValue *dev = virJSONValueArrayGet(blockstatsDevices, i);
         const char *dev_name;
@@ -2504,9 +2716,6 @@ qemuMonitorJSONGetAllBlockStatsInfo(qemuMonitor *mon,
             nstats = rc;
     }
 
-    if (!(blockstatsNodes = qemuMonitorJSONQueryBlockstats(mon, true)))
-        return -1;
-
     for (i = 0; i < virJSONValueArraySize(blockstatsNodes); i++) {
         virJSONValue *dev = virJSONValueArrayGet(blockstatsNodes, i);
 
@@ -2688,6 +2897,7 @@ qemuMonitorJSONBlockNamedNodeDataFree(qemuBlockNamedNodeData *data)
     if (!data)
         return;
 
+    g_clear_pointer(&data->bitmapsByName, g_hash_table_unref);
     for (i = 0; i < data->nbitmaps; i++)
         qemuMonitorJSONBlockNamedNodeDataBitmapFree(data->bitmaps[i]);
     g_free(data->bitmaps);
@@ -2728,6 +2938,8 @@ qemuMonitorJSONBlockGetNamedNodeDataBitmaps(virJSONValue *bitmaps,
     size_t i;
 
     data->bitmaps = g_new0(qemuBlockNamedNodeDataBitmap *, nbitmaps);
+    /* keys are borrowed from the bitmap objects freed along with @data */
+    data->bitmapsByName = g_hash_table_new(g_str_hash, g_str_equal);
 
     for (i = 0; i < nbitmaps; i++) {
         virJSONValue *bitmap = virJSONValueArrayGet(bitmaps, i);
@@ -2740,6 +2952,7 @@ qemuMonitorJSONBlockGetNamedNodeDataBitmaps(virJSONValue *bitmaps,
             continue;
 
         data->bitmaps[data->nbitmaps++] = tmp;
+        g_hash_table_insert(data->bitmapsByName, tmp->name, tmp);
     }
 }
 
@@ -6492,7 +6705,8 @@ qemuMonitorJSONBuildFDSocketAddress(const char *fdname)
 int
 qemuMonitorJSONNBDServerStart(qemuMonitor *mon,
                               const virStorageNetHostDef *server,
-                              const char *tls_alias)
+                              const char *tls_alias,
+                              unsigned int maxConnections)
 {
     g_autoptr(virJSONValue) cmd = NULL;
     g_autoptr(virJSONValue) reply = NULL;
@@ -6519,6 +6733,7 @@ qemuMonitorJSONNBDServerStart(qemuMonitor *mon,
     if (!(cmd = qemuMonitorJSONMakeCommand("nbd-server-start",
                                            "a:addr", &addr,
                                            "S:tls-creds", tls_alias,
+                                           "p:max-connections", maxConnections,
                                            NULL)))
         return -1;
 
@@ -8072,6 +8287,59 @@ qemuMonitorJSONBlockdevAdd(qemuMonitor *mon,
 }
 
 
+
+int
+qemuMonitorJSONBlockdevAddBatch(qemuMonitor *mon,
+                                qemuMonitorBlockdevAddBatchEntry *entries,
+                                virJSONValue *args,
+                                char **aliases)
+{
+    size_t nentries = virJSONValueArraySize(args);
+    g_autoptr(virJSONValue) cmdlist = virJSONValueNewArray();
+    g_autofree virJSONValue **cmds = g_new0(virJSONValue *, nentries);
+    g_autofree virJSONValue **replies = g_new0(virJSONValue *, nentries);
+    int ret = 0;
+    size_t i;
+
+    for (i = 0; i < nentries; i++) {
+        g_autoptr(virJSONValue) props = virJSONValueArraySteal(args, 0);
+        g_autoptr(virJSONValue) cmd = NULL;
+        const char *cmdname = "blockdev-add";
+
+        if (entries[i].objalias)
+            cmdname = "object-add";
+
+        if (!(cmd = qemuMonitorJSONMakeCommandInternal(cmdname, &props)))
+            return -1;
+
+        cmds[i] = cmd;
+
+        if (virJSONValueArrayAppend(cmdlist, &cmd) < 0)
+            return -1;
+    }
+
+    if (qemuMonitorJSONCommandBatch(mon, cmds, nentries, replies) < 0)
+        return -1;
+
+    for (i = 0; i < nentries; i++) {
+        g_autoptr(virJSONValue) reply = replies[i];
+
+        /* commands depending on a failed one fail too, report just the
+         * original error */
+        if (qemuMonitorJSONCheckErrorFull(cmds[i], reply, ret == 0) < 0) {
+            ret = -1;
+            continue;
+        }
+
+        if (entries[i].objalias)
+            *entries[i].objalias = g_steal_pointer(&aliases[i]);
+        else if (entries[i].added)
+            *entries[i].added = true;
+    }
+
+    return ret;
+}
+
 int
 qemuMonitorJSONBlockdevReopen(qemuMonitor *mon,
                               virJSONValue **props)
@@ -8973,3 +9241,62 @@ qemuMonitorJSONChangeMemoryRequestedSize(qemuMonitor *mon,
 
     return qemuMonitorJSONSetObjectProperty(mon, path, "requested-size", &prop);
 }
+
+
+virJSONValue *
+qemuMonitorJSONQueryStats(qemuMonitor *mon,
+                          qemuMonitorQueryStatsTargetType target,
+                          char **vcpus,
+                          qemuMonitorQueryStatsProviderType provider,
+                          const char **names)
+{
+    g_autoptr(virJSONValue) cmd = NULL;
+    g_autoptr(virJSONValue) reply = NULL;
+    g_autoptr(virJSONValue) vcpu_list = NULL;
+    g_autoptr(virJSONValue) name_list = NULL;
+    g_autoptr(virJSONValue) provider_obj = NULL;
+    g_autoptr(virJSONValue) provider_list = virJSONValueNewArray();
+    size_t i;
+
+    if (vcpus) {
+        vcpu_list = virJSONValueNewArray();
+
+        for (i = 0; vcpus[i]; i++) {
+            if (virJSONValueArrayAppendString(vcpu_list, vcpus[i]) < 0)
+                return NULL;
+        }
+    }
+
+    if (names) {
+        name_list = virJSONValueNewArray();
+
+        for (i = 0; names[i]; i++) {
+            if (virJSONValueArrayAppendString(name_list, names[i]) < 0)
+                return NULL;
+        }
+    }
+
+    if (virJSONValueObjectAdd(&provider_obj,
+                              "s:provider", qemuMonitorQueryStatsProviderTypeToString(provider),
+                              "A:names", &name_list,
+                              NULL) < 0)
+        return NULL;
+
+    if (virJSONValueArrayAppend(provider_list, &provider_obj) < 0)
+        return NULL;
+
+    if (!(cmd = qemuMonitorJSONMakeCommand("query-stats",
+                                           "s:target", qemuMonitorQueryStatsTargetTypeToString(target),
+                                           "A:vcpus", &vcpu_list,
+                                           "a:providers", &provider_list,
+                                           NULL)))
+        return NULL;
+
+    if (qemuMonitorJSONCommand(mon, cmd, &reply) < 0)
+        return NULL;
+
+    if (qemuMonitorJSONCheckReply(cmd, reply, VIR_JSON_TYPE_ARRAY) < 0)
+        return NULL;
+
+    return virJSONValueObjectStealArray(reply, "return");
+}
@@ -28,6 +28,13 @@
 #include "cpu/cpu.h"
 #include "util/virgic.h"
 
+int
+qemuMonitorJSONIOProcessObject(qemuMonitor *mon,
+                               virJSONValue **obj,
+                               const char *line,
+                               qemuMonitorMessage *msg)
+    G_GNUC_NO_INLINE;
+
 int
 qemuMonitorJSONIOProcessLine(qemuMonitor *mon,
                              const char *line,
@@ -611,7 +618,8 @@ qemuMonitorJSONGetTargetArch(qemuMonitor *mon);
 int
 qemuMonitorJSONNBDServerStart(qemuMonitor *mon,
                               const virStorageNetHostDef *server,
-                              const char *tls_alias);
+                              const char *tls_alias,
+                              unsigned int maxConnections);
 int
 qemuMonitorJSONNBDServerAdd(qemuMonitor *mon,
                             const char *deviceID,
@@ -744,6 +752,13 @@ qemuMonitorJSONBlockdevAdd(qemuMonitor *mon,
                            virJSONValue **props)
     ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
 
+int
+qemuMonitorJSONBlockdevAddBatch(qemuMonitor *mon,
+                                qemuMonitorBlockdevAddBatchEntry *entries,
+                                virJSONValue *args,
+                                char **aliases)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(3) ATTRIBUTE_NONNULL(4);
+
 int
 qemuMonitorJSONBlockdevReopen(qemuMonitor *mon,
                               virJSONValue **props)
@@ -872,3 +887,10 @@ int
 qemuMonitorJSONChangeMemoryRequestedSize(qemuMonitor *mon,
                                          const char *alias,
                                          unsigned long long requestedsize);
+
+virJSONValue *
+qemuMonitorJSONQueryStats(qemuMonitor *mon,
+                          qemuMonitorQueryStatsTargetType target,
+                          char **vcpus,
+                          qemuMonitorQueryStatsProviderType provider,
+                          const char **names);
@@ -37,7 +37,16 @@ struct _qemuMonitorMessage {
     /* Used by the JSON monitor to hold reply / error */
     void *rxObject;
 
-    /* True if rxObject is ready, or a fatal error occurred on the monitor channel */
+    /* Set when txBuffer holds a batch of pipelined commands. Their replies
+     * are matched by the command 'id' and stored in rxObjects at the index
+     * of the corresponding entry in ids, rxObject is unused. */
+    char **ids;
+    virJSONValue **rxObjects;
+    size_t nids;
+    size_t nreplies;
+
+    /* True if rxObject (or all of rxObjects) is ready, or a fatal error
+     * occurred on the monitor channel */
     bool finished;
 };
 
@@ -68,6 +77,12 @@ struct _qemuMonitor {
     size_t bufferLength;
     char *buffer;
 
+    /* A reply or event which didn't arrive in one piece is fed to the
+     * parser as the data comes in and dropped from buffer right away.
+     * parserLength is the number of bytes of it fed so far. */
+    virJSONStreamParser *parser;
+    size_t parserLength;
+
     /* If anything went wrong, this will be fed back
      * the next monitor msg */
     virError lastError;
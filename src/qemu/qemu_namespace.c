@@ -1225,8 +1225,18 @@ qemuNamespacePrepareOneItem(qemuNamespaceMknodData *data,
         if (STRPREFIX(item.file, QEMU_DEVPREFIX)) {
             GStrv n;
             bool found = false;
+            size_t i;
 
-            for (n = devMountsPath; n && *n; n++) {
+            /* Several devices often share a node, e.g. /dev/vfio/vfio is
+             * listed for every VFIO hostdev. Create each one just once. */
+            for (i = 0; i < data->nitems; i++) {
+                if (STREQ(data->items[i].file, item.file)) {
+                    found = true;
+                    break;
+                }
+            }
+
+            for (n = devMountsPath; !found && n && *n; n++) {
                 if (STREQ(*n, "/dev"))
                     continue;
                 if (STRPREFIX(item.file, *n)) {
@@ -1285,6 +1295,16 @@ qemuNamespaceMknodPaths(virDomainObj *vm,
             goto cleanup;
     }
 
+    /* Most hotplugged paths, e.g. disks backed by plain files, have no
+     * representation under /dev. Don't fork into the namespace just to
+     * find out there is nothing to do. */
+    if (data.nitems == 0) {
+        VIR_DEBUG("No paths to create in the namespace of domain %s",
+                  vm->def->name);
+        ret = 0;
+        goto cleanup;
+    }
+
     for (i = 0; i < data.nitems; i++) {
         qemuNamespaceMknodItem *item = &data.items[i];
         if (item->target &&
@@ -0,0 +1,150 @@
+/*
+ * qemu_periodic.c: QEMU driver threads running a task periodically
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "qemu_periodic.h"
+
+#include "viralloc.h"
+#include "virerror.h"
+#include "virthread.h"
+#include "virtime.h"
+
+#define VIR_FROM_THIS VIR_FROM_QEMU
+
+struct _qemuPeriodic {
+    virMutex lock;
+    virCond cond;
+    virThread thread;
+    bool running;
+    bool quit;
+
+    unsigned long long interval; /* in milliseconds */
+    qemuPeriodicFunc func;
+    void *opaque;
+};
+
+
+static void
+qemuPeriodicThread(void *opaque)
+{
+    qemuPeriodic *periodic = opaque;
+    unsigned long long next = 0;
+
+    virMutexLock(&periodic->lock);
+
+    while (!periodic->quit) {
+        unsigned long long now;
+
+        ignore_value(virTimeMillisNow(&now));
+
+        if (now >= next) {
+            virMutexUnlock(&periodic->lock);
+            periodic->func(periodic->opaque);
+            virMutexLock(&periodic->lock);
+
+            next = now + periodic->interval;
+            continue;
+        }
+
+        ignore_value(virCondWaitUntil(&periodic->cond, &periodic->lock, next));
+    }
+
+    virMutexUnlock(&periodic->lock);
+}
+
+
+/**
+ * qemuPeriodicNew:
+ * @name: name of the thread
+ * @desc: description of the task used in error messages
+ * @interval: time in milliseconds between the starts of two runs of @func
+ * @func: the task
+ * @opaque: data passed to @func
+ *
+ * Starts a thread calling @func right away and then every @interval
+ * milliseconds until the returned object is freed. A run which takes longer
+ * than @interval is followed by the next one immediately.
+ *
+ * Returns the new object on success, NULL on error.
+ */
+qemuPeriodic *
+qemuPeriodicNew(const char *name,
+                const char *desc,
+                unsigned long long interval,
+                qemuPeriodicFunc func,
+                void *opaque)
+{
+    qemuPeriodic *periodic = g_new0(qemuPeriodic, 1);
+
+    periodic->interval = interval;
+    periodic->func = func;
+    periodic->opaque = opaque;
+
+    if (virMutexInit(&periodic->lock) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("cannot initialize %s mutex"), desc);
+        g_free(periodic);
+        return NULL;
+    }
+
+    if (virCondInit(&periodic->cond) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("cannot initialize %s condition"), desc);
+        virMutexDestroy(&periodic->lock);
+        g_free(periodic);
+        return NULL;
+    }
+
+    if (virThreadCreateFull(&periodic->thread, true, qemuPeriodicThread,
+                            name, false, periodic) < 0) {
+        virReportSystemError(errno, _("Unable to create %s thread"), desc);
+        qemuPeriodicFree(periodic);
+        return NULL;
+    }
+    periodic->running = true;
+
+    return periodic;
+}
+
+
+/**
+ * qemuPeriodicFree:
+ * @periodic: periodic task
+ *
+ * Stops the thread of @periodic, waiting for a run in progress to finish, and
+ * frees @periodic.
+ */
+void
+qemuPeriodicFree(qemuPeriodic *periodic)
+{
+    if (!periodic)
+        return;
+
+    if (periodic->running) {
+        VIR_WITH_MUTEX_LOCK_GUARD(&periodic->lock) {
+            periodic->quit = true;
+            virCondSignal(&periodic->cond);
+        }
+        virThreadJoin(&periodic->thread);
+    }
+
+    virCondDestroy(&periodic->cond);
+    virMutexDestroy(&periodic->lock);
+    g_free(periodic);
+}
@@ -52,6 +52,7 @@
 #include "qemu_command.h"
 #include "qemu_hostdev.h"
 #include "qemu_hotplug.h"
+#include "qemu_iothread_poll_tuner.h"
 #include "qemu_migration.h"
 #include "qemu_migration_params.h"
 #include "qemu_interface.h"
@@ -59,6 +60,7 @@
 #include "qemu_extdevice.h"
 #include "qemu_firmware.h"
 #include "qemu_backup.h"
+#include "qemu_balloon_autosizer.h"
 #include "qemu_dbus.h"
 #include "qemu_snapshot.h"
 
@@ -87,6 +89,7 @@
 #include "virnuma.h"
 #include "virstring.h"
 #include "virhostdev.h"
+#include "virprobe.h"
 #include "virsecret.h"
 #include "configmake.h"
 #include "nwfilter_conf.h"
@@ -102,6 +105,10 @@
 #include "logging/log_manager.h"
 #include "logging/log_protocol.h"
 
+#ifdef WITH_DTRACE_PROBES
+# include "libvirt_qemu_probes.h"
+#endif
+
 #define VIR_FROM_THIS VIR_FROM_QEMU
 
 VIR_LOG_INIT("qemu.qemu_process");
@@ -121,9 +128,12 @@ qemuProcessRemoveDomainStatus(virQEMUDriver *driver,
 
     file = g_strdup_printf("%s/%s.xml", cfg->stateDir, vm->def->name);
 
+    /* wait for a status write-back which may be in progress */
+    g_mutex_lock(&priv->statusLock);
     if (unlink(file) < 0 && errno != ENOENT && errno != ENOTDIR)
         VIR_WARN("Failed to remove domain XML for %s: %s",
                  vm->def->name, g_strerror(errno));
+    g_mutex_unlock(&priv->statusLock);
 
     if (priv->pidfile &&
         unlink(priv->pidfile) < 0 &&
@@ -296,6 +306,70 @@ qemuProcessEventSubmit(virDomainObj *vm,
 }
 
 
+static void
+qemuProcessDirtyRateTimer(int timer G_GNUC_UNUSED,
+                          void *opaque)
+{
+    virDomainObj *vm = opaque;
+
+    qemuProcessEventSubmit(vm, QEMU_PROCESS_EVENT_DIRTYRATE_SAMPLE, 0, 0, NULL);
+}
+
+
+/**
+ * qemuProcessStartDirtyRateSampling:
+ * @vm: domain object
+ * @seconds: duration of each calculation
+ * @mode: calculation mode
+ *
+ * Makes the event handling thread collect the result of the dirty rate
+ * calculation of @vm and start a new one every @seconds + 1 seconds, until
+ * qemuProcessStopDirtyRateSampling is called or the domain stops. The
+ * caller is expected to start the first calculation.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+qemuProcessStartDirtyRateSampling(virDomainObj *vm,
+                                  int seconds,
+                                  qemuMonitorDirtyRateCalcMode mode)
+{
+    qemuDomainObjPrivate *priv = vm->privateData;
+    int timer;
+
+    qemuProcessStopDirtyRateSampling(vm);
+
+    if ((timer = virEventAddTimeout((seconds + 1) * 1000,
+                                    qemuProcessDirtyRateTimer,
+                                    virObjectRef(vm),
+                                    virObjectFreeCallback)) < 0) {
+        virObjectUnref(vm);
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("unable to add dirty rate calculation timer"));
+        return -1;
+    }
+
+    priv->dirtyRateTimer = timer;
+    priv->dirtyRatePeriod = seconds;
+    priv->dirtyRateMode = mode;
+
+    return 0;
+}
+
+
+void
+qemuProcessStopDirtyRateSampling(virDomainObj *vm)
+{
+    qemuDomainObjPrivate *priv = vm->privateData;
+
+    if (priv->dirtyRateTimer == 0)
+        return;
+
+    virEventRemoveTimeout(priv->dirtyRateTimer);
+    priv->dirtyRateTimer = 0;
+}
+
+
 /*
  * This is a callback registered with a qemuMonitor *instance,
  * and to be invoked when the monitor console hits an end of file
@@ -1393,6 +1467,10 @@ qemuProcessHandleBlockThreshold(qemuMonitor *mon G_GNUC_UNUSED,
             eventSource = virDomainEventBlockThresholdNewFromObj(vm, dev, path,
                                                                  threshold, excess);
         }
+
+        if (src == disk->src && disk->autoextend)
+            qemuProcessEventSubmit(vm, QEMU_PROCESS_EVENT_BLOCK_THRESHOLD,
+                                   0, 0, g_strdup(nodename));
     }
 
     virObjectUnlock(vm);
@@ -1535,6 +1613,9 @@ qemuProcessHandleMigrationPass(qemuMonitor *mon G_GNUC_UNUSED,
     virObjectEventStateQueue(priv->driver->domainEventState,
                          virDomainEventMigrationIterationNewFromObj(vm, pass));
 
+    /* Wake up the migration job so that it can react to the new pass */
+    virDomainObjBroadcast(vm);
+
  cleanup:
     virObjectUnlock(vm);
 }
@@ -2978,7 +3059,6 @@ qemuProcessUpdateVideoRamSize(virQEMUDriver *driver,
     ssize_t i;
     qemuDomainObjPrivate *priv = vm->privateData;
     virDomainVideoDef *video = NULL;
-    g_autoptr(virQEMUDriverConfig) cfg = NULL;
 
     if (qemuDomainObjEnterMonitorAsync(driver, vm, asyncJob) < 0)
         return -1;
@@ -3034,8 +3114,7 @@ qemuProcessUpdateVideoRamSize(virQEMUDriver *driver,
 
     qemuDomainObjExitMonitor(vm);
 
-    cfg = virQEMUDriverGetConfig(driver);
-    ret = virDomainObjSave(vm, driver->xmlopt, cfg->stateDir);
+    ret = qemuDomainSaveStatusBarrier(vm);
 
     return ret;
 
@@ -5502,6 +5581,34 @@ qemuProcessPrepareQEMUCaps(virDomainObj *vm,
 }
 
 
+/**
+ * qemuProcessStartPhaseEnd:
+ * @vm: domain object
+ * @phase: the phase of the start which ended
+ *
+ * Records the time spent in @phase since the end of the previous phase, which
+ * is reported by the "start" group of domain stats.
+ */
+static void
+qemuProcessStartPhaseEnd(virDomainObj *vm,
+                         qemuDomainStartPhase phase)
+{
+    qemuDomainObjPrivate *priv = vm->privateData;
+    unsigned long long now = g_get_monotonic_time();
+
+    if (priv->startPhaseBegin == 0)
+        return;
+
+    priv->startPhases[phase] = now - priv->startPhaseBegin;
+    priv->startPhaseBegin = now;
+
+    PROBE(QEMU_PROCESS_START_PHASE,
+          "vm=%p name=%s phase=%s usec=%llu",
+          vm, vm->def->name, qemuDomainStartPhaseTypeToString(phase),
+          priv->startPhases[phase]);
+}
+
+
 /**
  * qemuProcessInit:
  *
@@ -5538,6 +5645,9 @@ qemuProcessInit(virQEMUDriver *driver,
         goto cleanup;
     }
 
+    memset(priv->startPhases, 0, sizeof(priv->startPhases));
+    priv->startBegin = priv->startPhaseBegin = g_get_monotonic_time();
+
     /* in case when the post parse callback failed we need to re-run it on the
      * old config prior we start the VM */
     if (vm->def->postParseFailed) {
@@ -5579,6 +5689,9 @@ qemuProcessInit(virQEMUDriver *driver,
         if (g_atomic_int_add(&driver->nactive, 1) == 0 && driver->inhibitCallback)
             driver->inhibitCallback(true, driver->inhibitOpaque);
 
+        qemuIOThreadPollTunerAddDomain(driver, vm);
+        qemuBalloonAutosizerAddDomain(driver, vm);
+
         /* Run an early hook to set-up missing devices */
         if (qemuProcessStartHook(driver, vm,
                                  VIR_HOOK_QEMU_OP_PREPARE,
@@ -5591,6 +5704,8 @@ qemuProcessInit(virQEMUDriver *driver,
         priv->origCPU = g_steal_pointer(&origCPU);
     }
 
+    qemuProcessStartPhaseEnd(vm, QEMU_DOMAIN_START_PHASE_INIT);
+
     ret = 0;
 
  cleanup:
@@ -6080,10 +6195,486 @@ qemuProcessUpdateGuestCPU(virDomainDef *def,
 }
 
 
+/*
+ * Remember the host CPUs the domain is placed on or pinned to, so that the
+ * built-in NUMA placement of domains started later can avoid them. Runtime
+ * changes of the pinning are not tracked.
+ */
+static void
+qemuProcessRegisterBusyCpus(virQEMUDriver *driver,
+                            virDomainObj *vm)
+{
+    qemuDomainObjPrivate *priv = vm->privateData;
+    g_autoptr(virBitmap) cpus = virBitmapNew(0);
+    size_t i;
+
+    if (priv->autoCpuset)
+        virBitmapUnion(cpus, priv->autoCpuset);
+    else if (vm->def->cpumask)
+        virBitmapUnion(cpus, vm->def->cpumask);
+
+    for (i = 0; i < virDomainDefGetVcpusMax(vm->def); i++) {
+        virDomainVcpuDef *vcpu = virDomainDefGetVcpu(vm->def, i);
+
+        if (vcpu->online && vcpu->cpumask)
+            virBitmapUnion(cpus, vcpu->cpumask);
+    }
+
+    if (virBitmapIsAllClear(cpus))
+        return;
+
+    VIR_WITH_MUTEX_LOCK_GUARD(&driver->lock) {
+        ignore_value(virHashUpdateEntry(driver->busyCpus, vm->def->name,
+                                        g_steal_pointer(&cpus)));
+    }
+}
+
+
+static void
+qemuProcessUnregisterBusyCpus(virQEMUDriver *driver,
+                              virDomainObj *vm)
+{
+    VIR_WITH_MUTEX_LOCK_GUARD(&driver->lock) {
+        ignore_value(virHashRemoveEntry(driver->busyCpus, vm->def->name));
+    }
+}
+
+
+static int
+qemuProcessCollectBusyCpus(void *payload,
+                           const char *name G_GNUC_UNUSED,
+                           void *opaque)
+{
+    virBitmapUnion(opaque, payload);
+    return 0;
+}
+
+
+/*
+ * Huge pages a running or starting domain is expected to use from the pool
+ * of a given page size on a host NUMA node, or from the pages of any node
+ * if the memory isn't bound to a single one.
+ */
+typedef struct _qemuProcessHugepageReservation qemuProcessHugepageReservation;
+struct _qemuProcessHugepageReservation {
+    int node; /* -1 for any node */
+    unsigned int pagesize; /* KiB */
+    unsigned long long pages;
+    unsigned long long grown; /* pages added to the pool for the domain */
+};
+
+
+static void
+qemuProcessHugepageReservationAdd(GArray *res,
+                                  int node,
+                                  unsigned long long pagesize,
+                                  unsigned long long size)
+{
+    qemuProcessHugepageReservation tmp = { .node = node, .pagesize = pagesize };
+    size_t i;
+
+    if (!pagesize || !size ||
+        pagesize == (unsigned long long) virGetSystemPageSizeKB())
+        return;
+
+    for (i = 0; i < res->len; i++) {
+        qemuProcessHugepageReservation *r;
+
+        r = &g_array_index(res, qemuProcessHugepageReservation, i);
+        if (r->node == node && r->pagesize == pagesize) {
+            r->pages += VIR_DIV_UP(size, pagesize);
+            return;
+        }
+    }
+
+    tmp.pages = VIR_DIV_UP(size, pagesize);
+    g_array_append_val(res, tmp);
+}
+
+
+/*
+ * Returns the page size backing the memory of guest NUMA node @cellid (or of
+ * the whole domain if @cellid is -1), or 0 if it's not backed by huge pages.
+ */
+static unsigned long long
+qemuProcessGetHugepageSize(virQEMUDriverConfig *cfg,
+                           virDomainDef *def,
+                           ssize_t cellid)
+{
+    virDomainHugePage *hugepage = NULL;
+    size_t i;
+
+    for (i = 0; i < def->mem.nhugepages; i++) {
+        virDomainHugePage *p = &def->mem.hugepages[i];
+
+        if (!p->nodemask) {
+            hugepage = p;
+        } else if (cellid >= 0 && virBitmapIsBitSet(p->nodemask, cellid)) {
+            hugepage = p;
+            break;
+        }
+    }
+
+    if (!hugepage)
+        return 0;
+
+    if (!hugepage->size) {
+        virHugeTLBFS *p;
+
+        if (!(p = virFileGetDefaultHugepage(cfg->hugetlbfs, cfg->nhugetlbfs)) &&
+            cfg->nhugetlbfs)
+            p = &cfg->hugetlbfs[0];
+
+        return p ? p->size : 0;
+    }
+
+    return hugepage->size;
+}
+
+
+/*
+ * Returns the host NUMA node the memory of guest NUMA node @cellid is bound
+ * to, or -1 if it can be allocated from more than one node.
+ */
 static int
-qemuProcessPrepareDomainNUMAPlacement(virDomainObj *vm)
+qemuProcessGetHugepageNode(virDomainObj *vm,
+                           ssize_t cellid)
 {
     qemuDomainObjPrivate *priv = vm->privateData;
+    virDomainNumatuneMemMode mode;
+    virBitmap *nodeset;
+
+    if (virDomainNumatuneGetMode(vm->def->numa, cellid, &mode) < 0 ||
+        mode == VIR_DOMAIN_NUMATUNE_MEM_PREFERRED)
+        return -1;
+
+    nodeset = virDomainNumatuneGetNodeset(vm->def->numa, priv->autoNodeset,
+                                          cellid);
+    if (!nodeset || virBitmapCountBits(nodeset) != 1)
+        return -1;
+
+    return virBitmapNextSetBit(nodeset, -1);
+}
+
+
+static GArray *
+qemuProcessGetHugepageReservations(virQEMUDriver *driver,
+                                   virDomainObj *vm)
+{
+    g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(driver);
+    GArray *res = g_array_new(false, false, sizeof(qemuProcessHugepageReservation));
+    size_t ncells = virDomainNumaGetNodeCount(vm->def->numa);
+    size_t i;
+
+    if (ncells == 0) {
+        qemuProcessHugepageReservationAdd(res,
+                                          qemuProcessGetHugepageNode(vm, -1),
+                                          qemuProcessGetHugepageSize(cfg, vm->def, -1),
+                                          virDomainDefGetMemoryInitial(vm->def));
+    }
+
+    for (i = 0; i < ncells; i++) {
+        qemuProcessHugepageReservationAdd(res,
+                                          qemuProcessGetHugepageNode(vm, i),
+                                          qemuProcessGetHugepageSize(cfg, vm->def, i),
+                                          virDomainNumaGetNodeMemorySize(vm->def->numa, i));
+    }
+
+    for (i = 0; i < vm->def->nmems; i++) {
+        virDomainMemoryDef *mem = vm->def->mems[i];
+        int node = -1;
+
+        if (mem->model != VIR_DOMAIN_MEMORY_MODEL_DIMM)
+            continue;
+
+        if (mem->sourceNodes && virBitmapCountBits(mem->sourceNodes) == 1)
+            node = virBitmapNextSetBit(mem->sourceNodes, -1);
+
+        qemuProcessHugepageReservationAdd(res, node, mem->pagesize, mem->size);
+    }
+
+    return res;
+}
+
+
+/*
+ * Returns the number of pages of @pagesize on host @node (or all nodes if
+ * -1) which are neither reserved by domains nor used by anything else.
+ * Pages reserved by domains don't have to be allocated yet, since they are
+ * reserved before QEMU is started and QEMU might allocate them only on
+ * demand. Must be called with the driver locked.
+ */
+static int
+qemuProcessGetHugepagesAvailable(virQEMUDriver *driver,
+                                 int node,
+                                 unsigned int pagesize,
+                                 unsigned long long *total,
+                                 unsigned long long *avail)
+{
+    g_autofree virHashKeyValuePair *items = NULL;
+    unsigned long long pageFree = 0;
+    unsigned long long reserved = 0;
+    unsigned long long used;
+    size_t i;
+    size_t j;
+
+    if (virNumaGetPageInfo(node, pagesize, 0, total, &pageFree) < 0)
+        return -1;
+
+    items = virHashGetItems(driver->hugepageReservations, NULL, false);
+    for (i = 0; items && items[i].key; i++) {
+        const GArray *res = items[i].value;
+
+        for (j = 0; j < res->len; j++) {
+            qemuProcessHugepageReservation *r;
+
+            r = &g_array_index(res, qemuProcessHugepageReservation, j);
+            if (r->pagesize == pagesize && (node == -1 || r->node == node))
+                reserved += r->pages;
+        }
+    }
+
+    /* pages allocated beyond the reservations are used by someone else */
+    used = *total - pageFree;
+    if (used > reserved)
+        reserved = used;
+
+    *avail = *total > reserved ? *total - reserved : 0;
+
+    return 0;
+}
+
+
+/*
+ * Gives the pages added to a pool for a reservation back to the kernel,
+ * as far as they are not used or reserved by others. Must be called with
+ * the driver locked and @r not registered.
+ */
+static void
+qemuProcessHugepagePoolShrink(virQEMUDriver *driver,
+                              qemuProcessHugepageReservation *r)
+{
+    unsigned long long total;
+    unsigned long long avail;
+
+    if (!r->grown)
+        return;
+
+    if (qemuProcessGetHugepagesAvailable(driver, r->node, r->pagesize,
+                                         &total, &avail) < 0 ||
+        virNumaSetPagePoolSize(r->node, r->pagesize,
+                               total - MIN(r->grown, avail), false) < 0) {
+        VIR_WARN("Unable to shrink pool of %uKiB huge pages of node %d: %s",
+                 r->pagesize, r->node, virGetLastErrorMessage());
+        virResetLastError();
+    }
+}
+
+
+/**
+ * qemuProcessReserveHugepages:
+ * @driver: qemu driver
+ * @vm: domain object
+ * @check: check that there are enough huge pages
+ *
+ * Reserves the huge pages the domain is going to use, so that domains
+ * starting in parallel don't take the same free pages and fail once QEMU
+ * tries to allocate them. If there are not enough pages and the
+ * 'hugepage_pool_grow' option is enabled, the pools are grown.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+static int
+qemuProcessReserveHugepages(virQEMUDriver *driver,
+                            virDomainObj *vm,
+                            bool check)
+{
+    g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(driver);
+    g_autoptr(GArray) res = qemuProcessGetHugepageReservations(driver, vm);
+    size_t i;
+    VIR_LOCK_GUARD lock = virLockGuardLock(&driver->lock);
+
+    if (res->len == 0) {
+        ignore_value(virHashRemoveEntry(driver->hugepageReservations,
+                                        vm->def->name));
+        return 0;
+    }
+
+    for (i = 0; check && i < res->len; i++) {
+        qemuProcessHugepageReservation *r;
+        unsigned long long total;
+        unsigned long long avail;
+
+        r = &g_array_index(res, qemuProcessHugepageReservation, i);
+
+        if (qemuProcessGetHugepagesAvailable(driver, r->node, r->pagesize,
+                                             &total, &avail) < 0)
+            goto error;
+
+        if (avail >= r->pages)
+            continue;
+
+        if (cfg->hugepagePoolGrow &&
+            virNumaSetPagePoolSize(r->node, r->pagesize,
+                                   r->pages - avail, true) == 0) {
+            VIR_DEBUG("grew pool of %uKiB pages of node %d by %llu for domain %s",
+                      r->pagesize, r->node, r->pages - avail, vm->def->name);
+            r->grown = r->pages - avail;
+            continue;
+        }
+
+        virResetLastError();
+        if (r->node == -1) {
+            virReportError(VIR_ERR_OPERATION_FAILED,
+                           _("not enough free huge pages of size %uKiB: "
+                             "%llu needed, %llu available"),
+                           r->pagesize, r->pages, avail);
+        } else {
+            virReportError(VIR_ERR_OPERATION_FAILED,
+                           _("not enough free huge pages of size %uKiB on "
+                             "NUMA node %d: %llu needed, %llu available"),
+                           r->pagesize, r->node, r->pages, avail);
+        }
+        goto error;
+    }
+
+    VIR_DEBUG("reserving huge pages of %u pools for domain %s",
+              res->len, vm->def->name);
+
+    if (virHashUpdateEntry(driver->hugepageReservations, vm->def->name,
+                           res) < 0)
+        goto error;
+    res = NULL;
+
+    return 0;
+
+ error:
+    /* give back what was added to the pools so far */
+    while (i-- > 0) {
+        qemuProcessHugepagePoolShrink(driver,
+                                      &g_array_index(res, qemuProcessHugepageReservation, i));
+    }
+    return -1;
+}
+
+
+static void
+qemuProcessReleaseHugepages(virQEMUDriver *driver,
+                            virDomainObj *vm)
+{
+    g_autoptr(GArray) res = NULL;
+    size_t i;
+    VIR_LOCK_GUARD lock = virLockGuardLock(&driver->lock);
+
+    if (!(res = virHashSteal(driver->hugepageReservations, vm->def->name)))
+        return;
+
+    for (i = 0; i < res->len; i++) {
+        qemuProcessHugepagePoolShrink(driver,
+                                      &g_array_index(res, qemuProcessHugepageReservation, i));
+    }
+}
+
+
+/*
+ * Free memory of a host NUMA node usable by the domain in KiB, i.e. free
+ * huge pages if the domain is backed by them.
+ */
+static unsigned long long
+qemuProcessGetNodeFreeMemory(virQEMUDriverConfig *cfg,
+                             virDomainDef *def,
+                             virCapsHostNUMACell *cell)
+{
+    unsigned long long pagesize = 0;
+    unsigned long long pages = 0;
+    unsigned long long bytes = 0;
+
+    if (def->mem.nhugepages) {
+        pagesize = def->mem.hugepages[0].size;
+
+        if (!pagesize) {
+            virHugeTLBFS *p;
+
+            if (!(p = virFileGetDefaultHugepage(cfg->hugetlbfs, cfg->nhugetlbfs)) &&
+                cfg->nhugetlbfs)
+                p = &cfg->hugetlbfs[0];
+
+            if (p)
+                pagesize = p->size;
+        }
+
+        if (pagesize == (unsigned long long) virGetSystemPageSizeKB())
+            pagesize = 0;
+    }
+
+    if (pagesize) {
+        if (virNumaGetPageInfo(cell->num, pagesize, 0, NULL, &pages) < 0) {
+            virResetLastError();
+            return 0;
+        }
+
+        return pages * pagesize;
+    }
+
+    if (virNumaGetNodeMemory(cell->num, NULL, &bytes) < 0) {
+        virResetLastError();
+        return cell->mem;
+    }
+
+    return bytes / 1024;
+}
+
+
+/*
+ * Choose host NUMA nodes for the domain within libvirt instead of asking
+ * numad, which knows nothing about huge pages, pinning of other domains or
+ * locality of assigned devices.
+ */
+static virBitmap *
+qemuProcessGetBuiltinNUMAPlacement(virQEMUDriver *driver,
+                                   virDomainObj *vm,
+                                   virCapsHostNUMA *caps)
+{
+    g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(driver);
+    g_autofree unsigned long long *freeMem = NULL;
+    g_autoptr(virBitmap) busyCpus = virBitmapNew(0);
+    g_autoptr(virBitmap) deviceNodes = virBitmapNew(0);
+    size_t i;
+
+    freeMem = g_new0(unsigned long long, caps->cells->len);
+    for (i = 0; i < caps->cells->len; i++) {
+        virCapsHostNUMACell *cell = g_ptr_array_index(caps->cells, i);
+
+        freeMem[i] = qemuProcessGetNodeFreeMemory(cfg, vm->def, cell);
+    }
+
+    VIR_WITH_MUTEX_LOCK_GUARD(&driver->lock) {
+        virHashForEach(driver->busyCpus, qemuProcessCollectBusyCpus, busyCpus);
+    }
+
+    for (i = 0; i < vm->def->nhostdevs; i++) {
+        virDomainHostdevDef *hostdev = vm->def->hostdevs[i];
+        int node;
+
+        if (!virHostdevIsPCIDevice(hostdev))
+            continue;
+
+        if ((node = virPCIDeviceAddressGetNumaNode(&hostdev->source.subsys.u.pci.addr)) >= 0)
+            virBitmapSetBitExpand(deviceNodes, node);
+    }
+
+    return virCapabilitiesHostNUMAPlace(caps, freeMem, busyCpus, deviceNodes,
+                                        virDomainDefGetVcpus(vm->def),
+                                        virDomainDefGetMemoryTotal(vm->def));
+}
+
+
+static int
+qemuProcessPrepareDomainNUMAPlacement(virQEMUDriver *driver,
+                                      virDomainObj *vm)
+{
+    qemuDomainObjPrivate *priv = vm->privateData;
+    g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(driver);
     g_autofree char *nodeset = NULL;
     g_autoptr(virBitmap) numadNodeset = NULL;
     g_autoptr(virBitmap) hostMemoryNodeset = NULL;
@@ -6095,21 +6686,29 @@ qemuProcessPrepareDomainNUMAPlacement(virDomainObj *vm)
     if (!virDomainDefNeedsPlacementAdvice(vm->def))
         return 0;
 
-    nodeset = virNumaGetAutoPlacementAdvice(virDomainDefGetVcpus(vm->def),
-                                            virDomainDefGetMemoryTotal(vm->def));
-
-    if (!nodeset)
+    if (!(caps = virCapabilitiesHostNUMANewHost()))
         return -1;
 
-    if (!(hostMemoryNodeset = virNumaGetHostMemoryNodeset()))
-        return -1;
+    if (cfg->numadPlacement) {
+        nodeset = virNumaGetAutoPlacementAdvice(virDomainDefGetVcpus(vm->def),
+                                                virDomainDefGetMemoryTotal(vm->def));
 
-    VIR_DEBUG("Nodeset returned from numad: %s", nodeset);
+        if (!nodeset)
+            return -1;
 
-    if (virBitmapParse(nodeset, &numadNodeset, VIR_DOMAIN_CPUMASK_LEN) < 0)
-        return -1;
+        VIR_DEBUG("Nodeset returned from numad: %s", nodeset);
 
-    if (!(caps = virCapabilitiesHostNUMANewHost()))
+        if (virBitmapParse(nodeset, &numadNodeset, VIR_DOMAIN_CPUMASK_LEN) < 0)
+            return -1;
+    } else {
+        if (!(numadNodeset = qemuProcessGetBuiltinNUMAPlacement(driver, vm, caps)))
+            return -1;
+
+        nodeset = virBitmapFormat(numadNodeset);
+        VIR_DEBUG("Nodeset chosen by libvirt: %s", nodeset);
+    }
+
+    if (!(hostMemoryNodeset = virNumaGetHostMemoryNodeset()))
         return -1;
 
     /* numad may return a nodeset that only contains cpus but cgroups don't play
@@ -6348,6 +6947,29 @@ qemuProcessPrepareAllowReboot(virDomainObj *vm)
 }
 
 
+/*
+ * Autosized balloons let the guest return the pages it frees right away
+ * rather than only when the balloon is inflated. Not done for incoming
+ * domains as it changes the guest visible features of the device.
+ */
+static void
+qemuProcessPrepareMemballoon(virDomainObj *vm,
+                             unsigned int flags)
+{
+    virDomainMemballoonDef *memballoon = vm->def->memballoon;
+    qemuDomainObjPrivate *priv = vm->privateData;
+
+    if (!(flags & VIR_QEMU_PROCESS_START_NEW) ||
+        !virDomainDefHasMemballoon(vm->def) ||
+        !memballoon->autosize ||
+        memballoon->free_page_reporting != VIR_TRISTATE_SWITCH_ABSENT ||
+        !virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_VIRTIO_BALLOON_FREE_PAGE_REPORTING))
+        return;
+
+    memballoon->free_page_reporting = VIR_TRISTATE_SWITCH_ON;
+}
+
+
 static int
 qemuProcessUpdateSEVInfo(virDomainObj *vm)
 {
@@ -6393,6 +7015,33 @@ qemuProcessPrepareChardevSource(virDomainDef *def,
 }
 
 
+static int
+qemuProcessPrepareDomainDevices(virQEMUDriver *driver,
+                                virDomainObj *vm,
+                                qemuDomainObjPrivate *priv,
+                                virQEMUDriverConfig *cfg,
+                                unsigned int flags)
+{
+    VIR_DEBUG("Setting up storage");
+    if (qemuProcessPrepareDomainStorage(driver, vm, priv, cfg, flags) < 0)
+        return -1;
+
+    VIR_DEBUG("Setting up host devices");
+    if (qemuProcessPrepareDomainHostdevs(vm, priv) < 0)
+        return -1;
+
+    VIR_DEBUG("Prepare chardev source backends");
+    if (qemuProcessPrepareChardevSource(vm->def, cfg) < 0)
+        return -1;
+
+    VIR_DEBUG("Prepare device secrets");
+    if (qemuDomainSecretPrepare(driver, vm) < 0)
+        return -1;
+
+    return 0;
+}
+
+
 /**
  * qemuProcessPrepareDomain:
  * @driver: qemu driver
@@ -6414,6 +7063,7 @@ qemuProcessPrepareDomain(virQEMUDriver *driver,
                          unsigned int flags)
 {
     size_t i;
+    int rc;
     qemuDomainObjPrivate *priv = vm->privateData;
     g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(driver);
 
@@ -6431,8 +7081,10 @@ qemuProcessPrepareDomain(virQEMUDriver *driver,
         }
         virDomainAuditSecurityLabel(vm, true);
 
-        if (qemuProcessPrepareDomainNUMAPlacement(vm) < 0)
+        if (qemuProcessPrepareDomainNUMAPlacement(driver, vm) < 0)
             return -1;
+
+        qemuProcessRegisterBusyCpus(driver, vm);
     }
 
     /* Whether we should use virtlogd as stdio handler for character
@@ -6447,6 +7099,8 @@ qemuProcessPrepareDomain(virQEMUDriver *driver,
 
     qemuProcessPrepareAllowReboot(vm);
 
+    qemuProcessPrepareMemballoon(vm, flags);
+
     /*
      * Normally PCI addresses are assigned in the virDomainCreate
      * or virDomainDefine methods. We might still need to assign
@@ -6473,20 +7127,12 @@ qemuProcessPrepareDomain(virQEMUDriver *driver,
     if (qemuDomainMasterKeyCreate(vm) < 0)
         return -1;
 
-    VIR_DEBUG("Setting up storage");
-    if (qemuProcessPrepareDomainStorage(driver, vm, priv, cfg, flags) < 0)
-        return -1;
-
-    VIR_DEBUG("Setting up host devices");
-    if (qemuProcessPrepareDomainHostdevs(vm, priv) < 0)
-        return -1;
-
-    VIR_DEBUG("Prepare chardev source backends");
-    if (qemuProcessPrepareChardevSource(vm->def, cfg) < 0)
-        return -1;
-
-    VIR_DEBUG("Prepare device secrets");
-    if (qemuDomainSecretPrepare(driver, vm) < 0)
+    /* Disks and other devices often share their secrets, fetch each of
+     * them just once */
+    priv->secretCache = virSecretCacheNew(virGetConnectSecret);
+    rc = qemuProcessPrepareDomainDevices(driver, vm, priv, cfg, flags);
+    g_clear_pointer(&priv->secretCache, virSecretCacheFree);
+    if (rc < 0)
         return -1;
 
     VIR_DEBUG("Prepare bios/uefi paths");
@@ -6537,6 +7183,8 @@ qemuProcessPrepareDomain(virQEMUDriver *driver,
             return -1;
     }
 
+    qemuProcessStartPhaseEnd(vm, QEMU_DOMAIN_START_PHASE_PREPARE_DOMAIN);
+
     return 0;
 }
 
@@ -6979,6 +7627,10 @@ qemuProcessPrepareHost(virQEMUDriver *driver,
     if (qemuProcessBuildDestroyMemoryPaths(driver, vm, NULL, true) < 0)
         return -1;
 
+    VIR_DEBUG("Reserving huge pages");
+    if (qemuProcessReserveHugepages(driver, vm, true) < 0)
+        return -1;
+
     /* Ensure no historical cgroup for this VM is lying around bogus
      * settings */
     VIR_DEBUG("Ensuring no historical cgroup is lying around");
@@ -7025,6 +7677,8 @@ qemuProcessPrepareHost(virQEMUDriver *driver,
     if (qemuProcessPrepareLaunchSecurityGuestInput(vm) < 0)
         return -1;
 
+    qemuProcessStartPhaseEnd(vm, QEMU_DOMAIN_START_PHASE_PREPARE_HOST);
+
     return 0;
 }
 
@@ -7062,6 +7716,36 @@ qemuProcessGenID(virDomainObj *vm,
 }
 
 
+/**
+ * qemuProcessSetupDisksAutoExtend:
+ *
+ * Registers the write thresholds of disks with an <autoextend> policy.
+ */
+static int
+qemuProcessSetupDisksAutoExtend(virDomainObj *vm,
+                                virDomainAsyncJob asyncJob)
+{
+    g_autoptr(GHashTable) blockNamedNodeData = NULL;
+    size_t i;
+
+    for (i = 0; i < vm->def->ndisks; i++) {
+        virDomainDiskDef *disk = vm->def->disks[i];
+
+        if (!disk->autoextend)
+            continue;
+
+        if (!blockNamedNodeData &&
+            !(blockNamedNodeData = qemuBlockGetNamedNodeData(vm, asyncJob)))
+            return -1;
+
+        if (qemuBlockAutoExtendArm(vm, disk, blockNamedNodeData, asyncJob) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
 /**
  * qemuProcessSetupDiskThrottlingBlockdev:
  *
@@ -7399,6 +8083,8 @@ qemuProcessLaunch(virConnectPtr conn,
 
     qemuDomainLogContextMarkPosition(logCtxt);
 
+    qemuProcessStartPhaseEnd(vm, QEMU_DOMAIN_START_PHASE_COMMAND_LINE);
+
     VIR_DEBUG("Building mount namespace");
 
     if (qemuProcessEnableDomainNamespaces(driver, vm) < 0)
@@ -7465,7 +8151,7 @@ qemuProcessLaunch(virConnectPtr conn,
     }
 
     VIR_DEBUG("Writing early domain status to disk");
-    if (virDomainObjSave(vm, driver->xmlopt, cfg->stateDir) < 0)
+    if (qemuDomainSaveStatusBarrier(vm) < 0)
         goto cleanup;
 
     VIR_DEBUG("Waiting for handshake from child");
@@ -7476,10 +8162,14 @@ qemuProcessLaunch(virConnectPtr conn,
         goto cleanup;
     }
 
+    qemuProcessStartPhaseEnd(vm, QEMU_DOMAIN_START_PHASE_SPAWN);
+
     VIR_DEBUG("Building domain mount namespace (if required)");
     if (qemuDomainBuildNamespace(cfg, vm) < 0)
         goto cleanup;
 
+    qemuProcessStartPhaseEnd(vm, QEMU_DOMAIN_START_PHASE_NAMESPACE);
+
     VIR_DEBUG("Setting up domain cgroup (if required)");
     if (qemuSetupCgroup(vm, nnicindexes, nicindexes) < 0)
         goto cleanup;
@@ -7510,6 +8200,8 @@ qemuProcessLaunch(virConnectPtr conn,
         qemuProcessStartManagedPRDaemon(vm) < 0)
         goto cleanup;
 
+    qemuProcessStartPhaseEnd(vm, QEMU_DOMAIN_START_PHASE_CGROUP);
+
     VIR_DEBUG("Setting domain security labels");
     if (qemuSecuritySetAllLabel(driver,
                                 vm,
@@ -7542,6 +8234,8 @@ qemuProcessLaunch(virConnectPtr conn,
             goto cleanup;
     }
 
+    qemuProcessStartPhaseEnd(vm, QEMU_DOMAIN_START_PHASE_SECURITY);
+
     VIR_DEBUG("Labelling done, completing handshake to child");
     if (virCommandHandshakeNotify(cmd) < 0)
         goto cleanup;
@@ -7557,6 +8251,8 @@ qemuProcessLaunch(virConnectPtr conn,
     if (qemuConnectAgent(driver, vm) < 0)
         goto cleanup;
 
+    qemuProcessStartPhaseEnd(vm, QEMU_DOMAIN_START_PHASE_MONITOR);
+
     VIR_DEBUG("setting up hotpluggable cpus");
     if (qemuDomainHasHotpluggableStartupVcpus(vm->def)) {
         if (qemuDomainRefreshVcpuInfo(driver, vm, asyncJob, false) < 0)
@@ -7605,6 +8301,8 @@ qemuProcessLaunch(virConnectPtr conn,
                                vm->def->cputune.emulatorsched->priority) < 0)
         goto cleanup;
 
+    qemuProcessStartPhaseEnd(vm, QEMU_DOMAIN_START_PHASE_VCPUS);
+
     VIR_DEBUG("Setting any required VM passwords");
     if (qemuProcessInitPasswords(driver, vm, asyncJob) < 0)
         goto cleanup;
@@ -7640,10 +8338,16 @@ qemuProcessLaunch(virConnectPtr conn,
             goto cleanup;
     }
 
+    VIR_DEBUG("Setting up automatic extension of disks");
+    if (qemuProcessSetupDisksAutoExtend(vm, asyncJob) < 0)
+        goto cleanup;
+
     VIR_DEBUG("Setting handling of lifecycle actions");
     if (qemuProcessSetupLifecycleActions(vm, asyncJob) < 0)
         goto cleanup;
 
+    qemuProcessStartPhaseEnd(vm, QEMU_DOMAIN_START_PHASE_DEVICES);
+
     ret = 0;
 
  cleanup:
@@ -7704,8 +8408,6 @@ qemuProcessFinishStartup(virQEMUDriver *driver,
                          bool startCPUs,
                          virDomainPausedReason pausedReason)
 {
-    g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(driver);
-
     if (startCPUs) {
         VIR_DEBUG("Starting domain CPUs");
         if (qemuProcessStartCPUs(driver, vm,
@@ -7721,7 +8423,7 @@ qemuProcessFinishStartup(virQEMUDriver *driver,
     }
 
     VIR_DEBUG("Writing domain status to disk");
-    if (virDomainObjSave(vm, driver->xmlopt, cfg->stateDir) < 0)
+    if (qemuDomainSaveStatusBarrier(vm) < 0)
         return -1;
 
     if (qemuProcessStartHook(driver, vm,
@@ -7729,6 +8431,8 @@ qemuProcessFinishStartup(virQEMUDriver *driver,
                              VIR_HOOK_SUBOP_BEGIN) < 0)
         return -1;
 
+    qemuProcessStartPhaseEnd(vm, QEMU_DOMAIN_START_PHASE_FINISH);
+
     return 0;
 }
 
@@ -7814,6 +8518,8 @@ qemuProcessStart(virConnectPtr conn,
             goto stop;
     }
 
+    qemuProcessStartPhaseEnd(vm, QEMU_DOMAIN_START_PHASE_REFRESH);
+
     if (qemuProcessFinishStartup(driver, vm, asyncJob,
                                  !(flags & VIR_QEMU_PROCESS_START_PAUSED),
                                  incoming ?
@@ -8007,6 +8713,13 @@ void qemuProcessStop(virQEMUDriver *driver,
     if (!!g_atomic_int_dec_and_test(&driver->nactive) && driver->inhibitCallback)
         driver->inhibitCallback(false, driver->inhibitOpaque);
 
+    qemuIOThreadPollTunerRemoveDomain(driver, vm);
+    qemuBalloonAutosizerRemoveDomain(driver, vm);
+
+    qemuProcessUnregisterBusyCpus(driver, vm);
+    qemuProcessReleaseHugepages(driver, vm);
+    qemuProcessStopDirtyRateSampling(vm);
+
     if ((timestamp = virTimeStringNow()) != NULL) {
         qemuDomainLogAppendMessage(driver, vm, "%s: shutting down, reason=%s\n",
                                    timestamp,
@@ -8278,6 +8991,12 @@ void qemuProcessStop(virQEMUDriver *driver,
     /* clear all private data entries which are no longer needed */
     qemuDomainObjPrivateDataClear(priv);
 
+    for (i = 0; i < virDomainDefGetVcpusMax(vm->def); i++) {
+        virDomainVcpuDef *vcpu = virDomainDefGetVcpu(vm->def, i);
+
+        g_clear_pointer(&QEMU_DOMAIN_VCPU_PRIVATE(vcpu)->perf, virPerfFree);
+    }
+
     /* The "release" hook cleans up additional resources */
     if (virHookPresent(VIR_HOOK_DRIVER_QEMU)) {
         g_autofree char *xml = qemuDomainDefFormatXML(driver, NULL, vm->def, 0);
@@ -8761,6 +9480,10 @@ qemuProcessReconnect(void *opaque)
     if (qemuProcessUpdateState(driver, obj) < 0)
         goto error;
 
+    qemuProcessRegisterBusyCpus(driver, obj);
+
+    ignore_value(qemuProcessReserveHugepages(driver, obj, false));
+
     state = virDomainObjGetState(obj, &reason);
     if (state == VIR_DOMAIN_SHUTOFF ||
         (state == VIR_DOMAIN_PAUSED &&
@@ -8891,7 +9614,7 @@ qemuProcessReconnect(void *opaque)
     }
 
     /* update domain state XML with possibly updated state in virDomainObj */
-    if (virDomainObjSave(obj, driver->xmlopt, cfg->stateDir) < 0)
+    if (qemuDomainSaveStatusBarrier(obj) < 0)
         goto error;
 
     /* Run an hook to allow admins to do some magic */
@@ -8915,6 +9638,9 @@ qemuProcessReconnect(void *opaque)
     if (g_atomic_int_add(&driver->nactive, 1) == 0 && driver->inhibitCallback)
         driver->inhibitCallback(true, driver->inhibitOpaque);
 
+    qemuIOThreadPollTunerAddDomain(driver, obj);
+    qemuBalloonAutosizerAddDomain(driver, obj);
+
  cleanup:
     if (jobStarted)
         qemuDomainObjEndJob(obj);
@@ -8953,6 +9679,103 @@ qemuProcessReconnect(void *opaque)
     goto cleanup;
 }
 
+/*
+ * Runs in the reconnect pool, inherits a reference to @opaque domain
+ * object. Domains prioritized by qemuProcessReconnectPrioritize are
+ * queued twice and only the first job to run does the reconnect.
+ */
+static void
+qemuProcessReconnectWorker(void *opaque,
+                           void *privdata)
+{
+    virDomainObj *obj = opaque;
+    virQEMUDriver *driver = privdata;
+    qemuDomainObjPrivate *priv = obj->privateData;
+    struct qemuProcessReconnectData *data;
+    g_autoptr(virIdentity) identity = virIdentityGetCurrent();
+    unsigned int done;
+
+    virObjectLock(obj);
+
+    if (!priv->reconnectPending) {
+        virDomainObjEndAPI(&obj);
+        return;
+    }
+
+    priv->reconnectPending = false;
+    virCondBroadcast(&priv->job.cond);
+
+    data = g_new0(struct qemuProcessReconnectData, 1);
+    data->driver = driver;
+    data->obj = obj;
+    if (identity)
+        data->identity = g_object_ref(identity);
+
+    /* consumes the lock and reference on @obj and resets the identity */
+    qemuProcessReconnect(data);
+    virIdentitySetCurrent(identity);
+
+    done = g_atomic_int_add(&driver->reconnectDone, 1) + 1;
+    VIR_INFO("Reconnected %u of %u domains",
+             done, g_atomic_int_get(&driver->reconnectQueued));
+}
+
+
+/**
+ * qemuProcessReconnectPrioritize:
+ * @driver: qemu driver
+ * @vm: domain object, locked
+ *
+ * Moves the reconnect of @vm still waiting in the reconnect pool ahead
+ * of all other domains. Called from qemuDomainObjBeginJobInternal so
+ * that APIs targeting a domain don't have to wait for the reconnect of
+ * every domain queued before it.
+ */
+void
+qemuProcessReconnectPrioritize(virQEMUDriver *driver,
+                               virDomainObj *vm)
+{
+    qemuDomainObjPrivate *priv = vm->privateData;
+
+    if (!priv->reconnectPending || priv->reconnectPrioritized)
+        return;
+
+    priv->reconnectPrioritized = true;
+
+    VIR_DEBUG("Prioritizing reconnect of domain %s", vm->def->name);
+
+    virObjectRef(vm);
+    if (virThreadPoolSendJob(driver->reconnectPool,
+                             VIR_THREAD_POOL_CLASS_PRIORITY, vm) < 0) {
+        virObjectUnref(vm);
+        virResetLastError();
+    }
+}
+
+
+static int
+qemuProcessReconnectQueue(virQEMUDriver *driver,
+                          virDomainObj *obj)
+{
+    qemuDomainObjPrivate *priv = obj->privateData;
+
+    virObjectLock(obj);
+    virObjectRef(obj);
+    priv->reconnectPending = true;
+
+    if (virThreadPoolSendJob(driver->reconnectPool, 0, obj) < 0) {
+        priv->reconnectPending = false;
+        virObjectUnref(obj);
+        virObjectUnlock(obj);
+        return -1;
+    }
+
+    g_atomic_int_inc(&driver->reconnectQueued);
+    virObjectUnlock(obj);
+    return 0;
+}
+
+
 static int
 qemuProcessReconnectHelper(virDomainObj *obj,
                            void *opaque)
@@ -8966,6 +9789,10 @@ qemuProcessReconnectHelper(virDomainObj *obj,
     if (obj->pid == 0)
         return 0;
 
+    if (src->driver->reconnectPool &&
+        qemuProcessReconnectQueue(src->driver, obj) == 0)
+        return 0;
+
     data = g_new0(struct qemuProcessReconnectData, 1);
 
     memcpy(data, src, sizeof(*data));
@@ -9006,12 +9833,32 @@ qemuProcessReconnectHelper(virDomainObj *obj,
  * qemuProcessReconnectAll
  *
  * Try to re-open the resources for live VMs that we care
- * about.
+ * about. If reconnect_workers is set in qemu.conf, at most that many
+ * domains are reconnected at a time, otherwise each domain gets a
+ * thread of its own.
  */
 void
 qemuProcessReconnectAll(virQEMUDriver *driver)
 {
+    g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(driver);
     struct qemuProcessReconnectData data = {.driver = driver};
+
+    if (cfg->reconnectWorkers > 0) {
+        g_autoptr(virIdentity) identity = virIdentityGetCurrent();
+
+        if (!(driver->reconnectPool = virThreadPoolNewFull(0,
+                                                           cfg->reconnectWorkers,
+                                                           1,
+                                                           qemuProcessReconnectWorker,
+                                                           "qemu-reconnect",
+                                                           identity,
+                                                           driver))) {
+            VIR_WARN("Failed to create reconnect pool, falling back to "
+                     "a thread per domain: %s", virGetLastErrorMessage());
+            virResetLastError();
+        }
+    }
+
     virDomainObjListForEach(driver->domains, true,
                             qemuProcessReconnectHelper, &data);
 }
@@ -48,6 +48,8 @@ int qemuProcessDestroyMemoryBackingPath(virQEMUDriver *driver,
                                         virDomainMemoryDef *mem);
 
 void qemuProcessReconnectAll(virQEMUDriver *driver);
+void qemuProcessReconnectPrioritize(virQEMUDriver *driver,
+                                    virDomainObj *vm);
 
 typedef struct _qemuProcessIncomingDef qemuProcessIncomingDef;
 struct _qemuProcessIncomingDef {
@@ -159,6 +161,11 @@ void qemuProcessStop(virQEMUDriver *driver,
                      virDomainAsyncJob asyncJob,
                      unsigned int flags);
 
+int qemuProcessStartDirtyRateSampling(virDomainObj *vm,
+                                      int seconds,
+                                      qemuMonitorDirtyRateCalcMode mode);
+void qemuProcessStopDirtyRateSampling(virDomainObj *vm);
+
 typedef enum {
    VIR_QEMU_PROCESS_KILL_FORCE  = 1 << 0,
    VIR_QEMU_PROCESS_KILL_NOWAIT = 1 << 1,
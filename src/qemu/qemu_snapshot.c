@@ -43,6 +43,7 @@
 #include "virdomainsnapshotobjlist.h"
 #include "virqemu.h"
 #include "storage_source.h"
+#include "virthread.h"
 
 #define VIR_FROM_THIS VIR_FROM_QEMU
 
@@ -851,6 +852,7 @@ struct _qemuSnapshotDiskData {
     char *relPath; /* relative path component to fill into original disk */
     qemuBlockStorageSourceChainData *crdata;
     bool blockdevadded;
+    bool createPending; /* @src is yet to be created by qemuSnapshotDiskCreateOverlays */
 
     virStorageSource *persistsrc;
     virDomainDiskDef *persistdisk;
@@ -1041,10 +1043,9 @@ qemuSnapshotDiskPrepareOneBlockdev(virQEMUDriver *driver,
                                                    dd->src, dd->disk->src) < 0)
             return -1;
 
-        if (qemuBlockStorageSourceCreate(vm, dd->src, dd->disk->src,
-                                         NULL, dd->crdata->srcdata[0],
-                                         asyncJob) < 0)
-            return -1;
+        /* the overlays of all disks are created at once later */
+        dd->createPending = true;
+        return 0;
     }
 
     dd->blockdevadded = true;
@@ -1052,6 +1053,62 @@ qemuSnapshotDiskPrepareOneBlockdev(virQEMUDriver *driver,
 }
 
 
+/**
+ * qemuSnapshotDiskCreateOverlays:
+ * @snapctxt: snapshot disk context
+ *
+ * Creates and attaches the overlay images of all disks in @snapctxt which
+ * were not reused, running the blockdev-create jobs for all of them at the
+ * same time rather than one disk after another.
+ */
+static int
+qemuSnapshotDiskCreateOverlays(qemuSnapshotDiskContext *snapctxt)
+{
+    g_autofree qemuBlockStorageSourceCreateData *create = NULL;
+    size_t ncreate = 0;
+    size_t i;
+
+    for (i = 0; i < snapctxt->ndd; i++) {
+        if (snapctxt->dd[i].createPending)
+            ncreate++;
+    }
+
+    if (ncreate == 0)
+        return 0;
+
+    create = g_new0(qemuBlockStorageSourceCreateData, ncreate);
+    ncreate = 0;
+
+    for (i = 0; i < snapctxt->ndd; i++) {
+        qemuSnapshotDiskData *dd = snapctxt->dd + i;
+
+        if (!dd->createPending)
+            continue;
+
+        create[ncreate].src = dd->src;
+        create[ncreate].backingStore = dd->disk->src;
+        create[ncreate].data = dd->crdata->srcdata[0];
+        ncreate++;
+    }
+
+    if (qemuBlockStorageSourceCreateMultiple(snapctxt->vm, create, ncreate,
+                                             snapctxt->asyncJob) < 0)
+        return -1;
+
+    for (i = 0; i < snapctxt->ndd; i++) {
+        qemuSnapshotDiskData *dd = snapctxt->dd + i;
+
+        if (!dd->createPending)
+            continue;
+
+        dd->createPending = false;
+        dd->blockdevadded = true;
+    }
+
+    return 0;
+}
+
+
 int
 qemuSnapshotDiskPrepareOne(qemuSnapshotDiskContext *snapctxt,
                            virDomainDiskDef *disk,
@@ -1186,6 +1243,9 @@ qemuSnapshotDiskPrepareActiveExternal(virDomainObj *vm,
             return NULL;
     }
 
+    if (qemuSnapshotDiskCreateOverlays(snapctxt) < 0)
+        return NULL;
+
     return g_steal_pointer(&snapctxt);
 }
 
@@ -1285,6 +1345,9 @@ qemuSnapshotDiskCreate(qemuSnapshotDiskContext *snapctxt)
     if (snapctxt->ndd == 0)
         return 0;
 
+    if (qemuSnapshotDiskCreateOverlays(snapctxt) < 0)
+        return -1;
+
     if (qemuDomainObjEnterMonitorAsync(driver, snapctxt->vm, snapctxt->asyncJob) < 0)
         return -1;
 
@@ -1304,7 +1367,7 @@ qemuSnapshotDiskCreate(qemuSnapshotDiskContext *snapctxt)
     if (rc < 0)
         return -1;
 
-    if (virDomainObjSave(snapctxt->vm, driver->xmlopt, snapctxt->cfg->stateDir) < 0 ||
+    if (qemuDomainSaveStatusBarrier(snapctxt->vm) < 0 ||
         (snapctxt->vm->newDef && virDomainDefSave(snapctxt->vm->newDef, driver->xmlopt,
                                                   snapctxt->cfg->configDir) < 0))
         return -1;
@@ -1907,6 +1970,381 @@ qemuSnapshotCreateXML(virDomainPtr domain,
 }
 
 
+typedef enum {
+    QEMU_SNAPSHOT_GROUP_PHASE_PREPARE, /* overlays of all domains created */
+    QEMU_SNAPSHOT_GROUP_PHASE_FREEZE, /* file systems of all domains frozen */
+    QEMU_SNAPSHOT_GROUP_PHASE_SNAPSHOT, /* disks of all domains snapshotted */
+
+    QEMU_SNAPSHOT_GROUP_PHASE_LAST
+} qemuSnapshotGroupPhase;
+
+typedef struct _qemuSnapshotGroup qemuSnapshotGroup;
+struct _qemuSnapshotGroup {
+    virQEMUDriver *driver;
+    unsigned int flags;
+
+    virMutex lock;
+    virCond cond;
+    size_t nmembers; /* number of running member threads */
+    size_t arrived[QEMU_SNAPSHOT_GROUP_PHASE_LAST];
+    bool failed;
+};
+
+typedef struct _qemuSnapshotGroupMember qemuSnapshotGroupMember;
+struct _qemuSnapshotGroupMember {
+    qemuSnapshotGroup *group;
+    virThread thread;
+
+    virDomainPtr domain;
+    virDomainObj *vm;
+    const char *xmlDesc;
+
+    bool job; /* the snapshot job was started */
+    bool thaw; /* the file systems were frozen */
+    bool created; /* the disk snapshot was taken */
+    virDomainMomentObj *snap;
+    virDomainMomentObj *tmpsnap; /* @snap if no metadata is kept */
+    qemuSnapshotDiskContext *snapctxt;
+
+    virDomainSnapshotPtr snapshot;
+    virErrorPtr err;
+};
+
+
+/*
+ * Waits until all members of the group reach the end of @phase, with the
+ * domain unlocked meanwhile. Returns false if any of them failed to get
+ * there, so that all members agree on whether to continue at each phase.
+ */
+static bool
+qemuSnapshotGroupBarrier(qemuSnapshotGroupMember *member,
+                         qemuSnapshotGroupPhase phase,
+                         bool ok)
+{
+    qemuSnapshotGroup *group = member->group;
+    bool ret = false;
+
+    if (!ok)
+        virErrorPreserveLast(&member->err);
+
+    virObjectUnlock(member->vm);
+
+    VIR_WITH_MUTEX_LOCK_GUARD(&group->lock) {
+        if (!ok)
+            group->failed = true;
+
+        if (++group->arrived[phase] == group->nmembers)
+            virCondBroadcast(&group->cond);
+
+        while (group->arrived[phase] < group->nmembers)
+            ignore_value(virCondWait(&group->cond, &group->lock));
+
+        ret = !group->failed;
+    }
+
+    virObjectLock(member->vm);
+
+    return ret;
+}
+
+
+/* Starts the snapshot job of @member and creates its overlay images. */
+static int
+qemuSnapshotGroupMemberPrepare(qemuSnapshotGroupMember *member)
+{
+    virQEMUDriver *driver = member->group->driver;
+    virDomainObj *vm = member->vm;
+    qemuDomainObjPrivate *priv = vm->privateData;
+    unsigned int flags = member->group->flags;
+    bool reuse = (flags & VIR_DOMAIN_SNAPSHOT_CREATE_REUSE_EXT) != 0;
+    bool has_manual = false;
+    g_autoptr(virDomainSnapshotDef) def = NULL;
+    g_autoptr(GHashTable) blockNamedNodeData = NULL;
+    virDomainMomentObj *current;
+
+    if (virDomainObjCheckActive(vm) < 0)
+        return -1;
+
+    if (qemuDomainSupportsCheckpointsBlockjobs(vm) < 0)
+        return -1;
+
+    if (!(def = qemuSnapshotCreateXMLParse(vm, driver, member->xmlDesc, flags)))
+        return -1;
+
+    if (qemuSnapshotCreateXMLValidateDef(vm, def, flags) < 0)
+        return -1;
+
+    if (qemuDomainObjBeginAsyncJob(driver, vm, VIR_ASYNC_JOB_SNAPSHOT,
+                                   VIR_DOMAIN_JOB_OPERATION_SNAPSHOT, flags) < 0)
+        return -1;
+    member->job = true;
+
+    qemuDomainObjSetAsyncJobMask(vm, VIR_JOB_NONE);
+
+    if (virDomainObjCheckActive(vm) < 0)
+        return -1;
+
+    if (qemuSnapshotCreateAlignDisks(vm, def, driver, flags) < 0)
+        return -1;
+
+    if (qemuSnapshotPrepare(vm, def, &has_manual, &flags) < 0)
+        return -1;
+
+    /* manual snapshots of disks would require pausing the guests */
+    if (has_manual) {
+        virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                       _("manual disk snapshots are not supported when "
+                         "snapshotting multiple domains"));
+        return -1;
+    }
+
+    if (flags & VIR_DOMAIN_SNAPSHOT_CREATE_NO_METADATA) {
+        member->snap = member->tmpsnap = virDomainMomentObjNew();
+        member->snap->def = &def->parent;
+        def = NULL;
+    } else {
+        if (!(member->snap = virDomainSnapshotAssignDef(vm->snapshots, &def)))
+            return -1;
+
+        if ((current = virDomainSnapshotGetCurrent(vm->snapshots)))
+            member->snap->def->parent_name = g_strdup(current->def->name);
+    }
+
+    if (virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_BLOCKDEV) &&
+        !(blockNamedNodeData = qemuBlockGetNamedNodeData(vm, VIR_ASYNC_JOB_SNAPSHOT)))
+        return -1;
+
+    /* Create the overlays before the guests are frozen, only the transaction
+     * switching to them needs to happen while they are */
+    if (!(member->snapctxt = qemuSnapshotDiskPrepareActiveExternal(vm, member->snap,
+                                                                   reuse,
+                                                                   blockNamedNodeData,
+                                                                   VIR_ASYNC_JOB_SNAPSHOT)))
+        return -1;
+
+    return 0;
+}
+
+
+static int
+qemuSnapshotGroupMemberFreeze(qemuSnapshotGroupMember *member)
+{
+    virQEMUDriver *driver = member->group->driver;
+    virDomainObj *vm = member->vm;
+    int frozen;
+
+    if (!(member->group->flags & VIR_DOMAIN_SNAPSHOT_CREATE_QUIESCE))
+        return 0;
+
+    if (qemuDomainObjBeginAgentJob(driver, vm, VIR_AGENT_JOB_MODIFY) < 0)
+        return -1;
+
+    if (virDomainObjCheckActive(vm) < 0) {
+        qemuDomainObjEndAgentJob(vm);
+        return -1;
+    }
+
+    frozen = qemuSnapshotFSFreeze(vm, NULL, 0);
+    qemuDomainObjEndAgentJob(vm);
+
+    if (frozen < 0)
+        return -1;
+
+    member->thaw = frozen > 0;
+
+    return 0;
+}
+
+
+/* Thaws the guest, writes the metadata and ends the job of @member. */
+static void
+qemuSnapshotGroupMemberFinish(qemuSnapshotGroupMember *member)
+{
+    virQEMUDriver *driver = member->group->driver;
+    virDomainObj *vm = member->vm;
+    g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(driver);
+    /* report errors only on an otherwise successful snapshot */
+    bool report = member->created && !member->err;
+    bool failed = false;
+
+    if (member->thaw &&
+        qemuDomainObjBeginAgentJob(driver, vm, VIR_AGENT_JOB_MODIFY) >= 0) {
+        if (virDomainObjIsActive(vm) &&
+            qemuSnapshotFSThaw(vm, report) < 0 && report)
+            failed = true;
+
+        qemuDomainObjEndAgentJob(vm);
+    }
+
+    g_clear_pointer(&member->snapctxt, qemuSnapshotDiskContextCleanup);
+
+    if (member->created && !member->tmpsnap) {
+        qemuSnapshotSetCurrent(vm, member->snap);
+
+        if (qemuSnapshotCreateWriteMetadata(vm, member->snap, driver, cfg) < 0) {
+            member->created = false;
+            failed = true;
+        }
+    }
+
+    if (report && !failed &&
+        !(member->snapshot = virGetDomainSnapshot(member->domain,
+                                                  member->snap->def->name)))
+        failed = true;
+
+    if (failed && !member->err)
+        virErrorPreserveLast(&member->err);
+
+    if (!member->created && member->snap && !member->tmpsnap)
+        virDomainSnapshotObjListRemove(vm->snapshots, member->snap);
+    g_clear_pointer(&member->tmpsnap, virDomainMomentObjFree);
+    member->snap = NULL;
+
+    if (member->job)
+        qemuDomainObjEndAsyncJob(vm);
+}
+
+
+static void
+qemuSnapshotGroupMemberRun(void *opaque)
+{
+    qemuSnapshotGroupMember *member = opaque;
+    bool ok;
+
+    virObjectLock(member->vm);
+
+    ok = qemuSnapshotGroupMemberPrepare(member) == 0;
+    if (!qemuSnapshotGroupBarrier(member, QEMU_SNAPSHOT_GROUP_PHASE_PREPARE, ok))
+        goto cleanup;
+
+    ok = qemuSnapshotGroupMemberFreeze(member) == 0;
+    if (!qemuSnapshotGroupBarrier(member, QEMU_SNAPSHOT_GROUP_PHASE_FREEZE, ok))
+        goto cleanup;
+
+    /* only thaw once the disks of all domains are snapshotted */
+    ok = member->created = qemuSnapshotDiskCreate(member->snapctxt) == 0;
+    qemuSnapshotGroupBarrier(member, QEMU_SNAPSHOT_GROUP_PHASE_SNAPSHOT, ok);
+
+ cleanup:
+    qemuSnapshotGroupMemberFinish(member);
+    virObjectUnlock(member->vm);
+}
+
+
+/**
+ * qemuSnapshotCreateXMLList:
+ * @driver: qemu driver
+ * @doms: domains to snapshot
+ * @vms: unlocked domain objects of @doms
+ * @xmlDescs: snapshot XML of each domain
+ * @ndoms: number of domains
+ * @snaps: filled with the new snapshots on success
+ * @flags: bitwise-OR of virDomainSnapshotCreateFlags
+ *
+ * Takes disk only snapshots of all @vms at once. Each domain is handled by
+ * a thread of its own so that the slow steps run for all of them at the
+ * same time, while the phases which must not overlap for the snapshots to
+ * be consistent across the group are separated by barriers: the overlay
+ * images of all domains are created before any guest is frozen, all guests
+ * are frozen before any disk is snapshotted, and no guest is thawed before
+ * the disks of all domains are snapshotted.
+ *
+ * Returns @ndoms on success, -1 on error.
+ */
+int
+qemuSnapshotCreateXMLList(virQEMUDriver *driver,
+                          virDomainPtr *doms,
+                          virDomainObj **vms,
+                          const char **xmlDescs,
+                          size_t ndoms,
+                          virDomainSnapshotPtr **snaps,
+                          unsigned int flags)
+{
+    qemuSnapshotGroup group = { .driver = driver, .flags = flags };
+    g_autofree qemuSnapshotGroupMember *members = NULL;
+    g_autofree virDomainSnapshotPtr *ret = NULL;
+    virErrorPtr err = NULL;
+    size_t nmembers = 0;
+    size_t i;
+
+    virCheckFlags(VIR_DOMAIN_SNAPSHOT_CREATE_NO_METADATA |
+                  VIR_DOMAIN_SNAPSHOT_CREATE_DISK_ONLY |
+                  VIR_DOMAIN_SNAPSHOT_CREATE_REUSE_EXT |
+                  VIR_DOMAIN_SNAPSHOT_CREATE_QUIESCE |
+                  VIR_DOMAIN_SNAPSHOT_CREATE_ATOMIC |
+                  VIR_DOMAIN_SNAPSHOT_CREATE_VALIDATE, -1);
+
+    if (!(flags & VIR_DOMAIN_SNAPSHOT_CREATE_DISK_ONLY)) {
+        virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                       _("only disk snapshots of multiple domains are supported"));
+        return -1;
+    }
+
+    if (virMutexInit(&group.lock) < 0) {
+        virReportSystemError(errno, "%s", _("unable to init mutex"));
+        return -1;
+    }
+
+    if (virCondInit(&group.cond) < 0) {
+        virReportSystemError(errno, "%s", _("unable to init cond"));
+        virMutexDestroy(&group.lock);
+        return -1;
+    }
+
+    members = g_new0(qemuSnapshotGroupMember, ndoms);
+
+    /* The members can't reach the first barrier before all of them are
+     * started as it is guarded by the group lock */
+    VIR_WITH_MUTEX_LOCK_GUARD(&group.lock) {
+        for (i = 0; i < ndoms; i++) {
+            qemuSnapshotGroupMember *member = &members[i];
+
+            member->group = &group;
+            member->domain = doms[i];
+            member->vm = vms[i];
+            member->xmlDesc = xmlDescs[i];
+
+            if (virThreadCreateFull(&member->thread, true,
+                                    qemuSnapshotGroupMemberRun,
+                                    "snapshot-group", false, member) < 0) {
+                virReportSystemError(errno, "%s",
+                                     _("Unable to create snapshot thread"));
+                virErrorPreserveLast(&err);
+                group.failed = true;
+                break;
+            }
+            nmembers++;
+        }
+
+        group.nmembers = nmembers;
+    }
+
+    for (i = 0; i < nmembers; i++)
+        virThreadJoin(&members[i].thread);
+
+    virCondDestroy(&group.cond);
+    virMutexDestroy(&group.lock);
+
+    ret = g_new0(virDomainSnapshotPtr, ndoms + 1);
+    for (i = 0; i < nmembers; i++) {
+        ret[i] = members[i].snapshot;
+
+        if (!err)
+            err = g_steal_pointer(&members[i].err);
+        g_clear_pointer(&members[i].err, virFreeError);
+    }
+
+    if (err || nmembers < ndoms) {
+        virObjectListFreeCount(g_steal_pointer(&ret), nmembers);
+        virErrorRestore(&err);
+        return -1;
+    }
+
+    *snaps = g_steal_pointer(&ret);
+    return ndoms;
+}
+
+
 static int
 qemuSnapshotRevertValidate(virDomainObj *vm,
                            virDomainMomentObj *snap,
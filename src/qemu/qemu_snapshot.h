@@ -45,6 +45,15 @@ qemuSnapshotCreateXML(virDomainPtr domain,
                       const char *xmlDesc,
                       unsigned int flags);
 
+int
+qemuSnapshotCreateXMLList(virQEMUDriver *driver,
+                          virDomainPtr *doms,
+                          virDomainObj **vms,
+                          const char **xmlDescs,
+                          size_t ndoms,
+                          virDomainSnapshotPtr **snaps,
+                          unsigned int flags);
+
 int
 qemuSnapshotRevert(virDomainObj *vm,
                    virDomainSnapshotPtr snapshot,
@@ -3154,6 +3154,15 @@ qemuValidateDomainDeviceDefDisk(const virDomainDiskDef *disk,
     if (qemuValidateDomainDeviceDefDiskTransient(disk, def, qemuCaps) < 0)
         return -1;
 
+    if (disk->autoextend &&
+        (!virQEMUCapsGet(qemuCaps, QEMU_CAPS_BLOCKDEV) ||
+         !virQEMUCapsGet(qemuCaps, QEMU_CAPS_BLOCK_WRITE_THRESHOLD))) {
+        virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
+                       _("automatic extension of disk '%s' is not supported with this QEMU"),
+                       disk->dst);
+        return -1;
+    }
+
     if (disk->src->shared && !disk->src->readonly &&
         !qemuBlockStorageSourceSupportsConcurrentAccess(disk->src)) {
         virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
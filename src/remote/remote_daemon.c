@@ -47,6 +47,7 @@
 #include "virnetlink.h"
 #include "virnetdaemon.h"
 #include "remote_daemon_dispatch.h"
+#include "remote_daemon_metrics.h"
 #include "virhook.h"
 #include "viraudit.h"
 #include "virstring.h"
@@ -55,9 +56,12 @@
 #include "virutil.h"
 #include "virgettext.h"
 #include "util/virnetdevopenvswitch.h"
+#include "object_event.h"
 #include "virsystemd.h"
+#include "virhostcpu.h"
 #include "virhostuptime.h"
 #include "virdaemon.h"
+#include "vireventglib.h"
 
 #include "driver.h"
 
@@ -194,6 +198,43 @@ static int daemonInitialize(void)
 }
 
 
+/* Calls which keep a worker busy for as long as the job they run */
+static const int daemonSlowProcs[] = {
+    REMOTE_PROC_DOMAIN_CORE_DUMP,
+    REMOTE_PROC_DOMAIN_CORE_DUMP_WITH_FORMAT,
+    REMOTE_PROC_DOMAIN_MANAGED_SAVE,
+    REMOTE_PROC_DOMAIN_MIGRATE_PERFORM,
+    REMOTE_PROC_DOMAIN_MIGRATE_PERFORM3,
+    REMOTE_PROC_DOMAIN_MIGRATE_PERFORM3_PARAMS,
+    REMOTE_PROC_DOMAIN_RESTORE,
+    REMOTE_PROC_DOMAIN_RESTORE_FLAGS,
+    REMOTE_PROC_DOMAIN_RESTORE_PARAMS,
+    REMOTE_PROC_DOMAIN_SAVE,
+    REMOTE_PROC_DOMAIN_SAVE_FLAGS,
+    REMOTE_PROC_DOMAIN_SAVE_PARAMS,
+};
+
+/* Run the slow calls by their own workers only */
+static int
+daemonSetupSlowProcs(virNetServer *srv,
+                     unsigned int workers)
+{
+    int jobClass;
+    size_t i;
+
+    if (workers == 0)
+        return 0;
+
+    if ((jobClass = virNetServerAddJobClass(srv, "slow", workers, true)) < 0)
+        return -1;
+
+    for (i = 0; i < G_N_ELEMENTS(daemonSlowProcs); i++)
+        remoteProcs[daemonSlowProcs[i]].jobClass = jobClass;
+
+    return 0;
+}
+
+
 static int ATTRIBUTE_NONNULL(3)
 daemonSetupNetworking(virNetServer *srv,
                       virNetServer *srvAdm,
@@ -364,6 +405,9 @@ daemonSetupNetworking(virNetServer *srv,
                 return -1;
         }
 
+        virNetTLSContextSetSessionTicketRotation(ctxt,
+                                                 config->tls_session_ticket_rotation);
+
         VIR_DEBUG("Registering TLS socket %s:%s",
                   config->listen_addr, config->tls_port);
         if (virNetServerAddServiceTCP(srv,
@@ -403,6 +447,88 @@ daemonSetupNetworking(virNetServer *srv,
 }
 
 
+/*
+ * Set up the OpenMetrics endpoint, if enabled
+ */
+static int
+daemonSetupMetrics(virNetDaemon *dmn,
+                   struct daemonConfig *config,
+                   bool privileged G_GNUC_UNUSED)
+{
+    const char *uri = config->metrics_uri;
+    bool enabled = false;
+#ifdef MODULE_NAME
+    g_autofree char *defaultURI = NULL;
+#endif /* ! MODULE_NAME */
+
+    if (config->metrics_unix_sock) {
+        g_autoptr(virNetSocket) sock = NULL;
+        gid_t gid = 0;
+        int mask = 0;
+
+        if (config->unix_sock_group &&
+            virGetGroupID(config->unix_sock_group, &gid) < 0)
+            return -1;
+
+        if (virStrToLong_i(config->metrics_unix_sock_perms, NULL, 8, &mask) != 0) {
+            VIR_ERROR(_("Failed to parse mode '%s'"), config->metrics_unix_sock_perms);
+            return -1;
+        }
+
+        VIR_DEBUG("Serving metrics on %s", config->metrics_unix_sock);
+        if (virNetSocketNewListenUNIX(config->metrics_unix_sock,
+                                      mask, -1, gid, &sock) < 0 ||
+            virNetDaemonAddMetricsSocket(dmn, sock, false) < 0)
+            return -1;
+
+        enabled = true;
+    }
+
+#ifdef WITH_IP
+    if (config->metrics_tcp_port) {
+        virNetSocket **socks = NULL;
+        size_t nsocks = 0;
+        size_t i;
+        int rc = 0;
+
+        VIR_DEBUG("Serving metrics on %s:%s",
+                  NULLSTR(config->metrics_listen_addr), config->metrics_tcp_port);
+        if (virNetSocketNewListenTCP(config->metrics_listen_addr,
+                                     config->metrics_tcp_port,
+                                     AF_UNSPEC, &socks, &nsocks) < 0)
+            return -1;
+
+        for (i = 0; i < nsocks; i++) {
+            if (rc == 0)
+                rc = virNetDaemonAddMetricsSocket(dmn, socks[i],
+                                                  config->metrics_allow_unauthenticated_tcp);
+            virObjectUnref(socks[i]);
+        }
+        g_free(socks);
+
+        if (rc < 0)
+            return -1;
+
+        enabled = true;
+    }
+#endif /* ! WITH_IP */
+
+    if (!enabled)
+        return 0;
+
+#ifdef MODULE_NAME
+    if (!uri) {
+        defaultURI = g_strdup_printf("%s:///%s", MODULE_NAME,
+                                     privileged ? "system" : "session");
+        uri = defaultURI;
+    }
+#endif /* ! MODULE_NAME */
+
+    daemonMetricsInit(dmn, uri);
+    return 0;
+}
+
+
 /*
  * Set up the openvswitch timeout
  */
@@ -413,6 +539,28 @@ daemonSetupNetDevOpenvswitch(struct daemonConfig *config)
 }
 
 
+/*
+ * Set up the delivery policy of client event callbacks
+ */
+static void
+daemonSetupEvents(struct daemonConfig *config)
+{
+    virObjectEventSetDefaultPolicy(config->event_coalesce_interval,
+                                   config->event_max_queued);
+}
+
+
+/*
+ * Set up the detection of callbacks blocking the event loop, which
+ * virNetDaemonNew registers
+ */
+static void
+daemonSetupEventLoop(struct daemonConfig *config)
+{
+    virEventGLibSetSlowThreshold(config->event_loop_slow_threshold);
+}
+
+
 static int
 daemonSetupAccessManager(struct daemonConfig *config)
 {
@@ -930,6 +1078,7 @@ int main(int argc, char **argv) {
                               config->log_level,
                               config->log_filters,
                               config->log_outputs,
+                              config->log_async,
                               privileged,
                               verbose,
                               godaemon) < 0) {
@@ -947,6 +1096,8 @@ int main(int argc, char **argv) {
 
     daemonSetupNetDevOpenvswitch(config);
 
+    daemonSetupEvents(config);
+
     if (daemonSetupAccessManager(config) < 0) {
         VIR_ERROR(_("Can't initialize access manager"));
         exit(EXIT_FAILURE);
@@ -1025,6 +1176,8 @@ int main(int argc, char **argv) {
         goto cleanup;
     }
 
+    daemonSetupEventLoop(config);
+
     if (!(srv = virNetServerNew(DAEMON_NAME, 1,
                                 config->min_workers,
                                 config->max_workers,
@@ -1056,6 +1209,10 @@ int main(int argc, char **argv) {
     remoteProcs[REMOTE_PROC_AUTH_SASL_STEP].needAuth = false;
     remoteProcs[REMOTE_PROC_AUTH_SASL_START].needAuth = false;
     remoteProcs[REMOTE_PROC_AUTH_POLKIT].needAuth = false;
+    if (daemonSetupSlowProcs(srv, config->slow_workers) < 0) {
+        ret = VIR_DAEMON_ERR_INIT;
+        goto cleanup;
+    }
     if (!(remoteProgram = virNetServerProgramNew(REMOTE_PROGRAM,
                                                  REMOTE_PROTOCOL_VERSION,
                                                  remoteProcs,
@@ -1128,6 +1285,7 @@ int main(int argc, char **argv) {
     if (timeout > 0) {
         VIR_DEBUG("Registering shutdown timeout %d", timeout);
         virNetDaemonAutoShutdown(dmn, timeout);
+        virNetDaemonSetIdleStandby(dmn, config->idle_standby);
     }
 
     if ((daemonSetupSignals(dmn)) < 0) {
@@ -1178,6 +1336,11 @@ int main(int argc, char **argv) {
         goto cleanup;
     }
 
+    if (daemonSetupMetrics(dmn, config, privileged) < 0) {
+        ret = VIR_DAEMON_ERR_NETWORK;
+        goto cleanup;
+    }
+
     /* Tell parent of daemon that basic initialization is complete
      * In particular we're ready to accept net connections & have
      * written the pidfile
@@ -1208,6 +1371,13 @@ int main(int argc, char **argv) {
         ret = VIR_DAEMON_ERR_NETWORK;
         goto cleanup;
     }
+
+    /* Cache host topology until CPUs or memory are hotplugged */
+    if (virHostCPUTopologyWatch() < 0) {
+        VIR_WARN("Unable to watch host topology changes: %s",
+                 virGetLastErrorMessage());
+        virResetLastError();
+    }
 #endif
 
     /* Run event loop. */
@@ -50,6 +50,12 @@ struct daemonClientPrivate {
     size_t nnetworkEventCallbacks;
     daemonClientEventCallback **qemuEventCallbacks;
     size_t nqemuEventCallbacks;
+    daemonClientEventCallback **domainStatsCallbacks;
+    size_t ndomainStatsCallbacks;
+    daemonClientEventCallback **eventRingCallbacks;
+    size_t neventRingCallbacks;
+    daemonClientEventCallback **eventRingStatsCallbacks;
+    size_t neventRingStatsCallbacks;
     daemonClientEventCallback **storageEventCallbacks;
     size_t nstorageEventCallbacks;
     daemonClientEventCallback **nodeDeviceEventCallbacks;
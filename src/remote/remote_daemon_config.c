@@ -145,6 +145,7 @@ daemonConfigNew(bool privileged G_GNUC_UNUSED)
     data->max_anonymous_clients = 20;
 
     data->prio_workers = 5;
+    data->slow_workers = 0;
 
     data->max_client_requests = 5;
 
@@ -165,6 +166,11 @@ daemonConfigNew(bool privileged G_GNUC_UNUSED)
 
     data->ovs_timeout = VIR_NETDEV_OVS_DEFAULT_TIMEOUT;
 
+    data->metrics_unix_sock_perms = g_strdup("0700");
+#ifdef WITH_IP
+    data->metrics_listen_addr = g_strdup("127.0.0.1");
+#endif /* ! WITH_IP */
+
     return data;
 }
 
@@ -222,6 +228,15 @@ daemonConfigFree(struct daemonConfig *data)
     g_free(data->host_uuid_source);
     g_free(data->log_filters);
     g_free(data->log_outputs);
+    g_free(data->log_async);
+
+    g_free(data->metrics_unix_sock);
+    g_free(data->metrics_unix_sock_perms);
+#ifdef WITH_IP
+    g_free(data->metrics_tcp_port);
+    g_free(data->metrics_listen_addr);
+#endif /* ! WITH_IP */
+    g_free(data->metrics_uri);
 
     g_free(data);
 }
@@ -305,6 +320,10 @@ daemonConfigLoadOptions(struct daemonConfig *data,
     if (virConfGetValueString(conf, "tls_priority", &data->tls_priority) < 0)
         return -1;
 
+    if (virConfGetValueUInt(conf, "tls_session_ticket_rotation",
+                            &data->tls_session_ticket_rotation) < 0)
+        return -1;
+
     if ((rc = virConfGetValueUInt(conf, "tcp_min_ssf", &data->tcp_min_ssf)) < 0) {
         return -1;
     } else if (rc > 0 && data->tcp_min_ssf < SSF_WARNING_LEVEL) {
@@ -339,9 +358,15 @@ daemonConfigLoadOptions(struct daemonConfig *data,
     if (virConfGetValueUInt(conf, "prio_workers", &data->prio_workers) < 0)
         return -1;
 
+    if (virConfGetValueUInt(conf, "slow_workers", &data->slow_workers) < 0)
+        return -1;
+
     if (virConfGetValueUInt(conf, "max_client_requests", &data->max_client_requests) < 0)
         return -1;
 
+    if (virConfGetValueBool(conf, "idle_standby", &data->idle_standby) < 0)
+        return -1;
+
     if (virConfGetValueUInt(conf, "admin_min_workers", &data->admin_min_workers) < 0)
         return -1;
     if (virConfGetValueUInt(conf, "admin_max_workers", &data->admin_max_workers) < 0)
@@ -369,6 +394,8 @@ daemonConfigLoadOptions(struct daemonConfig *data,
         return -1;
     if (virConfGetValueString(conf, "log_outputs", &data->log_outputs) < 0)
         return -1;
+    if (virConfGetValueString(conf, "log_async", &data->log_async) < 0)
+        return -1;
 
     if (virConfGetValueInt(conf, "keepalive_interval", &data->keepalive_interval) < 0)
         return -1;
@@ -380,9 +407,37 @@ daemonConfigLoadOptions(struct daemonConfig *data,
     if (virConfGetValueUInt(conf, "admin_keepalive_count", &data->admin_keepalive_count) < 0)
         return -1;
 
+    if (virConfGetValueUInt(conf, "event_coalesce_interval", &data->event_coalesce_interval) < 0)
+        return -1;
+    if (virConfGetValueUInt(conf, "event_max_queued", &data->event_max_queued) < 0)
+        return -1;
+    if (data->event_max_queued && !data->event_coalesce_interval) {
+        virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
+                       _("'event_max_queued' requires 'event_coalesce_interval'"));
+        return -1;
+    }
+    if (virConfGetValueUInt(conf, "event_loop_slow_threshold", &data->event_loop_slow_threshold) < 0)
+        return -1;
+
     if (virConfGetValueUInt(conf, "ovs_timeout", &data->ovs_timeout) < 0)
         return -1;
 
+    if (virConfGetValueString(conf, "metrics_unix_sock", &data->metrics_unix_sock) < 0)
+        return -1;
+    if (virConfGetValueString(conf, "metrics_unix_sock_perms", &data->metrics_unix_sock_perms) < 0)
+        return -1;
+#ifdef WITH_IP
+    if (virConfGetValueString(conf, "metrics_tcp_port", &data->metrics_tcp_port) < 0)
+        return -1;
+    if (virConfGetValueString(conf, "metrics_listen_addr", &data->metrics_listen_addr) < 0)
+        return -1;
+    if (virConfGetValueBool(conf, "metrics_allow_unauthenticated_tcp",
+                            &data->metrics_allow_unauthenticated_tcp) < 0)
+        return -1;
+#endif /* ! WITH_IP */
+    if (virConfGetValueString(conf, "metrics_uri", &data->metrics_uri) < 0)
+        return -1;
+
     return 0;
 }
 
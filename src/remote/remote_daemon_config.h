@@ -56,6 +56,7 @@ struct daemonConfig {
     bool tls_no_sanity_certificate;
     char **tls_allowed_dn_list;
     char *tls_priority;
+    unsigned int tls_session_ticket_rotation;
     unsigned int tcp_min_ssf;
 
     char *key_file;
@@ -73,12 +74,16 @@ struct daemonConfig {
     unsigned int max_anonymous_clients;
 
     unsigned int prio_workers;
+    unsigned int slow_workers;
 
     unsigned int max_client_requests;
 
+    bool idle_standby;
+
     unsigned int log_level;
     char *log_filters;
     char *log_outputs;
+    char *log_async;
 
     unsigned int audit_level;
     bool audit_logging;
@@ -95,7 +100,20 @@ struct daemonConfig {
     int admin_keepalive_interval;
     unsigned int admin_keepalive_count;
 
+    unsigned int event_coalesce_interval;
+    unsigned int event_max_queued;
+    unsigned int event_loop_slow_threshold;
+
     unsigned int ovs_timeout;
+
+    char *metrics_unix_sock;
+    char *metrics_unix_sock_perms;
+#ifdef WITH_IP
+    char *metrics_tcp_port;
+    char *metrics_listen_addr;
+    bool metrics_allow_unauthenticated_tcp;
+#endif /* ! WITH_IP */
+    char *metrics_uri;
 };
 
 
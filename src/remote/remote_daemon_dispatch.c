@@ -49,6 +49,7 @@
 #include "viraccessapicheckqemu.h"
 #include "virpolkit.h"
 #include "virthreadjob.h"
+#include "virshmring.h"
 #include "configmake.h"
 
 #define VIR_FROM_THIS VIR_FROM_RPC
@@ -80,6 +81,7 @@ struct daemonClientEventCallback {
     int eventID;
     int callbackID;
     bool legacy;
+    virShmRing *ring; /* publish to this instead of sending messages */
 };
 
 static virDomainPtr get_nonnull_domain(virConnectPtr conn, remote_nonnull_domain domain);
@@ -151,6 +153,7 @@ remoteEventCallbackFree(void *opaque)
         return;
     virObjectUnref(callback->program);
     virObjectUnref(callback->client);
+    virObjectUnref(callback->ring);
     g_free(callback);
 }
 
@@ -310,6 +313,32 @@ remoteRelayDomainQemuMonitorEventCheckACL(virNetServerClient *client,
     return ret;
 }
 
+static bool
+remoteRelayDomainStatsCheckACL(virNetServerClient *client,
+                               virConnectPtr conn, virDomainPtr dom)
+{
+    virDomainDef def;
+    g_autoptr(virIdentity) identity = NULL;
+    bool ret = false;
+
+    /* For now, we just create a virDomainDef with enough contents to
+     * satisfy what viraccessdriverpolkit.c references.  This is a bit
+     * fragile, but I don't know of anything better.  */
+    memset(&def, 0, sizeof(def));
+    def.name = dom->name;
+    memcpy(def.uuid, dom->uuid, VIR_UUID_BUFLEN);
+
+    if (!(identity = virNetServerClientGetIdentity(client)))
+        goto cleanup;
+    if (virIdentitySetCurrent(identity) < 0)
+        goto cleanup;
+    ret = virConnectDomainStatsRegisterCheckACL(conn, &def);
+
+ cleanup:
+    ignore_value(virIdentitySetCurrent(NULL));
+    return ret;
+}
+
 
 static int
 remoteRelayDomainEventLifecycle(virConnectPtr conn,
@@ -1672,6 +1701,264 @@ remoteRelayDomainQemuMonitorEvent(virConnectPtr conn,
     return;
 }
 
+static void
+remoteRelayDomainStats(virConnectPtr conn,
+                       virDomainPtr dom,
+                       virTypedParameterPtr params,
+                       int nparams,
+                       void *opaque)
+{
+    daemonClientEventCallback *callback = opaque;
+    remote_domain_event_callback_stats_msg data;
+
+    if (callback->callbackID < 0 ||
+        !remoteRelayDomainStatsCheckACL(callback->client, conn, dom))
+        return;
+
+    VIR_DEBUG("Relaying domain stats %s %d, callback %d, params %p %d",
+              dom->name, dom->id, callback->callbackID, params, nparams);
+
+    /* build return data */
+    memset(&data, 0, sizeof(data));
+
+    if (virTypedParamsSerialize(params, nparams,
+                                REMOTE_CONNECT_GET_ALL_DOMAIN_STATS_MAX,
+                                (struct _virTypedParameterRemote **) &data.params.params_val,
+                                &data.params.params_len,
+                                VIR_TYPED_PARAM_STRING_OKAY) < 0)
+        return;
+
+    data.callbackID = callback->callbackID;
+    make_nonnull_domain(&data.dom, dom);
+
+    remoteDispatchObjectEventSend(callback->client, callback->program,
+                                  REMOTE_PROC_DOMAIN_EVENT_CALLBACK_STATS,
+                                  (xdrproc_t)xdr_remote_domain_event_callback_stats_msg,
+                                  &data);
+}
+
+
+/* Size of the data area of event rings, enough for several seconds
+ * worth of events and stats of a busy host */
+#define REMOTE_EVENT_RING_SIZE (1024 * 1024)
+
+/* The public layout must match what virShmRing expects */
+G_STATIC_ASSERT(sizeof(virDomainEventRingHeader) == sizeof(virShmRingHeader));
+G_STATIC_ASSERT(offsetof(virDomainEventRingRecord, type) ==
+                offsetof(virShmRingRecord, type));
+G_STATIC_ASSERT((int)VIR_DOMAIN_EVENT_RING_RECORD_PADDING ==
+                VIR_SHM_RING_RECORD_PADDING);
+
+static size_t
+remoteEventRingStringSize(const char *str)
+{
+    return VIR_ROUND_UP(strlen(str) + 1, VIR_SHM_RING_ALIGN);
+}
+
+
+static void
+remoteEventRingAppendString(GByteArray *buf,
+                            const char *str)
+{
+    static const guint8 zeros[VIR_SHM_RING_ALIGN] = { 0 };
+    size_t len = strlen(str) + 1;
+
+    g_byte_array_append(buf, (const guint8 *)str, len);
+    g_byte_array_append(buf, zeros, remoteEventRingStringSize(str) - len);
+}
+
+
+/* Starts a record of an event ring with its @len bytes long fixed @part,
+ * which begins with virDomainEventRingRecord, followed by the name of
+ * @dom */
+static GByteArray *
+remoteEventRingRecordNew(virDomainPtr dom,
+                         void *part,
+                         size_t len)
+{
+    virDomainEventRingRecord *record = part;
+    GByteArray *buf = g_byte_array_new();
+
+    record->timestamp = g_get_real_time() / 1000;
+    memcpy(record->uuid, dom->uuid, VIR_UUID_BUFLEN);
+    record->id = dom->id;
+    record->name = len;
+
+    g_byte_array_append(buf, part, len);
+    remoteEventRingAppendString(buf, dom->name);
+
+    return buf;
+}
+
+
+static void
+remoteEventRingPublishEvent(virConnectPtr conn,
+                            virDomainPtr dom,
+                            daemonClientEventCallback *callback,
+                            long long data0,
+                            long long data1)
+{
+    virDomainEventRingEvent event = { 0 };
+    g_autoptr(GByteArray) buf = NULL;
+
+    if (callback->callbackID < 0 ||
+        !remoteRelayDomainEventCheckACL(callback->client, conn, dom))
+        return;
+
+    VIR_DEBUG("Publishing domain event %d of %s to event ring, callback %d",
+              callback->eventID, dom->name, callback->callbackID);
+
+    event.eventID = callback->eventID;
+    event.data[0] = data0;
+    event.data[1] = data1;
+
+    buf = remoteEventRingRecordNew(dom, &event, sizeof(event));
+    ignore_value(virShmRingAppend(callback->ring,
+                                  VIR_DOMAIN_EVENT_RING_RECORD_EVENT,
+                                  buf->data, buf->len));
+}
+
+
+static int
+remoteEventRingLifecycle(virConnectPtr conn,
+                         virDomainPtr dom,
+                         int event,
+                         int detail,
+                         void *opaque)
+{
+    remoteEventRingPublishEvent(conn, dom, opaque, event, detail);
+    return 0;
+}
+
+
+static int
+remoteEventRingNoData(virConnectPtr conn,
+                      virDomainPtr dom,
+                      void *opaque)
+{
+    remoteEventRingPublishEvent(conn, dom, opaque, 0, 0);
+    return 0;
+}
+
+
+static int
+remoteEventRingRTCChange(virConnectPtr conn,
+                         virDomainPtr dom,
+                         long long offset,
+                         void *opaque)
+{
+    remoteEventRingPublishEvent(conn, dom, opaque, offset, 0);
+    return 0;
+}
+
+
+static int
+remoteEventRingInt(virConnectPtr conn,
+                   virDomainPtr dom,
+                   int value,
+                   void *opaque)
+{
+    remoteEventRingPublishEvent(conn, dom, opaque, value, 0);
+    return 0;
+}
+
+
+static int
+remoteEventRingBalloonChange(virConnectPtr conn,
+                             virDomainPtr dom,
+                             unsigned long long actual,
+                             void *opaque)
+{
+    remoteEventRingPublishEvent(conn, dom, opaque, actual, 0);
+    return 0;
+}
+
+
+/* Events carrying nothing but numbers, which are published to event
+ * rings */
+static const struct {
+    int eventID;
+    virConnectDomainEventGenericCallback cb;
+} remoteEventRingCallbacks[] = {
+    { VIR_DOMAIN_EVENT_ID_LIFECYCLE, VIR_DOMAIN_EVENT_CALLBACK(remoteEventRingLifecycle) },
+    { VIR_DOMAIN_EVENT_ID_REBOOT, VIR_DOMAIN_EVENT_CALLBACK(remoteEventRingNoData) },
+    { VIR_DOMAIN_EVENT_ID_RTC_CHANGE, VIR_DOMAIN_EVENT_CALLBACK(remoteEventRingRTCChange) },
+    { VIR_DOMAIN_EVENT_ID_WATCHDOG, VIR_DOMAIN_EVENT_CALLBACK(remoteEventRingInt) },
+    { VIR_DOMAIN_EVENT_ID_CONTROL_ERROR, VIR_DOMAIN_EVENT_CALLBACK(remoteEventRingNoData) },
+    { VIR_DOMAIN_EVENT_ID_PMWAKEUP, VIR_DOMAIN_EVENT_CALLBACK(remoteEventRingInt) },
+    { VIR_DOMAIN_EVENT_ID_PMSUSPEND, VIR_DOMAIN_EVENT_CALLBACK(remoteEventRingInt) },
+    { VIR_DOMAIN_EVENT_ID_BALLOON_CHANGE, VIR_DOMAIN_EVENT_CALLBACK(remoteEventRingBalloonChange) },
+    { VIR_DOMAIN_EVENT_ID_PMSUSPEND_DISK, VIR_DOMAIN_EVENT_CALLBACK(remoteEventRingInt) },
+    { VIR_DOMAIN_EVENT_ID_AGENT_LIFECYCLE, VIR_DOMAIN_EVENT_CALLBACK(remoteEventRingLifecycle) },
+};
+
+
+static void
+remoteEventRingStats(virConnectPtr conn,
+                     virDomainPtr dom,
+                     virTypedParameterPtr params,
+                     int nparams,
+                     void *opaque)
+{
+    daemonClientEventCallback *callback = opaque;
+    virDomainEventRingStats stats = { 0 };
+    g_autoptr(GByteArray) buf = NULL;
+    size_t i;
+
+    if (callback->callbackID < 0 ||
+        !remoteRelayDomainStatsCheckACL(callback->client, conn, dom))
+        return;
+
+    VIR_DEBUG("Publishing %d domain stats of %s to event ring, callback %d",
+              nparams, dom->name, callback->callbackID);
+
+    stats.nparams = nparams;
+    stats.params = sizeof(stats) + remoteEventRingStringSize(dom->name);
+    buf = remoteEventRingRecordNew(dom, &stats, sizeof(stats));
+
+    for (i = 0; i < nparams; i++) {
+        virDomainEventRingParam param = { 0 };
+
+        param.length = sizeof(param) + remoteEventRingStringSize(params[i].field);
+        param.type = params[i].type;
+        switch ((virTypedParameterType) params[i].type) {
+        case VIR_TYPED_PARAM_INT:
+            param.value.i = params[i].value.i;
+            break;
+        case VIR_TYPED_PARAM_UINT:
+            param.value.ui = params[i].value.ui;
+            break;
+        case VIR_TYPED_PARAM_LLONG:
+            param.value.l = params[i].value.l;
+            break;
+        case VIR_TYPED_PARAM_ULLONG:
+            param.value.ul = params[i].value.ul;
+            break;
+        case VIR_TYPED_PARAM_DOUBLE:
+            param.value.d = params[i].value.d;
+            break;
+        case VIR_TYPED_PARAM_BOOLEAN:
+            param.value.b = params[i].value.b;
+            break;
+        case VIR_TYPED_PARAM_STRING:
+            param.value.s = param.length;
+            param.length += remoteEventRingStringSize(params[i].value.s);
+            break;
+        case VIR_TYPED_PARAM_LAST:
+            break;
+        }
+
+        g_byte_array_append(buf, (const guint8 *)&param, sizeof(param));
+        remoteEventRingAppendString(buf, params[i].field);
+        if (params[i].type == VIR_TYPED_PARAM_STRING)
+            remoteEventRingAppendString(buf, params[i].value.s);
+    }
+
+    ignore_value(virShmRingAppend(callback->ring,
+                                  VIR_DOMAIN_EVENT_RING_RECORD_STATS,
+                                  buf->data, buf->len));
+}
+
 static
 void remoteRelayConnectionClosedEvent(virConnectPtr conn G_GNUC_UNUSED, int reason, void *opaque)
 {
@@ -1711,6 +1998,19 @@ void remoteRelayConnectionClosedEvent(virConnectPtr conn G_GNUC_UNUSED, int reas
     } while (0);
 
 
+/* Stops publishing to the event ring of the client */
+static void
+remoteClientFreeEventRing(struct daemonClientPrivate *priv)
+{
+    DEREG_CB(priv->conn, priv->eventRingCallbacks,
+             priv->neventRingCallbacks,
+             virConnectDomainEventDeregisterAny, "event ring");
+    DEREG_CB(priv->conn, priv->eventRingStatsCallbacks,
+             priv->neventRingStatsCallbacks,
+             virConnectDomainStatsDeregister, "event ring stats");
+}
+
+
 static void
 remoteClientFreePrivateCallbacks(struct daemonClientPrivate *priv)
 {
@@ -1735,6 +2035,10 @@ remoteClientFreePrivateCallbacks(struct daemonClientPrivate *priv)
     DEREG_CB(priv->conn, priv->qemuEventCallbacks,
              priv->nqemuEventCallbacks,
              virConnectDomainQemuMonitorEventDeregister, "qemu monitor");
+    DEREG_CB(priv->conn, priv->domainStatsCallbacks,
+             priv->ndomainStatsCallbacks,
+             virConnectDomainStatsDeregister, "domain stats");
+    remoteClientFreeEventRing(priv);
 
     if (priv->closeRegistered && priv->conn) {
         if (virConnectUnregisterCloseCallback(priv->conn,
@@ -4605,30 +4909,63 @@ remoteDispatchConnectDomainEventCallbackDeregisterAny(virNetServer *server G_GNU
 
 
 static int
-qemuDispatchDomainMonitorCommand(virNetServer *server G_GNUC_UNUSED,
-                                 virNetServerClient *client,
-                                 virNetMessage *msg G_GNUC_UNUSED,
-                                 struct virNetMessageError *rerr,
-                                 qemu_domain_monitor_command_args *args,
-                                 qemu_domain_monitor_command_ret *ret)
+remoteDispatchConnectDomainStatsRegister(virNetServer *server G_GNUC_UNUSED,
+                                         virNetServerClient *client,
+                                         virNetMessage *msg G_GNUC_UNUSED,
+                                         struct virNetMessageError *rerr G_GNUC_UNUSED,
+                                         remote_connect_domain_stats_register_args *args,
+                                         remote_connect_domain_stats_register_ret *ret)
 {
-    virDomainPtr dom = NULL;
+    int callbackID;
     int rv = -1;
+    daemonClientEventCallback *callback = NULL;
+    daemonClientEventCallback *ref;
+    struct daemonClientPrivate *priv =
+        virNetServerClientGetPrivateData(client);
+    virDomainPtr dom = NULL;
     virConnectPtr conn = remoteGetHypervisorConn(client);
+    VIR_LOCK_GUARD lock = virLockGuardLock(&priv->lock);
 
     if (!conn)
         goto cleanup;
 
-    if (!(dom = get_nonnull_domain(conn, args->dom)))
+    if (args->dom &&
+        !(dom = get_nonnull_domain(conn, *args->dom)))
         goto cleanup;
 
-    if (virDomainQemuMonitorCommand(dom, args->cmd, &ret->result,
-                                    args->flags) < 0)
+    /* See qemuDispatchConnectDomainMonitorEventRegister for why an
+     * incomplete callback is appended before registering. */
+    callback = g_new0(daemonClientEventCallback, 1);
+    callback->client = virObjectRef(client);
+    callback->program = virObjectRef(remoteProgram);
+    callback->eventID = -1;
+    callback->callbackID = -1;
+    ref = callback;
+    VIR_APPEND_ELEMENT(priv->domainStatsCallbacks,
+                       priv->ndomainStatsCallbacks,
+                       callback);
+
+    if ((callbackID = virConnectDomainStatsRegister(conn,
+                                                    dom,
+                                                    args->stats,
+                                                    args->interval,
+                                                    remoteRelayDomainStats,
+                                                    ref,
+                                                    remoteEventCallbackFree,
+                                                    args->flags)) < 0) {
+        VIR_SHRINK_N(priv->domainStatsCallbacks,
+                     priv->ndomainStatsCallbacks, 1);
+        callback = ref;
         goto cleanup;
+    }
+
+    ref->callbackID = callbackID;
+    ret->callbackID = callbackID;
 
     rv = 0;
 
  cleanup:
+    remoteEventCallbackFree(callback);
     if (rv < 0)
         virNetMessageSaveError(rerr);
     virObjectUnref(dom);
@@ -4637,81 +4974,278 @@ qemuDispatchDomainMonitorCommand(virNetServer *server G_GNUC_UNUSED,
 
 
 static int
-qemuDispatchDomainMonitorCommandWithFiles(virNetServer *server G_GNUC_UNUSED,
-                                          virNetServerClient *client,
-                                          virNetMessage *msg,
-                                          struct virNetMessageError *rerr,
-                                          qemu_domain_monitor_command_with_files_args *args,
-                                          qemu_domain_monitor_command_with_files_ret *ret)
+remoteDispatchConnectDomainStatsDeregister(virNetServer *server G_GNUC_UNUSED,
+                                           virNetServerClient *client,
+                                           virNetMessage *msg G_GNUC_UNUSED,
+                                           struct virNetMessageError *rerr G_GNUC_UNUSED,
+                                           remote_connect_domain_stats_deregister_args *args)
 {
-    virDomainPtr dom = NULL;
-    g_autofree int *infiles = NULL;
-    unsigned int ninfiles = 0;
-    int *outfiles = NULL;
-    unsigned int noutfiles = 0;
-    int rv = -1;
-    virConnectPtr conn = remoteGetHypervisorConn(client);
     size_t i;
+    struct daemonClientPrivate *priv =
+        virNetServerClientGetPrivateData(client);
+    virConnectPtr conn = remoteGetHypervisorConn(client);
+    VIR_LOCK_GUARD lock = virLockGuardLock(&priv->lock);
 
     if (!conn)
         goto cleanup;
 
-    if (!(dom = get_nonnull_domain(conn, args->dom)))
+    for (i = 0; i < priv->ndomainStatsCallbacks; i++) {
+        if (priv->domainStatsCallbacks[i]->callbackID == args->callbackID)
+            break;
+    }
+    if (i == priv->ndomainStatsCallbacks) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("domain stats callback %d not registered"),
+                       args->callbackID);
         goto cleanup;
-
-    infiles = g_new0(int, msg->nfds);
-    for (i = 0; i < msg->nfds; i++) {
-        if ((infiles[i] = virNetMessageDupFD(msg, i)) < 0)
-            goto cleanup;
-        ninfiles++;
     }
 
-    /* This API can both receive FDs from the client and send FDs back, but 'msg'
-     * is being reused. Thus we must clear the list of FDs in it to prevent
-     * us sending back the FDs client sent us. */
-    virNetMessageClearFDs(msg);
-
-    if (virDomainQemuMonitorCommandWithFiles(dom, args->cmd, ninfiles, infiles,
-                                             &noutfiles, &outfiles,
-                                             &ret->result, args->flags) < 0)
+    if (virConnectDomainStatsDeregister(conn, args->callbackID) < 0)
         goto cleanup;
 
-    for (i = 0; i < noutfiles; i++) {
-        if (virNetMessageAddFD(msg, outfiles[i]) < 0)
-            goto cleanup;
-    }
+    VIR_DELETE_ELEMENT(priv->domainStatsCallbacks, i,
+                       priv->ndomainStatsCallbacks);
 
-    /* return 1 here to let virNetServerProgramDispatchCall know we are passing fds */
-    if (noutfiles > 0)
-        rv = 1;
-    else
-        rv = 0;
+    return 0;
 
  cleanup:
-    for (i = 0; i < ninfiles; i++)
-        VIR_FORCE_CLOSE(infiles[i]);
-
-    for (i = 0; i < noutfiles; i++)
-        VIR_FORCE_CLOSE(outfiles[i]);
-
-    if (rv < 0)
-        virNetMessageSaveError(rerr);
-    virObjectUnref(dom);
-    return rv;
+    virNetMessageSaveError(rerr);
+    return -1;
 }
 
 
 static int
-remoteDispatchDomainMigrateBegin3(virNetServer *server G_GNUC_UNUSED,
-                                  virNetServerClient *client,
-                                  virNetMessage *msg G_GNUC_UNUSED,
-                                  struct virNetMessageError *rerr,
-                                  remote_domain_migrate_begin3_args *args,
-                                  remote_domain_migrate_begin3_ret *ret)
+remoteDispatchConnectDomainEventRingOpen(virNetServer *server G_GNUC_UNUSED,
+                                         virNetServerClient *client,
+                                         virNetMessage *msg,
+                                         struct virNetMessageError *rerr,
+                                         remote_connect_domain_event_ring_open_args *args)
 {
-    char *xml = NULL;
-    virDomainPtr dom = NULL;
-    char *dname;
+    g_autoptr(virShmRing) ring = NULL;
+    daemonClientEventCallback *callback = NULL;
+    daemonClientEventCallback *ref;
+    struct daemonClientPrivate *priv =
+        virNetServerClientGetPrivateData(client);
+    virConnectPtr conn = remoteGetHypervisorConn(client);
+    VIR_LOCK_GUARD lock = virLockGuardLock(&priv->lock);
+    virErrorPtr orig_err;
+    int callbackID;
+    int fd = -1;
+    int rv = -1;
+    size_t i;
+
+    if (!conn)
+        goto cleanup;
+
+    /* The shared memory can't be used by remote clients anyway, but
+     * they can't even receive file descriptors */
+    if (!virNetServerClientIsLocal(client)) {
+        virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                       _("event ring is only available to local clients"));
+        goto cleanup;
+    }
+
+    if (priv->neventRingCallbacks > 0) {
+        virReportError(VIR_ERR_OPERATION_INVALID, "%s",
+                       _("event ring is already open"));
+        goto cleanup;
+    }
+
+    if (!(ring = virShmRingNew("libvirt-event-ring",
+                               VIR_DOMAIN_EVENT_RING_MAGIC,
+                               VIR_DOMAIN_EVENT_RING_VERSION,
+                               REMOTE_EVENT_RING_SIZE)))
+        goto cleanup;
+
+    /* See qemuDispatchConnectDomainMonitorEventRegister for why an
+     * incomplete callback is appended before registering. */
+    for (i = 0; i < G_N_ELEMENTS(remoteEventRingCallbacks); i++) {
+        callback = g_new0(daemonClientEventCallback, 1);
+        callback->client = virObjectRef(client);
+        callback->program = virObjectRef(remoteProgram);
+        callback->ring = virObjectRef(ring);
+        callback->eventID = remoteEventRingCallbacks[i].eventID;
+        callback->callbackID = -1;
+        ref = callback;
+        VIR_APPEND_ELEMENT(priv->eventRingCallbacks,
+                           priv->neventRingCallbacks,
+                           callback);
+
+        if ((callbackID = virConnectDomainEventRegisterAny(conn,
+                                                           NULL,
+                                                           ref->eventID,
+                                                           remoteEventRingCallbacks[i].cb,
+                                                           ref,
+                                                           remoteEventCallbackFree)) < 0) {
+            VIR_SHRINK_N(priv->eventRingCallbacks,
+                         priv->neventRingCallbacks, 1);
+            callback = ref;
+            goto cleanup;
+        }
+
+        ref->callbackID = callbackID;
+    }
+
+    if (args->interval > 0) {
+        callback = g_new0(daemonClientEventCallback, 1);
+        callback->client = virObjectRef(client);
+        callback->program = virObjectRef(remoteProgram);
+        callback->ring = virObjectRef(ring);
+        callback->eventID = -1;
+        callback->callbackID = -1;
+        ref = callback;
+        VIR_APPEND_ELEMENT(priv->eventRingStatsCallbacks,
+                           priv->neventRingStatsCallbacks,
+                           callback);
+
+        if ((callbackID = virConnectDomainStatsRegister(conn,
+                                                        NULL,
+                                                        args->stats,
+                                                        args->interval,
+                                                        remoteEventRingStats,
+                                                        ref,
+                                                        remoteEventCallbackFree,
+                                                        args->flags)) < 0) {
+            VIR_SHRINK_N(priv->eventRingStatsCallbacks,
+                         priv->neventRingStatsCallbacks, 1);
+            callback = ref;
+            goto cleanup;
+        }
+
+        ref->callbackID = callbackID;
+    }
+
+    if ((fd = virShmRingGetReadOnlyFD(ring)) < 0)
+        goto cleanup;
+
+    if (virNetMessageAddFD(msg, fd) < 0)
+        goto cleanup;
+
+    /* return 1 here to let virNetServerProgramDispatchCall know
+     * we are passing a FD */
+    rv = 1;
+
+ cleanup:
+    VIR_FORCE_CLOSE(fd);
+    remoteEventCallbackFree(callback);
+    if (rv < 0) {
+        virErrorPreserveLast(&orig_err);
+        remoteClientFreeEventRing(priv);
+        virErrorRestore(&orig_err);
+        virNetMessageSaveError(rerr);
+    }
+    return rv;
+}
+
+
+static int
+qemuDispatchDomainMonitorCommand(virNetServer *server G_GNUC_UNUSED,
+                                 virNetServerClient *client,
+                                 virNetMessage *msg G_GNUC_UNUSED,
+                                 struct virNetMessageError *rerr,
+                                 qemu_domain_monitor_command_args *args,
+                                 qemu_domain_monitor_command_ret *ret)
+{
+    virDomainPtr dom = NULL;
+    int rv = -1;
+    virConnectPtr conn = remoteGetHypervisorConn(client);
+
+    if (!conn)
+        goto cleanup;
+
+    if (!(dom = get_nonnull_domain(conn, args->dom)))
+        goto cleanup;
+
+    if (virDomainQemuMonitorCommand(dom, args->cmd, &ret->result,
+                                    args->flags) < 0)
+        goto cleanup;
+
+    rv = 0;
+
+ cleanup:
+    if (rv < 0)
+        virNetMessageSaveError(rerr);
+    virObjectUnref(dom);
+    return rv;
+}
+
+
+static int
+qemuDispatchDomainMonitorCommandWithFiles(virNetServer *server G_GNUC_UNUSED,
+                                          virNetServerClient *client,
+                                          virNetMessage *msg,
+                                          struct virNetMessageError *rerr,
+                                          qemu_domain_monitor_command_with_files_args *args,
+                                          qemu_domain_monitor_command_with_files_ret *ret)
+{
+    virDomainPtr dom = NULL;
+    g_autofree int *infiles = NULL;
+    unsigned int ninfiles = 0;
+    int *outfiles = NULL;
+    unsigned int noutfiles = 0;
+    int rv = -1;
+    virConnectPtr conn = remoteGetHypervisorConn(client);
+    size_t i;
+
+    if (!conn)
+        goto cleanup;
+
+    if (!(dom = get_nonnull_domain(conn, args->dom)))
+        goto cleanup;
+
+    infiles = g_new0(int, msg->nfds);
+    for (i = 0; i < msg->nfds; i++) {
+        if ((infiles[i] = virNetMessageDupFD(msg, i)) < 0)
+            goto cleanup;
+        ninfiles++;
+    }
+
+    /* This API can both receive FDs from the client and send FDs back, but 'msg'
+     * is being reused. Thus we must clear the list of FDs in it to prevent
+     * us sending back the FDs client sent us. */
+    virNetMessageClearFDs(msg);
+
+    if (virDomainQemuMonitorCommandWithFiles(dom, args->cmd, ninfiles, infiles,
+                                             &noutfiles, &outfiles,
+                                             &ret->result, args->flags) < 0)
+        goto cleanup;
+
+    for (i = 0; i < noutfiles; i++) {
+        if (virNetMessageAddFD(msg, outfiles[i]) < 0)
+            goto cleanup;
+    }
+
+    /* return 1 here to let virNetServerProgramDispatchCall know we are passing fds */
+    if (noutfiles > 0)
+        rv = 1;
+    else
+        rv = 0;
+
+ cleanup:
+    for (i = 0; i < ninfiles; i++)
+        VIR_FORCE_CLOSE(infiles[i]);
+
+    for (i = 0; i < noutfiles; i++)
+        VIR_FORCE_CLOSE(outfiles[i]);
+
+    if (rv < 0)
+        virNetMessageSaveError(rerr);
+    virObjectUnref(dom);
+    return rv;
+}
+
+
+static int
+remoteDispatchDomainMigrateBegin3(virNetServer *server G_GNUC_UNUSED,
+                                  virNetServerClient *client,
+                                  virNetMessage *msg G_GNUC_UNUSED,
+                                  struct virNetMessageError *rerr,
+                                  remote_domain_migrate_begin3_args *args,
+                                  remote_domain_migrate_begin3_ret *ret)
+{
+    char *xml = NULL;
+    virDomainPtr dom = NULL;
+    char *dname;
     char *xmlin;
     char *cookieout = NULL;
     int cookieoutlen = 0;
@@ -4966,6 +5500,7 @@ static int remoteDispatchConnectSupportsFeature(virNetServer *server G_GNUC_UNUS
     case VIR_DRV_FEATURE_FD_PASSING:
     case VIR_DRV_FEATURE_REMOTE_EVENT_CALLBACK:
     case VIR_DRV_FEATURE_REMOTE_CLOSE_CALLBACK:
+    case VIR_DRV_FEATURE_REMOTE_COMPACT_DOMAIN_STATS:
         supported = 1;
         break;
     case VIR_DRV_FEATURE_MIGRATION_V1:
@@ -6702,6 +7237,48 @@ remoteDispatchNetworkGetDHCPLeases(virNetServer *server G_GNUC_UNUSED,
 }
 
 
+static int
+remoteDispatchGetDomainStats(virConnectPtr conn,
+                             remote_nonnull_domain *rdoms,
+                             unsigned int nrdoms,
+                             unsigned int stats,
+                             virDomainStatsRecordPtr **retStats,
+                             unsigned int flags)
+{
+    virDomainPtr *doms = NULL;
+    int nrecords = -1;
+    size_t i;
+
+    if (nrdoms) {
+        doms = g_new0(virDomainPtr, nrdoms + 1);
+
+        for (i = 0; i < nrdoms; i++) {
+            if (!(doms[i] = get_nonnull_domain(conn, rdoms[i])))
+                goto cleanup;
+        }
+
+        if ((nrecords = virDomainListGetStats(doms, stats, retStats, flags)) < 0)
+            goto cleanup;
+    } else {
+        if ((nrecords = virConnectGetAllDomainStats(conn, stats, retStats, flags)) < 0)
+            goto cleanup;
+    }
+
+    if (nrecords > REMOTE_DOMAIN_LIST_MAX) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Number of domain stats records is %d, "
+                         "which exceeds max limit: %d"),
+                       nrecords, REMOTE_DOMAIN_LIST_MAX);
+        g_clear_pointer(retStats, virDomainStatsRecordListFree);
+        nrecords = -1;
+    }
+
+ cleanup:
+    virObjectListFree(doms);
+    return nrecords;
+}
+
+
 static int
 remoteDispatchConnectGetAllDomainStats(virNetServer *server G_GNUC_UNUSED,
                                        virNetServerClient *client,
@@ -6714,42 +7291,20 @@ remoteDispatchConnectGetAllDomainStats(virNetServer *server G_GNUC_UNUSED,
     size_t i;
     virDomainStatsRecordPtr *retStats = NULL;
     int nrecords = 0;
-    virDomainPtr *doms = NULL;
     virConnectPtr conn = remoteGetHypervisorConn(client);
 
     if (!conn)
         goto cleanup;
 
-    if (args->doms.doms_len) {
-        doms = g_new0(virDomainPtr, args->doms.doms_len + 1);
-
-        for (i = 0; i < args->doms.doms_len; i++) {
-            if (!(doms[i] = get_nonnull_domain(conn, args->doms.doms_val[i])))
-                goto cleanup;
-        }
-
-        if ((nrecords = virDomainListGetStats(doms,
-                                              args->stats,
-                                              &retStats,
-                                              args->flags)) < 0)
-            goto cleanup;
-    } else {
-        if ((nrecords = virConnectGetAllDomainStats(conn,
-                                                    args->stats,
-                                                    &retStats,
-                                                    args->flags)) < 0)
-            goto cleanup;
-    }
+    if ((nrecords = remoteDispatchGetDomainStats(conn,
+                                                 args->doms.doms_val,
+                                                 args->doms.doms_len,
+                                                 args->stats,
+                                                 &retStats,
+                                                 args->flags)) < 0)
+        goto cleanup;
 
     if (nrecords) {
-        if (nrecords > REMOTE_DOMAIN_LIST_MAX) {
-            virReportError(VIR_ERR_INTERNAL_ERROR,
-                           _("Number of domain stats records is %d, "
-                             "which exceeds max limit: %d"),
-                           nrecords, REMOTE_DOMAIN_LIST_MAX);
-            goto cleanup;
-        }
-
         ret->retStats.retStats_val = g_new0(remote_domain_stats_record, nrecords);
         ret->retStats.retStats_len = nrecords;
 
@@ -6781,12 +7336,171 @@ remoteDispatchConnectGetAllDomainStats(virNetServer *server G_GNUC_UNUSED,
     }
 
     virDomainStatsRecordListFree(retStats);
-    virObjectListFree(doms);
 
     return rv;
 }
 
 
+/*
+ * Same as remoteDispatchConnectGetAllDomainStats, except that each distinct
+ * field name is sent once in the @fields array of the reply and the stats
+ * records refer to it by index. Bulk stats of many domains repeat the same
+ * few hundred names over and over, which otherwise dominate the payload.
+ */
+static int
+remoteDispatchConnectGetAllDomainStatsCompact(virNetServer *server G_GNUC_UNUSED,
+                                              virNetServerClient *client,
+                                              virNetMessage *msg G_GNUC_UNUSED,
+                                              struct virNetMessageError *rerr,
+                                              remote_connect_get_all_domain_stats_compact_args *args,
+                                              remote_connect_get_all_domain_stats_compact_ret *ret)
+{
+    int rv = -1;
+    size_t i;
+    size_t j;
+    virDomainStatsRecordPtr *retStats = NULL;
+    int nrecords = 0;
+    g_autoptr(GHashTable) fieldIndex = g_hash_table_new(g_str_hash, g_str_equal);
+    g_autoptr(GPtrArray) fields = g_ptr_array_new();
+    virConnectPtr conn = remoteGetHypervisorConn(client);
+
+    if (!conn)
+        goto cleanup;
+
+    if ((nrecords = remoteDispatchGetDomainStats(conn,
+                                                 args->doms.doms_val,
+                                                 args->doms.doms_len,
+                                                 args->stats,
+                                                 &retStats,
+                                                 args->flags)) < 0)
+        goto cleanup;
+
+    ret->retStats.retStats_val = g_new0(remote_domain_stats_compact_record, nrecords);
+    ret->retStats.retStats_len = nrecords;
+
+    for (i = 0; i < nrecords; i++) {
+        remote_domain_stats_compact_record *dst = ret->retStats.retStats_val + i;
+        remote_typed_param *params = NULL;
+        unsigned int nparams = 0;
+
+        make_nonnull_domain(&dst->dom, retStats[i]->dom);
+
+        if (virTypedParamsSerialize(retStats[i]->params,
+                                    retStats[i]->nparams,
+                                    REMOTE_CONNECT_GET_ALL_DOMAIN_STATS_MAX,
+                                    (struct _virTypedParameterRemote **) &params,
+                                    &nparams,
+                                    VIR_TYPED_PARAM_STRING_OKAY) < 0)
+            goto cleanup;
+
+        dst->params.params_val = g_new0(remote_domain_stats_compact_param, nparams);
+        dst->params.params_len = nparams;
+
+        /* Move the values over and replace the names by their index in the
+         * dictionary, which takes ownership of the first copy of each name */
+        for (j = 0; j < nparams; j++) {
+            void *idx;
+
+            if (g_hash_table_lookup_extended(fieldIndex, params[j].field,
+                                             NULL, &idx)) {
+                g_free(params[j].field);
+            } else {
+                idx = GUINT_TO_POINTER(fields->len);
+                g_hash_table_insert(fieldIndex, params[j].field, idx);
+                g_ptr_array_add(fields, params[j].field);
+            }
+
+            dst->params.params_val[j].field = GPOINTER_TO_UINT(idx);
+            dst->params.params_val[j].value = params[j].value;
+        }
+
+        g_free(params);
+    }
+
+    if (fields->len > REMOTE_CONNECT_GET_ALL_DOMAIN_STATS_MAX) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Number of domain stats fields is %u, "
+                         "which exceeds max limit: %d"),
+                       fields->len, REMOTE_CONNECT_GET_ALL_DOMAIN_STATS_MAX);
+        goto cleanup;
+    }
+
+    rv = 0;
+
+ cleanup:
+    /* the strings are owned by @fields from here on, free them along with
+     * the reply on error */
+    ret->fields.fields_len = fields->len;
+    ret->fields.fields_val = (char **) g_ptr_array_free(g_steal_pointer(&fields), FALSE);
+
+    if (rv < 0) {
+        virNetMessageSaveError(rerr);
+        xdr_free((xdrproc_t)xdr_remote_connect_get_all_domain_stats_compact_ret,
+                 (char *) ret);
+    }
+
+    virDomainStatsRecordListFree(retStats);
+
+    return rv;
+}
+
+
+static int
+remoteDispatchDomainListSnapshotCreateXML(virNetServer *server G_GNUC_UNUSED,
+                                          virNetServerClient *client,
+                                          virNetMessage *msg G_GNUC_UNUSED,
+                                          struct virNetMessageError *rerr,
+                                          remote_domain_list_snapshot_create_xml_args *args,
+                                          remote_domain_list_snapshot_create_xml_ret *ret)
+{
+    int rv = -1;
+    size_t i;
+    virDomainPtr *doms = NULL;
+    const char **xmlDescs = NULL;
+    virDomainSnapshotPtr *snaps = NULL;
+    int nsnaps = 0;
+    virConnectPtr conn = remoteGetHypervisorConn(client);
+
+    if (!conn)
+        goto cleanup;
+
+    if (args->doms.doms_len != args->xml_descs.xml_descs_len) {
+        virReportError(VIR_ERR_INVALID_ARG, "%s",
+                       _("Number of domains and snapshot descriptions differ"));
+        goto cleanup;
+    }
+
+    doms = g_new0(virDomainPtr, args->doms.doms_len + 1);
+    xmlDescs = g_new0(const char *, args->doms.doms_len + 1);
+
+    for (i = 0; i < args->doms.doms_len; i++) {
+        if (!(doms[i] = get_nonnull_domain(conn, args->doms.doms_val[i])))
+            goto cleanup;
+        xmlDescs[i] = args->xml_descs.xml_descs_val[i];
+    }
+
+    if ((nsnaps = virDomainListSnapshotCreateXML(doms, xmlDescs, &snaps,
+                                                 args->flags)) < 0)
+        goto cleanup;
+
+    ret->snaps.snaps_val = g_new0(remote_nonnull_domain_snapshot, nsnaps);
+    ret->snaps.snaps_len = nsnaps;
+
+    for (i = 0; i < ret->snaps.snaps_len; i++)
+        make_nonnull_domain_snapshot(ret->snaps.snaps_val + i, snaps[i]);
+
+    rv = 0;
+
+ cleanup:
+    if (rv < 0)
+        virNetMessageSaveError(rerr);
+    virObjectListFree(snaps);
+    virObjectListFree(doms);
+    g_free(xmlDescs);
+    return rv;
+}
+
+
 static int
 remoteDispatchNodeAllocPages(virNetServer *server G_GNUC_UNUSED,
                              virNetServerClient *client,
@@ -7408,6 +8122,165 @@ remoteDispatchDomainAuthorizedSshKeysSet(virNetServer *server G_GNUC_UNUSED,
     return rv;
 }
 
+static int
+remoteDispatchDomainAttachDevices(virNetServer *server G_GNUC_UNUSED,
+                                  virNetServerClient *client,
+                                  virNetMessage *msg G_GNUC_UNUSED,
+                                  struct virNetMessageError *rerr,
+                                  remote_domain_attach_devices_args *args)
+{
+    int rv = -1;
+    virConnectPtr conn = remoteGetHypervisorConn(client);
+    virDomainPtr dom = NULL;
+
+    if (!conn)
+        goto cleanup;
+
+    if (!(dom = get_nonnull_domain(conn, args->dom)))
+        goto cleanup;
+
+    if (args->xmls.xmls_len > REMOTE_DOMAIN_ATTACH_DEVICES_MAX) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Number of devices %d, which exceeds max limit: %d"),
+                       args->xmls.xmls_len, REMOTE_DOMAIN_ATTACH_DEVICES_MAX);
+        goto cleanup;
+    }
+
+    rv = virDomainAttachDevices(dom, (const char **) args->xmls.xmls_val,
+                                args->xmls.xmls_len, args->flags);
+
+ cleanup:
+    if (rv < 0)
+        virNetMessageSaveError(rerr);
+    virObjectUnref(dom);
+
+    return rv;
+}
+
+
+static int
+remoteDispatchDomainDetachDevices(virNetServer *server G_GNUC_UNUSED,
+                                  virNetServerClient *client,
+                                  virNetMessage *msg G_GNUC_UNUSED,
+                                  struct virNetMessageError *rerr,
+                                  remote_domain_detach_devices_args *args)
+{
+    int rv = -1;
+    virConnectPtr conn = remoteGetHypervisorConn(client);
+    virDomainPtr dom = NULL;
+
+    if (!conn)
+        goto cleanup;
+
+    if (!(dom = get_nonnull_domain(conn, args->dom)))
+        goto cleanup;
+
+    if (args->xmls.xmls_len > REMOTE_DOMAIN_DETACH_DEVICES_MAX) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Number of devices %d, which exceeds max limit: %d"),
+                       args->xmls.xmls_len, REMOTE_DOMAIN_DETACH_DEVICES_MAX);
+        goto cleanup;
+    }
+
+    rv = virDomainDetachDevices(dom, (const char **) args->xmls.xmls_val,
+                                args->xmls.xmls_len, args->flags);
+
+ cleanup:
+    if (rv < 0)
+        virNetMessageSaveError(rerr);
+    virObjectUnref(dom);
+
+    return rv;
+}
+
+
+static int
+remoteDispatchConnectListDomainsPage(virNetServer *server G_GNUC_UNUSED,
+                                     virNetServerClient *client,
+                                     virNetMessage *msg G_GNUC_UNUSED,
+                                     struct virNetMessageError *rerr,
+                                     remote_connect_list_domains_page_args *args,
+                                     remote_connect_list_domains_page_ret *ret)
+{
+    int rv = -1;
+    size_t i;
+    virTypedParameterPtr params = NULL;
+    virTypedParameterPtr limit;
+    int nparams = 0;
+    virDomainStatsRecordPtr *records = NULL;
+    char *cursor = NULL;
+    int nrecords = 0;
+    virConnectPtr conn = remoteGetHypervisorConn(client);
+
+    if (!conn)
+        goto cleanup;
+
+    if (virTypedParamsDeserialize((struct _virTypedParameterRemote *) args->params.params_val,
+                                  args->params.params_len,
+                                  REMOTE_CONNECT_LIST_DOMAINS_PAGE_PARAMS_MAX,
+                                  &params, &nparams) < 0)
+        goto cleanup;
+
+    /* don't let the driver collect a page that can't be sent back */
+    if ((limit = virTypedParamsGet(params, nparams,
+                                   VIR_CONNECT_LIST_DOMAINS_PAGE_LIMIT)) &&
+        limit->type == VIR_TYPED_PARAM_UINT &&
+        limit->value.ui > REMOTE_DOMAIN_LIST_MAX)
+        limit->value.ui = REMOTE_DOMAIN_LIST_MAX;
+
+    if ((nrecords = virConnectListDomainsPage(conn, params, nparams,
+                                              &records, &cursor,
+                                              args->flags)) < 0)
+        goto cleanup;
+
+    if (nrecords > REMOTE_DOMAIN_LIST_MAX) {
+        virReportError(VIR_ERR_RPC,
+                       _("Number of domains %d, which exceeds max limit: %d"),
+                       nrecords, REMOTE_DOMAIN_LIST_MAX);
+        goto cleanup;
+    }
+
+    if (nrecords) {
+        ret->records.records_val = g_new0(remote_domain_stats_record, nrecords);
+        ret->records.records_len = nrecords;
+
+        for (i = 0; i < nrecords; i++) {
+            remote_domain_stats_record *dst = ret->records.records_val + i;
+
+            make_nonnull_domain(&dst->dom, records[i]->dom);
+
+            if (virTypedParamsSerialize(records[i]->params,
+                                        records[i]->nparams,
+                                        REMOTE_CONNECT_GET_ALL_DOMAIN_STATS_MAX,
+                                        (struct _virTypedParameterRemote **) &dst->params.params_val,
+                                        &dst->params.params_len,
+                                        VIR_TYPED_PARAM_STRING_OKAY) < 0)
+                goto cleanup;
+        }
+    }
+
+    if (cursor) {
+        ret->cursor = g_new0(char *, 1);
+        *ret->cursor = g_steal_pointer(&cursor);
+    }
+
+    rv = 0;
+
+ cleanup:
+    if (rv < 0) {
+        virNetMessageSaveError(rerr);
+        xdr_free((xdrproc_t)xdr_remote_connect_list_domains_page_ret,
+                 (char *) ret);
+    }
+
+    virTypedParamsFree(params, nparams);
+    virDomainStatsRecordListFree(records);
+    g_free(cursor);
+
+    return rv;
+}
+
+
 static int
 remoteDispatchDomainGetMessages(virNetServer *server G_GNUC_UNUSED,
                                 virNetServerClient *client,
@@ -0,0 +1,269 @@
+/*
+ * remote_daemon_metrics.c: domain statistics for the metrics endpoint
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "remote_daemon_metrics.h"
+#include "virerror.h"
+#include "virhash.h"
+#include "virlog.h"
+#include "virstring.h"
+#include "virthread.h"
+
+#define VIR_FROM_THIS VIR_FROM_RPC
+
+VIR_LOG_INIT("daemon.metrics");
+
+/* The connection is opened by every scrape with the identity of the
+ * scraping client, so the access control driver decides which domains it
+ * sees. Being opened inside the daemon, it talks to the hypervisor driver
+ * directly, so the stats don't go through RPC at all. */
+static virMutex daemonMetricsLock = VIR_MUTEX_INITIALIZER;
+static char *daemonMetricsURI;
+static bool daemonMetricsUnsupported;
+
+
+static bool
+daemonMetricsIsIndex(const char *str)
+{
+    if (!*str)
+        return false;
+
+    for (; *str; str++) {
+        if (!g_ascii_isdigit(*str))
+            return false;
+    }
+
+    return true;
+}
+
+
+/*
+ * Typed parameter keys are turned into metric names by dropping the
+ * numeric components, which become labels named after the preceding
+ * component instead. The label gets the value of the "<prefix>.name"
+ * parameter if the stats group has one, so for example
+ * "block.1.rd.bytes" becomes libvirt_domain_block_rd_bytes{block="vdb"}.
+ */
+static void
+daemonMetricsAddParam(virOpenMetrics *metrics,
+                      const char *domain,
+                      GHashTable *names,
+                      virTypedParameterPtr param)
+{
+    g_auto(GStrv) parts = g_strsplit(param->field, ".", 0);
+    g_autoptr(GPtrArray) strs = g_ptr_array_new_with_free_func(g_free);
+    g_autofree virOpenMetricsLabel *labels = NULL;
+    g_auto(virBuffer) family = VIR_BUFFER_INITIALIZER;
+    g_auto(virBuffer) help = VIR_BUFFER_INITIALIZER;
+    g_auto(virBuffer) prefix = VIR_BUFFER_INITIALIZER;
+    g_autofree char *name = NULL;
+    size_t nlabels = 0;
+    size_t i;
+
+    labels = g_new0(virOpenMetricsLabel, g_strv_length(parts) + 1);
+    labels[nlabels].name = "domain";
+    labels[nlabels++].value = domain;
+
+    virBufferAddLit(&family, "libvirt_domain");
+    virBufferAddLit(&help, "Domain statistics ");
+
+    for (i = 0; parts[i]; i++) {
+        if (i > 0) {
+            virBufferAddChar(&prefix, '.');
+            virBufferAddChar(&help, '.');
+        }
+        virBufferAdd(&prefix, parts[i], -1);
+
+        if (daemonMetricsIsIndex(parts[i])) {
+            const char *value = g_hash_table_lookup(names,
+                                                    virBufferCurrentContent(&prefix));
+            char *label = virOpenMetricsSanitizeName(i > 0 ? parts[i - 1] : "index");
+
+            g_ptr_array_add(strs, label);
+            labels[nlabels].name = label;
+            labels[nlabels++].value = value ? value : parts[i];
+            virBufferAddLit(&help, "<num>");
+        } else {
+            virBufferAsprintf(&family, "_%s", parts[i]);
+            virBufferAdd(&help, parts[i], -1);
+        }
+    }
+
+    name = virOpenMetricsSanitizeName(virBufferCurrentContent(&family));
+    virOpenMetricsDeclare(metrics, name, VIR_OPEN_METRICS_UNKNOWN,
+                          virBufferCurrentContent(&help));
+
+    switch ((virTypedParameterType) param->type) {
+    case VIR_TYPED_PARAM_INT:
+        virOpenMetricsAddDouble(metrics, name, labels, nlabels, param->value.i);
+        break;
+    case VIR_TYPED_PARAM_UINT:
+        virOpenMetricsAddULLong(metrics, name, labels, nlabels, param->value.ui);
+        break;
+    case VIR_TYPED_PARAM_LLONG:
+        virOpenMetricsAddDouble(metrics, name, labels, nlabels, param->value.l);
+        break;
+    case VIR_TYPED_PARAM_ULLONG:
+        virOpenMetricsAddULLong(metrics, name, labels, nlabels, param->value.ul);
+        break;
+    case VIR_TYPED_PARAM_DOUBLE:
+        virOpenMetricsAddDouble(metrics, name, labels, nlabels, param->value.d);
+        break;
+    case VIR_TYPED_PARAM_BOOLEAN:
+        virOpenMetricsAddULLong(metrics, name, labels, nlabels, !!param->value.b);
+        break;
+    case VIR_TYPED_PARAM_STRING:
+    case VIR_TYPED_PARAM_LAST:
+        break;
+    }
+}
+
+
+static void
+daemonMetricsAddRecord(virOpenMetrics *metrics,
+                       virDomainStatsRecordPtr record)
+{
+    g_autoptr(GHashTable) names = virHashNew(NULL);
+    const char *domain = virDomainGetName(record->dom);
+    int i;
+
+    /* Strings can't be metrics, but the names of disks, interfaces and
+     * alike make better labels than their indexes */
+    for (i = 0; i < record->nparams; i++) {
+        virTypedParameterPtr param = record->params + i;
+        g_autofree char *prefix = NULL;
+
+        if (param->type != VIR_TYPED_PARAM_STRING)
+            continue;
+
+        prefix = g_strdup(param->field);
+        if (virStringStripSuffix(prefix, ".name"))
+            g_hash_table_insert(names, g_steal_pointer(&prefix), param->value.s);
+    }
+
+    for (i = 0; i < record->nparams; i++) {
+        if (record->params[i].type == VIR_TYPED_PARAM_STRING)
+            continue;
+
+        daemonMetricsAddParam(metrics, domain, names, record->params + i);
+    }
+}
+
+
+/*
+ * Returns 0 with @conn set to NULL if the driver doesn't have domains,
+ * -1 on error.
+ */
+static int
+daemonMetricsGetConnection(virConnectPtr *conn)
+{
+    g_autofree char *uri = NULL;
+
+    *conn = NULL;
+
+    VIR_WITH_MUTEX_LOCK_GUARD(&daemonMetricsLock) {
+        if (daemonMetricsUnsupported)
+            return 0;
+
+        uri = g_strdup(daemonMetricsURI);
+    }
+
+    if (!(*conn = virConnectOpen(uri)))
+        return -1;
+
+    return 0;
+}
+
+
+static int
+daemonMetricsCollect(virNetDaemon *dmn G_GNUC_UNUSED,
+                     virOpenMetrics *metrics,
+                     void *opaque G_GNUC_UNUSED)
+{
+    virDomainStatsRecordPtr *records = NULL;
+    virConnectPtr conn = NULL;
+    gint64 start = g_get_monotonic_time();
+    int nrecords;
+    int ret = -1;
+    int i;
+
+    virOpenMetricsDeclare(metrics, "libvirt_domain_stats_up",
+                          VIR_OPEN_METRICS_GAUGE,
+                          "Whether domain statistics were collected");
+    virOpenMetricsDeclare(metrics, "libvirt_domain_stats_duration_seconds",
+                          VIR_OPEN_METRICS_GAUGE,
+                          "Time spent collecting domain statistics");
+
+    if (daemonMetricsGetConnection(&conn) < 0)
+        goto cleanup;
+
+    if (!conn)
+        return 0;
+
+    if ((nrecords = virConnectGetAllDomainStats(conn, 0, &records,
+                                                VIR_CONNECT_GET_ALL_DOMAINS_STATS_NOWAIT)) < 0) {
+        if (virGetLastErrorCode() != VIR_ERR_NO_SUPPORT)
+            goto cleanup;
+
+        VIR_DEBUG("Driver of '%s' doesn't support domain statistics",
+                  NULLSTR(daemonMetricsURI));
+        VIR_WITH_MUTEX_LOCK_GUARD(&daemonMetricsLock) {
+            daemonMetricsUnsupported = true;
+        }
+        virResetLastError();
+        virConnectClose(conn);
+        return 0;
+    }
+
+    for (i = 0; i < nrecords; i++)
+        daemonMetricsAddRecord(metrics, records[i]);
+
+    virOpenMetricsAddDouble(metrics, "libvirt_domain_stats_duration_seconds",
+                            NULL, 0, (g_get_monotonic_time() - start) / 1e6);
+    ret = 0;
+
+ cleanup:
+    virOpenMetricsAddULLong(metrics, "libvirt_domain_stats_up",
+                            NULL, 0, ret == 0);
+    virDomainStatsRecordListFree(records);
+    if (conn)
+        virConnectClose(conn);
+    return ret;
+}
+
+
+/**
+ * daemonMetricsInit:
+ * @dmn: daemon
+ * @uri: URI of the driver to report domain statistics of, or NULL
+ *
+ * Adds statistics of the domains the scraping client may read to the
+ * metrics endpoint of @dmn. Daemons without domains report nothing.
+ */
+void
+daemonMetricsInit(virNetDaemon *dmn,
+                  const char *uri)
+{
+    VIR_WITH_MUTEX_LOCK_GUARD(&daemonMetricsLock) {
+        g_free(daemonMetricsURI);
+        daemonMetricsURI = g_strdup(uri);
+    }
+
+    virNetDaemonSetMetricsCallback(dmn, daemonMetricsCollect, NULL);
+}
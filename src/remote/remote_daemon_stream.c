@@ -26,6 +26,7 @@
 #include "viralloc.h"
 #include "virlog.h"
 #include "virnetserverclient.h"
+#include "virfdstream.h"
 #include "virerror.h"
 #include "libvirt_internal.h"
 
@@ -822,8 +823,9 @@ daemonStreamHandleRead(virNetServerClient *client,
 {
     virNetMessage *msg = NULL;
     virNetMessageError rerr;
-    char *buffer;
+    char *buffer = NULL;
     size_t bufferLen = VIR_NET_MESSAGE_LEGACY_PAYLOAD_MAX;
+    int spliceFD = -1;
     int ret = -1;
     int rv;
     int inData = 0;
@@ -846,8 +848,6 @@ daemonStreamHandleRead(virNetServerClient *client,
 
     memset(&rerr, 0, sizeof(rerr));
 
-    buffer = g_new0(char, bufferLen);
-
     if (!(msg = virNetMessageNew(false)))
         goto cleanup;
 
@@ -905,6 +905,50 @@ daemonStreamHandleRead(virNetServerClient *client,
         bufferLen > stream->dataLen)
         bufferLen = stream->dataLen;
 
+    /* Local clients reading a file get the data moved from the
+     * file stream straight into their socket. */
+    if (virNetServerClientCanSplice(client) &&
+        (rv = virFDStreamSpliceData(stream->st, bufferLen, &spliceFD)) != 0) {
+        if (rv < 0) {
+            if (virNetServerProgramSendStreamError(stream->prog,
+                                                   client,
+                                                   msg,
+                                                   &rerr,
+                                                   stream->procedure,
+                                                   stream->serial) < 0)
+                goto cleanup;
+            msg = NULL;
+            goto done;
+        }
+
+        if (stream->allowSkip)
+            stream->dataLen -= rv;
+
+        stream->tx = false;
+        msg->cb = daemonStreamMessageFinished;
+        msg->opaque = stream;
+        stream->refs++;
+        if (virNetServerProgramSendStreamDataSplice(stream->prog,
+                                                    client,
+                                                    msg,
+                                                    stream->procedure,
+                                                    stream->serial,
+                                                    spliceFD, rv) < 0)
+            goto cleanup;
+        msg = NULL;
+        goto done;
+    }
+
+    /* The data is read right into the message sent to the client, which
+     * saves copying it once more. This matters most for virtproxyd, which
+     * already had to copy the data out of the message it got from the
+     * backing daemon. */
+    if (!(buffer = virNetServerProgramPrepareStreamData(stream->prog, msg,
+                                                        stream->procedure,
+                                                        stream->serial,
+                                                        bufferLen)))
+        goto cleanup;
+
     rv = virStreamRecv(stream->st, buffer, bufferLen);
     if (rv == -2) {
         /* Should never get this, since we're only called when we know
@@ -929,12 +973,7 @@ daemonStreamHandleRead(virNetServerClient *client,
         msg->cb = daemonStreamMessageFinished;
         msg->opaque = stream;
         stream->refs++;
-        if (virNetServerProgramSendStreamData(stream->prog,
-                                              client,
-                                              msg,
-                                              stream->procedure,
-                                              stream->serial,
-                                              buffer, rv) < 0)
+        if (virNetServerProgramSendPreparedStreamData(client, msg, rv) < 0)
             goto cleanup;
         msg = NULL;
     }
@@ -942,7 +981,6 @@ daemonStreamHandleRead(virNetServerClient *client,
  done:
     ret = 0;
  cleanup:
-    VIR_FREE(buffer);
     virNetMessageFree(msg);
     return ret;
 }
@@ -76,6 +76,9 @@ VIR_LOG_INIT("remote.remote_driver");
 
 static bool inside_daemon;
 
+/* Maximum value of the 'connections' URI parameter */
+#define REMOTE_CONNECTIONS_MAX 32
+
 struct private_data {
     virMutex lock;
 
@@ -95,6 +98,17 @@ struct private_data {
     bool serverKeepAlive;       /* Does server support keepalive protocol? */
     bool serverEventFilter;     /* Does server support modern event filtering */
     bool serverCloseCallback;   /* Does server support driver close callback */
+    bool serverCompactStats;    /* Does server support compact domain stats */
+    bool stateCache;            /* Is the state of domains cached? */
+    int stateCacheCallbackID;   /* Server side lifecycle callback of the cache */
+
+    /* Additional connections to the same server, which calls are spread
+     * across. They are only ever used under the lock of this connection */
+    size_t poolSize;            /* Requested number of connections */
+    bool poolPinned;            /* Are all calls made over this connection? */
+    struct private_data **pool;
+    size_t npool;
+    unsigned int calls;         /* Calls in progress over this connection */
 
     virObjectEventState *eventState;
     virConnectCloseCallbackData *closeCallback;
@@ -135,6 +149,7 @@ static int remoteAuthSASL(virConnectPtr conn, struct private_data *priv,
 #endif /* WITH_SASL */
 static int remoteAuthPolkit(virConnectPtr conn, struct private_data *priv,
                             virConnectAuthPtr auth);
+static int doRemoteClose(virConnectPtr conn, struct private_data *priv);
 
 static virDomainPtr get_nonnull_domain(virConnectPtr conn, remote_nonnull_domain domain);
 static virNetworkPtr get_nonnull_network(virConnectPtr conn, remote_nonnull_network network);
@@ -413,6 +428,11 @@ static void
 remoteDomainBuildEventMemoryDeviceSizeChange(virNetClientProgram *prog,
                                              virNetClient *client,
                                              void *evdata, void *opaque);
+
+static void
+remoteDomainBuildEventCallbackStats(virNetClientProgram *prog,
+                                    virNetClient *client,
+                                    void *evdata, void *opaque);
 static void
 remoteConnectNotifyEventConnectionClosed(virNetClientProgram *prog G_GNUC_UNUSED,
                                          virNetClient *client G_GNUC_UNUSED,
@@ -632,6 +652,10 @@ static virNetClientProgramEvent remoteEvents[] = {
       remoteDomainBuildEventMemoryDeviceSizeChange,
       sizeof(remote_domain_event_memory_device_size_change_msg),
       (xdrproc_t)xdr_remote_domain_event_memory_device_size_change_msg },
+    { REMOTE_PROC_DOMAIN_EVENT_CALLBACK_STATS,
+      remoteDomainBuildEventCallbackStats,
+      sizeof(remote_domain_event_callback_stats_msg),
+      (xdrproc_t)xdr_remote_domain_event_callback_stats_msg },
 };
 
 static void
@@ -707,6 +731,18 @@ remoteConnectSupportsFeatureUnlocked(virConnectPtr conn,
         continue; \
     }
 
+#define EXTRACT_URI_ARG_INT(ARG_NAME, ARG_VAR) \
+    if (STRCASEEQ(var->name, ARG_NAME)) { \
+        if (virStrToLong_i(var->value, NULL, 10, &ARG_VAR) < 0) { \
+            virReportError(VIR_ERR_INVALID_ARG, \
+                           _("Failed to parse value of URI component %s"), \
+                           var->name); \
+            goto failed; \
+        } \
+        var->ignore = 1; \
+        continue; \
+    }
+
 
 /*
  * URIs that this driver needs to handle:
@@ -755,6 +791,11 @@ doRemoteOpen(virConnectPtr conn,
     g_autofree char *proxy_str = NULL;
     bool sanity = true;
     bool verify = true;
+    bool compress = transport != REMOTE_DRIVER_TRANSPORT_UNIX;
+    int ioThread = 0;
+    int stateCache = 0;
+    int connections = 1;
+    bool asyncIO = false;
 #ifndef WIN32
     bool tty = true;
 #endif
@@ -802,6 +843,10 @@ doRemoteOpen(virConnectPtr conn,
             EXTRACT_URI_ARG_STR("proxy", proxy_str);
             EXTRACT_URI_ARG_BOOL("no_sanity", sanity);
             EXTRACT_URI_ARG_BOOL("no_verify", verify);
+            EXTRACT_URI_ARG_BOOL("no_compress", compress);
+            EXTRACT_URI_ARG_INT("io_thread", ioThread);
+            EXTRACT_URI_ARG_INT("state_cache", stateCache);
+            EXTRACT_URI_ARG_INT("connections", connections);
 #ifndef WIN32
             EXTRACT_URI_ARG_BOOL("no_tty", tty);
 #endif
@@ -912,6 +957,14 @@ doRemoteOpen(virConnectPtr conn,
         return VIR_DRV_OPEN_ERROR;
     }
 
+    if (connections < 1 || connections > REMOTE_CONNECTIONS_MAX) {
+        virReportError(VIR_ERR_INVALID_ARG,
+                       _("connections must be between 1 and %d"),
+                       REMOTE_CONNECTIONS_MAX);
+        goto failed;
+    }
+    priv->poolSize = connections;
+
     VIR_DEBUG("proceeding with name = %s", name);
 
     /* For ext transport, command is required. */
@@ -1088,6 +1141,7 @@ doRemoteOpen(virConnectPtr conn,
                   " keepalive messages");
         virResetLastError();
     } else {
+        asyncIO = true;
         if (virNetClientRegisterKeepAlive(priv->client) < 0)
             goto failed;
     }
@@ -1129,6 +1183,15 @@ doRemoteOpen(virConnectPtr conn,
     if (remoteAuthenticate(conn, priv, auth, authtype) == -1)
         goto failed;
 
+    if (compress &&
+        virNetClientEnableCompression(priv->client,
+                                      VIR_NET_MESSAGE_COMPRESS_THRESHOLD) < 0)
+        goto failed;
+
+    if (ioThread &&
+        virNetClientStartIOThread(priv->client) < 0)
+        goto failed;
+
     if (virNetClientKeepAliveIsSupported(priv->client)) {
         priv->serverKeepAlive = remoteConnectSupportsFeatureUnlocked(conn,
                                     priv, VIR_DRV_FEATURE_PROGRAM_KEEPALIVE);
@@ -1186,6 +1249,27 @@ doRemoteOpen(virConnectPtr conn,
                  "by the remote side.");
     }
 
+    priv->serverCompactStats = remoteConnectSupportsFeatureUnlocked(conn,
+                                   priv, VIR_DRV_FEATURE_REMOTE_COMPACT_DOMAIN_STATS);
+
+    if (stateCache) {
+        /* The cache is invalidated by lifecycle events, which must be
+         * read as soon as they arrive rather than with the next call */
+        if (!asyncIO && !ioThread) {
+            virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
+                           _("state_cache requires an event loop or io_thread"));
+            goto failed;
+        }
+
+        if (!priv->serverEventFilter) {
+            virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
+                           _("state_cache is not supported by the server"));
+            goto failed;
+        }
+
+        priv->stateCache = true;
+    }
+
     return VIR_DRV_OPEN_SUCCESS;
 
  failed:
@@ -1202,6 +1286,7 @@ doRemoteOpen(virConnectPtr conn,
 }
 #undef EXTRACT_URI_ARG_STR
 #undef EXTRACT_URI_ARG_BOOL
+#undef EXTRACT_URI_ARG_INT
 
 static struct private_data *
 remoteAllocPrivateData(void)
@@ -1221,6 +1306,75 @@ remoteAllocPrivateData(void)
     return priv;
 }
 
+/*
+ * Ask the server for lifecycle events of all domains, which invalidate
+ * the cached state. Events of this callback are consumed right when they
+ * are received and never dispatched.
+ */
+static int
+remoteStateCacheRegister(virConnectPtr conn,
+                         struct private_data *priv)
+{
+    remote_connect_domain_event_callback_register_any_args args;
+    remote_connect_domain_event_callback_register_any_ret ret;
+
+    args.eventID = VIR_DOMAIN_EVENT_ID_LIFECYCLE;
+    args.dom = NULL;
+
+    memset(&ret, 0, sizeof(ret));
+    if (call(conn, priv, 0, REMOTE_PROC_CONNECT_DOMAIN_EVENT_CALLBACK_REGISTER_ANY,
+             (xdrproc_t) xdr_remote_connect_domain_event_callback_register_any_args, (char *) &args,
+             (xdrproc_t) xdr_remote_connect_domain_event_callback_register_any_ret, (char *) &ret) == -1)
+        return -1;
+
+    priv->stateCacheCallbackID = ret.callbackID;
+    return 0;
+}
+
+
+/*
+ * Open the additional connections requested by the 'connections' URI
+ * parameter. Each of them is set up and authenticated on its own, just
+ * like the first one.
+ */
+static int
+remotePoolOpen(virConnectPtr conn,
+               struct private_data *priv,
+               const char *driver_str,
+               remoteDriverTransport transport,
+               virConnectAuthPtr auth,
+               virConf *conf,
+               unsigned int flags)
+{
+    size_t i;
+
+    if (priv->poolSize <= 1)
+        return 0;
+
+    priv->pool = g_new0(struct private_data *, priv->poolSize - 1);
+
+    for (i = 1; i < priv->poolSize; i++) {
+        struct private_data *member;
+
+        if (!(member = remoteAllocPrivateData()))
+            return -1;
+
+        if (doRemoteOpen(conn, member, driver_str, transport,
+                         auth, conf, flags) != VIR_DRV_OPEN_SUCCESS) {
+            remoteDriverUnlock(member);
+            virMutexDestroy(&member->lock);
+            VIR_FREE(member);
+            return -1;
+        }
+
+        remoteDriverUnlock(member);
+        priv->pool[priv->npool++] = member;
+    }
+
+    return 0;
+}
+
+
 static virDrvOpenStatus
 remoteConnectOpen(virConnectPtr conn,
                   virConnectAuthPtr auth,
@@ -1271,12 +1425,24 @@ remoteConnectOpen(virConnectPtr conn,
         rflags |= REMOTE_DRIVER_OPEN_RO;
 
     ret = doRemoteOpen(conn, priv, driver, transport, auth, conf, rflags);
+    if (ret == VIR_DRV_OPEN_SUCCESS) {
+        /* Events may be received as soon as the callback is registered,
+         * so the connection must be fully set up by then */
+        conn->privateData = priv;
+        if (remotePoolOpen(conn, priv, driver, transport,
+                           auth, conf, rflags) < 0 ||
+            (priv->stateCache &&
+             remoteStateCacheRegister(conn, priv) < 0)) {
+            doRemoteClose(conn, priv);
+            ret = VIR_DRV_OPEN_ERROR;
+        }
+    }
+
     if (ret != VIR_DRV_OPEN_SUCCESS) {
         conn->privateData = NULL;
         remoteDriverUnlock(priv);
         VIR_FREE(priv);
     } else {
-        conn->privateData = priv;
         remoteDriverUnlock(priv);
     }
 
@@ -1293,12 +1459,26 @@ static int
 doRemoteClose(virConnectPtr conn, struct private_data *priv)
 {
     int ret = 0;
+    size_t i;
 
     if (call(conn, priv, 0, REMOTE_PROC_CONNECT_CLOSE,
              (xdrproc_t) xdr_void, (char *) NULL,
              (xdrproc_t) xdr_void, (char *) NULL) == -1)
         ret = -1;
 
+    for (i = 0; i < priv->npool; i++) {
+        struct private_data *member = priv->pool[i];
+
+        remoteDriverLock(member);
+        if (doRemoteClose(conn, member) < 0)
+            ret = -1;
+        remoteDriverUnlock(member);
+        virMutexDestroy(&member->lock);
+        VIR_FREE(member);
+    }
+    VIR_FREE(priv->pool);
+    priv->npool = 0;
+
     g_clear_pointer(&priv->tls, virObjectUnref);
 
     virNetClientSetCloseCallback(priv->client,
@@ -2381,6 +2561,24 @@ remoteDomainGetState(virDomainPtr domain,
     remote_domain_get_state_args args;
     remote_domain_get_state_ret ret;
     struct private_data *priv = domain->conn->privateData;
+    bool cache = priv->stateCache && flags == 0;
+    unsigned int generation = 0;
+
+    if (cache) {
+        bool cached;
+
+        virObjectLock(domain->conn);
+        if ((cached = domain->stateCached)) {
+            *state = domain->state;
+            if (reason)
+                *reason = domain->reason;
+        }
+        generation = domain->stateGeneration;
+        virObjectUnlock(domain->conn);
+
+        if (cached)
+            return 0;
+    }
 
     remoteDriverLock(priv);
 
@@ -2397,6 +2595,17 @@ remoteDomainGetState(virDomainPtr domain,
     if (reason)
         *reason = ret.reason;
 
+    /* Unless a lifecycle event came in since the call was made */
+    if (cache) {
+        virObjectLock(domain->conn);
+        if (domain->stateGeneration == generation) {
+            domain->stateCached = true;
+            domain->state = ret.state;
+            domain->reason = ret.reason;
+        }
+        virObjectUnlock(domain->conn);
+    }
+
     rv = 0;
 
  done:
@@ -4347,6 +4556,18 @@ remoteDomainBuildEventLifecycleHelper(virConnectPtr conn,
     if (!dom)
         return;
 
+    if (priv->stateCache) {
+        virObjectLock(conn);
+        dom->stateCached = false;
+        dom->stateGeneration++;
+        virObjectUnlock(conn);
+
+        if (callbackID == priv->stateCacheCallbackID) {
+            virObjectUnref(dom);
+            return;
+        }
+    }
+
     event = virDomainEventLifecycleNewFromDom(dom, msg->event, msg->detail);
     virObjectUnref(dom);
 
@@ -5466,6 +5687,39 @@ remoteDomainBuildEventMemoryDeviceSizeChange(virNetClientProgram *prog G_GNUC_UN
 }
 
 
+static void
+remoteDomainBuildEventCallbackStats(virNetClientProgram *prog G_GNUC_UNUSED,
+                                    virNetClient *client G_GNUC_UNUSED,
+                                    void *evdata, void *opaque)
+{
+    virConnectPtr conn = opaque;
+    remote_domain_event_callback_stats_msg *msg = evdata;
+    struct private_data *priv = conn->privateData;
+    virDomainPtr dom;
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+    virObjectEvent *event = NULL;
+
+    if (virTypedParamsDeserialize((struct _virTypedParameterRemote *) msg->params.params_val,
+                                  msg->params.params_len,
+                                  REMOTE_CONNECT_GET_ALL_DOMAIN_STATS_MAX,
+                                  &params, &nparams) < 0)
+        return;
+
+    if (!(dom = get_nonnull_domain(conn, msg->dom))) {
+        virTypedParamsFree(params, nparams);
+        return;
+    }
+
+    event = virDomainStatsEventNew(dom->id, dom->name, dom->uuid, -1,
+                                   params, nparams);
+
+    virObjectUnref(dom);
+
+    virObjectEventStateQueueRemote(priv->eventState, event, msg->callbackID);
+}
+
+
 static int
 remoteStreamSend(virStreamPtr st,
                  const char *data,
@@ -5896,6 +6150,143 @@ remoteConnectDomainEventDeregisterAny(virConnectPtr conn,
 }
 
 
+static int
+remoteConnectDomainStatsRegister(virConnectPtr conn,
+                                 virDomainPtr dom,
+                                 unsigned int stats,
+                                 unsigned int interval,
+                                 virConnectDomainStatsCallback callback,
+                                 void *opaque,
+                                 virFreeCallback freecb,
+                                 unsigned int flags)
+{
+    int rv = -1;
+    struct private_data *priv = conn->privateData;
+    remote_connect_domain_stats_register_args args;
+    remote_connect_domain_stats_register_ret ret;
+    int callbackID;
+    remote_nonnull_domain domain;
+
+    remoteDriverLock(priv);
+
+    /* Each subscription has its own stats groups and interval, so unlike
+     * other events every client callback has a server callback. */
+    if (virDomainStatsEventStateRegisterID(conn, priv->eventState,
+                                           dom, callback, opaque, freecb,
+                                           &callbackID) < 0)
+        goto done;
+
+    if (dom) {
+        make_nonnull_domain(&domain, dom);
+        args.dom = &domain;
+    } else {
+        args.dom = NULL;
+    }
+    args.stats = stats;
+    args.interval = interval;
+    args.flags = flags;
+
+    memset(&ret, 0, sizeof(ret));
+    if (call(conn, priv, 0, REMOTE_PROC_CONNECT_DOMAIN_STATS_REGISTER,
+             (xdrproc_t) xdr_remote_connect_domain_stats_register_args, (char *) &args,
+             (xdrproc_t) xdr_remote_connect_domain_stats_register_ret, (char *) &ret) == -1) {
+        virObjectEventStateDeregisterID(conn, priv->eventState,
+                                        callbackID, false);
+        goto done;
+    }
+    virObjectEventStateSetRemote(conn, priv->eventState, callbackID,
+                                 ret.callbackID);
+
+    rv = callbackID;
+
+ done:
+    remoteDriverUnlock(priv);
+    return rv;
+}
+
+
+static int
+remoteConnectDomainStatsDeregister(virConnectPtr conn,
+                                   int callbackID)
+{
+    struct private_data *priv = conn->privateData;
+    int rv = -1;
+    remote_connect_domain_stats_deregister_args args;
+    int remoteID;
+
+    remoteDriverLock(priv);
+
+    if (virObjectEventStateEventID(conn, priv->eventState,
+                                   callbackID, &remoteID) < 0)
+        goto done;
+
+    if (virObjectEventStateDeregisterID(conn, priv->eventState,
+                                        callbackID, true) < 0)
+        goto done;
+
+    args.callbackID = remoteID;
+
+    if (call(conn, priv, 0, REMOTE_PROC_CONNECT_DOMAIN_STATS_DEREGISTER,
+             (xdrproc_t) xdr_remote_connect_domain_stats_deregister_args, (char *) &args,
+             (xdrproc_t) xdr_void, (char *) NULL) == -1)
+        goto done;
+
+    rv = 0;
+
+ done:
+    remoteDriverUnlock(priv);
+    return rv;
+}
+
+
+static int
+remoteConnectDomainEventRingOpen(virConnectPtr conn,
+                                 unsigned int stats,
+                                 unsigned int interval,
+                                 unsigned int flags)
+{
+    int rv = -1;
+    remote_connect_domain_event_ring_open_args args;
+    struct private_data *priv = conn->privateData;
+    int *fdout = NULL;
+    size_t fdoutlen = 0;
+
+    remoteDriverLock(priv);
+
+    args.stats = stats;
+    args.interval = interval;
+    args.flags = flags;
+
+    if (callFull(conn, priv, 0,
+                 NULL, 0,
+                 &fdout, &fdoutlen,
+                 REMOTE_PROC_CONNECT_DOMAIN_EVENT_RING_OPEN,
+                 (xdrproc_t) xdr_remote_connect_domain_event_ring_open_args, (char *) &args,
+                 (xdrproc_t) xdr_void, NULL) == -1)
+        goto done;
+
+    if (fdoutlen != 1) {
+        if (fdoutlen) {
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("too many file descriptors received"));
+            while (fdoutlen)
+                VIR_FORCE_CLOSE(fdout[--fdoutlen]);
+        } else {
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("no file descriptor received"));
+        }
+        goto done;
+    }
+    rv = fdout[0];
+
+ done:
+    VIR_FREE(fdout);
+    remoteDriverUnlock(priv);
+
+    return rv;
+}
+
+
 /*----------------------------------------------------------------------*/
 
 static int
@@ -6482,6 +6873,7 @@ remoteConnectSetKeepAlive(virConnectPtr conn, int interval, unsigned int count)
 {
     struct private_data *priv = conn->privateData;
     int ret = -1;
+    size_t i;
 
     remoteDriverLock(priv);
     if (!virNetClientKeepAliveIsSupported(priv->client)) {
@@ -6498,8 +6890,13 @@ remoteConnectSetKeepAlive(virConnectPtr conn, int interval, unsigned int count)
 
     if (interval > 0) {
         ret = virNetClientKeepAliveStart(priv->client, interval, count);
+        for (i = 0; i < priv->npool && ret == 0; i++)
+            ret = virNetClientKeepAliveStart(priv->pool[i]->client,
+                                             interval, count);
     } else {
         virNetClientKeepAliveStop(priv->client);
+        for (i = 0; i < priv->npool; i++)
+            virNetClientKeepAliveStop(priv->pool[i]->client);
         ret = 0;
     }
 
@@ -6573,6 +6970,70 @@ remoteDomainGetDiskErrors(virDomainPtr dom,
 #include "lxc_client_bodies.h"
 #include "qemu_client_bodies.h"
 
+/*
+ * Choose the connection of the pool to make a call of @proc_nr over.
+ * Calls which leave state behind on the server side, such as event
+ * callbacks or streams, are made over the first connection, the others
+ * go to the connection with the least calls in progress.
+ */
+static struct private_data *
+remotePoolPick(struct private_data *priv,
+               unsigned int flags,
+               int proc_nr)
+{
+    struct private_data *best = priv;
+    size_t i;
+
+    if (priv->npool == 0 || priv->poolPinned ||
+        flags & (REMOTE_CALL_QEMU | REMOTE_CALL_LXC))
+        return priv;
+
+    switch (proc_nr) {
+    case REMOTE_PROC_CONNECT_SET_IDENTITY:
+        /* The other connections keep the identity they were opened with */
+        priv->poolPinned = true;
+        return priv;
+
+    case REMOTE_PROC_CONNECT_CLOSE:
+    case REMOTE_PROC_CONNECT_DOMAIN_EVENT_REGISTER:
+    case REMOTE_PROC_CONNECT_DOMAIN_EVENT_DEREGISTER:
+    case REMOTE_PROC_CONNECT_DOMAIN_EVENT_REGISTER_ANY:
+    case REMOTE_PROC_CONNECT_DOMAIN_EVENT_DEREGISTER_ANY:
+    case REMOTE_PROC_CONNECT_DOMAIN_EVENT_CALLBACK_REGISTER_ANY:
+    case REMOTE_PROC_CONNECT_DOMAIN_EVENT_CALLBACK_DEREGISTER_ANY:
+    case REMOTE_PROC_CONNECT_NETWORK_EVENT_REGISTER_ANY:
+    case REMOTE_PROC_CONNECT_NETWORK_EVENT_DEREGISTER_ANY:
+    case REMOTE_PROC_CONNECT_STORAGE_POOL_EVENT_REGISTER_ANY:
+    case REMOTE_PROC_CONNECT_STORAGE_POOL_EVENT_DEREGISTER_ANY:
+    case REMOTE_PROC_CONNECT_NODE_DEVICE_EVENT_REGISTER_ANY:
+    case REMOTE_PROC_CONNECT_NODE_DEVICE_EVENT_DEREGISTER_ANY:
+    case REMOTE_PROC_CONNECT_SECRET_EVENT_REGISTER_ANY:
+    case REMOTE_PROC_CONNECT_SECRET_EVENT_DEREGISTER_ANY:
+    case REMOTE_PROC_CONNECT_DOMAIN_STATS_REGISTER:
+    case REMOTE_PROC_CONNECT_DOMAIN_STATS_DEREGISTER:
+    case REMOTE_PROC_CONNECT_DOMAIN_EVENT_RING_OPEN:
+    case REMOTE_PROC_CONNECT_REGISTER_CLOSE_CALLBACK:
+    case REMOTE_PROC_CONNECT_UNREGISTER_CLOSE_CALLBACK:
+        return priv;
+
+    default:
+        break;
+    }
+
+    /* Streams are added to the client with the serial of the call
+     * right before it is made */
+    if (virNetClientHasStream(priv->client, proc_nr, priv->counter))
+        return priv;
+
+    for (i = 0; i < priv->npool; i++) {
+        if (priv->pool[i]->calls < best->calls)
+            best = priv->pool[i];
+    }
+
+    return best;
+}
+
+
 /*
  * Serial a set of arguments into a method call message,
  * send that to the server and wait for reply
@@ -6591,16 +7052,18 @@ callFull(virConnectPtr conn G_GNUC_UNUSED,
 {
     int rv;
     virNetClientProgram *prog;
-    int counter = priv->counter++;
-    virNetClient *client = priv->client;
+    struct private_data *target = remotePoolPick(priv, flags, proc_nr);
+    int counter = target->counter++;
+    virNetClient *client = target->client;
     priv->localUses++;
+    target->calls++;
 
     if (flags & REMOTE_CALL_QEMU)
-        prog = priv->qemuProgram;
+        prog = target->qemuProgram;
     else if (flags & REMOTE_CALL_LXC)
-        prog = priv->lxcProgram;
+        prog = target->lxcProgram;
     else
-        prog = priv->remoteProgram;
+        prog = target->remoteProgram;
 
     /* Unlock, so that if we get any async events/stream data
      * while processing the RPC, we don't deadlock when our
@@ -6616,6 +7079,7 @@ callFull(virConnectPtr conn G_GNUC_UNUSED,
                                  args_filter, args,
                                  ret_filter, ret);
     remoteDriverLock(priv);
+    target->calls--;
     priv->localUses--;
 
     return rv;
@@ -7562,6 +8026,115 @@ remoteNetworkGetDHCPLeases(virNetworkPtr net,
 }
 
 
+static int
+remoteConnectGetAllDomainStatsCompact(virConnectPtr conn,
+                                      virDomainPtr *doms,
+                                      unsigned int ndoms,
+                                      unsigned int stats,
+                                      virDomainStatsRecordPtr **retStats,
+                                      unsigned int flags)
+{
+    struct private_data *priv = conn->privateData;
+    int rv = -1;
+    size_t i;
+    size_t j;
+    remote_connect_get_all_domain_stats_compact_args args;
+    remote_connect_get_all_domain_stats_compact_ret ret;
+    virDomainStatsRecordPtr elem = NULL;
+    virDomainStatsRecordPtr *tmpret = NULL;
+    remote_typed_param *params = NULL;
+
+    memset(&args, 0, sizeof(args));
+
+    if (ndoms) {
+        args.doms.doms_val = g_new0(remote_nonnull_domain, ndoms);
+
+        for (i = 0; i < ndoms; i++)
+            make_nonnull_domain(args.doms.doms_val + i, doms[i]);
+    }
+    args.doms.doms_len = ndoms;
+
+    args.stats = stats;
+    args.flags = flags;
+
+    memset(&ret, 0, sizeof(ret));
+
+    remoteDriverLock(priv);
+    if (call(conn, priv, 0, REMOTE_PROC_CONNECT_GET_ALL_DOMAIN_STATS_COMPACT,
+             (xdrproc_t)xdr_remote_connect_get_all_domain_stats_compact_args, (char *)&args,
+             (xdrproc_t)xdr_remote_connect_get_all_domain_stats_compact_ret, (char *)&ret) == -1) {
+        remoteDriverUnlock(priv);
+        goto cleanup;
+    }
+    remoteDriverUnlock(priv);
+
+    if (ret.retStats.retStats_len > REMOTE_DOMAIN_LIST_MAX) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Number of stats entries is %d, which exceeds max limit: %d"),
+                       ret.retStats.retStats_len, REMOTE_DOMAIN_LIST_MAX);
+        goto cleanup;
+    }
+
+    *retStats = NULL;
+
+    tmpret = g_new0(virDomainStatsRecordPtr, ret.retStats.retStats_len + 1);
+
+    for (i = 0; i < ret.retStats.retStats_len; i++) {
+        remote_domain_stats_compact_record *rec = ret.retStats.retStats_val + i;
+
+        elem = g_new0(virDomainStatsRecord, 1);
+
+        if (!(elem->dom = get_nonnull_domain(conn, rec->dom)))
+            goto cleanup;
+
+        /* Expand the records back into plain typed parameters. The field
+         * names are borrowed from the dictionary in @ret. */
+        params = g_new0(remote_typed_param, rec->params.params_len);
+
+        for (j = 0; j < rec->params.params_len; j++) {
+            remote_domain_stats_compact_param *param = rec->params.params_val + j;
+
+            if (param->field >= ret.fields.fields_len) {
+                virReportError(VIR_ERR_RPC,
+                               _("Invalid stats field index %u, only %u fields"),
+                               param->field, ret.fields.fields_len);
+                goto cleanup;
+            }
+
+            params[j].field = ret.fields.fields_val[param->field];
+            params[j].value = param->value;
+        }
+
+        if (virTypedParamsDeserialize((struct _virTypedParameterRemote *) params,
+                                      rec->params.params_len,
+                                      REMOTE_CONNECT_GET_ALL_DOMAIN_STATS_MAX,
+                                      &elem->params,
+                                      &elem->nparams))
+            goto cleanup;
+
+        VIR_FREE(params);
+
+        tmpret[i] = g_steal_pointer(&elem);
+    }
+
+    *retStats = g_steal_pointer(&tmpret);
+    rv = ret.retStats.retStats_len;
+
+ cleanup:
+    if (elem) {
+        virObjectUnref(elem->dom);
+        VIR_FREE(elem);
+    }
+    g_free(params);
+    virDomainStatsRecordListFree(tmpret);
+    VIR_FREE(args.doms.doms_val);
+    xdr_free((xdrproc_t)xdr_remote_connect_get_all_domain_stats_compact_ret,
+             (char *) &ret);
+
+    return rv;
+}
+
+
 static int
 remoteConnectGetAllDomainStats(virConnectPtr conn,
                                virDomainPtr *doms,
@@ -7578,6 +8151,10 @@ remoteConnectGetAllDomainStats(virConnectPtr conn,
     virDomainStatsRecordPtr elem = NULL;
     virDomainStatsRecordPtr *tmpret = NULL;
 
+    if (priv->serverCompactStats)
+        return remoteConnectGetAllDomainStatsCompact(conn, doms, ndoms, stats,
+                                                     retStats, flags);
+
     memset(&args, 0, sizeof(args));
 
     if (ndoms) {
@@ -7648,6 +8225,81 @@ remoteConnectGetAllDomainStats(virConnectPtr conn,
 }
 
 
+static int
+remoteDomainListSnapshotCreateXML(virConnectPtr conn,
+                                  virDomainPtr *doms,
+                                  unsigned int ndoms,
+                                  const char **xmlDescs,
+                                  virDomainSnapshotPtr **snaps,
+                                  unsigned int flags)
+{
+    struct private_data *priv = conn->privateData;
+    int rv = -1;
+    size_t i;
+    remote_domain_list_snapshot_create_xml_args args;
+    remote_domain_list_snapshot_create_xml_ret ret;
+    virDomainSnapshotPtr *tmpret = NULL;
+
+    if (ndoms > REMOTE_DOMAIN_LIST_MAX) {
+        virReportError(VIR_ERR_RPC,
+                       _("Number of domains is %u, which exceeds max limit: %d"),
+                       ndoms, REMOTE_DOMAIN_LIST_MAX);
+        return -1;
+    }
+
+    memset(&args, 0, sizeof(args));
+
+    args.doms.doms_val = g_new0(remote_nonnull_domain, ndoms);
+    args.xml_descs.xml_descs_val = g_new0(remote_nonnull_string, ndoms);
+
+    for (i = 0; i < ndoms; i++) {
+        make_nonnull_domain(args.doms.doms_val + i, doms[i]);
+        args.xml_descs.xml_descs_val[i] = (char *) xmlDescs[i];
+    }
+    args.doms.doms_len = ndoms;
+    args.xml_descs.xml_descs_len = ndoms;
+    args.flags = flags;
+
+    memset(&ret, 0, sizeof(ret));
+
+    remoteDriverLock(priv);
+    if (call(conn, priv, 0, REMOTE_PROC_DOMAIN_LIST_SNAPSHOT_CREATE_XML,
+             (xdrproc_t)xdr_remote_domain_list_snapshot_create_xml_args, (char *)&args,
+             (xdrproc_t)xdr_remote_domain_list_snapshot_create_xml_ret, (char *)&ret) == -1) {
+        remoteDriverUnlock(priv);
+        goto cleanup;
+    }
+    remoteDriverUnlock(priv);
+
+    if (ret.snaps.snaps_len != ndoms) {
+        virReportError(VIR_ERR_RPC,
+                       _("Number of snapshots is %u, expected %u"),
+                       ret.snaps.snaps_len, ndoms);
+        goto cleanup;
+    }
+
+    tmpret = g_new0(virDomainSnapshotPtr, ndoms + 1);
+
+    for (i = 0; i < ndoms; i++) {
+        if (!(tmpret[i] = get_nonnull_domain_snapshot(doms[i],
+                                                      ret.snaps.snaps_val[i])))
+            goto cleanup;
+    }
+
+    *snaps = g_steal_pointer(&tmpret);
+    rv = ndoms;
+
+ cleanup:
+    virObjectListFree(tmpret);
+    VIR_FREE(args.doms.doms_val);
+    VIR_FREE(args.xml_descs.xml_descs_val);
+    xdr_free((xdrproc_t)xdr_remote_domain_list_snapshot_create_xml_ret,
+             (char *) &ret);
+
+    return rv;
+}
+
+
 static int
 remoteNodeAllocPages(virConnectPtr conn,
                      unsigned int npages,
@@ -8171,6 +8823,168 @@ remoteDomainAuthorizedSSHKeysSet(virDomainPtr domain,
 }
 
 
+static int
+remoteDomainAttachDevices(virDomainPtr domain,
+                          const char **xmls,
+                          unsigned int nxmls,
+                          unsigned int flags)
+{
+    int rv = -1;
+    struct private_data *priv = domain->conn->privateData;
+    remote_domain_attach_devices_args args;
+
+    remoteDriverLock(priv);
+
+    if (nxmls > REMOTE_DOMAIN_ATTACH_DEVICES_MAX) {
+        virReportError(VIR_ERR_RPC,
+                       _("Number of devices is %u, which exceeds max limit: %d"),
+                       nxmls, REMOTE_DOMAIN_ATTACH_DEVICES_MAX);
+        goto cleanup;
+    }
+
+    make_nonnull_domain(&args.dom, domain);
+    args.xmls.xmls_len = nxmls;
+    args.xmls.xmls_val = (char **) xmls;
+    args.flags = flags;
+
+    if (call(domain->conn, priv, 0, REMOTE_PROC_DOMAIN_ATTACH_DEVICES,
+             (xdrproc_t) xdr_remote_domain_attach_devices_args, (char *)&args,
+             (xdrproc_t) xdr_void, (char *) NULL) == -1) {
+        goto cleanup;
+    }
+
+    rv = 0;
+
+ cleanup:
+    remoteDriverUnlock(priv);
+    return rv;
+}
+
+
+static int
+remoteDomainDetachDevices(virDomainPtr domain,
+                          const char **xmls,
+                          unsigned int nxmls,
+                          unsigned int flags)
+{
+    int rv = -1;
+    struct private_data *priv = domain->conn->privateData;
+    remote_domain_detach_devices_args args;
+
+    remoteDriverLock(priv);
+
+    if (nxmls > REMOTE_DOMAIN_DETACH_DEVICES_MAX) {
+        virReportError(VIR_ERR_RPC,
+                       _("Number of devices is %u, which exceeds max limit: %d"),
+                       nxmls, REMOTE_DOMAIN_DETACH_DEVICES_MAX);
+        goto cleanup;
+    }
+
+    make_nonnull_domain(&args.dom, domain);
+    args.xmls.xmls_len = nxmls;
+    args.xmls.xmls_val = (char **) xmls;
+    args.flags = flags;
+
+    if (call(domain->conn, priv, 0, REMOTE_PROC_DOMAIN_DETACH_DEVICES,
+             (xdrproc_t) xdr_remote_domain_detach_devices_args, (char *)&args,
+             (xdrproc_t) xdr_void, (char *) NULL) == -1) {
+        goto cleanup;
+    }
+
+    rv = 0;
+
+ cleanup:
+    remoteDriverUnlock(priv);
+    return rv;
+}
+
+
+static int
+remoteConnectListDomainsPage(virConnectPtr conn,
+                             virTypedParameterPtr params,
+                             int nparams,
+                             virDomainStatsRecordPtr **records,
+                             char **cursor,
+                             unsigned int flags)
+{
+    struct private_data *priv = conn->privateData;
+    int rv = -1;
+    size_t i;
+    remote_connect_list_domains_page_args args;
+    remote_connect_list_domains_page_ret ret;
+    virDomainStatsRecordPtr elem = NULL;
+    virDomainStatsRecordPtr *tmpret = NULL;
+
+    memset(&args, 0, sizeof(args));
+    memset(&ret, 0, sizeof(ret));
+
+    if (virTypedParamsSerialize(params, nparams,
+                                REMOTE_CONNECT_LIST_DOMAINS_PAGE_PARAMS_MAX,
+                                (struct _virTypedParameterRemote **) &args.params.params_val,
+                                &args.params.params_len,
+                                VIR_TYPED_PARAM_STRING_OKAY) < 0) {
+        xdr_free((xdrproc_t) xdr_remote_connect_list_domains_page_args,
+                 (char *) &args);
+        return -1;
+    }
+
+    args.flags = flags;
+
+    remoteDriverLock(priv);
+    if (call(conn, priv, 0, REMOTE_PROC_CONNECT_LIST_DOMAINS_PAGE,
+             (xdrproc_t)xdr_remote_connect_list_domains_page_args, (char *)&args,
+             (xdrproc_t)xdr_remote_connect_list_domains_page_ret, (char *)&ret) == -1) {
+        remoteDriverUnlock(priv);
+        goto cleanup;
+    }
+    remoteDriverUnlock(priv);
+
+    if (ret.records.records_len > REMOTE_DOMAIN_LIST_MAX) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Number of domains is %d, which exceeds max limit: %d"),
+                       ret.records.records_len, REMOTE_DOMAIN_LIST_MAX);
+        goto cleanup;
+    }
+
+    tmpret = g_new0(virDomainStatsRecordPtr, ret.records.records_len + 1);
+
+    for (i = 0; i < ret.records.records_len; i++) {
+        remote_domain_stats_record *rec = ret.records.records_val + i;
+
+        elem = g_new0(virDomainStatsRecord, 1);
+
+        if (!(elem->dom = get_nonnull_domain(conn, rec->dom)))
+            goto cleanup;
+
+        if (virTypedParamsDeserialize((struct _virTypedParameterRemote *) rec->params.params_val,
+                                      rec->params.params_len,
+                                      REMOTE_CONNECT_GET_ALL_DOMAIN_STATS_MAX,
+                                      &elem->params,
+                                      &elem->nparams))
+            goto cleanup;
+
+        tmpret[i] = g_steal_pointer(&elem);
+    }
+
+    *records = g_steal_pointer(&tmpret);
+    *cursor = ret.cursor ? g_steal_pointer(ret.cursor) : NULL;
+    rv = ret.records.records_len;
+
+ cleanup:
+    if (elem) {
+        virObjectUnref(elem->dom);
+        VIR_FREE(elem);
+    }
+    virDomainStatsRecordListFree(tmpret);
+    xdr_free((xdrproc_t) xdr_remote_connect_list_domains_page_args,
+             (char *) &args);
+    xdr_free((xdrproc_t) xdr_remote_connect_list_domains_page_ret,
+             (char *) &ret);
+
+    return rv;
+}
+
+
 static int
 remoteDomainGetMessages(virDomainPtr domain,
                         char ***msgs,
@@ -8653,6 +9467,13 @@ static virHypervisorDriver hypervisor_driver = {
     .domainGetMessages = remoteDomainGetMessages, /* 7.1.0 */
     .domainStartDirtyRateCalc = remoteDomainStartDirtyRateCalc, /* 7.2.0 */
     .domainSetLaunchSecurityState = remoteDomainSetLaunchSecurityState, /* 8.0.0 */
+    .connectDomainStatsRegister = remoteConnectDomainStatsRegister, /* 8.5.0 */
+    .connectDomainStatsDeregister = remoteConnectDomainStatsDeregister, /* 8.5.0 */
+    .connectDomainEventRingOpen = remoteConnectDomainEventRingOpen, /* 8.5.0 */
+    .domainListSnapshotCreateXML = remoteDomainListSnapshotCreateXML, /* 8.5.0 */
+    .domainAttachDevices = remoteDomainAttachDevices, /* 8.5.0 */
+    .domainDetachDevices = remoteDomainDetachDevices, /* 8.5.0 */
+    .connectListDomainsPage = remoteConnectListDomainsPage, /* 8.5.0 */
 };
 
 static virNetworkDriver network_driver = {
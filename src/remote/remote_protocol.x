@@ -292,6 +292,15 @@ const REMOTE_DOMAIN_AUTHORIZED_SSH_KEYS_MAX = 2048;
 /* Upper limit on number of messages */
 const REMOTE_DOMAIN_MESSAGES_MAX = 2048;
 
+/* Upper limit on number of devices attached at once */
+const REMOTE_DOMAIN_ATTACH_DEVICES_MAX = 256;
+
+/* Upper limit on number of devices detached at once */
+const REMOTE_DOMAIN_DETACH_DEVICES_MAX = 256;
+
+/* Upper limit on number of domain listing parameters */
+const REMOTE_CONNECT_LIST_DOMAINS_PAGE_PARAMS_MAX = 16;
+
 
 /* UUID.  VIR_UUID_BUFLEN definition comes from libvirt.h */
 typedef opaque remote_uuid[VIR_UUID_BUFLEN];
@@ -3923,6 +3932,87 @@ struct remote_domain_event_memory_device_size_change_msg {
     unsigned hyper size;
 };
 
+struct remote_connect_domain_stats_register_args {
+    remote_domain dom;
+    unsigned int stats;
+    unsigned int interval;
+    unsigned int flags;
+};
+
+struct remote_connect_domain_stats_register_ret {
+    int callbackID;
+};
+
+struct remote_connect_domain_stats_deregister_args {
+    int callbackID;
+};
+
+struct remote_domain_event_callback_stats_msg {
+    int callbackID;
+    remote_nonnull_domain dom;
+    remote_typed_param params<REMOTE_CONNECT_GET_ALL_DOMAIN_STATS_MAX>;
+};
+
+/* @field is an index into the @fields array of the reply */
+struct remote_domain_stats_compact_param {
+    unsigned int field;
+    remote_typed_param_value value;
+};
+
+struct remote_domain_stats_compact_record {
+    remote_nonnull_domain dom;
+    remote_domain_stats_compact_param params<REMOTE_CONNECT_GET_ALL_DOMAIN_STATS_MAX>;
+};
+
+struct remote_connect_get_all_domain_stats_compact_args {
+    remote_nonnull_domain doms<REMOTE_DOMAIN_LIST_MAX>;
+    unsigned int stats;
+    unsigned int flags;
+};
+
+struct remote_connect_get_all_domain_stats_compact_ret {
+    remote_nonnull_string fields<REMOTE_CONNECT_GET_ALL_DOMAIN_STATS_MAX>;
+    remote_domain_stats_compact_record retStats<REMOTE_DOMAIN_LIST_MAX>;
+};
+
+struct remote_domain_list_snapshot_create_xml_args {
+    remote_nonnull_domain doms<REMOTE_DOMAIN_LIST_MAX>;
+    remote_nonnull_string xml_descs<REMOTE_DOMAIN_LIST_MAX>;
+    unsigned int flags;
+};
+
+struct remote_domain_list_snapshot_create_xml_ret {
+    remote_nonnull_domain_snapshot snaps<REMOTE_DOMAIN_LIST_MAX>;
+};
+
+struct remote_domain_attach_devices_args {
+    remote_nonnull_domain dom;
+    remote_nonnull_string xmls<REMOTE_DOMAIN_ATTACH_DEVICES_MAX>;
+    unsigned int flags;
+};
+
+struct remote_domain_detach_devices_args {
+    remote_nonnull_domain dom;
+    remote_nonnull_string xmls<REMOTE_DOMAIN_DETACH_DEVICES_MAX>;
+    unsigned int flags;
+};
+
+struct remote_connect_list_domains_page_args {
+    remote_typed_param params<REMOTE_CONNECT_LIST_DOMAINS_PAGE_PARAMS_MAX>;
+    unsigned int flags;
+};
+
+struct remote_connect_list_domains_page_ret {
+    remote_domain_stats_record records<REMOTE_DOMAIN_LIST_MAX>;
+    remote_string cursor;
+};
+
+struct remote_connect_domain_event_ring_open_args {
+    unsigned int stats;
+    unsigned int interval;
+    unsigned int flags;
+};
+
 /*----- Protocol. -----*/
 
 /* Define the program number, protocol version and procedure numbers here. */
@@ -6947,5 +7037,71 @@ enum remote_procedure {
      * @acl: domain:start
      * @acl: domain:write
      */
-    REMOTE_PROC_DOMAIN_RESTORE_PARAMS = 441
+    REMOTE_PROC_DOMAIN_RESTORE_PARAMS = 441,
+
+    /**
+     * @generate: none
+     * @priority: high
+     * @acl: connect:search_domains
+     * @aclfilter: domain:read
+     */
+    REMOTE_PROC_CONNECT_DOMAIN_STATS_REGISTER = 442,
+
+    /**
+     * @generate: none
+     * @priority: high
+     * @acl: connect:read
+     */
+    REMOTE_PROC_CONNECT_DOMAIN_STATS_DEREGISTER = 443,
+
+    /**
+     * @generate: both
+     * @acl: none
+     */
+    REMOTE_PROC_DOMAIN_EVENT_CALLBACK_STATS = 444,
+
+    /**
+     * @generate: none
+     * @acl: connect:search_domains
+     * @aclfilter: domain:read
+     */
+    REMOTE_PROC_CONNECT_GET_ALL_DOMAIN_STATS_COMPACT = 445,
+
+    /**
+     * @generate: none
+     * @acl: domain:snapshot
+     * @acl: domain:fs_freeze:VIR_DOMAIN_SNAPSHOT_CREATE_QUIESCE
+     */
+    REMOTE_PROC_DOMAIN_LIST_SNAPSHOT_CREATE_XML = 446,
+
+    /**
+     * @generate: none
+     * @acl: domain:write
+     * @acl: domain:save:!VIR_DOMAIN_AFFECT_CONFIG|VIR_DOMAIN_AFFECT_LIVE
+     * @acl: domain:save:VIR_DOMAIN_AFFECT_CONFIG
+     */
+    REMOTE_PROC_DOMAIN_ATTACH_DEVICES = 447,
+
+    /**
+     * @generate: none
+     * @acl: domain:write
+     * @acl: domain:save:!VIR_DOMAIN_AFFECT_CONFIG|VIR_DOMAIN_AFFECT_LIVE
+     * @acl: domain:save:VIR_DOMAIN_AFFECT_CONFIG
+     */
+    REMOTE_PROC_DOMAIN_DETACH_DEVICES = 448,
+
+    /**
+     * @generate: none
+     * @acl: connect:search_domains
+     * @aclfilter: domain:getattr
+     */
+    REMOTE_PROC_CONNECT_LIST_DOMAINS_PAGE = 449,
+
+    /**
+     * @generate: none
+     * @priority: high
+     * @acl: connect:search_domains
+     * @aclfilter: domain:getattr
+     */
+    REMOTE_PROC_CONNECT_DOMAIN_EVENT_RING_OPEN = 450
 };
@@ -44,6 +44,15 @@ struct _virKeepAlive {
     gint64 intervalStart;
     int timer;
 
+    /* Scheduled on the shared timer wheel rather than on @timer */
+    bool shared;
+    bool active;
+    /* Wheel linkage, protected by the wheel lock */
+    virKeepAlive **wheelSlot;
+    virKeepAlive *wheelPrev;
+    virKeepAlive *wheelNext;
+    gint64 wheelExpiry;
+
     virKeepAliveSendFunc sendCB;
     virKeepAliveDeadFunc deadCB;
     virKeepAliveFreeFunc freeCB;
@@ -51,6 +60,34 @@ struct _virKeepAlive {
 };
 
 
+/*
+ * Hierarchical timer wheel with one second ticks shared by all
+ * keepalive objects created with VIR_KEEPALIVE_SHARED_TIMER, so
+ * that a daemon with thousands of clients arms a single event loop
+ * timer. Each level has VIR_KEEPALIVE_WHEEL_SIZE slots, a slot on
+ * level N covers VIR_KEEPALIVE_WHEEL_SIZE^N ticks and is cascaded
+ * down to the lower levels once its time comes.
+ */
+#define VIR_KEEPALIVE_WHEEL_BITS 6
+#define VIR_KEEPALIVE_WHEEL_SIZE (1 << VIR_KEEPALIVE_WHEEL_BITS)
+#define VIR_KEEPALIVE_WHEEL_MASK (VIR_KEEPALIVE_WHEEL_SIZE - 1)
+#define VIR_KEEPALIVE_WHEEL_LEVELS 4
+
+typedef struct _virKeepAliveWheel virKeepAliveWheel;
+struct _virKeepAliveWheel {
+    virMutex lock;
+
+    int timer;
+    gint64 due;     /* tick the timer is armed for */
+    gint64 tick;    /* last processed tick */
+    size_t count;   /* number of scheduled keepalive objects */
+
+    virKeepAlive *slots[VIR_KEEPALIVE_WHEEL_LEVELS][VIR_KEEPALIVE_WHEEL_SIZE];
+};
+
+static virKeepAliveWheel keepaliveWheel;
+
+
 static virClass *virKeepAliveClass;
 static void virKeepAliveDispose(void *obj);
 
@@ -59,11 +96,212 @@ static int virKeepAliveOnceInit(void)
     if (!VIR_CLASS_NEW(virKeepAlive, virClassForObjectLockable()))
         return -1;
 
+    if (virMutexInit(&keepaliveWheel.lock) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to initialize keepalive timer wheel"));
+        return -1;
+    }
+    keepaliveWheel.timer = -1;
+    keepaliveWheel.due = -1;
+
     return 0;
 }
 
 VIR_ONCE_GLOBAL_INIT(virKeepAlive);
 
+
+static gint64
+virKeepAliveNow(void)
+{
+    return g_get_monotonic_time() / G_USEC_PER_SEC;
+}
+
+
+/*
+ * Wheel helpers below expect keepaliveWheel.lock to be held.
+ */
+static void
+virKeepAliveWheelUnlink(virKeepAlive *ka)
+{
+    if (ka->wheelPrev)
+        ka->wheelPrev->wheelNext = ka->wheelNext;
+    else
+        *ka->wheelSlot = ka->wheelNext;
+    if (ka->wheelNext)
+        ka->wheelNext->wheelPrev = ka->wheelPrev;
+
+    ka->wheelSlot = NULL;
+    ka->wheelPrev = NULL;
+    ka->wheelNext = NULL;
+}
+
+
+static void
+virKeepAliveWheelLink(virKeepAlive *ka,
+                      gint64 expiry)
+{
+    gint64 base = keepaliveWheel.tick + 1;
+    gint64 delta;
+    size_t level;
+    virKeepAlive **slot;
+
+    if (expiry < base)
+        expiry = base;
+    ka->wheelExpiry = expiry;
+    delta = expiry - base;
+
+    for (level = 0; level < VIR_KEEPALIVE_WHEEL_LEVELS - 1; level++) {
+        if (delta < (1LL << (VIR_KEEPALIVE_WHEEL_BITS * (level + 1))))
+            break;
+    }
+
+    /* Expiry beyond the horizon is clamped, the keepalive object
+     * simply gets rescheduled once it fires too early */
+    if (delta >= (1LL << (VIR_KEEPALIVE_WHEEL_BITS * VIR_KEEPALIVE_WHEEL_LEVELS)))
+        expiry = base + (1LL << (VIR_KEEPALIVE_WHEEL_BITS * VIR_KEEPALIVE_WHEEL_LEVELS)) - 1;
+
+    slot = &keepaliveWheel.slots[level][(expiry >> (VIR_KEEPALIVE_WHEEL_BITS * level)) &
+                                        VIR_KEEPALIVE_WHEEL_MASK];
+
+    ka->wheelSlot = slot;
+    ka->wheelPrev = NULL;
+    ka->wheelNext = *slot;
+    if (*slot)
+        (*slot)->wheelPrev = ka;
+    *slot = ka;
+}
+
+
+/* Moves the keepalive objects from higher levels due at @tick down */
+static void
+virKeepAliveWheelCascade(gint64 tick)
+{
+    size_t level;
+
+    for (level = VIR_KEEPALIVE_WHEEL_LEVELS - 1; level > 0; level--) {
+        size_t shift = VIR_KEEPALIVE_WHEEL_BITS * level;
+        virKeepAlive *ka;
+
+        if (tick & ((1LL << shift) - 1))
+            continue;
+
+        ka = g_steal_pointer(&keepaliveWheel.slots[level][(tick >> shift) &
+                                                          VIR_KEEPALIVE_WHEEL_MASK]);
+        while (ka) {
+            virKeepAlive *next = ka->wheelNext;
+
+            virKeepAliveWheelLink(ka, ka->wheelExpiry);
+            ka = next;
+        }
+    }
+}
+
+
+static bool
+virKeepAliveWheelHasCascade(gint64 tick)
+{
+    size_t level;
+
+    for (level = 1; level < VIR_KEEPALIVE_WHEEL_LEVELS; level++) {
+        size_t shift = VIR_KEEPALIVE_WHEEL_BITS * level;
+
+        if (tick & ((1LL << shift) - 1))
+            break;
+
+        if (keepaliveWheel.slots[level][(tick >> shift) & VIR_KEEPALIVE_WHEEL_MASK])
+            return true;
+    }
+
+    return false;
+}
+
+
+static void virKeepAliveWheelTimer(int timer, void *opaque);
+
+static void
+virKeepAliveWheelRearm(gint64 now)
+{
+    gint64 next;
+    int timeout;
+
+    if (keepaliveWheel.count == 0) {
+        if (keepaliveWheel.timer >= 0 && keepaliveWheel.due >= 0)
+            virEventUpdateTimeout(keepaliveWheel.timer, -1);
+        keepaliveWheel.due = -1;
+        return;
+    }
+
+    for (next = keepaliveWheel.tick + 1;
+         next < keepaliveWheel.tick + VIR_KEEPALIVE_WHEEL_SIZE;
+         next++) {
+        if (keepaliveWheel.slots[0][next & VIR_KEEPALIVE_WHEEL_MASK] ||
+            virKeepAliveWheelHasCascade(next))
+            break;
+    }
+
+    if (next == keepaliveWheel.due)
+        return;
+
+    timeout = next > now ? (next - now) * 1000 : 0;
+
+    if (keepaliveWheel.timer < 0) {
+        keepaliveWheel.timer = virEventAddTimeout(timeout, virKeepAliveWheelTimer,
+                                                  NULL, NULL);
+        if (keepaliveWheel.timer < 0) {
+            VIR_WARN("Failed to add keepalive timer wheel timeout");
+            return;
+        }
+    } else {
+        virEventUpdateTimeout(keepaliveWheel.timer, timeout);
+    }
+
+    keepaliveWheel.due = next;
+}
+
+
+/* @ka must be locked */
+static void
+virKeepAliveWheelAdd(virKeepAlive *ka,
+                     int timeout)
+{
+    gint64 now = virKeepAliveNow();
+
+    VIR_WITH_MUTEX_LOCK_GUARD(&keepaliveWheel.lock) {
+        if (ka->wheelSlot) {
+            virKeepAliveWheelUnlink(ka);
+        } else {
+            /* Don't replay ticks of an idle wheel */
+            if (keepaliveWheel.count == 0)
+                keepaliveWheel.tick = now - 1;
+            /* the wheel has another reference to this object */
+            virObjectRef(ka);
+            keepaliveWheel.count++;
+        }
+
+        virKeepAliveWheelLink(ka, now + timeout);
+        virKeepAliveWheelRearm(now);
+    }
+}
+
+
+/*
+ * @ka must be locked. Returns true if the reference held by the
+ * wheel has to be released by the caller.
+ */
+static bool
+virKeepAliveWheelRemove(virKeepAlive *ka)
+{
+    VIR_LOCK_GUARD lock = virLockGuardLock(&keepaliveWheel.lock);
+
+    if (!ka->wheelSlot)
+        return false;
+
+    virKeepAliveWheelUnlink(ka);
+    keepaliveWheel.count--;
+    virKeepAliveWheelRearm(virKeepAliveNow());
+    return true;
+}
+
 static virNetMessage *
 virKeepAliveMessage(virKeepAlive *ka, int proc)
 {
@@ -109,19 +347,34 @@ virKeepAliveMessage(virKeepAlive *ka, int proc)
 }
 
 
+/* @ka must be locked */
+static void
+virKeepAliveArm(virKeepAlive *ka,
+                int timeout)
+{
+    if (ka->shared) {
+        if (ka->active)
+            virKeepAliveWheelAdd(ka, timeout);
+    } else if (ka->timer >= 0) {
+        virEventUpdateTimeout(ka->timer, timeout * 1000);
+    }
+}
+
+
 static bool
 virKeepAliveTimerInternal(virKeepAlive *ka,
                           virNetMessage **msg)
 {
-    gint64 now = g_get_monotonic_time() / G_USEC_PER_SEC;
+    gint64 now = virKeepAliveNow();
     int timeval;
 
-    if (ka->interval <= 0 || ka->intervalStart == 0)
+    if (ka->interval <= 0 || ka->intervalStart == 0 ||
+        (ka->shared && !ka->active))
         return false;
 
     if (now - ka->intervalStart < ka->interval) {
         timeval = ka->interval - (now - ka->intervalStart);
-        virEventUpdateTimeout(ka->timer, timeval * 1000);
+        virKeepAliveArm(ka, timeval);
         return false;
     }
 
@@ -141,7 +394,7 @@ virKeepAliveTimerInternal(virKeepAlive *ka,
         ka->countToDeath--;
         ka->intervalStart = now;
         *msg = virKeepAliveMessage(ka, KEEPALIVE_PROC_PING);
-        virEventUpdateTimeout(ka->timer, ka->interval * 1000);
+        virKeepAliveArm(ka, ka->interval);
         return false;
     }
 }
@@ -178,17 +431,64 @@ virKeepAliveTimer(int timer G_GNUC_UNUSED, void *opaque)
 }
 
 
+static void
+virKeepAliveWheelTimer(int timer G_GNUC_UNUSED,
+                       void *opaque G_GNUC_UNUSED)
+{
+    g_autofree virKeepAlive **due = NULL;
+    size_t ndue = 0;
+    gint64 now = virKeepAliveNow();
+    size_t i;
+
+    VIR_WITH_MUTEX_LOCK_GUARD(&keepaliveWheel.lock) {
+        while (keepaliveWheel.tick < now) {
+            gint64 tick = keepaliveWheel.tick + 1;
+            virKeepAlive *ka;
+
+            virKeepAliveWheelCascade(tick);
+            keepaliveWheel.tick = tick;
+
+            ka = g_steal_pointer(&keepaliveWheel.slots[0][tick & VIR_KEEPALIVE_WHEEL_MASK]);
+            while (ka) {
+                virKeepAlive *next = ka->wheelNext;
+
+                ka->wheelSlot = NULL;
+                ka->wheelPrev = NULL;
+                ka->wheelNext = NULL;
+                keepaliveWheel.count--;
+                /* the wheel reference is handed over to @due */
+                VIR_APPEND_ELEMENT(due, ndue, ka);
+                ka = next;
+            }
+        }
+
+        keepaliveWheel.due = -1;
+        virKeepAliveWheelRearm(now);
+    }
+
+    /* Every keepalive object re-adds itself to the wheel as needed */
+    for (i = 0; i < ndue; i++) {
+        virKeepAliveTimer(-1, due[i]);
+        virObjectUnref(due[i]);
+    }
+}
+
+
 virKeepAlive *
 virKeepAliveNew(int interval,
                 unsigned int count,
                 void *client,
                 virKeepAliveSendFunc sendCB,
                 virKeepAliveDeadFunc deadCB,
-                virKeepAliveFreeFunc freeCB)
+                virKeepAliveFreeFunc freeCB,
+                unsigned int flags)
 {
     virKeepAlive *ka;
 
-    VIR_DEBUG("client=%p, interval=%d, count=%u", client, interval, count);
+    VIR_DEBUG("client=%p, interval=%d, count=%u, flags=0x%x",
+              client, interval, count, flags);
+
+    virCheckFlags(VIR_KEEPALIVE_SHARED_TIMER, NULL);
 
     if (virKeepAliveInitialize() < 0)
         return NULL;
@@ -200,6 +500,7 @@ virKeepAliveNew(int interval,
     ka->count = count;
     ka->countToDeath = count;
     ka->timer = -1;
+    ka->shared = !!(flags & VIR_KEEPALIVE_SHARED_TIMER);
     ka->client = client;
     ka->sendCB = sendCB;
     ka->deadCB = deadCB;
@@ -237,7 +538,7 @@ virKeepAliveStart(virKeepAlive *ka,
 
     virObjectLock(ka);
 
-    if (ka->timer >= 0) {
+    if (ka->timer >= 0 || ka->active) {
         VIR_DEBUG("Keepalive messages already enabled");
         ret = 0;
         goto cleanup;
@@ -270,13 +571,21 @@ virKeepAliveStart(virKeepAlive *ka,
           "ka=%p client=%p interval=%d count=%u",
           ka, ka->client, interval, count);
 
-    now = g_get_monotonic_time() / G_USEC_PER_SEC;
+    now = virKeepAliveNow();
     delay = now - ka->lastPacketReceived;
     if (delay > ka->interval)
         timeout = 0;
     else
         timeout = ka->interval - delay;
     ka->intervalStart = now - (ka->interval - timeout);
+
+    if (ka->shared) {
+        ka->active = true;
+        virKeepAliveWheelAdd(ka, timeout);
+        ret = 0;
+        goto cleanup;
+    }
+
     ka->timer = virEventAddTimeout(timeout * 1000, virKeepAliveTimer,
                                    ka, virObjectFreeCallback);
     if (ka->timer < 0)
@@ -295,18 +604,26 @@ virKeepAliveStart(virKeepAlive *ka,
 void
 virKeepAliveStop(virKeepAlive *ka)
 {
+    bool unref = false;
+
     virObjectLock(ka);
 
     PROBE(RPC_KEEPALIVE_STOP,
           "ka=%p client=%p",
           ka, ka->client);
 
-    if (ka->timer > 0) {
+    if (ka->shared) {
+        ka->active = false;
+        unref = virKeepAliveWheelRemove(ka);
+    } else if (ka->timer > 0) {
         virEventRemoveTimeout(ka->timer);
         ka->timer = -1;
     }
 
     virObjectUnlock(ka);
+
+    if (unref)
+        virObjectUnref(ka);
 }
 
 
@@ -375,7 +692,7 @@ virKeepAliveCheckMessage(virKeepAlive *ka,
     virObjectLock(ka);
 
     ka->countToDeath = ka->count;
-    ka->intervalStart = g_get_monotonic_time() / G_USEC_PER_SEC;
+    ka->intervalStart = virKeepAliveNow();
     ka->lastPacketReceived = ka->intervalStart;
 
     if (msg->header.prog == KEEPALIVE_PROGRAM &&
@@ -402,7 +719,10 @@ virKeepAliveCheckMessage(virKeepAlive *ka,
         }
     }
 
-    if (ka->timer >= 0)
+    /* There's no need to touch the shared timer wheel for every
+     * message, the keepalive object reschedules itself according to
+     * the updated @intervalStart once its current expiry passes */
+    if (!ka->shared && ka->timer >= 0)
         virEventUpdateTimeout(ka->timer, ka->interval * 1000);
 
     virObjectUnlock(ka);
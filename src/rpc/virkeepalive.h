@@ -29,13 +29,20 @@ typedef void (*virKeepAliveFreeFunc)(void *client);
 
 typedef struct _virKeepAlive virKeepAlive;
 
+typedef enum {
+    /* Use a timer wheel shared by all keepalive objects instead of
+     * an event loop timer per object */
+    VIR_KEEPALIVE_SHARED_TIMER = (1 << 0),
+} virKeepAliveFlags;
+
 
 virKeepAlive *virKeepAliveNew(int interval,
                                 unsigned int count,
                                 void *client,
                                 virKeepAliveSendFunc sendCB,
                                 virKeepAliveDeadFunc deadCB,
-                                virKeepAliveFreeFunc freeCB)
+                                virKeepAliveFreeFunc freeCB,
+                                unsigned int flags)
                                 ATTRIBUTE_NONNULL(3) ATTRIBUTE_NONNULL(4)
                                 ATTRIBUTE_NONNULL(5) ATTRIBUTE_NONNULL(6);
 
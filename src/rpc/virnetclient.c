@@ -98,11 +98,15 @@ struct _virNetClient {
     virNetClientCall *waitDispatch;
     /* True if a thread holds the buck */
     bool haveTheBuck;
+    /* Placeholder call of the dedicated I/O thread, which holds the
+     * buck for the whole lifetime of the connection when running */
+    virNetClientCall *ioCall;
 
     size_t nstreams;
     virNetClientStream **streams;
 
     virKeepAlive *keepalive;
+    bool compress;
     bool wantClose;
     int closeReason;
     virErrorPtr error;
@@ -689,7 +693,7 @@ int virNetClientRegisterKeepAlive(virNetClient *client)
     if (!(ka = virKeepAliveNew(-1, 0, client,
                                virNetClientKeepAliveSendCB,
                                virNetClientKeepAliveDeadCB,
-                               virObjectFreeCallback)))
+                               virObjectFreeCallback, 0)))
         return -1;
 
     /* keepalive object has a reference to client */
@@ -1103,6 +1107,26 @@ void virNetClientRemoveStream(virNetClient *client,
 }
 
 
+/*
+ * Returns true if a stream was added for the call of @proc with @serial,
+ * which then has to be made over @client.
+ */
+bool virNetClientHasStream(virNetClient *client,
+                           int proc,
+                           unsigned int serial)
+{
+    bool ret = false;
+    size_t i;
+
+    virObjectLock(client);
+    for (i = 0; i < client->nstreams && !ret; i++)
+        ret = virNetClientStreamMatchesCall(client->streams[i], proc, serial);
+    virObjectUnlock(client);
+
+    return ret;
+}
+
+
 const char *virNetClientLocalAddrStringSASL(virNetClient *client)
 {
     return virNetSocketLocalAddrStringSASL(client->sock);
@@ -1144,12 +1168,8 @@ virNetClientCallDispatchReply(virNetClient *client)
         return -1;
     }
 
-    VIR_REALLOC_N(thecall->msg->buffer, client->msg.bufferLength);
-
-    memcpy(thecall->msg->buffer, client->msg.buffer, client->msg.bufferLength);
+    virNetMessageStealBuffer(thecall->msg, &client->msg);
     memcpy(&thecall->msg->header, &client->msg.header, sizeof(client->msg.header));
-    thecall->msg->bufferLength = client->msg.bufferLength;
-    thecall->msg->bufferOffset = client->msg.bufferOffset;
 
     thecall->msg->nfds = client->msg.nfds;
     thecall->msg->fds = g_steal_pointer(&client->msg.fds);
@@ -1317,6 +1337,16 @@ virNetClientCallDispatch(virNetClient *client)
     case VIR_NET_REPLY_WITH_FDS: /* Normal RPC replies with FDs */
         return virNetClientCallDispatchReply(client);
 
+    case VIR_NET_REPLY_COMPRESSED: /* Deflated RPC replies */
+        if (!client->compress) {
+            virReportError(VIR_ERR_RPC, "%s",
+                           _("got compressed reply without requesting compression"));
+            return -1;
+        }
+        if (virNetMessageDecompressPayload(&client->msg) < 0)
+            return -1;
+        return virNetClientCallDispatchReply(client);
+
     case VIR_NET_MESSAGE: /* Async notifications */
         return virNetClientCallDispatchMessage(client);
 
@@ -1409,10 +1439,8 @@ virNetClientIOReadMessage(virNetClient *client)
     ssize_t ret;
 
     /* Start by reading length word */
-    if (client->msg.bufferLength == 0) {
-        client->msg.bufferLength = 4;
-        client->msg.buffer = g_new0(char, client->msg.bufferLength);
-    }
+    if (client->msg.bufferLength == 0)
+        virNetMessageResizeBuffer(&client->msg, VIR_NET_MESSAGE_LEN_MAX);
 
     wantData = client->msg.bufferLength - client->msg.bufferOffset;
 
@@ -1689,9 +1717,10 @@ static int virNetClientIOEventLoop(virNetClient *client,
 
         /* We have to be prepared to receive stream data
          * regardless of whether any of the calls waiting
-         * for dispatch are for streams.
+         * for dispatch are for streams. The I/O thread also
+         * takes care of any async events.
          */
-        if (client->nstreams)
+        if (client->nstreams || client->ioCall)
             ev |= G_IO_IN;
 
         source = virEventGLibAddSocketWatch(virNetSocketGetFD(client->sock),
@@ -1904,6 +1933,11 @@ static void virNetClientIOUpdateCallback(virNetClient *client,
  *
  * NB(7) Don't Panic!
  *
+ * NB(8) If virNetClientStartIOThread was used, the I/O thread holds
+ * the buck until the connection is closed, so callers just queue
+ * their call and sleep. The buck is only passed on to them when the
+ * I/O thread gives up due to an error.
+ *
  * Returns 1 if the call was queued and will be completed later (only
  * for nonBlock == true), 0 if the call was completed and -1 on error.
  */
@@ -2001,6 +2035,93 @@ static int virNetClientIO(virNetClient *client,
 }
 
 
+static void
+virNetClientIOThread(void *opaque)
+{
+    virNetClient *client = opaque;
+    virNetClientCall *call;
+
+    virObjectLock(client);
+
+    call = client->ioCall;
+    VIR_DEBUG("I/O thread running client=%p call=%p", client, call);
+
+    /* The buck was taken on our behalf by virNetClientStartIOThread
+     * and is only given up once the connection fails or is closed,
+     * all other threads just queue their calls and sleep until the
+     * calls are done */
+    virNetClientIOUpdateCallback(client, false);
+
+    ignore_value(virNetClientIOEventLoop(client, call));
+
+    if (client->sock)
+        virNetClientIOUpdateCallback(client, true);
+
+    client->ioCall = NULL;
+    VIR_DEBUG("I/O thread exiting client=%p", client);
+
+    virObjectUnlock(client);
+
+    g_free(call);
+    virObjectUnref(client);
+}
+
+
+/**
+ * virNetClientStartIOThread:
+ * @client: the client
+ *
+ * Starts a thread owning the socket of @client for the rest of its
+ * lifetime. Calls made from other threads are then only queued for
+ * the I/O thread, and the callers wait for their own calls to complete
+ * rather than taking turns running the event loop for each other,
+ * which avoids convoying when many threads share one connection.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virNetClientStartIOThread(virNetClient *client)
+{
+    VIR_LOCK_GUARD lock = virObjectLockGuard(client);
+    virThread thread;
+
+    if (client->ioCall)
+        return 0;
+
+    if (!client->sock || client->wantClose) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("client socket is closed"));
+        return -1;
+    }
+
+    if (client->haveTheBuck) {
+        virReportError(VIR_ERR_OPERATION_INVALID, "%s",
+                       _("cannot start I/O thread while a call is in progress"));
+        return -1;
+    }
+
+    /* Never completes, so the I/O thread keeps the buck */
+    client->ioCall = g_new0(virNetClientCall, 1);
+    client->ioCall->mode = VIR_NET_CLIENT_MODE_WAIT_RX;
+    client->haveTheBuck = true;
+
+    /* the I/O thread has another reference to the client */
+    virObjectRef(client);
+
+    if (virThreadCreateFull(&thread, false, virNetClientIOThread,
+                            "rpc-client-io", false, client) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to create client I/O thread"));
+        client->haveTheBuck = false;
+        g_clear_pointer(&client->ioCall, g_free);
+        virObjectUnref(client);
+        return -1;
+    }
+
+    return 0;
+}
+
+
 void virNetClientIncomingEvent(virNetSocket *sock,
                                int events,
                                void *opaque)
@@ -2216,6 +2337,55 @@ int virNetClientSendNonBlock(virNetClient *client,
     return ret;
 }
 
+
+/**
+ * virNetClientEnableCompression:
+ * @client: the client
+ * @threshold: smallest reply payload to compress in bytes
+ *
+ * Asks the server to deflate successful replies whose payload is
+ * larger than @threshold bytes. Servers not knowing about compression
+ * silently ignore the request and keep sending plain replies.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virNetClientEnableCompression(virNetClient *client,
+                              unsigned int threshold)
+{
+    virNetCompressEnableArgs args = { VIR_NET_COMPRESS_DEFLATE, threshold };
+    virNetMessage *msg;
+    int ret = -1;
+
+    if (!(msg = virNetMessageNew(false)))
+        return -1;
+
+    msg->header.prog = VIR_NET_COMPRESS_PROGRAM;
+    msg->header.vers = VIR_NET_COMPRESS_PROTOCOL_VERSION;
+    msg->header.type = VIR_NET_MESSAGE;
+    msg->header.proc = VIR_NET_COMPRESS_PROC_ENABLE;
+    msg->header.serial = 0;
+    msg->header.status = VIR_NET_OK;
+
+    if (virNetMessageEncodeHeader(msg) < 0 ||
+        virNetMessageEncodePayload(msg, (xdrproc_t)xdr_virNetCompressEnableArgs,
+                                   &args) < 0)
+        goto cleanup;
+
+    VIR_WITH_OBJECT_LOCK_GUARD(client) {
+        /* Accept compressed replies before the server can send any */
+        client->compress = true;
+        if (virNetClientSendInternal(client, msg, false, false) < 0)
+            client->compress = false;
+        else
+            ret = 0;
+    }
+
+ cleanup:
+    virNetMessageFree(msg);
+    return ret;
+}
+
 /*
  * @msg: a message allocated on heap or stack
  *
@@ -127,6 +127,10 @@ int virNetClientAddStream(virNetClient *client,
 void virNetClientRemoveStream(virNetClient *client,
                               virNetClientStream *st);
 
+bool virNetClientHasStream(virNetClient *client,
+                           int proc,
+                           unsigned int serial);
+
 int virNetClientSendWithReply(virNetClient *client,
                               virNetMessage *msg);
 
@@ -161,3 +165,8 @@ int virNetClientKeepAliveStart(virNetClient *client,
                                unsigned int count);
 
 void virNetClientKeepAliveStop(virNetClient *client);
+
+int virNetClientEnableCompression(virNetClient *client,
+                                  unsigned int threshold);
+
+int virNetClientStartIOThread(virNetClient *client);
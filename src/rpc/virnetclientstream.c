@@ -180,6 +180,18 @@ bool virNetClientStreamMatches(virNetClientStream *st,
 }
 
 
+bool virNetClientStreamMatchesCall(virNetClientStream *st,
+                                   int proc,
+                                   unsigned int serial)
+{
+    bool match;
+    virObjectLock(st);
+    match = st->proc == proc && st->serial == serial;
+    virObjectUnlock(st);
+    return match;
+}
+
+
 static
 void virNetClientStreamRaiseError(virNetClientStream *st)
 {
@@ -339,10 +351,7 @@ int virNetClientStreamQueuePacket(virNetClientStream *st,
     memcpy(&tmp_msg->header, &msg->header, sizeof(msg->header));
 
     /* Steal message buffer */
-    tmp_msg->buffer = g_steal_pointer(&msg->buffer);
-    tmp_msg->bufferLength = msg->bufferLength;
-    tmp_msg->bufferOffset = msg->bufferOffset;
-    msg->bufferLength = msg->bufferOffset = 0;
+    virNetMessageStealBuffer(tmp_msg, msg);
 
     virObjectLock(st);
 
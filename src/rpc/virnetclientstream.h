@@ -53,6 +53,10 @@ void virNetClientStreamSetClosed(virNetClientStream *st,
 bool virNetClientStreamMatches(virNetClientStream *st,
                                virNetMessage *msg);
 
+bool virNetClientStreamMatchesCall(virNetClientStream *st,
+                                   int proc,
+                                   unsigned int serial);
+
 int virNetClientStreamQueuePacket(virNetClientStream *st,
                                   virNetMessage *msg);
 
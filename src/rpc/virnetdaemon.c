@@ -22,6 +22,9 @@
 
 #include <unistd.h>
 #include <fcntl.h>
+#if WITH_MALLOC_TRIM
+# include <malloc.h>
+#endif
 
 #include "virnetdaemon.h"
 #include "virlog.h"
@@ -34,8 +37,12 @@
 #include "virnetserver.h"
 #include "virgdbus.h"
 #include "virhash.h"
+#include "viridentity.h"
 #include "virstring.h"
 #include "virsystemd.h"
+#include "virevent.h"
+#include "vireventglib.h"
+#include "virtime.h"
 
 #define VIR_FROM_THIS VIR_FROM_RPC
 
@@ -79,6 +86,13 @@ struct _virNetDaemon {
     unsigned int autoShutdownTimeout;
     size_t autoShutdownInhibitions;
     int autoShutdownInhibitFd;
+    bool idleStandby;
+
+    virNetSocket **metricsSocks;
+    size_t nmetricsSocks;
+    virNetDaemonMetricsFunc metricsFunc;
+    void *metricsOpaque;
+    size_t metricsScrapes;  /* scrapes being served right now */
 };
 
 
@@ -89,6 +103,9 @@ daemonServerClose(void *payload,
                   const char *key G_GNUC_UNUSED,
                   void *opaque G_GNUC_UNUSED);
 
+static void
+virNetDaemonCloseMetrics(virNetDaemon *dmn);
+
 static void
 virNetDaemonDispose(void *obj)
 {
@@ -110,6 +127,8 @@ virNetDaemonDispose(void *obj)
     VIR_FORCE_CLOSE(dmn->autoShutdownInhibitFd);
     g_free(dmn->stateStopThread);
 
+    virNetDaemonCloseMetrics(dmn);
+
     g_clear_pointer(&dmn->servers, g_hash_table_unref);
 
     virJSONValueFree(dmn->srvObject);
@@ -413,6 +432,26 @@ virNetDaemonAutoShutdown(virNetDaemon *dmn,
 }
 
 
+/**
+ * virNetDaemonSetIdleStandby:
+ * @dmn: daemon
+ * @standby: whether to stay in standby once idle
+ *
+ * Once the daemon has no clients for the automatic shutdown timeout and
+ * @standby is true, it releases the memory it can instead of quitting, so
+ * that the next client doesn't have to wait for the daemon to start up
+ * and initialize the drivers again.
+ */
+void
+virNetDaemonSetIdleStandby(virNetDaemon *dmn,
+                           bool standby)
+{
+    VIR_LOCK_GUARD lock = virObjectLockGuard(dmn);
+
+    dmn->idleStandby = standby;
+}
+
+
 #ifdef G_OS_UNIX
 /* As per: https://www.freedesktop.org/wiki/Software/systemd/inhibit */
 static void
@@ -657,13 +696,46 @@ virNetDaemonAddSignalHandler(virNetDaemon *dmn G_GNUC_UNUSED,
 #endif /* WIN32 */
 
 
+static int
+daemonServerTrimWorkers(void *payload,
+                        const char *key G_GNUC_UNUSED,
+                        void *opaque G_GNUC_UNUSED)
+{
+    virNetServer *srv = payload;
+
+    virNetServerTrimWorkers(srv);
+    return 0;
+}
+
+
+/* Release the memory the idle daemon doesn't need: the workers above the
+ * minimum, cached message buffers and the free memory held by malloc. */
+static void
+virNetDaemonStandby(virNetDaemon *dmn)
+{
+    virHashForEach(dmn->servers, daemonServerTrimWorkers, NULL);
+    virNetMessageTrimBufferPool();
+#if WITH_MALLOC_TRIM
+    malloc_trim(0);
+#endif
+}
+
+
 static void
-virNetDaemonAutoShutdownTimer(int timerid G_GNUC_UNUSED,
+virNetDaemonAutoShutdownTimer(int timerid,
                               void *opaque)
 {
     virNetDaemon *dmn = opaque;
     VIR_LOCK_GUARD lock = virObjectLockGuard(dmn);
 
+    if (dmn->idleStandby) {
+        VIR_DEBUG("Entering standby");
+        /* Re-armed by virNetDaemonRun once clients come and go again */
+        virEventUpdateTimeout(timerid, -1);
+        virNetDaemonStandby(dmn);
+        return;
+    }
+
     if (!dmn->autoShutdownInhibitions) {
         VIR_DEBUG("Automatic shutdown triggered");
         dmn->quit = true;
@@ -687,8 +759,13 @@ virNetDaemonUpdateServices(virNetDaemon *dmn,
                            bool enabled)
 {
     VIR_LOCK_GUARD lock = virObjectLockGuard(dmn);
+    size_t i;
 
     virHashForEach(dmn->servers, daemonServerUpdateServices, &enabled);
+
+    for (i = 0; i < dmn->nmetricsSocks; i++)
+        virNetSocketUpdateIOCallback(dmn->metricsSocks[i],
+                                     enabled ? VIR_EVENT_HANDLE_READABLE : 0);
 }
 
 static int
@@ -815,6 +892,7 @@ virNetDaemonRun(virNetDaemon *dmn)
 
         if (dmn->quit && dmn->finishTimer == -1) {
             virHashForEach(dmn->servers, daemonServerClose, NULL);
+            virNetDaemonCloseMetrics(dmn);
             if (dmn->shutdownPrepareCb && dmn->shutdownPrepareCb() < 0)
                 break;
 
@@ -922,3 +1000,721 @@ virNetDaemonSetShutdownCallbacks(virNetDaemon *dmn,
     dmn->shutdownPrepareCb = prepareCb;
     dmn->shutdownWaitCb = waitCb;
 }
+
+
+/*
+ * The metrics endpoint: a minimal HTTP server answering GET requests
+ * with the metrics of the daemon in the OpenMetrics text format. Every
+ * scrape is served by its own thread, so that neither a slow client nor
+ * slow collection of the driver metrics blocks the event loop. The thread
+ * runs with the identity of the scraping client, so the access control
+ * of the drivers applies to what they report.
+ */
+#define VIR_NET_DAEMON_METRICS_MAX_SCRAPES 4
+#define VIR_NET_DAEMON_METRICS_MAX_REQUEST 8192
+#define VIR_NET_DAEMON_METRICS_TIMEOUT 5000 /* milliseconds */
+
+typedef struct _virNetDaemonMetricsScrape virNetDaemonMetricsScrape;
+struct _virNetDaemonMetricsScrape {
+    virNetDaemon *dmn;
+    virNetSocket *sock;
+};
+
+
+static void
+virNetDaemonMetricsScrapeFree(virNetDaemonMetricsScrape *scrape)
+{
+    VIR_WITH_OBJECT_LOCK_GUARD(scrape->dmn) {
+        scrape->dmn->metricsScrapes--;
+    }
+
+    virNetSocketClose(scrape->sock);
+    virObjectUnref(scrape->sock);
+    virObjectUnref(scrape->dmn);
+    g_free(scrape);
+}
+
+
+static int
+virNetDaemonMetricsReadRequest(virNetSocket *sock,
+                               char **request)
+{
+    g_autofree char *buf = g_new0(char, VIR_NET_DAEMON_METRICS_MAX_REQUEST);
+    GPollFD pollfd = { .fd = virNetSocketGetFD(sock), .events = G_IO_IN };
+    gint64 deadline = g_get_monotonic_time() +
+        VIR_NET_DAEMON_METRICS_TIMEOUT * G_TIME_SPAN_MILLISECOND;
+    size_t len = 0;
+
+    if (virNetSocketSetBlocking(sock, false) < 0)
+        return -1;
+
+    /* Only the request line matters, but wait for the whole header so
+     * that the client doesn't see the connection reset */
+    while (!strstr(buf, "\r\n\r\n") && !strstr(buf, "\n\n")) {
+        gint64 timeout = (deadline - g_get_monotonic_time()) / G_TIME_SPAN_MILLISECOND;
+        ssize_t got;
+
+        if (len == VIR_NET_DAEMON_METRICS_MAX_REQUEST - 1 || timeout <= 0) {
+            VIR_DEBUG("Dropping incomplete metrics request");
+            return -1;
+        }
+
+        if (g_poll(&pollfd, 1, timeout) < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+
+        got = read(pollfd.fd, buf + len, VIR_NET_DAEMON_METRICS_MAX_REQUEST - 1 - len);
+        if (got < 0) {
+            if (errno == EINTR || errno == EAGAIN)
+                continue;
+            return -1;
+        }
+        if (got == 0)
+            return -1;
+
+        len += got;
+    }
+
+    *request = g_steal_pointer(&buf);
+    return 0;
+}
+
+
+/*
+ * Returns NULL if @request asks for the metrics, the HTTP status line to
+ * answer it with otherwise.
+ */
+static const char *
+virNetDaemonMetricsCheckRequest(const char *request,
+                                bool *head)
+{
+    g_autofree char *line = g_strndup(request, strcspn(request, "\r\n"));
+    g_auto(GStrv) words = g_strsplit(line, " ", 0);
+    char *query;
+
+    if (g_strv_length(words) != 3 || !STRPREFIX(words[2], "HTTP/1."))
+        return "400 Bad Request";
+
+    if (STREQ(words[0], "HEAD"))
+        *head = true;
+    else if (STRNEQ(words[0], "GET"))
+        return "405 Method Not Allowed";
+
+    if ((query = strchr(words[1], '?')))
+        *query = '\0';
+
+    if (STRNEQ(words[1], "/metrics") && STRNEQ(words[1], "/"))
+        return "404 Not Found";
+
+    return NULL;
+}
+
+
+typedef struct _virNetDaemonLoopProbe virNetDaemonLoopProbe;
+struct _virNetDaemonLoopProbe {
+    int refs;
+    virMutex lock;
+    virCond cond;
+    bool fired;
+};
+
+
+static void
+virNetDaemonLoopProbeUnref(void *opaque)
+{
+    virNetDaemonLoopProbe *probe = opaque;
+
+    if (!g_atomic_int_dec_and_test(&probe->refs))
+        return;
+
+    virCondDestroy(&probe->cond);
+    virMutexDestroy(&probe->lock);
+    g_free(probe);
+}
+
+
+static void
+virNetDaemonLoopProbeTimer(int timer,
+                           void *opaque)
+{
+    virNetDaemonLoopProbe *probe = opaque;
+
+    VIR_WITH_MUTEX_LOCK_GUARD(&probe->lock) {
+        probe->fired = true;
+        virCondSignal(&probe->cond);
+    }
+
+    virEventRemoveTimeout(timer);
+}
+
+
+/*
+ * Measures how long it takes the event loop to run a timer which is due
+ * immediately, in microseconds. A busy or stuck loop delays all clients
+ * of the daemon. The probe is shared with the timer, which may outlive
+ * this function if the loop doesn't get to it in time.
+ */
+static int
+virNetDaemonMeasureLoopLag(unsigned long long *lag)
+{
+    virNetDaemonLoopProbe *probe = g_new0(virNetDaemonLoopProbe, 1);
+    unsigned long long deadline;
+    gint64 start;
+
+    if (virMutexInit(&probe->lock) < 0) {
+        g_free(probe);
+        return -1;
+    }
+    if (virCondInit(&probe->cond) < 0) {
+        virMutexDestroy(&probe->lock);
+        g_free(probe);
+        return -1;
+    }
+    probe->refs = 2;
+
+    if (virTimeMillisNow(&deadline) < 0) {
+        probe->refs = 1;
+        virNetDaemonLoopProbeUnref(probe);
+        return -1;
+    }
+    deadline += VIR_NET_DAEMON_METRICS_TIMEOUT;
+    start = g_get_monotonic_time();
+
+    if (virEventAddTimeout(0, virNetDaemonLoopProbeTimer, probe,
+                           virNetDaemonLoopProbeUnref) < 0) {
+        probe->refs = 1;
+        virNetDaemonLoopProbeUnref(probe);
+        return -1;
+    }
+
+    VIR_WITH_MUTEX_LOCK_GUARD(&probe->lock) {
+        while (!probe->fired) {
+            if (virCondWaitUntil(&probe->cond, &probe->lock, deadline) < 0)
+                break;
+        }
+    }
+
+    *lag = g_get_monotonic_time() - start;
+    virNetDaemonLoopProbeUnref(probe);
+    return 0;
+}
+
+
+static void
+virNetDaemonMetricsEventLoop(virOpenMetrics *metrics)
+{
+    virEventGLibStats st;
+    double bounds[VIR_EVENT_GLIB_HIST_BUCKETS - 1];
+    unsigned long long lag;
+    size_t i;
+
+    virEventGLibGetStats(&st);
+
+    for (i = 0; i < G_N_ELEMENTS(bounds); i++)
+        bounds[i] = (1ULL << i) / 1e6;
+
+    virOpenMetricsDeclare(metrics, "libvirt_event_loop_iterations",
+                          VIR_OPEN_METRICS_COUNTER,
+                          "Iterations of the event loop");
+    virOpenMetricsDeclare(metrics, "libvirt_event_loop_handle_dispatches",
+                          VIR_OPEN_METRICS_COUNTER,
+                          "File handle callbacks run by the event loop");
+    virOpenMetricsDeclare(metrics, "libvirt_event_loop_timeout_dispatches",
+                          VIR_OPEN_METRICS_COUNTER,
+                          "Timer callbacks run by the event loop");
+    virOpenMetricsDeclare(metrics, "libvirt_event_loop_handles",
+                          VIR_OPEN_METRICS_GAUGE,
+                          "File handles watched by the event loop");
+    virOpenMetricsDeclare(metrics, "libvirt_event_loop_timeouts",
+                          VIR_OPEN_METRICS_GAUGE,
+                          "Timers registered with the event loop");
+    virOpenMetricsDeclare(metrics, "libvirt_event_loop_timeouts_enabled",
+                          VIR_OPEN_METRICS_GAUGE,
+                          "Timers of the event loop which are enabled");
+    virOpenMetricsDeclare(metrics, "libvirt_event_loop_lag_seconds",
+                          VIR_OPEN_METRICS_GAUGE,
+                          "Time the event loop took to run a timer due immediately");
+    virOpenMetricsDeclare(metrics, "libvirt_event_loop_dispatch_seconds",
+                          VIR_OPEN_METRICS_HISTOGRAM,
+                          "Time spent in a callback run by the event loop");
+    virOpenMetricsDeclare(metrics, "libvirt_event_loop_slow_dispatches",
+                          VIR_OPEN_METRICS_COUNTER,
+                          "Callbacks which ran longer than the slow threshold");
+    virOpenMetricsDeclare(metrics, "libvirt_event_loop_heartbeats",
+                          VIR_OPEN_METRICS_COUNTER,
+                          "Runs of the heartbeat timer of the event loop");
+    virOpenMetricsDeclare(metrics, "libvirt_event_loop_heartbeat_lag_seconds",
+                          VIR_OPEN_METRICS_COUNTER,
+                          "Time the heartbeat timer of the event loop ran late");
+
+    virOpenMetricsAddULLong(metrics, "libvirt_event_loop_iterations",
+                            NULL, 0, st.iterations);
+    virOpenMetricsAddULLong(metrics, "libvirt_event_loop_handle_dispatches",
+                            NULL, 0, st.handleDispatches);
+    virOpenMetricsAddULLong(metrics, "libvirt_event_loop_timeout_dispatches",
+                            NULL, 0, st.timeoutDispatches);
+    virOpenMetricsAddULLong(metrics, "libvirt_event_loop_handles",
+                            NULL, 0, st.handles);
+    virOpenMetricsAddULLong(metrics, "libvirt_event_loop_timeouts",
+                            NULL, 0, st.timeouts);
+    virOpenMetricsAddULLong(metrics, "libvirt_event_loop_timeouts_enabled",
+                            NULL, 0, st.timeoutsEnabled);
+    virOpenMetricsAddHistogram(metrics, "libvirt_event_loop_dispatch_seconds",
+                               NULL, 0, bounds, st.dispatchHist,
+                               VIR_EVENT_GLIB_HIST_BUCKETS,
+                               st.dispatchTime / 1e6);
+    virOpenMetricsAddULLong(metrics, "libvirt_event_loop_slow_dispatches",
+                            NULL, 0, st.slowDispatches);
+    virOpenMetricsAddULLong(metrics, "libvirt_event_loop_heartbeats",
+                            NULL, 0, st.heartbeats);
+    virOpenMetricsAddDouble(metrics, "libvirt_event_loop_heartbeat_lag_seconds",
+                            NULL, 0, st.heartbeatLag / 1e6);
+
+    if (virNetDaemonMeasureLoopLag(&lag) == 0)
+        virOpenMetricsAddDouble(metrics, "libvirt_event_loop_lag_seconds",
+                                NULL, 0, lag / 1e6);
+}
+
+
+static void
+virNetDaemonMetricsProcedures(virOpenMetrics *metrics,
+                              virNetServer *srv)
+{
+    g_autofree virNetServerProgramProcStats *stats = NULL;
+    double bounds[VIR_NET_SERVER_PROGRAM_HIST_BUCKETS - 1];
+    size_t nstats = 0;
+    size_t i;
+
+    virNetServerGetProcedureStats(srv, &stats, &nstats);
+
+    for (i = 0; i < G_N_ELEMENTS(bounds); i++)
+        bounds[i] = virNetServerProgramHistBucketStart(i + 1) / 1e6;
+
+    for (i = 0; i < nstats; i++) {
+        g_autofree char *program = g_strdup_printf("0x%x", stats[i].program);
+        g_autofree char *procedure = g_strdup_printf("%d", stats[i].procedure);
+        virOpenMetricsLabel labels[] = {
+            { "server", virNetServerGetName(srv) },
+            { "program", program },
+            { "procedure", procedure },
+        };
+        size_t nlabels = G_N_ELEMENTS(labels);
+
+        virOpenMetricsAddULLong(metrics, "libvirt_rpc_calls",
+                                labels, nlabels, stats[i].calls);
+        virOpenMetricsAddULLong(metrics, "libvirt_rpc_errors",
+                                labels, nlabels, stats[i].errors);
+        virOpenMetricsAddULLong(metrics, "libvirt_rpc_received_bytes",
+                                labels, nlabels, stats[i].bytesIn);
+        virOpenMetricsAddULLong(metrics, "libvirt_rpc_sent_bytes",
+                                labels, nlabels, stats[i].bytesOut);
+        virOpenMetricsAddHistogram(metrics, "libvirt_rpc_queue_seconds",
+                                   labels, nlabels, bounds,
+                                   stats[i].queueHist,
+                                   VIR_NET_SERVER_PROGRAM_HIST_BUCKETS,
+                                   stats[i].queueTime / 1e6);
+        virOpenMetricsAddHistogram(metrics, "libvirt_rpc_dispatch_seconds",
+                                   labels, nlabels, bounds,
+                                   stats[i].dispatchHist,
+                                   VIR_NET_SERVER_PROGRAM_HIST_BUCKETS,
+                                   stats[i].dispatchTime / 1e6);
+    }
+}
+
+
+static void
+virNetDaemonMetricsServer(virOpenMetrics *metrics,
+                          virNetServer *srv)
+{
+    virOpenMetricsLabel label = { "server", virNetServerGetName(srv) };
+    g_autofree virThreadPoolClassStats *classes = NULL;
+    size_t nclasses = 0;
+    size_t minWorkers;
+    size_t maxWorkers;
+    size_t nWorkers;
+    size_t freeWorkers;
+    size_t nPrioWorkers;
+    size_t jobQueueDepth;
+    size_t jobQueues;
+    unsigned int idleTimeout;
+    unsigned long long spawnedWorkers;
+    unsigned long long retiredWorkers;
+    size_t i;
+
+    virOpenMetricsAddULLong(metrics, "libvirt_server_clients", &label, 1,
+                            virNetServerGetCurrentClients(srv));
+    virOpenMetricsAddULLong(metrics, "libvirt_server_clients_max", &label, 1,
+                            virNetServerGetMaxClients(srv));
+    virOpenMetricsAddULLong(metrics, "libvirt_server_clients_unauth", &label, 1,
+                            virNetServerGetCurrentUnauthClients(srv));
+
+    if (virNetServerGetThreadPoolParameters(srv, &minWorkers, &maxWorkers,
+                                            &nWorkers, &freeWorkers,
+                                            &nPrioWorkers, &jobQueueDepth,
+                                            &jobQueues, &idleTimeout,
+                                            &spawnedWorkers,
+                                            &retiredWorkers) == 0) {
+        virOpenMetricsAddULLong(metrics, "libvirt_server_workers", &label, 1,
+                                nWorkers);
+        virOpenMetricsAddULLong(metrics, "libvirt_server_workers_free", &label, 1,
+                                freeWorkers);
+        virOpenMetricsAddULLong(metrics, "libvirt_server_workers_min", &label, 1,
+                                minWorkers);
+        virOpenMetricsAddULLong(metrics, "libvirt_server_workers_max", &label, 1,
+                                maxWorkers);
+        virOpenMetricsAddULLong(metrics, "libvirt_server_workers_priority", &label, 1,
+                                nPrioWorkers);
+        virOpenMetricsAddULLong(metrics, "libvirt_server_workers_spawned", &label, 1,
+                                spawnedWorkers);
+        virOpenMetricsAddULLong(metrics, "libvirt_server_workers_retired", &label, 1,
+                                retiredWorkers);
+        virOpenMetricsAddULLong(metrics, "libvirt_server_job_queue_depth", &label, 1,
+                                jobQueueDepth);
+    }
+
+    virNetServerGetJobClassStats(srv, &classes, &nclasses);
+    for (i = 0; i < nclasses; i++) {
+        virOpenMetricsLabel labels[] = {
+            label,
+            { "class", classes[i].name },
+        };
+
+        virOpenMetricsAddULLong(metrics, "libvirt_server_job_class_jobs",
+                                labels, G_N_ELEMENTS(labels), classes[i].jobs);
+        virOpenMetricsAddDouble(metrics, "libvirt_server_job_class_wait_seconds",
+                                labels, G_N_ELEMENTS(labels),
+                                classes[i].waitTime / 1e6);
+        virOpenMetricsAddULLong(metrics, "libvirt_server_job_class_queue_depth",
+                                labels, G_N_ELEMENTS(labels),
+                                classes[i].jobQueueDepth);
+    }
+
+    virNetDaemonMetricsProcedures(metrics, srv);
+}
+
+
+static void
+virNetDaemonMetricsDeclareServer(virOpenMetrics *metrics)
+{
+    static const struct {
+        const char *name;
+        virOpenMetricsType type;
+        const char *help;
+    } families[] = {
+        { "libvirt_server_clients", VIR_OPEN_METRICS_GAUGE,
+          "Clients connected to the server" },
+        { "libvirt_server_clients_max", VIR_OPEN_METRICS_GAUGE,
+          "Limit of clients connected to the server" },
+        { "libvirt_server_clients_unauth", VIR_OPEN_METRICS_GAUGE,
+          "Clients waiting for authentication" },
+        { "libvirt_server_workers", VIR_OPEN_METRICS_GAUGE,
+          "Worker threads of the server" },
+        { "libvirt_server_workers_free", VIR_OPEN_METRICS_GAUGE,
+          "Worker threads waiting for a call" },
+        { "libvirt_server_workers_min", VIR_OPEN_METRICS_GAUGE,
+          "Worker threads kept running at least" },
+        { "libvirt_server_workers_max", VIR_OPEN_METRICS_GAUGE,
+          "Limit of worker threads" },
+        { "libvirt_server_workers_priority", VIR_OPEN_METRICS_GAUGE,
+          "Worker threads for high priority calls" },
+        { "libvirt_server_workers_spawned", VIR_OPEN_METRICS_COUNTER,
+          "Worker threads started" },
+        { "libvirt_server_workers_retired", VIR_OPEN_METRICS_COUNTER,
+          "Idle worker threads which exited" },
+        { "libvirt_server_job_queue_depth", VIR_OPEN_METRICS_GAUGE,
+          "Calls waiting for a worker thread" },
+        { "libvirt_server_job_class_jobs", VIR_OPEN_METRICS_COUNTER,
+          "Calls of the job class taken by a worker thread" },
+        { "libvirt_server_job_class_wait_seconds", VIR_OPEN_METRICS_COUNTER,
+          "Time calls of the job class waited for a worker thread" },
+        { "libvirt_server_job_class_queue_depth", VIR_OPEN_METRICS_GAUGE,
+          "Calls of the job class waiting for a worker thread" },
+        { "libvirt_rpc_calls", VIR_OPEN_METRICS_COUNTER,
+          "Calls of the procedure" },
+        { "libvirt_rpc_errors", VIR_OPEN_METRICS_COUNTER,
+          "Calls of the procedure which failed" },
+        { "libvirt_rpc_received_bytes", VIR_OPEN_METRICS_COUNTER,
+          "Bytes of calls of the procedure received" },
+        { "libvirt_rpc_sent_bytes", VIR_OPEN_METRICS_COUNTER,
+          "Bytes of replies of the procedure sent" },
+        { "libvirt_rpc_queue_seconds", VIR_OPEN_METRICS_HISTOGRAM,
+          "Time calls of the procedure waited for a worker thread" },
+        { "libvirt_rpc_dispatch_seconds", VIR_OPEN_METRICS_HISTOGRAM,
+          "Time spent dispatching calls of the procedure" },
+    };
+    size_t i;
+
+    for (i = 0; i < G_N_ELEMENTS(families); i++)
+        virOpenMetricsDeclare(metrics, families[i].name,
+                              families[i].type, families[i].help);
+}
+
+
+static char *
+virNetDaemonMetricsCollect(virNetDaemon *dmn)
+{
+    g_autoptr(virOpenMetrics) metrics = virOpenMetricsNew();
+    virNetServer **servers = NULL;
+    ssize_t nservers;
+    virNetDaemonMetricsFunc func = NULL;
+    void *opaque = NULL;
+    ssize_t i;
+
+    if ((nservers = virNetDaemonGetServers(dmn, &servers)) >= 0) {
+        virNetDaemonMetricsDeclareServer(metrics);
+        for (i = 0; i < nservers; i++)
+            virNetDaemonMetricsServer(metrics, servers[i]);
+        virObjectListFreeCount(servers, nservers);
+    }
+
+    virNetDaemonMetricsEventLoop(metrics);
+
+    VIR_WITH_OBJECT_LOCK_GUARD(dmn) {
+        func = dmn->metricsFunc;
+        opaque = dmn->metricsOpaque;
+    }
+
+    if (func && func(dmn, metrics, opaque) < 0)
+        VIR_WARN("Failed to collect metrics: %s", virGetLastErrorMessage());
+
+    return virOpenMetricsFormat(metrics);
+}
+
+
+static void
+virNetDaemonMetricsRespond(virNetSocket *sock,
+                           const char *status,
+                           const char *body,
+                           bool head)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    g_autofree char *error = NULL;
+
+    if (status)
+        body = error = g_strdup_printf("%s\n", status);
+
+    virBufferAsprintf(&buf, "HTTP/1.1 %s\r\n", status ? status : "200 OK");
+    virBufferAsprintf(&buf, "Content-Type: %s\r\n",
+                      status ? "text/plain; charset=utf-8" : VIR_OPEN_METRICS_CONTENT_TYPE);
+    virBufferAsprintf(&buf, "Content-Length: %zu\r\n", strlen(body));
+    virBufferAddLit(&buf, "Connection: close\r\n\r\n");
+    if (!head)
+        virBufferAdd(&buf, body, -1);
+
+    if (virNetSocketSetBlocking(sock, true) < 0 ||
+        safewrite(virNetSocketGetFD(sock), virBufferCurrentContent(&buf),
+                  virBufferUse(&buf)) < 0)
+        VIR_DEBUG("Failed to send metrics: %s", g_strerror(errno));
+}
+
+
+/*
+ * Clients connected over UNIX sockets are identified by their credentials,
+ * clients connected over TCP are anonymous.
+ */
+static virIdentity *
+virNetDaemonMetricsCreateIdentity(virNetSocket *sock)
+{
+    g_autofree char *username = NULL;
+    g_autofree char *groupname = NULL;
+    g_autofree char *seccontext = NULL;
+    g_autoptr(virIdentity) ret = virIdentityNew();
+
+    if (virNetSocketIsLocal(sock)) {
+        gid_t gid;
+        uid_t uid;
+        pid_t pid;
+        unsigned long long timestamp;
+
+        if (virNetSocketGetUNIXIdentity(sock, &uid, &gid, &pid,
+                                        &timestamp) < 0)
+            return NULL;
+
+        if (!(username = virGetUserName(uid)) ||
+            virIdentitySetUserName(ret, username) < 0 ||
+            virIdentitySetUNIXUserID(ret, uid) < 0)
+            return NULL;
+
+        if (!(groupname = virGetGroupName(gid)) ||
+            virIdentitySetGroupName(ret, groupname) < 0 ||
+            virIdentitySetUNIXGroupID(ret, gid) < 0)
+            return NULL;
+
+        if (virIdentitySetProcessID(ret, pid) < 0 ||
+            virIdentitySetProcessTime(ret, timestamp) < 0)
+            return NULL;
+    }
+
+    if (virNetSocketGetSELinuxContext(sock, &seccontext) < 0)
+        return NULL;
+    if (seccontext &&
+        virIdentitySetSELinuxContext(ret, seccontext) < 0)
+        return NULL;
+
+    return g_steal_pointer(&ret);
+}
+
+
+static void
+virNetDaemonMetricsWorker(void *opaque)
+{
+    virNetDaemonMetricsScrape *scrape = opaque;
+    g_autoptr(virIdentity) identity = NULL;
+    g_autofree char *request = NULL;
+    g_autofree char *body = NULL;
+    const char *status;
+    bool head = false;
+
+    if (virNetDaemonMetricsReadRequest(scrape->sock, &request) < 0)
+        goto cleanup;
+
+    if (!(status = virNetDaemonMetricsCheckRequest(request, &head))) {
+        if (!(identity = virNetDaemonMetricsCreateIdentity(scrape->sock))) {
+            VIR_WARN("Failed to identify metrics client: %s",
+                     virGetLastErrorMessage());
+            status = "500 Internal Server Error";
+        } else {
+            /* The thread serves just this scrape */
+            virIdentitySetCurrent(identity);
+            body = virNetDaemonMetricsCollect(scrape->dmn);
+            virIdentitySetCurrent(NULL);
+        }
+    }
+
+    virNetDaemonMetricsRespond(scrape->sock, status, body, head);
+
+ cleanup:
+    virNetDaemonMetricsScrapeFree(scrape);
+}
+
+
+static void
+virNetDaemonMetricsAccept(virNetSocket *sock,
+                          int events G_GNUC_UNUSED,
+                          void *opaque)
+{
+    virNetDaemon *dmn = opaque;
+    g_autoptr(virNetSocket) clientsock = NULL;
+    virNetDaemonMetricsScrape *scrape;
+    virThread thread;
+
+    if (virNetSocketAccept(sock, &clientsock) < 0) {
+        VIR_WARN("Failed to accept metrics client: %s",
+                 virGetLastErrorMessage());
+        return;
+    }
+
+    if (!clientsock)
+        return;
+
+    VIR_WITH_OBJECT_LOCK_GUARD(dmn) {
+        if (dmn->metricsScrapes >= VIR_NET_DAEMON_METRICS_MAX_SCRAPES) {
+            VIR_DEBUG("Too many metrics scrapes in progress");
+            virNetSocketClose(clientsock);
+            return;
+        }
+        dmn->metricsScrapes++;
+    }
+
+    scrape = g_new0(virNetDaemonMetricsScrape, 1);
+    scrape->dmn = virObjectRef(dmn);
+    scrape->sock = g_steal_pointer(&clientsock);
+
+    if (virThreadCreateFull(&thread, false, virNetDaemonMetricsWorker,
+                            "daemon-metrics", false, scrape) < 0) {
+        VIR_WARN("Failed to start metrics thread: %s",
+                 virGetLastErrorMessage());
+        virNetDaemonMetricsScrapeFree(scrape);
+    }
+}
+
+
+static void
+virNetDaemonCloseMetrics(virNetDaemon *dmn)
+{
+    size_t i;
+
+    for (i = 0; i < dmn->nmetricsSocks; i++) {
+        virNetSocketRemoveIOCallback(dmn->metricsSocks[i]);
+        virNetSocketClose(dmn->metricsSocks[i]);
+        virObjectUnref(dmn->metricsSocks[i]);
+    }
+    g_clear_pointer(&dmn->metricsSocks, g_free);
+    dmn->nmetricsSocks = 0;
+    dmn->metricsFunc = NULL;
+}
+
+
+/**
+ * virNetDaemonAddMetricsSocket:
+ * @dmn: daemon
+ * @sock: socket to listen on
+ * @allowTCP: whether @sock may be a TCP socket
+ *
+ * Serves metrics of the daemon in the OpenMetrics format over HTTP on
+ * @sock, once the services of @dmn are enabled by
+ * virNetDaemonUpdateServices(). The metrics describe the RPC servers of
+ * the daemon, their procedures and the event loop, together with what the
+ * callback set by virNetDaemonSetMetricsCallback() adds.
+ *
+ * The endpoint doesn't authenticate its clients. Access to a UNIX socket
+ * is controlled by its permissions and the callback runs with the
+ * identity of the client, while anyone who can reach a TCP socket gets
+ * what an anonymous identity is allowed to see, so it's refused unless
+ * @allowTCP is true.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virNetDaemonAddMetricsSocket(virNetDaemon *dmn,
+                             virNetSocket *sock,
+                             bool allowTCP)
+{
+    VIR_LOCK_GUARD lock = virObjectLockGuard(dmn);
+
+    if (!allowTCP && !virNetSocketIsLocal(sock)) {
+        virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                       _("Serving metrics on an unauthenticated TCP socket is not allowed"));
+        return -1;
+    }
+
+    if (virNetSocketListen(sock, 0) < 0)
+        return -1;
+
+    /* Enabled by virNetDaemonUpdateServices together with the RPC
+     * services of the daemon. The callback doesn't hold a reference to
+     * @dmn, it's removed before @dmn is disposed. */
+    if (virNetSocketAddIOCallback(sock, 0, virNetDaemonMetricsAccept,
+                                  dmn, NULL) < 0)
+        return -1;
+
+    virObjectRef(sock);
+    VIR_APPEND_ELEMENT(dmn->metricsSocks, dmn->nmetricsSocks, sock);
+
+    return 0;
+}
+
+
+/**
+ * virNetDaemonSetMetricsCallback:
+ * @dmn: daemon
+ * @func: callback adding metrics, or NULL
+ * @opaque: data for @func
+ *
+ * Sets a callback adding metrics of the drivers of the daemon to every
+ * scrape of the endpoint added by virNetDaemonAddMetricsSocket(). The
+ * callback is called from a thread serving the scrape and must not fail
+ * on missing data, only on errors which make all its metrics useless.
+ */
+void
+virNetDaemonSetMetricsCallback(virNetDaemon *dmn,
+                               virNetDaemonMetricsFunc func,
+                               void *opaque)
+{
+    VIR_LOCK_GUARD lock = virObjectLockGuard(dmn);
+
+    dmn->metricsFunc = func;
+    dmn->metricsOpaque = opaque;
+}
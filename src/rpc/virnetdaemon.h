@@ -29,6 +29,8 @@
 #include "virnetserverclient.h"
 #include "virnetserverservice.h"
 #include "virnetserver.h"
+#include "virnetsocket.h"
+#include "viropenmetrics.h"
 
 virNetDaemon *virNetDaemonNew(void);
 
@@ -51,6 +53,8 @@ bool virNetDaemonIsPrivileged(virNetDaemon *dmn);
 
 void virNetDaemonAutoShutdown(virNetDaemon *dmn,
                               unsigned int timeout);
+void virNetDaemonSetIdleStandby(virNetDaemon *dmn,
+                                bool standby);
 
 void virNetDaemonAddShutdownInhibition(virNetDaemon *dmn);
 void virNetDaemonRemoveShutdownInhibition(virNetDaemon *dmn);
@@ -90,3 +94,14 @@ typedef int (*virNetDaemonShutdownCallback)(void);
 void virNetDaemonSetShutdownCallbacks(virNetDaemon *dmn,
                                       virNetDaemonShutdownCallback prepareCb,
                                       virNetDaemonShutdownCallback waitCb);
+
+typedef int (*virNetDaemonMetricsFunc)(virNetDaemon *dmn,
+                                       virOpenMetrics *metrics,
+                                       void *opaque);
+
+int virNetDaemonAddMetricsSocket(virNetDaemon *dmn,
+                                 virNetSocket *sock,
+                                 bool allowTCP);
+void virNetDaemonSetMetricsCallback(virNetDaemon *dmn,
+                                    virNetDaemonMetricsFunc func,
+                                    void *opaque);
@@ -21,6 +21,7 @@
 #include <config.h>
 
 #include <unistd.h>
+#include <gio/gio.h>
 
 #include "virnetmessage.h"
 #include "viralloc.h"
@@ -34,6 +35,231 @@
 
 VIR_LOG_INIT("rpc.netmessage");
 
+/*
+ * Message buffers of VIR_NET_MESSAGE_INITIAL bytes and more are allocated
+ * in power of two size classes and recycled through per class free lists
+ * instead of going back to the allocator once the message is done. Each
+ * class caches at most VIR_NET_MESSAGE_POOL_CLASS_BYTES worth of buffers,
+ * classes larger than that are not cached at all.
+ */
+#define VIR_NET_MESSAGE_POOL_CLASSES 10
+#define VIR_NET_MESSAGE_POOL_CLASS_BYTES (4 * 1024 * 1024)
+
+G_STATIC_ASSERT((VIR_NET_MESSAGE_INITIAL << (VIR_NET_MESSAGE_POOL_CLASSES - 1)) ==
+                VIR_NET_MESSAGE_MAX);
+
+typedef struct _virNetMessageBufferPool virNetMessageBufferPool;
+struct _virNetMessageBufferPool {
+    virMutex lock;
+    char **buffers[VIR_NET_MESSAGE_POOL_CLASSES];
+    size_t nbuffers[VIR_NET_MESSAGE_POOL_CLASSES];
+    unsigned long long hits;
+    unsigned long long misses;
+};
+
+static virNetMessageBufferPool bufferPool = {
+    .lock = VIR_MUTEX_INITIALIZER,
+};
+
+
+static size_t
+virNetMessageBufferClassSize(size_t class)
+{
+    return ((size_t) VIR_NET_MESSAGE_INITIAL << class) + VIR_NET_MESSAGE_LEN_MAX;
+}
+
+
+static size_t
+virNetMessageBufferClassMaxCached(size_t class)
+{
+    return VIR_NET_MESSAGE_POOL_CLASS_BYTES / virNetMessageBufferClassSize(class);
+}
+
+
+/* Returns the smallest class big enough for @len, or -1 if @len is too
+ * small or too large to be served from the pool */
+static int
+virNetMessageBufferClass(size_t len)
+{
+    size_t class;
+
+    if (len < virNetMessageBufferClassSize(0))
+        return -1;
+
+    for (class = 0; class < VIR_NET_MESSAGE_POOL_CLASSES; class++) {
+        if (len <= virNetMessageBufferClassSize(class))
+            return class;
+    }
+
+    return -1;
+}
+
+
+static char *
+virNetMessageBufferAlloc(size_t len,
+                         size_t *alloc)
+{
+    int class = virNetMessageBufferClass(len);
+
+    if (class < 0) {
+        *alloc = len;
+        return g_new0(char, len);
+    }
+
+    *alloc = virNetMessageBufferClassSize(class);
+
+    VIR_WITH_MUTEX_LOCK_GUARD(&bufferPool.lock) {
+        if (bufferPool.nbuffers[class] > 0) {
+            bufferPool.hits++;
+            return bufferPool.buffers[class][--bufferPool.nbuffers[class]];
+        }
+        bufferPool.misses++;
+    }
+
+    return g_new0(char, *alloc);
+}
+
+
+static void
+virNetMessageBufferRelease(char *buffer,
+                           size_t alloc)
+{
+    int class;
+
+    if (!buffer)
+        return;
+
+    class = virNetMessageBufferClass(alloc);
+
+    if (class >= 0 && alloc == virNetMessageBufferClassSize(class)) {
+        /* Hand out recycled buffers as clean as new ones, so that no
+         * message can leak through the data of a previous one. Done here
+         * rather than on reuse to not keep the data around in the pool. */
+        memset(buffer, 0, alloc);
+
+        VIR_WITH_MUTEX_LOCK_GUARD(&bufferPool.lock) {
+            size_t max = virNetMessageBufferClassMaxCached(class);
+
+            if (bufferPool.nbuffers[class] < max) {
+                if (!bufferPool.buffers[class])
+                    bufferPool.buffers[class] = g_new0(char *, max);
+                bufferPool.buffers[class][bufferPool.nbuffers[class]++] = buffer;
+                return;
+            }
+        }
+    }
+
+    g_free(buffer);
+}
+
+
+/**
+ * virNetMessageResizeBuffer:
+ * @msg: the message
+ * @len: new length of the message buffer
+ *
+ * Changes the length of the buffer of @msg to @len bytes, preserving the
+ * existing content up to the lesser of the new and old lengths, and sets
+ * msg->bufferLength accordingly. The buffer is only reallocated if its
+ * capacity doesn't suffice; buffers are taken from and returned to the
+ * message buffer pool where possible.
+ */
+void
+virNetMessageResizeBuffer(virNetMessage *msg,
+                          size_t len)
+{
+    char *buffer;
+    size_t alloc;
+
+    if (msg->buffer && len <= msg->bufferAlloc) {
+        msg->bufferLength = len;
+        return;
+    }
+
+    buffer = virNetMessageBufferAlloc(len, &alloc);
+    if (msg->buffer)
+        memcpy(buffer, msg->buffer, MIN(msg->bufferLength, len));
+    virNetMessageBufferRelease(msg->buffer, msg->bufferAlloc);
+
+    msg->buffer = buffer;
+    msg->bufferAlloc = alloc;
+    msg->bufferLength = len;
+}
+
+
+/**
+ * virNetMessageStealBuffer:
+ * @dst: the message to move the buffer to
+ * @src: the message to take the buffer from
+ *
+ * Releases the buffer of @dst and moves the buffer, including its length
+ * and offset, of @src over to @dst. @src is left without any buffer.
+ */
+void
+virNetMessageStealBuffer(virNetMessage *dst,
+                         virNetMessage *src)
+{
+    virNetMessageBufferRelease(dst->buffer, dst->bufferAlloc);
+
+    dst->buffer = g_steal_pointer(&src->buffer);
+    dst->bufferAlloc = src->bufferAlloc;
+    dst->bufferLength = src->bufferLength;
+    dst->bufferOffset = src->bufferOffset;
+
+    src->bufferAlloc = src->bufferLength = src->bufferOffset = 0;
+}
+
+
+/**
+ * virNetMessageGetBufferPoolStats:
+ * @hits: filled with number of buffer allocations served from the pool
+ * @misses: filled with number of buffer allocations missing the pool
+ * @nbuffers: filled with number of buffers currently cached
+ * @nbytes: filled with size of buffers currently cached
+ *
+ * Retrieves statistics of the process wide message buffer pool.
+ */
+void
+virNetMessageGetBufferPoolStats(unsigned long long *hits,
+                                unsigned long long *misses,
+                                size_t *nbuffers,
+                                size_t *nbytes)
+{
+    VIR_LOCK_GUARD lock = virLockGuardLock(&bufferPool.lock);
+    size_t class;
+
+    *hits = bufferPool.hits;
+    *misses = bufferPool.misses;
+    *nbuffers = 0;
+    *nbytes = 0;
+
+    for (class = 0; class < VIR_NET_MESSAGE_POOL_CLASSES; class++) {
+        *nbuffers += bufferPool.nbuffers[class];
+        *nbytes += bufferPool.nbuffers[class] *
+            virNetMessageBufferClassSize(class);
+    }
+}
+
+
+/**
+ * virNetMessageTrimBufferPool:
+ *
+ * Frees all buffers cached by the process wide message buffer pool.
+ */
+void
+virNetMessageTrimBufferPool(void)
+{
+    VIR_LOCK_GUARD lock = virLockGuardLock(&bufferPool.lock);
+    size_t class;
+
+    for (class = 0; class < VIR_NET_MESSAGE_POOL_CLASSES; class++) {
+        while (bufferPool.nbuffers[class] > 0)
+            g_free(bufferPool.buffers[class][--bufferPool.nbuffers[class]]);
+        g_clear_pointer(&bufferPool.buffers[class], g_free);
+    }
+}
+
+
 virNetMessage *virNetMessageNew(bool tracked)
 {
     virNetMessage *msg;
@@ -66,9 +292,15 @@ virNetMessageClearPayload(virNetMessage *msg)
 {
     virNetMessageClearFDs(msg);
 
+    if (msg->spliceLength)
+        VIR_FORCE_CLOSE(msg->spliceFD);
+    msg->spliceLength = 0;
+    msg->spliceOffset = 0;
+
     msg->bufferOffset = 0;
     msg->bufferLength = 0;
-    VIR_FREE(msg->buffer);
+    virNetMessageBufferRelease(g_steal_pointer(&msg->buffer), msg->bufferAlloc);
+    msg->bufferAlloc = 0;
 }
 
 
@@ -157,8 +389,7 @@ int virNetMessageDecodeLength(virNetMessage *msg)
 
     /* Extend our declared buffer length and carry
        on reading the header + payload */
-    msg->bufferLength += len;
-    VIR_REALLOC_N(msg->buffer, msg->bufferLength);
+    virNetMessageResizeBuffer(msg, msg->bufferLength + len);
 
     VIR_DEBUG("Got length, now need %zu total (%u more)",
               msg->bufferLength, len);
@@ -233,8 +464,7 @@ int virNetMessageEncodeHeader(virNetMessage *msg)
     int ret = -1;
     unsigned int len = 0;
 
-    msg->bufferLength = VIR_NET_MESSAGE_INITIAL + VIR_NET_MESSAGE_LEN_MAX;
-    VIR_REALLOC_N(msg->buffer, msg->bufferLength);
+    virNetMessageResizeBuffer(msg, VIR_NET_MESSAGE_INITIAL + VIR_NET_MESSAGE_LEN_MAX);
     msg->bufferOffset = 0;
 
     /* Format the header. */
@@ -347,6 +577,99 @@ int virNetMessageDecodeNumFDs(virNetMessage *msg)
 }
 
 
+/* Offset of the payload in a message carrying no FDs */
+#define VIR_NET_MESSAGE_PAYLOAD_OFFSET \
+    (VIR_NET_MESSAGE_LEN_MAX + VIR_NET_MESSAGE_HEADER_MAX)
+
+/**
+ * virNetMessageCompressPayload:
+ * @msg: the message
+ *
+ * Replaces the encoded payload of @msg with a virNetCompressHeader
+ * followed by the deflated payload and turns the message type into
+ * VIR_NET_REPLY_COMPRESSED. The message is left untouched if the
+ * payload doesn't shrink.
+ */
+static void
+virNetMessageCompressPayload(virNetMessage *msg)
+{
+    g_autoptr(GZlibCompressor) compressor = NULL;
+    size_t start = VIR_NET_MESSAGE_PAYLOAD_OFFSET;
+    size_t len = msg->bufferOffset - start;
+    size_t hdrlen = 2 * VIR_NET_MESSAGE_HEADER_XDR_LEN;
+    size_t avail;
+    size_t nin = 0;
+    size_t nout = 0;
+    virNetCompressHeader hdr = { VIR_NET_COMPRESS_DEFLATE, len };
+    char *buffer;
+    size_t alloc;
+    XDR xdr;
+
+    if (len <= hdrlen)
+        return;
+    avail = len - hdrlen;
+
+    compressor = g_zlib_compressor_new(G_ZLIB_COMPRESSOR_FORMAT_RAW, 1);
+    buffer = virNetMessageBufferAlloc(msg->bufferOffset, &alloc);
+
+    while (true) {
+        g_autoptr(GError) err = NULL;
+        gsize nread = 0;
+        gsize nwritten = 0;
+        GConverterResult res;
+
+        res = g_converter_convert(G_CONVERTER(compressor),
+                                  msg->buffer + start + nin, len - nin,
+                                  buffer + start + hdrlen + nout, avail - nout,
+                                  G_CONVERTER_INPUT_AT_END,
+                                  &nread, &nwritten, &err);
+        nin += nread;
+        nout += nwritten;
+
+        if (res == G_CONVERTER_FINISHED)
+            break;
+
+        /* Either an error, most likely G_IO_ERROR_NO_SPACE as the
+         * payload didn't shrink, or out of room without finishing */
+        if (res == G_CONVERTER_ERROR || nout == avail) {
+            VIR_DEBUG("Not compressing payload of %zu bytes: %s",
+                      len, err ? err->message : "no space");
+            virNetMessageBufferRelease(buffer, alloc);
+            return;
+        }
+    }
+
+    memcpy(buffer, msg->buffer, start);
+
+    xdrmem_create(&xdr, buffer + start, hdrlen, XDR_ENCODE);
+    if (!xdr_virNetCompressHeader(&xdr, &hdr)) {
+        xdr_destroy(&xdr);
+        virNetMessageBufferRelease(buffer, alloc);
+        return;
+    }
+    xdr_destroy(&xdr);
+
+    msg->header.type = VIR_NET_REPLY_COMPRESSED;
+    xdrmem_create(&xdr, buffer + VIR_NET_MESSAGE_LEN_MAX,
+                  VIR_NET_MESSAGE_HEADER_MAX, XDR_ENCODE);
+    if (!xdr_virNetMessageHeader(&xdr, &msg->header)) {
+        msg->header.type = VIR_NET_REPLY;
+        xdr_destroy(&xdr);
+        virNetMessageBufferRelease(buffer, alloc);
+        return;
+    }
+    xdr_destroy(&xdr);
+
+    VIR_DEBUG("Compressed payload from %zu to %zu bytes", len, nout);
+
+    virNetMessageBufferRelease(msg->buffer, msg->bufferAlloc);
+    msg->buffer = buffer;
+    msg->bufferAlloc = alloc;
+    msg->bufferLength = alloc;
+    msg->bufferOffset = start + hdrlen + nout;
+}
+
+
 int virNetMessageEncodePayload(virNetMessage *msg,
                                xdrproc_t filter,
                                void *data)
@@ -372,9 +695,7 @@ int virNetMessageEncodePayload(virNetMessage *msg,
 
         xdr_destroy(&xdr);
 
-        msg->bufferLength = newlen + VIR_NET_MESSAGE_LEN_MAX;
-
-        VIR_REALLOC_N(msg->buffer, msg->bufferLength);
+        virNetMessageResizeBuffer(msg, newlen + VIR_NET_MESSAGE_LEN_MAX);
 
         xdrmem_create(&xdr, msg->buffer + msg->bufferOffset,
                       msg->bufferLength - msg->bufferOffset, XDR_ENCODE);
@@ -386,6 +707,12 @@ int virNetMessageEncodePayload(virNetMessage *msg,
     msg->bufferOffset += xdr_getpos(&xdr);
     xdr_destroy(&xdr);
 
+    if (msg->compressThreshold &&
+        msg->header.type == VIR_NET_REPLY &&
+        msg->header.status == VIR_NET_OK &&
+        msg->bufferOffset - VIR_NET_MESSAGE_PAYLOAD_OFFSET > msg->compressThreshold)
+        virNetMessageCompressPayload(msg);
+
     /* Re-encode the length word. */
     VIR_DEBUG("Encode length as %zu", msg->bufferOffset);
     xdrmem_create(&xdr, msg->buffer, VIR_NET_MESSAGE_HEADER_XDR_LEN, XDR_ENCODE);
@@ -435,47 +762,163 @@ int virNetMessageDecodePayload(virNetMessage *msg,
 
 
 /**
- * virNetMessageEncodePayloadRaw:
- * @msg: message to encode payload into
- * @data: data to encode into @msg
- * @len: lenght of @data
+ * virNetMessageDecompressPayload:
+ * @msg: the message
  *
- * Encodes message payload. If @data is NULL or @len is 0 an empty message is
- * encoded.
+ * Inflates the payload of a VIR_NET_REPLY_COMPRESSED message whose
+ * header has already been decoded, leaving @msg as if it had been
+ * received as a plain VIR_NET_REPLY.
+ *
+ * Returns 0 on success, -1 on error.
  */
-int virNetMessageEncodePayloadRaw(virNetMessage *msg,
-                                  const char *data,
-                                  size_t len)
+int virNetMessageDecompressPayload(virNetMessage *msg)
 {
+    g_autoptr(GZlibDecompressor) decompressor = NULL;
+    virNetCompressHeader hdr;
+    size_t start = msg->bufferOffset;
+    size_t in;
+    size_t len;
+    size_t avail;
+    size_t nin = 0;
+    size_t nout = 0;
+    char *buffer;
+    size_t alloc;
     XDR xdr;
-    unsigned int msglen;
 
-    if (data && len > 0) {
-        /* If the message buffer is too small for the payload increase it accordingly. */
-        if ((msg->bufferLength - msg->bufferOffset) < len) {
-            if ((msg->bufferOffset + len) >
-                (VIR_NET_MESSAGE_MAX + VIR_NET_MESSAGE_LEN_MAX)) {
-                virReportError(VIR_ERR_RPC,
-                               _("Stream data too long to send "
-                                 "(%zu bytes needed, %zu bytes available)"),
-                               len,
-                               VIR_NET_MESSAGE_MAX +
-                               VIR_NET_MESSAGE_LEN_MAX -
-                               msg->bufferOffset);
-                return -1;
-            }
+    xdrmem_create(&xdr, msg->buffer + start,
+                  msg->bufferLength - start, XDR_DECODE);
+    if (!xdr_virNetCompressHeader(&xdr, &hdr)) {
+        virReportError(VIR_ERR_RPC, "%s", _("Unable to decode compression header"));
+        xdr_destroy(&xdr);
+        return -1;
+    }
+    in = start + xdr_getpos(&xdr);
+    xdr_destroy(&xdr);
 
-            msg->bufferLength = msg->bufferOffset + len;
+    if (hdr.algorithm != VIR_NET_COMPRESS_DEFLATE) {
+        virReportError(VIR_ERR_RPC,
+                       _("Unsupported payload compression algorithm %d"),
+                       hdr.algorithm);
+        return -1;
+    }
+
+    if (hdr.length == 0 || hdr.length > VIR_NET_MESSAGE_PAYLOAD_MAX) {
+        virReportError(VIR_ERR_RPC,
+                       _("Invalid uncompressed payload length %u"),
+                       hdr.length);
+        return -1;
+    }
+
+    /* One spare byte lets zlib consume the end of the stream and
+     * catches payloads inflating beyond their announced length */
+    len = msg->bufferLength - in;
+    avail = hdr.length + 1;
+    decompressor = g_zlib_decompressor_new(G_ZLIB_COMPRESSOR_FORMAT_RAW);
+    buffer = virNetMessageBufferAlloc(start + avail, &alloc);
+
+    while (true) {
+        g_autoptr(GError) err = NULL;
+        gsize nread = 0;
+        gsize nwritten = 0;
+        GConverterResult res;
+
+        res = g_converter_convert(G_CONVERTER(decompressor),
+                                  msg->buffer + in + nin, len - nin,
+                                  buffer + start + nout, avail - nout,
+                                  G_CONVERTER_INPUT_AT_END,
+                                  &nread, &nwritten, &err);
+        nin += nread;
+        nout += nwritten;
+
+        if (res == G_CONVERTER_FINISHED)
+            break;
+
+        if (res == G_CONVERTER_ERROR || nout == avail) {
+            virReportError(VIR_ERR_RPC,
+                           _("Unable to decompress message payload: %s"),
+                           err ? err->message : _("payload too long"));
+            virNetMessageBufferRelease(buffer, alloc);
+            return -1;
+        }
+    }
+
+    if (nout != hdr.length) {
+        virReportError(VIR_ERR_RPC,
+                       _("Decompressed payload length %zu does not match %u"),
+                       nout, hdr.length);
+        virNetMessageBufferRelease(buffer, alloc);
+        return -1;
+    }
+
+    memcpy(buffer, msg->buffer, start);
+    virNetMessageBufferRelease(msg->buffer, msg->bufferAlloc);
+
+    msg->buffer = buffer;
+    msg->bufferAlloc = alloc;
+    msg->bufferLength = start + hdr.length;
+    msg->bufferOffset = start;
+    msg->header.type = VIR_NET_REPLY;
+
+    return 0;
+}
 
-            VIR_REALLOC_N(msg->buffer, msg->bufferLength);
 
-            VIR_DEBUG("Increased message buffer length = %zu", msg->bufferLength);
+/**
+ * virNetMessageEncodePayloadReserve:
+ * @msg: message with header already encoded
+ * @len: maximum length of the payload
+ *
+ * Makes room for @len bytes of payload in @msg, so that the caller can
+ * produce the payload right in the message buffer instead of having it
+ * copied there by virNetMessageEncodePayloadRaw. The message is finished
+ * by virNetMessageEncodePayloadCommit.
+ *
+ * Returns the location for the payload, NULL on error.
+ */
+char *
+virNetMessageEncodePayloadReserve(virNetMessage *msg,
+                                  size_t len)
+{
+    /* If the message buffer is too small for the payload increase it accordingly. */
+    if ((msg->bufferLength - msg->bufferOffset) < len) {
+        if ((msg->bufferOffset + len) >
+            (VIR_NET_MESSAGE_MAX + VIR_NET_MESSAGE_LEN_MAX)) {
+            virReportError(VIR_ERR_RPC,
+                           _("Stream data too long to send "
+                             "(%zu bytes needed, %zu bytes available)"),
+                           len,
+                           VIR_NET_MESSAGE_MAX +
+                           VIR_NET_MESSAGE_LEN_MAX -
+                           msg->bufferOffset);
+            return NULL;
         }
 
-        memcpy(msg->buffer + msg->bufferOffset, data, len);
-        msg->bufferOffset += len;
+        virNetMessageResizeBuffer(msg, msg->bufferOffset + len);
+
+        VIR_DEBUG("Increased message buffer length = %zu", msg->bufferLength);
     }
 
+    return msg->buffer + msg->bufferOffset;
+}
+
+
+/**
+ * virNetMessageEncodePayloadCommit:
+ * @msg: message to encode payload into
+ * @len: length of the payload
+ *
+ * Finishes encoding of a message whose first @len bytes of the payload
+ * were stored at the location returned by virNetMessageEncodePayloadReserve.
+ */
+int
+virNetMessageEncodePayloadCommit(virNetMessage *msg,
+                                 size_t len)
+{
+    XDR xdr;
+    unsigned int msglen;
+
+    msg->bufferOffset += len;
+
     /* Re-encode the length word. */
     VIR_DEBUG("Encode length as %zu", msg->bufferOffset);
     xdrmem_create(&xdr, msg->buffer, VIR_NET_MESSAGE_HEADER_XDR_LEN, XDR_ENCODE);
@@ -496,6 +939,83 @@ int virNetMessageEncodePayloadRaw(virNetMessage *msg,
 }
 
 
+/**
+ * virNetMessageEncodePayloadRaw:
+ * @msg: message to encode payload into
+ * @data: data to encode into @msg
+ * @len: lenght of @data
+ *
+ * Encodes message payload. If @data is NULL or @len is 0 an empty message is
+ * encoded.
+ */
+int virNetMessageEncodePayloadRaw(virNetMessage *msg,
+                                  const char *data,
+                                  size_t len)
+{
+    char *payload;
+
+    if (!data || len == 0)
+        return virNetMessageEncodePayloadCommit(msg, 0);
+
+    if (!(payload = virNetMessageEncodePayloadReserve(msg, len)))
+        return -1;
+
+    memcpy(payload, data, len);
+
+    return virNetMessageEncodePayloadCommit(msg, len);
+}
+
+
+/**
+ * virNetMessageEncodePayloadSplice:
+ * @msg: message with header already encoded
+ * @fd: pipe to take the payload from
+ * @len: payload length
+ *
+ * Like virNetMessageEncodePayloadRaw, except the @len bytes of
+ * payload are not copied into the message buffer. They are moved
+ * from @fd straight into the socket once the message buffer was
+ * written. The message takes ownership of @fd, it is closed on
+ * failure.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int virNetMessageEncodePayloadSplice(virNetMessage *msg,
+                                     int fd,
+                                     size_t len)
+{
+    XDR xdr;
+    unsigned int msglen;
+
+    if (len == 0 ||
+        (msg->bufferOffset + len) >
+        (VIR_NET_MESSAGE_MAX + VIR_NET_MESSAGE_LEN_MAX)) {
+        virReportError(VIR_ERR_RPC,
+                       _("Invalid stream data length %zu"), len);
+        VIR_FORCE_CLOSE(fd);
+        return -1;
+    }
+
+    VIR_DEBUG("Encode length as %zu", msg->bufferOffset + len);
+    xdrmem_create(&xdr, msg->buffer, VIR_NET_MESSAGE_HEADER_XDR_LEN, XDR_ENCODE);
+    msglen = msg->bufferOffset + len;
+    if (!xdr_u_int(&xdr, &msglen)) {
+        virReportError(VIR_ERR_RPC, "%s", _("Unable to encode message length"));
+        xdr_destroy(&xdr);
+        VIR_FORCE_CLOSE(fd);
+        return -1;
+    }
+    xdr_destroy(&xdr);
+
+    msg->bufferLength = msg->bufferOffset;
+    msg->bufferOffset = 0;
+    msg->spliceFD = fd;
+    msg->spliceLength = len;
+    msg->spliceOffset = 0;
+    return 0;
+}
+
+
 void virNetMessageSaveError(struct virNetMessageError *rerr)
 {
     virErrorPtr verr;
@@ -31,6 +31,7 @@ struct _virNetMessage {
 
     char *buffer; /* Initially VIR_NET_MESSAGE_INITIAL + VIR_NET_MESSAGE_LEN_MAX */
                   /* Maximum   VIR_NET_MESSAGE_MAX     + VIR_NET_MESSAGE_LEN_MAX */
+    size_t bufferAlloc; /* Allocated size of buffer, >= bufferLength */
     size_t bufferLength;
     size_t bufferOffset;
 
@@ -43,6 +44,16 @@ struct _virNetMessage {
     int *fds;
     size_t donefds;
 
+    /* Payload which follows @buffer on the wire and is moved
+     * straight from the pipe @spliceFD, valid if @spliceLength > 0 */
+    int spliceFD;
+    size_t spliceLength;
+    size_t spliceOffset;
+
+    /* Successful replies with a payload larger than this are
+     * compressed by virNetMessageEncodePayload, 0 to disable */
+    unsigned int compressThreshold;
+
     virNetMessage *next;
 };
 
@@ -54,8 +65,24 @@ void virNetMessageClearPayload(virNetMessage *msg);
 
 void virNetMessageClear(virNetMessage *);
 
+void virNetMessageResizeBuffer(virNetMessage *msg,
+                               size_t len)
+    ATTRIBUTE_NONNULL(1);
+void virNetMessageStealBuffer(virNetMessage *dst,
+                              virNetMessage *src)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
+
+void virNetMessageGetBufferPoolStats(unsigned long long *hits,
+                                     unsigned long long *misses,
+                                     size_t *nbuffers,
+                                     size_t *nbytes);
+void virNetMessageTrimBufferPool(void);
+
 void virNetMessageFree(virNetMessage *msg);
 
+/* Default smallest reply payload worth compressing */
+#define VIR_NET_MESSAGE_COMPRESS_THRESHOLD (16 * 1024)
+
 virNetMessage *virNetMessageQueueServe(virNetMessage **queue)
     ATTRIBUTE_NONNULL(1);
 void virNetMessageQueuePush(virNetMessage **queue,
@@ -78,13 +105,26 @@ int virNetMessageDecodePayload(virNetMessage *msg,
                                void *data)
     ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2) ATTRIBUTE_NONNULL(2) G_GNUC_WARN_UNUSED_RESULT;
 
+int virNetMessageDecompressPayload(virNetMessage *msg)
+    ATTRIBUTE_NONNULL(1) G_GNUC_WARN_UNUSED_RESULT;
+
 int virNetMessageEncodeNumFDs(virNetMessage *msg);
 int virNetMessageDecodeNumFDs(virNetMessage *msg);
 
+char *virNetMessageEncodePayloadReserve(virNetMessage *msg,
+                                        size_t len)
+    ATTRIBUTE_NONNULL(1) G_GNUC_WARN_UNUSED_RESULT;
+int virNetMessageEncodePayloadCommit(virNetMessage *msg,
+                                     size_t len)
+    ATTRIBUTE_NONNULL(1) G_GNUC_WARN_UNUSED_RESULT;
 int virNetMessageEncodePayloadRaw(virNetMessage *msg,
                                   const char *buf,
                                   size_t len)
     ATTRIBUTE_NONNULL(1) G_GNUC_WARN_UNUSED_RESULT;
+int virNetMessageEncodePayloadSplice(virNetMessage *msg,
+                                     int fd,
+                                     size_t len)
+    ATTRIBUTE_NONNULL(1) G_GNUC_WARN_UNUSED_RESULT;
 
 void virNetMessageSaveError(struct virNetMessageError *rerr)
     ATTRIBUTE_NONNULL(1);
@@ -149,6 +149,11 @@ const VIR_NET_MESSAGE_NUM_FDS_MAX = 32;
  *     * status == VIR_NET_OK
  *          <empty>
  *
+ *  - type == VIR_NET_REPLY_COMPRESSED
+ *     * status == VIR_NET_OK
+ *          virNetCompressHeader
+ *          byte[]  compressed XXX_ret for procedure
+ *
  */
 enum virNetMessageType {
     /* client -> server. args from a method call */
@@ -164,7 +169,10 @@ enum virNetMessageType {
     /* server -> client. reply/error from a method call, with passed FDs */
     VIR_NET_REPLY_WITH_FDS = 5,
     /* either direction, stream hole data packet */
-    VIR_NET_STREAM_HOLE = 6
+    VIR_NET_STREAM_HOLE = 6,
+    /* server -> client. compressed reply from a method call, only sent
+     * to clients which enabled compression */
+    VIR_NET_REPLY_COMPRESSED = 7
 };
 
 enum virNetMessageStatus {
@@ -249,3 +257,35 @@ struct virNetStreamHole {
     hyper length;
     unsigned int flags;
 };
+
+/*
+ * Payload compression
+ *
+ * A client able to decompress replies announces it by sending an
+ * async VIR_NET_MESSAGE for VIR_NET_COMPRESS_PROC_ENABLE of
+ * VIR_NET_COMPRESS_PROGRAM. Servers which don't know about the program
+ * silently drop the message, others may from then on answer calls with
+ * VIR_NET_REPLY_COMPRESSED whenever the reply payload is larger than
+ * the threshold requested by the client.
+ */
+const VIR_NET_COMPRESS_PROGRAM = 0x636f6d70;
+const VIR_NET_COMPRESS_PROTOCOL_VERSION = 1;
+
+enum virNetCompressAlgorithm {
+    /* raw deflate stream, RFC 1951 */
+    VIR_NET_COMPRESS_DEFLATE = 1
+};
+
+enum virNetCompressProcedure {
+    VIR_NET_COMPRESS_PROC_ENABLE = 1
+};
+
+struct virNetCompressEnableArgs {
+    virNetCompressAlgorithm algorithm;
+    unsigned int threshold; /* smallest payload worth compressing */
+};
+
+struct virNetCompressHeader {
+    virNetCompressAlgorithm algorithm;
+    unsigned int length; /* uncompressed payload length */
+};
@@ -21,6 +21,8 @@
 
 #include <config.h>
 
+#include <time.h>
+
 #include "virnetserver.h"
 #include "virlog.h"
 #include "viralloc.h"
@@ -40,6 +42,7 @@ struct _virNetServerJob {
     virNetServerClient *client;
     virNetMessage *msg;
     virNetServerProgram *prog;
+    gint64 queued;
 };
 
 struct _virNetServer {
@@ -103,12 +106,29 @@ virNetServerNextClientID(virNetServer *srv)
 }
 
 
+/* CPU time consumed by the calling thread, in microseconds */
+static unsigned long long
+virNetServerThreadCPUTime(void)
+{
+#ifdef CLOCK_THREAD_CPUTIME_ID
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0)
+        return ts.tv_sec * 1000000ull + ts.tv_nsec / 1000;
+#endif
+    return 0;
+}
+
+
 static int
 virNetServerProcessMsg(virNetServer *srv,
                        virNetServerClient *client,
                        virNetServerProgram *prog,
                        virNetMessage *msg)
 {
+    unsigned long long cpuTime;
+    int rc;
+
     if (!prog) {
         /* Only send back an error for type == CALL. Other
          * message types are not expecting replies, so we
@@ -133,13 +153,14 @@ virNetServerProcessMsg(virNetServer *srv,
         return 0;
     }
 
-    if (virNetServerProgramDispatch(prog,
-                                    srv,
-                                    client,
-                                    msg) < 0)
-        return -1;
+    cpuTime = virNetServerThreadCPUTime();
 
-    return 0;
+    rc = virNetServerProgramDispatch(prog, srv, client, msg);
+
+    virNetServerClientRecordCall(client,
+                                 virNetServerThreadCPUTime() - cpuTime);
+
+    return rc;
 }
 
 
@@ -153,6 +174,10 @@ virNetServerHandleJob(void *jobOpaque,
     VIR_DEBUG("server=%p client=%p message=%p prog=%p",
               srv, job->client, job->msg, job->prog);
 
+    if (job->prog)
+        virNetServerProgramRecordQueueTime(job->prog, job->msg->header.proc,
+                                           g_get_monotonic_time() - job->queued);
+
     if (virNetServerProcessMsg(srv, job->client, job->prog, job->msg) < 0)
         goto error;
 
@@ -199,7 +224,7 @@ virNetServerDispatchNewMessage(virNetServerClient *client,
 {
     virNetServer *srv = opaque;
     virNetServerProgram *prog = NULL;
-    unsigned int priority = 0;
+    unsigned int jobClass = VIR_THREAD_POOL_CLASS_DEFAULT;
 
     VIR_DEBUG("server=%p client=%p message=%p",
               srv, client, msg);
@@ -219,13 +244,14 @@ virNetServerDispatchNewMessage(virNetServerClient *client,
 
         job->client = virObjectRef(client);
         job->msg = msg;
+        job->queued = g_get_monotonic_time();
 
         if (prog) {
             job->prog = virObjectRef(prog);
-            priority = virNetServerProgramGetPriority(prog, msg->header.proc);
+            jobClass = virNetServerProgramGetJobClass(prog, msg->header.proc);
         }
 
-        if (virThreadPoolSendJob(srv->workers, priority, job) < 0) {
+        if (virThreadPoolSendJob(srv->workers, jobClass, job) < 0) {
             virObjectUnref(client);
             VIR_FREE(job);
             virObjectUnref(prog);
@@ -985,7 +1011,11 @@ virNetServerGetThreadPoolParameters(virNetServer *srv,
                                     size_t *nWorkers,
                                     size_t *freeWorkers,
                                     size_t *nPrioWorkers,
-                                    size_t *jobQueueDepth)
+                                    size_t *jobQueueDepth,
+                                    size_t *jobQueues,
+                                    unsigned int *idleTimeout,
+                                    unsigned long long *spawnedWorkers,
+                                    unsigned long long *retiredWorkers)
 {
     VIR_LOCK_GUARD lock = virObjectLockGuard(srv);
 
@@ -995,21 +1025,129 @@ virNetServerGetThreadPoolParameters(virNetServer *srv,
     *nWorkers = virThreadPoolGetCurrentWorkers(srv->workers);
     *nPrioWorkers = virThreadPoolGetPriorityWorkers(srv->workers);
     *jobQueueDepth = virThreadPoolGetJobQueueDepth(srv->workers);
+    *jobQueues = virThreadPoolGetJobQueues(srv->workers);
+    *idleTimeout = virThreadPoolGetIdleTimeout(srv->workers);
+    virThreadPoolGetWorkerStats(srv->workers, spawnedWorkers, retiredWorkers);
 
     return 0;
 }
 
 
+/**
+ * virNetServerGetProcedureStats:
+ * @srv: server
+ * @stats: filled with a newly allocated array of statistics
+ * @nstats: filled with the number of elements in @stats
+ *
+ * Collects the per procedure statistics of all programs registered
+ * with @srv. Only procedures which were used at least once are
+ * reported.
+ */
+void
+virNetServerGetProcedureStats(virNetServer *srv,
+                              virNetServerProgramProcStats **stats,
+                              size_t *nstats)
+{
+    VIR_LOCK_GUARD lock = virObjectLockGuard(srv);
+    size_t i;
+
+    *stats = NULL;
+    *nstats = 0;
+
+    for (i = 0; i < srv->nprograms; i++) {
+        g_autofree virNetServerProgramProcStats *progstats = NULL;
+        size_t nprogstats = 0;
+
+        virNetServerProgramGetProcStats(srv->programs[i],
+                                        &progstats, &nprogstats);
+        if (nprogstats == 0)
+            continue;
+
+        *stats = g_renew(virNetServerProgramProcStats, *stats,
+                         *nstats + nprogstats);
+        memcpy(*stats + *nstats, progstats,
+               sizeof(*progstats) * nprogstats);
+        *nstats += nprogstats;
+    }
+}
+
+
+/**
+ * virNetServerAddJobClass:
+ * @srv: server
+ * @name: name of the class
+ * @workers: number of workers to reserve for the class
+ * @exclusive: whether only the reserved workers may run the calls
+ *
+ * Adds a job class to the worker pool of @srv. Procedures are put into
+ * the class by setting the jobClass of their virNetServerProgramProc to
+ * the returned value before the program is added to @srv.
+ *
+ * Returns the job class on success, -1 on error.
+ */
+int
+virNetServerAddJobClass(virNetServer *srv,
+                        const char *name,
+                        size_t workers,
+                        bool exclusive)
+{
+    VIR_LOCK_GUARD lock = virObjectLockGuard(srv);
+
+    return virThreadPoolAddClass(srv->workers, name, workers, exclusive);
+}
+
+
+void
+virNetServerGetJobClassStats(virNetServer *srv,
+                             virThreadPoolClassStats **stats,
+                             size_t *nstats)
+{
+    VIR_LOCK_GUARD lock = virObjectLockGuard(srv);
+
+    virThreadPoolGetClassStats(srv->workers, stats, nstats);
+}
+
+
+void
+virNetServerGetWorkerThreadStats(virNetServer *srv,
+                                 virThreadPoolThreadStats **stats,
+                                 size_t *nstats)
+{
+    VIR_LOCK_GUARD lock = virObjectLockGuard(srv);
+
+    virThreadPoolGetThreadStats(srv->workers, stats, nstats);
+}
+
+
+/**
+ * virNetServerTrimWorkers:
+ * @srv: server
+ *
+ * Makes the idle workers of @srv above the minimum number of workers
+ * exit.
+ */
+void
+virNetServerTrimWorkers(virNetServer *srv)
+{
+    VIR_LOCK_GUARD lock = virObjectLockGuard(srv);
+
+    virThreadPoolTrim(srv->workers);
+}
+
+
 int
 virNetServerSetThreadPoolParameters(virNetServer *srv,
                                     long long int minWorkers,
                                     long long int maxWorkers,
-                                    long long int prioWorkers)
+                                    long long int prioWorkers,
+                                    long long int jobQueues,
+                                    long long int idleTimeout)
 {
     VIR_LOCK_GUARD lock = virObjectLockGuard(srv);
 
     return virThreadPoolSetParameters(srv->workers, minWorkers,
-                                      maxWorkers, prioWorkers);
+                                      maxWorkers, prioWorkers,
+                                      jobQueues, idleTimeout);
 }
 
 
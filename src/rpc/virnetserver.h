@@ -28,6 +28,7 @@
 #include "virobject.h"
 #include "virjson.h"
 #include "virsystemd.h"
+#include "virthreadpool.h"
 
 
 virNetServer *virNetServerNew(const char *name,
@@ -108,12 +109,36 @@ int virNetServerGetThreadPoolParameters(virNetServer *srv,
                                         size_t *nWorkers,
                                         size_t *freeWorkers,
                                         size_t *nPrioWorkers,
-                                        size_t *jobQueueDepth);
+                                        size_t *jobQueueDepth,
+                                        size_t *jobQueues,
+                                        unsigned int *idleTimeout,
+                                        unsigned long long *spawnedWorkers,
+                                        unsigned long long *retiredWorkers);
+
+void virNetServerGetProcedureStats(virNetServer *srv,
+                                   virNetServerProgramProcStats **stats,
+                                   size_t *nstats);
+
+int virNetServerAddJobClass(virNetServer *srv,
+                            const char *name,
+                            size_t workers,
+                            bool exclusive);
+
+void virNetServerGetJobClassStats(virNetServer *srv,
+                                  virThreadPoolClassStats **stats,
+                                  size_t *nstats);
+void virNetServerGetWorkerThreadStats(virNetServer *srv,
+                                      virThreadPoolThreadStats **stats,
+                                      size_t *nstats);
+
+void virNetServerTrimWorkers(virNetServer *srv);
 
 int virNetServerSetThreadPoolParameters(virNetServer *srv,
                                         long long int minWorkers,
                                         long long int maxWorkers,
-                                        long long int prioWorkers);
+                                        long long int prioWorkers,
+                                        long long int jobQueues,
+                                        long long int idleTimeout);
 
 unsigned long long virNetServerNextClientID(virNetServer *srv);
 
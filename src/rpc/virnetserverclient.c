@@ -115,6 +115,16 @@ struct _virNetServerClient
     virNetServerClientCloseFunc privateDataCloseFunc;
 
     virKeepAlive *keepalive;
+
+    /* Replies larger than this are compressed, 0 if the client
+     * has not asked for compression */
+    unsigned int compressThreshold;
+
+    /* Resources used by the client so far */
+    unsigned long long calls;
+    unsigned long long cpuTime;
+    unsigned long long bytesIn;
+    unsigned long long bytesOut;
 };
 
 
@@ -299,8 +309,7 @@ virNetServerClientCheckAccess(virNetServerClient *client)
      * indicate this (otherwise the socket is abruptly closed).
      * (NB. The '\1' byte is sent in an encrypted record).
      */
-    confirm->bufferLength = 1;
-    confirm->buffer = g_new0(char, confirm->bufferLength);
+    virNetMessageResizeBuffer(confirm, 1);
     confirm->bufferOffset = 0;
     confirm->buffer[0] = '\1';
 
@@ -400,8 +409,7 @@ virNetServerClientNewInternal(unsigned long long id,
     /* Prepare one for packet receive */
     if (!(client->rx = virNetMessageNew(true)))
         goto error;
-    client->rx->bufferLength = VIR_NET_MESSAGE_LEN_MAX;
-    client->rx->buffer = g_new0(char, client->rx->bufferLength);
+    virNetMessageResizeBuffer(client->rx, VIR_NET_MESSAGE_LEN_MAX);
     client->nrequests = 1;
 
     PROBE(RPC_SERVER_CLIENT_NEW,
@@ -629,6 +637,14 @@ virNetServerClientSetAuthLocked(virNetServerClient *client,
 }
 
 
+unsigned int virNetServerClientGetCompressThreshold(virNetServerClient *client)
+{
+    VIR_LOCK_GUARD lock = virObjectLockGuard(client);
+
+    return client->compressThreshold;
+}
+
+
 bool virNetServerClientGetReadonly(virNetServerClient *client)
 {
     VIR_LOCK_GUARD lock = virObjectLockGuard(client);
@@ -693,6 +709,26 @@ int virNetServerClientGetFD(virNetServerClient *client)
 }
 
 
+/*
+ * Returns true if stream data can be spliced into the client
+ * socket, see virNetServerProgramSendStreamDataSplice.
+ */
+bool virNetServerClientCanSplice(virNetServerClient *client)
+{
+    VIR_LOCK_GUARD lock = virObjectLockGuard(client);
+
+    if (!client->sock || client->tls)
+        return false;
+#if WITH_SASL
+    /* A SASL session may still be installed on the socket once
+     * pending messages are sent */
+    if (client->sasl)
+        return false;
+#endif
+    return virNetSocketCanSplice(client->sock);
+}
+
+
 bool virNetServerClientIsLocal(virNetServerClient *client)
 {
     VIR_LOCK_GUARD lock = virObjectLockGuard(client);
@@ -1126,6 +1162,7 @@ static ssize_t virNetServerClientRead(virNetServerClient *client)
         return ret;
 
     client->rx->bufferOffset += ret;
+    client->bytesIn += ret;
     return ret;
 }
 
@@ -1139,6 +1176,42 @@ static ssize_t virNetServerClientRead(virNetServerClient *client)
  * yet available, or an error occurred. On error, the wantClose
  * flag will be set.
  */
+/*
+ * @client: a locked client object
+ *
+ * Returns true if @msg was a request to enable compression of replies
+ */
+static bool
+virNetServerClientCheckCompress(virNetServerClient *client,
+                                virNetMessage *msg)
+{
+    virNetCompressEnableArgs args = { 0 };
+
+    if (msg->header.prog != VIR_NET_COMPRESS_PROGRAM ||
+        msg->header.vers != VIR_NET_COMPRESS_PROTOCOL_VERSION ||
+        msg->header.type != VIR_NET_MESSAGE ||
+        msg->header.proc != VIR_NET_COMPRESS_PROC_ENABLE)
+        return false;
+
+    if (virNetMessageDecodePayload(msg, (xdrproc_t)xdr_virNetCompressEnableArgs,
+                                   &args) < 0) {
+        VIR_WARN("Ignoring malformed compression request from client %p", client);
+        return true;
+    }
+
+    if (args.algorithm != VIR_NET_COMPRESS_DEFLATE) {
+        VIR_DEBUG("Client %p requested unsupported compression algorithm %d",
+                  client, args.algorithm);
+        return true;
+    }
+
+    VIR_DEBUG("Enabling compression of replies larger than %u bytes for client %p",
+              args.threshold, client);
+    client->compressThreshold = args.threshold;
+    return true;
+}
+
+
 static virNetMessage *virNetServerClientDispatchRead(virNetServerClient *client)
 {
  readmore:
@@ -1232,6 +1305,11 @@ static virNetMessage *virNetServerClientDispatchRead(virNetServerClient *client)
                 virNetMessageFree(response);
         }
 
+        if (msg && virNetServerClientCheckCompress(client, msg)) {
+            g_clear_pointer(&msg, virNetMessageFree);
+            client->nrequests--;
+        }
+
         /* Maybe send off for queue against a filter */
         if (msg) {
             filter = client->filters;
@@ -1256,8 +1334,7 @@ static virNetMessage *virNetServerClientDispatchRead(virNetServerClient *client)
             if (!(client->rx = virNetMessageNew(true))) {
                 client->wantClose = true;
             } else {
-                client->rx->bufferLength = VIR_NET_MESSAGE_LEN_MAX;
-                client->rx->buffer = g_new0(char, client->rx->bufferLength);
+                virNetMessageResizeBuffer(client->rx, VIR_NET_MESSAGE_LEN_MAX);
                 client->nrequests++;
             }
         }
@@ -1298,6 +1375,7 @@ static ssize_t virNetServerClientWrite(virNetServerClient *client)
         return ret; /* -1 error, 0 = egain */
 
     client->tx->bufferOffset += ret;
+    client->bytesOut += ret;
     return ret;
 }
 
@@ -1321,6 +1399,25 @@ virNetServerClientDispatchWrite(virNetServerClient *client)
                 return; /* Would block on write EAGAIN */
         }
 
+        if (client->tx->bufferOffset == client->tx->bufferLength &&
+            client->tx->spliceOffset < client->tx->spliceLength) {
+            ssize_t ret;
+            ret = virNetSocketSpliceFrom(client->sock,
+                                         client->tx->spliceFD,
+                                         client->tx->spliceLength -
+                                         client->tx->spliceOffset);
+            if (ret < 0) {
+                client->wantClose = true;
+                return;
+            }
+            if (ret == 0)
+                return; /* Would block on write EAGAIN */
+
+            client->tx->spliceOffset += ret;
+            if (client->tx->spliceOffset < client->tx->spliceLength)
+                continue;
+        }
+
         if (client->tx->bufferOffset == client->tx->bufferLength) {
             virNetMessage *msg;
             size_t i;
@@ -1356,8 +1453,7 @@ virNetServerClientDispatchWrite(virNetServerClient *client)
                     client->nrequests < client->nrequests_max) {
                     /* Ready to recv more messages */
                     virNetMessageClear(msg);
-                    msg->bufferLength = VIR_NET_MESSAGE_LEN_MAX;
-                    msg->buffer = g_new0(char, msg->bufferLength);
+                    virNetMessageResizeBuffer(msg, VIR_NET_MESSAGE_LEN_MAX);
                     client->rx = g_steal_pointer(&msg);
                     client->nrequests++;
                 }
@@ -1522,7 +1618,8 @@ virNetServerClientInitKeepAlive(virNetServerClient *client,
     if (!(ka = virKeepAliveNew(interval, count, client,
                                virNetServerClientKeepAliveSendCB,
                                virNetServerClientKeepAliveDeadCB,
-                               virObjectFreeCallback)))
+                               virObjectFreeCallback,
+                               VIR_KEEPALIVE_SHARED_TIMER)))
         return -1;
 
     /* keepalive object has a reference to client */
@@ -1594,6 +1691,54 @@ virNetServerClientGetInfo(virNetServerClient *client,
 }
 
 
+/**
+ * virNetServerClientRecordCall:
+ * @client: the client
+ * @cpuTime: CPU time the worker spent on the call, in microseconds
+ *
+ * Accounts a call dispatched on behalf of @client.
+ */
+void
+virNetServerClientRecordCall(virNetServerClient *client,
+                             unsigned long long cpuTime)
+{
+    VIR_LOCK_GUARD lock = virObjectLockGuard(client);
+
+    client->calls++;
+    client->cpuTime += cpuTime;
+}
+
+
+void
+virNetServerClientGetStats(virNetServerClient *client,
+                           virNetServerClientStats *stats)
+{
+    VIR_LOCK_GUARD lock = virObjectLockGuard(client);
+    virNetMessage *msg;
+
+    memset(stats, 0, sizeof(*stats));
+
+    stats->calls = client->calls;
+    stats->cpuTime = client->cpuTime;
+    stats->bytesIn = client->bytesIn;
+    stats->bytesOut = client->bytesOut;
+
+    /* The buffer waiting for the next call is accounted as a request */
+    stats->requests = client->nrequests;
+    if (client->rx && stats->requests > 0)
+        stats->requests--;
+    stats->requestsMax = client->nrequests_max;
+
+    if (client->rx)
+        stats->bufferBytes += sizeof(*client->rx) + client->rx->bufferAlloc;
+
+    for (msg = client->tx; msg; msg = msg->next) {
+        stats->txQueued++;
+        stats->bufferBytes += sizeof(*msg) + msg->bufferAlloc;
+    }
+}
+
+
 /**
  * virNetServerClientSetQuietEOF:
  *
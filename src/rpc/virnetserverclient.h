@@ -97,6 +97,7 @@ void virNetServerClientRemoveFilter(virNetServerClient *client,
 int virNetServerClientGetAuth(virNetServerClient *client);
 void virNetServerClientSetAuthLocked(virNetServerClient *client, int auth);
 bool virNetServerClientGetReadonly(virNetServerClient *client);
+unsigned int virNetServerClientGetCompressThreshold(virNetServerClient *client);
 void virNetServerClientSetReadonly(virNetServerClient *client, bool readonly);
 unsigned long long virNetServerClientGetID(virNetServerClient *client);
 long long virNetServerClientGetTimestamp(virNetServerClient *client);
@@ -116,6 +117,7 @@ int virNetServerClientGetFD(virNetServerClient *client);
 
 bool virNetServerClientIsSecure(virNetServerClient *client);
 
+bool virNetServerClientCanSplice(virNetServerClient *client);
 bool virNetServerClientIsLocal(virNetServerClient *client);
 
 int virNetServerClientGetUNIXIdentity(virNetServerClient *client,
@@ -172,4 +174,21 @@ int virNetServerClientGetInfo(virNetServerClient *client,
                               bool *readonly, char **sock_addr,
                               virIdentity **identity);
 
+typedef struct _virNetServerClientStats virNetServerClientStats;
+struct _virNetServerClientStats {
+    unsigned long long calls;
+    unsigned long long cpuTime; /* microseconds spent dispatching calls */
+    unsigned long long bytesIn;
+    unsigned long long bytesOut;
+    size_t requests; /* calls being processed or replied to */
+    size_t requestsMax;
+    size_t txQueued; /* messages waiting to be sent */
+    size_t bufferBytes; /* allocated by messages being received or sent */
+};
+
+void virNetServerClientRecordCall(virNetServerClient *client,
+                                  unsigned long long cpuTime);
+void virNetServerClientGetStats(virNetServerClient *client,
+                                virNetServerClientStats *stats);
+
 void virNetServerClientSetQuietEOF(virNetServerClient *client);
@@ -29,6 +29,7 @@
 #include "virlog.h"
 #include "virfile.h"
 #include "virthread.h"
+#include "virprobe.h"
 
 #define VIR_FROM_THIS VIR_FROM_RPC
 
@@ -41,6 +42,9 @@ struct _virNetServerProgram {
     unsigned version;
     virNetServerProgramProc *procs;
     size_t nprocs;
+
+    virMutex statsLock;
+    virNetServerProgramProcStats *stats; /* indexed by procedure */
 };
 
 
@@ -76,6 +80,14 @@ virNetServerProgram *virNetServerProgramNew(unsigned program,
     prog->procs = procs;
     prog->nprocs = nprocs;
 
+    if (virMutexInit(&prog->statsLock) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to initialize mutex"));
+        virObjectUnref(prog);
+        return NULL;
+    }
+    prog->stats = g_new0(virNetServerProgramProcStats, nprocs);
+
     VIR_DEBUG("prog=%p", prog);
 
     return prog;
@@ -122,8 +134,134 @@ static virNetServerProgramProc *virNetServerProgramGetProc(virNetServerProgram *
     return proc;
 }
 
+
+static size_t
+virNetServerProgramHistBucket(unsigned long long usecs)
+{
+    size_t bucket = 0;
+
+    while (usecs && bucket < VIR_NET_SERVER_PROGRAM_HIST_BUCKETS - 1) {
+        usecs >>= 1;
+        bucket++;
+    }
+
+    return bucket;
+}
+
+
+/**
+ * virNetServerProgramHistBucketStart:
+ * @bucket: histogram bucket index
+ *
+ * Returns the lower bound in microseconds of the durations counted
+ * by histogram bucket @bucket.
+ */
+unsigned long long
+virNetServerProgramHistBucketStart(size_t bucket)
+{
+    if (bucket == 0)
+        return 0;
+
+    return 1ULL << (bucket - 1);
+}
+
+
+/**
+ * virNetServerProgramRecordQueueTime:
+ * @prog: the program
+ * @procedure: procedure number of the queued message
+ * @usecs: time the message spent waiting for a worker
+ *
+ * Accounts the time an incoming message for @procedure spent in the
+ * worker pool queue before being dispatched.
+ */
+void
+virNetServerProgramRecordQueueTime(virNetServerProgram *prog,
+                                   int procedure,
+                                   unsigned long long usecs)
+{
+    virNetServerProgramProcStats *stats;
+
+    if (!virNetServerProgramGetProc(prog, procedure))
+        return;
+
+    VIR_WITH_MUTEX_LOCK_GUARD(&prog->statsLock) {
+        stats = &prog->stats[procedure];
+        stats->queued++;
+        stats->queueTime += usecs;
+        stats->queueHist[virNetServerProgramHistBucket(usecs)]++;
+    }
+}
+
+
+static void
+virNetServerProgramRecordCall(virNetServerProgram *prog,
+                              int procedure,
+                              size_t bytesIn,
+                              size_t bytesOut,
+                              unsigned long long usecs,
+                              bool failed)
+{
+    VIR_LOCK_GUARD lock = virLockGuardLock(&prog->statsLock);
+    virNetServerProgramProcStats *stats = &prog->stats[procedure];
+
+    stats->calls++;
+    if (failed)
+        stats->errors++;
+    stats->bytesIn += bytesIn;
+    stats->bytesOut += bytesOut;
+    stats->dispatchTime += usecs;
+    stats->dispatchHist[virNetServerProgramHistBucket(usecs)]++;
+}
+
+
+/**
+ * virNetServerProgramGetProcStats:
+ * @prog: the program
+ * @stats: filled with a newly allocated array of statistics
+ * @nstats: filled with the number of elements in @stats
+ *
+ * Retrieves a snapshot of the statistics of all procedures of
+ * @prog which have been called or queued at least once.
+ */
+void
+virNetServerProgramGetProcStats(virNetServerProgram *prog,
+                                virNetServerProgramProcStats **stats,
+                                size_t *nstats)
+{
+    VIR_LOCK_GUARD lock = virLockGuardLock(&prog->statsLock);
+    size_t i;
+    size_t n = 0;
+
+    *stats = NULL;
+    *nstats = 0;
+
+    for (i = 0; i < prog->nprocs; i++) {
+        if (prog->stats[i].calls || prog->stats[i].queued)
+            n++;
+    }
+
+    if (n == 0)
+        return;
+
+    *stats = g_new0(virNetServerProgramProcStats, n);
+
+    for (i = 0; i < prog->nprocs; i++) {
+        virNetServerProgramProcStats *ent;
+
+        if (!prog->stats[i].calls && !prog->stats[i].queued)
+            continue;
+
+        ent = &(*stats)[(*nstats)++];
+        *ent = prog->stats[i];
+        ent->program = prog->program;
+        ent->procedure = i;
+    }
+}
+
+
 unsigned int
-virNetServerProgramGetPriority(virNetServerProgram *prog,
+virNetServerProgramGetJobClass(virNetServerProgram *prog,
                                int procedure)
 {
     virNetServerProgramProc *proc = virNetServerProgramGetProc(prog, procedure);
@@ -131,7 +269,7 @@ virNetServerProgramGetPriority(virNetServerProgram *prog,
     if (!proc)
         return 0;
 
-    return proc->priority;
+    return proc->jobClass;
 }
 
 static int
@@ -319,6 +457,7 @@ int virNetServerProgramDispatch(virNetServerProgram *prog,
 
     case VIR_NET_REPLY:
     case VIR_NET_REPLY_WITH_FDS:
+    case VIR_NET_REPLY_COMPRESSED:
     case VIR_NET_MESSAGE:
     case VIR_NET_STREAM_HOLE:
     default:
@@ -368,10 +507,13 @@ virNetServerProgramDispatchCall(virNetServerProgram *prog,
     g_autofree char *arg = NULL;
     g_autofree char *ret = NULL;
     int rv = -1;
-    virNetServerProgramProc *dispatcher;
+    virNetServerProgramProc *dispatcher = NULL;
     virNetMessageError rerr;
     size_t i;
     g_autoptr(virIdentity) identity = NULL;
+    gint64 start = g_get_monotonic_time();
+    size_t bytesIn = msg->bufferLength;
+    unsigned long long usecs;
 
     memset(&rerr, 0, sizeof(rerr));
 
@@ -471,6 +613,8 @@ virNetServerProgramDispatchCall(virNetServerProgram *prog,
         goto error;
     }
 
+    msg->compressThreshold = virNetServerClientGetCompressThreshold(client);
+
     if (virNetMessageEncodePayload(msg, dispatcher->ret_filter, ret) < 0) {
         xdr_free(dispatcher->ret_filter, ret);
         goto error;
@@ -478,10 +622,28 @@ virNetServerProgramDispatchCall(virNetServerProgram *prog,
 
     xdr_free(dispatcher->ret_filter, ret);
 
+    usecs = g_get_monotonic_time() - start;
+    virNetServerProgramRecordCall(prog, msg->header.proc,
+                                  bytesIn, msg->bufferLength, usecs, false);
+    PROBE_QUIET(RPC_SERVER_PROGRAM_DISPATCH_DONE,
+                "client=%p prog=%u vers=%u proc=%u serial=%u failed=%d usec=%llu",
+                client, msg->header.prog, msg->header.vers, msg->header.proc,
+                msg->header.serial, 0, usecs);
+
     /* Put reply on end of tx queue to send out  */
     return virNetServerClientSendMessage(client, msg);
 
  error:
+    if (dispatcher) {
+        usecs = g_get_monotonic_time() - start;
+        virNetServerProgramRecordCall(prog, msg->header.proc, bytesIn, 0,
+                                      usecs, true);
+        PROBE_QUIET(RPC_SERVER_PROGRAM_DISPATCH_DONE,
+                    "client=%p prog=%u vers=%u proc=%u serial=%u failed=%d usec=%llu",
+                    client, msg->header.prog, msg->header.vers, msg->header.proc,
+                    msg->header.serial, 1, usecs);
+    }
+
     /* Bad stuff (de-)serializing message, but we have an
      * RPC error message we can send back to the client */
     rv = virNetServerProgramSendReplyError(prog, client, msg, &rerr, &msg->header);
@@ -527,6 +689,82 @@ int virNetServerProgramSendStreamData(virNetServerProgram *prog,
 }
 
 
+/*
+ * Prepare @msg for sending up to @len bytes of stream data, which the
+ * caller then stores at the returned location, so that they don't need to
+ * be copied into the message. The message is sent by
+ * virNetServerProgramSendPreparedStreamData once the actual length of the
+ * data is known. Returns NULL on error.
+ */
+char *virNetServerProgramPrepareStreamData(virNetServerProgram *prog,
+                                           virNetMessage *msg,
+                                           int procedure,
+                                           unsigned int serial,
+                                           size_t len)
+{
+    msg->header.prog = prog->program;
+    msg->header.vers = prog->version;
+    msg->header.proc = procedure;
+    msg->header.type = VIR_NET_STREAM;
+    msg->header.serial = serial;
+    msg->header.status = VIR_NET_CONTINUE;
+
+    if (virNetMessageEncodeHeader(msg) < 0)
+        return NULL;
+
+    return virNetMessageEncodePayloadReserve(msg, len);
+}
+
+
+int virNetServerProgramSendPreparedStreamData(virNetServerClient *client,
+                                              virNetMessage *msg,
+                                              size_t len)
+{
+    VIR_DEBUG("client=%p msg=%p len=%zu", client, msg, len);
+
+    if (virNetMessageEncodePayloadCommit(msg, len) < 0)
+        return -1;
+
+    return virNetServerClientSendMessage(client, msg);
+}
+
+
+/*
+ * Like virNetServerProgramSendStreamData, except the @len bytes of
+ * data are spliced from the pipe @fd into the client socket. The
+ * message takes ownership of @fd, it is closed on failure.
+ */
+int virNetServerProgramSendStreamDataSplice(virNetServerProgram *prog,
+                                            virNetServerClient *client,
+                                            virNetMessage *msg,
+                                            int procedure,
+                                            unsigned int serial,
+                                            int fd,
+                                            size_t len)
+{
+    VIR_DEBUG("client=%p msg=%p fd=%d len=%zu", client, msg, fd, len);
+
+    msg->header.prog = prog->program;
+    msg->header.vers = prog->version;
+    msg->header.proc = procedure;
+    msg->header.type = VIR_NET_STREAM;
+    msg->header.serial = serial;
+    msg->header.status = VIR_NET_CONTINUE;
+
+    if (virNetMessageEncodeHeader(msg) < 0) {
+        VIR_FORCE_CLOSE(fd);
+        return -1;
+    }
+
+    if (virNetMessageEncodePayloadSplice(msg, fd, len) < 0)
+        return -1;
+
+    VIR_DEBUG("Total %zu", msg->bufferLength + msg->spliceLength);
+
+    return virNetServerClientSendMessage(client, msg);
+}
+
+
 int virNetServerProgramSendStreamHole(virNetServerProgram *prog,
                                       virNetServerClient *client,
                                       virNetMessage *msg,
@@ -562,6 +800,10 @@ int virNetServerProgramSendStreamHole(virNetServerProgram *prog,
 }
 
 
-void virNetServerProgramDispose(void *obj G_GNUC_UNUSED)
+void virNetServerProgramDispose(void *obj)
 {
+    virNetServerProgram *prog = obj;
+
+    g_free(prog->stats);
+    virMutexDestroy(&prog->statsLock);
 }
@@ -47,7 +47,30 @@ struct _virNetServerProgramProc {
     size_t ret_len;
     xdrproc_t ret_filter;
     bool needAuth;
-    unsigned int priority;
+    unsigned int jobClass; /* worker pool job class, 1 for high priority */
+};
+
+/* Number of log2 sized buckets of the per procedure histograms. Bucket 0
+ * counts durations below 1 microsecond, bucket N > 0 counts durations of
+ * at least 2^(N-1) microseconds, the last bucket being open ended */
+#define VIR_NET_SERVER_PROGRAM_HIST_BUCKETS 24
+
+typedef struct _virNetServerProgramProcStats virNetServerProgramProcStats;
+struct _virNetServerProgramProcStats {
+    unsigned int program;
+    int procedure;
+
+    unsigned long long calls;
+    unsigned long long errors;
+    unsigned long long queued;
+    unsigned long long bytesIn;
+    unsigned long long bytesOut;
+
+    /* Totals and histograms, all in microseconds */
+    unsigned long long queueTime;
+    unsigned long long dispatchTime;
+    unsigned long long queueHist[VIR_NET_SERVER_PROGRAM_HIST_BUCKETS];
+    unsigned long long dispatchHist[VIR_NET_SERVER_PROGRAM_HIST_BUCKETS];
 };
 
 virNetServerProgram *virNetServerProgramNew(unsigned program,
@@ -58,12 +81,22 @@ virNetServerProgram *virNetServerProgramNew(unsigned program,
 int virNetServerProgramGetID(virNetServerProgram *prog);
 int virNetServerProgramGetVersion(virNetServerProgram *prog);
 
-unsigned int virNetServerProgramGetPriority(virNetServerProgram *prog,
+unsigned int virNetServerProgramGetJobClass(virNetServerProgram *prog,
                                             int procedure);
 
 int virNetServerProgramMatches(virNetServerProgram *prog,
                                virNetMessage *msg);
 
+unsigned long long virNetServerProgramHistBucketStart(size_t bucket);
+
+void virNetServerProgramRecordQueueTime(virNetServerProgram *prog,
+                                        int procedure,
+                                        unsigned long long usecs);
+
+void virNetServerProgramGetProcStats(virNetServerProgram *prog,
+                                     virNetServerProgramProcStats **stats,
+                                     size_t *nstats);
+
 int virNetServerProgramDispatch(virNetServerProgram *prog,
                                 virNetServer *server,
                                 virNetServerClient *client,
@@ -94,6 +127,24 @@ int virNetServerProgramSendStreamData(virNetServerProgram *prog,
                                       const char *data,
                                       size_t len);
 
+char *virNetServerProgramPrepareStreamData(virNetServerProgram *prog,
+                                           virNetMessage *msg,
+                                           int procedure,
+                                           unsigned int serial,
+                                           size_t len);
+
+int virNetServerProgramSendPreparedStreamData(virNetServerClient *client,
+                                              virNetMessage *msg,
+                                              size_t len);
+
+int virNetServerProgramSendStreamDataSplice(virNetServerProgram *prog,
+                                            virNetServerClient *client,
+                                            virNetMessage *msg,
+                                            int procedure,
+                                            unsigned int serial,
+                                            int fd,
+                                            size_t len);
+
 int virNetServerProgramSendStreamHole(virNetServerProgram *prog,
                                       virNetServerClient *client,
                                       virNetMessage *msg,
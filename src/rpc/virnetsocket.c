@@ -1973,6 +1973,84 @@ ssize_t virNetSocketWrite(virNetSocket *sock, const char *buf, size_t len)
 }
 
 
+/*
+ * Returns true if data can be moved into the socket straight from
+ * a pipe with virNetSocketSpliceFrom, i.e. it is a plain UNIX
+ * socket without any encryption or encapsulation layer.
+ */
+bool virNetSocketCanSplice(virNetSocket *sock)
+{
+#ifdef WITH_SPLICE
+    bool canSplice;
+
+    virObjectLock(sock);
+    canSplice = sock->localAddr.data.sa.sa_family == AF_UNIX &&
+        !sock->tlsSession;
+# if WITH_SASL
+    if (sock->saslSession)
+        canSplice = false;
+# endif
+# if WITH_SSH2
+    if (sock->sshSession)
+        canSplice = false;
+# endif
+# if WITH_LIBSSH
+    if (sock->libsshSession)
+        canSplice = false;
+# endif
+    virObjectUnlock(sock);
+    return canSplice;
+#else /* !WITH_SPLICE */
+    return false;
+#endif /* !WITH_SPLICE */
+}
+
+
+/*
+ * Moves up to @len bytes from the pipe @fd into the socket without
+ * copying them through userspace.
+ *
+ * Returns the number of bytes moved, 0 if it would block, -1 on error
+ */
+#ifdef WITH_SPLICE
+ssize_t virNetSocketSpliceFrom(virNetSocket *sock, int fd, size_t len)
+{
+    ssize_t ret;
+
+    virObjectLock(sock);
+ resplice:
+    ret = splice(fd, NULL, sock->fd, NULL, len,
+                 SPLICE_F_MOVE | SPLICE_F_NONBLOCK | SPLICE_F_MORE);
+
+    if (ret < 0) {
+        if (errno == EINTR)
+            goto resplice;
+        if (errno == EAGAIN) {
+            ret = 0;
+        } else {
+            virReportSystemError(errno, "%s",
+                                 _("Cannot splice data into socket"));
+        }
+    } else if (ret == 0) {
+        virReportSystemError(EIO, "%s",
+                             _("End of file while splicing data"));
+        ret = -1;
+    }
+    virObjectUnlock(sock);
+    return ret;
+}
+#else /* !WITH_SPLICE */
+ssize_t virNetSocketSpliceFrom(virNetSocket *sock G_GNUC_UNUSED,
+                               int fd G_GNUC_UNUSED,
+                               size_t len G_GNUC_UNUSED)
+{
+    virReportSystemError(ENOSYS, "%s",
+                         _("Splicing data is not supported on this platform"));
+    return -1;
+}
+#endif /* !WITH_SPLICE */
+
+
 /*
  * Returns 1 if an FD was sent, 0 if it would block, -1 on error
  */
@@ -145,6 +145,9 @@ void virNetSocketSetQuietEOF(virNetSocket *sock);
 ssize_t virNetSocketRead(virNetSocket *sock, char *buf, size_t len);
 ssize_t virNetSocketWrite(virNetSocket *sock, const char *buf, size_t len);
 
+bool virNetSocketCanSplice(virNetSocket *sock);
+ssize_t virNetSocketSpliceFrom(virNetSocket *sock, int fd, size_t len);
+
 int virNetSocketSendFD(virNetSocket *sock, int fd);
 int virNetSocketRecvFD(virNetSocket *sock, int *fd);
 
@@ -36,6 +36,7 @@
 #include "virlog.h"
 #include "virprobe.h"
 #include "virthread.h"
+#include "virsecureerase.h"
 #include "configmake.h"
 
 #define LIBVIRT_PKI_DIR SYSCONFDIR "/pki"
@@ -60,6 +61,14 @@ struct _virNetTLSContext {
     bool requireValidCert;
     const char *const *x509dnACL;
     char *priority;
+
+    /* Server side session tickets, enabled if @ticketKeyRotation > 0 */
+    unsigned int ticketKeyRotation; /* seconds */
+    gnutls_datum_t ticketKey;
+    gint64 ticketKeyCreated; /* monotonic, microseconds */
+
+    /* Client side, identifies the credentials in the session cache */
+    char *sessionCacheID;
 };
 
 struct _virNetTLSSession {
@@ -74,8 +83,19 @@ struct _virNetTLSSession {
     virNetTLSSessionReadFunc readFunc;
     void *opaque;
     char *x509dname;
+
+    /* Client side key into the session cache */
+    char *sessionCacheKey;
 };
 
+/*
+ * Client side cache of session resumption data, keyed by the
+ * client credentials and server hostname so that a session is only
+ * ever resumed with the same identity it was established with.
+ */
+static GHashTable *virNetTLSSessionCache;
+static virMutex virNetTLSSessionCacheLock = VIR_MUTEX_INITIALIZER;
+
 static virClass *virNetTLSContextClass;
 static virClass *virNetTLSSessionClass;
 static void virNetTLSContextDispose(void *obj);
@@ -96,6 +116,31 @@ static int virNetTLSContextOnceInit(void)
 VIR_ONCE_GLOBAL_INIT(virNetTLSContext);
 
 
+static void
+virNetTLSDatumFree(gnutls_datum_t *datum)
+{
+    if (!datum)
+        return;
+
+    if (datum->data) {
+        virSecureErase(datum->data, datum->size);
+        gnutls_free(datum->data);
+    }
+    datum->data = NULL;
+    datum->size = 0;
+}
+
+
+static void
+virNetTLSSessionCacheEntryFree(void *opaque)
+{
+    gnutls_datum_t *datum = opaque;
+
+    virNetTLSDatumFree(datum);
+    g_free(datum);
+}
+
+
 static int
 virNetTLSContextCheckCertFile(const char *type, const char *file, bool allowMissing)
 {
@@ -746,6 +791,10 @@ static virNetTLSContext *virNetTLSContextNew(const char *cacert,
     ctxt->requireValidCert = requireValidCert;
     ctxt->x509dnACL = x509dnACL;
     ctxt->isServer = isServer;
+    if (!isServer)
+        ctxt->sessionCacheID = g_strdup_printf("%s|%s",
+                                               NULLSTR_EMPTY(cacert),
+                                               NULLSTR_EMPTY(cert));
 
     PROBE(RPC_TLS_CONTEXT_NEW,
           "ctxt=%p cacert=%s cacrl=%s cert=%s key=%s sanityCheckCert=%d requireValidCert=%d isServer=%d",
@@ -955,6 +1004,10 @@ int virNetTLSContextReloadForServer(virNetTLSContext *ctxt,
 
     gnutls_certificate_free_credentials(x509credBak);
 
+    /* Don't let clients resume sessions established with the old
+     * credentials */
+    virNetTLSDatumFree(&ctxt->ticketKey);
+
     return 0;
 
  error:
@@ -1121,6 +1174,54 @@ static int virNetTLSContextValidCertificate(virNetTLSContext *ctxt,
     return -1;
 }
 
+/**
+ * virNetTLSContextSetSessionTicketRotation:
+ * @ctxt: server TLS context
+ * @seconds: ticket key lifetime, 0 to disable session tickets
+ *
+ * Let clients resume sessions established with @ctxt by means of
+ * session tickets, which saves them a full handshake on reconnect.
+ * The key tickets are encrypted with is replaced with a fresh one
+ * every @seconds, which also bounds the ticket lifetime.
+ */
+void virNetTLSContextSetSessionTicketRotation(virNetTLSContext *ctxt,
+                                              unsigned int seconds)
+{
+    VIR_LOCK_GUARD lock = virObjectLockGuard(ctxt);
+
+    ctxt->ticketKeyRotation = seconds;
+    if (seconds == 0)
+        virNetTLSDatumFree(&ctxt->ticketKey);
+}
+
+
+static int
+virNetTLSContextRefreshTicketKey(virNetTLSContext *ctxt)
+{
+    gint64 now = g_get_monotonic_time();
+    int err;
+
+    if (ctxt->ticketKey.data &&
+        now - ctxt->ticketKeyCreated <
+        (gint64) ctxt->ticketKeyRotation * G_USEC_PER_SEC)
+        return 0;
+
+    /* Sessions copy the key, so the old one can go right away */
+    virNetTLSDatumFree(&ctxt->ticketKey);
+
+    if ((err = gnutls_session_ticket_key_generate(&ctxt->ticketKey)) < 0) {
+        virReportError(VIR_ERR_SYSTEM_ERROR,
+                       _("Unable to generate TLS session ticket key: %s"),
+                       gnutls_strerror(err));
+        return -1;
+    }
+
+    ctxt->ticketKeyCreated = now;
+    VIR_DEBUG("ctxt=%p generated new session ticket key", ctxt);
+    return 0;
+}
+
+
 int virNetTLSContextCheckCertificate(virNetTLSContext *ctxt,
                                      virNetTLSSession *sess)
 {
@@ -1156,6 +1257,8 @@ void virNetTLSContextDispose(void *obj)
           "ctxt=%p", ctxt);
 
     g_free(ctxt->priority);
+    g_free(ctxt->sessionCacheID);
+    virNetTLSDatumFree(&ctxt->ticketKey);
     gnutls_dh_params_deinit(ctxt->dhParams);
     gnutls_certificate_free_credentials(ctxt->x509cred);
 }
@@ -1189,6 +1292,97 @@ virNetTLSSessionPull(void *opaque, void *buf, size_t len)
 }
 
 
+static bool
+virNetTLSSessionIsTLS13(virNetTLSSession *sess G_GNUC_UNUSED)
+{
+#if GNUTLS_VERSION_NUMBER >= 0x030603
+    return gnutls_protocol_get_version(sess->session) == GNUTLS_TLS1_3;
+#else
+    return false;
+#endif
+}
+
+
+static void
+virNetTLSSessionCacheStore(virNetTLSSession *sess)
+{
+    g_autofree gnutls_datum_t *data = g_new0(gnutls_datum_t, 1);
+    VIR_LOCK_GUARD lock = virLockGuardLock(&virNetTLSSessionCacheLock);
+
+    if (gnutls_session_get_data2(sess->session, data) < 0) {
+        VIR_DEBUG("Unable to get TLS session data for %s",
+                  sess->sessionCacheKey);
+        return;
+    }
+
+    if (!virNetTLSSessionCache)
+        virNetTLSSessionCache = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                                      g_free,
+                                                      virNetTLSSessionCacheEntryFree);
+
+    VIR_DEBUG("Caching TLS session data for %s", sess->sessionCacheKey);
+    g_hash_table_insert(virNetTLSSessionCache,
+                        g_strdup(sess->sessionCacheKey),
+                        g_steal_pointer(&data));
+}
+
+
+/*
+ * Invoked when the client receives a session ticket. With TLS 1.3
+ * tickets only arrive after the handshake has completed, earlier
+ * protocols send them as part of the handshake and the session is
+ * cached once it completes instead.
+ */
+static int
+virNetTLSSessionTicketHook(gnutls_session_t session,
+                           unsigned int htype G_GNUC_UNUSED,
+                           unsigned int when G_GNUC_UNUSED,
+                           unsigned int incoming G_GNUC_UNUSED,
+                           const gnutls_datum_t *msg G_GNUC_UNUSED)
+{
+    virNetTLSSession *sess = gnutls_transport_get_ptr(session);
+
+    if (sess->sessionCacheKey && sess->handshakeComplete)
+        virNetTLSSessionCacheStore(sess);
+
+    return 0;
+}
+
+
+static void
+virNetTLSSessionSetupResume(virNetTLSSession *sess,
+                            virNetTLSContext *ctxt)
+{
+    VIR_LOCK_GUARD lock = virLockGuardLock(&virNetTLSSessionCacheLock);
+    gnutls_datum_t *data = NULL;
+    int err;
+
+    sess->sessionCacheKey = g_strdup_printf("%s|%s", ctxt->sessionCacheID,
+                                            sess->hostname);
+
+    gnutls_handshake_set_hook_function(sess->session,
+                                       GNUTLS_HANDSHAKE_NEW_SESSION_TICKET,
+                                       GNUTLS_HOOK_POST,
+                                       virNetTLSSessionTicketHook);
+
+    if (virNetTLSSessionCache)
+        data = g_hash_table_lookup(virNetTLSSessionCache,
+                                   sess->sessionCacheKey);
+    if (!data)
+        return;
+
+    if ((err = gnutls_session_set_data(sess->session,
+                                       data->data, data->size)) < 0) {
+        VIR_DEBUG("Dropping unusable TLS session data for %s: %s",
+                  sess->sessionCacheKey, gnutls_strerror(err));
+        g_hash_table_remove(virNetTLSSessionCache, sess->sessionCacheKey);
+        return;
+    }
+
+    VIR_DEBUG("Trying to resume TLS session for %s", sess->sessionCacheKey);
+}
+
+
 virNetTLSSession *virNetTLSSessionNew(virNetTLSContext *ctxt,
                                         const char *hostname)
 {
@@ -1238,7 +1432,28 @@ virNetTLSSession *virNetTLSSessionNew(virNetTLSContext *ctxt,
     /* request client certificate if any.
      */
     if (ctxt->isServer) {
+        VIR_LOCK_GUARD lock = virObjectLockGuard(ctxt);
+
         gnutls_certificate_server_set_request(sess->session, GNUTLS_CERT_REQUEST);
+
+        /* let clients resume sessions with a ticket */
+        if (ctxt->ticketKeyRotation > 0) {
+            if (virNetTLSContextRefreshTicketKey(ctxt) < 0)
+                goto error;
+
+            if ((err = gnutls_session_ticket_enable_server(sess->session,
+                                                           &ctxt->ticketKey)) < 0) {
+                virReportError(VIR_ERR_SYSTEM_ERROR,
+                               _("Failed to enable TLS session tickets: %s"),
+                               gnutls_strerror(err));
+                goto error;
+            }
+
+            gnutls_db_set_cache_expiration(sess->session,
+                                           ctxt->ticketKeyRotation);
+        }
+    } else if (hostname) {
+        virNetTLSSessionSetupResume(sess, ctxt);
     }
 
     gnutls_transport_set_ptr(sess->session, sess);
@@ -1346,7 +1561,10 @@ int virNetTLSSessionHandshake(virNetTLSSession *sess)
     VIR_DEBUG("Ret=%d", ret);
     if (ret == 0) {
         sess->handshakeComplete = true;
-        VIR_DEBUG("Handshake is complete");
+        VIR_DEBUG("Handshake is complete resumed=%d",
+                  gnutls_session_is_resumed(sess->session));
+        if (sess->sessionCacheKey && !virNetTLSSessionIsTLS13(sess))
+            virNetTLSSessionCacheStore(sess);
         goto cleanup;
     }
     if (ret == GNUTLS_E_INTERRUPTED || ret == GNUTLS_E_AGAIN) {
@@ -1384,6 +1602,14 @@ virNetTLSSessionGetHandshakeStatus(virNetTLSSession *sess)
     return ret;
 }
 
+bool virNetTLSSessionIsResumed(virNetTLSSession *sess)
+{
+    VIR_LOCK_GUARD lock = virObjectLockGuard(sess);
+
+    return sess->handshakeComplete &&
+        gnutls_session_is_resumed(sess->session) != 0;
+}
+
 int virNetTLSSessionGetKeySize(virNetTLSSession *sess)
 {
     gnutls_cipher_algorithm_t cipher;
@@ -1424,6 +1650,7 @@ void virNetTLSSessionDispose(void *obj)
 
     g_free(sess->x509dname);
     g_free(sess->hostname);
+    g_free(sess->sessionCacheKey);
     gnutls_deinit(sess->session);
 }
 
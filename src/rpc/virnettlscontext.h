@@ -66,6 +66,9 @@ int virNetTLSContextReloadForServer(virNetTLSContext *ctxt,
 int virNetTLSContextCheckCertificate(virNetTLSContext *ctxt,
                                      virNetTLSSession *sess);
 
+void virNetTLSContextSetSessionTicketRotation(virNetTLSContext *ctxt,
+                                              unsigned int seconds);
+
 
 typedef ssize_t (*virNetTLSSessionWriteFunc)(const char *buf, size_t len,
                                              void *opaque);
@@ -96,6 +99,8 @@ typedef enum {
 virNetTLSSessionHandshakeStatus
 virNetTLSSessionGetHandshakeStatus(virNetTLSSession *sess);
 
+bool virNetTLSSessionIsResumed(virNetTLSSession *sess);
+
 int virNetTLSSessionGetKeySize(virNetTLSSession *sess);
 
 const char *virNetTLSSessionGetX509DName(virNetTLSSession *sess);
@@ -78,8 +78,8 @@ secretObjFromSecret(virSecretPtr secret)
     virSecretObj *obj;
     char uuidstr[VIR_UUID_STRING_BUFLEN];
 
-    virUUIDFormat(secret->uuid, uuidstr);
-    if (!(obj = virSecretObjListFindByUUID(driver->secrets, uuidstr))) {
+    if (!(obj = virSecretObjListFindByUUID(driver->secrets, secret->uuid))) {
+        virUUIDFormat(secret->uuid, uuidstr);
         virReportError(VIR_ERR_NO_SECRET,
                        _("no secret with matching uuid '%s'"), uuidstr);
         return NULL;
@@ -142,8 +142,8 @@ secretLookupByUUID(virConnectPtr conn,
     virSecretDef *def;
     char uuidstr[VIR_UUID_STRING_BUFLEN];
 
-    virUUIDFormat(uuid, uuidstr);
-    if (!(obj = virSecretObjListFindByUUID(driver->secrets, uuidstr))) {
+    if (!(obj = virSecretObjListFindByUUID(driver->secrets, uuid))) {
+        virUUIDFormat(uuid, uuidstr);
         virReportError(VIR_ERR_NO_SECRET,
                        _("no secret with matching uuid '%s'"), uuidstr);
         goto cleanup;
@@ -699,6 +699,7 @@ static virConnectDriver secretConnectDriver = {
 
 static virStateDriver stateDriver = {
     .name = "secret",
+    .dependencies = (const char *const []) { NULL },
     .stateInitialize = secretStateInitialize,
     .stateCleanup = secretStateCleanup,
     .stateReload = secretStateReload,
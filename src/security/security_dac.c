@@ -145,6 +145,63 @@ virSecurityDACChownListFree(void *opaque)
 G_DEFINE_AUTOPTR_CLEANUP_FUNC(virSecurityDACChownList, virSecurityDACChownListFree);
 
 
+/**
+ * virSecurityDACChownListSplit:
+ * @list: transaction
+ *
+ * A transaction which only restores labels doesn't need to be run in
+ * order, because failed restores are not rolled back. Such a
+ * transaction is split into smaller ones which can run at the same
+ * time, and the items of @list are moved over to them. All the items
+ * for the same path end up in the same transaction.
+ *
+ * Returns the transactions, or NULL if @list is to be run whole.
+ */
+static GPtrArray *
+virSecurityDACChownListSplit(virSecurityDACChownList *list)
+{
+    g_autoptr(GPtrArray) chunks = NULL;
+    size_t nchunks = virSecurityRestoreChunks(list->nItems);
+    size_t i;
+
+    if (nchunks < 2)
+        return NULL;
+
+    for (i = 0; i < list->nItems; i++) {
+        if (!list->items[i]->restore)
+            return NULL;
+    }
+
+    chunks = g_ptr_array_new_with_free_func(virSecurityDACChownListFree);
+
+    for (i = 0; i < nchunks; i++) {
+        virSecurityDACChownList *chunk = g_new0(virSecurityDACChownList, 1);
+
+        chunk->manager = virObjectRef(list->manager);
+        chunk->lock = list->lock;
+        g_ptr_array_add(chunks, chunk);
+    }
+
+    for (i = 0; i < list->nItems; i++) {
+        virSecurityDACChownItem *item = g_steal_pointer(&list->items[i]);
+        size_t idx = virSecurityRestoreChunkIndex(item->path, nchunks);
+        virSecurityDACChownList *chunk = g_ptr_array_index(chunks, idx);
+
+        VIR_APPEND_ELEMENT(chunk->items, chunk->nItems, item);
+    }
+    list->nItems = 0;
+
+    for (i = chunks->len; i > 0; i--) {
+        virSecurityDACChownList *chunk = g_ptr_array_index(chunks, i - 1);
+
+        if (chunk->nItems == 0)
+            g_ptr_array_remove_index(chunks, i - 1);
+    }
+
+    return g_steal_pointer(&chunks);
+}
+
+
 /**
  * virSecurityDACTransactionAppend:
  * @path: Path to chown
@@ -586,7 +643,10 @@ virSecurityDACTransactionStart(virSecurityManager *mgr)
  * then the transaction is performed in the namespace of the caller.
  *
  * If @lock is true then all the paths that transaction would
- * touch are locked before and unlocked after it is done so.
+ * touch are locked before and unlocked after it is done so. A
+ * transaction which only restores labels in the namespace of the
+ * caller is then split and run in several processes at once, because
+ * remembered owners cost a few XATTR calls per path.
  *
  * Note that the transaction is also freed, therefore new one has to be
  * started after successful return from this function. Also it is
@@ -632,10 +692,16 @@ virSecurityDACTransactionCommit(virSecurityManager *mgr G_GNUC_UNUSED,
     }
 
     if (pid == -1) {
-        if (lock)
-            rc = virProcessRunInFork(virSecurityDACTransactionRun, list);
-        else
+        if (lock) {
+            g_autoptr(GPtrArray) chunks = virSecurityDACChownListSplit(list);
+
+            if (chunks)
+                rc = virSecurityRunInForks(virSecurityDACTransactionRun, chunks);
+            else
+                rc = virProcessRunInFork(virSecurityDACTransactionRun, list);
+        } else {
             rc = virSecurityDACTransactionRun(pid, list);
+        }
     }
 
     if (rc < 0)
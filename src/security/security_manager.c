@@ -31,6 +31,7 @@
 #include "virobject.h"
 #include "virlog.h"
 #include "virfile.h"
+#include "virprobe.h"
 
 #define VIR_FROM_THIS VIR_FROM_SECURITY
 
@@ -291,11 +292,21 @@ virSecurityManagerTransactionCommit(virSecurityManager *mgr,
                                     bool lock)
 {
     VIR_LOCK_GUARD lockguard = virObjectLockGuard(mgr);
+    gint64 start;
+    int ret;
 
     if (!mgr->drv->transactionCommit)
         return 0;
 
-    return mgr->drv->transactionCommit(mgr, pid, lock);
+    start = g_get_monotonic_time();
+    ret = mgr->drv->transactionCommit(mgr, pid, lock);
+
+    PROBE(SECURITY_TRANSACTION_COMMIT,
+          "driver=%s pid=%lld lock=%d ret=%d usec=%llu",
+          mgr->drv->name, (long long) pid, lock, ret,
+          (unsigned long long) (g_get_monotonic_time() - start));
+
+    return ret;
 }
 
 
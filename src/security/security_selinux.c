@@ -147,6 +147,63 @@ virSecuritySELinuxContextListFree(void *opaque)
 }
 
 
+/**
+ * virSecuritySELinuxContextListSplit:
+ * @list: transaction
+ *
+ * A transaction which only restores labels doesn't need to be run in
+ * order, because failed restores are not rolled back. Such a
+ * transaction is split into smaller ones which can run at the same
+ * time, and the items of @list are moved over to them. All the items
+ * for the same path end up in the same transaction.
+ *
+ * Returns the transactions, or NULL if @list is to be run whole.
+ */
+static GPtrArray *
+virSecuritySELinuxContextListSplit(virSecuritySELinuxContextList *list)
+{
+    g_autoptr(GPtrArray) chunks = NULL;
+    size_t nchunks = virSecurityRestoreChunks(list->nItems);
+    size_t i;
+
+    if (nchunks < 2)
+        return NULL;
+
+    for (i = 0; i < list->nItems; i++) {
+        if (!list->items[i]->restore)
+            return NULL;
+    }
+
+    chunks = g_ptr_array_new_with_free_func(virSecuritySELinuxContextListFree);
+
+    for (i = 0; i < nchunks; i++) {
+        virSecuritySELinuxContextList *chunk = g_new0(virSecuritySELinuxContextList, 1);
+
+        chunk->manager = virObjectRef(list->manager);
+        chunk->lock = list->lock;
+        g_ptr_array_add(chunks, chunk);
+    }
+
+    for (i = 0; i < list->nItems; i++) {
+        virSecuritySELinuxContextItem *item = g_steal_pointer(&list->items[i]);
+        size_t idx = virSecurityRestoreChunkIndex(item->path, nchunks);
+        virSecuritySELinuxContextList *chunk = g_ptr_array_index(chunks, idx);
+
+        VIR_APPEND_ELEMENT(chunk->items, chunk->nItems, item);
+    }
+    list->nItems = 0;
+
+    for (i = chunks->len; i > 0; i--) {
+        virSecuritySELinuxContextList *chunk = g_ptr_array_index(chunks, i - 1);
+
+        if (chunk->nItems == 0)
+            g_ptr_array_remove_index(chunks, i - 1);
+    }
+
+    return g_steal_pointer(&chunks);
+}
+
+
 /**
  * virSecuritySELinuxTransactionAppend:
  * @path: Path to chown
@@ -1107,7 +1164,9 @@ virSecuritySELinuxTransactionStart(virSecurityManager *mgr)
  * caller.
  *
  * If @lock is true then all the paths that transaction would
- * touch are locked before and unlocked after it is done so.
+ * touch are locked before and unlocked after it is done so. A
+ * transaction which only restores labels in the namespace of the
+ * caller is then split and run in several processes at once.
  *
  * Note that the transaction is also freed, therefore new one has to be
  * started after successful return from this function. Also it is
@@ -1154,10 +1213,16 @@ virSecuritySELinuxTransactionCommit(virSecurityManager *mgr G_GNUC_UNUSED,
     }
 
     if (pid == -1) {
-        if (lock)
-            rc = virProcessRunInFork(virSecuritySELinuxTransactionRun, list);
-        else
+        if (lock) {
+            g_autoptr(GPtrArray) chunks = virSecuritySELinuxContextListSplit(list);
+
+            if (chunks)
+                rc = virSecurityRunInForks(virSecuritySELinuxTransactionRun, chunks);
+            else
+                rc = virProcessRunInFork(virSecuritySELinuxTransactionRun, list);
+        } else {
             rc = virSecuritySELinuxTransactionRun(pid, list);
+        }
     }
 
     if (rc < 0)
@@ -1353,7 +1418,19 @@ virSecuritySELinuxSetFilecon(virSecurityManager *mgr,
         }
     }
 
-    rc = virSecuritySELinuxSetFileconImpl(path, tcon, privileged);
+    /* Images shared by many domains, like the read-only layers of backing
+     * chains, usually have the right context already. Reading it is much
+     * cheaper than setting it again. */
+    if (!remember && getfilecon_raw(path, &econ) < 0)
+        econ = NULL;
+
+    if (econ && STREQ(econ, tcon)) {
+        VIR_DEBUG("SELinux context of '%s' is already '%s'", path, tcon);
+        rc = 0;
+    } else {
+        rc = virSecuritySELinuxSetFileconImpl(path, tcon, privileged);
+    }
+
     if (rc < 0)
         goto cleanup;
 
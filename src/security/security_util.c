@@ -25,6 +25,7 @@
 #include "virlog.h"
 #include "viruuid.h"
 #include "virhostuptime.h"
+#include "virthread.h"
 
 #include "security_util.h"
 
@@ -32,6 +33,12 @@
 
 VIR_LOG_INIT("security.security_util");
 
+/* Restoring labels of a domain is split into at most this many
+ * transactions running at the same time, each restoring at least
+ * VIR_SECURITY_RESTORE_CHUNK_MIN paths to be worth a fork(). */
+#define VIR_SECURITY_RESTORE_CHUNKS_MAX 4
+#define VIR_SECURITY_RESTORE_CHUNK_MIN 4
+
 /* There are four namespaces available on Linux (xattr(7)):
  *
  *  user - can be modified by anybody,
@@ -545,3 +552,125 @@ virSecurityMoveRememberedLabel(const char *name,
 
     return 0;
 }
+
+
+/**
+ * virSecurityRestoreChunks:
+ * @nitems: number of paths a transaction restores
+ *
+ * Returns the number of transactions a transaction restoring labels
+ * of @nitems paths is worth splitting into, 1 if it should be kept
+ * whole.
+ */
+size_t
+virSecurityRestoreChunks(size_t nitems)
+{
+    size_t nchunks = nitems / VIR_SECURITY_RESTORE_CHUNK_MIN;
+
+    return MAX(1, MIN(nchunks, VIR_SECURITY_RESTORE_CHUNKS_MAX));
+}
+
+
+/**
+ * virSecurityRestoreChunkIndex:
+ * @path: path to restore
+ * @nchunks: number of transactions returned by virSecurityRestoreChunks()
+ *
+ * Picks the transaction restoring label of @path, so that all the
+ * restores of the same path happen in one transaction, in order.
+ *
+ * Returns index of the transaction.
+ */
+size_t
+virSecurityRestoreChunkIndex(const char *path,
+                             size_t nchunks)
+{
+    if (!path)
+        return 0;
+
+    return g_str_hash(path) % nchunks;
+}
+
+
+struct virSecurityRunInForksData {
+    virProcessForkCallback cb;
+    void *opaque;
+    int rc;
+    virErrorPtr err;
+};
+
+
+static void
+virSecurityRunInForksWorker(void *opaque)
+{
+    struct virSecurityRunInForksData *data = opaque;
+
+    if ((data->rc = virProcessRunInFork(data->cb, data->opaque)) < 0)
+        virErrorPreserveLast(&data->err);
+}
+
+
+/**
+ * virSecurityRunInForks:
+ * @cb: callback to run
+ * @opaques: data to run @cb with
+ *
+ * Runs @cb with each of @opaques in its own child process, all of
+ * them at the same time. The children are forked from threads
+ * created just for that, so that nothing but @cb runs in them, just
+ * like with virProcessRunInFork().
+ *
+ * Returns: 0 on success,
+ *         -1 if any of the callbacks failed, with the first error
+ *            reported.
+ */
+int
+virSecurityRunInForks(virProcessForkCallback cb,
+                      GPtrArray *opaques)
+{
+    g_autofree struct virSecurityRunInForksData *data = NULL;
+    g_autofree virThread *threads = NULL;
+    g_autofree bool *started = NULL;
+    virErrorPtr err = NULL;
+    size_t i;
+    int ret = 0;
+
+    data = g_new0(struct virSecurityRunInForksData, opaques->len);
+    threads = g_new0(virThread, opaques->len);
+    started = g_new0(bool, opaques->len);
+
+    for (i = 0; i < opaques->len; i++) {
+        data[i].cb = cb;
+        data[i].opaque = g_ptr_array_index(opaques, i);
+
+        /* The first one is run by the caller, as are those which
+         * can't get a thread */
+        if (i > 0 &&
+            virThreadCreateFull(&threads[i], true,
+                                virSecurityRunInForksWorker,
+                                "sec-restore", false, &data[i]) == 0)
+            started[i] = true;
+    }
+
+    for (i = 0; i < opaques->len; i++) {
+        if (!started[i])
+            virSecurityRunInForksWorker(&data[i]);
+    }
+
+    for (i = 0; i < opaques->len; i++) {
+        if (started[i])
+            virThreadJoin(&threads[i]);
+
+        if (data[i].rc < 0) {
+            ret = -1;
+            if (!err)
+                err = g_steal_pointer(&data[i].err);
+        }
+        virFreeError(data[i].err);
+    }
+
+    if (ret < 0)
+        virErrorRestore(&err);
+
+    return ret;
+}
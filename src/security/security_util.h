@@ -18,6 +18,8 @@
 
 #pragma once
 
+#include "virprocess.h"
+
 int
 virSecurityGetRememberedLabel(const char *name,
                               const char *path,
@@ -35,3 +37,14 @@ virSecurityMoveRememberedLabel(const char *name,
 
 bool
 virSecurityXATTRNamespaceDefined(void);
+
+size_t
+virSecurityRestoreChunks(size_t nitems);
+
+size_t
+virSecurityRestoreChunkIndex(const char *path,
+                             size_t nchunks);
+
+int
+virSecurityRunInForks(virProcessForkCallback cb,
+                      GPtrArray *opaques);
@@ -212,20 +212,16 @@ virStorageBackendGlusterSetMetadata(virStorageBackendGlusterState *state,
 
 
 /* Populate *volptr for the given name and stat information, or leave
- * it NULL if the entry should be skipped (such as ".").  Return 0 on
- * success, -1 on failure. */
+ * it NULL if the entry should be skipped (such as ".").  The image
+ * header is read later by virStorageBackendGlusterProbeVol.  Return 0
+ * on success, -1 on failure. */
 static int
 virStorageBackendGlusterRefreshVol(virStorageBackendGlusterState *state,
                                    const char *name,
                                    struct stat *st,
                                    virStorageVolDef **volptr)
 {
-    int ret = -1;
-    glfs_fd_t *fd = NULL;
-    ssize_t len;
     g_autoptr(virStorageVolDef) vol = NULL;
-    g_autoptr(virStorageSource) meta = NULL;
-    g_autofree char *header = NULL;
 
     *volptr = NULL;
 
@@ -237,42 +233,61 @@ virStorageBackendGlusterRefreshVol(virStorageBackendGlusterState *state,
     if (S_ISLNK(st->st_mode) && glfs_stat(state->vol, name, st) < 0) {
         if (errno == ENOENT || errno == ELOOP) {
             VIR_WARN("ignoring dangling symlink '%s'", name);
-            ret = 0;
-        } else {
-            virReportSystemError(errno, _("cannot stat '%s'"), name);
+            return 0;
         }
-        return ret;
+
+        virReportSystemError(errno, _("cannot stat '%s'"), name);
+        return -1;
     }
 
     vol = g_new0(virStorageVolDef, 1);
 
     if (virStorageBackendUpdateVolTargetInfoFD(&vol->target, -1, st) < 0)
-        goto cleanup;
+        return -1;
 
     if (virStorageBackendGlusterSetMetadata(state, vol, name) < 0)
-        goto cleanup;
+        return -1;
 
     if (S_ISDIR(st->st_mode)) {
         vol->type = VIR_STORAGE_VOL_NETDIR;
         vol->target.format = VIR_STORAGE_FILE_DIR;
-        *volptr = g_steal_pointer(&vol);
-        ret = 0;
-        goto cleanup;
     }
 
+    *volptr = g_steal_pointer(&vol);
+    return 0;
+}
+
+
+/* Fill in the format and image details of @vol from its header.  Runs
+ * in parallel for the volumes of a pool, so it must not modify the
+ * shared state.  Return 0 on success, -1 on failure. */
+static int
+virStorageBackendGlusterProbeVol(virStorageVolDef *vol,
+                                 void *opaque)
+{
+    virStorageBackendGlusterState *state = opaque;
+    int ret = -1;
+    glfs_fd_t *fd = NULL;
+    ssize_t len;
+    g_autoptr(virStorageSource) meta = NULL;
+    g_autofree char *header = NULL;
+
+    if (vol->type == VIR_STORAGE_VOL_NETDIR)
+        return 0;
+
     /* No need to worry about O_NONBLOCK - gluster doesn't allow creation
      * of fifos, so there's nothing it would protect us from. */
-    if (!(fd = glfs_open(state->vol, name, O_RDONLY | O_NOCTTY))) {
+    if (!(fd = glfs_open(state->vol, vol->name, O_RDONLY | O_NOCTTY))) {
         /* A dangling symlink now implies a TOCTTOU race; report it.  */
-        virReportSystemError(errno, _("cannot open volume '%s'"), name);
+        virReportSystemError(errno, _("cannot open volume '%s'"), vol->name);
         goto cleanup;
     }
 
-    if ((len = virStorageBackendGlusterRead(fd, name, VIR_STORAGE_MAX_HEADER,
+    if ((len = virStorageBackendGlusterRead(fd, vol->name, VIR_STORAGE_MAX_HEADER,
                                             &header)) < 0)
         goto cleanup;
 
-    if (!(meta = virStorageSourceGetMetadataFromBuf(name, header, len,
+    if (!(meta = virStorageSourceGetMetadataFromBuf(vol->name, header, len,
                                                     VIR_STORAGE_FILE_AUTO)))
         goto cleanup;
 
@@ -295,7 +310,6 @@ virStorageBackendGlusterRefreshVol(virStorageBackendGlusterState *state,
     vol->target.features = g_steal_pointer(&meta->features);
     vol->target.compat = g_steal_pointer(&meta->compat);
 
-    *volptr = g_steal_pointer(&vol);
     ret = 0;
  cleanup:
     if (fd)
@@ -319,6 +333,9 @@ virStorageBackendGlusterRefreshPool(virStoragePoolObj *pool)
     glfs_fd_t *dir = NULL;
     struct stat st;
     struct statvfs sb;
+    g_autoptr(GPtrArray) vols = NULL;
+
+    vols = g_ptr_array_new_with_free_func((GDestroyNotify) virStorageVolDefFree);
 
     if (!(state = virStorageBackendGlusterOpen(pool)))
         goto cleanup;
@@ -351,8 +368,8 @@ virStorageBackendGlusterRefreshPool(virStoragePoolObj *pool)
 
         if (okay < 0)
             goto cleanup;
-        if (vol && virStoragePoolObjAddVol(pool, vol) < 0)
-            goto cleanup;
+        if (vol)
+            g_ptr_array_add(vols, vol);
     }
     if (errno) {
         virReportSystemError(errno, _("failed to read directory '%s' in '%s'"),
@@ -360,6 +377,10 @@ virStorageBackendGlusterRefreshPool(virStoragePoolObj *pool)
         goto cleanup;
     }
 
+    if (virStorageBackendProbeVols(pool, vols,
+                                   virStorageBackendGlusterProbeVol, state) < 0)
+        goto cleanup;
+
     if (glfs_statvfs(state->vol, state->dir, &sb) < 0) {
         virReportSystemError(errno, _("cannot statvfs path '%s' in '%s'"),
                              state->dir, state->volname);
@@ -20,6 +20,7 @@
 
 #include <config.h>
 
+#include <poll.h>
 #include <iscsi/iscsi.h>
 #include <iscsi/scsi-lowlevel.h>
 
@@ -300,33 +301,228 @@ virISCSIDirectGetVolumeCapacity(struct iscsi_context *iscsi,
     return ret;
 }
 
+typedef struct _virISCSIDirectLun virISCSIDirectLun;
+struct _virISCSIDirectLun {
+    int lun;
+    bool skip; /* no command is sent to this LUN */
+    uint32_t block_size;
+    uint64_t nb_block;
+    size_t *pending;
+    int status;
+    struct scsi_task *task; /* the last command sent to the LUN */
+};
+
+typedef struct scsi_task *(*virISCSIDirectLunCommand)(struct iscsi_context *iscsi,
+                                                      int lun,
+                                                      iscsi_command_cb cb,
+                                                      void *private_data);
+
+static void
+virISCSIDirectLunCommandDone(struct iscsi_context *iscsi G_GNUC_UNUSED,
+                             int status,
+                             void *command_data G_GNUC_UNUSED,
+                             void *private_data)
+{
+    virISCSIDirectLun *lun = private_data;
+
+    lun->status = status;
+    (*lun->pending)--;
+}
+
+static struct scsi_task *
+virISCSIDirectInquiryTask(struct iscsi_context *iscsi,
+                          int lun,
+                          iscsi_command_cb cb,
+                          void *private_data)
+{
+    return iscsi_inquiry_task(iscsi, lun, 0, 0, 64, cb, private_data);
+}
+
+static void
+virISCSIDirectLunsClear(virISCSIDirectLun *luns,
+                        size_t nluns)
+{
+    size_t i;
+
+    for (i = 0; i < nluns; i++)
+        g_clear_pointer(&luns[i].task, scsi_free_scsi_task);
+}
+
+/*
+ * Sends @command to all @luns which are not skipped at once and waits for
+ * all of them to complete, so that a refresh takes as long as the slowest
+ * LUN rather than the sum of all of them. The replies are stored in @luns
+ * for the caller to check, and freed by virISCSIDirectLunsClear.
+ */
+static int
+virISCSIDirectLunsRun(struct iscsi_context *iscsi,
+                      virISCSIDirectLun *luns,
+                      size_t nluns,
+                      virISCSIDirectLunCommand command,
+                      const char *name)
+{
+    size_t pending = 0;
+    size_t i;
+
+    virISCSIDirectLunsClear(luns, nluns);
+
+    for (i = 0; i < nluns; i++) {
+        if (luns[i].skip)
+            continue;
+
+        luns[i].pending = &pending;
+        luns[i].status = SCSI_STATUS_ERROR;
+        if (!(luns[i].task = command(iscsi, luns[i].lun,
+                                     virISCSIDirectLunCommandDone,
+                                     &luns[i]))) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Failed to send %s command: %s"),
+                           name, iscsi_get_error(iscsi));
+            goto error;
+        }
+        pending++;
+    }
+
+    while (pending > 0) {
+        struct pollfd pfd = {
+            .fd = iscsi_get_fd(iscsi),
+            .events = iscsi_which_events(iscsi),
+        };
+
+        /* wake up regularly for libiscsi to handle timeouts */
+        if (poll(&pfd, 1, 1000) < 0) {
+            if (errno == EINTR)
+                continue;
+
+            virReportSystemError(errno, "%s",
+                                 _("Failed to poll iscsi connection"));
+            goto error;
+        }
+
+        if (iscsi_service(iscsi, pfd.revents) < 0) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Failed to process %s replies: %s"),
+                           name, iscsi_get_error(iscsi));
+            goto error;
+        }
+    }
+
+    return 0;
+
+ error:
+    /* don't let libiscsi complete the commands after @luns are gone */
+    if (pending > 0)
+        iscsi_scsi_cancel_all_tasks(iscsi);
+    virISCSIDirectLunsClear(luns, nluns);
+    return -1;
+}
+
+static int
+virISCSIDirectProbeLuns(struct iscsi_context *iscsi,
+                        virISCSIDirectLun *luns,
+                        size_t nluns)
+{
+    size_t i;
+
+    if (virISCSIDirectLunsRun(iscsi, luns, nluns,
+                              iscsi_testunitready_task, "testunitready") < 0)
+        return -1;
+
+    for (i = 0; i < nluns; i++) {
+        struct scsi_task *task = luns[i].task;
+
+        /* keep retrying LUNs which were just reset the slow way */
+        if (luns[i].status == SCSI_STATUS_CHECK_CONDITION &&
+            task->sense.key == SCSI_SENSE_UNIT_ATTENTION &&
+            task->sense.ascq == SCSI_SENSE_ASCQ_BUS_RESET) {
+            if (virISCSIDirectTestUnitReady(iscsi, luns[i].lun) < 0)
+                return -1;
+            continue;
+        }
+
+        if (luns[i].status != SCSI_STATUS_GOOD) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Failed testunitready: %s"),
+                           iscsi_get_error(iscsi));
+            return -1;
+        }
+    }
+
+    if (virISCSIDirectLunsRun(iscsi, luns, nluns,
+                              virISCSIDirectInquiryTask, "inquiry") < 0)
+        return -1;
+
+    for (i = 0; i < nluns; i++) {
+        struct scsi_inquiry_standard *inq = NULL;
+
+        if (luns[i].status != SCSI_STATUS_GOOD) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Failed to send inquiry command: %s"),
+                           iscsi_get_error(iscsi));
+            return -1;
+        }
+
+        if (!(inq = scsi_datain_unmarshall(luns[i].task))) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Failed to unmarshall reply: %s"),
+                           iscsi_get_error(iscsi));
+            return -1;
+        }
+
+        /* only direct access devices have a capacity */
+        if (inq->device_type != SCSI_INQUIRY_PERIPHERAL_DEVICE_TYPE_DIRECT_ACCESS)
+            luns[i].skip = true;
+    }
+
+    if (virISCSIDirectLunsRun(iscsi, luns, nluns,
+                              iscsi_readcapacity16_task, "readcapacity16") < 0)
+        return -1;
+
+    for (i = 0; i < nluns; i++) {
+        struct scsi_readcapacity16 *rc16 = NULL;
+
+        if (luns[i].skip)
+            continue;
+
+        if (luns[i].status != SCSI_STATUS_GOOD) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Failed to get capacity of lun: %s"),
+                           iscsi_get_error(iscsi));
+            return -1;
+        }
+
+        if (!(rc16 = scsi_datain_unmarshall(luns[i].task))) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Failed to unmarshall reply: %s"),
+                           iscsi_get_error(iscsi));
+            return -1;
+        }
+
+        luns[i].block_size = rc16->block_length;
+        luns[i].nb_block = rc16->returned_lba;
+    }
+
+    return 0;
+}
+
 static int
 virISCSIDirectRefreshVol(virStoragePoolObj *pool,
-                         struct iscsi_context *iscsi,
-                         int lun,
+                         virISCSIDirectLun *lun,
                          char *portal)
 {
     virStoragePoolDef *def = virStoragePoolObjGetDef(pool);
-    uint32_t block_size = 0;
-    uint64_t nb_block = 0;
     g_autoptr(virStorageVolDef) vol = NULL;
 
-    if (virISCSIDirectTestUnitReady(iscsi, lun) < 0)
-        return -1;
-
     vol = g_new0(virStorageVolDef, 1);
 
     vol->type = VIR_STORAGE_VOL_NETWORK;
 
-    if (virISCSIDirectGetVolumeCapacity(iscsi, lun, &block_size, &nb_block) < 0)
-        return -1;
-
-    vol->target.capacity = block_size * nb_block;
-    vol->target.allocation = block_size * nb_block;
+    vol->target.capacity = lun->block_size * lun->nb_block;
+    vol->target.allocation = lun->block_size * lun->nb_block;
     def->capacity += vol->target.capacity;
     def->allocation += vol->target.allocation;
 
-    if (virISCSIDirectSetVolumeAttributes(pool, vol, lun, portal) < 0)
+    if (virISCSIDirectSetVolumeAttributes(pool, vol, lun->lun, portal) < 0)
         return -1;
 
     if (virStoragePoolObjAddVol(pool, vol) < 0)
@@ -344,6 +540,7 @@ virISCSIDirectReportLuns(virStoragePoolObj *pool,
     virStoragePoolDef *def = virStoragePoolObjGetDef(pool);
     struct scsi_task *task = NULL;
     struct scsi_reportluns_list *list = NULL;
+    g_autofree virISCSIDirectLun *luns = NULL;
     int full_size;
     size_t i;
     int ret = -1;
@@ -374,15 +571,24 @@ virISCSIDirectReportLuns(virStoragePoolObj *pool,
         goto cleanup;
     }
 
+    luns = g_new0(virISCSIDirectLun, list->num);
+    for (i = 0; i < list->num; i++)
+        luns[i].lun = list->luns[i];
+
+    if (virISCSIDirectProbeLuns(iscsi, luns, list->num) < 0)
+        goto cleanup;
+
     def->capacity = 0;
     def->allocation = 0;
     for (i = 0; i < list->num; i++) {
-        if (virISCSIDirectRefreshVol(pool, iscsi, list->luns[i], portal) < 0)
+        if (virISCSIDirectRefreshVol(pool, &luns[i], portal) < 0)
             goto cleanup;
     }
 
     ret = 0;
  cleanup:
+    if (luns)
+        virISCSIDirectLunsClear(luns, list->num);
     scsi_free_scsi_task(task);
     return ret;
 }
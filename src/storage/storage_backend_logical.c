@@ -112,6 +112,7 @@ virStorageBackendLogicalInitializeDevice(const char *path)
 struct virStorageBackendLogicalPoolVolData {
     virStoragePoolObj *pool;
     virStorageVolDef *vol;
+    bool haveVGSize; /* volume group size was reported along with the LVs */
 };
 
 static int
@@ -340,6 +341,100 @@ virStorageBackendLogicalMakeVol(char **const groups,
            VIR_STORAGE_VOL_LOGICAL_LV_ATTR_REGEX \
            VIR_STORAGE_VOL_LOGICAL_SUFFIX_REGEX
 
+/* The lv_attr field isn't the last one when the sizes of the volume group
+ * are reported in the same lvs invocation */
+#define VIR_STORAGE_VOL_LOGICAL_VG_LV_ATTR_REGEX "([^#\\s]+)#"
+#define VIR_STORAGE_VOL_LOGICAL_VG_SIZE_REGEX "([0-9]+)#"
+#define VIR_STORAGE_VOL_LOGICAL_VG_FREE_REGEX "([0-9]+)#"
+
+#define VIR_STORAGE_VOL_LOGICAL_VG_REGEX_COUNT 12
+#define VIR_STORAGE_VOL_LOGICAL_VG_REGEX \
+           VIR_STORAGE_VOL_LOGICAL_PREFIX_REGEX \
+           VIR_STORAGE_VOL_LOGICAL_LV_NAME_REGEX \
+           VIR_STORAGE_VOL_LOGICAL_ORIGIN_REGEX \
+           VIR_STORAGE_VOL_LOGICAL_UUID_REGEX \
+           VIR_STORAGE_VOL_LOGICAL_DEVICES_REGEX \
+           VIR_STORAGE_VOL_LOGICAL_SEGTYPE_REGEX \
+           VIR_STORAGE_VOL_LOGICAL_STRIPES_REGEX \
+           VIR_STORAGE_VOL_LOGICAL_SEG_SIZE_REGEX \
+           VIR_STORAGE_VOL_LOGICAL_VG_EXTENT_SIZE_REGEX \
+           VIR_STORAGE_VOL_LOGICAL_SIZE_REGEX \
+           VIR_STORAGE_VOL_LOGICAL_VG_LV_ATTR_REGEX \
+           VIR_STORAGE_VOL_LOGICAL_VG_SIZE_REGEX \
+           VIR_STORAGE_VOL_LOGICAL_VG_FREE_REGEX \
+           VIR_STORAGE_VOL_LOGICAL_SUFFIX_REGEX
+
+
+static int
+virStorageBackendLogicalSetPoolSize(virStoragePoolDef *def,
+                                    const char *size,
+                                    const char *free)
+{
+    if (virStrToLong_ull(size, NULL, 10, &def->capacity) < 0)
+        return -1;
+    if (virStrToLong_ull(free, NULL, 10, &def->available) < 0)
+        return -1;
+    def->allocation = def->capacity - def->available;
+
+    return 0;
+}
+
+
+static int
+virStorageBackendLogicalMakeVolWithVG(char **const groups,
+                                      void *opaque)
+{
+    struct virStorageBackendLogicalPoolVolData *data = opaque;
+    virStoragePoolDef *def = virStoragePoolObjGetDef(data->pool);
+
+    if (virStorageBackendLogicalSetPoolSize(def, groups[10], groups[11]) < 0)
+        return -1;
+    data->haveVGSize = true;
+
+    return virStorageBackendLogicalMakeVol(groups, opaque);
+}
+
+
+/*
+ * Lists all logical volumes of the volume group of @pool, and fills in its
+ * size and free space from the same invocation of lvs, which saves LVM from
+ * scanning all physical volumes once more just for that. Returns 1 if the
+ * sizes could not be reported because there is no logical volume.
+ */
+static int
+virStorageBackendLogicalFindLVsWithVG(virStoragePoolObj *pool)
+{
+    const char *regexes[] = {
+        VIR_STORAGE_VOL_LOGICAL_VG_REGEX
+    };
+    int vars[] = {
+        VIR_STORAGE_VOL_LOGICAL_VG_REGEX_COUNT
+    };
+    virStoragePoolDef *def = virStoragePoolObjGetDef(pool);
+    struct virStorageBackendLogicalPoolVolData cbdata = {
+        .pool = pool,
+    };
+    g_autoptr(virCommand) cmd = NULL;
+
+    cmd = virCommandNewArgList(LVS,
+                               "--separator", "#",
+                               "--noheadings",
+                               "--units", "b",
+                               "--unbuffered",
+                               "--nosuffix",
+                               "--options",
+                               "lv_name,origin,uuid,devices,segtype,stripes,seg_size,vg_extent_size,size,lv_attr,vg_size,vg_free",
+                               def->source.name,
+                               NULL);
+    if (virCommandRunRegex(cmd, 1, regexes, vars,
+                           virStorageBackendLogicalMakeVolWithVG,
+                           &cbdata, "lvs", NULL) < 0)
+        return -1;
+
+    return cbdata.haveVGSize ? 0 : 1;
+}
+
+
 static int
 virStorageBackendLogicalFindLVs(virStoragePoolObj *pool,
                                 virStorageVolDef *vol)
@@ -402,15 +497,9 @@ virStorageBackendLogicalRefreshPoolFunc(char **const groups,
                                         void *data)
 {
     virStoragePoolObj *pool = data;
-    virStoragePoolDef *def = virStoragePoolObjGetDef(pool);
-
-    if (virStrToLong_ull(groups[0], NULL, 10, &def->capacity) < 0)
-        return -1;
-    if (virStrToLong_ull(groups[1], NULL, 10, &def->available) < 0)
-        return -1;
-    def->allocation = def->capacity - def->available;
 
-    return 0;
+    return virStorageBackendLogicalSetPoolSize(virStoragePoolObjGetDef(pool),
+                                               groups[0], groups[1]);
 }
 
 
@@ -723,12 +812,13 @@ virStorageBackendLogicalRefreshPool(virStoragePoolObj *pool)
     };
     virStoragePoolDef *def = virStoragePoolObjGetDef(pool);
     g_autoptr(virCommand) cmd = NULL;
+    int rc;
 
     virWaitForDevices();
 
-    /* Get list of all logical volumes */
-    if (virStorageBackendLogicalFindLVs(pool, NULL) < 0)
-        return -1;
+    /* Get list of all logical volumes and the volgrp size along with them */
+    if ((rc = virStorageBackendLogicalFindLVsWithVG(pool)) <= 0)
+        return rc;
 
     cmd = virCommandNewArgList(VGS,
                                "--separator", ":",
@@ -975,6 +1065,39 @@ virStorageBackendLogicalVolWipe(virStoragePoolObj *pool,
     return -1;
 }
 
+
+static int
+virStorageBackendLogicalResizeVol(virStoragePoolObj *pool G_GNUC_UNUSED,
+                                  virStorageVolDef *vol,
+                                  unsigned long long capacity,
+                                  unsigned int flags)
+{
+    g_autoptr(virCommand) cmd = NULL;
+
+    /* extending a logical volume always allocates the new extents */
+    virCheckFlags(VIR_STORAGE_VOL_RESIZE_ALLOCATE, -1);
+
+    /* extending a sparse volume would grow its snapshot storage rather
+     * than the size visible to its users */
+    if (vol->target.sparse) {
+        virReportError(VIR_ERR_NO_SUPPORT,
+                       _("logical volume '%s' is sparse, volume resize "
+                         "not supported"),
+                       vol->target.path);
+        return -1;
+    }
+
+    /* account for the LUKS header the same way as on creation */
+    if (vol->target.encryption)
+        capacity += 2 * 1024 * 1024;
+
+    cmd = virCommandNewArgList(LVEXTEND, "-L", NULL);
+    virCommandAddArgFormat(cmd, "%lluK", VIR_DIV_UP(capacity, 1024));
+    virCommandAddArg(cmd, vol->target.path);
+
+    return virCommandRun(cmd, NULL);
+}
+
 virStorageBackend virStorageBackendLogical = {
     .type = VIR_STORAGE_POOL_LOGICAL,
 
@@ -992,6 +1115,7 @@ virStorageBackend virStorageBackendLogical = {
     .uploadVol = virStorageBackendVolUploadLocal,
     .downloadVol = virStorageBackendVolDownloadLocal,
     .wipeVol = virStorageBackendLogicalVolWipe,
+    .resizeVol = virStorageBackendLogicalResizeVol,
 };
 
 
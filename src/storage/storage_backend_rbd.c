@@ -27,11 +27,13 @@
 #include "storage_backend_rbd.h"
 #include "storage_conf.h"
 #include "viralloc.h"
+#include "virhash.h"
 #include "viridentity.h"
 #include "virlog.h"
 #include "viruuid.h"
 #include "virstring.h"
 #include "virrandom.h"
+#include "virthread.h"
 #include "rados/librados.h"
 #include "rbd/librbd.h"
 #include "virsecret.h"
@@ -43,13 +45,29 @@
 VIR_LOG_INIT("storage.storage_backend_rbd");
 
 struct _virStorageBackendRBDState {
+    virObject parent;
+
     rados_t cluster;
     rados_ioctx_t ioctx;
     time_t starttime;
+    time_t lastused; /* protected by virStorageBackendRBDStatesLock */
 };
 
 typedef struct _virStorageBackendRBDState virStorageBackendRBDState;
 
+/* A connection unused for longer than this many seconds is checked
+ * before it is handed out again */
+#define VIR_STORAGE_BACKEND_RBD_STATE_CHECK_INTERVAL 60
+
+static virClass *virStorageBackendRBDStateClass;
+
+static void
+virStorageBackendRBDStateDispose(void *opaque);
+
+/* Connections of active pools, pool UUID -> virStorageBackendRBDState */
+static GHashTable *virStorageBackendRBDStates;
+static virMutex virStorageBackendRBDStatesLock = VIR_MUTEX_INITIALIZER;
+
 typedef struct _virStoragePoolRBDConfigOptionsDef virStoragePoolRBDConfigOptionsDef;
 struct _virStoragePoolRBDConfigOptionsDef {
     size_t noptions;
@@ -369,25 +387,101 @@ virStorageBackendRBDCloseRADOSConn(virStorageBackendRBDState *ptr)
 }
 
 
+static int
+virStorageBackendRBDStateOnceInit(void)
+{
+    if (!VIR_CLASS_NEW(virStorageBackendRBDState, virClassForObject()))
+        return -1;
+
+    return 0;
+}
+
+VIR_ONCE_GLOBAL_INIT(virStorageBackendRBDState);
+
+
+static void
+virStorageBackendRBDStateDispose(void *opaque)
+{
+    virStorageBackendRBDState *ptr = opaque;
+
+    virStorageBackendRBDCloseRADOSConn(ptr);
+}
+
+
+/* Releases the reference to the connection obtained by
+ * virStorageBackendRBDNewState */
 static void
 virStorageBackendRBDFreeState(virStorageBackendRBDState **ptr)
 {
-    if (!*ptr)
+    g_clear_pointer(ptr, virObjectUnref);
+}
+
+
+/* Forgets the connection of @def, or only @ptr if it is non-NULL */
+static void
+virStorageBackendRBDDropState(virStoragePoolDef *def,
+                              virStorageBackendRBDState *ptr)
+{
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
+
+    virUUIDFormat(def->uuid, uuidstr);
+
+    VIR_LOCK_GUARD lock = virLockGuardLock(&virStorageBackendRBDStatesLock);
+
+    if (!virStorageBackendRBDStates)
         return;
 
-    virStorageBackendRBDCloseRADOSConn(*ptr);
+    if (ptr && g_hash_table_lookup(virStorageBackendRBDStates, uuidstr) != ptr)
+        return;
 
-    VIR_FREE(*ptr);
+    g_hash_table_remove(virStorageBackendRBDStates, uuidstr);
 }
 
 
+/*
+ * Returns the RADOS connection of @pool. Connecting to the cluster needs
+ * several round trips to the monitors for authentication, so the connection
+ * is kept for as long as the pool is active and shared by all operations
+ * on it. The caller has to release it with virStorageBackendRBDFreeState.
+ */
 static virStorageBackendRBDState *
 virStorageBackendRBDNewState(virStoragePoolObj *pool)
 {
-    virStorageBackendRBDState *ptr;
+    virStorageBackendRBDState *ptr = NULL;
     virStoragePoolDef *def = virStoragePoolObjGetDef(pool);
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
+    time_t now = time(0);
+    time_t idle = 0;
+
+    if (virStorageBackendRBDStateInitialize() < 0)
+        return NULL;
+
+    virUUIDFormat(def->uuid, uuidstr);
+
+    VIR_WITH_MUTEX_LOCK_GUARD(&virStorageBackendRBDStatesLock) {
+        if (virStorageBackendRBDStates &&
+            (ptr = g_hash_table_lookup(virStorageBackendRBDStates, uuidstr))) {
+            virObjectRef(ptr);
+            idle = now - ptr->lastused;
+            ptr->lastused = now;
+        }
+    }
+
+    if (ptr) {
+        struct rados_cluster_stat_t clusterstat;
+
+        if (idle < VIR_STORAGE_BACKEND_RBD_STATE_CHECK_INTERVAL ||
+            rados_cluster_stat(ptr->cluster, &clusterstat) == 0)
+            return ptr;
+
+        VIR_WARN("RADOS connection of pool '%s' doesn't respond, reconnecting",
+                 def->name);
+        virStorageBackendRBDDropState(def, ptr);
+        virStorageBackendRBDFreeState(&ptr);
+    }
 
-    ptr = g_new0(virStorageBackendRBDState, 1);
+    if (!(ptr = virObjectNew(virStorageBackendRBDStateClass)))
+        return NULL;
 
     if (virStorageBackendRBDOpenRADOSConn(ptr, def) < 0)
         goto error;
@@ -395,6 +489,16 @@ virStorageBackendRBDNewState(virStoragePoolObj *pool)
     if (virStorageBackendRBDOpenIoCTX(ptr, pool) < 0)
         goto error;
 
+    ptr->lastused = now;
+
+    VIR_WITH_MUTEX_LOCK_GUARD(&virStorageBackendRBDStatesLock) {
+        if (!virStorageBackendRBDStates)
+            virStorageBackendRBDStates = virHashNew(virObjectUnref);
+
+        g_hash_table_insert(virStorageBackendRBDStates, g_strdup(uuidstr),
+                            virObjectRef(ptr));
+    }
+
     return ptr;
 
  error:
@@ -403,6 +507,14 @@ virStorageBackendRBDNewState(virStoragePoolObj *pool)
 }
 
 
+static int
+virStorageBackendRBDStopPool(virStoragePoolObj *pool)
+{
+    virStorageBackendRBDDropState(virStoragePoolObjGetDef(pool), NULL);
+    return 0;
+}
+
+
 static int
 volStorageBackendRBDGetFeatures(rbd_image_t image,
                                 const char *volname,
@@ -649,15 +761,51 @@ virStorageBackendRBDGetVolNames(virStorageBackendRBDState *ptr)
 #endif /* ! WITH_RBD_LIST2 */
 
 
+typedef struct _virStorageBackendRBDProbeData virStorageBackendRBDProbeData;
+struct _virStorageBackendRBDProbeData {
+    virStoragePoolObj *pool;
+    virStorageBackendRBDState *ptr;
+};
+
+
+static int
+virStorageBackendRBDProbeVol(virStorageVolDef *vol,
+                             void *opaque)
+{
+    virStorageBackendRBDProbeData *data = opaque;
+    int rc = volStorageBackendRBDRefreshVolInfo(vol, data->pool, data->ptr);
+
+    /* It could be that a volume has been deleted through a different route
+     * then libvirt and that will cause a -ENOENT to be returned.
+     *
+     * Another possibility is that there is something wrong with the placement
+     * group (PG) that RBD image's header is in and that causes -ETIMEDOUT
+     * to be returned.
+     *
+     * Do not error out and simply ignore the volume
+     */
+    if (rc < 0) {
+        if (rc == -ENOENT || rc == -ETIMEDOUT)
+            return -2;
+
+        return -1;
+    }
+
+    return 0;
+}
+
+
 static int
 virStorageBackendRBDRefreshPool(virStoragePoolObj *pool)
 {
-    int rc, ret = -1;
+    int ret = -1;
     virStoragePoolDef *def = virStoragePoolObjGetDef(pool);
     virStorageBackendRBDState *ptr = NULL;
     struct rados_cluster_stat_t clusterstat;
     struct rados_pool_stat_t poolstat;
     g_auto(GStrv) names = NULL;
+    g_autoptr(GPtrArray) vols = NULL;
+    virStorageBackendRBDProbeData probe = { 0 };
     size_t i;
 
     if (!(ptr = virStorageBackendRBDNewState(pool)))
@@ -686,36 +834,23 @@ virStorageBackendRBDRefreshPool(virStoragePoolObj *pool)
     if (!(names = virStorageBackendRBDGetVolNames(ptr)))
         goto cleanup;
 
-    for (i = 0; names[i] != NULL; i++) {
-        g_autoptr(virStorageVolDef) vol = NULL;
+    vols = g_ptr_array_new_with_free_func((GDestroyNotify) virStorageVolDefFree);
 
-        vol = g_new0(virStorageVolDef, 1);
+    for (i = 0; names[i] != NULL; i++) {
+        virStorageVolDef *vol = g_new0(virStorageVolDef, 1);
 
         vol->name = g_steal_pointer(&names[i]);
-
-        rc = volStorageBackendRBDRefreshVolInfo(vol, pool, ptr);
-
-        /* It could be that a volume has been deleted through a different route
-         * then libvirt and that will cause a -ENOENT to be returned.
-         *
-         * Another possibility is that there is something wrong with the placement
-         * group (PG) that RBD image's header is in and that causes -ETIMEDOUT
-         * to be returned.
-         *
-         * Do not error out and simply ignore the volume
-         */
-        if (rc < 0) {
-            if (rc == -ENOENT || rc == -ETIMEDOUT)
-                continue;
-
-            goto cleanup;
-        }
-
-        if (virStoragePoolObjAddVol(pool, vol) < 0)
-            goto cleanup;
-        vol = NULL;
+        g_ptr_array_add(vols, vol);
     }
 
+    /* Opening an image is a round trip to the cluster, so probe the
+     * images in parallel */
+    probe.pool = pool;
+    probe.ptr = ptr;
+    if (virStorageBackendProbeVols(pool, vols,
+                                   virStorageBackendRBDProbeVol, &probe) < 0)
+        goto cleanup;
+
     VIR_DEBUG("Found %zu images in RBD pool %s",
               virStoragePoolObjGetVolumesCount(pool), def->source.name);
 
@@ -1435,6 +1570,7 @@ virStorageBackend virStorageBackendRBD = {
     .type = VIR_STORAGE_POOL_RBD,
 
     .refreshPool = virStorageBackendRBDRefreshPool,
+    .stopPool = virStorageBackendRBDStopPool,
     .createVol = virStorageBackendRBDCreateVol,
     .buildVol = virStorageBackendRBDBuildVol,
     .buildVolFrom = virStorageBackendRBDBuildVolFrom,
@@ -50,6 +50,11 @@
 #include "viraccessapicheck.h"
 #include "storage_util.h"
 #include "virutil.h"
+#include "virprobe.h"
+
+#ifdef WITH_DTRACE_PROBES
+# include "libvirt_storage_probes.h"
+#endif
 
 #define VIR_FROM_THIS VIR_FROM_STORAGE
 
@@ -88,8 +93,24 @@ storagePoolRefreshImpl(virStorageBackend *backend,
                        virStoragePoolObj *obj,
                        const char *stateFile)
 {
-    virStoragePoolObjClearVols(obj);
-    if (backend->refreshPool(obj) < 0) {
+    virStoragePoolDef *def = virStoragePoolObjGetDef(obj);
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
+    unsigned long long start = g_get_monotonic_time();
+    int rc;
+
+    /* Backends may take over definitions of volumes that did not change
+     * since the last refresh instead of probing them again */
+    virStoragePoolObjStashVols(obj);
+    rc = backend->refreshPool(obj);
+    virStoragePoolObjClearStashedVols(obj);
+
+    virUUIDFormat(def->uuid, uuidstr);
+    PROBE(STORAGE_POOL_REFRESH,
+          "uuid=%s name=%s type=%s ret=%d usec=%llu",
+          uuidstr, def->name, virStoragePoolTypeToString(def->type), rc,
+          g_get_monotonic_time() - start);
+
+    if (rc < 0) {
         storagePoolRefreshFailCleanup(backend, obj, stateFile);
         return -1;
     }
@@ -2895,6 +2916,8 @@ static virConnectDriver storageConnectDriver = {
 
 static virStateDriver stateDriver = {
     .name = "storage",
+    /* pools may need secrets to authenticate */
+    .dependencies = (const char *const []) { "secret", NULL },
     .stateInitialize = storageStateInitialize,
     .stateCleanup = storageStateCleanup,
     .stateReload = storageStateReload,
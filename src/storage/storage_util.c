@@ -66,6 +66,7 @@
 #include "virfdstream.h"
 #include "virutil.h"
 #include "virsecureerase.h"
+#include "virthreadpool.h"
 
 #define VIR_FROM_THIS VIR_FROM_STORAGE
 
@@ -116,6 +117,119 @@ reflinkCloneFile(int dest_fd G_GNUC_UNUSED,
 #endif
 
 
+#if WITH_COPY_FILE_RANGE
+/* Upper bound of bytes copied by one copy_file_range call */
+# define COPY_RANGE_CHUNK_SIZE (1ULL << 30)
+
+/*
+ * Copy up to @total bytes from @inputfd to the current position of @fd
+ * within the kernel, which allows file systems to share the extents
+ * instead of copying them and network file systems to copy on the
+ * server side. If @want_sparse is true, holes in the input are skipped.
+ *
+ * Returns 0 on success, 1 if copying between the two files isn't
+ * supported and nothing was written, -1 with error reported on failure.
+ */
+static int
+storageBackendCopyFileRange(virStorageVolDef *vol,
+                            virStorageVolDef *inputvol,
+                            int inputfd,
+                            int fd,
+                            unsigned long long *total,
+                            bool want_sparse)
+{
+    unsigned long long remain = *total;
+    off_t inoff = 0;
+    off_t outoff;
+    bool copied = false;
+
+    if ((outoff = lseek(fd, 0, SEEK_CUR)) < 0)
+        return 1;
+
+    while (remain > 0) {
+        unsigned long long len = remain;
+        ssize_t rc;
+
+        if (want_sparse) {
+            off_t data;
+            off_t hole;
+
+            if ((data = lseek(inputfd, inoff, SEEK_DATA)) < 0) {
+                if (errno != ENXIO) {
+                    /* no idea about holes, copy everything */
+                    want_sparse = false;
+                    continue;
+                }
+
+                /* the rest of the input is a hole */
+                data = inoff + remain;
+            }
+
+            if ((unsigned long long) (data - inoff) >= remain) {
+                outoff += remain;
+                remain = 0;
+                break;
+            }
+
+            outoff += data - inoff;
+            remain -= data - inoff;
+            inoff = data;
+
+            if ((hole = lseek(inputfd, inoff, SEEK_HOLE)) > inoff)
+                len = MIN(remain, (unsigned long long) (hole - inoff));
+        }
+
+        rc = copy_file_range(inputfd, &inoff, fd, &outoff,
+                             MIN(len, COPY_RANGE_CHUNK_SIZE), 0);
+        if (rc < 0) {
+            if (errno == EINTR)
+                continue;
+
+            if (!copied &&
+                (errno == ENOSYS || errno == EXDEV || errno == EINVAL ||
+                 errno == EOPNOTSUPP || errno == EBADF)) {
+                VIR_DEBUG("copy_file_range from '%s' not supported: %s",
+                          inputvol->target.path, g_strerror(errno));
+                return 1;
+            }
+
+            virReportSystemError(errno,
+                                 _("failed to copy from '%s' to '%s'"),
+                                 inputvol->target.path, vol->target.path);
+            return -1;
+        }
+
+        /* end of the input */
+        if (rc == 0)
+            break;
+
+        remain -= rc;
+        copied = true;
+    }
+
+    if (lseek(fd, outoff, SEEK_SET) < 0) {
+        virReportSystemError(errno, _("cannot seek in file '%s'"),
+                             vol->target.path);
+        return -1;
+    }
+
+    *total = remain;
+    return 0;
+}
+#else /* !WITH_COPY_FILE_RANGE */
+static int
+storageBackendCopyFileRange(virStorageVolDef *vol G_GNUC_UNUSED,
+                            virStorageVolDef *inputvol G_GNUC_UNUSED,
+                            int inputfd G_GNUC_UNUSED,
+                            int fd G_GNUC_UNUSED,
+                            unsigned long long *total G_GNUC_UNUSED,
+                            bool want_sparse G_GNUC_UNUSED)
+{
+    return 1;
+}
+#endif /* !WITH_COPY_FILE_RANGE */
+
+
 static int ATTRIBUTE_NONNULL(2)
 virStorageBackendCopyToFD(virStorageVolDef *vol,
                           virStorageVolDef *inputvol,
@@ -165,6 +279,23 @@ virStorageBackendCopyToFD(virStorageVolDef *vol,
         }
     }
 
+    switch (storageBackendCopyFileRange(vol, inputvol, inputfd, fd,
+                                        total, want_sparse)) {
+    case 0:
+        amtread = 0;
+        break;
+    case 1:
+        /* copy by reading and writing */
+        if (lseek(inputfd, 0, SEEK_SET) < 0) {
+            virReportSystemError(errno, _("cannot seek in file '%s'"),
+                                 inputvol->target.path);
+            return -1;
+        }
+        break;
+    default:
+        return -1;
+    }
+
     while (amtread != 0) {
         int amtleft;
 
@@ -2572,6 +2703,133 @@ storageBackendVolZeroSparseFileLocal(const char *path,
 }
 
 
+/* Minimum size of the buffer used to write zeroes to volumes */
+#define WIPE_WRITE_SIZE_MIN (1024 * 1024)
+
+#ifdef __linux__
+/*
+ * Let the kernel zero @len bytes at @offset of the block device @fd,
+ * which offloads the work to the device if it supports a write zeroes
+ * command.
+ *
+ * Returns 0 on success, 1 if the range can't be zeroed this way, -1 with
+ * error reported on failure.
+ */
+static int
+storageBackendWipeBlockZeroOut(const char *path,
+                               int fd,
+                               unsigned long long offset,
+                               unsigned long long len)
+{
+    uint64_t range[2] = { offset, len };
+
+    if (offset % DEV_BSIZE || len % DEV_BSIZE)
+        return 1;
+
+    if (ioctl(fd, BLKZEROOUT, range) < 0) {
+        if (errno == ENOTTY || errno == EOPNOTSUPP || errno == EINVAL)
+            return 1;
+
+        virReportSystemError(errno,
+                             _("Failed to zero out volume with path '%s'"),
+                             path);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/*
+ * Discard @len bytes at @offset of the block device @fd.
+ *
+ * Returns 0 on success, -1 with error reported on failure.
+ */
+static int
+storageBackendWipeBlockDiscard(const char *path,
+                               int fd,
+                               unsigned long long offset,
+                               unsigned long long len)
+{
+    uint64_t range[2] = { offset, len };
+
+    if (ioctl(fd, BLKDISCARD, range) < 0) {
+        virReportSystemError(errno,
+                             _("Failed to discard data of volume with path '%s'"),
+                             path);
+        return -1;
+    }
+
+    return 0;
+}
+#else /* !__linux__ */
+static int
+storageBackendWipeBlockZeroOut(const char *path G_GNUC_UNUSED,
+                               int fd G_GNUC_UNUSED,
+                               unsigned long long offset G_GNUC_UNUSED,
+                               unsigned long long len G_GNUC_UNUSED)
+{
+    return 1;
+}
+
+
+static int
+storageBackendWipeBlockDiscard(const char *path,
+                               int fd G_GNUC_UNUSED,
+                               unsigned long long offset G_GNUC_UNUSED,
+                               unsigned long long len G_GNUC_UNUSED)
+{
+    virReportError(VIR_ERR_OPERATION_UNSUPPORTED,
+                   _("discarding data of volume with path '%s' is not supported on this platform"),
+                   path);
+    return -1;
+}
+#endif /* !__linux__ */
+
+
+/*
+ * Discard all data of the volume @fd, which is either a block device
+ * or a regular file.
+ */
+static int
+storageBackendVolTrimLocal(const char *path,
+                           int fd,
+                           struct stat *st)
+{
+    if (S_ISBLK(st->st_mode)) {
+        off_t size;
+
+        if ((size = lseek(fd, 0, SEEK_END)) < 0) {
+            virReportSystemError(errno,
+                                 _("Failed to get size of volume with path '%s'"),
+                                 path);
+            return -1;
+        }
+
+        return storageBackendWipeBlockDiscard(path, fd, 0, size);
+    }
+
+#if WITH_FALLOCATE - 0 && defined(FALLOC_FL_PUNCH_HOLE)
+    if (S_ISREG(st->st_mode)) {
+        if (fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                      0, st->st_size) < 0) {
+            virReportSystemError(errno,
+                                 _("Failed to discard data of volume with path '%s'"),
+                                 path);
+            return -1;
+        }
+
+        return 0;
+    }
+#endif
+
+    virReportError(VIR_ERR_ARGUMENT_UNSUPPORTED,
+                   _("'trim' algorithm not supported for volume with path '%s'"),
+                   path);
+    return -1;
+}
+
+
 static int
 storageBackendWipeLocal(const char *path,
                         int fd,
@@ -2581,6 +2839,7 @@ storageBackendWipeLocal(const char *path,
 {
     unsigned long long remaining = 0;
     off_t size;
+    struct stat st;
     g_autofree char *writebuf = NULL;
 
     writebuf = g_new0(char, writebuf_length);
@@ -2605,6 +2864,19 @@ storageBackendWipeLocal(const char *path,
 
     VIR_DEBUG("wiping start: %zd len: %llu", (ssize_t)size, wipe_len);
 
+    if (fstat(fd, &st) == 0 && S_ISBLK(st.st_mode)) {
+        switch (storageBackendWipeBlockZeroOut(path, fd, size, wipe_len)) {
+        case 0:
+            VIR_DEBUG("Zeroed out %llu bytes of volume with path '%s'",
+                      wipe_len, path);
+            return 0;
+        case 1:
+            break;
+        default:
+            return -1;
+        }
+    }
+
     remaining = wipe_len;
     while (remaining > 0) {
         size_t write_size = MIN(writebuf_length, remaining);
@@ -2690,9 +2962,8 @@ storageBackendVolWipeLocalFile(const char *path,
         alg_char = "random";
         break;
     case VIR_STORAGE_VOL_WIPE_ALG_TRIM:
-        virReportError(VIR_ERR_ARGUMENT_UNSUPPORTED, "%s",
-                       _("'trim' algorithm not supported"));
-        return -1;
+        VIR_DEBUG("Trimming file '%s'", path);
+        return storageBackendVolTrimLocal(path, fd, &st);
     case VIR_STORAGE_VOL_WIPE_ALG_LAST:
         virReportError(VIR_ERR_INVALID_ARG,
                        _("unsupported algorithm %d"),
@@ -2712,7 +2983,8 @@ storageBackendVolWipeLocalFile(const char *path,
     if (S_ISREG(st.st_mode) && st.st_blocks < (st.st_size / DEV_BSIZE))
         return storageBackendVolZeroSparseFileLocal(path, st.st_size, fd);
 
-    return storageBackendWipeLocal(path, fd, allocation, st.st_blksize,
+    return storageBackendWipeLocal(path, fd, allocation,
+                                   MAX(st.st_blksize, WIPE_WRITE_SIZE_MIN),
                                    zero_end);
 }
 
@@ -3551,6 +3823,228 @@ virStorageBackendRefreshVolTargetUpdate(virStorageVolDef *vol)
 }
 
 
+/* Upper bound of threads probing volumes in parallel on pool refresh */
+#define VIR_STORAGE_BACKEND_PROBE_WORKERS 8
+
+typedef struct _virStorageBackendProbeData virStorageBackendProbeData;
+struct _virStorageBackendProbeData {
+    virStorageBackendProbeVolFunc probe;
+    void *opaque;
+
+    virMutex lock;
+    virCond cond;
+    size_t pending;
+};
+
+typedef struct _virStorageBackendProbeJob virStorageBackendProbeJob;
+struct _virStorageBackendProbeJob {
+    virStorageBackendProbeData *data;
+    virStorageVolDef *vol;
+
+    int rc;
+    virErrorPtr err;
+};
+
+
+static void
+virStorageBackendProbeVol(virStorageBackendProbeJob *job)
+{
+    virStorageBackendProbeData *data = job->data;
+
+    /* Errors are thread local, keep the error for the refreshing thread */
+    if ((job->rc = data->probe(job->vol, data->opaque)) == -1)
+        virErrorPreserveLast(&job->err);
+}
+
+
+static void
+virStorageBackendProbeVolWorker(void *jobdata,
+                                void *opaque G_GNUC_UNUSED)
+{
+    virStorageBackendProbeJob *job = jobdata;
+    virStorageBackendProbeData *data = job->data;
+
+    virStorageBackendProbeVol(job);
+
+    VIR_WITH_MUTEX_LOCK_GUARD(&data->lock) {
+        if (--data->pending == 0)
+            virCondSignal(&data->cond);
+    }
+}
+
+
+/*
+ * Probes the volumes of @njobs @jobs on a short lived pool of @nworkers
+ * threads. Returns the number of jobs handled, which is less than @njobs
+ * if not all of them could be queued.
+ */
+static size_t
+virStorageBackendProbeVolsParallel(virStorageBackendProbeData *data,
+                                   virStorageBackendProbeJob *jobs,
+                                   size_t njobs,
+                                   size_t nworkers)
+{
+    virThreadPool *pool;
+    size_t i = 0;
+
+    if (virMutexInit(&data->lock) < 0)
+        return 0;
+
+    if (virCondInit(&data->cond) < 0) {
+        virMutexDestroy(&data->lock);
+        return 0;
+    }
+
+    if ((pool = virThreadPoolNewFull(0, nworkers, 0,
+                                     virStorageBackendProbeVolWorker,
+                                     "storage-probe", NULL, NULL))) {
+        VIR_WITH_MUTEX_LOCK_GUARD(&data->lock) {
+            for (i = 0; i < njobs; i++) {
+                if (virThreadPoolSendJob(pool, 0, &jobs[i]) < 0)
+                    break;
+                data->pending++;
+            }
+
+            while (data->pending > 0)
+                ignore_value(virCondWait(&data->cond, &data->lock));
+        }
+
+        virThreadPoolFree(pool);
+    }
+
+    virCondDestroy(&data->cond);
+    virMutexDestroy(&data->lock);
+
+    return i;
+}
+
+
+/**
+ * virStorageBackendProbeVols:
+ * @pool: pool object being refreshed
+ * @vols: array of volume definitions to probe
+ * @probe: callback filling in the details of one volume
+ * @opaque: data passed to @probe
+ *
+ * Calls @probe for all volumes in @vols on a bounded number of threads and
+ * adds the volumes to @pool in the order of @vols once all of them were
+ * probed. @pool stays locked by the caller meanwhile, so @probe may only
+ * read its definition. @probe returns 0 on success, -2 if the volume should
+ * be silently skipped and -1 with an error reported on failure.
+ *
+ * The definitions added to @pool are removed from @vols, the rest is left
+ * for the caller to free.
+ *
+ * Returns 0 on success, -1 if any of the volumes failed to be probed or
+ * added to @pool.
+ */
+int
+virStorageBackendProbeVols(virStoragePoolObj *pool,
+                           GPtrArray *vols,
+                           virStorageBackendProbeVolFunc probe,
+                           void *opaque)
+{
+    virStorageBackendProbeData data = { .probe = probe, .opaque = opaque };
+    g_autofree virStorageBackendProbeJob *jobs = NULL;
+    size_t njobs = vols->len;
+    size_t nworkers = MIN(njobs, VIR_STORAGE_BACKEND_PROBE_WORKERS);
+    size_t i = 0;
+    int ret = 0;
+
+    jobs = g_new0(virStorageBackendProbeJob, njobs);
+    for (i = 0; i < njobs; i++) {
+        jobs[i].data = &data;
+        jobs[i].vol = g_ptr_array_index(vols, i);
+    }
+
+    i = 0;
+    if (nworkers > 1)
+        i = virStorageBackendProbeVolsParallel(&data, jobs, njobs, nworkers);
+
+    /* Whatever could not be probed in parallel is probed right here */
+    for (; i < njobs; i++)
+        virStorageBackendProbeVol(&jobs[i]);
+
+    for (i = 0; i < njobs; i++) {
+        if (ret < 0 || jobs[i].rc == -2) {
+            g_clear_pointer(&jobs[i].err, virFreeError);
+            continue;
+        }
+
+        if (jobs[i].rc < 0) {
+            virErrorRestore(&jobs[i].err);
+            ret = -1;
+            continue;
+        }
+
+        if (virStoragePoolObjAddVol(pool, jobs[i].vol) < 0) {
+            ret = -1;
+            continue;
+        }
+        g_ptr_array_index(vols, i) = NULL;
+    }
+
+    return ret;
+}
+
+
+/**
+ * storageBackendRefreshVolReuse:
+ * @pool: pool object being refreshed
+ * @path: path of the volume
+ *
+ * Take over the definition of the volume at @path from before the refresh
+ * if the file has not changed since it was probed, which saves reading the
+ * image header and walking the backing chain of every single image in large
+ * pools. Since replacing the file or any write updates its change time, it
+ * is sufficient to compare the size and the timestamps.
+ *
+ * Returns the definition or NULL if the volume has to be probed.
+ */
+static virStorageVolDef *
+storageBackendRefreshVolReuse(virStoragePoolObj *pool,
+                              const char *path)
+{
+    g_autoptr(virStorageVolDef) vol = NULL;
+    virStorageTimestamps *ts;
+    const struct timespec *mtime;
+    const struct timespec *ctime;
+    struct stat sb;
+
+    if (!(vol = virStoragePoolObjUnstashVol(pool, path)) ||
+        !(ts = vol->target.timestamps))
+        return NULL;
+
+    if (stat(path, &sb) < 0 || !S_ISREG(sb.st_mode))
+        return NULL;
+
+#ifdef __APPLE__
+    mtime = &sb.st_mtimespec;
+    ctime = &sb.st_ctimespec;
+#else /* ! __APPLE__ */
+    mtime = &sb.st_mtim;
+    ctime = &sb.st_ctim;
+#endif /* ! __APPLE__ */
+
+    if (sb.st_size != vol->target.physical ||
+        mtime->tv_sec != ts->mtime.tv_sec ||
+        mtime->tv_nsec != ts->mtime.tv_nsec ||
+        ctime->tv_sec != ts->ctime.tv_sec ||
+        ctime->tv_nsec != ts->ctime.tv_nsec)
+        return NULL;
+
+    return g_steal_pointer(&vol);
+}
+
+
+static int
+storageBackendRefreshLocalProbe(virStorageVolDef *vol,
+                                void *opaque G_GNUC_UNUSED)
+{
+    return virStorageBackendRefreshVolTargetUpdate(vol);
+}
+
+
 /**
  * Iterate over the pool's directory and enumerate all disk images
  * within it. This is non-recursive.
@@ -3567,12 +4061,15 @@ virStorageBackendRefreshLocal(virStoragePoolObj *pool)
     g_autoptr(virStorageVolDef) vol = NULL;
     VIR_AUTOCLOSE fd = -1;
     g_autoptr(virStorageSource) target = NULL;
+    g_autoptr(GPtrArray) vols = NULL;
+
+    vols = g_ptr_array_new_with_free_func((GDestroyNotify) virStorageVolDefFree);
 
     if (virDirOpen(&dir, def->target.path) < 0)
         return -1;
 
     while ((direrr = virDirRead(dir, &ent, def->target.path)) > 0) {
-        int err;
+        g_autofree char *path = NULL;
 
         if (virStringHasControlChars(ent->d_name)) {
             VIR_WARN("Ignoring file '%s' with control characters under '%s'",
@@ -3580,32 +4077,35 @@ virStorageBackendRefreshLocal(virStoragePoolObj *pool)
             continue;
         }
 
+        path = g_strdup_printf("%s/%s", def->target.path, ent->d_name);
+
+        if ((vol = storageBackendRefreshVolReuse(pool, path))) {
+            if (virStoragePoolObjAddVol(pool, vol) < 0)
+                return -1;
+            vol = NULL;
+            continue;
+        }
+
         vol = g_new0(virStorageVolDef, 1);
 
         vol->name = g_strdup(ent->d_name);
 
         vol->type = VIR_STORAGE_VOL_FILE;
-        vol->target.path = g_strdup_printf("%s/%s", def->target.path, vol->name);
+        vol->target.path = g_steal_pointer(&path);
 
         vol->key = g_strdup(vol->target.path);
 
-        if ((err = virStorageBackendRefreshVolTargetUpdate(vol)) < 0) {
-            if (err == -2) {
-                /* Silently ignore non-regular files,
-                 * eg 'lost+found', dangling symbolic link */
-                g_clear_pointer(&vol, virStorageVolDefFree);
-                continue;
-            }
-            return -1;
-        }
-
-        if (virStoragePoolObjAddVol(pool, vol) < 0)
-            return -1;
-        vol = NULL;
+        g_ptr_array_add(vols, g_steal_pointer(&vol));
     }
     if (direrr < 0)
         return -1;
 
+    /* Non-regular files, eg 'lost+found', dangling symbolic links,
+     * are silently ignored by the probe */
+    if (virStorageBackendProbeVols(pool, vols,
+                                   storageBackendRefreshLocalProbe, NULL) < 0)
+        return -1;
+
     target = virStorageSourceNew();
 
     if ((fd = open(def->target.path, O_RDONLY)) < 0) {
@@ -3671,15 +4171,21 @@ virStorageBackendSCSISerial(const char *dev,
 }
 
 
+typedef struct _virStorageBackendSCSIProbeData virStorageBackendSCSIProbeData;
+struct _virStorageBackendSCSIProbeData {
+    virStoragePoolObj *pool;
+    virMutex lock; /* protects the fields below */
+    unsigned long long capacity;
+    unsigned long long allocation;
+    int found;
+};
+
+
 /*
- * Attempt to create a new LUN
- *
- * Returns:
+ * Prepare a new LUN for probing, its target path is the device node
+ * until virStorageBackendSCSIProbeLun finds the stable path.
  *
- *  0  => Success
- *  -1 => Failure due to some sort of OOM or other fatal issue found when
- *        attempting to get/update information about a found volume
- *  -2 => Failure to find a stable path, not fatal, caller can try another
+ * Returns: 0 on success, -1 if the pool target path is not usable
  */
 static int
 virStorageBackendSCSINewLun(virStoragePoolObj *pool,
@@ -3687,12 +4193,11 @@ virStorageBackendSCSINewLun(virStoragePoolObj *pool,
                             uint32_t bus,
                             uint32_t target,
                             uint32_t lun,
-                            const char *dev)
+                            const char *dev,
+                            GPtrArray *vols)
 {
     virStoragePoolDef *def = virStoragePoolObjGetDef(pool);
-    int retval = -1;
-    g_autoptr(virStorageVolDef) vol = NULL;
-    g_autofree char *devpath = NULL;
+    virStorageVolDef *vol;
 
     /* Check if the pool is using a stable target path. The call to
      * virStorageBackendStablePath will fail if the pool target path
@@ -3711,6 +4216,7 @@ virStorageBackendSCSINewLun(virStoragePoolObj *pool,
     }
 
     vol = g_new0(virStorageVolDef, 1);
+    g_ptr_array_add(vols, vol);
 
     vol->type = VIR_STORAGE_VOL_BLOCK;
 
@@ -3721,7 +4227,30 @@ virStorageBackendSCSINewLun(virStoragePoolObj *pool,
      */
     vol->name = g_strdup_printf("unit:%u:%u:%u", bus, target, lun);
 
-    devpath = g_strdup_printf("/dev/%s", dev);
+    vol->target.path = g_strdup_printf("/dev/%s", dev);
+
+    return 0;
+}
+
+
+/*
+ * Attempt to fill in a new LUN, called for many LUNs in parallel
+ *
+ * Returns:
+ *
+ *  0  => Success
+ *  -1 => Failure due to some sort of OOM or other fatal issue found when
+ *        attempting to get/update information about a found volume
+ *  -2 => Failure to find a stable path, not fatal, caller can try another
+ */
+static int
+virStorageBackendSCSIProbeLun(virStorageVolDef *vol,
+                              void *opaque)
+{
+    virStorageBackendSCSIProbeData *data = opaque;
+    virStoragePoolDef *def = virStoragePoolObjGetDef(data->pool);
+    g_autofree char *devpath = g_steal_pointer(&vol->target.path);
+    int retval;
 
     VIR_DEBUG("Trying to create volume for '%s'", devpath);
 
@@ -3731,7 +4260,7 @@ virStorageBackendSCSINewLun(virStoragePoolObj *pool,
      * dir every time its run. Should figure out a more efficient
      * way of doing this...
      */
-    if ((vol->target.path = virStorageBackendStablePath(pool,
+    if ((vol->target.path = virStorageBackendStablePath(data->pool,
                                                         devpath,
                                                         true)) == NULL)
         return -1;
@@ -3758,12 +4287,11 @@ virStorageBackendSCSINewLun(virStoragePoolObj *pool,
     if (!vol->key)
         return -1;
 
-    def->capacity += vol->target.capacity;
-    def->allocation += vol->target.allocation;
-
-    if (virStoragePoolObjAddVol(pool, vol) < 0)
-        return -1;
-    vol = NULL;
+    VIR_WITH_MUTEX_LOCK_GUARD(&data->lock) {
+        data->capacity += vol->target.capacity;
+        data->allocation += vol->target.allocation;
+        data->found++;
+    }
 
     return 0;
 }
@@ -3939,7 +4467,8 @@ getDeviceType(uint32_t host,
 
 
 /*
- * Process a Logical Unit entry from the scsi host device directory
+ * Process a Logical Unit entry from the scsi host device directory and
+ * add the new volume to @vols for probing
  *
  * Returns:
  *
@@ -3952,7 +4481,8 @@ processLU(virStoragePoolObj *pool,
           uint32_t host,
           uint32_t bus,
           uint32_t target,
-          uint32_t lun)
+          uint32_t lun,
+          GPtrArray *vols)
 {
     int retval = -1;
     int device_type;
@@ -3984,7 +4514,7 @@ processLU(virStoragePoolObj *pool,
     }
 
     retval = virStorageBackendSCSINewLun(pool, host, bus, target, lun,
-                                         block_device);
+                                         block_device, vols);
     if (retval < 0) {
         VIR_DEBUG("Failed to create new storage volume for %u:%u:%u:%u",
                   host, bus, target, lun);
@@ -4009,7 +4539,8 @@ virStorageBackendSCSIFindLUs(virStoragePoolObj *pool,
     g_autoptr(DIR) devicedir = NULL;
     struct dirent *lun_dirent = NULL;
     char devicepattern[64];
-    int found = 0;
+    virStorageBackendSCSIProbeData data = { .pool = pool };
+    g_autoptr(GPtrArray) vols = NULL;
 
     VIR_DEBUG("Discovering LUs on host %u", scanhost);
 
@@ -4020,9 +4551,9 @@ virStorageBackendSCSIFindLUs(virStoragePoolObj *pool,
 
     g_snprintf(devicepattern, sizeof(devicepattern), "%u:%%u:%%u:%%u\n", scanhost);
 
-    while ((retval = virDirRead(devicedir, &lun_dirent, device_path)) > 0) {
-        int rc;
+    vols = g_ptr_array_new_with_free_func((GDestroyNotify) virStorageVolDefFree);
 
+    while ((retval = virDirRead(devicedir, &lun_dirent, device_path)) > 0) {
         if (sscanf(lun_dirent->d_name, devicepattern,
                    &bus, &target, &lun) != 3) {
             continue;
@@ -4030,21 +4561,34 @@ virStorageBackendSCSIFindLUs(virStoragePoolObj *pool,
 
         VIR_DEBUG("Found possible LU '%s'", lun_dirent->d_name);
 
-        rc = processLU(pool, scanhost, bus, target, lun);
-        if (rc == -1) {
+        if (processLU(pool, scanhost, bus, target, lun, vols) == -1) {
             retval = -1;
             break;
         }
-        if (rc == 0)
-            found++;
     }
 
     if (retval < 0)
         return -1;
 
-    VIR_DEBUG("Found %d LUs for pool %s", found, def->name);
+    /* Finding the stable path, reading the size and the serial of each
+     * LU takes a while, do that for many of them in parallel */
+    if (virMutexInit(&data.lock) < 0) {
+        virReportSystemError(errno, "%s", _("unable to init mutex"));
+        return -1;
+    }
+
+    retval = virStorageBackendProbeVols(pool, vols,
+                                        virStorageBackendSCSIProbeLun, &data);
+    virMutexDestroy(&data.lock);
+    if (retval < 0)
+        return -1;
+
+    def->capacity += data.capacity;
+    def->allocation += data.allocation;
+
+    VIR_DEBUG("Found %d LUs for pool %s", data.found, def->name);
 
-    return found;
+    return data.found;
 }
 
 
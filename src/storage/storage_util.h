@@ -102,6 +102,15 @@ int virStorageBackendDeleteLocal(virStoragePoolObj *pool,
 int
 virStorageBackendRefreshVolTargetUpdate(virStorageVolDef *vol);
 
+typedef int (*virStorageBackendProbeVolFunc)(virStorageVolDef *vol,
+                                             void *opaque);
+
+int
+virStorageBackendProbeVols(virStoragePoolObj *pool,
+                           GPtrArray *vols,
+                           virStorageBackendProbeVolFunc probe,
+                           void *opaque);
+
 int virStorageBackendRefreshLocal(virStoragePoolObj *pool);
 
 int virStorageUtilGlusterExtractPoolSources(const char *host,
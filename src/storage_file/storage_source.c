@@ -37,6 +37,7 @@
 #include "virobject.h"
 #include "virstoragefile.h"
 #include "virstring.h"
+#include "virthread.h"
 #include "virutil.h"
 
 #define VIR_FROM_THIS VIR_FROM_STORAGE
@@ -135,6 +136,180 @@ virStorageSourceGetMetadataFromBuf(const char *path,
 }
 
 
+/* Upper bound of image headers kept by the header cache */
+#define VIR_STORAGE_SOURCE_HEADER_CACHE_SIZE 128
+
+/*
+ * The header cache remembers the headers of local regular files, so that
+ * images shared by many domains, such as base images of backing chains,
+ * don't have to be read again whenever a domain using them starts or a
+ * pool containing them is refreshed. An entry is identified by the
+ * device, inode, size and timestamps of the file and by the user reading
+ * it, so that a modified or replaced file is never matched and nobody is
+ * given a header they would not be able to read.
+ */
+typedef struct _virStorageSourceHeaderCacheEntry virStorageSourceHeaderCacheEntry;
+struct _virStorageSourceHeaderCacheEntry {
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+    struct timespec ctime;
+    uid_t uid;
+    gid_t gid;
+
+    char *buf;
+    size_t len;
+};
+
+static virMutex virStorageSourceHeaderCacheLock = VIR_MUTEX_INITIALIZER;
+static GHashTable *virStorageSourceHeaderCache;
+/* entries in the order of insertion, evicted from the head */
+static GQueue virStorageSourceHeaderCacheQueue = G_QUEUE_INIT;
+
+
+static guint
+virStorageSourceHeaderCacheHash(const void *key)
+{
+    const virStorageSourceHeaderCacheEntry *entry = key;
+
+    return (guint) entry->ino ^ (guint) entry->dev ^ (guint) entry->size;
+}
+
+
+static gboolean
+virStorageSourceHeaderCacheEqual(const void *a,
+                                 const void *b)
+{
+    const virStorageSourceHeaderCacheEntry *x = a;
+    const virStorageSourceHeaderCacheEntry *y = b;
+
+    return x->dev == y->dev &&
+           x->ino == y->ino &&
+           x->size == y->size &&
+           x->mtime.tv_sec == y->mtime.tv_sec &&
+           x->mtime.tv_nsec == y->mtime.tv_nsec &&
+           x->ctime.tv_sec == y->ctime.tv_sec &&
+           x->ctime.tv_nsec == y->ctime.tv_nsec &&
+           x->uid == y->uid &&
+           x->gid == y->gid;
+}
+
+
+static void
+virStorageSourceHeaderCacheEntryFree(void *opaque)
+{
+    virStorageSourceHeaderCacheEntry *entry = opaque;
+
+    g_free(entry->buf);
+    g_free(entry);
+}
+
+
+static void
+virStorageSourceHeaderCacheKey(virStorageSourceHeaderCacheEntry *key,
+                               const struct stat *sb,
+                               uid_t uid,
+                               gid_t gid)
+{
+    key->dev = sb->st_dev;
+    key->ino = sb->st_ino;
+    key->size = sb->st_size;
+#ifdef __APPLE__
+    key->mtime = sb->st_mtimespec;
+    key->ctime = sb->st_ctimespec;
+#else /* ! __APPLE__ */
+    key->mtime = sb->st_mtim;
+    key->ctime = sb->st_ctim;
+#endif /* ! __APPLE__ */
+    key->uid = uid;
+    key->gid = gid;
+}
+
+
+/*
+ * Returns a copy of the cached header of the file described by @sb as read
+ * by @uid:@gid and fills in its length in @len, or NULL if it isn't known.
+ */
+static char *
+virStorageSourceHeaderCacheLookup(const struct stat *sb,
+                                  uid_t uid,
+                                  gid_t gid,
+                                  size_t *len)
+{
+    virStorageSourceHeaderCacheEntry key = { 0 };
+    virStorageSourceHeaderCacheEntry *entry;
+    char *buf;
+
+    if (!S_ISREG(sb->st_mode))
+        return NULL;
+
+    virStorageSourceHeaderCacheKey(&key, sb, uid, gid);
+
+    VIR_LOCK_GUARD lock = virLockGuardLock(&virStorageSourceHeaderCacheLock);
+
+    if (!virStorageSourceHeaderCache ||
+        !(entry = g_hash_table_lookup(virStorageSourceHeaderCache, &key)))
+        return NULL;
+
+    buf = g_new0(char, entry->len);
+    memcpy(buf, entry->buf, entry->len);
+    *len = entry->len;
+
+    return buf;
+}
+
+
+static void
+virStorageSourceHeaderCacheAdd(const struct stat *sb,
+                               uid_t uid,
+                               gid_t gid,
+                               const char *buf,
+                               size_t len)
+{
+    virStorageSourceHeaderCacheEntry *entry;
+    gint64 now = g_get_real_time() / G_USEC_PER_SEC;
+
+    if (!S_ISREG(sb->st_mode))
+        return;
+
+    entry = g_new0(virStorageSourceHeaderCacheEntry, 1);
+    virStorageSourceHeaderCacheKey(entry, sb, uid, gid);
+
+    /* Timestamps are updated with a coarse granularity, so a file changed
+     * recently could still be changed without its identity changing */
+    if (entry->mtime.tv_sec >= now - 1 || entry->ctime.tv_sec >= now - 1) {
+        virStorageSourceHeaderCacheEntryFree(entry);
+        return;
+    }
+    entry->buf = g_new0(char, len);
+    memcpy(entry->buf, buf, len);
+    entry->len = len;
+
+    VIR_LOCK_GUARD lock = virLockGuardLock(&virStorageSourceHeaderCacheLock);
+
+    if (!virStorageSourceHeaderCache) {
+        virStorageSourceHeaderCache = g_hash_table_new_full(virStorageSourceHeaderCacheHash,
+                                                            virStorageSourceHeaderCacheEqual,
+                                                            NULL,
+                                                            virStorageSourceHeaderCacheEntryFree);
+    }
+
+    if (g_hash_table_contains(virStorageSourceHeaderCache, entry)) {
+        virStorageSourceHeaderCacheEntryFree(entry);
+        return;
+    }
+
+    if (virStorageSourceHeaderCacheQueue.length >= VIR_STORAGE_SOURCE_HEADER_CACHE_SIZE) {
+        g_hash_table_remove(virStorageSourceHeaderCache,
+                            g_queue_pop_head(&virStorageSourceHeaderCacheQueue));
+    }
+
+    g_hash_table_add(virStorageSourceHeaderCache, entry);
+    g_queue_push_tail(&virStorageSourceHeaderCacheQueue, entry);
+}
+
+
 /**
  * virStorageSourceGetMetadataFromFD:
  *
@@ -155,6 +330,7 @@ virStorageSourceGetMetadataFromFD(const char *path,
 
 {
     ssize_t len = VIR_STORAGE_MAX_HEADER;
+    size_t cachedLen;
     struct stat sb;
     g_autofree char *buf = NULL;
     g_autoptr(virStorageSource) meta = NULL;
@@ -181,9 +357,17 @@ virStorageSourceGetMetadataFromFD(const char *path,
         return NULL;
     }
 
-    if ((len = virFileReadHeaderFD(fd, len, &buf)) < 0) {
-        virReportSystemError(errno, _("cannot read header '%s'"), meta->path);
-        return NULL;
+    if ((buf = virStorageSourceHeaderCacheLookup(&sb, geteuid(), getegid(),
+                                                 &cachedLen))) {
+        VIR_DEBUG("using cached header of '%s'", meta->path);
+        len = cachedLen;
+    } else {
+        if ((len = virFileReadHeaderFD(fd, len, &buf)) < 0) {
+            virReportSystemError(errno, _("cannot read header '%s'"), meta->path);
+            return NULL;
+        }
+
+        virStorageSourceHeaderCacheAdd(&sb, geteuid(), getegid(), buf, len);
     }
 
     if (virStorageFileProbeGetMetadata(meta, buf, len) < 0)
@@ -1265,6 +1449,8 @@ virStorageSourceGetMetadataRecurseReadHeader(virStorageSource *src,
 {
     int ret = -1;
     ssize_t len;
+    struct stat sb;
+    bool cacheable = false;
 
     if (virStorageSourceInitAs(src, uid, gid) < 0)
         return -1;
@@ -1274,9 +1460,27 @@ virStorageSourceGetMetadataRecurseReadHeader(virStorageSource *src,
         goto cleanup;
     }
 
+    /* only the identity of local files can be relied upon */
+    if (virStorageSourceIsLocalStorage(src) &&
+        virStorageSourceStat(src, &sb) == 0) {
+        cacheable = true;
+
+        if ((*buf = virStorageSourceHeaderCacheLookup(&sb, src->drv->uid,
+                                                      src->drv->gid,
+                                                      headerLen))) {
+            VIR_DEBUG("using cached header of '%s'", NULLSTR(src->path));
+            ret = 0;
+            goto cleanup;
+        }
+    }
+
     if ((len = virStorageSourceRead(src, 0, VIR_STORAGE_MAX_HEADER, buf)) < 0)
         goto cleanup;
 
+    if (cacheable)
+        virStorageSourceHeaderCacheAdd(&sb, src->drv->uid, src->drv->gid,
+                                       *buf, len);
+
     *headerLen = len;
     ret = 0;
 
@@ -121,6 +121,8 @@ struct _testDriver {
 typedef struct _testDriver testDriver;
 
 static testDriver *defaultPrivconn;
+static testDriver *syntheticPrivconn;
+static char *syntheticQuery;
 static virMutex defaultLock = VIR_MUTEX_INITIALIZER;
 
 static virClass *testDriverClass;
@@ -1439,6 +1441,357 @@ testOpenDefault(virConnectPtr conn)
     return VIR_DRV_OPEN_ERROR;
 }
 
+
+/* Size of the generated config of test:///synthetic */
+typedef struct _testSyntheticParams testSyntheticParams;
+struct _testSyntheticParams {
+    unsigned int domains;
+    unsigned int inactive;      /* how many of the domains are shut off */
+    unsigned int disks;         /* per domain */
+    unsigned int interfaces;    /* per domain */
+    unsigned int networks;
+    unsigned int pools;
+    unsigned int volumes;       /* spread across all pools */
+};
+
+static const struct {
+    const char *name;
+    size_t offset;
+    unsigned int max;
+} testSyntheticParamsInfo[] = {
+    { "domains", offsetof(testSyntheticParams, domains), 1000000 },
+    { "inactive", offsetof(testSyntheticParams, inactive), 1000000 },
+    { "disks", offsetof(testSyntheticParams, disks), 256 },
+    { "interfaces", offsetof(testSyntheticParams, interfaces), 64 },
+    { "networks", offsetof(testSyntheticParams, networks), 10000 },
+    { "pools", offsetof(testSyntheticParams, pools), 10000 },
+    { "volumes", offsetof(testSyntheticParams, volumes), 10000000 },
+};
+
+
+static int
+testSyntheticParseParams(virURI *uri,
+                         testSyntheticParams *params)
+{
+    size_t i;
+    size_t j;
+
+    params->domains = 100;
+    params->inactive = 0;
+    params->disks = 1;
+    params->interfaces = 1;
+    params->networks = 1;
+    params->pools = 1;
+    params->volumes = 0;
+
+    for (i = 0; i < uri->paramsCount; i++) {
+        virURIParam *param = &uri->params[i];
+        unsigned int *value = NULL;
+
+        if (param->ignore)
+            continue;
+
+        for (j = 0; j < G_N_ELEMENTS(testSyntheticParamsInfo); j++) {
+            if (STREQ(param->name, testSyntheticParamsInfo[j].name)) {
+                value = (unsigned int *)((char *)params +
+                                         testSyntheticParamsInfo[j].offset);
+                break;
+            }
+        }
+
+        if (!value) {
+            virReportError(VIR_ERR_INVALID_ARG,
+                           _("unknown parameter '%s' of synthetic config"),
+                           param->name);
+            return -1;
+        }
+
+        if (virStrToLong_uip(param->value, NULL, 10, value) < 0 ||
+            *value > testSyntheticParamsInfo[j].max) {
+            virReportError(VIR_ERR_INVALID_ARG,
+                           _("parameter '%s' must be a number up to %u"),
+                           param->name, testSyntheticParamsInfo[j].max);
+            return -1;
+        }
+    }
+
+    if (params->inactive > params->domains) {
+        virReportError(VIR_ERR_INVALID_ARG, "%s",
+                       _("more inactive domains than domains requested"));
+        return -1;
+    }
+
+    if (params->volumes && !params->pools) {
+        virReportError(VIR_ERR_INVALID_ARG, "%s",
+                       _("volumes require at least one pool"));
+        return -1;
+    }
+
+    if ((unsigned long long) params->domains * params->interfaces > 0xffffff) {
+        virReportError(VIR_ERR_INVALID_ARG, "%s",
+                       _("too many interfaces requested"));
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static char *
+testSyntheticDomainXML(const testSyntheticParams *params,
+                       size_t idx)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    size_t i;
+
+    virBufferAddLit(&buf, "<domain type='test'>\n");
+    virBufferAdjustIndent(&buf, 2);
+    virBufferAsprintf(&buf, "<name>synthetic-%zu</name>\n", idx);
+    virBufferAsprintf(&buf, "<uuid>00000000-0000-4000-8000-%012zx</uuid>\n", idx);
+    virBufferAddLit(&buf, "<memory unit='MiB'>1024</memory>\n");
+    virBufferAddLit(&buf, "<vcpu>2</vcpu>\n");
+    virBufferAddLit(&buf, "<os>\n  <type>hvm</type>\n</os>\n");
+    virBufferAddLit(&buf, "<devices>\n");
+    virBufferAdjustIndent(&buf, 2);
+
+    for (i = 0; i < params->disks; i++) {
+        g_autofree char *dev = virIndexToDiskName(i, "vd");
+
+        virBufferAddLit(&buf, "<disk type='file' device='disk'>\n");
+        virBufferAdjustIndent(&buf, 2);
+        virBufferAddLit(&buf, "<driver type='qcow2'/>\n");
+        virBufferAsprintf(&buf,
+                          "<source file='/var/lib/libvirt/images/synthetic-%zu-%s.qcow2'/>\n",
+                          idx, dev);
+        virBufferAsprintf(&buf, "<target dev='%s' bus='virtio'/>\n", dev);
+        virBufferAdjustIndent(&buf, -2);
+        virBufferAddLit(&buf, "</disk>\n");
+    }
+
+    for (i = 0; i < params->interfaces; i++) {
+        size_t mac = idx * params->interfaces + i;
+
+        if (params->networks) {
+            virBufferAddLit(&buf, "<interface type='network'>\n");
+            virBufferAsprintf(&buf, "  <source network='synthetic-%zu'/>\n",
+                              (idx + i) % params->networks);
+        } else {
+            virBufferAddLit(&buf, "<interface type='user'>\n");
+        }
+        virBufferAsprintf(&buf, "  <mac address='52:54:00:%02zx:%02zx:%02zx'/>\n",
+                          (mac >> 16) & 0xff, (mac >> 8) & 0xff, mac & 0xff);
+        virBufferAddLit(&buf, "  <model type='virtio'/>\n");
+        virBufferAddLit(&buf, "</interface>\n");
+    }
+
+    virBufferAdjustIndent(&buf, -2);
+    virBufferAddLit(&buf, "</devices>\n");
+    virBufferAdjustIndent(&buf, -2);
+    virBufferAddLit(&buf, "</domain>\n");
+
+    return virBufferContentAndReset(&buf);
+}
+
+
+static int
+testSyntheticAddDomains(testDriver *privconn,
+                        const testSyntheticParams *params)
+{
+    size_t i;
+
+    for (i = 0; i < params->domains; i++) {
+        g_autofree char *xml = testSyntheticDomainXML(params, i);
+        g_autoptr(virDomainDef) def = NULL;
+        virDomainObj *obj;
+
+        if (!(def = virDomainDefParseString(xml, privconn->xmlopt, NULL,
+                                            VIR_DOMAIN_DEF_PARSE_INACTIVE)))
+            return -1;
+
+        if (testDomainGenerateIfnames(def) < 0 ||
+            !(obj = virDomainObjListAdd(privconn->domains, &def,
+                                        privconn->xmlopt, 0, NULL)))
+            return -1;
+
+        obj->persistent = 1;
+
+        if (i < params->domains - params->inactive &&
+            testDomainStartState(privconn, obj,
+                                 VIR_DOMAIN_RUNNING_BOOTED) < 0) {
+            virDomainObjEndAPI(&obj);
+            return -1;
+        }
+
+        testDomainGenerateIOThreadInfos(obj);
+
+        virDomainObjEndAPI(&obj);
+    }
+
+    return 0;
+}
+
+
+static int
+testSyntheticAddNetworks(testDriver *privconn,
+                         const testSyntheticParams *params)
+{
+    size_t i;
+
+    for (i = 0; i < params->networks; i++) {
+        g_autofree char *xml = NULL;
+        g_autoptr(virNetworkDef) def = NULL;
+        virNetworkObj *obj;
+
+        xml = g_strdup_printf("<network>\n"
+                              "  <name>synthetic-%zu</name>\n"
+                              "  <forward mode='nat'/>\n"
+                              "  <bridge name='synbr%zu'/>\n"
+                              "  <ip address='10.%zu.%zu.1' netmask='255.255.255.0'>\n"
+                              "    <dhcp>\n"
+                              "      <range start='10.%zu.%zu.2' end='10.%zu.%zu.254'/>\n"
+                              "    </dhcp>\n"
+                              "  </ip>\n"
+                              "</network>\n",
+                              i, i,
+                              i >> 8, i & 0xff,
+                              i >> 8, i & 0xff,
+                              i >> 8, i & 0xff);
+
+        if (!(def = virNetworkDefParseString(xml, NULL, false)))
+            return -1;
+
+        if (!(obj = virNetworkObjAssignDef(privconn->networks, def, 0)))
+            return -1;
+        def = NULL;
+
+        virNetworkObjSetActive(obj, true);
+        virNetworkObjEndAPI(&obj);
+    }
+
+    return 0;
+}
+
+
+static int
+testSyntheticAddStorage(testDriver *privconn,
+                        const testSyntheticParams *params)
+{
+    g_autofree virStoragePoolObj **pools = NULL;
+    size_t i;
+    int ret = -1;
+
+    pools = g_new0(virStoragePoolObj *, params->pools);
+
+    for (i = 0; i < params->pools; i++) {
+        g_autofree char *xml = NULL;
+        virStoragePoolDef *def;
+
+        xml = g_strdup_printf("<pool type='dir'>\n"
+                              "  <name>synthetic-%zu</name>\n"
+                              "  <target>\n"
+                              "    <path>/var/lib/libvirt/synthetic-%zu</path>\n"
+                              "  </target>\n"
+                              "</pool>\n",
+                              i, i);
+
+        if (!(def = virStoragePoolDefParseString(xml, 0)))
+            goto cleanup;
+
+        if (!(pools[i] = virStoragePoolObjListAdd(privconn->pools, &def, 0))) {
+            virStoragePoolDefFree(def);
+            goto cleanup;
+        }
+
+        if (testStoragePoolObjSetDefaults(pools[i]) < 0)
+            goto cleanup;
+        virStoragePoolObjSetActive(pools[i], true);
+    }
+
+    for (i = 0; i < params->volumes; i++) {
+        virStoragePoolObj *obj = pools[i % params->pools];
+        virStoragePoolDef *def = virStoragePoolObjGetDef(obj);
+        g_autoptr(virStorageVolDef) volDef = NULL;
+        g_autofree char *xml = NULL;
+
+        xml = g_strdup_printf("<volume>\n"
+                              "  <name>synthetic-%zu.qcow2</name>\n"
+                              "  <capacity unit='GiB'>10</capacity>\n"
+                              "  <allocation>0</allocation>\n"
+                              "  <target>\n"
+                              "    <format type='qcow2'/>\n"
+                              "  </target>\n"
+                              "</volume>\n",
+                              i);
+
+        if (!(volDef = virStorageVolDefParseString(def, xml, 0)))
+            goto cleanup;
+
+        volDef->target.path = g_strdup_printf("%s/%s", def->target.path,
+                                              volDef->name);
+        volDef->key = g_strdup(volDef->target.path);
+
+        if (virStoragePoolObjAddVol(obj, volDef) < 0)
+            goto cleanup;
+        volDef = NULL;
+    }
+
+    ret = 0;
+
+ cleanup:
+    for (i = 0; i < params->pools; i++)
+        virStoragePoolObjEndAPI(&pools[i]);
+    return ret;
+}
+
+
+/* Simultaneous test:///synthetic connections with the same parameters
+ * share their state, just like test:///default ones. Generating the
+ * config takes a while for large sizes, so this also saves time. */
+static int
+testOpenSynthetic(virConnectPtr conn)
+{
+    testDriver *privconn = NULL;
+    testSyntheticParams params;
+    g_autofree char *query = virURIFormatParams(conn->uri);
+    VIR_LOCK_GUARD lock = virLockGuardLock(&defaultLock);
+
+    if (syntheticPrivconn && STREQ_NULLABLE(syntheticQuery, query)) {
+        conn->privateData = virObjectRef(syntheticPrivconn);
+        return VIR_DRV_OPEN_SUCCESS;
+    }
+
+    if (testSyntheticParseParams(conn->uri, &params) < 0)
+        return VIR_DRV_OPEN_ERROR;
+
+    if (!(privconn = testDriverNew()))
+        return VIR_DRV_OPEN_ERROR;
+
+    conn->privateData = privconn;
+
+    memmove(&privconn->nodeInfo, &defaultNodeInfo, sizeof(defaultNodeInfo));
+
+    if (!(privconn->caps = testBuildCapabilities(conn)))
+        goto error;
+
+    if (testSyntheticAddDomains(privconn, &params) < 0 ||
+        testSyntheticAddNetworks(privconn, &params) < 0 ||
+        testSyntheticAddStorage(privconn, &params) < 0)
+        goto error;
+
+    /* Only the first generated config is shared */
+    if (!syntheticPrivconn) {
+        syntheticPrivconn = privconn;
+        syntheticQuery = g_steal_pointer(&query);
+    }
+
+    return VIR_DRV_OPEN_SUCCESS;
+
+ error:
+    virObjectUnref(privconn);
+    conn->privateData = NULL;
+    return VIR_DRV_OPEN_ERROR;
+}
+
 static int
 testConnectAuthenticate(virConnectPtr conn,
                         virConnectAuthPtr auth)
@@ -1500,6 +1853,10 @@ testDriverCloseInternal(testDriver *driver)
     virObjectUnref(driver);
     if (testDriverDisposed && driver == defaultPrivconn)
         defaultPrivconn = NULL;
+    if (testDriverDisposed && driver == syntheticPrivconn) {
+        syntheticPrivconn = NULL;
+        VIR_FREE(syntheticQuery);
+    }
 }
 
 
@@ -1522,6 +1879,8 @@ testConnectOpen(virConnectPtr conn,
 
     if (STREQ(conn->uri->path, "/default"))
         ret = testOpenDefault(conn);
+    else if (STREQ(conn->uri->path, "/synthetic"))
+        ret = testOpenSynthetic(conn);
     else
         ret = testOpenFromFile(conn,
                                conn->uri->path);
@@ -1683,6 +2042,7 @@ testConnectSupportsFeature(virConnectPtr conn G_GNUC_UNUSED,
     case VIR_DRV_FEATURE_PROGRAM_KEEPALIVE:
     case VIR_DRV_FEATURE_REMOTE:
     case VIR_DRV_FEATURE_REMOTE_CLOSE_CALLBACK:
+    case VIR_DRV_FEATURE_REMOTE_COMPACT_DOMAIN_STATS:
     case VIR_DRV_FEATURE_REMOTE_EVENT_CALLBACK:
     default:
         return 0;
@@ -206,6 +206,33 @@ virBitmapClearBitExpand(virBitmap *bitmap,
 }
 
 
+/* Helper function. Sets bits @start to @last including, the caller must ensure
+ * @start <= @last < bitmap->nbits. The range is filled a word at a time. */
+static void
+virBitmapSetRange(virBitmap *bitmap,
+                  size_t start,
+                  size_t last)
+{
+    size_t nl = VIR_BITMAP_UNIT_OFFSET(start);
+    size_t ll = VIR_BITMAP_UNIT_OFFSET(last);
+    unsigned long head = -1UL << VIR_BITMAP_BIT_OFFSET(start);
+    unsigned long tail = -1UL >> (VIR_BITMAP_BITS_PER_UNIT - 1 -
+                                  VIR_BITMAP_BIT_OFFSET(last));
+
+    if (nl == ll) {
+        bitmap->map[nl] |= head & tail;
+        return;
+    }
+
+    bitmap->map[nl++] |= head;
+
+    for (; nl < ll; nl++)
+        bitmap->map[nl] = -1UL;
+
+    bitmap->map[ll] |= tail;
+}
+
+
 /* Helper function. caller must ensure b < bitmap->nbits */
 static bool
 virBitmapIsSet(virBitmap *bitmap, size_t b)
@@ -326,39 +353,30 @@ char *
 virBitmapFormat(virBitmap *bitmap)
 {
     g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
-    bool first = true;
-    int start, cur, prev;
-
-    if (!bitmap || (cur = virBitmapNextSetBit(bitmap, -1)) < 0) {
-        char *ret;
-        ret = g_strdup("");
-        return ret;
-    }
-
-    start = prev = cur;
-    while (prev >= 0) {
-        cur = virBitmapNextSetBit(bitmap, prev);
-
-        if (cur == prev + 1) {
-            prev = cur;
-            continue;
-        }
-
-        /* cur < 0 or cur > prev + 1 */
-
-        if (!first)
-            virBufferAddLit(&buf, ",");
-        else
-            first = false;
-
-        if (prev == start)
-            virBufferAsprintf(&buf, "%d", start);
+    ssize_t start;
+    ssize_t last;
+
+    if (!bitmap || (start = virBitmapNextSetBit(bitmap, -1)) < 0)
+        return g_strdup("");
+
+    /* Find runs of set bits by looking for the next clear and the next set
+     * bit, both skip whole words, so large ranges like 0-511 don't cost a
+     * step per bit. */
+    while (start >= 0) {
+        if ((last = virBitmapNextClearBit(bitmap, start)) < 0)
+            last = bitmap->nbits;
+        last--;
+
+        if (last == start)
+            virBufferAsprintf(&buf, "%zd,", start);
         else
-            virBufferAsprintf(&buf, "%d-%d", start, prev);
+            virBufferAsprintf(&buf, "%zd-%zd,", start, last);
 
-        start = prev = cur;
+        start = virBitmapNextSetBit(bitmap, last);
     }
 
+    virBufferTrim(&buf, ",");
+
     return virBufferContentAndReset(&buf);
 }
 
@@ -386,7 +404,6 @@ virBitmapParseInternal(const char *str,
     bool neg = false;
     const char *cur = str;
     char *tmp;
-    size_t i;
     int start, last;
 
     if (!str)
@@ -451,15 +468,15 @@ virBitmapParseInternal(const char *str,
 
             cur = tmp;
 
-            for (i = start; i <= last; i++) {
-                if (limited) {
-                    if (virBitmapSetBit(bitmap, i) < 0)
-                        goto error;
-                } else {
-                    virBitmapSetBitExpand(bitmap, i);
-                }
+            if (last >= bitmap->nbits) {
+                if (limited)
+                    goto error;
+
+                virBitmapExpand(bitmap, last);
             }
 
+            virBitmapSetRange(bitmap, start, last);
+
             virSkipSpaces(&cur);
         }
 
@@ -858,7 +875,6 @@ virBitmapNextSetBit(virBitmap *bitmap,
 ssize_t
 virBitmapLastSetBit(virBitmap *bitmap)
 {
-    ssize_t i;
     int unusedBits;
     ssize_t sz;
     unsigned long bits;
@@ -888,12 +904,8 @@ virBitmapLastSetBit(virBitmap *bitmap)
     return -1;
 
  found:
-    for (i = VIR_BITMAP_BITS_PER_UNIT - 1; i >= 0; i--) {
-        if (bits & 1UL << i)
-            return i + sz * VIR_BITMAP_BITS_PER_UNIT;
-    }
-
-    return -1;
+    return VIR_BITMAP_BITS_PER_UNIT - 1 - __builtin_clzl(bits) +
+           sz * VIR_BITMAP_BITS_PER_UNIT;
 }
 
 
@@ -21,10 +21,25 @@
 #include <config.h>
 
 #include <stdarg.h>
+#include <gio/gio.h>
 
 #include "virbuffer.h"
 #include "virstring.h"
 #include "viralloc.h"
+#include "virfile.h"
+
+/* Default amount of content buffered before it is passed to a sink */
+#define VIR_BUFFER_SINK_CHUNK (64 * 1024)
+
+struct _virBufferSink {
+    size_t chunk;
+    virBufferSinkWriteFunc writeFunc;
+    virBufferSinkCloseFunc closeFunc;
+    void *opaque;
+    GDestroyNotify freeFunc;
+
+    int error; /* errno of the first failed write, content is dropped since */
+};
 
 #define VIR_FROM_THIS VIR_FROM_NONE
 
@@ -143,6 +158,48 @@ virBufferApplyIndent(virBuffer *buf)
 }
 
 
+static void
+virBufferSinkWrite(virBufferSink *sink,
+                   const char *data,
+                   size_t len)
+{
+    if (sink->error || len == 0)
+        return;
+
+    if (sink->writeFunc(data, len, sink->opaque) < 0)
+        sink->error = errno ? errno : EIO;
+}
+
+
+/**
+ * virBufferFlushSink:
+ * @buf: the buffer
+ *
+ * Passes the content of @buf up to the last complete line to its sink
+ * once there is at least a chunk of it. The current line stays in the
+ * buffer so that trimming and auto-indentation work as without a sink.
+ */
+static void
+virBufferFlushSink(virBuffer *buf)
+{
+    size_t len;
+
+    if (!buf->sink || !buf->str || buf->str->len < buf->sink->chunk)
+        return;
+
+    for (len = buf->str->len - 1; len > 0; len--) {
+        if (buf->str->str[len] == '\n')
+            break;
+    }
+
+    if (len == 0)
+        return;
+
+    virBufferSinkWrite(buf->sink, buf->str->str, len);
+    g_string_erase(buf->str, 0, len);
+}
+
+
 /**
  * virBufferAdd:
  * @buf: the buffer to append to
@@ -166,6 +223,8 @@ virBufferAdd(virBuffer *buf, const char *str, int len)
         g_string_append(buf->str, str);
     else
         g_string_append_len(buf->str, str, len);
+
+    virBufferFlushSink(buf);
 }
 
 /**
@@ -188,6 +247,7 @@ virBufferAddBuffer(virBuffer *buf, virBuffer *toadd)
     if (buf) {
         virBufferInitialize(buf);
         g_string_append_len(buf->str, toadd->str->str, toadd->str->len);
+        virBufferFlushSink(buf);
     }
 
     virBufferFreeAndReset(toadd);
@@ -213,7 +273,8 @@ virBufferAddChar(virBuffer *buf, char c)
  *
  * Get the current content from the buffer.  The content is only valid
  * until the next operation on @buf, and an empty string is returned if
- * no content is present yet.
+ * no content is present yet. If @buf has a sink, only the content not
+ * yet passed to the sink is returned.
  *
  * Returns the buffer content or NULL in case of error.
  */
@@ -289,6 +350,42 @@ virBufferUse(const virBuffer *buf)
     return buf->str->len;
 }
 
+/**
+ * virBufferSizeHint:
+ * @buf: the buffer
+ * @len: expected length of the content
+ *
+ * Preallocates @buf for @len bytes of content, e.g. the length of the
+ * same document when it was formatted the last time, so that it doesn't
+ * need to be reallocated repeatedly as it grows. The content of @buf is
+ * not changed. For buffers with a sink the preallocation is limited to
+ * what is buffered before passing it to the sink.
+ */
+void
+virBufferSizeHint(virBuffer *buf,
+                  size_t len)
+{
+    gsize used;
+
+    if (!buf || len == 0)
+        return;
+
+    if (buf->sink)
+        len = MIN(len, buf->sink->chunk * 2);
+
+    if (!buf->str) {
+        buf->str = g_string_sized_new(len);
+        return;
+    }
+
+    if (buf->str->allocated_len > len)
+        return;
+
+    used = buf->str->len;
+    g_string_set_size(buf->str, len);
+    g_string_truncate(buf->str, used);
+}
+
 /**
  * virBufferAsprintf:
  * @buf: the buffer to append to
@@ -324,6 +421,8 @@ virBufferVasprintf(virBuffer *buf, const char *format, va_list argptr)
     virBufferApplyIndent(buf);
 
     g_string_append_vprintf(buf->str, format, argptr);
+
+    virBufferFlushSink(buf);
 }
 
 
@@ -539,6 +638,8 @@ virBufferURIEncodeString(virBuffer *buf, const char *str)
     virBufferApplyIndent(buf);
 
     g_string_append_uri_escaped(buf->str, str, NULL, false);
+
+    virBufferFlushSink(buf);
 }
 
 /**
@@ -729,3 +830,252 @@ virBufferAddStr(virBuffer *buf,
         }
     }
 }
+
+
+/**
+ * virBufferSinkNew:
+ * @chunk: amount of buffered content to pass to the sink at once, 0 for
+ *         the default
+ * @writeFunc: callback writing data
+ * @closeFunc: optional callback called by virBufferSinkFinish
+ * @opaque: data passed to the callbacks
+ * @freeFunc: optional callback freeing @opaque
+ *
+ * Creates a sink passing content of a buffer to @writeFunc, e.g. to
+ * queue it as chunks of an RPC stream. Formatting of a large document
+ * then doesn't need to keep all of it in memory.
+ *
+ * Returns the new sink, free with virBufferSinkFree.
+ */
+virBufferSink *
+virBufferSinkNew(size_t chunk,
+                 virBufferSinkWriteFunc writeFunc,
+                 virBufferSinkCloseFunc closeFunc,
+                 void *opaque,
+                 GDestroyNotify freeFunc)
+{
+    virBufferSink *sink = g_new0(virBufferSink, 1);
+
+    sink->chunk = chunk ? chunk : VIR_BUFFER_SINK_CHUNK;
+    sink->writeFunc = writeFunc;
+    sink->closeFunc = closeFunc;
+    sink->opaque = opaque;
+    sink->freeFunc = freeFunc;
+
+    return sink;
+}
+
+
+static int
+virBufferSinkFDWrite(const char *data,
+                     size_t len,
+                     void *opaque)
+{
+    int fd = GPOINTER_TO_INT(opaque);
+
+    if (safewrite(fd, data, len) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+/**
+ * virBufferSinkNewFD:
+ * @fd: file descriptor to write to
+ *
+ * Creates a sink writing content of a buffer to @fd. The caller keeps
+ * owning @fd.
+ *
+ * Returns the new sink, free with virBufferSinkFree.
+ */
+virBufferSink *
+virBufferSinkNewFD(int fd)
+{
+    return virBufferSinkNew(0, virBufferSinkFDWrite, NULL,
+                            GINT_TO_POINTER(fd), NULL);
+}
+
+
+typedef struct _virBufferSinkGzip virBufferSinkGzip;
+struct _virBufferSinkGzip {
+    GConverter *compressor;
+    virBufferSink *next;
+};
+
+
+static void
+virBufferSinkGzipFree(void *opaque)
+{
+    virBufferSinkGzip *gz = opaque;
+
+    g_clear_object(&gz->compressor);
+    virBufferSinkFree(gz->next);
+    g_free(gz);
+}
+
+
+static int
+virBufferSinkGzipConvert(virBufferSinkGzip *gz,
+                         const char *data,
+                         size_t len,
+                         GConverterFlags flags)
+{
+    char out[16 * 1024];
+
+    while (true) {
+        g_autoptr(GError) err = NULL;
+        gsize nread = 0;
+        gsize nwritten = 0;
+        GConverterResult res;
+
+        res = g_converter_convert(gz->compressor, data, len, out, sizeof(out),
+                                  flags, &nread, &nwritten, &err);
+        if (res == G_CONVERTER_ERROR) {
+            errno = EIO;
+            return -1;
+        }
+
+        virBufferSinkWrite(gz->next, out, nwritten);
+        if (gz->next->error) {
+            errno = gz->next->error;
+            return -1;
+        }
+
+        data += nread;
+        len -= nread;
+
+        if (res == G_CONVERTER_FINISHED ||
+            (len == 0 && !(flags & G_CONVERTER_INPUT_AT_END)))
+            return 0;
+    }
+}
+
+
+static int
+virBufferSinkGzipWrite(const char *data,
+                       size_t len,
+                       void *opaque)
+{
+    return virBufferSinkGzipConvert(opaque, data, len, G_CONVERTER_NO_FLAGS);
+}
+
+
+static int
+virBufferSinkGzipClose(void *opaque)
+{
+    virBufferSinkGzip *gz = opaque;
+
+    if (virBufferSinkGzipConvert(gz, NULL, 0, G_CONVERTER_INPUT_AT_END) < 0)
+        return -1;
+
+    if (gz->next->closeFunc && gz->next->closeFunc(gz->next->opaque) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+/**
+ * virBufferSinkNewGzip:
+ * @next: sink receiving the compressed data
+ *
+ * Creates a sink compressing content of a buffer in gzip format and
+ * passing it to @next, which is consumed.
+ *
+ * Returns the new sink, free with virBufferSinkFree.
+ */
+virBufferSink *
+virBufferSinkNewGzip(virBufferSink *next)
+{
+    virBufferSinkGzip *gz = g_new0(virBufferSinkGzip, 1);
+
+    gz->compressor = G_CONVERTER(g_zlib_compressor_new(G_ZLIB_COMPRESSOR_FORMAT_GZIP, -1));
+    gz->next = next;
+
+    return virBufferSinkNew(next->chunk,
+                            virBufferSinkGzipWrite,
+                            virBufferSinkGzipClose,
+                            gz,
+                            virBufferSinkGzipFree);
+}
+
+
+/**
+ * virBufferSinkFree:
+ * @sink: the sink
+ *
+ * Frees @sink. Buffers using it must not be used anymore.
+ */
+void
+virBufferSinkFree(virBufferSink *sink)
+{
+    if (!sink)
+        return;
+
+    if (sink->freeFunc)
+        sink->freeFunc(sink->opaque);
+
+    g_free(sink);
+}
+
+
+/**
+ * virBufferSetSink:
+ * @buf: the buffer
+ * @sink: the sink
+ *
+ * Makes @buf pass its content to @sink as it grows, instead of keeping
+ * all of it. Only complete lines are passed so that trimming and
+ * auto-indentation of the current line keep working. The content which
+ * was passed to the sink can't be retrieved from @buf anymore.
+ *
+ * Call virBufferSinkFinish once done to pass the rest of the content and
+ * learn about errors of the sink. The caller keeps owning @sink, which
+ * must outlive use of @buf.
+ */
+void
+virBufferSetSink(virBuffer *buf,
+                 virBufferSink *sink)
+{
+    buf->sink = sink;
+    virBufferFlushSink(buf);
+}
+
+
+/**
+ * virBufferSinkFinish:
+ * @buf: the buffer
+ *
+ * Passes all remaining content of @buf to its sink and closes the sink.
+ * @buf is left empty and without a sink.
+ *
+ * Returns 0 on success, -1 with errno set if writing any of the content
+ * to the sink failed.
+ */
+int
+virBufferSinkFinish(virBuffer *buf)
+{
+    virBufferSink *sink = buf->sink;
+
+    if (!sink)
+        return 0;
+
+    if (buf->str) {
+        virBufferSinkWrite(sink, buf->str->str, buf->str->len);
+        g_string_truncate(buf->str, 0);
+    }
+
+    buf->sink = NULL;
+
+    if (!sink->error && sink->closeFunc &&
+        sink->closeFunc(sink->opaque) < 0)
+        sink->error = errno ? errno : EIO;
+
+    if (sink->error) {
+        errno = sink->error;
+        return -1;
+    }
+
+    return 0;
+}
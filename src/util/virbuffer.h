@@ -32,6 +32,13 @@
  */
 typedef struct _virBuffer virBuffer;
 
+/**
+ * virBufferSink:
+ *
+ * Destination a virBuffer streams its content to, see virBufferSetSink.
+ */
+typedef struct _virBufferSink virBufferSink;
+
 #define VIR_BUFFER_INITIALIZER { NULL, 0 }
 
 /**
@@ -46,6 +53,7 @@ typedef struct _virBuffer virBuffer;
 struct _virBuffer {
     GString *str;
     int indent;
+    virBufferSink *sink;
 };
 
 const char *virBufferCurrentContent(virBuffer *buf);
@@ -55,6 +63,7 @@ void virBufferFreeAndReset(virBuffer *buf);
 G_DEFINE_AUTO_CLEANUP_CLEAR_FUNC(virBuffer, virBufferFreeAndReset);
 
 size_t virBufferUse(const virBuffer *buf);
+void virBufferSizeHint(virBuffer *buf, size_t len);
 void virBufferAdd(virBuffer *buf, const char *str, int len);
 void virBufferAddBuffer(virBuffer *buf, virBuffer *toadd);
 void virBufferAddChar(virBuffer *buf, char c);
@@ -94,3 +103,38 @@ void virBufferTrim(virBuffer *buf, const char *trim);
 void virBufferTrimChars(virBuffer *buf, const char *trim);
 void virBufferTrimLen(virBuffer *buf, int len);
 void virBufferAddStr(virBuffer *buf, const char *str);
+
+/**
+ * virBufferSinkWriteFunc:
+ * @data: data to write
+ * @len: length of @data
+ * @opaque: opaque data of the sink
+ *
+ * Returns 0 on success, -1 with errno set on error.
+ */
+typedef int (*virBufferSinkWriteFunc)(const char *data,
+                                      size_t len,
+                                      void *opaque);
+
+/**
+ * virBufferSinkCloseFunc:
+ * @opaque: opaque data of the sink
+ *
+ * Called by virBufferSinkFinish after all data was written.
+ *
+ * Returns 0 on success, -1 with errno set on error.
+ */
+typedef int (*virBufferSinkCloseFunc)(void *opaque);
+
+virBufferSink *virBufferSinkNew(size_t chunk,
+                                virBufferSinkWriteFunc writeFunc,
+                                virBufferSinkCloseFunc closeFunc,
+                                void *opaque,
+                                GDestroyNotify freeFunc);
+virBufferSink *virBufferSinkNewFD(int fd);
+virBufferSink *virBufferSinkNewGzip(virBufferSink *next);
+void virBufferSinkFree(virBufferSink *sink);
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(virBufferSink, virBufferSinkFree);
+
+void virBufferSetSink(virBuffer *buf, virBufferSink *sink);
+int virBufferSinkFinish(virBuffer *buf);
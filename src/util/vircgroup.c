@@ -63,6 +63,11 @@ VIR_ENUM_IMPL(virCgroupController,
               "name=systemd",
 );
 
+VIR_ENUM_IMPL(virCgroupPressureResource,
+              VIR_CGROUP_PRESSURE_LAST,
+              "cpu", "memory", "io",
+);
+
 
 /**
  * virCgroupGetDevicePermsString:
@@ -564,6 +569,115 @@ virCgroupGetValueRaw(const char *path,
 }
 
 
+/* Files which are written to move tasks or to trigger an action rather
+ * than to set a value. Writing them is never skipped. */
+static const char *virCgroupActionFiles[] = {
+    "cgroup.kill",
+    "cgroup.procs",
+    "cgroup.threads",
+    "tasks",
+    NULL
+};
+
+
+static void
+virCgroupCachedFileFree(void *opaque)
+{
+    int *fd = opaque;
+
+    VIR_FORCE_CLOSE(*fd);
+    g_free(fd);
+}
+
+
+/**
+ * virCgroupSetValueCached:
+ * @group: the cgroup owning the directory cache
+ * @path: path of the file to write
+ * @value: value to write
+ *
+ * Writes @value to @path relative to a descriptor of its directory cached
+ * in @group, opening it on first use, so that setting up the many tunables
+ * of a domain and its vCPU, emulator and IOThread cgroups doesn't look up
+ * the same directories over and over. The write is skipped if the file
+ * already reads as @value. On failure the directory is dropped from the
+ * cache so that a cgroup which was removed and created again is not
+ * accessed through a stale descriptor.
+ *
+ * Returns 0 on success, or -1 with errno set and no error reported; the
+ * caller is expected to fall back to an uncached write.
+ */
+static int
+virCgroupSetValueCached(virCgroup *group,
+                        const char *path,
+                        const char *value)
+{
+    g_autoptr(GMutexLocker) locker = g_mutex_locker_new(&group->filesLock);
+    g_autofree char *dir = NULL;
+    const char *name;
+    VIR_AUTOCLOSE fd = -1;
+    int *dirfd;
+
+    if (!(name = strrchr(path, '/'))) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    dir = g_strndup(path, name - path);
+    name++;
+
+    if (!group->dirs)
+        group->dirs = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                            g_free, virCgroupCachedFileFree);
+
+    if (!(dirfd = g_hash_table_lookup(group->dirs, dir))) {
+        int newfd;
+
+        if ((newfd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0)
+            return -1;
+
+        dirfd = g_new0(int, 1);
+        *dirfd = newfd;
+        g_hash_table_insert(group->dirs, g_strdup(dir), dirfd);
+    }
+
+    if (!g_strv_contains(virCgroupActionFiles, name) &&
+        (fd = openat(*dirfd, name, O_RDONLY | O_CLOEXEC)) >= 0) {
+        char buf[1024];
+        ssize_t got = saferead(fd, buf, sizeof(buf));
+
+        VIR_FORCE_CLOSE(fd);
+
+        if (got > 0 && (size_t) got < sizeof(buf)) {
+            buf[got] = '\0';
+            if (buf[got - 1] == '\n')
+                buf[got - 1] = '\0';
+
+            if (STREQ(buf, value)) {
+                VIR_DEBUG("Value of '%s' is already '%s'", path, value);
+                return 0;
+            }
+        }
+    }
+
+    if ((fd = openat(*dirfd, name, O_WRONLY | O_TRUNC | O_CLOEXEC)) < 0)
+        goto error;
+
+    if (safewrite(fd, value, strlen(value)) < 0)
+        goto error;
+
+    if (VIR_CLOSE(fd) < 0)
+        goto error;
+
+    return 0;
+
+ error:
+    VIR_FORCE_CLOSE(fd);
+    g_hash_table_remove(group->dirs, dir);
+    return -1;
+}
+
+
 int
 virCgroupSetValueStr(virCgroup *group,
                      int controller,
@@ -575,10 +689,126 @@ virCgroupSetValueStr(virCgroup *group,
     if (virCgroupPathOfController(group, controller, key, &keypath) < 0)
         return -1;
 
+    VIR_DEBUG("Set cached value '%s' to '%s'", keypath, value);
+
+    if (virCgroupSetValueCached(group, keypath, value) == 0)
+        return 0;
+
+    VIR_DEBUG("Cached write of %s failed: %s", keypath, g_strerror(errno));
+
     return virCgroupSetValueRaw(keypath, value);
 }
 
 
+/* Statistics files which are polled periodically. Their file descriptors
+ * are kept open on the virCgroup so that each read costs a single pread()
+ * rather than a path lookup, open() and close(). */
+static const char *virCgroupCachedFiles[] = {
+    "blkio.throttle.io_service_bytes",
+    "blkio.throttle.io_serviced",
+    "cpu.stat",
+    "cpuacct.stat",
+    "cpuacct.usage",
+    "cpuacct.usage_percpu",
+    "io.stat",
+    "memory.current",
+    "memory.stat",
+    "memory.usage_in_bytes",
+    NULL
+};
+
+#define VIR_CGROUP_READ_MAX (1024 * 1024)
+
+
+/**
+ * virCgroupGetValueCached:
+ * @group: the cgroup owning the file cache
+ * @path: path of the file to read
+ * @value: filled with the contents of the file
+ *
+ * Reads @path from the start using a file descriptor cached in @group,
+ * opening it on first use. On failure the descriptor is dropped from the
+ * cache so that a file removed together with its cgroup is not retried.
+ *
+ * Returns the number of bytes read, or -1 with errno set and no error
+ * reported; the caller is expected to fall back to an uncached read.
+ */
+static int
+virCgroupGetValueCached(virCgroup *group,
+                        const char *path,
+                        char **value)
+{
+    g_autoptr(GMutexLocker) locker = g_mutex_locker_new(&group->filesLock);
+    g_autofree char *buf = NULL;
+    size_t size = 0;
+    size_t len = 0;
+    int *fd;
+
+    if (!group->files)
+        group->files = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                             g_free, virCgroupCachedFileFree);
+
+    if (!(fd = g_hash_table_lookup(group->files, path))) {
+        int newfd;
+
+        if ((newfd = open(path, O_RDONLY | O_CLOEXEC)) < 0)
+            return -1;
+
+        fd = g_new0(int, 1);
+        *fd = newfd;
+        g_hash_table_insert(group->files, g_strdup(path), fd);
+    }
+
+    while (true) {
+        ssize_t got;
+
+        if (len + 1 >= size) {
+            if (size >= VIR_CGROUP_READ_MAX) {
+                errno = EFBIG;
+                goto error;
+            }
+            size = size ? size * 2 : 4096;
+            buf = g_realloc(buf, size);
+        }
+
+        if ((got = pread(*fd, buf + len, size - len - 1, len)) < 0) {
+            if (errno == EINTR)
+                continue;
+            goto error;
+        }
+
+        if (got == 0)
+            break;
+
+        len += got;
+    }
+
+    buf[len] = '\0';
+    *value = g_steal_pointer(&buf);
+    return len;
+
+ error:
+    g_hash_table_remove(group->files, path);
+    return -1;
+}
+
+
+/**
+ * virCgroupDropCachedFiles:
+ * @group: the cgroup
+ *
+ * Closes all file and directory descriptors cached in @group.
+ */
+static void
+virCgroupDropCachedFiles(virCgroup *group)
+{
+    g_autoptr(GMutexLocker) locker = g_mutex_locker_new(&group->filesLock);
+
+    g_clear_pointer(&group->files, g_hash_table_unref);
+    g_clear_pointer(&group->dirs, g_hash_table_unref);
+}
+
+
 int
 virCgroupGetValueStr(virCgroup *group,
                      int controller,
@@ -590,6 +820,20 @@ virCgroupGetValueStr(virCgroup *group,
     if (virCgroupPathOfController(group, controller, key, &keypath) < 0)
         return -1;
 
+    if (g_strv_contains(virCgroupCachedFiles, key)) {
+        int rc;
+
+        VIR_DEBUG("Get cached value %s", keypath);
+
+        if ((rc = virCgroupGetValueCached(group, keypath, value)) >= 0) {
+            if (rc > 0 && (*value)[rc - 1] == '\n')
+                (*value)[rc - 1] = '\0';
+            return 0;
+        }
+
+        VIR_DEBUG("Cached read of %s failed: %s", keypath, g_strerror(errno));
+    }
+
     return virCgroupGetValueRaw(keypath, value);
 }
 
@@ -748,6 +992,7 @@ virCgroupNew(const char *path,
 
     *group = NULL;
     newGroup = g_new0(virCgroup, 1);
+    g_mutex_init(&newGroup->filesLock);
 
     if (virCgroupSetBackends(newGroup) < 0)
         return -1;
@@ -895,6 +1140,8 @@ virCgroupNewFromParent(virCgroup *parent,
 {
     g_autoptr(virCgroup) new = g_new0(virCgroup, 1);
 
+    g_mutex_init(&new->filesLock);
+
     VIR_DEBUG("parent=%p path=%s controllers=%d group=%p",
               parent, path, controllers, group);
 
@@ -1143,6 +1390,8 @@ virCgroupNewDetect(pid_t pid,
 {
     g_autoptr(virCgroup) new = g_new0(virCgroup, 1);
 
+    g_mutex_init(&new->filesLock);
+
     VIR_DEBUG("pid=%lld controllers=%d group=%p",
               (long long) pid, controllers, group);
 
@@ -2621,6 +2870,10 @@ virCgroupRemove(virCgroup *group)
 {
     size_t i;
 
+    virCgroupDropCachedFiles(group);
+    if (group->nested)
+        virCgroupDropCachedFiles(group->nested);
+
     for (i = 0; i < VIR_CGROUP_BACKEND_TYPE_LAST; i++) {
         if (group->backends[i]) {
             int rc = group->backends[i]->remove(group);
@@ -2907,6 +3160,79 @@ virCgroupGetFreezerState(virCgroup *group, char **state)
 }
 
 
+/**
+ * virCgroupPressureResourceController:
+ * @resource: pressure stall information resource
+ *
+ * Returns the controller owning the pressure file of @resource.
+ */
+int
+virCgroupPressureResourceController(virCgroupPressureResource resource)
+{
+    switch (resource) {
+    case VIR_CGROUP_PRESSURE_CPU:
+        return VIR_CGROUP_CONTROLLER_CPU;
+    case VIR_CGROUP_PRESSURE_MEMORY:
+        return VIR_CGROUP_CONTROLLER_MEMORY;
+    case VIR_CGROUP_PRESSURE_IO:
+    case VIR_CGROUP_PRESSURE_LAST:
+        break;
+    }
+
+    return VIR_CGROUP_CONTROLLER_BLKIO;
+}
+
+
+/**
+ * virCgroupGetPressure:
+ * @group: the cgroup
+ * @resource: resource to get pressure stall information of
+ * @some: filled with the stalls of some of the tasks of @group
+ * @full: filled with the stalls of all non-idle tasks of @group
+ * @hasFull: set to whether @full was reported
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virCgroupGetPressure(virCgroup *group,
+                     virCgroupPressureResource resource,
+                     virCgroupPressure *some,
+                     virCgroupPressure *full,
+                     bool *hasFull)
+{
+    virCgroup *parent = virCgroupGetNested(group);
+
+    VIR_CGROUP_BACKEND_CALL(parent, virCgroupPressureResourceController(resource),
+                            getPressure, -1, resource, some, full, hasFull);
+}
+
+
+/**
+ * virCgroupOpenPressureTrigger:
+ * @group: the cgroup
+ * @resource: resource to watch
+ * @trigger: trigger as understood by the kernel, e.g. "some 150000 1000000"
+ *           for a stall of 150ms within a 1s window
+ *
+ * Registers a pressure stall information trigger of @group. The returned
+ * file descriptor gets a priority event (POLLPRI) whenever the trigger
+ * fires and an error once @group is removed. The trigger is unregistered
+ * by closing it.
+ *
+ * Returns a file descriptor on success, -1 on error.
+ */
+int
+virCgroupOpenPressureTrigger(virCgroup *group,
+                             virCgroupPressureResource resource,
+                             const char *trigger)
+{
+    virCgroup *parent = virCgroupGetNested(group);
+
+    VIR_CGROUP_BACKEND_CALL(parent, virCgroupPressureResourceController(resource),
+                            openPressureTrigger, -1, resource, trigger);
+}
+
+
 int
 virCgroupBindMount(virCgroup *group, const char *oldroot,
                    const char *mountopts)
@@ -3728,6 +4054,30 @@ virCgroupGetFreezerState(virCgroup *group G_GNUC_UNUSED,
 }
 
 
+int
+virCgroupGetPressure(virCgroup *group G_GNUC_UNUSED,
+                     virCgroupPressureResource resource G_GNUC_UNUSED,
+                     virCgroupPressure *some G_GNUC_UNUSED,
+                     virCgroupPressure *full G_GNUC_UNUSED,
+                     bool *hasFull G_GNUC_UNUSED)
+{
+    virReportSystemError(ENOSYS, "%s",
+                         _("Control groups not supported on this platform"));
+    return -1;
+}
+
+
+int
+virCgroupOpenPressureTrigger(virCgroup *group G_GNUC_UNUSED,
+                             virCgroupPressureResource resource G_GNUC_UNUSED,
+                             const char *trigger G_GNUC_UNUSED)
+{
+    virReportSystemError(ENOSYS, "%s",
+                         _("Control groups not supported on this platform"));
+    return -1;
+}
+
+
 int
 virCgroupBindMount(virCgroup *group G_GNUC_UNUSED,
                    const char *oldroot G_GNUC_UNUSED,
@@ -3820,6 +4170,12 @@ virCgroupFree(virCgroup *group)
     g_free(group->unified.placement);
     g_free(group->unitName);
 
+    if (group->files)
+        g_hash_table_unref(group->files);
+    if (group->dirs)
+        g_hash_table_unref(group->dirs);
+    g_mutex_clear(&group->filesLock);
+
     virCgroupFree(group->nested);
 
     g_free(group);
@@ -254,6 +254,35 @@ int virCgroupGetCpuacctStat(virCgroup *group, unsigned long long *user,
 int virCgroupSetFreezerState(virCgroup *group, const char *state);
 int virCgroupGetFreezerState(virCgroup *group, char **state);
 
+typedef enum {
+    VIR_CGROUP_PRESSURE_CPU,
+    VIR_CGROUP_PRESSURE_MEMORY,
+    VIR_CGROUP_PRESSURE_IO,
+
+    VIR_CGROUP_PRESSURE_LAST
+} virCgroupPressureResource;
+
+VIR_ENUM_DECL(virCgroupPressureResource);
+
+typedef struct _virCgroupPressure virCgroupPressure;
+struct _virCgroupPressure {
+    /* percentage of time tasks were stalled over the last 10, 60 and
+     * 300 seconds */
+    double avg10;
+    double avg60;
+    double avg300;
+    unsigned long long total; /* total stall time in microseconds */
+};
+
+int virCgroupGetPressure(virCgroup *group,
+                         virCgroupPressureResource resource,
+                         virCgroupPressure *some,
+                         virCgroupPressure *full,
+                         bool *hasFull);
+int virCgroupOpenPressureTrigger(virCgroup *group,
+                                 virCgroupPressureResource resource,
+                                 const char *trigger);
+
 int virCgroupSetCpusetMems(virCgroup *group, const char *mems);
 int virCgroupGetCpusetMems(virCgroup *group, char **mems);
 
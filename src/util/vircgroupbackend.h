@@ -345,6 +345,18 @@ typedef int
 (*virCgroupGetFreezerStateCB)(virCgroup *group,
                               char **state);
 
+typedef int
+(*virCgroupGetPressureCB)(virCgroup *group,
+                          virCgroupPressureResource resource,
+                          virCgroupPressure *some,
+                          virCgroupPressure *full,
+                          bool *hasFull);
+
+typedef int
+(*virCgroupOpenPressureTriggerCB)(virCgroup *group,
+                                  virCgroupPressureResource resource,
+                                  const char *trigger);
+
 typedef int
 (*virCgroupSetCpusetMemsCB)(virCgroup *group,
                             const char *mems);
@@ -442,6 +454,9 @@ struct _virCgroupBackend {
     virCgroupSetFreezerStateCB setFreezerState;
     virCgroupGetFreezerStateCB getFreezerState;
 
+    virCgroupGetPressureCB getPressure;
+    virCgroupOpenPressureTriggerCB openPressureTrigger;
+
     virCgroupSetCpusetMemsCB setCpusetMems;
     virCgroupGetCpusetMemsCB getCpusetMems;
     virCgroupSetCpusetMemoryMigrateCB setCpusetMemoryMigrate;
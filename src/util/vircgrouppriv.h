@@ -64,6 +64,13 @@ struct _virCgroup {
 
     char *unitName;
     virCgroup *nested;
+
+    /* Open file descriptors of frequently read statistics files,
+     * keyed by file path, and of the directories tunables are written
+     * to, keyed by directory path. Guarded by @filesLock. */
+    GMutex filesLock;
+    GHashTable *files;
+    GHashTable *dirs;
 };
 
 #define virCgroupGetNested(cgroup) \
@@ -109,6 +116,8 @@ int virCgroupGetValueI64(virCgroup *group,
                          const char *key,
                          long long int *value);
 
+int virCgroupPressureResourceController(virCgroupPressureResource resource);
+
 int virCgroupPartitionEscape(char **path);
 
 char *virCgroupGetBlockDevString(const char *path);
@@ -20,6 +20,7 @@
 #include <config.h>
 
 #include <unistd.h>
+#include <fcntl.h>
 #ifdef __linux__
 # include <mntent.h>
 # include <sys/mount.h>
@@ -1744,6 +1745,127 @@ virCgroupV2GetCpuacctStat(virCgroup *group,
 }
 
 
+/* Parses the fields following "some" or "full" in @fields */
+static int
+virCgroupV2ParsePressure(const virStringView *line,
+                         virStringView fields,
+                         virCgroupPressure *pressure)
+{
+    virStringView field;
+
+    while (virStringViewNextToken(&fields, " ", &field)) {
+        virStringView name;
+        double *avg = NULL;
+
+        if (!virStringViewNextToken(&field, "=", &name) ||
+            !virStringViewSkipPrefix(&field, "="))
+            continue;
+
+        if (virStringViewEqual(&name, "avg10")) {
+            avg = &pressure->avg10;
+        } else if (virStringViewEqual(&name, "avg60")) {
+            avg = &pressure->avg60;
+        } else if (virStringViewEqual(&name, "avg300")) {
+            avg = &pressure->avg300;
+        } else if (virStringViewEqual(&name, "total")) {
+            if (virStringViewToULL(&field, &pressure->total) < 0)
+                goto error;
+            continue;
+        } else {
+            continue;
+        }
+
+        if (virStringViewToDouble(&field, avg) < 0)
+            goto error;
+    }
+
+    return 0;
+
+ error:
+    virReportError(VIR_ERR_INTERNAL_ERROR,
+                   _("cannot parse pressure stall information '%.*s'"),
+                   (int) line->len, line->str);
+    return -1;
+}
+
+
+static int
+virCgroupV2GetPressure(virCgroup *group,
+                       virCgroupPressureResource resource,
+                       virCgroupPressure *some,
+                       virCgroupPressure *full,
+                       bool *hasFull)
+{
+    g_autofree char *key = NULL;
+    g_autofree char *str = NULL;
+    virStringView rest;
+    virStringView line;
+
+    key = g_strdup_printf("%s.pressure",
+                          virCgroupPressureResourceTypeToString(resource));
+
+    if (virCgroupGetValueStr(group,
+                             virCgroupPressureResourceController(resource),
+                             key, &str) < 0)
+        return -1;
+
+    memset(some, 0, sizeof(*some));
+    memset(full, 0, sizeof(*full));
+    *hasFull = false;
+
+    virStringViewInit(&rest, str);
+    while (virStringViewNextToken(&rest, "\n", &line)) {
+        virStringView fields = line;
+
+        if (virStringViewSkipPrefix(&fields, "some ")) {
+            if (virCgroupV2ParsePressure(&line, fields, some) < 0)
+                return -1;
+        } else if (virStringViewSkipPrefix(&fields, "full ")) {
+            if (virCgroupV2ParsePressure(&line, fields, full) < 0)
+                return -1;
+            *hasFull = true;
+        }
+    }
+
+    return 0;
+}
+
+
+static int
+virCgroupV2OpenPressureTrigger(virCgroup *group,
+                               virCgroupPressureResource resource,
+                               const char *trigger)
+{
+    g_autofree char *key = NULL;
+    g_autofree char *path = NULL;
+    int fd;
+
+    key = g_strdup_printf("%s.pressure",
+                          virCgroupPressureResourceTypeToString(resource));
+
+    if (virCgroupV2PathOfController(group,
+                                    virCgroupPressureResourceController(resource),
+                                    key, &path) < 0)
+        return -1;
+
+    if ((fd = open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC)) < 0) {
+        virReportSystemError(errno, _("Unable to open '%s'"), path);
+        return -1;
+    }
+
+    /* the kernel expects the trigger including the terminating NUL */
+    if (safewrite(fd, trigger, strlen(trigger) + 1) < 0) {
+        virReportSystemError(errno,
+                             _("Unable to set pressure trigger '%s' of '%s'"),
+                             trigger, path);
+        VIR_FORCE_CLOSE(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+
 static int
 virCgroupV2SetCpusetMems(virCgroup *group,
                          const char *mems)
@@ -1969,6 +2091,9 @@ virCgroupBackend virCgroupV2Backend = {
     .getCpuacctUsage = virCgroupV2GetCpuacctUsage,
     .getCpuacctStat = virCgroupV2GetCpuacctStat,
 
+    .getPressure = virCgroupV2GetPressure,
+    .openPressureTrigger = virCgroupV2OpenPressureTrigger,
+
     .setCpusetMems = virCgroupV2SetCpusetMems,
     .getCpusetMems = virCgroupV2GetCpusetMems,
     .setCpusetMemoryMigrate = virCgroupV2SetCpusetMemoryMigrate,
@@ -30,6 +30,9 @@
 #ifndef WIN32
 # include <sys/wait.h>
 #endif
+#ifdef WITH_POSIX_SPAWN_FILE_ACTIONS_ADDCLOSEFROM_NP
+# include <spawn.h>
+#endif
 #include <fcntl.h>
 #include <unistd.h>
 
@@ -556,6 +559,79 @@ virCommandMassClose(virCommand *cmd,
 
 # else /* ! __FreeBSD__ */
 
+#  ifdef WITH_CLOSE_RANGE
+/* With close_range() the kernel closes whole ranges of FDs at once, so
+ * there is no need to walk /proc/self/fd and close FDs one by one. Only
+ * the gaps between the FDs we want to pass onto the child are closed.
+ *
+ * Returns: 0 on success,
+ *          1 if close_range() is not supported by the kernel,
+ *         -1 otherwise (with error reported).
+ */
+static int
+virCommandMassCloseRange(virCommand *cmd,
+                         int childin,
+                         int childout,
+                         int childerr)
+{
+    g_autoptr(virBitmap) keep = NULL;
+    int lastfd = STDERR_FILENO;
+    unsigned int first = STDERR_FILENO + 1;
+    int fd;
+    size_t i;
+
+    lastfd = MAX(lastfd, childin);
+    lastfd = MAX(lastfd, childout);
+    lastfd = MAX(lastfd, childerr);
+
+    for (i = 0; i < cmd->npassfd; i++)
+        lastfd = MAX(lastfd, cmd->passfd[i].fd);
+
+    keep = virBitmapNew(lastfd + 1);
+
+    if (childin >= 0)
+        ignore_value(virBitmapSetBit(keep, childin));
+    if (childout >= 0)
+        ignore_value(virBitmapSetBit(keep, childout));
+    if (childerr >= 0)
+        ignore_value(virBitmapSetBit(keep, childerr));
+
+    for (i = 0; i < cmd->npassfd; i++)
+        ignore_value(virBitmapSetBit(keep, cmd->passfd[i].fd));
+
+    fd = virBitmapNextSetBit(keep, STDERR_FILENO);
+    for (; fd >= 0; fd = virBitmapNextSetBit(keep, fd)) {
+        if (fd > first && close_range(first, fd - 1, 0) < 0)
+            goto error;
+        first = fd + 1;
+    }
+
+    if (close_range(first, ~0U, 0) < 0)
+        goto error;
+
+    for (i = 0; i < cmd->npassfd; i++) {
+        fd = cmd->passfd[i].fd;
+
+        if (fd == childin || fd == childout || fd == childerr)
+            continue;
+
+        if (virSetInherit(fd, true) < 0) {
+            virReportSystemError(errno, _("failed to preserve fd %d"), fd);
+            return -1;
+        }
+    }
+
+    return 0;
+
+ error:
+    if (errno == ENOSYS)
+        return 1;
+
+    virReportSystemError(errno, "%s", _("failed to close file descriptors"));
+    return -1;
+}
+#  endif /* WITH_CLOSE_RANGE */
+
 static int
 virCommandMassClose(virCommand *cmd,
                     int childin,
@@ -566,6 +642,13 @@ virCommandMassClose(virCommand *cmd,
     int openmax = sysconf(_SC_OPEN_MAX);
     int fd = -1;
 
+#  ifdef WITH_CLOSE_RANGE
+    int rc;
+
+    if ((rc = virCommandMassCloseRange(cmd, childin, childout, childerr)) <= 0)
+        return rc;
+#  endif
+
     /* In general, it is not safe to call malloc() between fork() and exec()
      * because the child might have forked at the worst possible time, i.e.
      * when another thread was in malloc() and thus held its lock. That is to
@@ -607,6 +690,104 @@ virCommandMassClose(virCommand *cmd,
 
 # endif /* ! __FreeBSD__ */
 
+# ifdef WITH_POSIX_SPAWN_FILE_ACTIONS_ADDCLOSEFROM_NP
+/*
+ * virExecSpawn:
+ * @cmd: command to run
+ * @binary: resolved path to the program
+ * @childin, @childout, @childerr: FDs to become stdio of the child
+ *
+ * Many helpers need nothing else done between fork() and exec() than
+ * setting up their stdio and closing all the other FDs. Those are started
+ * with posix_spawn() which, unlike fork(), doesn't copy the page tables of
+ * the (possibly huge) daemon.
+ *
+ * Returns: PID of the child process on success,
+ *          0 if @cmd must be started with virFork() instead.
+ */
+static pid_t
+virExecSpawn(virCommand *cmd,
+             const char *binary,
+             int childin,
+             int childout,
+             int childerr)
+{
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    sigset_t sigdefault;
+    sigset_t sigmask;
+    pid_t pid = 0;
+    int rc;
+
+    if (cmd->hook || cmd->handshake || cmd->pidfile || cmd->pwd ||
+        cmd->mask || cmd->npassfd > 0 ||
+        (cmd->flags & (VIR_EXEC_DAEMON | VIR_EXEC_CLEAR_CAPS)) ||
+        cmd->uid != (uid_t)-1 || cmd->gid != (gid_t)-1 ||
+        cmd->capabilities ||
+        cmd->setMaxMemLock || cmd->setMaxProcesses ||
+        cmd->setMaxFiles || cmd->setMaxCore)
+        return 0;
+
+#  if defined(WITH_SECDRIVER_SELINUX)
+    if (cmd->seLinuxLabel)
+        return 0;
+#  endif
+#  if defined(WITH_SECDRIVER_APPARMOR)
+    if (cmd->appArmorProfile)
+        return 0;
+#  endif
+
+    if (posix_spawn_file_actions_init(&actions) != 0)
+        return 0;
+
+    if (posix_spawnattr_init(&attr) != 0) {
+        posix_spawn_file_actions_destroy(&actions);
+        return 0;
+    }
+
+    /* Just like virFork(), reset all signal handlers and unblock all
+     * signals in the child. */
+    sigfillset(&sigdefault);
+    sigemptyset(&sigmask);
+
+    if (posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGDEF |
+                                        POSIX_SPAWN_SETSIGMASK) != 0 ||
+        posix_spawnattr_setsigdefault(&attr, &sigdefault) != 0 ||
+        posix_spawnattr_setsigmask(&attr, &sigmask) != 0 ||
+        posix_spawn_file_actions_adddup2(&actions, childin, STDIN_FILENO) != 0 ||
+        posix_spawn_file_actions_adddup2(&actions, childout, STDOUT_FILENO) != 0 ||
+        posix_spawn_file_actions_adddup2(&actions, childerr, STDERR_FILENO) != 0 ||
+        posix_spawn_file_actions_addclosefrom_np(&actions, STDERR_FILENO + 1) != 0)
+        goto cleanup;
+
+    /* On failure, let the regular code path run the command again, so
+     * that the failure is reported the usual way, e.g. through the exit
+     * status of the child. */
+    if ((rc = posix_spawn(&pid, binary, &actions, &attr, cmd->args,
+                          cmd->env ? cmd->env : environ)) != 0) {
+        VIR_DEBUG("Unable to spawn %s: %s", binary, g_strerror(rc));
+        pid = 0;
+    }
+
+ cleanup:
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    return pid;
+}
+
+# else /* !WITH_POSIX_SPAWN_FILE_ACTIONS_ADDCLOSEFROM_NP */
+
+static pid_t
+virExecSpawn(virCommand *cmd G_GNUC_UNUSED,
+             const char *binary G_GNUC_UNUSED,
+             int childin G_GNUC_UNUSED,
+             int childout G_GNUC_UNUSED,
+             int childerr G_GNUC_UNUSED)
+{
+    return 0;
+}
+# endif /* !WITH_POSIX_SPAWN_FILE_ACTIONS_ADDCLOSEFROM_NP */
+
 /*
  * virExec:
  * @cmd virCommand * containing all information about the program to
@@ -627,7 +808,7 @@ virExec(virCommand *cmd)
     const char *binary = NULL;
     int ret;
     g_autofree gid_t *groups = NULL;
-    int ngroups;
+    int ngroups = 0;
 
     if (!g_path_is_absolute(cmd->args[0])) {
         if (!(binary = binarystr = virFindFileInPath(cmd->args[0]))) {
@@ -692,10 +873,12 @@ virExec(virCommand *cmd)
         childerr = null;
     }
 
-    if ((ngroups = virGetGroupList(cmd->uid, cmd->gid, &groups)) < 0)
-        goto cleanup;
+    if ((pid = virExecSpawn(cmd, binary, childin, childout, childerr)) == 0) {
+        if ((ngroups = virGetGroupList(cmd->uid, cmd->gid, &groups)) < 0)
+            goto cleanup;
 
-    pid = virFork();
+        pid = virFork();
+    }
 
     if (pid < 0)
         goto cleanup;
@@ -2006,6 +2189,27 @@ virCommandWriteArgLog(virCommand *cmd, int logfd)
 }
 
 
+/* Estimate of the length of @cmd formatted as a string. Formatting the
+ * command line of a QEMU process with many devices would otherwise
+ * reallocate the buffer over and over. */
+static size_t
+virCommandStringSizeHint(virCommand *cmd,
+                         bool linebreaks)
+{
+    size_t len = 0;
+    size_t i;
+
+    /* add room for a separator, quotes and a line break of each item */
+    for (i = 0; i < cmd->nenv; i++)
+        len += strlen(cmd->env[i]) + 3 + (linebreaks ? 2 : 0);
+
+    for (i = 0; i < cmd->nargs; i++)
+        len += strlen(cmd->args[i]) + 3 + (linebreaks ? 2 : 0);
+
+    return len;
+}
+
+
 /**
  * virCommandToStringBuf:
  * @cmd: the command to convert
@@ -2037,6 +2241,9 @@ virCommandToStringBuf(virCommand *cmd,
         return -1;
     }
 
+    virBufferSizeHint(buf, virBufferUse(buf) +
+                      virCommandStringSizeHint(cmd, linebreaks));
+
     for (i = 0; i < cmd->nenv; i++) {
         /* In shell, a='b c' has a different meaning than 'a=b c', so
          * we must determine where the '=' lives.  */
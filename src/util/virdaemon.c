@@ -156,6 +156,7 @@ virDaemonSetupLogging(const char *daemon_name,
                       unsigned int log_level,
                       char *log_filters,
                       char *log_outputs,
+                      char *log_async,
                       bool privileged,
                       bool verbose,
                       bool godaemon)
@@ -179,7 +180,8 @@ virDaemonSetupLogging(const char *daemon_name,
      * setup a default one.
      */
     if (virLogSetFilters(log_filters) < 0 ||
-        virLogSetOutputs(log_outputs) < 0)
+        virLogSetOutputs(log_outputs) < 0 ||
+        virLogSetAsync(log_async) < 0)
         return -1;
 
     /* If there are some environment variables defined, use those instead */
@@ -279,6 +281,7 @@ int virDaemonSetupLogging(const char *daemon_name G_GNUC_UNUSED,
                           unsigned int log_level G_GNUC_UNUSED,
                           char *log_filters G_GNUC_UNUSED,
                           char *log_outputs G_GNUC_UNUSED,
+                          char *log_async G_GNUC_UNUSED,
                           bool privileged G_GNUC_UNUSED,
                           bool verbose G_GNUC_UNUSED,
                           bool godaemon G_GNUC_UNUSED)
@@ -62,6 +62,7 @@ int virDaemonSetupLogging(const char *daemon_name,
                           unsigned int log_level,
                           char *log_filters,
                           char *log_outputs,
+                          char *log_async,
                           bool privileged,
                           bool verbose,
                           bool godaemon);
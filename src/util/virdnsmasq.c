@@ -39,6 +39,7 @@
 #include "virerror.h"
 #include "virlog.h"
 #include "virfile.h"
+#include "virhash.h"
 #include "virstring.h"
 
 #define VIR_FROM_THIS VIR_FROM_NETWORK
@@ -48,6 +49,8 @@ VIR_LOG_INIT("util.dnsmasq");
 #define DNSMASQ "dnsmasq"
 #define DNSMASQ_HOSTSFILE_SUFFIX "hostsfile"
 #define DNSMASQ_ADDNHOSTSFILE_SUFFIX "addnhosts"
+#define DNSMASQ_HOSTSDIR_SUFFIX "hostsdir"
+#define DNSMASQ_HOSTS_MAX_LEN (16 * 1024 * 1024)
 
 #define DNSMASQ_MIN_MAJOR 2
 #define DNSMASQ_MIN_MINOR 67
@@ -270,6 +273,7 @@ hostsfileFree(dnsmasqHostsfile *hostsfile)
     }
 
     g_free(hostsfile->path);
+    g_free(hostsfile->dir);
 
     g_free(hostsfile);
 }
@@ -341,6 +345,13 @@ hostsfileNew(const char *name,
 
     if (!(hostsfile->path = virBufferContentAndReset(&buf)))
         goto error;
+
+    virBufferAsprintf(&buf, "%s", config_dir);
+    virBufferEscapeString(&buf, "/%s", name);
+    virBufferAsprintf(&buf, ".%s", DNSMASQ_HOSTSDIR_SUFFIX);
+
+    if (!(hostsfile->dir = virBufferContentAndReset(&buf)))
+        goto error;
     return hostsfile;
 
  error:
@@ -395,6 +406,35 @@ hostsfileWrite(const char *path,
     return 0;
 }
 
+/* Remove all files from the hosts directory, creating it if needed */
+static int
+hostsdirClear(const char *dir)
+{
+    g_autoptr(DIR) dirp = NULL;
+    struct dirent *ent;
+    int rc;
+
+    if (g_mkdir_with_parents(dir, 0755) < 0) {
+        virReportSystemError(errno, _("cannot create directory '%s'"), dir);
+        return -1;
+    }
+
+    if (virDirOpen(&dirp, dir) < 0)
+        return -1;
+
+    while ((rc = virDirRead(dirp, &ent, dir)) > 0) {
+        g_autofree char *path = g_strdup_printf("%s/%s", dir, ent->d_name);
+
+        if (unlink(path) < 0 && errno != ENOENT) {
+            virReportSystemError(errno, _("cannot remove config file '%s'"),
+                                 path);
+            return -1;
+        }
+    }
+
+    return rc;
+}
+
 static int
 hostsfileSave(dnsmasqHostsfile *hostsfile)
 {
@@ -407,6 +447,91 @@ hostsfileSave(dnsmasqHostsfile *hostsfile)
         return -1;
     }
 
+    /* all hosts are in the hostsfile now */
+    return hostsdirClear(hostsfile->dir);
+}
+
+/* Add lines of @content as keys to @set */
+static void
+hostsfileAddLines(GHashTable *set,
+                  const char *content)
+{
+    g_auto(GStrv) lines = g_strsplit(content, "\n", 0);
+    size_t i;
+
+    for (i = 0; lines[i]; i++) {
+        if (*lines[i])
+            g_hash_table_add(set, g_steal_pointer(&lines[i]));
+    }
+}
+
+/* Returns the set of hosts known to a running dnsmasq: those in the
+ * hostsfile and those added to the hosts directory since */
+static GHashTable *
+hostsfileReadKnown(dnsmasqHostsfile *hostsfile)
+{
+    g_autoptr(GHashTable) known = virHashNew(NULL);
+    g_autofree char *content = NULL;
+    g_autoptr(DIR) dirp = NULL;
+    struct dirent *ent;
+    int rc;
+
+    if (virFileReadAll(hostsfile->path, DNSMASQ_HOSTS_MAX_LEN, &content) < 0)
+        return NULL;
+
+    hostsfileAddLines(known, content);
+
+    if (virDirOpen(&dirp, hostsfile->dir) < 0)
+        return NULL;
+
+    while ((rc = virDirRead(dirp, &ent, hostsfile->dir)) > 0) {
+        g_autofree char *path = NULL;
+
+        /* dnsmasq ignores hidden files */
+        if (ent->d_name[0] == '.')
+            continue;
+
+        path = g_strdup_printf("%s/%s", hostsfile->dir, ent->d_name);
+        g_clear_pointer(&content, g_free);
+        if (virFileReadAll(path, DNSMASQ_HOSTS_MAX_LEN, &content) < 0)
+            return NULL;
+
+        hostsfileAddLines(known, content);
+    }
+
+    if (rc < 0)
+        return NULL;
+
+    return g_steal_pointer(&known);
+}
+
+/* Write @content into a new file in the hosts directory. The file is
+ * created under a hidden name first so that dnsmasq never sees it
+ * partially written. */
+static int
+hostsdirAdd(dnsmasqHostsfile *hostsfile,
+            const char *content)
+{
+    g_autofree char *tmp = g_strdup_printf("%s/.new", hostsfile->dir);
+    g_autofree char *path = NULL;
+    unsigned long long id = g_get_real_time();
+
+    do {
+        g_free(path);
+        path = g_strdup_printf("%s/%llu", hostsfile->dir, id++);
+    } while (virFileExists(path));
+
+    if (virFileWriteStr(tmp, content, 0644) < 0) {
+        virReportSystemError(errno, _("cannot write config file '%s'"), tmp);
+        return -1;
+    }
+
+    if (rename(tmp, path) < 0) {
+        virReportSystemError(errno, _("cannot write config file '%s'"), path);
+        unlink(tmp);
+        return -1;
+    }
+
     return 0;
 }
 
@@ -527,6 +652,81 @@ dnsmasqSave(const dnsmasqContext *ctx)
 }
 
 
+
+/**
+ * dnsmasqSaveIncremental:
+ * @ctx: pointer to the dnsmasq context for each network
+ * @reload: set to true if dnsmasq has to reread its files
+ *
+ * Like dnsmasqSave(), for a dnsmasq configured with the hosts directory
+ * (see dhcp-hostsdir) that is already running. If the only change of DHCP
+ * hosts since the files were saved last time is the addition of new
+ * hosts, these are written into a new file in the hosts directory which
+ * dnsmasq reads on its own. Otherwise all files are rewritten and @reload
+ * is set, as dnsmasq only rereads them on SIGHUP.
+ *
+ * Returns 0 on success, -1 on failure.
+ */
+int
+dnsmasqSaveIncremental(const dnsmasqContext *ctx,
+                       bool *reload)
+{
+    g_autoptr(GHashTable) known = NULL;
+    g_autoptr(GHashTable) wanted = virHashNew(NULL);
+    g_autofree char *oldaddnhosts = NULL;
+    g_autofree char *newaddnhosts = NULL;
+    g_auto(virBuffer) added = VIR_BUFFER_INITIALIZER;
+    g_autofree char *content = NULL;
+    GHashTableIter iter;
+    void *removed;
+    size_t i;
+
+    *reload = true;
+
+    if (!ctx->hostsfile || !ctx->addnhostsfile ||
+        virFileReadAllQuiet(ctx->addnhostsfile->path,
+                            DNSMASQ_HOSTS_MAX_LEN, &oldaddnhosts) < 0)
+        return dnsmasqSave(ctx);
+
+    /* additional hosts are reread only on SIGHUP */
+    if (addnhostsSave(ctx->addnhostsfile) < 0)
+        return -1;
+
+    if (virFileReadAll(ctx->addnhostsfile->path,
+                       DNSMASQ_HOSTS_MAX_LEN, &newaddnhosts) < 0 ||
+        STRNEQ(oldaddnhosts, newaddnhosts) ||
+        !(known = hostsfileReadKnown(ctx->hostsfile))) {
+        virResetLastError();
+        return hostsfileSave(ctx->hostsfile);
+    }
+
+    /* whatever remains in @known afterwards was removed or changed */
+    for (i = 0; i < ctx->hostsfile->nhosts; i++) {
+        const char *host = ctx->hostsfile->hosts[i].host;
+
+        if (!g_hash_table_add(wanted, g_strdup(host)))
+            continue;
+
+        if (!g_hash_table_remove(known, host))
+            virBufferAsprintf(&added, "%s\n", host);
+    }
+
+    g_hash_table_iter_init(&iter, known);
+    if (g_hash_table_iter_next(&iter, &removed, NULL)) {
+        VIR_DEBUG("DHCP host '%s' removed, rewriting '%s'",
+                  (const char *) removed, ctx->hostsfile->path);
+        return hostsfileSave(ctx->hostsfile);
+    }
+
+    *reload = false;
+
+    if (!(content = virBufferContentAndReset(&added)))
+        return 0;
+
+    return hostsdirAdd(ctx->hostsfile, content);
+}
+
+
 /**
  * dnsmasqDelete:
  * @ctx: pointer to the dnsmasq context for each network
@@ -538,8 +738,13 @@ dnsmasqDelete(const dnsmasqContext *ctx)
 {
     int ret = 0;
 
-    if (ctx->hostsfile)
+    if (ctx->hostsfile) {
         ret = genericFileDelete(ctx->hostsfile->path);
+        if (virFileExists(ctx->hostsfile->dir) &&
+            (hostsdirClear(ctx->hostsfile->dir) < 0 ||
+             rmdir(ctx->hostsfile->dir) < 0))
+            ret = -1;
+    }
     if (ctx->addnhostsfile)
         ret = genericFileDelete(ctx->addnhostsfile->path);
 
@@ -576,6 +781,7 @@ dnsmasqReload(pid_t pid G_GNUC_UNUSED)
 struct _dnsmasqCaps {
     virObject parent;
     char *binaryPath;
+    virBitmap *flags;
 };
 
 static virClass *dnsmasqCapsClass;
@@ -586,6 +792,7 @@ dnsmasqCapsDispose(void *obj)
     dnsmasqCaps *caps = obj;
 
     g_free(caps->binaryPath);
+    virBitmapFree(caps->flags);
 }
 
 static int dnsmasqCapsOnceInit(void)
@@ -626,6 +833,10 @@ dnsmasqCapsSetFromBuffer(dnsmasqCaps *caps, const char *buf)
         goto error;
     }
 
+    /* --dhcp-hostsdir was introduced in dnsmasq 2.73 */
+    if (version >= 2073000)
+        ignore_value(virBitmapSetBit(caps->flags, DNSMASQ_CAPS_DHCP_HOSTSDIR));
+
     VIR_INFO("dnsmasq version is %d.%d",
              (int)version / 1000000,
              (int)(version % 1000000) / 1000);
@@ -671,6 +882,8 @@ dnsmasqCapsNewFromBinary(void)
     if (!(caps = virObjectNew(dnsmasqCapsClass)))
         return NULL;
 
+    caps->flags = virBitmapNew(DNSMASQ_CAPS_LAST);
+
     if (!(caps->binaryPath = virFindFileInPath(DNSMASQ))) {
         virReportSystemError(ENOENT, "%s",
                              _("Unable to find 'dnsmasq' binary in $PATH"));
@@ -689,6 +902,12 @@ dnsmasqCapsGetBinaryPath(dnsmasqCaps *caps)
     return caps->binaryPath;
 }
 
+bool
+dnsmasqCapsGet(dnsmasqCaps *caps, dnsmasqCapsFlags flag)
+{
+    return caps && virBitmapIsBitSet(caps->flags, flag);
+}
+
 /** dnsmasqDhcpHostsToString:
  *
  *   Turns a vector of dnsmasqDhcpHost into the string that is ought to be
@@ -42,6 +42,7 @@ typedef struct
     dnsmasqDhcpHost *hosts;
 
     char            *path;  /* Absolute path of dnsmasq's hostsfile. */
+    char            *dir;   /* Absolute path of dnsmasq's dhcp-hostsdir. */
 } dnsmasqHostsfile;
 
 typedef struct
@@ -67,6 +68,12 @@ typedef struct
     dnsmasqAddnHostsfile *addnhostsfile;
 } dnsmasqContext;
 
+typedef enum {
+    DNSMASQ_CAPS_DHCP_HOSTSDIR, /* new files in --dhcp-hostsdir are read without SIGHUP */
+
+    DNSMASQ_CAPS_LAST,          /* this must always be the last item */
+} dnsmasqCapsFlags;
+
 typedef struct _dnsmasqCaps dnsmasqCaps;
 
 G_DEFINE_AUTOPTR_CLEANUP_FUNC(dnsmasqCaps, virObjectUnref);
@@ -88,10 +95,13 @@ int              dnsmasqAddHost(dnsmasqContext *ctx,
                                 virSocketAddr *ip,
                                 const char *name);
 int              dnsmasqSave(const dnsmasqContext *ctx);
+int              dnsmasqSaveIncremental(const dnsmasqContext *ctx,
+                                        bool *reload);
 int              dnsmasqDelete(const dnsmasqContext *ctx);
 int              dnsmasqReload(pid_t pid);
 
 dnsmasqCaps *dnsmasqCapsNewFromBinary(void);
 const char *dnsmasqCapsGetBinaryPath(dnsmasqCaps *caps);
+bool dnsmasqCapsGet(dnsmasqCaps *caps, dnsmasqCapsFlags flag);
 char *dnsmasqDhcpHostsToString(dnsmasqDhcpHost *hosts,
                                unsigned int nhosts);
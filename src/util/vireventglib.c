@@ -35,6 +35,10 @@
 # include <io.h>
 #endif
 
+#ifdef WITH_DLFCN_H
+# include <dlfcn.h>
+#endif
+
 #define VIR_FROM_THIS VIR_FROM_EVENT
 
 VIR_LOG_INIT("util.eventglib");
@@ -56,7 +60,14 @@ struct virEventGLibTimeout
     int timer;
     int interval;
     int removed;
-    GSource *source;
+    /* monotonic time of the next dispatch in microseconds while the
+     * timeout is on timerqueue, -1 otherwise */
+    gint64 expiry;
+    GSequenceIter *iter;
+    /* collected into the batch being dispatched by timersource */
+    bool due;
+    /* expiry the timeout was collected into the batch for */
+    gint64 dueTime;
     virEventTimeoutCallback cb;
     void *opaque;
     virFreeCallback ff;
@@ -64,11 +75,32 @@ struct virEventGLibTimeout
 
 static GMutex *eventlock;
 
+/* watch -> struct virEventGLibHandle */
 static int nextwatch = 1;
-static GPtrArray *handles;
+static GHashTable *handles;
 
+/* timer -> struct virEventGLibTimeout */
 static int nexttimer = 1;
-static GPtrArray *timeouts;
+static GHashTable *timeouts;
+
+/*
+ * Instead of a GSource per timeout, which GLib has to check one by one on
+ * every iteration of the main loop, all enabled timeouts are kept on
+ * timerqueue sorted by their expiry. The ready time of the single
+ * timersource is set to the earliest expiry and its dispatch runs all
+ * timeouts which are due as one batch.
+ */
+static GSequence *timerqueue;
+static GSource *timersource;
+
+static virEventGLibStats stats;
+
+/* Callbacks running longer than slowThreshold microseconds are logged,
+ * with 0 nothing is logged and heartbeattimer is not registered */
+static unsigned long long slowThreshold;
+static int heartbeattimer = -1;
+
+#define VIR_EVENT_GLIB_HEARTBEAT_INTERVAL 5000
 
 static GIOCondition
 virEventGLibEventsToCondition(int events)
@@ -102,6 +134,80 @@ virEventGLibConditionToEvents(GIOCondition cond)
     return events;
 }
 
+/**
+ * virEventGLibCallbackName:
+ * @cb: address of a callback
+ *
+ * Returns a description of @cb for logging, which the caller must free.
+ * That's the name of the symbol if @cb is exported, otherwise the binary
+ * containing @cb with the offset of @cb in it, which tools like addr2line
+ * can resolve.
+ */
+char *
+virEventGLibCallbackName(const void *cb)
+{
+#ifdef WITH_DLFCN_H
+    Dl_info info;
+
+    if (cb && dladdr(cb, &info) != 0) {
+        if (info.dli_sname && info.dli_saddr == cb)
+            return g_strdup(info.dli_sname);
+
+        if (info.dli_fname) {
+            g_autofree char *file = g_path_get_basename(info.dli_fname);
+
+            return g_strdup_printf("%s+0x%tx", file,
+                                   (const char *) cb - (const char *) info.dli_fbase);
+        }
+    }
+#endif
+
+    return g_strdup_printf("%p", cb);
+}
+
+
+/*
+ * Accounts a run of the callback @cb of the handle or timeout @id which
+ * started at @start and logs it if it took longer than the slow
+ * threshold. Returns the duration of the run in microseconds.
+ */
+static unsigned long long
+virEventGLibDispatchDone(const char *what,
+                         int id,
+                         const void *cb,
+                         gint64 start)
+{
+    unsigned long long duration = g_get_monotonic_time() - start;
+    size_t bucket = 0;
+    bool slow = false;
+
+    if (duration > 0)
+        bucket = MIN(g_bit_storage(duration), VIR_EVENT_GLIB_HIST_BUCKETS - 1);
+
+    g_mutex_lock(eventlock);
+    stats.dispatchTime += duration;
+    stats.dispatchHist[bucket]++;
+    if (duration > stats.dispatchTimeMax) {
+        stats.dispatchTimeMax = duration;
+        stats.slowestCb = cb;
+    }
+    if (slowThreshold > 0 && duration >= slowThreshold) {
+        stats.slowDispatches++;
+        slow = true;
+    }
+    g_mutex_unlock(eventlock);
+
+    if (slow) {
+        g_autofree char *name = virEventGLibCallbackName(cb);
+
+        VIR_WARN("Event loop was blocked for %llu ms by callback %s of %s=%d",
+                 duration / 1000, name, what, id);
+    }
+
+    return duration;
+}
+
+
 static gboolean
 virEventGLibHandleDispatch(int fd G_GNUC_UNUSED,
                            GIOCondition condition,
@@ -109,6 +215,12 @@ virEventGLibHandleDispatch(int fd G_GNUC_UNUSED,
 {
     struct virEventGLibHandle *data = opaque;
     int events = virEventGLibConditionToEvents(condition);
+    unsigned long long duration;
+    gint64 start;
+
+    g_mutex_lock(eventlock);
+    stats.handleDispatches++;
+    g_mutex_unlock(eventlock);
 
     VIR_DEBUG("Dispatch handler data=%p watch=%d fd=%d events=%d opaque=%p",
               data, data->watch, data->fd, events, data->opaque);
@@ -117,7 +229,14 @@ virEventGLibHandleDispatch(int fd G_GNUC_UNUSED,
           "watch=%d events=%d cb=%p opaque=%p",
           data->watch, events, data->cb, data->opaque);
 
+    start = g_get_monotonic_time();
     (data->cb)(data->watch, data->fd, events, data->opaque);
+    duration = virEventGLibDispatchDone("watch", data->watch,
+                                        (const void *) data->cb, start);
+
+    PROBE(EVENT_GLIB_DISPATCH_HANDLE_DONE,
+          "watch=%d cb=%p duration=%llu",
+          data->watch, data->cb, duration);
 
     return TRUE;
 }
@@ -153,7 +272,7 @@ virEventGLibHandleAdd(int fd,
             fd, cond, NULL, virEventGLibHandleDispatch, data, NULL);
     }
 
-    g_ptr_array_add(handles, data);
+    g_hash_table_insert(handles, GINT_TO_POINTER(data->watch), data);
 
     ret = data->watch;
 
@@ -168,21 +287,13 @@ virEventGLibHandleAdd(int fd,
 static struct virEventGLibHandle *
 virEventGLibHandleFind(int watch)
 {
-    guint i;
-
-    for (i = 0; i < handles->len; i++) {
-        struct virEventGLibHandle *h = g_ptr_array_index(handles, i);
-
-        if (h == NULL) {
-            g_warn_if_reached();
-            continue;
-        }
+    struct virEventGLibHandle *h = g_hash_table_lookup(handles,
+                                                       GINT_TO_POINTER(watch));
 
-        if ((h->watch == watch) && !h->removed)
-            return h;
-    }
+    if (h && h->removed)
+        return NULL;
 
-    return NULL;
+    return h;
 }
 
 
@@ -248,7 +359,7 @@ virEventGLibHandleRemoveIdle(gpointer data)
         (h->ff)(h->opaque);
 
     g_mutex_lock(eventlock);
-    g_ptr_array_remove_fast(handles, h);
+    g_hash_table_remove(handles, GINT_TO_POINTER(h->watch));
     g_mutex_unlock(eventlock);
 
     return FALSE;
@@ -295,38 +406,179 @@ virEventGLibHandleRemove(int watch)
 }
 
 
-static gboolean
-virEventGLibTimeoutDispatch(void *opaque)
+static gint
+virEventGLibTimeoutCompare(gconstpointer a,
+                           gconstpointer b,
+                           gpointer opaque G_GNUC_UNUSED)
 {
-    struct virEventGLibTimeout *data = opaque;
+    const struct virEventGLibTimeout *ta = a;
+    const struct virEventGLibTimeout *tb = b;
 
-    VIR_DEBUG("Dispatch timeout data=%p cb=%p timer=%d opaque=%p",
-              data, data->cb, data->timer, data->opaque);
+    if (ta->expiry != tb->expiry)
+        return ta->expiry < tb->expiry ? -1 : 1;
 
-    PROBE(EVENT_GLIB_DISPATCH_TIMEOUT,
-          "timer=%d cb=%p opaque=%p",
-          data->timer, data->cb, data->opaque);
-    (data->cb)(data->timer, data->opaque);
+    return ta->timer - tb->timer;
+}
 
-    return TRUE;
+
+/* Must be called with eventlock held */
+static void
+virEventGLibTimeoutSchedule(void)
+{
+    GSequenceIter *first = g_sequence_get_begin_iter(timerqueue);
+    gint64 ready = -1;
+
+    if (!g_sequence_iter_is_end(first)) {
+        struct virEventGLibTimeout *t = g_sequence_get(first);
+        ready = t->expiry;
+    }
+
+    g_source_set_ready_time(timersource, ready);
+}
+
+
+/*
+ * Puts @data on timerqueue to be dispatched @interval milliseconds after
+ * @now, or takes it off if @interval is negative. Must be called with
+ * eventlock held.
+ */
+static void
+virEventGLibTimeoutArm(struct virEventGLibTimeout *data,
+                       int interval,
+                       gint64 now)
+{
+    if (data->iter)
+        g_sequence_remove(data->iter);
+
+    data->iter = NULL;
+    data->expiry = -1;
+    data->interval = interval;
+    data->due = false;
+
+    if (interval >= 0) {
+        data->expiry = now + interval * (gint64) G_TIME_SPAN_MILLISECOND;
+        data->iter = g_sequence_insert_sorted(timerqueue, data,
+                                              virEventGLibTimeoutCompare,
+                                              NULL);
+    }
 }
 
 
-static GSource *
-virEventGLibTimeoutCreate(int interval,
-                          struct virEventGLibTimeout *data)
+static struct virEventGLibTimeout *
+virEventGLibTimeoutFind(int timer)
 {
-    GSource *source = g_timeout_source_new(interval);
+    struct virEventGLibTimeout *t;
 
-    g_source_set_callback(source,
-                          virEventGLibTimeoutDispatch,
-                          data, NULL);
-    g_source_attach(source, NULL);
+    g_return_val_if_fail(timeouts != NULL, NULL);
 
-    return source;
+    t = g_hash_table_lookup(timeouts, GINT_TO_POINTER(timer));
+
+    if (t && t->removed)
+        return NULL;
+
+    return t;
 }
 
 
+static gboolean
+virEventGLibTimeoutDispatch(GSource *source,
+                            GSourceFunc callback G_GNUC_UNUSED,
+                            gpointer opaque G_GNUC_UNUSED)
+{
+    g_autoptr(GPtrArray) batch = g_ptr_array_new();
+    g_autoptr(GArray) due = g_array_new(FALSE, FALSE, sizeof(int));
+    gint64 now = g_source_get_time(source);
+    GSequenceIter *iter;
+    size_t i;
+
+    g_mutex_lock(eventlock);
+
+    stats.timeoutBatches++;
+
+    for (iter = g_sequence_get_begin_iter(timerqueue);
+         !g_sequence_iter_is_end(iter);
+         iter = g_sequence_iter_next(iter)) {
+        struct virEventGLibTimeout *t = g_sequence_get(iter);
+
+        if (t->expiry > now)
+            break;
+
+        g_ptr_array_add(batch, t);
+    }
+
+    /* Re-arm the timeouts before running any of them, so that a timeout
+     * with zero interval runs again on the next iteration rather than in
+     * this batch. Callbacks may update or remove any timeout, which drops
+     * it from the batch. */
+    for (i = 0; i < batch->len; i++) {
+        struct virEventGLibTimeout *t = g_ptr_array_index(batch, i);
+
+        t->dueTime = t->expiry;
+        virEventGLibTimeoutArm(t, t->interval, now);
+        t->due = true;
+        g_array_append_val(due, t->timer);
+    }
+
+    virEventGLibTimeoutSchedule();
+    g_mutex_unlock(eventlock);
+
+    for (i = 0; i < due->len; i++) {
+        struct virEventGLibTimeout *data;
+        virEventTimeoutCallback cb;
+        void *cbopaque;
+        int timer = g_array_index(due, int, i);
+        unsigned long long duration;
+        unsigned long long lag;
+        bool late = false;
+        gint64 start;
+
+        g_mutex_lock(eventlock);
+        if (!(data = virEventGLibTimeoutFind(timer)) || !data->due) {
+            g_mutex_unlock(eventlock);
+            continue;
+        }
+
+        data->due = false;
+        cb = data->cb;
+        cbopaque = data->opaque;
+        stats.timeoutDispatches++;
+        start = g_get_monotonic_time();
+        lag = MAX(start - data->dueTime, 0);
+        if (timer == heartbeattimer) {
+            stats.heartbeats++;
+            stats.heartbeatLag += lag;
+            stats.heartbeatLagMax = MAX(stats.heartbeatLagMax, lag);
+            late = slowThreshold > 0 && lag >= slowThreshold;
+        }
+        g_mutex_unlock(eventlock);
+
+        if (late)
+            VIR_WARN("Event loop ran its heartbeat %llu ms late", lag / 1000);
+
+        VIR_DEBUG("Dispatch timeout data=%p cb=%p timer=%d opaque=%p",
+                  data, cb, timer, cbopaque);
+
+        PROBE(EVENT_GLIB_DISPATCH_TIMEOUT,
+              "timer=%d cb=%p opaque=%p",
+              timer, cb, cbopaque);
+        (cb)(timer, cbopaque);
+        duration = virEventGLibDispatchDone("timer", timer,
+                                            (const void *) cb, start);
+
+        PROBE(EVENT_GLIB_DISPATCH_TIMEOUT_DONE,
+              "timer=%d cb=%p lag=%llu duration=%llu",
+              timer, cb, lag, duration);
+    }
+
+    return G_SOURCE_CONTINUE;
+}
+
+
+static GSourceFuncs virEventGLibTimeoutSourceFuncs = {
+    .dispatch = virEventGLibTimeoutDispatch,
+};
+
+
 static int
 virEventGLibTimeoutAdd(int interval,
                        virEventTimeoutCallback cb,
@@ -340,14 +592,13 @@ virEventGLibTimeoutAdd(int interval,
 
     data = g_new0(struct virEventGLibTimeout, 1);
     data->timer = nexttimer++;
-    data->interval = interval;
     data->cb = cb;
     data->opaque = opaque;
     data->ff = ff;
-    if (interval >= 0)
-        data->source = virEventGLibTimeoutCreate(interval, data);
+    virEventGLibTimeoutArm(data, interval, g_get_monotonic_time());
+    virEventGLibTimeoutSchedule();
 
-    g_ptr_array_add(timeouts, data);
+    g_hash_table_insert(timeouts, GINT_TO_POINTER(data->timer), data);
 
     VIR_DEBUG("Add timeout data=%p interval=%d ms cb=%p opaque=%p timer=%d",
               data, interval, cb, opaque, data->timer);
@@ -363,29 +614,6 @@ virEventGLibTimeoutAdd(int interval,
 }
 
 
-static struct virEventGLibTimeout *
-virEventGLibTimeoutFind(int timer)
-{
-    guint i;
-
-    g_return_val_if_fail(timeouts != NULL, NULL);
-
-    for (i = 0; i < timeouts->len; i++) {
-        struct virEventGLibTimeout *t = g_ptr_array_index(timeouts, i);
-
-        if (t == NULL) {
-            g_warn_if_reached();
-            continue;
-        }
-
-        if ((t->timer == timer) && !t->removed)
-            return t;
-    }
-
-    return NULL;
-}
-
-
 static void
 virEventGLibTimeoutUpdate(int timer,
                           int interval)
@@ -405,21 +633,11 @@ virEventGLibTimeoutUpdate(int timer,
 
     VIR_DEBUG("Update timeout data=%p timer=%d interval=%d ms", data, timer, interval);
 
-    if (interval >= 0) {
-        if (data->source != NULL) {
-            g_source_destroy(data->source);
-            vir_g_source_unref(data->source, NULL);
-        }
+    if (interval < 0 && !data->iter && !data->due)
+        goto cleanup;
 
-        data->interval = interval;
-        data->source = virEventGLibTimeoutCreate(interval, data);
-    } else {
-        if (data->source == NULL)
-            goto cleanup;
-
-        vir_g_source_unref(data->source, NULL);
-        g_clear_pointer(&data->source, g_source_destroy);
-    }
+    virEventGLibTimeoutArm(data, interval, g_get_monotonic_time());
+    virEventGLibTimeoutSchedule();
 
  cleanup:
     g_mutex_unlock(eventlock);
@@ -438,7 +656,7 @@ virEventGLibTimeoutRemoveIdle(gpointer data)
         (t->ff)(t->opaque);
 
     g_mutex_lock(eventlock);
-    g_ptr_array_remove_fast(timeouts, t);
+    g_hash_table_remove(timeouts, GINT_TO_POINTER(t->timer));
     g_mutex_unlock(eventlock);
 
     return FALSE;
@@ -464,10 +682,8 @@ virEventGLibTimeoutRemove(int timer)
     VIR_DEBUG("Remove timeout data=%p timer=%d",
               data, timer);
 
-    if (data->source != NULL) {
-        vir_g_source_unref(data->source, NULL);
-        g_clear_pointer(&data->source, g_source_destroy);
-    }
+    virEventGLibTimeoutArm(data, -1, 0);
+    virEventGLibTimeoutSchedule();
 
     /* since the actual timeout deletion is done asynchronously, a timeoutUpdate call may
      * reschedule the timeout before it's fully deleted, that's why we need to mark it as
@@ -487,8 +703,11 @@ virEventGLibTimeoutRemove(int timer)
 static gpointer virEventGLibRegisterOnce(gpointer data G_GNUC_UNUSED)
 {
     eventlock = g_new0(GMutex, 1);
-    timeouts = g_ptr_array_new_with_free_func(g_free);
-    handles = g_ptr_array_new_with_free_func(g_free);
+    timeouts = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+    handles = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+    timerqueue = g_sequence_new(NULL);
+    timersource = g_source_new(&virEventGLibTimeoutSourceFuncs, sizeof(GSource));
+    g_source_attach(timersource, NULL);
     virEventRegisterImpl(virEventGLibHandleAdd,
                          virEventGLibHandleUpdate,
                          virEventGLibHandleRemove,
@@ -507,9 +726,97 @@ void virEventGLibRegister(void)
 }
 
 
+/* The lag is accounted when the timeout is dispatched */
+static void
+virEventGLibHeartbeat(int timer G_GNUC_UNUSED,
+                      void *opaque G_GNUC_UNUSED)
+{
+}
+
+
+/**
+ * virEventGLibSetSlowThreshold:
+ * @msecs: threshold in milliseconds, 0 to disable
+ *
+ * Makes the event loop registered by virEventGLibRegister log callbacks
+ * blocking it for at least @msecs and run a heartbeat timer to detect
+ * delays caused by something else. Their statistics are collected
+ * regardless of the threshold.
+ */
+void virEventGLibSetSlowThreshold(unsigned int msecs)
+{
+    int timer = -1;
+    bool running;
+
+    if (!eventlock)
+        return;
+
+    g_mutex_lock(eventlock);
+    slowThreshold = msecs * (unsigned long long) G_TIME_SPAN_MILLISECOND;
+    if (msecs == 0) {
+        timer = heartbeattimer;
+        heartbeattimer = -1;
+    }
+    running = heartbeattimer >= 0;
+    g_mutex_unlock(eventlock);
+
+    if (msecs == 0) {
+        if (timer >= 0)
+            virEventGLibTimeoutRemove(timer);
+        return;
+    }
+
+    if (running)
+        return;
+
+    timer = virEventGLibTimeoutAdd(VIR_EVENT_GLIB_HEARTBEAT_INTERVAL,
+                                   virEventGLibHeartbeat, NULL, NULL);
+
+    /* Keep the first heartbeat if called concurrently */
+    g_mutex_lock(eventlock);
+    if (heartbeattimer < 0) {
+        heartbeattimer = timer;
+        timer = -1;
+    }
+    g_mutex_unlock(eventlock);
+
+    if (timer >= 0)
+        virEventGLibTimeoutRemove(timer);
+}
+
+
 int virEventGLibRunOnce(void)
 {
+    if (eventlock) {
+        g_mutex_lock(eventlock);
+        stats.iterations++;
+        g_mutex_unlock(eventlock);
+    }
+
     g_main_context_iteration(NULL, TRUE);
 
     return 0;
 }
+
+
+/**
+ * virEventGLibGetStats:
+ * @st: filled with the statistics
+ *
+ * Retrieves statistics of the event loop implementation registered by
+ * virEventGLibRegister.
+ */
+void virEventGLibGetStats(virEventGLibStats *st)
+{
+    memset(st, 0, sizeof(*st));
+
+    if (!eventlock)
+        return;
+
+    g_mutex_lock(eventlock);
+    *st = stats;
+    st->handles = g_hash_table_size(handles);
+    st->timeouts = g_hash_table_size(timeouts);
+    st->timeoutsEnabled = g_sequence_get_length(timerqueue);
+    g_mutex_unlock(eventlock);
+}
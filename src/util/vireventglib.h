@@ -26,3 +26,37 @@
 void virEventGLibRegister(void);
 
 int virEventGLibRunOnce(void);
+
+void virEventGLibSetSlowThreshold(unsigned int msecs);
+
+char *virEventGLibCallbackName(const void *cb);
+
+/* Bucket N > 0 counts callbacks which took [2^(N-1), 2^N) microseconds
+ * to run, the last one counts all the longer ones */
+#define VIR_EVENT_GLIB_HIST_BUCKETS 24
+
+typedef struct _virEventGLibStats virEventGLibStats;
+struct _virEventGLibStats {
+    unsigned long long iterations; /* main loop iterations run */
+    unsigned long long handleDispatches;
+    unsigned long long timeoutDispatches;
+    unsigned long long timeoutBatches; /* wakeups dispatching timeouts */
+    size_t handles;
+    size_t timeouts;
+    size_t timeoutsEnabled;
+
+    /* time spent in handle and timeout callbacks, in microseconds */
+    unsigned long long dispatchTime;
+    unsigned long long dispatchTimeMax;
+    unsigned long long dispatchHist[VIR_EVENT_GLIB_HIST_BUCKETS];
+    /* callbacks which took longer than the slow threshold */
+    unsigned long long slowDispatches;
+    const void *slowestCb; /* callback which took dispatchTimeMax */
+
+    /* how late the heartbeat timer ran, in microseconds */
+    unsigned long long heartbeats;
+    unsigned long long heartbeatLag;
+    unsigned long long heartbeatLagMax;
+};
+
+void virEventGLibGetStats(virEventGLibStats *st);
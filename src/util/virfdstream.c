@@ -28,6 +28,10 @@
 #ifndef WIN32
 # include <termios.h>
 #endif
+#ifdef __linux__
+# include <sys/ioctl.h>
+# include <linux/fs.h>
+#endif
 
 #include "virfdstream.h"
 #include "virerror.h"
@@ -47,6 +51,12 @@
 VIR_LOG_INIT("fdstream");
 
 #ifndef WIN32
+/* The worker thread reads at most this many bytes per message */
+# define VIR_FDSTREAM_THREAD_BUFLEN (256 * 1024)
+
+/* Longest run of zeroes read from a block device sent as a single hole */
+# define VIR_FDSTREAM_BLOCK_HOLE_MAX (64 * 1024 * 1024)
+
 typedef enum {
     VIR_FDSTREAM_MSG_TYPE_DATA,
     VIR_FDSTREAM_MSG_TYPE_HOLE,
@@ -63,6 +73,8 @@ struct _virFDStreamMsg {
             char *buf;
             size_t len;
             size_t offset;
+            bool inPipe; /* payload lives in virFDStreamData::dataPipe
+                          * instead of @buf */
         } data;
         struct {
             long long len;
@@ -107,6 +119,13 @@ struct virFDStreamData {
     bool threadAbort;
     bool threadDoRead;
     virFDStreamMsg *msg;
+
+    /* Zero copy read support. The worker thread splice()s file
+     * data into this pipe and the consumer either reads it or
+     * splice()s it further (e.g. into a socket). */
+    int dataPipe[2];
+    size_t dataPipeChunk; /* maximum bytes per message in the pipe */
+    bool dataPipeBroken; /* @fdin does not support splice() */
 };
 
 static virClass *virFDStreamDataClass;
@@ -123,6 +142,8 @@ virFDStreamDataDispose(void *obj)
     virFDStreamDataDisposed = true;
     virFreeError(fdst->threadErr);
     virFDStreamMsgQueueFree(&fdst->msg);
+    VIR_FORCE_CLOSE(fdst->dataPipe[0]);
+    VIR_FORCE_CLOSE(fdst->dataPipe[1]);
 }
 
 static int virFDStreamDataOnceInit(void)
@@ -415,6 +436,126 @@ virFDStreamThreadDataFree(virFDStreamThreadData *data)
 }
 
 
+#ifdef WITH_SPLICE
+/**
+ * virFDStreamSpliceIn:
+ * @fdst: the stream data
+ * @fdin: file to read data from
+ * @len: maximum number of bytes to move
+ *
+ * Moves up to @len bytes from @fdin into the data pipe of @fdst
+ * without copying them through userspace. Since the data pipe is
+ * sized to hold two chunks this never blocks as long as the
+ * consumer keeps at most one chunk unread.
+ *
+ * Returns the number of bytes moved (0 on EOF), -1 on error or -2
+ * if @fdin does not support splice().
+ */
+static ssize_t
+virFDStreamSpliceIn(virFDStreamData *fdst,
+                    int fdin,
+                    size_t len)
+{
+    size_t done = 0;
+
+    while (done < len) {
+        ssize_t got = splice(fdin, NULL, fdst->dataPipe[1], NULL,
+                             len - done, SPLICE_F_MOVE);
+
+        if (got < 0) {
+            if (errno == EINTR)
+                continue;
+            if (done == 0 && (errno == EINVAL || errno == ENOSYS))
+                return -2;
+            return -1;
+        }
+
+        if (got == 0)
+            break;
+
+        done += got;
+    }
+
+    return done;
+}
+#endif /* WITH_SPLICE */
+
+
+static bool
+virFDStreamBufIsZero(const char *buf,
+                     size_t len)
+{
+    return len && buf[0] == 0 && memcmp(buf, buf + 1, len - 1) == 0;
+}
+
+
+/*
+ * Block devices don't have holes, but runs of zeroes read from them are
+ * sent as holes to keep the stream proportional to the data stored.
+ */
+static ssize_t
+virFDStreamThreadDoReadBlockSparse(virFDStreamData *fdst,
+                                   const int fdin,
+                                   const int fdout,
+                                   const char *fdinname,
+                                   const char *fdoutname,
+                                   size_t length,
+                                   size_t total,
+                                   size_t buflen)
+{
+    g_autoptr(virFDStreamMsg) msg = NULL;
+    g_autofree char *buf = NULL;
+    long long holeLen = 0;
+    ssize_t got = 0;
+
+    while (true) {
+        if (length &&
+            buflen > length - total - holeLen)
+            buflen = length - total - holeLen;
+
+        if (!buf)
+            buf = g_new0(char, buflen);
+
+        if ((got = saferead(fdin, buf, buflen)) < 0) {
+            virReportSystemError(errno,
+                                 _("Unable to read %s"),
+                                 fdinname);
+            return -1;
+        }
+
+        if (!virFDStreamBufIsZero(buf, got))
+            break;
+
+        holeLen += got;
+
+        if (holeLen >= VIR_FDSTREAM_BLOCK_HOLE_MAX ||
+            (length && total + holeLen >= length)) {
+            got = 0;
+            break;
+        }
+    }
+
+    if (holeLen > 0) {
+        msg = g_new0(virFDStreamMsg, 1);
+        msg->type = VIR_FDSTREAM_MSG_TYPE_HOLE;
+        msg->stream.hole.len = holeLen;
+        virFDStreamMsgQueuePush(fdst, &msg, fdout, fdoutname);
+
+        /* the end of the device is reported by the next read */
+        if (got == 0)
+            return holeLen;
+    }
+
+    msg = g_new0(virFDStreamMsg, 1);
+    msg->type = VIR_FDSTREAM_MSG_TYPE_DATA;
+    msg->stream.data.buf = g_steal_pointer(&buf);
+    msg->stream.data.len = got;
+    virFDStreamMsgQueuePush(fdst, &msg, fdout, fdoutname);
+
+    return holeLen + got;
+}
+
+
 static ssize_t
 virFDStreamThreadDoRead(virFDStreamData *fdst,
                         bool sparse,
@@ -432,23 +573,16 @@ virFDStreamThreadDoRead(virFDStreamData *fdst,
     int inData = 0;
     long long sectionLen = 0;
     g_autofree char *buf = NULL;
-    ssize_t got;
+    ssize_t got = 0;
+
+    if (sparse && isBlock)
+        return virFDStreamThreadDoReadBlockSparse(fdst, fdin, fdout,
+                                                  fdinname, fdoutname,
+                                                  length, total, buflen);
 
     if (sparse && *dataLen == 0) {
-        if (isBlock) {
-            /* Block devices are always in data section by definition. The
-             * @sectionLen is slightly more tricky. While we could try and get
-             * how much bytes is there left until EOF, we can pretend there is
-             * always X bytes left and let the saferead() below hit EOF (which
-             * is then handled gracefully anyway). Worst case scenario, this
-             * branch is called more than once.
-             * X was chosen to be 1MiB but it has ho special meaning. */
-            inData = 1;
-            sectionLen = 1 * 1024 * 1024;
-        } else {
-            if (virFileInData(fdin, &inData, &sectionLen) < 0)
-                return -1;
-        }
+        if (virFileInData(fdin, &inData, &sectionLen) < 0)
+            return -1;
 
         if (length &&
             sectionLen > length - total)
@@ -483,17 +617,42 @@ virFDStreamThreadDoRead(virFDStreamData *fdst,
             buflen > *dataLen)
             buflen = *dataLen;
 
-        buf = g_new0(char, buflen);
+        msg->type = VIR_FDSTREAM_MSG_TYPE_DATA;
 
-        if ((got = saferead(fdin, buf, buflen)) < 0) {
-            virReportSystemError(errno,
-                                 _("Unable to read %s"),
-                                 fdinname);
-            return -1;
+#ifdef WITH_SPLICE
+        if (fdst->dataPipe[1] >= 0 && !fdst->dataPipeBroken) {
+            got = virFDStreamSpliceIn(fdst, fdin,
+                                      MIN(buflen, fdst->dataPipeChunk));
+            if (got == -1) {
+                virReportSystemError(errno,
+                                     _("Unable to read %s"),
+                                     fdinname);
+                return -1;
+            }
+
+            if (got == -2) {
+                VIR_DEBUG("splice() not supported on %s, falling back to read()",
+                          fdinname);
+                fdst->dataPipeBroken = true;
+            } else {
+                msg->stream.data.inPipe = true;
+            }
+        }
+#endif /* WITH_SPLICE */
+
+        if (!msg->stream.data.inPipe) {
+            buf = g_new0(char, buflen);
+
+            if ((got = saferead(fdin, buf, buflen)) < 0) {
+                virReportSystemError(errno,
+                                     _("Unable to read %s"),
+                                     fdinname);
+                return -1;
+            }
+
+            msg->stream.data.buf = g_steal_pointer(&buf);
         }
 
-        msg->type = VIR_FDSTREAM_MSG_TYPE_DATA;
-        msg->stream.data.buf = g_steal_pointer(&buf);
         msg->stream.data.len = got;
         if (sparse)
             *dataLen -= got;
@@ -505,6 +664,35 @@ virFDStreamThreadDoRead(virFDStreamData *fdst,
 }
 
 
+/*
+ * Let the kernel zero @len bytes at the current position of the block
+ * device @fd, which the device may do without any data being transferred.
+ * Returns 0 on success, -1 if the zeroes have to be written instead.
+ */
+static int
+virFDStreamBlockZeroOut(int fd G_GNUC_UNUSED,
+                        long long len G_GNUC_UNUSED)
+{
+# ifdef BLKZEROOUT
+    off_t cur;
+    uint64_t range[2];
+
+    if ((cur = lseek(fd, 0, SEEK_CUR)) == (off_t) -1)
+        return -1;
+
+    if (cur % 512 || len % 512)
+        return -1;
+
+    range[0] = cur;
+    range[1] = len;
+
+    return ioctl(fd, BLKZEROOUT, range) < 0 ? -1 : 0;
+# else /* !BLKZEROOUT */
+    return -1;
+# endif /* !BLKZEROOUT */
+}
+
+
 static ssize_t
 virFDStreamThreadDoWrite(virFDStreamData *fdst,
                          bool sparse,
@@ -543,7 +731,14 @@ virFDStreamThreadDoWrite(virFDStreamData *fdst,
         }
 
         got = msg->stream.hole.len;
-        if (isBlock) {
+        if (isBlock && virFDStreamBlockZeroOut(fdout, got) == 0) {
+            if (lseek(fdout, got, SEEK_CUR) == (off_t) -1) {
+                virReportSystemError(errno,
+                                     _("unable to seek in %s"),
+                                     fdoutname);
+                return -1;
+            }
+        } else if (isBlock) {
             g_autofree char * buf = NULL;
             const size_t buflen = 1 * 1024 * 1024; /* 1MiB */
             size_t toWrite = got;
@@ -614,7 +809,7 @@ virFDStreamThread(void *opaque)
     char *fdoutname = data->fdoutname;
     virFDStreamData *fdst = st->privateData;
     bool doRead = fdst->threadDoRead;
-    size_t buflen = 256 * 1024;
+    size_t buflen = VIR_FDSTREAM_THREAD_BUFLEN;
     size_t total = 0;
     size_t dataLen = 0;
 
@@ -946,9 +1141,18 @@ static int virFDStreamRead(virStreamPtr st, char *bytes, size_t nbytes)
         if (nbytes > msg->stream.data.len - msg->stream.data.offset)
             nbytes = msg->stream.data.len - msg->stream.data.offset;
 
-        memcpy(bytes,
-               msg->stream.data.buf + msg->stream.data.offset,
-               nbytes);
+        if (msg->stream.data.inPipe) {
+            /* The data is guaranteed to be in the pipe already. */
+            if (saferead(fdst->dataPipe[0], bytes, nbytes) != (ssize_t) nbytes) {
+                virReportSystemError(errno, "%s",
+                                     _("cannot read from stream"));
+                goto cleanup;
+            }
+        } else {
+            memcpy(bytes,
+                   msg->stream.data.buf + msg->stream.data.offset,
+                   nbytes);
+        }
 
         msg->stream.data.offset += nbytes;
         if (msg->stream.data.offset == msg->stream.data.len) {
@@ -1121,6 +1325,137 @@ static virStreamDriver virFDStreamDrv = {
     .streamEventRemoveCallback = virFDStreamRemoveCallback
 };
 
+#if defined(WITH_SPLICE) && defined(F_SETPIPE_SZ)
+
+/**
+ * virFDStreamDataPipeInit:
+ * @fdst: the stream data
+ *
+ * Set up the pipe used to pass file data from the worker thread
+ * to the consumer without copying it through userspace. The pipe
+ * has to be able to hold two messages: the one the consumer may
+ * still be draining and the one the worker thread produces
+ * meanwhile. Otherwise the worker thread would block with the
+ * stream locked. Failure is not fatal, the stream just falls back
+ * to passing data in memory buffers.
+ */
+static void
+virFDStreamDataPipeInit(virFDStreamData *fdst)
+{
+    int sz;
+
+    if (virPipe(fdst->dataPipe) < 0) {
+        VIR_DEBUG("Unable to create data pipe: %s",
+                  virGetLastErrorMessage());
+        virResetLastError();
+        return;
+    }
+
+    if ((sz = fcntl(fdst->dataPipe[1], F_SETPIPE_SZ,
+                    2 * VIR_FDSTREAM_THREAD_BUFLEN)) < 0)
+        sz = fcntl(fdst->dataPipe[1], F_GETPIPE_SZ);
+
+    if (sz < 2 * 64 * 1024) {
+        VIR_DEBUG("Data pipe too small (%d), not using splice()", sz);
+        VIR_FORCE_CLOSE(fdst->dataPipe[0]);
+        VIR_FORCE_CLOSE(fdst->dataPipe[1]);
+        return;
+    }
+
+    fdst->dataPipeChunk = sz / 2;
+    VIR_DEBUG("fdst=%p dataPipe chunk=%zu", fdst, fdst->dataPipeChunk);
+}
+
+
+/**
+ * virFDStreamSpliceData:
+ * @st: stream
+ * @maxlen: maximum number of bytes to claim
+ * @fd: filled with a file descriptor to read the claimed data from
+ *
+ * If @st is a file stream whose next message is data sitting in
+ * the zero copy pipe, claim up to @maxlen bytes of it. The caller
+ * must then move exactly the returned number of bytes out of @fd
+ * (e.g. by splice()-ing them into a socket) and close @fd when
+ * done. Until then no other data may be read from @st.
+ *
+ * Returns the number of bytes claimed, 0 if zero copy is not
+ * possible right now (the caller should use virStreamRecv()
+ * instead) or -1 on error.
+ */
+int
+virFDStreamSpliceData(virStreamPtr st,
+                      size_t maxlen,
+                      int *fd)
+{
+    virFDStreamData *fdst = st->privateData;
+    virFDStreamMsg *msg;
+    size_t len;
+    int ret = 0;
+
+    *fd = -1;
+
+    if (st->driver != &virFDStreamDrv || !fdst || maxlen == 0)
+        return 0;
+
+    if (maxlen > INT_MAX)
+        maxlen = INT_MAX;
+
+    virObjectLock(fdst);
+
+    if (!fdst->thread || !fdst->threadDoRead || fdst->threadErr ||
+        !(msg = fdst->msg) ||
+        msg->type != VIR_FDSTREAM_MSG_TYPE_DATA ||
+        !msg->stream.data.inPipe)
+        goto cleanup;
+
+    len = MIN(maxlen, msg->stream.data.len - msg->stream.data.offset);
+    if (fdst->length && fdst->length - fdst->offset < len)
+        len = fdst->length - fdst->offset;
+    if (len == 0)
+        goto cleanup;
+
+    if ((*fd = dup(fdst->dataPipe[0])) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to duplicate stream data pipe"));
+        ret = -1;
+        goto cleanup;
+    }
+
+    msg->stream.data.offset += len;
+    if (msg->stream.data.offset == msg->stream.data.len) {
+        virFDStreamMsgQueuePop(fdst, fdst->fd, "pipe");
+        virFDStreamMsgFree(msg);
+    }
+
+    if (fdst->length)
+        fdst->offset += len;
+
+    ret = len;
+
+ cleanup:
+    virObjectUnlock(fdst);
+    return ret;
+}
+#else /* !(WITH_SPLICE && F_SETPIPE_SZ) */
+
+static void
+virFDStreamDataPipeInit(virFDStreamData *fdst G_GNUC_UNUSED)
+{
+}
+
+
+int
+virFDStreamSpliceData(virStreamPtr st G_GNUC_UNUSED,
+                      size_t maxlen G_GNUC_UNUSED,
+                      int *fd)
+{
+    *fd = -1;
+    return 0;
+}
+#endif /* !(WITH_SPLICE && F_SETPIPE_SZ) */
+
+
 static int virFDStreamOpenInternal(virStreamPtr st,
                                    int fd,
                                    virFDStreamThreadData *threadData,
@@ -1145,6 +1480,7 @@ static int virFDStreamOpenInternal(virStreamPtr st,
 
     fdst->fd = fd;
     fdst->length = length;
+    fdst->dataPipe[0] = fdst->dataPipe[1] = -1;
 
     st->driver = &virFDStreamDrv;
     st->privateData = fdst;
@@ -1152,6 +1488,9 @@ static int virFDStreamOpenInternal(virStreamPtr st,
     if (threadData) {
         fdst->threadDoRead = threadData->doRead;
 
+        if (fdst->threadDoRead)
+            virFDStreamDataPipeInit(fdst);
+
         /* Create the thread after fdst and st were initialized.
          * The thread worker expects them to be that way. */
         fdst->thread = g_new0(virThread, 1);
@@ -1524,6 +1863,16 @@ virFDStreamOpenBlockDevice(virStreamPtr st G_GNUC_UNUSED,
 }
 
 
+int
+virFDStreamSpliceData(virStreamPtr st G_GNUC_UNUSED,
+                      size_t maxlen G_GNUC_UNUSED,
+                      int *fd)
+{
+    *fd = -1;
+    return 0;
+}
+
+
 int
 virFDStreamSetInternalCloseCb(virStreamPtr st G_GNUC_UNUSED,
                               virFDStreamInternalCloseCb cb G_GNUC_UNUSED,
@@ -60,6 +60,11 @@ int virFDStreamOpenBlockDevice(virStreamPtr st,
                                bool sparse,
                                int oflags);
 
+int virFDStreamSpliceData(virStreamPtr st,
+                          size_t maxlen,
+                          int *fd)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(3);
+
 int virFDStreamSetInternalCloseCb(virStreamPtr st,
                                   virFDStreamInternalCloseCb cb,
                                   void *opaque,
@@ -89,6 +89,7 @@
 #include "virstring.h"
 #include "virutil.h"
 #include "virsocket.h"
+#include "virthread.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
 
@@ -4589,84 +4590,217 @@ struct runIOParams {
     const char *fdoutname;
 };
 
-/**
- * runIOCopy: execute the IO copy based on the passed parameters
- * @p: the IO parameters
- *
- * Execute the copy based on the passed parameters.
- *
- * Returns: size transferred, or < 0 on error.
- */
+/* Number of buffers in flight between the reading and the writing side of
+ * runIOCopy. Reading from the pipe and writing to the disk overlap as long
+ * as at least two are available. */
+# define RUN_IO_BUFFERS 4
 
-static off_t
-runIOCopy(const struct runIOParams p)
-{
-    g_autofree void *base = NULL; /* Location to be freed */
-    char *buf = NULL; /* Aligned location within base */
-    size_t buflen = 1024*1024;
-    intptr_t alignMask = 64*1024 - 1;
-    off_t total = 0;
+struct runIOBuffer {
+    void *base; /* Location to be freed */
+    char *buf; /* Aligned location within base */
+    ssize_t got;
+};
+
+struct runIOPipeline {
+    const struct runIOParams *p;
+    size_t buflen;
+
+    virMutex lock;
+    virCond cond;
+    struct runIOBuffer bufs[RUN_IO_BUFFERS];
+    size_t nfull; /* buffers filled by the reader and not written yet */
+    size_t head; /* next buffer to be filled */
+    bool eof; /* reader finished, either at EOF or because of readErr */
+    int readErr;
+    bool quit; /* writer failed, reader has to stop */
+};
 
-# if WITH_POSIX_MEMALIGN
-    if (posix_memalign(&base, alignMask + 1, buflen))
-        abort();
-    buf = base;
-# else
-    buf = g_new0(char, buflen + alignMask);
-    base = buf;
-    buf = (char *) (((intptr_t) base + alignMask) & ~alignMask);
-# endif
+
+static void
+runIOReader(void *opaque)
+{
+    struct runIOPipeline *pipeline = opaque;
+    const struct runIOParams *p = pipeline->p;
 
     while (1) {
+        struct runIOBuffer *b;
         ssize_t got;
 
+        VIR_WITH_MUTEX_LOCK_GUARD(&pipeline->lock) {
+            while (pipeline->nfull == RUN_IO_BUFFERS && !pipeline->quit)
+                ignore_value(virCondWait(&pipeline->cond, &pipeline->lock));
+
+            if (pipeline->quit) {
+                pipeline->eof = true;
+                virCondSignal(&pipeline->cond);
+                return;
+            }
+
+            b = pipeline->bufs + pipeline->head;
+        }
+
         /* If we read with O_DIRECT from file we can't use saferead as
          * it can lead to unaligned read after reading last bytes.
          * If we write with O_DIRECT use should use saferead so that
          * writes will be aligned.
          * In other cases using saferead reduces number of syscalls.
          */
-        if (!p.isWrite && p.isDirect) {
-            if ((got = read(p.fdin, buf, buflen)) < 0 &&
-                errno == EINTR)
-                continue;
+        if (!p->isWrite && p->isDirect) {
+            while ((got = read(p->fdin, b->buf, pipeline->buflen)) < 0 &&
+                   errno == EINTR)
+                ;
         } else {
-            got = saferead(p.fdin, buf, buflen);
+            got = saferead(p->fdin, b->buf, pipeline->buflen);
         }
 
-        if (got < 0) {
-            virReportSystemError(errno, _("Unable to read %s"), p.fdinname);
-            return -2;
+        VIR_WITH_MUTEX_LOCK_GUARD(&pipeline->lock) {
+            if (got <= 0) {
+                if (got < 0)
+                    pipeline->readErr = errno;
+                pipeline->eof = true;
+                virCondSignal(&pipeline->cond);
+                return;
+            }
+
+            b->got = got;
+            pipeline->head = (pipeline->head + 1) % RUN_IO_BUFFERS;
+            pipeline->nfull++;
+            virCondSignal(&pipeline->cond);
         }
-        if (got == 0)
-            break;
+    }
+}
 
+
+static off_t
+runIOWriter(struct runIOPipeline *pipeline)
+{
+    const struct runIOParams *p = pipeline->p;
+    intptr_t alignMask = 64*1024 - 1;
+    size_t tail = 0;
+    off_t total = 0;
+
+    while (1) {
+        struct runIOBuffer *b;
+        ssize_t got;
+
+        VIR_WITH_MUTEX_LOCK_GUARD(&pipeline->lock) {
+            while (pipeline->nfull == 0 && !pipeline->eof)
+                ignore_value(virCondWait(&pipeline->cond, &pipeline->lock));
+
+            if (pipeline->nfull == 0) {
+                if (pipeline->readErr) {
+                    virReportSystemError(pipeline->readErr,
+                                         _("Unable to read %s"), p->fdinname);
+                    return -2;
+                }
+                return total;
+            }
+        }
+
+        b = pipeline->bufs + tail;
+        got = b->got;
         total += got;
 
         /* handle last write size align in direct case */
-        if (got < buflen && p.isDirect && p.isWrite) {
+        if (got < pipeline->buflen && p->isDirect && p->isWrite) {
             ssize_t aligned_got = (got + alignMask) & ~alignMask;
 
-            memset(buf + got, 0, aligned_got - got);
+            memset(b->buf + got, 0, aligned_got - got);
 
-            if (safewrite(p.fdout, buf, aligned_got) < 0) {
-                virReportSystemError(errno, _("Unable to write %s"), p.fdoutname);
+            if (safewrite(p->fdout, b->buf, aligned_got) < 0) {
+                virReportSystemError(errno, _("Unable to write %s"), p->fdoutname);
                 return -3;
             }
 
-            if (!p.isBlockDev && ftruncate(p.fdout, total) < 0) {
-                virReportSystemError(errno, _("Unable to truncate %s"), p.fdoutname);
+            if (!p->isBlockDev && ftruncate(p->fdout, total) < 0) {
+                virReportSystemError(errno, _("Unable to truncate %s"), p->fdoutname);
                 return -4;
             }
 
-            break;
+            return total;
         }
 
-        if (safewrite(p.fdout, buf, got) < 0) {
-            virReportSystemError(errno, _("Unable to write %s"), p.fdoutname);
+        if (safewrite(p->fdout, b->buf, got) < 0) {
+            virReportSystemError(errno, _("Unable to write %s"), p->fdoutname);
             return -3;
         }
+
+        tail = (tail + 1) % RUN_IO_BUFFERS;
+        VIR_WITH_MUTEX_LOCK_GUARD(&pipeline->lock) {
+            pipeline->nfull--;
+            virCondSignal(&pipeline->cond);
+        }
+    }
+}
+
+
+/**
+ * runIOCopy: execute the IO copy based on the passed parameters
+ * @p: the IO parameters
+ *
+ * Execute the copy based on the passed parameters. Reading is done by a
+ * separate thread, so that reading the next chunk of data overlaps with
+ * writing the previous one.
+ *
+ * Returns: size transferred, or < 0 on error.
+ */
+
+static off_t
+runIOCopy(const struct runIOParams p)
+{
+    struct runIOPipeline pipeline = { .p = &p, .buflen = 1024*1024 };
+    intptr_t alignMask = 64*1024 - 1;
+    virThread reader;
+    off_t total;
+    size_t i;
+
+    for (i = 0; i < RUN_IO_BUFFERS; i++) {
+        struct runIOBuffer *b = pipeline.bufs + i;
+
+# if WITH_POSIX_MEMALIGN
+        if (posix_memalign(&b->base, alignMask + 1, pipeline.buflen))
+            abort();
+        b->buf = b->base;
+# else
+        b->base = g_new0(char, pipeline.buflen + alignMask);
+        b->buf = (char *) (((intptr_t) b->base + alignMask) & ~alignMask);
+# endif
+    }
+
+    if (virMutexInit(&pipeline.lock) < 0) {
+        virReportSystemError(errno, "%s", _("Unable to initialize mutex"));
+        total = -1;
+        goto cleanup;
     }
+
+    if (virCondInit(&pipeline.cond) < 0) {
+        virReportSystemError(errno, "%s", _("Unable to initialize condition"));
+        virMutexDestroy(&pipeline.lock);
+        total = -1;
+        goto cleanup;
+    }
+
+    if (virThreadCreateFull(&reader, true, runIOReader, "io-reader",
+                            false, &pipeline) < 0) {
+        virReportSystemError(errno, "%s", _("Unable to create reader thread"));
+        total = -1;
+        goto destroy;
+    }
+
+    total = runIOWriter(&pipeline);
+
+    VIR_WITH_MUTEX_LOCK_GUARD(&pipeline.lock) {
+        pipeline.quit = true;
+        virCondSignal(&pipeline.cond);
+    }
+    virThreadJoin(&reader);
+
+ destroy:
+    virCondDestroy(&pipeline.cond);
+    virMutexDestroy(&pipeline.lock);
+ cleanup:
+    for (i = 0; i < RUN_IO_BUFFERS; i++)
+        g_free(pipeline.bufs[i].base);
     return total;
 }
 
@@ -43,12 +43,31 @@
 
 VIR_LOG_INIT("util.filecache");
 
+/* Once cached data was found valid, it is not validated again for this many
+ * microseconds. Validating means stat()-ing files for QEMU capabilities for
+ * example, which is not worth doing on every single lookup. */
+#define VIR_FILE_CACHE_VALID_TTL (1 * G_USEC_PER_SEC)
+
+typedef struct _virFileCacheEntry virFileCacheEntry;
+struct _virFileCacheEntry {
+    /* the data is being validated or created with the cache unlocked,
+     * lookups of the same name wait on entryCond meanwhile */
+    bool busy;
+    /* monotonic time in microseconds until which the data is assumed to be
+     * valid without calling isValid */
+    gint64 validUntil;
+};
+
 
 struct _virFileCache {
     virObjectLockable parent;
 
     GHashTable *table;
 
+    /* per name state of the data, see virFileCacheEntry */
+    GHashTable *entries;
+    virCond entryCond;
+
     char *dir;
     char *suffix;
 
@@ -78,6 +97,8 @@ virFileCacheDispose(void *obj)
     g_free(cache->suffix);
 
     g_clear_pointer(&cache->table, g_hash_table_unref);
+    g_clear_pointer(&cache->entries, g_hash_table_unref);
+    virCondDestroy(&cache->entryCond);
 
     virFileCachePrivFree(cache);
 }
@@ -194,6 +215,7 @@ virFileCacheSave(virFileCache *cache,
 }
 
 
+/* Must be called with the cache unlocked. */
 static void *
 virFileCacheNewData(virFileCache *cache,
                     const char *name)
@@ -205,10 +227,8 @@ virFileCacheNewData(virFileCache *cache,
         return NULL;
 
     if (rv == 0) {
-        if (!(data = cache->handlers.newData(name, cache->priv)))
-            return NULL;
-
-        if (virFileCacheSave(cache, name, data) < 0) {
+        if ((data = cache->handlers.newData(name, cache->priv)) &&
+            virFileCacheSave(cache, name, data) < 0) {
             g_clear_pointer(&data, virObjectUnref);
         }
     }
@@ -241,7 +261,15 @@ virFileCacheNew(const char *dir,
     if (!(cache = virObjectNew(virFileCacheClass)))
         return NULL;
 
+    if (virCondInit(&cache->entryCond) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("unable to initialize file cache condition"));
+        virObjectUnref(cache);
+        return NULL;
+    }
+
     cache->table = virHashNew(virObjectFreeHashData);
+    cache->entries = virHashNew(g_free);
 
     cache->dir = g_strdup(dir);
 
@@ -253,29 +281,93 @@ virFileCacheNew(const char *dir,
 }
 
 
-static void
+static virFileCacheEntry *
+virFileCacheGetEntry(virFileCache *cache,
+                     const char *name)
+{
+    virFileCacheEntry *entry;
+
+    if (!(entry = virHashLookup(cache->entries, name))) {
+        entry = g_new0(virFileCacheEntry, 1);
+        g_hash_table_insert(cache->entries, g_strdup(name), entry);
+    }
+
+    return entry;
+}
+
+
+/*
+ * Validates @data found in the cache for @name or creates new data if
+ * there's none or it is no longer valid. Both may take a long time, QEMU
+ * capabilities are probed by running QEMU for example, so it's done with
+ * the cache unlocked: lookups of other names don't need to wait for it and
+ * lookups of @name wait for the result instead of doing the same work
+ * again.
+ *
+ * Returns a new reference to valid data or NULL on error.
+ */
+static void *
 virFileCacheValidate(virFileCache *cache,
                      const char *name,
-                     void **data)
+                     void *data)
 {
-    if (*data && !cache->handlers.isValid(*data, cache->priv)) {
-        VIR_DEBUG("Cached data '%p' no longer valid for '%s'",
-                  *data, NULLSTR(name));
-        if (name)
-            virHashRemoveEntry(cache->table, name);
-        *data = NULL;
+    virFileCacheEntry *entry;
+    bool valid = false;
+
+    if (!name)
+        return NULL;
+
+    entry = virFileCacheGetEntry(cache, name);
+
+    while (entry->busy) {
+        VIR_DEBUG("Waiting for data for '%s'", name);
+        if (virCondWait(&cache->entryCond, &cache->parent.lock) < 0) {
+            virReportSystemError(errno, "%s",
+                                 _("failed to wait for cached data"));
+            return NULL;
+        }
+
+        /* if the other thread failed, try again ourselves */
+        data = virHashLookup(cache->table, name);
+    }
+
+    if (data && g_get_monotonic_time() < entry->validUntil)
+        return virObjectRef(data);
+
+    entry->busy = true;
+    virObjectRef(data);
+    virObjectUnlock(cache);
+
+    if (data) {
+        if (!(valid = cache->handlers.isValid(data, cache->priv))) {
+            VIR_DEBUG("Cached data '%p' no longer valid for '%s'",
+                      data, name);
+            g_clear_pointer(&data, virObjectUnref);
+        }
     }
 
-    if (!*data && name) {
+    if (!data) {
         VIR_DEBUG("Creating data for '%s'", name);
-        *data = virFileCacheNewData(cache, name);
-        if (*data) {
-            VIR_DEBUG("Caching data '%p' for '%s'", *data, name);
-            if (virHashAddEntry(cache->table, name, *data) < 0) {
-                g_clear_pointer(data, virObjectUnref);
-            }
+        data = virFileCacheNewData(cache, name);
+    }
+
+    virObjectLock(cache);
+
+    if (data) {
+        entry->validUntil = g_get_monotonic_time() + VIR_FILE_CACHE_VALID_TTL;
+
+        if (!valid) {
+            VIR_DEBUG("Caching data '%p' for '%s'", data, name);
+            g_hash_table_insert(cache->table, g_strdup(name), virObjectRef(data));
         }
+    } else {
+        virHashRemoveEntry(cache->table, name);
     }
+
+    entry->busy = false;
+    virCondBroadcast(&cache->entryCond);
+
+    return data;
 }
 
 
@@ -300,9 +392,8 @@ virFileCacheLookup(virFileCache *cache,
     virObjectLock(cache);
 
     data = virHashLookup(cache->table, name);
-    virFileCacheValidate(cache, name, &data);
+    data = virFileCacheValidate(cache, name, data);
 
-    virObjectRef(data);
     virObjectUnlock(cache);
 
     return data;
@@ -331,9 +422,8 @@ virFileCacheLookupByFunc(virFileCache *cache,
     virObjectLock(cache);
 
     data = virHashSearch(cache->table, iter, iterData, &name);
-    virFileCacheValidate(cache, name, &data);
+    data = virFileCacheValidate(cache, name, data);
 
-    virObjectRef(data);
     virObjectUnlock(cache);
 
     return data;
@@ -403,7 +493,8 @@ virFileCacheInsertData(virFileCache *cache,
 
     virObjectLock(cache);
 
-    ret = virHashUpdateEntry(cache->table, name, data);
+    if ((ret = virHashUpdateEntry(cache->table, name, data)) == 0)
+        virFileCacheGetEntry(cache, name)->validUntil = 0;
 
     virObjectUnlock(cache);
 
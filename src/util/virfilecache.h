@@ -34,7 +34,9 @@ typedef struct _virFileCache virFileCache;
  * @priv: private data created together with cache
  *
  * Validates the cached data whether it needs to be refreshed
- * or no.
+ * or no.  Data found valid is not validated again for a short
+ * while.  Like other handlers, it is called with the cache
+ * unlocked and may run concurrently for different names.
  *
  * Returns *true* if it's valid or *false* if not valid.
  */
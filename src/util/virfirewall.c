@@ -31,6 +31,7 @@
 #include "virlog.h"
 #include "virfile.h"
 #include "virthread.h"
+#include "virprobe.h"
 
 #define VIR_FROM_THIS VIR_FROM_FIREWALL
 
@@ -46,6 +47,12 @@ VIR_ENUM_IMPL(virFirewallLayerCommand,
               IP6TABLES,
 );
 
+VIR_ENUM_IMPL(virFirewallBackend,
+              VIR_FIREWALL_BACKEND_LAST,
+              "iptables",
+              "nftables",
+);
+
 struct _virFirewallRule {
     virFirewallLayer layer;
 
@@ -74,6 +81,7 @@ struct _virFirewallGroup {
 
 struct _virFirewall {
     int err;
+    virFirewallBackend backend;
 
     size_t ngroups;
     virFirewallGroup **groups;
@@ -100,13 +108,39 @@ virFirewallGroupNew(void)
  * Returns the new firewall ruleset
  */
 virFirewall *virFirewallNew(void)
+{
+    return virFirewallNewFromBackend(VIR_FIREWALL_BACKEND_IPTABLES);
+}
+
+
+/**
+ * virFirewallNewFromBackend:
+ * @backend: the tool to apply the rules with
+ *
+ * Same as virFirewallNew(), except that rules added to the
+ * ruleset are arguments to the command of @backend. With the
+ * nftables backend, all rules are passed to 'nft' regardless
+ * of their layer.
+ *
+ * Returns the new firewall ruleset
+ */
+virFirewall *virFirewallNewFromBackend(virFirewallBackend backend)
 {
     virFirewall *firewall = g_new0(virFirewall, 1);
 
+    firewall->backend = backend;
+
     return firewall;
 }
 
 
+virFirewallBackend
+virFirewallGetBackend(virFirewall *firewall)
+{
+    return firewall->backend;
+}
+
+
 static void
 virFirewallRuleFree(virFirewallRule *rule)
 {
@@ -214,18 +248,20 @@ virFirewallAddRuleFullV(virFirewall *firewall,
     rule->queryOpaque = opaque;
     rule->ignoreErrors = ignoreErrors;
 
-    switch (rule->layer) {
-    case VIR_FIREWALL_LAYER_ETHERNET:
-        ADD_ARG(rule, "--concurrent");
-        break;
-    case VIR_FIREWALL_LAYER_IPV4:
-        ADD_ARG(rule, "-w");
-        break;
-    case VIR_FIREWALL_LAYER_IPV6:
-        ADD_ARG(rule, "-w");
-        break;
-    case VIR_FIREWALL_LAYER_LAST:
-        break;
+    if (firewall->backend == VIR_FIREWALL_BACKEND_IPTABLES) {
+        switch (rule->layer) {
+        case VIR_FIREWALL_LAYER_ETHERNET:
+            ADD_ARG(rule, "--concurrent");
+            break;
+        case VIR_FIREWALL_LAYER_IPV4:
+            ADD_ARG(rule, "-w");
+            break;
+        case VIR_FIREWALL_LAYER_IPV6:
+            ADD_ARG(rule, "-w");
+            break;
+        case VIR_FIREWALL_LAYER_LAST:
+            break;
+        }
     }
 
     while ((str = va_arg(args, char *)) != NULL)
@@ -462,10 +498,22 @@ void virFirewallStartRollback(virFirewall *firewall,
 }
 
 
+static const char *
+virFirewallRuleGetCommand(virFirewall *firewall,
+                          virFirewallRule *rule)
+{
+    if (firewall->backend == VIR_FIREWALL_BACKEND_NFTABLES)
+        return NFT;
+
+    return virFirewallLayerCommandTypeToString(rule->layer);
+}
+
+
 static char *
-virFirewallRuleToString(virFirewallRule *rule)
+virFirewallRuleToString(virFirewall *firewall,
+                        virFirewallRule *rule)
 {
-    const char *bin = virFirewallLayerCommandTypeToString(rule->layer);
+    const char *bin = virFirewallRuleGetCommand(firewall, rule);
     g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
     size_t i;
 
@@ -479,12 +527,13 @@ virFirewallRuleToString(virFirewallRule *rule)
 }
 
 static int
-virFirewallApplyRuleDirect(virFirewallRule *rule,
+virFirewallApplyRuleDirect(virFirewall *firewall,
+                           virFirewallRule *rule,
                            bool ignoreErrors,
                            char **output)
 {
     size_t i;
-    const char *bin = virFirewallLayerCommandTypeToString(rule->layer);
+    const char *bin = virFirewallRuleGetCommand(firewall, rule);
     g_autoptr(virCommand) cmd = NULL;
     int status;
     g_autofree char *error = NULL;
@@ -524,6 +573,222 @@ virFirewallApplyRuleDirect(virFirewallRule *rule,
 }
 
 
+/* Whether @rule can be applied as part of a single *tables-restore
+ * or nft transaction along with its neighbours. That's not the case for
+ * rules whose output or failure is of interest on its own. */
+static bool
+virFirewallRuleIsBatchable(virFirewall *firewall,
+                           virFirewallRule *rule,
+                           bool ignoreErrors)
+{
+    size_t i;
+
+    if (ignoreErrors || rule->ignoreErrors || rule->queryCB)
+        return false;
+
+    if (firewall->backend == VIR_FIREWALL_BACKEND_NFTABLES)
+        return rule->argsLen > 0 && STRNEQ(rule->args[0], "list");
+
+    if (rule->layer != VIR_FIREWALL_LAYER_IPV4 &&
+        rule->layer != VIR_FIREWALL_LAYER_IPV6)
+        return false;
+
+    /* commands iptables-restore doesn't accept */
+    for (i = 0; i < rule->argsLen; i++) {
+        if (STREQ(rule->args[i], "-L") ||
+            STREQ(rule->args[i], "--list") ||
+            STREQ(rule->args[i], "-S") ||
+            STREQ(rule->args[i], "--list-rules") ||
+            STREQ(rule->args[i], "-C") ||
+            STREQ(rule->args[i], "--check"))
+            return false;
+    }
+
+    return true;
+}
+
+
+static const char *
+virFirewallRuleGetTable(virFirewallRule *rule)
+{
+    size_t i;
+
+    for (i = 0; i + 1 < rule->argsLen; i++) {
+        if (STREQ(rule->args[i], "-t") ||
+            STREQ(rule->args[i], "--table"))
+            return rule->args[i + 1];
+    }
+
+    return "filter";
+}
+
+
+/* Returns the number of consecutive rules starting at @start which can
+ * be applied in one go, i.e. which are batchable and, unless nft is used,
+ * use the same layer and table. */
+static size_t
+virFirewallGroupGetBatchLength(virFirewall *firewall,
+                               virFirewallGroup *group,
+                               size_t start,
+                               bool ignoreErrors)
+{
+    virFirewallRule *first = group->action[start];
+    bool nft = firewall->backend == VIR_FIREWALL_BACKEND_NFTABLES;
+    const char *table;
+    size_t i;
+
+    if (!virFirewallRuleIsBatchable(firewall, first, ignoreErrors))
+        return 1;
+
+    table = virFirewallRuleGetTable(first);
+
+    for (i = start + 1; i < group->naction; i++) {
+        virFirewallRule *rule = group->action[i];
+
+        if (!virFirewallRuleIsBatchable(firewall, rule, ignoreErrors))
+            break;
+
+        if (!nft &&
+            (rule->layer != first->layer ||
+             STRNEQ(virFirewallRuleGetTable(rule), table)))
+            break;
+    }
+
+    return i - start;
+}
+
+
+/* Format @rule as a line of iptables-restore input, that is without the
+ * table which is given by the enclosing block and without the wait flag
+ * which is passed to iptables-restore itself. Arguments of nft are joined
+ * the same way nft does it for its command line. */
+static void
+virFirewallRuleFormatBatch(virFirewall *firewall,
+                           virFirewallRule *rule,
+                           virBuffer *buf)
+{
+    bool first = true;
+    size_t i;
+
+    if (firewall->backend == VIR_FIREWALL_BACKEND_NFTABLES) {
+        virBufferAdd(buf, rule->args[0], -1);
+        for (i = 1; i < rule->argsLen; i++)
+            virBufferAsprintf(buf, " %s", rule->args[i]);
+        virBufferAddLit(buf, "\n");
+        return;
+    }
+
+    for (i = 0; i < rule->argsLen; i++) {
+        const char *arg = rule->args[i];
+
+        /* added by virFirewallAddRuleFullV() for every rule */
+        if (i == 0 && STREQ(arg, "-w"))
+            continue;
+
+        if (STREQ(arg, "-t") || STREQ(arg, "--table")) {
+            i++;
+            continue;
+        }
+
+        if (!first)
+            virBufferAddLit(buf, " ");
+        first = false;
+
+        if (*arg && !strpbrk(arg, " \t\"'\\")) {
+            virBufferAdd(buf, arg, -1);
+            continue;
+        }
+
+        virBufferAddChar(buf, '"');
+        for (; *arg; arg++) {
+            if (*arg == '"' || *arg == '\\')
+                virBufferAddChar(buf, '\\');
+            virBufferAddChar(buf, *arg);
+        }
+        virBufferAddChar(buf, '"');
+    }
+
+    virBufferAddLit(buf, "\n");
+}
+
+
+/* Returns the path of the binary to apply a batch of rules of @layer
+ * with, or NULL if it is not available. */
+static char *
+virFirewallGetBatchCommand(virFirewall *firewall,
+                           virFirewallLayer layer)
+{
+    if (firewall->backend == VIR_FIREWALL_BACKEND_NFTABLES)
+        return virFindFileInPath(NFT);
+
+    switch (layer) {
+    case VIR_FIREWALL_LAYER_IPV4:
+        return virFindFileInPath(IPTABLES_RESTORE);
+    case VIR_FIREWALL_LAYER_IPV6:
+        return virFindFileInPath(IP6TABLES_RESTORE);
+    case VIR_FIREWALL_LAYER_ETHERNET:
+    case VIR_FIREWALL_LAYER_LAST:
+        break;
+    }
+
+    return NULL;
+}
+
+
+/* Apply @nrules rules, as returned by virFirewallGroupGetBatchLength(),
+ * as a single iptables-restore or nft transaction. Either all of them
+ * get applied, or none. */
+static int
+virFirewallApplyRulesBatch(virFirewall *firewall,
+                           virFirewallRule **rules,
+                           size_t nrules,
+                           const char *bin)
+{
+    bool nft = firewall->backend == VIR_FIREWALL_BACKEND_NFTABLES;
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    g_autoptr(virCommand) cmd = NULL;
+    g_autofree char *input = NULL;
+    g_autofree char *output = NULL;
+    g_autofree char *error = NULL;
+    int status;
+    size_t i;
+
+    if (!nft)
+        virBufferAsprintf(&buf, "*%s\n", virFirewallRuleGetTable(rules[0]));
+    for (i = 0; i < nrules; i++) {
+        g_autofree char *str = virFirewallRuleToString(firewall, rules[i]);
+        VIR_INFO("Applying rule '%s'", NULLSTR(str));
+
+        virFirewallRuleFormatBatch(firewall, rules[i], &buf);
+    }
+    if (!nft)
+        virBufferAddLit(&buf, "COMMIT\n");
+    input = virBufferContentAndReset(&buf);
+
+    if (nft)
+        cmd = virCommandNewArgList(bin, "-f", "-", NULL);
+    else
+        cmd = virCommandNewArgList(bin, "-w", "--noflush", NULL);
+    virCommandSetInputBuffer(cmd, input);
+    virCommandSetOutputBuffer(cmd, &output);
+    virCommandSetErrorBuffer(cmd, &error);
+
+    if (virCommandRun(cmd, &status) < 0)
+        return -1;
+
+    if (status != 0) {
+        g_autofree char *args = virCommandToString(cmd, false);
+        VIR_DEBUG("Failed transaction was:\n%s", input);
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Failed to apply firewall rules %s: %s"),
+                       NULLSTR(args), NULLSTR(error));
+        return -1;
+    }
+
+    return 0;
+}
+
+
 static int G_GNUC_UNUSED
 virFirewallApplyRuleFirewallD(virFirewallRule *rule,
                               bool ignoreErrors,
@@ -540,14 +805,14 @@ virFirewallApplyRule(virFirewall *firewall,
                      bool ignoreErrors)
 {
     g_autofree char *output = NULL;
-    g_autofree char *str = virFirewallRuleToString(rule);
+    g_autofree char *str = virFirewallRuleToString(firewall, rule);
     g_auto(GStrv) lines = NULL;
     VIR_INFO("Applying rule '%s'", NULLSTR(str));
 
     if (rule->ignoreErrors)
         ignoreErrors = rule->ignoreErrors;
 
-    if (virFirewallApplyRuleDirect(rule, ignoreErrors, &output) < 0)
+    if (virFirewallApplyRuleDirect(firewall, rule, ignoreErrors, &output) < 0)
         return -1;
 
     if (rule->queryCB && output) {
@@ -581,11 +846,29 @@ virFirewallApplyGroup(virFirewall *firewall,
              firewall, group, group->actionFlags);
     firewall->currentGroup = idx;
     group->addingRollback = false;
-    for (i = 0; i < group->naction; i++) {
-        if (virFirewallApplyRule(firewall,
-                                 group->action[i],
-                                 ignoreErrors) < 0)
-            return -1;
+    /* Each iptables invocation reads and writes back the whole table, so
+     * apply runs of rules which don't need to be looked at one by one
+     * using a single iptables-restore (or nft) transaction instead. Query
+     * callbacks may append further rules to the group while we're
+     * iterating over it. */
+    for (i = 0; i < group->naction;) {
+        size_t n = virFirewallGroupGetBatchLength(firewall, group, i, ignoreErrors);
+        g_autofree char *bin = NULL;
+
+        if (n > 1 &&
+            (bin = virFirewallGetBatchCommand(firewall, group->action[i]->layer))) {
+            if (virFirewallApplyRulesBatch(firewall, group->action + i, n, bin) < 0)
+                return -1;
+            i += n;
+            continue;
+        }
+
+        for (; n > 0; n--, i++) {
+            if (virFirewallApplyRule(firewall,
+                                     group->action[i],
+                                     ignoreErrors) < 0)
+                return -1;
+        }
     }
     return 0;
 }
@@ -609,21 +892,10 @@ virFirewallRollbackGroup(virFirewall *firewall,
 }
 
 
-int
-virFirewallApply(virFirewall *firewall)
+static int
+virFirewallApplyGroups(virFirewall *firewall)
 {
     size_t i, j;
-    VIR_LOCK_GUARD lock = virLockGuardLock(&ruleLock);
-
-    if (!firewall || firewall->err) {
-        int err = EINVAL;
-
-        if (firewall)
-            err = firewall->err;
-
-        virReportSystemError(err, "%s", _("Unable to create rule"));
-        return -1;
-    }
 
     VIR_DEBUG("Applying groups for %p", firewall);
     for (i = 0; i < firewall->ngroups; i++) {
@@ -662,3 +934,33 @@ virFirewallApply(virFirewall *firewall)
 
     return 0;
 }
+
+
+int
+virFirewallApply(virFirewall *firewall)
+{
+    VIR_LOCK_GUARD lock = virLockGuardLock(&ruleLock);
+    gint64 start;
+    int ret;
+
+    if (!firewall || firewall->err) {
+        int err = EINVAL;
+
+        if (firewall)
+            err = firewall->err;
+
+        virReportSystemError(err, "%s", _("Unable to create rule"));
+        return -1;
+    }
+
+    start = g_get_monotonic_time();
+    ret = virFirewallApplyGroups(firewall);
+
+    PROBE(FIREWALL_APPLY,
+          "firewall=%p backend=%s groups=%zu ret=%d usec=%llu",
+          firewall, virFirewallBackendTypeToString(firewall->backend),
+          firewall->ngroups, ret,
+          (unsigned long long) (g_get_monotonic_time() - start));
+
+    return ret;
+}
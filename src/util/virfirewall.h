@@ -21,6 +21,7 @@
 #pragma once
 
 #include "internal.h"
+#include "virenum.h"
 
 typedef struct _virFirewall virFirewall;
 
@@ -34,7 +35,19 @@ typedef enum {
     VIR_FIREWALL_LAYER_LAST,
 } virFirewallLayer;
 
+typedef enum {
+    VIR_FIREWALL_BACKEND_IPTABLES,
+    VIR_FIREWALL_BACKEND_NFTABLES,
+
+    VIR_FIREWALL_BACKEND_LAST,
+} virFirewallBackend;
+
+VIR_ENUM_DECL(virFirewallBackend);
+
 virFirewall *virFirewallNew(void);
+virFirewall *virFirewallNewFromBackend(virFirewallBackend backend);
+
+virFirewallBackend virFirewallGetBackend(virFirewall *firewall);
 
 void virFirewallFree(virFirewall *firewall);
 
@@ -91,6 +91,60 @@ virHashNew(GDestroyNotify dataFree)
 }
 
 
+static unsigned int
+virHashTableUUIDKey(const void *vkey)
+{
+    return virHashCodeGen(vkey, VIR_UUID_BUFLEN, virHashTableSeed);
+}
+
+
+static gboolean
+virHashTableUUIDEqual(const void *a,
+                      const void *b)
+{
+    return memcmp(a, b, VIR_UUID_BUFLEN) == 0;
+}
+
+
+/**
+ * virHashNewUUID:
+ * @dataFree: callback to free data
+ *
+ * Create a new GHashTable * for use with raw UUIDs of VIR_UUID_BUFLEN
+ * bytes as keys. Unlike with UUID strings there's no need to format the
+ * UUID on every lookup. Keys to insert must be allocated by
+ * virHashUUIDKeyNew, the table frees them.
+ *
+ * Returns the newly created object.
+ */
+GHashTable *
+virHashNewUUID(GDestroyNotify dataFree)
+{
+    ignore_value(virHashTableSeedInitialize());
+
+    return g_hash_table_new_full(virHashTableUUIDKey, virHashTableUUIDEqual,
+                                 g_free, dataFree);
+}
+
+
+/**
+ * virHashUUIDKeyNew:
+ * @uuid: raw UUID
+ *
+ * Returns a copy of @uuid for use as a key of a table created by
+ * virHashNewUUID.
+ */
+unsigned char *
+virHashUUIDKeyNew(const unsigned char *uuid)
+{
+    unsigned char *key = g_new(unsigned char, VIR_UUID_BUFLEN);
+
+    memcpy(key, uuid, VIR_UUID_BUFLEN);
+
+    return key;
+}
+
+
 virHashAtomic *
 virHashAtomicNew(GDestroyNotify dataFree)
 {
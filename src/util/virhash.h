@@ -43,6 +43,8 @@ typedef int (*virHashSearcher) (const void *payload, const char *name,
  * Constructor and destructor.
  */
 GHashTable *virHashNew(GDestroyNotify dataFree) G_GNUC_WARN_UNUSED_RESULT;
+GHashTable *virHashNewUUID(GDestroyNotify dataFree) G_GNUC_WARN_UNUSED_RESULT;
+unsigned char *virHashUUIDKeyNew(const unsigned char *uuid);
 virHashAtomic *virHashAtomicNew(GDestroyNotify dataFree);
 ssize_t virHashSize(GHashTable *table);
 
@@ -49,6 +49,7 @@
 #include "virstring.h"
 #include "virnuma.h"
 #include "virlog.h"
+#include "virnetlink.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
 
@@ -57,6 +58,25 @@ VIR_LOG_INIT("util.hostcpu");
 #define KVM_DEVICE "/dev/kvm"
 #define MSR_DEVICE "/dev/cpu/0/msr"
 
+/* Bumped on every CPU, memory or NUMA node hotplug once
+ * virHostCPUTopologyWatch() succeeded */
+static unsigned int virHostCPUTopologyGeneration;
+static int virHostCPUTopologyWatched;
+
+/* Result of the last virHostCPUGetInfo() call parsing the host */
+static virMutex virHostCPUInfoCacheLock = VIR_MUTEX_INITIALIZER;
+static struct {
+    bool valid;
+    unsigned int generation;
+    virArch arch;
+    unsigned int cpus;
+    unsigned int mhz;
+    unsigned int nodes;
+    unsigned int sockets;
+    unsigned int cores;
+    unsigned int threads;
+} virHostCPUInfoCache;
+
 
 #if defined(__FreeBSD__) || defined(__APPLE__)
 static int
@@ -761,7 +781,7 @@ virHostCPUGetStatsLinux(FILE *procstat,
     char line[1024];
     unsigned long long usr, ni, sys, idle, iowait;
     unsigned long long irq, softirq, steal, guest, guest_nice;
-    g_autofree char *cpu_header = NULL;
+    char cpu_header[VIR_INT64_STR_BUFLEN + 4];
 
     if ((*nparams) == 0) {
         /* Current number of cpu stats supported by linux */
@@ -777,9 +797,9 @@ virHostCPUGetStatsLinux(FILE *procstat,
     }
 
     if (cpuNum == VIR_NODE_CPU_STATS_ALL_CPUS) {
-        cpu_header = g_strdup("cpu ");
+        g_snprintf(cpu_header, sizeof(cpu_header), "cpu ");
     } else {
-        cpu_header = g_strdup_printf("cpu%d ", cpuNum);
+        g_snprintf(cpu_header, sizeof(cpu_header), "cpu%d ", cpuNum);
     }
 
     while (fgets(line, sizeof(line), procstat) != NULL) {
@@ -871,6 +891,92 @@ virHostCPUStatsAssign(virNodeCPUStatsPtr param,
 }
 
 
+#if defined(__linux__) && defined(WITH_LIBNL)
+static void
+virHostCPUTopologyEvent(struct nlmsghdr *msg,
+                        unsigned int length,
+                        struct sockaddr_nl *peer G_GNUC_UNUSED,
+                        bool *handled G_GNUC_UNUSED,
+                        void *opaque G_GNUC_UNUSED)
+{
+    const char *event = (const char *) msg;
+    const char *devpath;
+    size_t len = strnlen(event, length);
+
+    /* Kernel uevents start with "ACTION@DEVPATH" */
+    if (len == length || !(devpath = strchr(event, '@')))
+        return;
+
+    devpath++;
+    if (STRPREFIX(devpath, "/devices/system/cpu/") ||
+        STRPREFIX(devpath, "/devices/system/memory/") ||
+        STRPREFIX(devpath, "/devices/system/node/")) {
+        VIR_DEBUG("Host topology changed: %s", event);
+        g_atomic_int_inc(&virHostCPUTopologyGeneration);
+    }
+}
+
+
+/**
+ * virHostCPUTopologyWatch:
+ *
+ * Start watching CPU, memory and NUMA node hotplug events delivered by the
+ * NETLINK_KOBJECT_UEVENT event service, which must be running already.
+ * Until this succeeds, host topology is never cached and parsed again on
+ * each query. Without uevent support this is a no-op.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virHostCPUTopologyWatch(void)
+{
+    if (g_atomic_int_get(&virHostCPUTopologyWatched))
+        return 0;
+
+    if (!virNetlinkEventServiceIsRunning(NETLINK_KOBJECT_UEVENT)) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("uevent monitor is not running"));
+        return -1;
+    }
+
+    if (virNetlinkEventAddClient(virHostCPUTopologyEvent, NULL, NULL, NULL,
+                                 NETLINK_KOBJECT_UEVENT) < 0)
+        return -1;
+
+    g_atomic_int_set(&virHostCPUTopologyWatched, 1);
+    return 0;
+}
+#else /* !(__linux__ && WITH_LIBNL) */
+int
+virHostCPUTopologyWatch(void)
+{
+    VIR_DEBUG("Host topology changes can't be watched, not caching it");
+    return 0;
+}
+#endif /* !(__linux__ && WITH_LIBNL) */
+
+
+/**
+ * virHostCPUGetTopologyGeneration:
+ * @generation: filled with the current generation of host topology
+ *
+ * Host topology information may be cached for as long as @generation
+ * doesn't change.
+ *
+ * Returns true if @generation is valid, false if hotplug events are not
+ * watched and host topology must not be cached.
+ */
+bool
+virHostCPUGetTopologyGeneration(unsigned int *generation)
+{
+    if (!g_atomic_int_get(&virHostCPUTopologyWatched))
+        return false;
+
+    *generation = g_atomic_int_get(&virHostCPUTopologyGeneration);
+    return true;
+}
+
+
 int
 virHostCPUGetInfo(virArch hostarch G_GNUC_UNUSED,
                   unsigned int *cpus G_GNUC_UNUSED,
@@ -882,9 +988,27 @@ virHostCPUGetInfo(virArch hostarch G_GNUC_UNUSED,
 {
 #ifdef __linux__
     int ret = -1;
-    FILE *cpuinfo = fopen(CPUINFO_PATH, "r");
+    FILE *cpuinfo = NULL;
+    unsigned int generation = 0;
+    bool cache = virHostCPUGetTopologyGeneration(&generation);
+
+    if (cache) {
+        VIR_LOCK_GUARD lock = virLockGuardLock(&virHostCPUInfoCacheLock);
+
+        if (virHostCPUInfoCache.valid &&
+            virHostCPUInfoCache.generation == generation &&
+            virHostCPUInfoCache.arch == hostarch) {
+            *cpus = virHostCPUInfoCache.cpus;
+            *mhz = virHostCPUInfoCache.mhz;
+            *nodes = virHostCPUInfoCache.nodes;
+            *sockets = virHostCPUInfoCache.sockets;
+            *cores = virHostCPUInfoCache.cores;
+            *threads = virHostCPUInfoCache.threads;
+            return 0;
+        }
+    }
 
-    if (!cpuinfo) {
+    if (!(cpuinfo = fopen(CPUINFO_PATH, "r"))) {
         virReportSystemError(errno,
                              _("cannot open %s"), CPUINFO_PATH);
         return -1;
@@ -896,6 +1020,20 @@ virHostCPUGetInfo(virArch hostarch G_GNUC_UNUSED,
     if (ret < 0)
         goto cleanup;
 
+    if (cache) {
+        VIR_LOCK_GUARD lock = virLockGuardLock(&virHostCPUInfoCacheLock);
+
+        virHostCPUInfoCache.valid = true;
+        virHostCPUInfoCache.generation = generation;
+        virHostCPUInfoCache.arch = hostarch;
+        virHostCPUInfoCache.cpus = *cpus;
+        virHostCPUInfoCache.mhz = *mhz;
+        virHostCPUInfoCache.nodes = *nodes;
+        virHostCPUInfoCache.sockets = *sockets;
+        virHostCPUInfoCache.cores = *cores;
+        virHostCPUInfoCache.threads = *threads;
+    }
+
  cleanup:
     VIR_FORCE_FCLOSE(cpuinfo);
     return ret;
@@ -50,6 +50,9 @@ int virHostCPUGetThreadsPerSubcore(virArch arch) G_GNUC_NO_INLINE;
 int virHostCPUGetMap(unsigned char **cpumap,
                      unsigned int *online,
                      unsigned int flags);
+int virHostCPUTopologyWatch(void);
+bool virHostCPUGetTopologyGeneration(unsigned int *generation);
+
 int virHostCPUGetInfo(virArch hostarch,
                       unsigned int *cpus,
                       unsigned int *mhz,
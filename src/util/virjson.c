@@ -58,14 +58,43 @@ struct _virJSONObjectPair {
 
 struct _virJSONObject {
     size_t npairs;
+    size_t npairs_max;
     virJSONObjectPair *pairs;
+    /* key -> value lookup table, built once the object grows large */
+    GHashTable *index;
 };
 
 struct _virJSONArray {
     size_t nvalues;
+    size_t nvalues_max;
     virJSONValue **values;
 };
 
+/* Objects with at least this many members get a hash table for lookups.
+ * Below that, a linear search is cheaper than maintaining the table. */
+#define VIR_JSON_OBJECT_INDEX_MIN 16
+
+typedef enum {
+    VIR_JSON_NUMBER_UNPARSED = 0, /* only @str is valid */
+    VIR_JSON_NUMBER_LONG, /* fits into long long */
+    VIR_JSON_NUMBER_ULONG, /* fits only into unsigned long long */
+    VIR_JSON_NUMBER_OTHER, /* not an integer */
+} virJSONNumberKind;
+
+/* Numbers are kept in the form they were created in and converted into the
+ * other one only once it's asked for. Parsed numbers keep the string, since
+ * the precision of doubles can't be known up front, and parse it on the first
+ * access. Integers created by libvirt are formatted only when needed. */
+typedef struct _virJSONNumber virJSONNumber;
+struct _virJSONNumber {
+    char *str;
+    virJSONNumberKind kind;
+    union {
+        long long l;
+        unsigned long long ul;
+    } val;
+};
+
 struct _virJSONValue {
     int type; /* enum virJSONType */
 
@@ -73,7 +102,7 @@ struct _virJSONValue {
         virJSONObject object;
         virJSONArray array;
         char *string;
-        char *number; /* int/float/etc format is context defined so we can't parse it here :-( */
+        virJSONNumber number;
         int boolean;
     } data;
 };
@@ -378,6 +407,7 @@ virJSONValueFree(virJSONValue *value)
 
     switch ((virJSONType) value->type) {
     case VIR_JSON_TYPE_OBJECT:
+        g_clear_pointer(&value->data.object.index, g_hash_table_unref);
         for (i = 0; i < value->data.object.npairs; i++) {
             g_free(value->data.object.pairs[i].key);
             virJSONValueFree(value->data.object.pairs[i].value);
@@ -393,7 +423,7 @@ virJSONValueFree(virJSONValue *value)
         g_free(value->data.string);
         break;
     case VIR_JSON_TYPE_NUMBER:
-        g_free(value->data.number);
+        g_free(value->data.number.str);
         break;
     case VIR_JSON_TYPE_BOOLEAN:
     case VIR_JSON_TYPE_NULL:
@@ -443,7 +473,19 @@ virJSONValueNewNumber(char *data)
     val = g_new0(virJSONValue, 1);
 
     val->type = VIR_JSON_TYPE_NUMBER;
-    val->data.number = data;
+    val->data.number.str = data;
+
+    return val;
+}
+
+
+static virJSONValue *
+virJSONValueNewNumberInteger(long long data)
+{
+    virJSONValue *val = virJSONValueNewNumber(NULL);
+
+    val->data.number.kind = VIR_JSON_NUMBER_LONG;
+    val->data.number.val.l = data;
 
     return val;
 }
@@ -452,28 +494,37 @@ virJSONValueNewNumber(char *data)
 virJSONValue *
 virJSONValueNewNumberInt(int data)
 {
-    return virJSONValueNewNumber(g_strdup_printf("%i", data));
+    return virJSONValueNewNumberInteger(data);
 }
 
 
 virJSONValue *
 virJSONValueNewNumberUint(unsigned int data)
 {
-    return virJSONValueNewNumber(g_strdup_printf("%u", data));
+    return virJSONValueNewNumberInteger(data);
 }
 
 
 virJSONValue *
 virJSONValueNewNumberLong(long long data)
 {
-    return virJSONValueNewNumber(g_strdup_printf("%lld", data));
+    return virJSONValueNewNumberInteger(data);
 }
 
 
 virJSONValue *
 virJSONValueNewNumberUlong(unsigned long long data)
 {
-    return virJSONValueNewNumber(g_strdup_printf("%llu", data));
+    virJSONValue *val;
+
+    if (data <= LLONG_MAX)
+        return virJSONValueNewNumberInteger(data);
+
+    val = virJSONValueNewNumber(NULL);
+    val->data.number.kind = VIR_JSON_NUMBER_ULONG;
+    val->data.number.val.ul = data;
+
+    return val;
 }
 
 
@@ -536,14 +587,62 @@ virJSONValueNewObject(void)
 }
 
 
-static int
-virJSONValueObjectInsert(virJSONValue *object,
+static void
+virJSONObjectIndexBuild(virJSONObject *obj)
+{
+    size_t i;
+
+    obj->index = g_hash_table_new(g_str_hash, g_str_equal);
+
+    for (i = 0; i < obj->npairs; i++)
+        g_hash_table_insert(obj->index, obj->pairs[i].key, obj->pairs[i].value);
+}
+
+
+/* Looks up @key in @object, which must be a JSON object. Sets @found as the
+ * value of a member may be NULL. */
+static virJSONValue *
+virJSONValueObjectLookup(virJSONValue *object,
                          const char *key,
-                         virJSONValue **value,
-                         bool prepend)
+                         bool *found)
 {
-    virJSONObjectPair pair = { NULL, *value };
-    int ret = -1;
+    virJSONObject *obj = &object->data.object;
+    gpointer value = NULL;
+    size_t i;
+
+    if (!obj->index && obj->npairs >= VIR_JSON_OBJECT_INDEX_MIN)
+        virJSONObjectIndexBuild(obj);
+
+    if (obj->index) {
+        *found = g_hash_table_lookup_extended(obj->index, key, NULL, &value);
+        return value;
+    }
+
+    for (i = 0; i < obj->npairs; i++) {
+        if (STREQ(obj->pairs[i].key, key)) {
+            *found = true;
+            return obj->pairs[i].value;
+        }
+    }
+
+    *found = false;
+    return NULL;
+}
+
+
+/* Same as virJSONValueObjectInsert, but takes ownership of *@key on
+ * success, so that callers which already have an allocated copy, such as the
+ * parser, don't need to duplicate it. */
+static int
+virJSONValueObjectInsertKeySteal(virJSONValue *object,
+                                 char **key,
+                                 virJSONValue **value,
+                                 bool prepend)
+{
+    virJSONObject *obj = &object->data.object;
+    virJSONObjectPair pair = { *key, *value };
+    virJSONObjectPair *inserted;
+    bool found;
 
     if (object->type != VIR_JSON_TYPE_OBJECT) {
         virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
@@ -551,27 +650,40 @@ virJSONValueObjectInsert(virJSONValue *object,
         return -1;
     }
 
-    if (virJSONValueObjectHasKey(object, key)) {
-        virReportError(VIR_ERR_INTERNAL_ERROR, _("duplicate key '%s'"), key);
+    virJSONValueObjectLookup(object, *key, &found);
+    if (found) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, _("duplicate key '%s'"), *key);
         return -1;
     }
 
-    pair.key = g_strdup(key);
+    VIR_RESIZE_N(obj->pairs, obj->npairs_max, obj->npairs, 1);
 
     if (prepend) {
-        ret = VIR_INSERT_ELEMENT(object->data.object.pairs, 0,
-                                 object->data.object.npairs, pair);
+        ignore_value(VIR_INSERT_ELEMENT_INPLACE(obj->pairs, 0, obj->npairs, pair));
+        inserted = obj->pairs;
     } else {
-        VIR_APPEND_ELEMENT(object->data.object.pairs,
-                           object->data.object.npairs, pair);
-        ret = 0;
+        VIR_APPEND_ELEMENT_INPLACE(obj->pairs, obj->npairs, pair);
+        inserted = obj->pairs + obj->npairs - 1;
     }
 
-    if (ret == 0)
-        *value = NULL;
+    if (obj->index)
+        g_hash_table_insert(obj->index, inserted->key, inserted->value);
 
-    VIR_FREE(pair.key);
-    return ret;
+    *key = NULL;
+    *value = NULL;
+    return 0;
+}
+
+
+static int
+virJSONValueObjectInsert(virJSONValue *object,
+                         const char *key,
+                         virJSONValue **value,
+                         bool prepend)
+{
+    g_autofree char *keycopy = g_strdup(key);
+
+    return virJSONValueObjectInsertKeySteal(object, &keycopy, value, prepend);
 }
 
 
@@ -741,7 +853,8 @@ virJSONValueArrayAppend(virJSONValue *array,
         return -1;
     }
 
-    VIR_REALLOC_N(array->data.array.values, array->data.array.nvalues + 1);
+    VIR_RESIZE_N(array->data.array.values, array->data.array.nvalues_max,
+                 array->data.array.nvalues, 1);
 
     array->data.array.values[array->data.array.nvalues] = g_steal_pointer(value);
     array->data.array.nvalues++;
@@ -782,8 +895,8 @@ virJSONValueArrayConcat(virJSONValue *a,
         return -1;
     }
 
-    a->data.array.values = g_renew(virJSONValue *, a->data.array.values,
-                                   a->data.array.nvalues + c->data.array.nvalues);
+    VIR_RESIZE_N(a->data.array.values, a->data.array.nvalues_max,
+                 a->data.array.nvalues, c->data.array.nvalues);
 
     for (i = 0; i < c->data.array.nvalues; i++)
         a->data.array.values[a->data.array.nvalues++] = g_steal_pointer(&c->data.array.values[i]);
@@ -798,17 +911,14 @@ int
 virJSONValueObjectHasKey(virJSONValue *object,
                          const char *key)
 {
-    size_t i;
+    bool found;
 
     if (object->type != VIR_JSON_TYPE_OBJECT)
         return -1;
 
-    for (i = 0; i < object->data.object.npairs; i++) {
-        if (STREQ(object->data.object.pairs[i].key, key))
-            return 1;
-    }
+    virJSONValueObjectLookup(object, key, &found);
 
-    return 0;
+    return found ? 1 : 0;
 }
 
 
@@ -816,17 +926,12 @@ virJSONValue *
 virJSONValueObjectGet(virJSONValue *object,
                       const char *key)
 {
-    size_t i;
+    bool found;
 
     if (object->type != VIR_JSON_TYPE_OBJECT)
         return NULL;
 
-    for (i = 0; i < object->data.object.npairs; i++) {
-        if (STREQ(object->data.object.pairs[i].key, key))
-            return object->data.object.pairs[i].value;
-    }
-
-    return NULL;
+    return virJSONValueObjectLookup(object, key, &found);
 }
 
 
@@ -908,10 +1013,12 @@ virJSONValueObjectRemoveKey(virJSONValue *object,
             if (value) {
                 *value = g_steal_pointer(&object->data.object.pairs[i].value);
             }
+            if (object->data.object.index)
+                g_hash_table_remove(object->data.object.index, key);
             VIR_FREE(object->data.object.pairs[i].key);
             virJSONValueFree(object->data.object.pairs[i].value);
-            VIR_DELETE_ELEMENT(object->data.object.pairs, i,
-                               object->data.object.npairs);
+            VIR_DELETE_ELEMENT_INPLACE(object->data.object.pairs, i,
+                                       object->data.object.npairs);
             return 1;
         }
     }
@@ -986,9 +1093,9 @@ virJSONValueArraySteal(virJSONValue *array,
 
     ret = array->data.array.values[element];
 
-    VIR_DELETE_ELEMENT(array->data.array.values,
-                       element,
-                       array->data.array.nvalues);
+    VIR_DELETE_ELEMENT_INPLACE(array->data.array.values,
+                               element,
+                               array->data.array.nvalues);
 
     return ret;
 }
@@ -1059,24 +1166,82 @@ virJSONValueGetString(virJSONValue *string)
 }
 
 
+/* Finds out which integer type the string form of @number fits into. */
+static void
+virJSONNumberParse(virJSONNumber *number)
+{
+    if (number->kind != VIR_JSON_NUMBER_UNPARSED)
+        return;
+
+    if (virStrToLong_ll(number->str, NULL, 10, &number->val.l) == 0)
+        number->kind = VIR_JSON_NUMBER_LONG;
+    else if (virStrToLong_ull(number->str, NULL, 10, &number->val.ul) == 0)
+        number->kind = VIR_JSON_NUMBER_ULONG;
+    else
+        number->kind = VIR_JSON_NUMBER_OTHER;
+}
+
+
+/* Returns the string form of @number, formatting it into @buf if it doesn't
+ * have one yet. */
+static const char *
+virJSONNumberFormat(const virJSONNumber *number,
+                    char buf[VIR_INT64_STR_BUFLEN])
+{
+    if (number->str)
+        return number->str;
+
+    if (number->kind == VIR_JSON_NUMBER_ULONG)
+        g_snprintf(buf, VIR_INT64_STR_BUFLEN, "%llu", number->val.ul);
+    else
+        g_snprintf(buf, VIR_INT64_STR_BUFLEN, "%lld", number->val.l);
+
+    return buf;
+}
+
+
+/* Like virJSONNumberFormat, but keeps the string for the caller. */
+static const char *
+virJSONNumberGetString(virJSONNumber *number)
+{
+    char buf[VIR_INT64_STR_BUFLEN];
+
+    if (!number->str)
+        number->str = g_strdup(virJSONNumberFormat(number, buf));
+
+    return number->str;
+}
+
+
 const char *
 virJSONValueGetNumberString(virJSONValue *number)
 {
     if (number->type != VIR_JSON_TYPE_NUMBER)
         return NULL;
 
-    return number->data.number;
+    return virJSONNumberGetString(&number->data.number);
 }
 
 
+/* All the integer getters below behave as the corresponding virStrToLong_*
+ * function applied on the string form of the number would. */
 int
 virJSONValueGetNumberInt(virJSONValue *number,
                          int *value)
 {
+    virJSONNumber *num = &number->data.number;
+
     if (number->type != VIR_JSON_TYPE_NUMBER)
         return -1;
 
-    return virStrToLong_i(number->data.number, NULL, 10, value);
+    virJSONNumberParse(num);
+
+    if (num->kind != VIR_JSON_NUMBER_LONG ||
+        num->val.l < INT_MIN || num->val.l > INT_MAX)
+        return -1;
+
+    *value = num->val.l;
+    return 0;
 }
 
 
@@ -1084,10 +1249,20 @@ int
 virJSONValueGetNumberUint(virJSONValue *number,
                           unsigned int *value)
 {
+    virJSONNumber *num = &number->data.number;
+
     if (number->type != VIR_JSON_TYPE_NUMBER)
         return -1;
 
-    return virStrToLong_ui(number->data.number, NULL, 10, value);
+    virJSONNumberParse(num);
+
+    /* negative numbers wrap around, "-1" is UINT_MAX */
+    if (num->kind != VIR_JSON_NUMBER_LONG ||
+        num->val.l < -(long long) UINT_MAX || num->val.l > UINT_MAX)
+        return -1;
+
+    *value = num->val.l;
+    return 0;
 }
 
 
@@ -1095,10 +1270,18 @@ int
 virJSONValueGetNumberLong(virJSONValue *number,
                           long long *value)
 {
+    virJSONNumber *num = &number->data.number;
+
     if (number->type != VIR_JSON_TYPE_NUMBER)
         return -1;
 
-    return virStrToLong_ll(number->data.number, NULL, 10, value);
+    virJSONNumberParse(num);
+
+    if (num->kind != VIR_JSON_NUMBER_LONG)
+        return -1;
+
+    *value = num->val.l;
+    return 0;
 }
 
 
@@ -1106,10 +1289,22 @@ int
 virJSONValueGetNumberUlong(virJSONValue *number,
                            unsigned long long *value)
 {
+    virJSONNumber *num = &number->data.number;
+
     if (number->type != VIR_JSON_TYPE_NUMBER)
         return -1;
 
-    return virStrToLong_ull(number->data.number, NULL, 10, value);
+    virJSONNumberParse(num);
+
+    /* negative numbers wrap around */
+    if (num->kind == VIR_JSON_NUMBER_LONG)
+        *value = num->val.l;
+    else if (num->kind == VIR_JSON_NUMBER_ULONG)
+        *value = num->val.ul;
+    else
+        return -1;
+
+    return 0;
 }
 
 
@@ -1117,10 +1312,18 @@ int
 virJSONValueGetNumberDouble(virJSONValue *number,
                             double *value)
 {
+    char buf[VIR_INT64_STR_BUFLEN];
+
     if (number->type != VIR_JSON_TYPE_NUMBER)
         return -1;
 
-    return virStrToDouble(number->data.number, NULL, value);
+    if (number->data.number.kind == VIR_JSON_NUMBER_LONG) {
+        *value = number->data.number.val.l;
+        return 0;
+    }
+
+    return virStrToDouble(virJSONNumberFormat(&number->data.number, buf),
+                          NULL, value);
 }
 
 
@@ -1164,6 +1367,11 @@ virJSONValueObjectReplaceValue(virJSONValue *object,
         if (STREQ(object->data.object.pairs[i].key, key)) {
             virJSONValueFree(object->data.object.pairs[i].value);
             object->data.object.pairs[i].value = g_steal_pointer(newval);
+
+            if (object->data.object.index)
+                g_hash_table_insert(object->data.object.index,
+                                    object->data.object.pairs[i].key,
+                                    object->data.object.pairs[i].value);
         }
     }
 }
@@ -1190,7 +1398,7 @@ virJSONValueObjectGetStringOrNumber(virJSONValue *object,
     if (val->type == VIR_JSON_TYPE_STRING)
         return val->data.string;
     else if (val->type == VIR_JSON_TYPE_NUMBER)
-        return val->data.number;
+        return virJSONNumberGetString(&val->data.number);
 
     return NULL;
 }
@@ -1399,6 +1607,7 @@ virJSONValueCopy(const virJSONValue *in)
 
         out->data.object.pairs = g_new0(virJSONObjectPair, in->data.object.npairs);
         out->data.object.npairs = in->data.object.npairs;
+        out->data.object.npairs_max = in->data.object.npairs;
 
         for (i = 0; i < in->data.object.npairs; i++) {
             out->data.object.pairs[i].key = g_strdup(in->data.object.pairs[i].key);
@@ -1410,6 +1619,7 @@ virJSONValueCopy(const virJSONValue *in)
 
         out->data.array.values = g_new0(virJSONValue *, in->data.array.nvalues);
         out->data.array.nvalues = in->data.array.nvalues;
+        out->data.array.nvalues_max = in->data.array.nvalues;
 
         for (i = 0; i < in->data.array.nvalues; i++) {
             out->data.array.values[i] = virJSONValueCopy(in->data.array.values[i]);
@@ -1421,7 +1631,9 @@ virJSONValueCopy(const virJSONValue *in)
         out = virJSONValueNewString(g_strdup(in->data.string));
         break;
     case VIR_JSON_TYPE_NUMBER:
-        out = virJSONValueNewNumber(g_strdup(in->data.number));
+        out = virJSONValueNewNumber(g_strdup(in->data.number.str));
+        out->data.number.kind = in->data.number.kind;
+        out->data.number.val = in->data.number.val;
         break;
     case VIR_JSON_TYPE_BOOLEAN:
         out = virJSONValueNewBoolean(in->data.boolean);
@@ -1458,12 +1670,10 @@ virJSONParserInsertValue(virJSONParser *parser,
                 return -1;
             }
 
-            if (virJSONValueObjectAppend(state->value,
-                                         state->key,
-                                         value) < 0)
+            if (virJSONValueObjectInsertKeySteal(state->value,
+                                                 &state->key,
+                                                 value, false) < 0)
                 return -1;
-
-            VIR_FREE(state->key);
         }   break;
 
         case VIR_JSON_TYPE_ARRAY: {
@@ -1526,7 +1736,7 @@ virJSONParserHandleNumber(void *ctx,
     virJSONParser *parser = ctx;
     g_autoptr(virJSONValue) value = virJSONValueNewNumber(g_strndup(s, l));
 
-    VIR_DEBUG("parser=%p str=%s", parser, value->data.number);
+    VIR_DEBUG("parser=%p str=%s", parser, value->data.number.str);
 
     if (virJSONParserInsertValue(parser, &value) < 0)
         return 0;
@@ -1738,6 +1948,364 @@ virJSONValueFromString(const char *jsonstring)
 }
 
 
+struct _virJSONStreamParser {
+    yajl_handle hand;
+    virJSONParser parser;
+};
+
+
+static void
+virJSONStreamParserClear(virJSONStreamParser *parser)
+{
+    size_t i;
+
+    if (parser->hand)
+        yajl_free(parser->hand);
+    parser->hand = NULL;
+
+    g_clear_pointer(&parser->parser.head, virJSONValueFree);
+    for (i = 0; i < parser->parser.nstate; i++)
+        VIR_FREE(parser->parser.state[i].key);
+    VIR_FREE(parser->parser.state);
+    parser->parser.nstate = 0;
+}
+
+
+static int
+virJSONStreamParserReset(virJSONStreamParser *parser)
+{
+    virJSONStreamParserClear(parser);
+
+    if (!(parser->hand = yajl_alloc(&parserCallbacks, NULL, &parser->parser))) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("Unable to create JSON parser"));
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * virJSONStreamParserNew:
+ *
+ * Creates a parser which builds a virJSONValue out of a JSON document
+ * handed to it in arbitrarily sized pieces via virJSONStreamParserFeed,
+ * e.g. as the data arrives from a socket. Unlike virJSONValueFromString
+ * this doesn't need the whole document to be held in memory as a string
+ * besides the resulting tree.
+ */
+virJSONStreamParser *
+virJSONStreamParserNew(void)
+{
+    g_autoptr(virJSONStreamParser) parser = g_new0(virJSONStreamParser, 1);
+
+    if (virJSONStreamParserReset(parser) < 0)
+        return NULL;
+
+    return g_steal_pointer(&parser);
+}
+
+
+void
+virJSONStreamParserFree(virJSONStreamParser *parser)
+{
+    if (!parser)
+        return;
+
+    virJSONStreamParserClear(parser);
+    g_free(parser);
+}
+
+
+/**
+ * virJSONStreamParserFeed:
+ * @parser: stream parser
+ * @data: next piece of the JSON document
+ * @len: length of @data
+ *
+ * Parses @data as a continuation of the JSON document fed to @parser so
+ * far. On error the partially parsed document is discarded and @parser
+ * is ready to parse a new one.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virJSONStreamParserFeed(virJSONStreamParser *parser,
+                        const char *data,
+                        size_t len)
+{
+    unsigned char *errstr;
+
+    if (len == 0)
+        return 0;
+
+    if (yajl_parse(parser->hand, (const unsigned char *)data, len) == yajl_status_ok)
+        return 0;
+
+    errstr = yajl_get_error(parser->hand, 1, (const unsigned char *)data, len);
+    virReportError(VIR_ERR_INTERNAL_ERROR,
+                   _("cannot parse json: %s"), (const char *)errstr);
+    yajl_free_error(parser->hand, errstr);
+
+    ignore_value(virJSONStreamParserReset(parser));
+    return -1;
+}
+
+
+/**
+ * virJSONStreamParserFinish:
+ * @parser: stream parser
+ *
+ * Signals the end of the JSON document fed to @parser and resets @parser
+ * so that it can be used to parse another document.
+ *
+ * Returns the parsed document, or NULL if it was incomplete or invalid.
+ */
+virJSONValue *
+virJSONStreamParserFinish(virJSONStreamParser *parser)
+{
+    g_autoptr(virJSONValue) ret = NULL;
+
+    if (yajl_complete_parse(parser->hand) != yajl_status_ok) {
+        unsigned char *errstr = yajl_get_error(parser->hand, 0, NULL, 0);
+
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("cannot parse json: %s"), (const char *)errstr);
+        yajl_free_error(parser->hand, errstr);
+    } else if (parser->parser.nstate != 0 || !parser->parser.head) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("cannot parse json: unterminated string/map/array"));
+    } else {
+        ret = g_steal_pointer(&parser->parser.head);
+    }
+
+    if (virJSONStreamParserReset(parser) < 0)
+        return NULL;
+
+    return g_steal_pointer(&ret);
+}
+
+
+typedef struct _virJSONVisitorState virJSONVisitorState;
+struct _virJSONVisitorState {
+    const virJSONVisitor *visitor;
+    void *opaque;
+    char *key; /* key of the next value if it's a member of an object */
+    int rc; /* non-zero return value of a visitor callback */
+};
+
+
+static int
+virJSONVisitorHandleResult(virJSONVisitorState *state,
+                           int rc)
+{
+    if (rc != 0) {
+        state->rc = rc;
+        return 0;
+    }
+
+    return 1;
+}
+
+
+static int
+virJSONVisitorHandleValue(virJSONVisitorState *state,
+                          virJSONType type,
+                          const char *value)
+{
+    g_autofree char *key = g_steal_pointer(&state->key);
+
+    if (!state->visitor->value)
+        return 1;
+
+    return virJSONVisitorHandleResult(state,
+                                      state->visitor->value(key, type, value,
+                                                            state->opaque));
+}
+
+
+static int
+virJSONVisitorHandleNull(void *ctx)
+{
+    return virJSONVisitorHandleValue(ctx, VIR_JSON_TYPE_NULL, NULL);
+}
+
+
+static int
+virJSONVisitorHandleBoolean(void *ctx,
+                            int boolean_)
+{
+    return virJSONVisitorHandleValue(ctx, VIR_JSON_TYPE_BOOLEAN,
+                                     boolean_ ? "true" : "false");
+}
+
+
+static int
+virJSONVisitorHandleNumber(void *ctx,
+                           const char *s,
+                           size_t l)
+{
+    g_autofree char *value = g_strndup(s, l);
+
+    return virJSONVisitorHandleValue(ctx, VIR_JSON_TYPE_NUMBER, value);
+}
+
+
+static int
+virJSONVisitorHandleString(void *ctx,
+                           const unsigned char *stringVal,
+                           size_t stringLen)
+{
+    g_autofree char *value = g_strndup((const char *)stringVal, stringLen);
+
+    return virJSONVisitorHandleValue(ctx, VIR_JSON_TYPE_STRING, value);
+}
+
+
+static int
+virJSONVisitorHandleMapKey(void *ctx,
+                           const unsigned char *stringVal,
+                           size_t stringLen)
+{
+    virJSONVisitorState *state = ctx;
+
+    g_free(state->key);
+    state->key = g_strndup((const char *)stringVal, stringLen);
+    return 1;
+}
+
+
+static int
+virJSONVisitorHandleStart(virJSONVisitorState *state,
+                          virJSONType type)
+{
+    g_autofree char *key = g_steal_pointer(&state->key);
+
+    if (!state->visitor->start)
+        return 1;
+
+    return virJSONVisitorHandleResult(state,
+                                      state->visitor->start(key, type,
+                                                            state->opaque));
+}
+
+
+static int
+virJSONVisitorHandleEnd(virJSONVisitorState *state,
+                        virJSONType type)
+{
+    if (!state->visitor->end)
+        return 1;
+
+    return virJSONVisitorHandleResult(state,
+                                      state->visitor->end(type, state->opaque));
+}
+
+
+static int
+virJSONVisitorHandleStartMap(void *ctx)
+{
+    return virJSONVisitorHandleStart(ctx, VIR_JSON_TYPE_OBJECT);
+}
+
+
+static int
+virJSONVisitorHandleEndMap(void *ctx)
+{
+    return virJSONVisitorHandleEnd(ctx, VIR_JSON_TYPE_OBJECT);
+}
+
+
+static int
+virJSONVisitorHandleStartArray(void *ctx)
+{
+    return virJSONVisitorHandleStart(ctx, VIR_JSON_TYPE_ARRAY);
+}
+
+
+static int
+virJSONVisitorHandleEndArray(void *ctx)
+{
+    return virJSONVisitorHandleEnd(ctx, VIR_JSON_TYPE_ARRAY);
+}
+
+
+static const yajl_callbacks visitorCallbacks = {
+    virJSONVisitorHandleNull,
+    virJSONVisitorHandleBoolean,
+    NULL,
+    NULL,
+    virJSONVisitorHandleNumber,
+    virJSONVisitorHandleString,
+    virJSONVisitorHandleStartMap,
+    virJSONVisitorHandleMapKey,
+    virJSONVisitorHandleEndMap,
+    virJSONVisitorHandleStartArray,
+    virJSONVisitorHandleEndArray
+};
+
+
+/**
+ * virJSONVisitString:
+ * @jsonstring: JSON document
+ * @visitor: callbacks to invoke
+ * @opaque: opaque data passed to the callbacks
+ *
+ * Walks @jsonstring invoking the callbacks of @visitor for each value
+ * without building a virJSONValue tree. This is meant for callers which are
+ * interested only in a few fields of a large document. Any callback may be
+ * NULL. A callback returning a positive number stops the walk successfully,
+ * a negative number stops it with an error which the callback is expected
+ * to have reported.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virJSONVisitString(const char *jsonstring,
+                   const virJSONVisitor *visitor,
+                   void *opaque)
+{
+    virJSONVisitorState state = { visitor, opaque, NULL, 0 };
+    size_t len = strlen(jsonstring);
+    yajl_handle hand;
+    int rc;
+    int ret = -1;
+
+    if (!(hand = yajl_alloc(&visitorCallbacks, NULL, &state))) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("Unable to create JSON parser"));
+        return -1;
+    }
+
+    rc = yajl_parse(hand, (const unsigned char *)jsonstring, len);
+    if (rc == yajl_status_ok)
+        rc = yajl_complete_parse(hand);
+
+    if (state.rc < 0)
+        goto cleanup;
+
+    if (state.rc == 0 && rc != yajl_status_ok) {
+        unsigned char *errstr = yajl_get_error(hand, 1,
+                                               (const unsigned char *)jsonstring,
+                                               len);
+
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("cannot parse json %s: %s"),
+                       jsonstring, (const char *)errstr);
+        yajl_free_error(hand, errstr);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    g_free(state.key);
+    yajl_free(hand);
+    return ret;
+}
+
+
 static int
 virJSONValueToStringOne(virJSONValue *object,
                         yajl_gen g)
@@ -1779,11 +2347,13 @@ virJSONValueToStringOne(virJSONValue *object,
             return -1;
         break;
 
-    case VIR_JSON_TYPE_NUMBER:
-        if (yajl_gen_number(g, object->data.number,
-                            strlen(object->data.number)) != yajl_gen_status_ok)
+    case VIR_JSON_TYPE_NUMBER: {
+        char buf[VIR_INT64_STR_BUFLEN];
+        const char *str = virJSONNumberFormat(&object->data.number, buf);
+
+        if (yajl_gen_number(g, str, strlen(str)) != yajl_gen_status_ok)
             return -1;
-        break;
+    }   break;
 
     case VIR_JSON_TYPE_BOOLEAN:
         if (yajl_gen_bool(g, object->data.boolean) != yajl_gen_status_ok)
@@ -1857,6 +2427,52 @@ virJSONValueFromString(const char *jsonstring G_GNUC_UNUSED)
 }
 
 
+virJSONStreamParser *
+virJSONStreamParserNew(void)
+{
+    virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                   _("No JSON parser implementation is available"));
+    return NULL;
+}
+
+
+void
+virJSONStreamParserFree(virJSONStreamParser *parser G_GNUC_UNUSED)
+{
+}
+
+
+int
+virJSONStreamParserFeed(virJSONStreamParser *parser G_GNUC_UNUSED,
+                        const char *data G_GNUC_UNUSED,
+                        size_t len G_GNUC_UNUSED)
+{
+    virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                   _("No JSON parser implementation is available"));
+    return -1;
+}
+
+
+virJSONValue *
+virJSONStreamParserFinish(virJSONStreamParser *parser G_GNUC_UNUSED)
+{
+    virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                   _("No JSON parser implementation is available"));
+    return NULL;
+}
+
+
+int
+virJSONVisitString(const char *jsonstring G_GNUC_UNUSED,
+                   const virJSONVisitor *visitor G_GNUC_UNUSED,
+                   void *opaque G_GNUC_UNUSED)
+{
+    virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                   _("No JSON parser implementation is available"));
+    return -1;
+}
+
+
 int
 virJSONValueToBuffer(virJSONValue *object G_GNUC_UNUSED,
                      virBuffer *buf G_GNUC_UNUSED,
@@ -2031,10 +2647,12 @@ virJSONValueObjectDeflattenArrays(virJSONValue *json)
         g_free(obj->pairs[i].key);
 
     g_free(json->data.object.pairs);
+    g_clear_pointer(&obj->index, g_hash_table_unref);
 
     i = obj->npairs;
     json->type = VIR_JSON_TYPE_ARRAY;
     json->data.array.nvalues = i;
+    json->data.array.nvalues_max = i;
     json->data.array.values = g_steal_pointer(&arraymembers);
 }
 
@@ -260,6 +260,43 @@ virJSONValueArrayAppendString(virJSONValue *object,
 
 virJSONValue *
 virJSONValueFromString(const char *jsonstring);
+
+typedef struct _virJSONStreamParser virJSONStreamParser;
+
+virJSONStreamParser *
+virJSONStreamParserNew(void);
+void
+virJSONStreamParserFree(virJSONStreamParser *parser);
+int
+virJSONStreamParserFeed(virJSONStreamParser *parser,
+                        const char *data,
+                        size_t len)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
+virJSONValue *
+virJSONStreamParserFinish(virJSONStreamParser *parser)
+    ATTRIBUTE_NONNULL(1);
+
+typedef struct _virJSONVisitor virJSONVisitor;
+struct _virJSONVisitor {
+    /* Called for strings, numbers, booleans and nulls. @key is the name of
+     * the member when inside an object. @value is NULL for null. */
+    int (*value)(const char *key,
+                 virJSONType type,
+                 const char *value,
+                 void *opaque);
+    /* Called when an object or array starts and ends */
+    int (*start)(const char *key,
+                 virJSONType type,
+                 void *opaque);
+    int (*end)(virJSONType type,
+               void *opaque);
+};
+
+int
+virJSONVisitString(const char *jsonstring,
+                   const virJSONVisitor *visitor,
+                   void *opaque)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
 char *
 virJSONValueToString(virJSONValue *object,
                      bool pretty);
@@ -289,3 +326,4 @@ virJSONValue *
 virJSONValueObjectDeflatten(virJSONValue *json);
 
 G_DEFINE_AUTOPTR_CLEANUP_FUNC(virJSONValue, virJSONValueFree);
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(virJSONStreamParser, virJSONStreamParserFree);
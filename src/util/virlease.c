@@ -31,6 +31,7 @@
 #include "virerror.h"
 #include "viralloc.h"
 #include "virutil.h"
+#include "virleaseindex.h"
 
 #define VIR_FROM_THIS VIR_FROM_NETWORK
 
@@ -257,3 +258,165 @@ virLeaseNew(virJSONValue **lease_ret,
     *lease_ret = g_steal_pointer(&lease_new);
     return 0;
 }
+
+
+typedef struct _virLeaseIndexItem virLeaseIndexItem;
+struct _virLeaseIndexItem {
+    const char *ipaddr;
+    const char *macaddr;
+    const char *hostname;
+    long long expiry;
+    uint32_t idx;
+};
+
+typedef struct _virLeaseIndexData virLeaseIndexData;
+struct _virLeaseIndexData {
+    virLeaseIndexHeader header;
+    virLeaseIndexEntry *entries;
+    uint32_t *bymac;
+    GByteArray *strings;
+};
+
+
+static int
+virLeaseIndexItemCompareName(const void *a,
+                             const void *b)
+{
+    const virLeaseIndexItem *itema = a;
+    const virLeaseIndexItem *itemb = b;
+
+    return g_ascii_strcasecmp(NULLSTR_EMPTY(itema->hostname),
+                              NULLSTR_EMPTY(itemb->hostname));
+}
+
+
+static int
+virLeaseIndexItemCompareMAC(const void *a,
+                            const void *b)
+{
+    const virLeaseIndexItem *itema = *(virLeaseIndexItem *const *)a;
+    const virLeaseIndexItem *itemb = *(virLeaseIndexItem *const *)b;
+
+    return strcmp(itema->macaddr, itemb->macaddr);
+}
+
+
+static uint32_t
+virLeaseIndexAddString(GByteArray *strings,
+                       const char *str)
+{
+    uint32_t ret = strings->len;
+
+    if (!str)
+        return VIR_LEASE_INDEX_NO_STRING;
+
+    g_byte_array_append(strings, (const guint8 *)str, strlen(str) + 1);
+    return ret;
+}
+
+
+static int
+virLeaseIndexWrite(int fd,
+                   const char *path,
+                   const void *opaque)
+{
+    const virLeaseIndexData *data = opaque;
+    size_t nentries = data->header.nentries;
+
+    if (safewrite(fd, &data->header, sizeof(data->header)) < 0 ||
+        safewrite(fd, data->entries, sizeof(*data->entries) * nentries) < 0 ||
+        safewrite(fd, data->bymac, sizeof(*data->bymac) * nentries) < 0 ||
+        safewrite(fd, data->strings->data, data->strings->len) < 0) {
+        virReportSystemError(errno,
+                             _("cannot write data to file '%s'"),
+                             path);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * virLeaseWriteIndex:
+ * @custom_lease_file: path to the leases file
+ * @leases: array of leases just written to @custom_lease_file
+ *
+ * Write the binary index of @leases (see virleaseindex.h) next to
+ * @custom_lease_file, which is used by the NSS plugin to look leases up
+ * without parsing the JSON. Leases without an IP or MAC address are never
+ * reported by the plugin and thus left out.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virLeaseWriteIndex(const char *custom_lease_file,
+                   virJSONValue *leases)
+{
+    g_autofree char *path = g_strdup_printf("%s" VIR_LEASE_INDEX_SUFFIX,
+                                            custom_lease_file);
+    g_autofree virLeaseIndexItem *items = NULL;
+    g_autofree virLeaseIndexItem **macs = NULL;
+    g_autofree virLeaseIndexEntry *entries = NULL;
+    g_autofree uint32_t *bymac = NULL;
+    g_autoptr(GByteArray) strings = g_byte_array_new();
+    virLeaseIndexData data = { 0 };
+    struct stat sb;
+    size_t nleases = virJSONValueArraySize(leases);
+    size_t nitems = 0;
+    size_t i;
+
+    if (stat(custom_lease_file, &sb) < 0) {
+        virReportSystemError(errno, _("cannot stat '%s'"), custom_lease_file);
+        return -1;
+    }
+
+    items = g_new0(virLeaseIndexItem, nleases);
+
+    for (i = 0; i < nleases; i++) {
+        virJSONValue *lease = virJSONValueArrayGet(leases, i);
+        virLeaseIndexItem *item = items + nitems;
+
+        if (!(item->ipaddr = virJSONValueObjectGetString(lease, "ip-address")) ||
+            !(item->macaddr = virJSONValueObjectGetString(lease, "mac-address")))
+            continue;
+
+        item->hostname = virJSONValueObjectGetString(lease, "hostname");
+        ignore_value(virJSONValueObjectGetNumberLong(lease, "expiry-time",
+                                                     &item->expiry));
+        nitems++;
+    }
+
+    qsort(items, nitems, sizeof(*items), virLeaseIndexItemCompareName);
+
+    entries = g_new0(virLeaseIndexEntry, nitems);
+    bymac = g_new0(uint32_t, nitems);
+    macs = g_new0(virLeaseIndexItem *, nitems);
+
+    for (i = 0; i < nitems; i++) {
+        items[i].idx = i;
+        macs[i] = &items[i];
+
+        entries[i].expiry = items[i].expiry;
+        entries[i].ipaddr = virLeaseIndexAddString(strings, items[i].ipaddr);
+        entries[i].macaddr = virLeaseIndexAddString(strings, items[i].macaddr);
+        entries[i].hostname = virLeaseIndexAddString(strings, items[i].hostname);
+    }
+
+    qsort(macs, nitems, sizeof(*macs), virLeaseIndexItemCompareMAC);
+
+    for (i = 0; i < nitems; i++)
+        bymac[i] = macs[i]->idx;
+
+    memcpy(data.header.magic, VIR_LEASE_INDEX_MAGIC, sizeof(data.header.magic));
+    data.header.version = VIR_LEASE_INDEX_VERSION;
+    data.header.nentries = nitems;
+    data.header.leasesIno = sb.st_ino;
+    data.header.leasesSize = sb.st_size;
+    data.header.leasesMtime = sb.st_mtime;
+    data.entries = entries;
+    data.bymac = bymac;
+    data.strings = strings;
+
+    return virFileRewrite(path, 0644, -1, -1, virLeaseIndexWrite, &data);
+}
@@ -40,3 +40,6 @@ int virLeaseNew(virJSONValue **lease_ret,
                 const char *hostname,
                 const char *iaid,
                 const char *server_duid);
+
+int virLeaseWriteIndex(const char *custom_lease_file,
+                       virJSONValue *leases);
@@ -0,0 +1,69 @@
+/*
+ * virleaseindex.h: binary index of custom leases files
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+/* This header is shared with the NSS plugin, which doesn't link with
+ * libvirt, so it must not contain anything but the file format. */
+
+#include <stdint.h>
+
+/*
+ * Next to each custom leases file (<bridge>.status) written by the
+ * leaseshelper there's an index of it (<bridge>.status.index), so that the
+ * NSS plugin can look leases up by binary search in the mmap()-ed file
+ * instead of parsing the JSON. All numbers are in host byte order and the
+ * file consists of:
+ *
+ *   virLeaseIndexHeader header;
+ *   virLeaseIndexEntry entries[nentries];  sorted by hostname, ignoring case
+ *   uint32_t bymac[nentries];              entries sorted by MAC address
+ *   char strings[];                        NUL terminated strings
+ *
+ * The header records the inode, size and modification time of the leases
+ * file the index was built from. If they don't match the leases file, the
+ * index is stale and must be ignored.
+ */
+
+#define VIR_LEASE_INDEX_SUFFIX ".index"
+#define VIR_LEASE_INDEX_MAGIC "LVLEASE"
+#define VIR_LEASE_INDEX_VERSION 1
+
+/* Offset of a missing string */
+#define VIR_LEASE_INDEX_NO_STRING UINT32_MAX
+
+typedef struct _virLeaseIndexHeader virLeaseIndexHeader;
+struct _virLeaseIndexHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t nentries;
+    uint64_t leasesIno;
+    uint64_t leasesSize;
+    int64_t leasesMtime;
+};
+
+typedef struct _virLeaseIndexEntry virLeaseIndexEntry;
+struct _virLeaseIndexEntry {
+    int64_t expiry;     /* 0 for leases that never expire */
+    /* offsets into strings */
+    uint32_t ipaddr;
+    uint32_t macaddr;
+    uint32_t hostname;  /* sorted as "" if missing */
+    uint32_t padding;
+};
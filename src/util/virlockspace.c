@@ -50,11 +50,21 @@ struct _virLockSpaceResource {
     unsigned int flags;
     size_t nOwners;
     pid_t *owners;
+
+    /* Set while the resource file is being locked or unlocked. That may take
+     * a while on shared storage, so it's done without holding the lockspace
+     * lock. The resource stays in the table meanwhile and any other request
+     * for it must wait for the outcome. Besides serializing access to the
+     * file, this matters because fcntl() locks belong to the process and
+     * closing any FD of the file drops them, including the one another
+     * request of ours might have just acquired. */
+    bool pending;
 };
 
 struct _virLockSpace {
     char *dir;
     virMutex lock;
+    virCond cond; /* broadcast when a pending resource is resolved */
 
     GHashTable *resources;
 };
@@ -72,11 +82,10 @@ static char *virLockSpaceGetResourcePath(virLockSpace *lockspace,
 }
 
 
-static void virLockSpaceResourceFree(virLockSpaceResource *res)
+/* Releases the lock on the file of @res and closes it. Like locking, this
+ * doesn't touch the lockspace and may block. */
+static void virLockSpaceResourceUnlock(virLockSpaceResource *res)
 {
-    if (!res)
-        return;
-
     if (res->lockHeld &&
         (res->flags & VIR_LOCK_SPACE_ACQUIRE_AUTOCREATE)) {
         if (res->flags & VIR_LOCK_SPACE_ACQUIRE_SHARED) {
@@ -100,8 +109,19 @@ static void virLockSpaceResourceFree(virLockSpaceResource *res)
         }
     }
 
-    g_free(res->owners);
+    res->lockHeld = false;
     VIR_FORCE_CLOSE(res->fd);
+}
+
+
+static void virLockSpaceResourceFree(virLockSpaceResource *res)
+{
+    if (!res)
+        return;
+
+    virLockSpaceResourceUnlock(res);
+
+    g_free(res->owners);
     g_free(res->path);
     g_free(res->name);
     g_free(res);
@@ -115,7 +135,6 @@ virLockSpaceResourceNew(virLockSpace *lockspace,
                         pid_t owner)
 {
     virLockSpaceResource *res;
-    bool shared = !!(flags & VIR_LOCK_SPACE_ACQUIRE_SHARED);
 
     res = g_new0(virLockSpaceResource, 1);
 
@@ -123,32 +142,45 @@ virLockSpaceResourceNew(virLockSpace *lockspace,
     res->flags = flags;
 
     res->name = g_strdup(resname);
+    res->path = virLockSpaceGetResourcePath(lockspace, resname);
+
+    VIR_EXPAND_N(res->owners, res->nOwners, 1);
+    res->owners[res->nOwners-1] = owner;
+
+    return res;
+}
 
-    if (!(res->path = virLockSpaceGetResourcePath(lockspace, resname)))
-        goto error;
 
-    if (flags & VIR_LOCK_SPACE_ACQUIRE_AUTOCREATE) {
+/* Opens and locks the file of @res. Doesn't touch the lockspace, so that
+ * it can be called without holding the lockspace lock. */
+static int
+virLockSpaceResourceLock(virLockSpaceResource *res)
+{
+    const char *resname = res->name;
+    bool shared = !!(res->flags & VIR_LOCK_SPACE_ACQUIRE_SHARED);
+
+    if (res->flags & VIR_LOCK_SPACE_ACQUIRE_AUTOCREATE) {
         while (1) {
             struct stat a, b;
             if ((res->fd = open(res->path, O_RDWR|O_CREAT, 0600)) < 0) {
                 virReportSystemError(errno,
                                      _("Unable to open/create resource %s"),
                                      res->path);
-                goto error;
+                return -1;
             }
 
             if (virSetCloseExec(res->fd) < 0) {
                 virReportSystemError(errno,
                                      _("Failed to set close-on-exec flag '%s'"),
                                      res->path);
-                goto error;
+                return -1;
             }
 
             if (fstat(res->fd, &b) < 0) {
                 virReportSystemError(errno,
                                      _("Unable to check status of pid file '%s'"),
                                      res->path);
-                goto error;
+                return -1;
             }
 
             if (virFileLock(res->fd, shared, 0, 1, false) < 0) {
@@ -161,7 +193,7 @@ virLockSpaceResourceNew(virLockSpace *lockspace,
                                          _("Unable to acquire lock on '%s'"),
                                          res->path);
                 }
-                goto error;
+                return -1;
             }
 
             /* Now make sure the pidfile we locked is the same
@@ -187,14 +219,14 @@ virLockSpaceResourceNew(virLockSpace *lockspace,
             virReportSystemError(errno,
                                  _("Unable to open resource %s"),
                                  res->path);
-            goto error;
+            return -1;
         }
 
         if (virSetCloseExec(res->fd) < 0) {
             virReportSystemError(errno,
                                  _("Failed to set close-on-exec flag '%s'"),
                                  res->path);
-            goto error;
+            return -1;
         }
 
         if (virFileLock(res->fd, shared, 0, 1, false) < 0) {
@@ -207,19 +239,12 @@ virLockSpaceResourceNew(virLockSpace *lockspace,
                                      _("Unable to acquire lock on '%s'"),
                                      res->path);
             }
-            goto error;
+            return -1;
         }
     }
     res->lockHeld = true;
 
-    VIR_EXPAND_N(res->owners, res->nOwners, 1);
-    res->owners[res->nOwners-1] = owner;
-
-    return res;
-
- error:
-    virLockSpaceResourceFree(res);
-    return NULL;
+    return 0;
 }
 
 
@@ -245,6 +270,14 @@ virLockSpace *virLockSpaceNew(const char *directory)
         return NULL;
     }
 
+    if (virCondInit(&lockspace->cond) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("Unable to initialize lockspace condition"));
+        virMutexDestroy(&lockspace->lock);
+        VIR_FREE(lockspace);
+        return NULL;
+    }
+
     lockspace->dir = g_strdup(directory);
 
     lockspace->resources = virHashNew(virLockSpaceResourceDataFree);
@@ -293,6 +326,14 @@ virLockSpace *virLockSpaceNewPostExecRestart(virJSONValue *object)
         return NULL;
     }
 
+    if (virCondInit(&lockspace->cond) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("Unable to initialize lockspace condition"));
+        virMutexDestroy(&lockspace->lock);
+        VIR_FREE(lockspace);
+        return NULL;
+    }
+
     lockspace->resources = virHashNew(virLockSpaceResourceDataFree);
 
     if (virJSONValueObjectHasKey(object, "directory")) {
@@ -408,6 +449,59 @@ virLockSpace *virLockSpaceNewPostExecRestart(virJSONValue *object)
 }
 
 
+static int
+virLockSpaceResourceIsPending(const void *payload,
+                              const char *name G_GNUC_UNUSED,
+                              const void *opaque)
+{
+    const virLockSpaceResource *res = payload;
+    const pid_t *owner = opaque;
+
+    /* resources being released have no owners anymore */
+    return res->pending &&
+        (!owner || (res->nOwners > 0 && res->owners[0] == *owner));
+}
+
+
+/* Waits until no resource is pending, or if @owner is non-NULL, until no
+ * resource acquired by @owner is. Must be called with the lockspace locked. */
+static int
+virLockSpaceWaitPending(virLockSpace *lockspace,
+                        const pid_t *owner)
+{
+    while (virHashSearch(lockspace->resources,
+                         virLockSpaceResourceIsPending, owner, NULL)) {
+        if (virCondWait(&lockspace->cond, &lockspace->lock) < 0) {
+            virReportSystemError(errno, "%s",
+                                 _("Unable to wait on lockspace condition"));
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+/* Looks up @resname, waiting for its outcome if it's pending. Must be called
+ * with the lockspace locked. */
+static int
+virLockSpaceLookupResource(virLockSpace *lockspace,
+                           const char *resname,
+                           virLockSpaceResource **res)
+{
+    while ((*res = virHashLookup(lockspace->resources, resname)) &&
+           (*res)->pending) {
+        if (virCondWait(&lockspace->cond, &lockspace->lock) < 0) {
+            virReportSystemError(errno, "%s",
+                                 _("Unable to wait on lockspace condition"));
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
 virJSONValue *virLockSpacePreExecRestart(virLockSpace *lockspace)
 {
     g_autoptr(virJSONValue) object = virJSONValueNewObject();
@@ -416,6 +510,9 @@ virJSONValue *virLockSpacePreExecRestart(virLockSpace *lockspace)
     virHashKeyValuePair *tmp;
     VIR_LOCK_GUARD lock = virLockGuardLock(&lockspace->lock);
 
+    if (virLockSpaceWaitPending(lockspace, NULL) < 0)
+        return NULL;
+
     if (lockspace->dir &&
         virJSONValueObjectAppendString(object, "directory", lockspace->dir) < 0)
         return NULL;
@@ -473,6 +570,7 @@ void virLockSpaceFree(virLockSpace *lockspace)
 
     g_clear_pointer(&lockspace->resources, g_hash_table_unref);
     g_free(lockspace->dir);
+    virCondDestroy(&lockspace->cond);
     virMutexDestroy(&lockspace->lock);
     g_free(lockspace);
 }
@@ -488,11 +586,15 @@ int virLockSpaceCreateResource(virLockSpace *lockspace,
                                const char *resname)
 {
     g_autofree char *respath = NULL;
+    virLockSpaceResource *res;
     VIR_LOCK_GUARD lock = virLockGuardLock(&lockspace->lock);
 
     VIR_DEBUG("lockspace=%p resname=%s", lockspace, resname);
 
-    if (virHashLookup(lockspace->resources, resname) != NULL) {
+    if (virLockSpaceLookupResource(lockspace, resname, &res) < 0)
+        return -1;
+
+    if (res) {
         virReportError(VIR_ERR_RESOURCE_BUSY,
                        _("Lockspace resource '%s' is locked"),
                        resname);
@@ -513,11 +615,15 @@ int virLockSpaceDeleteResource(virLockSpace *lockspace,
                                const char *resname)
 {
     g_autofree char *respath = NULL;
+    virLockSpaceResource *res;
     VIR_LOCK_GUARD lock = virLockGuardLock(&lockspace->lock);
 
     VIR_DEBUG("lockspace=%p resname=%s", lockspace, resname);
 
-    if (virHashLookup(lockspace->resources, resname) != NULL) {
+    if (virLockSpaceLookupResource(lockspace, resname, &res) < 0)
+        return -1;
+
+    if (res) {
         virReportError(VIR_ERR_RESOURCE_BUSY,
                        _("Lockspace resource '%s' is locked"),
                        resname);
@@ -545,7 +651,7 @@ int virLockSpaceAcquireResource(virLockSpace *lockspace,
                                 unsigned int flags)
 {
     virLockSpaceResource *res;
-    VIR_LOCK_GUARD lock = virLockGuardLock(&lockspace->lock);
+    int rc;
 
     VIR_DEBUG("lockspace=%p resname=%s flags=0x%x owner=%lld",
               lockspace, resname, flags, (unsigned long long)owner);
@@ -553,25 +659,46 @@ int virLockSpaceAcquireResource(virLockSpace *lockspace,
     virCheckFlags(VIR_LOCK_SPACE_ACQUIRE_SHARED |
                   VIR_LOCK_SPACE_ACQUIRE_AUTOCREATE, -1);
 
-    if ((res = virHashLookup(lockspace->resources, resname))) {
-        if ((res->flags & VIR_LOCK_SPACE_ACQUIRE_SHARED) &&
-            (flags & VIR_LOCK_SPACE_ACQUIRE_SHARED)) {
+    VIR_WITH_MUTEX_LOCK_GUARD(&lockspace->lock) {
+        if (virLockSpaceLookupResource(lockspace, resname, &res) < 0)
+            return -1;
 
-            VIR_EXPAND_N(res->owners, res->nOwners, 1);
-            res->owners[res->nOwners-1] = owner;
+        if (res) {
+            if ((res->flags & VIR_LOCK_SPACE_ACQUIRE_SHARED) &&
+                (flags & VIR_LOCK_SPACE_ACQUIRE_SHARED)) {
 
-            return 0;
+                VIR_EXPAND_N(res->owners, res->nOwners, 1);
+                res->owners[res->nOwners-1] = owner;
+
+                return 0;
+            }
+            virReportError(VIR_ERR_RESOURCE_BUSY,
+                           _("Lockspace resource '%s' is locked"),
+                           resname);
+            return -1;
+        }
+
+        res = virLockSpaceResourceNew(lockspace, resname, flags, owner);
+        res->pending = true;
+
+        if (virHashAddEntry(lockspace->resources, resname, res) < 0) {
+            virLockSpaceResourceFree(res);
+            return -1;
         }
-        virReportError(VIR_ERR_RESOURCE_BUSY,
-                       _("Lockspace resource '%s' is locked"),
-                       resname);
-        return -1;
     }
 
-    if (!(res = virLockSpaceResourceNew(lockspace, resname, flags, owner)))
-        return -1;
+    rc = virLockSpaceResourceLock(res);
+    if (rc < 0)
+        virLockSpaceResourceUnlock(res);
+
+    VIR_WITH_MUTEX_LOCK_GUARD(&lockspace->lock) {
+        res->pending = false;
+        if (rc < 0)
+            virHashSteal(lockspace->resources, resname);
+        virCondBroadcast(&lockspace->cond);
+    }
 
-    if (virHashAddEntry(lockspace->resources, resname, res) < 0) {
+    if (rc < 0) {
         virLockSpaceResourceFree(res);
         return -1;
     }
@@ -586,35 +713,49 @@ int virLockSpaceReleaseResource(virLockSpace *lockspace,
 {
     virLockSpaceResource *res;
     size_t i;
-    VIR_LOCK_GUARD lock = virLockGuardLock(&lockspace->lock);
 
     VIR_DEBUG("lockspace=%p resname=%s owner=%lld",
               lockspace, resname, (unsigned long long)owner);
 
-    if (!(res = virHashLookup(lockspace->resources, resname))) {
-        virReportError(VIR_ERR_RESOURCE_BUSY,
-                       _("Lockspace resource '%s' is not locked"),
-                       resname);
-        return -1;
-    }
+    VIR_WITH_MUTEX_LOCK_GUARD(&lockspace->lock) {
+        if (virLockSpaceLookupResource(lockspace, resname, &res) < 0)
+            return -1;
 
-    for (i = 0; i < res->nOwners; i++) {
-        if (res->owners[i] == owner)
-            break;
-    }
+        if (!res) {
+            virReportError(VIR_ERR_RESOURCE_BUSY,
+                           _("Lockspace resource '%s' is not locked"),
+                           resname);
+            return -1;
+        }
 
-    if (i == res->nOwners) {
-        virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("owner %lld does not hold the resource lock"),
-                       (unsigned long long)owner);
-        return -1;
+        for (i = 0; i < res->nOwners; i++) {
+            if (res->owners[i] == owner)
+                break;
+        }
+
+        if (i == res->nOwners) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("owner %lld does not hold the resource lock"),
+                           (unsigned long long)owner);
+            return -1;
+        }
+
+        VIR_DELETE_ELEMENT(res->owners, i, res->nOwners);
+
+        if (res->nOwners != 0)
+            return 0;
+
+        res->pending = true;
     }
 
-    VIR_DELETE_ELEMENT(res->owners, i, res->nOwners);
+    virLockSpaceResourceUnlock(res);
 
-    if ((res->nOwners == 0) &&
-        virHashRemoveEntry(lockspace->resources, resname) < 0)
-        return -1;
+    VIR_WITH_MUTEX_LOCK_GUARD(&lockspace->lock) {
+        virHashSteal(lockspace->resources, resname);
+        virCondBroadcast(&lockspace->cond);
+    }
+
+    virLockSpaceResourceFree(res);
 
     return 0;
 }
@@ -623,16 +764,17 @@ int virLockSpaceReleaseResource(virLockSpace *lockspace,
 struct virLockSpaceRemoveData {
     pid_t owner;
     size_t count;
+    GSList *removed;
 };
 
 
-static int
-virLockSpaceRemoveResourcesForOwner(const void *payload,
-                                    const char *name G_GNUC_UNUSED,
-                                    const void *opaque)
+static void
+virLockSpaceRemoveResourcesForOwner(gpointer key G_GNUC_UNUSED,
+                                    gpointer payload,
+                                    gpointer opaque)
 {
-    virLockSpaceResource *res = (virLockSpaceResource *)payload;
-    struct virLockSpaceRemoveData *data = (struct virLockSpaceRemoveData *)opaque;
+    virLockSpaceResource *res = payload;
+    struct virLockSpaceRemoveData *data = opaque;
     size_t i;
 
     VIR_DEBUG("res %s owner %lld", res->name, (unsigned long long)data->owner);
@@ -643,7 +785,7 @@ virLockSpaceRemoveResourcesForOwner(const void *payload,
     }
 
     if (i == res->nOwners)
-        return 0;
+        return;
 
     data->count++;
 
@@ -651,11 +793,12 @@ virLockSpaceRemoveResourcesForOwner(const void *payload,
 
     if (res->nOwners) {
         VIR_DEBUG("Other shared owners remain");
-        return 0;
+        return;
     }
 
     VIR_DEBUG("No more owners, remove it");
-    return 1;
+    res->pending = true;
+    data->removed = g_slist_prepend(data->removed, res);
 }
 
 
@@ -663,16 +806,34 @@ int virLockSpaceReleaseResourcesForOwner(virLockSpace *lockspace,
                                          pid_t owner)
 {
     struct virLockSpaceRemoveData data = {
-        owner, 0
+        owner, 0, NULL
     };
-    VIR_LOCK_GUARD lock = virLockGuardLock(&lockspace->lock);
+    GSList *next;
 
     VIR_DEBUG("lockspace=%p owner=%lld", lockspace, (unsigned long long)owner);
 
-    if (virHashRemoveSet(lockspace->resources,
-                         virLockSpaceRemoveResourcesForOwner,
-                         &data) < 0)
-        return -1;
+    VIR_WITH_MUTEX_LOCK_GUARD(&lockspace->lock) {
+        if (virLockSpaceWaitPending(lockspace, &owner) < 0)
+            return -1;
+
+        g_hash_table_foreach(lockspace->resources,
+                             virLockSpaceRemoveResourcesForOwner,
+                             &data);
+    }
+
+    for (next = data.removed; next; next = next->next)
+        virLockSpaceResourceUnlock(next->data);
+
+    VIR_WITH_MUTEX_LOCK_GUARD(&lockspace->lock) {
+        for (next = data.removed; next; next = next->next) {
+            virLockSpaceResource *res = next->data;
+
+            virHashSteal(lockspace->resources, res->name);
+        }
+        virCondBroadcast(&lockspace->cond);
+    }
+
+    g_slist_free_full(data.removed, virLockSpaceResourceDataFree);
 
     return data.count;
 }
@@ -47,6 +47,13 @@
  * htole64.  */
 #if WITH_SYSLOG_H && defined(__linux__) && WITH_DECL_HTOLE64
 # define USE_JOURNALD 1
+#endif
+
+#ifndef WIN32
+# define USE_ASYNC 1
+#endif
+
+#if USE_JOURNALD || USE_ASYNC
 # include <sys/uio.h>
 #endif
 
@@ -127,6 +134,74 @@ static void virLogOutputToFd(virLogSource *src,
  */
 static virMutex virLogMutex = VIR_MUTEX_INITIALIZER;
 
+static bool virLogInitMessageStderr = true;
+
+
+/*
+ * In the asynchronous mode the logging threads only format their messages
+ * and queue them in a bounded lock-free ring. A writer thread drains the
+ * ring in batches and passes them to the outputs, writing all messages of
+ * a batch to a file or stderr by a single writev(). The ring implements
+ * Dmitry Vyukov's bounded queue for multiple producers and one consumer:
+ * the sequence number of each slot tells whether it's free for the
+ * producer claiming its position or filled for the consumer.
+ */
+VIR_ENUM_DECL(virLogAsyncMode);
+VIR_ENUM_IMPL(virLogAsyncMode,
+              VIR_LOG_ASYNC_LAST,
+              "none", "drop", "block",
+);
+
+#ifdef USE_ASYNC
+/* Number of slots of the ring, a power of two */
+# define VIR_LOG_ASYNC_SIZE 8192
+# define VIR_LOG_ASYNC_MASK (VIR_LOG_ASYNC_SIZE - 1)
+
+/* Most messages passed to the outputs at once */
+# define VIR_LOG_ASYNC_BATCH 64
+
+typedef struct _virLogAsyncMessage virLogAsyncMessage;
+struct _virLogAsyncMessage {
+    virLogSource *source;
+    virLogPriority priority;
+    char *filename;
+    int linenr;
+    char *funcname;
+    char timestamp[VIR_TIME_STRING_BUFLEN];
+    virLogMetadata *metadata;
+    char *str;
+    char *msg;
+    char *line; /* as written by virLogOutputToFd */
+};
+
+typedef struct _virLogAsyncSlot virLogAsyncSlot;
+struct _virLogAsyncSlot {
+    int seq;
+    virLogAsyncMessage *message;
+};
+
+static struct {
+    int mode; /* virLogAsyncMode */
+    pid_t pid; /* process running the writer thread, 0 if none */
+
+    virLogAsyncSlot *slots;
+    int head; /* next position to fill */
+    int tail; /* next position to drain, under drainLock */
+
+    int dropped; /* messages dropped since the last report */
+    unsigned long long droppedTotal; /* under drainLock */
+
+    /* the writer sleeps on @cond while @sleeping */
+    int sleeping;
+    virMutex lock;
+    virCond cond;
+
+    /* serializes the writer and flushing on exit */
+    virMutex drainLock;
+    virThread thread;
+} virLogAsync;
+#endif /* USE_ASYNC */
+
 void
 virLogLock(void)
 {
@@ -283,6 +358,12 @@ virLogReset(void)
     if (virLogInitialize() < 0)
         return -1;
 
+#ifdef USE_ASYNC
+    /* the outputs are about to be closed, e.g. before exec() */
+    g_atomic_int_set(&virLogAsync.mode, VIR_LOG_ASYNC_NONE);
+    virLogAsyncFlush();
+#endif /* USE_ASYNC */
+
     virLogLock();
     virLogResetFilters();
     virLogResetOutputs();
@@ -479,6 +560,506 @@ virLogSourceUpdate(virLogSource *source)
 }
 
 
+/*
+ * Emits the version and host name messages to @output before the first
+ * message it gets, or to stderr if @output is NULL. Must be called with
+ * the log lock held.
+ */
+static void
+virLogOutputInitMessage(virLogOutput *output,
+                        const char *timestamp)
+{
+    virLogOutputFunc f = virLogOutputToFd;
+    void *data = (void *) STDERR_FILENO;
+    const char *rawinitmsg;
+    char *hoststr = NULL;
+    char *initmsg = NULL;
+
+    if (output) {
+        if (!output->logInitMessage)
+            return;
+        f = output->f;
+        data = output->data;
+        output->logInitMessage = false;
+    } else {
+        if (!virLogInitMessageStderr)
+            return;
+        virLogInitMessageStderr = false;
+    }
+
+    virLogVersionString(&rawinitmsg, &initmsg);
+    f(&virLogSelf, VIR_LOG_INFO,
+      __FILE__, __LINE__, __func__,
+      timestamp, NULL, rawinitmsg, initmsg, data);
+    VIR_FREE(initmsg);
+
+    virLogHostnameString(&hoststr, &initmsg);
+    f(&virLogSelf, VIR_LOG_INFO,
+      __FILE__, __LINE__, __func__,
+      timestamp, NULL, hoststr, initmsg, data);
+    VIR_FREE(hoststr);
+    VIR_FREE(initmsg);
+}
+
+
+/*
+ * Pushes the message to the outputs defined, if none exist then
+ * uses stderr. Must be called with the log lock held.
+ */
+static void
+virLogOutputMessage(virLogSource *source,
+                    virLogPriority priority,
+                    const char *filename,
+                    int linenr,
+                    const char *funcname,
+                    const char *timestamp,
+                    struct _virLogMetadata *metadata,
+                    const char *str,
+                    const char *msg)
+{
+    size_t i;
+
+    for (i = 0; i < virLogNbOutputs; i++) {
+        if (priority >= virLogOutputs[i]->priority) {
+            virLogOutputInitMessage(virLogOutputs[i], timestamp);
+            virLogOutputs[i]->f(source, priority,
+                                filename, linenr, funcname,
+                                timestamp, metadata,
+                                str, msg, virLogOutputs[i]->data);
+        }
+    }
+    if (virLogNbOutputs == 0) {
+        virLogOutputInitMessage(NULL, timestamp);
+        virLogOutputToFd(source, priority,
+                         filename, linenr, funcname,
+                         timestamp, metadata,
+                         str, msg, (void *) STDERR_FILENO);
+    }
+}
+
+
+#ifdef USE_ASYNC
+static virLogAsyncMessage *
+virLogAsyncMessageNew(virLogSource *source,
+                      virLogPriority priority,
+                      const char *filename,
+                      int linenr,
+                      const char *funcname,
+                      const char *timestamp,
+                      struct _virLogMetadata *metadata,
+                      char *str,
+                      char *msg)
+{
+    virLogAsyncMessage *message = g_new0(virLogAsyncMessage, 1);
+    size_t nmetadata = 0;
+    size_t i;
+
+    message->source = source;
+    message->priority = priority;
+    message->filename = g_strdup(filename);
+    message->linenr = linenr;
+    message->funcname = g_strdup(funcname);
+    ignore_value(virStrcpyStatic(message->timestamp, timestamp));
+    message->str = str;
+    message->msg = msg;
+    message->line = g_strdup_printf("%s: %s", timestamp, msg);
+
+    if (metadata) {
+        while (metadata[nmetadata].key)
+            nmetadata++;
+
+        message->metadata = g_new0(virLogMetadata, nmetadata + 1);
+        for (i = 0; i < nmetadata; i++) {
+            message->metadata[i].key = g_strdup(metadata[i].key);
+            message->metadata[i].s = g_strdup(metadata[i].s);
+            message->metadata[i].iv = metadata[i].iv;
+        }
+    }
+
+    return message;
+}
+
+
+static void
+virLogAsyncMessageFree(virLogAsyncMessage *message)
+{
+    size_t i;
+
+    if (message->metadata) {
+        for (i = 0; message->metadata[i].key; i++) {
+            g_free((char *) message->metadata[i].key);
+            g_free((char *) message->metadata[i].s);
+        }
+        g_free(message->metadata);
+    }
+
+    g_free(message->filename);
+    g_free(message->funcname);
+    g_free(message->str);
+    g_free(message->msg);
+    g_free(message->line);
+    g_free(message);
+}
+
+
+static void
+virLogAsyncWake(void)
+{
+    /* only the producer which catches the writer asleep takes the lock */
+    if (!g_atomic_int_compare_and_exchange(&virLogAsync.sleeping, 1, 0))
+        return;
+
+    virMutexLock(&virLogAsync.lock);
+    virCondSignal(&virLogAsync.cond);
+    virMutexUnlock(&virLogAsync.lock);
+}
+
+
+/*
+ * Queues @message for the writer thread. When the ring is full, @message
+ * is dropped or the calling thread waits for the writer thread to make
+ * room, depending on the mode.
+ */
+static void
+virLogAsyncQueue(virLogAsyncMessage *message)
+{
+    virLogAsyncSlot *slot;
+    int pos = g_atomic_int_get(&virLogAsync.head);
+
+    for (;;) {
+        int diff;
+
+        slot = &virLogAsync.slots[pos & VIR_LOG_ASYNC_MASK];
+        diff = (int) ((unsigned int) g_atomic_int_get(&slot->seq) -
+                      (unsigned int) pos);
+
+        if (diff == 0) {
+            if (g_atomic_int_compare_and_exchange(&virLogAsync.head,
+                                                  pos, pos + 1))
+                break;
+        } else if (diff < 0) {
+            if (g_atomic_int_get(&virLogAsync.mode) != VIR_LOG_ASYNC_BLOCK) {
+                g_atomic_int_inc(&virLogAsync.dropped);
+                virLogAsyncMessageFree(message);
+                return;
+            }
+
+            virLogAsyncWake();
+            g_usleep(100);
+        }
+
+        pos = g_atomic_int_get(&virLogAsync.head);
+    }
+
+    slot->message = message;
+    g_atomic_int_set(&slot->seq, pos + 1);
+
+    virLogAsyncWake();
+}
+
+
+static bool
+virLogAsyncIsEmpty(void)
+{
+    int tail = g_atomic_int_get(&virLogAsync.tail);
+    virLogAsyncSlot *slot = &virLogAsync.slots[tail & VIR_LOG_ASYNC_MASK];
+
+    return g_atomic_int_get(&slot->seq) != tail + 1;
+}
+
+
+static void
+virLogAsyncWrite(int fd,
+                 struct iovec *iov,
+                 size_t niov)
+{
+    while (niov > 0) {
+        ssize_t done = writev(fd, iov, niov);
+
+        if (done < 0) {
+            if (errno == EINTR)
+                continue;
+            return;
+        }
+
+        while (niov > 0 && (size_t) done >= iov->iov_len) {
+            done -= iov->iov_len;
+            iov++;
+            niov--;
+        }
+
+        if (niov > 0) {
+            iov->iov_base = (char *) iov->iov_base + done;
+            iov->iov_len -= done;
+        }
+    }
+}
+
+
+/*
+ * Passes @messages to the outputs, writing the lines of file and stderr
+ * outputs at once. Must be called with the log lock held.
+ */
+static void
+virLogAsyncOutput(virLogAsyncMessage **messages,
+                  size_t nmessages)
+{
+    struct iovec iov[VIR_LOG_ASYNC_BATCH];
+    size_t niov = 0;
+    size_t i;
+    size_t j;
+
+    for (i = 0; i < virLogNbOutputs; i++) {
+        virLogOutput *output = virLogOutputs[i];
+
+        niov = 0;
+
+        for (j = 0; j < nmessages; j++) {
+            virLogAsyncMessage *message = messages[j];
+
+            if (message->priority < output->priority)
+                continue;
+
+            virLogOutputInitMessage(output, message->timestamp);
+
+            if (output->f == virLogOutputToFd) {
+                iov[niov].iov_base = message->line;
+                iov[niov++].iov_len = strlen(message->line);
+                continue;
+            }
+
+            output->f(message->source, message->priority,
+                      message->filename, message->linenr, message->funcname,
+                      message->timestamp, message->metadata,
+                      message->str, message->msg, output->data);
+        }
+
+        if (niov > 0 && (intptr_t) output->data >= 0)
+            virLogAsyncWrite((intptr_t) output->data, iov, niov);
+    }
+
+    if (virLogNbOutputs == 0 && nmessages > 0) {
+        virLogOutputInitMessage(NULL, messages[0]->timestamp);
+
+        for (j = 0; j < nmessages; j++) {
+            iov[niov].iov_base = messages[j]->line;
+            iov[niov++].iov_len = strlen(messages[j]->line);
+        }
+
+        virLogAsyncWrite(STDERR_FILENO, iov, niov);
+    }
+}
+
+
+/*
+ * Passes a batch of queued messages to the outputs, preceded by a warning
+ * if messages were dropped since the previous batch.
+ *
+ * Returns the number of messages drained.
+ */
+static size_t
+virLogAsyncDrain(void)
+{
+    virLogAsyncMessage *messages[VIR_LOG_ASYNC_BATCH];
+    virLogAsyncMessage *warning = NULL;
+    size_t nmessages = 0;
+    size_t i;
+    int dropped;
+    VIR_LOCK_GUARD lock = virLockGuardLock(&virLogAsync.drainLock);
+
+    while (nmessages < VIR_LOG_ASYNC_BATCH) {
+        int tail = virLogAsync.tail;
+        virLogAsyncSlot *slot = &virLogAsync.slots[tail & VIR_LOG_ASYNC_MASK];
+
+        if (g_atomic_int_get(&slot->seq) != tail + 1)
+            break;
+
+        messages[nmessages++] = g_steal_pointer(&slot->message);
+        g_atomic_int_set(&slot->seq, tail + VIR_LOG_ASYNC_SIZE);
+        g_atomic_int_set(&virLogAsync.tail, tail + 1);
+    }
+
+    do {
+        dropped = g_atomic_int_get(&virLogAsync.dropped);
+    } while (dropped > 0 &&
+             !g_atomic_int_compare_and_exchange(&virLogAsync.dropped,
+                                                dropped, 0));
+
+    if (dropped > 0) {
+        g_autofree char *str = NULL;
+        char *msg = NULL;
+        char timestamp[VIR_TIME_STRING_BUFLEN];
+
+        virLogAsync.droppedTotal += dropped;
+        str = g_strdup_printf("dropped %d log messages, %llu in total",
+                              dropped, virLogAsync.droppedTotal);
+        virLogFormatString(&msg, __LINE__, __func__, VIR_LOG_WARN, str);
+
+        if (virTimeStringNowRaw(timestamp) < 0)
+            timestamp[0] = '\0';
+
+        warning = virLogAsyncMessageNew(&virLogSelf, VIR_LOG_WARN,
+                                        __FILE__, __LINE__, __func__,
+                                        timestamp, NULL,
+                                        g_steal_pointer(&str), msg);
+    }
+
+    if (nmessages == 0 && !warning)
+        return 0;
+
+    virLogLock();
+    if (warning)
+        virLogAsyncOutput(&warning, 1);
+    virLogAsyncOutput(messages, nmessages);
+    virLogUnlock();
+
+    if (warning)
+        virLogAsyncMessageFree(warning);
+    for (i = 0; i < nmessages; i++)
+        virLogAsyncMessageFree(messages[i]);
+
+    return nmessages;
+}
+
+
+static void
+virLogAsyncWriter(void *opaque G_GNUC_UNUSED)
+{
+    for (;;) {
+        if (virLogAsyncDrain() > 0)
+            continue;
+
+        virMutexLock(&virLogAsync.lock);
+        g_atomic_int_set(&virLogAsync.sleeping, 1);
+
+        /* producers queueing from now on wake us up */
+        if (virLogAsyncIsEmpty())
+            virCondWait(&virLogAsync.cond, &virLogAsync.lock);
+
+        g_atomic_int_set(&virLogAsync.sleeping, 0);
+        virMutexUnlock(&virLogAsync.lock);
+    }
+}
+
+
+/*
+ * Writes out all queued messages, e.g. on exit. Does nothing in child
+ * processes, which inherit the queued messages of their parent.
+ */
+static void
+virLogAsyncFlush(void)
+{
+    if (virLogAsync.pid != getpid())
+        return;
+
+    while (virLogAsyncDrain() > 0)
+        ;
+}
+
+
+/*
+ * Starts the writer thread unless this process runs it already. Must be
+ * called with the log lock held.
+ */
+static int
+virLogAsyncStart(void)
+{
+    size_t i;
+
+    if (virLogAsync.pid == getpid())
+        return 0;
+
+    /* The ring of a parent process is abandoned by its children */
+    virLogAsync.slots = g_new0(virLogAsyncSlot, VIR_LOG_ASYNC_SIZE);
+    for (i = 0; i < VIR_LOG_ASYNC_SIZE; i++)
+        virLogAsync.slots[i].seq = i;
+    virLogAsync.head = 0;
+    virLogAsync.tail = 0;
+    virLogAsync.dropped = 0;
+    virLogAsync.droppedTotal = 0;
+    virLogAsync.sleeping = 0;
+
+    if (virMutexInit(&virLogAsync.lock) < 0 ||
+        virMutexInit(&virLogAsync.drainLock) < 0 ||
+        virCondInit(&virLogAsync.cond) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("cannot initialize log writer"));
+        return -1;
+    }
+
+    if (virThreadCreateFull(&virLogAsync.thread, false,
+                            virLogAsyncWriter,
+                            "log-writer",
+                            false,
+                            NULL) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to create log writer thread"));
+        return -1;
+    }
+
+    if (virLogAsync.pid == 0)
+        atexit(virLogAsyncFlush);
+    virLogAsync.pid = getpid();
+
+    return 0;
+}
+#endif /* USE_ASYNC */
+
+
+/**
+ * virLogSetAsync:
+ * @mode: "none", "drop" or "block"
+ *
+ * Switches between writing log messages to the outputs synchronously by
+ * the logging threads ("none") and queueing them for a writer thread.
+ * With "drop", messages exceeding the queue are dropped and reported by
+ * a warning later, with "block" the logging threads wait for the writer
+ * thread instead. A NULL or empty @mode keeps the current mode.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virLogSetAsync(const char *mode)
+{
+    int m;
+
+    if (virLogInitialize() < 0)
+        return -1;
+
+    if (!mode || !*mode)
+        return 0;
+
+    if ((m = virLogAsyncModeTypeFromString(mode)) < 0) {
+        virReportError(VIR_ERR_INVALID_ARG,
+                       _("Invalid asynchronous logging mode '%s'"), mode);
+        return -1;
+    }
+
+#ifdef USE_ASYNC
+    if (m != VIR_LOG_ASYNC_NONE) {
+        int rc;
+
+        virLogLock();
+        rc = virLogAsyncStart();
+        virLogUnlock();
+
+        if (rc < 0)
+            return -1;
+    }
+
+    g_atomic_int_set(&virLogAsync.mode, m);
+#else /* !USE_ASYNC */
+    if (m != VIR_LOG_ASYNC_NONE) {
+        virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
+                       _("asynchronous logging is not supported on this platform"));
+        return -1;
+    }
+#endif /* !USE_ASYNC */
+
+    return 0;
+}
+
+
 /**
  * virLogVMessage:
  * @source: where is that message coming from
@@ -504,11 +1085,9 @@ virLogVMessage(virLogSource *source,
                const char *fmt,
                va_list vargs)
 {
-    static bool logInitMessageStderr = true;
     g_autofree char *str = NULL;
     g_autofree char *msg = NULL;
     char timestamp[VIR_TIME_STRING_BUFLEN];
-    size_t i;
     int saved_errno = errno;
 
     if (virLogInitialize() < 0)
@@ -540,66 +1119,22 @@ virLogVMessage(virLogSource *source,
     if (virTimeStringNowRaw(timestamp) < 0)
         timestamp[0] = '\0';
 
-    virLogLock();
-
-    /*
-     * Push the message to the outputs defined, if none exist then
-     * use stderr.
-     */
-    for (i = 0; i < virLogNbOutputs; i++) {
-        if (priority >= virLogOutputs[i]->priority) {
-            if (virLogOutputs[i]->logInitMessage) {
-                const char *rawinitmsg;
-                char *hoststr = NULL;
-                char *initmsg = NULL;
-                virLogVersionString(&rawinitmsg, &initmsg);
-                virLogOutputs[i]->f(&virLogSelf, VIR_LOG_INFO,
-                                    __FILE__, __LINE__, __func__,
-                                    timestamp, NULL, rawinitmsg, initmsg,
-                                    virLogOutputs[i]->data);
-                VIR_FREE(initmsg);
-
-                virLogHostnameString(&hoststr, &initmsg);
-                virLogOutputs[i]->f(&virLogSelf, VIR_LOG_INFO,
-                                    __FILE__, __LINE__, __func__,
-                                    timestamp, NULL, hoststr, initmsg,
-                                    virLogOutputs[i]->data);
-                VIR_FREE(hoststr);
-                VIR_FREE(initmsg);
-                virLogOutputs[i]->logInitMessage = false;
-            }
-            virLogOutputs[i]->f(source, priority,
-                                filename, linenr, funcname,
-                                timestamp, metadata,
-                                str, msg, virLogOutputs[i]->data);
-        }
-    }
-    if (virLogNbOutputs == 0) {
-        if (logInitMessageStderr) {
-            const char *rawinitmsg;
-            char *hoststr = NULL;
-            char *initmsg = NULL;
-            virLogVersionString(&rawinitmsg, &initmsg);
-            virLogOutputToFd(&virLogSelf, VIR_LOG_INFO,
-                             __FILE__, __LINE__, __func__,
-                             timestamp, NULL, rawinitmsg, initmsg,
-                             (void *) STDERR_FILENO);
-            VIR_FREE(initmsg);
-
-            virLogHostnameString(&hoststr, &initmsg);
-            virLogOutputToFd(&virLogSelf, VIR_LOG_INFO,
-                             __FILE__, __LINE__, __func__,
-                             timestamp, NULL, hoststr, initmsg,
-                             (void *) STDERR_FILENO);
-            VIR_FREE(hoststr);
-            VIR_FREE(initmsg);
-            logInitMessageStderr = false;
-        }
-        virLogOutputToFd(source, priority,
-                         filename, linenr, funcname,
-                         timestamp, metadata,
-                         str, msg, (void *) STDERR_FILENO);
+#ifdef USE_ASYNC
+    /* a child process doesn't inherit the writer thread */
+    if (g_atomic_int_get(&virLogAsync.mode) != VIR_LOG_ASYNC_NONE &&
+        virLogAsync.pid == getpid()) {
+        virLogAsyncQueue(virLogAsyncMessageNew(source, priority,
+                                               filename, linenr, funcname,
+                                               timestamp, metadata,
+                                               g_steal_pointer(&str),
+                                               g_steal_pointer(&msg)));
+        goto cleanup;
     }
+#endif /* USE_ASYNC */
+
+    virLogLock();
+    virLogOutputMessage(source, priority, filename, linenr, funcname,
+                        timestamp, metadata, str, msg);
     virLogUnlock();
 
  cleanup:
@@ -1232,6 +1767,10 @@ virLogSetFromEnv(void)
     if (debugEnv && *debugEnv &&
         virLogSetOutputs(debugEnv))
         return -1;
+    debugEnv = getenv("LIBVIRT_LOG_ASYNC");
+    if (debugEnv && *debugEnv &&
+        virLogSetAsync(debugEnv) < 0)
+        return -1;
 
     return 0;
 }
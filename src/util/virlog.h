@@ -56,6 +56,13 @@ typedef enum {
     VIR_LOG_TO_OUTPUT_LAST,
 } virLogDestination;
 
+typedef enum {
+    VIR_LOG_ASYNC_NONE = 0,
+    VIR_LOG_ASYNC_DROP,
+    VIR_LOG_ASYNC_BLOCK,
+    VIR_LOG_ASYNC_LAST,
+} virLogAsyncMode;
+
 typedef struct _virLogSource virLogSource;
 struct _virLogSource {
     const char *name;
@@ -153,6 +160,7 @@ void virLogFilterFree(virLogFilter *filter);
 void virLogFilterListFree(virLogFilter **list, int count);
 int virLogSetOutputs(const char *outputs);
 int virLogSetFilters(const char *filters);
+int virLogSetAsync(const char *mode);
 char *virLogGetDefaultOutput(void);
 int virLogSetDefaultOutput(const char *fname, bool godaemon, bool privileged);
 
@@ -42,9 +42,8 @@ virNetDevBandwidthFree(virNetDevBandwidth *def)
     g_free(def);
 }
 
-static void
-virNetDevBandwidthCmdAddOptimalQuantum(virCommand *cmd,
-                                       const virNetDevBandwidthRate *rate)
+static unsigned long long
+virNetDevBandwidthOptimalQuantum(const virNetDevBandwidthRate *rate)
 {
     const unsigned long long mtu = 1500;
     unsigned long long r2q;
@@ -61,12 +60,67 @@ virNetDevBandwidthCmdAddOptimalQuantum(virCommand *cmd,
     if (!r2q)
         r2q = 1;
 
-    virCommandAddArg(cmd, "quantum");
-    virCommandAddArgFormat(cmd, "%llu", r2q);
+    return r2q;
+}
+
+
+/* Append a tc command made of the NULL terminated list of arguments to
+ * @batch, see virNetDevBandwidthRunBatch() */
+static void G_GNUC_NULL_TERMINATED
+virNetDevBandwidthBatchAdd(virBuffer *batch,
+                           ...)
+{
+    va_list list;
+    const char *arg;
+    bool first = true;
+
+    va_start(list, batch);
+    while ((arg = va_arg(list, const char *))) {
+        if (!first)
+            virBufferAddChar(batch, ' ');
+        virBufferAdd(batch, arg, -1);
+        first = false;
+    }
+    va_end(list);
+
+    virBufferAddChar(batch, '\n');
+}
+
+
+/**
+ * virNetDevBandwidthRunBatch:
+ * @batch: tc commands, one per line
+ * @ignoreErrors: whether failing commands are expected
+ *
+ * Run all commands from @batch in a single tc process rather than one
+ * process each. Unless @ignoreErrors is set, tc stops at the first
+ * failing command and an error is reported. Otherwise all commands are
+ * tried, which is what removing settings that might not exist needs.
+ *
+ * Returns 0 on success, -1 otherwise.
+ */
+static int
+virNetDevBandwidthRunBatch(virBuffer *batch,
+                           bool ignoreErrors)
+{
+    g_autoptr(virCommand) cmd = virCommandNew(TC);
+    g_autofree char *input = virBufferContentAndReset(batch);
+    int status;
+
+    if (!input)
+        return 0;
+
+    if (ignoreErrors)
+        virCommandAddArg(cmd, "-force");
+    virCommandAddArgList(cmd, "-batch", "-", NULL);
+    virCommandSetInputBuffer(cmd, input);
+
+    return virCommandRun(cmd, ignoreErrors ? &status : NULL);
 }
 
 /**
  * virNetDevBandwidthManipulateFilter:
+ * @batch: tc commands to append the creation of the filter to
  * @ifname: interface to operate on
  * @ifmac_ptr: MAC of the interface to create filter over
  * @id: filter ID
@@ -91,13 +145,17 @@ virNetDevBandwidthCmdAddOptimalQuantum(virCommand *cmd,
  *
  * This function can be used for both, removing stale filter
  * (@remove_old set to true) and creating new one (@create_new
- * set to true). Both at once for the same price!
+ * set to true). Both at once for the same price! The stale filter is
+ * removed right away, while the command creating the new one is only
+ * appended to @batch so that the caller can run it along with the
+ * commands setting up the class the filter refers to.
  *
  * Returns: 0 on success,
  *         -1 otherwise (with error reported).
  */
-static int ATTRIBUTE_NONNULL(1)
-virNetDevBandwidthManipulateFilter(const char *ifname,
+static int ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2)
+virNetDevBandwidthManipulateFilter(virBuffer *batch,
+                                   const char *ifname,
                                    const virMacAddr *ifmac_ptr,
                                    unsigned int id,
                                    const char *class_id,
@@ -119,19 +177,16 @@ virNetDevBandwidthManipulateFilter(const char *ifname,
     filter_id = g_strdup_printf("800::%u", id);
 
     if (remove_old) {
-        g_autoptr(virCommand) cmd = virCommandNew(TC);
-        int cmd_ret = 0;
+        g_auto(virBuffer) del = VIR_BUFFER_INITIALIZER;
 
-        virCommandAddArgList(cmd, "filter", "del", "dev", ifname,
-                             "prio", "2", "handle",  filter_id, "u32", NULL);
+        virNetDevBandwidthBatchAdd(&del, "filter", "del", "dev", ifname,
+                                   "prio", "2", "handle",  filter_id, "u32", NULL);
 
-        if (virCommandRun(cmd, &cmd_ret) < 0)
+        if (virNetDevBandwidthRunBatch(&del, true) < 0)
             goto cleanup;
-
     }
 
     if (create_new) {
-        g_autoptr(virCommand) cmd = virCommandNew(TC);
         virMacAddrGetRaw(ifmac_ptr, ifmac);
 
         mac[0] = g_strdup_printf("0x%02x%02x%02x%02x", ifmac[2],
@@ -143,15 +198,13 @@ virNetDevBandwidthManipulateFilter(const char *ifname,
          * ebtables marks, we need to use u32 selector to match MAC address.
          * If libvirt will ever know something, remove this FIXME
          */
-        virCommandAddArgList(cmd, "filter", "add", "dev", ifname, "protocol", "ip",
-                             "prio", "2", "handle", filter_id, "u32",
-                             "match", "u16", "0x0800", "0xffff", "at", "-2",
-                             "match", "u32", mac[0], "0xffffffff", "at", "-12",
-                             "match", "u16", mac[1], "0xffff", "at", "-14",
-                             "flowid", class_id, NULL);
-
-        if (virCommandRun(cmd, NULL) < 0)
-            goto cleanup;
+        virNetDevBandwidthBatchAdd(batch, "filter", "add", "dev", ifname,
+                                   "protocol", "ip",
+                                   "prio", "2", "handle", filter_id, "u32",
+                                   "match", "u16", "0x0800", "0xffff", "at", "-2",
+                                   "match", "u32", mac[0], "0xffffffff", "at", "-12",
+                                   "match", "u16", mac[1], "0xffff", "at", "-14",
+                                   "flowid", class_id, NULL);
     }
 
     ret = 0;
@@ -194,10 +247,11 @@ virNetDevBandwidthSet(const char *ifname,
     int ret = -1;
     virNetDevBandwidthRate *rx = NULL; /* From domain POV */
     virNetDevBandwidthRate *tx = NULL; /* From domain POV */
-    virCommand *cmd = NULL;
+    g_auto(virBuffer) batch = VIR_BUFFER_INITIALIZER;
     char *average = NULL;
     char *peak = NULL;
     char *burst = NULL;
+    char *quantum = NULL;
 
     if (!bandwidth) {
         /* nothing to be enabled */
@@ -235,13 +289,11 @@ virNetDevBandwidthSet(const char *ifname,
             peak = g_strdup_printf("%llukbps", tx->peak);
         if (tx->burst)
             burst = g_strdup_printf("%llukb", tx->burst);
+        quantum = g_strdup_printf("%llu", virNetDevBandwidthOptimalQuantum(tx));
 
-        cmd = virCommandNew(TC);
-        virCommandAddArgList(cmd, "qdisc", "add", "dev", ifname, "root",
-                             "handle", "1:", "htb", "default",
-                             hierarchical_class ? "2" : "1", NULL);
-        if (virCommandRun(cmd, NULL) < 0)
-            goto cleanup;
+        virNetDevBandwidthBatchAdd(&batch, "qdisc", "add", "dev", ifname, "root",
+                                   "handle", "1:", "htb", "default",
+                                   hierarchical_class ? "2" : "1", NULL);
 
         /* If we are creating a hierarchical class, all non guaranteed traffic
          * goes to the 1:2 class which will adjust 'rate' dynamically as NICs
@@ -307,49 +359,33 @@ virNetDevBandwidthSet(const char *ifname,
          * it before you dig into the code.
          */
         if (hierarchical_class) {
-            virCommandFree(cmd);
-            cmd = virCommandNew(TC);
-            virCommandAddArgList(cmd, "class", "add", "dev", ifname, "parent",
-                                 "1:", "classid", "1:1", "htb", "rate", average,
-                                 "ceil", peak ? peak : average, NULL);
-            virNetDevBandwidthCmdAddOptimalQuantum(cmd, tx);
-            if (virCommandRun(cmd, NULL) < 0)
-                goto cleanup;
+            virNetDevBandwidthBatchAdd(&batch, "class", "add", "dev", ifname,
+                                       "parent", "1:", "classid", "1:1",
+                                       "htb", "rate", average,
+                                       "ceil", peak ? peak : average,
+                                       "quantum", quantum, NULL);
         }
-        virCommandFree(cmd);
-        cmd = virCommandNew(TC);
-        virCommandAddArgList(cmd, "class", "add", "dev", ifname, "parent",
-                             hierarchical_class ? "1:1" : "1:", "classid",
-                             hierarchical_class ? "1:2" : "1:1", "htb",
-                             "rate", average, NULL);
 
+        virBufferAsprintf(&batch, "class add dev %s parent %s classid %s "
+                          "htb rate %s", ifname,
+                          hierarchical_class ? "1:1" : "1:",
+                          hierarchical_class ? "1:2" : "1:1",
+                          average);
         if (peak)
-            virCommandAddArgList(cmd, "ceil", peak, NULL);
+            virBufferAsprintf(&batch, " ceil %s", peak);
         if (burst)
-            virCommandAddArgList(cmd, "burst", burst, NULL);
-
-        virNetDevBandwidthCmdAddOptimalQuantum(cmd, tx);
-        if (virCommandRun(cmd, NULL) < 0)
-            goto cleanup;
-
-        virCommandFree(cmd);
-        cmd = virCommandNew(TC);
-        virCommandAddArgList(cmd, "qdisc", "add", "dev", ifname, "parent",
-                             hierarchical_class ? "1:2" : "1:1",
-                             "handle", "2:", "sfq", "perturb",
-                             "10", NULL);
-
-        if (virCommandRun(cmd, NULL) < 0)
-            goto cleanup;
+            virBufferAsprintf(&batch, " burst %s", burst);
+        virBufferAsprintf(&batch, " quantum %s\n", quantum);
 
-        virCommandFree(cmd);
-        cmd = virCommandNew(TC);
-        virCommandAddArgList(cmd, "filter", "add", "dev", ifname, "parent",
-                             "1:0", "protocol", "all", "prio", "1", "handle",
-                             "1", "fw", "flowid", "1", NULL);
+        virNetDevBandwidthBatchAdd(&batch, "qdisc", "add", "dev", ifname,
+                                   "parent", hierarchical_class ? "1:2" : "1:1",
+                                   "handle", "2:", "sfq", "perturb",
+                                   "10", NULL);
 
-        if (virCommandRun(cmd, NULL) < 0)
-            goto cleanup;
+        virNetDevBandwidthBatchAdd(&batch, "filter", "add", "dev", ifname,
+                                   "parent", "1:0", "protocol", "all",
+                                   "prio", "1", "handle", "1", "fw",
+                                   "flowid", "1", NULL);
 
         VIR_FREE(average);
         VIR_FREE(peak);
@@ -370,34 +406,29 @@ virNetDevBandwidthSet(const char *ifname,
             burst = g_strdup_printf("%llukb", avg);
         }
 
-        virCommandFree(cmd);
-        cmd = virCommandNew(TC);
-            virCommandAddArgList(cmd, "qdisc", "add", "dev", ifname,
-                                 "ingress", NULL);
-
-        if (virCommandRun(cmd, NULL) < 0)
-            goto cleanup;
+        virNetDevBandwidthBatchAdd(&batch, "qdisc", "add", "dev", ifname,
+                                   "ingress", NULL);
 
-        virCommandFree(cmd);
-        cmd = virCommandNew(TC);
         /* Set filter to match all ingress traffic */
-        virCommandAddArgList(cmd, "filter", "add", "dev", ifname, "parent",
-                             "ffff:", "protocol", "all", "u32", "match", "u32",
-                             "0", "0", "police", "rate", average,
-                             "burst", burst, "mtu", "64kb", "drop", "flowid",
-                             ":1", NULL);
-
-        if (virCommandRun(cmd, NULL) < 0)
-            goto cleanup;
+        virNetDevBandwidthBatchAdd(&batch, "filter", "add", "dev", ifname,
+                                   "parent", "ffff:", "protocol", "all",
+                                   "u32", "match", "u32", "0", "0",
+                                   "police", "rate", average,
+                                   "burst", burst, "mtu", "64kb", "drop",
+                                   "flowid", ":1", NULL);
     }
 
+    /* All of the qdiscs, classes and filters are set up by one tc */
+    if (virNetDevBandwidthRunBatch(&batch, false) < 0)
+        goto cleanup;
+
     ret = 0;
 
  cleanup:
-    virCommandFree(cmd);
     VIR_FREE(average);
     VIR_FREE(peak);
     VIR_FREE(burst);
+    VIR_FREE(quantum);
     return ret;
 }
 
@@ -414,27 +445,16 @@ virNetDevBandwidthSet(const char *ifname,
 int
 virNetDevBandwidthClear(const char *ifname)
 {
-    int ret = 0;
-    int dummy; /* for ignoring the exit status */
-    g_autoptr(virCommand) rootcmd = NULL;
-    g_autoptr(virCommand) ingresscmd = NULL;
+    g_auto(virBuffer) batch = VIR_BUFFER_INITIALIZER;
 
     if (!ifname)
        return 0;
 
-    rootcmd = virCommandNew(TC);
-    virCommandAddArgList(rootcmd, "qdisc", "del", "dev", ifname, "root", NULL);
-
-    if (virCommandRun(rootcmd, &dummy) < 0)
-        ret = -1;
-
-    ingresscmd = virCommandNew(TC);
-    virCommandAddArgList(ingresscmd, "qdisc",  "del", "dev", ifname, "ingress", NULL);
-
-    if (virCommandRun(ingresscmd, &dummy) < 0)
-        ret = -1;
+    virNetDevBandwidthBatchAdd(&batch, "qdisc", "del", "dev", ifname, "root", NULL);
+    virNetDevBandwidthBatchAdd(&batch, "qdisc", "del", "dev", ifname, "ingress", NULL);
 
-    return ret;
+    /* either qdisc might not exist */
+    return virNetDevBandwidthRunBatch(&batch, true);
 }
 
 /*
@@ -538,12 +558,12 @@ virNetDevBandwidthPlug(const char *brname,
                        virNetDevBandwidth *bandwidth,
                        unsigned int id)
 {
-    g_autoptr(virCommand) cmd1 = NULL;
-    g_autoptr(virCommand) cmd2 = NULL;
+    g_auto(virBuffer) batch = VIR_BUFFER_INITIALIZER;
     g_autofree char *class_id = NULL;
     g_autofree char *qdisc_id = NULL;
     g_autofree char *floor = NULL;
     g_autofree char *ceil = NULL;
+    g_autofree char *quantum = NULL;
     char ifmacStr[VIR_MAC_STRING_BUFLEN];
 
     if (id <= 2) {
@@ -567,29 +587,23 @@ virNetDevBandwidthPlug(const char *brname,
     ceil = g_strdup_printf("%llukbps", net_bandwidth->in->peak ?
                            net_bandwidth->in->peak :
                            net_bandwidth->in->average);
+    quantum = g_strdup_printf("%llu",
+                              virNetDevBandwidthOptimalQuantum(bandwidth->in));
 
-    cmd1 = virCommandNew(TC);
-    virCommandAddArgList(cmd1, "class", "add", "dev", brname, "parent", "1:1",
-                         "classid", class_id, "htb", "rate", floor,
-                         "ceil", ceil, NULL);
-    virNetDevBandwidthCmdAddOptimalQuantum(cmd1, bandwidth->in);
-
-    if (virCommandRun(cmd1, NULL) < 0)
-        return -1;
+    virNetDevBandwidthBatchAdd(&batch, "class", "add", "dev", brname,
+                               "parent", "1:1", "classid", class_id,
+                               "htb", "rate", floor, "ceil", ceil,
+                               "quantum", quantum, NULL);
 
-    cmd2 = virCommandNew(TC);
-    virCommandAddArgList(cmd2, "qdisc", "add", "dev", brname, "parent",
-                         class_id, "handle", qdisc_id, "sfq", "perturb",
-                         "10", NULL);
+    virNetDevBandwidthBatchAdd(&batch, "qdisc", "add", "dev", brname,
+                               "parent", class_id, "handle", qdisc_id,
+                               "sfq", "perturb", "10", NULL);
 
-    if (virCommandRun(cmd2, NULL) < 0)
-        return -1;
-
-    if (virNetDevBandwidthManipulateFilter(brname, ifmac_ptr, id,
+    if (virNetDevBandwidthManipulateFilter(&batch, brname, ifmac_ptr, id,
                                            class_id, false, true) < 0)
         return -1;
 
-    return 0;
+    return virNetDevBandwidthRunBatch(&batch, false);
 }
 
 /*
@@ -605,11 +619,10 @@ int
 virNetDevBandwidthUnplug(const char *brname,
                          unsigned int id)
 {
-    int cmd_ret = 0;
-    g_autoptr(virCommand) cmd1 = NULL;
-    g_autoptr(virCommand) cmd2 = NULL;
+    g_auto(virBuffer) batch = VIR_BUFFER_INITIALIZER;
     g_autofree char *class_id = NULL;
     g_autofree char *qdisc_id = NULL;
+    g_autofree char *filter_id = NULL;
 
     if (id <= 2) {
         virReportError(VIR_ERR_INTERNAL_ERROR, _("Invalid class ID %d"), id);
@@ -618,28 +631,20 @@ virNetDevBandwidthUnplug(const char *brname,
 
     class_id = g_strdup_printf("1:%x", id);
     qdisc_id = g_strdup_printf("%x:", id);
+    /* u32 filters must have 800:: prefix, see
+     * virNetDevBandwidthManipulateFilter() */
+    filter_id = g_strdup_printf("800::%u", id);
 
-    cmd1 = virCommandNew(TC);
-    virCommandAddArgList(cmd1, "qdisc", "del", "dev", brname,
-                         "handle", qdisc_id, NULL);
+    virNetDevBandwidthBatchAdd(&batch, "qdisc", "del", "dev", brname,
+                               "handle", qdisc_id, NULL);
+    virNetDevBandwidthBatchAdd(&batch, "filter", "del", "dev", brname,
+                               "prio", "2", "handle", filter_id, "u32", NULL);
+    virNetDevBandwidthBatchAdd(&batch, "class", "del", "dev", brname,
+                               "classid", class_id, NULL);
 
     /* Don't threat tc errors as fatal, but
      * try to remove as much as possible */
-    if (virCommandRun(cmd1, &cmd_ret) < 0)
-        return -1;
-
-    if (virNetDevBandwidthManipulateFilter(brname, NULL, id,
-                                           NULL, true, false) < 0)
-        return -1;
-
-    cmd2 = virCommandNew(TC);
-    virCommandAddArgList(cmd2, "class", "del", "dev", brname,
-                         "classid", class_id, NULL);
-
-    if (virCommandRun(cmd2, &cmd_ret) < 0)
-        return -1;
-
-    return 0;
+    return virNetDevBandwidthRunBatch(&batch, true);
 }
 
 /**
@@ -676,8 +681,9 @@ virNetDevBandwidthUpdateRate(const char *ifname,
     cmd = virCommandNew(TC);
     virCommandAddArgList(cmd, "class", "change", "dev", ifname,
                          "classid", class_id, "htb", "rate", rate,
-                         "ceil", ceil, NULL);
-    virNetDevBandwidthCmdAddOptimalQuantum(cmd, bandwidth->in);
+                         "ceil", ceil, "quantum", NULL);
+    virCommandAddArgFormat(cmd, "%llu",
+                           virNetDevBandwidthOptimalQuantum(bandwidth->in));
 
     return virCommandRun(cmd, NULL);
 }
@@ -704,13 +710,15 @@ virNetDevBandwidthUpdateFilter(const char *ifname,
                                const virMacAddr *ifmac_ptr,
                                unsigned int id)
 {
+    g_auto(virBuffer) batch = VIR_BUFFER_INITIALIZER;
     int ret = -1;
     char *class_id = NULL;
 
     class_id = g_strdup_printf("1:%x", id);
 
-    if (virNetDevBandwidthManipulateFilter(ifname, ifmac_ptr, id,
-                                           class_id, true, true) < 0)
+    if (virNetDevBandwidthManipulateFilter(&batch, ifname, ifmac_ptr, id,
+                                           class_id, true, true) < 0 ||
+        virNetDevBandwidthRunBatch(&batch, false) < 0)
         goto cleanup;
 
     ret = 0;
@@ -621,101 +621,142 @@ int virNetDevOpenvswitchUpdateVlan(const char *ifname,
     return 0;
 }
 
-static char*
-virNetDevOpenvswitchFindUUID(const char *table,
-                             const char *vmid_ex_id,
-                             const char *ifname_ex_id)
+/**
+ * virNetDevOpenvswitchParseUUIDs:
+ * @json: a table printed by ovs-vsctl --format=json --columns=_uuid
+ *
+ * Returns: a NULL terminated list of UUIDs found in @json,
+ *          NULL if @json is malformed.
+ */
+static char **
+virNetDevOpenvswitchParseUUIDs(const char *json)
 {
-    g_autoptr(virCommand) cmd = NULL;
-    char *uuid = NULL;
+    g_autoptr(virJSONValue) table = NULL;
+    g_auto(GStrv) uuids = NULL;
+    virJSONValue *data;
+    size_t ndata;
+    size_t i;
 
-    cmd = virNetDevOpenvswitchCreateCmd();
-    virCommandAddArgList(cmd, "--no-heading", "--columns=_uuid", "find", table,
-                         vmid_ex_id, ifname_ex_id, NULL);
-    virCommandSetOutputBuffer(cmd, &uuid);
+    if (!(table = virJSONValueFromString(json)) ||
+        !(data = virJSONValueObjectGetArray(table, "data")))
+        return NULL;
+
+    ndata = virJSONValueArraySize(data);
+    uuids = g_new0(char *, ndata + 1);
+
+    for (i = 0; i < ndata; i++) {
+        virJSONValue *row = virJSONValueArrayGet(data, i);
+        virJSONValue *cell;
+        virJSONValue *uuid;
+        const char *str;
+
+        /* each row holds just the _uuid column: ["uuid","..."] */
+        if (!(cell = virJSONValueArrayGet(row, 0)) ||
+            !(uuid = virJSONValueArrayGet(cell, 1)) ||
+            !(str = virJSONValueGetString(uuid)))
+            return NULL;
+
+        uuids[i] = g_strdup(str);
+    }
+
+    return g_steal_pointer(&uuids);
+}
+
+
+/**
+ * virNetDevOpenvswitchFindQos:
+ * @ifname: the name of the interface
+ * @vmid_ex_id: external-ids match for the domain UUID
+ * @ifname_ex_id: external-ids match for @ifname
+ * @queues: returns the UUIDs of queues created for @ifname
+ * @qoses: returns the UUIDs of qos created for @ifname
+ *
+ * Looks up both queues and qos records belonging to @ifname with a single
+ * ovs-vsctl call. If the lookup fails, a warning is logged and empty lists
+ * are returned, just like if there were no records.
+ */
+static void
+virNetDevOpenvswitchFindQos(const char *ifname,
+                            const char *vmid_ex_id,
+                            const char *ifname_ex_id,
+                            char ***queues,
+                            char ***qoses)
+{
+    g_autoptr(virCommand) cmd = virNetDevOpenvswitchCreateCmd();
+    g_autofree char *output = NULL;
+
+    *queues = NULL;
+    *qoses = NULL;
+
+    virCommandAddArgList(cmd, "--format=json", "--columns=_uuid",
+                         "find", "queue", vmid_ex_id, ifname_ex_id,
+                         "--", "find", "qos", vmid_ex_id, ifname_ex_id, NULL);
+    virCommandSetOutputBuffer(cmd, &output);
+
+    /* Each of the commands prints its table on a separate line, e.g.:
+     *   {"data":[[["uuid","4b5a9b3c-..."]]],"headings":["_uuid"]}
+     *   {"data":[],"headings":["_uuid"]}
+     */
     if (virCommandRun(cmd, NULL) < 0) {
-        VIR_WARN("Unable to find queue on port with %s", ifname_ex_id);
+        VIR_WARN("Unable to find queue and qos on port %s", ifname);
+    } else if (output && *output) {
+        g_auto(GStrv) lines = g_strsplit(output, "\n", 0);
+
+        if (!lines[0] || !lines[1] ||
+            !(*queues = virNetDevOpenvswitchParseUUIDs(lines[0])) ||
+            !(*qoses = virNetDevOpenvswitchParseUUIDs(lines[1]))) {
+            virResetLastError();
+            VIR_WARN("Malformed ovs-vsctl output while looking up qos on port %s",
+                     ifname);
+            g_clear_pointer(queues, g_strfreev);
+        }
     }
-    return uuid;
+
+    if (!*queues)
+        *queues = g_new0(char *, 1);
+    if (!*qoses)
+        *qoses = g_new0(char *, 1);
 }
 
 static int
 virNetDevOpenvswitchInterfaceClearTxQos(const char *ifname,
                                         const unsigned char *vmuuid)
 {
-    int ret = 0;
     char vmuuidstr[VIR_UUID_STRING_BUFLEN];
+    g_autoptr(virCommand) cmd = NULL;
     g_autofree char *ifname_ex_id = NULL;
     g_autofree char *vmid_ex_id = NULL;
-    g_autofree char *qos_uuid = NULL;
-    g_autofree char *queue_uuid = NULL;
-    g_autofree char *port_qos = NULL;
+    g_auto(GStrv) queues = NULL;
+    g_auto(GStrv) qoses = NULL;
     size_t i;
 
-    /* find qos */
     virUUIDFormat(vmuuid, vmuuidstr);
     vmid_ex_id = g_strdup_printf("external-ids:vm-id=\"%s\"", vmuuidstr);
     ifname_ex_id = g_strdup_printf("external-ids:ifname=\"%s\"", ifname);
-    /* find queue */
-    queue_uuid = virNetDevOpenvswitchFindUUID("queue", vmid_ex_id, ifname_ex_id);
-    /* find qos */
-    qos_uuid = virNetDevOpenvswitchFindUUID("qos", vmid_ex_id, ifname_ex_id);
-
-    if (qos_uuid && *qos_uuid) {
-        g_auto(GStrv) lines = g_strsplit(qos_uuid, "\n", 0);
-
-        /* destroy qos */
-        for (i = 0; lines[i] != NULL; i++) {
-            const char *line = lines[i];
-            g_autoptr(virCommand) listcmd = NULL;
-            g_autoptr(virCommand) destroycmd = NULL;
-
-            if (!*line) {
-                continue;
-            }
-            listcmd = virNetDevOpenvswitchCreateCmd();
-            virCommandAddArgList(listcmd, "--no-heading", "--columns=_uuid", "--if-exists",
-                                 "list", "port", ifname, "qos", NULL);
-            virCommandSetOutputBuffer(listcmd, &port_qos);
-            if (virCommandRun(listcmd, NULL) < 0) {
-                VIR_WARN("Unable to remove port qos on port %s", ifname);
-            }
-            if (port_qos && *port_qos) {
-                g_autoptr(virCommand) cmd = virNetDevOpenvswitchCreateCmd();
-                virCommandAddArgList(cmd, "remove", "port", ifname, "qos", line, NULL);
-                if (virCommandRun(cmd, NULL) < 0) {
-                    VIR_WARN("Unable to remove port qos on port %s", ifname);
-                }
-            }
-            destroycmd = virNetDevOpenvswitchCreateCmd();
-            virCommandAddArgList(destroycmd, "destroy", "qos", line, NULL);
-            if (virCommandRun(destroycmd, NULL) < 0) {
-                VIR_WARN("Unable to destroy qos on port %s", ifname);
-                ret = -1;
-            }
-        }
+    virNetDevOpenvswitchFindQos(ifname, vmid_ex_id, ifname_ex_id,
+                                &queues, &qoses);
+
+    if (!queues[0] && !qoses[0])
+        return 0;
+
+    /* Detach and destroy all of the qos and queues in one transaction.
+     * Removing a qos the port doesn't refer to is a no-op. */
+    cmd = virNetDevOpenvswitchCreateCmd();
+    for (i = 0; qoses[i]; i++) {
+        virCommandAddArgList(cmd,
+                             "--", "--if-exists", "remove", "port", ifname,
+                             "qos", qoses[i],
+                             "--", "destroy", "qos", qoses[i], NULL);
     }
-    /* destroy queue */
-    if (queue_uuid && *queue_uuid) {
-        g_auto(GStrv) lines = g_strsplit(queue_uuid, "\n", 0);
-
-        for (i = 0; lines[i] != NULL; i++) {
-            g_autoptr(virCommand) cmd = NULL;
-            const char *line = lines[i];
-            if (!*line) {
-                continue;
-            }
-
-            cmd = virNetDevOpenvswitchCreateCmd();
-            virCommandAddArgList(cmd, "destroy", "queue", line, NULL);
-            if (virCommandRun(cmd, NULL) < 0) {
-                VIR_WARN("Unable to destroy queue on port %s", ifname);
-                ret = -1;
-            }
-        }
+    for (i = 0; queues[i]; i++)
+        virCommandAddArgList(cmd, "--", "destroy", "queue", queues[i], NULL);
+
+    if (virCommandRun(cmd, NULL) < 0) {
+        VIR_WARN("Unable to destroy qos on port %s", ifname);
+        return -1;
     }
 
-    return ret;
+    return 0;
 }
 
 static int
@@ -759,8 +800,8 @@ virNetDevOpenvswitchInterfaceSetTxQos(const char *ifname,
     g_autofree char *average = NULL;
     g_autofree char *peak = NULL;
     g_autofree char *burst = NULL;
-    g_autofree char *qos_uuid = NULL;
-    g_autofree char *queue_uuid = NULL;
+    g_auto(GStrv) queues = NULL;
+    g_auto(GStrv) qoses = NULL;
 
     average = g_strdup_printf("%llu", KBYTE_TO_BITS(tx->average));
     if (tx->burst)
@@ -771,16 +812,13 @@ virNetDevOpenvswitchInterfaceSetTxQos(const char *ifname,
     virUUIDFormat(vmuuid, vmuuidstr);
     vmid_ex_id = g_strdup_printf("external-ids:vm-id=\"%s\"", vmuuidstr);
     ifname_ex_id = g_strdup_printf("external-ids:ifname=\"%s\"", ifname);
-    /* find queue */
-    queue_uuid = virNetDevOpenvswitchFindUUID("queue", vmid_ex_id, ifname_ex_id);
-    /* find qos */
-    qos_uuid = virNetDevOpenvswitchFindUUID("qos", vmid_ex_id, ifname_ex_id);
+    virNetDevOpenvswitchFindQos(ifname, vmid_ex_id, ifname_ex_id,
+                                &queues, &qoses);
 
     /* create qos and set */
     cmd = virNetDevOpenvswitchCreateCmd();
-    if (queue_uuid && *queue_uuid) {
-        g_auto(GStrv) lines = g_strsplit(queue_uuid, "\n", 0);
-        virCommandAddArgList(cmd, "set", "queue", lines[0], NULL);
+    if (queues[0]) {
+        virCommandAddArgList(cmd, "set", "queue", queues[0], NULL);
     } else {
         virCommandAddArgList(cmd, "set", "port", ifname, "qos=@qos1",
                              vmid_ex_id, ifname_ex_id,
@@ -803,8 +841,22 @@ virNetDevOpenvswitchInterfaceSetTxQos(const char *ifname,
         virCommandAddArgFormat(cmd, "other_config:max-rate=%s", peak);
     }
     virCommandAddArgList(cmd, vmid_ex_id, ifname_ex_id, NULL);
+
+    /* update the existing qos within the same transaction */
+    if (qoses[0]) {
+        virCommandAddArgList(cmd, "--", "set", "qos", qoses[0], NULL);
+        virCommandAddArgFormat(cmd, "other_config:min-rate=%s", average);
+        if (burst) {
+            virCommandAddArgFormat(cmd, "other_config:burst=%s", burst);
+        }
+        if (peak) {
+            virCommandAddArgFormat(cmd, "other_config:max-rate=%s", peak);
+        }
+        virCommandAddArgList(cmd, vmid_ex_id, ifname_ex_id, NULL);
+    }
+
     if (virCommandRun(cmd, NULL) < 0) {
-        if (queue_uuid && *queue_uuid) {
+        if (queues[0]) {
             virReportError(VIR_ERR_INTERNAL_ERROR,
                            _("Unable to set queue configuration on port %s"), ifname);
         } else {
@@ -814,26 +866,6 @@ virNetDevOpenvswitchInterfaceSetTxQos(const char *ifname,
         return -1;
     }
 
-    if (qos_uuid && *qos_uuid) {
-        g_auto(GStrv) lines = g_strsplit(qos_uuid, "\n", 0);
-        g_autoptr(virCommand) qoscmd = virNetDevOpenvswitchCreateCmd();
-
-        virCommandAddArgList(qoscmd, "set", "qos", lines[0], NULL);
-        virCommandAddArgFormat(qoscmd, "other_config:min-rate=%s", average);
-        if (burst) {
-            virCommandAddArgFormat(qoscmd, "other_config:burst=%s", burst);
-        }
-        if (peak) {
-            virCommandAddArgFormat(qoscmd, "other_config:max-rate=%s", peak);
-        }
-        virCommandAddArgList(qoscmd, vmid_ex_id, ifname_ex_id, NULL);
-        if (virCommandRun(qoscmd, NULL) < 0) {
-            virReportError(VIR_ERR_INTERNAL_ERROR,
-                           _("Unable to set qos configuration on port %s"), ifname);
-            return -1;
-        }
-    }
-
     return 0;
 }
 
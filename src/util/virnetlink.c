@@ -128,6 +128,16 @@ static int nextWatch = 1;
 static virNetlinkEventSrvPrivate *server[MAX_LINKS] = {NULL};
 static virNetlinkHandle *placeholder_nlhandle;
 
+/* Every thread keeps its rtnetlink socket around for reuse by later
+ * requests, saving the creation and binding of a new socket each time. */
+typedef struct _virNetlinkThreadSocket virNetlinkThreadSocket;
+struct _virNetlinkThreadSocket {
+    pid_t pid; /* process the socket was created in */
+    virNetlinkHandle *nlhandle;
+};
+
+static virThreadLocal virNetlinkRouteSocket;
+
 /* Function definitions */
 
 struct nl_msg *
@@ -242,6 +252,112 @@ virNetlinkCreateSocket(int protocol)
     return NULL;
 }
 
+static void
+virNetlinkThreadSocketFree(void *opaque)
+{
+    virNetlinkThreadSocket *sock = opaque;
+
+    if (!sock)
+        return;
+
+    virNetlinkFree(sock->nlhandle);
+    g_free(sock);
+}
+
+
+static int
+virNetlinkOnceInit(void)
+{
+    if (virThreadLocalInit(&virNetlinkRouteSocket,
+                           virNetlinkThreadSocketFree) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("cannot initialize thread local for netlink socket"));
+        return -1;
+    }
+
+    return 0;
+}
+
+VIR_ONCE_GLOBAL_INIT(virNetlink);
+
+
+/**
+ * virNetlinkGetThreadSocket:
+ *
+ * Returns the rtnetlink socket of the calling thread, creating it if
+ * needed, or NULL on failure. Any messages left unread on the socket by
+ * a previous request (e.g. the rest of a dump) are discarded.
+ */
+static virNetlinkHandle *
+virNetlinkGetThreadSocket(void)
+{
+    virNetlinkThreadSocket *sock;
+    char c;
+
+    if (virNetlinkInitialize() < 0)
+        return NULL;
+
+    if (!(sock = virThreadLocalGet(&virNetlinkRouteSocket))) {
+        sock = g_new0(virNetlinkThreadSocket, 1);
+        if (virThreadLocalSet(&virNetlinkRouteSocket, sock) < 0) {
+            virReportSystemError(errno, "%s",
+                                 _("cannot set thread local netlink socket"));
+            g_free(sock);
+            return NULL;
+        }
+    }
+
+    /* A forked child must not share the socket with its parent */
+    if (sock->nlhandle && sock->pid != getpid())
+        g_clear_pointer(&sock->nlhandle, virNetlinkFree);
+
+    if (!sock->nlhandle) {
+        if (!(sock->nlhandle = virNetlinkCreateSocket(NETLINK_ROUTE)))
+            return NULL;
+        sock->pid = getpid();
+        return sock->nlhandle;
+    }
+
+    /* recv() consumes a whole message regardless of the buffer size */
+    while (recv(nl_socket_get_fd(sock->nlhandle), &c, sizeof(c),
+                MSG_DONTWAIT | MSG_TRUNC) >= 0)
+        ;
+
+    return sock->nlhandle;
+}
+
+
+/**
+ * virNetlinkReleaseSocket:
+ * @nlhandle: socket returned by virNetlinkSendRequest()
+ * @failed: whether the request failed
+ *
+ * Frees @nlhandle unless it is the calling thread's rtnetlink socket. That
+ * one is kept for the next request, unless the request failed midway in
+ * which case the state of the socket can't be trusted anymore.
+ */
+static void
+virNetlinkReleaseSocket(virNetlinkHandle *nlhandle,
+                        bool failed)
+{
+    virNetlinkThreadSocket *sock = NULL;
+
+    if (!nlhandle)
+        return;
+
+    if (virNetlinkInitialize() == 0)
+        sock = virThreadLocalGet(&virNetlinkRouteSocket);
+
+    if (!sock || sock->nlhandle != nlhandle) {
+        virNetlinkFree(nlhandle);
+        return;
+    }
+
+    if (failed)
+        g_clear_pointer(&sock->nlhandle, virNetlinkFree);
+}
+
+
 static virNetlinkHandle *
 virNetlinkSendRequest(struct nl_msg *nl_msg, uint32_t src_pid,
                       struct sockaddr_nl nladdr,
@@ -260,7 +376,13 @@ virNetlinkSendRequest(struct nl_msg *nl_msg, uint32_t src_pid,
         goto error;
     }
 
-    if (!(nlhandle = virNetlinkCreateSocket(protocol)))
+    /* Sockets joining multicast groups are not worth keeping */
+    if (protocol == NETLINK_ROUTE && !groups)
+        nlhandle = virNetlinkGetThreadSocket();
+    else
+        nlhandle = virNetlinkCreateSocket(protocol);
+
+    if (!nlhandle)
         goto error;
 
     fd = nl_socket_get_fd(nlhandle);
@@ -305,7 +427,7 @@ virNetlinkSendRequest(struct nl_msg *nl_msg, uint32_t src_pid,
     return nlhandle;
 
  error:
-    virNetlinkFree(nlhandle);
+    virNetlinkReleaseSocket(nlhandle, true);
     return NULL;
 }
 
@@ -336,7 +458,7 @@ int virNetlinkCommand(struct nl_msg *nl_msg,
     };
     struct pollfd fds[1];
     g_autofree struct nlmsghdr *temp_resp = NULL;
-    g_autoptr(virNetlinkHandle) nlhandle = NULL;
+    virNetlinkHandle *nlhandle = NULL;
     int len = 0;
 
     memset(fds, 0, sizeof(fds));
@@ -349,13 +471,17 @@ int virNetlinkCommand(struct nl_msg *nl_msg,
     if (len == 0) {
         virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                        _("nl_recv failed - returned 0 bytes"));
+        virNetlinkReleaseSocket(nlhandle, true);
         return -1;
     }
     if (len < 0) {
         virReportSystemError(errno, "%s", _("nl_recv failed"));
+        virNetlinkReleaseSocket(nlhandle, true);
         return -1;
     }
 
+    virNetlinkReleaseSocket(nlhandle, false);
+
     *resp = g_steal_pointer(&temp_resp);
     *respbuflen = len;
     return 0;
@@ -453,7 +579,7 @@ virNetlinkDumpCommand(struct nl_msg *nl_msg,
             .nl_pid    = dst_pid,
             .nl_groups = 0,
     };
-    g_autoptr(virNetlinkHandle) nlhandle = NULL;
+    virNetlinkHandle *nlhandle = NULL;
 
     if (!(nlhandle = virNetlinkSendRequest(nl_msg, src_pid, nladdr,
                                            protocol, groups)))
@@ -469,14 +595,15 @@ virNetlinkDumpCommand(struct nl_msg *nl_msg,
             if (msg->nlmsg_type == NLMSG_DONE)
                 end = true;
 
-            if (virNetlinkGetErrorCode(msg, len) < 0)
-                return -1;
-
-            if (callback(msg, opaque) < 0)
+            if (virNetlinkGetErrorCode(msg, len) < 0 ||
+                callback(msg, opaque) < 0) {
+                virNetlinkReleaseSocket(nlhandle, true);
                 return -1;
+            }
         }
     }
 
+    virNetlinkReleaseSocket(nlhandle, false);
     return 0;
 }
 
@@ -72,6 +72,11 @@ static virClass *virObjectClassImpl;
 static virClass *virObjectLockableClass;
 static virClass *virObjectRWLockableClass;
 
+/* The GTypes of the above classes, resolved once so that checking the
+ * type of an object on the hot paths takes a single GType lookup */
+static GType virObjectLockableType;
+static GType virObjectRWLockableType;
+
 static void virObjectLockableDispose(void *anyobj);
 static void virObjectRWLockableDispose(void *anyobj);
 
@@ -91,6 +96,9 @@ virObjectOnceInit(void)
     if (!VIR_CLASS_NEW(virObjectRWLockable, virObjectClassImpl))
         return -1;
 
+    virObjectLockableType = virObjectLockableClass->type;
+    virObjectRWLockableType = virObjectRWLockableClass->type;
+
     return 0;
 }
 
@@ -407,7 +415,8 @@ virObjectRef(void *anyobj)
 static virObjectLockable *
 virObjectGetLockableObj(void *anyobj)
 {
-    if (virObjectIsClass(anyobj, virObjectLockableClass))
+    if (anyobj && virObjectLockableType &&
+        G_TYPE_CHECK_INSTANCE_TYPE(anyobj, virObjectLockableType))
         return anyobj;
 
     VIR_OBJECT_USAGE_PRINT_WARNING(anyobj, virObjectLockable);
@@ -418,7 +427,8 @@ virObjectGetLockableObj(void *anyobj)
 static virObjectRWLockable *
 virObjectGetRWLockableObj(void *anyobj)
 {
-    if (virObjectIsClass(anyobj, virObjectRWLockableClass))
+    if (anyobj && virObjectRWLockableType &&
+        G_TYPE_CHECK_INSTANCE_TYPE(anyobj, virObjectRWLockableType))
         return anyobj;
 
     VIR_OBJECT_USAGE_PRINT_WARNING(anyobj, virObjectRWLockable);
@@ -568,7 +578,9 @@ virObjectRWUnlock(void *anyobj)
  * @klass: the class to check
  *
  * Checks whether @anyobj is an instance of
- * @klass
+ * @klass. Since the GType hierarchy mirrors the one of
+ * the classes, this is a single GType check rather than
+ * a walk over the parents of the class of @anyobj.
  *
  * Returns true if @anyobj is an instance of @klass
  */
@@ -576,14 +588,10 @@ bool
 virObjectIsClass(void *anyobj,
                  virClass *klass)
 {
-    virObject *obj = anyobj;
-    virObjectPrivate *priv;
-
-    if (VIR_OBJECT_NOTVALID(obj))
+    if (!anyobj)
         return false;
 
-    priv = vir_object_get_instance_private(obj);
-    return virClassIsDerivedFrom(priv->klass, klass);
+    return G_TYPE_CHECK_INSTANCE_TYPE(anyobj, klass->type);
 }
 
 
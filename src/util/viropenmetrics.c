@@ -0,0 +1,384 @@
+/*
+ * viropenmetrics.c: formatting of metrics in the OpenMetrics text format
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <config.h>
+
+#include <math.h>
+
+#include "viropenmetrics.h"
+#include "viralloc.h"
+#include "virbuffer.h"
+#include "virhash.h"
+#include "virstring.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+VIR_ENUM_IMPL(virOpenMetrics,
+              VIR_OPEN_METRICS_LAST,
+              "unknown",
+              "gauge",
+              "counter",
+              "histogram",
+);
+
+typedef struct _virOpenMetricsFamily virOpenMetricsFamily;
+struct _virOpenMetricsFamily {
+    char *name;
+    virOpenMetricsType type;
+    char *help;
+    virBuffer samples;
+};
+
+struct _virOpenMetrics {
+    /* Families in the order they were declared, the hash table is just
+     * an index of them by name */
+    virOpenMetricsFamily **families;
+    size_t nfamilies;
+    GHashTable *byName;
+};
+
+
+virOpenMetrics *
+virOpenMetricsNew(void)
+{
+    virOpenMetrics *metrics = g_new0(virOpenMetrics, 1);
+
+    metrics->byName = virHashNew(NULL);
+
+    return metrics;
+}
+
+
+void
+virOpenMetricsFree(virOpenMetrics *metrics)
+{
+    size_t i;
+
+    if (!metrics)
+        return;
+
+    for (i = 0; i < metrics->nfamilies; i++) {
+        g_free(metrics->families[i]->name);
+        g_free(metrics->families[i]->help);
+        virBufferFreeAndReset(&metrics->families[i]->samples);
+        g_free(metrics->families[i]);
+    }
+    g_free(metrics->families);
+    g_clear_pointer(&metrics->byName, g_hash_table_unref);
+    g_free(metrics);
+}
+
+
+/**
+ * virOpenMetricsSanitizeName:
+ * @name: name of a metric or label
+ *
+ * Returns a copy of @name with all characters not allowed in names of
+ * metrics and labels replaced by underscores.
+ */
+char *
+virOpenMetricsSanitizeName(const char *name)
+{
+    g_autofree char *ret = NULL;
+    char *p;
+
+    if (g_ascii_isdigit(*name))
+        ret = g_strdup_printf("_%s", name);
+    else
+        ret = g_strdup(name);
+
+    for (p = ret; *p; p++) {
+        if (!g_ascii_isalnum(*p) && *p != '_')
+            *p = '_';
+    }
+
+    return g_steal_pointer(&ret);
+}
+
+
+static virOpenMetricsFamily *
+virOpenMetricsGetFamily(virOpenMetrics *metrics,
+                        const char *name,
+                        virOpenMetricsType type,
+                        const char *help)
+{
+    virOpenMetricsFamily *family;
+
+    if ((family = virHashLookup(metrics->byName, name)))
+        return family;
+
+    family = g_new0(virOpenMetricsFamily, 1);
+    family->name = g_strdup(name);
+    family->type = type;
+    family->help = g_strdup(help);
+
+    ignore_value(virHashAddEntry(metrics->byName, name, family));
+    VIR_APPEND_ELEMENT(metrics->families, metrics->nfamilies, family);
+
+    return metrics->families[metrics->nfamilies - 1];
+}
+
+
+/**
+ * virOpenMetricsDeclare:
+ * @metrics: metrics
+ * @name: name of the metric family
+ * @type: type of the metric family
+ * @help: description of the metric family, or NULL
+ *
+ * Declares a family of metrics. There's no need to declare families of
+ * unknown type, they are created on first use. Declaring an existing
+ * family has no effect.
+ */
+void
+virOpenMetricsDeclare(virOpenMetrics *metrics,
+                      const char *name,
+                      virOpenMetricsType type,
+                      const char *help)
+{
+    ignore_value(virOpenMetricsGetFamily(metrics, name, type, help));
+}
+
+
+static void
+virOpenMetricsEscape(virBuffer *buf,
+                     const char *str)
+{
+    for (; *str; str++) {
+        switch (*str) {
+        case '\\':
+            virBufferAddLit(buf, "\\\\");
+            break;
+        case '"':
+            virBufferAddLit(buf, "\\\"");
+            break;
+        case '\n':
+            virBufferAddLit(buf, "\\n");
+            break;
+        default:
+            virBufferAddChar(buf, *str);
+        }
+    }
+}
+
+
+static void
+virOpenMetricsFormatDouble(virBuffer *buf,
+                           double value)
+{
+    g_autofree char *str = NULL;
+
+    if (isnan(value)) {
+        virBufferAddLit(buf, "NaN");
+    } else if (isinf(value)) {
+        virBufferAdd(buf, value > 0 ? "+Inf" : "-Inf", -1);
+    } else {
+        ignore_value(virDoubleToStr(&str, value));
+        virBufferAdd(buf, str, -1);
+    }
+}
+
+
+static void
+virOpenMetricsFormatSampleName(virBuffer *buf,
+                               virOpenMetricsFamily *family,
+                               const char *suffix,
+                               const virOpenMetricsLabel *labels,
+                               size_t nlabels,
+                               const char *le)
+{
+    size_t i;
+
+    virBufferAsprintf(buf, "%s%s", family->name, suffix);
+
+    if (nlabels == 0 && !le) {
+        virBufferAddChar(buf, ' ');
+        return;
+    }
+
+    virBufferAddChar(buf, '{');
+    for (i = 0; i < nlabels; i++) {
+        if (i > 0)
+            virBufferAddChar(buf, ',');
+        virBufferAsprintf(buf, "%s=\"", labels[i].name);
+        virOpenMetricsEscape(buf, labels[i].value);
+        virBufferAddChar(buf, '"');
+    }
+    if (le)
+        virBufferAsprintf(buf, "%sle=\"%s\"", nlabels ? "," : "", le);
+    virBufferAddLit(buf, "} ");
+}
+
+
+static const char *
+virOpenMetricsSampleSuffix(virOpenMetricsFamily *family)
+{
+    return family->type == VIR_OPEN_METRICS_COUNTER ? "_total" : "";
+}
+
+
+/**
+ * virOpenMetricsAddULLong:
+ * @metrics: metrics
+ * @name: name of the metric family
+ * @labels: labels of the sample
+ * @nlabels: number of @labels
+ * @value: value of the sample
+ *
+ * Adds a sample to a gauge, counter or unknown metric family.
+ */
+void
+virOpenMetricsAddULLong(virOpenMetrics *metrics,
+                        const char *name,
+                        const virOpenMetricsLabel *labels,
+                        size_t nlabels,
+                        unsigned long long value)
+{
+    virOpenMetricsFamily *family;
+
+    family = virOpenMetricsGetFamily(metrics, name, VIR_OPEN_METRICS_UNKNOWN, NULL);
+
+    virOpenMetricsFormatSampleName(&family->samples, family,
+                                   virOpenMetricsSampleSuffix(family),
+                                   labels, nlabels, NULL);
+    virBufferAsprintf(&family->samples, "%llu\n", value);
+}
+
+
+/**
+ * virOpenMetricsAddDouble:
+ * @metrics: metrics
+ * @name: name of the metric family
+ * @labels: labels of the sample
+ * @nlabels: number of @labels
+ * @value: value of the sample
+ *
+ * Adds a sample to a gauge, counter or unknown metric family.
+ */
+void
+virOpenMetricsAddDouble(virOpenMetrics *metrics,
+                        const char *name,
+                        const virOpenMetricsLabel *labels,
+                        size_t nlabels,
+                        double value)
+{
+    virOpenMetricsFamily *family;
+
+    family = virOpenMetricsGetFamily(metrics, name, VIR_OPEN_METRICS_UNKNOWN, NULL);
+
+    virOpenMetricsFormatSampleName(&family->samples, family,
+                                   virOpenMetricsSampleSuffix(family),
+                                   labels, nlabels, NULL);
+    virOpenMetricsFormatDouble(&family->samples, value);
+    virBufferAddChar(&family->samples, '\n');
+}
+
+
+/**
+ * virOpenMetricsAddHistogram:
+ * @metrics: metrics
+ * @name: name of the metric family
+ * @labels: labels of the histogram
+ * @nlabels: number of @labels
+ * @bounds: upper bounds of all the buckets but the last one
+ * @counts: number of observations in each bucket, not cumulative
+ * @nbuckets: number of buckets, one more than the elements of @bounds
+ * @sum: sum of all the observations
+ *
+ * Adds a histogram to a histogram metric family, which is declared if it
+ * doesn't exist yet. The last bucket has no upper bound.
+ */
+void
+virOpenMetricsAddHistogram(virOpenMetrics *metrics,
+                           const char *name,
+                           const virOpenMetricsLabel *labels,
+                           size_t nlabels,
+                           const double *bounds,
+                           const unsigned long long *counts,
+                           size_t nbuckets,
+                           double sum)
+{
+    virOpenMetricsFamily *family;
+    unsigned long long count = 0;
+    size_t i;
+
+    family = virOpenMetricsGetFamily(metrics, name, VIR_OPEN_METRICS_HISTOGRAM, NULL);
+
+    for (i = 0; i < nbuckets; i++) {
+        g_auto(virBuffer) le = VIR_BUFFER_INITIALIZER;
+
+        count += counts[i];
+
+        if (i < nbuckets - 1)
+            virOpenMetricsFormatDouble(&le, bounds[i]);
+        else
+            virBufferAddLit(&le, "+Inf");
+
+        virOpenMetricsFormatSampleName(&family->samples, family, "_bucket",
+                                       labels, nlabels,
+                                       virBufferCurrentContent(&le));
+        virBufferAsprintf(&family->samples, "%llu\n", count);
+    }
+
+    virOpenMetricsFormatSampleName(&family->samples, family, "_count",
+                                   labels, nlabels, NULL);
+    virBufferAsprintf(&family->samples, "%llu\n", count);
+
+    virOpenMetricsFormatSampleName(&family->samples, family, "_sum",
+                                   labels, nlabels, NULL);
+    virOpenMetricsFormatDouble(&family->samples, sum);
+    virBufferAddChar(&family->samples, '\n');
+}
+
+
+/**
+ * virOpenMetricsFormat:
+ * @metrics: metrics
+ *
+ * Formats all the metric families with at least one sample into an
+ * OpenMetrics exposition, including the terminating "# EOF" line.
+ *
+ * Returns the exposition, which the caller must free.
+ */
+char *
+virOpenMetricsFormat(virOpenMetrics *metrics)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    size_t i;
+
+    for (i = 0; i < metrics->nfamilies; i++) {
+        virOpenMetricsFamily *family = metrics->families[i];
+
+        if (virBufferUse(&family->samples) == 0)
+            continue;
+
+        virBufferAsprintf(&buf, "# TYPE %s %s\n", family->name,
+                          virOpenMetricsTypeToString(family->type));
+        if (family->help) {
+            virBufferAsprintf(&buf, "# HELP %s ", family->name);
+            virOpenMetricsEscape(&buf, family->help);
+            virBufferAddChar(&buf, '\n');
+        }
+        virBufferAdd(&buf, virBufferCurrentContent(&family->samples), -1);
+    }
+
+    virBufferAddLit(&buf, "# EOF\n");
+
+    return virBufferContentAndReset(&buf);
+}
@@ -0,0 +1,77 @@
+/*
+ * viropenmetrics.h: formatting of metrics in the OpenMetrics text format
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include "internal.h"
+#include "virenum.h"
+
+#define VIR_OPEN_METRICS_CONTENT_TYPE \
+    "application/openmetrics-text; version=1.0.0; charset=utf-8"
+
+typedef enum {
+    VIR_OPEN_METRICS_UNKNOWN = 0,
+    VIR_OPEN_METRICS_GAUGE,
+    VIR_OPEN_METRICS_COUNTER,
+    VIR_OPEN_METRICS_HISTOGRAM,
+
+    VIR_OPEN_METRICS_LAST
+} virOpenMetricsType;
+
+VIR_ENUM_DECL(virOpenMetrics);
+
+typedef struct _virOpenMetricsLabel virOpenMetricsLabel;
+struct _virOpenMetricsLabel {
+    const char *name;
+    const char *value;
+};
+
+typedef struct _virOpenMetrics virOpenMetrics;
+
+virOpenMetrics *virOpenMetricsNew(void);
+void virOpenMetricsFree(virOpenMetrics *metrics);
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(virOpenMetrics, virOpenMetricsFree);
+
+char *virOpenMetricsSanitizeName(const char *name);
+
+void virOpenMetricsDeclare(virOpenMetrics *metrics,
+                           const char *name,
+                           virOpenMetricsType type,
+                           const char *help);
+
+void virOpenMetricsAddULLong(virOpenMetrics *metrics,
+                             const char *name,
+                             const virOpenMetricsLabel *labels,
+                             size_t nlabels,
+                             unsigned long long value);
+void virOpenMetricsAddDouble(virOpenMetrics *metrics,
+                             const char *name,
+                             const virOpenMetricsLabel *labels,
+                             size_t nlabels,
+                             double value);
+void virOpenMetricsAddHistogram(virOpenMetrics *metrics,
+                                const char *name,
+                                const virOpenMetricsLabel *labels,
+                                size_t nlabels,
+                                const double *bounds,
+                                const unsigned long long *counts,
+                                size_t nbuckets,
+                                double sum);
+
+char *virOpenMetricsFormat(virOpenMetrics *metrics);
@@ -101,6 +101,7 @@ struct _virPCIDeviceList {
 
     size_t count;
     virPCIDevice **devs;
+    GHashTable *index; /* &dev->address -> dev, for each of @devs */
 };
 
 
@@ -1645,6 +1646,24 @@ virPCIDeviceGetUsedBy(virPCIDevice *dev,
     *dom_name = dev->used_by_domname;
 }
 
+static guint
+virPCIDeviceAddressHash(const void *key)
+{
+    const virPCIDeviceAddress *addr = key;
+
+    return (addr->domain << 16) ^ (addr->bus << 8) ^
+           (addr->slot << 3) ^ addr->function;
+}
+
+
+static gboolean
+virPCIDeviceAddressHashEqual(const void *a,
+                             const void *b)
+{
+    return virPCIDeviceAddressEqual(a, b);
+}
+
+
 virPCIDeviceList *
 virPCIDeviceListNew(void)
 {
@@ -1656,6 +1675,12 @@ virPCIDeviceListNew(void)
     if (!(list = virObjectLockableNew(virPCIDeviceListClass)))
         return NULL;
 
+    /* Hosts can have hundreds of assignable devices and the lists are
+     * searched for each of them when checking for conflicts, so keep an
+     * index by address next to the array which preserves their order. */
+    list->index = g_hash_table_new(virPCIDeviceAddressHash,
+                                   virPCIDeviceAddressHashEqual);
+
     return list;
 }
 
@@ -1671,6 +1696,7 @@ virPCIDeviceListDispose(void *obj)
 
     list->count = 0;
     g_free(list->devs);
+    g_clear_pointer(&list->index, g_hash_table_unref);
 }
 
 int
@@ -1682,6 +1708,7 @@ virPCIDeviceListAdd(virPCIDeviceList *list,
                        _("Device %s is already in use"), dev->name);
         return -1;
     }
+    g_hash_table_insert(list->index, &dev->address, dev);
     VIR_APPEND_ELEMENT(list->devs, list->count, dev);
 
     return 0;
@@ -1732,6 +1759,7 @@ virPCIDeviceListStealIndex(virPCIDeviceList *list,
         return NULL;
 
     ret = list->devs[idx];
+    g_hash_table_remove(list->index, &ret->address);
     VIR_DELETE_ELEMENT(list->devs, idx, list->count);
     return ret;
 }
@@ -1754,14 +1782,14 @@ int
 virPCIDeviceListFindIndex(virPCIDeviceList *list,
                           virPCIDeviceAddress *devAddr)
 {
+    virPCIDevice *dev;
     size_t i;
 
+    if (!(dev = g_hash_table_lookup(list->index, devAddr)))
+        return -1;
+
     for (i = 0; i < list->count; i++) {
-        virPCIDevice *other = list->devs[i];
-        if (other->address.domain   == devAddr->domain &&
-            other->address.bus      == devAddr->bus    &&
-            other->address.slot     == devAddr->slot   &&
-            other->address.function == devAddr->function)
+        if (list->devs[i] == dev)
             return i;
     }
     return -1;
@@ -1775,29 +1803,17 @@ virPCIDeviceListFindByIDs(virPCIDeviceList *list,
                           unsigned int slot,
                           unsigned int function)
 {
-    size_t i;
+    virPCIDeviceAddress devAddr = { .domain = domain, .bus = bus,
+                                    .slot = slot, .function = function };
 
-    for (i = 0; i < list->count; i++) {
-        virPCIDevice *other = list->devs[i];
-        if (other->address.domain   == domain &&
-            other->address.bus      == bus    &&
-            other->address.slot     == slot   &&
-            other->address.function == function)
-            return list->devs[i];
-    }
-    return NULL;
+    return g_hash_table_lookup(list->index, &devAddr);
 }
 
 
 virPCIDevice *
 virPCIDeviceListFind(virPCIDeviceList *list, virPCIDeviceAddress *devAddr)
 {
-    int idx;
-
-    if ((idx = virPCIDeviceListFindIndex(list, devAddr)) >= 0)
-        return list->devs[idx];
-    else
-        return NULL;
+    return g_hash_table_lookup(list->index, devAddr);
 }
 
 
@@ -1841,6 +1857,115 @@ int virPCIDeviceFileIterate(virPCIDevice *dev,
 }
 
 
+/*
+ * Reading the members of an IOMMU group means walking a sysfs directory,
+ * which is done over and over for the same devices e.g. whenever host
+ * devices are prepared for a domain. The members of a group can only
+ * change when PCI devices are added or removed from the host, therefore
+ * a process which watches for such events (i.e. the nodedev driver) can
+ * enable a cache of them and invalidate it as needed.
+ */
+typedef struct _virPCIIOMMUGroupCacheEntry virPCIIOMMUGroupCacheEntry;
+struct _virPCIIOMMUGroupCacheEntry {
+    virPCIDeviceAddress *addrs;
+    size_t naddrs;
+};
+
+static virMutex virPCITopologyCacheLock = VIR_MUTEX_INITIALIZER;
+static GHashTable *virPCIIOMMUGroupCache; /* device address -> members */
+
+
+static void
+virPCIIOMMUGroupCacheEntryFree(void *opaque)
+{
+    virPCIIOMMUGroupCacheEntry *entry = opaque;
+
+    g_free(entry->addrs);
+    g_free(entry);
+}
+
+
+/**
+ * virPCITopologyCacheSetEnabled:
+ * @enabled: whether to cache the PCI topology
+ *
+ * Enable or disable caching of the PCI device topology read from sysfs.
+ * The caller is responsible for calling virPCITopologyCacheInvalidate()
+ * whenever a PCI device is added or removed from the host while the cache
+ * is enabled.
+ */
+void
+virPCITopologyCacheSetEnabled(bool enabled)
+{
+    VIR_LOCK_GUARD lock = virLockGuardLock(&virPCITopologyCacheLock);
+
+    if (!enabled) {
+        g_clear_pointer(&virPCIIOMMUGroupCache, g_hash_table_unref);
+        return;
+    }
+
+    if (!virPCIIOMMUGroupCache)
+        virPCIIOMMUGroupCache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                                      virPCIIOMMUGroupCacheEntryFree);
+}
+
+
+/**
+ * virPCITopologyCacheInvalidate:
+ *
+ * Drop everything cached about the PCI device topology, to be called
+ * after a PCI device was added or removed from the host.
+ */
+void
+virPCITopologyCacheInvalidate(void)
+{
+    VIR_LOCK_GUARD lock = virLockGuardLock(&virPCITopologyCacheLock);
+
+    if (virPCIIOMMUGroupCache)
+        g_hash_table_remove_all(virPCIIOMMUGroupCache);
+}
+
+
+static virPCIDeviceAddress *
+virPCIIOMMUGroupCacheLookup(const char *devName,
+                            size_t *naddrs)
+{
+    VIR_LOCK_GUARD lock = virLockGuardLock(&virPCITopologyCacheLock);
+    virPCIIOMMUGroupCacheEntry *entry;
+    virPCIDeviceAddress *addrs;
+
+    if (!virPCIIOMMUGroupCache ||
+        !(entry = g_hash_table_lookup(virPCIIOMMUGroupCache, devName)))
+        return NULL;
+
+    addrs = g_new0(virPCIDeviceAddress, entry->naddrs);
+    memcpy(addrs, entry->addrs, entry->naddrs * sizeof(*addrs));
+    *naddrs = entry->naddrs;
+
+    return addrs;
+}
+
+
+static void
+virPCIIOMMUGroupCacheStore(const char *devName,
+                           const virPCIDeviceAddress *addrs,
+                           size_t naddrs)
+{
+    VIR_LOCK_GUARD lock = virLockGuardLock(&virPCITopologyCacheLock);
+    virPCIIOMMUGroupCacheEntry *entry;
+
+    if (!virPCIIOMMUGroupCache)
+        return;
+
+    entry = g_new0(virPCIIOMMUGroupCacheEntry, 1);
+    entry->addrs = g_new0(virPCIDeviceAddress, naddrs);
+    memcpy(entry->addrs, addrs, naddrs * sizeof(*addrs));
+    entry->naddrs = naddrs;
+
+    g_hash_table_insert(virPCIIOMMUGroupCache, g_strdup(devName), entry);
+}
+
+
 /* virPCIDeviceAddressIOMMUGroupIterate:
  *   Call @actor for all devices in the same iommu_group as orig
  *   (including orig itself) Even if there is no iommu_group for the
@@ -1851,34 +1976,47 @@ virPCIDeviceAddressIOMMUGroupIterate(virPCIDeviceAddress *orig,
                                      virPCIDeviceAddressActor actor,
                                      void *opaque)
 {
+    g_autofree char *devName = virPCIDeviceAddressAsString(orig);
     g_autofree char *groupPath = NULL;
-    g_autoptr(DIR) groupDir = NULL;
-    struct dirent *ent;
-    int direrr;
+    g_autofree virPCIDeviceAddress *addrs = NULL;
+    size_t naddrs = 0;
+    size_t i;
 
-    groupPath = g_strdup_printf(PCI_SYSFS "devices/" VIR_PCI_DEVICE_ADDRESS_FMT "/iommu_group/devices",
-                                orig->domain, orig->bus, orig->slot, orig->function);
+    if (!(addrs = virPCIIOMMUGroupCacheLookup(devName, &naddrs))) {
+        g_autoptr(DIR) groupDir = NULL;
+        struct dirent *ent;
+        int direrr;
 
-    if (virDirOpenQuiet(&groupDir, groupPath) < 0) {
-        /* just process the original device, nothing more */
-        return (actor)(orig, opaque);
-    }
+        groupPath = g_strdup_printf(PCI_SYSFS "devices/%s/iommu_group/devices",
+                                    devName);
 
-    while ((direrr = virDirRead(groupDir, &ent, groupPath)) > 0) {
-        virPCIDeviceAddress newDev = { 0 };
+        if (virDirOpenQuiet(&groupDir, groupPath) < 0) {
+            /* just process the original device, nothing more */
+            return (actor)(orig, opaque);
+        }
 
-        if (virPCIDeviceAddressParse(ent->d_name, &newDev) < 0) {
-            virReportError(VIR_ERR_INTERNAL_ERROR,
-                           _("Found invalid device link '%s' in '%s'"),
-                           ent->d_name, groupPath);
-            return -1;
+        while ((direrr = virDirRead(groupDir, &ent, groupPath)) > 0) {
+            virPCIDeviceAddress newDev = { 0 };
+
+            if (virPCIDeviceAddressParse(ent->d_name, &newDev) < 0) {
+                virReportError(VIR_ERR_INTERNAL_ERROR,
+                               _("Found invalid device link '%s' in '%s'"),
+                               ent->d_name, groupPath);
+                return -1;
+            }
+
+            VIR_APPEND_ELEMENT(addrs, naddrs, newDev);
         }
+        if (direrr < 0)
+            return -1;
+
+        virPCIIOMMUGroupCacheStore(devName, addrs, naddrs);
+    }
 
-        if ((actor)(&newDev, opaque) < 0)
+    for (i = 0; i < naddrs; i++) {
+        if ((actor)(&addrs[i], opaque) < 0)
             return -1;
     }
-    if (direrr < 0)
-        return -1;
 
     return 0;
 }
@@ -2463,6 +2601,35 @@ virPCIDeviceAddressGetSysfsFile(virPCIDeviceAddress *addr,
     return 0;
 }
 
+/**
+ * virPCIDeviceAddressGetNumaNode:
+ * @addr: PCI address of the device
+ *
+ * Returns the host NUMA node the device is attached to, or -1 if it's not
+ * known.
+ */
+int
+virPCIDeviceAddressGetNumaNode(virPCIDeviceAddress *addr)
+{
+    g_autofree char *path = NULL;
+    g_autofree char *buf = NULL;
+    int node;
+
+    path = g_strdup_printf(PCI_SYSFS "devices/" VIR_PCI_DEVICE_ADDRESS_FMT "/numa_node",
+                           addr->domain, addr->bus, addr->slot, addr->function);
+
+    if (!virFileExists(path) ||
+        virFileReadAllQuiet(path, 16, &buf) < 0)
+        return -1;
+
+    virTrimSpaces(buf, NULL);
+
+    if (virStrToLong_i(buf, NULL, 10, &node) < 0)
+        return -1;
+
+    return node;
+}
+
 /**
  * virPCIGetNetName:
  * @device_link_sysfs_path: sysfs path to the PCI device
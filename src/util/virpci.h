@@ -190,6 +190,9 @@ int virPCIDeviceFileIterate(virPCIDevice *dev,
                             virPCIDeviceFileActor actor,
                             void *opaque);
 
+void virPCITopologyCacheSetEnabled(bool enabled);
+void virPCITopologyCacheInvalidate(void);
+
 typedef int (*virPCIDeviceAddressActor)(virPCIDeviceAddress *addr,
                                         void *opaque);
 int virPCIDeviceAddressIOMMUGroupIterate(virPCIDeviceAddress *orig,
@@ -243,6 +246,8 @@ int virPCIGetVirtualFunctionIndex(const char *pf_sysfs_device_link,
 int virPCIDeviceAddressGetSysfsFile(virPCIDeviceAddress *addr,
                                     char **pci_sysfs_device_link);
 
+int virPCIDeviceAddressGetNumaNode(virPCIDeviceAddress *addr);
+
 int virPCIGetNetName(const char *device_link_sysfs_path,
                      size_t idx,
                      const char *physPortNetDevName,
@@ -54,6 +54,8 @@ VIR_ENUM_IMPL(virPerfEvent,
 struct virPerfEvent {
     int fd;
     bool enabled;
+    bool grouped; /* member of the group of perf->leader */
+    uint64_t id; /* kernel ID of a grouped event */
     union {
         /* cmt */
         struct {
@@ -64,8 +66,29 @@ struct virPerfEvent {
 
 struct _virPerf {
     struct virPerfEvent events[VIR_PERF_EVENT_LAST];
+
+    /* Counting events of the CPU and the kernel are opened as members of a
+     * group led by a dummy event, so that all of them are read at once and
+     * scheduled onto the PMU together. */
+    int leader;
+    pid_t leaderPid;
 };
 
+
+/* Closes the group leader once the group has no members. */
+static void
+virPerfGroupClose(virPerf *perf)
+{
+    size_t i;
+
+    for (i = 0; i < VIR_PERF_EVENT_LAST; i++) {
+        if (perf->events[i].grouped)
+            return;
+    }
+
+    VIR_FORCE_CLOSE(perf->leader);
+}
+
 #if defined(__linux__) && defined(WITH_SYS_SYSCALL_H)
 
 # include <linux/perf_event.h>
@@ -200,6 +223,58 @@ virPerfRdtAttrInit(void)
 }
 
 
+# define VIR_PERF_READ_FORMAT \
+    (PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING | \
+     PERF_FORMAT_GROUP | PERF_FORMAT_ID)
+
+static bool
+virPerfEventIsRdt(virPerfEventType type)
+{
+    return type == VIR_PERF_EVENT_CMT ||
+           type == VIR_PERF_EVENT_MBMT ||
+           type == VIR_PERF_EVENT_MBML;
+}
+
+
+/**
+ * virPerfGroupOpen:
+ * @perf: perf events
+ * @pid: process to count the events of
+ *
+ * Opens the leader of the group of events of @pid unless it's open already.
+ * The leader doesn't count anything by itself.
+ *
+ * Returns 0 on success, -1 if events of @pid can't be grouped.
+ */
+static int
+virPerfGroupOpen(virPerf *perf,
+                 pid_t pid)
+{
+    struct perf_event_attr attr;
+
+    if (perf->leader >= 0)
+        return perf->leaderPid == pid ? 0 : -1;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.inherit = 1;
+    attr.type = PERF_TYPE_SOFTWARE;
+    attr.config = PERF_COUNT_SW_DUMMY;
+    attr.read_format = VIR_PERF_READ_FORMAT;
+
+    perf->leader = syscall(__NR_perf_event_open, &attr, pid, -1, -1, 0);
+    if (perf->leader < 0) {
+        VIR_DEBUG("Unable to open perf event group leader: %s",
+                  g_strerror(errno));
+        return -1;
+    }
+
+    perf->leaderPid = pid;
+    return 0;
+}
+
+
+
 int
 virPerfEventEnable(virPerf *perf,
                    virPerfEventType type,
@@ -212,9 +287,7 @@ virPerfEventEnable(virPerf *perf,
     if (event->enabled)
         return 0;
 
-    if (event_attr->attrType == 0 && (type == VIR_PERF_EVENT_CMT ||
-                                      type == VIR_PERF_EVENT_MBMT ||
-                                      type == VIR_PERF_EVENT_MBML)) {
+    if (event_attr->attrType == 0 && virPerfEventIsRdt(type)) {
         virReportError(VIR_ERR_ARGUMENT_UNSUPPORTED,
                        _("unable to enable host cpu perf event for %s"),
                        virPerfEventTypeToString(type));
@@ -243,7 +316,34 @@ virPerfEventEnable(virPerf *perf,
     attr.type = event_attr->attrType;
     attr.config = event_attr->attrConfig;
 
-    event->fd = syscall(__NR_perf_event_open, &attr, pid, -1, -1, 0);
+    if (!virPerfEventIsRdt(type)) {
+        attr.read_format = VIR_PERF_READ_FORMAT;
+
+        /* The kernel refuses to add an event to a group that could never
+         * be scheduled onto the PMU as a whole, such an event is counted
+         * on its own. */
+        if (virPerfGroupOpen(perf, pid) == 0) {
+            event->fd = syscall(__NR_perf_event_open, &attr, pid, -1,
+                                perf->leader, 0);
+            if (event->fd >= 0 &&
+                ioctl(event->fd, PERF_EVENT_IOC_ID, &event->id) == 0) {
+                event->grouped = true;
+            } else {
+                VIR_DEBUG("Counting perf event %s outside of the group",
+                          virPerfEventTypeToString(type));
+                VIR_FORCE_CLOSE(event->fd);
+            }
+        }
+
+        if (!event->grouped) {
+            virPerfGroupClose(perf);
+            attr.read_format &= ~(PERF_FORMAT_GROUP | PERF_FORMAT_ID);
+        }
+    }
+
+    if (!event->grouped)
+        event->fd = syscall(__NR_perf_event_open, &attr, pid, -1, -1, 0);
+
     if (event->fd < 0) {
         virReportSystemError(errno,
                              _("unable to open host cpu perf event for %s"),
@@ -263,6 +363,8 @@ virPerfEventEnable(virPerf *perf,
 
  error:
     VIR_FORCE_CLOSE(event->fd);
+    event->grouped = false;
+    virPerfGroupClose(perf);
     return -1;
 }
 
@@ -283,7 +385,9 @@ virPerfEventDisable(virPerf *perf,
     }
 
     event->enabled = false;
+    event->grouped = false;
     VIR_FORCE_CLOSE(event->fd);
+    virPerfGroupClose(perf);
     return 0;
 }
 
@@ -293,25 +397,156 @@ bool virPerfEventIsEnabled(virPerf *perf,
     return perf && perf->events[type].enabled;
 }
 
+/* Scales a counter which was not on the PMU all the time it was enabled,
+ * because the PMU was multiplexed between more events than it has
+ * counters. */
+static uint64_t
+virPerfEventScale(uint64_t value,
+                  uint64_t enabled,
+                  uint64_t running)
+{
+    if (running == 0)
+        return 0;
+
+    if (running >= enabled)
+        return value;
+
+    return (uint64_t) ((double) value * enabled / running);
+}
+
+
+static int
+virPerfReadGroup(virPerf *perf,
+                 uint64_t *values)
+{
+    /* nr, time_enabled, time_running, and value and id of every event */
+    uint64_t buf[3 + 2 * (VIR_PERF_EVENT_LAST + 1)];
+    ssize_t len;
+    size_t n;
+    uint64_t nr;
+    size_t i;
+    size_t j;
+
+    if ((len = saferead(perf->leader, buf, sizeof(buf))) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to read perf event group"));
+        return -1;
+    }
+
+    n = len / sizeof(uint64_t);
+    if (n < 3 || (nr = buf[0]) > (n - 3) / 2) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("Truncated read of perf event group"));
+        return -1;
+    }
+
+    for (i = 0; i < nr; i++) {
+        uint64_t value = buf[3 + 2 * i];
+        uint64_t id = buf[3 + 2 * i + 1];
+
+        for (j = 0; j < VIR_PERF_EVENT_LAST; j++) {
+            struct virPerfEvent *event = &perf->events[j];
+
+            if (event->enabled && event->grouped && event->id == id) {
+                values[j] = virPerfEventScale(value, buf[1], buf[2]);
+                break;
+            }
+        }
+    }
+
+    return 0;
+}
+
+
+static int
+virPerfReadOne(virPerf *perf,
+               virPerfEventType type,
+               uint64_t *value)
+{
+    struct virPerfEvent *event = &perf->events[type];
+    uint64_t buf[3];
+
+    if (virPerfEventIsRdt(type)) {
+        if (saferead(event->fd, value, sizeof(uint64_t)) < 0) {
+            virReportSystemError(errno, "%s",
+                                 _("Unable to read cache data"));
+            return -1;
+        }
+
+        if (type == VIR_PERF_EVENT_CMT)
+            *value *= event->efields.cmt.scale;
+
+        return 0;
+    }
+
+    if (saferead(event->fd, buf, sizeof(buf)) < 0) {
+        virReportSystemError(errno,
+                             _("Unable to read perf event %s"),
+                             virPerfEventTypeToString(type));
+        return -1;
+    }
+
+    *value = virPerfEventScale(buf[0], buf[1], buf[2]);
+    return 0;
+}
+
+
+/**
+ * virPerfReadEvents:
+ * @perf: perf events
+ * @values: array of VIR_PERF_EVENT_LAST values
+ *
+ * Reads the counters of all enabled events into @values indexed by
+ * virPerfEventType, the values of disabled events are set to 0. All grouped
+ * events are read by a single read() of the group. Counters of events that
+ * were not scheduled onto the PMU all the time are scaled up to the time
+ * they were enabled.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virPerfReadEvents(virPerf *perf,
+                  uint64_t *values)
+{
+    size_t i;
+
+    memset(values, 0, sizeof(*values) * VIR_PERF_EVENT_LAST);
+
+    if (perf->leader >= 0 &&
+        virPerfReadGroup(perf, values) < 0)
+        return -1;
+
+    for (i = 0; i < VIR_PERF_EVENT_LAST; i++) {
+        if (!perf->events[i].enabled || perf->events[i].grouped)
+            continue;
+
+        if (virPerfReadOne(perf, i, &values[i]) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
 int
 virPerfReadEvent(virPerf *perf,
                  virPerfEventType type,
                  uint64_t *value)
 {
-    struct virPerfEvent *event = &perf->events[type];
-    if (!event->enabled)
-        return -1;
+    uint64_t values[VIR_PERF_EVENT_LAST] = { 0 };
 
-    if (saferead(event->fd, value, sizeof(uint64_t)) < 0) {
-        virReportSystemError(errno, "%s",
-                             _("Unable to read cache data"));
+    if (!perf->events[type].enabled)
         return -1;
-    }
 
-    if (type == VIR_PERF_EVENT_CMT)
-        *value *= event->efields.cmt.scale;
+    if (perf->events[type].grouped) {
+        if (virPerfReadGroup(perf, values) < 0)
+            return -1;
 
-    return 0;
+        *value = values[type];
+        return 0;
+    }
+
+    return virPerfReadOne(perf, type, value);
 }
 
 #else
@@ -358,6 +593,15 @@ virPerfReadEvent(virPerf *perf G_GNUC_UNUSED,
     return -1;
 }
 
+int
+virPerfReadEvents(virPerf *perf G_GNUC_UNUSED,
+                  uint64_t *values G_GNUC_UNUSED)
+{
+    virReportSystemError(ENXIO, "%s",
+                         _("Perf not supported on this platform"));
+    return -1;
+}
+
 #endif
 
 virPerf *
@@ -372,6 +616,7 @@ virPerfNew(void)
         perf->events[i].fd = -1;
         perf->events[i].enabled = false;
     }
+    perf->leader = -1;
 
     if (virPerfRdtAttrInit() < 0)
         virResetLastError();
@@ -392,5 +637,6 @@ virPerfFree(virPerf *perf)
             virPerfEventDisable(perf, i);
     }
 
+    virPerfGroupClose(perf);
     g_free(perf);
 }
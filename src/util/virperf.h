@@ -79,4 +79,7 @@ int virPerfReadEvent(virPerf *perf,
                      virPerfEventType type,
                      uint64_t *value);
 
+int virPerfReadEvents(virPerf *perf,
+                      uint64_t *values);
+
 G_DEFINE_AUTOPTR_CLEANUP_FUNC(virPerf, virPerfFree);
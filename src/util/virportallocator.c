@@ -37,10 +37,18 @@
 
 #define VIR_PORT_ALLOCATOR_NUM_PORTS 65536
 
+/* How long (in microseconds) ports found bound by somebody else are skipped
+ * without trying to bind them again */
+#define VIR_PORT_ALLOCATOR_BUSY_TIMEOUT (30 * G_USEC_PER_SEC)
+
 typedef struct _virPortAllocator virPortAllocator;
 struct _virPortAllocator {
     virObjectLockable parent;
     virBitmap *bitmap;
+
+    /* Ports we failed to bind to, since @busyStamp (monotonic time) */
+    virBitmap *busy;
+    long long busyStamp;
 };
 
 struct _virPortAllocatorRange {
@@ -59,6 +67,7 @@ virPortAllocatorDispose(void *obj)
     virPortAllocator *pa = obj;
 
     virBitmapFree(pa->bitmap);
+    virBitmapFree(pa->busy);
 }
 
 static virPortAllocator *
@@ -70,6 +79,8 @@ virPortAllocatorNew(void)
         return NULL;
 
     pa->bitmap = virBitmapNew(VIR_PORT_ALLOCATOR_NUM_PORTS);
+    pa->busy = virBitmapNew(VIR_PORT_ALLOCATOR_NUM_PORTS);
+    pa->busyStamp = g_get_monotonic_time();
 
     return pa;
 }
@@ -200,11 +211,60 @@ virPortAllocatorGet(void)
     return virPortAllocatorInstance;
 }
 
+/*
+ * Find the first port of @range that is neither reserved nor (if @skipBusy)
+ * known to be bound by somebody else, and reserve it. Failing to find one
+ * isn't an error, @port is left 0 then and @skipped tells whether any busy
+ * port was skipped over.
+ */
+static int
+virPortAllocatorAcquireLocked(virPortAllocator *pa,
+                              const virPortAllocatorRange *range,
+                              bool skipBusy,
+                              bool *skipped,
+                              unsigned short *port)
+{
+    ssize_t i = range->start - 1;
+
+    /* Reserved ports are skipped a bitmap word at a time, so only the ports
+     * that are actually bind-checked cost anything. */
+    while ((i = virBitmapNextClearBit(pa->bitmap, i)) >= 0 &&
+           i <= range->end) {
+        bool used = false, v6used = false;
+
+        if (skipBusy && virBitmapIsBitSet(pa->busy, i)) {
+            *skipped = true;
+            continue;
+        }
+
+        if (virPortAllocatorBindToPort(&v6used, i, AF_INET6) < 0 ||
+            virPortAllocatorBindToPort(&used, i, AF_INET) < 0)
+            return -1;
+
+        if (used || v6used) {
+            ignore_value(virBitmapSetBit(pa->busy, i));
+            continue;
+        }
+
+        ignore_value(virBitmapClearBit(pa->busy, i));
+
+        /* Add port to bitmap of reserved ports */
+        if (virBitmapSetBit(pa->bitmap, i) < 0) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Failed to reserve port %zd"), i);
+            return -1;
+        }
+        *port = i;
+        return 0;
+    }
+
+    return 0;
+}
+
 int
 virPortAllocatorAcquire(const virPortAllocatorRange *range,
                         unsigned short *port)
 {
-    size_t i;
     virPortAllocator *pa = virPortAllocatorGet();
 
     *port = 0;
@@ -213,27 +273,27 @@ virPortAllocatorAcquire(const virPortAllocatorRange *range,
         return -1;
 
     VIR_WITH_OBJECT_LOCK_GUARD(pa) {
-        for (i = range->start; i <= range->end; i++) {
-            bool used = false, v6used = false;
-
-            if (virBitmapIsBitSet(pa->bitmap, i))
-                continue;
-
-            if (virPortAllocatorBindToPort(&v6used, i, AF_INET6) < 0 ||
-                virPortAllocatorBindToPort(&used, i, AF_INET) < 0)
-                return -1;
-
-            if (!used && !v6used) {
-                /* Add port to bitmap of reserved ports */
-                if (virBitmapSetBit(pa->bitmap, i) < 0) {
-                    virReportError(VIR_ERR_INTERNAL_ERROR,
-                                   _("Failed to reserve port %zu"), i);
-                    return -1;
-                }
-                *port = i;
-                return 0;
-            }
+        long long now = g_get_monotonic_time();
+        bool skipped = false;
+
+        /* Ports bound by other processes usually stay bound, so don't try
+         * them on every allocation, but don't trust that forever either. */
+        if (now - pa->busyStamp > VIR_PORT_ALLOCATOR_BUSY_TIMEOUT) {
+            virBitmapClearAll(pa->busy);
+            pa->busyStamp = now;
         }
+
+        if (virPortAllocatorAcquireLocked(pa, range, true, &skipped, port) < 0)
+            return -1;
+
+        /* The range is exhausted without the busy ports, check whether any
+         * of them was freed in the meantime before giving up. */
+        if (*port == 0 && skipped &&
+            virPortAllocatorAcquireLocked(pa, range, false, &skipped, port) < 0)
+            return -1;
+
+        if (*port != 0)
+            return 0;
     }
 
     virReportError(VIR_ERR_INTERNAL_ERROR,
@@ -1656,42 +1656,19 @@ virProcessSetScheduler(pid_t pid G_GNUC_UNUSED,
 #endif /* !WITH_SCHED_SETSCHEDULER */
 
 /*
- * Get all stat fields for a process based on pid and tid:
- * - pid == 0 && tid == 0 => /proc/self/stat
- * - pid != 0 && tid == 0 => /proc/<pid>/stat
- * - pid == 0 && tid != 0 => /proc/self/task/<tid>/stat
- * - pid != 0 && tid != 0 => /proc/<pid>/task/<tid>/stat
- * and return them as array of strings.
+ * Split the contents of a stat file in @buf of @len bytes into its fields.
+ * @buf is modified in place.
  */
-GStrv
-virProcessGetStat(pid_t pid,
-                  pid_t tid)
+static GStrv
+virProcessParseStat(char *buf,
+                    int len)
 {
-    int len = 10 * 1024;  /* 10kB ought to be enough for everyone */
-    g_autofree char *buf = NULL;
-    g_autofree char *path = NULL;
     GStrv rest = NULL;
     GStrv ret = NULL;
     char *comm = NULL;
     char *rparen = NULL;
     size_t nrest = 0;
 
-    if (pid) {
-        if (tid)
-            path = g_strdup_printf("/proc/%d/task/%d/stat", (int)pid, (int)tid);
-        else
-            path = g_strdup_printf("/proc/%d/stat", (int)pid);
-    } else {
-        if (tid)
-            path = g_strdup_printf("/proc/self/task/%d/stat", (int)tid);
-        else
-            path = g_strdup("/proc/self/stat");
-    }
-
-    len = virFileReadAllQuiet(path, len, &buf);
-    if (len < 0)
-        return NULL;
-
     /* eliminate trailing spaces */
     while (len > 0 && g_ascii_isspace(buf[--len]))
            buf[len] = '\0';
@@ -1733,27 +1710,126 @@ virProcessGetStat(pid_t pid,
 }
 
 
+/*
+ * Format the path of the stat file of a process based on pid and tid:
+ * - pid == 0 && tid == 0 => /proc/self/stat
+ * - pid != 0 && tid == 0 => /proc/<pid>/stat
+ * - pid == 0 && tid != 0 => /proc/self/task/<tid>/stat
+ * - pid != 0 && tid != 0 => /proc/<pid>/task/<tid>/stat
+ */
+static void
+virProcessFormatStatPath(char *path,
+                         size_t pathlen,
+                         pid_t pid,
+                         pid_t tid)
+{
+    if (pid) {
+        if (tid)
+            g_snprintf(path, pathlen, "/proc/%d/task/%d/stat", (int)pid, (int)tid);
+        else
+            g_snprintf(path, pathlen, "/proc/%d/stat", (int)pid);
+    } else {
+        if (tid)
+            g_snprintf(path, pathlen, "/proc/self/task/%d/stat", (int)tid);
+        else
+            g_snprintf(path, pathlen, "/proc/self/stat");
+    }
+}
+
+
+/*
+ * Get all stat fields for a process based on pid and tid, see
+ * virProcessFormatStatPath(), and return them as array of strings.
+ */
+GStrv
+virProcessGetStat(pid_t pid,
+                  pid_t tid)
+{
+    int len = 10 * 1024;  /* 10kB ought to be enough for everyone */
+    g_autofree char *buf = NULL;
+    char path[64];
+
+    virProcessFormatStatPath(path, sizeof(path), pid, tid);
+
+    len = virFileReadAllQuiet(path, len, &buf);
+    if (len < 0)
+        return NULL;
+
+    return virProcessParseStat(buf, len);
+}
+
+
+struct _virProcessTasks {
+    pid_t pid;
+    int dirfd;
+};
+
+
 #ifdef __linux__
-int
-virProcessGetStatInfo(unsigned long long *cpuTime,
-                      int *lastCpu,
-                      long *vm_rss,
-                      pid_t pid,
-                      pid_t tid)
+/* Enough for all the fields of a stat file up to VIR_PROCESS_STAT_PROCESSOR,
+ * which is all virProcessStatInfoParse() needs */
+# define VIR_PROCESS_STAT_BUFLEN 4096
+
+/*
+ * Parse the fields of the stat file in @buf needed for the CPU time, last
+ * CPU and RSS in place. The executable name may contain spaces and
+ * parentheses itself, the fields following it are separated by spaces.
+ */
+static void
+virProcessStatInfoParse(const char *buf,
+                        unsigned long long *cpuTime,
+                        int *lastCpu,
+                        long *vm_rss,
+                        pid_t pid,
+                        pid_t tid)
 {
-    g_auto(GStrv) proc_stat = virProcessGetStat(pid, tid);
     unsigned long long usertime = 0, systime = 0;
-    long rss = 0;
-    int cpu = 0;
-
-    if (!proc_stat ||
-        virStrToLong_ullp(proc_stat[VIR_PROCESS_STAT_UTIME], NULL, 10, &usertime) < 0 ||
-        virStrToLong_ullp(proc_stat[VIR_PROCESS_STAT_STIME], NULL, 10, &systime) < 0 ||
-        virStrToLong_l(proc_stat[VIR_PROCESS_STAT_RSS], NULL, 10, &rss) < 0 ||
-        virStrToLong_i(proc_stat[VIR_PROCESS_STAT_PROCESSOR], NULL, 10, &cpu) < 0) {
-        VIR_WARN("cannot parse process status data");
+    long long rss = 0;
+    long long cpu = 0;
+    const char *rparen = buf ? strrchr(buf, ')') : NULL;
+    size_t nparsed = 0;
+
+    if (rparen && rparen[1] == ' ') {
+        virStringView rest;
+        virStringView field;
+        int i;
+
+        virStringViewInit(&rest, rparen + 2);
+
+        for (i = VIR_PROCESS_STAT_STATE;
+             i <= VIR_PROCESS_STAT_PROCESSOR &&
+             virStringViewNextToken(&rest, " \n", &field); i++) {
+            int rc = 0;
+
+            switch (i) {
+            case VIR_PROCESS_STAT_UTIME:
+                rc = virStringViewToULL(&field, &usertime);
+                break;
+            case VIR_PROCESS_STAT_STIME:
+                rc = virStringViewToULL(&field, &systime);
+                break;
+            case VIR_PROCESS_STAT_RSS:
+                rc = virStringViewToLL(&field, &rss);
+                break;
+            case VIR_PROCESS_STAT_PROCESSOR:
+                if ((rc = virStringViewToLL(&field, &cpu)) == 0 &&
+                    (cpu < INT_MIN || cpu > INT_MAX)) {
+                    cpu = 0;
+                    rc = -1;
+                }
+                break;
+            default:
+                continue;
+            }
+
+            if (rc == 0)
+                nparsed++;
+        }
     }
 
+    if (nparsed != 4)
+        VIR_WARN("cannot parse process status data");
+
     /* We got jiffies
      * We want nanoseconds
      * _SC_CLK_TCK is jiffies per second
@@ -1769,12 +1845,77 @@ virProcessGetStatInfo(unsigned long long *cpuTime,
         *vm_rss = rss * virGetSystemPageSizeKB();
 
 
-    VIR_DEBUG("Got status for %d/%d user=%llu sys=%llu cpu=%d rss=%ld",
+    VIR_DEBUG("Got status for %d/%d user=%llu sys=%llu cpu=%lld rss=%lld",
               (int) pid, tid, usertime, systime, cpu, rss);
+}
+
+
+int
+virProcessGetStatInfo(unsigned long long *cpuTime,
+                      int *lastCpu,
+                      long *vm_rss,
+                      pid_t pid,
+                      pid_t tid)
+{
+    char path[64];
+    char buf[VIR_PROCESS_STAT_BUFLEN];
+
+    virProcessFormatStatPath(path, sizeof(path), pid, tid);
+
+    virProcessStatInfoParse(virFileReadBufQuiet(path, buf, sizeof(buf)) >= 0 ?
+                            buf : NULL,
+                            cpuTime, lastCpu, vm_rss, pid, tid);
+
+    return 0;
+}
+
+
+static int
+virProcessSchedInfoParse(const char *data,
+                         unsigned long long *cpuWait)
+{
+    virStringView rest;
+    virStringView line;
+    double val;
+
+    virStringViewInit(&rest, data);
+
+    while (virStringViewNextToken(&rest, "\n", &line)) {
+        virStringView value = line;
+        virStringView num;
+        const char *sep;
+
+        /* Needs CONFIG_SCHEDSTATS. The second check
+         * is the old name the kernel used in past */
+        if (!virStringViewSkipPrefix(&value, "se.statistics.wait_sum") &&
+            !virStringViewSkipPrefix(&value, "se.wait_sum"))
+            continue;
+
+        if (!(sep = memchr(value.str, ':', value.len))) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Missing separator in sched info '%.*s'"),
+                           (int) line.len, line.str);
+            return -1;
+        }
+        value.len -= sep + 1 - value.str;
+        value.str = sep + 1;
+
+        if (!virStringViewNextToken(&value, " ", &num) ||
+            virStringViewToDouble(&num, &val) < 0) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Unable to parse sched info value '%.*s'"),
+                           (int) line.len, line.str);
+            return -1;
+        }
+
+        *cpuWait = (unsigned long long) (val * 1000000);
+        break;
+    }
 
     return 0;
 }
 
+
 int
 virProcessGetSchedInfo(unsigned long long *cpuWait,
                        pid_t pid,
@@ -1782,9 +1923,6 @@ virProcessGetSchedInfo(unsigned long long *cpuWait,
 {
     g_autofree char *proc = NULL;
     g_autofree char *data = NULL;
-    g_auto(GStrv) lines = NULL;
-    size_t i;
-    double val;
 
     *cpuWait = 0;
 
@@ -1803,38 +1941,195 @@ virProcessGetSchedInfo(unsigned long long *cpuWait,
     if (virFileReadAll(proc, (1 << 16), &data) < 0)
         return -1;
 
-    lines = g_strsplit(data, "\n", 0);
-    if (!lines)
+    return virProcessSchedInfoParse(data, cpuWait);
+}
+
+
+/**
+ * virProcessTasksOpen:
+ * @pid: process ID
+ *
+ * Opens the task directory of @pid so that per-thread statistics of many
+ * threads can be read by lookups relative to it, instead of resolving the
+ * full /proc/<pid>/task/<tid>/... path of each file.
+ *
+ * Returns the task directory handle, or NULL on error.
+ */
+virProcessTasks *
+virProcessTasksOpen(pid_t pid)
+{
+    g_autofree char *path = g_strdup_printf("/proc/%d/task", (int) pid);
+    virProcessTasks *tasks = NULL;
+    int dirfd;
+
+    if ((dirfd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0) {
+        virReportSystemError(errno, _("Unable to open '%s'"), path);
+        return NULL;
+    }
+
+    tasks = g_new0(virProcessTasks, 1);
+    tasks->pid = pid;
+    tasks->dirfd = dirfd;
+
+    return tasks;
+}
+
+
+void
+virProcessTasksFree(virProcessTasks *tasks)
+{
+    if (!tasks)
+        return;
+
+    VIR_FORCE_CLOSE(tasks->dirfd);
+    g_free(tasks);
+}
+
+
+/*
+ * Open @file of thread @tid. Returns the file descriptor, or -1 with
+ * errno set.
+ */
+static int
+virProcessTasksOpenFile(virProcessTasks *tasks,
+                        pid_t tid,
+                        const char *file)
+{
+    char path[64];
+
+    /* Files of the main thread also exist in the process directory */
+    if (tid)
+        g_snprintf(path, sizeof(path), "%d/%s", (int) tid, file);
+    else
+        g_snprintf(path, sizeof(path), "../%s", file);
+
+    return openat(tasks->dirfd, path, O_RDONLY | O_CLOEXEC);
+}
+
+
+/*
+ * Read @file of thread @tid into @buf. Returns the number of bytes read,
+ * or -1 with errno set.
+ */
+static int
+virProcessTasksReadFile(virProcessTasks *tasks,
+                        pid_t tid,
+                        const char *file,
+                        int maxlen,
+                        char **buf)
+{
+    VIR_AUTOCLOSE fd = -1;
+
+    if ((fd = virProcessTasksOpenFile(tasks, tid, file)) < 0)
         return -1;
 
-    for (i = 0; lines[i] != NULL; i++) {
-        const char *line = lines[i];
+    return virFileReadLimFD(fd, maxlen, buf);
+}
 
-        /* Needs CONFIG_SCHEDSTATS. The second check
-         * is the old name the kernel used in past */
-        if (STRPREFIX(line, "se.statistics.wait_sum") ||
-            STRPREFIX(line, "se.wait_sum")) {
-            line = strchr(line, ':');
-            if (!line) {
-                virReportError(VIR_ERR_INTERNAL_ERROR,
-                               _("Missing separator in sched info '%s'"),
-                               lines[i]);
-                return -1;
-            }
-            line++;
-            while (*line == ' ')
-                line++;
-
-            if (virStrToDouble(line, NULL, &val) < 0) {
-                virReportError(VIR_ERR_INTERNAL_ERROR,
-                               _("Unable to parse sched info value '%s'"),
-                               line);
-                return -1;
-            }
 
-            *cpuWait = (unsigned long long) (val * 1000000);
-            break;
-        }
+/**
+ * virProcessTasksGetStatInfo:
+ * @tasks: task directory handle
+ * @tid: thread ID
+ * @cpuTime: filled with the CPU time of the thread in nanoseconds
+ * @lastCpu: filled with the host CPU the thread last ran on
+ *
+ * Same as virProcessGetStatInfo() for a thread of the process of @tasks.
+ *
+ * Returns 0 on success, -1 otherwise.
+ */
+int
+virProcessTasksGetStatInfo(virProcessTasks *tasks,
+                           pid_t tid,
+                           unsigned long long *cpuTime,
+                           int *lastCpu)
+{
+    char buf[VIR_PROCESS_STAT_BUFLEN];
+    VIR_AUTOCLOSE fd = virProcessTasksOpenFile(tasks, tid, "stat");
+    ssize_t len = -1;
+
+    if (fd >= 0 && (len = saferead(fd, buf, sizeof(buf) - 1)) >= 0)
+        buf[len] = '\0';
+
+    virProcessStatInfoParse(len >= 0 ? buf : NULL,
+                            cpuTime, lastCpu, NULL, tasks->pid, tid);
+
+    return 0;
+}
+
+
+/**
+ * virProcessTasksGetSchedInfo:
+ * @tasks: task directory handle
+ * @tid: thread ID
+ * @cpuWait: filled with the time the thread spent waiting for a CPU in
+ *           nanoseconds
+ *
+ * Same as virProcessGetSchedInfo() for a thread of the process of @tasks.
+ *
+ * Returns 0 on success, -1 otherwise.
+ */
+int
+virProcessTasksGetSchedInfo(virProcessTasks *tasks,
+                            pid_t tid,
+                            unsigned long long *cpuWait)
+{
+    g_autofree char *data = NULL;
+
+    *cpuWait = 0;
+
+    if (virProcessTasksReadFile(tasks, tid, "sched", (1 << 16), &data) < 0) {
+        /* The file is not guaranteed to exist (needs CONFIG_SCHED_DEBUG) */
+        if (errno == ENOENT)
+            return 0;
+
+        virReportSystemError(errno,
+                             _("Unable to read sched info of thread %d/%d"),
+                             (int) tasks->pid, (int) tid);
+        return -1;
+    }
+
+    return virProcessSchedInfoParse(data, cpuWait);
+}
+
+
+/**
+ * virProcessTasksGetSchedDelay:
+ * @tasks: task directory handle
+ * @tid: thread ID
+ * @cpuDelay: filled with the time the thread spent waiting on a runqueue
+ *            in nanoseconds
+ *
+ * Reads the run delay of a thread of the process of @tasks from its
+ * schedstat file.
+ *
+ * Returns 0 on success, -1 otherwise.
+ */
+int
+virProcessTasksGetSchedDelay(virProcessTasks *tasks,
+                             pid_t tid,
+                             unsigned long long *cpuDelay)
+{
+    g_autofree char *buf = NULL;
+
+    *cpuDelay = 0;
+
+    if (virProcessTasksReadFile(tasks, tid, "schedstat", 1024, &buf) < 0) {
+        /* This file might not exist (needs CONFIG_SCHED_INFO) */
+        if (errno == ENOENT)
+            return 0;
+
+        virReportSystemError(errno,
+                             _("Unable to read schedstat info of thread %d/%d"),
+                             (int) tasks->pid, (int) tid);
+        return -1;
+    }
+
+    if (sscanf(buf, "%*u %llu", cpuDelay) != 1) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Unable to parse schedstat info of thread %d/%d"),
+                       (int) tasks->pid, (int) tid);
+        return -1;
     }
 
     return 0;
@@ -1872,4 +2167,53 @@ virProcessGetSchedInfo(unsigned long long *cpuWait,
 
     return 0;
 }
+
+virProcessTasks *
+virProcessTasksOpen(pid_t pid G_GNUC_UNUSED)
+{
+    virReportSystemError(ENOSYS, "%s",
+                         _("Reading thread statistics is not supported "
+                           "on this platform"));
+    return NULL;
+}
+
+void
+virProcessTasksFree(virProcessTasks *tasks)
+{
+    g_free(tasks);
+}
+
+int
+virProcessTasksGetStatInfo(virProcessTasks *tasks G_GNUC_UNUSED,
+                           pid_t tid G_GNUC_UNUSED,
+                           unsigned long long *cpuTime,
+                           int *lastCpu)
+{
+    if (cpuTime)
+        *cpuTime = 0;
+    if (lastCpu)
+        *lastCpu = 0;
+
+    return 0;
+}
+
+int
+virProcessTasksGetSchedInfo(virProcessTasks *tasks G_GNUC_UNUSED,
+                            pid_t tid G_GNUC_UNUSED,
+                            unsigned long long *cpuWait)
+{
+    *cpuWait = 0;
+
+    return 0;
+}
+
+int
+virProcessTasksGetSchedDelay(virProcessTasks *tasks G_GNUC_UNUSED,
+                             pid_t tid G_GNUC_UNUSED,
+                             unsigned long long *cpuDelay)
+{
+    *cpuDelay = 0;
+
+    return 0;
+}
 #endif /* __linux__ */
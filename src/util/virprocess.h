@@ -202,3 +202,20 @@ int virProcessGetStatInfo(unsigned long long *cpuTime,
 int virProcessGetSchedInfo(unsigned long long *cpuWait,
                            pid_t pid,
                            pid_t tid);
+
+typedef struct _virProcessTasks virProcessTasks;
+
+virProcessTasks *virProcessTasksOpen(pid_t pid);
+void virProcessTasksFree(virProcessTasks *tasks);
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(virProcessTasks, virProcessTasksFree);
+
+int virProcessTasksGetStatInfo(virProcessTasks *tasks,
+                               pid_t tid,
+                               unsigned long long *cpuTime,
+                               int *lastCpu);
+int virProcessTasksGetSchedInfo(virProcessTasks *tasks,
+                                pid_t tid,
+                                unsigned long long *cpuWait);
+int virProcessTasksGetSchedDelay(virProcessTasks *tasks,
+                                 pid_t tid,
+                                 unsigned long long *cpuDelay);
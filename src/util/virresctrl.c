@@ -32,6 +32,8 @@
 #include "virlog.h"
 #include "virobject.h"
 #include "virstring.h"
+#include "virthread.h"
+#include "virtime.h"
 
 #define VIR_FROM_THIS VIR_FROM_RESCTRL
 
@@ -342,6 +344,35 @@ struct _virResctrlAlloc {
     char *path;
 };
 
+/*
+ * An open file with resource utilization data of one node of a monitor.
+ * Files with accumulative counters (mbm_*) are also sampled periodically to
+ * compute their rate.
+ */
+typedef struct _virResctrlMonitorFile virResctrlMonitorFile;
+struct _virResctrlMonitorFile {
+    char *name;
+    int fd;
+
+    unsigned long long last; /* value in the last sample */
+    unsigned long long sampled; /* time of the last sample in ms, 0 if none */
+    unsigned long long rate; /* per second */
+    bool hasRate;
+};
+
+/*
+ * A directory "mon_<node_name>_<node_id>" under the mon_data directory of
+ * a monitor.
+ */
+typedef struct _virResctrlMonitorNode virResctrlMonitorNode;
+struct _virResctrlMonitorNode {
+    unsigned int id;
+    char *path;
+
+    virResctrlMonitorFile **files;
+    size_t nfiles;
+};
+
 /*
  * virResctrlMonitor is the data structure for resctrl monitor. Resctrl
  * monitor represents a resctrl monitoring group, which can be used to
@@ -349,7 +380,7 @@ struct _virResctrlAlloc {
  * memory bandwidth.
  */
 struct _virResctrlMonitor {
-    virObject parent;
+    virObjectLockable parent;
 
     /* Each virResctrlMonitor is associated with one specific allocation,
      * either the root directory allocation under /sys/fs/resctrl or a
@@ -364,6 +395,13 @@ struct _virResctrlMonitor {
     /* libvirt-generated path in /sys/fs/resctrl for this particular
      * monitor */
     char *path;
+
+    /* Nodes found in the mon_data directory by the first
+     * virResctrlMonitorGetStats, sorted by @id. The files are opened on first
+     * use and kept open until the monitor is removed. */
+    virResctrlMonitorNode **nodes;
+    size_t nnodes;
+    bool scanned;
 };
 
 
@@ -416,11 +454,49 @@ virResctrlAllocDispose(void *obj)
 }
 
 
+static void
+virResctrlMonitorNodeFree(virResctrlMonitorNode *node)
+{
+    size_t i;
+
+    if (!node)
+        return;
+
+    for (i = 0; i < node->nfiles; i++) {
+        VIR_FORCE_CLOSE(node->files[i]->fd);
+        g_free(node->files[i]->name);
+        g_free(node->files[i]);
+    }
+
+    g_free(node->files);
+    g_free(node->path);
+    g_free(node);
+}
+
+
+static void
+virResctrlMonitorClearNodes(virResctrlMonitor *monitor)
+{
+    size_t i;
+
+    for (i = 0; i < monitor->nnodes; i++)
+        virResctrlMonitorNodeFree(monitor->nodes[i]);
+
+    g_clear_pointer(&monitor->nodes, g_free);
+    monitor->nnodes = 0;
+    monitor->scanned = false;
+}
+
+
+static void virResctrlSamplerRemove(virResctrlMonitor *monitor);
+
 static void
 virResctrlMonitorDispose(void *obj)
 {
     virResctrlMonitor *monitor = obj;
 
+    virResctrlSamplerRemove(monitor);
+    virResctrlMonitorClearNodes(monitor);
     virObjectUnref(monitor->alloc);
     g_free(monitor->id);
     g_free(monitor->path);
@@ -437,7 +513,7 @@ virResctrlOnceInit(void)
     if (!VIR_CLASS_NEW(virResctrlAlloc, virClassForObject()))
         return -1;
 
-    if (!VIR_CLASS_NEW(virResctrlMonitor, virClassForObject()))
+    if (!VIR_CLASS_NEW(virResctrlMonitor, virClassForObjectLockable()))
         return -1;
 
     return 0;
@@ -2398,7 +2474,7 @@ virResctrlMonitorNew(void)
     if (virResctrlInitialize() < 0)
         return NULL;
 
-    return virObjectNew(virResctrlMonitorClass);
+    return virObjectLockableNew(virResctrlMonitorClass);
 }
 
 
@@ -2524,6 +2600,11 @@ virResctrlMonitorRemove(virResctrlMonitor *monitor)
     if (!monitor->path)
         return 0;
 
+    virResctrlSamplerRemove(monitor);
+    VIR_WITH_OBJECT_LOCK_GUARD(monitor) {
+        virResctrlMonitorClearNodes(monitor);
+    }
+
     if (STREQ(monitor->path, monitor->alloc->path))
         return 0;
 
@@ -2538,58 +2619,50 @@ virResctrlMonitorRemove(virResctrlMonitor *monitor)
 
 
 static int
-virResctrlMonitorStatsSorter(const void *a,
-                             const void *b)
+virResctrlMonitorNodeSorter(const void *a,
+                            const void *b)
 {
-    return (*(virResctrlMonitorStats **)a)->id
-        - (*(virResctrlMonitorStats **)b)->id;
+    unsigned int ida = (*(virResctrlMonitorNode * const *)a)->id;
+    unsigned int idb = (*(virResctrlMonitorNode * const *)b)->id;
+
+    if (ida < idb)
+        return -1;
+    if (ida > idb)
+        return 1;
+    return 0;
 }
 
 
 /*
- * virResctrlMonitorGetStats
+ * virResctrlMonitorScan
  *
- * @monitor: The monitor that the statistic data will be retrieved from.
- * @resources: A string list for the monitor feature names.
- * @stats: Pointer of of virResctrlMonitorStats * array for holding cache or
- * memory bandwidth usage data.
- * @nstats: A size_t pointer to hold the returned array length of @stats
+ * @monitor: locked monitor
  *
- * Get cache or memory bandwidth utilization information.
+ * Finds the nodes in the mon_data directory of @monitor unless done already.
  *
  * Returns 0 on success, -1 on error.
  */
-int
-virResctrlMonitorGetStats(virResctrlMonitor *monitor,
-                          const char **resources,
-                          virResctrlMonitorStats ***stats,
-                          size_t *nstats)
+static int
+virResctrlMonitorScan(virResctrlMonitor *monitor)
 {
-    int rv = -1;
-    int ret = -1;
-    size_t i = 0;
-    unsigned long long val = 0;
     g_autoptr(DIR) dirp = NULL;
     g_autofree char *datapath = NULL;
     struct dirent *ent = NULL;
-    virResctrlMonitorStats *stat = NULL;
-    size_t nresources = g_strv_length((char **) resources);
+    int rv;
 
-    if (!monitor) {
-        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                       _("Invalid resctrl monitor"));
-        return -1;
-    }
+    if (monitor->scanned)
+        return 0;
 
     datapath = g_strdup_printf("%s/mon_data", monitor->path);
 
     if (virDirOpen(&dirp, datapath) < 0)
-        goto cleanup;
+        return -1;
 
-    *nstats = 0;
-    while (virDirRead(dirp, &ent, datapath) > 0) {
+    while ((rv = virDirRead(dirp, &ent, datapath)) > 0) {
         g_autofree char *filepath = NULL;
+        virResctrlMonitorNode *node;
         char *node_id = NULL;
+        unsigned int id;
 
         /* Looking for directory that contains resource utilization
          * information file. The directory name is arranged in format
@@ -2615,40 +2688,301 @@ virResctrlMonitorGetStats(virResctrlMonitor *monitor,
         if (!(node_id = STRSKIP(node_id, "_")))
             continue;
 
-        stat = g_new0(virResctrlMonitorStats, 1);
-        stat->features = g_new0(char *, nresources + 1);
-
         /* The node ID number should be here, parsing it. */
-        if (virStrToLong_uip(node_id, NULL, 0, &stat->id) < 0)
-            goto cleanup;
+        if (virStrToLong_uip(node_id, NULL, 0, &id) < 0) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Cannot parse resctrl node id '%s'"), node_id);
+            rv = -1;
+            break;
+        }
 
-        for (i = 0; resources[i]; i++) {
-            rv = virFileReadValueUllong(&val, "%s/%s/%s", datapath,
-                                        ent->d_name, resources[i]);
-            if (rv == -2) {
-                virReportError(VIR_ERR_INTERNAL_ERROR,
-                               _("File '%s/%s/%s' does not exist."),
-                               datapath, ent->d_name, resources[i]);
+        node = g_new0(virResctrlMonitorNode, 1);
+        node->id = id;
+        node->path = g_steal_pointer(&filepath);
+        VIR_APPEND_ELEMENT(monitor->nodes, monitor->nnodes, node);
+    }
+
+    if (rv < 0) {
+        virResctrlMonitorClearNodes(monitor);
+        return -1;
+    }
+
+    /* Sort in id's ascending order */
+    if (monitor->nnodes)
+        qsort(monitor->nodes, monitor->nnodes, sizeof(*monitor->nodes),
+              virResctrlMonitorNodeSorter);
+
+    monitor->scanned = true;
+    return 0;
+}
+
+
+static virResctrlMonitorFile *
+virResctrlMonitorNodeGetFile(virResctrlMonitorNode *node,
+                             const char *name)
+{
+    g_autofree char *path = NULL;
+    virResctrlMonitorFile *file;
+    size_t i;
+    int fd;
+
+    for (i = 0; i < node->nfiles; i++) {
+        if (STREQ(node->files[i]->name, name))
+            return node->files[i];
+    }
+
+    path = g_strdup_printf("%s/%s", node->path, name);
+
+    if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0) {
+        if (errno == ENOENT)
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("File '%s' does not exist."), path);
+        else
+            virReportSystemError(errno, _("Unable to open '%s'"), path);
+        return NULL;
+    }
+
+    file = g_new0(virResctrlMonitorFile, 1);
+    file->name = g_strdup(name);
+    file->fd = fd;
+    VIR_APPEND_ELEMENT(node->files, node->nfiles, file);
+
+    return file;
+}
+
+
+static int
+virResctrlMonitorFileRead(virResctrlMonitorNode *node,
+                          virResctrlMonitorFile *file,
+                          unsigned long long *value)
+{
+    char buf[64];
+    ssize_t len;
+    char *end;
+
+    if (lseek(file->fd, 0, SEEK_SET) < 0 ||
+        (len = saferead(file->fd, buf, sizeof(buf) - 1)) < 0) {
+        virReportSystemError(errno, _("Unable to read '%s/%s'"),
+                             node->path, file->name);
+        return -1;
+    }
+
+    buf[len] = '\0';
+
+    if (virStrToLong_ullp(buf, &end, 10, value) < 0 ||
+        (*end && *end != '\n')) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Invalid unsigned long long value '%s' in file '%s/%s'"),
+                       g_strstrip(buf), node->path, file->name);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/* Sampling of accumulative counters of monitors, to compute their rates */
+
+/* Interval in milliseconds between two samples of counters of monitors */
+#define VIR_RESCTRL_SAMPLE_INTERVAL 1000
+
+static virMutex virResctrlSamplerLock = VIR_MUTEX_INITIALIZER;
+static GPtrArray *virResctrlSamplerMonitors; /* no references */
+static bool virResctrlSamplerRunning;
+
+
+static void
+virResctrlSamplerSampleMonitor(virResctrlMonitor *monitor,
+                               unsigned long long now)
+{
+    size_t i;
+    size_t j;
+
+    for (i = 0; i < monitor->nnodes; i++) {
+        virResctrlMonitorNode *node = monitor->nodes[i];
+
+        for (j = 0; j < node->nfiles; j++) {
+            virResctrlMonitorFile *file = node->files[j];
+            unsigned long long val;
+
+            if (!STRPREFIX(file->name, "mbm_"))
+                continue;
+
+            if (virResctrlMonitorFileRead(node, file, &val) < 0) {
+                virResetLastError();
+                file->sampled = 0;
+                file->hasRate = false;
+                continue;
             }
-            if (rv < 0)
-                goto cleanup;
 
-            VIR_APPEND_ELEMENT(stat->vals, stat->nvals, val);
+            if (file->sampled && now > file->sampled && val >= file->last) {
+                file->rate = (val - file->last) * 1000 / (now - file->sampled);
+                file->hasRate = true;
+            }
 
-            stat->features[i] = g_strdup(resources[i]);
+            file->last = val;
+            file->sampled = now;
         }
+    }
+}
+
+
+static void
+virResctrlSamplerThread(void *opaque G_GNUC_UNUSED)
+{
+    while (true) {
+        unsigned long long now;
+        size_t i;
+
+        g_usleep(VIR_RESCTRL_SAMPLE_INTERVAL * 1000);
+
+        if (virTimeMillisNow(&now) < 0) {
+            virResetLastError();
+            continue;
+        }
+
+        VIR_WITH_MUTEX_LOCK_GUARD(&virResctrlSamplerLock) {
+            for (i = 0; i < virResctrlSamplerMonitors->len; i++) {
+                virResctrlMonitor *monitor = g_ptr_array_index(virResctrlSamplerMonitors, i);
 
-        VIR_APPEND_ELEMENT(*stats, *nstats, stat);
+                VIR_WITH_OBJECT_LOCK_GUARD(monitor) {
+                    virResctrlSamplerSampleMonitor(monitor, now);
+                }
+            }
+        }
     }
+}
 
-    /* Sort in id's ascending order */
-    if (*nstats)
-        qsort(*stats, *nstats, sizeof(**stats), virResctrlMonitorStatsSorter);
 
-    ret = 0;
- cleanup:
-    virResctrlMonitorStatsFree(stat);
-    return ret;
+/*
+ * virResctrlSamplerAdd
+ *
+ * @monitor: unlocked monitor
+ *
+ * Makes the sampling thread, started on first use, sample the accumulative
+ * counters of @monitor which were read by virResctrlMonitorGetStats.
+ */
+static void
+virResctrlSamplerAdd(virResctrlMonitor *monitor)
+{
+    VIR_LOCK_GUARD lock = virLockGuardLock(&virResctrlSamplerLock);
+    virThread thread;
+
+    if (!virResctrlSamplerMonitors)
+        virResctrlSamplerMonitors = g_ptr_array_new();
+
+    if (g_ptr_array_find(virResctrlSamplerMonitors, monitor, NULL))
+        return;
+
+    if (!virResctrlSamplerRunning) {
+        if (virThreadCreateFull(&thread, false, virResctrlSamplerThread,
+                                "resctrl-sampler", false, NULL) < 0) {
+            VIR_WARN("Unable to create resctrl sampler thread: %s",
+                     g_strerror(errno));
+            return;
+        }
+        virResctrlSamplerRunning = true;
+    }
+
+    g_ptr_array_add(virResctrlSamplerMonitors, monitor);
+}
+
+
+/* Stops sampling of @monitor, which must not be locked by the caller */
+static void
+virResctrlSamplerRemove(virResctrlMonitor *monitor)
+{
+    VIR_LOCK_GUARD lock = virLockGuardLock(&virResctrlSamplerLock);
+
+    if (virResctrlSamplerMonitors)
+        g_ptr_array_remove_fast(virResctrlSamplerMonitors, monitor);
+}
+
+
+/*
+ * virResctrlMonitorGetStats
+ *
+ * @monitor: The monitor that the statistic data will be retrieved from.
+ * @resources: A string list for the monitor feature names.
+ * @stats: Pointer of of virResctrlMonitorStats * array for holding cache or
+ * memory bandwidth usage data.
+ * @nstats: A size_t pointer to hold the returned array length of @stats
+ *
+ * Get cache or memory bandwidth utilization information. The files with the
+ * data are kept open by @monitor, so that repeated calls only read them.
+ * Accumulative counters (mbm_*) returned by this function are sampled
+ * periodically from then on, and once their rate is known, @rates of the
+ * returned statistics are set.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virResctrlMonitorGetStats(virResctrlMonitor *monitor,
+                          const char **resources,
+                          virResctrlMonitorStats ***stats,
+                          size_t *nstats)
+{
+    size_t i = 0;
+    size_t j = 0;
+    virResctrlMonitorStats *stat = NULL;
+    size_t nresources = g_strv_length((char **) resources);
+    bool counters = false;
+
+    if (!monitor) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("Invalid resctrl monitor"));
+        return -1;
+    }
+
+    *nstats = 0;
+
+    VIR_WITH_OBJECT_LOCK_GUARD(monitor) {
+        if (virResctrlMonitorScan(monitor) < 0)
+            return -1;
+
+        for (i = 0; i < monitor->nnodes; i++) {
+            virResctrlMonitorNode *node = monitor->nodes[i];
+            bool rated = true;
+
+            stat = g_new0(virResctrlMonitorStats, 1);
+            stat->features = g_new0(char *, nresources + 1);
+            stat->rates = g_new0(unsigned long long, nresources);
+            stat->id = node->id;
+
+            for (j = 0; resources[j]; j++) {
+                virResctrlMonitorFile *file;
+                unsigned long long val = 0;
+
+                if (!(file = virResctrlMonitorNodeGetFile(node, resources[j])) ||
+                    virResctrlMonitorFileRead(node, file, &val) < 0) {
+                    virResctrlMonitorStatsFree(stat);
+                    return -1;
+                }
+
+                VIR_APPEND_ELEMENT(stat->vals, stat->nvals, val);
+
+                stat->features[j] = g_strdup(resources[j]);
+
+                if (STRPREFIX(file->name, "mbm_"))
+                    counters = true;
+
+                if (file->hasRate)
+                    stat->rates[j] = file->rate;
+                else
+                    rated = false;
+            }
+
+            if (!rated)
+                g_clear_pointer(&stat->rates, g_free);
+
+            VIR_APPEND_ELEMENT(*stats, *nstats, stat);
+        }
+    }
+
+    if (counters)
+        virResctrlSamplerAdd(monitor);
+
+    return 0;
 }
 
 
@@ -2660,5 +2994,6 @@ virResctrlMonitorStatsFree(virResctrlMonitorStats *stat)
 
     g_strfreev(stat->features);
     g_free(stat->vals);
+    g_free(stat->rates);
     g_free(stat);
 }
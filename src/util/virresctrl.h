@@ -199,6 +199,9 @@ struct _virResctrlMonitorStats {
     unsigned long long *vals;
     /* The length of @vals array */
     size_t nvals;
+    /* @rates store the change per second of accumulative @vals, as sampled
+     * in the background. NULL if the rate of any @vals is not known. */
+    unsigned long long *rates;
 };
 
 virResctrlMonitor *
@@ -24,9 +24,13 @@
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#ifndef WIN32
+# include <sys/resource.h>
+#endif
 
 #include "virrotatingfile.h"
 #include "viralloc.h"
+#include "vircommand.h"
 #include "virerror.h"
 #include "virstring.h"
 #include "virfile.h"
@@ -38,6 +42,25 @@ VIR_LOG_INIT("util.rotatingfile");
 
 #define VIR_MAX_MAX_BACKUP 32
 
+VIR_ENUM_IMPL(virRotatingFileCompression,
+              VIR_ROTATING_FILE_COMPRESSION_LAST,
+              "none",
+              "gzip",
+              "xz",
+              "zstd",
+);
+
+/* File name suffixes of compressed backups, indexed by
+ * virRotatingFileCompression. The compressors are named after the format. */
+static const char *virRotatingFileCompressionSuffix[] = {
+    "",
+    ".gz",
+    ".xz",
+    ".zst",
+};
+G_STATIC_ASSERT(G_N_ELEMENTS(virRotatingFileCompressionSuffix) ==
+                VIR_ROTATING_FILE_COMPRESSION_LAST);
+
 typedef struct virRotatingFileWriterEntry virRotatingFileWriterEntry;
 
 typedef struct virRotatingFileReaderEntry virRotatingFileReaderEntry;
@@ -55,13 +78,22 @@ struct virRotatingFileWriter {
     size_t maxbackup;
     mode_t mode;
     size_t maxlen;
+
+    virRotatingFileCompression compression;
+    virCommand *compress; /* compressor of the second newest backup */
 };
 
 
+/* Files are opened only once they're read from, so that reading the end of
+ * the newest file doesn't cost opening, let alone decompressing, all the
+ * backups before it. */
 struct virRotatingFileReaderEntry {
     char *path;
-    int fd;
+    bool exists; /* uncompressed, as of creating the reader */
     off_t inode;
+    bool opened;
+    int fd;
+    virCommand *decompress; /* @fd is its output if the file is compressed */
 };
 
 struct virRotatingFileReader {
@@ -90,6 +122,11 @@ virRotatingFileReaderEntryFree(virRotatingFileReaderEntry *entry)
 
     g_free(entry->path);
     VIR_FORCE_CLOSE(entry->fd);
+    if (entry->decompress) {
+        /* the rest of the output isn't needed */
+        virCommandAbort(entry->decompress);
+        virCommandFree(entry->decompress);
+    }
     g_free(entry);
 }
 
@@ -137,32 +174,82 @@ virRotatingFileWriterEntryNew(const char *path,
 }
 
 
+/*
+ * Opens the compressed form of @path, if there's any, and starts
+ * decompressing it into a pipe which becomes @entry->fd. Leaves @entry->fd
+ * at -1 if there's no compressed file.
+ */
+static int
+virRotatingFileReaderEntryOpenCompressed(virRotatingFileReaderEntry *entry,
+                                         const char *path)
+{
+    size_t i;
+
+    for (i = VIR_ROTATING_FILE_COMPRESSION_NONE + 1;
+         i < VIR_ROTATING_FILE_COMPRESSION_LAST; i++) {
+        g_autofree char *cpath = g_strdup_printf("%s%s", path,
+                                                 virRotatingFileCompressionSuffix[i]);
+        g_autoptr(virCommand) cmd = NULL;
+        VIR_AUTOCLOSE fd = -1;
+        struct stat sb;
+
+        if ((fd = open(cpath, O_RDONLY|O_CLOEXEC)) < 0) {
+            if (errno == ENOENT)
+                continue;
+            virReportSystemError(errno,
+                                 _("Unable to open file: %s"), cpath);
+            return -1;
+        }
+
+        if (fstat(fd, &sb) < 0) {
+            virReportSystemError(errno,
+                                 _("Unable to determine current file inode: %s"),
+                                 cpath);
+            return -1;
+        }
+
+        VIR_DEBUG("Decompressing %s", cpath);
+
+        cmd = virCommandNewArgList(virRotatingFileCompressionTypeToString(i),
+                                   "-d", "-c", "-q", NULL);
+        virCommandSetInputFD(cmd, fd);
+        virCommandSetOutputFD(cmd, &entry->fd);
+
+        /* an old backup which can't be read is no reason to fail reading
+         * the newer ones */
+        if (virCommandRunAsync(cmd, NULL) < 0) {
+            VIR_WARN("Unable to decompress %s", cpath);
+            VIR_FORCE_CLOSE(entry->fd);
+            return 0;
+        }
+
+        entry->inode = sb.st_ino;
+        entry->decompress = g_steal_pointer(&cmd);
+        return 0;
+    }
+
+    return 0;
+}
+
+
 static virRotatingFileReaderEntry *
 virRotatingFileReaderEntryNew(const char *path)
 {
     virRotatingFileReaderEntry *entry;
     struct stat sb;
 
-    VIR_DEBUG("Opening %s", path);
-
     entry = g_new0(virRotatingFileReaderEntry, 1);
+    entry->fd = -1;
 
-    if ((entry->fd = open(path, O_RDONLY|O_CLOEXEC)) < 0) {
+    if (stat(path, &sb) < 0) {
         if (errno != ENOENT) {
-            virReportSystemError(errno,
-                                 _("Unable to open file: %s"), path);
-            goto error;
-        }
-    }
-
-    if (entry->fd != -1) {
-        if (fstat(entry->fd, &sb) < 0) {
             virReportSystemError(errno,
                                  _("Unable to determine current file inode: %s"),
                                  path);
             goto error;
         }
-
+    } else {
+        entry->exists = true;
         entry->inode = sb.st_ino;
     }
 
@@ -176,32 +263,140 @@ virRotatingFileReaderEntryNew(const char *path)
 }
 
 
+/*
+ * Opens @entry, unless that was done already. @entry->fd is left at -1 if
+ * the file doesn't exist in any form.
+ */
 static int
-virRotatingFileWriterDelete(virRotatingFileWriter *file)
+virRotatingFileReaderEntryOpen(virRotatingFileReaderEntry *entry)
 {
-    size_t i;
+    if (entry->opened)
+        return 0;
+
+    entry->opened = true;
+
+    VIR_DEBUG("Opening %s", entry->path);
+
+    if ((entry->fd = open(entry->path, O_RDONLY|O_CLOEXEC)) < 0) {
+        if (errno != ENOENT) {
+            virReportSystemError(errno,
+                                 _("Unable to open file: %s"), entry->path);
+            return -1;
+        }
+
+        /* the backup may have been compressed since the reader was created */
+        return virRotatingFileReaderEntryOpenCompressed(entry, entry->path);
+    }
+
+    return 0;
+}
+
+
+/*
+ * Waits for the compression of a backup started by the last rollover, so
+ * that the next rollover doesn't rename the file under the compressor.
+ * A failed compression only leaves the backup uncompressed.
+ */
+static void
+virRotatingFileWriterCompressWait(virRotatingFileWriter *file)
+{
+    int status;
+
+    if (!file->compress)
+        return;
+
+    if (virCommandWait(file->compress, &status) == 0 && status != 0)
+        VIR_WARN("Failed to compress backup of %s, status %d",
+                 file->basepath, status);
+
+    g_clear_pointer(&file->compress, virCommandFree);
+}
+
+
+static int
+virRotatingFileCompressHook(void *opaque G_GNUC_UNUSED)
+{
+#ifndef WIN32
+    /* the compressor shouldn't compete with running guests, but it's still
+     * better to compress at normal priority than not at all */
+    ignore_value(setpriority(PRIO_PROCESS, 0, 19));
+#endif
+    return 0;
+}
+
+
+/*
+ * Starts compressing the second newest backup in the background. The newest
+ * one is kept uncompressed, since that's where readers of recent messages
+ * usually end up.
+ */
+static void
+virRotatingFileWriterCompress(virRotatingFileWriter *file)
+{
+    g_autoptr(virCommand) cmd = NULL;
+    g_autofree char *path = NULL;
+
+    if (file->compression == VIR_ROTATING_FILE_COMPRESSION_NONE ||
+        file->maxbackup < 2)
+        return;
+
+    path = g_strdup_printf("%s.1", file->basepath);
+
+    VIR_DEBUG("Compressing %s", path);
+
+    cmd = virCommandNewArgList(virRotatingFileCompressionTypeToString(file->compression),
+                               "-q", "-f", NULL);
+    /* gzip and xz remove the uncompressed file by default */
+    if (file->compression == VIR_ROTATING_FILE_COMPRESSION_ZSTD)
+        virCommandAddArg(cmd, "--rm");
+    virCommandAddArg(cmd, path);
+    virCommandSetPreExecHook(cmd, virRotatingFileCompressHook, NULL);
+
+    if (virCommandRunAsync(cmd, NULL) < 0) {
+        VIR_WARN("Unable to compress %s", path);
+        return;
+    }
+
+    file->compress = g_steal_pointer(&cmd);
+}
+
 
-    if (unlink(file->basepath) < 0 &&
+static int
+virRotatingFileUnlink(const char *path)
+{
+    if (unlink(path) < 0 &&
         errno != ENOENT) {
         virReportSystemError(errno,
                              _("Unable to delete file %s"),
-                             file->basepath);
+                             path);
         return -1;
     }
 
+    return 0;
+}
+
+
+static int
+virRotatingFileWriterDelete(virRotatingFileWriter *file)
+{
+    size_t i;
+    size_t j;
+
+    virRotatingFileWriterCompressWait(file);
+
+    if (virRotatingFileUnlink(file->basepath) < 0)
+        return -1;
+
     for (i = 0; i < file->maxbackup; i++) {
-        char *oldpath;
-        oldpath = g_strdup_printf("%s.%zu", file->basepath, i);
+        for (j = 0; j < VIR_ROTATING_FILE_COMPRESSION_LAST; j++) {
+            g_autofree char *oldpath = NULL;
 
-        if (unlink(oldpath) < 0 &&
-            errno != ENOENT) {
-            virReportSystemError(errno,
-                                 _("Unable to delete file %s"),
-                                 oldpath);
-            VIR_FREE(oldpath);
-            return -1;
+            oldpath = g_strdup_printf("%s.%zu%s", file->basepath, i,
+                                      virRotatingFileCompressionSuffix[j]);
+
+            if (virRotatingFileUnlink(oldpath) < 0)
+                return -1;
         }
-        VIR_FREE(oldpath);
     }
 
     return 0;
@@ -266,6 +461,23 @@ virRotatingFileWriterNew(const char *path,
 }
 
 
+/**
+ * virRotatingFileWriterSetCompression:
+ * @file: the file context
+ * @compression: the format to compress backups with
+ *
+ * Make rollovers compress all backups but the newest one into
+ * @compression format, by running the compressor in the background.
+ * Compressed backups are read transparently by virRotatingFileReader.
+ */
+void
+virRotatingFileWriterSetCompression(virRotatingFileWriter *file,
+                                    virRotatingFileCompression compression)
+{
+    file->compression = compression;
+}
+
+
 /**
  * virRotatingFileReaderNew:
  * @path: the base path for files
@@ -360,9 +572,7 @@ static int
 virRotatingFileWriterRollover(virRotatingFileWriter *file)
 {
     size_t i;
-    char *nextpath = NULL;
-    char *thispath = NULL;
-    int ret = -1;
+    size_t j;
 
     VIR_DEBUG("Rollover %s", file->basepath);
     if (file->maxbackup == 0) {
@@ -371,39 +581,60 @@ virRotatingFileWriterRollover(virRotatingFileWriter *file)
             virReportSystemError(errno,
                                  _("Unable to remove %s"),
                                  file->basepath);
-            goto cleanup;
+            return -1;
         }
     } else {
-        nextpath = g_strdup_printf("%s.%zu", file->basepath, file->maxbackup - 1);
+        virRotatingFileWriterCompressWait(file);
 
-        for (i = file->maxbackup; i > 0; i--) {
-            if (i == 1) {
-                thispath = g_strdup(file->basepath);
-            } else {
-                thispath = g_strdup_printf("%s.%zu", file->basepath, i - 2);
-            }
-            VIR_DEBUG("Rollover %s -> %s", thispath, nextpath);
+        /* The oldest backup may exist in any format, drop all of them first
+         * so that none is left behind when the next one takes its place.
+         * Backups are moved in whichever format they are in, regardless of
+         * the current setting. */
+        for (j = 0; j < VIR_ROTATING_FILE_COMPRESSION_LAST; j++) {
+            g_autofree char *oldpath = NULL;
 
-            if (rename(thispath, nextpath) < 0 &&
-                errno != ENOENT) {
-                virReportSystemError(errno,
-                                     _("Unable to rename %s to %s"),
-                                     thispath, nextpath);
-                goto cleanup;
-            }
+            oldpath = g_strdup_printf("%s.%zu%s", file->basepath,
+                                      file->maxbackup - 1,
+                                      virRotatingFileCompressionSuffix[j]);
 
-            VIR_FREE(nextpath);
-            nextpath = g_steal_pointer(&thispath);
+            if (virRotatingFileUnlink(oldpath) < 0)
+                return -1;
         }
+
+        for (i = file->maxbackup; i > 0; i--) {
+            for (j = 0; j < VIR_ROTATING_FILE_COMPRESSION_LAST; j++) {
+                const char *suffix = virRotatingFileCompressionSuffix[j];
+                g_autofree char *nextpath = NULL;
+                g_autofree char *thispath = NULL;
+
+                /* the primary file is never compressed */
+                if (i == 1 && j != VIR_ROTATING_FILE_COMPRESSION_NONE)
+                    continue;
+
+                nextpath = g_strdup_printf("%s.%zu%s", file->basepath, i - 1, suffix);
+                if (i == 1) {
+                    thispath = g_strdup(file->basepath);
+                } else {
+                    thispath = g_strdup_printf("%s.%zu%s", file->basepath, i - 2, suffix);
+                }
+                VIR_DEBUG("Rollover %s -> %s", thispath, nextpath);
+
+                if (rename(thispath, nextpath) < 0 &&
+                    errno != ENOENT) {
+                    virReportSystemError(errno,
+                                         _("Unable to rename %s to %s"),
+                                         thispath, nextpath);
+                    return -1;
+                }
+            }
+        }
+
+        virRotatingFileWriterCompress(file);
     }
 
     VIR_DEBUG("Rollover done %s", file->basepath);
 
-    ret = 0;
- cleanup:
-    VIR_FREE(nextpath);
-    VIR_FREE(thispath);
-    return ret;
+    return 0;
 }
 
 
@@ -492,6 +723,35 @@ virRotatingFileWriterAppend(virRotatingFileWriter *file,
 }
 
 
+/*
+ * Seeks to @offset in @entry. Decompressed data can only be skipped by
+ * reading it.
+ */
+static off_t
+virRotatingFileReaderEntrySeek(virRotatingFileReaderEntry *entry,
+                               off_t offset)
+{
+    char buf[1024];
+    off_t pos = 0;
+
+    if (!entry->decompress)
+        return lseek(entry->fd, offset, SEEK_SET);
+
+    while (pos < offset) {
+        ssize_t got = saferead(entry->fd, buf, MIN(sizeof(buf), offset - pos));
+
+        if (got < 0)
+            return -1;
+        if (got == 0)
+            break;
+
+        pos += got;
+    }
+
+    return pos;
+}
+
+
 /**
  * virRotatingFileReaderSeek
  * @file: the file context
@@ -500,7 +760,7 @@ virRotatingFileWriterAppend(virRotatingFileWriter *file,
  *
  * Seek to @offset in the file identified by @inode.
  * If no file with a inode matching @inode currently
- * exists, then seeks to the start of the oldest
+ * exists, then seeks to @offset in the oldest existing
  * file, on the basis that the requested file has
  * probably been rotated out of existence
  */
@@ -514,11 +774,17 @@ virRotatingFileReaderSeek(virRotatingFileReader *file,
 
     for (i = 0; i < file->nentries; i++) {
         virRotatingFileReaderEntry *entry = file->entries[i];
-        if (entry->inode != inode ||
-            entry->fd == -1)
+        if (!entry->exists ||
+            entry->inode != inode)
             continue;
 
-        ret = lseek(entry->fd, offset, SEEK_SET);
+        if (virRotatingFileReaderEntryOpen(entry) < 0)
+            return -1;
+
+        if (entry->fd == -1)
+            continue;
+
+        ret = virRotatingFileReaderEntrySeek(entry, offset);
         if (ret == (off_t)-1) {
             virReportSystemError(errno,
                                  _("Unable to seek to inode %llu offset %llu"),
@@ -530,14 +796,27 @@ virRotatingFileReaderSeek(virRotatingFileReader *file,
         return 0;
     }
 
-    file->current = 0;
-    ret = lseek(file->entries[0]->fd, offset, SEEK_SET);
-    if (ret == (off_t)-1) {
-        virReportSystemError(errno,
-                             _("Unable to seek to inode %llu offset %llu"),
-                             (unsigned long long)inode, (unsigned long long)offset);
-        return -1;
+    for (i = 0; i < file->nentries; i++) {
+        virRotatingFileReaderEntry *entry = file->entries[i];
+
+        if (virRotatingFileReaderEntryOpen(entry) < 0)
+            return -1;
+
+        if (entry->fd == -1)
+            continue;
+
+        file->current = i;
+        ret = virRotatingFileReaderEntrySeek(entry, offset);
+        if (ret == (off_t)-1) {
+            virReportSystemError(errno,
+                                 _("Unable to seek to inode %llu offset %llu"),
+                                 (unsigned long long)inode, (unsigned long long)offset);
+            return -1;
+        }
+        return 0;
     }
+
+    file->current = file->nentries;
     return 0;
 }
 
@@ -569,6 +848,9 @@ virRotatingFileReaderConsume(virRotatingFileReader *file,
             break;
 
         entry = file->entries[file->current];
+        if (virRotatingFileReaderEntryOpen(entry) < 0)
+            return -1;
+
         if (entry->fd == -1) {
             file->current++;
             continue;
@@ -607,6 +889,7 @@ virRotatingFileWriterFree(virRotatingFileWriter *file)
     if (!file)
         return;
 
+    virRotatingFileWriterCompressWait(file);
     virRotatingFileWriterEntryFree(file->entry);
     g_free(file->basepath);
     g_free(file);
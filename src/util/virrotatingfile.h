@@ -22,6 +22,18 @@
 #pragma once
 
 #include "internal.h"
+#include "virenum.h"
+
+typedef enum {
+    VIR_ROTATING_FILE_COMPRESSION_NONE = 0,
+    VIR_ROTATING_FILE_COMPRESSION_GZIP,
+    VIR_ROTATING_FILE_COMPRESSION_XZ,
+    VIR_ROTATING_FILE_COMPRESSION_ZSTD,
+
+    VIR_ROTATING_FILE_COMPRESSION_LAST
+} virRotatingFileCompression;
+
+VIR_ENUM_DECL(virRotatingFileCompression);
 
 typedef struct virRotatingFileWriter virRotatingFileWriter;
 
@@ -33,6 +45,9 @@ virRotatingFileWriter *virRotatingFileWriterNew(const char *path,
                                                   bool trunc,
                                                   mode_t mode);
 
+void virRotatingFileWriterSetCompression(virRotatingFileWriter *file,
+                                         virRotatingFileCompression compression);
+
 virRotatingFileReader *virRotatingFileReaderNew(const char *path,
                                                   size_t maxbackup);
 
@@ -24,8 +24,10 @@
 #include "datatypes.h"
 #include "viralloc.h"
 #include "virerror.h"
+#include "virhash.h"
 #include "virlog.h"
 #include "virsecret.h"
+#include "virsecureerase.h"
 #include "virstring.h"
 #include "viruuid.h"
 
@@ -185,3 +187,124 @@ virSecretGetSecretString(virConnectPtr conn,
     virObjectUnref(sec);
     return ret;
 }
+
+
+typedef struct _virSecretCacheEntry virSecretCacheEntry;
+struct _virSecretCacheEntry {
+    uint8_t *value;     /* allocated by virSecureAlloc */
+    size_t size;
+};
+
+struct _virSecretCache {
+    virSecretCacheConnectFunc connect;
+    virConnectPtr conn;
+
+    /* "usage type/uuid" or "usage type/usage" -> virSecretCacheEntry */
+    GHashTable *values;
+};
+
+
+static void
+virSecretCacheEntryFree(void *opaque)
+{
+    virSecretCacheEntry *entry = opaque;
+
+    virSecureFree(entry->value, entry->size);
+    g_free(entry);
+}
+
+
+/**
+ * virSecretCacheNew:
+ * @connect: function opening a connection to the secret driver
+ *
+ * Creates a cache of secret values for callers which need many secrets
+ * in a row, such as when starting a domain with lots of network disks
+ * sharing their credentials. The secret driver is connected to once,
+ * on the first lookup, and every secret is fetched from it just once.
+ *
+ * The values are kept in locked memory until the cache is freed, which
+ * is why the cache is meant to be short lived. It doesn't notice secrets
+ * being changed or undefined.
+ */
+virSecretCache *
+virSecretCacheNew(virSecretCacheConnectFunc connect)
+{
+    virSecretCache *cache = g_new0(virSecretCache, 1);
+
+    cache->connect = connect;
+    cache->values = virHashNew(virSecretCacheEntryFree);
+
+    return cache;
+}
+
+
+void
+virSecretCacheFree(virSecretCache *cache)
+{
+    if (!cache)
+        return;
+
+    g_clear_pointer(&cache->values, g_hash_table_unref);
+    virObjectUnref(cache->conn);
+    g_free(cache);
+}
+
+
+/* virSecretCacheGetSecretString:
+ * @cache: secret cache
+ * @seclookupdef: Secret lookup def
+ * @secretUsageType: Type of secret usage for usage lookup
+ * @secret: returned secret as a sized stream of unsigned chars
+ * @secret_size: Return size of the secret
+ *
+ * Same as virSecretGetSecretString, except that the secret driver is
+ * asked only for secrets which are not in @cache yet.
+ *
+ * Returns 0 on success, -1 on failure.  On success the memory in secret
+ * needs to be cleared and free'd after usage.
+ */
+int
+virSecretCacheGetSecretString(virSecretCache *cache,
+                              virSecretLookupTypeDef *seclookupdef,
+                              virSecretUsageType secretUsageType,
+                              uint8_t **secret,
+                              size_t *secret_size)
+{
+    char uuidstr[VIR_UUID_STRING_BUFLEN] = "";
+    g_autofree char *key = NULL;
+    g_autofree uint8_t *value = NULL;
+    virSecretCacheEntry *entry;
+    size_t size = 0;
+
+    if (seclookupdef->type == VIR_SECRET_LOOKUP_TYPE_UUID)
+        virUUIDFormat(seclookupdef->u.uuid, uuidstr);
+
+    key = g_strdup_printf("%s/%s",
+                          virSecretUsageTypeToString(secretUsageType),
+                          seclookupdef->type == VIR_SECRET_LOOKUP_TYPE_UUID ?
+                          uuidstr : seclookupdef->u.usage);
+
+    if (!(entry = virHashLookup(cache->values, key))) {
+        if (!cache->conn && !(cache->conn = cache->connect()))
+            return -1;
+
+        if (virSecretGetSecretString(cache->conn, seclookupdef,
+                                     secretUsageType, &value, &size) < 0)
+            return -1;
+
+        entry = g_new0(virSecretCacheEntry, 1);
+        entry->value = virSecureAlloc(size);
+        entry->size = size;
+        memcpy(entry->value, value, size);
+        virSecureErase(value, size);
+
+        g_hash_table_insert(cache->values, g_steal_pointer(&key), entry);
+    }
+
+    *secret = g_new0(uint8_t, entry->size);
+    memcpy(*secret, entry->value, entry->size);
+    *secret_size = entry->size;
+
+    return 0;
+}
@@ -62,3 +62,19 @@ int virSecretGetSecretString(virConnectPtr conn,
                              size_t *ret_secret_size)
     ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2) ATTRIBUTE_NONNULL(4)
     ATTRIBUTE_NONNULL(5) G_GNUC_WARN_UNUSED_RESULT;
+
+typedef virConnectPtr (*virSecretCacheConnectFunc)(void);
+
+typedef struct _virSecretCache virSecretCache;
+
+virSecretCache *virSecretCacheNew(virSecretCacheConnectFunc connect);
+void virSecretCacheFree(virSecretCache *cache);
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(virSecretCache, virSecretCacheFree);
+
+int virSecretCacheGetSecretString(virSecretCache *cache,
+                                  virSecretLookupTypeDef *seclookupdef,
+                                  virSecretUsageType secretUsageType,
+                                  uint8_t **secret,
+                                  size_t *secret_size)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2) ATTRIBUTE_NONNULL(4)
+    ATTRIBUTE_NONNULL(5) G_GNUC_WARN_UNUSED_RESULT;
@@ -19,7 +19,17 @@
 
 #include <config.h>
 
+#if WITH_MMAP
+# include <sys/mman.h>
+#endif
+
 #include "virsecureerase.h"
+#include "virlog.h"
+#include "virutil.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+VIR_LOG_INIT("util.secureerase");
 
 /**
  * virSecureErase:
@@ -55,3 +65,81 @@ virSecureEraseString(char *str)
 
     virSecureErase(str, strlen(str));
 }
+
+
+#if WITH_MMAP
+static size_t
+virSecureAllocLength(size_t size)
+{
+    long pagesize = virGetSystemPageSize();
+
+    return VIR_ROUND_UP(MAX(size, 1), pagesize);
+}
+
+
+/**
+ * virSecureAlloc:
+ * @size: number of bytes to allocate
+ *
+ * Allocates zeroed memory for holding secrets. The memory gets pages of its
+ * own which are locked in RAM, if the limit of locked memory allows it, and
+ * excluded from core dumps. Like other allocations this aborts on failure.
+ *
+ * Returns the memory, which must be freed by virSecureFree.
+ */
+void *
+virSecureAlloc(size_t size)
+{
+    size_t length = virSecureAllocLength(size);
+    void *ptr;
+
+    if ((ptr = mmap(NULL, length, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED)
+        abort();
+
+    if (mlock(ptr, length) < 0)
+        VIR_DEBUG("Unable to lock secret memory: %s", g_strerror(errno));
+
+# ifdef MADV_DONTDUMP
+    ignore_value(madvise(ptr, length, MADV_DONTDUMP));
+# endif
+
+    return ptr;
+}
+
+
+/**
+ * virSecureFree:
+ * @ptr: memory allocated by virSecureAlloc
+ * @size: the size @ptr was allocated with
+ *
+ * Clears and frees @ptr.
+ */
+void
+virSecureFree(void *ptr,
+              size_t size)
+{
+    if (!ptr)
+        return;
+
+    virSecureErase(ptr, size);
+    munmap(ptr, virSecureAllocLength(size));
+}
+
+#else /* !WITH_MMAP */
+
+void *
+virSecureAlloc(size_t size)
+{
+    return g_malloc0(size);
+}
+
+
+void
+virSecureFree(void *ptr,
+              size_t size)
+{
+    virSecureErase(ptr, size);
+    g_free(ptr);
+}
+#endif /* !WITH_MMAP */
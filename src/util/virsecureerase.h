@@ -26,3 +26,9 @@ virSecureErase(void *ptr, size_t size);
 
 void
 virSecureEraseString(char *str);
+
+void *
+virSecureAlloc(size_t size);
+
+void
+virSecureFree(void *ptr, size_t size);
@@ -0,0 +1,334 @@
+/*
+ * virshmring.c: ring of records in shared memory
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <config.h>
+
+#include <fcntl.h>
+#if WITH_MMAP
+# include <sys/mman.h>
+#endif
+
+#include "virshmring.h"
+#include "virerror.h"
+#include "virfile.h"
+#include "virlog.h"
+#include "virutil.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+VIR_LOG_INIT("util.shmring");
+
+/*
+ * The ring has a single writer, the process which created it, and any
+ * number of readers which never write to it, so that they don't need
+ * to make any system calls to read. The writer overwrites the oldest
+ * records when the ring is full instead of waiting for the readers,
+ * which must cope with losing records if they can't keep up.
+ */
+struct _virShmRing {
+    virObjectLockable parent;
+
+    int fd;
+    void *map;
+    size_t maplen;
+
+    virShmRingHeader *header;
+    char *data;
+    unsigned long long size;
+
+    /* The writer's copies of the positions in the header */
+    unsigned long long head;
+    unsigned long long tail;
+};
+
+static virClass *virShmRingClass;
+
+
+static void
+virShmRingDispose(void *obj)
+{
+    virShmRing *ring = obj;
+
+#if WITH_MMAP
+    if (ring->map)
+        munmap(ring->map, ring->maplen);
+#endif
+    VIR_FORCE_CLOSE(ring->fd);
+}
+
+
+static int
+virShmRingOnceInit(void)
+{
+    if (!VIR_CLASS_NEW(virShmRing, virClassForObjectLockable()))
+        return -1;
+
+    return 0;
+}
+
+
+VIR_ONCE_GLOBAL_INIT(virShmRing);
+
+
+#if WITH_MEMFD_CREATE && WITH_MMAP
+/**
+ * virShmRingNew:
+ * @name: name of the memory, only used for debugging
+ * @magic: magic number identifying the records
+ * @version: version of the layout of the records
+ * @size: size of the data area, a power of two
+ *
+ * Creates a ring in anonymous shared memory which can be handed to
+ * other processes with virShmRingGetReadOnlyFD(). The memory is sealed
+ * so that its size can't be changed by anyone.
+ *
+ * Returns the ring or NULL on error.
+ */
+virShmRing *
+virShmRingNew(const char *name,
+              unsigned int magic,
+              unsigned int version,
+              size_t size)
+{
+    g_autoptr(virShmRing) ring = NULL;
+    long pagesize = virGetSystemPageSize();
+    int seals = F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL;
+
+    if (size < (size_t)pagesize || (size & (size - 1)) != 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("invalid size %zu of shared memory ring"), size);
+        return NULL;
+    }
+
+    if (virShmRingInitialize() < 0)
+        return NULL;
+
+    if (!(ring = virObjectLockableNew(virShmRingClass)))
+        return NULL;
+
+    ring->size = size;
+    ring->maplen = pagesize + size;
+
+    if ((ring->fd = memfd_create(name, MFD_CLOEXEC | MFD_ALLOW_SEALING)) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("unable to create shared memory"));
+        ring->fd = -1;
+        return NULL;
+    }
+
+    if (ftruncate(ring->fd, ring->maplen) < 0) {
+        virReportSystemError(errno,
+                             _("unable to resize shared memory to %zu bytes"),
+                             ring->maplen);
+        return NULL;
+    }
+
+    if ((ring->map = mmap(NULL, ring->maplen, PROT_READ | PROT_WRITE,
+                          MAP_SHARED, ring->fd, 0)) == MAP_FAILED) {
+        virReportSystemError(errno, "%s",
+                             _("unable to map shared memory"));
+        ring->map = NULL;
+        return NULL;
+    }
+
+# ifdef F_SEAL_FUTURE_WRITE
+    /* Keeps everyone but the mapping above from writing, even those who
+     * manage to open the memory for writing again */
+    if (fcntl(ring->fd, F_ADD_SEALS, seals | F_SEAL_FUTURE_WRITE) == 0)
+        seals = 0;
+# endif
+
+    if (seals != 0 && fcntl(ring->fd, F_ADD_SEALS, seals) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("unable to seal shared memory"));
+        return NULL;
+    }
+
+    ring->header = ring->map;
+    ring->data = (char *)ring->map + pagesize;
+
+    ring->header->magic = magic;
+    ring->header->version = version;
+    ring->header->offset = pagesize;
+    ring->header->size = size;
+
+    VIR_DEBUG("Created shared memory ring '%s' of %zu bytes", name, size);
+
+    return g_steal_pointer(&ring);
+}
+#else /* !(WITH_MEMFD_CREATE && WITH_MMAP) */
+virShmRing *
+virShmRingNew(const char *name G_GNUC_UNUSED,
+              unsigned int magic G_GNUC_UNUSED,
+              unsigned int version G_GNUC_UNUSED,
+              size_t size G_GNUC_UNUSED)
+{
+    virReportSystemError(ENOSYS, "%s",
+                         _("shared memory rings are not supported on this platform"));
+    return NULL;
+}
+#endif /* !(WITH_MEMFD_CREATE && WITH_MMAP) */
+
+
+/**
+ * virShmRingGetReadOnlyFD:
+ * @ring: ring
+ *
+ * Opens the shared memory of @ring again for reading only, so that the
+ * file descriptor can be passed to a reader which is not trusted to
+ * keep the records intact.
+ *
+ * Returns the new file descriptor, which the caller must close, or -1
+ * on error.
+ */
+int
+virShmRingGetReadOnlyFD(virShmRing *ring)
+{
+    g_autofree char *path = g_strdup_printf("/proc/self/fd/%d", ring->fd);
+    int fd;
+
+    if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("unable to open shared memory for reading"));
+        return -1;
+    }
+
+    return fd;
+}
+
+
+static virShmRingRecord *
+virShmRingRecordAt(virShmRing *ring,
+                   unsigned long long pos)
+{
+    void *record = ring->data + (pos & (ring->size - 1));
+
+    return record;
+}
+
+
+/* Returns the length of the record at @pos, or 0 if it's not a valid
+ * record. Readers may be able to write the shared memory if it could not
+ * be sealed for future writes, so the length has to be checked before
+ * trusting it to find the next record. */
+static unsigned int
+virShmRingRecordLength(virShmRing *ring,
+                       unsigned long long pos)
+{
+    unsigned long long offset = pos & (ring->size - 1);
+    unsigned int length;
+
+    length = __atomic_load_n(&virShmRingRecordAt(ring, pos)->length,
+                             __ATOMIC_RELAXED);
+
+    if (length < sizeof(virShmRingRecord) ||
+        length % VIR_SHM_RING_ALIGN != 0 ||
+        length > ring->size - offset ||
+        length > ring->head - pos)
+        return 0;
+
+    return length;
+}
+
+
+/* Drops the oldest records until the ring has room for everything
+ * before @end. Readers learn about it before the records are
+ * overwritten. */
+static void
+virShmRingMakeRoom(virShmRing *ring,
+                   unsigned long long end)
+{
+    if (end - ring->tail <= ring->size)
+        return;
+
+    do {
+        unsigned int length = virShmRingRecordLength(ring, ring->tail);
+
+        if (length == 0) {
+            VIR_WARN("shared memory ring was corrupted, dropping all records");
+            ring->tail = ring->head;
+            break;
+        }
+
+        ring->tail += length;
+    } while (end - ring->tail > ring->size);
+
+    __atomic_store_n(&ring->header->tail, ring->tail, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+
+/**
+ * virShmRingAppend:
+ * @ring: ring
+ * @type: type of the record
+ * @record: the record, starting with room for virShmRingRecord
+ * @len: length of @record
+ *
+ * Appends a record to @ring, overwriting the oldest records if there's
+ * not enough free space. The header of the record is filled in here,
+ * and the record is padded to a multiple of VIR_SHM_RING_ALIGN.
+ *
+ * Returns 0 on success, -1 if the record is too large for @ring.
+ */
+int
+virShmRingAppend(virShmRing *ring,
+                 unsigned int type,
+                 void *record,
+                 size_t len)
+{
+    virShmRingRecord *hdr = record;
+    size_t length = VIR_ROUND_UP(len, VIR_SHM_RING_ALIGN);
+    VIR_LOCK_GUARD lock = virObjectLockGuard(ring);
+    unsigned long long pos = ring->head;
+    size_t avail;
+
+    if (len < sizeof(*hdr) || length > ring->size / 2) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("record of %zu bytes doesn't fit in shared memory ring"),
+                       len);
+        return -1;
+    }
+
+    hdr->length = length;
+    hdr->type = type;
+
+    /* Records are never split, the end of the data area is skipped if
+     * the record doesn't fit there */
+    avail = ring->size - (pos & (ring->size - 1));
+    if (avail < length) {
+        virShmRingRecord *padding;
+
+        virShmRingMakeRoom(ring, pos + avail);
+        padding = virShmRingRecordAt(ring, pos);
+        padding->length = avail;
+        padding->type = VIR_SHM_RING_RECORD_PADDING;
+        pos += avail;
+    }
+
+    virShmRingMakeRoom(ring, pos + length);
+    memcpy(virShmRingRecordAt(ring, pos), record, len);
+    memset((char *)virShmRingRecordAt(ring, pos) + len, 0, length - len);
+    pos += length;
+
+    ring->head = pos;
+    __atomic_store_n(&ring->header->head, pos, __ATOMIC_RELEASE);
+
+    return 0;
+}
@@ -0,0 +1,70 @@
+/*
+ * virshmring.h: ring of records in shared memory
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include "internal.h"
+#include "virobject.h"
+
+/* Every record starts at a multiple of this */
+#define VIR_SHM_RING_ALIGN 8
+
+/* Type of the records filling the end of the data area when the next
+ * record doesn't fit there */
+#define VIR_SHM_RING_RECORD_PADDING 0
+
+/*
+ * The shared memory starts with the header, the data area starts at
+ * @offset. Positions in the ring count the bytes written since it was
+ * created, the record at position P starts at byte (P % @size) of the
+ * data area. Readers must load @head with acquire semantics before
+ * reading the records before it, then load @tail, again with acquire
+ * semantics, after copying a record out to make sure it wasn't
+ * overwritten meanwhile.
+ */
+typedef struct _virShmRingHeader virShmRingHeader;
+struct _virShmRingHeader {
+    unsigned int magic;
+    unsigned int version;
+    unsigned long long offset; /* of the data area */
+    unsigned long long size; /* of the data area, a power of two */
+    unsigned long long head; /* position following the newest record */
+    unsigned long long tail; /* position of the oldest record */
+};
+
+typedef struct _virShmRingRecord virShmRingRecord;
+struct _virShmRingRecord {
+    unsigned int length; /* including the header, a multiple of VIR_SHM_RING_ALIGN */
+    unsigned int type;
+};
+
+typedef struct _virShmRing virShmRing;
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(virShmRing, virObjectUnref);
+
+virShmRing *virShmRingNew(const char *name,
+                          unsigned int magic,
+                          unsigned int version,
+                          size_t size);
+
+int virShmRingGetReadOnlyFD(virShmRing *ring);
+
+int virShmRingAppend(virShmRing *ring,
+                     unsigned int type,
+                     void *record,
+                     size_t len);
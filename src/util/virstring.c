@@ -1066,3 +1066,199 @@ virStringParseVersion(unsigned long *version,
 
     return 0;
 }
+
+
+/**
+ * virStringViewInit:
+ * @view: view to initialize
+ * @str: NUL terminated string
+ *
+ * Makes @view refer to the whole of @str, which has to outlive @view.
+ */
+void
+virStringViewInit(virStringView *view,
+                  const char *str)
+{
+    view->str = str;
+    view->len = strlen(str);
+}
+
+
+/**
+ * virStringViewNextToken:
+ * @rest: the remainder of the string to split
+ * @delims: the characters separating the tokens
+ * @token: filled with the next token
+ *
+ * Splits the next token off @rest, skipping any leading delimiters, and
+ * advances @rest past it. Unlike g_strsplit() nothing is allocated or
+ * modified and empty tokens are never returned.
+ *
+ * Returns true if a token was found, false if @rest is exhausted.
+ */
+bool
+virStringViewNextToken(virStringView *rest,
+                       const char *delims,
+                       virStringView *token)
+{
+    size_t skip = 0;
+    size_t len = 0;
+
+    while (skip < rest->len && strchr(delims, rest->str[skip]))
+        skip++;
+
+    while (skip + len < rest->len && !strchr(delims, rest->str[skip + len]))
+        len++;
+
+    token->str = rest->str + skip;
+    token->len = len;
+
+    rest->str += skip + len;
+    rest->len -= skip + len;
+
+    return len > 0;
+}
+
+
+/**
+ * virStringViewEqual:
+ * @view: the view
+ * @str: NUL terminated string
+ *
+ * Returns true if @view matches @str exactly.
+ */
+bool
+virStringViewEqual(const virStringView *view,
+                   const char *str)
+{
+    return strncmp(view->str, str, view->len) == 0 && str[view->len] == '\0';
+}
+
+
+/**
+ * virStringViewSkipPrefix:
+ * @view: the view
+ * @prefix: NUL terminated prefix
+ *
+ * If @view starts with @prefix, advances @view past it.
+ *
+ * Returns true if @prefix was skipped, false otherwise.
+ */
+bool
+virStringViewSkipPrefix(virStringView *view,
+                        const char *prefix)
+{
+    size_t len = strlen(prefix);
+
+    if (len > view->len || memcmp(view->str, prefix, len) != 0)
+        return false;
+
+    view->str += len;
+    view->len -= len;
+    return true;
+}
+
+
+/**
+ * virStringViewToULL:
+ * @view: the view
+ * @result: filled with the number
+ *
+ * Parses the whole of @view as an unsigned decimal number. Unlike
+ * virStrToLong_ull(), neither a sign nor leading spaces are accepted.
+ *
+ * Returns 0 on success, -1 if @view is not a number or the number
+ * doesn't fit.
+ */
+int
+virStringViewToULL(const virStringView *view,
+                   unsigned long long *result)
+{
+    unsigned long long val = 0;
+    size_t i;
+
+    if (view->len == 0)
+        return -1;
+
+    for (i = 0; i < view->len; i++) {
+        unsigned int digit = view->str[i] - '0';
+
+        if (digit > 9)
+            return -1;
+
+        if (val > (ULLONG_MAX - digit) / 10)
+            return -1;
+
+        val = val * 10 + digit;
+    }
+
+    *result = val;
+    return 0;
+}
+
+
+/**
+ * virStringViewToLL:
+ * @view: the view
+ * @result: filled with the number
+ *
+ * Same as virStringViewToULL() for a signed decimal number with an
+ * optional leading '-'.
+ *
+ * Returns 0 on success, -1 if @view is not a number or the number
+ * doesn't fit.
+ */
+int
+virStringViewToLL(const virStringView *view,
+                  long long *result)
+{
+    virStringView digits = *view;
+    unsigned long long val;
+    bool negative = virStringViewSkipPrefix(&digits, "-");
+
+    if (virStringViewToULL(&digits, &val) < 0)
+        return -1;
+
+    if (negative) {
+        if (val > (unsigned long long) LLONG_MAX + 1)
+            return -1;
+        /* written so that LLONG_MIN doesn't overflow */
+        *result = -(long long) (val - 1) - 1;
+    } else {
+        if (val > LLONG_MAX)
+            return -1;
+        *result = val;
+    }
+
+    return 0;
+}
+
+
+/**
+ * virStringViewToDouble:
+ * @view: the view
+ * @result: filled with the number
+ *
+ * Parses the whole of @view as a floating point number the same way
+ * virStrToDouble() does, using a buffer on the stack.
+ *
+ * Returns 0 on success, -1 if @view is not a number.
+ */
+int
+virStringViewToDouble(const virStringView *view,
+                      double *result)
+{
+    char buf[64];
+    char *end;
+
+    if (view->len == 0 || view->len >= sizeof(buf))
+        return -1;
+
+    memcpy(buf, view->str, view->len);
+    buf[view->len] = '\0';
+
+    if (virStrToDouble(buf, &end, result) < 0 || *end != '\0')
+        return -1;
+
+    return 0;
+}
@@ -139,3 +139,34 @@ int virStringParseYesNo(const char *str,
 int virStringParseVersion(unsigned long *version,
                           const char *str,
                           bool allowMissing);
+
+/* A part of a string that isn't necessarily NUL terminated, so that
+ * strings can be split and parsed in place */
+typedef struct _virStringView virStringView;
+struct _virStringView {
+    const char *str;
+    size_t len;
+};
+
+void virStringViewInit(virStringView *view,
+                       const char *str)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
+bool virStringViewNextToken(virStringView *rest,
+                            const char *delims,
+                            virStringView *token)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2) ATTRIBUTE_NONNULL(3);
+bool virStringViewEqual(const virStringView *view,
+                        const char *str)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
+bool virStringViewSkipPrefix(virStringView *view,
+                             const char *prefix)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
+int virStringViewToULL(const virStringView *view,
+                       unsigned long long *result)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2) G_GNUC_WARN_UNUSED_RESULT;
+int virStringViewToLL(const virStringView *view,
+                      long long *result)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2) G_GNUC_WARN_UNUSED_RESULT;
+int virStringViewToDouble(const virStringView *view,
+                          double *result)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2) G_GNUC_WARN_UNUSED_RESULT;
@@ -220,25 +220,22 @@ size_t virThreadMaxName(void)
 #endif
 }
 
-static void *virThreadHelper(void *data)
+/**
+ * virThreadSetName:
+ * @name: new name of the thread
+ *
+ * Sets the name of the current thread shown by tools like top or perf,
+ * truncated to the length the platform allows.
+ */
+void virThreadSetName(const char *name)
 {
-    struct virThreadArgs *args = data;
-    struct virThreadArgs local = *args;
     g_autofree char *thname = NULL;
     size_t maxname = virThreadMaxName();
 
-    /* Free args early, rather than tying it up during the entire thread.  */
-    g_free(args);
-
-    if (local.worker)
-        virThreadJobSetWorker(local.name);
-    else
-        virThreadJobSet(local.name);
-
     if (maxname) {
-        thname = g_strndup(local.name, maxname);
+        thname = g_strndup(name, maxname);
     } else {
-        thname = g_strdup(local.name);
+        thname = g_strdup(name);
     }
 
 #if defined(__linux__) || defined(WIN32)
@@ -252,6 +249,22 @@ static void *virThreadHelper(void *data)
 #  endif
 # endif
 #endif
+}
+
+static void *virThreadHelper(void *data)
+{
+    struct virThreadArgs *args = data;
+    struct virThreadArgs local = *args;
+
+    /* Free args early, rather than tying it up during the entire thread.  */
+    g_free(args);
+
+    if (local.worker)
+        virThreadJobSetWorker(local.name);
+    else
+        virThreadJobSet(local.name);
+
+    virThreadSetName(local.name);
 
     local.func(local.opaque);
 
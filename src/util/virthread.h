@@ -91,6 +91,7 @@ bool virThreadIsSelf(virThread *thread);
 void virThreadJoin(virThread *thread);
 
 size_t virThreadMaxName(void);
+void virThreadSetName(const char *name);
 
 /* This API is *NOT* for general use. It exists solely as a stub
  * for integration with libselinux AVC callbacks */
@@ -31,13 +31,15 @@ VIR_LOG_INIT("util.threadjob");
 
 virThreadLocal virThreadJobWorker;
 virThreadLocal virThreadJobName;
+virThreadLocal virThreadJobTracker;
 
 
 static int
 virThreadJobOnceInit(void)
 {
     if (virThreadLocalInit(&virThreadJobWorker, NULL) < 0 ||
-        virThreadLocalInit(&virThreadJobName, NULL) < 0)
+        virThreadLocalInit(&virThreadJobName, NULL) < 0 ||
+        virThreadLocalInit(&virThreadJobTracker, NULL) < 0)
         return -1;
     return 0;
 }
@@ -76,6 +78,54 @@ virThreadJobSetWorker(const char *worker)
 }
 
 
+/**
+ * virThreadJobTrack:
+ * @job: where to store the job of the current thread
+ *
+ * Makes virThreadJobSet and virThreadJobClear store the job the current
+ * thread is running in @job, so that other threads can read it with
+ * g_atomic_pointer_get as long as this thread is running. Passing NULL
+ * stops the tracking.
+ */
+void
+virThreadJobTrack(const char **job)
+{
+    if (virThreadJobInitialize() < 0)
+        return;
+
+    if (virThreadLocalSet(&virThreadJobTracker, job) < 0)
+        virReportSystemError(errno, "%s", _("cannot track current job"));
+}
+
+
+static void
+virThreadJobUpdateTracker(const char *job)
+{
+    const char **tracker = virThreadLocalGet(&virThreadJobTracker);
+
+    if (tracker)
+        g_atomic_pointer_set(tracker, job);
+}
+
+
+/*
+ * Names of RPC dispatchers like remoteDispatchDomainGetInfo don't fit in
+ * the thread name limit of most platforms, keep just the procedure.
+ */
+static void
+virThreadJobSetThreadName(const char *job)
+{
+    const char *procedure = strstr(job, "Dispatch");
+
+    if (procedure && procedure[strlen("Dispatch")])
+        procedure += strlen("Dispatch");
+    else
+        procedure = job;
+
+    virThreadSetName(procedure);
+}
+
+
 void
 virThreadJobSet(const char *caller)
 {
@@ -89,7 +139,12 @@ virThreadJobSet(const char *caller)
                              _("cannot set current job to %s"),
                              caller);
 
+    virThreadJobUpdateTracker(caller);
+
+    /* Workers are named after the pool they belong to, rename them for
+     * the time of the job so that profiles show what they're doing */
     if ((worker = virThreadLocalGet(&virThreadJobWorker))) {
+        virThreadJobSetThreadName(caller);
         VIR_DEBUG("Thread %llu (%s) is now running job %s",
                   virThreadSelfID(), worker, caller);
     } else {
@@ -114,7 +169,10 @@ virThreadJobClear(int rv)
     if (virThreadLocalSet(&virThreadJobName, NULL) < 0)
         virReportSystemError(errno, "%s", _("cannot reset current job"));
 
+    virThreadJobUpdateTracker(NULL);
+
     if ((worker = virThreadLocalGet(&virThreadJobWorker))) {
+        virThreadSetName(worker);
         VIR_DEBUG("Thread %llu (%s) finished job %s with ret=%d",
                   virThreadSelfID(), worker, old, rv);
     } else {
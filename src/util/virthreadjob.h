@@ -25,3 +25,5 @@ const char *virThreadJobGet(void);
 void virThreadJobSetWorker(const char *caller);
 void virThreadJobSet(const char *caller);
 void virThreadJobClear(int rv);
+
+void virThreadJobTrack(const char **job);
@@ -22,18 +22,26 @@
 
 #include <config.h>
 
+#include <unistd.h>
+#include <time.h>
+
 #include "virthreadpool.h"
 #include "viralloc.h"
 #include "virthread.h"
 #include "virerror.h"
+#include "virtime.h"
+#include "virthreadjob.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
 
+#define VIR_THREAD_POOL_MAX_QUEUES 256
+
 typedef struct _virThreadPoolJob virThreadPoolJob;
 struct _virThreadPoolJob {
     virThreadPoolJob *prev;
     virThreadPoolJob *next;
-    unsigned int priority;
+    unsigned int jobClass;
+    gint64 queued;
 
     void *data;
 };
@@ -42,18 +50,72 @@ typedef struct _virThreadPoolJobList virThreadPoolJobList;
 struct _virThreadPoolJobList {
     virThreadPoolJob *head;
     virThreadPoolJob *tail;
-    virThreadPoolJob *firstPrio;
 };
 
+typedef struct _virThreadPoolWaitStats virThreadPoolWaitStats;
+struct _virThreadPoolWaitStats {
+    unsigned long long jobs;
+    unsigned long long waitTime;
+    unsigned long long maxWaitTime;
+};
+
+/* Every job belongs to a class. A class may have workers reserved for it,
+ * which only run jobs of that class. Jobs of non-exclusive classes are run
+ * by the ordinary workers as well, jobs of exclusive classes only by the
+ * reserved workers. The default class has no reserved workers. Classes
+ * are never freed before the pool itself and all their fields are
+ * protected by the pool mutex. */
+typedef struct _virThreadPoolClass virThreadPoolClass;
+struct _virThreadPoolClass {
+    char *name;
+    bool exclusive;
+
+    virThreadPoolJobList jobList;
+    size_t jobQueueDepth;
+    virThreadPoolWaitStats stats;
+
+    size_t maxWorkers;
+    size_t nWorkers;
+    virThread *workers;
+    virCond cond;
+};
+
+/* A per worker group queue of ordinary jobs. Workers are spread over the
+ * queues and prefer their own queue, but an idle worker steals jobs from
+ * the tail of any other queue before going to sleep. */
+typedef struct _virThreadPoolQueue virThreadPoolQueue;
+struct _virThreadPoolQueue {
+    virMutex mutex;
+    virCond cond;
+    virThreadPoolJobList jobList;
+    size_t jobQueueDepth;
+    virThreadPoolWaitStats stats;
+    size_t freeWorkers;
+    size_t wakeups;
+};
+
+/* A running worker, which lives on the stack of the worker thread and is
+ * registered in the pool while the thread runs. */
+typedef struct _virThreadPoolThread virThreadPoolThread;
+struct _virThreadPoolThread {
+    unsigned long long id;
+    virThreadPoolClass *cls; /* NULL for ordinary workers */
+    const char *job; /* updated atomically through virThreadJobTrack */
+    bool hasCPUClock;
+#if defined(_POSIX_THREAD_CPUTIME) && _POSIX_THREAD_CPUTIME >= 0
+    clockid_t cpuClock;
+#endif
+};
 
 struct _virThreadPool {
-    bool quit;
+    /* Set with @mutex held, but also read by workers holding just the
+     * mutex of a queue or none at all, so it's accessed atomically */
+    int quit;
 
     virThreadPoolJobFunc jobFunc;
     char *jobName;
     void *jobOpaque;
-    virThreadPoolJobList jobList;
-    size_t jobQueueDepth;
+    size_t jobQueueDepth; /* number of queued jobs of non-exclusive classes */
 
     virIdentity *identity;
 
@@ -67,16 +129,40 @@ struct _virThreadPool {
     size_t nWorkers;
     virThread *workers;
 
-    size_t maxPrioWorkers;
-    size_t nPrioWorkers;
-    virThread *prioWorkers;
-    virCond prioCond;
+    /* Ordinary workers above @minWorkers exit after being idle for
+     * @idleTimeout seconds, zero keeps them around forever */
+    unsigned int idleTimeout;
+    size_t trimWorkers; /* idle workers asked to exit by virThreadPoolTrim */
+    unsigned long long spawnedWorkers;
+    unsigned long long retiredWorkers;
+
+    virThreadPoolClass **classes;
+    size_t nclasses;
+    size_t nClassWorkers; /* number of reserved workers of all classes */
+
+    /* When @nqueues is non-zero, jobs of the default class are distributed
+     * over the first @nqueues entries of @queues instead of the job list
+     * of the class. The array is allocated with
+     * VIR_THREAD_POOL_MAX_QUEUES entries once and queues are never freed
+     * before the pool itself, so that workers can access them without
+     * holding @mutex. The following ints are accessed atomically. */
+    virThreadPoolQueue **queues;
+    int nqueues;
+    int nqueuesAlloc;
+    int nextQueue;
+    int nPending; /* number of jobs ordinary workers can take */
+    int generation; /* bumped whenever queues are reconfigured */
+    size_t nextWorkerID;
+
+    virThreadPoolThread **threads;
+    size_t nthreads;
 };
 
 struct virThreadPoolWorkerData {
     virThreadPool *pool;
     virCond *cond;
-    bool priority;
+    virThreadPoolClass *cls; /* NULL for ordinary workers */
+    size_t id;
 };
 
 /* Test whether the worker needs to quit if the current number of workers @count
@@ -87,20 +173,352 @@ static inline bool virThreadPoolWorkerQuitHelper(size_t count, size_t limit)
     return count > limit;
 }
 
+
+/*
+ * Returns the idle timeout in seconds after which an ordinary worker
+ * of @pool could be retired, zero if it can't. Must be called with
+ * pool->mutex held.
+ */
+static unsigned int
+virThreadPoolWorkerIdleTimeoutLocked(virThreadPool *pool)
+{
+    if (pool->nWorkers <= pool->minWorkers)
+        return 0;
+
+    return pool->idleTimeout;
+}
+
+
+/*
+ * Wait for @cond like virCondWait does, but give up after @idleTimeout
+ * seconds unless it is zero. Returns 1 if the worker timed out, 0 if it
+ * was woken up, -1 on error.
+ */
+static int
+virThreadPoolWorkerWait(virCond *cond,
+                        virMutex *mutex,
+                        unsigned int idleTimeout)
+{
+    unsigned long long now;
+
+    if (idleTimeout == 0 ||
+        virTimeMillisNow(&now) < 0)
+        return virCondWait(cond, mutex);
+
+    if (virCondWaitUntil(cond, mutex, now + idleTimeout * 1000ull) < 0) {
+        if (errno == ETIMEDOUT)
+            return 1;
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/*
+ * Decide whether an ordinary worker which just woke up, or timed out
+ * waiting for a job if @idle is true, should exit. Must be called with
+ * pool->mutex held.
+ */
+static bool
+virThreadPoolWorkerRetireLocked(virThreadPool *pool,
+                                bool idle)
+{
+    if (g_atomic_int_get(&pool->quit) ||
+        pool->nWorkers <= pool->minWorkers ||
+        g_atomic_int_get(&pool->nPending) > 0)
+        return false;
+
+    if (pool->trimWorkers > 0)
+        pool->trimWorkers--;
+    else if (!idle)
+        return false;
+
+    pool->retiredWorkers++;
+    return true;
+}
+
+
+static void
+virThreadPoolJobListAppend(virThreadPoolJobList *jobList,
+                           virThreadPoolJob *job)
+{
+    job->prev = jobList->tail;
+    if (jobList->tail)
+        jobList->tail->next = job;
+    jobList->tail = job;
+
+    if (!jobList->head)
+        jobList->head = job;
+}
+
+
+static void
+virThreadPoolJobListRemove(virThreadPoolJobList *jobList,
+                           virThreadPoolJob *job)
+{
+    if (job->prev)
+        job->prev->next = job->next;
+    else
+        jobList->head = job->next;
+    if (job->next)
+        job->next->prev = job->prev;
+    else
+        jobList->tail = job->prev;
+
+    job->prev = job->next = NULL;
+}
+
+
+static void
+virThreadPoolWaitStatsRecord(virThreadPoolWaitStats *stats,
+                             virThreadPoolJob *job)
+{
+    unsigned long long waitTime = g_get_monotonic_time() - job->queued;
+
+    stats->jobs++;
+    stats->waitTime += waitTime;
+    if (waitTime > stats->maxWaitTime)
+        stats->maxWaitTime = waitTime;
+}
+
+
+/*
+ * Take the next job for a worker reserved for @cls, or for an ordinary
+ * worker if @cls is NULL. Ordinary workers take the oldest job of all
+ * the non-exclusive classes. Must be called with pool->mutex held.
+ */
+static virThreadPoolJob *
+virThreadPoolTakeJobLocked(virThreadPool *pool,
+                           virThreadPoolClass *cls)
+{
+    virThreadPoolJob *job;
+    size_t i;
+
+    if (!cls) {
+        for (i = 0; i < pool->nclasses; i++) {
+            virThreadPoolClass *tmp = pool->classes[i];
+
+            if (tmp->exclusive || !tmp->jobList.head)
+                continue;
+
+            if (!cls || tmp->jobList.head->queued < cls->jobList.head->queued)
+                cls = tmp;
+        }
+    }
+
+    if (!cls || !(job = cls->jobList.head))
+        return NULL;
+
+    virThreadPoolJobListRemove(&cls->jobList, job);
+    cls->jobQueueDepth--;
+    virThreadPoolWaitStatsRecord(&cls->stats, job);
+
+    if (!cls->exclusive) {
+        pool->jobQueueDepth--;
+        g_atomic_int_add(&pool->nPending, -1);
+    }
+
+    return job;
+}
+
+
+/*
+ * Take a job from @queue. The owner of the queue takes the oldest job, a
+ * worker stealing from a foreign queue (@steal) takes the newest one.
+ */
+static virThreadPoolJob *
+virThreadPoolQueueTakeJob(virThreadPool *pool,
+                          virThreadPoolQueue *queue,
+                          bool steal)
+{
+    VIR_LOCK_GUARD lock = virLockGuardLock(&queue->mutex);
+    virThreadPoolJob *job;
+
+    if (steal)
+        job = queue->jobList.tail;
+    else
+        job = queue->jobList.head;
+
+    if (!job)
+        return NULL;
+
+    virThreadPoolJobListRemove(&queue->jobList, job);
+    queue->jobQueueDepth--;
+    virThreadPoolWaitStatsRecord(&queue->stats, job);
+    g_atomic_int_add(&pool->nPending, -1);
+
+    return job;
+}
+
+
+/* Must be called with queue->mutex held. Returns true if a sleeping
+ * worker was woken up. */
+static bool
+virThreadPoolQueueWakeLocked(virThreadPoolQueue *queue)
+{
+    if (queue->freeWorkers == 0)
+        return false;
+
+    queue->freeWorkers--;
+    queue->wakeups++;
+    virCondSignal(&queue->cond);
+    return true;
+}
+
+
+/* Wake up one sleeping worker from any queue, preferring @start. */
+static bool
+virThreadPoolWakeAnyQueue(virThreadPool *pool,
+                          size_t start)
+{
+    size_t nalloc = g_atomic_int_get(&pool->nqueuesAlloc);
+    size_t i;
+
+    for (i = 0; i < nalloc; i++) {
+        virThreadPoolQueue *queue = pool->queues[(start + i) % nalloc];
+        VIR_LOCK_GUARD lock = virLockGuardLock(&queue->mutex);
+
+        if (virThreadPoolQueueWakeLocked(queue))
+            return true;
+    }
+
+    return false;
+}
+
+
+/* Look for a job in the @home queue first and then try to steal one from
+ * the other queues. */
+static virThreadPoolJob *
+virThreadPoolFindQueuedJob(virThreadPool *pool,
+                           size_t home)
+{
+    size_t nalloc = g_atomic_int_get(&pool->nqueuesAlloc);
+    virThreadPoolJob *job;
+    size_t i;
+
+    if ((job = virThreadPoolQueueTakeJob(pool, pool->queues[home], false)))
+        return job;
+
+    for (i = 1; i < nalloc; i++) {
+        if ((job = virThreadPoolQueueTakeJob(pool,
+                                             pool->queues[(home + i) % nalloc],
+                                             true)))
+            return job;
+    }
+
+    return NULL;
+}
+
+
+/*
+ * Main loop of an ordinary worker while the pool uses per worker group
+ * queues. Must be called with pool->mutex held, which is dropped while
+ * the worker processes jobs from the queues; the mutex is only re-acquired
+ * once no queued job is found, so that busy workers don't contend on it.
+ * Returns with pool->mutex held once the worker should go back to the
+ * generic loop, true if it should exit since it's been idle for too long.
+ */
+static bool
+virThreadPoolWorkerQueues(virThreadPool *pool,
+                          size_t id)
+{
+    virThreadPoolJob *job;
+
+    while (!g_atomic_int_get(&pool->quit) &&
+           !virThreadPoolWorkerQuitHelper(pool->nWorkers, pool->maxWorkers)) {
+        size_t nqueues = g_atomic_int_get(&pool->nqueues);
+        int generation = g_atomic_int_get(&pool->generation);
+        virThreadPoolQueue *queue;
+        unsigned int idleTimeout;
+        size_t home;
+        bool idle = false;
+
+        if (nqueues == 0)
+            return false;
+
+        /* Jobs of the other classes and jobs left over from before the
+         * queues were enabled are still in the job lists of the classes */
+        if ((job = virThreadPoolTakeJobLocked(pool, NULL))) {
+            virMutexUnlock(&pool->mutex);
+            (pool->jobFunc)(job->data, pool->jobOpaque);
+            VIR_FREE(job);
+            virMutexLock(&pool->mutex);
+            continue;
+        }
+
+        home = id % nqueues;
+        queue = pool->queues[home];
+        /* May be stale by the time we sleep, which only makes the worker
+         * retire a bit sooner or later, the decision is taken with
+         * pool->mutex held again */
+        idleTimeout = virThreadPoolWorkerIdleTimeoutLocked(pool);
+        virMutexUnlock(&pool->mutex);
+
+        while (!g_atomic_int_get(&pool->quit) &&
+               (job = virThreadPoolFindQueuedJob(pool, home))) {
+            (pool->jobFunc)(job->data, pool->jobOpaque);
+            VIR_FREE(job);
+        }
+
+        /* Nothing left to steal. Go to sleep unless a job was queued in
+         * the meantime; anyone queueing a job later either sees us in
+         * freeWorkers or we see their job in nPending. */
+        virMutexLock(&queue->mutex);
+        if (g_atomic_int_get(&pool->nPending) == 0) {
+            queue->freeWorkers++;
+            while (!g_atomic_int_get(&pool->quit) && queue->wakeups == 0 &&
+                   generation == g_atomic_int_get(&pool->generation)) {
+                int rc = virThreadPoolWorkerWait(&queue->cond, &queue->mutex,
+                                                 idleTimeout);
+
+                if (rc != 0) {
+                    idle = rc > 0;
+                    break;
+                }
+            }
+            if (queue->wakeups > 0)
+                queue->wakeups--;
+            else
+                queue->freeWorkers--;
+        }
+        virMutexUnlock(&queue->mutex);
+
+        virMutexLock(&pool->mutex);
+
+        if (virThreadPoolWorkerRetireLocked(pool, idle))
+            return true;
+    }
+
+    return false;
+}
+
+
 static void virThreadPoolWorker(void *opaque)
 {
     struct virThreadPoolWorkerData *data = opaque;
     virThreadPool *pool = data->pool;
     virCond *cond = data->cond;
-    bool priority = data->priority;
-    size_t *curWorkers = priority ? &pool->nPrioWorkers : &pool->nWorkers;
-    size_t *maxLimit = priority ? &pool->maxPrioWorkers : &pool->maxWorkers;
+    virThreadPoolClass *cls = data->cls;
+    size_t id = data->id;
+    size_t *curWorkers = cls ? &cls->nWorkers : &pool->nWorkers;
+    size_t *maxLimit = cls ? &cls->maxWorkers : &pool->maxWorkers;
     virThreadPoolJob *job = NULL;
+    virThreadPoolThread self = { .id = virThreadSelfID(), .cls = cls };
+    virThreadPoolThread *selfptr = &self;
+    size_t i;
 
     VIR_FREE(data);
 
+#if defined(_POSIX_THREAD_CPUTIME) && _POSIX_THREAD_CPUTIME >= 0
+    self.hasCPUClock = pthread_getcpuclockid(pthread_self(), &self.cpuClock) == 0;
+#endif
+    virThreadJobTrack(&self.job);
+
     virMutexLock(&pool->mutex);
 
+    VIR_APPEND_ELEMENT_COPY(pool->threads, pool->nthreads, selfptr);
+
     if (pool->identity)
         virIdentitySetCurrent(pool->identity);
 
@@ -113,52 +531,44 @@ static void virThreadPoolWorker(void *opaque)
          */
         if (virThreadPoolWorkerQuitHelper(*curWorkers, *maxLimit))
             goto out;
-        while (!pool->quit &&
-               ((!priority && !pool->jobList.head) ||
-                (priority && !pool->jobList.firstPrio))) {
-            if (!priority)
-                pool->freeWorkers++;
-            if (virCondWait(cond, &pool->mutex) < 0) {
-                if (!priority)
-                    pool->freeWorkers--;
+
+        if (!cls && g_atomic_int_get(&pool->nqueues) > 0) {
+            if (virThreadPoolWorkerQueues(pool, id))
                 goto out;
+            if (g_atomic_int_get(&pool->quit))
+                break;
+            continue;
+        }
+
+        while (!g_atomic_int_get(&pool->quit) &&
+               ((!cls && pool->jobQueueDepth == 0 &&
+                 g_atomic_int_get(&pool->nqueues) == 0) ||
+                (cls && !cls->jobList.head))) {
+            unsigned int idleTimeout = 0;
+            int rc;
+
+            if (!cls) {
+                idleTimeout = virThreadPoolWorkerIdleTimeoutLocked(pool);
+                pool->freeWorkers++;
             }
-            if (!priority)
+            rc = virThreadPoolWorkerWait(cond, &pool->mutex, idleTimeout);
+            if (!cls)
                 pool->freeWorkers--;
+            if (rc < 0)
+                goto out;
+            if (!cls && virThreadPoolWorkerRetireLocked(pool, rc > 0))
+                goto out;
 
             if (virThreadPoolWorkerQuitHelper(*curWorkers, *maxLimit))
                 goto out;
         }
 
-        if (pool->quit)
+        if (g_atomic_int_get(&pool->quit))
             break;
 
-        if (priority) {
-            job = pool->jobList.firstPrio;
-        } else {
-            job = pool->jobList.head;
-        }
-
-        if (job == pool->jobList.firstPrio) {
-            virThreadPoolJob *tmp = job->next;
-            while (tmp) {
-                if (tmp->priority)
-                    break;
-                tmp = tmp->next;
-            }
-            pool->jobList.firstPrio = tmp;
-        }
-
-        if (job->prev)
-            job->prev->next = job->next;
-        else
-            pool->jobList.head = job->next;
-        if (job->next)
-            job->next->prev = job->prev;
-        else
-            pool->jobList.tail = job->prev;
-
-        pool->jobQueueDepth--;
+        /* The pool might have switched to per worker group queues */
+        if (!(job = virThreadPoolTakeJobLocked(pool, cls)))
+            continue;
 
         virMutexUnlock(&pool->mutex);
         (pool->jobFunc)(job->data, pool->jobOpaque);
@@ -167,35 +577,49 @@ static void virThreadPoolWorker(void *opaque)
     }
 
  out:
-    if (priority)
-        pool->nPrioWorkers--;
-    else
-        pool->nWorkers--;
-    if (pool->nWorkers == 0 && pool->nPrioWorkers == 0)
+    for (i = 0; i < pool->nthreads; i++) {
+        if (pool->threads[i] == &self) {
+            VIR_DELETE_ELEMENT(pool->threads, i, pool->nthreads);
+            break;
+        }
+    }
+    virThreadJobTrack(NULL);
+
+    (*curWorkers)--;
+    if (cls)
+        pool->nClassWorkers--;
+    if (pool->nWorkers == 0 && pool->nClassWorkers == 0)
         virCondSignal(&pool->quit_cond);
     virMutexUnlock(&pool->mutex);
 }
 
 static int
-virThreadPoolExpand(virThreadPool *pool, size_t gain, bool priority)
+virThreadPoolExpand(virThreadPool *pool, size_t gain, virThreadPoolClass *cls)
 {
-    virThread **workers = priority ? &pool->prioWorkers : &pool->workers;
-    size_t *curWorkers = priority ? &pool->nPrioWorkers : &pool->nWorkers;
+    virThread **workers = cls ? &cls->workers : &pool->workers;
+    size_t *curWorkers = cls ? &cls->nWorkers : &pool->nWorkers;
     size_t i = 0;
     struct virThreadPoolWorkerData *data = NULL;
 
     VIR_EXPAND_N(*workers, *curWorkers, gain);
+    if (cls) {
+        pool->nClassWorkers += gain;
+    } else {
+        pool->spawnedWorkers += gain;
+        pool->trimWorkers = 0;
+    }
 
     for (i = 0; i < gain; i++) {
         g_autofree char *name = NULL;
 
         data = g_new0(struct virThreadPoolWorkerData, 1);
         data->pool = pool;
-        data->cond = priority ? &pool->prioCond : &pool->cond;
-        data->priority = priority;
+        data->cond = cls ? &cls->cond : &pool->cond;
+        data->cls = cls;
+        data->id = pool->nextWorkerID++;
 
-        if (priority)
-            name = g_strdup_printf("prio-%s", pool->jobName);
+        if (cls)
+            name = g_strdup_printf("%s-%s", cls->name, pool->jobName);
         else
             name = g_strdup(pool->jobName);
 
@@ -215,9 +639,79 @@ virThreadPoolExpand(virThreadPool *pool, size_t gain, bool priority)
 
  error:
     *curWorkers -= gain - i;
+    if (cls)
+        pool->nClassWorkers -= gain - i;
+    else
+        pool->spawnedWorkers -= gain - i;
     return -1;
 }
 
+
+static virThreadPoolClass *
+virThreadPoolClassNew(const char *name,
+                      bool exclusive)
+{
+    virThreadPoolClass *cls = g_new0(virThreadPoolClass, 1);
+
+    if (virCondInit(&cls->cond) < 0) {
+        g_free(cls);
+        return NULL;
+    }
+
+    cls->name = g_strdup(name);
+    cls->exclusive = exclusive;
+
+    return cls;
+}
+
+
+static void
+virThreadPoolClassFree(virThreadPoolClass *cls)
+{
+    if (!cls)
+        return;
+
+    virCondDestroy(&cls->cond);
+    g_free(cls->workers);
+    g_free(cls->name);
+    g_free(cls);
+}
+
+
+/* Must be called with pool->mutex held */
+static int
+virThreadPoolAddClassLocked(virThreadPool *pool,
+                            const char *name,
+                            size_t workers,
+                            bool exclusive)
+{
+    virThreadPoolClass *cls;
+
+    if (exclusive && workers == 0) {
+        virReportError(VIR_ERR_INVALID_ARG,
+                       _("exclusive job class '%s' needs reserved workers"),
+                       name);
+        return -1;
+    }
+
+    if (!(cls = virThreadPoolClassNew(name, exclusive))) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("unable to initialize job class"));
+        return -1;
+    }
+
+    cls->maxWorkers = workers;
+    VIR_APPEND_ELEMENT(pool->classes, pool->nclasses, cls);
+
+    /* Jobs can't be queued to the class before it's returned, so there's
+     * no need to remove it again if the workers fail to start */
+    if (workers > 0 &&
+        virThreadPoolExpand(pool, workers, pool->classes[pool->nclasses - 1]) < 0)
+        return -1;
+
+    return pool->nclasses - 1;
+}
+
 virThreadPool *
 virThreadPoolNewFull(size_t minWorkers,
                      size_t maxWorkers,
@@ -234,8 +728,6 @@ virThreadPoolNewFull(size_t minWorkers,
 
     pool = g_new0(virThreadPool, 1);
 
-    pool->jobList.tail = pool->jobList.head = NULL;
-
     pool->jobFunc = func;
     pool->jobName = g_strdup(name);
     pool->jobOpaque = opaque;
@@ -247,20 +739,20 @@ virThreadPoolNewFull(size_t minWorkers,
         goto error;
     if (virCondInit(&pool->cond) < 0)
         goto error;
-    if (virCondInit(&pool->prioCond) < 0)
-        goto error;
     if (virCondInit(&pool->quit_cond) < 0)
         goto error;
 
     pool->minWorkers = minWorkers;
     pool->maxWorkers = maxWorkers;
-    pool->maxPrioWorkers = prioWorkers;
 
-    if ((minWorkers > 0) && virThreadPoolExpand(pool, minWorkers, false) < 0)
-        goto error;
+    VIR_WITH_MUTEX_LOCK_GUARD(&pool->mutex) {
+        if (virThreadPoolAddClassLocked(pool, "default", 0, false) < 0 ||
+            virThreadPoolAddClassLocked(pool, "prio", prioWorkers, false) < 0)
+            goto error;
 
-    if ((prioWorkers > 0) && virThreadPoolExpand(pool, prioWorkers, true) < 0)
-        goto error;
+        if ((minWorkers > 0) && virThreadPoolExpand(pool, minWorkers, NULL) < 0)
+            goto error;
+    }
 
     return pool;
 
@@ -271,33 +763,160 @@ virThreadPoolNewFull(size_t minWorkers,
 }
 
 
+static virThreadPoolQueue *
+virThreadPoolQueueNew(void)
+{
+    virThreadPoolQueue *queue = g_new0(virThreadPoolQueue, 1);
+
+    if (virMutexInit(&queue->mutex) < 0) {
+        g_free(queue);
+        return NULL;
+    }
+
+    if (virCondInit(&queue->cond) < 0) {
+        virMutexDestroy(&queue->mutex);
+        g_free(queue);
+        return NULL;
+    }
+
+    return queue;
+}
+
+
+static void
+virThreadPoolQueueFree(virThreadPoolQueue *queue)
+{
+    if (!queue)
+        return;
+
+    virCondDestroy(&queue->cond);
+    virMutexDestroy(&queue->mutex);
+    g_free(queue);
+}
+
+
 static void
 virThreadPoolStopLocked(virThreadPool *pool)
 {
-    if (pool->quit)
+    size_t nalloc = g_atomic_int_get(&pool->nqueuesAlloc);
+    size_t i;
+
+    if (g_atomic_int_get(&pool->quit))
         return;
 
-    pool->quit = true;
+    g_atomic_int_set(&pool->quit, true);
     if (pool->nWorkers > 0)
         virCondBroadcast(&pool->cond);
-    if (pool->nPrioWorkers > 0)
-        virCondBroadcast(&pool->prioCond);
+
+    for (i = 0; i < pool->nclasses; i++) {
+        if (pool->classes[i]->nWorkers > 0)
+            virCondBroadcast(&pool->classes[i]->cond);
+    }
+
+    for (i = 0; i < nalloc; i++) {
+        VIR_LOCK_GUARD lock = virLockGuardLock(&pool->queues[i]->mutex);
+
+        virCondBroadcast(&pool->queues[i]->cond);
+    }
+}
+
+
+/*
+ * Switch the pool to @nqueues per worker group queues, or back to the
+ * single global queue if @nqueues is zero. Must be called with
+ * pool->mutex held.
+ */
+static int
+virThreadPoolSetQueuesLocked(virThreadPool *pool,
+                             size_t nqueues)
+{
+    size_t nalloc = g_atomic_int_get(&pool->nqueuesAlloc);
+    size_t i;
+
+    if (nqueues > VIR_THREAD_POOL_MAX_QUEUES) {
+        virReportError(VIR_ERR_INVALID_ARG,
+                       _("number of job queues must not exceed %d"),
+                       VIR_THREAD_POOL_MAX_QUEUES);
+        return -1;
+    }
+
+    if (nqueues > 0 && !pool->queues)
+        pool->queues = g_new0(virThreadPoolQueue *, VIR_THREAD_POOL_MAX_QUEUES);
+
+    for (; nalloc < nqueues; nalloc++) {
+        if (!(pool->queues[nalloc] = virThreadPoolQueueNew())) {
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("unable to initialize job queue"));
+            return -1;
+        }
+        g_atomic_int_set(&pool->nqueuesAlloc, nalloc + 1);
+    }
+
+    g_atomic_int_set(&pool->nqueues, nqueues);
+    g_atomic_int_inc(&pool->generation);
+
+    /* Wake up all sleeping workers so that they pick their new home queue.
+     * When going back to the global queue, move the queued jobs over. */
+    for (i = 0; i < nalloc; i++) {
+        virThreadPoolQueue *queue = pool->queues[i];
+        VIR_LOCK_GUARD lock = virLockGuardLock(&queue->mutex);
+
+        if (nqueues == 0) {
+            virThreadPoolClass *cls = pool->classes[VIR_THREAD_POOL_CLASS_DEFAULT];
+            virThreadPoolJob *job;
+
+            while ((job = queue->jobList.head)) {
+                virThreadPoolJobListRemove(&queue->jobList, job);
+                virThreadPoolJobListAppend(&cls->jobList, job);
+            }
+
+            cls->jobQueueDepth += queue->jobQueueDepth;
+            pool->jobQueueDepth += queue->jobQueueDepth;
+            queue->jobQueueDepth = 0;
+        }
+
+        virCondBroadcast(&queue->cond);
+    }
+
+    virCondBroadcast(&pool->cond);
+
+    return 0;
 }
 
 
 static void
 virThreadPoolDrainLocked(virThreadPool *pool)
 {
+    size_t nalloc = g_atomic_int_get(&pool->nqueuesAlloc);
     virThreadPoolJob *job;
+    size_t i;
 
     virThreadPoolStopLocked(pool);
 
-    while (pool->nWorkers > 0 || pool->nPrioWorkers > 0)
+    while (pool->nWorkers > 0 || pool->nClassWorkers > 0)
         ignore_value(virCondWait(&pool->quit_cond, &pool->mutex));
 
-    while ((job = pool->jobList.head)) {
-        pool->jobList.head = pool->jobList.head->next;
-        VIR_FREE(job);
+    for (i = 0; i < pool->nclasses; i++) {
+        virThreadPoolClass *cls = pool->classes[i];
+
+        while ((job = cls->jobList.head)) {
+            cls->jobList.head = cls->jobList.head->next;
+            VIR_FREE(job);
+        }
+        cls->jobList.tail = NULL;
+        cls->jobQueueDepth = 0;
+    }
+    pool->jobQueueDepth = 0;
+
+    for (i = 0; i < nalloc; i++) {
+        virThreadPoolQueue *queue = pool->queues[i];
+
+        while ((job = queue->jobList.head)) {
+            queue->jobList.head = queue->jobList.head->next;
+            VIR_FREE(job);
+        }
+        queue->jobList.tail = NULL;
+        queue->jobQueueDepth = 0;
     }
 }
 
@@ -313,11 +932,24 @@ void virThreadPoolFree(virThreadPool *pool)
 
     g_free(pool->jobName);
     g_free(pool->workers);
+    g_free(pool->threads);
     virMutexDestroy(&pool->mutex);
     virCondDestroy(&pool->quit_cond);
     virCondDestroy(&pool->cond);
-    g_free(pool->prioWorkers);
-    virCondDestroy(&pool->prioCond);
+    if (pool->classes) {
+        size_t i;
+
+        for (i = 0; i < pool->nclasses; i++)
+            virThreadPoolClassFree(pool->classes[i]);
+        g_free(pool->classes);
+    }
+    if (pool->queues) {
+        size_t i;
+
+        for (i = 0; i < pool->nqueuesAlloc; i++)
+            virThreadPoolQueueFree(pool->queues[i]);
+        g_free(pool->queues);
+    }
     g_free(pool);
 }
 
@@ -340,7 +972,7 @@ size_t virThreadPoolGetPriorityWorkers(virThreadPool *pool)
 {
     VIR_LOCK_GUARD lock = virLockGuardLock(&pool->mutex);
 
-    return pool->nPrioWorkers;
+    return pool->classes[VIR_THREAD_POOL_CLASS_PRIORITY]->nWorkers;
 }
 
 size_t virThreadPoolGetCurrentWorkers(virThreadPool *pool)
@@ -353,66 +985,334 @@ size_t virThreadPoolGetCurrentWorkers(virThreadPool *pool)
 size_t virThreadPoolGetFreeWorkers(virThreadPool *pool)
 {
     VIR_LOCK_GUARD lock = virLockGuardLock(&pool->mutex);
+    size_t nalloc = g_atomic_int_get(&pool->nqueuesAlloc);
+    size_t freeWorkers = pool->freeWorkers;
+    size_t i;
+
+    for (i = 0; i < nalloc; i++) {
+        VIR_LOCK_GUARD qlock = virLockGuardLock(&pool->queues[i]->mutex);
+
+        freeWorkers += pool->queues[i]->freeWorkers;
+    }
 
-    return pool->freeWorkers;
+    return freeWorkers;
 }
 
 size_t virThreadPoolGetJobQueueDepth(virThreadPool *pool)
 {
     VIR_LOCK_GUARD lock = virLockGuardLock(&pool->mutex);
+    size_t nalloc = g_atomic_int_get(&pool->nqueuesAlloc);
+    size_t jobQueueDepth = 0;
+    size_t i;
+
+    for (i = 0; i < pool->nclasses; i++)
+        jobQueueDepth += pool->classes[i]->jobQueueDepth;
+
+    for (i = 0; i < nalloc; i++) {
+        VIR_LOCK_GUARD qlock = virLockGuardLock(&pool->queues[i]->mutex);
 
-    return pool->jobQueueDepth;
+        jobQueueDepth += pool->queues[i]->jobQueueDepth;
+    }
+
+    return jobQueueDepth;
 }
 
-/*
- * @priority - job priority
- * Return: 0 on success, -1 otherwise
+size_t virThreadPoolGetJobQueues(virThreadPool *pool)
+{
+    return g_atomic_int_get(&pool->nqueues);
+}
+
+unsigned int virThreadPoolGetIdleTimeout(virThreadPool *pool)
+{
+    VIR_LOCK_GUARD lock = virLockGuardLock(&pool->mutex);
+
+    return pool->idleTimeout;
+}
+
+void virThreadPoolGetWorkerStats(virThreadPool *pool,
+                                 unsigned long long *spawned,
+                                 unsigned long long *retired)
+{
+    VIR_LOCK_GUARD lock = virLockGuardLock(&pool->mutex);
+
+    *spawned = pool->spawnedWorkers;
+    *retired = pool->retiredWorkers;
+}
+
+
+/**
+ * virThreadPoolGetClassStats:
+ * @pool: the thread pool
+ * @stats: filled with a newly allocated array of statistics
+ * @nstats: filled with the number of entries in @stats
+ *
+ * Retrieves the statistics of all job classes of @pool, indexed by the
+ * class. The names in @stats are owned by @pool.
  */
-int virThreadPoolSendJob(virThreadPool *pool,
-                         unsigned int priority,
-                         void *jobData)
+void
+virThreadPoolGetClassStats(virThreadPool *pool,
+                           virThreadPoolClassStats **stats,
+                           size_t *nstats)
 {
     VIR_LOCK_GUARD lock = virLockGuardLock(&pool->mutex);
-    virThreadPoolJob *job;
+    size_t nalloc = g_atomic_int_get(&pool->nqueuesAlloc);
+    virThreadPoolClassStats *def;
+    size_t i;
+
+    *stats = g_new0(virThreadPoolClassStats, pool->nclasses);
+    *nstats = pool->nclasses;
+
+    for (i = 0; i < pool->nclasses; i++) {
+        virThreadPoolClass *cls = pool->classes[i];
+        virThreadPoolClassStats *ent = &(*stats)[i];
+
+        ent->name = cls->name;
+        ent->exclusive = cls->exclusive;
+        ent->workers = cls->nWorkers;
+        ent->jobQueueDepth = cls->jobQueueDepth;
+        ent->jobs = cls->stats.jobs;
+        ent->waitTime = cls->stats.waitTime;
+        ent->maxWaitTime = cls->stats.maxWaitTime;
+    }
+
+    /* The jobs in the per worker group queues are of the default class */
+    def = &(*stats)[VIR_THREAD_POOL_CLASS_DEFAULT];
+    def->workers = pool->nWorkers;
+
+    for (i = 0; i < nalloc; i++) {
+        virThreadPoolQueue *queue = pool->queues[i];
+        VIR_LOCK_GUARD qlock = virLockGuardLock(&queue->mutex);
+
+        def->jobQueueDepth += queue->jobQueueDepth;
+        def->jobs += queue->stats.jobs;
+        def->waitTime += queue->stats.waitTime;
+        if (queue->stats.maxWaitTime > def->maxWaitTime)
+            def->maxWaitTime = queue->stats.maxWaitTime;
+    }
+}
+
+
+/**
+ * virThreadPoolGetThreadStats:
+ * @pool: the thread pool
+ * @stats: filled with a newly allocated array of statistics
+ * @nstats: filled with the number of entries in @stats
+ *
+ * Retrieves the thread ID, CPU time and current job of every running
+ * worker of @pool.
+ */
+void
+virThreadPoolGetThreadStats(virThreadPool *pool,
+                            virThreadPoolThreadStats **stats,
+                            size_t *nstats)
+{
+    VIR_LOCK_GUARD lock = virLockGuardLock(&pool->mutex);
+    size_t i;
+
+    *stats = g_new0(virThreadPoolThreadStats, pool->nthreads);
+    *nstats = pool->nthreads;
+
+    /* Workers unregister themselves with the mutex held before exiting,
+     * so their CPU clocks are valid */
+    for (i = 0; i < pool->nthreads; i++) {
+        virThreadPoolThread *thread = pool->threads[i];
+        virThreadPoolThreadStats *ent = &(*stats)[i];
+
+        ent->id = thread->id;
+        ent->className = thread->cls ? thread->cls->name :
+            pool->classes[VIR_THREAD_POOL_CLASS_DEFAULT]->name;
+        ent->job = g_atomic_pointer_get(&thread->job);
+
+#if defined(_POSIX_THREAD_CPUTIME) && _POSIX_THREAD_CPUTIME >= 0
+        if (thread->hasCPUClock) {
+            struct timespec ts;
+
+            if (clock_gettime(thread->cpuClock, &ts) == 0) {
+                ent->hasCPUTime = true;
+                ent->cpuTime = ts.tv_sec * 1000000000ull + ts.tv_nsec;
+            }
+        }
+#endif
+    }
+}
+
+
+/**
+ * virThreadPoolAddClass:
+ * @pool: the thread pool
+ * @name: name of the class, used for naming the reserved workers
+ * @workers: number of workers to reserve for the class
+ * @exclusive: whether jobs of the class may be run by the reserved
+ *             workers only
+ *
+ * Adds a new job class to @pool and starts the workers reserved for it.
+ * Jobs of an exclusive class never occupy the ordinary workers, which is
+ * useful for long running jobs, while non-exclusive classes guarantee
+ * their jobs some workers even if all the ordinary ones are busy.
+ *
+ * Returns the class to pass to virThreadPoolSendJob, -1 on error.
+ */
+int
+virThreadPoolAddClass(virThreadPool *pool,
+                      const char *name,
+                      size_t workers,
+                      bool exclusive)
+{
+    VIR_LOCK_GUARD lock = virLockGuardLock(&pool->mutex);
+
+    return virThreadPoolAddClassLocked(pool, name, workers, exclusive);
+}
+
+/*
+ * Queue an ordinary job on one of the per worker group queues.
+ * Return: 0 on success, -1 on error, 1 if the pool doesn't use
+ *         per worker group queues.
+ */
+static int
+virThreadPoolSendJobQueues(virThreadPool *pool,
+                           virThreadPoolJob *job)
+{
+    size_t nqueues = g_atomic_int_get(&pool->nqueues);
+    virThreadPoolQueue *queue;
+    size_t idx;
+    bool woken = false;
+
+    if (nqueues == 0)
+        return 1;
+
+    idx = (unsigned int) g_atomic_int_add(&pool->nextQueue, 1) % nqueues;
+    queue = pool->queues[idx];
+
+    VIR_WITH_MUTEX_LOCK_GUARD(&queue->mutex) {
+        /* The queues might have been disabled meanwhile */
+        if (g_atomic_int_get(&pool->nqueues) == 0)
+            return 1;
+
+        if (g_atomic_int_get(&pool->quit))
+            return -1;
+
+        virThreadPoolJobListAppend(&queue->jobList, job);
+        queue->jobQueueDepth++;
+        g_atomic_int_inc(&pool->nPending);
+
+        woken = virThreadPoolQueueWakeLocked(queue);
+    }
+
+    if (woken || virThreadPoolWakeAnyQueue(pool, idx + 1))
+        return 0;
+
+    /* All workers are busy, spawn a new one if allowed */
+    VIR_WITH_MUTEX_LOCK_GUARD(&pool->mutex) {
+        if (g_atomic_int_get(&pool->quit) ||
+            pool->nWorkers >= pool->maxWorkers ||
+            virThreadPoolExpand(pool, 1, NULL) == 0)
+            return 0;
+    }
+
+    /* Nobody will process the job if we failed to create the first worker */
+    VIR_WITH_MUTEX_LOCK_GUARD(&queue->mutex) {
+        virThreadPoolJob *tmp;
+
+        for (tmp = queue->jobList.head; tmp; tmp = tmp->next) {
+            if (tmp == job) {
+                virThreadPoolJobListRemove(&queue->jobList, job);
+                queue->jobQueueDepth--;
+                g_atomic_int_add(&pool->nPending, -1);
+                return -1;
+            }
+        }
+    }
+
+    /* Some other worker already took the job */
+    virResetLastError();
+    return 0;
+}
 
-    if (pool->quit)
+/* Must be called with pool->mutex held */
+static int
+virThreadPoolSendJobLocked(virThreadPool *pool,
+                           virThreadPoolJob *job)
+{
+    virThreadPoolClass *cls;
+
+    if (g_atomic_int_get(&pool->quit))
         return -1;
 
-    if (pool->freeWorkers - pool->jobQueueDepth <= 0 &&
-        pool->nWorkers < pool->maxWorkers &&
-        virThreadPoolExpand(pool, 1, false) < 0)
+    if (job->jobClass >= pool->nclasses) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("unknown job class %u"), job->jobClass);
         return -1;
+    }
 
-    job = g_new0(virThreadPoolJob, 1);
+    cls = pool->classes[job->jobClass];
 
-    job->data = jobData;
-    job->priority = priority;
+    if (!cls->exclusive &&
+        pool->freeWorkers <= pool->jobQueueDepth &&
+        pool->nWorkers < pool->maxWorkers &&
+        g_atomic_int_get(&pool->nqueues) == 0 &&
+        virThreadPoolExpand(pool, 1, NULL) < 0)
+        return -1;
 
-    job->prev = pool->jobList.tail;
-    if (pool->jobList.tail)
-        pool->jobList.tail->next = job;
-    pool->jobList.tail = job;
+    virThreadPoolJobListAppend(&cls->jobList, job);
+    cls->jobQueueDepth++;
 
-    if (!pool->jobList.head)
-        pool->jobList.head = job;
+    if (cls->nWorkers > 0)
+        virCondSignal(&cls->cond);
 
-    if (priority && !pool->jobList.firstPrio)
-        pool->jobList.firstPrio = job;
+    if (cls->exclusive)
+        return 0;
 
     pool->jobQueueDepth++;
+    g_atomic_int_inc(&pool->nPending);
 
     virCondSignal(&pool->cond);
-    if (priority)
-        virCondSignal(&pool->prioCond);
+
+    /* Ordinary workers sleep on their own queues */
+    if (g_atomic_int_get(&pool->nqueues) > 0)
+        virThreadPoolWakeAnyQueue(pool, 0);
 
     return 0;
 }
 
+/*
+ * @jobClass - job class, VIR_THREAD_POOL_CLASS_DEFAULT,
+ *             VIR_THREAD_POOL_CLASS_PRIORITY or a class returned by
+ *             virThreadPoolAddClass
+ * Return: 0 on success, -1 otherwise
+ */
+int virThreadPoolSendJob(virThreadPool *pool,
+                         unsigned int jobClass,
+                         void *jobData)
+{
+    virThreadPoolJob *job;
+    int rc = -1;
+
+    job = g_new0(virThreadPoolJob, 1);
+
+    job->data = jobData;
+    job->jobClass = jobClass;
+    job->queued = g_get_monotonic_time();
+
+    if (jobClass != VIR_THREAD_POOL_CLASS_DEFAULT ||
+        (rc = virThreadPoolSendJobQueues(pool, job)) > 0) {
+        VIR_WITH_MUTEX_LOCK_GUARD(&pool->mutex) {
+            rc = virThreadPoolSendJobLocked(pool, job);
+        }
+    }
+
+    if (rc < 0)
+        VIR_FREE(job);
+
+    return rc;
+}
+
 int
 virThreadPoolSetParameters(virThreadPool *pool,
                            long long int minWorkers,
                            long long int maxWorkers,
-                           long long int prioWorkers)
+                           long long int prioWorkers,
+                           long long int jobQueues,
+                           long long int idleTimeout)
 {
     VIR_LOCK_GUARD lock = virLockGuardLock(&pool->mutex);
     size_t max;
@@ -436,30 +1336,80 @@ virThreadPoolSetParameters(virThreadPool *pool,
 
     if (minWorkers >= 0) {
         if ((size_t) minWorkers > pool->nWorkers &&
-            virThreadPoolExpand(pool, minWorkers - pool->nWorkers, false) < 0)
+            virThreadPoolExpand(pool, minWorkers - pool->nWorkers, NULL) < 0)
             return -1;
         pool->minWorkers = minWorkers;
     }
 
-    if (maxWorkers >= 0) {
-        pool->maxWorkers = maxWorkers;
+    if (idleTimeout >= 0)
+        pool->idleTimeout = MIN(idleTimeout, UINT_MAX);
+
+    if (maxWorkers >= 0 || idleTimeout >= 0 || minWorkers >= 0) {
+        size_t nalloc = g_atomic_int_get(&pool->nqueuesAlloc);
+        size_t i;
+
+        if (maxWorkers >= 0)
+            pool->maxWorkers = maxWorkers;
         virCondBroadcast(&pool->cond);
+
+        /* Let idle workers sleeping on their queues notice the new limits */
+        g_atomic_int_inc(&pool->generation);
+        for (i = 0; i < nalloc; i++) {
+            VIR_LOCK_GUARD qlock = virLockGuardLock(&pool->queues[i]->mutex);
+
+            virCondBroadcast(&pool->queues[i]->cond);
+        }
     }
 
     if (prioWorkers >= 0) {
-        if (prioWorkers < pool->nPrioWorkers) {
-            virCondBroadcast(&pool->prioCond);
-        } else if ((size_t) prioWorkers > pool->nPrioWorkers &&
-                   virThreadPoolExpand(pool, prioWorkers - pool->nPrioWorkers,
-                                       true) < 0) {
+        virThreadPoolClass *prio = pool->classes[VIR_THREAD_POOL_CLASS_PRIORITY];
+
+        if (prioWorkers < prio->nWorkers) {
+            virCondBroadcast(&prio->cond);
+        } else if ((size_t) prioWorkers > prio->nWorkers &&
+                   virThreadPoolExpand(pool, prioWorkers - prio->nWorkers,
+                                       prio) < 0) {
             return -1;
         }
-        pool->maxPrioWorkers = prioWorkers;
+        prio->maxWorkers = prioWorkers;
     }
 
+    if (jobQueues >= 0 &&
+        jobQueues != g_atomic_int_get(&pool->nqueues) &&
+        virThreadPoolSetQueuesLocked(pool, jobQueues) < 0)
+        return -1;
+
     return 0;
 }
 
+/**
+ * virThreadPoolTrim:
+ * @pool: the thread pool
+ *
+ * Makes the idle ordinary workers above the minimum number of workers
+ * exit, regardless of the idle timeout.
+ */
+void
+virThreadPoolTrim(virThreadPool *pool)
+{
+    VIR_LOCK_GUARD lock = virLockGuardLock(&pool->mutex);
+    size_t nalloc = g_atomic_int_get(&pool->nqueuesAlloc);
+    size_t i;
+
+    if (pool->nWorkers <= pool->minWorkers)
+        return;
+
+    pool->trimWorkers = pool->nWorkers - pool->minWorkers;
+    virCondBroadcast(&pool->cond);
+
+    g_atomic_int_inc(&pool->generation);
+    for (i = 0; i < nalloc; i++) {
+        VIR_LOCK_GUARD qlock = virLockGuardLock(&pool->queues[i]->mutex);
+
+        virCondBroadcast(&pool->queues[i]->cond);
+    }
+}
+
 void
 virThreadPoolStop(virThreadPool *pool)
 {
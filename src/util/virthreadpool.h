@@ -28,6 +28,34 @@ typedef struct _virThreadPool virThreadPool;
 
 typedef void (*virThreadPoolJobFunc)(void *jobdata, void *opaque);
 
+/* Job classes every pool has, further ones are added by
+ * virThreadPoolAddClass */
+#define VIR_THREAD_POOL_CLASS_DEFAULT 0  /* run by the ordinary workers */
+#define VIR_THREAD_POOL_CLASS_PRIORITY 1 /* also run by the priority workers */
+
+typedef struct _virThreadPoolClassStats virThreadPoolClassStats;
+struct _virThreadPoolClassStats {
+    const char *name;
+    bool exclusive;
+    size_t workers; /* reserved workers, ordinary ones for the default class */
+    size_t jobQueueDepth;
+
+    /* Jobs taken by a worker so far and the time they spent queued, in
+     * microseconds */
+    unsigned long long jobs;
+    unsigned long long waitTime;
+    unsigned long long maxWaitTime;
+};
+
+typedef struct _virThreadPoolThreadStats virThreadPoolThreadStats;
+struct _virThreadPoolThreadStats {
+    unsigned long long id; /* as returned by virThreadSelfID */
+    const char *className;
+    const char *job; /* as set by virThreadJobSet, NULL if idle */
+    bool hasCPUTime;
+    unsigned long long cpuTime; /* in nanoseconds */
+};
+
 virThreadPool *virThreadPoolNewFull(size_t minWorkers,
                                     size_t maxWorkers,
                                     size_t prioWorkers,
@@ -42,18 +70,38 @@ size_t virThreadPoolGetPriorityWorkers(virThreadPool *pool);
 size_t virThreadPoolGetCurrentWorkers(virThreadPool *pool);
 size_t virThreadPoolGetFreeWorkers(virThreadPool *pool);
 size_t virThreadPoolGetJobQueueDepth(virThreadPool *pool);
+size_t virThreadPoolGetJobQueues(virThreadPool *pool);
+unsigned int virThreadPoolGetIdleTimeout(virThreadPool *pool);
+void virThreadPoolGetWorkerStats(virThreadPool *pool,
+                                 unsigned long long *spawned,
+                                 unsigned long long *retired);
+void virThreadPoolGetClassStats(virThreadPool *pool,
+                                virThreadPoolClassStats **stats,
+                                size_t *nstats);
+void virThreadPoolGetThreadStats(virThreadPool *pool,
+                                 virThreadPoolThreadStats **stats,
+                                 size_t *nstats);
+
+int virThreadPoolAddClass(virThreadPool *pool,
+                          const char *name,
+                          size_t workers,
+                          bool exclusive) ATTRIBUTE_NONNULL(1)
+                                          ATTRIBUTE_NONNULL(2);
 
 void virThreadPoolFree(virThreadPool *pool);
 
 int virThreadPoolSendJob(virThreadPool *pool,
-                         unsigned int priority,
+                         unsigned int jobClass,
                          void *jobdata) ATTRIBUTE_NONNULL(1)
                                         G_GNUC_WARN_UNUSED_RESULT;
 
 int virThreadPoolSetParameters(virThreadPool *pool,
                                long long int minWorkers,
                                long long int maxWorkers,
-                               long long int prioWorkers);
+                               long long int prioWorkers,
+                               long long int jobQueues,
+                               long long int idleTimeout);
 
+void virThreadPoolTrim(virThreadPool *pool);
 void virThreadPoolStop(virThreadPool *pool);
 void virThreadPoolDrain(virThreadPool *pool);
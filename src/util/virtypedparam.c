@@ -752,6 +752,40 @@ virTypedParamListFromParams(virTypedParameterPtr *params,
 }
 
 
+/**
+ * virTypedParamListAddParams:
+ * @list: typed parameter list
+ * @params: array of typed parameters
+ * @nparams: number of parameters in @params
+ *
+ * Appends a deep copy of @params to @list. The caller keeps ownership of
+ * @params.
+ */
+void
+virTypedParamListAddParams(virTypedParamList *list,
+                           virTypedParameterPtr params,
+                           size_t nparams)
+{
+    size_t i;
+
+    if (nparams == 0)
+        return;
+
+    VIR_RESIZE_N(list->par, list->par_alloc, list->npar, nparams);
+
+    for (i = 0; i < nparams; i++) {
+        virTypedParameterPtr par = list->par + list->npar++;
+
+        ignore_value(virStrcpyStatic(par->field, params[i].field));
+        par->type = params[i].type;
+        if (params[i].type == VIR_TYPED_PARAM_STRING)
+            par->value.s = g_strdup(params[i].value.s);
+        else
+            par->value = params[i].value;
+    }
+}
+
+
 static int G_GNUC_PRINTF(2, 0)
 virTypedParamSetNameVPrintf(virTypedParameterPtr par,
                             const char *fmt,
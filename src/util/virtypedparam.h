@@ -142,6 +142,10 @@ virTypedParamList *
 virTypedParamListFromParams(virTypedParameterPtr *params,
                             size_t nparams);
 
+void virTypedParamListAddParams(virTypedParamList *list,
+                                virTypedParameterPtr params,
+                                size_t nparams);
+
 int virTypedParamListAddInt(virTypedParamList *list,
                             int value,
                             const char *namefmt,
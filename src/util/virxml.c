@@ -33,6 +33,7 @@
 #include "virfile.h"
 #include "virstring.h"
 #include "virutil.h"
+#include "virthread.h"
 #include "configmake.h"
 
 #define VIR_FROM_THIS VIR_FROM_XML
@@ -59,6 +60,82 @@ virXMLXPathContextNew(xmlDocPtr xml)
 }
 
 
+/* Upper bound on the number of cached compiled expressions per thread. The
+ * vast majority of expressions are string literals, this only guards against
+ * callers constructing unique expressions at runtime. */
+#define VIR_XPATH_CACHE_MAX 1024
+
+/* Per-thread cache of compiled XPath expressions keyed by the expression
+ * string. The compiled expressions don't depend on the context they are
+ * evaluated in, but evaluating one is not guaranteed to be thread safe. */
+static virThreadLocal virXPathCache;
+
+static void
+virXPathCacheFree(void *opaque)
+{
+    g_hash_table_unref(opaque);
+}
+
+
+static int
+virXPathOnceInit(void)
+{
+    return virThreadLocalInit(&virXPathCache, virXPathCacheFree);
+}
+
+VIR_ONCE_GLOBAL_INIT(virXPath);
+
+
+static GHashTable *
+virXPathCacheGet(void)
+{
+    GHashTable *cache;
+
+    if (virXPathInitialize() < 0)
+        return NULL;
+
+    if (!(cache = virThreadLocalGet(&virXPathCache))) {
+        cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                      (GDestroyNotify) xmlXPathFreeCompExpr);
+
+        if (virThreadLocalSet(&virXPathCache, cache) < 0) {
+            g_hash_table_unref(cache);
+            return NULL;
+        }
+    }
+
+    return cache;
+}
+
+
+/*
+ * Evaluate @xpath in @ctxt like xmlXPathEval does, but compile each
+ * expression only once per thread.
+ */
+static xmlXPathObjectPtr
+virXPathEval(const char *xpath,
+             xmlXPathContextPtr ctxt)
+{
+    GHashTable *cache = virXPathCacheGet();
+    xmlXPathCompExprPtr comp;
+
+    if (!cache)
+        return xmlXPathEval(BAD_CAST xpath, ctxt);
+
+    if (!(comp = g_hash_table_lookup(cache, xpath))) {
+        if (g_hash_table_size(cache) >= VIR_XPATH_CACHE_MAX)
+            return xmlXPathEval(BAD_CAST xpath, ctxt);
+
+        if (!(comp = xmlXPathCompile(BAD_CAST xpath)))
+            return NULL;
+
+        g_hash_table_insert(cache, g_strdup(xpath), comp);
+    }
+
+    return xmlXPathCompiledEval(comp, ctxt);
+}
+
+
 /**
  * virXPathString:
  * @xpath: the XPath string to evaluate
@@ -80,7 +157,7 @@ virXPathString(const char *xpath,
                        "%s", _("Invalid parameter to virXPathString()"));
         return NULL;
     }
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     if ((obj == NULL) || (obj->type != XPATH_STRING) ||
         (obj->stringval == NULL) || (obj->stringval[0] == 0)) {
         return NULL;
@@ -112,7 +189,7 @@ virXPathNumber(const char *xpath,
                        "%s", _("Invalid parameter to virXPathNumber()"));
         return -1;
     }
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     if ((obj == NULL) || (obj->type != XPATH_NUMBER) ||
         (isnan(obj->floatval))) {
         return -1;
@@ -136,7 +213,7 @@ virXPathLongBase(const char *xpath,
                        "%s", _("Invalid parameter to virXPathLong()"));
         return -1;
     }
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     if ((obj != NULL) && (obj->type == XPATH_STRING) &&
         (obj->stringval != NULL) && (obj->stringval[0] != 0)) {
         if (virStrToLong_l((char *) obj->stringval, NULL, base, value) < 0)
@@ -237,7 +314,7 @@ virXPathULongBase(const char *xpath,
                        "%s", _("Invalid parameter to virXPathULong()"));
         return -1;
     }
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     if ((obj != NULL) && (obj->type == XPATH_STRING) &&
         (obj->stringval != NULL) && (obj->stringval[0] != 0)) {
         if (virStrToLong_ul((char *) obj->stringval, NULL, base, value) < 0)
@@ -349,7 +426,7 @@ virXPathULongLong(const char *xpath,
                        "%s", _("Invalid parameter to virXPathULong()"));
         return -1;
     }
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     if ((obj != NULL) && (obj->type == XPATH_STRING) &&
         (obj->stringval != NULL) && (obj->stringval[0] != 0)) {
         if (virStrToLong_ull((char *) obj->stringval, NULL, 10, value) < 0)
@@ -391,7 +468,7 @@ virXPathLongLong(const char *xpath,
                        "%s", _("Invalid parameter to virXPathLongLong()"));
         return -1;
     }
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     if ((obj != NULL) && (obj->type == XPATH_STRING) &&
         (obj->stringval != NULL) && (obj->stringval[0] != 0)) {
         if (virStrToLong_ll((char *) obj->stringval, NULL, 10, value) < 0)
@@ -848,7 +925,7 @@ virXPathBoolean(const char *xpath,
                        "%s", _("Invalid parameter to virXPathBoolean()"));
         return -1;
     }
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     if ((obj == NULL) || (obj->type != XPATH_BOOLEAN) ||
         (obj->boolval < 0) || (obj->boolval > 1)) {
         return -1;
@@ -877,7 +954,7 @@ virXPathNode(const char *xpath,
                        "%s", _("Invalid parameter to virXPathNode()"));
         return NULL;
     }
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     if ((obj == NULL) || (obj->type != XPATH_NODESET) ||
         (obj->nodesetval == NULL) || (obj->nodesetval->nodeNr <= 0) ||
         (obj->nodesetval->nodeTab == NULL)) {
@@ -915,7 +992,7 @@ virXPathNodeSet(const char *xpath,
     if (list != NULL)
         *list = NULL;
 
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     if (obj == NULL)
         return 0;
 
@@ -1226,6 +1303,74 @@ virXMLSaveFile(const char *path,
                           virXMLRewriteFile, &data);
 }
 
+
+struct virXMLRewriteFileFormatData {
+    const char *warnName;
+    const char *warnCommand;
+    virXMLFormatFunc format;
+    const void *opaque;
+};
+
+static int
+virXMLRewriteFileFormat(int fd,
+                        const char *path,
+                        const void *opaque)
+{
+    const struct virXMLRewriteFileFormatData *data = opaque;
+    g_autoptr(virBufferSink) sink = virBufferSinkNewFD(fd);
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+
+    if (data->warnCommand &&
+        virXMLEmitWarning(fd, data->warnName, data->warnCommand) < 0) {
+        virReportSystemError(errno,
+                             _("cannot write data to file '%s'"),
+                             path);
+        return -1;
+    }
+
+    virBufferSetSink(&buf, sink);
+
+    if (data->format(&buf, data->opaque) < 0)
+        return -1;
+
+    if (virBufferSinkFinish(&buf) < 0) {
+        virReportSystemError(errno,
+                             _("cannot write data to file '%s'"),
+                             path);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * virXMLSaveFileFormat:
+ * @path: file to write
+ * @warnName: name to put into the warning comment
+ * @warnCommand: command to put into the warning comment, NULL for none
+ * @format: callback formatting the XML
+ * @opaque: data passed to @format
+ *
+ * Same as virXMLSaveFile, but the XML formatted by @format into the
+ * buffer it is given is streamed into the file in chunks instead of
+ * being formatted into memory first.
+ *
+ * Returns 0 on success, -1 with error reported otherwise.
+ */
+int
+virXMLSaveFileFormat(const char *path,
+                     const char *warnName,
+                     const char *warnCommand,
+                     virXMLFormatFunc format,
+                     const void *opaque)
+{
+    struct virXMLRewriteFileFormatData data = { warnName, warnCommand,
+                                                format, opaque };
+
+    return virFileRewrite(path, S_IRUSR | S_IWUSR, -1, -1,
+                          virXMLRewriteFileFormat, &data);
+}
+
 /**
  * virXMLNodeToString: convert an XML node ptr to an XML string
  *
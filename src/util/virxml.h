@@ -264,6 +264,23 @@ virXMLSaveFile(const char *path,
                const char *warnCommand,
                const char *xml);
 
+/**
+ * virXMLFormatFunc:
+ * @buf: buffer to format the XML into
+ * @opaque: opaque data
+ *
+ * Returns 0 on success, -1 with error reported otherwise.
+ */
+typedef int (*virXMLFormatFunc)(virBuffer *buf,
+                                const void *opaque);
+
+int
+virXMLSaveFileFormat(const char *path,
+                     const char *warnName,
+                     const char *warnCommand,
+                     virXMLFormatFunc format,
+                     const void *opaque);
+
 char *
 virXMLNodeToString(xmlDocPtr doc,
                    xmlNodePtr node);
@@ -300,6 +300,106 @@ static int testFDStreamWriteNonblock(const void *data)
     return testFDStreamWriteCommon(data, false);
 }
 
+static int testFDStreamSplice(const void *data)
+{
+    const char *scratchdir = data;
+    VIR_AUTOCLOSE fd = -1;
+    g_autofree char *file = NULL;
+    int ret = -1;
+    g_autofree char *pattern = NULL;
+    g_autofree char *buf = NULL;
+    virStreamPtr st = NULL;
+    size_t i;
+    size_t total = 0;
+    virConnectPtr conn = NULL;
+
+    if (!(conn = virConnectOpen("test:///default")))
+        goto cleanup;
+
+    pattern = g_new0(char, PATTERN_LEN * 10);
+    buf = g_new0(char, PATTERN_LEN * 10);
+
+    for (i = 0; i < PATTERN_LEN * 10; i++)
+        pattern[i] = i % 251;
+
+    file = g_strdup_printf("%s/input.data", scratchdir);
+
+    if ((fd = open(file, O_CREAT|O_WRONLY|O_EXCL, 0600)) < 0)
+        goto cleanup;
+
+    if (safewrite(fd, pattern, PATTERN_LEN * 10) != PATTERN_LEN * 10)
+        goto cleanup;
+
+    if (VIR_CLOSE(fd) < 0)
+        goto cleanup;
+
+    if (!(st = virStreamNew(conn, VIR_STREAM_NONBLOCK)))
+        goto cleanup;
+
+    if (virFDStreamOpenFile(st, file, 0, 0, O_RDONLY) < 0)
+        goto cleanup;
+
+    /* Claim data in odd sized chunks, falling back to plain reads
+     * whenever zero copy is not possible. */
+    while (1) {
+        VIR_AUTOCLOSE pipefd = -1;
+        int got;
+
+        if (total == PATTERN_LEN * 10)
+            break;
+
+        got = virFDStreamSpliceData(st, PATTERN_LEN + 3, &pipefd);
+        if (got < 0) {
+            fprintf(stderr, "Failed to splice stream: %s\n",
+                    virGetLastErrorMessage());
+            goto cleanup;
+        }
+
+        if (got > 0) {
+            if (total + got > PATTERN_LEN * 10 ||
+                saferead(pipefd, buf + total, got) != got) {
+                fprintf(stderr, "Failed to read spliced data\n");
+                goto cleanup;
+            }
+        } else {
+            got = st->driver->streamRecv(st, buf + total,
+                                         PATTERN_LEN * 10 - total);
+            if (got == -2) {
+                g_usleep(20 * 1000);
+                continue;
+            }
+            if (got <= 0) {
+                fprintf(stderr, "Unexpected EOF or error at %zu: %s\n",
+                        total, virGetLastErrorMessage());
+                goto cleanup;
+            }
+        }
+
+        total += got;
+    }
+
+    if (memcmp(buf, pattern, PATTERN_LEN * 10) != 0) {
+        fprintf(stderr, "Mismatched pattern data\n");
+        goto cleanup;
+    }
+
+    if (st->driver->streamFinish(st) != 0) {
+        fprintf(stderr, "Failed to finish stream: %s\n",
+                virGetLastErrorMessage());
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    if (st)
+        virStreamFree(st);
+    if (file != NULL)
+        unlink(file);
+    if (conn)
+        virConnectClose(conn);
+    return ret;
+}
+
 #define SCRATCHDIRTEMPLATE abs_builddir "/fdstreamdir-XXXXXX"
 
 static int
@@ -321,6 +421,8 @@ mymain(void)
         ret = -1;
     if (virTestRun("Stream write non-blocking ", testFDStreamWriteNonblock, scratchdir) < 0)
         ret = -1;
+    if (virTestRun("Stream splice ", testFDStreamSplice, scratchdir) < 0)
+        ret = -1;
 
     if (getenv("LIBVIRT_SKIP_CLEANUP") == NULL)
         virFileDeleteTree(scratchdir);
@@ -241,6 +241,7 @@ mymain(void)
     DO_TEST_BACKUP("backup-pull");
     DO_TEST_BACKUP("backup-pull-seclabel");
     DO_TEST_BACKUP("backup-pull-encrypted");
+    DO_TEST_BACKUP("backup-pull-nbd-exports");
     DO_TEST_BACKUP("backup-push");
     DO_TEST_BACKUP("backup-push-seclabel");
     DO_TEST_BACKUP("backup-push-encrypted");
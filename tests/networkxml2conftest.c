@@ -117,10 +117,12 @@ buildCapsCallback(const char *const*args,
                   char **output,
                   char **error G_GNUC_UNUSED,
                   int *status,
-                  void *opaque G_GNUC_UNUSED)
+                  void *opaque)
 {
+    const char *version = opaque;
+
     if (STREQ(args[0], "/usr/sbin/dnsmasq") && STREQ(args[1], "--version")) {
-        *output = g_strdup("Dnsmasq version 2.67\n");
+        *output = g_strdup_printf("Dnsmasq version %s\n", version);
         *status = EXIT_SUCCESS;
     } else {
         *status = EXIT_FAILURE;
@@ -128,12 +130,13 @@ buildCapsCallback(const char *const*args,
 }
 
 static dnsmasqCaps *
-buildCaps(void)
+buildCaps(const char *version)
 {
     g_autoptr(dnsmasqCaps) caps = NULL;
     g_autoptr(virCommandDryRunToken) dryRunToken = virCommandDryRunTokenNew();
 
-    virCommandSetDryRun(dryRunToken, NULL, true, true, buildCapsCallback, NULL);
+    virCommandSetDryRun(dryRunToken, NULL, true, true, buildCapsCallback,
+                        (void *)version);
 
     caps = dnsmasqCapsNewFromBinary();
 
@@ -146,8 +149,10 @@ mymain(void)
 {
     int ret = 0;
     g_autoptr(dnsmasqCaps) full = NULL;
+    g_autoptr(dnsmasqCaps) hostsdir = NULL;
 
-    if (!(full = buildCaps())) {
+    if (!(full = buildCaps("2.67")) ||
+        !(hostsdir = buildCaps("2.73"))) {
         fprintf(stderr, "failed to create the fake capabilities: %s",
                 virGetLastErrorMessage());
         return EXIT_FAILURE;
@@ -175,6 +180,7 @@ mymain(void)
     DO_TEST("routed-network-no-dns", full);
     DO_TEST("open-network", full);
     DO_TEST("nat-network", full);
+    DO_TEST("nat-network-dhcp-hostsdir", hostsdir);
     DO_TEST("nat-network-dns-txt-record", full);
     DO_TEST("nat-network-dns-srv-record", full);
     DO_TEST("nat-network-dns-hosts", full);
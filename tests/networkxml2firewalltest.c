@@ -74,12 +74,18 @@ VIR_MOCK_WRAP_RET_ARGS(g_dbus_connection_call_sync,
 static void
 testCommandDryRun(const char *const*args G_GNUC_UNUSED,
                   const char *const*env G_GNUC_UNUSED,
-                  const char *input G_GNUC_UNUSED,
+                  const char *input,
                   char **output,
                   char **error,
                   int *status,
-                  void *opaque G_GNUC_UNUSED)
+                  void *opaque)
 {
+    virBuffer *buf = opaque;
+
+    /* rules applied in one transaction are passed on stdin */
+    if (input)
+        virBufferAdd(buf, input, -1);
+
     *status = 0;
     *output = g_strdup("");
     *error = g_strdup("");
@@ -87,7 +93,8 @@ testCommandDryRun(const char *const*args G_GNUC_UNUSED,
 
 static int testCompareXMLToArgvFiles(const char *xml,
                                      const char *cmdline,
-                                     const char *baseargs)
+                                     const char *baseargs,
+                                     virFirewallBackend backend)
 {
     g_autofree char *actualargv = NULL;
     g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
@@ -96,12 +103,12 @@ static int testCompareXMLToArgvFiles(const char *xml,
     char *actual;
     g_autoptr(virCommandDryRunToken) dryRunToken = virCommandDryRunTokenNew();
 
-    virCommandSetDryRun(dryRunToken, &buf, true, true, testCommandDryRun, NULL);
+    virCommandSetDryRun(dryRunToken, &buf, true, true, testCommandDryRun, &buf);
 
     if (!(def = virNetworkDefParseFile(xml, NULL)))
         goto cleanup;
 
-    if (networkAddFirewallRules(def) < 0)
+    if (networkAddFirewallRules(def, backend) < 0)
         goto cleanup;
 
     actual = actualargv = virBufferContentAndReset(&buf);
@@ -126,6 +133,7 @@ static int testCompareXMLToArgvFiles(const char *xml,
 struct testInfo {
     const char *name;
     const char *baseargs;
+    virFirewallBackend backend;
 };
 
 
@@ -139,10 +147,15 @@ testCompareXMLToIPTablesHelper(const void *data)
 
     xml = g_strdup_printf("%s/networkxml2firewalldata/%s.xml",
                           abs_srcdir, info->name);
-    args = g_strdup_printf("%s/networkxml2firewalldata/%s-%s.args",
-                           abs_srcdir, info->name, RULESTYPE);
+    if (info->backend == VIR_FIREWALL_BACKEND_NFTABLES)
+        args = g_strdup_printf("%s/networkxml2firewalldata/%s-nftables.args",
+                               abs_srcdir, info->name);
+    else
+        args = g_strdup_printf("%s/networkxml2firewalldata/%s-%s.args",
+                               abs_srcdir, info->name, RULESTYPE);
 
-    result = testCompareXMLToArgvFiles(xml, args, info->baseargs);
+    result = testCompareXMLToArgvFiles(xml, args, info->baseargs,
+                                       info->backend);
 
     return result;
 }
@@ -154,20 +167,35 @@ mymain(void)
     int ret = 0;
     g_autofree char *basefile = NULL;
     g_autofree char *baseargs = NULL;
+    g_autofree char *nftBasefile = NULL;
+    g_autofree char *nftBaseargs = NULL;
 
 # define DO_TEST(name) \
     do { \
         struct testInfo info = { \
-            name, baseargs, \
+            name, baseargs, VIR_FIREWALL_BACKEND_IPTABLES, \
         }; \
         if (virTestRun("Network XML-2-iptables " name, \
                        testCompareXMLToIPTablesHelper, &info) < 0) \
             ret = -1; \
     } while (0)
 
+# define DO_TEST_NFTABLES(name) \
+    do { \
+        struct testInfo info = { \
+            name, nftBaseargs, VIR_FIREWALL_BACKEND_NFTABLES, \
+        }; \
+        if (virTestRun("Network XML-2-nftables " name, \
+                       testCompareXMLToIPTablesHelper, &info) < 0) \
+            ret = -1; \
+    } while (0)
+
     basefile = g_strdup_printf("%s/networkxml2firewalldata/base.args", abs_srcdir);
+    nftBasefile = g_strdup_printf("%s/networkxml2firewalldata/base-nftables.args",
+                                  abs_srcdir);
 
-    if (virFileReadAll(basefile, INT_MAX, &baseargs) < 0)
+    if (virFileReadAll(basefile, INT_MAX, &baseargs) < 0 ||
+        virFileReadAll(nftBasefile, INT_MAX, &nftBaseargs) < 0)
         return EXIT_FAILURE;
 
     DO_TEST("nat-default");
@@ -178,6 +206,10 @@ mymain(void)
     DO_TEST("nat-ipv6-masquerade");
     DO_TEST("route-default");
 
+    DO_TEST_NFTABLES("nat-default");
+    DO_TEST_NFTABLES("nat-ipv6");
+    DO_TEST_NFTABLES("route-default");
+
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
@@ -263,6 +263,7 @@ nodedevTestDriverFree(virNodeDeviceDriverState *drv)
         return;
 
     virNodeDeviceObjListFree(drv->devs);
+    virCondDestroy(&drv->devsCond);
     virCondDestroy(&drv->initCond);
     virMutexDestroy(&drv->lock);
     g_free(drv->stateDir);
@@ -396,7 +397,8 @@ nodedevTestDriverInit(void)
 
     driver->lockFD = -1;
     if (virMutexInit(&driver->lock) < 0 ||
-        virCondInit(&driver->initCond) < 0) {
+        virCondInit(&driver->initCond) < 0 ||
+        virCondInit(&driver->devsCond) < 0) {
         VIR_TEST_DEBUG("Unable to initialize test nodedev driver");
         goto error;
     }
@@ -23,8 +23,12 @@
 
 #include "testutils.h"
 
+#include "datatypes.h"
+#include "domain_event.h"
+#include "object_event.h"
 #include "virerror.h"
 #include "virxml.h"
+#include "viruuid.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
 
@@ -83,6 +87,12 @@ typedef struct {
 } lifecycleEventCounter;
 
 
+typedef struct {
+    int events;
+    unsigned long long actual;
+} balloonEventCounter;
+
+
 typedef struct {
     virConnectPtr conn;
     virNetworkPtr net;
@@ -120,6 +130,18 @@ domainLifecycleCb(virConnectPtr conn G_GNUC_UNUSED,
     return 0;
 }
 
+static void
+domainBalloonChangeCb(virConnectPtr conn G_GNUC_UNUSED,
+                      virDomainPtr dom G_GNUC_UNUSED,
+                      unsigned long long actual,
+                      void *opaque)
+{
+    balloonEventCounter *counter = opaque;
+
+    counter->events++;
+    counter->actual = actual;
+}
+
 static void
 networkLifecycleCb(virConnectPtr conn G_GNUC_UNUSED,
                    virNetworkPtr net G_GNUC_UNUSED,
@@ -447,6 +469,80 @@ testDomainStartStopEvent(const void *data)
     return ret;
 }
 
+static int
+testDomainBalloonCoalesce(const void *data)
+{
+    const objecteventTest *test = data;
+    balloonEventCounter counter = { 0 };
+    virObjectEventState *state = NULL;
+    virDomainPtr doms[5] = { NULL };
+    unsigned char uuid[VIR_UUID_BUFLEN];
+    int id = -1;
+    size_t i;
+    int ret = -1;
+
+    if (!(state = virObjectEventStateNew()))
+        return -1;
+
+    for (i = 0; i < G_N_ELEMENTS(doms); i++) {
+        g_autofree char *name = g_strdup_printf("test-%zu", i);
+
+        if (virUUIDGenerate(uuid) < 0 ||
+            !(doms[i] = virGetDomain(test->conn, name, uuid, i + 1)))
+            goto cleanup;
+    }
+
+    if (virDomainEventStateRegisterID(test->conn, state, NULL,
+                                      VIR_DOMAIN_EVENT_ID_BALLOON_CHANGE,
+                                      VIR_DOMAIN_EVENT_CALLBACK(&domainBalloonChangeCb),
+                                      &counter, NULL, &id) < 0)
+        goto cleanup;
+
+    if (virObjectEventStateSetCallbackPolicy(test->conn, state, id, 50, 2) < 0)
+        goto cleanup;
+
+    /* Only the latest change of a single domain is delivered */
+    for (i = 1; i <= 5; i++)
+        virObjectEventStateQueue(state,
+                                 virDomainEventBalloonChangeNewFromDom(doms[0],
+                                                                       i * 1024));
+
+    while (counter.events == 0) {
+        if (virEventRunDefaultImpl() < 0)
+            goto cleanup;
+    }
+
+    if (counter.events != 1 || counter.actual != 5 * 1024)
+        goto cleanup;
+
+    /* Changes of distinct domains are kept, up to the queue bound */
+    memset(&counter, 0, sizeof(counter));
+    for (i = 0; i < G_N_ELEMENTS(doms); i++)
+        virObjectEventStateQueue(state,
+                                 virDomainEventBalloonChangeNewFromDom(doms[i],
+                                                                       i));
+
+    while (counter.events == 0) {
+        if (virEventRunDefaultImpl() < 0)
+            goto cleanup;
+    }
+
+    if (counter.events != 2 || counter.actual != G_N_ELEMENTS(doms) - 1 ||
+        virObjectEventStateGetDropped(state) != G_N_ELEMENTS(doms) - 2)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    if (id >= 0)
+        virObjectEventStateDeregisterID(test->conn, state, id, true);
+    for (i = 0; i < G_N_ELEMENTS(doms); i++) {
+        if (doms[i])
+            virDomainFree(doms[i]);
+    }
+    virObjectUnref(state);
+    return ret;
+}
+
 static int
 testNetworkCreateXML(const void *data)
 {
@@ -807,6 +903,9 @@ mymain(void)
         ret = EXIT_FAILURE;
     if (virTestRun("Domain start stop events", testDomainStartStopEvent, &test) < 0)
         ret = EXIT_FAILURE;
+    if (virTestRun("Domain balloon change coalescing",
+                   testDomainBalloonCoalesce, &test) < 0)
+        ret = EXIT_FAILURE;
 
     /* Network event tests */
     /* Tests requiring the test network not to be set up */
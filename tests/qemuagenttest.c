@@ -1292,6 +1292,25 @@ testQemuAgentOSInfo(const void *data)
     nparams = 0;
     maxparams = 0;
 
+    /* the reply is cached, so the agent isn't asked again */
+    if (qemuAgentGetOSInfo(qemuMonitorTestGetAgent(test),
+                           &params, &nparams, &maxparams, true) < 0)
+        goto cleanup;
+
+    if (nparams != 8) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       "Expected 8 cached params, got %d", nparams);
+        goto cleanup;
+    }
+
+    VALIDATE_PARAM("os.id", "centos");
+    virTypedParamsFree(params, nparams);
+    params = NULL;
+    nparams = 0;
+    maxparams = 0;
+
+    qemuAgentInvalidateCache(qemuMonitorTestGetAgent(test));
+
     if (qemuMonitorTestAddAgentSyncResponse(test) < 0)
         goto cleanup;
 
@@ -1328,6 +1347,68 @@ testQemuAgentOSInfo(const void *data)
     return ret;
 }
 
+static int
+testQemuAgentPrefetch(const void *data)
+{
+    virDomainXMLOption *xmlopt = (virDomainXMLOption *)data;
+    g_autoptr(qemuMonitorTest) test = qemuMonitorTestNewAgent(xmlopt);
+    const char *commands[] = { "guest-get-users", "guest-get-osinfo" };
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+    int maxparams = 0;
+    unsigned int count;
+    int ret = -1;
+
+    if (!test)
+        return -1;
+
+    /* a single sync for both commands */
+    if (qemuMonitorTestAddAgentSyncResponse(test) < 0)
+        goto cleanup;
+
+    if (qemuMonitorTestAddItem(test, "guest-get-users",
+                               testQemuAgentUsersResponse) < 0 ||
+        qemuMonitorTestAddItem(test, "guest-get-osinfo",
+                               testQemuAgentOSInfoResponse) < 0)
+        goto cleanup;
+
+    qemuAgentPrefetch(qemuMonitorTestGetAgent(test),
+                      commands, G_N_ELEMENTS(commands));
+
+    if (qemuAgentGetUsers(qemuMonitorTestGetAgent(test),
+                          &params, &nparams, &maxparams, true) < 0 ||
+        qemuAgentGetOSInfo(qemuMonitorTestGetAgent(test),
+                           &params, &nparams, &maxparams, true) < 0)
+        goto cleanup;
+
+    qemuAgentPrefetchClear(qemuMonitorTestGetAgent(test));
+
+    if (virTypedParamsGetUInt(params, nparams, "user.count", &count) < 0 ||
+        count != 2) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       "Expected 2 prefetched users");
+        goto cleanup;
+    }
+
+    if (checkUserInfo(params, nparams, 0, "test", NULL, 1561739203584) < 0 ||
+        checkUserInfo(params, nparams, 1, "test2", NULL, 1561739229190) < 0)
+        goto cleanup;
+
+    /* user.count and two users with a name and login time each */
+    if (nparams != 5 + 8) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       "Expected 13 params, got %d", nparams);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virTypedParamsFree(params, nparams);
+    return ret;
+}
+
+
 static const char testQemuAgentTimezoneResponse1[] =
 "{\"return\":{\"zone\":\"IST\",\"offset\":19800}}";
 static const char testQemuAgentTimezoneResponse2[] =
@@ -1431,6 +1512,7 @@ mymain(void)
     DO_TEST(GetInterfaces);
     DO_TEST(Users);
     DO_TEST(OSInfo);
+    DO_TEST(Prefetch);
     DO_TEST(Timezone);
     DO_TEST(SSHKeys);
     DO_TEST(GetDisks);
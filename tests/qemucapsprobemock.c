@@ -81,34 +81,33 @@ qemuMonitorSend(qemuMonitor *mon,
 }
 
 
-static int (*realQemuMonitorJSONIOProcessLine)(qemuMonitor *mon,
-                                               const char *line,
-                                               qemuMonitorMessage *msg);
+static int (*realQemuMonitorJSONIOProcessObject)(qemuMonitor *mon,
+                                                 virJSONValue **obj,
+                                                 const char *line,
+                                                 qemuMonitorMessage *msg);
 
 int
-qemuMonitorJSONIOProcessLine(qemuMonitor *mon,
-                             const char *line,
-                             qemuMonitorMessage *msg)
+qemuMonitorJSONIOProcessObject(qemuMonitor *mon,
+                               virJSONValue **obj,
+                               const char *line,
+                               qemuMonitorMessage *msg)
 {
-    g_autoptr(virJSONValue) value = NULL;
     g_autofree char *json = NULL;
+    bool greeting = virJSONValueObjectHasKey(*obj, "QMP") == 1;
     int ret;
 
-    REAL_SYM(realQemuMonitorJSONIOProcessLine);
+    REAL_SYM(realQemuMonitorJSONIOProcessObject);
 
-    ret = realQemuMonitorJSONIOProcessLine(mon, line, msg);
-
-    if (ret == 0) {
-        if (!(value = virJSONValueFromString(line)) ||
-            !(json = virJSONValueToString(value, true))) {
-            fprintf(stderr, "Failed to reformat reply string '%s'\n", line);
-            abort();
-        }
+    /* @obj may be stolen by the real implementation */
+    if (!(json = virJSONValueToString(*obj, true))) {
+        fprintf(stderr, "Failed to reformat reply string '%s'\n", line);
+        abort();
+    }
 
-        /* Ignore QMP greeting */
-        if (virJSONValueObjectHasKey(value, "QMP"))
-            return 0;
+    ret = realQemuMonitorJSONIOProcessObject(mon, obj, line, msg);
 
+    /* Ignore QMP greeting */
+    if (ret == 0 && !greeting) {
         if (first)
             first = false;
         else
@@ -0,0 +1,178 @@
+/*
+ * qemumigrationconvergencetest.c: replay migration traces against the
+ *                                 convergence controller
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <config.h>
+
+#include "virbuffer.h"
+#include "testutils.h"
+#include "testutilsqemu.h"
+#include "qemumonitortestutils.h"
+#include "qemu/qemu_monitor.h"
+#define LIBVIRT_QEMU_MIGRATIONPRIV_H_ALLOW
+#include "qemu/qemu_migrationpriv.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+typedef struct _qemuMigConvergenceData qemuMigConvergenceData;
+struct _qemuMigConvergenceData {
+    virDomainXMLOption *xmlopt;
+    const char *name;
+    const char *trace;
+    unsigned long long downtime; /* initial downtime limit in ms */
+    unsigned long long maxDowntime; /* 0 disables the controller */
+    bool postcopy;
+};
+
+
+/*
+ * Each reply in the trace is a query-migrate result as recorded from QEMU
+ * during a migration, one per wake up of the migration job. Since QEMU
+ * switches over once the expected downtime fits into the downtime limit,
+ * the simulated migration converges at the first sample that satisfies the
+ * limit in effect at that time.
+ */
+static int
+qemuMigConvergenceTestReplay(const void *opaque)
+{
+    const qemuMigConvergenceData *data = opaque;
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    g_autofree char *replyFile = NULL;
+    g_autofree char *outFile = NULL;
+    g_autofree char *actual = NULL;
+    g_autofree char *trace = NULL;
+    char *tmp;
+    g_autoptr(qemuMonitorTest) mon = NULL;
+    qemuMigrationConvergence conv = {
+        .maxDowntime = data->maxDowntime,
+        .postcopy = data->postcopy,
+        .downtime = data->downtime,
+    };
+    unsigned long long time = 0;
+    size_t nsamples = 1;
+    size_t i;
+
+    replyFile = g_strdup_printf("%s/qemumigrationconvergencedata/%s.reply",
+                                abs_srcdir, data->trace);
+    outFile = g_strdup_printf("%s/qemumigrationconvergencedata/%s.out",
+                              abs_srcdir, data->name);
+
+    if (virTestLoadFile(replyFile, &trace) < 0)
+        return -1;
+
+    /* replies are separated by empty lines */
+    for (tmp = trace; (tmp = strstr(tmp, "\n\n")); tmp += 2)
+        nsamples++;
+
+    if (!(mon = qemuMonitorTestNewFromFile(replyFile, data->xmlopt, true)))
+        return -1;
+
+    qemuMonitorTestAllowUnusedCommands(mon);
+
+    for (i = 0; i < nsamples; i++) {
+        qemuMonitorMigrationStats stats = { 0 };
+        unsigned long long downtime = 0;
+
+        if (qemuMonitorGetMigrationStats(qemuMonitorTestGetMonitor(mon),
+                                         &stats, NULL) < 0)
+            return -1;
+
+        time = stats.total_time;
+
+        if (stats.status == QEMU_MONITOR_MIGRATION_STATUS_COMPLETED) {
+            virBufferAsprintf(&buf, "completed after %llums, downtime %llums\n",
+                              time, stats.downtime);
+            break;
+        }
+
+        if (stats.status != QEMU_MONITOR_MIGRATION_STATUS_ACTIVE) {
+            virBufferAsprintf(&buf, "unexpected status '%s' after %llums\n",
+                              qemuMonitorMigrationStatusTypeToString(stats.status),
+                              time);
+            break;
+        }
+
+        if (stats.downtime_set && stats.downtime <= conv.downtime) {
+            virBufferAsprintf(&buf, "converged after %llums, downtime %llums\n",
+                              time, stats.downtime);
+            break;
+        }
+
+        if (conv.maxDowntime) {
+            switch (qemuMigrationConvergenceDecide(&conv, &stats, &downtime)) {
+            case QEMU_MIGRATION_CONVERGENCE_NONE:
+                break;
+
+            case QEMU_MIGRATION_CONVERGENCE_SET_DOWNTIME:
+                virBufferAsprintf(&buf, "%llums: pass %llu, downtime limit %llums\n",
+                                  time, stats.ram_iteration, downtime);
+                break;
+
+            case QEMU_MIGRATION_CONVERGENCE_POSTCOPY:
+                virBufferAsprintf(&buf, "%llums: pass %llu, post-copy\n",
+                                  time, stats.ram_iteration);
+                break;
+            }
+
+            if (!conv.maxDowntime)
+                break;
+        }
+    }
+
+    if (i == nsamples)
+        virBufferAsprintf(&buf, "not converged after %llums\n", time);
+
+    actual = virBufferContentAndReset(&buf);
+
+    return virTestCompareToFile(actual, outFile);
+}
+
+
+static int
+mymain(void)
+{
+    virQEMUDriver driver;
+    int ret = 0;
+
+    if (qemuTestDriverInit(&driver) < 0)
+        return EXIT_FAILURE;
+
+    virEventRegisterDefaultImpl();
+
+#define DO_TEST(name, trace, maxDowntime, postcopy) \
+    do { \
+        qemuMigConvergenceData data = { \
+            driver.xmlopt, name, trace, 300, maxDowntime, postcopy \
+        }; \
+        if (virTestRun(name, qemuMigConvergenceTestReplay, &data) < 0) \
+            ret = -1; \
+    } while (0)
+
+    DO_TEST("converging-default", "converging", 0, false);
+    DO_TEST("converging-max-1000", "converging", 1000, false);
+    DO_TEST("stalled-default", "stalled", 0, false);
+    DO_TEST("stalled-max-1000", "stalled", 1000, false);
+    DO_TEST("stalled-max-1000-postcopy", "stalled", 1000, true);
+
+    qemuTestDriverFree(&driver);
+
+    return (ret == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
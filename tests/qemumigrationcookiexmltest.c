@@ -428,7 +428,8 @@ mymain(void)
         ret = -1;
 
     if (testQemuMigrationCookieXML2XML("basic", "qemustatusxml2xmldata/modern-in.xml", 0) < 0 ||
-        testQemuMigrationCookieXML2XML("full", "qemustatusxml2xmldata/modern-in.xml", 0) < 0)
+        testQemuMigrationCookieXML2XML("full", "qemustatusxml2xmldata/modern-in.xml", 0) < 0 ||
+        testQemuMigrationCookieXML2XML("persistent-ref", "qemustatusxml2xmldata/modern-in.xml", 0) < 0)
         ret = -1;
 
     if (testQemuMigrationCookieXML2XMLBitmaps("nbd-bitmaps", "qemustatusxml2xmldata/migration-out-nbd-bitmaps-in.xml", 0) < 0)
@@ -1269,11 +1269,11 @@ testQemuMonitorJSONqemuMonitorJSONNBDServerStart(const void *opaque)
         return -1;
 
     if (qemuMonitorJSONNBDServerStart(qemuMonitorTestGetMonitor(test),
-                                      &server_tcp, "test-alias") < 0)
+                                      &server_tcp, "test-alias", 0) < 0)
         return -1;
 
     if (qemuMonitorJSONNBDServerStart(qemuMonitorTestGetMonitor(test),
-                                      &server_unix, "test-alias") < 0)
+                                      &server_unix, "test-alias", 8) < 0)
         return -1;
 
     return 0;
@@ -2352,6 +2352,68 @@ testQemuMonitorJSONGetIOThreads(const void *opaque)
     return ret;
 }
 
+static int
+testQemuMonitorJSONQueryStats(const void *opaque)
+{
+    const testGenericData *data = opaque;
+    const char *names[] = { "halt_poll_success_ns", "halt_poll_fail_ns", NULL };
+    g_autoptr(qemuMonitorTest) test = NULL;
+    g_autoptr(virJSONValue) ret = NULL;
+    g_autoptr(GHashTable) stats = NULL;
+    virJSONValue *value;
+    unsigned long long num;
+
+    /* the QMP schema in the test data predates 'query-stats' */
+    if (!(test = qemuMonitorTestNewSimple(data->xmlopt)))
+        return -1;
+
+    if (qemuMonitorTestAddItemParams(test, "query-stats",
+                                     "{ \"return\": ["
+                                     "  { \"provider\": \"kvm\","
+                                     "    \"qom-path\": \"/machine/unattached/device[0]\","
+                                     "    \"stats\": ["
+                                     "      { \"name\": \"halt_poll_success_ns\", \"value\": 1234 },"
+                                     "      { \"name\": \"halt_poll_fail_ns\", \"value\": 56 }"
+                                     "    ] }"
+                                     "] }",
+                                     "target", "\"vcpu\"",
+                                     "providers", "[{\"provider\":\"kvm\","
+                                                  "\"names\":[\"halt_poll_success_ns\","
+                                                  "\"halt_poll_fail_ns\"]}]",
+                                     NULL, NULL) < 0)
+        return -1;
+
+    if (!(ret = qemuMonitorQueryStats(qemuMonitorTestGetMonitor(test),
+                                      QEMU_MONITOR_QUERY_STATS_TARGET_VCPU,
+                                      NULL,
+                                      QEMU_MONITOR_QUERY_STATS_PROVIDER_KVM,
+                                      names)))
+        return -1;
+
+    if (virJSONValueArraySize(ret) != 1) {
+        VIR_TEST_VERBOSE("expected 1 stats result, got %zu",
+                         virJSONValueArraySize(ret));
+        return -1;
+    }
+
+    if (!(stats = qemuMonitorExtractQueryStats(virJSONValueArrayGet(ret, 0))))
+        return -1;
+
+    if (!(value = virHashLookup(stats, "halt_poll_success_ns")) ||
+        virJSONValueGetNumberUlong(value, &num) < 0 || num != 1234) {
+        VIR_TEST_VERBOSE("wrong value of 'halt_poll_success_ns'");
+        return -1;
+    }
+
+    if (!(value = virHashLookup(stats, "halt_poll_fail_ns")) ||
+        virJSONValueGetNumberUlong(value, &num) < 0 || num != 56) {
+        VIR_TEST_VERBOSE("wrong value of 'halt_poll_fail_ns'");
+        return -1;
+    }
+
+    return 0;
+}
+
 struct testCPUInfoData {
     const char *name;
     size_t maxvcpus;
@@ -2792,7 +2854,8 @@ testQemuMonitorJSONBlockExportAdd(const void *opaque)
     if (!(test = qemuMonitorTestNewSchema(data->xmlopt, data->schema)))
         return -1;
 
-    if (!(nbddata = qemuBlockExportGetNBDProps("nodename", "exportname", true, bitmaps)))
+    if (!(nbddata = qemuBlockExportGetNBDProps("nodename", "exportname", true, bitmaps,
+                                                "iothread1")))
         return -1;
 
     if (qemuMonitorTestAddItem(test, "block-export-add", "{\"return\":{}}") < 0)
@@ -2831,6 +2894,57 @@ testQemuMonitorJSONBlockdevReopen(const void *opaque)
 }
 
 
+static int
+testQemuMonitorJSONBlockdevAddBatch(const void *opaque)
+{
+    const testGenericData *data = opaque;
+    g_autoptr(qemuMonitorTest) test = NULL;
+    g_autoptr(virJSONValue) storageProps = NULL;
+    g_autoptr(virJSONValue) formatProps = NULL;
+    bool storageAttached = false;
+    bool formatAttached = false;
+    qemuMonitorBlockdevAddBatchEntry entries[] = {
+        { &storageProps, NULL, &storageAttached },
+        { &formatProps, NULL, &formatAttached },
+    };
+
+    if (!(test = qemuMonitorTestNewSchema(data->xmlopt, data->schema)))
+        return -1;
+
+    if (virJSONValueObjectAdd(&storageProps,
+                              "s:driver", "file",
+                              "s:filename", "/var/lib/libvirt/images/a.qcow2",
+                              "s:node-name", "storage",
+                              NULL) < 0 ||
+        virJSONValueObjectAdd(&formatProps,
+                              "s:driver", "qcow2",
+                              "s:file", "storage",
+                              "s:node-name", "format",
+                              NULL) < 0)
+        return -1;
+
+    if (qemuMonitorTestAddItem(test, "blockdev-add", "{\"return\":{}}") < 0 ||
+        qemuMonitorTestAddItem(test, "blockdev-add",
+                               "{\"error\":{\"class\":\"GenericError\","
+                               "\"desc\":\"Image is not in qcow2 format\"}}") < 0)
+        return -1;
+
+    if (qemuMonitorBlockdevAddBatch(qemuMonitorTestGetMonitor(test),
+                                    entries, G_N_ELEMENTS(entries)) == 0) {
+        VIR_TEST_VERBOSE("failure of 'blockdev-add' was not reported");
+        return -1;
+    }
+
+    if (!storageAttached || formatAttached) {
+        VIR_TEST_VERBOSE("unexpected attach state: storage=%d format=%d",
+                         storageAttached, formatAttached);
+        return -1;
+    }
+
+    return 0;
+}
+
+
 static int
 testQemuMonitorJSONqemuMonitorJSONGetCPUModelComparison(const void *opaque)
 {
@@ -3067,10 +3181,12 @@ mymain(void)
     DO_TEST(CPU);
     DO_TEST(GetNonExistingCPUData);
     DO_TEST(GetIOThreads);
+    DO_TEST(QueryStats);
     DO_TEST(GetSEVInfo);
     DO_TEST(Transaction);
     DO_TEST(BlockExportAdd);
     DO_TEST(BlockdevReopen);
+    DO_TEST(BlockdevAddBatch);
     DO_TEST_SIMPLE("qmp_capabilities", qemuMonitorJSONSetCapabilities);
     DO_TEST_SIMPLE("system_powerdown", qemuMonitorJSONSystemPowerdown);
     DO_TEST_SIMPLE("system_reset", qemuMonitorJSONSystemReset);
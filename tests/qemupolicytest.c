@@ -0,0 +1,687 @@
+/*
+ * qemupolicytest.c: test the decisions of the QEMU driver resource policies
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "testutils.h"
+#define LIBVIRT_QEMU_BALLOON_AUTOSIZERPRIV_H_ALLOW
+#include "qemu/qemu_balloon_autosizerpriv.h"
+#define LIBVIRT_QEMU_BLOCKJOB_GOVERNORPRIV_H_ALLOW
+#include "qemu/qemu_blockjob_governorpriv.h"
+#define LIBVIRT_QEMU_CPU_BALANCERPRIV_H_ALLOW
+#include "qemu/qemu_cpu_balancerpriv.h"
+#define LIBVIRT_QEMU_IOTHREAD_POLL_TUNERPRIV_H_ALLOW
+#include "qemu/qemu_iothread_poll_tunerpriv.h"
+#define LIBVIRT_QEMU_IOTUNE_BALANCERPRIV_H_ALLOW
+#include "qemu/qemu_iotune_balancerpriv.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+#define MiB (1ULL << 20)
+
+/* 1GiB in KiB, the unit of the balloon size */
+#define GiB_KiB (1ULL << 20)
+
+
+struct testGovernorCongestedData {
+    qemuBlockJobGovernorSample prev;
+    qemuBlockJobGovernorSample cur;
+    unsigned long long latencyTarget;
+    bool expected;
+};
+
+static int
+testGovernorCongested(const void *opaque)
+{
+    const struct testGovernorCongestedData *data = opaque;
+    bool actual = qemuBlockJobGovernorCongested(&data->prev, &data->cur,
+                                                data->latencyTarget);
+
+    if (actual != data->expected) {
+        VIR_TEST_DEBUG("Expected congestion %d, got %d",
+                       data->expected, actual);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+struct testGovernorBudgetData {
+    unsigned long long limit;
+    size_t njobs;
+    const bool *congested; /* one entry per pass */
+    size_t npasses;
+    const unsigned long long *budgets; /* expected budget after each pass */
+    unsigned long long share; /* expected share after the last pass */
+};
+
+static int
+testGovernorBudget(const void *opaque)
+{
+    const struct testGovernorBudgetData *data = opaque;
+    unsigned long long budget = data->limit;
+    unsigned long long share;
+    size_t i;
+
+    for (i = 0; i < data->npasses; i++) {
+        budget = qemuBlockJobGovernorAdjustBudget(budget, data->limit,
+                                                  data->njobs,
+                                                  data->congested[i]);
+
+        if (budget != data->budgets[i]) {
+            VIR_TEST_DEBUG("Pass %zu: expected budget %llu, got %llu",
+                           i, data->budgets[i], budget);
+            return -1;
+        }
+    }
+
+    share = qemuBlockJobGovernorShare(budget, data->njobs);
+    if (share != data->share) {
+        VIR_TEST_DEBUG("Expected share %llu, got %llu", data->share, share);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+struct testIOTuneSampleData {
+    qemuIOTuneBalancerGroup group;
+    unsigned long long ops;
+    unsigned long long transferred;
+    unsigned long long now;
+    unsigned long long wantIops;
+    unsigned long long wantBytes;
+};
+
+static int
+testIOTuneSample(const void *opaque)
+{
+    const struct testIOTuneSampleData *data = opaque;
+    qemuIOTuneBalancerGroup group = data->group;
+
+    qemuIOTuneBalancerGroupSample(&group, data->ops, data->transferred,
+                                  data->now);
+
+    if (group.wantIops != data->wantIops ||
+        group.wantBytes != data->wantBytes) {
+        VIR_TEST_DEBUG("Expected demand %llu IOPS %llu bytes/s, got %llu %llu",
+                       data->wantIops, data->wantBytes,
+                       group.wantIops, group.wantBytes);
+        return -1;
+    }
+
+    if (group.ops != data->ops || group.transferred != data->transferred ||
+        group.sampled != data->now) {
+        VIR_TEST_DEBUG("Sample not recorded");
+        return -1;
+    }
+
+    return 0;
+}
+
+
+struct testIOTuneAllocateData {
+    unsigned long long total;
+    const unsigned long long *base;
+    const unsigned long long *want;
+    const unsigned long long *expected;
+    size_t ngroups;
+};
+
+static int
+testIOTuneAllocate(const void *opaque)
+{
+    const struct testIOTuneAllocateData *data = opaque;
+    g_autofree qemuIOTuneBalancerGroup *groups = NULL;
+    g_autofree qemuIOTuneBalancerGroup **ptrs = NULL;
+    bool bytes;
+    size_t i;
+
+    groups = g_new0(qemuIOTuneBalancerGroup, data->ngroups);
+    ptrs = g_new0(qemuIOTuneBalancerGroup *, data->ngroups);
+
+    /* IOPS and bytes limits are split the same way */
+    for (bytes = false; ; bytes = true) {
+        for (i = 0; i < data->ngroups; i++) {
+            groups[i].baseIops = groups[i].baseBytes = data->base[i];
+            groups[i].wantIops = groups[i].wantBytes = data->want[i];
+            ptrs[i] = &groups[i];
+        }
+
+        qemuIOTuneBalancerAllocate(ptrs, data->ngroups, data->total, bytes);
+
+        for (i = 0; i < data->ngroups; i++) {
+            unsigned long long actual = bytes ? groups[i].wantBytes : groups[i].wantIops;
+            unsigned long long other = bytes ? groups[i].wantIops : groups[i].wantBytes;
+
+            if (actual != data->expected[i]) {
+                VIR_TEST_DEBUG("Group %zu: expected %llu, got %llu",
+                               i, data->expected[i], actual);
+                return -1;
+            }
+
+            if (other != data->want[i]) {
+                VIR_TEST_DEBUG("Group %zu: the other limit changed", i);
+                return -1;
+            }
+        }
+
+        if (bytes)
+            break;
+    }
+
+    return 0;
+}
+
+
+struct testCPUUpdateData {
+    qemuCPUBalancerDomain dom;
+    unsigned int nvcpus;
+    unsigned long long cpuTime;
+    unsigned long long cpuWait;
+    unsigned long long now;
+    unsigned long long load;
+    unsigned long long wait;
+};
+
+static int
+testCPUUpdate(const void *opaque)
+{
+    const struct testCPUUpdateData *data = opaque;
+    qemuCPUBalancerDomain dom = data->dom;
+
+    qemuCPUBalancerDomainUpdate(&dom, data->nvcpus, data->cpuTime,
+                                data->cpuWait, data->now);
+
+    if (dom.load != data->load || dom.wait != data->wait) {
+        VIR_TEST_DEBUG("Expected load %llu wait %llu, got %llu %llu",
+                       data->load, data->wait, dom.load, dom.wait);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+#define TEST_CPU_MAX 4
+
+struct testCPUAssignData {
+    qemuCPUBalancerGroup groups[TEST_CPU_MAX];
+    size_t ngroups;
+    qemuCPUBalancerDomain doms[TEST_CPU_MAX]; /* sorted by load */
+    size_t ndoms;
+    unsigned long long now;
+    int expected[TEST_CPU_MAX]; /* group of each domain */
+};
+
+static int
+testCPUAssign(const void *opaque)
+{
+    const struct testCPUAssignData *data = opaque;
+    qemuCPUBalancerGroup groups[TEST_CPU_MAX];
+    qemuCPUBalancerDomain doms[TEST_CPU_MAX];
+    qemuCPUBalancerDomain *ptrs[TEST_CPU_MAX];
+    size_t i;
+
+    memcpy(groups, data->groups, sizeof(groups));
+    memcpy(doms, data->doms, sizeof(doms));
+    for (i = 0; i < data->ndoms; i++)
+        ptrs[i] = &doms[i];
+
+    qemuCPUBalancerAssign(ptrs, data->ndoms, groups, data->ngroups, data->now);
+
+    for (i = 0; i < data->ndoms; i++) {
+        if (doms[i].group != data->expected[i]) {
+            VIR_TEST_DEBUG("Domain %zu: expected group %d, got %d",
+                           i, data->expected[i], doms[i].group);
+            return -1;
+        }
+
+        /* a move is a change from one group to another */
+        if (doms[i].group >= 0 && data->doms[i].group >= 0 &&
+            doms[i].group != data->doms[i].group &&
+            doms[i].moved != data->now) {
+            VIR_TEST_DEBUG("Domain %zu: move not recorded", i);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+struct testPollStep {
+    unsigned long long cpuTime;
+    unsigned long long ops;
+    unsigned long long latency;
+    unsigned long long expected;
+};
+
+struct testPollData {
+    unsigned long long pollMaxNs;
+    unsigned int budget;
+    const struct testPollStep *steps;
+    size_t nsteps;
+};
+
+/* every step simulates a pass 5 seconds after the previous one */
+static int
+testPoll(const void *opaque)
+{
+    const struct testPollData *data = opaque;
+    qemuIOThreadPollTunerState state = { .pollMaxNs = data->pollMaxNs };
+    size_t i;
+
+    for (i = 0; i < data->nsteps; i++) {
+        const struct testPollStep *step = &data->steps[i];
+        unsigned long long want;
+
+        want = qemuIOThreadPollTunerDecide(&state, data->budget, 5000,
+                                           step->cpuTime, step->ops,
+                                           step->ops * step->latency);
+
+        if (want != step->expected) {
+            VIR_TEST_DEBUG("Step %zu: expected %llu, got %llu",
+                           i, step->expected, want);
+            return -1;
+        }
+
+        state.pollMaxNs = want;
+    }
+
+    return 0;
+}
+
+
+struct testBalloonData {
+    unsigned int hold;
+    unsigned long long cur;
+    unsigned long long min;
+    unsigned long long max;
+    unsigned long long usable;
+    bool hostShort;
+    unsigned long long hostFree; /* 0 if unknown */
+    unsigned long long expected;
+    unsigned int expectedHold;
+};
+
+static int
+testBalloon(const void *opaque)
+{
+    const struct testBalloonData *data = opaque;
+    qemuBalloonAutosizerState state = { .hold = data->hold };
+    unsigned long long want;
+
+    want = qemuBalloonAutosizerDecide(&state, data->cur, data->min, data->max,
+                                      data->usable, data->hostShort,
+                                      data->hostFree ? data->hostFree : ULLONG_MAX);
+
+    if (want != data->expected) {
+        VIR_TEST_DEBUG("Expected balloon %llu KiB, got %llu KiB",
+                       data->expected, want);
+        return -1;
+    }
+
+    if (state.hold != data->expectedHold) {
+        VIR_TEST_DEBUG("Expected hold %u, got %u", data->expectedHold, state.hold);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+
+#define DO_TEST_BALLOON(name, lo, hi, ...) \
+    do { \
+        struct testBalloonData data = { \
+            .cur = GiB_KiB, .min = lo, .max = hi, __VA_ARGS__ \
+        }; \
+        if (virTestRun("Balloon " name, testBalloon, &data) < 0) \
+            ret = -1; \
+    } while (0)
+
+    /* the headroom of a 1GiB balloon is 209715KiB */
+    DO_TEST_BALLOON("short", GiB_KiB / 2, 2 * GiB_KiB,
+                    .usable = 50000,
+                    .expected = GiB_KiB + 159715,
+                    .expectedHold = QEMU_BALLOON_AUTOSIZER_HOLD);
+    DO_TEST_BALLOON("short of host memory", GiB_KiB / 2, 2 * GiB_KiB,
+                    .usable = 50000, .hostFree = 100000,
+                    .expected = GiB_KiB + 100000,
+                    .expectedHold = QEMU_BALLOON_AUTOSIZER_HOLD);
+    DO_TEST_BALLOON("excess", GiB_KiB / 2, 2 * GiB_KiB,
+                    .usable = 600000,
+                    .expected = GiB_KiB - 390285 / 4);
+    DO_TEST_BALLOON("excess on pressure", GiB_KiB / 2, 2 * GiB_KiB,
+                    .usable = 600000, .hostShort = true,
+                    .expected = GiB_KiB - 390285);
+    DO_TEST_BALLOON("hold", GiB_KiB / 2, 2 * GiB_KiB,
+                    .hold = 3, .usable = 600000,
+                    .expected = GiB_KiB, .expectedHold = 2);
+    DO_TEST_BALLOON("hold on pressure", GiB_KiB / 2, 2 * GiB_KiB,
+                    .hold = 3, .usable = 600000,
+                    .hostShort = true,
+                    .expected = GiB_KiB - 390285, .expectedHold = 3);
+    DO_TEST_BALLOON("balanced", GiB_KiB / 2, 2 * GiB_KiB,
+                    .usable = 250000, .expected = GiB_KiB);
+    DO_TEST_BALLOON("small step", GiB_KiB / 2, 2 * GiB_KiB,
+                    .usable = 50000, .hostFree = 10000,
+                    .expected = GiB_KiB,
+                    .expectedHold = QEMU_BALLOON_AUTOSIZER_HOLD);
+    DO_TEST_BALLOON("minimum", 1000000, 2 * GiB_KiB,
+                    .usable = 600000,
+                    .hostShort = true, .expected = 1000000);
+    DO_TEST_BALLOON("above maximum", GiB_KiB / 2, 900000,
+                    .usable = 250000,
+                    .expected = 900000);
+
+#define DO_TEST_GOVERNOR_CONGESTED(name, ...) \
+    do { \
+        struct testGovernorCongestedData data = { __VA_ARGS__ }; \
+        if (virTestRun("Governor congested " name, \
+                       testGovernorCongested, &data) < 0) \
+            ret = -1; \
+    } while (0)
+
+    /* 10 requests taking 5ms each against a 4ms target */
+    DO_TEST_GOVERNOR_CONGESTED("slow",
+                               .prev = { 100, 1000000000 },
+                               .cur = { 110, 1050000000 },
+                               .latencyTarget = 4000000, .expected = true);
+    DO_TEST_GOVERNOR_CONGESTED("fast",
+                               .prev = { 100, 1000000000 },
+                               .cur = { 110, 1030000000 },
+                               .latencyTarget = 4000000, .expected = false);
+    DO_TEST_GOVERNOR_CONGESTED("at target",
+                               .prev = { 100, 1000000000 },
+                               .cur = { 110, 1040000000 },
+                               .latencyTarget = 4000000, .expected = false);
+    DO_TEST_GOVERNOR_CONGESTED("idle",
+                               .prev = { 100, 1000000000 },
+                               .cur = { 100, 1000000000 },
+                               .latencyTarget = 1, .expected = false);
+    DO_TEST_GOVERNOR_CONGESTED("reset",
+                               .prev = { 100, 1000000000 },
+                               .cur = { 10, 90000000 },
+                               .latencyTarget = 1, .expected = false);
+
+#define DO_TEST_GOVERNOR_BUDGET(name, lim, jobs, shr, ...) \
+    do { \
+        const bool congested[] = { __VA_ARGS__ }; \
+        struct testGovernorBudgetData data = { \
+            .limit = lim, .njobs = jobs, .congested = congested, \
+            .npasses = G_N_ELEMENTS(congested), .budgets = budgets, \
+            .share = shr, \
+        }; \
+        G_STATIC_ASSERT(G_N_ELEMENTS(congested) == G_N_ELEMENTS(budgets)); \
+        if (virTestRun("Governor budget " name, \
+                       testGovernorBudget, &data) < 0) \
+            ret = -1; \
+    } while (0)
+
+    {
+        const unsigned long long budgets[] = { 100 * MiB };
+        DO_TEST_GOVERNOR_BUDGET("no jobs", 100 * MiB, 0, 100 * MiB, true);
+    }
+    {
+        const unsigned long long budgets[] = { 100 * MiB };
+        DO_TEST_GOVERNOR_BUDGET("uncongested", 100 * MiB, 4, 25 * MiB, false);
+    }
+    {
+        const unsigned long long budgets[] = { 50 * MiB, 25 * MiB };
+        DO_TEST_GOVERNOR_BUDGET("halve", 100 * MiB, 2, 25 * MiB / 2,
+                                true, true);
+    }
+    {
+        const unsigned long long budgets[] = {
+            50 * MiB, 25 * MiB, 12 * MiB + MiB / 2, 10 * MiB,
+        };
+        DO_TEST_GOVERNOR_BUDGET("floor", 100 * MiB, 10, MiB,
+                                true, true, true, true);
+    }
+    {
+        const unsigned long long budgets[] = {
+            50 * MiB, 60 * MiB, 70 * MiB, 35 * MiB,
+        };
+        DO_TEST_GOVERNOR_BUDGET("recover", 100 * MiB, 1, 35 * MiB,
+                                true, false, false, true);
+    }
+    {
+        /* the limit is too low to give every job the minimum speed */
+        const unsigned long long budgets[] = { 4 * MiB, 4 * MiB };
+        DO_TEST_GOVERNOR_BUDGET("low limit", 4 * MiB, 8, MiB, true, false);
+    }
+
+#define DO_TEST_CPU_UPDATE(name, ...) \
+    do { \
+        struct testCPUUpdateData data = { __VA_ARGS__ }; \
+        if (virTestRun("CPU update " name, testCPUUpdate, &data) < 0) \
+            ret = -1; \
+    } while (0)
+
+    DO_TEST_CPU_UPDATE("first", .nvcpus = 2,
+                       .cpuTime = 5000000000ULL, .now = 10000,
+                       .load = 2000);
+    /* 1.5 CPUs busy, vCPUs waiting a quarter of the time */
+    DO_TEST_CPU_UPDATE("busy",
+                       .dom = { .cpuTime = 5000000000ULL, .cpuWait = 1000000000ULL,
+                                .sampled = 10000 },
+                       .nvcpus = 2,
+                       .cpuTime = 20000000000ULL, .cpuWait = 3500000000ULL,
+                       .now = 20000, .load = 1500, .wait = 250);
+    DO_TEST_CPU_UPDATE("restarted",
+                       .dom = { .cpuTime = 5000000000ULL, .sampled = 10000 },
+                       .nvcpus = 4, .cpuTime = 1000000000ULL, .now = 20000,
+                       .load = 4000);
+
+#define TEST_CPU_GROUP(first, numa) \
+    { .id = first, .node = numa, .ncpus = 4, .capacity = 4000 }
+#define TEST_CPU_DOMAIN(busy, vcpus, grp, when) \
+    { .load = busy, .nvcpus = vcpus, .group = grp, .moved = when }
+#define DO_TEST_CPU_ASSIGN(name, ...) \
+    do { \
+        struct testCPUAssignData data = { .now = 1000000, __VA_ARGS__ }; \
+        if (virTestRun("CPU assign " name, testCPUAssign, &data) < 0) \
+            ret = -1; \
+    } while (0)
+
+    DO_TEST_CPU_ASSIGN("place",
+                       .groups = { TEST_CPU_GROUP(0, 0), TEST_CPU_GROUP(4, 0) },
+                       .ngroups = 2,
+                       .doms = { TEST_CPU_DOMAIN(3000, 2, -1, 0),
+                                 TEST_CPU_DOMAIN(2000, 2, -1, 0),
+                                 TEST_CPU_DOMAIN(1000, 1, -1, 0) },
+                       .ndoms = 3,
+                       .expected = { 0, 4, 4 });
+    DO_TEST_CPU_ASSIGN("too big",
+                       .groups = { TEST_CPU_GROUP(0, 0), TEST_CPU_GROUP(4, 0) },
+                       .ngroups = 2,
+                       .doms = { TEST_CPU_DOMAIN(8000, 8, 0, 0),
+                                 TEST_CPU_DOMAIN(1000, 1, -1, 0) },
+                       .ndoms = 2,
+                       .expected = { -1, 0 });
+    DO_TEST_CPU_ASSIGN("move",
+                       .groups = { TEST_CPU_GROUP(0, 0), TEST_CPU_GROUP(4, 0) },
+                       .ngroups = 2,
+                       .doms = { TEST_CPU_DOMAIN(2500, 2, 0, 0),
+                                 TEST_CPU_DOMAIN(2000, 2, 0, 0) },
+                       .ndoms = 2,
+                       .expected = { 4, 0 });
+    DO_TEST_CPU_ASSIGN("settling",
+                       .groups = { TEST_CPU_GROUP(0, 0), TEST_CPU_GROUP(4, 0) },
+                       .ngroups = 2,
+                       .doms = { TEST_CPU_DOMAIN(2500, 2, 0, 990000),
+                                 TEST_CPU_DOMAIN(2000, 2, 0, 990000) },
+                       .ndoms = 2,
+                       .expected = { 0, 0 });
+    /* moving lowers the utilization of the busiest group by a quarter */
+    DO_TEST_CPU_ASSIGN("same node",
+                       .groups = { TEST_CPU_GROUP(0, 0), TEST_CPU_GROUP(4, 0) },
+                       .ngroups = 2,
+                       .doms = { TEST_CPU_DOMAIN(2700, 3, 0, 0),
+                                 TEST_CPU_DOMAIN(1000, 1, 0, 0) },
+                       .ndoms = 2,
+                       .expected = { 4, 0 });
+    DO_TEST_CPU_ASSIGN("other node",
+                       .groups = { TEST_CPU_GROUP(0, 0), TEST_CPU_GROUP(4, 1) },
+                       .ngroups = 2,
+                       .doms = { TEST_CPU_DOMAIN(2700, 3, 0, 0),
+                                 TEST_CPU_DOMAIN(1000, 1, 0, 0) },
+                       .ndoms = 2,
+                       .expected = { 0, 0 });
+
+#define DO_TEST_POLL(name, start) \
+    do { \
+        struct testPollData data = { \
+            .pollMaxNs = start, .budget = QEMU_IOTHREAD_POLL_TUNER_BUDGET, \
+            .steps = steps, .nsteps = G_N_ELEMENTS(steps), \
+        }; \
+        if (virTestRun("IOThread poll " name, testPoll, &data) < 0) \
+            ret = -1; \
+    } while (0)
+
+    {
+        const struct testPollStep steps[] = {
+            { 0, 0, 0, 16384 },
+            { 0, 0, 0, 8192 },
+            { 0, 0, 0, 4096 },
+            { 0, 0, 0, 0 },
+            { 0, 0, 0, 0 },
+        };
+        DO_TEST_POLL("idle", 32768);
+    }
+    {
+        /* the budget of 10% is 500ms of CPU time per pass */
+        const struct testPollStep steps[] = {
+            { 600000000, 1000, 100000, 16384 },
+            { 100000000, 1000, 100000, 16384 },
+        };
+        DO_TEST_POLL("over budget", 32768);
+    }
+    {
+        const struct testPollStep steps[] = {
+            { 100000000, 1000, 100000, 4096 },
+            /* 10% lower latency, keep probing */
+            { 100000000, 1000, 90000, 4096 },
+            { 100000000, 1000, 90000, 8192 },
+            /* 2% isn't worth it, revert and hold */
+            { 100000000, 1000, 88000, 4096 },
+            { 100000000, 1000, 88000, 4096 },
+            { 100000000, 1000, 88000, 4096 },
+            { 100000000, 1000, 88000, 4096 },
+            { 100000000, 1000, 88000, 4096 },
+            { 100000000, 1000, 88000, 4096 },
+            { 100000000, 1000, 88000, 4096 },
+            { 100000000, 1000, 88000, 8192 },
+        };
+        DO_TEST_POLL("probe", 0);
+    }
+    {
+        const struct testPollStep steps[] = {
+            { 100000000, 1000, 100000, 262144 },
+        };
+        DO_TEST_POLL("max", 262144);
+    }
+
+#define DO_TEST_IOTUNE_SAMPLE(name, ...) \
+    do { \
+        struct testIOTuneSampleData data = { __VA_ARGS__ }; \
+        if (virTestRun("IOTune sample " name, testIOTuneSample, &data) < 0) \
+            ret = -1; \
+    } while (0)
+
+    DO_TEST_IOTUNE_SAMPLE("first",
+                          .group = { .iops = 1000, .bytes = 8 * MiB },
+                          .ops = 500, .transferred = 4 * MiB, .now = 5000,
+                          .wantIops = 1000, .wantBytes = 8 * MiB);
+    /* 100 IOPS and 1MiB/s get a quarter of headroom */
+    DO_TEST_IOTUNE_SAMPLE("light",
+                          .group = { .iops = 1000, .bytes = 8 * MiB,
+                                     .ops = 500, .transferred = 4 * MiB,
+                                     .sampled = 5000 },
+                          .ops = 1000, .transferred = 9 * MiB, .now = 10000,
+                          .wantIops = 125, .wantBytes = MiB + MiB / 4);
+    /* 95 IOPS against a limit of 100 are offered twice the limit */
+    DO_TEST_IOTUNE_SAMPLE("saturated",
+                          .group = { .iops = 100,
+                                     .ops = 500, .sampled = 5000 },
+                          .ops = 975, .now = 10000,
+                          .wantIops = 200);
+    DO_TEST_IOTUNE_SAMPLE("reset",
+                          .group = { .iops = 1000, .bytes = 8 * MiB,
+                                     .ops = 500, .transferred = 4 * MiB,
+                                     .sampled = 5000 },
+                          .ops = 10, .transferred = MiB, .now = 10000,
+                          .wantIops = 1000, .wantBytes = 8 * MiB);
+    DO_TEST_IOTUNE_SAMPLE("same time",
+                          .group = { .iops = 1000,
+                                     .ops = 500, .sampled = 5000 },
+                          .ops = 600, .now = 5000,
+                          .wantIops = 1000);
+
+#define DO_TEST_IOTUNE_ALLOCATE(name, tot) \
+    do { \
+        struct testIOTuneAllocateData data = { \
+            .total = tot, .base = base, .want = want, .expected = expected, \
+            .ngroups = G_N_ELEMENTS(base), \
+        }; \
+        G_STATIC_ASSERT(G_N_ELEMENTS(base) == G_N_ELEMENTS(want)); \
+        G_STATIC_ASSERT(G_N_ELEMENTS(base) == G_N_ELEMENTS(expected)); \
+        if (virTestRun("IOTune allocate " name, \
+                       testIOTuneAllocate, &data) < 0) \
+            ret = -1; \
+    } while (0)
+
+    {
+        const unsigned long long base[] = { 100, 200 };
+        const unsigned long long want[] = { 300, 100 };
+        const unsigned long long expected[] = { 300, 200 };
+        DO_TEST_IOTUNE_ALLOCATE("spare", 1000);
+    }
+    {
+        /* 200 to split between an additional demand of 200 and 100 */
+        const unsigned long long base[] = { 100, 100 };
+        const unsigned long long want[] = { 300, 200 };
+        const unsigned long long expected[] = { 233, 166 };
+        DO_TEST_IOTUNE_ALLOCATE("scarce", 400);
+    }
+    {
+        const unsigned long long base[] = { 100, 100 };
+        const unsigned long long want[] = { 300, 200 };
+        const unsigned long long expected[] = { 100, 100 };
+        DO_TEST_IOTUNE_ALLOCATE("overcommitted", 150);
+    }
+    {
+        /* a group without a limit stays unlimited */
+        const unsigned long long base[] = { 0, 100 };
+        const unsigned long long want[] = { 500, 300 };
+        const unsigned long long expected[] = { 0, 300 };
+        DO_TEST_IOTUNE_ALLOCATE("unlimited", 1000);
+    }
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
@@ -336,6 +336,7 @@ mymain(void)
     DO_TEST_NOCAPS("disk-boot-cdrom");
     DO_TEST_NOCAPS("disk-error-policy");
     DO_TEST_CAPS_LATEST("disk-transient");
+    DO_TEST_CAPS_LATEST("disk-autoextend");
     DO_TEST_NOCAPS("disk-fmt-qcow");
     DO_TEST_CAPS_LATEST("disk-cache");
     DO_TEST_CAPS_LATEST("disk-metadata-cache");
@@ -598,6 +599,7 @@ mymain(void)
     DO_TEST_NOCAPS("iothreads");
     DO_TEST_NOCAPS("iothreads-ids");
     DO_TEST_NOCAPS("iothreads-ids-partial");
+    DO_TEST_NOCAPS("iothreads-poll-tuning");
     DO_TEST_NOCAPS("cputune-iothreads");
     DO_TEST_NOCAPS("iothreads-disk");
     DO_TEST("iothreads-disk-virtio-ccw", QEMU_CAPS_CCW);
@@ -737,6 +739,7 @@ mymain(void)
 
     DO_TEST_NOCAPS("balloon-device-auto");
     DO_TEST_NOCAPS("balloon-device-period");
+    DO_TEST_NOCAPS("balloon-device-autosize");
     DO_TEST_NOCAPS("channel-virtio-auto");
     DO_TEST_NOCAPS("console-compat-auto");
     DO_TEST("disk-scsi-device-auto",
@@ -0,0 +1,744 @@
+/*
+ * remotebench.c: load generator measuring the throughput of the daemon
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Unless given the URI of a running daemon, this starts libvirtd from the
+ * build tree in a temporary directory, serving either test:///default or a
+ * generated test driver config with the requested number of domains. A
+ * number of clients, each with its own connection and thread, then make
+ * calls picked at random according to the weights of the mix, e.g.
+ *
+ *   remotebench --clients 16 --domains 1000 --mix lookup=4,dumpxml=1,stats=1
+ *
+ * For each kind of call the number of calls per second and the latency
+ * percentiles are reported. The 'events' call suspends and resumes a
+ * domain, so that each client receives lifecycle events of all the others.
+ */
+
+#include <config.h>
+
+#include "internal.h"
+#include "viralloc.h"
+#include "vircommand.h"
+#include "virfile.h"
+#include "virthread.h"
+#include "virbuffer.h"
+#include "virenum.h"
+#include "virstring.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+typedef enum {
+    REMOTE_BENCH_OP_LOOKUP,
+    REMOTE_BENCH_OP_DUMPXML,
+    REMOTE_BENCH_OP_LIST,
+    REMOTE_BENCH_OP_STATS,
+    REMOTE_BENCH_OP_EVENTS,
+
+    REMOTE_BENCH_OP_LAST
+} remoteBenchOp;
+
+VIR_ENUM_DECL(remoteBenchOp);
+VIR_ENUM_IMPL(remoteBenchOp,
+              REMOTE_BENCH_OP_LAST,
+              "lookup",
+              "dumpxml",
+              "list",
+              "stats",
+              "events",
+);
+
+typedef struct _remoteBenchSamples remoteBenchSamples;
+struct _remoteBenchSamples {
+    unsigned long long *latency; /* in microseconds */
+    size_t nlatency;
+    size_t errors;
+};
+
+typedef struct _remoteBench remoteBench;
+typedef struct _remoteBenchClient remoteBenchClient;
+struct _remoteBenchClient {
+    remoteBench *bench;
+    size_t id;
+    virThread thread;
+    virConnectPtr conn;
+    virDomainPtr *doms;
+    int ndoms;
+    int callbackID;
+    remoteBenchSamples samples[REMOTE_BENCH_OP_LAST];
+};
+
+struct _remoteBench {
+    char *uri;
+    unsigned int weights[REMOTE_BENCH_OP_LAST];
+    unsigned int totalWeight;
+    gint64 duration; /* in microseconds */
+
+    virMutex lock;
+    virCond cond;
+    bool started;
+    gint64 deadline;
+
+    remoteBenchClient *clients;
+    size_t nclients;
+    int events; /* lifecycle events received by all clients */
+};
+
+
+static void
+remoteBenchErrorFunc(void *opaque G_GNUC_UNUSED,
+                     virErrorPtr err G_GNUC_UNUSED)
+{
+    /* Failed calls are counted rather than reported one by one */
+}
+
+
+static void
+remoteBenchEventLoop(void *opaque G_GNUC_UNUSED)
+{
+    while (1) {
+        if (virEventRunDefaultImpl() < 0) {
+            fprintf(stderr, "Failed to run event loop: %s\n",
+                    virGetLastErrorMessage());
+        }
+    }
+}
+
+
+static int
+remoteBenchLifecycle(virConnectPtr conn G_GNUC_UNUSED,
+                     virDomainPtr dom G_GNUC_UNUSED,
+                     int event G_GNUC_UNUSED,
+                     int detail G_GNUC_UNUSED,
+                     void *opaque)
+{
+    remoteBench *bench = opaque;
+
+    g_atomic_int_inc(&bench->events);
+    return 0;
+}
+
+
+static int
+remoteBenchParseMix(remoteBench *bench,
+                    const char *mix)
+{
+    g_auto(GStrv) items = g_strsplit(mix, ",", 0);
+    char **item;
+
+    memset(bench->weights, 0, sizeof(bench->weights));
+    bench->totalWeight = 0;
+
+    for (item = items; *item; item++) {
+        g_auto(GStrv) pair = g_strsplit(*item, "=", 2);
+        unsigned int weight = 1;
+        int op;
+
+        if ((op = remoteBenchOpTypeFromString(pair[0])) < 0) {
+            fprintf(stderr, "Unknown call '%s'\n", pair[0]);
+            return -1;
+        }
+
+        if (pair[1] && virStrToLong_uip(pair[1], NULL, 10, &weight) < 0) {
+            fprintf(stderr, "Invalid weight '%s' of '%s'\n", pair[1], pair[0]);
+            return -1;
+        }
+
+        bench->weights[op] = weight;
+        bench->totalWeight += weight;
+    }
+
+    if (bench->totalWeight == 0) {
+        fprintf(stderr, "The mix doesn't contain any calls\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static remoteBenchOp
+remoteBenchPickOp(remoteBench *bench,
+                  GRand *rand)
+{
+    unsigned int n = g_rand_int_range(rand, 0, bench->totalWeight);
+    size_t i;
+
+    for (i = 0; i < REMOTE_BENCH_OP_LAST - 1; i++) {
+        if (n < bench->weights[i])
+            break;
+        n -= bench->weights[i];
+    }
+
+    return i;
+}
+
+
+static int
+remoteBenchRunOp(remoteBenchClient *client,
+                 remoteBenchOp op,
+                 GRand *rand)
+{
+    virDomainPtr dom = client->doms[g_rand_int_range(rand, 0, client->ndoms)];
+
+    switch (op) {
+    case REMOTE_BENCH_OP_LOOKUP: {
+        virDomainPtr found;
+
+        if (!(found = virDomainLookupByName(client->conn,
+                                            virDomainGetName(dom))))
+            return -1;
+        virDomainFree(found);
+        return 0;
+    }
+
+    case REMOTE_BENCH_OP_DUMPXML: {
+        g_autofree char *xml = NULL;
+
+        if (!(xml = virDomainGetXMLDesc(dom, 0)))
+            return -1;
+        return 0;
+    }
+
+    case REMOTE_BENCH_OP_LIST: {
+        virDomainPtr *doms = NULL;
+        int ndoms;
+        int i;
+
+        if ((ndoms = virConnectListAllDomains(client->conn, &doms, 0)) < 0)
+            return -1;
+        for (i = 0; i < ndoms; i++)
+            virDomainFree(doms[i]);
+        g_free(doms);
+        return 0;
+    }
+
+    case REMOTE_BENCH_OP_STATS: {
+        virDomainStatsRecordPtr *records = NULL;
+
+        if (virConnectGetAllDomainStats(client->conn, 0, &records, 0) < 0)
+            return -1;
+        virDomainStatsRecordListFree(records);
+        return 0;
+    }
+
+    case REMOTE_BENCH_OP_EVENTS:
+        /* Clients don't share domains, unless there are fewer domains
+         * than clients, so that the calls don't fail */
+        dom = client->doms[client->id % client->ndoms];
+        if (virDomainSuspend(dom) < 0 ||
+            virDomainResume(dom) < 0)
+            return -1;
+        return 0;
+
+    case REMOTE_BENCH_OP_LAST:
+        break;
+    }
+
+    return -1;
+}
+
+
+static void
+remoteBenchClientRun(void *opaque)
+{
+    remoteBenchClient *client = opaque;
+    remoteBench *bench = client->bench;
+    g_autoptr(GRand) rand = g_rand_new_with_seed(client->id);
+    gint64 deadline;
+
+    virMutexLock(&bench->lock);
+    while (!bench->started)
+        virCondWait(&bench->cond, &bench->lock);
+    deadline = bench->deadline;
+    virMutexUnlock(&bench->lock);
+
+    while (g_get_monotonic_time() < deadline) {
+        remoteBenchOp op = remoteBenchPickOp(bench, rand);
+        remoteBenchSamples *samples = &client->samples[op];
+        gint64 start = g_get_monotonic_time();
+        unsigned long long latency;
+
+        if (remoteBenchRunOp(client, op, rand) < 0) {
+            samples->errors++;
+            continue;
+        }
+
+        latency = g_get_monotonic_time() - start;
+        VIR_APPEND_ELEMENT(samples->latency, samples->nlatency, latency);
+    }
+}
+
+
+static int
+remoteBenchClientOpen(remoteBench *bench,
+                      remoteBenchClient *client)
+{
+    client->callbackID = -1;
+
+    if (!(client->conn = virConnectOpen(bench->uri))) {
+        fprintf(stderr, "Failed to connect to '%s': %s\n",
+                bench->uri, virGetLastErrorMessage());
+        return -1;
+    }
+
+    if ((client->ndoms = virConnectListAllDomains(client->conn,
+                                                  &client->doms, 0)) < 0) {
+        fprintf(stderr, "Failed to list domains: %s\n",
+                virGetLastErrorMessage());
+        return -1;
+    }
+
+    if (client->ndoms == 0) {
+        fprintf(stderr, "There are no domains on '%s'\n", bench->uri);
+        return -1;
+    }
+    if (bench->weights[REMOTE_BENCH_OP_EVENTS] &&
+        (client->callbackID =
+         virConnectDomainEventRegisterAny(client->conn, NULL,
+                                          VIR_DOMAIN_EVENT_ID_LIFECYCLE,
+                                          VIR_DOMAIN_EVENT_CALLBACK(remoteBenchLifecycle),
+                                          bench, NULL)) < 0) {
+        fprintf(stderr, "Failed to register event callback: %s\n",
+                virGetLastErrorMessage());
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static void
+remoteBenchClientClose(remoteBenchClient *client)
+{
+    int i;
+
+    if (!client->conn)
+        return;
+
+    if (client->callbackID >= 0)
+        virConnectDomainEventDeregisterAny(client->conn, client->callbackID);
+    for (i = 0; i < client->ndoms; i++)
+        virDomainFree(client->doms[i]);
+    g_free(client->doms);
+    virConnectClose(client->conn);
+}
+
+
+static int
+remoteBenchCompare(const void *a,
+                   const void *b)
+{
+    unsigned long long x = *(const unsigned long long *)a;
+    unsigned long long y = *(const unsigned long long *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+
+static unsigned long long
+remoteBenchPercentile(unsigned long long *latency,
+                      size_t nlatency,
+                      unsigned int percentile)
+{
+    size_t i = (nlatency * percentile + 99) / 100;
+
+    return latency[i ? i - 1 : 0];
+}
+
+
+static void
+remoteBenchReport(remoteBench *bench,
+                  gint64 elapsed)
+{
+    double seconds = elapsed / (double) G_USEC_PER_SEC;
+    size_t total = 0;
+    size_t i;
+    size_t j;
+
+    printf("%-8s %10s %10s %8s %10s %10s %10s %10s\n",
+           "call", "calls", "calls/s", "errors",
+           "p50 us", "p90 us", "p99 us", "max us");
+
+    for (i = 0; i < REMOTE_BENCH_OP_LAST; i++) {
+        g_autofree unsigned long long *latency = NULL;
+        size_t nlatency = 0;
+        size_t errors = 0;
+
+        if (!bench->weights[i])
+            continue;
+
+        for (j = 0; j < bench->nclients; j++) {
+            remoteBenchSamples *samples = &bench->clients[j].samples[i];
+
+            VIR_REALLOC_N(latency, nlatency + samples->nlatency);
+            memcpy(latency + nlatency, samples->latency,
+                   samples->nlatency * sizeof(*latency));
+            nlatency += samples->nlatency;
+            errors += samples->errors;
+        }
+
+        total += nlatency;
+
+        if (nlatency == 0) {
+            printf("%-8s %10zu %10.1f %8zu\n",
+                   remoteBenchOpTypeToString(i), nlatency, 0.0, errors);
+            continue;
+        }
+
+        qsort(latency, nlatency, sizeof(*latency), remoteBenchCompare);
+
+        printf("%-8s %10zu %10.1f %8zu %10llu %10llu %10llu %10llu\n",
+               remoteBenchOpTypeToString(i), nlatency, nlatency / seconds,
+               errors,
+               remoteBenchPercentile(latency, nlatency, 50),
+               remoteBenchPercentile(latency, nlatency, 90),
+               remoteBenchPercentile(latency, nlatency, 99),
+               latency[nlatency - 1]);
+    }
+
+    printf("%-8s %10zu %10.1f\n", "total", total, total / seconds);
+
+    if (bench->weights[REMOTE_BENCH_OP_EVENTS]) {
+        int events = g_atomic_int_get(&bench->events);
+
+        printf("%-8s %10d %10.1f\n", "received", events, events / seconds);
+    }
+}
+
+
+/*
+ * Write a test driver config with @ndomains running domains, each with a
+ * disk and an interface so that there's something to report stats of.
+ */
+static char *
+remoteBenchWriteNode(const char *dir,
+                     unsigned int ndomains)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    g_autofree char *path = g_strdup_printf("%s/node.xml", dir);
+    g_autofree char *xml = NULL;
+    size_t i;
+
+    virBufferAddLit(&buf, "<node>\n");
+    virBufferAdjustIndent(&buf, 2);
+
+    for (i = 0; i < ndomains; i++) {
+        virBufferAddLit(&buf, "<domain type='test'>\n");
+        virBufferAdjustIndent(&buf, 2);
+        virBufferAsprintf(&buf, "<name>bench-%zu</name>\n", i);
+        virBufferAddLit(&buf, "<memory>1048576</memory>\n");
+        virBufferAddLit(&buf, "<vcpu>2</vcpu>\n");
+        virBufferAddLit(&buf, "<os><type>hvm</type></os>\n");
+        virBufferAddLit(&buf, "<devices>\n");
+        virBufferAdjustIndent(&buf, 2);
+        virBufferAsprintf(&buf,
+                          "<disk type='file' device='disk'>\n"
+                          "  <source file='/var/lib/libvirt/images/bench-%zu.img'/>\n"
+                          "  <target dev='vda' bus='virtio'/>\n"
+                          "</disk>\n", i);
+        virBufferAsprintf(&buf,
+                          "<interface type='network'>\n"
+                          "  <mac address='52:54:00:%02zx:%02zx:%02zx'/>\n"
+                          "  <source network='default'/>\n"
+                          "  <target dev='vnet%zu'/>\n"
+                          "</interface>\n",
+                          (i >> 16) & 0xff, (i >> 8) & 0xff, i & 0xff, i);
+        virBufferAdjustIndent(&buf, -2);
+        virBufferAddLit(&buf, "</devices>\n");
+        virBufferAdjustIndent(&buf, -2);
+        virBufferAddLit(&buf, "</domain>\n");
+    }
+
+    virBufferAdjustIndent(&buf, -2);
+    virBufferAddLit(&buf, "</node>\n");
+
+    xml = virBufferContentAndReset(&buf);
+    if (virFileWriteStr(path, xml, 0600) < 0) {
+        fprintf(stderr, "Failed to write '%s'\n", path);
+        return NULL;
+    }
+
+    return g_steal_pointer(&path);
+}
+
+
+static virCommand *
+remoteBenchStartDaemon(const char *daemon,
+                       const char *dir,
+                       bool tcp,
+                       unsigned int port,
+                       unsigned int workers)
+{
+    g_autoptr(virCommand) cmd = NULL;
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    g_autofree char *confFile = g_strdup_printf("%s/libvirtd.conf", dir);
+    g_autofree char *pidFile = g_strdup_printf("%s/libvirtd.pid", dir);
+    g_autofree char *conf = NULL;
+
+    virBufferAsprintf(&buf, "unix_sock_dir = \"%s\"\n", dir);
+    virBufferAddLit(&buf, "auth_unix_rw = \"none\"\n");
+    virBufferAddLit(&buf, "listen_tls = 0\n");
+    virBufferAsprintf(&buf, "listen_tcp = %d\n", tcp);
+    virBufferAddLit(&buf, "listen_addr = \"127.0.0.1\"\n");
+    virBufferAsprintf(&buf, "tcp_port = \"%u\"\n", port);
+    virBufferAddLit(&buf, "auth_tcp = \"none\"\n");
+    virBufferAddLit(&buf, "max_clients = 100000\n");
+    if (workers) {
+        virBufferAsprintf(&buf, "min_workers = %u\n", MIN(workers, 5));
+        virBufferAsprintf(&buf, "max_workers = %u\n", workers);
+    }
+
+    conf = virBufferContentAndReset(&buf);
+    if (virFileWriteStr(confFile, conf, 0600) < 0) {
+        fprintf(stderr, "Failed to write '%s'\n", confFile);
+        return NULL;
+    }
+
+    cmd = virCommandNewArgList(daemon, "--config", confFile,
+                               "--pid-file", pidFile, NULL);
+    if (tcp)
+        virCommandAddArg(cmd, "--listen");
+
+    /* Keep the session daemon of the user out of the way */
+    virCommandAddEnvPassCommon(cmd);
+    virCommandAddEnvPair(cmd, "XDG_CONFIG_HOME", dir);
+    virCommandAddEnvPair(cmd, "XDG_CACHE_HOME", dir);
+    virCommandAddEnvPair(cmd, "XDG_RUNTIME_DIR", dir);
+
+    if (virCommandRunAsync(cmd, NULL) < 0) {
+        fprintf(stderr, "Failed to start '%s': %s\n",
+                daemon, virGetLastErrorMessage());
+        return NULL;
+    }
+
+    return g_steal_pointer(&cmd);
+}
+
+
+static int
+remoteBenchWaitDaemon(const char *uri)
+{
+    size_t tries;
+
+    for (tries = 0; tries < 100; tries++) {
+        virConnectPtr conn;
+
+        if ((conn = virConnectOpen(uri))) {
+            virConnectClose(conn);
+            return 0;
+        }
+        g_usleep(100 * 1000);
+    }
+
+    fprintf(stderr, "The daemon didn't start listening: %s\n",
+            virGetLastErrorMessage());
+    return -1;
+}
+
+
+int
+main(int argc, char **argv)
+{
+    g_autoptr(GOptionContext) context = NULL;
+    g_autoptr(GError) error = NULL;
+    g_autoptr(virCommand) daemonCmd = NULL;
+    g_autofree char *uri = NULL;
+    g_autofree char *mix = NULL;
+    g_autofree char *transport = NULL;
+    g_autofree char *daemon = NULL;
+    g_autofree char *dir = NULL;
+    g_autofree char *node = NULL;
+    remoteBench bench = { 0 };
+    virThread loop;
+    int clients = 4;
+    int domains = 0;
+    int duration = 10;
+    int port = 16599;
+    int workers = 0;
+    gint64 start;
+    int ret = EXIT_FAILURE;
+    size_t nthreads = 0;
+    size_t i;
+    GOptionEntry entries[] = {
+        { "uri", 'c', 0, G_OPTION_ARG_STRING, &uri,
+          "URI of a running daemon, instead of starting one", "URI" },
+        { "clients", 'n', 0, G_OPTION_ARG_INT, &clients,
+          "Number of clients (default 4)", "M" },
+        { "mix", 'm', 0, G_OPTION_ARG_STRING, &mix,
+          "Weights of calls: lookup, dumpxml, list, stats, events "
+          "(default lookup,dumpxml,list,stats)", "CALL[=WEIGHT],..." },
+        { "duration", 'd', 0, G_OPTION_ARG_INT, &duration,
+          "Seconds to run for (default 10)", "S" },
+        { "domains", 0, 0, G_OPTION_ARG_INT, &domains,
+          "Serve a test driver config with N domains "
+          "instead of test:///default", "N" },
+        { "transport", 't', 0, G_OPTION_ARG_STRING, &transport,
+          "Transport to the started daemon: unix or tcp (default unix)", "T" },
+        { "port", 'p', 0, G_OPTION_ARG_INT, &port,
+          "TCP port of the started daemon (default 16599)", "PORT" },
+        { "workers", 'w', 0, G_OPTION_ARG_INT, &workers,
+          "Maximum number of worker threads of the started daemon", "N" },
+        { "daemon", 0, 0, G_OPTION_ARG_STRING, &daemon,
+          "Daemon binary to start (default libvirtd of the build tree)", "PATH" },
+        { NULL, '\0', 0, 0, NULL, NULL, NULL }
+    };
+
+    context = g_option_context_new("- measure throughput of the daemon");
+    g_option_context_add_main_entries(context, entries, PACKAGE);
+    if (!g_option_context_parse(context, &argc, &argv, &error)) {
+        fprintf(stderr, "option parsing failed: %s\n", error->message);
+        return EXIT_FAILURE;
+    }
+
+    if (argc != 1) {
+        g_autofree char *help = g_option_context_get_help(context, TRUE, NULL);
+        fprintf(stderr, "%s", help);
+        return EXIT_FAILURE;
+    }
+
+    if (clients < 1 || duration < 1 || domains < 0 ||
+        port < 1 || port > 65535 || workers < 0) {
+        fprintf(stderr, "Invalid arguments\n");
+        return EXIT_FAILURE;
+    }
+
+    if (uri && (domains || transport || daemon || workers)) {
+        fprintf(stderr, "--uri can't be used together with options "
+                "of the started daemon\n");
+        return EXIT_FAILURE;
+    }
+
+    if (transport && STRNEQ(transport, "unix") && STRNEQ(transport, "tcp")) {
+        fprintf(stderr, "Unknown transport '%s'\n", transport);
+        return EXIT_FAILURE;
+    }
+
+    if (remoteBenchParseMix(&bench, mix ? mix : "lookup,dumpxml,list,stats") < 0)
+        return EXIT_FAILURE;
+
+    if (virInitialize() < 0) {
+        fprintf(stderr, "Failed to initialize libvirt\n");
+        return EXIT_FAILURE;
+    }
+
+    virSetErrorFunc(NULL, remoteBenchErrorFunc);
+
+    if (virEventRegisterDefaultImpl() < 0) {
+        fprintf(stderr, "Failed to register event implementation: %s\n",
+                virGetLastErrorMessage());
+        return EXIT_FAILURE;
+    }
+
+    if (virThreadCreate(&loop, false, remoteBenchEventLoop, NULL) < 0)
+        return EXIT_FAILURE;
+
+    if (virMutexInit(&bench.lock) < 0 ||
+        virCondInit(&bench.cond) < 0)
+        return EXIT_FAILURE;
+
+    if (!uri) {
+        bool tcp = transport && STREQ(transport, "tcp");
+
+        if (!(dir = g_mkdtemp(g_strdup("/tmp/remotebench-XXXXXX")))) {
+            fprintf(stderr, "Failed to create temporary directory\n");
+            return EXIT_FAILURE;
+        }
+
+        if (!daemon)
+            daemon = g_strdup(abs_top_builddir "/src/libvirtd");
+
+        if (domains > 0 && !(node = remoteBenchWriteNode(dir, domains)))
+            goto cleanup;
+
+        if (tcp)
+            uri = g_strdup_printf("test+tcp://127.0.0.1:%d%s",
+                                  port, node ? node : "/default");
+        else
+            uri = g_strdup_printf("test+unix://%s?socket=%s/libvirt-sock",
+                                  node ? node : "/default", dir);
+
+        if (!(daemonCmd = remoteBenchStartDaemon(daemon, dir, tcp,
+                                                 port, workers)) ||
+            remoteBenchWaitDaemon(uri) < 0)
+            goto cleanup;
+    }
+
+    bench.uri = uri;
+    bench.duration = duration * G_USEC_PER_SEC;
+    bench.clients = g_new0(remoteBenchClient, clients);
+
+    for (i = 0; i < (size_t) clients; i++) {
+        remoteBenchClient *client = &bench.clients[i];
+
+        client->bench = &bench;
+        client->id = i;
+        bench.nclients++;
+
+        if (remoteBenchClientOpen(&bench, client) < 0)
+            goto cleanup;
+    }
+
+    for (nthreads = 0; nthreads < bench.nclients; nthreads++) {
+        remoteBenchClient *client = &bench.clients[nthreads];
+
+        if (virThreadCreate(&client->thread, true,
+                            remoteBenchClientRun, client) < 0)
+            goto cleanup;
+    }
+
+    virMutexLock(&bench.lock);
+    start = g_get_monotonic_time();
+    bench.deadline = start + bench.duration;
+    bench.started = true;
+    virCondBroadcast(&bench.cond);
+    virMutexUnlock(&bench.lock);
+
+    for (i = 0; i < nthreads; i++)
+        virThreadJoin(&bench.clients[i].thread);
+
+    remoteBenchReport(&bench, g_get_monotonic_time() - start);
+    ret = EXIT_SUCCESS;
+
+ cleanup:
+    if (nthreads && !bench.started) {
+        /* Let the threads which were created finish right away */
+        virMutexLock(&bench.lock);
+        bench.started = true;
+        virCondBroadcast(&bench.cond);
+        virMutexUnlock(&bench.lock);
+        for (i = 0; i < nthreads; i++)
+            virThreadJoin(&bench.clients[i].thread);
+    }
+
+    for (i = 0; i < bench.nclients; i++) {
+        size_t j;
+
+        remoteBenchClientClose(&bench.clients[i]);
+        for (j = 0; j < REMOTE_BENCH_OP_LAST; j++)
+            g_free(bench.clients[i].samples[j].latency);
+    }
+    g_free(bench.clients);
+
+    if (daemonCmd)
+        virCommandAbort(daemonCmd);
+    if (dir)
+        virFileDeleteTree(dir);
+
+    return ret;
+}
@@ -388,6 +388,7 @@ void qemuTestDriverFree(virQEMUDriver *driver)
     virObjectUnref(driver->caps);
     virObjectUnref(driver->config);
     virObjectUnref(driver->securityManager);
+    g_clear_pointer(&driver->busyCpus, g_hash_table_unref);
 
     virCPUDefFree(cpuDefault);
     virCPUDefFree(cpuHaswell);
@@ -592,6 +593,7 @@ int qemuTestDriverInit(virQEMUDriver *driver)
         return -1;
 
     driver->hostarch = virArchFromHost();
+    driver->busyCpus = virHashNew((GDestroyNotify) virBitmapFree);
     driver->config = virQEMUDriverConfigNew(false, NULL);
     if (!driver->config)
         goto error;
@@ -0,0 +1,467 @@
+/*
+ * utilbench.c: microbenchmarks of frequently used helpers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Every benchmark is run repeatedly for at least VIR_BENCH_TIME
+ * milliseconds (500 by default) and its result is printed to stdout as a
+ * line of JSON:
+ *
+ *   {"name": "json-parse", "iterations": 120, "items": 35,
+ *    "ns_per_iteration": 4180000.0, "ns_per_item": 119428.6}
+ *
+ * where an iteration processes all the items of the benchmark, e.g. all
+ * the QMP replies of the corpus. Use 'meson test --benchmark' to run it.
+ */
+
+#include <config.h>
+
+#include "testutils.h"
+#include "virbitmap.h"
+#include "virbuffer.h"
+#include "virhash.h"
+#include "virjson.h"
+#include "virxml.h"
+#include "virstring.h"
+#include "domain_conf.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+#define BENCH_HASH_KEYS 10000
+#define BENCH_BITMAP_SIZE 4096
+#define BENCH_BITMAP_STR "0-1023,^100-199,2048-3071,4000,4095"
+
+typedef struct _benchCorpus benchCorpus;
+struct _benchCorpus {
+    char **files; /* contents */
+    size_t nfiles;
+};
+
+typedef struct _benchData benchData;
+struct _benchData {
+    const char *name;
+    int (*func)(const void *opaque);
+    const void *opaque;
+    size_t items;
+};
+
+static gint64 benchTime = 500 * 1000; /* in microseconds */
+static virDomainXMLOption *xmlopt;
+
+
+static int
+benchRunOne(const void *opaque)
+{
+    const benchData *data = opaque;
+    unsigned long long iterations = 0;
+    gint64 start = g_get_monotonic_time();
+    gint64 elapsed;
+    double perIteration;
+
+    do {
+        if (data->func(data->opaque) < 0)
+            return -1;
+        iterations++;
+    } while ((elapsed = g_get_monotonic_time() - start) < benchTime);
+
+    perIteration = elapsed * 1000.0 / iterations;
+
+    printf("{\"name\": \"%s\", \"iterations\": %llu, \"items\": %zu, "
+           "\"ns_per_iteration\": %.1f, \"ns_per_item\": %.1f}\n",
+           data->name, iterations, data->items, perIteration,
+           data->items ? perIteration / data->items : perIteration);
+    fflush(stdout);
+
+    return 0;
+}
+
+
+static int
+benchCorpusLoad(benchCorpus *corpus,
+                const char *dirname,
+                const char *suffix)
+{
+    g_autofree char *path = g_strdup_printf("%s/%s", abs_srcdir, dirname);
+    g_autoptr(DIR) dir = NULL;
+    struct dirent *ent;
+    int rc;
+
+    if (virDirOpen(&dir, path) < 0)
+        return -1;
+
+    while ((rc = virDirRead(dir, &ent, path)) > 0) {
+        g_autofree char *file = NULL;
+        char *content = NULL;
+
+        if (ent->d_name[0] == '.' ||
+            !virStringHasSuffix(ent->d_name, suffix))
+            continue;
+
+        file = g_strdup_printf("%s/%s", path, ent->d_name);
+        if (virTestLoadFile(file, &content) < 0)
+            return -1;
+
+        VIR_APPEND_ELEMENT(corpus->files, corpus->nfiles, content);
+    }
+
+    return rc;
+}
+
+
+static void
+benchCorpusClear(benchCorpus *corpus)
+{
+    size_t i;
+
+    for (i = 0; i < corpus->nfiles; i++)
+        g_free(corpus->files[i]);
+    g_clear_pointer(&corpus->files, g_free);
+    corpus->nfiles = 0;
+}
+
+
+typedef struct _benchJSON benchJSON;
+struct _benchJSON {
+    benchCorpus corpus;
+    virJSONValue **values;
+    size_t nvalues;
+};
+
+
+static int
+benchJSONParse(const void *opaque)
+{
+    const benchJSON *data = opaque;
+    size_t i;
+
+    for (i = 0; i < data->corpus.nfiles; i++) {
+        g_autoptr(virJSONValue) value = NULL;
+
+        if (!(value = virJSONValueFromString(data->corpus.files[i])))
+            return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+benchJSONFormat(const void *opaque)
+{
+    const benchJSON *data = opaque;
+    size_t i;
+
+    for (i = 0; i < data->nvalues; i++) {
+        g_autofree char *str = NULL;
+
+        if (!(str = virJSONValueToString(data->values[i], false)))
+            return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+benchBufferFormat(const void *opaque G_GNUC_UNUSED)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    g_autofree char *str = NULL;
+    size_t i;
+
+    virBufferAddLit(&buf, "<devices>\n");
+    virBufferAdjustIndent(&buf, 2);
+    for (i = 0; i < 1000; i++) {
+        virBufferAsprintf(&buf, "<disk type='file' index='%zu'>\n", i);
+        virBufferAdjustIndent(&buf, 2);
+        virBufferEscapeString(&buf, "<source file='%s'/>\n",
+                              "/var/lib/libvirt/images/<guest> & 'disk'.qcow2");
+        virBufferAsprintf(&buf, "<target dev='vd%c' bus='virtio'/>\n",
+                          (char) ('a' + i % 26));
+        virBufferAdjustIndent(&buf, -2);
+        virBufferAddLit(&buf, "</disk>\n");
+    }
+    virBufferAdjustIndent(&buf, -2);
+    virBufferAddLit(&buf, "</devices>\n");
+
+    if (!(str = virBufferContentAndReset(&buf)))
+        return -1;
+
+    return 0;
+}
+
+
+typedef struct _benchHash benchHash;
+struct _benchHash {
+    char *keys[BENCH_HASH_KEYS];
+    GHashTable *table; /* filled with all the keys */
+};
+
+
+static int
+benchHashAddRemove(const void *opaque)
+{
+    const benchHash *data = opaque;
+    g_autoptr(GHashTable) table = virHashNew(NULL);
+    size_t i;
+
+    for (i = 0; i < BENCH_HASH_KEYS; i++) {
+        if (virHashAddEntry(table, data->keys[i], data->keys[i]) < 0)
+            return -1;
+    }
+
+    for (i = 0; i < BENCH_HASH_KEYS; i++) {
+        if (virHashRemoveEntry(table, data->keys[i]) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+benchHashLookup(const void *opaque)
+{
+    const benchHash *data = opaque;
+    size_t i;
+
+    for (i = 0; i < BENCH_HASH_KEYS; i++) {
+        if (!virHashLookup(data->table, data->keys[i]))
+            return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+benchBitmapParse(const void *opaque G_GNUC_UNUSED)
+{
+    g_autoptr(virBitmap) bitmap = NULL;
+
+    return virBitmapParse(BENCH_BITMAP_STR, &bitmap, BENCH_BITMAP_SIZE);
+}
+
+
+static int
+benchBitmapFormat(const void *opaque)
+{
+    g_autofree char *str = NULL;
+
+    if (!(str = virBitmapFormat((virBitmap *) opaque)))
+        return -1;
+
+    return 0;
+}
+
+
+static int
+benchBitmapIterate(const void *opaque)
+{
+    virBitmap *bitmap = (virBitmap *) opaque;
+    ssize_t pos = -1;
+    size_t count = 0;
+
+    while ((pos = virBitmapNextSetBit(bitmap, pos)) >= 0)
+        count++;
+
+    return count == virBitmapCountBits(bitmap) ? 0 : -1;
+}
+
+
+static int
+benchXPath(const void *opaque)
+{
+    xmlXPathContextPtr ctxt = (xmlXPathContextPtr) opaque;
+    g_autofree xmlNodePtr *nodes = NULL;
+    g_autofree char *name = NULL;
+    unsigned long memory;
+    size_t i;
+    int n;
+
+    if (!(name = virXPathString("string(./name)", ctxt)) ||
+        virXPathULong("string(./memory)", ctxt, &memory) < 0 ||
+        virXPathBoolean("boolean(./devices/disk)", ctxt) < 0 ||
+        (n = virXPathNodeSet("./devices/*", ctxt, &nodes)) < 0)
+        return -1;
+
+    for (i = 0; i < n; i++) {
+        VIR_XPATH_NODE_AUTORESTORE(ctxt)
+        g_autofree char *type = NULL;
+
+        ctxt->node = nodes[i];
+        type = virXPathString("string(./@type)", ctxt);
+    }
+
+    return 0;
+}
+
+
+typedef struct _benchDomain benchDomain;
+struct _benchDomain {
+    benchCorpus corpus;
+    virDomainDef **defs;
+    size_t ndefs;
+};
+
+
+static int
+benchDomainParse(const void *opaque)
+{
+    const benchDomain *data = opaque;
+    size_t i;
+
+    for (i = 0; i < data->corpus.nfiles; i++) {
+        g_autoptr(virDomainDef) def = NULL;
+
+        if (!(def = virDomainDefParseString(data->corpus.files[i], xmlopt, NULL,
+                                            VIR_DOMAIN_DEF_PARSE_INACTIVE)))
+            return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+benchDomainFormat(const void *opaque)
+{
+    const benchDomain *data = opaque;
+    size_t i;
+
+    for (i = 0; i < data->ndefs; i++) {
+        g_autofree char *xml = NULL;
+
+        if (!(xml = virDomainDefFormat(data->defs[i], xmlopt,
+                                       VIR_DOMAIN_DEF_FORMAT_SECURE)))
+            return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+    const char *env = getenv("VIR_BENCH_TIME");
+    benchJSON json = { 0 };
+    benchHash hash = { 0 };
+    benchDomain domain = { 0 };
+    g_autoptr(virBitmap) bitmap = NULL;
+    g_autoptr(xmlDoc) xml = NULL;
+    g_autoptr(xmlXPathContext) ctxt = NULL;
+    unsigned int ms;
+    size_t i;
+
+    if (env) {
+        if (virStrToLong_ui(env, NULL, 10, &ms) < 0 || ms == 0) {
+            fprintf(stderr, "Invalid VIR_BENCH_TIME '%s'\n", env);
+            return EXIT_FAILURE;
+        }
+        benchTime = ms * 1000LL;
+    }
+
+    if (!(xmlopt = virTestGenericDomainXMLConfInit()))
+        return EXIT_FAILURE;
+
+    /* Load all the data first, so that reading files isn't measured */
+    if (benchCorpusLoad(&json.corpus, "qemumonitorjsondata", ".json") < 0)
+        return EXIT_FAILURE;
+
+    for (i = 0; i < json.corpus.nfiles; i++) {
+        virJSONValue *value;
+
+        if (!(value = virJSONValueFromString(json.corpus.files[i])))
+            return EXIT_FAILURE;
+        VIR_APPEND_ELEMENT(json.values, json.nvalues, value);
+    }
+
+    for (i = 0; i < BENCH_HASH_KEYS; i++)
+        hash.keys[i] = g_strdup_printf("domain-%zu", i);
+    hash.table = virHashNew(NULL);
+    for (i = 0; i < BENCH_HASH_KEYS; i++) {
+        if (virHashAddEntry(hash.table, hash.keys[i], hash.keys[i]) < 0)
+            return EXIT_FAILURE;
+    }
+
+    if (virBitmapParse(BENCH_BITMAP_STR, &bitmap, BENCH_BITMAP_SIZE) < 0)
+        return EXIT_FAILURE;
+
+    if (!(xml = virXMLParseFileCtxt(abs_srcdir "/qemuxml2argvdata/disk-aio.xml",
+                                    &ctxt)))
+        return EXIT_FAILURE;
+
+    if (benchCorpusLoad(&domain.corpus, "qemuxml2argvdata", ".xml") < 0)
+        return EXIT_FAILURE;
+
+    /* Not all of the files can be parsed without the QEMU driver, which
+     * resolves aliases of machine types and fills in defaults. Only the
+     * ones which can are benchmarked. */
+    for (i = 0; i < domain.corpus.nfiles; ) {
+        virDomainDef *def;
+
+        if (!(def = virDomainDefParseString(domain.corpus.files[i], xmlopt,
+                                            NULL, VIR_DOMAIN_DEF_PARSE_INACTIVE))) {
+            g_free(domain.corpus.files[i]);
+            VIR_DELETE_ELEMENT(domain.corpus.files, i, domain.corpus.nfiles);
+            continue;
+        }
+
+        VIR_APPEND_ELEMENT(domain.defs, domain.ndefs, def);
+        i++;
+    }
+    virResetLastError();
+
+#define DO_BENCH(name, func, opaque, items) \
+    do { \
+        benchData data = { name, func, opaque, items }; \
+        if (virTestRun(name, benchRunOne, &data) < 0) \
+            ret = -1; \
+    } while (0)
+
+    DO_BENCH("json-parse", benchJSONParse, &json, json.corpus.nfiles);
+    DO_BENCH("json-format", benchJSONFormat, &json, json.nvalues);
+    DO_BENCH("buffer-format", benchBufferFormat, NULL, 1000);
+    DO_BENCH("hash-add-remove", benchHashAddRemove, &hash, BENCH_HASH_KEYS);
+    DO_BENCH("hash-lookup", benchHashLookup, &hash, BENCH_HASH_KEYS);
+    DO_BENCH("bitmap-parse", benchBitmapParse, NULL, 1);
+    DO_BENCH("bitmap-format", benchBitmapFormat, bitmap, 1);
+    DO_BENCH("bitmap-iterate", benchBitmapIterate, bitmap,
+             virBitmapCountBits(bitmap));
+    DO_BENCH("xpath", benchXPath, ctxt, 1);
+    DO_BENCH("domain-parse", benchDomainParse, &domain, domain.corpus.nfiles);
+    DO_BENCH("domain-format", benchDomainFormat, &domain, domain.ndefs);
+
+    benchCorpusClear(&json.corpus);
+    for (i = 0; i < json.nvalues; i++)
+        virJSONValueFree(json.values[i]);
+    g_free(json.values);
+    g_hash_table_unref(hash.table);
+    for (i = 0; i < BENCH_HASH_KEYS; i++)
+        g_free(hash.keys[i]);
+    benchCorpusClear(&domain.corpus);
+    for (i = 0; i < domain.ndefs; i++)
+        virDomainDefFree(domain.defs[i]);
+    g_free(domain.defs);
+    virObjectUnref(xmlopt);
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
@@ -705,6 +705,59 @@ test16(const void *opaque G_GNUC_UNUSED)
 }
 
 
+/* virBitmapParse/virBitmapFormat of ranges spanning multiple words */
+static int
+test17(const void *opaque G_GNUC_UNUSED)
+{
+    const struct {
+        const char *str;
+        size_t count;
+    } ranges[] = {
+        { "0-1023", 1024 },
+        { "1-62", 62 },
+        { "63-64", 2 },
+        { "0,63-128,1023", 68 },
+        { "5-700,702-1000", 995 },
+        { "64-127,129-191,193", 128 },
+    };
+    g_autoptr(virBitmap) overflow = NULL;
+    size_t i;
+
+    for (i = 0; i < G_N_ELEMENTS(ranges); i++) {
+        g_autoptr(virBitmap) map = NULL;
+        g_autoptr(virBitmap) unlimited = NULL;
+        g_autofree char *str = NULL;
+
+        if (virBitmapParse(ranges[i].str, &map, 1024) < 0 ||
+            !(unlimited = virBitmapParseUnlimited(ranges[i].str)))
+            return -1;
+
+        if (virBitmapCountBits(map) != ranges[i].count ||
+            !virBitmapEqual(map, unlimited)) {
+            fprintf(stderr, "\n bitmap '%s' parsed incorrectly\n",
+                    ranges[i].str);
+            return -1;
+        }
+
+        if (!(str = virBitmapFormat(map)))
+            return -1;
+
+        if (STRNEQ(ranges[i].str, str)) {
+            fprintf(stderr, "\n expected bitmap string '%s' actual string "
+                    "'%s'\n", ranges[i].str, str);
+            return -1;
+        }
+    }
+
+    if (virBitmapParse("0-1024", &overflow, 1024) == 0) {
+        fprintf(stderr, "\n range exceeding the bitmap size was accepted\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+
 #define TESTBINARYOP(A, B, RES, FUNC) \
     testBinaryOpData.a = A; \
     testBinaryOpData.b = B; \
@@ -780,6 +833,8 @@ mymain(void)
 
     if (virTestRun("test16", test16, NULL) < 0)
         ret = -1;
+    if (virTestRun("test17", test17, NULL) < 0)
+        ret = -1;
 
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
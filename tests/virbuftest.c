@@ -1,5 +1,6 @@
 #include <config.h>
 
+#include <gio/gio.h>
 
 #include "internal.h"
 #include "testutils.h"
@@ -364,6 +365,147 @@ testBufSetIndent(const void *opaque G_GNUC_UNUSED)
 }
 
 
+static void
+testBufSinkFormat(virBuffer *buf)
+{
+    size_t i;
+
+    virBufferAddLit(buf, "<devices>\n");
+    virBufferAdjustIndent(buf, 2);
+    for (i = 0; i < 100; i++) {
+        virBufferAsprintf(buf, "<disk index='%zu' bus='virtio',", i);
+        virBufferTrim(buf, ",");
+        virBufferAddLit(buf, "/>\n");
+    }
+    virBufferAdjustIndent(buf, -2);
+    virBufferAddLit(buf, "</devices>\n");
+}
+
+
+static int
+testBufSinkWrite(const char *data,
+                 size_t len,
+                 void *opaque)
+{
+    GString *str = opaque;
+
+    g_string_append_len(str, data, len);
+    return 0;
+}
+
+
+static int
+testBufSink(const void *opaque G_GNUC_UNUSED)
+{
+    g_auto(virBuffer) expectbuf = VIR_BUFFER_INITIALIZER;
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    g_autoptr(GString) str = g_string_new(NULL);
+    g_autoptr(virBufferSink) sink = NULL;
+    g_autofree char *expect = NULL;
+
+    testBufSinkFormat(&expectbuf);
+    expect = virBufferContentAndReset(&expectbuf);
+
+    sink = virBufferSinkNew(64, testBufSinkWrite, NULL, str, NULL);
+    virBufferSetSink(&buf, sink);
+    testBufSinkFormat(&buf);
+
+    if (virBufferUse(&buf) >= strlen(expect)) {
+        VIR_TEST_DEBUG("testBufSink: content was not passed to the sink");
+        return -1;
+    }
+
+    if (virBufferSinkFinish(&buf) < 0 ||
+        virBufferUse(&buf) != 0) {
+        VIR_TEST_DEBUG("testBufSink: finishing failed");
+        return -1;
+    }
+
+    if (STRNEQ(str->str, expect)) {
+        virTestDifference(stderr, expect, str->str);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testBufSinkGzip(const void *opaque G_GNUC_UNUSED)
+{
+    g_auto(virBuffer) expectbuf = VIR_BUFFER_INITIALIZER;
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    g_autoptr(GString) str = g_string_new(NULL);
+    g_autoptr(virBufferSink) sink = NULL;
+    g_autoptr(GZlibDecompressor) decompressor = NULL;
+    g_autoptr(GError) err = NULL;
+    g_autofree char *expect = NULL;
+    g_autofree char *actual = NULL;
+    gsize nread = 0;
+    gsize nwritten = 0;
+    size_t len;
+
+    testBufSinkFormat(&expectbuf);
+    expect = virBufferContentAndReset(&expectbuf);
+    len = strlen(expect);
+
+    sink = virBufferSinkNewGzip(virBufferSinkNew(64, testBufSinkWrite,
+                                                 NULL, str, NULL));
+    virBufferSetSink(&buf, sink);
+    testBufSinkFormat(&buf);
+
+    if (virBufferSinkFinish(&buf) < 0) {
+        VIR_TEST_DEBUG("testBufSinkGzip: finishing failed");
+        return -1;
+    }
+
+    decompressor = g_zlib_decompressor_new(G_ZLIB_COMPRESSOR_FORMAT_GZIP);
+    actual = g_new0(char, len + 1);
+
+    if (g_converter_convert(G_CONVERTER(decompressor), str->str, str->len,
+                            actual, len + 1, G_CONVERTER_INPUT_AT_END,
+                            &nread, &nwritten, &err) != G_CONVERTER_FINISHED) {
+        VIR_TEST_DEBUG("testBufSinkGzip: decompression failed: %s",
+                       err ? err->message : "not finished");
+        return -1;
+    }
+
+    if (STRNEQ(actual, expect)) {
+        virTestDifference(stderr, expect, actual);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testBufSizeHint(const void *opaque G_GNUC_UNUSED)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    g_autofree char *actual = NULL;
+
+    virBufferSizeHint(&buf, 16);
+    virBufferAddLit(&buf, "<a>\n");
+    virBufferSizeHint(&buf, 4096);
+    virBufferAdjustIndent(&buf, 2);
+    virBufferAddLit(&buf, "<b/>\n");
+    virBufferSizeHint(&buf, 2);
+    virBufferAdjustIndent(&buf, -2);
+    virBufferAddLit(&buf, "</a>\n");
+
+    if (!(actual = virBufferContentAndReset(&buf)))
+        return -1;
+
+    if (STRNEQ(actual, "<a>\n  <b/>\n</a>\n")) {
+        virTestDifference(stderr, "<a>\n  <b/>\n</a>\n", actual);
+        return -1;
+    }
+
+    return 0;
+}
+
+
 /* Result of this shows up only in valgrind or similar */
 static int
 testBufferAutoclean(const void *opaque G_GNUC_UNUSED)
@@ -392,6 +534,9 @@ mymain(void)
     DO_TEST("AddBuffer", testBufAddBuffer);
     DO_TEST("set indent", testBufSetIndent);
     DO_TEST("autoclean", testBufferAutoclean);
+    DO_TEST("sink", testBufSink);
+    DO_TEST("gzip sink", testBufSinkGzip);
+    DO_TEST("size hint", testBufSizeHint);
 
 #define DO_TEST_ADD_STR(_data, _expect) \
     do { \
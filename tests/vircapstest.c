@@ -51,6 +51,97 @@ test_virCapabilitiesGetCpusForNodemask(const void *data G_GNUC_UNUSED)
 }
 
 
+/* Two sockets with two nodes each, two CPUs per node */
+#define PLACE_CELLS 4
+#define PLACE_CPUS_IN_CELL 2
+
+static virCapsHostNUMA *
+testCapsBuildPlacementTopology(void)
+{
+    g_autoptr(virCapsHostNUMA) caps = virCapabilitiesHostNUMANew();
+    int cell_id;
+    int cpu_id;
+
+    for (cell_id = 0; cell_id < PLACE_CELLS; cell_id++) {
+        virCapsHostNUMACellCPU *cpus = g_new0(virCapsHostNUMACellCPU, PLACE_CPUS_IN_CELL);
+        virNumaDistance *distances = g_new0(virNumaDistance, PLACE_CELLS);
+        int i;
+
+        for (cpu_id = 0; cpu_id < PLACE_CPUS_IN_CELL; cpu_id++) {
+            cpus[cpu_id].id = cell_id * PLACE_CPUS_IN_CELL + cpu_id;
+            cpus[cpu_id].socket_id = cell_id / 2;
+            cpus[cpu_id].core_id = cpus[cpu_id].id;
+        }
+
+        for (i = 0; i < PLACE_CELLS; i++) {
+            distances[i].cellid = i;
+            if (i == cell_id)
+                distances[i].value = 10;
+            else if (i / 2 == cell_id / 2)
+                distances[i].value = 11;
+            else
+                distances[i].value = 21;
+        }
+
+        virCapabilitiesHostNUMAAddCell(caps, cell_id, 4 * 1024 * 1024,
+                                       PLACE_CPUS_IN_CELL, &cpus,
+                                       PLACE_CELLS, &distances,
+                                       0, NULL,
+                                       NULL);
+    }
+
+    return g_steal_pointer(&caps);
+}
+
+
+struct testPlaceData {
+    unsigned long long freeMem[PLACE_CELLS]; /* in GiB */
+    const char *busyCpus;
+    const char *deviceNodes;
+    unsigned int vcpus;
+    unsigned long long memory; /* in GiB */
+    const char *expected;
+};
+
+
+static int
+test_virCapabilitiesHostNUMAPlace(const void *opaque)
+{
+    const struct testPlaceData *data = opaque;
+    g_autoptr(virCapsHostNUMA) caps = testCapsBuildPlacementTopology();
+    g_autoptr(virBitmap) busyCpus = NULL;
+    g_autoptr(virBitmap) deviceNodes = NULL;
+    g_autoptr(virBitmap) nodeset = NULL;
+    g_autofree char *actual = NULL;
+    unsigned long long freeMem[PLACE_CELLS];
+    size_t i;
+
+    for (i = 0; i < PLACE_CELLS; i++)
+        freeMem[i] = data->freeMem[i] * 1024 * 1024;
+
+    if (data->busyCpus &&
+        virBitmapParse(data->busyCpus, &busyCpus, 64) < 0)
+        return -1;
+
+    if (data->deviceNodes &&
+        virBitmapParse(data->deviceNodes, &deviceNodes, 64) < 0)
+        return -1;
+
+    nodeset = virCapabilitiesHostNUMAPlace(caps, freeMem, busyCpus,
+                                           deviceNodes, data->vcpus,
+                                           data->memory * 1024 * 1024);
+    actual = virBitmapFormat(nodeset);
+
+    if (STRNEQ(actual, data->expected)) {
+        VIR_TEST_DEBUG("Expected nodeset '%s', got '%s'",
+                       data->expected, actual);
+        return -1;
+    }
+
+    return 0;
+}
+
+
 static bool G_GNUC_UNUSED
 doCapsExpectFailure(virCaps *caps,
                     int ostype,
@@ -213,6 +304,26 @@ mymain(void)
     if (virTestRun("virCapabilitiesGetCpusForNodemask",
                    test_virCapabilitiesGetCpusForNodemask, NULL) < 0)
         ret = -1;
+
+#define DO_TEST_PLACE(name, ...) \
+    do { \
+        struct testPlaceData data = { __VA_ARGS__ }; \
+        if (virTestRun("virCapabilitiesHostNUMAPlace " name, \
+                       test_virCapabilitiesHostNUMAPlace, &data) < 0) \
+            ret = -1; \
+    } while (0)
+
+    DO_TEST_PLACE("single", { 4, 4, 4, 4 }, NULL, NULL, 2, 2, "0");
+    DO_TEST_PLACE("most-free", { 1, 3, 2, 1 }, NULL, NULL, 2, 1, "1");
+    DO_TEST_PLACE("device", { 4, 4, 4, 4 }, NULL, "2", 2, 2, "2");
+    DO_TEST_PLACE("busy", { 4, 4, 4, 4 }, "0-1", NULL, 2, 2, "1");
+    DO_TEST_PLACE("vcpus", { 4, 4, 4, 4 }, NULL, NULL, 3, 2, "0-1");
+    DO_TEST_PLACE("memory", { 4, 4, 4, 4 }, NULL, NULL, 2, 6, "0-1");
+    DO_TEST_PLACE("memory-device", { 4, 4, 4, 4 }, NULL, "3", 2, 6, "2-3");
+    DO_TEST_PLACE("memory-socket", { 4, 1, 3, 3 }, NULL, NULL, 2, 5, "2-3");
+    DO_TEST_PLACE("no-fit", { 4, 4, 4, 4 }, NULL, NULL, 2, 20, "0-3");
+
+#undef DO_TEST_PLACE
 #ifdef WITH_QEMU
     if (virTestRun("virCapsDomainDataLookupQEMU",
                    test_virCapsDomainDataLookupQEMU, NULL) < 0)
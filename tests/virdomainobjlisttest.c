@@ -0,0 +1,256 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library;  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "internal.h"
+#include "testutils.h"
+#include "virdomainobjlist.h"
+#include "viruuid.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+static virDomainXMLOption *xmlopt;
+static virDomainObjList *domlist;
+
+static const char *const domainNames[] = {
+    "a", "b", "c", "d", "e", "f", "g", "h", "i", "j", "x1", "x2",
+};
+
+
+struct testPageData {
+    const char *cursor;
+    size_t limit;
+    const char *pattern;
+    const char *const *rejected;
+    const char *expected;
+    const char *next;
+};
+
+
+static const char *const *testRejected;
+
+static bool
+testPageFilter(virConnectPtr conn G_GNUC_UNUSED,
+               virDomainDef *def)
+{
+    return !testRejected ||
+        !g_strv_contains((const char *const *) testRejected, def->name);
+}
+
+
+static int
+testPage(const void *opaque)
+{
+    const struct testPageData *data = opaque;
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    virDomainObj **vms = NULL;
+    size_t nvms = 0;
+    g_autofree char *next = NULL;
+    g_autofree char *actual = NULL;
+    size_t i;
+
+    testRejected = data->rejected;
+
+    if (virDomainObjListCollectPage(domlist, NULL, data->cursor, data->limit,
+                                    data->pattern, NULL, &vms, &nvms, &next,
+                                    testPageFilter, 0) < 0)
+        return -1;
+
+    for (i = 0; i < nvms; i++) {
+        virBufferAsprintf(&buf, "%s,", vms[i]->def->name);
+        virObjectUnref(vms[i]);
+    }
+    g_free(vms);
+    virBufferTrim(&buf, ",");
+    actual = virBufferContentAndReset(&buf);
+
+    if (STRNEQ_NULLABLE(actual, data->expected)) {
+        VIR_TEST_DEBUG("Expected domains '%s', got '%s'",
+                       NULLSTR(data->expected), NULLSTR(actual));
+        return -1;
+    }
+
+    if (STRNEQ_NULLABLE(next, data->next)) {
+        VIR_TEST_DEBUG("Expected cursor '%s', got '%s'",
+                       NULLSTR(data->next), NULLSTR(next));
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testAddDomains(void)
+{
+    size_t i;
+
+    if (!(domlist = virDomainObjListNew()))
+        return -1;
+
+    for (i = 0; i < G_N_ELEMENTS(domainNames); i++) {
+        g_autoptr(virDomainDef) def = NULL;
+        virDomainObj *vm;
+
+        if (!(def = virDomainDefNew(xmlopt)))
+            return -1;
+
+        def->name = g_strdup(domainNames[i]);
+        if (virUUIDGenerate(def->uuid) < 0)
+            return -1;
+
+        if (!(vm = virDomainObjListAdd(domlist, &def, xmlopt, 0, NULL)))
+            return -1;
+
+        virDomainObjEndAPI(&vm);
+    }
+
+    return 0;
+}
+
+
+#define REDUNDANT_UUID "<uuid>c7a5fdbd-edaf-9455-926a-d65c16db1809</uuid>"
+#define REDUNDANT_XML(uuid) \
+    "<domain type='qemu'>" \
+    "  <name>redundant</name>" \
+    uuid \
+    "  <memory unit='KiB'>219136</memory>" \
+    "  <os><type arch='i686' machine='pc'>hvm</type></os>" \
+    "</domain>"
+
+
+struct testRedundantData {
+    const char *xml;
+    bool modify;
+    bool expected;
+};
+
+
+static int
+testRedundantDefine(const void *opaque)
+{
+    const struct testRedundantData *data = opaque;
+    unsigned int flags = VIR_DOMAIN_DEF_PARSE_INACTIVE;
+    virDomainObjList *doms = NULL;
+    g_autoptr(virDomainDef) def = NULL;
+    g_autofree char *hash = virDomainDefParseHash(data->xml, flags);
+    virDomainObj *vm = NULL;
+    int ret = -1;
+
+    if (!(doms = virDomainObjListNew()))
+        return -1;
+
+    if (!(def = virDomainDefParseString(data->xml, xmlopt, NULL, flags)))
+        goto cleanup;
+
+    if (!(vm = virDomainObjListAdd(doms, &def, xmlopt, 0, NULL)))
+        goto cleanup;
+
+    vm->persistent = 1;
+    virDomainObjSetDefineHash(vm, xmlopt, hash);
+
+    if (data->modify)
+        vm->def->title = g_strdup("modified");
+
+    virDomainObjEndAPI(&vm);
+
+    if (!(def = virDomainDefParseString(data->xml, xmlopt, NULL, flags)))
+        goto cleanup;
+
+    vm = virDomainObjListFindRedundantDefine(doms, def, xmlopt, hash);
+
+    if (!!vm != data->expected) {
+        VIR_TEST_DEBUG("Expected redefinition to be %sredundant",
+                       data->expected ? "" : "not ");
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virDomainObjEndAPI(&vm);
+    virObjectUnref(doms);
+    return ret;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+    const char *const rejectH[] = { "h", NULL };
+    const char *const acceptX2[] = {
+        "a", "b", "c", "d", "e", "f", "g", "h", "i", "j", "x1", NULL,
+    };
+
+    if (!(xmlopt = virTestGenericDomainXMLConfInit()))
+        return EXIT_FAILURE;
+
+    if (testAddDomains() < 0) {
+        ret = -1;
+        goto cleanup;
+    }
+
+#define DO_TEST_PAGE(name, ...) \
+    do { \
+        struct testPageData data = { __VA_ARGS__ }; \
+        if (virTestRun("Page " name, testPage, &data) < 0) \
+            ret = -1; \
+    } while (0)
+
+    DO_TEST_PAGE("first", .limit = 3, .expected = "a,b,c", .next = "c");
+    DO_TEST_PAGE("middle", .cursor = "c", .limit = 3,
+                 .expected = "d,e,f", .next = "f");
+    DO_TEST_PAGE("last", .cursor = "h", .limit = 5,
+                 .expected = "i,j,x1,x2");
+    DO_TEST_PAGE("exact", .limit = 12,
+                 .expected = "a,b,c,d,e,f,g,h,i,j,x1,x2");
+    DO_TEST_PAGE("past end", .cursor = "x2", .limit = 3);
+    DO_TEST_PAGE("pattern", .limit = 1, .pattern = "x*",
+                 .expected = "x1", .next = "x1");
+    DO_TEST_PAGE("pattern last", .cursor = "x1", .limit = 1, .pattern = "x*",
+                 .expected = "x2");
+    DO_TEST_PAGE("filled at bound", .cursor = "g", .limit = 2,
+                 .rejected = rejectH, .expected = "i,j", .next = "j");
+    DO_TEST_PAGE("after bound", .cursor = "j", .limit = 2,
+                 .rejected = rejectH, .expected = "x1,x2");
+    DO_TEST_PAGE("several passes", .limit = 2,
+                 .rejected = acceptX2, .expected = "x2");
+    DO_TEST_PAGE("all rejected", .cursor = "x2", .limit = 2,
+                 .rejected = acceptX2);
+
+#define DO_TEST_REDUNDANT(name, ...) \
+    do { \
+        struct testRedundantData data = { __VA_ARGS__ }; \
+        if (virTestRun("Redundant define " name, \
+                       testRedundantDefine, &data) < 0) \
+            ret = -1; \
+    } while (0)
+
+    DO_TEST_REDUNDANT("same", .xml = REDUNDANT_XML(REDUNDANT_UUID),
+                      .expected = true);
+    DO_TEST_REDUNDANT("modified", .xml = REDUNDANT_XML(REDUNDANT_UUID),
+                      .modify = true);
+    DO_TEST_REDUNDANT("no uuid", .xml = REDUNDANT_XML(""));
+
+ cleanup:
+    virObjectUnref(domlist);
+    virObjectUnref(xmlopt);
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
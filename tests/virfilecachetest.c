@@ -219,6 +219,8 @@ mymain(void)
     TEST_RUN("cacheValid", NULL, "aaa\n", false);
     TEST_RUN("cacheInvalid", "bbb\n", "bbb\n", true);
     TEST_RUN("cacheMissing", "ccc\n", "ccc\n", true);
+    /* looking it up again must not create new data */
+    TEST_RUN("cacheMissing", NULL, "ccc\n", false);
 
     virObjectUnref(cache);
 
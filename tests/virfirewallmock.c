@@ -22,10 +22,17 @@
 char *
 virFindFileInPath(const char *file)
 {
+    /* Rules are applied one by one unless a test asks for the
+     * iptables-restore transactions explicitly */
+    if (file && g_str_has_suffix(file, "-restore") &&
+        !getenv("VIR_TEST_MOCK_FIREWALL_RESTORE"))
+        return NULL;
+
     if (file &&
         (g_strrstr(file, "ebtables") ||
          g_strrstr(file, "iptables") ||
-         g_strrstr(file, "ip6tables"))) {
+         g_strrstr(file, "ip6tables") ||
+         g_str_has_suffix(file, "nft"))) {
         return g_strdup(file);
     }
 
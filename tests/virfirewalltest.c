@@ -100,6 +100,104 @@ testFirewallSingleGroup(const void *opaque G_GNUC_UNUSED)
 }
 
 
+static void
+testFirewallBatchHook(const char *const*args G_GNUC_UNUSED,
+                      const char *const*env G_GNUC_UNUSED,
+                      const char *input,
+                      char **output G_GNUC_UNUSED,
+                      char **error G_GNUC_UNUSED,
+                      int *status G_GNUC_UNUSED,
+                      void *opaque)
+{
+    virBuffer *inputbuf = opaque;
+
+    virBufferAdd(inputbuf, input, -1);
+}
+
+
+static int
+testFirewallBatch(const void *opaque G_GNUC_UNUSED)
+{
+    g_auto(virBuffer) cmdbuf = VIR_BUFFER_INITIALIZER;
+    g_auto(virBuffer) inputbuf = VIR_BUFFER_INITIALIZER;
+    g_autoptr(virFirewall) fw = virFirewallNew();
+    const char *actual = NULL;
+    const char *expected =
+        IPTABLES_RESTORE " -w --noflush\n"
+        IPTABLES " -w -A INPUT --source 192.168.122.2 --jump REJECT\n"
+        IPTABLES_RESTORE " -w --noflush\n";
+    const char *expectedInput =
+        "*filter\n"
+        "-A INPUT --source 192.168.122.1 --jump ACCEPT\n"
+        "-A INPUT --source !192.168.122.1 -m comment --comment \"libvirt \\\"test\\\"\" --jump REJECT\n"
+        "COMMIT\n"
+        "*nat\n"
+        "-A POSTROUTING --source 192.168.122.0/24 --jump MASQUERADE\n"
+        "-A POSTROUTING --jump RETURN\n"
+        "COMMIT\n";
+    g_autoptr(virCommandDryRunToken) dryRunToken = virCommandDryRunTokenNew();
+
+    virCommandSetDryRun(dryRunToken, &cmdbuf, false, false,
+                        testFirewallBatchHook, &inputbuf);
+
+    virFirewallStartTransaction(fw, 0);
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_IPV4,
+                       "-A", "INPUT",
+                       "--source", "192.168.122.1",
+                       "--jump", "ACCEPT", NULL);
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_IPV4,
+                       "-A", "INPUT",
+                       "--source", "!192.168.122.1",
+                       "-m", "comment", "--comment", "libvirt \"test\"",
+                       "--jump", "REJECT", NULL);
+
+    /* the rule ignoring errors must be applied on its own */
+    virFirewallAddRuleFull(fw, VIR_FIREWALL_LAYER_IPV4,
+                           true, NULL, NULL,
+                           "-A", "INPUT",
+                           "--source", "192.168.122.2",
+                           "--jump", "REJECT", NULL);
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_IPV4,
+                       "--table", "nat",
+                       "-A", "POSTROUTING",
+                       "--source", "192.168.122.0/24",
+                       "--jump", "MASQUERADE", NULL);
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_IPV4,
+                       "--table", "nat",
+                       "-A", "POSTROUTING",
+                       "--jump", "RETURN", NULL);
+
+    g_setenv("VIR_TEST_MOCK_FIREWALL_RESTORE", "1", TRUE);
+    if (virFirewallApply(fw) < 0) {
+        g_unsetenv("VIR_TEST_MOCK_FIREWALL_RESTORE");
+        return -1;
+    }
+    g_unsetenv("VIR_TEST_MOCK_FIREWALL_RESTORE");
+
+    actual = virBufferCurrentContent(&cmdbuf);
+
+    if (STRNEQ_NULLABLE(expected, actual)) {
+        fprintf(stderr, "Unexpected command execution\n");
+        virTestDifference(stderr, expected, actual);
+        return -1;
+    }
+
+    actual = virBufferCurrentContent(&inputbuf);
+
+    if (STRNEQ_NULLABLE(expectedInput, actual)) {
+        fprintf(stderr, "Unexpected iptables-restore input\n");
+        virTestDifference(stderr, expectedInput, actual);
+        return -1;
+    }
+
+    return 0;
+}
+
+
 static int
 testFirewallRemoveRule(const void *opaque G_GNUC_UNUSED)
 {
@@ -787,6 +885,7 @@ mymain(void)
 
     RUN_TEST("single group", testFirewallSingleGroup);
     RUN_TEST("remove rule", testFirewallRemoveRule);
+    RUN_TEST("batch", testFirewallBatch);
     RUN_TEST("many groups", testFirewallManyGroups);
     RUN_TEST("ignore fail group", testFirewallIgnoreFailGroup);
     RUN_TEST("ignore fail rule", testFirewallIgnoreFailRule);
@@ -470,6 +470,281 @@ testJSONObjectFormatSteal(const void *opaque G_GNUC_UNUSED)
 }
 
 
+/* Numbers created from integers must behave like numbers parsed from their
+ * string form. */
+static int
+testJSONNumbersCompare(virJSONValue *native,
+                       const char *str)
+{
+    g_autoptr(virJSONValue) parsed = virJSONValueFromString(str);
+    const char *nativeStr = virJSONValueGetNumberString(native);
+    int ia = 0, ib = 0;
+    unsigned int ua = 0, ub = 0;
+    long long la = 0, lb = 0;
+    unsigned long long ula = 0, ulb = 0;
+    double da = 0, db = 0;
+
+    if (!parsed || STRNEQ_NULLABLE(nativeStr, str)) {
+        VIR_TEST_VERBOSE("expected '%s', got '%s'", str, NULLSTR(nativeStr));
+        return -1;
+    }
+
+    if (virJSONValueGetNumberInt(native, &ia) != virJSONValueGetNumberInt(parsed, &ib) ||
+        virJSONValueGetNumberUint(native, &ua) != virJSONValueGetNumberUint(parsed, &ub) ||
+        virJSONValueGetNumberLong(native, &la) != virJSONValueGetNumberLong(parsed, &lb) ||
+        virJSONValueGetNumberUlong(native, &ula) != virJSONValueGetNumberUlong(parsed, &ulb) ||
+        virJSONValueGetNumberDouble(native, &da) != virJSONValueGetNumberDouble(parsed, &db) ||
+        ia != ib || ua != ub || la != lb || ula != ulb || da != db) {
+        VIR_TEST_VERBOSE("number '%s' differs when parsed", str);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testJSONNumbers(const void *data G_GNUC_UNUSED)
+{
+    const long long longs[] = {
+        0, 1, -1, INT_MAX, (long long) INT_MAX + 1, INT_MIN,
+        (long long) INT_MIN - 1, UINT_MAX, (long long) UINT_MAX + 1,
+        -(long long) UINT_MAX, -(long long) UINT_MAX - 1, LLONG_MAX, LLONG_MIN,
+    };
+    const unsigned long long ulongs[] = {
+        0, UINT_MAX, LLONG_MAX, (unsigned long long) LLONG_MAX + 1, ULLONG_MAX,
+    };
+    size_t i;
+
+    for (i = 0; i < G_N_ELEMENTS(longs); i++) {
+        g_autoptr(virJSONValue) val = virJSONValueNewNumberLong(longs[i]);
+        g_autofree char *str = g_strdup_printf("%lld", longs[i]);
+
+        if (testJSONNumbersCompare(val, str) < 0)
+            return -1;
+    }
+
+    for (i = 0; i < G_N_ELEMENTS(ulongs); i++) {
+        g_autoptr(virJSONValue) val = virJSONValueNewNumberUlong(ulongs[i]);
+        g_autofree char *str = g_strdup_printf("%llu", ulongs[i]);
+
+        if (testJSONNumbersCompare(val, str) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testJSONLargeObject(const void *data G_GNUC_UNUSED)
+{
+    g_autoptr(virJSONValue) obj = virJSONValueNewObject();
+    g_autoptr(virJSONValue) copy = NULL;
+    g_autoptr(virJSONValue) removed = NULL;
+    g_autoptr(virJSONValue) replacement = virJSONValueNewNumberInt(-1);
+    g_autoptr(virJSONValue) first = virJSONValueNewNumberInt(-2);
+    size_t nkeys = 100;
+    size_t i;
+    int num;
+
+    /* large enough to use the hashed lookup */
+    for (i = 0; i < nkeys; i++) {
+        g_autofree char *key = g_strdup_printf("key%zu", i);
+
+        if (virJSONValueObjectAppendNumberInt(obj, key, i) < 0)
+            return -1;
+    }
+
+    if (virJSONValueObjectAppendNumberInt(obj, "key42", 0) == 0) {
+        VIR_TEST_VERBOSE("duplicate key was accepted");
+        return -1;
+    }
+
+    if (virJSONValueObjectRemoveKey(obj, "key42", &removed) != 1 ||
+        virJSONValueObjectHasKey(obj, "key42") != 0) {
+        VIR_TEST_VERBOSE("failed to remove 'key42'");
+        return -1;
+    }
+
+    virJSONValueObjectReplaceValue(obj, "key7", &replacement);
+
+    if (virJSONValueObjectPrependString(obj, "key-first", "1") < 0)
+        return -1;
+
+    if (!(copy = virJSONValueCopy(obj)))
+        return -1;
+
+    for (i = 0; i < nkeys; i++) {
+        g_autofree char *key = g_strdup_printf("key%zu", i);
+        int expect = i == 7 ? -1 : (int) i;
+
+        if (i == 42)
+            continue;
+
+        if (virJSONValueObjectGetNumberInt(obj, key, &num) < 0 ||
+            num != expect ||
+            virJSONValueObjectGetNumberInt(copy, key, &num) < 0 ||
+            num != expect) {
+            VIR_TEST_VERBOSE("wrong value of '%s'", key);
+            return -1;
+        }
+    }
+
+    if (STRNEQ_NULLABLE(virJSONValueObjectGetKey(obj, 0), "key-first") ||
+        !virJSONValueObjectGetString(obj, "key-first")) {
+        VIR_TEST_VERBOSE("prepended key not found");
+        return -1;
+    }
+
+    if (virJSONValueObjectAppend(obj, "key42", &first) < 0 ||
+        virJSONValueObjectGetNumberInt(obj, "key42", &num) < 0 ||
+        num != -2) {
+        VIR_TEST_VERBOSE("failed to re-add 'key42'");
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testJSONStream(const void *data)
+{
+    const struct testInfo *info = data;
+    const char *expectstr = info->expect ? info->expect : info->doc;
+    size_t len = strlen(info->doc);
+    size_t chunk;
+
+    /* feed the document in pieces of various sizes, including single bytes */
+    for (chunk = 1; chunk <= len; chunk = chunk * 2 + 1) {
+        g_autoptr(virJSONStreamParser) parser = NULL;
+        g_autoptr(virJSONValue) json = NULL;
+        g_autofree char *formatted = NULL;
+        size_t i;
+        int rc = 0;
+
+        if (!(parser = virJSONStreamParserNew()))
+            return -1;
+
+        for (i = 0; i < len && rc == 0; i += chunk)
+            rc = virJSONStreamParserFeed(parser, info->doc + i,
+                                         MIN(chunk, len - i));
+
+        if (rc == 0)
+            json = virJSONStreamParserFinish(parser);
+
+        if (!json) {
+            if (info->pass) {
+                VIR_TEST_VERBOSE("Failed to parse %s in chunks of %zu",
+                                 info->doc, chunk);
+                return -1;
+            }
+            continue;
+        }
+
+        if (!info->pass) {
+            VIR_TEST_VERBOSE("Unexpected success while parsing %s", info->doc);
+            return -1;
+        }
+
+        if (!(formatted = virJSONValueToString(json, false)))
+            return -1;
+
+        if (STRNEQ(expectstr, formatted)) {
+            virTestDifference(stderr, expectstr, formatted);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+static int
+testJSONVisitValue(const char *key,
+                   virJSONType type G_GNUC_UNUSED,
+                   const char *value,
+                   void *opaque)
+{
+    virBuffer *buf = opaque;
+
+    if (key)
+        virBufferAsprintf(buf, "%s=", key);
+    virBufferAsprintf(buf, "%s ", NULLSTR(value));
+
+    /* stop at the 'stop' member */
+    if (STREQ_NULLABLE(key, "stop"))
+        return 1;
+
+    return 0;
+}
+
+
+static int
+testJSONVisitStart(const char *key,
+                   virJSONType type,
+                   void *opaque)
+{
+    virBuffer *buf = opaque;
+
+    if (key)
+        virBufferAsprintf(buf, "%s:", key);
+    virBufferAdd(buf, type == VIR_JSON_TYPE_OBJECT ? "{ " : "[ ", -1);
+
+    return 0;
+}
+
+
+static int
+testJSONVisitEnd(virJSONType type,
+                 void *opaque)
+{
+    virBuffer *buf = opaque;
+
+    virBufferAdd(buf, type == VIR_JSON_TYPE_OBJECT ? "} " : "] ", -1);
+
+    return 0;
+}
+
+
+static int
+testJSONVisit(const void *data)
+{
+    const struct testInfo *info = data;
+    virJSONVisitor visitor = {
+        .value = testJSONVisitValue,
+        .start = testJSONVisitStart,
+        .end = testJSONVisitEnd,
+    };
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    g_autofree char *actual = NULL;
+
+    if (virJSONVisitString(info->doc, &visitor, &buf) < 0) {
+        if (info->pass) {
+            VIR_TEST_VERBOSE("Failed to visit %s", info->doc);
+            return -1;
+        }
+        return 0;
+    }
+
+    if (!info->pass) {
+        VIR_TEST_VERBOSE("Unexpected success while visiting %s", info->doc);
+        return -1;
+    }
+
+    virBufferTrim(&buf, " ");
+    actual = virBufferContentAndReset(&buf);
+
+    if (STRNEQ_NULLABLE(info->expect, actual)) {
+        virTestDifference(stderr, info->expect, actual);
+        return -1;
+    }
+
+    return 0;
+}
+
+
 static int
 mymain(void)
 {
@@ -596,6 +871,32 @@ mymain(void)
     DO_TEST_FULL("stealing of attributes while creating objects",
                  ObjectFormatSteal, NULL, NULL, true);
 
+    DO_TEST_FULL("numbers", Numbers, NULL, NULL, true);
+
+    DO_TEST_FULL("large object", LargeObject, NULL, NULL, true);
+
+    DO_TEST_FULL("stream object", Stream,
+                 "{ \"return\": [ { \"name\": \"quit\" }, 1.5, null, true ],"
+                 "  \"id\": \"libvirt-1\" }",
+                 "{\"return\":[{\"name\":\"quit\"},1.5,null,true],"
+                 "\"id\":\"libvirt-1\"}", true);
+    DO_TEST_FULL("stream escaped string", Stream,
+                 "[\"{\\\"blurb\\\":\\\"test\\\"}\"]", NULL, true);
+    DO_TEST_FULL("stream unterminated", Stream,
+                 "{ \"return\": [ 1, 2 ", NULL, false);
+    DO_TEST_FULL("stream garbage", Stream,
+                 "{ \"return\": 1 } x", NULL, false);
+
+    DO_TEST_FULL("visit", Visit,
+                 "{ \"return\": [ { \"name\": \"a\", \"n\": 1 }, null ],"
+                 "  \"t\": true, \"s\": \"str\" }",
+                 "{ return:[ { name=a n=1 } <null> ] t=true s=str }", true);
+    DO_TEST_FULL("visit stop", Visit,
+                 "{ \"a\": 1, \"stop\": 2, \"b\": [ 3 ] }",
+                 "{ a=1 stop=2", true);
+    DO_TEST_FULL("visit invalid", Visit,
+                 "{ \"a\": 1, ", NULL, false);
+
 #define DO_TEST_DEFLATTEN(name, pass) \
     DO_TEST_FULL(name, Deflatten, NULL, NULL, pass)
 
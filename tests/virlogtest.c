@@ -22,6 +22,11 @@
 #include "testutils.h"
 
 #include "virlog.h"
+#include "virfile.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+VIR_LOG_INIT("tests.logtest");
 
 struct testLogData {
     const char *str;
@@ -107,6 +112,95 @@ testLogParseFilters(const void *opaque)
     return ret;
 }
 
+#ifndef WIN32
+# define TEST_LOG_ASYNC_MESSAGES 20000
+
+/* Logs more messages than the queue holds, all of which must be written
+ * out in order by the time the outputs are reset. */
+static int
+testLogAsync(const void *opaque G_GNUC_UNUSED)
+{
+    g_autofree char *path = g_strdup_printf("%s/virlogtest-async.log",
+                                            abs_builddir);
+    g_autofree char *outputs = g_strdup_printf("3:file:%s", path);
+    g_autofree char *content = NULL;
+    g_auto(GStrv) lines = NULL;
+    size_t count = 0;
+    size_t i;
+    int ret = -1;
+
+    unlink(path);
+
+    if (virLogSetOutputs(outputs) < 0 ||
+        virLogSetAsync("block") < 0)
+        goto cleanup;
+
+    for (i = 0; i < TEST_LOG_ASYNC_MESSAGES; i++)
+        VIR_WARN("async test message %zu", i);
+
+    /* flushes the queue */
+    if (virLogReset() < 0)
+        goto cleanup;
+
+    if (virFileReadAll(path, 100 * 1024 * 1024, &content) < 0)
+        goto cleanup;
+
+    lines = g_strsplit(content, "\n", 0);
+    for (i = 0; lines[i]; i++) {
+        g_autofree char *expected = NULL;
+        char *msg;
+
+        if (!(msg = strstr(lines[i], "async test message ")))
+            continue;
+
+        expected = g_strdup_printf("async test message %zu", count);
+        if (STRNEQ(msg, expected)) {
+            VIR_TEST_DEBUG("Expected '%s' but got '%s'", expected, msg);
+            goto cleanup;
+        }
+        count++;
+    }
+
+    if (count != TEST_LOG_ASYNC_MESSAGES) {
+        VIR_TEST_DEBUG("Expected %d messages but got %zu",
+                       TEST_LOG_ASYNC_MESSAGES, count);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virLogReset();
+    unlink(path);
+    return ret;
+}
+#endif /* !WIN32 */
+
+
+static int
+testLogAsyncMode(const void *opaque)
+{
+    const struct testLogData *data = opaque;
+
+    if (virLogSetAsync(data->str) < 0) {
+        if (!data->pass) {
+            VIR_TEST_DEBUG("Got expected error: %s",
+                           virGetLastErrorMessage());
+            virResetLastError();
+            return 0;
+        }
+        return -1;
+    }
+
+    if (!data->pass) {
+        VIR_TEST_DEBUG("Test should have failed");
+        return -1;
+    }
+
+    return 0;
+}
+
+
 static int
 mymain(void)
 {
@@ -150,6 +244,12 @@ mymain(void)
     TEST_PARSE_FILTERS_FAIL("1:", 1);
     TEST_PARSE_FILTERS_FAIL(":foo", 1);
     TEST_PARSE_FILTERS_FAIL("1:+", 1);
+    DO_TEST_FULL("testLogAsyncMode none", testLogAsyncMode, "none", 0, true);
+    DO_TEST_FULL("testLogAsyncMode foo", testLogAsyncMode, "foo", 0, false);
+#ifndef WIN32
+    if (virTestRun("testLogAsync", testLogAsync, NULL) < 0)
+        ret = -1;
+#endif
 
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -43,6 +43,7 @@ struct testClearQosStruct {
     const char *exp_cmd;
     const char *iface;
     const unsigned char *vmid;
+    const char *find_reply; /* output of looking up queue and qos */
 };
 
 static int
@@ -186,6 +187,22 @@ testVirNetDevOpenvswitchInterfaceSetQos(const void *data)
 }
 
 
+static void
+testVirNetDevOpenvswitchFindDryRun(const char *const*args,
+                                   const char *const*env G_GNUC_UNUSED,
+                                   const char *input G_GNUC_UNUSED,
+                                   char **output,
+                                   char **error G_GNUC_UNUSED,
+                                   int *status G_GNUC_UNUSED,
+                                   void *opaque)
+{
+    const char *reply = opaque;
+
+    if (output && g_strv_contains(args, "find"))
+        *output = g_strdup(reply);
+}
+
+
 static int
 testVirNetDevOpenvswitchInterfaceClearQos(const void *data)
 {
@@ -196,7 +213,12 @@ testVirNetDevOpenvswitchInterfaceClearQos(const void *data)
     const unsigned char *vmid = info->vmid;
     g_autoptr(virCommandDryRunToken) dryRunToken = virCommandDryRunTokenNew();
 
-    virCommandSetDryRun(dryRunToken, &buf, false, false, NULL, NULL);
+    if (info->find_reply)
+        virCommandSetDryRun(dryRunToken, &buf, false, false,
+                            testVirNetDevOpenvswitchFindDryRun,
+                            (void *)info->find_reply);
+    else
+        virCommandSetDryRun(dryRunToken, &buf, false, false, NULL, NULL);
 
     if (virNetDevOpenvswitchInterfaceClearQos(iface, vmid) < 0)
         return -1;
@@ -265,10 +287,10 @@ mymain(void)
     DO_TEST_SET(("<bandwidth>"
                  "  <inbound average='20000'/>"
                  "</bandwidth>"),
-                (OVS_VSCTL " --timeout=5 --no-heading --columns=_uuid find queue"
+                (OVS_VSCTL " --timeout=5 --format=json --columns=_uuid find queue"
                            " 'external-ids:vm-id=\"66616b65-7575-6964-0000-000000000000\"'"
-                           " 'external-ids:ifname=\"tap-fake\"'\n"
-                 OVS_VSCTL " --timeout=5 --no-heading --columns=_uuid find qos"
+                           " 'external-ids:ifname=\"tap-fake\"'"
+                           " -- find qos"
                            " 'external-ids:vm-id=\"66616b65-7575-6964-0000-000000000000\"'"
                            " 'external-ids:ifname=\"tap-fake\"'\n"
                  OVS_VSCTL " --timeout=5 set port tap-fake qos=@qos1"
@@ -289,10 +311,10 @@ mymain(void)
     DO_TEST_SET(("<bandwidth>"
                  "  <inbound average='0' />"
                  "</bandwidth>"),
-                (OVS_VSCTL " --timeout=5 --no-heading --columns=_uuid find queue"
+                (OVS_VSCTL " --timeout=5 --format=json --columns=_uuid find queue"
                            " 'external-ids:vm-id=\"66616b65-7575-6964-0000-000000000000\"'"
-                           " 'external-ids:ifname=\"tap-fake\"'\n"
-                 OVS_VSCTL " --timeout=5 --no-heading --columns=_uuid find qos"
+                           " 'external-ids:ifname=\"tap-fake\"'"
+                           " -- find qos"
                            " 'external-ids:vm-id=\"66616b65-7575-6964-0000-000000000000\"'"
                            " 'external-ids:ifname=\"tap-fake\"'\n"
                  OVS_VSCTL " --timeout=5 set Interface tap-fake ingress_policing_rate=0 ingress_policing_burst=0\n"));
@@ -301,10 +323,10 @@ mymain(void)
                  "  <inbound average='0' />"
                  "  <outbound average='5000' />"
                  "</bandwidth>"),
-                (OVS_VSCTL " --timeout=5 --no-heading --columns=_uuid find queue"
+                (OVS_VSCTL " --timeout=5 --format=json --columns=_uuid find queue"
                            " 'external-ids:vm-id=\"66616b65-7575-6964-0000-000000000000\"'"
-                           " 'external-ids:ifname=\"tap-fake\"'\n"
-                 OVS_VSCTL " --timeout=5 --no-heading --columns=_uuid find qos"
+                           " 'external-ids:ifname=\"tap-fake\"'"
+                           " -- find qos"
                            " 'external-ids:vm-id=\"66616b65-7575-6964-0000-000000000000\"'"
                            " 'external-ids:ifname=\"tap-fake\"'\n"
                  OVS_VSCTL " --timeout=5 set Interface tap-fake ingress_policing_rate=40000\n"));
@@ -322,14 +344,29 @@ mymain(void)
     } while (0)
 
     DO_TEST_CLEAR_QOS(("fake-iface"), vm_id,
-                      (OVS_VSCTL " --timeout=5 --no-heading --columns=_uuid find queue"
+                      (OVS_VSCTL " --timeout=5 --format=json --columns=_uuid find queue"
                                  " 'external-ids:vm-id=\"66616b65-7575-6964-0000-000000000000\"'"
-                                 " 'external-ids:ifname=\"fake-iface\"'\n"
-                       OVS_VSCTL " --timeout=5 --no-heading --columns=_uuid find qos"
+                                 " 'external-ids:ifname=\"fake-iface\"'"
+                                 " -- find qos"
                                  " 'external-ids:vm-id=\"66616b65-7575-6964-0000-000000000000\"'"
                                  " 'external-ids:ifname=\"fake-iface\"'\n"
                        OVS_VSCTL " --timeout=5 set Interface fake-iface ingress_policing_rate=0 ingress_policing_burst=0\n"));
 
+    DO_TEST_CLEAR_QOS(("fake-iface"), vm_id,
+                      (OVS_VSCTL " --timeout=5 --format=json --columns=_uuid find queue"
+                                 " 'external-ids:vm-id=\"66616b65-7575-6964-0000-000000000000\"'"
+                                 " 'external-ids:ifname=\"fake-iface\"'"
+                                 " -- find qos"
+                                 " 'external-ids:vm-id=\"66616b65-7575-6964-0000-000000000000\"'"
+                                 " 'external-ids:ifname=\"fake-iface\"'\n"
+                       OVS_VSCTL " --timeout=5"
+                                 " -- --if-exists remove port fake-iface qos 8cc4ee5d-3d34-4d5e-8d5e-1e1c5b1b0c01"
+                                 " -- destroy qos 8cc4ee5d-3d34-4d5e-8d5e-1e1c5b1b0c01"
+                                 " -- destroy queue 1f6b8d4a-8b5c-4f7b-9d43-0b3c9b3f2a02\n"
+                       OVS_VSCTL " --timeout=5 set Interface fake-iface ingress_policing_rate=0 ingress_policing_burst=0\n"),
+                      .find_reply = "{\"data\":[[[\"uuid\",\"1f6b8d4a-8b5c-4f7b-9d43-0b3c9b3f2a02\"]]],\"headings\":[\"_uuid\"]}\n"
+                                    "{\"data\":[[[\"uuid\",\"8cc4ee5d-3d34-4d5e-8d5e-1e1c5b1b0c01\"]]],\"headings\":[\"_uuid\"]}\n");
+
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
@@ -517,6 +517,169 @@ static int testMessagePayloadStreamEncode(const void *args G_GNUC_UNUSED)
 }
 
 
+static int testMessageBufferPool(const void *args G_GNUC_UNUSED)
+{
+    virNetMessage *msg = NULL;
+    char *buffer;
+    unsigned long long hits;
+    unsigned long long misses;
+    unsigned long long newHits;
+    unsigned long long newMisses;
+    size_t nbuffers;
+    size_t nbytes;
+    size_t i;
+    int ret = -1;
+
+    /* Make sure the pool holds at least one buffer */
+    msg = virNetMessageNew(true);
+    virNetMessageResizeBuffer(msg, VIR_NET_MESSAGE_INITIAL + VIR_NET_MESSAGE_LEN_MAX);
+    buffer = msg->buffer;
+    memset(msg->buffer, 'x', msg->bufferAlloc);
+    virNetMessageFree(msg);
+
+    virNetMessageGetBufferPoolStats(&hits, &misses, &nbuffers, &nbytes);
+    if (nbuffers == 0 || nbytes < VIR_NET_MESSAGE_INITIAL) {
+        VIR_DEBUG("Expected cached buffers, got %zu (%zu bytes)",
+                  nbuffers, nbytes);
+        return -1;
+    }
+
+    msg = virNetMessageNew(true);
+    virNetMessageResizeBuffer(msg, VIR_NET_MESSAGE_INITIAL + VIR_NET_MESSAGE_LEN_MAX);
+    if (msg->buffer != buffer) {
+        VIR_DEBUG("Expected the cached buffer to be reused");
+        goto cleanup;
+    }
+
+    virNetMessageGetBufferPoolStats(&newHits, &newMisses, &nbuffers, &nbytes);
+    if (newHits != hits + 1 || newMisses != misses) {
+        VIR_DEBUG("Expected one more hit, got hits %llu -> %llu misses %llu -> %llu",
+                  hits, newHits, misses, newMisses);
+        goto cleanup;
+    }
+
+    /* Nothing of the previous message is left */
+    for (i = 0; i < msg->bufferAlloc; i++) {
+        if (msg->buffer[i] != '\0') {
+            VIR_DEBUG("Recycled buffer not cleared at offset %zu", i);
+            goto cleanup;
+        }
+    }
+
+    /* Growing the buffer keeps its content */
+    msg->buffer[0] = 'x';
+    msg->buffer[VIR_NET_MESSAGE_INITIAL] = 'y';
+    virNetMessageResizeBuffer(msg, 2 * VIR_NET_MESSAGE_INITIAL + VIR_NET_MESSAGE_LEN_MAX);
+    if (msg->bufferLength != 2 * VIR_NET_MESSAGE_INITIAL + VIR_NET_MESSAGE_LEN_MAX ||
+        msg->buffer[0] != 'x' ||
+        msg->buffer[VIR_NET_MESSAGE_INITIAL] != 'y') {
+        VIR_DEBUG("Buffer content not preserved when growing");
+        goto cleanup;
+    }
+
+    /* Small buffers are not taken from the pool */
+    virNetMessageClearPayload(msg);
+    virNetMessageResizeBuffer(msg, VIR_NET_MESSAGE_LEN_MAX);
+    if (msg->bufferAlloc != VIR_NET_MESSAGE_LEN_MAX) {
+        VIR_DEBUG("Expected exact allocation, got %zu", msg->bufferAlloc);
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    virNetMessageFree(msg);
+    return ret;
+}
+
+
+static int testMessagePayloadCompress(const void *args G_GNUC_UNUSED)
+{
+    virNetMessage *msg = virNetMessageNew(true);
+    virNetMessageError err = { 0 };
+    virNetMessageError result = { 0 };
+    g_autofree char *text = g_strnfill(64 * 1024, 'x');
+    size_t plainLength;
+    int ret = -1;
+
+    err.code = VIR_ERR_INTERNAL_ERROR;
+    err.domain = VIR_FROM_RPC;
+    err.level = VIR_ERR_ERROR;
+    err.message = &text;
+
+    msg->header.prog = 0x11223344;
+    msg->header.vers = 0x01;
+    msg->header.proc = 0x666;
+    msg->header.type = VIR_NET_REPLY;
+    msg->header.serial = 0x99;
+    msg->header.status = VIR_NET_OK;
+
+    /* Without a threshold the payload is left alone */
+    if (virNetMessageEncodeHeader(msg) < 0 ||
+        virNetMessageEncodePayload(msg, (xdrproc_t)xdr_virNetMessageError, &err) < 0)
+        goto cleanup;
+
+    if (msg->header.type != VIR_NET_REPLY) {
+        VIR_DEBUG("Expected an uncompressed reply, got type %d", msg->header.type);
+        goto cleanup;
+    }
+    plainLength = msg->bufferLength;
+
+    virNetMessageClear(msg);
+    msg->header.prog = 0x11223344;
+    msg->header.vers = 0x01;
+    msg->header.proc = 0x666;
+    msg->header.type = VIR_NET_REPLY;
+    msg->header.serial = 0x99;
+    msg->header.status = VIR_NET_OK;
+    msg->compressThreshold = 1024;
+
+    if (virNetMessageEncodeHeader(msg) < 0 ||
+        virNetMessageEncodePayload(msg, (xdrproc_t)xdr_virNetMessageError, &err) < 0)
+        goto cleanup;
+
+    if (msg->header.type != VIR_NET_REPLY_COMPRESSED ||
+        msg->bufferLength >= plainLength) {
+        VIR_DEBUG("Expected a compressed reply, got type %d length %zu (plain %zu)",
+                  msg->header.type, msg->bufferLength, plainLength);
+        goto cleanup;
+    }
+
+    /* Now decode it as the client would */
+    if (virNetMessageDecodeHeader(msg) < 0)
+        goto cleanup;
+
+    if (msg->header.type != VIR_NET_REPLY_COMPRESSED) {
+        VIR_DEBUG("Expected compressed type on the wire, got %d", msg->header.type);
+        goto cleanup;
+    }
+
+    if (virNetMessageDecompressPayload(msg) < 0)
+        goto cleanup;
+
+    if (msg->header.type != VIR_NET_REPLY ||
+        msg->bufferLength != plainLength) {
+        VIR_DEBUG("Expected plain reply of %zu bytes, got type %d length %zu",
+                  plainLength, msg->header.type, msg->bufferLength);
+        goto cleanup;
+    }
+
+    if (virNetMessageDecodePayload(msg, (xdrproc_t)xdr_virNetMessageError, &result) < 0)
+        goto cleanup;
+
+    if (result.code != VIR_ERR_INTERNAL_ERROR ||
+        !result.message || STRNEQ(*result.message, text)) {
+        VIR_DEBUG("Decompressed payload does not match");
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    xdr_free((xdrproc_t)xdr_virNetMessageError, (void *)&result);
+    virNetMessageFree(msg);
+    return ret;
+}
+
+
 static int
 mymain(void)
 {
@@ -541,6 +704,12 @@ mymain(void)
     if (virTestRun("Message Payload Stream Encode", testMessagePayloadStreamEncode, NULL) < 0)
         ret = -1;
 
+    if (virTestRun("Message Buffer Pool", testMessageBufferPool, NULL) < 0)
+        ret = -1;
+
+    if (virTestRun("Message Payload Compress", testMessagePayloadCompress, NULL) < 0)
+        ret = -1;
+
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
@@ -233,6 +233,149 @@ static int testTLSSessionInit(const void *opaque)
 }
 
 
+/*
+ * Run a handshake between two fresh sessions, and exchange a byte
+ * of application data so that the client receives any session
+ * ticket sent after the handshake.
+ */
+static int
+testTLSSessionConnect(virNetTLSContext *serverCtxt,
+                      virNetTLSContext *clientCtxt,
+                      const char *hostname,
+                      bool *resumed)
+{
+    virNetTLSSession *clientSess = NULL;
+    virNetTLSSession *serverSess = NULL;
+    int channel[2];
+    bool clientShake = false;
+    bool serverShake = false;
+    char c = '\1';
+    size_t i;
+    int ret = -1;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, channel) < 0)
+        abort();
+
+    ignore_value(virSetNonBlock(channel[0]));
+    ignore_value(virSetNonBlock(channel[1]));
+
+    if (!(serverSess = virNetTLSSessionNew(serverCtxt, NULL)) ||
+        !(clientSess = virNetTLSSessionNew(clientCtxt, hostname)))
+        goto cleanup;
+
+    virNetTLSSessionSetIOCallbacks(serverSess, testWrite, testRead, &channel[0]);
+    virNetTLSSessionSetIOCallbacks(clientSess, testWrite, testRead, &channel[1]);
+
+    do {
+        int rv;
+        if (!serverShake) {
+            rv = virNetTLSSessionHandshake(serverSess);
+            if (rv < 0)
+                goto cleanup;
+            if (rv == VIR_NET_TLS_HANDSHAKE_COMPLETE)
+                serverShake = true;
+        }
+        if (!clientShake) {
+            rv = virNetTLSSessionHandshake(clientSess);
+            if (rv < 0)
+                goto cleanup;
+            if (rv == VIR_NET_TLS_HANDSHAKE_COMPLETE)
+                clientShake = true;
+        }
+    } while (!clientShake || !serverShake);
+
+    if (virNetTLSSessionWrite(serverSess, &c, 1) != 1)
+        goto cleanup;
+
+    /* Post-handshake messages such as session tickets are consumed
+     * internally and may surface as EAGAIN before the data arrives */
+    c = 0;
+    for (i = 0; i < 10; i++) {
+        if (virNetTLSSessionRead(clientSess, &c, 1) == 1)
+            break;
+        if (errno != EAGAIN)
+            goto cleanup;
+    }
+
+    if (c != '\1')
+        goto cleanup;
+
+    if (virNetTLSSessionIsResumed(clientSess) !=
+        virNetTLSSessionIsResumed(serverSess)) {
+        VIR_WARN("Client and server disagree on session resumption");
+        goto cleanup;
+    }
+
+    *resumed = virNetTLSSessionIsResumed(clientSess);
+    ret = 0;
+
+ cleanup:
+    virObjectUnref(serverSess);
+    virObjectUnref(clientSess);
+    VIR_FORCE_CLOSE(channel[0]);
+    VIR_FORCE_CLOSE(channel[1]);
+    return ret;
+}
+
+
+/*
+ * A client reconnecting to a server with session tickets enabled
+ * resumes its previous session instead of a full handshake.
+ */
+static int testTLSSessionResume(const void *opaque)
+{
+    struct testTLSSessionData *data = (struct testTLSSessionData *)opaque;
+    virNetTLSContext *serverCtxt = NULL;
+    virNetTLSContext *clientCtxt = NULL;
+    bool resumed = false;
+    int ret = -1;
+
+    serverCtxt = virNetTLSContextNewServer(data->servercacrt,
+                                           NULL,
+                                           data->servercrt,
+                                           KEYFILE,
+                                           data->wildcards,
+                                           "NORMAL",
+                                           false,
+                                           true);
+
+    clientCtxt = virNetTLSContextNewClient(data->clientcacrt,
+                                           NULL,
+                                           data->clientcrt,
+                                           KEYFILE,
+                                           "NORMAL",
+                                           false,
+                                           true);
+
+    if (!serverCtxt || !clientCtxt)
+        goto cleanup;
+
+    virNetTLSContextSetSessionTicketRotation(serverCtxt, 60);
+
+    /* The first connection may or may not resume a session cached
+     * by earlier tests, but it always leaves a fresh ticket behind */
+    if (testTLSSessionConnect(serverCtxt, clientCtxt,
+                              data->hostname, &resumed) < 0)
+        goto cleanup;
+
+    if (testTLSSessionConnect(serverCtxt, clientCtxt,
+                              data->hostname, &resumed) < 0)
+        goto cleanup;
+
+    if (!resumed) {
+        VIR_WARN("Expected the TLS session to be resumed");
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virObjectUnref(serverCtxt);
+    virObjectUnref(clientCtxt);
+    return ret;
+}
+
+
 static int
 mymain(void)
 {
@@ -337,6 +480,16 @@ mymain(void)
 
     DO_SESS_TEST(cacertreq.filename, servercertreq.filename, clientcertreq.filename,
                  false, false, "libvirt.org", NULL);
+    do {
+        static struct testTLSSessionData data;
+        data.servercacrt = cacertreq.filename;
+        data.clientcacrt = cacertreq.filename;
+        data.servercrt = servercertreq.filename;
+        data.clientcrt = clientcertreq.filename;
+        data.hostname = "libvirt.org";
+        if (virTestRun("TLS Session resume", testTLSSessionResume, &data) < 0)
+            ret = -1;
+    } while (0);
     DO_SESS_TEST_EXT(cacertreq.filename, altcacertreq.filename, servercertreq.filename,
                      clientcertaltreq.filename, true, true, "libvirt.org", NULL);
 
@@ -0,0 +1,97 @@
+#include <config.h>
+
+#include "internal.h"
+#include "testutils.h"
+#include "viropenmetrics.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+static int
+testOpenMetricsFormat(const void *opaque G_GNUC_UNUSED)
+{
+    g_autoptr(virOpenMetrics) metrics = virOpenMetricsNew();
+    virOpenMetricsLabel labels[] = {
+        { "server", "libvirtd" },
+        { "path", "C:\\dir\n\"x\"" },
+    };
+    double bounds[] = { 0.001, 0.01 };
+    unsigned long long counts[] = { 1, 0, 2 };
+    g_autofree char *actual = NULL;
+    const char *expected =
+        "# TYPE libvirt_clients gauge\n"
+        "# HELP libvirt_clients Connected clients\n"
+        "libvirt_clients{server=\"libvirtd\"} 3\n"
+        "libvirt_clients{server=\"admin\"} 1\n"
+        "# TYPE libvirt_calls counter\n"
+        "libvirt_calls_total 42\n"
+        "# TYPE libvirt_escaped unknown\n"
+        "libvirt_escaped{server=\"libvirtd\",path=\"C:\\\\dir\\n\\\"x\\\"\"} 0.5\n"
+        "# TYPE libvirt_latency_seconds histogram\n"
+        "libvirt_latency_seconds_bucket{server=\"libvirtd\",le=\"0.001\"} 1\n"
+        "libvirt_latency_seconds_bucket{server=\"libvirtd\",le=\"0.01\"} 1\n"
+        "libvirt_latency_seconds_bucket{server=\"libvirtd\",le=\"+Inf\"} 3\n"
+        "libvirt_latency_seconds_count{server=\"libvirtd\"} 3\n"
+        "libvirt_latency_seconds_sum{server=\"libvirtd\"} 2.25\n"
+        "# EOF\n";
+
+    virOpenMetricsDeclare(metrics, "libvirt_clients",
+                          VIR_OPEN_METRICS_GAUGE, "Connected clients");
+    virOpenMetricsDeclare(metrics, "libvirt_calls",
+                          VIR_OPEN_METRICS_COUNTER, NULL);
+    virOpenMetricsDeclare(metrics, "libvirt_unused",
+                          VIR_OPEN_METRICS_GAUGE, NULL);
+
+    virOpenMetricsAddULLong(metrics, "libvirt_clients", labels, 1, 3);
+    virOpenMetricsAddULLong(metrics, "libvirt_calls", NULL, 0, 42);
+    virOpenMetricsAddDouble(metrics, "libvirt_escaped", labels, 2, 0.5);
+    virOpenMetricsAddHistogram(metrics, "libvirt_latency_seconds", labels, 1,
+                               bounds, counts, G_N_ELEMENTS(counts), 2.25);
+
+    labels[0].value = "admin";
+    virOpenMetricsAddULLong(metrics, "libvirt_clients", labels, 1, 1);
+
+    actual = virOpenMetricsFormat(metrics);
+
+    return virTestCompareToString(expected, actual);
+}
+
+
+struct testSanitizeData {
+    const char *name;
+    const char *expected;
+};
+
+static int
+testOpenMetricsSanitize(const void *opaque)
+{
+    const struct testSanitizeData *data = opaque;
+    g_autofree char *actual = virOpenMetricsSanitizeName(data->name);
+
+    return virTestCompareToString(data->expected, actual);
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+
+    if (virTestRun("Format", testOpenMetricsFormat, NULL) < 0)
+        ret = -1;
+
+#define DO_TEST_SANITIZE(_name, _expected) \
+    do { \
+        struct testSanitizeData data = { _name, _expected }; \
+        if (virTestRun("Sanitize " _name, testOpenMetricsSanitize, &data) < 0) \
+            ret = -1; \
+    } while (0)
+
+    DO_TEST_SANITIZE("block_rd_bytes", "block_rd_bytes");
+    DO_TEST_SANITIZE("iothread_poll-max-ns", "iothread_poll_max_ns");
+    DO_TEST_SANITIZE("0day", "_0day");
+    DO_TEST_SANITIZE("a.b:c", "a_b_c");
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
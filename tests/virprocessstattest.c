@@ -60,6 +60,65 @@ test_virProcessGetStat(const void *opaque)
 }
 
 
+static int
+test_virProcessTasks(const void *opaque G_GNUC_UNUSED)
+{
+    g_autofree char *data_dir = NULL;
+    g_autoptr(virProcessTasks) tasks = NULL;
+    unsigned long long cpuTime = 0;
+    unsigned long long cpuWait = 0;
+    unsigned long long cpuDelay = 0;
+    unsigned long long expectTime;
+    int lastCpu = 0;
+
+    data_dir = g_strdup_printf("%s/virprocessstatdata/tasks",
+                               abs_srcdir);
+
+    virFileWrapperAddPrefix("/proc/-1/task", data_dir);
+
+    tasks = virProcessTasksOpen(-1);
+
+    if (tasks &&
+        (virProcessTasksGetStatInfo(tasks, 42, &cpuTime, &lastCpu) < 0 ||
+         virProcessTasksGetSchedInfo(tasks, 42, &cpuWait) < 0 ||
+         virProcessTasksGetSchedDelay(tasks, 42, &cpuDelay) < 0)) {
+        virFileWrapperClearPrefixes();
+        return -1;
+    }
+
+    virFileWrapperClearPrefixes();
+
+    if (!tasks) {
+        fprintf(stderr, "Could not open task directory\n");
+        return -1;
+    }
+
+    /* utime and stime are the 14th and 15th field */
+    expectTime = 1000ull * 1000ull * 1000ull * (14 + 15) /
+        (unsigned long long) sysconf(_SC_CLK_TCK);
+
+    if (cpuTime != expectTime || lastCpu != 39) {
+        fprintf(stderr, "Stat info incorrect, expected %llu/%d, got %llu/%d\n",
+                expectTime, 39, cpuTime, lastCpu);
+        return -1;
+    }
+
+    if (cpuWait != 1234567890) {
+        fprintf(stderr, "Wait time incorrect, expected %llu, got %llu\n",
+                1234567890ull, cpuWait);
+        return -1;
+    }
+
+    if (cpuDelay != 2000) {
+        fprintf(stderr, "Delay incorrect, expected %llu, got %llu\n",
+                2000ull, cpuDelay);
+        return -1;
+    }
+
+    return 0;
+}
+
+
 static int
 mymain(void)
 {
@@ -82,6 +141,9 @@ mymain(void)
     DO_TEST("simple", "command", 5, true);
     DO_TEST("complex", "this) is ( a \t weird )\n)( (command ( ", 100, false);
 
+    if (virTestRun("Reading thread stats", test_virProcessTasks, NULL) < 0)
+        ret = -1;
+
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
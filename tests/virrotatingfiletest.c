@@ -22,6 +22,7 @@
 #include <fcntl.h>
 
 #include "virrotatingfile.h"
+#include "virfile.h"
 #include "virlog.h"
 #include "testutils.h"
 
@@ -32,6 +33,7 @@ VIR_LOG_INIT("tests.rotatingfiletest");
 #define FILENAME "virrotatingfiledata.txt"
 #define FILENAME0 "virrotatingfiledata.txt.0"
 #define FILENAME1 "virrotatingfiledata.txt.1"
+#define FILENAME1GZ "virrotatingfiledata.txt.1.gz"
 
 #define FILEBYTE 0xde
 #define FILEBYTE0 0xad
@@ -692,6 +694,124 @@ static int testRotatingFileReaderSeek(const void *data G_GNUC_UNUSED)
     return ret;
 }
 
+static int testRotatingFileReaderSeekRotated(const void *data G_GNUC_UNUSED)
+{
+    virRotatingFileReader *file;
+    int ret = -1;
+    char buf[600];
+    ssize_t got;
+    size_t regions[] = { 156, 256 };
+    struct stat sb;
+
+    if (testRotatingFileInitFiles(256, 256, (off_t)-1) < 0)
+        return -1;
+
+    file = virRotatingFileReaderNew(FILENAME, 2);
+    if (!file)
+        goto cleanup;
+
+    /* no log file has the inode of a directory */
+    if (stat(".", &sb) < 0) {
+        virReportSystemError(errno, "Cannot stat %s", ".");
+        goto cleanup;
+    }
+
+    if (virRotatingFileReaderSeek(file, sb.st_ino, 100) < 0)
+        goto cleanup;
+
+    if ((got = virRotatingFileReaderConsume(file, buf, sizeof(buf))) < 0)
+        goto cleanup;
+
+    if (testRotatingFileReaderAssertBufferContent(buf, got,
+                                                  G_N_ELEMENTS(regions),
+                                                  regions) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    virRotatingFileReaderFree(file);
+    unlink(FILENAME);
+    unlink(FILENAME0);
+    unlink(FILENAME1);
+    return ret;
+}
+
+static int testRotatingFileCompress(const void *data G_GNUC_UNUSED)
+{
+    g_autofree char *gzip = virFindFileInPath("gzip");
+    virRotatingFileWriter *file = NULL;
+    virRotatingFileReader *reader = NULL;
+    int ret = -1;
+    char buf[512];
+    char all[512 * 6];
+    ssize_t got;
+    ssize_t i;
+
+    if (!gzip)
+        return EXIT_AM_SKIP;
+
+    if (testRotatingFileInitFiles((off_t)-1,
+                                  (off_t)-1,
+                                  (off_t)-1) < 0)
+        return -1;
+
+    file = virRotatingFileWriterNew(FILENAME,
+                                    1024,
+                                    2,
+                                    false,
+                                    0700);
+    if (!file)
+        goto cleanup;
+
+    virRotatingFileWriterSetCompression(file, VIR_ROTATING_FILE_COMPRESSION_GZIP);
+
+    memset(buf, 0x5e, sizeof(buf));
+
+    for (i = 0; i < 5; i++)
+        virRotatingFileWriterAppend(file, buf, sizeof(buf));
+
+    /* waits for the compression to finish */
+    g_clear_pointer(&file, virRotatingFileWriterFree);
+
+    if (testRotatingFileWriterAssertFileSizes(512,
+                                              1024,
+                                              (off_t)-1) < 0)
+        goto cleanup;
+
+    if (!virFileExists(FILENAME1GZ)) {
+        fprintf(stderr, "File %s does not exist\n", FILENAME1GZ);
+        goto cleanup;
+    }
+
+    if (!(reader = virRotatingFileReaderNew(FILENAME, 2)))
+        goto cleanup;
+
+    if ((got = virRotatingFileReaderConsume(reader, all, sizeof(all))) < 0)
+        goto cleanup;
+
+    if (got != 512 * 5) {
+        fprintf(stderr, "Expected %d bytes, got %zd\n", 512 * 5, got);
+        goto cleanup;
+    }
+
+    for (i = 0; i < got; i++) {
+        if (all[i] != 0x5e) {
+            fprintf(stderr, "Unexpected '0x%x' at byte %zd\n", all[i] & 0xff, i);
+            goto cleanup;
+        }
+    }
+
+    ret = 0;
+ cleanup:
+    virRotatingFileReaderFree(reader);
+    virRotatingFileWriterFree(file);
+    unlink(FILENAME);
+    unlink(FILENAME0);
+    unlink(FILENAME1);
+    unlink(FILENAME1GZ);
+    return ret;
+}
+
 static int
 mymain(void)
 {
@@ -736,6 +856,12 @@ mymain(void)
     if (virTestRun("Rotating file read seek", testRotatingFileReaderSeek, NULL) < 0)
         ret = -1;
 
+    if (virTestRun("Rotating file read seek rotated", testRotatingFileReaderSeekRotated, NULL) < 0)
+        ret = -1;
+
+    if (virTestRun("Rotating file compress", testRotatingFileCompress, NULL) < 0)
+        ret = -1;
+
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
@@ -0,0 +1,357 @@
+#include <config.h>
+
+#include "internal.h"
+#include "testutils.h"
+
+#if WITH_MEMFD_CREATE && WITH_MMAP
+
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+
+# include "virfile.h"
+# include "virshmring.h"
+# include "virutil.h"
+
+# define VIR_FROM_THIS VIR_FROM_NONE
+
+# define TEST_MAGIC 0x54455354
+# define TEST_TYPE 1
+
+typedef struct {
+    virShmRingRecord header;
+    unsigned int counter;
+    char payload[96];
+} testRecord;
+
+/* Reads the ring the way a process it's shared with does */
+typedef struct {
+    void *map;
+    size_t maplen;
+    const virShmRingHeader *header;
+    const char *data;
+    unsigned long long pos;
+} testReader;
+
+
+static void
+testReaderClose(testReader *reader)
+{
+    if (reader->map)
+        munmap(reader->map, reader->maplen);
+}
+
+
+static int
+testReaderOpen(testReader *reader,
+               virShmRing *ring)
+{
+    VIR_AUTOCLOSE fd = virShmRingGetReadOnlyFD(ring);
+    struct stat sb;
+
+    if (fd < 0)
+        return -1;
+
+    if (fstat(fd, &sb) < 0)
+        return -1;
+
+    reader->maplen = sb.st_size;
+    if ((reader->map = mmap(NULL, reader->maplen, PROT_READ,
+                            MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        reader->map = NULL;
+        return -1;
+    }
+
+    reader->header = reader->map;
+    reader->data = (const char *)reader->map + reader->header->offset;
+
+    if (reader->header->magic != TEST_MAGIC ||
+        reader->header->offset + reader->header->size != reader->maplen) {
+        VIR_TEST_DEBUG("Unexpected header");
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/* Returns 1 with the next record copied to @record, 0 if there is none,
+ * -1 if records were lost */
+static int
+testReaderNext(testReader *reader,
+               testRecord *record)
+{
+    unsigned long long size = reader->header->size;
+
+    while (true) {
+        unsigned long long head = __atomic_load_n(&reader->header->head,
+                                                  __ATOMIC_ACQUIRE);
+        unsigned long long tail;
+        virShmRingRecord hdr;
+        const char *ptr = reader->data + (reader->pos & (size - 1));
+
+        if (reader->pos == head)
+            return 0;
+
+        memcpy(&hdr, ptr, sizeof(hdr));
+        if (hdr.type == TEST_TYPE && hdr.length == sizeof(*record))
+            memcpy(record, ptr, sizeof(*record));
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        tail = __atomic_load_n(&reader->header->tail, __ATOMIC_RELAXED);
+        if (tail > reader->pos) {
+            reader->pos = tail;
+            return -1;
+        }
+
+        reader->pos += hdr.length;
+
+        if (hdr.type == VIR_SHM_RING_RECORD_PADDING)
+            continue;
+
+        if (hdr.type != TEST_TYPE || hdr.length != sizeof(*record)) {
+            VIR_TEST_DEBUG("Unexpected record type %u length %u",
+                           hdr.type, hdr.length);
+            return -1;
+        }
+
+        return 1;
+    }
+}
+
+
+static int
+testShmRingAppend(virShmRing *ring,
+                  unsigned int counter)
+{
+    testRecord record = { .counter = counter };
+
+    return virShmRingAppend(ring, TEST_TYPE, &record, sizeof(record));
+}
+
+
+static int
+testShmRingBasic(const void *opaque G_GNUC_UNUSED)
+{
+    g_autoptr(virShmRing) ring = NULL;
+    testReader reader = { 0 };
+    testRecord record;
+    unsigned int i;
+    int ret = -1;
+
+    if (!(ring = virShmRingNew("test", TEST_MAGIC, 1, virGetSystemPageSize())))
+        return -1;
+
+    if (testReaderOpen(&reader, ring) < 0)
+        goto cleanup;
+
+    if (testReaderNext(&reader, &record) != 0)
+        goto cleanup;
+
+    for (i = 0; i < 3; i++) {
+        if (testShmRingAppend(ring, i) < 0)
+            goto cleanup;
+    }
+
+    for (i = 0; i < 3; i++) {
+        if (testReaderNext(&reader, &record) != 1 ||
+            record.counter != i) {
+            VIR_TEST_DEBUG("Missing record %u", i);
+            goto cleanup;
+        }
+    }
+
+    if (testReaderNext(&reader, &record) != 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    testReaderClose(&reader);
+    return ret;
+}
+
+
+static int
+testShmRingOverwrite(const void *opaque G_GNUC_UNUSED)
+{
+    g_autoptr(virShmRing) ring = NULL;
+    testReader reader = { 0 };
+    testRecord record;
+    unsigned int last = 0;
+    unsigned int n = 0;
+    unsigned int i;
+    int rc;
+    int ret = -1;
+
+    if (!(ring = virShmRingNew("test", TEST_MAGIC, 1, virGetSystemPageSize())))
+        return -1;
+
+    if (testReaderOpen(&reader, ring) < 0)
+        goto cleanup;
+
+    /* Wraps around several times, with padding at the end each time */
+    for (i = 0; i < 100; i++) {
+        if (testShmRingAppend(ring, i) < 0)
+            goto cleanup;
+    }
+
+    if (testReaderNext(&reader, &record) != -1) {
+        VIR_TEST_DEBUG("Lost records not detected");
+        goto cleanup;
+    }
+
+    while ((rc = testReaderNext(&reader, &record)) == 1) {
+        if (n > 0 && record.counter != last + 1) {
+            VIR_TEST_DEBUG("Record %u follows %u", record.counter, last);
+            goto cleanup;
+        }
+        last = record.counter;
+        n++;
+    }
+
+    if (rc != 0 || n == 0 || last != 99 ||
+        n * sizeof(record) > reader.header->size) {
+        VIR_TEST_DEBUG("Read %u records up to %u", n, last);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    testReaderClose(&reader);
+    return ret;
+}
+
+
+static int
+testShmRingReadOnly(const void *opaque G_GNUC_UNUSED)
+{
+    g_autoptr(virShmRing) ring = NULL;
+    VIR_AUTOCLOSE fd = -1;
+    size_t size = virGetSystemPageSize();
+    g_autofree char *big = g_new0(char, size);
+    void *map;
+
+    if (!(ring = virShmRingNew("test", TEST_MAGIC, 1, size)))
+        return -1;
+
+    if ((fd = virShmRingGetReadOnlyFD(ring)) < 0)
+        return -1;
+
+    if ((map = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED, fd, 0)) != MAP_FAILED) {
+        munmap(map, size);
+        VIR_TEST_DEBUG("Ring mapped for writing");
+        return -1;
+    }
+
+    if (ftruncate(fd, 0) == 0) {
+        VIR_TEST_DEBUG("Ring truncated");
+        return -1;
+    }
+
+    /* Too large to keep more than one record */
+    if (virShmRingAppend(ring, TEST_TYPE, big, size) == 0) {
+        VIR_TEST_DEBUG("Oversized record appended");
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/* Readers may be able to write to the ring if it couldn't be sealed
+ * for future writes, the writer must not trust the records then */
+static int
+testShmRingCorrupt(const void *opaque G_GNUC_UNUSED)
+{
+    g_autoptr(virShmRing) ring = NULL;
+    VIR_AUTOCLOSE rofd = -1;
+    VIR_AUTOCLOSE fd = -1;
+    g_autofree char *path = NULL;
+    size_t size = virGetSystemPageSize();
+    size_t maplen = 2 * size;
+    virShmRingHeader *header;
+    virShmRingRecord *hdr;
+    const unsigned int lengths[] = { 0, 3, UINT_MAX & ~7 };
+    void *map;
+    size_t i;
+    int ret = -1;
+
+    if (!(ring = virShmRingNew("test", TEST_MAGIC, 1, size)))
+        return -1;
+
+    if ((rofd = virShmRingGetReadOnlyFD(ring)) < 0)
+        return -1;
+
+    path = g_strdup_printf("/proc/self/fd/%d", rofd);
+    if ((fd = open(path, O_RDWR)) < 0 ||
+        (map = mmap(NULL, maplen, PROT_READ | PROT_WRITE,
+                    MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        VIR_TEST_DEBUG("Ring is sealed for writing");
+        return EXIT_AM_SKIP;
+    }
+
+    header = map;
+
+    for (i = 0; i < G_N_ELEMENTS(lengths); i++) {
+        unsigned int j;
+
+        /* Fill the ring, then break the length of the oldest record */
+        for (j = 0; j * sizeof(testRecord) < size; j++) {
+            if (testShmRingAppend(ring, j) < 0)
+                goto cleanup;
+        }
+
+        hdr = (virShmRingRecord *)((char *)map + header->offset +
+                                   (header->tail & (size - 1)));
+        hdr->length = lengths[i];
+
+        /* Must neither hang nor walk off the data area while making
+         * room for these */
+        if (testShmRingAppend(ring, 0) < 0 ||
+            testShmRingAppend(ring, 1) < 0)
+            goto cleanup;
+
+        if (header->tail > header->head ||
+            header->head - header->tail > size) {
+            VIR_TEST_DEBUG("Tail %llu doesn't fit head %llu",
+                           header->tail, header->head);
+            goto cleanup;
+        }
+    }
+
+    ret = 0;
+
+ cleanup:
+    munmap(map, maplen);
+    return ret;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+
+    if (virTestRun("Basic", testShmRingBasic, NULL) < 0)
+        ret = -1;
+    if (virTestRun("Overwrite", testShmRingOverwrite, NULL) < 0)
+        ret = -1;
+    if (virTestRun("ReadOnly", testShmRingReadOnly, NULL) < 0)
+        ret = -1;
+    if (virTestRun("Corrupt", testShmRingCorrupt, NULL) < 0)
+        ret = -1;
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
+#else
+int
+main(void)
+{
+    return EXIT_AM_SKIP;
+}
+#endif
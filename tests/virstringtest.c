@@ -22,6 +22,7 @@
 #include "testutils.h"
 #include "virerror.h"
 #include "viralloc.h"
+#include "virbuffer.h"
 #include "virfile.h"
 #include "virlog.h"
 #include "virstring.h"
@@ -448,6 +449,94 @@ static int testFilterChars(const void *args)
     return 0;
 }
 
+struct testViewTokensData {
+    const char *string;
+    const char *delims;
+    const char *result;
+};
+
+static int
+testStringViewTokens(const void *args)
+{
+    const struct testViewTokensData *data = args;
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    g_autofree char *res = NULL;
+    virStringView rest;
+    virStringView token;
+
+    virStringViewInit(&rest, data->string);
+
+    while (virStringViewNextToken(&rest, data->delims, &token))
+        virBufferAsprintf(&buf, "%.*s|", (int) token.len, token.str);
+
+    res = virBufferContentAndReset(&buf);
+
+    if (STRNEQ_NULLABLE(res, data->result)) {
+        fprintf(stderr, "Returned '%s', expected '%s'\n",
+                NULLSTR(res), NULLSTR(data->result));
+        return -1;
+    }
+
+    return 0;
+}
+
+static int
+testStringViewNumbers(const void *args G_GNUC_UNUSED)
+{
+    virStringView rest;
+    virStringView token;
+    unsigned long long ull;
+    long long ll;
+    double d;
+
+    virStringViewInit(&rest, "18446744073709551615 18446744073709551616 "
+                      "-9223372036854775808 +1 1x avg10=0.25");
+
+    if (!virStringViewNextToken(&rest, " ", &token) ||
+        virStringViewToULL(&token, &ull) < 0 ||
+        ull != ULLONG_MAX) {
+        fprintf(stderr, "Failed to parse ULLONG_MAX\n");
+        return -1;
+    }
+
+    if (!virStringViewNextToken(&rest, " ", &token) ||
+        virStringViewToULL(&token, &ull) == 0) {
+        fprintf(stderr, "Overflow not detected\n");
+        return -1;
+    }
+
+    if (!virStringViewNextToken(&rest, " ", &token) ||
+        virStringViewToLL(&token, &ll) < 0 ||
+        ll != LLONG_MIN) {
+        fprintf(stderr, "Failed to parse LLONG_MIN\n");
+        return -1;
+    }
+
+    if (!virStringViewNextToken(&rest, " ", &token) ||
+        virStringViewToLL(&token, &ll) == 0 ||
+        !virStringViewNextToken(&rest, " ", &token) ||
+        virStringViewToULL(&token, &ull) == 0) {
+        fprintf(stderr, "Invalid number accepted\n");
+        return -1;
+    }
+
+    if (!virStringViewNextToken(&rest, " ", &token) ||
+        !virStringViewSkipPrefix(&token, "avg10=") ||
+        virStringViewToDouble(&token, &d) < 0 ||
+        d != 0.25) {
+        fprintf(stderr, "Failed to parse 'avg10=0.25'\n");
+        return -1;
+    }
+
+    if (virStringViewNextToken(&rest, " ", &token)) {
+        fprintf(stderr, "Unexpected token '%.*s'\n",
+                (int) token.len, token.str);
+        return -1;
+    }
+
+    return 0;
+}
+
 static int
 mymain(void)
 {
@@ -726,6 +815,28 @@ mymain(void)
     TEST_FILTER_CHARS(NULL, NULL, NULL);
     TEST_FILTER_CHARS("hello 123 hello", "helo", "hellohello");
 
+#define TEST_VIEW_TOKENS(str, dl, res) \
+    do { \
+        struct testViewTokensData viewData = { \
+            .string = str, \
+            .delims = dl, \
+            .result = res, \
+        }; \
+        if (virTestRun("Split view of " #str, \
+                       testStringViewTokens, &viewData) < 0) \
+            ret = -1; \
+    } while (0)
+
+    TEST_VIEW_TOKENS("", " ", NULL);
+    TEST_VIEW_TOKENS("   ", " ", NULL);
+    TEST_VIEW_TOKENS("a", " ", "a|");
+    TEST_VIEW_TOKENS("  a  bc d ", " ", "a|bc|d|");
+    TEST_VIEW_TOKENS("some avg10=0.00\nfull total=0\n", " \n",
+                     "some|avg10=0.00|full|total=0|");
+
+    if (virTestRun("Parse numbers from views", testStringViewNumbers, NULL) < 0)
+        ret = -1;
+
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
@@ -0,0 +1,311 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library;  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "internal.h"
+#include "testutils.h"
+#include "virthread.h"
+#include "virthreadpool.h"
+#include "virtime.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+/* How long to wait for the workers before giving up, in milliseconds */
+#define TEST_TIMEOUT 10000
+
+/* Jobs with a non-NULL data block until the test releases them */
+#define TEST_JOB_BLOCK GINT_TO_POINTER(1)
+
+typedef struct _testState testState;
+struct _testState {
+    virMutex lock;
+    virCond cond;
+    bool release;
+    size_t started;
+    size_t done;
+};
+
+
+static void
+testJob(void *jobdata,
+        void *opaque)
+{
+    testState *state = opaque;
+    VIR_LOCK_GUARD lock = virLockGuardLock(&state->lock);
+
+    state->started++;
+    virCondBroadcast(&state->cond);
+
+    while (jobdata && !state->release)
+        ignore_value(virCondWait(&state->cond, &state->lock));
+
+    state->done++;
+    virCondBroadcast(&state->cond);
+}
+
+
+static int
+testStateInit(testState *state)
+{
+    memset(state, 0, sizeof(*state));
+
+    if (virMutexInit(&state->lock) < 0)
+        return -1;
+
+    if (virCondInit(&state->cond) < 0) {
+        virMutexDestroy(&state->lock);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static void
+testStateRelease(testState *state)
+{
+    VIR_LOCK_GUARD lock = virLockGuardLock(&state->lock);
+
+    state->release = true;
+    virCondBroadcast(&state->cond);
+}
+
+
+static void
+testStateClear(testState *state)
+{
+    virCondDestroy(&state->cond);
+    virMutexDestroy(&state->lock);
+}
+
+
+/* Waits until at least @started jobs started and @done jobs finished */
+static int
+testStateWait(testState *state,
+              size_t started,
+              size_t done)
+{
+    VIR_LOCK_GUARD lock = virLockGuardLock(&state->lock);
+    unsigned long long deadline;
+
+    if (virTimeMillisNow(&deadline) < 0)
+        return -1;
+    deadline += TEST_TIMEOUT;
+
+    while (state->started < started || state->done < done) {
+        if (virCondWaitUntil(&state->cond, &state->lock, deadline) < 0) {
+            VIR_TEST_DEBUG("Started %zu jobs, finished %zu, expected %zu, %zu",
+                           state->started, state->done, started, done);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+static int
+testThreadPoolClasses(const void *opaque G_GNUC_UNUSED)
+{
+    testState state;
+    virThreadPool *pool = NULL;
+    virThreadPoolClassStats *stats = NULL;
+    size_t nstats = 0;
+    int slow;
+    int ret = -1;
+
+    if (testStateInit(&state) < 0)
+        return -1;
+
+    if (!(pool = virThreadPoolNewFull(1, 1, 1, testJob, "test",
+                                      NULL, &state)))
+        goto cleanup;
+
+    if ((slow = virThreadPoolAddClass(pool, "slow", 1, true)) < 0)
+        goto cleanup;
+
+    /* Occupy the only ordinary worker */
+    if (virThreadPoolSendJob(pool, VIR_THREAD_POOL_CLASS_DEFAULT,
+                             TEST_JOB_BLOCK) < 0 ||
+        testStateWait(&state, 1, 0) < 0)
+        goto cleanup;
+
+    /* Both have workers of their own */
+    if (virThreadPoolSendJob(pool, VIR_THREAD_POOL_CLASS_PRIORITY, NULL) < 0 ||
+        virThreadPoolSendJob(pool, slow, NULL) < 0 ||
+        testStateWait(&state, 3, 2) < 0)
+        goto cleanup;
+
+    virThreadPoolGetClassStats(pool, &stats, &nstats);
+
+    if (nstats != 3 ||
+        stats[VIR_THREAD_POOL_CLASS_PRIORITY].jobs != 1 ||
+        stats[slow].jobs != 1 || !stats[slow].exclusive ||
+        stats[slow].workers != 1) {
+        VIR_TEST_DEBUG("Unexpected class stats");
+        goto cleanup;
+    }
+
+    testStateRelease(&state);
+
+    if (testStateWait(&state, 3, 3) < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    testStateRelease(&state);
+    virThreadPoolFree(pool);
+    g_free(stats);
+    testStateClear(&state);
+    return ret;
+}
+
+
+static int
+testThreadPoolGrowth(const void *opaque G_GNUC_UNUSED)
+{
+    testState state;
+    virThreadPool *pool = NULL;
+    size_t i;
+    int ret = -1;
+
+    if (testStateInit(&state) < 0)
+        return -1;
+
+    if (!(pool = virThreadPoolNewFull(0, 4, 0, testJob, "test",
+                                      NULL, &state)))
+        goto cleanup;
+
+    /* A worker is spawned for every job nobody is free to run, up to
+     * the limit */
+    for (i = 0; i < 6; i++) {
+        if (virThreadPoolSendJob(pool, VIR_THREAD_POOL_CLASS_DEFAULT,
+                                 TEST_JOB_BLOCK) < 0)
+            goto cleanup;
+    }
+
+    if (testStateWait(&state, 4, 0) < 0)
+        goto cleanup;
+
+    if (virThreadPoolGetCurrentWorkers(pool) != 4 ||
+        virThreadPoolGetJobQueueDepth(pool) != 2) {
+        VIR_TEST_DEBUG("Expected 4 workers and 2 queued jobs, got %zu and %zu",
+                       virThreadPoolGetCurrentWorkers(pool),
+                       virThreadPoolGetJobQueueDepth(pool));
+        goto cleanup;
+    }
+
+    testStateRelease(&state);
+
+    if (testStateWait(&state, 6, 6) < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    testStateRelease(&state);
+    virThreadPoolFree(pool);
+    testStateClear(&state);
+    return ret;
+}
+
+
+static int
+testThreadPoolRetire(const void *opaque G_GNUC_UNUSED)
+{
+    testState state;
+    virThreadPool *pool = NULL;
+    unsigned long long spawned;
+    unsigned long long retired;
+    unsigned long long deadline;
+    unsigned long long now;
+    size_t i;
+    int ret = -1;
+
+    if (testStateInit(&state) < 0)
+        return -1;
+
+    if (!(pool = virThreadPoolNewFull(1, 4, 0, testJob, "test",
+                                      NULL, &state)))
+        goto cleanup;
+
+    if (virThreadPoolSetParameters(pool, -1, -1, -1, -1, 1) < 0)
+        goto cleanup;
+
+    for (i = 0; i < 4; i++) {
+        if (virThreadPoolSendJob(pool, VIR_THREAD_POOL_CLASS_DEFAULT,
+                                 TEST_JOB_BLOCK) < 0)
+            goto cleanup;
+    }
+
+    if (testStateWait(&state, 4, 0) < 0)
+        goto cleanup;
+
+    testStateRelease(&state);
+
+    if (testStateWait(&state, 4, 4) < 0)
+        goto cleanup;
+
+    /* All but the minimum number of workers exit once idle for long
+     * enough */
+    if (virTimeMillisNow(&deadline) < 0)
+        goto cleanup;
+    deadline += TEST_TIMEOUT;
+
+    while (virThreadPoolGetCurrentWorkers(pool) > 1) {
+        if (virTimeMillisNow(&now) < 0 || now > deadline) {
+            VIR_TEST_DEBUG("%zu workers still running",
+                           virThreadPoolGetCurrentWorkers(pool));
+            goto cleanup;
+        }
+        g_usleep(10 * 1000);
+    }
+
+    virThreadPoolGetWorkerStats(pool, &spawned, &retired);
+
+    if (spawned != 4 || retired != 3) {
+        VIR_TEST_DEBUG("Spawned %llu workers, retired %llu", spawned, retired);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    testStateRelease(&state);
+    virThreadPoolFree(pool);
+    testStateClear(&state);
+    return ret;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+
+    if (virTestRun("Classes", testThreadPoolClasses, NULL) < 0)
+        ret = -1;
+    if (virTestRun("Growth", testThreadPoolGrowth, NULL) < 0)
+        ret = -1;
+    if (virTestRun("Retire", testThreadPoolRetire, NULL) < 0)
+        ret = -1;
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
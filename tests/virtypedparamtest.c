@@ -149,6 +149,33 @@ testTypedParamsAddStringList(const void *opaque G_GNUC_UNUSED)
     return rv;
 }
 
+static int
+testTypedParamListAddParams(const void *opaque G_GNUC_UNUSED)
+{
+    g_autoptr(virTypedParamList) list = g_new0(virTypedParamList, 1);
+    virTypedParameter params[] = {
+        { .field = "foo", .type = VIR_TYPED_PARAM_UINT, .value.ui = 42 },
+        { .field = "bar", .type = VIR_TYPED_PARAM_STRING, .value.s = (char *) "baz" },
+    };
+
+    if (virTypedParamListAddInt(list, 1, "first") < 0)
+        return -1;
+
+    virTypedParamListAddParams(list, params, G_N_ELEMENTS(params));
+
+    if (list->npar != 3 ||
+        STRNEQ(list->par[1].field, "foo") ||
+        list->par[1].type != VIR_TYPED_PARAM_UINT ||
+        list->par[1].value.ui != 42 ||
+        STRNEQ(list->par[2].field, "bar") ||
+        list->par[2].type != VIR_TYPED_PARAM_STRING ||
+        STRNEQ(list->par[2].value.s, "baz") ||
+        list->par[2].value.s == params[1].value.s)
+        return -1;
+
+    return 0;
+}
+
 static int
 testTypedParamsGetStringList(const void *opaque G_GNUC_UNUSED)
 {
@@ -300,6 +327,9 @@ mymain(void)
     if (virTestRun("Add string list", testTypedParamsAddStringList, NULL) < 0)
         rv = -1;
 
+    if (virTestRun("List add params", testTypedParamListAddParams, NULL) < 0)
+        rv = -1;
+
     if (rv < 0)
         return EXIT_FAILURE;
     return EXIT_SUCCESS;
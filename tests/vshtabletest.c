@@ -28,6 +28,7 @@
 #include "internal.h"
 #include "testutils.h"
 #include "viralloc.h"
+#include "virbuffer.h"
 #include "../tools/vsh-table.h"
 
 static int
@@ -317,6 +318,82 @@ testNTables(const void *opaque G_GNUC_UNUSED)
     return 0;
 }
 
+static void
+testVshTableStreamFunc(const char *str,
+                       void *opaque)
+{
+    virBuffer *buf = opaque;
+
+    virBufferAdd(buf, str, -1);
+}
+
+static int
+testVshTableStream(const void *opaque G_GNUC_UNUSED)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    g_autoptr(vshTable) table = NULL;
+    g_autofree char *act = NULL;
+    const char *exp =
+        " Id   Name       State\n"
+        "--------------------------\n"
+        " 1    fedora28   running\n"
+        " 2    rhel7.5    running\n"
+        " 3    centos-stream9   shut off\n"
+        " 4    f\\x07c     running\n";
+
+    table = vshTableNew("Id", "Name", "State", NULL);
+    if (!table)
+        return -1;
+
+    vshTableStream(table, 2, true, testVshTableStreamFunc, &buf);
+
+    vshTableRowAppend(table, "1", "fedora28", "running", NULL);
+    if (virBufferUse(&buf) != 0) {
+        fprintf(stderr, "rows printed before the sample was complete\n");
+        return -1;
+    }
+
+    vshTableRowAppend(table, "2", "rhel7.5", "running", NULL);
+    vshTableRowAppend(table, "3", "centos-stream9", "shut off", NULL);
+    vshTableRowAppend(table, "4", "f\ac", "running", NULL);
+    vshTableStreamEnd(table);
+
+    act = virBufferContentAndReset(&buf);
+
+    if (virTestCompareToString(exp, act) < 0)
+        return -1;
+
+    return 0;
+}
+
+static int
+testVshTableRepeatedPrint(const void *opaque G_GNUC_UNUSED)
+{
+    g_autoptr(vshTable) table = NULL;
+    g_autofree char *act1 = NULL;
+    g_autofree char *act2 = NULL;
+    const char *exp =
+        " Id   Name\n"
+        "--------------------\n"
+        " 1    f\\x07edora28\n";
+
+    table = vshTableNew("Id", "Name", NULL);
+    if (!table)
+        return -1;
+
+    vshTableRowAppend(table, "1", "f\aedora28", NULL);
+
+    /* the cells must not be encoded again */
+    act1 = vshTablePrintToString(table, true);
+    act2 = vshTablePrintToString(table, true);
+
+    if (virTestCompareToString(exp, act1) < 0 ||
+        virTestCompareToString(exp, act2) < 0)
+        return -1;
+
+    return 0;
+}
+
 static int
 mymain(void)
 {
@@ -358,6 +435,14 @@ mymain(void)
     if (virTestRun("testNTables", testNTables, NULL) < 0)
         ret = -1;
 
+    if (virTestRun("testVshTableStream", testVshTableStream, NULL) < 0)
+        ret = -1;
+
+    if (virTestRun("testVshTableRepeatedPrint",
+                   testVshTableRepeatedPrint,
+                   NULL) < 0)
+        ret = -1;
+
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
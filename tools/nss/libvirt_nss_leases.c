@@ -21,16 +21,20 @@
 #include <config.h>
 
 #include <unistd.h>
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include <yajl/yajl_gen.h>
 #include <yajl/yajl_parse.h>
 
 #include "libvirt_nss_leases.h"
 #include "libvirt_nss.h"
+#include "virleaseindex.h"
 
 enum {
     FIND_LEASES_STATE_START,
@@ -343,6 +347,265 @@ findLeasesParserEndArray(void *ctx)
 }
 
 
+typedef struct {
+    const char *base;
+    size_t nentries;
+    const virLeaseIndexEntry *entries;
+    const uint32_t *bymac;
+    const char *strings;
+    size_t nstrings;
+} leaseIndex;
+
+
+static const char *
+leaseIndexString(const leaseIndex *idx,
+                 uint32_t offset)
+{
+    /* The string table is checked to end with NUL when opening */
+    if (offset >= idx->nstrings)
+        return NULL;
+
+    return idx->strings + offset;
+}
+
+
+/* Same ordering as g_ascii_strcasecmp() used when writing the index */
+static int
+leaseIndexCaseCmp(const char *a,
+                  const char *b)
+{
+    for (; *a && *b; a++, b++) {
+        int ca = (unsigned char) *a;
+        int cb = (unsigned char) *b;
+
+        if (ca >= 'A' && ca <= 'Z')
+            ca += 'a' - 'A';
+        if (cb >= 'A' && cb <= 'Z')
+            cb += 'a' - 'A';
+        if (ca != cb)
+            return ca - cb;
+    }
+
+    return (unsigned char) *a - (unsigned char) *b;
+}
+
+
+static int
+leaseIndexAppend(const leaseIndex *idx,
+                 const virLeaseIndexEntry *entry,
+                 const char *name,
+                 int af,
+                 time_t now,
+                 leaseAddress **addrs,
+                 size_t *naddrs,
+                 bool *found)
+{
+    const char *ipaddr = leaseIndexString(idx, entry->ipaddr);
+
+    if (entry->expiry != 0 && entry->expiry < now) {
+        DEBUG("Entry expired at %lld vs now %lld",
+              (long long) entry->expiry, (long long) now);
+        return 0;
+    }
+    if (!ipaddr)
+        return 0;
+
+    *found = true;
+
+    return appendAddr(name, addrs, naddrs, ipaddr, entry->expiry, af);
+}
+
+
+static int
+leaseIndexFindName(const leaseIndex *idx,
+                   const char *name,
+                   int af,
+                   time_t now,
+                   leaseAddress **addrs,
+                   size_t *naddrs,
+                   bool *found)
+{
+    size_t lo = 0;
+    size_t hi = idx->nentries;
+
+    /* Find the first entry not sorting before @name */
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        const char *hostname = leaseIndexString(idx, idx->entries[mid].hostname);
+
+        if (leaseIndexCaseCmp(hostname ? hostname : "", name) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    for (; lo < idx->nentries; lo++) {
+        const virLeaseIndexEntry *entry = idx->entries + lo;
+        const char *hostname = leaseIndexString(idx, entry->hostname);
+
+        if (!hostname || leaseIndexCaseCmp(hostname, name) != 0)
+            break;
+
+        DEBUG("Found name '%s'", hostname);
+        if (leaseIndexAppend(idx, entry, name, af, now,
+                             addrs, naddrs, found) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+leaseIndexFindMAC(const leaseIndex *idx,
+                  const char *name,
+                  const char *mac,
+                  int af,
+                  time_t now,
+                  leaseAddress **addrs,
+                  size_t *naddrs,
+                  bool *found)
+{
+    size_t lo = 0;
+    size_t hi = idx->nentries;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        const virLeaseIndexEntry *entry = idx->entries + idx->bymac[mid];
+        const char *macaddr = leaseIndexString(idx, entry->macaddr);
+
+        if (!macaddr || strcmp(macaddr, mac) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    for (; lo < idx->nentries; lo++) {
+        const virLeaseIndexEntry *entry = idx->entries + idx->bymac[lo];
+        const char *macaddr = leaseIndexString(idx, entry->macaddr);
+
+        if (!macaddr || strcmp(macaddr, mac) != 0)
+            break;
+
+        DEBUG("Found mac '%s'", macaddr);
+        if (leaseIndexAppend(idx, entry, name, af, now,
+                             addrs, naddrs, found) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+/*
+ * Look the leases up in the index of @file written by the leaseshelper.
+ * Returns 1 if the index was used, 0 if it is missing, stale or
+ * malformed, and -1 on error.
+ */
+static int
+findLeasesIndex(const char *file,
+                int leasesfd,
+                const char *name,
+                char **macs,
+                size_t nmacs,
+                int af,
+                time_t now,
+                leaseAddress **addrs,
+                size_t *naddrs,
+                bool *found)
+{
+    char *path = NULL;
+    int fd = -1;
+    struct stat leasesst;
+    struct stat st;
+    void *map = MAP_FAILED;
+    const virLeaseIndexHeader *header;
+    leaseIndex idx = { 0 };
+    size_t i;
+    int ret = 0;
+
+    if (asprintf(&path, "%s" VIR_LEASE_INDEX_SUFFIX, file) < 0) {
+        path = NULL;
+        goto cleanup;
+    }
+
+    if ((fd = open(path, O_RDONLY)) < 0) {
+        DEBUG("No index %s", path);
+        goto cleanup;
+    }
+
+    if (fstat(leasesfd, &leasesst) < 0 ||
+        fstat(fd, &st) < 0 ||
+        st.st_size < (off_t) sizeof(*header))
+        goto cleanup;
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED)
+        goto cleanup;
+
+    header = map;
+    if (memcmp(header->magic, VIR_LEASE_INDEX_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != VIR_LEASE_INDEX_VERSION) {
+        DEBUG("Unknown format of index %s", path);
+        goto cleanup;
+    }
+
+    if (header->leasesIno != (uint64_t) leasesst.st_ino ||
+        header->leasesSize != (uint64_t) leasesst.st_size ||
+        header->leasesMtime != (int64_t) leasesst.st_mtime) {
+        DEBUG("Index %s is stale", path);
+        goto cleanup;
+    }
+
+    idx.base = map;
+    idx.nentries = header->nentries;
+    if (idx.nentries > (st.st_size - sizeof(*header)) /
+        (sizeof(*idx.entries) + sizeof(*idx.bymac)))
+        goto cleanup;
+
+    idx.entries = (const virLeaseIndexEntry *)(idx.base + sizeof(*header));
+    idx.bymac = (const uint32_t *)(idx.entries + idx.nentries);
+    idx.strings = (const char *)(idx.bymac + idx.nentries);
+    idx.nstrings = idx.base + st.st_size - idx.strings;
+
+    if (idx.nstrings > 0 && idx.strings[idx.nstrings - 1] != '\0')
+        goto cleanup;
+
+    for (i = 0; i < idx.nentries; i++) {
+        if (idx.bymac[i] >= idx.nentries)
+            goto cleanup;
+    }
+
+    DEBUG("Using index %s with %zu entries", path, idx.nentries);
+
+    if (nmacs) {
+        for (i = 0; i < nmacs; i++) {
+            if (leaseIndexFindMAC(&idx, name, macs[i], af, now,
+                                  addrs, naddrs, found) < 0) {
+                ret = -1;
+                goto cleanup;
+            }
+        }
+    } else {
+        if (leaseIndexFindName(&idx, name, af, now,
+                               addrs, naddrs, found) < 0) {
+            ret = -1;
+            goto cleanup;
+        }
+    }
+
+    ret = 1;
+
+ cleanup:
+    if (map != MAP_FAILED)
+        munmap(map, st.st_size);
+    if (fd != -1)
+        close(fd);
+    free(path);
+    return ret;
+}
+
+
 int
 findLeases(const char *file,
            const char *name,
@@ -389,6 +652,13 @@ findLeases(const char *file,
         goto cleanup;
     }
 
+    if ((rv = findLeasesIndex(file, fd, name, macs, nmacs, af, now,
+                              addrs, naddrs, found)) != 0) {
+        if (rv > 0)
+            ret = 0;
+        goto cleanup;
+    }
+
     parser = yajl_alloc(&parserCallbacks, NULL, &parserState);
     if (!parser) {
         ERROR("Unable to create JSON parser");
@@ -28,6 +28,7 @@
 #include "internal.h"
 #include "conf/virdomainobjlist.h"
 #include "viralloc.h"
+#include "virjson.h"
 #include "virmacaddr.h"
 #include "virxml.h"
 #include "virstring.h"
@@ -1932,6 +1933,8 @@ cmdList(vshControl *ctl, const vshCmd *cmd)
 
         if (!table)
             goto cleanup;
+
+        vshTableStreamToStdout(table, ctl, VSH_TABLE_STREAM_SAMPLE);
     }
 
     for (i = 0; i < list->ndomains; i++) {
@@ -2064,6 +2067,26 @@ static const vshCmdOptDef opts_domstats[] = {
      .type = VSH_OT_BOOL,
      .help = N_("report domain dirty rate information"),
     },
+    {.name = "job",
+     .type = VSH_OT_BOOL,
+     .help = N_("report progress of the active domain job"),
+    },
+    {.name = "start",
+     .type = VSH_OT_BOOL,
+     .help = N_("report time spent starting the domain"),
+    },
+    {.name = "pressure",
+     .type = VSH_OT_BOOL,
+     .help = N_("report pressure stall information of the domain"),
+    },
+    {.name = "job-lock",
+     .type = VSH_OT_BOOL,
+     .help = N_("report contention of domain jobs"),
+    },
+    {.name = "daemon-memory",
+     .type = VSH_OT_BOOL,
+     .help = N_("report memory the daemon uses for the domain"),
+    },
     {.name = "list-active",
      .type = VSH_OT_BOOL,
      .help = N_("list only active domains"),
@@ -2112,34 +2135,464 @@ static const vshCmdOptDef opts_domstats[] = {
      .type = VSH_OT_BOOL,
      .help = N_("report only stats that are accessible instantly"),
     },
+    {.name = "cached",
+     .type = VSH_OT_BOOL,
+     .help = N_("accept recently cached stats"),
+    },
+    {.name = "format",
+     .type = VSH_OT_STRING,
+     .help = N_("output format: text, json or prometheus"),
+    },
+    {.name = "interval",
+     .type = VSH_OT_INT,
+     .help = N_("sample the stats repeatedly every given number of seconds"),
+    },
+    {.name = "page-size",
+     .type = VSH_OT_INT,
+     .help = N_("fetch the stats of this many domains at a time"),
+    },
     VIRSH_COMMON_OPT_DOMAIN_OT_ARGV(N_("list of domains to get stats for"), 0),
     {.name = NULL}
 };
 
 
+typedef enum {
+    VIRSH_DOMAIN_STATS_FORMAT_TEXT,
+    VIRSH_DOMAIN_STATS_FORMAT_JSON,
+    VIRSH_DOMAIN_STATS_FORMAT_PROMETHEUS,
+
+    VIRSH_DOMAIN_STATS_FORMAT_LAST
+} virshDomainStatsFormat;
+
+VIR_ENUM_DECL(virshDomainStatsFormat);
+VIR_ENUM_IMPL(virshDomainStatsFormat,
+              VIRSH_DOMAIN_STATS_FORMAT_LAST,
+              "text",
+              "json",
+              "prometheus",
+);
+
+
+/*
+ * Records are printed one by one as they are fetched, all of them through
+ * the same buffer so that sampling repeatedly doesn't allocate the output
+ * over and over. The Prometheus exposition format needs all samples of a
+ * metric grouped together though, so the lines of each metric are gathered
+ * in a buffer of their own and printed once all records of the sample are
+ * processed.
+ */
+typedef struct _virshDomainStatsPrinter virshDomainStatsPrinter;
+struct _virshDomainStatsPrinter {
+    virshDomainStatsFormat format;
+    bool raw;
+    size_t nrecords;
+
+    virBuffer buf;
+
+    GHashTable *metrics; /* metric name -> virBuffer with its lines */
+    GPtrArray *metricNames; /* in the order of first appearance */
+};
+
+
+static void
+virshDomainStatsMetricFree(void *opaque)
+{
+    virBuffer *buf = opaque;
+
+    virBufferFreeAndReset(buf);
+    g_free(buf);
+}
+
+
+static void
+virshDomainStatsPrinterInit(virshDomainStatsPrinter *printer,
+                            virshDomainStatsFormat format,
+                            bool raw)
+{
+    printer->format = format;
+    printer->raw = raw;
+
+    if (format == VIRSH_DOMAIN_STATS_FORMAT_PROMETHEUS) {
+        printer->metrics = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                                 g_free,
+                                                 virshDomainStatsMetricFree);
+        printer->metricNames = g_ptr_array_new();
+    }
+}
+
+
+static void
+virshDomainStatsPrinterClear(virshDomainStatsPrinter *printer)
+{
+    virBufferFreeAndReset(&printer->buf);
+    g_clear_pointer(&printer->metricNames, g_ptr_array_unref);
+    g_clear_pointer(&printer->metrics, g_hash_table_unref);
+}
+
+
+/* Prints and empties @buf, keeping its memory for the next use */
+static void
+virshDomainStatsPrinterFlush(vshControl *ctl,
+                             virBuffer *buf)
+{
+    if (virBufferUse(buf) == 0)
+        return;
+
+    vshPrint(ctl, "%s", virBufferCurrentContent(buf));
+    virBufferTrimLen(buf, virBufferUse(buf));
+}
+
+
 static bool
-virshDomainStatsPrintRecord(vshControl *ctl G_GNUC_UNUSED,
-                            virDomainStatsRecordPtr record,
-                            bool raw G_GNUC_UNUSED)
+virshDomainStatsPrintRecordText(vshControl *ctl,
+                                virshDomainStatsPrinter *printer,
+                                virDomainStatsRecordPtr record)
 {
     size_t i;
 
-    vshPrint(ctl, "Domain: '%s'\n", virDomainGetName(record->dom));
-
     /* XXX: Implement pretty-printing */
 
+    if (printer->nrecords > 0)
+        virBufferAddChar(&printer->buf, '\n');
+
+    virBufferAsprintf(&printer->buf, "Domain: '%s'\n",
+                      virDomainGetName(record->dom));
+
     for (i = 0; i < record->nparams; i++) {
         g_autofree char *param = NULL;
 
         if (!(param = vshGetTypedParamValue(ctl, record->params + i)))
             return false;
 
-        vshPrint(ctl, "  %s=%s\n", record->params[i].field, param);
+        virBufferAsprintf(&printer->buf, "  %s=%s\n",
+                          record->params[i].field, param);
+    }
+
+    return true;
+}
+
+
+static bool
+virshDomainStatsPrintRecordJSON(virshDomainStatsPrinter *printer,
+                                virDomainStatsRecordPtr record)
+{
+    g_autoptr(virJSONValue) obj = virJSONValueNewObject();
+    g_autoptr(virJSONValue) stats = virJSONValueNewObject();
+    size_t i;
+
+    for (i = 0; i < record->nparams; i++) {
+        virTypedParameterPtr param = record->params + i;
+        int rc = -1;
+
+        switch ((virTypedParameterType) param->type) {
+        case VIR_TYPED_PARAM_INT:
+            rc = virJSONValueObjectAppendNumberInt(stats, param->field,
+                                                   param->value.i);
+            break;
+        case VIR_TYPED_PARAM_UINT:
+            rc = virJSONValueObjectAppendNumberUint(stats, param->field,
+                                                    param->value.ui);
+            break;
+        case VIR_TYPED_PARAM_LLONG:
+            rc = virJSONValueObjectAppendNumberLong(stats, param->field,
+                                                    param->value.l);
+            break;
+        case VIR_TYPED_PARAM_ULLONG:
+            rc = virJSONValueObjectAppendNumberUlong(stats, param->field,
+                                                     param->value.ul);
+            break;
+        case VIR_TYPED_PARAM_DOUBLE:
+            rc = virJSONValueObjectAppendNumberDouble(stats, param->field,
+                                                      param->value.d);
+            break;
+        case VIR_TYPED_PARAM_BOOLEAN:
+            rc = virJSONValueObjectAppendBoolean(stats, param->field,
+                                                 param->value.b);
+            break;
+        case VIR_TYPED_PARAM_STRING:
+            rc = virJSONValueObjectAppendString(stats, param->field,
+                                                param->value.s);
+            break;
+        case VIR_TYPED_PARAM_LAST:
+        default:
+            break;
+        }
+
+        if (rc < 0)
+            return false;
     }
 
+    if (virJSONValueObjectAppendString(obj, "domain",
+                                       virDomainGetName(record->dom)) < 0 ||
+        virJSONValueObjectAppend(obj, "stats", &stats) < 0)
+        return false;
+
+    if (virJSONValueToBuffer(obj, &printer->buf, false) < 0)
+        return false;
+
+    virBufferAddChar(&printer->buf, '\n');
+
     return true;
 }
 
+
+static void
+virshDomainStatsEscapeLabel(virBuffer *buf,
+                            const char *value)
+{
+    for (; *value; value++) {
+        switch (*value) {
+        case '\\':
+            virBufferAddLit(buf, "\\\\");
+            break;
+        case '"':
+            virBufferAddLit(buf, "\\\"");
+            break;
+        case '\n':
+            virBufferAddLit(buf, "\\n");
+            break;
+        default:
+            virBufferAddChar(buf, *value);
+        }
+    }
+}
+
+
+static bool
+virshDomainStatsIsIndex(const char *part)
+{
+    return *part && strspn(part, "0123456789") == strlen(part);
+}
+
+
+static void
+virshDomainStatsAddMetricName(virBuffer *buf,
+                              const char *part)
+{
+    for (; *part; part++) {
+        if (g_ascii_isalnum(*part) || *part == '_')
+            virBufferAddChar(buf, *part);
+        else
+            virBufferAddChar(buf, '_');
+    }
+}
+
+
+/*
+ * Turns a stats field into a metric name and labels. Numeric components of
+ * the field are the indexes of devices and become labels named after the
+ * component preceding them, e.g. 'block.1.rd.bytes' of domain 'vm' becomes
+ * 'libvirt_domain_block_rd_bytes{domain="vm",block="1"}'. String fields,
+ * such as device names, are not metrics and are left out.
+ */
+static void
+virshDomainStatsPrintParamPrometheus(virshDomainStatsPrinter *printer,
+                                     const char *domname,
+                                     virTypedParameterPtr param)
+{
+    g_auto(GStrv) parts = NULL;
+    virBuffer *metric;
+    const char *name;
+    const char *label = "index";
+    size_t i;
+
+    if (param->type == VIR_TYPED_PARAM_STRING)
+        return;
+
+    parts = g_strsplit(param->field, ".", 0);
+
+    virBufferAddLit(&printer->buf, "libvirt_domain");
+    for (i = 0; parts[i]; i++) {
+        if (virshDomainStatsIsIndex(parts[i]))
+            continue;
+
+        virBufferAddChar(&printer->buf, '_');
+        virshDomainStatsAddMetricName(&printer->buf, parts[i]);
+    }
+
+    name = virBufferCurrentContent(&printer->buf);
+    if (!(metric = g_hash_table_lookup(printer->metrics, name))) {
+        char *key = g_strdup(name);
+
+        metric = g_new0(virBuffer, 1);
+        g_hash_table_insert(printer->metrics, key, metric);
+        g_ptr_array_add(printer->metricNames, key);
+    }
+
+    virBufferAdd(metric, name, -1);
+    virBufferAddLit(metric, "{domain=\"");
+    virshDomainStatsEscapeLabel(metric, domname);
+    virBufferAddChar(metric, '"');
+
+    for (i = 0; parts[i]; i++) {
+        if (!virshDomainStatsIsIndex(parts[i])) {
+            label = parts[i];
+            continue;
+        }
+
+        virBufferAddChar(metric, ',');
+        virshDomainStatsAddMetricName(metric, label);
+        virBufferAsprintf(metric, "=\"%s\"", parts[i]);
+    }
+
+    virBufferAddLit(metric, "} ");
+
+    switch ((virTypedParameterType) param->type) {
+    case VIR_TYPED_PARAM_INT:
+        virBufferAsprintf(metric, "%d\n", param->value.i);
+        break;
+    case VIR_TYPED_PARAM_UINT:
+        virBufferAsprintf(metric, "%u\n", param->value.ui);
+        break;
+    case VIR_TYPED_PARAM_LLONG:
+        virBufferAsprintf(metric, "%lld\n", param->value.l);
+        break;
+    case VIR_TYPED_PARAM_ULLONG:
+        virBufferAsprintf(metric, "%llu\n", param->value.ul);
+        break;
+    case VIR_TYPED_PARAM_DOUBLE: {
+        char num[G_ASCII_DTOSTR_BUF_SIZE];
+
+        virBufferAsprintf(metric, "%s\n",
+                          g_ascii_dtostr(num, sizeof(num), param->value.d));
+        break;
+    }
+    case VIR_TYPED_PARAM_BOOLEAN:
+        virBufferAsprintf(metric, "%d\n", param->value.b ? 1 : 0);
+        break;
+    case VIR_TYPED_PARAM_STRING:
+    case VIR_TYPED_PARAM_LAST:
+    default:
+        break;
+    }
+
+    virBufferTrimLen(&printer->buf, virBufferUse(&printer->buf));
+}
+
+
+static bool
+virshDomainStatsPrintRecord(vshControl *ctl,
+                            virshDomainStatsPrinter *printer,
+                            virDomainStatsRecordPtr record)
+{
+    size_t i;
+
+    switch (printer->format) {
+    case VIRSH_DOMAIN_STATS_FORMAT_TEXT:
+        if (!virshDomainStatsPrintRecordText(ctl, printer, record))
+            return false;
+        break;
+
+    case VIRSH_DOMAIN_STATS_FORMAT_JSON:
+        if (!virshDomainStatsPrintRecordJSON(printer, record))
+            return false;
+        break;
+
+    case VIRSH_DOMAIN_STATS_FORMAT_PROMETHEUS:
+        for (i = 0; i < record->nparams; i++)
+            virshDomainStatsPrintParamPrometheus(printer,
+                                                 virDomainGetName(record->dom),
+                                                 record->params + i);
+        break;
+
+    case VIRSH_DOMAIN_STATS_FORMAT_LAST:
+        break;
+    }
+
+    printer->nrecords++;
+    virshDomainStatsPrinterFlush(ctl, &printer->buf);
+
+    return true;
+}
+
+
+static void
+virshDomainStatsPrintSampleEnd(vshControl *ctl,
+                               virshDomainStatsPrinter *printer)
+{
+    size_t i;
+
+    if (printer->format != VIRSH_DOMAIN_STATS_FORMAT_PROMETHEUS)
+        return;
+
+    for (i = 0; i < printer->metricNames->len; i++) {
+        virBuffer *metric = g_hash_table_lookup(printer->metrics,
+                                                printer->metricNames->pdata[i]);
+
+        virshDomainStatsPrinterFlush(ctl, metric);
+    }
+}
+
+
+static bool
+virshDomainStatsPrintRecords(vshControl *ctl,
+                             virshDomainStatsPrinter *printer,
+                             virDomainStatsRecordPtr *records)
+{
+    virDomainStatsRecordPtr *next;
+
+    for (next = records; *next; next++) {
+        if (!virshDomainStatsPrintRecord(ctl, printer, *next))
+            return false;
+    }
+
+    return true;
+}
+
+
+/* Fetches the stats of all the matching domains a page at a time, so that
+ * neither the daemon nor virsh have to hold the whole set at once. */
+static bool
+virshDomainStatsCollectPaged(vshControl *ctl,
+                             virshDomainStatsPrinter *printer,
+                             unsigned int stats,
+                             unsigned int pageSize,
+                             unsigned int flags)
+{
+    virshControl *priv = ctl->privData;
+    g_autofree char *cursor = NULL;
+
+    do {
+        virTypedParameterPtr params = NULL;
+        int nparams = 0;
+        int maxparams = 0;
+        virDomainStatsRecordPtr *records = NULL;
+        char *next = NULL;
+        bool ok;
+
+        if (virTypedParamsAddUInt(&params, &nparams, &maxparams,
+                                  VIR_CONNECT_LIST_DOMAINS_PAGE_LIMIT,
+                                  pageSize) < 0 ||
+            virTypedParamsAddUInt(&params, &nparams, &maxparams,
+                                  VIR_CONNECT_LIST_DOMAINS_PAGE_STATS,
+                                  stats) < 0 ||
+            (cursor &&
+             virTypedParamsAddString(&params, &nparams, &maxparams,
+                                     VIR_CONNECT_LIST_DOMAINS_PAGE_CURSOR,
+                                     cursor) < 0)) {
+            virTypedParamsFree(params, nparams);
+            return false;
+        }
+
+        ok = virConnectListDomainsPage(priv->conn, params, nparams,
+                                       &records, &next, flags) >= 0;
+        virTypedParamsFree(params, nparams);
+
+        if (ok)
+            ok = virshDomainStatsPrintRecords(ctl, printer, records);
+
+        virDomainStatsRecordListFree(records);
+        g_free(cursor);
+        cursor = next;
+
+        if (!ok)
+            return false;
+    } while (cursor);
+
+    return true;
+}
+
+
 static bool
 cmdDomstats(vshControl *ctl, const vshCmd *cmd)
 {
@@ -2148,13 +2601,23 @@ cmdDomstats(vshControl *ctl, const vshCmd *cmd)
     virDomainPtr dom;
     size_t ndoms = 0;
     virDomainStatsRecordPtr *records = NULL;
-    virDomainStatsRecordPtr *next;
     bool raw = vshCommandOptBool(cmd, "raw");
     int flags = 0;
     const vshCmdOpt *opt = NULL;
+    const char *formatStr = NULL;
+    int format = VIRSH_DOMAIN_STATS_FORMAT_TEXT;
+    int interval = 0;
+    unsigned int pageSize = 0;
+    virshDomainStatsPrinter printer = { 0 };
+    bool eventStarted = false;
     bool ret = false;
     virshControl *priv = ctl->privData;
 
+    VSH_EXCLUSIVE_OPTIONS("page-size", "domain");
+    VSH_EXCLUSIVE_OPTIONS("page-size", "enforce");
+    VSH_EXCLUSIVE_OPTIONS("page-size", "backing");
+    VSH_EXCLUSIVE_OPTIONS("page-size", "cached");
+
     if (vshCommandOptBool(cmd, "state"))
         stats |= VIR_DOMAIN_STATS_STATE;
 
@@ -2185,6 +2648,21 @@ cmdDomstats(vshControl *ctl, const vshCmd *cmd)
     if (vshCommandOptBool(cmd, "dirtyrate"))
         stats |= VIR_DOMAIN_STATS_DIRTYRATE;
 
+    if (vshCommandOptBool(cmd, "job"))
+        stats |= VIR_DOMAIN_STATS_JOB;
+
+    if (vshCommandOptBool(cmd, "start"))
+        stats |= VIR_DOMAIN_STATS_START;
+
+    if (vshCommandOptBool(cmd, "pressure"))
+        stats |= VIR_DOMAIN_STATS_PRESSURE;
+
+    if (vshCommandOptBool(cmd, "job-lock"))
+        stats |= VIR_DOMAIN_STATS_JOB_LOCK;
+
+    if (vshCommandOptBool(cmd, "daemon-memory"))
+        stats |= VIR_DOMAIN_STATS_DAEMON_MEMORY;
+
     if (vshCommandOptBool(cmd, "list-active"))
         flags |= VIR_CONNECT_GET_ALL_DOMAINS_STATS_ACTIVE;
 
@@ -2218,6 +2696,29 @@ cmdDomstats(vshControl *ctl, const vshCmd *cmd)
     if (vshCommandOptBool(cmd, "nowait"))
         flags |= VIR_CONNECT_GET_ALL_DOMAINS_STATS_NOWAIT;
 
+    if (vshCommandOptBool(cmd, "cached"))
+        flags |= VIR_CONNECT_GET_ALL_DOMAINS_STATS_CACHED;
+
+    if (vshCommandOptStringReq(ctl, cmd, "format", &formatStr) < 0)
+        return false;
+
+    if (formatStr &&
+        (format = virshDomainStatsFormatTypeFromString(formatStr)) < 0) {
+        vshError(ctl, _("Invalid output format '%s'"), formatStr);
+        return false;
+    }
+
+    if (vshCommandOptInt(ctl, cmd, "interval", &interval) < 0)
+        return false;
+
+    if (interval < 0 || interval > INT_MAX / 1000) {
+        vshError(ctl, _("Invalid interval '%d'"), interval);
+        return false;
+    }
+
+    if (vshCommandOptUInt(ctl, cmd, "page-size", &pageSize) < 0)
+        return false;
+
     if (vshCommandOptBool(cmd, "domain")) {
         domlist = g_new0(virDomainPtr, 1);
         ndoms = 1;
@@ -2231,31 +2732,59 @@ cmdDomstats(vshControl *ctl, const vshCmd *cmd)
             if (VIR_INSERT_ELEMENT(domlist, ndoms - 1, ndoms, dom) < 0)
                 goto cleanup;
         }
+    }
 
-        if (virDomainListGetStats(domlist,
-                                  stats,
-                                  &records,
-                                  flags) < 0)
+    virshDomainStatsPrinterInit(&printer, format, raw);
+
+    if (interval > 0) {
+        if (vshEventStart(ctl, interval * 1000) < 0)
             goto cleanup;
-    } else {
-       if ((virConnectGetAllDomainStats(priv->conn,
-                                        stats,
-                                        &records,
-                                        flags)) < 0)
-           goto cleanup;
+        eventStarted = true;
     }
 
-    next = records;
-    while (*next) {
-        if (!virshDomainStatsPrintRecord(ctl, *next, raw))
-            goto cleanup;
+    while (true) {
+        if (pageSize > 0) {
+            if (!virshDomainStatsCollectPaged(ctl, &printer, stats, pageSize,
+                                              flags))
+                goto cleanup;
+        } else {
+            if (domlist) {
+                if (virDomainListGetStats(domlist, stats, &records, flags) < 0)
+                    goto cleanup;
+            } else {
+                if (virConnectGetAllDomainStats(priv->conn, stats,
+                                                &records, flags) < 0)
+                    goto cleanup;
+            }
 
-        if (*(++next))
-            vshPrint(ctl, "\n");
+            if (!virshDomainStatsPrintRecords(ctl, &printer, records))
+                goto cleanup;
+
+            g_clear_pointer(&records, virDomainStatsRecordListFree);
+        }
+
+        virshDomainStatsPrintSampleEnd(ctl, &printer);
+
+        if (interval == 0)
+            break;
+
+        switch (vshEventWait(ctl)) {
+        case VSH_EVENT_INTERRUPT:
+            ret = true;
+            goto cleanup;
+        case VSH_EVENT_TIMEOUT:
+        case VSH_EVENT_DONE:
+            break;
+        default:
+            goto cleanup;
+        }
     }
 
     ret = true;
  cleanup:
+    if (eventStarted)
+        vshEventCleanup(ctl);
+    virshDomainStatsPrinterClear(&printer);
     virDomainStatsRecordListFree(records);
     virObjectListFree(domlist);
 
@@ -2409,7 +2938,7 @@ const vshCmdDef domMonitoringCmds[] = {
      .handler = cmdDomblklist,
      .opts = opts_domblklist,
      .info = info_domblklist,
-     .flags = 0
+     .flags = VSH_CMD_FLAG_PARALLEL
     },
     {.name = "domblkstat",
      .handler = cmdDomblkstat,
@@ -2421,7 +2950,7 @@ const vshCmdDef domMonitoringCmds[] = {
      .handler = cmdDomControl,
      .opts = opts_domcontrol,
      .info = info_domcontrol,
-     .flags = 0
+     .flags = VSH_CMD_FLAG_PARALLEL
     },
     {.name = "domif-getlink",
      .handler = cmdDomIfGetLink,
@@ -2433,13 +2962,13 @@ const vshCmdDef domMonitoringCmds[] = {
      .handler = cmdDomIfAddr,
      .opts = opts_domifaddr,
      .info = info_domifaddr,
-     .flags = 0
+     .flags = VSH_CMD_FLAG_PARALLEL
     },
     {.name = "domiflist",
      .handler = cmdDomiflist,
      .opts = opts_domiflist,
      .info = info_domiflist,
-     .flags = 0
+     .flags = VSH_CMD_FLAG_PARALLEL
     },
     {.name = "domifstat",
      .handler = cmdDomIfstat,
@@ -2451,7 +2980,7 @@ const vshCmdDef domMonitoringCmds[] = {
      .handler = cmdDominfo,
      .opts = opts_dominfo,
      .info = info_dominfo,
-     .flags = 0
+     .flags = VSH_CMD_FLAG_PARALLEL
     },
     {.name = "dommemstat",
      .handler = cmdDomMemStat,
@@ -2463,7 +2992,7 @@ const vshCmdDef domMonitoringCmds[] = {
      .handler = cmdDomstate,
      .opts = opts_domstate,
      .info = info_domstate,
-     .flags = 0
+     .flags = VSH_CMD_FLAG_PARALLEL
     },
     {.name = "domstats",
      .handler = cmdDomstats,
@@ -5930,6 +5930,460 @@ cmdShutdown(vshControl *ctl, const vshCmd *cmd)
     return true;
 }
 
+/*
+ * "drain" command
+ */
+static const vshCmdInfo info_drain[] = {
+    {.name = "help",
+     .data = N_("shut down or save a set of domains")
+    },
+    {.name = "desc",
+     .data = N_("Gracefully shut down running domains, or save their state "
+                "with managed save, handling a limited number of domains at "
+                "once in the order of their priority.")
+    },
+    {.name = NULL}
+};
+
+static const vshCmdOptDef opts_drain[] = {
+    {.name = "managedsave",
+     .type = VSH_OT_BOOL,
+     .help = N_("save the state of domains instead of shutting them down")
+    },
+    {.name = "bypass-cache",
+     .type = VSH_OT_BOOL,
+     .help = N_("avoid file system cache when saving")
+    },
+    {.name = "max-parallel",
+     .type = VSH_OT_INT,
+     .help = N_("maximum number of domains handled at once (default 1)")
+    },
+    {.name = "timeout",
+     .type = VSH_OT_INT,
+     .help = N_("seconds to wait for each domain, 0 for no limit (default)")
+    },
+    {.name = "domains",
+     .type = VSH_OT_ARGV,
+     .completer = virshDomainNameCompleter,
+     .completer_flags = VIR_CONNECT_LIST_DOMAINS_ACTIVE,
+     .help = N_("list of domains, optionally followed by ',priority=N' and "
+                "',timeout=SECONDS' (default: all running domains)")
+    },
+    {.name = NULL}
+};
+
+typedef enum {
+    VIRSH_DRAIN_PENDING = 0,
+    VIRSH_DRAIN_RUNNING,
+    VIRSH_DRAIN_DONE,
+} virshDrainState;
+
+typedef struct _virshDrainJob virshDrainJob;
+struct _virshDrainJob {
+    vshControl *ctl;
+    virDomainPtr dom;
+    unsigned char uuid[VIR_UUID_BUFLEN];
+    int priority;
+    size_t order;
+    unsigned int timeout; /* seconds, 0 for no limit */
+    gint64 deadline; /* monotonic time in microseconds */
+    unsigned int flags;
+
+    virThread thread;
+    bool haveThread;
+    bool aborted;
+    virshDrainState state;
+    int finished; /* set by the worker thread or the lifecycle callback,
+                   * accessed atomically */
+    int ret;
+    char *error;
+};
+
+typedef struct _virshDrainData virshDrainData;
+struct _virshDrainData {
+    vshControl *ctl;
+    virshDrainJob *jobs;
+    size_t njobs;
+};
+
+static void
+virshDrainManagedSave(void *opaque)
+{
+    virshDrainJob *job = opaque;
+#ifndef WIN32
+    sigset_t sigmask, oldsigmask;
+
+    /* SIGINT is handled by the main thread */
+    sigemptyset(&sigmask);
+    sigaddset(&sigmask, SIGINT);
+    ignore_value(pthread_sigmask(SIG_BLOCK, &sigmask, &oldsigmask));
+#endif /* !WIN32 */
+
+    if ((job->ret = virDomainManagedSave(job->dom, job->flags)) < 0)
+        job->error = g_strdup(virGetLastErrorMessage());
+
+#ifndef WIN32
+    pthread_sigmask(SIG_SETMASK, &oldsigmask, NULL);
+#endif /* !WIN32 */
+    g_atomic_int_set(&job->finished, 1);
+    vshEventDone(job->ctl);
+}
+
+/* A domain being shut down is done once it stops, which is announced by
+ * the lifecycle event, so there's no need to poll its state. */
+static void
+virshDrainLifecycleCallback(virConnectPtr conn G_GNUC_UNUSED,
+                            virDomainPtr dom,
+                            int event,
+                            int detail G_GNUC_UNUSED,
+                            void *opaque)
+{
+    virshDrainData *data = opaque;
+    unsigned char uuid[VIR_UUID_BUFLEN];
+    size_t i;
+
+    if (event != VIR_DOMAIN_EVENT_STOPPED ||
+        virDomainGetUUID(dom, uuid) < 0)
+        return;
+
+    for (i = 0; i < data->njobs; i++) {
+        if (memcmp(data->jobs[i].uuid, uuid, VIR_UUID_BUFLEN) == 0) {
+            g_atomic_int_set(&data->jobs[i].finished, 1);
+            vshEventDone(data->ctl);
+            break;
+        }
+    }
+}
+
+/* Higher priority first, keeping the order of domains with equal priority */
+static int
+virshDrainJobCompare(const void *a,
+                     const void *b)
+{
+    const virshDrainJob *ja = a;
+    const virshDrainJob *jb = b;
+
+    if (ja->priority != jb->priority)
+        return ja->priority > jb->priority ? -1 : 1;
+    if (ja->order != jb->order)
+        return ja->order < jb->order ? -1 : 1;
+    return 0;
+}
+
+/* Parses DOMAIN[,priority=N][,timeout=SECONDS] into @job */
+static int
+virshDrainJobParse(vshControl *ctl,
+                   virshDrainJob *job,
+                   const char *spec)
+{
+    g_auto(GStrv) tokens = NULL;
+    size_t i;
+
+    if (vshStringToArray(spec, &tokens) < 1 || !*tokens[0])
+        goto error;
+
+    for (i = 1; tokens[i]; i++) {
+        const char *value;
+
+        if ((value = STRSKIP(tokens[i], "priority="))) {
+            if (virStrToLong_i(value, NULL, 10, &job->priority) < 0)
+                goto error;
+        } else if ((value = STRSKIP(tokens[i], "timeout="))) {
+            if (virStrToLong_ui(value, NULL, 10, &job->timeout) < 0)
+                goto error;
+        } else {
+            goto error;
+        }
+    }
+
+    if (!(job->dom = virshLookupDomainBy(ctl, tokens[0],
+                                         VIRSH_BYID |
+                                         VIRSH_BYUUID | VIRSH_BYNAME)))
+        return -1;
+
+    return 0;
+
+ error:
+    vshError(ctl, _("Invalid domain specification '%s'"), spec);
+    return -1;
+}
+
+static int
+virshDrainJobStart(virshDrainJob *job,
+                   bool managedsave)
+{
+    job->state = VIRSH_DRAIN_RUNNING;
+    if (job->timeout)
+        job->deadline = g_get_monotonic_time() + (gint64) job->timeout * G_USEC_PER_SEC;
+
+    if (managedsave) {
+        vshPrintExtra(job->ctl, _("Saving domain '%s'\n"),
+                      virDomainGetName(job->dom));
+
+        if (virThreadCreate(&job->thread, true,
+                            virshDrainManagedSave, job) < 0) {
+            job->error = g_strdup(_("failed to create thread"));
+            return -1;
+        }
+        job->haveThread = true;
+        return 0;
+    }
+
+    vshPrintExtra(job->ctl, _("Shutting down domain '%s'\n"),
+                  virDomainGetName(job->dom));
+
+    if (virDomainShutdown(job->dom) < 0) {
+        /* the domain might have stopped on its own in the meantime */
+        if (virDomainIsActive(job->dom) == 0) {
+            vshResetLibvirtError();
+            g_atomic_int_set(&job->finished, 1);
+            vshEventDone(job->ctl);
+            return 0;
+        }
+
+        job->error = g_strdup(virGetLastErrorMessage());
+        vshResetLibvirtError();
+        return -1;
+    }
+
+    return 0;
+}
+
+static bool
+cmdDrain(vshControl *ctl, const vshCmd *cmd)
+{
+    virshControl *priv = ctl->privData;
+    const vshCmdOpt *opt = NULL;
+    bool managedsave = vshCommandOptBool(cmd, "managedsave");
+    unsigned int flags = 0;
+    unsigned int maxParallel = 1;
+    unsigned int timeout = 0;
+    virshDrainData data = { .ctl = ctl };
+    virshDrainJob *jobs = NULL;
+    size_t njobs = 0;
+    size_t nstarted = 0;
+    size_t nrunning = 0;
+    size_t nfinished = 0;
+    size_t nfailed = 0;
+    int eventId = -1;
+    bool eventStarted = false;
+    bool interrupted = false;
+    size_t i;
+    size_t j;
+    bool ret = false;
+
+    VSH_REQUIRE_OPTION("bypass-cache", "managedsave");
+
+    if (vshCommandOptBool(cmd, "bypass-cache"))
+        flags |= VIR_DOMAIN_SAVE_BYPASS_CACHE;
+
+    if (vshCommandOptUInt(ctl, cmd, "max-parallel", &maxParallel) < 0)
+        return false;
+    if (maxParallel == 0) {
+        vshError(ctl, "%s", _("drain: Invalid max-parallel"));
+        return false;
+    }
+
+    if (vshCommandOptUInt(ctl, cmd, "timeout", &timeout) < 0)
+        return false;
+
+    if (vshCommandOptBool(cmd, "domains")) {
+        while ((opt = vshCommandOptArgv(ctl, cmd, opt))) {
+            virshDrainJob job = { .timeout = timeout };
+
+            if (virshDrainJobParse(ctl, &job, opt->data) < 0)
+                goto cleanup;
+
+            VIR_APPEND_ELEMENT(jobs, njobs, job);
+        }
+    } else {
+        virDomainPtr *doms = NULL;
+        unsigned int listFlags = VIR_CONNECT_LIST_DOMAINS_ACTIVE;
+        int ndoms;
+
+        /* transient domains can't be saved with managed save */
+        if (managedsave)
+            listFlags |= VIR_CONNECT_LIST_DOMAINS_PERSISTENT;
+
+        if ((ndoms = virConnectListAllDomains(priv->conn, &doms, listFlags)) < 0)
+            goto cleanup;
+
+        njobs = ndoms;
+        jobs = g_new0(virshDrainJob, njobs);
+        for (i = 0; i < njobs; i++) {
+            jobs[i].dom = doms[i];
+            jobs[i].timeout = timeout;
+        }
+        g_free(doms);
+    }
+
+    for (i = 0; i < njobs; i++) {
+        jobs[i].ctl = ctl;
+        jobs[i].order = i;
+        jobs[i].flags = flags;
+        if (virDomainGetUUID(jobs[i].dom, jobs[i].uuid) < 0)
+            goto cleanup;
+    }
+
+    /* drop domains given more than once, the first one counts */
+    for (i = 0; i < njobs; i++) {
+        for (j = 0; j < i; j++) {
+            if (memcmp(jobs[i].uuid, jobs[j].uuid, VIR_UUID_BUFLEN) == 0)
+                break;
+        }
+        if (j < i) {
+            virshDomainFree(jobs[i].dom);
+            VIR_DELETE_ELEMENT(jobs, i, njobs);
+            i--;
+        }
+    }
+
+    if (njobs == 0) {
+        vshPrintExtra(ctl, "%s", _("No domains to drain\n"));
+        ret = true;
+        goto cleanup;
+    }
+
+    qsort(jobs, njobs, sizeof(*jobs), virshDrainJobCompare);
+
+    data.jobs = jobs;
+    data.njobs = njobs;
+
+    /* wake up every second to check for expired timeouts */
+    if (vshEventStart(ctl, 1000) < 0)
+        goto cleanup;
+    eventStarted = true;
+
+    if (!managedsave &&
+        (eventId = virConnectDomainEventRegisterAny(priv->conn, NULL,
+                                                    VIR_DOMAIN_EVENT_ID_LIFECYCLE,
+                                                    VIR_DOMAIN_EVENT_CALLBACK(virshDrainLifecycleCallback),
+                                                    &data, NULL)) < 0)
+        goto cleanup;
+
+    while (nfinished < njobs) {
+        gint64 now = g_get_monotonic_time();
+
+        for (i = 0; i < nstarted; i++) {
+            virshDrainJob *job = jobs + i;
+
+            if (job->state != VIRSH_DRAIN_RUNNING)
+                continue;
+
+            if (!g_atomic_int_get(&job->finished)) {
+                if (!job->deadline || now < job->deadline || job->aborted)
+                    continue;
+
+                if (!managedsave) {
+                    job->ret = -1;
+                    job->error = g_strdup_printf(_("domain did not shut down within %u seconds"),
+                                                 job->timeout);
+                } else {
+                    /* the worker fails once the job is aborted */
+                    vshError(ctl, _("Saving domain '%s' did not finish within %u seconds, aborting"),
+                             virDomainGetName(job->dom), job->timeout);
+                    if (virDomainAbortJob(job->dom) < 0)
+                        vshResetLibvirtError();
+                    job->aborted = true;
+                    continue;
+                }
+            }
+
+            if (job->haveThread)
+                virThreadJoin(&job->thread);
+            job->haveThread = false;
+            job->state = VIRSH_DRAIN_DONE;
+            nrunning--;
+            nfinished++;
+
+            if (job->ret < 0) {
+                nfailed++;
+                if (managedsave)
+                    vshError(ctl, _("Failed to save domain '%s' state: %s"),
+                             virDomainGetName(job->dom), NULLSTR(job->error));
+                else
+                    vshError(ctl, _("Failed to shutdown domain '%s': %s"),
+                             virDomainGetName(job->dom), NULLSTR(job->error));
+            } else {
+                if (managedsave)
+                    vshPrintExtra(ctl, _("Domain '%s' state saved by libvirt\n"),
+                                  virDomainGetName(job->dom));
+                else
+                    vshPrintExtra(ctl, _("Domain '%s' shut down\n"),
+                                  virDomainGetName(job->dom));
+            }
+        }
+
+        while (!interrupted && nrunning < maxParallel && nstarted < njobs) {
+            virshDrainJob *job = jobs + nstarted++;
+
+            nrunning++;
+            if (virshDrainJobStart(job, managedsave) < 0) {
+                job->ret = -1;
+                g_atomic_int_set(&job->finished, 1);
+                vshEventDone(ctl);
+            }
+        }
+
+        if (nfinished == njobs || (interrupted && nrunning == 0))
+            break;
+
+        switch (vshEventWait(ctl)) {
+        case VSH_EVENT_INTERRUPT:
+            if (interrupted)
+                break;
+            interrupted = true;
+            if (managedsave)
+                vshPrintExtra(ctl, "%s", _("Interrupted, waiting for domains being saved\n"));
+            for (i = 0; i < nstarted; i++) {
+                if (jobs[i].state == VIRSH_DRAIN_RUNNING && !managedsave) {
+                    /* stop waiting for domains being shut down */
+                    jobs[i].ret = -1;
+                    jobs[i].error = g_strdup(_("interrupted"));
+                    g_atomic_int_set(&jobs[i].finished, 1);
+                    vshEventDone(ctl);
+                } else if (jobs[i].state == VIRSH_DRAIN_RUNNING &&
+                           !jobs[i].aborted) {
+                    if (virDomainAbortJob(jobs[i].dom) < 0)
+                        vshResetLibvirtError();
+                    jobs[i].aborted = true;
+                }
+            }
+            break;
+        case VSH_EVENT_TIMEOUT:
+        case VSH_EVENT_DONE:
+            break;
+        default:
+            goto cleanup;
+        }
+    }
+
+    if (nfailed || nfinished < njobs) {
+        /* the errors of all domains were reported already */
+        vshResetLibvirtError();
+        vshError(ctl, _("Failed to drain %zu of %zu domains"),
+                 njobs - (nfinished - nfailed), njobs);
+        goto cleanup;
+    }
+
+    vshPrintExtra(ctl, _("\nDrained %zu domains\n"), njobs);
+    ret = true;
+
+ cleanup:
+    if (eventId >= 0)
+        virConnectDomainEventDeregisterAny(priv->conn, eventId);
+    if (eventStarted)
+        vshEventCleanup(ctl);
+    for (i = 0; i < njobs; i++) {
+        if (jobs[i].haveThread)
+            virThreadJoin(&jobs[i].thread);
+        virshDomainFree(jobs[i].dom);
+        g_free(jobs[i].error);
+    }
+    g_free(jobs);
+    return ret;
+}
+
 /*
  * "reboot" command
  */
@@ -10909,6 +11363,10 @@ static const vshCmdOptDef opts_migrate[] = {
      .type = VSH_OT_INT,
      .help = N_("number of connections for parallel migration")
     },
+    {.name = "zerocopy",
+     .type = VSH_OT_BOOL,
+     .help = N_("use zero-copy mechanism for migrating memory pages")
+    },
     {.name = "bandwidth",
      .type = VSH_OT_INT,
      .help = N_("migration bandwidth limit in MiB/s")
@@ -11216,6 +11674,9 @@ doMigrate(void *opaque)
     if (vshCommandOptBool(cmd, "parallel"))
         flags |= VIR_MIGRATE_PARALLEL;
 
+    if (vshCommandOptBool(cmd, "zerocopy"))
+        flags |= VIR_MIGRATE_ZEROCOPY;
+
     if (flags & VIR_MIGRATE_PEER2PEER || vshCommandOptBool(cmd, "direct")) {
         if (virDomainMigrateToURI3(dom, desturi, params, nparams, flags) == 0)
             data->ret = 0;
@@ -11394,6 +11855,386 @@ cmdMigrate(vshControl *ctl, const vshCmd *cmd)
     return !data.ret;
 }
 
+/*
+ * "evacuate" command
+ */
+static const vshCmdInfo info_evacuate[] = {
+    {.name = "help",
+     .data = N_("migrate a set of domains away from the host")
+    },
+    {.name = "desc",
+     .data = N_("Migrate running domains to another host using peer-to-peer "
+                "migration, running a limited number of migrations at once "
+                "and sharing an aggregate bandwidth cap between them.")
+    },
+    {.name = NULL}
+};
+
+static const vshCmdOptDef opts_evacuate[] = {
+    {.name = "desturi",
+     .type = VSH_OT_DATA,
+     .flags = VSH_OFLAG_REQ,
+     .completer = virshCompleteEmpty,
+     .help = N_("connection URI of the destination host as seen from the source")
+    },
+    VIRSH_COMMON_OPT_LIVE(N_("live migration")),
+    {.name = "persistent",
+     .type = VSH_OT_BOOL,
+     .help = N_("persist VM on destination")
+    },
+    {.name = "undefinesource",
+     .type = VSH_OT_BOOL,
+     .help = N_("undefine VM on source")
+    },
+    {.name = "max-parallel",
+     .type = VSH_OT_INT,
+     .help = N_("maximum number of migrations running at once (default 2)")
+    },
+    {.name = "bandwidth",
+     .type = VSH_OT_INT,
+     .help = N_("aggregate bandwidth limit in MiB/s shared by all running migrations")
+    },
+    {.name = "verbose",
+     .type = VSH_OT_BOOL,
+     .help = N_("display the progress of evacuation")
+    },
+    {.name = "domains",
+     .type = VSH_OT_ARGV,
+     .completer = virshDomainNameCompleter,
+     .completer_flags = VIR_CONNECT_LIST_DOMAINS_ACTIVE,
+     .help = N_("list of domains to migrate (default: all running domains)")
+    },
+    {.name = NULL}
+};
+
+typedef enum {
+    VIRSH_EVACUATE_PENDING = 0,
+    VIRSH_EVACUATE_RUNNING,
+    VIRSH_EVACUATE_DONE,
+} virshEvacuateState;
+
+typedef struct _virshEvacuateJob virshEvacuateJob;
+struct _virshEvacuateJob {
+    virDomainPtr dom;
+    const char *desturi;
+    unsigned int flags;
+    unsigned long long bandwidth;
+
+    unsigned long long memory; /* KiB, from balloon.current */
+    unsigned long long dirtyRate; /* MiB/s, from dirtyrate.megabytes_per_second */
+
+    virThread thread;
+    virshEvacuateState state;
+    int finished; /* set by the worker thread, accessed atomically */
+    int ret;
+    char *error;
+
+    unsigned long long processed;
+    unsigned long long total;
+};
+
+static void
+virshEvacuateWorker(void *opaque)
+{
+    virshEvacuateJob *job = opaque;
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+    int maxparams = 0;
+
+    job->ret = -1;
+
+    if (job->bandwidth &&
+        virTypedParamsAddULLong(&params, &nparams, &maxparams,
+                                VIR_MIGRATE_PARAM_BANDWIDTH,
+                                job->bandwidth) < 0)
+        goto cleanup;
+
+    job->ret = virDomainMigrateToURI3(job->dom, job->desturi,
+                                      params, nparams, job->flags);
+
+ cleanup:
+    if (job->ret < 0)
+        job->error = g_strdup(virGetLastErrorMessage());
+    virTypedParamsFree(params, nparams);
+    g_atomic_int_set(&job->finished, 1);
+}
+
+/* Domains calculating their dirty rate in the background report the
+ * recent results, their average is less noisy than the last one. */
+static void
+virshEvacuateJobGetDirtyRate(virshEvacuateJob *job,
+                             virDomainStatsRecordPtr rec)
+{
+    unsigned int count = 0;
+    long long rate = 0;
+    long long sum = 0;
+    unsigned int n = 0;
+    size_t i;
+
+    ignore_value(virTypedParamsGetUInt(rec->params, rec->nparams,
+                                       "dirtyrate.history.count", &count));
+
+    for (i = 0; i < count; i++) {
+        char field[VIR_TYPED_PARAM_FIELD_LENGTH];
+
+        g_snprintf(field, sizeof(field),
+                   "dirtyrate.history.%zu.megabytes_per_second", i);
+        if (virTypedParamsGetLLong(rec->params, rec->nparams,
+                                   field, &rate) == 1) {
+            sum += rate;
+            n++;
+        }
+    }
+
+    if (n > 0) {
+        job->dirtyRate = sum / n;
+    } else if (virTypedParamsGetLLong(rec->params, rec->nparams,
+                                      "dirtyrate.megabytes_per_second",
+                                      &rate) == 1) {
+        job->dirtyRate = rate;
+    }
+
+    /* Don't let a parameter of unexpected type leave an error behind */
+    vshResetLibvirtError();
+}
+
+/* Migrate domains with the smallest expected cost first: clean domains
+ * converge quickly and free host resources for the heavier ones. */
+static int
+virshEvacuateJobCompare(const void *a,
+                        const void *b)
+{
+    const virshEvacuateJob *ja = a;
+    const virshEvacuateJob *jb = b;
+
+    if (ja->dirtyRate != jb->dirtyRate)
+        return ja->dirtyRate < jb->dirtyRate ? -1 : 1;
+    if (ja->memory != jb->memory)
+        return ja->memory < jb->memory ? -1 : 1;
+    return 0;
+}
+
+static void
+virshEvacuateJobUpdate(virshEvacuateJob *job)
+{
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+    int type;
+    unsigned long long value;
+
+    if (virDomainGetJobStats(job->dom, &type, &params, &nparams, 0) < 0) {
+        vshResetLibvirtError();
+        return;
+    }
+
+    if (type != VIR_DOMAIN_JOB_NONE) {
+        if (virTypedParamsGetULLong(params, nparams,
+                                    VIR_DOMAIN_JOB_DATA_PROCESSED, &value) > 0)
+            job->processed = value;
+        if (virTypedParamsGetULLong(params, nparams,
+                                    VIR_DOMAIN_JOB_DATA_TOTAL, &value) > 0)
+            job->total = value;
+    }
+
+    virTypedParamsFree(params, nparams);
+}
+
+static bool
+cmdEvacuate(vshControl *ctl, const vshCmd *cmd)
+{
+    virshControl *priv = ctl->privData;
+    const char *desturi = NULL;
+    const vshCmdOpt *opt = NULL;
+    unsigned int flags = VIR_MIGRATE_PEER2PEER;
+    unsigned int maxParallel = 2;
+    unsigned long long bandwidth = 0;
+    bool verbose = vshCommandOptBool(cmd, "verbose");
+    unsigned int stats = VIR_DOMAIN_STATS_BALLOON | VIR_DOMAIN_STATS_DIRTYRATE;
+    virDomainPtr *domlist = NULL;
+    size_t ndomlist = 0;
+    virDomainStatsRecordPtr *records = NULL;
+    virDomainStatsRecordPtr *next;
+    virshEvacuateJob *jobs = NULL;
+    size_t njobs = 0;
+    size_t nstarted = 0;
+    size_t nrunning = 0;
+    size_t nfinished = 0;
+    size_t nfailed = 0;
+    size_t i;
+    bool ret = false;
+
+    if (vshCommandOptStringReq(ctl, cmd, "desturi", &desturi) < 0)
+        return false;
+
+    if (vshCommandOptUInt(ctl, cmd, "max-parallel", &maxParallel) < 0)
+        return false;
+    if (maxParallel == 0) {
+        vshError(ctl, "%s", _("evacuate: Invalid max-parallel"));
+        return false;
+    }
+
+    if (vshCommandOptULongLong(ctl, cmd, "bandwidth", &bandwidth) < 0)
+        return false;
+
+    if (vshCommandOptBool(cmd, "live"))
+        flags |= VIR_MIGRATE_LIVE;
+    if (vshCommandOptBool(cmd, "persistent"))
+        flags |= VIR_MIGRATE_PERSIST_DEST;
+    if (vshCommandOptBool(cmd, "undefinesource"))
+        flags |= VIR_MIGRATE_UNDEFINE_SOURCE;
+
+    if (vshCommandOptBool(cmd, "domains")) {
+        while ((opt = vshCommandOptArgv(ctl, cmd, opt))) {
+            virDomainPtr dom;
+
+            if (!(dom = virshLookupDomainBy(ctl, opt->data,
+                                            VIRSH_BYID |
+                                            VIRSH_BYUUID | VIRSH_BYNAME)))
+                goto cleanup;
+
+            VIR_APPEND_ELEMENT(domlist, ndomlist, dom);
+        }
+        /* virDomainListGetStats expects a NULL terminated list */
+        VIR_APPEND_ELEMENT(domlist, ndomlist, NULL);
+
+        if (virDomainListGetStats(domlist, stats, &records, 0) < 0)
+            goto cleanup;
+    } else {
+        if (virConnectGetAllDomainStats(priv->conn, stats, &records,
+                                        VIR_CONNECT_GET_ALL_DOMAINS_STATS_ACTIVE) < 0)
+            goto cleanup;
+    }
+
+    for (next = records; *next; next++)
+        njobs++;
+
+    if (njobs == 0) {
+        vshPrintExtra(ctl, "%s", _("No domains to evacuate\n"));
+        ret = true;
+        goto cleanup;
+    }
+
+    jobs = g_new0(virshEvacuateJob, njobs);
+    for (i = 0; i < njobs; i++) {
+        virshEvacuateJob *job = jobs + i;
+        virDomainStatsRecordPtr rec = records[i];
+
+        virDomainRef(rec->dom);
+        job->dom = rec->dom;
+        job->desturi = desturi;
+        job->flags = flags;
+        job->bandwidth = bandwidth / MIN(maxParallel, njobs);
+        if (bandwidth && job->bandwidth == 0)
+            job->bandwidth = 1;
+
+        ignore_value(virTypedParamsGetULLong(rec->params, rec->nparams,
+                                             "balloon.current", &job->memory));
+        virshEvacuateJobGetDirtyRate(job, rec);
+    }
+
+    qsort(jobs, njobs, sizeof(*jobs), virshEvacuateJobCompare);
+
+    while (nfinished < njobs) {
+        unsigned long long processed = 0;
+        unsigned long long total = 0;
+
+        for (i = 0; i < nstarted; i++) {
+            virshEvacuateJob *job = jobs + i;
+
+            if (job->state != VIRSH_EVACUATE_RUNNING ||
+                !g_atomic_int_get(&job->finished))
+                continue;
+
+            virThreadJoin(&job->thread);
+            job->state = VIRSH_EVACUATE_DONE;
+            nrunning--;
+            nfinished++;
+
+            if (job->ret < 0) {
+                nfailed++;
+                if (verbose)
+                    fprintf(stderr, "\n");
+                vshError(ctl, _("Failed to migrate domain '%s': %s"),
+                         virDomainGetName(job->dom), NULLSTR(job->error));
+            } else {
+                job->processed = job->total;
+                if (verbose)
+                    fprintf(stderr, "\n");
+                vshPrintExtra(ctl, _("Domain '%s' migrated\n"),
+                              virDomainGetName(job->dom));
+            }
+        }
+
+        while (nrunning < maxParallel && nstarted < njobs) {
+            virshEvacuateJob *job = jobs + nstarted;
+
+            job->state = VIRSH_EVACUATE_RUNNING;
+            if (virThreadCreate(&job->thread, true,
+                                virshEvacuateWorker, job) < 0) {
+                vshError(ctl, _("Failed to start migration of domain '%s'"),
+                         virDomainGetName(job->dom));
+                job->state = VIRSH_EVACUATE_DONE;
+                job->ret = -1;
+                nstarted++;
+                nfinished++;
+                nfailed++;
+                continue;
+            }
+            nstarted++;
+            nrunning++;
+        }
+
+        if (nfinished == njobs)
+            break;
+
+        if (verbose) {
+            g_autofree char *label = NULL;
+
+            for (i = 0; i < nstarted; i++) {
+                virshEvacuateJob *job = jobs + i;
+
+                if (job->state == VIRSH_EVACUATE_RUNNING)
+                    virshEvacuateJobUpdate(job);
+
+                processed += job->processed;
+                total += job->total;
+            }
+
+            label = g_strdup_printf(_("Evacuation (%zu/%zu done, %zu running)"),
+                                    nfinished, njobs, nrunning);
+            if (total > 0)
+                virshPrintJobProgress(label, total - MIN(processed, total) + 1,
+                                      total + 1);
+        }
+
+        g_usleep(500 * 1000);
+    }
+
+    if (verbose)
+        virshPrintJobProgress(_("Evacuation"), 0, 1);
+
+    if (nfailed) {
+        vshError(ctl, _("Failed to migrate %zu of %zu domains"),
+                 nfailed, njobs);
+        goto cleanup;
+    }
+
+    vshPrintExtra(ctl, _("\nEvacuated %zu domains\n"), njobs);
+    ret = true;
+
+ cleanup:
+    for (i = 0; i < njobs; i++) {
+        virshDomainFree(jobs[i].dom);
+        g_free(jobs[i].error);
+    }
+    g_free(jobs);
+    virDomainStatsRecordListFree(records);
+    for (i = 0; i < ndomlist; i++)
+        virshDomainFree(domlist[i]);
+    g_free(domlist);
+    return ret;
+}
+
 /*
  * "migrate-setmaxdowntime" command
  */
@@ -13591,6 +14432,10 @@ static const vshCmdOptDef opts_domdirtyrate_calc[] = {
      .help = N_("dirty page rate calculation mode, either of these 3 options "
                 "'page-sampling, dirty-bitmap, dirty-ring' can be specified.")
     },
+    {.name = "continuous",
+     .type = VSH_OT_BOOL,
+     .help = N_("keep calculating memory dirty rate in the background")
+    },
     {.name = NULL}
 };
 
@@ -13640,6 +14485,9 @@ cmdDomDirtyRateCalc(vshControl *ctl, const vshCmd *cmd)
         }
     }
 
+    if (vshCommandOptBool(cmd, "continuous"))
+        flags |= VIR_DOMAIN_DIRTYRATE_CONTINUOUS;
+
     if (virDomainStartDirtyRateCalc(dom, seconds, flags) < 0)
         return false;
 
@@ -13673,7 +14521,7 @@ const vshCmdDef domManagementCmds[] = {
      .handler = cmdAutostart,
      .opts = opts_autostart,
      .info = info_autostart,
-     .flags = 0
+     .flags = VSH_CMD_FLAG_PARALLEL
     },
     {.name = "blkdeviotune",
      .handler = cmdBlkdeviotune,
@@ -13759,7 +14607,7 @@ const vshCmdDef domManagementCmds[] = {
      .handler = cmdDestroy,
      .opts = opts_destroy,
      .info = info_destroy,
-     .flags = 0
+     .flags = VSH_CMD_FLAG_PARALLEL
     },
     {.name = "detach-device",
      .handler = cmdDetachDevice,
@@ -13825,7 +14673,7 @@ const vshCmdDef domManagementCmds[] = {
      .handler = cmdDomid,
      .opts = opts_domid,
      .info = info_domid,
-     .flags = 0
+     .flags = VSH_CMD_FLAG_PARALLEL
     },
     {.name = "domif-setlink",
      .handler = cmdDomIfSetLink,
@@ -13867,7 +14715,7 @@ const vshCmdDef domManagementCmds[] = {
      .handler = cmdDomname,
      .opts = opts_domname,
      .info = info_domname,
-     .flags = 0
+     .flags = VSH_CMD_FLAG_PARALLEL
     },
     {.name = "domrename",
      .handler = cmdDomrename,
@@ -13891,7 +14739,7 @@ const vshCmdDef domManagementCmds[] = {
      .handler = cmdDomuuid,
      .opts = opts_domuuid,
      .info = info_domuuid,
-     .flags = 0
+     .flags = VSH_CMD_FLAG_PARALLEL
     },
     {.name = "domxml-from-native",
      .handler = cmdDomXMLFromNative,
@@ -13905,6 +14753,12 @@ const vshCmdDef domManagementCmds[] = {
      .info = info_domxmltonative,
      .flags = 0
     },
+    {.name = "drain",
+     .handler = cmdDrain,
+     .opts = opts_drain,
+     .info = info_drain,
+     .flags = 0
+    },
     {.name = "dump",
      .handler = cmdDump,
      .opts = opts_dump,
@@ -13915,7 +14769,7 @@ const vshCmdDef domManagementCmds[] = {
      .handler = cmdDumpXML,
      .opts = opts_dumpxml,
      .info = info_dumpxml,
-     .flags = 0
+     .flags = VSH_CMD_FLAG_PARALLEL
     },
     {.name = "edit",
      .handler = cmdEdit,
@@ -14037,6 +14891,12 @@ const vshCmdDef domManagementCmds[] = {
      .info = info_migrate,
      .flags = 0
     },
+    {.name = "evacuate",
+     .handler = cmdEvacuate,
+     .opts = opts_evacuate,
+     .info = info_evacuate,
+     .flags = 0
+    },
     {.name = "migrate-setmaxdowntime",
      .handler = cmdMigrateSetMaxDowntime,
      .opts = opts_migrate_setmaxdowntime,
@@ -14113,7 +14973,7 @@ const vshCmdDef domManagementCmds[] = {
      .handler = cmdReboot,
      .opts = opts_reboot,
      .info = info_reboot,
-     .flags = 0
+     .flags = VSH_CMD_FLAG_PARALLEL
     },
     {.name = "reset",
      .handler = cmdReset,
@@ -14131,7 +14991,7 @@ const vshCmdDef domManagementCmds[] = {
      .handler = cmdResume,
      .opts = opts_resume,
      .info = info_resume,
-     .flags = 0
+     .flags = VSH_CMD_FLAG_PARALLEL
     },
     {.name = "save",
      .handler = cmdSave,
@@ -14197,7 +15057,7 @@ const vshCmdDef domManagementCmds[] = {
      .handler = cmdSetmem,
      .opts = opts_setmem,
      .info = info_setmem,
-     .flags = 0
+     .flags = VSH_CMD_FLAG_PARALLEL
     },
     {.name = "setvcpus",
      .handler = cmdSetvcpus,
@@ -14209,7 +15069,7 @@ const vshCmdDef domManagementCmds[] = {
      .handler = cmdShutdown,
      .opts = opts_shutdown,
      .info = info_shutdown,
-     .flags = 0
+     .flags = VSH_CMD_FLAG_PARALLEL
     },
     {.name = "start",
      .handler = cmdStart,
@@ -14221,7 +15081,7 @@ const vshCmdDef domManagementCmds[] = {
      .handler = cmdSuspend,
      .opts = opts_suspend,
      .info = info_suspend,
-     .flags = 0
+     .flags = VSH_CMD_FLAG_PARALLEL
     },
     {.name = "ttyconsole",
      .handler = cmdTTYConsole,
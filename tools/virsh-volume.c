@@ -1402,6 +1402,8 @@ cmdVolList(vshControl *ctl, const vshCmd *cmd G_GNUC_UNUSED)
         if (!table)
             goto cleanup;
 
+        vshTableStreamToStdout(table, ctl, VSH_TABLE_STREAM_SAMPLE);
+
         for (i = 0; i < list->nvols; i++) {
             if (vshTableRowAppend(table,
                                   virStorageVolGetName(list->vols[i]),
@@ -1424,6 +1426,8 @@ cmdVolList(vshControl *ctl, const vshCmd *cmd G_GNUC_UNUSED)
     if (!table)
         goto cleanup;
 
+    vshTableStreamToStdout(table, ctl, VSH_TABLE_STREAM_SAMPLE);
+
     /* Insert the volume info rows into table */
     for (i = 0; i < list->nvols; i++) {
         if (vshTableRowAppend(table,
@@ -453,6 +453,7 @@ virshUsage(void)
                       "    -d | --debug=NUM        debug level [0-4]\n"
                       "    -e | --escape <char>    set escape sequence for console\n"
                       "    -h | --help             this help\n"
+                      "    -j | --jobs=NUM         run up to NUM independent commands concurrently\n"
                       "    -k | --keepalive-interval=NUM\n"
                       "                            keepalive interval in seconds, 0 for disable\n"
                       "    -K | --keepalive-count=NUM\n"
@@ -652,6 +653,7 @@ virshParseArgv(vshControl *ctl, int argc, char **argv)
         {"debug", required_argument, NULL, 'd'},
         {"escape", required_argument, NULL, 'e'},
         {"help", no_argument, NULL, 'h'},
+        {"jobs", required_argument, NULL, 'j'},
         {"keepalive-interval", required_argument, NULL, 'k'},
         {"keepalive-count", required_argument, NULL, 'K'},
         {"log", required_argument, NULL, 'l'},
@@ -665,7 +667,7 @@ virshParseArgv(vshControl *ctl, int argc, char **argv)
     /* Standard (non-command) options. The leading + ensures that no
      * argument reordering takes place, so that command options are
      * not confused with top-level virsh options. */
-    while ((arg = getopt_long(argc, argv, "+:c:d:e:hk:K:l:qrtvV", opt, &longindex)) != -1) {
+    while ((arg = getopt_long(argc, argv, "+:c:d:e:hj:k:K:l:qrtvV", opt, &longindex)) != -1) {
         switch (arg) {
         case 'c':
             VIR_FREE(ctl->connname);
@@ -700,6 +702,14 @@ virshParseArgv(vshControl *ctl, int argc, char **argv)
             virshUsage();
             exit(EXIT_SUCCESS);
             break;
+        case 'j':
+            if (virStrToLong_ui(optarg, NULL, 10, &ctl->jobs) < 0 ||
+                ctl->jobs == 0) {
+                vshError(ctl, _("option %s requires a positive integer argument"),
+                         longindex == -1 ? "-j" : "--jobs");
+                exit(EXIT_FAILURE);
+            }
+            break;
         case 'k':
             if (virStrToLong_i(optarg, NULL, 0, &keepalive) < 0) {
                 vshError(ctl,
@@ -780,6 +790,18 @@ virshParseArgv(vshControl *ctl, int argc, char **argv)
     }
 
     if (argc == optind) {
+        if (ctl->jobs > 1 && !ctl->istty) {
+            g_autofree char *script = NULL;
+
+            /* Commands piped on stdin are read and parsed as a whole so
+             * that independent ones can be run concurrently. */
+            ctl->imode = false;
+            if (virFileReadLimFD(STDIN_FILENO, VIRSH_MAX_SCRIPT_LEN, &script) < 0) {
+                vshError(ctl, "%s", _("Failed to read commands from stdin"));
+                return false;
+            }
+            return vshCommandStringParse(ctl, script, NULL, 0);
+        }
         ctl->imode = true;
     } else {
         /* parse command */
@@ -33,6 +33,9 @@
 #define VIRSH_PROMPT_RW    "virsh # "
 #define VIRSH_PROMPT_RO    "virsh > "
 
+/* maximum size of a script read from stdin in batch mode */
+#define VIRSH_MAX_SCRIPT_LEN (64 * 1024 * 1024)
+
 #define VIR_FROM_THIS VIR_FROM_NONE
 
 /*
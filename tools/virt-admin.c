@@ -421,8 +421,225 @@ cmdSrvThreadpoolInfo(vshControl *ctl, const vshCmd *cmd)
         goto cleanup;
     }
 
-    for (i = 0; i < nparams; i++)
-        vshPrint(ctl, "%-15s: %u\n", params[i].field, params[i].value.ui);
+    for (i = 0; i < nparams; i++) {
+        if (params[i].type == VIR_TYPED_PARAM_ULLONG)
+            vshPrint(ctl, "%-15s: %llu\n", params[i].field, params[i].value.ul);
+        else
+            vshPrint(ctl, "%-15s: %u\n", params[i].field, params[i].value.ui);
+    }
+
+    ret = true;
+
+ cleanup:
+    virTypedParamsFree(params, nparams);
+    if (srv)
+        virAdmServerFree(srv);
+    return ret;
+}
+
+/* ---------------------
+ * Command server-stats
+ * ---------------------
+ */
+
+static const vshCmdInfo info_srv_stats[] = {
+    {.name = "help",
+     .data = N_("get server runtime statistics")
+    },
+    {.name = "desc",
+     .data = N_("Retrieve runtime statistics from a server.")
+    },
+    {.name = NULL}
+};
+
+static const vshCmdOptDef opts_srv_stats[] = {
+    {.name = "server",
+     .type = VSH_OT_DATA,
+     .flags = VSH_OFLAG_REQ,
+     .completer = vshAdmServerCompleter,
+     .help = N_("Server to retrieve statistics from."),
+    },
+    {.name = NULL}
+};
+
+static bool
+cmdSrvStats(vshControl *ctl, const vshCmd *cmd)
+{
+    bool ret = false;
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+    size_t i;
+    const char *srvname = NULL;
+    virAdmServerPtr srv = NULL;
+    vshAdmControl *priv = ctl->privData;
+
+    if (vshCommandOptStringReq(ctl, cmd, "server", &srvname) < 0)
+        return false;
+
+    if (!(srv = virAdmConnectLookupServer(priv->conn, srvname, 0)))
+        goto cleanup;
+
+    if (virAdmServerGetStats(srv, &params, &nparams, 0) < 0) {
+        vshError(ctl, "%s", _("Unable to get server statistics"));
+        goto cleanup;
+    }
+
+    for (i = 0; i < nparams; i++) {
+        g_autofree char *str = vshGetTypedParamValue(ctl, &params[i]);
+        vshPrint(ctl, "%-24s: %s\n", params[i].field, str);
+    }
+
+    ret = true;
+
+ cleanup:
+    virTypedParamsFree(params, nparams);
+    if (srv)
+        virAdmServerFree(srv);
+    return ret;
+}
+
+/* -------------------------------
+ * Command server-procedure-stats
+ * -------------------------------
+ */
+
+static const vshCmdInfo info_srv_procedure_stats[] = {
+    {.name = "help",
+     .data = N_("get per procedure RPC statistics of a server")
+    },
+    {.name = "desc",
+     .data = N_("Retrieve call counts, timings and traffic of the RPC "
+                "procedures handled by a server.")
+    },
+    {.name = NULL}
+};
+
+static const vshCmdOptDef opts_srv_procedure_stats[] = {
+    {.name = "server",
+     .type = VSH_OT_DATA,
+     .flags = VSH_OFLAG_REQ,
+     .completer = vshAdmServerCompleter,
+     .help = N_("Server to retrieve statistics from."),
+    },
+    {.name = "histogram",
+     .type = VSH_OT_BOOL,
+     .help = N_("print the queue and dispatch time histograms"),
+    },
+    {.name = NULL}
+};
+
+static unsigned long long
+vshAdmProcStatsGet(virTypedParameterPtr params,
+                   int nparams,
+                   size_t idx,
+                   const char *name)
+{
+    g_autofree char *field = g_strdup_printf("proc.%zu.%s", idx, name);
+    unsigned long long value = 0;
+
+    ignore_value(virTypedParamsGetULLong(params, nparams, field, &value));
+    return value;
+}
+
+static bool
+cmdSrvProcedureStats(vshControl *ctl, const vshCmd *cmd)
+{
+    bool ret = false;
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+    unsigned int count = 0;
+    size_t i;
+    int j;
+    const char *srvname = NULL;
+    virAdmServerPtr srv = NULL;
+    vshAdmControl *priv = ctl->privData;
+    g_autoptr(vshTable) table = NULL;
+
+    if (vshCommandOptStringReq(ctl, cmd, "server", &srvname) < 0)
+        return false;
+
+    if (!(srv = virAdmConnectLookupServer(priv->conn, srvname, 0)))
+        goto cleanup;
+
+    if (virAdmServerGetProcedureStats(srv, &params, &nparams, 0) < 0) {
+        vshError(ctl, "%s", _("Unable to get server procedure statistics"));
+        goto cleanup;
+    }
+
+    if (virTypedParamsGetUInt(params, nparams, "proc.count", &count) < 0) {
+        vshError(ctl, "%s", _("Unable to get server procedure statistics"));
+        goto cleanup;
+    }
+
+    table = vshTableNew(_("Program"), _("Procedure"), _("Calls"), _("Errors"),
+                        _("Avg queue (us)"), _("Avg dispatch (us)"),
+                        _("Bytes in"), _("Bytes out"), NULL);
+    if (!table)
+        goto cleanup;
+
+    for (i = 0; i < count; i++) {
+        g_autofree char *field = NULL;
+        g_autofree char *progStr = NULL;
+        g_autofree char *procStr = NULL;
+        g_autofree char *callsStr = NULL;
+        g_autofree char *errorsStr = NULL;
+        g_autofree char *queueStr = NULL;
+        g_autofree char *dispatchStr = NULL;
+        g_autofree char *inStr = NULL;
+        g_autofree char *outStr = NULL;
+        unsigned int program = 0;
+        unsigned int procedure = 0;
+        unsigned long long calls = vshAdmProcStatsGet(params, nparams, i, "calls");
+        unsigned long long queued = vshAdmProcStatsGet(params, nparams, i, "queued");
+
+        field = g_strdup_printf("proc.%zu.program", i);
+        ignore_value(virTypedParamsGetUInt(params, nparams, field, &program));
+        g_free(field);
+        field = g_strdup_printf("proc.%zu.procedure", i);
+        ignore_value(virTypedParamsGetUInt(params, nparams, field, &procedure));
+
+        progStr = g_strdup_printf("0x%x", program);
+        procStr = g_strdup_printf("%u", procedure);
+        callsStr = g_strdup_printf("%llu", calls);
+        errorsStr = g_strdup_printf("%llu",
+                                    vshAdmProcStatsGet(params, nparams, i, "errors"));
+        queueStr = g_strdup_printf("%llu", queued ?
+                                   vshAdmProcStatsGet(params, nparams, i,
+                                                      "queue_time") / queued : 0);
+        dispatchStr = g_strdup_printf("%llu", calls ?
+                                      vshAdmProcStatsGet(params, nparams, i,
+                                                         "dispatch_time") / calls : 0);
+        inStr = g_strdup_printf("%llu",
+                                vshAdmProcStatsGet(params, nparams, i, "bytes_in"));
+        outStr = g_strdup_printf("%llu",
+                                 vshAdmProcStatsGet(params, nparams, i, "bytes_out"));
+
+        if (vshTableRowAppend(table, progStr, procStr, callsStr, errorsStr,
+                              queueStr, dispatchStr, inStr, outStr, NULL) < 0)
+            goto cleanup;
+    }
+
+    vshTablePrintToStdout(table, ctl);
+
+    if (vshCommandOptBool(cmd, "histogram")) {
+        for (i = 0; i < count; i++) {
+            g_autofree char *prefix = g_strdup_printf("proc.%zu.", i);
+            size_t prefixlen = strlen(prefix);
+
+            vshPrint(ctl, "\n%s\n", prefix);
+            for (j = 0; j < nparams; j++) {
+                const char *name = params[j].field;
+
+                if (!STRPREFIX(name, prefix))
+                    continue;
+                name += prefixlen;
+
+                if (STRPREFIX(name, "queue_hist.") ||
+                    STRPREFIX(name, "dispatch_hist."))
+                    vshPrint(ctl, "  %-24s: %llu\n", name, params[j].value.ul);
+            }
+        }
+    }
 
     ret = true;
 
@@ -468,6 +685,14 @@ static const vshCmdOptDef opts_srv_threadpool_set[] = {
      .type = VSH_OT_INT,
      .help = N_("Change the current number of priority workers"),
     },
+    {.name = "job-queues",
+     .type = VSH_OT_INT,
+     .help = N_("Change the number of job queues workers are spread over"),
+    },
+    {.name = "idle-timeout",
+     .type = VSH_OT_INT,
+     .help = N_("Change the number of seconds after which idle workers exit"),
+    },
     {.name = NULL}
 };
 
@@ -500,13 +725,16 @@ cmdSrvThreadpoolSet(vshControl *ctl, const vshCmd *cmd)
     PARSE_CMD_TYPED_PARAM("max-workers", VIR_THREADPOOL_WORKERS_MAX);
     PARSE_CMD_TYPED_PARAM("min-workers", VIR_THREADPOOL_WORKERS_MIN);
     PARSE_CMD_TYPED_PARAM("priority-workers", VIR_THREADPOOL_WORKERS_PRIORITY);
+    PARSE_CMD_TYPED_PARAM("job-queues", VIR_THREADPOOL_JOB_QUEUES);
+    PARSE_CMD_TYPED_PARAM("idle-timeout", VIR_THREADPOOL_WORKERS_IDLE_TIMEOUT);
 
 #undef PARSE_CMD_TYPED_PARAM
 
     if (!nparams) {
         vshError(ctl, "%s",
                  _("At least one of options --min-workers, --max-workers, "
-                   "--priority-workers is mandatory "));
+                   "--priority-workers, --job-queues, --idle-timeout "
+                   "is mandatory "));
             goto cleanup;
     }
 
@@ -1447,6 +1675,18 @@ static const vshCmdDef monitoringCmds[] = {
      .info = info_srv_clients_info,
      .flags = 0
     },
+    {.name = "server-procedure-stats",
+     .handler = cmdSrvProcedureStats,
+     .opts = opts_srv_procedure_stats,
+     .info = info_srv_procedure_stats,
+     .flags = 0
+    },
+    {.name = "server-stats",
+     .handler = cmdSrvStats,
+     .opts = opts_srv_stats,
+     .info = info_srv_stats,
+     .flags = 0
+    },
     {.name = NULL}
 };
 
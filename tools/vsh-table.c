@@ -33,7 +33,8 @@
 
 typedef struct _vshTableRow vshTableRow;
 struct _vshTableRow {
-    char **cells;
+    char **cells; /* already passed through vshTableSafeEncode */
+    size_t *widths; /* count of characters of each cell */
     size_t ncells;
 };
 
@@ -41,6 +42,17 @@ struct _vshTableRow {
 struct _vshTable {
     vshTableRow **rows;
     size_t nrows;
+
+    /* maximum count of characters of each column, not counting the
+     * header, updated as the rows are appended */
+    size_t *maxwidths;
+
+    /* streaming mode, see vshTableStream */
+    vshTableStreamFunc streamFunc;
+    void *streamOpaque;
+    size_t streamSample;
+    bool streamHeader;
+    bool streaming; /* column widths are fixed and rows printed right away */
 };
 
 
@@ -56,6 +68,7 @@ vshTableRowFree(vshTableRow *row)
         g_free(row->cells[i]);
 
     g_free(row->cells);
+    g_free(row->widths);
     g_free(row);
 }
 
@@ -71,17 +84,93 @@ vshTableFree(vshTable *table)
     for (i = 0; i < table->nrows; i++)
         vshTableRowFree(table->rows[i]);
     g_free(table->rows);
+    g_free(table->maxwidths);
     g_free(table);
 }
 
 
+/**
+ * Function pulled from util-linux
+ *
+ * Function's name in util-linux: mbs_safe_encode_to_buffer
+ *
+ * Returns allocated string where all control and non-printable chars are
+ * replaced with \x?? hex sequence, or NULL.
+ */
+static char *
+vshTableSafeEncode(const char *s, size_t *width)
+{
+    const char *p = s;
+    size_t sz = s ? strlen(s) : 0;
+    char *buf;
+    char *ret;
+    mbstate_t st;
+
+    memset(&st, 0, sizeof(st));
+
+    buf = g_new0(char, (sz * HEX_ENCODE_LENGTH) + 1);
+
+    ret = buf;
+    *width = 0;
+
+    while (p && *p) {
+        if ((*p == '\\' && *(p + 1) == 'x') ||
+            g_ascii_iscntrl(*p)) {
+            g_snprintf(buf, HEX_ENCODE_LENGTH + 1, "\\x%02x", *p);
+            buf += HEX_ENCODE_LENGTH;
+            *width += HEX_ENCODE_LENGTH;
+            p++;
+        } else {
+            wchar_t wc;
+            size_t len = mbrtowc(&wc, p, MB_CUR_MAX, &st);
+
+            if (len == 0)
+                break;		/* end of string */
+
+            if (len == (size_t) -1 || len == (size_t) -2) {
+                len = 1;
+                /*
+                 * Not valid multibyte sequence -- maybe it's
+                 * printable char according to the current locales.
+                 */
+                if (!g_ascii_isprint(*p)) {
+                    g_snprintf(buf, HEX_ENCODE_LENGTH + 1, "\\x%02x", *p);
+                    buf += HEX_ENCODE_LENGTH;
+                    *width += HEX_ENCODE_LENGTH;
+                } else {
+                    *buf++ = *p;
+                    (*width)++;
+                }
+            } else if (!iswprint(wc)) {
+                size_t i;
+                for (i = 0; i < len; i++) {
+                    g_snprintf(buf, HEX_ENCODE_LENGTH + 1, "\\x%02x", p[i]);
+                    buf += HEX_ENCODE_LENGTH;
+                    *width += HEX_ENCODE_LENGTH;
+                }
+            } else {
+                memcpy(buf, p, len);
+                buf += len;
+                *width += g_unichar_iszerowidth(wc) ? 0 : (g_unichar_iswide(wc) ? 2 : 1);
+            }
+            p += len;
+        }
+    }
+
+    *buf = '\0';
+    return ret;
+}
+
+
 /**
  * vshTableRowNew:
  * @arg: the first argument.
  * @ap: list of variadic arguments
  *
  * Create a new row in the table. Each argument passed
- * represents a cell in the row.
+ * represents a cell in the row. The cells are encoded and
+ * measured right away, so that printing the table doesn't
+ * need to go through them again.
  *
  * Return: pointer to vshTableRow *row or NULL.
  */
@@ -89,6 +178,7 @@ static vshTableRow *
 vshTableRowNew(const char *arg, va_list ap)
 {
     vshTableRow *row = NULL;
+    size_t nwidths = 0;
 
     if (!arg) {
         virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
@@ -100,9 +190,14 @@ vshTableRowNew(const char *arg, va_list ap)
 
     while (arg) {
         g_autofree char *tmp = NULL;
+        size_t width = 0;
 
-        tmp = g_strdup(arg);
+        /* need to replace nonprintable and control characters,
+         * because width of some of those characters (e.g. \t, \v, \b ...)
+         * cannot be counted properly */
+        tmp = vshTableSafeEncode(arg, &width);
 
+        VIR_APPEND_ELEMENT(row->widths, nwidths, width);
         VIR_APPEND_ELEMENT(row->cells, row->ncells, tmp);
 
         arg = va_arg(ap, const char *);
@@ -140,6 +235,8 @@ vshTableNew(const char *arg, ...)
     if (!header)
         goto error;
 
+    table->maxwidths = g_new0(size_t, header->ncells);
+
     VIR_APPEND_ELEMENT(table->rows, table->nrows, header);
 
     return table;
@@ -151,189 +248,82 @@ vshTableNew(const char *arg, ...)
 
 
 /**
- * vshTableRowAppend:
- * @table: table to append to
- * @arg: cells of the row (NULL terminated)
- *
- * Append new row into the @table. The number of cells in the row has
- * to be equal to the number of cells in the table header.
- *
- * Returns: 0 if succeeded, -1 if failed.
- */
-int
-vshTableRowAppend(vshTable *table, const char *arg, ...)
-{
-    vshTableRow *row = NULL;
-    size_t ncolumns = table->rows[0]->ncells;
-    va_list ap;
-    int ret = -1;
-
-    va_start(ap, arg);
-    row = vshTableRowNew(arg, ap);
-    va_end(ap);
-
-    if (!row)
-        goto cleanup;
-
-    if (ncolumns != row->ncells) {
-        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                       _("Incorrect number of cells in a table row"));
-        goto cleanup;
-    }
-
-    VIR_APPEND_ELEMENT(table->rows, table->nrows, row);
-
-    ret = 0;
- cleanup:
-    vshTableRowFree(row);
-    return ret;
-}
-
-
-/**
- * Function pulled from util-linux
- *
- * Function's name in util-linux: mbs_safe_encode_to_buffer
- *
- * Returns allocated string where all control and non-printable chars are
- * replaced with \x?? hex sequence, or NULL.
+ * vshTableRowPrint:
+ * @row: table to append to
+ * @maxwidths: maximum count of characters for each columns
+ * @buf: buffer to store table (only if @toStdout == true)
  */
-static char *
-vshTableSafeEncode(const char *s, size_t *width)
+static void
+vshTableRowPrint(vshTableRow *row,
+                 size_t *maxwidths,
+                 virBuffer *buf)
 {
-    const char *p = s;
-    size_t sz = s ? strlen(s) : 0;
-    char *buf;
-    char *ret;
-    mbstate_t st;
-
-    memset(&st, 0, sizeof(st));
-
-    buf = g_new0(char, (sz * HEX_ENCODE_LENGTH) + 1);
-
-    ret = buf;
-    *width = 0;
+    size_t i;
+    size_t j;
 
-    while (p && *p) {
-        if ((*p == '\\' && *(p + 1) == 'x') ||
-            g_ascii_iscntrl(*p)) {
-            g_snprintf(buf, HEX_ENCODE_LENGTH + 1, "\\x%02x", *p);
-            buf += HEX_ENCODE_LENGTH;
-            *width += HEX_ENCODE_LENGTH;
-            p++;
-        } else {
-            wchar_t wc;
-            size_t len = mbrtowc(&wc, p, MB_CUR_MAX, &st);
+    for (i = 0; i < row->ncells; i++) {
+        virBufferAsprintf(buf, " %s", row->cells[i]);
 
-            if (len == 0)
-                break;		/* end of string */
+        if (i < (row->ncells - 1)) {
+            /* cells streamed after the widths were fixed may not fit */
+            size_t pad = maxwidths[i] > row->widths[i] ?
+                maxwidths[i] - row->widths[i] : 0;
 
-            if (len == (size_t) -1 || len == (size_t) -2) {
-                len = 1;
-                /*
-                 * Not valid multibyte sequence -- maybe it's
-                 * printable char according to the current locales.
-                 */
-                if (!g_ascii_isprint(*p)) {
-                    g_snprintf(buf, HEX_ENCODE_LENGTH + 1, "\\x%02x", *p);
-                    buf += HEX_ENCODE_LENGTH;
-                    *width += HEX_ENCODE_LENGTH;
-                } else {
-                    *buf++ = *p;
-                    (*width)++;
-                }
-            } else if (!iswprint(wc)) {
-                size_t i;
-                for (i = 0; i < len; i++) {
-                    g_snprintf(buf, HEX_ENCODE_LENGTH + 1, "\\x%02x", p[i]);
-                    buf += HEX_ENCODE_LENGTH;
-                    *width += HEX_ENCODE_LENGTH;
-                }
-            } else {
-                memcpy(buf, p, len);
-                buf += len;
-                *width += g_unichar_iszerowidth(wc) ? 0 : (g_unichar_iswide(wc) ? 2 : 1);
-            }
-            p += len;
+            for (j = 0; j < pad + 2; j++)
+                virBufferAddChar(buf, ' ');
         }
     }
-
-    *buf = '\0';
-    return ret;
+    virBufferAddChar(buf, '\n');
 }
 
 
 /**
  * vshTableGetColumnsWidths:
  * @table: table
- * @maxwidths: maximum count of characters for each columns
- * @widths: count of characters for each cell in the table
+ * @header: whether the header is printed
  *
- * Fill passed @maxwidths and @widths arrays with maximum number
- * of characters for columns and number of character per each
- * table cell, respectively.
- * Handle unicode strings (user must have multibyte locale)
- *
- * Return 0 in case of success, -1 otherwise.
+ * Returns an array with the maximum count of characters of each
+ * column of @table which has to be freed by the caller.
  */
-static int
+static size_t *
 vshTableGetColumnsWidths(vshTable *table,
-                         size_t *maxwidths,
-                         size_t **widths,
                          bool header)
 {
+    vshTableRow *head = table->rows[0];
+    size_t *maxwidths = g_new0(size_t, head->ncells);
     size_t i;
 
-    i = header? 0 : 1;
-    for (; i < table->nrows; i++) {
-        vshTableRow *row = table->rows[i];
-        size_t j;
-
-        for (j = 0; j < row->ncells; j++) {
-            size_t size = 0;
-            /* need to replace nonprintable and control characters,
-             * because width of some of those characters (e.g. \t, \v, \b ...)
-             * cannot be counted properly */
-            char *tmp = vshTableSafeEncode(row->cells[j], &size);
-            if (!tmp)
-                return -1;
-
-            VIR_FREE(row->cells[j]);
-            row->cells[j] = tmp;
-            widths[i][j] = size;
-
-            if (widths[i][j] > maxwidths[j])
-                maxwidths[j] = widths[i][j];
-        }
+    for (i = 0; i < head->ncells; i++) {
+        maxwidths[i] = table->maxwidths[i];
+
+        if (header && head->widths[i] > maxwidths[i])
+            maxwidths[i] = head->widths[i];
     }
 
-    return 0;
+    return maxwidths;
 }
 
 
 /**
- * vshTableRowPrint:
- * @row: table to append to
+ * vshTablePrintHeader:
+ * @table: table to print
  * @maxwidths: maximum count of characters for each columns
- * @widths: count of character for each cell in this row
- * @buf: buffer to store table (only if @toStdout == true)
+ * @buf: buffer to print to
  */
 static void
-vshTableRowPrint(vshTableRow *row,
-                 size_t *maxwidths,
-                 size_t *widths,
-                 virBuffer *buf)
+vshTablePrintHeader(vshTable *table,
+                    size_t *maxwidths,
+                    virBuffer *buf)
 {
     size_t i;
     size_t j;
 
-    for (i = 0; i < row->ncells; i++) {
-        virBufferAsprintf(buf, " %s", row->cells[i]);
+    vshTableRowPrint(table->rows[0], maxwidths, buf);
 
-        if (i < (row->ncells - 1)) {
-            for (j = 0; j < maxwidths[i] - widths[i] + 2; j++)
-                virBufferAddChar(buf, ' ');
-        }
+    /* print dividing line  */
+    for (i = 0; i < table->rows[0]->ncells; i++) {
+        for (j = 0; j < maxwidths[i] + 3; j++)
+            virBufferAddChar(buf, '-');
     }
     virBufferAddChar(buf, '\n');
 }
@@ -345,10 +335,9 @@ vshTableRowPrint(vshTableRow *row,
  * @header: whetever to print to header (true) or not (false)
  * this argument is relevant only if @ctl == NULL
  *
- * Get table. To get an alignment of columns right, function
- * fills 2d array @widths with count of characters in each cell and
- * array @maxwidths maximum count of character in each column.
- * Function then prints tables header and content.
+ * Get table. The widths of the cells are computed as the rows are
+ * appended, so this only pads each cell to the width of its column.
+ * The header is not printed again if the table is being streamed.
  *
  * Return string containing table, or NULL
  */
@@ -356,48 +345,193 @@ static char *
 vshTablePrint(vshTable *table, bool header)
 {
     size_t i;
-    size_t j;
     g_autofree size_t *maxwidths = NULL;
-    size_t **widths;
+    size_t *widths = table->maxwidths;
     g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
-    char *ret = NULL;
 
-    maxwidths = g_new0(size_t, table->rows[0]->ncells);
+    if (!table->streaming) {
+        widths = maxwidths = vshTableGetColumnsWidths(table, header);
 
-    widths = g_new0(size_t *, table->nrows);
+        if (header)
+            vshTablePrintHeader(table, widths, &buf);
+    }
 
-    /* retrieve widths of columns */
-    for (i = 0; i < table->nrows; i++)
-        widths[i] = g_new0(size_t, table->rows[0]->ncells);
+    /* print content */
+    for (i = 1; i < table->nrows; i++)
+        vshTableRowPrint(table->rows[i], widths, &buf);
 
-    if (vshTableGetColumnsWidths(table, maxwidths, widths, header) < 0)
-        goto cleanup;
+    return virBufferContentAndReset(&buf);
+}
 
-    if (header) {
-        /* print header */
-        vshTableRowPrint(table->rows[0], maxwidths, widths[0], &buf);
 
-        /* print dividing line  */
-        for (i = 0; i < table->rows[0]->ncells; i++) {
-            for (j = 0; j < maxwidths[i] + 3; j++)
-                virBufferAddChar(&buf, '-');
-        }
-        virBufferAddChar(&buf, '\n');
+/**
+ * vshTableFlush:
+ * @table: table being streamed
+ *
+ * Passes all rows of @table not printed yet to the stream function, along
+ * with the header if it wasn't printed yet, and drops them from @table.
+ * From now on, the widths of the columns are fixed.
+ */
+static void
+vshTableFlush(vshTable *table)
+{
+    g_autofree char *out = vshTablePrint(table, table->streamHeader);
+    size_t i;
+
+    if (!table->streaming) {
+        g_autofree size_t *maxwidths = NULL;
+
+        maxwidths = vshTableGetColumnsWidths(table, table->streamHeader);
+        memcpy(table->maxwidths, maxwidths,
+               sizeof(size_t) * table->rows[0]->ncells);
+        table->streaming = true;
     }
-    /* print content */
+
+    if (out && *out)
+        table->streamFunc(out, table->streamOpaque);
+
     for (i = 1; i < table->nrows; i++)
-        vshTableRowPrint(table->rows[i], maxwidths, widths[i], &buf);
+        vshTableRowFree(table->rows[i]);
+    table->nrows = 1;
+}
 
-    ret = virBufferContentAndReset(&buf);
 
+/**
+ * vshTableRowAppend:
+ * @table: table to append to
+ * @arg: cells of the row (NULL terminated)
+ *
+ * Append new row into the @table. The number of cells in the row has
+ * to be equal to the number of cells in the table header. If @table
+ * is being streamed and its column widths are fixed already, the row
+ * is printed right away instead.
+ *
+ * Returns: 0 if succeeded, -1 if failed.
+ */
+int
+vshTableRowAppend(vshTable *table, const char *arg, ...)
+{
+    vshTableRow *row = NULL;
+    size_t ncolumns = table->rows[0]->ncells;
+    va_list ap;
+    size_t i;
+    int ret = -1;
+
+    va_start(ap, arg);
+    row = vshTableRowNew(arg, ap);
+    va_end(ap);
+
+    if (!row)
+        goto cleanup;
+
+    if (ncolumns != row->ncells) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("Incorrect number of cells in a table row"));
+        goto cleanup;
+    }
+
+    if (table->streaming) {
+        g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+        g_autofree char *out = NULL;
+
+        vshTableRowPrint(row, table->maxwidths, &buf);
+        out = virBufferContentAndReset(&buf);
+        table->streamFunc(out, table->streamOpaque);
+
+        ret = 0;
+        goto cleanup;
+    }
+
+    for (i = 0; i < ncolumns; i++) {
+        if (row->widths[i] > table->maxwidths[i])
+            table->maxwidths[i] = row->widths[i];
+    }
+
+    VIR_APPEND_ELEMENT(table->rows, table->nrows, row);
+
+    if (table->streamFunc && table->nrows > table->streamSample)
+        vshTableFlush(table);
+
+    ret = 0;
  cleanup:
-    for (i = 0; i < table->nrows; i++)
-        VIR_FREE(widths[i]);
-    VIR_FREE(widths);
+    vshTableRowFree(row);
     return ret;
 }
 
 
+/**
+ * vshTableStream:
+ * @table: table to stream
+ * @sample: number of rows to base the column widths on
+ * @header: whether to print the header
+ * @func: function to pass the printed rows to
+ * @opaque: opaque data for @func
+ *
+ * Switches @table to the streaming mode. The first @sample rows appended
+ * to @table are kept to find out the widths of the columns as usual. Once
+ * there are more of them, they are printed and any further rows are
+ * printed as they are appended, so that huge tables don't have to be held
+ * in memory. Cells that don't fit into the widths found are not truncated,
+ * just the rest of their row is shifted. Call vshTableStreamEnd() to print
+ * the rows which are left once all of them are appended.
+ */
+void
+vshTableStream(vshTable *table,
+               size_t sample,
+               bool header,
+               vshTableStreamFunc func,
+               void *opaque)
+{
+    table->streamSample = sample;
+    table->streamHeader = header;
+    table->streamFunc = func;
+    table->streamOpaque = opaque;
+}
+
+
+/**
+ * vshTableStreamEnd:
+ * @table: table being streamed
+ *
+ * Prints the rows of @table which were not printed yet.
+ */
+void
+vshTableStreamEnd(vshTable *table)
+{
+    if (table->streamFunc)
+        vshTableFlush(table);
+}
+
+
+static void
+vshTableStreamToStdoutFunc(const char *str,
+                           void *opaque)
+{
+    vshControl *ctl = opaque;
+
+    vshPrint(ctl, "%s", str);
+}
+
+
+/**
+ * vshTableStreamToStdout:
+ * @table: table to stream
+ * @ctl virtshell control structure
+ * @sample: number of rows to base the column widths on
+ *
+ * Streams @table to stdout, see vshTableStream(). The rows which are left
+ * are printed by vshTablePrintToStdout().
+ */
+void
+vshTableStreamToStdout(vshTable *table,
+                       vshControl *ctl,
+                       size_t sample)
+{
+    vshTableStream(table, sample, ctl ? !ctl->quiet : true,
+                   vshTableStreamToStdoutFunc, ctl);
+}
+
+
 /**
  * vshTablePrintToStdout:
  * @table: table to print
@@ -413,6 +547,11 @@ vshTablePrintToStdout(vshTable *table, vshControl *ctl)
     bool header;
     g_autofree char *out = NULL;
 
+    if (table->streamFunc) {
+        vshTableStreamEnd(table);
+        return;
+    }
+
     header = ctl ? !ctl->quiet : true;
 
     out = vshTablePrintToString(table, header);
@@ -24,6 +24,11 @@
 
 typedef struct _vshTable vshTable;
 
+/* Number of rows the column widths of streamed tables are based on */
+#define VSH_TABLE_STREAM_SAMPLE 1000
+
+typedef void (*vshTableStreamFunc)(const char *str, void *opaque);
+
 void
 vshTableFree(vshTable *table);
 G_DEFINE_AUTOPTR_CLEANUP_FUNC(vshTable, vshTableFree);
@@ -36,6 +41,21 @@ int
 vshTableRowAppend(vshTable *table, const char *arg, ...)
     G_GNUC_NULL_TERMINATED;
 
+void
+vshTableStream(vshTable *table,
+               size_t sample,
+               bool header,
+               vshTableStreamFunc func,
+               void *opaque);
+
+void
+vshTableStreamEnd(vshTable *table);
+
+void
+vshTableStreamToStdout(vshTable *table,
+                       vshControl *ctl,
+                       size_t sample);
+
 void
 vshTablePrintToStdout(vshTable *table, vshControl *ctl);
 
@@ -156,7 +156,60 @@ vshStringToArray(const char *str,
     return ntoks;
 }
 
-virErrorPtr last_error;
+/*
+ * Commands are run by the main thread, unless vshCommandRun runs them
+ * concurrently. Each of the worker threads has its own error and captures
+ * the output of the command it runs, so that it can be printed in the order
+ * the commands were given.
+ */
+typedef struct _vshThreadState vshThreadState;
+struct _vshThreadState {
+    virErrorPtr lastError;
+    virBuffer *out;             /* captured stdout, or NULL */
+    virBuffer *err;             /* captured stderr, or NULL */
+};
+
+static vshThreadState vshMainThreadState;
+static virThreadLocal vshThreadStateLocal;
+static bool vshThreadStateLocalReady;
+
+static vshThreadState *
+vshGetThreadState(void)
+{
+    vshThreadState *state = NULL;
+
+    if (vshThreadStateLocalReady)
+        state = virThreadLocalGet(&vshThreadStateLocal);
+
+    return state ? state : &vshMainThreadState;
+}
+
+
+virErrorPtr *
+vshLastErrorPtr(void)
+{
+    return &vshGetThreadState()->lastError;
+}
+
+
+/*
+ * Print @str to @stream, unless the output of the calling thread is
+ * being captured.
+ */
+static void
+vshOutput(FILE *stream, const char *str)
+{
+    vshThreadState *state = vshGetThreadState();
+    virBuffer *buf = stream == stdout ? state->out : state->err;
+
+    if (buf) {
+        virBufferAdd(buf, str, -1);
+        return;
+    }
+
+    fputs(str, stream);
+    fflush(stream);
+}
 
 /*
  * Quieten libvirt until we're done with the command.
@@ -1289,54 +1342,285 @@ vshBlockJobOptionBandwidth(vshControl *ctl,
 
 
 /*
- * Executes command(s) and returns return code from last command
+ * Executes a single command. If @checkConn is false, the connection was
+ * already checked by the caller.
  */
-bool
-vshCommandRun(vshControl *ctl, const vshCmd *cmd)
+static bool
+vshCommandRunOne(vshControl *ctl, const vshCmd *cmd, bool checkConn)
+{
+    const vshClientHooks *hooks = ctl->hooks;
+    gint64 before, after;
+    bool enable_timing = ctl->timing;
+    bool ret;
+
+    before = g_get_real_time();
+
+    if ((cmd->def->flags & VSH_CMD_FLAG_NOCONNECT) || !checkConn ||
+        (hooks && hooks->connHandler && hooks->connHandler(ctl))) {
+        ret = cmd->def->handler(ctl, cmd);
+    } else {
+        /* connection is not usable, return error */
+        ret = false;
+    }
+
+    after = g_get_real_time();
+
+    /* try to automatically catch disconnections */
+    if (!ret &&
+        ((last_error != NULL) &&
+         (((last_error->code == VIR_ERR_SYSTEM_ERROR) &&
+           (last_error->domain == VIR_FROM_REMOTE)) ||
+          (last_error->code == VIR_ERR_RPC) ||
+          (last_error->code == VIR_ERR_NO_CONNECT) ||
+          (last_error->code == VIR_ERR_INVALID_CONN))))
+        g_atomic_int_inc(&disconnected);
+
+    if (!ret)
+        vshReportError(ctl);
+
+    if (STREQ(cmd->def->name, "quit") ||
+        STREQ(cmd->def->name, "exit"))        /* hack ... */
+        return ret;
+
+    if (enable_timing) {
+        double diff_ms = (after - before) / 1000.0;
+
+        vshPrint(ctl, _("\n(Time: %.3f ms)\n\n"), diff_ms);
+    } else {
+        vshPrintExtra(ctl, "\n");
+    }
+
+    return ret;
+}
+
+
+/*
+ * Consecutive commands flagged with VSH_CMD_FLAG_PARALLEL are run by a pool
+ * of ctl->jobs worker threads. Commands working on the same domain form a
+ * chain which is run by a single worker in the order the commands were
+ * given, so only commands on different domains overlap. The main thread
+ * prints the captured output of each command as soon as it and all the
+ * commands preceding it are finished.
+ */
+typedef struct _vshCommandJob vshCommandJob;
+struct _vshCommandJob {
+    const vshCmd *cmd;
+    vshCommandJob *next;        /* next command of the chain */
+    bool head;                  /* first command of a chain */
+    virBuffer out;
+    virBuffer err;
+    bool ret;
+    bool done;
+};
+
+typedef struct _vshCommandBatch vshCommandBatch;
+struct _vshCommandBatch {
+    vshControl *ctl;
+    virMutex lock;
+    virCond cond;
+    vshCommandJob *jobs;
+    size_t njobs;
+    size_t next;                /* next job to be picked by a worker */
+};
+
+
+static bool
+vshCommandIsParallel(const vshCmd *cmd)
+{
+    return cmd && (cmd->def->flags & VSH_CMD_FLAG_PARALLEL);
+}
+
+
+/* Commands with the same key must not run concurrently */
+static const char *
+vshCommandGetKey(const vshCmd *cmd)
+{
+    const vshCmdOpt *opt;
+
+    for (opt = cmd->opts; opt; opt = opt->next) {
+        if (STREQ(opt->def->name, "domain"))
+            return opt->data;
+    }
+
+    return NULL;
+}
+
+
+static void
+vshCommandBatchWorker(void *opaque)
+{
+    vshCommandBatch *batch = opaque;
+    vshThreadState state = { 0 };
+
+    if (virThreadLocalSet(&vshThreadStateLocal, &state) < 0)
+        return;
+
+    while (true) {
+        vshCommandJob *job = NULL;
+
+        VIR_WITH_MUTEX_LOCK_GUARD(&batch->lock) {
+            while (batch->next < batch->njobs && !batch->jobs[batch->next].head)
+                batch->next++;
+
+            if (batch->next < batch->njobs)
+                job = &batch->jobs[batch->next++];
+        }
+
+        if (!job)
+            break;
+
+        for (; job; job = job->next) {
+            state.out = &job->out;
+            state.err = &job->err;
+
+            job->ret = vshCommandRunOne(batch->ctl, job->cmd, false);
+
+            VIR_WITH_MUTEX_LOCK_GUARD(&batch->lock) {
+                job->done = true;
+                virCondBroadcast(&batch->cond);
+            }
+        }
+    }
+
+    virFreeError(state.lastError);
+    ignore_value(virThreadLocalSet(&vshThreadStateLocal, NULL));
+}
+
+
+/*
+ * Runs the commands starting at @cmd that may run concurrently and moves
+ * @cmd past them. Returns the return code of the last command.
+ */
+static bool
+vshCommandRunParallel(vshControl *ctl, const vshCmd **cmd)
 {
     const vshClientHooks *hooks = ctl->hooks;
+    vshCommandBatch batch = { .ctl = ctl };
+    g_autoptr(GHashTable) chains = NULL;
+    g_autofree virThread *threads = NULL;
+    size_t nthreads = 0;
+    size_t nheads = 0;
+    const vshCmd *tmp;
     bool ret = true;
+    size_t i;
 
-    while (cmd) {
-        gint64 before, after;
-        bool enable_timing = ctl->timing;
+    /* Connect once up front rather than from the workers. If that fails,
+     * just run the first command to get the error reported. */
+    if (!hooks || !hooks->connHandler || !hooks->connHandler(ctl)) {
+        ret = vshCommandRunOne(ctl, *cmd, true);
+        *cmd = (*cmd)->next;
+        return ret;
+    }
+
+    for (tmp = *cmd; vshCommandIsParallel(tmp); tmp = tmp->next)
+        batch.njobs++;
+
+    batch.jobs = g_new0(vshCommandJob, batch.njobs);
+    chains = g_hash_table_new(g_str_hash, g_str_equal);
+
+    for (i = 0, tmp = *cmd; i < batch.njobs; i++, tmp = tmp->next) {
+        vshCommandJob *job = &batch.jobs[i];
+        const char *key = vshCommandGetKey(tmp);
+        vshCommandJob *prev = NULL;
 
-        before = g_get_real_time();
+        job->cmd = tmp;
 
-        if ((cmd->def->flags & VSH_CMD_FLAG_NOCONNECT) ||
-            (hooks && hooks->connHandler && hooks->connHandler(ctl))) {
-            ret = cmd->def->handler(ctl, cmd);
+        if (key && (prev = g_hash_table_lookup(chains, key))) {
+            prev->next = job;
         } else {
-            /* connection is not usable, return error */
-            ret = false;
+            job->head = true;
+            nheads++;
         }
 
-        after = g_get_real_time();
+        if (key)
+            g_hash_table_insert(chains, (char *) key, job);
+    }
 
-        /* try to automatically catch disconnections */
-        if (!ret &&
-            ((last_error != NULL) &&
-             (((last_error->code == VIR_ERR_SYSTEM_ERROR) &&
-               (last_error->domain == VIR_FROM_REMOTE)) ||
-              (last_error->code == VIR_ERR_RPC) ||
-              (last_error->code == VIR_ERR_NO_CONNECT) ||
-              (last_error->code == VIR_ERR_INVALID_CONN))))
-            disconnected++;
+    if (virMutexInit(&batch.lock) < 0) {
+        vshError(ctl, "%s", _("Failed to initialize mutex"));
+        ret = false;
+        goto cleanup;
+    }
 
-        if (!ret)
-            vshReportError(ctl);
+    if (virCondInit(&batch.cond) < 0) {
+        vshError(ctl, "%s", _("Failed to initialize condition"));
+        virMutexDestroy(&batch.lock);
+        ret = false;
+        goto cleanup;
+    }
+
+    threads = g_new0(virThread, MIN(ctl->jobs, nheads));
+    for (nthreads = 0; nthreads < MIN(ctl->jobs, nheads); nthreads++) {
+        if (virThreadCreateFull(&threads[nthreads], true, vshCommandBatchWorker,
+                                "vsh-batch", false, &batch) < 0)
+            break;
+    }
+
+    if (nthreads == 0) {
+        /* run everything here if no worker could be started */
+        vshCommandBatchWorker(&batch);
+    }
+
+    for (i = 0; i < batch.njobs; i++) {
+        vshCommandJob *job = &batch.jobs[i];
+
+        VIR_WITH_MUTEX_LOCK_GUARD(&batch.lock) {
+            while (!job->done)
+                ignore_value(virCondWait(&batch.cond, &batch.lock));
+        }
+
+        if (virBufferUse(&job->out) > 0) {
+            fputs(virBufferCurrentContent(&job->out), stdout);
+            fflush(stdout);
+        }
+
+        if (virBufferUse(&job->err) > 0) {
+            fputs(virBufferCurrentContent(&job->err), stderr);
+            fflush(stderr);
+        }
+
+        ret = job->ret;
+    }
+
+    for (i = 0; i < nthreads; i++)
+        virThreadJoin(&threads[i]);
+
+    virCondDestroy(&batch.cond);
+    virMutexDestroy(&batch.lock);
+
+ cleanup:
+    for (i = 0; i < batch.njobs; i++) {
+        virBufferFreeAndReset(&batch.jobs[i].out);
+        virBufferFreeAndReset(&batch.jobs[i].err);
+    }
+    g_free(batch.jobs);
+
+    *cmd = tmp;
+    return ret;
+}
+
+
+/*
+ * Executes command(s) and returns return code from last command
+ */
+bool
+vshCommandRun(vshControl *ctl, const vshCmd *cmd)
+{
+    bool ret = true;
+
+    while (cmd) {
+        if (ctl->jobs > 1 &&
+            vshCommandIsParallel(cmd) && vshCommandIsParallel(cmd->next)) {
+            ret = vshCommandRunParallel(ctl, &cmd);
+            continue;
+        }
+
+        ret = vshCommandRunOne(ctl, cmd, true);
 
         if (STREQ(cmd->def->name, "quit") ||
             STREQ(cmd->def->name, "exit"))        /* hack ... */
             return ret;
 
-        if (enable_timing) {
-            double diff_ms = (after - before) / 1000.0;
-
-            vshPrint(ctl, _("\n(Time: %.3f ms)\n\n"), diff_ms);
-        } else {
-            vshPrintExtra(ctl, "\n");
-        }
         cmd = cmd->next;
     }
     return ret;
@@ -1862,8 +2146,7 @@ vshDebug(vshControl *ctl, int level, const char *format, ...)
     va_start(ap, format);
     str = g_strdup_vprintf(format, ap);
     va_end(ap);
-    fputs(str, stdout);
-    fflush(stdout);
+    vshOutput(stdout, str);
 }
 
 void
@@ -1878,8 +2161,7 @@ vshPrintExtra(vshControl *ctl, const char *format, ...)
     va_start(ap, format);
     str = g_strdup_vprintf(format, ap);
     va_end(ap);
-    fputs(str, stdout);
-    fflush(stdout);
+    vshOutput(stdout, str);
 }
 
 
@@ -1892,8 +2174,7 @@ vshPrint(vshControl *ctl G_GNUC_UNUSED, const char *format, ...)
     va_start(ap, format);
     str = g_strdup_vprintf(format, ap);
     va_end(ap);
-    fputs(str, stdout);
-    fflush(stdout);
+    vshOutput(stdout, str);
 }
 
 
@@ -1993,6 +2274,7 @@ vshError(vshControl *ctl, const char *format, ...)
 {
     va_list ap;
     g_autofree char *str = NULL;
+    virBuffer *buf;
 
     if (ctl != NULL) {
         va_start(ap, format);
@@ -2000,16 +2282,21 @@ vshError(vshControl *ctl, const char *format, ...)
         va_end(ap);
     }
 
+    va_start(ap, format);
+    str = g_strdup_vprintf(format, ap);
+    va_end(ap);
+
+    if ((buf = vshGetThreadState()->err)) {
+        virBufferAsprintf(buf, "%s%s\n", _("error: "), NULLSTR(str));
+        return;
+    }
+
     /* Most output is to stdout, but if someone ran virsh 2>&1, then
      * printing to stderr will not interleave correctly with stdout
      * unless we flush between every transition between streams.  */
     fflush(stdout);
     fputs(_("error: "), stderr);
 
-    va_start(ap, format);
-    str = g_strdup_vprintf(format, ap);
-    va_end(ap);
-
     fprintf(stderr, "%s\n", NULLSTR(str));
     fflush(stderr);
 }
@@ -3021,6 +3308,12 @@ vshInit(vshControl *ctl, const vshCmdGrp *groups, const vshCmdDef *set)
     cmdGroups = groups;
     cmdSet = set;
 
+    if (virThreadLocalInit(&vshThreadStateLocal, NULL) < 0) {
+        vshError(ctl, "%s", _("Failed to initialize thread local storage"));
+        return false;
+    }
+    vshThreadStateLocalReady = true;
+
     if (vshInitDebug(ctl) < 0 ||
         (ctl->imode && vshReadlineInit(ctl) < 0))
         return false;
@@ -164,6 +164,7 @@ enum {
     VSH_CMD_FLAG_NOCONNECT = (1 << 0),  /* no prior connection needed */
     VSH_CMD_FLAG_ALIAS     = (1 << 1),  /* command is an alias */
     VSH_CMD_FLAG_HIDDEN    = (1 << 2),  /* command is hidden/internal */
+    VSH_CMD_FLAG_PARALLEL  = (1 << 3),  /* command may run concurrently */
 };
 
 /*
@@ -203,6 +204,7 @@ struct _vshControl {
     bool imode;                 /* interactive mode? */
     bool quiet;                 /* quiet mode */
     bool timing;                /* print timing info? */
+    unsigned int jobs;          /* max number of commands run concurrently */
     int debug;                  /* print debug messages? */
     char *logfile;              /* log file name */
     int log_fd;                 /* log file descriptor */
@@ -333,7 +335,8 @@ int vshTreePrint(vshControl *ctl, vshTreeLookup lookup, void *opaque,
                  int num_devices, int devid);
 
 /* error handling */
-extern virErrorPtr last_error;
+virErrorPtr *vshLastErrorPtr(void);
+#define last_error (*vshLastErrorPtr())
 void vshErrorHandler(void *opaque, virErrorPtr error);
 void vshReportError(vshControl *ctl);
 void vshResetLibvirtError(void);